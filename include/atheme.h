@@ -19,7 +19,9 @@
 #include <atheme/base64.h>
 #include <atheme/bcrypt.h>
 #include <atheme/botserv.h>
+#include <atheme/capture.h>
 #include <atheme/channels.h>
+#include <atheme/clones.h>
 #include <atheme/commandhelp.h>
 #include <atheme/commandtree.h>
 #include <atheme/common.h>
@@ -31,9 +33,11 @@
 #include <atheme/culture.h>
 #include <atheme/database_backend.h>
 #include <atheme/datastream.h>
+#include <atheme/delivery.h>
 #include <atheme/digest.h>
 #include <atheme/entity.h>
 #include <atheme/entity-validation.h>
+#include <atheme/expiry.h>
 #include <atheme/flags.h>
 #include <atheme/global.h>
 #include <atheme/hook.h>
@@ -42,15 +46,21 @@
 #include <atheme/i18n.h>
 #include <atheme/inline.h>
 #include <atheme/linker.h>
+#include <atheme/logindex.h>
+#include <atheme/mailqueue.h>
 #include <atheme/match.h>
 #include <atheme/memory.h>
+#include <atheme/memostore.h>
 #include <atheme/module.h>
+#include <atheme/namehash.h>
+#include <atheme/netstats.h>
 #include <atheme/object.h>
 #include <atheme/pbkdf2.h>
 #include <atheme/phandler.h>
 #include <atheme/pmodule.h>
 #include <atheme/privs.h>
 #include <atheme/random.h>
+#include <atheme/ratelimit.h>
 #include <atheme/sasl.h>
 #include <atheme/scrypt.h>
 #include <atheme/serno.h>
@@ -59,15 +69,22 @@
 #include <atheme/servtree.h>
 #include <atheme/sharedheap.h>
 #include <atheme/sourceinfo.h>
+#include <atheme/startup.h>
 #include <atheme/stdheaders.h>
 #include <atheme/string.h>
 #include <atheme/structures.h>
 #include <atheme/table.h>
 #include <atheme/taint.h>
 #include <atheme/template.h>
+#include <atheme/timer.h>
+#include <atheme/timerwheel.h>
 #include <atheme/tools.h>
+#include <atheme/trace.h>
 #include <atheme/uid.h>
 #include <atheme/uplink.h>
 #include <atheme/users.h>
+#include <atheme/userscan.h>
+#include <atheme/warmimage.h>
+#include <atheme/worldsnap.h>
 
 #endif /* !ATHEME_INC_ATHEME_H */
@@ -12,9 +12,12 @@
 
 #include <atheme/attributes.h>
 #include <atheme/entity.h>
+#include <atheme/expiry.h>
+#include <atheme/match.h>
 #include <atheme/object.h>
 #include <atheme/stdheaders.h>
 #include <atheme/structures.h>
+#include <atheme/timerwheel.h>
 
 /* kline list struct */
 struct kline
@@ -27,6 +30,37 @@ struct kline
 	long            duration;
 	time_t          settime;
 	time_t          expires;
+
+	// Lookup index linkage; managed by libathemecore/node.c
+	struct match_pattern *  userpat;
+	struct match_pattern *  hostpat;
+	unsigned long           serial;
+	mowgli_node_t           hostnode;
+	mowgli_node_t           cidrnode;
+
+	struct timerwheel_entry expire_timer;
+	struct cidr_tree_node * cidrleaf;
+
+	// Waiting to be sent to the network; see kline_add_bulk()
+	mowgli_node_t           propnode;
+	bool                    propagating;
+};
+
+// For kline_add_bulk()
+struct kline_mask
+{
+	const char *            user;
+	const char *            host;
+};
+
+// Lookup index linkage for xlines and qlines; managed by libathemecore/node.c
+struct mask_index_entry
+{
+	void *                  owner;
+	unsigned long           serial;
+	unsigned int            prefixlen;      // of a prefix* mask, or 0
+	mowgli_node_t           exactnode;
+	mowgli_node_t           matchnode;
 };
 
 /* xline list struct */
@@ -39,6 +73,10 @@ struct xline
 	long            duration;
 	time_t          settime;
 	time_t          expires;
+
+	struct match_pattern *  realnamepat;
+	struct timerwheel_entry expire_timer;
+	struct mask_index_entry index;
 };
 
 /* qline list struct */
@@ -51,6 +89,10 @@ struct qline
 	long            duration;
 	time_t          settime;
 	time_t          expires;
+
+	struct match_pattern *  maskpat;
+	struct timerwheel_entry expire_timer;
+	struct mask_index_entry index;
 };
 
 /* services ignore struct */
@@ -61,6 +103,14 @@ struct svsignore
 	time_t                  settime;
 	char *                  setby;
 	char *                  reason;
+	struct match_pattern *  maskpat;
+
+	// Lookup index linkage; managed by libathemecore/svsignore.c
+	struct match_pattern *  nickpat;        // nick!user@host parts, when the mask has them
+	struct match_pattern *  userpat;
+	struct match_pattern *  hostpat;
+	char *                  hostkey;        // host index bucket, or NULL if matched the slow way
+	mowgli_node_t           indexnode;
 };
 
 /* services accounts */
@@ -79,11 +129,25 @@ struct myuser
 	unsigned int            memoct_new;
 	unsigned int            memo_ratelimit_num;     // memos sent recently
 	time_t                  memo_ratelimit_time;    // last time a memo was sent
-	mowgli_list_t           memo_ignores;
+	mowgli_list_t           memo_ignores;           // 'struct memo_ignore's, in the order they were added
+	mowgli_list_t           memo_ignored_by;        // 'struct memo_ignore's naming this account
 	mowgli_list_t           access_list;
 	mowgli_list_t           nicks;                  // registered nicks, must include mu->name if nonempty
 	struct language *       language;
 	mowgli_list_t           cert_fingerprints;
+	struct expiry_timer     expiry;
+	mowgli_list_t           authcookies;            // 'struct authcookie's for remote logins
+	mowgli_node_t           email_node;             // for myuser_email_accounts() of email_canonical
+};
+
+// An account ignoring memos from another; managed by libathemecore/memoignore.c
+struct memo_ignore
+{
+	struct myuser *         owner;
+	struct myuser *         target;
+	mowgli_node_t           node;           // for struct myuser -> memo_ignores
+	mowgli_node_t           tnode;          // for struct myuser -> memo_ignored_by
+	mowgli_node_t           hnode;          // in its hash table bucket
 };
 
 /* Keep this synchronized with mu_flags in libathemecore/flags.c */
@@ -120,6 +184,7 @@ struct mynick
 	time_t                  registered;
 	time_t                  lastseen;
 	mowgli_node_t           node;   // for struct myuser -> nicks
+	struct expiry_timer     expiry;
 };
 
 /* record about a name that used to exist */
@@ -136,19 +201,65 @@ struct mycertfp
 	mowgli_node_t   node;
 };
 
+// Defined by chanserv/antiflood
+struct antiflood_ring;
+
+// The mode lock as last rendered, and what it was rendered from
+struct mlock_cache
+{
+	unsigned int    on;
+	unsigned int    off;
+	unsigned int    limit;
+	bool            key;
+	char *          ext;            // private:mlockext, or NULL
+	char *          mlock;          // mychan_get_mlock(), or NULL until asked for
+	char *          sts_mlock;      // mychan_get_sts_mlock(), likewise
+};
+
+// How many of a channel's access entries have a given level
+struct chanacs_level_count
+{
+	unsigned int            level;
+	unsigned int            count;
+};
+
+/* Kept up to date as entries are linked, unlinked and their levels changed
+ * (by chanacs_set_level()), so that CS COUNT and the like need not walk the
+ * access list.
+ */
+struct chanacs_counts
+{
+	unsigned int            flags[32];              // entries with each bit of the level set
+	struct chanacs_level_count *levels;             // entries with each distinct level
+	unsigned int            nlevels;
+	unsigned int            levels_size;
+};
+
 struct mychan
 {
 	struct atheme_object    parent;
 	stringref               name;
 	struct channel *        chan;
 	mowgli_list_t           chanacs;
+	struct chanacs **       chanacs_index;          // user entries by entity pointer
+	unsigned int            chanacs_index_size;
+	unsigned int            chanacs_index_count;
+	mowgli_list_t           chanacs_indirect;       // host, group and exttarget entries
+	unsigned int            chanacs_dynamic;        // how many of those are exttargets
+	unsigned int            chanacs_host_count;     // how many of those are hostmasks
+	mowgli_patricia_t *     chanacs_hosts;          // hostmasks by literal host part, long lists only
+	mowgli_list_t           chanacs_hostmasks;      // hostmasks with wildcards in the host part, likewise
+	struct chanacs_counts * chanacs_counts;         // NULL while the access list is empty
 	time_t                  registered;
 	time_t                  used;
 	unsigned int            mlock_on;
 	unsigned int            mlock_off;
 	unsigned int            mlock_limit;
 	char *                  mlock_key;
+	struct mlock_cache *    mlock_cache;
 	unsigned int            flags;
+	struct expiry_timer     expiry;
+	struct antiflood_ring * flood_ring;             // recent lines, if chanserv/antiflood saw any
 };
 
 /* Keep this synchronized with mc_flags in libathemecore/flags.c */
@@ -182,13 +293,27 @@ struct chanacs
 	struct myentity *       entity;
 	struct mychan *         mychan;
 	char *                  host;
-	unsigned int            level;
+	unsigned int            level;                  // change with chanacs_set_level()
 	time_t                  tmodified;
 	mowgli_node_t           cnode;
 	mowgli_node_t           unode;
+	mowgli_node_t           inode;                  // for mychan -> chanacs_indirect
+	mowgli_node_t           hnode;                  // for mychan -> chanacs_hostmasks
+	struct chanacs *        host_next;              // same host part, in mychan -> chanacs_hosts
+	struct cidr_addr        cidr;                   // host part of a CIDR hostmask, family 0 if not one
 	char                    setter_uid[IDLEN + 1];
 };
 
+// One entry of an access list given to chanacs_replace(): for an entity, or failing that a hostmask
+struct chanacs_import
+{
+	struct myentity *       entity;
+	const char *            host;
+	unsigned int            level;
+	time_t                  tmodified;
+	struct myentity *       setter;
+};
+
 /* the new atheme-style channel flags */
 #define CA_VOICE         0x00000001U /* Ability to use voice/devoice command. */
 #define CA_AUTOVOICE     0x00000002U /* Gain voice automatically upon entry. */
@@ -244,6 +369,13 @@ struct chanacs
 #define SHRIKE_CA_FOUNDER       0x00000010U
 #define SHRIKE_CA_SUCCESSOR     0x00000020U
 
+// An account that is in a group, directly or through nested groups
+struct mygroup_member
+{
+	struct myentity *       mt;
+	unsigned int            flags;  // of the entries naming it, ORed together
+};
+
 struct mygroup
 {
 	struct myentity ent;
@@ -251,6 +383,12 @@ struct mygroup
 	time_t          regtime;
 	unsigned int    flags;
 	bool            visited;
+
+	// built from acs on demand by groupserv/main, see groupacs_find()
+	struct mygroup_member * members;
+	unsigned int            members_size;
+	unsigned int            members_count;
+	unsigned int            members_gen;
 };
 
 #define MG_REGNOLIMIT		0x00000001U
@@ -284,9 +422,12 @@ struct groupacs
 struct mymemo
 {
 	char            sender[NICKLEN + 1];
-	char            text[MEMOLEN + 1];
+	char *          text;           // NULL if it is in the memo store; see memo_text()
 	time_t          sent;
 	unsigned int    status;
+	unsigned int    store_len;      // length of its record in the memo store, or 0
+	uint64_t        store_offset;
+	mowgli_node_t   node;           // for struct myuser -> memos
 };
 
 /* memo status flags */
@@ -298,8 +439,8 @@ extern bool backend_loaded;
 
 /* dbhandler.c */
 /* BLOCKING:     wait for the write to finish; cancel previous write if necessary
- * BG_REGULAR:   try to fork, no-op if a previous write is still in progress
- * BG_IMPORTANT: try to fork, canceling previous write first if necessary
+ * BG_REGULAR:   try to fork (or thread), no-op if a previous write is still in progress
+ * BG_IMPORTANT: try to fork (or thread), canceling (or finishing) previous write first if necessary
  */
 enum db_save_strategy
 {
@@ -308,8 +449,56 @@ enum db_save_strategy
 	DB_SAVE_BG_IMPORTANT
 };
 
+/* which kind of persistent object a metadata target is, see db_object_type() */
+enum db_object_type
+{
+	DB_OBJECT_OTHER,
+	DB_OBJECT_MYUSER,
+	DB_OBJECT_MYUSER_NAME,
+	DB_OBJECT_MYCHAN,
+	DB_OBJECT_CHANACS
+};
+
+/* how the most recent finished db_save() went, for db_write hooks and the like */
+struct db_save_stats
+{
+	enum db_save_strategy   strategy;
+	time_t                  finished;
+	unsigned int            duration;       // milliseconds, including time spent in the background
+	size_t                  bytes;          // size of the database file written
+	unsigned long long      uncompressed;   // bytes written before compression, 0 if not known
+};
+
 extern void (*db_save)(void *arg, enum db_save_strategy strategy);
 extern void (*db_load)(const char *arg);
+extern struct db_save_stats db_last_save;
+
+/* dbcommit.c: changes made since the last save, counted by the core object
+ * functions, to decide when to save next
+ */
+enum db_change_kind
+{
+	DB_CHANGE_MYUSER,       // accounts, their nicks, certfps and access masks
+	DB_CHANGE_MYCHAN,
+	DB_CHANGE_CHANACS,
+	DB_CHANGE_METADATA,
+	DB_CHANGE_OTHER,        // network bans, services ignores, module shards, ...
+	DB_CHANGE_KINDS
+};
+
+struct db_change_stats
+{
+	unsigned long long      total;                          // since startup
+	unsigned int            unsaved;                        // since the last save started
+	unsigned int            unsaved_by[DB_CHANGE_KINDS];
+	time_t                  oldest_unsaved;                 // when the first of those was made, 0 if none
+	unsigned int            skipped;                        // periodic saves skipped in a row for lack of changes
+};
+
+extern struct db_change_stats db_changes;
+
+void db_change_note(enum db_change_kind kind);
+void db_changes_saving(void);
 
 /* function.c */
 bool is_founder(struct mychan *mychan, struct myentity *myuser);
@@ -320,7 +509,9 @@ extern mowgli_list_t klnlist;
 struct kline *kline_add_with_id(const char *user, const char *host, const char *reason, long duration, const char *setby, unsigned long id);
 struct kline *kline_add(const char *user, const char *host, const char *reason, long duration, const char *setby);
 struct kline *kline_add_user(struct user *user, const char *reason, long duration, const char *setby);
+unsigned int kline_add_bulk(const struct kline_mask *masks, size_t count, const char *reason, long duration, const char *setby, unsigned int *dups);
 void kline_delete(struct kline *k);
+void kline_set_settime(struct kline *k, time_t settime);
 struct kline *kline_find(const char *user, const char *host);
 struct kline *kline_find_num(unsigned long number);
 struct kline *kline_find_user(struct user *u);
@@ -330,6 +521,7 @@ extern mowgli_list_t xlnlist;
 
 struct xline *xline_add(const char *realname, const char *reason, long duration, const char *setby);
 void xline_delete(const char *realname);
+void xline_set_settime(struct xline *x, time_t settime);
 struct xline *xline_find(const char *realname);
 struct xline *xline_find_num(unsigned int number);
 struct xline *xline_find_user(struct user *u);
@@ -339,6 +531,7 @@ extern mowgli_list_t qlnlist;
 
 struct qline *qline_add(const char *mask, const char *reason, long duration, const char *setby);
 void qline_delete(const char *mask);
+void qline_set_settime(struct qline *q, time_t settime);
 struct qline *qline_find(const char *mask);
 struct qline *qline_find_match(const char *mask);
 struct qline *qline_find_num(unsigned int number);
@@ -346,22 +539,38 @@ struct qline *qline_find_user(struct user *u);
 struct qline *qline_find_channel(struct channel *c);
 void qline_expire(void *arg);
 
+/* nickfilter.c */
+bool nickfilter_maybe(const char *name);
+
 /* account.c */
 extern mowgli_patricia_t *nicklist;
 extern mowgli_patricia_t *oldnameslist;
 extern mowgli_patricia_t *mclist;
 
+extern struct expiry_queue myuser_expiry;
+extern struct expiry_queue mynick_expiry;
+extern struct expiry_queue mychan_expiry;
+
 void init_accounts(void);
 
 struct myuser *myuser_add(const char *name, const char *pass, const char *email, unsigned int flags);
 struct myuser *myuser_add_id(const char *id, const char *name, const char *pass, const char *email, unsigned int flags);
 void myuser_delete(struct myuser *mu);
+struct delivery_job *myuser_purge_start(const char *owner, struct myuser *const *accounts, unsigned int count);
 //inline struct myuser *myuser_find(const char *name);
 void myuser_rename(struct myuser *mu, const char *name);
 void myuser_set_email(struct myuser *mu, const char *newemail);
+const mowgli_list_t *myuser_email_accounts(const char *email);
 struct myuser *myuser_find_ext(const char *name);
 void myuser_notice(const char *from, struct myuser *target, const char *fmt, ...) ATHEME_FATTR_PRINTF(3, 4);
 
+// Located in libathemecore/memoignore.c
+struct memo_ignore *myuser_memo_ignore_find(const struct myuser *mu, const struct myuser *target);
+struct memo_ignore *myuser_memo_ignore_add(struct myuser *mu, struct myuser *target);
+void myuser_memo_ignore_delete(struct memo_ignore *mi);
+void myuser_memo_ignore_delete_all(struct myuser *mu);
+void myuser_memo_ignore_add_name(struct myuser *mu, const char *name);
+
 bool myuser_access_verify(struct user *u, struct myuser *mu);
 bool myuser_access_add(struct myuser *mu, const char *mask);
 char *myuser_access_find(struct myuser *mu, const char *mask);
@@ -390,6 +599,11 @@ const char *mychan_get_sts_mlock(struct mychan *mc);
 
 struct chanacs *chanacs_add(struct mychan *mychan, struct myentity *myuser, unsigned int level, time_t ts, struct myentity *setter);
 struct chanacs *chanacs_add_host(struct mychan *mychan, const char *host, unsigned int level, time_t ts, struct myentity *setter);
+unsigned int chanacs_replace(struct mychan *mychan, const struct chanacs_import *entries, size_t count, unsigned int keep);
+void chanacs_set_level(struct chanacs *ca, unsigned int level);
+void chanacs_detach(struct chanacs *ca);
+unsigned int chanacs_count_level(const struct mychan *mychan, unsigned int level);
+unsigned int chanacs_count_flag(const struct mychan *mychan, unsigned int flag);
 
 struct chanacs *chanacs_find(struct mychan *mychan, struct myentity *myuser, unsigned int level);
 unsigned int chanacs_entity_flags(struct mychan *mychan, struct myentity *myuser);
@@ -401,6 +615,8 @@ struct chanacs *chanacs_find_host_by_user(struct mychan *mychan, struct user *u,
 struct chanacs *chanacs_find_by_mask(struct mychan *mychan, const char *mask, unsigned int level);
 bool chanacs_user_has_flag(struct mychan *mychan, struct user *u, unsigned int level);
 unsigned int chanacs_user_flags(struct mychan *mychan, struct user *u);
+void chanacs_flags_invalidate(void);
+unsigned int chanacs_flags_generation(void);
 //inline bool chanacs_source_has_flag(struct mychan *mychan, struct sourceinfo *si, unsigned int level);
 unsigned int chanacs_source_flags(struct mychan *mychan, struct sourceinfo *si);
 
@@ -417,6 +633,7 @@ bool chanacs_change_simple(struct mychan *mychan, struct myentity *mt, const cha
 void expire_check(void *arg);
 /* Check the database for (version) problems common to all backends */
 void db_check(void);
+enum db_object_type db_object_type(void *target);
 
 /* svsignore.c */
 extern mowgli_list_t svs_ignore_list;
@@ -50,4 +50,7 @@
 #define ATHEME_ARGON2_HASHLEN_DEF   64U
 #define ATHEME_ARGON2_HASHLEN_MAX   128U
 
+// Working buffers kept between computations; "auto" is one per password verification thread
+#define ATHEME_ARGON2_MEMPOOL_MAX   64U
+
 #endif /* !ATHEME_INC_ARGON2_H */
@@ -47,6 +47,9 @@
 #  if __has_attribute(__format__)
 #    define ATHEME_ATTR_HAS_FORMAT                      1
 #  endif
+#  if __has_attribute(__format_arg__)
+#    define ATHEME_ATTR_HAS_FORMAT_ARG                  1
+#  endif
 #  if __has_attribute(__malloc__)
 #    define ATHEME_ATTR_HAS_MALLOC                      1
 #  endif
@@ -77,6 +80,7 @@
 #      define ATHEME_ATTR_HAS_ALIGNED                   1
 #      define ATHEME_ATTR_HAS_DEPRECATED                1
 #      define ATHEME_ATTR_HAS_FORMAT                    1
+#      define ATHEME_ATTR_HAS_FORMAT_ARG                1
 #      define ATHEME_ATTR_HAS_MALLOC                    1
 #      define ATHEME_ATTR_HAS_NORETURN                  1
 #      define ATHEME_ATTR_HAS_PACKED                    1
@@ -204,6 +208,18 @@
 #  define ATHEME_FATTR_SCANF(fmt, start)                /* No 'format' function attribute support */
 #endif
 
+/* Tells the compiler that this function returns a translation of the format string in the parameter position given
+ * by 'fmt', so that the result can be checked against the arguments wherever the format string itself could be.
+ *
+ * Example:
+ *   const char *my_gettext(const char *msgid) __attribute__((format_arg(1)));
+ */
+#ifdef ATHEME_ATTR_HAS_FORMAT_ARG
+#  define ATHEME_FATTR_FORMAT_ARG(fmt)                  __attribute__((__format_arg__((fmt))))
+#else
+#  define ATHEME_FATTR_FORMAT_ARG(fmt)                  /* No 'format_arg' function attribute support */
+#endif
+
 /* Inform the compiler that this function allocates memory; in particular, that the pointer it returns cannot
  * possibly alias or overlap another object that existed at the time the function was called; and also that if the
  * return value is a pointer to a structure, that any of the structure's pointer members also do not point to such
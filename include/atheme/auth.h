@@ -15,9 +15,66 @@
 #include <atheme/structures.h>
 
 void set_password(struct myuser *mu, const char *newpassword);
+
+/* Stores 'pass' as it is, already hashed if 'crypted' (or in plain text if
+ * not); unlike set_password(), this does not call the myuser_change hook.
+ * Both call myuser_password_change.
+ */
+void replace_password(struct myuser *mu, const char *pass, bool crypted);
+
 bool verify_password(struct myuser *mu, const char *password) ATHEME_FATTR_WUR;
 
+/* Asynchronous verification: the password is checked on a worker thread or
+ * process (see general::auth_threads and general::auth_processes) and the callback is invoked later from the
+ * event loop, never from within verify_password_async() itself. 'mu' is
+ * looked up again at completion and is NULL if the account was dropped in
+ * the meantime. A request may be cancelled until its callback has run.
+ */
+typedef void (*verify_password_cb)(struct myuser *mu, bool verified, void *priv);
+
+struct pwverify_request;
+
+struct pwverify_stats
+{
+	unsigned int    threads;        // worker threads running
+	unsigned int    processes;      // worker processes running
+	unsigned int    queued;         // requests waiting for a worker
+	unsigned int    running;        // requests being verified right now
+	unsigned int    completed;      // requests completed since startup
+	unsigned int    latency_avg;    // average submit-to-callback time (ms)
+	unsigned int    latency_max;    // worst submit-to-callback time (ms)
+	unsigned int    rehash_queued;  // password re-encryptions waiting or in progress
+	unsigned int    rehash_done;    // passwords re-encrypted since startup
+	unsigned int    rehash_dropped; // re-encryptions not queued because the queue was full
+	unsigned int    rehash_stale;   // results discarded (password changed meanwhile, or hashing failed)
+};
+
+struct pwverify_request *verify_password_async(struct myuser *mu, const char *password,
+                                               verify_password_cb cb, void *priv);
+void verify_password_async_cancel(struct pwverify_request *req);
+void pwverify_get_stats(struct pwverify_stats *stats);
+
+/* Other expensive cryptography (e.g. signature verification for SASL) can be
+ * run on the same worker threads: run is called off the main thread and must
+ * only touch what priv points to, then done is called from the event loop.
+ */
+typedef void (*crypto_job_run_fn)(void *priv);
+typedef void (*crypto_job_done_fn)(void *priv);
+
+struct pwverify_request *crypto_job_submit(crypto_job_run_fn run, crypto_job_done_fn done, void *priv);
+void crypto_job_cancel(struct pwverify_request *req);
+
 extern bool auth_module_loaded;
 extern bool (*auth_user_custom)(struct myuser *mu, const char *password) ATHEME_FATTR_WUR;
 
+/* A custom authentication module that can check passwords without blocking
+ * sets this as well. It returns false if it cannot start the check, in which
+ * case auth_user_custom() is used instead. Otherwise it must hand the request
+ * back exactly once with auth_user_custom_async_done(), from the main thread
+ * (also when unloading, with verified = false).
+ */
+extern bool (*auth_user_custom_async)(struct myuser *mu, const char *password,
+                                      struct pwverify_request *req) ATHEME_FATTR_WUR;
+void auth_user_custom_async_done(struct pwverify_request *req, bool verified);
+
 #endif /* !ATHEME_INC_AUTH_H */
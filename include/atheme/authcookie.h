@@ -12,23 +12,27 @@
 
 #include <atheme/attributes.h>
 #include <atheme/stdheaders.h>
+#include <atheme/timerwheel.h>
 
 #define AUTHCOOKIE_LENGTH 20
 
 struct authcookie
 {
-	char *          ticket;
-	struct myuser * myuser;
-	time_t          expire;
-	mowgli_node_t   node;
+	char *                  ticket;
+	struct myuser *         myuser;
+	time_t                  expire;
+	mowgli_node_t           node;           // in myuser->authcookies
+	struct timerwheel_entry expire_timer;
 };
 
+// Incremented whenever an authcookie is destroyed, so callers can cache a validation
+extern unsigned int authcookie_destroyed;
+
 void authcookie_init(void);
 struct authcookie *authcookie_create(struct myuser *mu);
 struct authcookie *authcookie_find(const char *ticket, struct myuser *myuser);
 void authcookie_destroy(struct authcookie *ac);
 void authcookie_destroy_all(struct myuser *mu);
 bool authcookie_validate(const char *ticket, struct myuser *myuser) ATHEME_FATTR_WUR;
-void authcookie_expire(void *arg);
 
 #endif /* !ATHEME_INC_AUTHCOOKIE_H */
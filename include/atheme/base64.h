@@ -46,4 +46,13 @@ size_t base64_decode_table(const char *, void *, size_t, const char alphabet[sta
 size_t base64_encode(const void *, size_t, char *, size_t) ATHEME_FATTR_WUR;
 size_t base64_encode_table(const void *, size_t, char *, size_t, const char alphabet[static 65]) ATHEME_FATTR_WUR;
 
+/* The RFC 4648 alphabet is encoded and decoded with vector instructions where
+ * the CPU has them (see libathemecore/base64_accel.c); the best kernel is
+ * selected on first use, and crypto-benchmark selects each in turn.
+ */
+size_t base64_kernel_count(void);
+const char *base64_kernel_name(size_t);
+bool base64_kernel_select(size_t);
+size_t base64_kernel_selected(void);
+
 #endif /* !ATHEME_INC_BASE64_H */
@@ -0,0 +1,63 @@
+/*
+ * SPDX-License-Identifier: ISC
+ * SPDX-URL: https://spdx.org/licenses/ISC.html
+ *
+ * Copyright (C) 2026 Atheme Development Group (https://atheme.github.io/)
+ *
+ * Capturing uplink traffic to a ring file, and reading it back.
+ */
+
+#ifndef ATHEME_INC_CAPTURE_H
+#define ATHEME_INC_CAPTURE_H 1
+
+#include <atheme/stdheaders.h>
+
+#define CAPTURE_MAGIC           "ATHMCAP1"
+#define CAPTURE_SIZE_MIN        (64U * 1024U)
+#define CAPTURE_SIZE_MAX        (4096ULL * 1024U * 1024U)
+
+enum capture_direction
+{
+	CAPTURE_IN              = 0,    // received from the uplink
+	CAPTURE_OUT             = 1,    // sent to it
+};
+
+struct capture_record
+{
+	unsigned long long      when;           // nanoseconds since the epoch
+	enum capture_direction  direction;
+	size_t                  len;
+	const char *            line;           // not NUL-terminated; valid until the next capture_read()
+};
+
+struct capture_status
+{
+	const char *            path;
+	size_t                  size;           // of the ring, in bytes
+	size_t                  used;
+	unsigned long long      records;        // in the ring now
+	unsigned long long      written;        // since the capture was started
+	time_t                  started;
+};
+
+struct capture_reader;
+
+extern bool capture_running;
+
+bool capture_start(const char *path, size_t size);
+void capture_stop(void);
+bool capture_status_get(struct capture_status *status);
+void capture_write(enum capture_direction direction, const char *line, size_t len);
+
+struct capture_reader *capture_open(const char *path);
+bool capture_read(struct capture_reader *reader, struct capture_record *record);
+void capture_close(struct capture_reader *reader);
+
+static inline void
+capture_line(const enum capture_direction direction, const char *const restrict line, const size_t len)
+{
+	if (capture_running)
+		capture_write(direction, line, len);
+}
+
+#endif /* !ATHEME_INC_CAPTURE_H */
@@ -10,12 +10,16 @@
 #ifndef ATHEME_INC_CHANNELS_H
 #define ATHEME_INC_CHANNELS_H 1
 
+#include <atheme/match.h>
 #include <atheme/stdheaders.h>
 #include <atheme/structures.h>
 
 #define VALID_GLOBAL_CHANNEL_PFX(name)	(*(name) == '#' || *(name) == '+' || *(name) == '!')
 #define VALID_CHANNEL_PFX(name)		(VALID_GLOBAL_CHANNEL_PFX(name) || *(name) == '&')
 
+// Pending mode changes; only libathemecore/cmode.c looks inside
+struct modestackdata;
+
 struct channel
 {
 	char *          name;
@@ -33,6 +37,13 @@ struct channel
 	mowgli_list_t   bans;
 	unsigned int    flags;
 	struct mychan * mychan;
+	struct chanuser **memberhash;   // members by user pointer, large channels only
+	unsigned int    memberhash_size;
+	mowgli_patricia_t *banindex;    // bans by mask (chained by type), long ban lists only
+	mowgli_node_t   splitnode;      // while CHAN_SPLITEMPTY is set
+	struct modestackdata *modestack; // mode changes not sent yet
+	unsigned int    fantasy_gen;    // when fantasy_first was worked out, 0 if it has to be again
+	uint8_t         fantasy_first[32]; // bitmap of first bytes a service here may act on
 };
 
 /* struct for channel memberships */
@@ -43,6 +54,14 @@ struct chanuser
 	unsigned int    modes;
 	mowgli_node_t   unode;
 	mowgli_node_t   cnode;
+
+	// chanacs_user_flags() for this membership, valid while the generations match
+	struct mychan * acs_mychan;
+	unsigned int    acs_gen;
+	unsigned int    acs_usergen;
+	unsigned int    acs_flags;
+
+	bool            stale;          // from before an uplink reconnect, see channel_mark_stale()
 };
 
 struct chanban
@@ -52,6 +71,9 @@ struct chanban
 	int             type;   // 'b', 'e', 'I', etc -- jilles
 	mowgli_node_t   node;   // for struct channel -> bans
 	unsigned int    flags;
+	unsigned int    suffixlen;      // literal tail of the mask that anything it matches ends with
+	struct chanban *index_next;     // same mask, other types, in struct channel -> banindex
+	struct cidr_addr cidr;          // host part of an n!u@i/c mask, family 0 if not one
 };
 
 /* for struct channel -> modes */
@@ -67,6 +89,7 @@ struct chanban
 
 /* for struct channel -> flags */
 #define CHAN_LOG        0x00000001U /* logs sent to here */
+#define CHAN_SPLITEMPTY 0x00000002U /* emptied by a netsplit, deleted once it is over */
 
 /* for struct chanuser -> modes */
 #define CSTATUS_OP      0x00000001U
@@ -119,8 +142,20 @@ extern void (*modestack_mode_param)(const char *source, struct channel *channel,
 
 void modestack_flush_now(void);
 
+struct modestack_stats
+{
+	unsigned long long      changes;        // mode changes stacked
+	unsigned long long      lines;          // MODE lines they were sent as
+	unsigned long long      flushes;        // end-of-pass flushes
+	unsigned int            peak_channels;  // most channels pending at one of those
+	unsigned long long      holds;          // times those waited for the uplink's sendq to drain
+};
+
+extern struct modestack_stats modestack_stats;
+
 /* channels.c */
 extern mowgli_patricia_t *chanlist;
+extern struct namehash *chanhash;
 
 void init_channels(void);
 
@@ -128,13 +163,30 @@ struct channel *channel_add(const char *name, time_t ts, struct server *creator)
 void channel_delete(struct channel *c);
 //inline struct channel *channel_find(const char *name);
 
+struct chanuser_add_entry
+{
+	const char *            name;           // nick or UID, without prefixes
+	unsigned int            modes;          // CSTATUS_*
+};
+
+// How many members of a burst line protocol modules collect before adding them
+#define CHANUSER_ADD_BATCH      64U
+
+unsigned int chanuser_prefix_modes(const char **name);
 struct chanuser *chanuser_add(struct channel *chan, const char *user);
+unsigned int chanuser_add_many(struct channel *chan, const struct chanuser_add_entry *entries, unsigned int count);
 void chanuser_delete(struct channel *chan, struct user *user);
+void chanuser_delete_member(struct chanuser *cu);
+void channel_mark_stale(void (*rejoin)(struct channel *, struct user *));
+unsigned int chanuser_purge_stale(void);
 struct chanuser *chanuser_find(struct channel *chan, struct user *user);
+void channel_fantasy_invalidate(struct channel *c);
+bool channel_fantasy_candidate(struct channel *c, const char *message);
 
 struct chanban *chanban_add(struct channel *chan, const char *mask, int type);
 void chanban_delete(struct chanban *c);
 struct chanban *chanban_find(struct channel *chan, const char *mask, int type);
+bool chanban_may_match(const struct chanban *c, const char *const *forms, const size_t *lens, size_t count);
 //inline void chanban_clear(struct channel *chan);
 
 #endif /* !ATHEME_INC_CHANNELS_H */
@@ -0,0 +1,30 @@
+/*
+ * SPDX-License-Identifier: ISC
+ * SPDX-URL: https://spdx.org/licenses/ISC.html
+ *
+ * Copyright (C) 2026 Atheme Development Group (https://atheme.github.io/)
+ *
+ * The hosts with the most clients, as kept by operserv/clones.
+ */
+
+#ifndef ATHEME_INC_CLONES_H
+#define ATHEME_INC_CLONES_H 1
+
+#include <atheme/stdheaders.h>
+
+struct clones_top_entry
+{
+	const char *            ip;             // the address, or prefix/length
+	unsigned int            clients;
+	bool                    exempt;
+	unsigned int            allowed;        // the limit that applies, exempt or not (0 if none)
+};
+
+typedef void (*clones_top_fn)(const struct clones_top_entry *entry, void *privdata);
+
+/* Exported by operserv/clones as clones_top_foreach; calls cb for up to max
+ * of the hosts with at least min clients, most first. Returns how many.
+ */
+typedef unsigned int (*clones_top_foreach_fn)(unsigned int max, unsigned int min, clones_top_fn cb, void *privdata);
+
+#endif /* !ATHEME_INC_CLONES_H */
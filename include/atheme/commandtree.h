@@ -14,6 +14,55 @@
 #include <atheme/stdheaders.h>
 #include <atheme/structures.h>
 
+#define COMMAND_STATS_BUCKETS   24U
+
+/* Kept per (sub)command in command_exec(); these outlive the module the
+ * command came from, so that a reload does not lose them.
+ */
+struct command_stats
+{
+	char *                  name;       // service internal name, command (and subcommand) name
+	unsigned int            calls;
+	unsigned int            slow;       // calls that took at least config_options.slow_command_time
+	unsigned long long      total_us;
+	unsigned long long      max_us;
+	unsigned int            hist[COMMAND_STATS_BUCKETS];   // hist[i]: calls taking 2^i to 2^(i+1) usec
+};
+
+/* Called when a suspended command's source goes away (or its module is
+ * unloaded): stops whatever the command is waiting for and frees priv.
+ */
+typedef void (*command_cancel_fn)(void *priv);
+
+struct command_pending;
+
+/* Called for each slice of a command run with command_run_sliced(); returns
+ * true once it is done (and has freed priv).
+ */
+typedef bool (*command_slice_fn)(struct sourceinfo *si, void *priv);
+
+/* Which of the users waiting for services go first, by the command each of
+ * them sent next (see cmdqueue.c).
+ */
+enum command_sched_class
+{
+	CMD_SCHED_NORMAL        = 0,
+	CMD_SCHED_AUTH          = 1,        // logs the user in; goes first, and never waits unless behind their own
+	CMD_SCHED_QUERY         = 2,        // (potentially long) listings and searches; go last
+	CMD_SCHED_CLASSES
+};
+
+struct command_queue_stats
+{
+	unsigned int            deferred;       // messages that had to wait for their turn
+	unsigned int            waiting;        // ... and are waiting now
+	unsigned int            dropped;        // ... whose sender left first
+	unsigned int            passes_over;    // event loop passes whose commands took longer than the budget
+	unsigned int            sliced;         // commands that ran in slices
+	unsigned int            slices_running; // ... and are still running
+	unsigned long long      max_wait_us;
+};
+
 struct command
 {
 	const char *            name;
@@ -25,6 +74,9 @@ struct command
 		const char *    path;
 		void          (*func)(struct sourceinfo *, const char *subcmd);
 	}                       help;
+	struct command_stats *  stats;      // set by command_exec()
+	bool                    replica_safe;   // only reports; may run on a journal-following replica
+	enum command_sched_class sched_class;
 };
 
 /* commandtree.c */
@@ -34,9 +86,26 @@ void command_delete_trie_cb(const char *, void *, void *);
 struct command *command_find(mowgli_patricia_t *, const char *);
 void command_exec(struct service *, struct sourceinfo *, struct command *, int, char **);
 void command_exec_split(struct service *, struct sourceinfo *, const char *, char *, mowgli_patricia_t *);
+void command_exec_args(struct service *, struct sourceinfo *, struct command *, int, char **, char *);
+int text_to_parv(char *text, int maxparc, char **parv);
+void command_stats_foreach(void (*)(const struct command_stats *, void *), void *);
+unsigned long long command_stats_percentile(const struct command_stats *, unsigned int);
+struct command_pending *command_suspend(struct sourceinfo *si, command_cancel_fn cancel, void *priv);
+struct sourceinfo *command_resume(struct command_pending *cp);
+void command_yield(struct command_pending *cp);
+void command_finish(struct command_pending *cp);
+void *command_pending_find(const struct user *u, const struct command *c);
+void command_cancel_all(const struct command *c);
 void subcommand_dispatch_simple(struct service *, struct sourceinfo *, int, char **, mowgli_patricia_t *, const char *);
 extern bool (*command_authorize)(struct service *, struct sourceinfo *, struct command *c, const char *userlevel);
 
+/* cmdqueue.c */
+void command_queue_dispatch(struct sourceinfo *si, char *target, char *message);
+void command_queue_forget_user(struct user *u);
+bool command_slice_expired(void);
+void command_run_sliced(struct sourceinfo *si, command_slice_fn fn, command_cancel_fn cancel, void *priv);
+void command_queue_get_stats(struct command_queue_stats *stats);
+
 /* logger.c */
 void logaudit_denycmd(struct sourceinfo *si, struct command *cmd, const char *userlevel);
 
@@ -45,12 +45,27 @@ enum cmd_faultcode
 		continue;						\
 	}
 
-/* strshare.c - stringref management */
+/* strshare.c - stringref management
+ * Equal strings share one copy, so two stringrefs hold the same text exactly
+ * when they are the same pointer.
+ */
 typedef const char *stringref;
 
+struct strshare_stats
+{
+	size_t          unique;         // distinct strings held
+	size_t          refs;           // references to them
+	size_t          bytes;          // memory taken by the strings and their headers
+	size_t          saved;          // memory that one copy per reference would have taken on top
+	size_t          table_size;     // slots in the hash table
+};
+
 void strshare_init(void);
 stringref strshare_get(const char *str);
 stringref strshare_ref(stringref str);
 void strshare_unref(stringref str);
+void strshare_reserve(size_t count);
+void strshare_get_stats(struct strshare_stats *stats);
+void strshare_foreach(void (*cb)(stringref str, unsigned int refcount, void *privdata), void *privdata);
 
 #endif /* !ATHEME_INC_COMMON_H */
@@ -46,6 +46,7 @@ typedef int (*conf_handler_fn)(mowgli_config_file_entry_t *);
 conf_handler_fn conftable_get_conf_handler(struct ConfTable *ct);
 
 void conf_process(mowgli_config_file_t *cfp);
+bool conf_block_changed(const char *name);
 
 int token_to_value(struct Token token_table[], const char *token);
 /* special return values for token_to_value */
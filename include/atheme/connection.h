@@ -31,6 +31,35 @@ union sockaddr_any
 #define SOCKADDR_IN(foo) 	(struct sockaddr_in	*) &(foo)
 #define SOCKADDR_IN6(foo) 	(struct sockaddr_in6	*) &(foo)
 
+/* Events are handled in lanes (see connection.c): the uplink's as soon as
+ * they are seen, those of everything else after them, a few at a time.
+ */
+enum connection_lane_id
+{
+	CONNECTION_LANE_UPLINK          = 0,
+	CONNECTION_LANE_CLIENT          = 1,    // listeners, HTTP/RPC clients, DCC and the like
+	CONNECTION_LANE_TIMER           = 2,    // periodic (housekeeping) timers
+	CONNECTION_LANES
+};
+
+struct connection_lane_entry
+{
+	mowgli_node_t                   node;
+	struct timeval                  queued;
+	void                          (*run)(struct connection_lane_entry *);
+	enum connection_lane_id         lane;
+	bool                            listed;
+};
+
+struct connection_lane_stats
+{
+	unsigned long long              runs;
+	unsigned long long              carried;        // left for a later pass, over the lane's cap
+	unsigned long long              total_wait_us;
+	unsigned long long              max_wait_us;
+	unsigned int                    waiting;
+};
+
 struct connection
 {
 	char                            name[HOSTLEN + 1];
@@ -42,6 +71,8 @@ struct connection
 	time_t                          first_recv;
 	time_t                          last_recv;
 	size_t                          sendq_limit;
+	size_t                          sendq_high;     // producers should hold back above this (see sendq_congested())
+	size_t                          sendq_low;      // ... until the sendq is back down to this
 	union sockaddr_any              saddr;
 	socklen_t                       saddr_size;
 	void                          (*read_handler)(struct connection *);
@@ -52,6 +83,9 @@ struct connection
 	struct connection *             listener;
 	void *                          userdata;
 	mowgli_eventloop_pollable_t *   pollable;
+	struct uring_connection *       uring;          // when its I/O goes through io_uring (see uring.c)
+	struct connection_lane_entry    lane_read;      // waiting for its turn to read
+	struct connection_lane_entry    lane_write;     // ... or write
 };
 
 #define CF_UPLINK     0x00000001U
@@ -66,6 +100,8 @@ struct connection
 #define CF_NONEWLINE  0x00000080U
 #define CF_SEND_EOF   0x00000100U /* shutdown(2) write end if sendq empty */
 #define CF_SEND_DEAD  0x00000200U /* write end shut down */
+#define CF_SENDQ_FULL 0x00000400U /* sendq went over its high watermark */
+#define CF_SENDQ_RESUME 0x00000800U /* ... and is back at the low one; sendq_resume not yet called */
 
 #define CF_IS_UPLINK(x) ((x)->flags & CF_UPLINK)
 #define CF_IS_DCC(x) ((x)->flags & (CF_DCCOUT | CF_DCCIN))
@@ -95,6 +131,11 @@ void connection_close_soon_children(struct connection *);
 void connection_close_all(void);
 void connection_close_all_fds(void);
 void connection_stats(void (*)(const char *, void *), void *);
+void connection_lane_defer(struct connection_lane_entry *);
+void connection_lane_cancel(struct connection_lane_entry *);
+void connection_lanes_run(void);
+const char *connection_lane_name(enum connection_lane_id);
+void connection_lane_stats_get(enum connection_lane_id, struct connection_lane_stats *);
 struct connection *connection_find(int);
 //inline int connection_count(void);
 
@@ -65,7 +65,7 @@
 #define CACHEFILE_HEAP_SIZE     32U
 #define CACHELINE_HEAP_SIZE     64U
 
-#define FLOOD_MSGS_FACTOR       256U
+#define FLOOD_MSGS_FACTOR       RATELIMIT_UNIT
 #define FLOOD_HEAVY             (3U * FLOOD_MSGS_FACTOR)
 #define FLOOD_MODERATE          FLOOD_MSGS_FACTOR
 #define FLOOD_LIGHT             0U
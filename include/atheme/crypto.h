@@ -19,12 +19,23 @@
 
 typedef const char *(*crypt_crypt_func)(const char *, const char *) ATHEME_FATTR_WUR;
 typedef bool (*crypt_verify_func)(const char *, const char *, unsigned int *) ATHEME_FATTR_WUR;
+typedef void (*crypt_verify_multi_func)(const char *const *, const char *const *, unsigned int *, bool *, size_t);
 
 struct crypt_impl
 {
 	const char *            id;
 	crypt_crypt_func        crypt;
 	crypt_verify_func       verify;
+	bool                    threadsafe;     // verify may be called from a password verification thread
+	crypt_verify_multi_func verify_multi;   // Optional: like verify, for several passwords at once
+	const char *const *     prefixes;       // Optional: NULL-terminated; the "$tag$" its hashes start with
+};
+
+struct crypt_verify_stats
+{
+	unsigned int            dispatched;     // hashes handed straight to the provider owning their prefix
+	unsigned int            probed;         // hashes no provider owns, tried against the ones without prefixes
+	unsigned int            probe_calls;    // provider functions called for those
 };
 
 void crypt_register(const struct crypt_impl *impl);
@@ -36,5 +47,9 @@ const struct crypt_impl *crypt_verify_password(const char *password, const char
     ATHEME_FATTR_WUR;
 
 const char *crypt_password(const char *password);
+bool crypt_password_using(const struct crypt_impl *ci, const char *password, char *buf, size_t buflen)
+    ATHEME_FATTR_WUR;
+const struct crypt_impl *crypt_get_hash_provider(const char *parameters);
+void crypt_get_verify_stats(struct crypt_verify_stats *stats);
 
 #endif /* !ATHEME_INC_CRYPTO_H */
@@ -12,11 +12,26 @@
 
 #include <atheme/stdheaders.h>
 
+// Translations already looked up, by the address of the string translated
+struct translation_cache_entry
+{
+	const char *    key;
+	const char *    value;
+};
+
+struct translation_cache
+{
+	struct translation_cache_entry *entries;
+	size_t          size;   // a power of 2, or 0 before the first entry
+	size_t          count;
+};
+
 struct language
 {
 	char *          name;
 	unsigned int    flags;  // LANG_*
 	mowgli_node_t   node;
+	struct translation_cache cache;         // gettext(3) results in this language
 };
 
 struct translation
@@ -31,6 +46,7 @@ void itranslation_destroy(const char *str);
 void translation_create(const char *str, const char *trans);
 void translation_destroy(const char *str);
 void translation_init(void);
+void translation_cache_flush(void);
 
 struct language *language_add(const char *name);
 struct language *language_find(const char *name);
@@ -39,6 +55,7 @@ const char *language_get_name(const struct language *lang);
 const char *language_get_real_name(const struct language *lang);
 bool language_is_valid(const struct language *lang);
 void language_set_active(struct language *lang);
+void language_preload(void);
 
 bool languages_get_available(void);
 void languages_set_available(bool);
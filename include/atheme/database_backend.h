@@ -93,8 +93,51 @@ typedef void (*database_handler_fn)(struct database_handle *db, const char *type
 
 void db_register_type_handler(const char *type, database_handler_fn fun);
 void db_unregister_type_handler(const char *type);
+database_handler_fn db_resolve_type_handler(const char *type);
 void db_process(struct database_handle *db, const char *type);
+void db_process_resolved(struct database_handle *db, const char *type, database_handler_fn fun);
 void db_init(void);
+
+/* Where backends write the database; compressed when db_compress_level
+ * says so. path is only used in messages.
+ */
+struct db_output
+{
+	FILE *                  f;
+	void *                  gz;             // gzFile, when compressing
+	unsigned long long      bytes;          // written so far, uncompressed
+	bool                    error;
+};
+
+extern unsigned long long db_output_last_bytes;
+
+bool db_output_open(struct db_output *out, int fd, const char *path);
+void db_output_write(struct db_output *out, const void *data, size_t len);
+bool db_output_close(struct db_output *out);
+char *db_input_decompress(FILE *f, const char *path, size_t *len);
+
+/* A module's rows in a file of their own next to the main database
+ * (services.db.<name>), rewritten only when the module has marked it dirty
+ * instead of with every commit. The main database lists the shards in
+ * SHARD rows; a shard file it doesn't list is ignored, since the rows are
+ * then still in the main database.
+ */
+typedef void (*database_shard_write_fn)(struct database_handle *db);
+
+struct db_shard
+{
+	char *                          name;
+	database_shard_write_fn         fun;    // NULL while no module has it registered
+	bool                            dirty;
+	bool                            listed; // in a SHARD row of the loaded or a written main database
+};
+
+struct db_shard *db_shard_register(const char *name, database_shard_write_fn fun);
+void db_shard_unregister(struct db_shard *shard);
+void db_shard_load(struct db_shard *shard);
+void db_shard_dirty(struct db_shard *shard);
+void db_shards_load(const char *filename);
+void db_shards_save(const char *filename);
 extern const struct database_module *db_mod;
 
 #endif /* !ATHEME_INC_DATABASE_BACKEND_H */
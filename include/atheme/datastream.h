@@ -10,19 +10,53 @@
 #ifndef ATHEME_INC_DATASTREAM_H
 #define ATHEME_INC_DATASTREAM_H 1
 
+#include <atheme/attributes.h>
 #include <atheme/stdheaders.h>
 #include <atheme/structures.h>
 
+struct sendq_line
+{
+	struct connection *     cptr;
+	void *                  slab;           // the sendq slab the line is being written into
+	char *                  buf;
+	size_t                  len;
+	size_t                  room;           // how long it may grow in this slab
+};
+
+struct sendq_pool_stats
+{
+	size_t                  bytes;          // held in slabs by the sendqs and recvqs of connections other than the uplink
+	size_t                  peak;           // most that has been held at once
+	unsigned int            cached;         // freed slabs kept for reuse
+	unsigned int            refused;        // connections dropped for going over general::sendq_pool_limit
+};
+
+extern struct sendq_pool_stats sendq_pool;
+
 void sendq_add(struct connection *cptr, char *buf, size_t len);
+const char *sendq_add_vline(struct connection *cptr, size_t *lenp, const char *fmt, va_list ap) ATHEME_FATTR_PRINTF(3, 0);
+bool sendq_line_begin(struct connection *cptr, struct sendq_line *l);
+void sendq_line_str(struct sendq_line *l, const char *str);
+void sendq_line_strn(struct sendq_line *l, const char *str, size_t len);
+void sendq_line_char(struct sendq_line *l, char c);
+void sendq_line_uint(struct sendq_line *l, unsigned long long value);
+const char *sendq_line_end(struct sendq_line *l, size_t *lenp);
+char *sendq_reserve(struct connection *cptr, size_t min, size_t *roomp);
+void sendq_commit(struct connection *cptr, size_t len);
 void sendq_add_eof(struct connection *cptr);
 void sendq_flush(struct connection *cptr);
 bool sendq_nonempty(struct connection *cptr);
+size_t sendq_length(const struct connection *cptr);
 void sendq_set_limit(struct connection *cptr, size_t len);
+void sendq_set_watermarks(struct connection *cptr, size_t high, size_t low);
+bool sendq_congested(const struct connection *cptr);
 
 int recvq_length(struct connection *cptr);
 void recvq_put(struct connection *cptr);
 int recvq_get(struct connection *cptr, char *buf, size_t len);
 int recvq_getline(struct connection *cptr, char *buf, size_t len);
+char *recvq_peekline(struct connection *cptr, size_t len, size_t *lenp);
+void recvq_consume(struct connection *cptr, size_t len);
 
 void sendqrecvq_free(struct connection *cptr);
 
@@ -0,0 +1,46 @@
+/*
+ * SPDX-License-Identifier: ISC
+ * SPDX-URL: https://spdx.org/licenses/ISC.html
+ *
+ * Copyright (C) 2026 Atheme Development Group (https://atheme.github.io/)
+ *
+ * Deliveries to many recipients (GLOBAL, MemoServ SENDALL, ...) done a
+ * slice at a time in the background, paced against the uplink's sendq.
+ */
+
+#ifndef ATHEME_INC_DELIVERY_H
+#define ATHEME_INC_DELIVERY_H 1
+
+#include <atheme/stdheaders.h>
+
+struct delivery_job;
+
+// Delivers to the next recipient; returns false, doing nothing, once there are none left
+typedef bool (*delivery_step_fn)(struct delivery_job *job);
+
+// Called once the job has finished or been cancelled; the job is freed afterwards
+typedef void (*delivery_done_fn)(struct delivery_job *job, bool cancelled);
+
+struct delivery_job
+{
+	mowgli_node_t           node;
+	unsigned int            id;
+	char *                  owner;          // who started it
+	char *                  desc;
+	const char *            privilege;      // needed to see or cancel it
+	time_t                  started;
+	unsigned int            done;           // recipients delivered to so far
+	unsigned int            total;          // how many there are, or 0 if not known
+	delivery_step_fn        step;
+	delivery_done_fn        done_fn;
+	void *                  data;
+};
+
+extern mowgli_list_t delivery_jobs;
+
+struct delivery_job *delivery_job_start(const char *owner, const char *desc, const char *privilege, unsigned int total,
+                                        delivery_step_fn step, delivery_done_fn done_fn, void *data);
+struct delivery_job *delivery_job_find(unsigned int id);
+void delivery_job_cancel(struct delivery_job *job);
+
+#endif /* !ATHEME_INC_DELIVERY_H */
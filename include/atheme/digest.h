@@ -58,6 +58,14 @@ bool digest_oneshot_hkdf(enum digest_algorithm, const void *, size_t, const void
 bool digest_oneshot_pbkdf2(enum digest_algorithm, const void *, size_t, const void *, size_t, size_t, void *, size_t)
     ATHEME_FATTR_WUR;
 
+/* Several independent PBKDF2 derivations at once. Jobs with the same iteration
+ * count are run side by side when the frontend has a multi-buffer kernel for
+ * the algorithm; digest_pbkdf2_lanes() says how many fit in one batch (1 if
+ * they are simply done one after another).
+ */
+size_t digest_pbkdf2_lanes(enum digest_algorithm);
+bool digest_oneshot_pbkdf2_multi(enum digest_algorithm, const struct digest_pbkdf2_job *, size_t) ATHEME_FATTR_WUR;
+
 bool digest_testsuite_run(void) ATHEME_FATTR_WUR;
 const char *digest_get_frontend_info(void);
 
@@ -12,6 +12,7 @@
 
 #include <atheme/stdheaders.h>
 #include <atheme/attributes.h>
+#include <atheme/digest/types.h>
 
 #define DIGEST_BKLEN_MD5        0x40U
 #define DIGEST_IVLEN_MD5        0x04U
@@ -32,6 +33,39 @@
 #define DIGEST_BKLEN_MAX        DIGEST_BKLEN_SHA2_512
 #define DIGEST_MDLEN_MAX        DIGEST_MDLEN_SHA2_512
 
+/* The multi-buffer PBKDF2 kernels need the compiler's generic vector types;
+ * on x86-64 an AVX2 build of them is also selected at runtime if possible.
+ */
+#ifdef __has_attribute
+#  if __has_attribute(__vector_size__)
+#    define ATHEME_DIGEST_HAVE_MB_SHA2              1
+#    if defined(__x86_64__) && __has_attribute(__target__) && (defined(__GNUC__) || defined(__clang__))
+#      define ATHEME_DIGEST_HAVE_MB_SHA2_AVX2       1
+#    endif
+#  endif
+#endif
+
+/* SHA1 and SHA2-256 compression can use the x86 SHA extensions, or the ARMv8
+ * cryptography extensions (on Linux, where the kernel tells us about them),
+ * and a build of the SHA2-512 code for AVX2 can be used on x86; all of these
+ * are compiled for with per-function target attributes and selected at
+ * runtime, so the rest of the program does not need to be built for them.
+ */
+#ifdef __has_attribute
+#  if __has_attribute(__target__) && (defined(__GNUC__) || defined(__clang__))
+#    if defined(__x86_64__) || defined(__i386__)
+#      define ATHEME_DIGEST_HAVE_ACCEL_X86          1
+#    endif
+#    if defined(__aarch64__) && defined(__linux__) && (defined(__ARM_FEATURE_CRYPTO) || \
+        (defined(__GNUC__) && ! defined(__clang__) && (__GNUC__ >= 8)))
+#      define ATHEME_DIGEST_HAVE_ACCEL_ARMV8        1
+#    endif
+#  endif
+#endif
+
+#define DIGEST_MB_LANES_SHA2_256        0x08U
+#define DIGEST_MB_LANES_SHA2_512        0x04U
+
 struct digest_direct_ctx_md5
 {
 	uint32_t        count[0x02U];
@@ -60,6 +94,23 @@ struct digest_direct_ctx_sha2_512
 	unsigned char   buf[DIGEST_BKLEN_SHA2_512] ATHEME_VATTR_ALIGNED(8);
 };
 
+// One PBKDF2 derivation in a multi-buffer batch (all words in host byte order)
+struct digest_direct_pbkdf2_lane_sha2_256
+{
+	uint32_t        istate[DIGEST_IVLEN_SHA2_256];  // State after compressing the inner HMAC key block
+	uint32_t        ostate[DIGEST_IVLEN_SHA2_256];  // State after compressing the outer HMAC key block
+	uint32_t        u[DIGEST_IVLEN_SHA2_256];       // Last U(j)
+	uint32_t        t[DIGEST_IVLEN_SHA2_256];       // XOR of all U(j) so far
+};
+
+struct digest_direct_pbkdf2_lane_sha2_512
+{
+	uint64_t        istate[DIGEST_IVLEN_SHA2_512];
+	uint64_t        ostate[DIGEST_IVLEN_SHA2_512];
+	uint64_t        u[DIGEST_IVLEN_SHA2_512];
+	uint64_t        t[DIGEST_IVLEN_SHA2_512];
+};
+
 union digest_direct_ctx
 {
 	struct digest_direct_ctx_md5        md5;
@@ -68,6 +119,9 @@ union digest_direct_ctx
 	struct digest_direct_ctx_sha2_512   sha2_512;
 };
 
+// Compresses nblocks whole blocks from in into the state of a context
+typedef void (*digest_direct_blocks_fn)(union digest_direct_ctx *, const unsigned char *, size_t);
+
 void digest_direct_init_md5(union digest_direct_ctx *);
 void digest_direct_init_sha1(union digest_direct_ctx *);
 void digest_direct_init_sha2_256(union digest_direct_ctx *);
@@ -83,4 +137,27 @@ void digest_direct_final_sha1(union digest_direct_ctx *, void *);
 void digest_direct_final_sha2_256(union digest_direct_ctx *, void *);
 void digest_direct_final_sha2_512(union digest_direct_ctx *, void *);
 
+extern digest_direct_blocks_fn digest_direct_blocks_sha1;
+extern digest_direct_blocks_fn digest_direct_blocks_sha2_256;
+extern digest_direct_blocks_fn digest_direct_blocks_sha2_512;
+
+void digest_direct_blocks_sha1_portable(union digest_direct_ctx *, const unsigned char *, size_t);
+void digest_direct_blocks_sha2_256_portable(union digest_direct_ctx *, const unsigned char *, size_t);
+void digest_direct_blocks_sha2_512_portable(union digest_direct_ctx *, const unsigned char *, size_t);
+#ifdef ATHEME_DIGEST_HAVE_ACCEL_X86
+void digest_direct_blocks_sha2_512_avx2(union digest_direct_ctx *, const unsigned char *, size_t);
+#endif
+
+size_t digest_direct_kernel_count(enum digest_algorithm);
+const char *digest_direct_kernel_name(enum digest_algorithm, size_t);
+bool digest_direct_kernel_select(enum digest_algorithm, size_t);
+size_t digest_direct_kernel_selected(enum digest_algorithm);
+const char *digest_direct_get_kernels(void);
+
+#ifdef ATHEME_DIGEST_HAVE_MB_SHA2
+const char *digest_direct_mb_get_isa(void);
+void digest_direct_pbkdf2_mb_sha2_256(struct digest_direct_pbkdf2_lane_sha2_256 *, size_t, size_t);
+void digest_direct_pbkdf2_mb_sha2_512(struct digest_direct_pbkdf2_lane_sha2_512 *, size_t, size_t);
+#endif /* ATHEME_DIGEST_HAVE_MB_SHA2 */
+
 #endif /* !ATHEME_INC_DIGEST_DIRECT_H */
@@ -31,6 +31,7 @@ struct myentity
 	char                         id[IDLEN + 1];
 	mowgli_list_t                chanacs;
 	const struct entity_vtable * vtable;
+	unsigned int                 type_slot;     // in its type's table (see entity.c) plus one, or 0
 };
 
 #define entity(x)	((struct myentity *)(x))
@@ -51,10 +52,16 @@ struct myentity *myentity_find(const char *name);
 struct myentity *myentity_find_ext(const char *name);
 struct myentity *myentity_find_uid(const char *uid);
 
+/* Iterating over one type walks that type's table rather than the tree, so
+ * it is in no particular order; only ENT_ANY goes by name. Either way, the
+ * current entity may be deleted.
+ */
 struct myentity_iteration_state
 {
 	mowgli_patricia_iteration_state_t       st;
 	enum myentity_type                      type;
+	unsigned int                            idx;
+	struct myentity *                       cur;
 };
 
 void myentity_foreach(int (*cb)(struct myentity *me, void *privdata), void *privdata);
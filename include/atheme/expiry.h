@@ -0,0 +1,35 @@
+/*
+ * SPDX-License-Identifier: ISC
+ * SPDX-URL: https://spdx.org/licenses/ISC.html
+ *
+ * Copyright (C) 2026 Atheme Development Group (https://atheme.github.io/)
+ *
+ * Expiry scheduling: a binary min-heap of objects keyed on when they next
+ * need to be looked at by expire_check().
+ */
+
+#ifndef ATHEME_INC_EXPIRY_H
+#define ATHEME_INC_EXPIRY_H 1
+
+#include <atheme/stdheaders.h>
+
+struct expiry_timer
+{
+	time_t                  due;
+	unsigned int            slot;   // 1-based position in its queue, 0 if not queued
+	void *                  owner;
+};
+
+struct expiry_queue
+{
+	struct expiry_timer **  heap;
+	unsigned int            count;
+	unsigned int            alloc;
+};
+
+void expiry_queue_schedule(struct expiry_queue *queue, struct expiry_timer *timer, void *owner, time_t due);
+void expiry_queue_cancel(struct expiry_queue *queue, struct expiry_timer *timer);
+void *expiry_queue_pop_due(struct expiry_queue *queue, time_t now);
+void expiry_queue_clear(struct expiry_queue *queue);
+
+#endif /* !ATHEME_INC_EXPIRY_H */
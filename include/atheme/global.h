@@ -27,6 +27,9 @@ struct me
 	char *          adminname;              // SRA's name (for ADMIN)
 	char *          adminemail;             // SRA's email (for ADMIN)
 	char *          mta;                    // path to mta program
+	char *          smtprelay;              // SMTP/LMTP relay to queue email for instead
+	unsigned int    smtpport;
+	bool            lmtp;                   // smtprelay speaks LMTP
 	char *          numeric;                // server numeric
 	int             maxfd;                  // how many fds do we have?
 	unsigned int    mdlimit;                // metadata entry limit
@@ -71,7 +74,16 @@ struct ConfOption
 	unsigned int    vhost_change;           // days in which a user must wait between vhost changes
 	unsigned int    clone_time;             // default expire for clone exemptions
 	unsigned int    commit_interval;        // interval between commits
+	unsigned int    commit_change_threshold; // changes that bring the next commit forward (0 = never)
 	bool            db_save_blocking;       // whether to always use a blocking database commit
+	bool            db_save_threaded;       // whether to write the database in a thread instead of forking
+	unsigned int    db_compress_level;      // gzip level for saved databases, 0 to write them uncompressed
+	bool            db_warm_image;          // write a warm restart image at shutdown, and start from one
+	unsigned int    auth_threads;           // password verification threads (0 = verify on the main thread)
+	unsigned int    auth_processes;         // password verification worker processes (0 = none)
+	unsigned int    password_upgrade_rate;  // password re-encryptions started per minute (0 = no limit)
+	bool            memo_cold_storage;      // keep memo texts on disk instead of in memory
+	bool            io_uring;               // socket I/O through io_uring where the system has it
 	bool            silent;                 // stop sending WALLOPS?
 	bool            join_chans;             // join registered channels?
 	bool            leave_chans;            // leave channels when empty?
@@ -89,7 +101,11 @@ struct ConfOption
 	unsigned int    default_clone_allowed;  // default clone kill
 	unsigned int    default_clone_warn;     // default clone warn
 	bool            clone_increase;         // If the clone limit will increase based on # of identified clones
+	unsigned int    clone_ipv4_prefix;      // Clones are counted per prefix of this length
+	unsigned int    clone_ipv6_prefix;
 	unsigned int    uplink_sendq_limit;
+	unsigned int    uplink_reconcile_time;  // seconds to keep the network state after losing the uplink (0 = never)
+	unsigned int    sendq_pool_limit;       // bytes all other connections' queues may hold together (0 = no limit)
 	char *          language;               // default language
 	mowgli_list_t   exempts;                // List of masks never to automatically kline
 	bool            allow_taint;            // allow tainted operation
@@ -97,6 +113,13 @@ struct ConfOption
 	bool            show_entity_id;         // do not require user:auspex to see entity IDs
 	bool            load_database_mdeps;    // for core module deps listed in DB, whether to load them or abort
 	bool            hide_opers;             // whether or not to hide RPL_WHOISOPERATOR from remote whois
+	unsigned int    slow_command_time;      // log commands that take at least this many milliseconds (0 = never)
+	unsigned int    command_budget;         // milliseconds of commands per event loop pass (0 = unlimited)
+	bool            hook_profiling;         // time every hook handler, see OperServ STATS HOOKS
+	unsigned int    slow_loop_time;         // log event loop iterations that take at least this many milliseconds (0 = never)
+	bool            log_async;              // write log files from a separate thread
+	unsigned int    log_fsync_interval;     // ... and fsync(2) them at most this often, in seconds (0 = never)
+	bool            log_index;              // keep word indexes of the command logs, for GREPLOG
 };
 
 extern struct ConfOption config_options;
@@ -122,6 +145,10 @@ struct cnt
 	unsigned int    node;
 	unsigned int    bin;
 	unsigned int    bout;
+	unsigned int    bout_writes;            // write syscalls made by sendq_flush()
+	unsigned int    bout_written;           // bytes those syscalls wrote
+	unsigned int    sendq;                  // bytes currently queued for sending, on all connections
+	unsigned int    recvq;                  // bytes received and not yet processed, on all connections
 	unsigned int    uplink;
 	unsigned int    operclass;
 	unsigned int    myuser_access;
@@ -162,6 +189,7 @@ void remove_illegals(void);
 extern mowgli_eventloop_t *base_eventloop;
 extern bool cold_start;
 extern bool readonly;
+extern bool replica;
 extern bool offline_mode;
 extern bool permissive_mode;
 extern bool database_create;
@@ -16,10 +16,38 @@
 
 typedef void (*hook_fn)(void *data);
 
+#define HOOK_STATS_BUCKETS      24U
+
+/* Kept for every handler ever added to a hook, and never freed, so that a
+ * handler that removes itself (or unloads its module) can still be counted.
+ * Only updated while config_options.hook_profiling is enabled.
+ */
+struct hook_handler_stats
+{
+	stringref               hook;
+	hook_fn                 handler;
+	char *                  module;     // the module that was loading when it was added, or NULL
+	bool                    installed;
+	unsigned int            calls;
+	unsigned long long      total_us;
+	unsigned long long      max_us;
+	unsigned int            hist[HOOK_STATS_BUCKETS];  // hist[i]: calls taking 2^i to 2^(i+1) usec
+};
+
 struct hook
 {
-	stringref       name;
-	mowgli_list_t   hooks;
+	stringref                       name;
+	hook_fn *                       handlers;   // contiguous, in call order
+	struct hook_handler_stats **    stats;      // parallel to handlers
+	size_t                          count;
+	size_t                          alloc;
+};
+
+// chanacs_replace(): entries of mc holding any of keep were kept, all others replaced
+struct hook_chanacs_replace
+{
+	struct mychan *     mc;
+	unsigned int        keep;
 };
 
 struct hook_channel_acl_req
@@ -100,6 +128,21 @@ struct hook_chanuser_sync
 	const bool         take_prefixes; // Whether temporary prefixes should be removed
 };
 
+enum hook_config_block_change_kind
+{
+	HOOK_CONFIG_BLOCK_ADDED     = 0,
+	HOOK_CONFIG_BLOCK_CHANGED,
+	HOOK_CONFIG_BLOCK_REMOVED,
+};
+
+struct hook_config_block_change
+{
+	const char *                            name;   // e.g. "LDAP" or "LOGFILE"; always upper case
+	const char *                            param;  // what follows the name, e.g. a logfile path, or NULL
+	const char *                            file;
+	enum hook_config_block_change_kind      kind;
+};
+
 struct hook_expiry_req
 {
 	union {
@@ -132,6 +175,13 @@ struct hook_metadata_change
 	char *          value;
 };
 
+struct hook_metadata_req
+{
+	void *          target;
+	const char *    name;
+	const char *    value;      // NULL for metadata_delete
+};
+
 struct hook_module_load
 {
 	const char *    name;       // The module name we're searching for
@@ -147,6 +197,20 @@ struct hook_myentity_req
 	bool                approval;
 };
 
+struct hook_myuser_password
+{
+	struct myuser *         mu;
+	const char *            oldpass;    // mu->pass before the change
+	bool                    oldcrypted; // ... and whether it was MU_CRYPTPASS
+};
+
+struct hook_myuser_purge
+{
+	const char *            owner;      // who started it
+	struct myuser *const *  accounts;   // the accounts about to be dropped
+	unsigned int            count;
+};
+
 struct hook_nick_enforce
 {
 	struct user *   u;
@@ -194,6 +258,12 @@ struct hook_user_needforce
 	int                 allowed;
 };
 
+struct hook_user_netsplit
+{
+	struct server *         s;      // the server that split
+	const mowgli_list_t *   users;  // every user behind it, including on its children
+};
+
 struct hook_user_nick
 {
 	struct user *    u;             // User in question. Write NULL here if you delete the user
@@ -230,6 +300,20 @@ struct hook_user_req
 	struct mynick *     mn;
 };
 
+struct hook *hook_get(const char *);
+void hook_handle_del(struct hook *, hook_fn);
+void hook_handle_add(struct hook *, hook_fn);
+void hook_handle_add_first(struct hook *, hook_fn);
+void hook_handle_dispatch(struct hook *, void *);
+
+/* Resolved-handle dispatch; a hook with no handlers costs a single branch */
+static inline void
+hook_handle_call(struct hook *const hook, void *const dptr)
+{
+	if (hook->count)
+		hook_handle_dispatch(hook, dptr);
+}
+
 void hook_del_hook(const char *, hook_fn);
 void hook_add_hook(const char *, hook_fn);
 void hook_add_hook_first(const char *, hook_fn);
@@ -238,4 +322,7 @@ void hook_call_event(const char *, void *);
 void hook_stop(void);
 void hook_continue(void *newptr);
 
+void hook_stats_foreach(void (*cb)(const struct hook_handler_stats *, void *), void *privdata);
+void hook_stats_dump(void);
+
 #endif /* !ATHEME_INC_HOOK_H */
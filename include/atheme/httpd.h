@@ -10,20 +10,36 @@
 #ifndef ATHEME_INC_HTTPD_H
 #define ATHEME_INC_HTTPD_H 1
 
+#include <atheme/connection.h>
+#include <atheme/datastream.h>
 #include <atheme/stdheaders.h>
 #include <atheme/structures.h>
 
+/* Registered by path in misc/httpd's httpd_path_handlers patricia (a
+ * mowgli_patricia_t *, keyed case-sensitively on the exact path).
+ */
 struct path_handler
 {
 	const char *    path;
 	void          (*handler)(struct connection *, void *);
+	bool            allow_get;      // also called, with a NULL request body, for GET requests
+
+	/* Optional; called as a request body arrives, with [from, to) of
+	 * hd->requestbuf being what has just been added. Returning false
+	 * rejects the request (413) without waiting for the rest of it.
+	 */
+	bool          (*body_progress)(struct connection *, size_t from, size_t to);
 };
 
+#define HTTPD_ENCODING_GZIP     0x00000001U
+#define HTTPD_ENCODING_BR       0x00000002U
+
 struct httpddata
 {
 	char            method[64];
 	char            filename[256];
 	char *          requestbuf;
+	void *          bodystate;      // for the path handler's body_progress; sfree()d with the request
 	char *          replybuf;
 	int             length;
 	int             lengthdone;
@@ -31,6 +47,48 @@ struct httpddata
 	bool            correct_content_type;
 	bool            expect_100_continue;
 	bool            sent_reply;
+	unsigned int    requests;       // requests read on this connection so far
+
+	// For static files; from the request's headers
+	unsigned int    accept_encoding;        // HTTPD_ENCODING_* the client will take
+	char            if_none_match[256];
+	char            if_modified_since[64];
+
+	/* A path handler that will only send its reply later (e.g. once a password
+	 * has been checked) sets 'deferred'; no further requests are read from the
+	 * connection until it calls httpd_deferred_done(). If the connection is
+	 * closed first, 'deferred_cancel' is called instead.
+	 */
+	void *          deferred;
+	void          (*deferred_cancel)(struct connection *, void *);
+
+	/* The reply is an open-ended stream (e.g. of server-sent events) written
+	 * for as long as the connection stays up; such connections are deferred
+	 * and exempt from idle_timeout.
+	 */
+	bool            streaming;
 };
 
+static inline void
+httpd_deferred_done(struct connection *const restrict cptr)
+{
+	struct httpddata *const hd = cptr->userdata;
+
+	hd->deferred = NULL;
+	hd->deferred_cancel = NULL;
+
+	// Carry on with any requests the client pipelined behind the deferred one
+	int len = recvq_length(cptr);
+
+	while (len > 0 && ! hd->deferred && cptr->recvq_handler)
+	{
+		const int prev = len;
+
+		(void) cptr->recvq_handler(cptr);
+
+		if ((len = recvq_length(cptr)) == prev)
+			break;
+	}
+}
+
 #endif /* !ATHEME_INC_HTTPD_H */
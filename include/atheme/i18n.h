@@ -10,6 +10,7 @@
 #ifndef ATHEME_INC_INTL_H
 #define ATHEME_INC_INTL_H 1
 
+#include <atheme/attributes.h>
 #include <atheme/stdheaders.h>
 
 #ifdef ENABLE_NLS
@@ -19,12 +20,15 @@
 #  ifdef HAVE_LIBINTL_H
 #    include <libintl.h>
 #  endif
-#  define _(String)             gettext((String))
+#  define _(String)             language_gettext((String))
 #  ifdef gettext_noop
 #    define N_(String)          gettext_noop((String))
 #  else
 #    define N_(String)          ((String))
 #  endif
+
+// gettext(3) through a cache of the active language's translations, see culture.c
+const char *language_gettext(const char *msgid) ATHEME_FATTR_FORMAT_ARG(1);
 #else
 #  define _(x)                  (x)
 #  define N_(x)                 (x)
@@ -56,7 +56,7 @@ static inline struct myuser *myuser_find_uid(const char *uid)
  */
 static inline struct mynick *mynick_find(const char *name)
 {
-	return name ? mowgli_patricia_retrieve(nicklist, name) : NULL;
+	return name && nickfilter_maybe(name) ? mowgli_patricia_retrieve(nicklist, name) : NULL;
 }
 
 static inline struct myuser *myuser_find_by_nick(const char *name)
@@ -9,6 +9,7 @@
 #define ATHEME_INC_INLINE_CHANNELS_H 1
 
 #include <atheme/channels.h>
+#include <atheme/namehash.h>
 #include <atheme/stdheaders.h>
 
 /*
@@ -28,7 +29,7 @@
  */
 static inline struct channel *channel_find(const char *name)
 {
-	return name ? mowgli_patricia_retrieve(chanlist, name) : NULL;
+	return name ? namehash_find(chanhash, name) : NULL;
 }
 
 /*
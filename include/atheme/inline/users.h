@@ -11,6 +11,24 @@
 #include <atheme/stdheaders.h>
 #include <atheme/users.h>
 
+static inline const char *
+user_gecos(const struct user *const restrict u)
+{
+	return u->cold->gecos;
+}
+
+static inline const char *
+user_chost(const struct user *const restrict u)
+{
+	return u->cold->chost;
+}
+
+static inline const char *
+user_certfp(const struct user *const restrict u)
+{
+	return u->cold->certfp;
+}
+
 static inline bool
 user_is_channel_banned(struct user *const restrict u, const char ban_type)
 {
@@ -0,0 +1,50 @@
+/*
+ * SPDX-License-Identifier: ISC
+ * SPDX-URL: https://spdx.org/licenses/ISC.html
+ *
+ * Copyright (C) 2026 Atheme Development Group (https://atheme.github.io/)
+ *
+ * Word indexes of the command and registration logs, for OperServ GREPLOG.
+ */
+
+#ifndef ATHEME_INC_LOGINDEX_H
+#define ATHEME_INC_LOGINDEX_H 1
+
+#include <atheme/stdheaders.h>
+#include <atheme/structures.h>
+
+// Shortest key worth looking up; shorter words are not indexed at all
+#define LOG_INDEX_KEY_MIN       3U
+
+/* Which lines of a log file could contain a key. Only the bytes from start
+ * up to end are covered by the index, and in there only the lines starting
+ * at offsets (sorted, absolute) need to be looked at; anything before start
+ * or from end on has to be read in full. If indexed is false, there is no
+ * usable index and the whole file has to be read.
+ */
+struct log_index_plan
+{
+	bool                    indexed;
+	uint64_t                start;
+	uint64_t                end;
+	uint64_t *              offsets;
+	size_t                  count;
+};
+
+/* Picks the key to look up for a match() pattern (the longest run of it
+ * that every matching line has to contain within a single word), casefolded.
+ * Returns false if there is none of at least LOG_INDEX_KEY_MIN characters.
+ */
+bool log_index_key(const char *pattern, char *key, size_t keysz);
+
+// For the file an open struct logfile writes to; main thread only
+void log_index_plan_live(struct logfile *lf, const char *key, struct log_index_plan *plan);
+
+/* For an older (rotated) copy of the log file that base is the path of,
+ * found by its inode; this one may be called from any thread.
+ */
+void log_index_plan_file(const char *base, const char *path, const char *key, struct log_index_plan *plan);
+
+void log_index_plan_free(struct log_index_plan *plan);
+
+#endif /* !ATHEME_INC_LOGINDEX_H */
@@ -0,0 +1,33 @@
+/*
+ * SPDX-License-Identifier: ISC
+ * SPDX-URL: https://spdx.org/licenses/ISC.html
+ *
+ * Copyright (C) 2026 Atheme Development Group (https://atheme.github.io/)
+ *
+ * Outgoing email, queued and handed to an SMTP or LMTP relay over a
+ * connection on the event loop instead of a forked MTA per message.
+ */
+
+#ifndef ATHEME_INC_MAILQUEUE_H
+#define ATHEME_INC_MAILQUEUE_H 1
+
+#include <atheme/stdheaders.h>
+
+struct mailqueue_stats
+{
+	unsigned int            queued;         // waiting or being sent right now
+	unsigned long long      submitted;
+	unsigned long long      delivered;
+	unsigned long long      deferred;       // temporary failures, retried later
+	unsigned long long      failed;         // rejected, or given up on
+	unsigned long long      connections;
+};
+
+extern struct mailqueue_stats mailqueue_stats;
+
+/* Queues a message; body is the rendered message, headers included, with
+ * lines ending in \n. Returns false if the queue is full.
+ */
+bool mailqueue_submit(const char *sender, const char *rcpt, const char *body, size_t len);
+
+#endif /* !ATHEME_INC_MAILQUEUE_H */
@@ -14,31 +14,73 @@
 #include <atheme/attributes.h>
 #include <atheme/stdheaders.h>
 
-#ifdef HAVE_LIBPCRE
+#ifdef HAVE_LIBPCRE2
+#  define PCRE2_CODE_UNIT_WIDTH 8
+#  include <pcre2.h>
+#elif defined(HAVE_LIBPCRE)
 #  include <pcre.h>
 #endif
 
 enum atheme_regex_type
 {
 	at_posix = 1,
-	at_pcre = 2
+	at_pcre = 2,
+	at_pcre2 = 3
 };
 
 struct atheme_regex
 {
 	enum atheme_regex_type  type;
+	bool                    jit;            // compiled to machine code by PCRE2
 	union {
 		regex_t         posix;
-#ifdef HAVE_LIBPCRE
+#ifdef HAVE_LIBPCRE2
+		pcre2_code *    pcre2;
+#elif defined(HAVE_LIBPCRE)
 		pcre *          pcre;
 #endif
 	} un;
 };
 
+struct cidr_addr
+{
+	int             family;         // AF_INET or AF_INET6
+	unsigned int    prefixlen;
+	unsigned char   addr[16];
+};
+
+struct cidr_tree_node
+{
+	struct cidr_tree_node * parent;
+	struct cidr_tree_node * child[2];
+	mowgli_list_t           entries;
+	int                     family;
+	unsigned int            bitlen;
+	unsigned char           prefix[16];
+};
+
+struct cidr_tree
+{
+	struct cidr_tree_node * root4;
+	struct cidr_tree_node * root6;
+};
+
 /* cidr.c */
 int match_ips(const char *mask, const char *address);
 int match_cidr(const char *mask, const char *address);
 
+bool cidr_parse_mask(const char *mask, struct cidr_addr *ca);
+bool cidr_parse_address(const char *address, struct cidr_addr *ca);
+bool cidr_contains(const struct cidr_addr *net, const struct cidr_addr *addr);
+bool cidr_parse_hostmask(const char *mask, struct cidr_addr *ca);
+int match_cidr_parsed(const char *mask, const struct cidr_addr *net, const char *address, const struct cidr_addr *addr);
+
+struct cidr_tree *cidr_tree_create(void) ATHEME_FATTR_MALLOC;
+void cidr_tree_destroy(struct cidr_tree *tree);
+struct cidr_tree_node *cidr_tree_add(struct cidr_tree *tree, const struct cidr_addr *ca, void *data, mowgli_node_t *n);
+void cidr_tree_delete(struct cidr_tree *tree, struct cidr_tree_node *node, mowgli_node_t *n);
+void cidr_tree_foreach_match(struct cidr_tree *tree, const struct cidr_addr *ca, void (*cb)(mowgli_list_t *entries, void *privdata), void *privdata);
+
 /* match.c */
 #define MATCH_RFC1459   0
 #define MATCH_ASCII     1
@@ -80,14 +122,46 @@ void noopcanon(char *);
 int match(const char *, const char *);
 char *collapse(char *);
 
+/* A mask taken apart by match_compile(), for masks matched many times over */
+struct match_pattern
+{
+	char *          mask;           // the original mask, for the full match()
+	char *          prefix;         // casefolded literal run before the first wildcard
+	char *          suffix;         // casefolded literal run after the last wildcard
+	char *          inner;          // longest casefolded literal run in between
+	size_t          prefixlen;
+	size_t          suffixlen;
+	size_t          innerlen;
+	size_t          minlen;         // shortest name that could possibly match
+	int             mapping;        // match_mapping the runs were folded with
+	bool            fixedlen;       // no '*', so name length must equal minlen
+	bool            literal;        // no wildcards at all
+	bool            matchall;       // the mask is just "*"
+};
+
+struct match_pattern *match_compile(const char *mask) ATHEME_FATTR_MALLOC;
+int match_compiled(const struct match_pattern *mp, const char *name);
+void match_pattern_free(struct match_pattern *mp);
+
 /* regex_create() flags */
 #define AREGEX_ICASE	1 /* case insensitive */
 #define AREGEX_PCRE	2 /* use libpcre engine */
 #define AREGEX_KLINE	4 /* XXX for rwatch, match kline */
+#define AREGEX_NOJIT	8 /* don't JIT-compile a PCRE2 pattern */
 
 struct atheme_regex *regex_create(char *pattern, int flags) ATHEME_FATTR_MALLOC;
 char *regex_extract(char *pattern, char **pend, int *pflags);
 bool regex_match(struct atheme_regex *preg, char *string);
 bool regex_destroy(struct atheme_regex *preg);
 
+/* A set of regexes that are all matched against the same strings. See
+ * regex_set_create() in match.c.
+ */
+struct regex_set;
+
+struct regex_set *regex_set_create(char *const *patterns, const int *flags, struct atheme_regex *const *regexes,
+                                   size_t count) ATHEME_FATTR_MALLOC;
+void regex_set_match(const struct regex_set *set, char *string, bool *matches);
+void regex_set_destroy(struct regex_set *set);
+
 #endif /* !ATHEME_INC_MATCH_H */
@@ -19,6 +19,8 @@
 extern void *(* volatile volatile_memset)(void *, int, size_t);
 #endif /* !HAVE_MEMSET_S && !HAVE_EXPLICIT_BZERO && !HAVE_LIBSODIUM_MEMZERO */
 
+// Calls to scalloc() (and so smalloc()) and srealloc(); for benchmarks, and not kept atomically
+extern unsigned long long memory_allocations;
 
 
 int smemcmp(const void *ptr1, const void *ptr2, size_t len)
@@ -0,0 +1,35 @@
+/*
+ * SPDX-License-Identifier: ISC
+ * SPDX-URL: https://spdx.org/licenses/ISC.html
+ *
+ * Copyright (C) 2026 Atheme Development Group (https://atheme.github.io/)
+ *
+ * Memo texts, either held in memory or (with general::memo_cold_storage)
+ * kept in an append-only file next to the database and read back when
+ * they are needed.
+ */
+
+#ifndef ATHEME_INC_MEMOSTORE_H
+#define ATHEME_INC_MEMOSTORE_H 1
+
+#include <atheme/stdheaders.h>
+#include <atheme/structures.h>
+
+// Sets the text of a new memo for owner (who receives it)
+void memo_set_text(struct mymemo *memo, const struct myuser *owner, const char *text);
+
+/* The text of a memo; if it has to be read from the memo store, the result
+ * is only valid until the next call.
+ */
+const char *memo_text(const struct mymemo *memo);
+
+void memo_free(struct mymemo *memo);
+
+// For the database backends
+unsigned int memostore_generation(void);
+bool memostore_in_use(void);
+void memostore_set_generation(unsigned int gen);
+bool memo_set_stored(struct mymemo *memo, uint64_t offset, unsigned int len);
+void memostore_sync(void);
+
+#endif /* !ATHEME_INC_MEMOSTORE_H */
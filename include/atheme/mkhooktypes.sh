@@ -29,20 +29,37 @@ while read hook type; do
 	[#]*|:)
 		continue
 		;;
-	*:void)
-		echo "#define hook_call_$hook() hook_call_event(\"$hook\", NULL)"
+	esac
+
+	# Each translation unit resolves the handle once, on first use.
+	echo "static inline struct hook *"
+	echo "hook_handle_$hook(void)"
+	echo "{"
+	echo "	static struct hook *handle = NULL;"
+	echo
+	echo "	if (handle == NULL)"
+	echo "		handle = hook_get(\"$hook\");"
+	echo
+	echo "	return handle;"
+	echo "}"
+
+	case $type in
+	void)
+		echo "#define hook_call_$hook() hook_handle_call(hook_handle_$hook(), NULL)"
 		# Still require a dummy void * function parameter here.
-		echo "#define hook_add_$hook(f) hook_add_hook(\"$hook\", f)"
-		echo "#define hook_add_first_$hook(f) hook_add_hook_first(\"$hook\", f)"
-		echo "#define hook_del_$hook(f) hook_del_hook(\"$hook\", f)"
+		echo "#define hook_add_$hook(f) hook_handle_add(hook_handle_$hook(), f)"
+		echo "#define hook_add_first_$hook(f) hook_handle_add_first(hook_handle_$hook(), f)"
+		echo "#define hook_del_$hook(f) hook_handle_del(hook_handle_$hook(), f)"
 		;;
 	*)
-		echo "#define hook_call_$hook(x) hook_call_event(\"$hook\", ENSURE_TYPE(x, $type))"
-		echo "#define hook_add_$hook(f) hook_add_hook(\"$hook\", (void (*)(void *))ENSURE_TYPE(f, void (*)($type)))"
-		echo "#define hook_add_first_$hook(f) hook_add_hook_first(\"$hook\", (void (*)(void *))ENSURE_TYPE(f, void (*)($type)))"
-		echo "#define hook_del_$hook(f) hook_del_hook(\"$hook\", (void (*)(void *))ENSURE_TYPE(f, void (*)($type)))"
+		echo "#define hook_call_$hook(x) hook_handle_call(hook_handle_$hook(), ENSURE_TYPE(x, $type))"
+		echo "#define hook_add_$hook(f) hook_handle_add(hook_handle_$hook(), (void (*)(void *))ENSURE_TYPE(f, void (*)($type)))"
+		echo "#define hook_add_first_$hook(f) hook_handle_add_first(hook_handle_$hook(), (void (*)(void *))ENSURE_TYPE(f, void (*)($type)))"
+		echo "#define hook_del_$hook(f) hook_handle_del(hook_handle_$hook(), (void (*)(void *))ENSURE_TYPE(f, void (*)($type)))"
 		;;
 	esac
+
+	echo
 done < "$1"
 
 echo
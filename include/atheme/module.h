@@ -79,6 +79,14 @@ bool module_request(const char *name);
 // Located in libathemecore/module.c
 extern mowgli_list_t modules;
 
+// Located in libathemecore/lazymodule.c
+struct module_lazy;
+struct module_lazy *module_lazy_declare(const char *path);
+void module_lazy_add_command(struct module_lazy *ml, const char *svsname, const char *name);
+void module_lazy_add_row(struct module_lazy *ml, const char *type);
+bool module_lazy_arm(struct module_lazy *ml, const char *access, const char *desc);
+bool module_lazy_declared(const char *name, bool *has_rows);
+
 #define DECLARE_MODULE_V1(_name, _ucap, _modinit, _moddeinit, _ver, _ven)  \
         extern const struct v4_moduleheader _header;                       \
         const struct v4_moduleheader _header = {                           \
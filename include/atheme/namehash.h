@@ -0,0 +1,45 @@
+/*
+ * SPDX-License-Identifier: ISC
+ * SPDX-URL: https://spdx.org/licenses/ISC.html
+ *
+ * Copyright (C) 2026 Atheme Development Group (https://atheme.github.io/)
+ *
+ * Open-addressing hash tables for point lookups of nicknames, UIDs and
+ * channel names. The patricia trees stay where ordered iteration is wanted.
+ */
+
+#ifndef ATHEME_INC_NAMEHASH_H
+#define ATHEME_INC_NAMEHASH_H 1
+
+#include <atheme/stdheaders.h>
+#include <atheme/structures.h>
+
+struct namehash_slot
+{
+	const char *    key;            // NULL if the slot is empty; owned by the value
+	void *          value;
+	unsigned int    hash;           // of the key, casefolded if the table folds
+};
+
+struct namehash
+{
+	struct namehash_slot *  slots;
+	unsigned int            mask;   // number of slots minus one
+	unsigned int            count;
+	bool                    fold;   // compare keys through the IRC casemapping
+};
+
+// The hash these tables use, for anything else that has to agree with them
+unsigned int namehash_key(const char *key, bool fold);
+
+struct namehash *namehash_create(bool fold);
+void namehash_destroy(struct namehash *h);
+
+/* The key is not copied; it must stay valid (and unchanged) for as long as
+ * the entry is in the table, so delete before changing it.
+ */
+void namehash_add(struct namehash *h, const char *key, void *value);
+bool namehash_delete(struct namehash *h, const char *key, const void *value);
+void *namehash_find(const struct namehash *h, const char *key);
+
+#endif /* !ATHEME_INC_NAMEHASH_H */
@@ -0,0 +1,67 @@
+/*
+ * SPDX-License-Identifier: ISC
+ * SPDX-URL: https://spdx.org/licenses/ISC.html
+ *
+ * Copyright (C) 2026 Atheme Development Group (https://atheme.github.io/)
+ *
+ * Network size over time (users, channels, servers), kept up to date from
+ * hooks and downsampled into fixed-size rings of per-minute, per-hour and
+ * per-day samples.
+ */
+
+#ifndef ATHEME_INC_NETSTATS_H
+#define ATHEME_INC_NETSTATS_H 1
+
+#include <atheme/stdheaders.h>
+
+enum netstats_metric
+{
+	NETSTATS_USERS          = 0,
+	NETSTATS_CHANNELS       = 1,
+	NETSTATS_SERVERS        = 2,
+	NETSTATS_METRIC_COUNT
+};
+
+enum netstats_resolution
+{
+	NETSTATS_MINUTE         = 0,
+	NETSTATS_HOUR           = 1,
+	NETSTATS_DAY            = 2,
+	NETSTATS_RESOLUTION_COUNT
+};
+
+// How many samples of each resolution are kept
+#define NETSTATS_MINUTES        180U
+#define NETSTATS_HOURS          168U
+#define NETSTATS_DAYS           366U
+
+struct netstats_value
+{
+	unsigned int    last;           // at the end of the period
+	unsigned int    peak;
+	unsigned int    added;
+	unsigned int    removed;
+};
+
+struct netstats_sample
+{
+	time_t                  start;
+	time_t                  end;
+	struct netstats_value   values[NETSTATS_METRIC_COUNT];
+};
+
+const char *netstats_metric_name(enum netstats_metric metric);
+const char *netstats_resolution_name(enum netstats_resolution res);
+bool netstats_resolution_parse(const char *name, enum netstats_resolution *res);
+unsigned int netstats_resolution_size(enum netstats_resolution res);
+
+/* The period in progress, as of now for minutes and as of the last whole
+ * minute for hours and days; returns false if it has not started yet.
+ */
+bool netstats_current(enum netstats_resolution res, struct netstats_sample *sample);
+
+// Calls cb on up to max finished samples, newest first; returns how many
+unsigned int netstats_history_foreach(enum netstats_resolution res, unsigned int max,
+                                      void (*cb)(const struct netstats_sample *, void *), void *privdata);
+
+#endif /* !ATHEME_INC_NETSTATS_H */
@@ -19,14 +19,46 @@ struct metadata
 	char *          value;
 };
 
+/* Objects carrying only a few keys keep them in a small array sorted by
+ * name; past METADATA_INLINE_MAX keys they are moved to a patricia.
+ */
+#define METADATA_INLINE_MAX     6U
+
+struct metadata_table
+{
+	unsigned int            count;
+	unsigned int            alloc;
+	mowgli_patricia_t *     tree;
+	struct metadata *       entries[];
+};
+
+struct metadata_iteration_state
+{
+	mowgli_patricia_iteration_state_t       st;
+	const struct atheme_object *            obj;
+	const struct metadata_table *           table;
+	bool                                    tree;
+	struct metadata *                       cur;
+	unsigned int                            idx;
+};
+
+/* Per-object module state, by the slot that privatedata_slot_register() gave
+ * out for the module's key; grown on demand, up to the highest slot set.
+ */
+struct privatedata_table
+{
+	unsigned int            size;
+	void *                  slots[];
+};
+
 typedef void (*atheme_object_destructor_fn)(void *);
 
 struct atheme_object
 {
 	int                             refcount;
 	atheme_object_destructor_fn     destructor;
-	mowgli_patricia_t *             metadata;
-	mowgli_patricia_t *             privatedata;
+	struct metadata_table *         metadata;
+	struct privatedata_table *      privatedata;
 #ifdef OBJECT_DEBUG
 	mowgli_node_t                   dnode;
 #endif
@@ -44,7 +76,23 @@ struct metadata *metadata_add(void *target, const char *name, const char *value)
 void metadata_delete(void *target, const char *name);
 struct metadata *metadata_find(void *target, const char *name);
 void metadata_delete_all(void *target);
+unsigned int metadata_count(void *target);
+
+void metadata_foreach_start(struct metadata_iteration_state *state, void *target);
+void metadata_foreach_next(struct metadata_iteration_state *state);
+struct metadata *metadata_foreach_cur(struct metadata_iteration_state *state);
+
+/* The current entry may be deleted while iterating, but nothing may be
+ * added: that can move the table, or turn it into a patricia, and the
+ * iteration then stops early.
+ */
+#define METADATA_FOREACH(md, state, target) for (metadata_foreach_start(state, target); (md = metadata_foreach_cur(state)); metadata_foreach_next(state))
+
+unsigned int privatedata_slot_register(const char *key);
+void *privatedata_slot_get(void *target, unsigned int slot);
+void privatedata_slot_set(void *target, unsigned int slot, void *data);
 
+// The same, looking the slot up by name each time
 void *privatedata_get(void *target, const char *key);
 void privatedata_set(void *target, const char *key, void *data);
 
@@ -102,6 +102,11 @@ extern void (*wallops_sts)(const char *text);
  * modes is a convenience argument giving the simple modes with parameters
  * do not rely upon chanuser_find(c,u) */
 extern void (*join_sts)(struct channel *c, struct user *u, bool isnew, char *modes);
+/* join a client on the services server to several channels at once, in
+ * as few lines as the ircd allows; isnew[i] and the modes are as for
+ * join_sts() for each channel
+ * the default calls join_sts() for each of them */
+extern void (*join_batch_sts)(struct user *u, struct channel **chans, const bool *isnew, size_t count);
 /* lower the TS of a channel, joining it with the given client on the
  * services server (opped), replacing the current simple modes with the
  * ones stored in the struct channel and clearing all other statuses
@@ -112,6 +117,12 @@ extern void (*chan_lowerts)(struct channel *c, struct user *u);
  * source is a client on the services server which may or may not be
  * on the channel */
 extern void (*kick)(struct user *source, struct channel *c, struct user *u, const char *reason);
+/* kick several users from a channel with the same reason, in as few lines
+ * as the ircd allows, removing them from it as kick() does
+ * none of them are clients on the services server, so the channel stays
+ * until the last of them is removed
+ * the default calls kick() for each of them */
+extern void (*kick_batch_sts)(struct user *source, struct channel *c, struct user **users, size_t count, const char *reason);
 /* send a privmsg
  * here it's ok to assume the source is able to send */
 extern void (*msg)(const char *from, const char *target, const char *fmt, ...) ATHEME_FATTR_PRINTF(3, 4);
@@ -231,6 +242,9 @@ extern void (*sasl_mechlist_sts)(const char *mechlist);
 extern bool (*mask_matches_user)(const char *mask, struct user *u);
 /* find next channel ban (or other ban-like mode) matching user */
 extern mowgli_node_t *(*next_matching_ban)(struct channel *c, struct user *u, int type, mowgli_node_t *first);
+/* find all channel bans of any of the given types matching user, in one pass;
+ * bans must have room for every entry of c->bans. returns how many there were */
+extern size_t (*matching_bans)(struct channel *c, struct user *u, const char *types, struct chanban **bans);
 /* find next host channel access matching user */
 extern mowgli_node_t *(*next_matching_host_chanacs)(struct mychan *mc, struct user *u, mowgli_node_t *first);
 /* check a nickname for validity; normally you don't need to override this */
@@ -266,8 +280,10 @@ void generic_invite_sts(struct user *source, struct user *target, struct channel
 void generic_quit_sts(struct user *u, const char *reason);
 void generic_wallops_sts(const char *text);
 void generic_join_sts(struct channel *c, struct user *u, bool isnew, char *modes);
+void generic_join_batch_sts(struct user *u, struct channel **chans, const bool *isnew, size_t count);
 void generic_chan_lowerts(struct channel *c, struct user *u);
 void generic_kick(struct user *source, struct channel *c, struct user *u, const char *reason);
+void generic_kick_batch_sts(struct user *source, struct channel *c, struct user **users, size_t count, const char *reason);
 void generic_msg(const char *from, const char *target, const char *fmt, ...) ATHEME_FATTR_PRINTF(3, 4);
 void generic_msg_global_sts(struct user *from, const char *mask, const char *text);
 void generic_notice_user_sts(struct user *from, struct user *target, const char *text);
@@ -296,7 +312,9 @@ void generic_svslogin_sts(const char *target, const char *nick, const char *user
 void generic_sasl_sts(const char *target, char mode, const char *data);
 void generic_sasl_mechlist_sts(const char *mechlist);
 bool generic_mask_matches_user(const char *mask, struct user *u);
+bool generic_mask_matches_user_parsed(const char *mask, const struct cidr_addr *net, struct user *u);
 mowgli_node_t *generic_next_matching_ban(struct channel *c, struct user *u, int type, mowgli_node_t *first);
+size_t generic_matching_bans(struct channel *c, struct user *u, const char *types, struct chanban **bans);
 mowgli_node_t *generic_next_matching_host_chanacs(struct mychan *mc, struct user *u, mowgli_node_t *first);
 bool generic_is_valid_host(const char *host);
 bool generic_is_valid_nick(const char *nick);
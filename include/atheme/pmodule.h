@@ -20,6 +20,12 @@ struct proto_cmd
 	void  (*handler)(struct sourceinfo *si, int parc, char *parv[]);
 	int     minparc;
 	int     sourcetype;
+
+	// Counted by the transport's parser; for STATS P and the metrics module
+	unsigned long long      lines;
+	unsigned long long      bytes;      // whole lines, without the terminator
+	unsigned long long      total_us;   // time spent in the handler
+	unsigned long long      max_us;
 };
 
 /* values for sourcetype */
@@ -30,7 +36,7 @@ struct proto_cmd
 #define MAXPARC		35 /* max # params to protocol command */
 
 /* pmodule.c */
-extern mowgli_heap_t *pcommand_heap;
+extern struct named_heap *pcommand_heap;
 extern mowgli_heap_t *messagetree_heap;
 extern mowgli_patricia_t *pcommands;
 
@@ -40,6 +46,8 @@ void pcommand_add(const char *token,
 	int minparc, int sourcetype);
 void pcommand_delete(const char *token);
 struct proto_cmd *pcommand_find(const char *token);
+void pcommand_dispatch(struct proto_cmd *pcmd, struct sourceinfo *si, int parc, char *parv[]);
+void pcommand_stats_foreach(void (*cb)(const struct proto_cmd *, void *), void *privdata);
 
 /* ptasks.c */
 const char *get_build_date(void);
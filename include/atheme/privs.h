@@ -69,6 +69,8 @@ struct operclass
 	char *          privs;  // priv1 priv2 priv3...
 	int             flags;
 	mowgli_node_t   node;
+	uint64_t *      privset;        // privs as a bitset of interned privilege IDs
+	unsigned int    privset_words;
 };
 
 #define OPERCLASS_NEEDOPER	0x1U /* only give privs to IRCops */
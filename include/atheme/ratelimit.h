@@ -0,0 +1,32 @@
+/*
+ * SPDX-License-Identifier: ISC
+ * SPDX-URL: https://spdx.org/licenses/ISC.html
+ *
+ * Copyright (C) 2026 Atheme Development Group (https://atheme.github.io/)
+ *
+ * Rate limiting with the generic cell rate algorithm: O(1) per event, and
+ * fixed-size state that can be embedded in whatever is being limited.
+ */
+
+#ifndef ATHEME_INC_RATELIMIT_H
+#define ATHEME_INC_RATELIMIT_H 1
+
+#include <atheme/stdheaders.h>
+
+// The cost of one event; costs may be fractions or multiples of this
+#define RATELIMIT_UNIT          256U
+
+/* All zeroes is a limiter that has seen nothing, so it needs no setting up.
+ * A limit of `count' events per `period' seconds lets `count' events through
+ * at once, and after that one every period / count seconds.
+ */
+struct ratelimit
+{
+	unsigned long long      tat;            // Theoretical arrival time, in microseconds
+};
+
+bool ratelimit_take(struct ratelimit *rl, unsigned int cost, unsigned int count, unsigned int period);
+void ratelimit_charge(struct ratelimit *rl, unsigned int cost, unsigned int count, unsigned int period);
+void ratelimit_reset(struct ratelimit *rl);
+
+#endif /* !ATHEME_INC_RATELIMIT_H */
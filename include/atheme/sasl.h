@@ -16,6 +16,7 @@
 #include <atheme/sourceinfo.h>
 #include <atheme/stdheaders.h>
 #include <atheme/structures.h>
+#include <atheme/timerwheel.h>
 
 // Maximum number of parameters for an SASL S2S command (arbitrary, increment in future if necessary)
 #define SASL_MESSAGE_MAXPARA            8
@@ -27,14 +28,18 @@
 #define SASL_S2S_MAXLEN_ATONCE_RAW      300U
 #define SASL_S2S_MAXLEN_ATONCE_B64      400U
 
+// How long a session may go without making progress before it is abandoned
+#define SASL_SESSION_TIMEOUT            SECONDS_PER_MINUTE
+
 // Maximum length of data that can be buffered as one message/request
 #define SASL_S2S_MAXLEN_TOTAL_RAW       3072U
 #define SASL_S2S_MAXLEN_TOTAL_B64       4096U
 
 // Flags for sasl_session->flags
 #define ASASL_SFLAG_NONE                0x00000000U // Nothing special
-#define ASASL_SFLAG_MARKED_FOR_DELETION 0x00000001U // See sasl_delete_stale() in modules/saslserv/main.c
 #define ASASL_SFLAG_CLIENT_USING_TLS    0x00000002U // The client is connected to the network via TLS
+#define ASASL_SFLAG_ASYNC_PENDING       0x00000004U // The mechanism returned ASASL_MRESULT_ASYNC and has not finished
+#define ASASL_SFLAG_OUTCOME_COUNTED     0x00000008U // The session's outcome has been added to its mechanism's stats
 
 // Flags for sasl_input_buf->flags
 #define ASASL_INFLAG_NONE               0x00000000U // Nothing special
@@ -52,6 +57,7 @@ struct sasl_session
 	struct server *                 server;                 // Server they're on
 	struct sourceinfo *             si;                     // The source info for logcommand(), bad_password(), and login hooks
 	void *                          mechdata;               // Mechanism-specific allocated memory
+	void *                          pwreq;                  // Outstanding verify_password_async() request (if any)
 	char *                          certfp;                 // TLS client certificate fingerprint (if any)
 	char *                          host;                   // Hostname
 	char *                          ip;                     // IP address
@@ -63,6 +69,46 @@ struct sasl_session
 	char                            authceid[IDLEN + 1];    // Entity ID for authcid
 	char                            authzeid[IDLEN + 1];    // Entity ID for authzid
 	char                            uid[UIDLEN + 1];        // Network UID
+	struct timerwheel_entry         expire_timer;           // Abandons the session if it makes no progress
+	struct sasl_mech_stats *        mstats;                 // Figures for the mechanism they're using
+	struct timeval                  mech_started;           // When they chose the mechanism
+	struct timeval                  step_started;           // When the step in progress was handed to it
+	unsigned long long              server_us;              // Time spent in the mechanism's steps so far
+};
+
+// Kept by saslserv/main as sasl_session_stats
+struct sasl_session_stats
+{
+	unsigned int                    active;
+	unsigned int                    peak;
+	unsigned long long              started;
+	unsigned long long              timed_out;              // no progress for SASL_SESSION_TIMEOUT seconds
+};
+
+#define SASL_MECH_STATS_BUCKETS         24U
+
+/* Kept by saslserv/main in the sasl_mech_stats list, one for each mechanism
+ * name that has been registered since it was loaded (they outlive the
+ * mechanism's module). Exchanges are timed from the client choosing the
+ * mechanism to the outcome; server time is the part of that spent in the
+ * mechanism's steps, including any asynchronous work such as password
+ * verification or an external authentication server.
+ */
+struct sasl_mech_stats
+{
+	mowgli_node_t                   node;
+	char                            name[SASL_MECHANISM_MAXLEN];
+	unsigned long long              started;
+	unsigned long long              steps;
+	unsigned long long              succeeded;
+	unsigned long long              failed;                 // bad credentials
+	unsigned long long              errored;                // malformed exchanges, or the login was refused
+	unsigned long long              aborted;                // by the client, or the mechanism unloaded
+	unsigned long long              timed_out;
+	unsigned long long              total_us;               // sum of exchange times, for completed sessions
+	unsigned long long              server_us;              // sum of server times, likewise
+	unsigned int                    hist[SASL_MECH_STATS_BUCKETS];          // hist[i]: 2^i to 2^(i+1) usec
+	unsigned int                    server_hist[SASL_MECH_STATS_BUCKETS];
 };
 
 struct sasl_sourceinfo
@@ -100,6 +146,7 @@ enum sasl_mechanism_result
 	ASASL_MRESULT_FAILURE   = 2,    // Client supplied invalid credentials; run bad_password() on the target
 	ASASL_MRESULT_CONTINUE  = 3,    // Everything looks good so far, but we need more data from the client
 	ASASL_MRESULT_SUCCESS   = 4,    // The client has successfully authenticated
+	ASASL_MRESULT_ASYNC     = 5,    // The result is not known yet; the mechanism will call mech_async_done()
 };
 
 typedef enum sasl_mechanism_result (*sasl_mech_start_fn)(struct sasl_session *restrict,
@@ -110,12 +157,21 @@ typedef enum sasl_mechanism_result (*sasl_mech_step_fn)(struct sasl_session *res
 
 typedef void (*sasl_mech_finish_fn)(struct sasl_session *);
 
+/* Called when a session goes away while a step's ASASL_MRESULT_ASYNC is
+ * still outstanding, before mech_finish. Only needed by mechanisms that
+ * start asynchronous work of their own (ECDSA-NIST256P-CHALLENGE cancels
+ * its crypto job); a password check started with mech_verify_password()
+ * is cancelled by SaslServ itself, so PLAIN does not set it.
+ */
+typedef void (*sasl_mech_cancel_fn)(struct sasl_session *);
+
 struct sasl_mechanism
 {
 	char                name[SASL_MECHANISM_MAXLEN];
 	sasl_mech_start_fn  mech_start;
 	sasl_mech_step_fn   mech_step;
 	sasl_mech_finish_fn mech_finish;
+	sasl_mech_cancel_fn mech_cancel;        // Abandon work started by a step that returned ASASL_MRESULT_ASYNC
 	bool                password_based;
 };
 
@@ -129,6 +185,8 @@ struct sasl_core_functions
 	sasl_authxid_can_login_fn   authcid_can_login;
 	sasl_authxid_can_login_fn   authzid_can_login;
 	void                      (*recalc_mechlist)(const struct sasl_session *, const struct myuser *, const char **);
+	void                      (*mech_async_done)(struct sasl_session *, enum sasl_mechanism_result);
+	enum sasl_mechanism_result (*mech_verify_password)(struct sasl_session *, struct myuser *, const char *);
 };
 
 #endif /* !ATHEME_INC_SASL_H */
@@ -28,6 +28,10 @@ struct server
 	struct server * uplink;         // uplink server
 	mowgli_list_t   children;       // children linked to me
 	mowgli_list_t   userlist;       // users attached to me
+	mowgli_list_t   burstq_users;   // enforcement deferred until EOB (see burst.c)
+	mowgli_list_t   burstq_chanusers;
+	struct user **  p10_clients;    // by client numeric, on P10 networks (see servers.c)
+	unsigned int    p10_clients_size;
 };
 
 #define SF_HIDE        0x00000001U
@@ -35,6 +39,7 @@ struct server
 #define SF_EOB2        0x00000004U /* Is EOB but an uplink is not (for P10) */
 #define SF_JUPE_PENDING 0x00000008U /* Sent SQUIT request, will introduce jupe when it dies (unconnect semantics) */
 #define SF_MASKED      0x00000010U /* Is masked, has no own name (for ircnet) */
+#define SF_STALE       0x00000020U /* Linked before the uplink was lost, not introduced again yet */
 
 /* tld list struct */
 struct tld
@@ -58,5 +63,21 @@ struct tld *tld_find(const char *name);
 struct server *server_add(const char *name, unsigned int hops, struct server *uplink, const char *id, const char *desc);
 void server_delete(const char *name);
 struct server *server_find(const char *name);
+void server_mark_stale(void);
+unsigned int server_purge_stale(void);
+
+/* burst.c */
+typedef void (*burst_user_fn)(struct user *);
+typedef void (*burst_chanuser_fn)(struct chanuser *);
+
+void init_burst(void);
+
+bool burst_defer_user(struct user *u, burst_user_fn fn);
+bool burst_defer_chanuser(struct chanuser *cu, burst_chanuser_fn fn);
+void burst_forget_user(struct user *u);
+void burst_forget_chanuser(struct chanuser *cu);
+void burst_cancel_user_fn(burst_user_fn fn);
+void burst_cancel_chanuser_fn(burst_chanuser_fn fn);
+void burst_run(struct server *s);
 
 #endif /* !ATHEME_INC_SERVERS_H */
@@ -80,10 +80,14 @@ unsigned int remove_ban_exceptions(struct user *source, struct channel *chan, st
 
 bool try_kick_real(struct user *source, struct channel *chan, struct user *target, const char *reason);
 extern bool (*try_kick)(struct user *source, struct channel *chan, struct user *target, const char *reason);
+unsigned int kick_users_real(struct user *source, struct channel *chan, struct user **targets, size_t count, const char *reason);
+extern unsigned int (*kick_users)(struct user *source, struct channel *chan, struct user **targets, size_t count, const char *reason);
 
 void kill_user(struct user *source, struct user *victim, const char *fmt, ...) ATHEME_FATTR_PRINTF(3, 4);
 void introduce_enforcer(const char *nick);
 void join(const char *chan, const char *nick);
+typedef void (*join_queued_fn)(struct channel *c, struct user *u);
+void join_queue(const char *chan, const char *nick, join_queued_fn joined);
 void joinall(const char *name);
 void part(const char *chan, const char *nick);
 void partall(const char *name);
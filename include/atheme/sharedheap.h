@@ -22,7 +22,69 @@ struct sharedheap
 	size_t                  size;
 };
 
+/* A named heap is a view onto a shared heap that counts what it has handed
+ * out, so that memory use can be broken down by what it is used for even
+ * when the underlying heap is shared by several object types.
+ */
+struct named_heap
+{
+	mowgli_node_t           node;
+	mowgli_heap_t *         heap;       // NULL for named_heap_get_external()
+	char *                  name;
+	size_t                  size;       // element size
+	size_t                  block_elems; // objects per block of the underlying heap
+	size_t                  live;       // objects currently allocated
+	size_t                  peak;
+	unsigned long long      allocs;     // objects ever allocated
+	unsigned int            refcount;
+
+	// Freed with named_heap_free_deferred() and not yet handed back; chained through their first word
+	void *                  deferred;
+	size_t                  deferred_count;
+	mowgli_node_t           deferred_node;
+};
+
+struct named_heap_deferred_stats
+{
+	size_t                  pending;    // objects waiting to be handed back to their heaps
+	size_t                  peak;
+	unsigned long long      reclaimed;
+};
+
+extern struct named_heap_deferred_stats named_heap_deferred;
+
 mowgli_heap_t *sharedheap_get(size_t size);
 void sharedheap_unref(mowgli_heap_t *heap);
 
+struct named_heap *named_heap_get(const char *name, size_t size);
+struct named_heap *named_heap_get_external(const char *name, size_t size);
+void named_heap_release(struct named_heap *nh);
+size_t named_heap_reserved(const struct named_heap *nh);
+size_t named_heap_count(const char *name);
+bool named_heap_presize(const char *name, size_t count);
+void named_heap_foreach(void (*cb)(const struct named_heap *, void *), void *privdata);
+void named_heap_free_deferred(struct named_heap *nh, void *ptr);
+void named_heap_reclaim(void);
+
+static inline void *
+named_heap_alloc(struct named_heap *const restrict nh)
+{
+	void *const ptr = mowgli_heap_alloc(nh->heap);
+
+	nh->allocs++;
+
+	if (++nh->live > nh->peak)
+		nh->peak = nh->live;
+
+	return ptr;
+}
+
+static inline void
+named_heap_free(struct named_heap *const restrict nh, void *const restrict ptr)
+{
+	nh->live--;
+
+	(void) mowgli_heap_free(nh->heap, ptr);
+}
+
 #endif /* !ATHEME_INC_SHAREDHEAP_H */
@@ -0,0 +1,56 @@
+/*
+ * SPDX-License-Identifier: ISC
+ * SPDX-URL: https://spdx.org/licenses/ISC.html
+ *
+ * Copyright (C) 2026 Atheme Development Group (https://atheme.github.io/)
+ *
+ * Where the time went while starting up: wall and CPU time, resident size
+ * and object counts for each phase of startup, and the time each module
+ * spent in its mod_init (not counting the modules it pulled in).
+ */
+
+#ifndef ATHEME_INC_STARTUP_H
+#define ATHEME_INC_STARTUP_H 1
+
+#include <atheme/stdheaders.h>
+
+enum startup_entry_kind
+{
+	STARTUP_PHASE           = 0,
+	STARTUP_MODULE          = 1,
+};
+
+struct startup_entry
+{
+	char *                  name;
+	enum startup_entry_kind kind;
+	unsigned int            runs;       // more than one for phases that happen piecemeal
+	unsigned long long      wall_us;
+	unsigned long long      cpu_us;
+	long                    rss_kb;     // phases: at the end; modules: growth (with what they pulled in)
+	unsigned int            myusers;    // object counts, at the end of a phase
+	unsigned int            mynicks;
+	unsigned int            mychans;
+	unsigned int            chanacs;
+};
+
+// Taken at the start of something to be recorded with startup_record()
+struct startup_mark
+{
+	struct timeval          wall;
+	unsigned long long      cpu_us;
+	long                    rss_kb;
+	unsigned long long      nested_wall_us;
+	unsigned long long      nested_cpu_us;
+};
+
+void startup_mark(struct startup_mark *mark);
+void startup_record(const struct startup_mark *mark, const char *name, enum startup_entry_kind kind);
+void startup_report(void);
+void startup_uplink_connecting(void);
+void startup_uplink_connected(void);
+void startup_uplink_synced(void);
+bool startup_complete(unsigned long long *total_us);
+void startup_entry_foreach(void (*cb)(const struct startup_entry *, void *), void *privdata);
+
+#endif /* !ATHEME_INC_STARTUP_H */
@@ -113,11 +113,21 @@
 #  include <sys/file.h>
 #endif
 
+#ifdef HAVE_SYS_MMAN_H
+// mmap(), munmap(), madvise(), MAP_*, PROT_*, ...
+#  include <sys/mman.h>
+#endif
+
 #ifdef HAVE_SYS_RESOURCE_H
 // getrlimit(), setrlimit(), RLIM_*, ...
 #  include <sys/resource.h>
 #endif
 
+#ifdef HAVE_SYS_SENDFILE_H
+// sendfile()
+#  include <sys/sendfile.h>
+#endif
+
 #ifdef HAVE_SYS_SOCKET_H
 // SHUT_*, struct mmsghdr, socket(), socketpair(), bind(), connect(), ...
 #  include <sys/socket.h>
@@ -133,6 +143,11 @@
 #  include <sys/time.h>
 #endif
 
+#ifdef HAVE_SYS_UIO_H
+// struct iovec, readv(), writev(), ...
+#  include <sys/uio.h>
+#endif
+
 #ifdef HAVE_SYS_WAIT_H
 // W*, wait(), waitpid(), ...
 #  include <sys/wait.h>
@@ -15,6 +15,7 @@ struct chanacs;
 struct groupacs;
 struct mychan;
 struct mygroup;
+struct mymemo;
 struct mynick;
 struct myuser;
 struct svsignore;
@@ -28,9 +29,15 @@ struct chanban;
 struct channel;
 struct chanuser;
 
+// Private to libathemecore/cmdqueue.c
+struct command_queue;
+
 // Defined in atheme/connection.h
 struct connection;
 
+// Private to libathemecore/uring.c
+struct uring_connection;
+
 // Defined in atheme/crypto.h
 struct crypt_impl;
 
@@ -38,10 +45,17 @@ struct crypt_impl;
 struct language;
 struct translation;
 
+// Defined in atheme/datastream.h
+struct sendq_line;
+
 // Defined in atheme/database_backend.h
 struct database_handle;
 struct database_module;
 struct database_vtable;
+struct db_shard;
+
+// Defined in atheme/delivery.h
+struct delivery_job;
 
 // Defined in atheme/digest*.h
 struct digest_context;
@@ -54,6 +68,10 @@ struct myentity_iteration_state;
 // Defined in atheme/entity-validation.h
 struct entity_vtable;
 
+// Defined in atheme/expiry.h
+struct expiry_queue;
+struct expiry_timer;
+
 // Defined in atheme/flags.h
 struct gflags;
 
@@ -66,13 +84,27 @@ struct hook;
 // Defined in atheme/httpd.h
 struct path_handler;
 
+// Defined in atheme/logindex.h
+struct log_index_plan;
+
+// Private to libathemecore/logindex.c
+struct log_index;
+
 // Defined in atheme/match.h
 struct atheme_regex;
+struct cidr_addr;
+struct cidr_tree;
+struct cidr_tree_node;
+struct match_pattern;
 
 // Defined in atheme/module.h
 struct module;
 struct v4_moduleheader;
 
+// Defined in atheme/namehash.h
+struct namehash;
+struct namehash_slot;
+
 // Defined in atheme/object.h
 struct atheme_object;
 struct metadata;
@@ -140,5 +172,6 @@ struct uplink;
 
 // Defined in atheme/users.h
 struct user;
+struct user_cold;
 
 #endif /* !ATHEME_INC_STRUCTURES_H */
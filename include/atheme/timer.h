@@ -0,0 +1,32 @@
+/*
+ * SPDX-License-Identifier: ISC
+ * SPDX-URL: https://spdx.org/licenses/ISC.html
+ *
+ * Copyright (C) 2026 Atheme Development Group (https://atheme.github.io/)
+ *
+ * Profiled event loop callbacks: timers registered through timer_add() and
+ * connection I/O are timed, and an iteration of io_loop() that takes too
+ * long is reported along with the callback that was the slowest in it.
+ */
+
+#ifndef ATHEME_INC_TIMER_H
+#define ATHEME_INC_TIMER_H 1
+
+#include <atheme/stdheaders.h>
+
+// Kept per timer name (and per kind of connection I/O); never freed
+struct timer_stats
+{
+	char *                  name;
+	unsigned int            runs;
+	unsigned int            slow;       // runs that took at least config_options.slow_loop_time
+	unsigned long long      total_us;
+	unsigned long long      max_us;
+};
+
+mowgli_eventloop_timer_t *timer_add(const char *name, mowgli_event_dispatch_func_t *func, void *arg, time_t when);
+mowgli_eventloop_timer_t *timer_add_once(const char *name, mowgli_event_dispatch_func_t *func, void *arg, time_t when);
+void timer_destroy(mowgli_eventloop_timer_t *timer);
+void timer_stats_foreach(void (*cb)(const struct timer_stats *, void *), void *privdata);
+
+#endif /* !ATHEME_INC_TIMER_H */
@@ -0,0 +1,40 @@
+/*
+ * SPDX-License-Identifier: ISC
+ * SPDX-URL: https://spdx.org/licenses/ISC.html
+ *
+ * Copyright (C) 2026 Atheme Development Group (https://atheme.github.io/)
+ *
+ * A hierarchical timer wheel for large numbers of one-shot timeouts at a
+ * resolution of one second, with O(1) scheduling and cancellation; the
+ * entries are embedded in whatever they belong to, so neither allocates.
+ */
+
+#ifndef ATHEME_INC_TIMERWHEEL_H
+#define ATHEME_INC_TIMERWHEEL_H 1
+
+#include <atheme/stdheaders.h>
+
+// All zeroes is an entry that is not scheduled
+struct timerwheel_entry
+{
+	mowgli_event_dispatch_func_t *  func;
+	void *                          arg;
+	time_t                          expires;
+	mowgli_node_t                   node;
+	mowgli_list_t *                 slot;   // NULL if not scheduled
+};
+
+/* Runs func(arg) once, at or soon after `expires' (an absolute time); an
+ * entry that is already scheduled is moved. The callback may reschedule its
+ * own entry or schedule and cancel any others.
+ */
+void timerwheel_add(struct timerwheel_entry *te, mowgli_event_dispatch_func_t *func, void *arg, time_t expires);
+void timerwheel_cancel(struct timerwheel_entry *te);
+
+static inline bool
+timerwheel_pending(const struct timerwheel_entry *const restrict te)
+{
+	return te->slot != NULL;
+}
+
+#endif /* !ATHEME_INC_TIMERWHEEL_H */
@@ -51,10 +51,13 @@ struct logfile
 	unsigned int            log_mask;
 	log_write_func_fn       write_func;
 	enum log_type           log_type;
+	struct log_index *      index;          // NULL if not indexed (general::log_index)
+	struct log_irc_queue *  irc_queue;      // lines waiting to go to a channel or snotices
 };
 
 extern char *log_path; /* contains path to default log. */
 extern int log_force;
+extern unsigned int log_mask_active;
 
 struct logfile *logfile_new(const char *log_path_, unsigned int log_mask) ATHEME_FATTR_MALLOC;
 void logfile_register(struct logfile *lf);
@@ -101,7 +104,15 @@ void log_shutdown(void);
 bool log_debug_enabled(void);
 void log_master_set_mask(unsigned int mask);
 struct logfile *logfile_find_mask(unsigned int log_mask);
+unsigned int log_writer_dropped(void);
 void slog(unsigned int level, const char *fmt, ...) ATHEME_FATTR_PRINTF(2, 3);
+
+/* Whether slog() at this level would be written anywhere. slog() checks this
+ * itself before formatting anything; slog_lazy() checks it before even
+ * evaluating the arguments, for hot paths whose messages are usually off.
+ */
+#define slog_enabled(level)     (log_force || ((level) & log_mask_active))
+#define slog_lazy(level, ...)   ((slog_enabled(level)) ? slog((level), __VA_ARGS__) : (void) 0)
 void logcommand(struct sourceinfo *si, int level, const char *fmt, ...) ATHEME_FATTR_PRINTF(3, 4);
 void logcommand_user(struct service *svs, struct user *source, int level, const char *fmt, ...) ATHEME_FATTR_PRINTF(4, 5);
 void logcommand_external(struct service *svs, const char *type, struct connection *source, const char *sourcedesc, struct myuser *login, int level, const char *fmt, ...) ATHEME_FATTR_PRINTF(7, 8);
@@ -117,6 +128,27 @@ struct email_canonicalizer_item
 	mowgli_node_t           node;
 };
 
+/* An e-mail address checker that may need to wait (e.g. for DNS). start
+ * returns VALID or INVALID if it knows already; otherwise, with cb set, it
+ * sets *handle and calls cb(valid, priv) later from the event loop, unless
+ * cancel(handle) is called first. Without cb it must not wait, and should
+ * return VALID for what it does not know yet.
+ */
+enum email_check_result
+{
+	EMAIL_CHECK_VALID,
+	EMAIL_CHECK_INVALID,
+	EMAIL_CHECK_PENDING,
+};
+
+typedef void (*email_check_cb)(bool valid, void *priv);
+
+struct email_checker
+{
+	enum email_check_result   (*start)(const char *email, email_check_cb cb, void *priv, void **handle);
+	void                      (*cancel)(void *handle);
+};
+
 /* misc string stuff */
 bool string_in_list(const char *str, const char *list);
 char *random_string(size_t sz) ATHEME_FATTR_MALLOC ATHEME_FATTR_RETURNS_NONNULL;
@@ -131,6 +163,9 @@ void canonicalize_email_case(char email[static (EMAILLEN + 1)], void *user_data)
 void register_email_canonicalizer(email_canonicalizer_fn func, void *user_data);
 void unregister_email_canonicalizer(email_canonicalizer_fn func, void *user_data);
 bool email_within_limits(const char *email);
+void email_checker_register(const struct email_checker *checker);
+void email_checker_unregister(const struct email_checker *checker);
+bool command_check_email(struct sourceinfo *si, const char *email, int parc, char *parv[]);
 bool validhostmask(const char *host);
 char *pretty_mask(char *mask);
 bool validtopic(const char *topic);
@@ -166,6 +201,7 @@ char *timediff(time_t seconds);
 /* tokenize.c */
 int sjtoken(char *message, char delimiter, char **parv);
 int tokenize(char *message, char **parv);
+int irc_tokenize(char *line, char **origin, char **command, char **parv);
 
 /* ubase64.c */
 const char *uinttobase64(char *buf, uint64_t v, int64_t count);
@@ -0,0 +1,32 @@
+/*
+ * SPDX-License-Identifier: ISC
+ * SPDX-URL: https://spdx.org/licenses/ISC.html
+ *
+ * Copyright (C) 2026 Atheme Development Group (https://atheme.github.io/)
+ *
+ * Static tracepoints (USDT probes) for perf, bpftrace and the like; see
+ * doc/TRACING for the probes and their arguments. Unless atheme was
+ * configured with --enable-usdt, these compile to nothing.
+ */
+
+#ifndef ATHEME_INC_TRACE_H
+#define ATHEME_INC_TRACE_H 1
+
+#include <atheme/sysconf.h>
+
+#ifdef ATHEME_ENABLE_USDT
+#  include <sys/sdt.h>
+#  define ATHEME_TRACE0(probe)                  DTRACE_PROBE(atheme, probe)
+#  define ATHEME_TRACE1(probe, a)               DTRACE_PROBE1(atheme, probe, a)
+#  define ATHEME_TRACE2(probe, a, b)            DTRACE_PROBE2(atheme, probe, a, b)
+#  define ATHEME_TRACE3(probe, a, b, c)         DTRACE_PROBE3(atheme, probe, a, b, c)
+#  define ATHEME_TRACE4(probe, a, b, c, d)      DTRACE_PROBE4(atheme, probe, a, b, c, d)
+#else
+#  define ATHEME_TRACE0(probe)                  do { } while (0)
+#  define ATHEME_TRACE1(probe, a)               do { } while (0)
+#  define ATHEME_TRACE2(probe, a, b)            do { } while (0)
+#  define ATHEME_TRACE3(probe, a, b, c)         do { } while (0)
+#  define ATHEME_TRACE4(probe, a, b, c, d)      do { } while (0)
+#endif
+
+#endif /* !ATHEME_INC_TRACE_H */
@@ -39,6 +39,7 @@ struct uplink *uplink_add(const char *name, const char *host, const char *send_p
 void uplink_delete(struct uplink *u);
 struct uplink *uplink_find(const char *name);
 void uplink_connect(void);
+void uplink_reconcile_done(void);
 
 /* packet.c */
 /* bursting timer */
@@ -51,6 +52,13 @@ void irc_handle_connect(struct connection *cptr);
 
 /* send.c */
 int sts(const char *fmt, ...) ATHEME_FATTR_PRINTF(1, 2);
+bool sts_begin(struct sendq_line *l, const char *source);
+void sts_word(struct sendq_line *l, const char *word);
+void sts_uint(struct sendq_line *l, unsigned long long value);
+void sts_time(struct sendq_line *l, time_t ts);
+void sts_client(struct sendq_line *l, const struct user *u);
+void sts_trailing(struct sendq_line *l, const char *text);
+void sts_end(struct sendq_line *l);
 void io_loop(void);
 
 #endif /* !ATHEME_INC_UPLINK_H */
@@ -11,31 +11,62 @@
 #define ATHEME_INC_USERS_H 1
 
 #include <atheme/common.h>
+#include <atheme/match.h>
 #include <atheme/object.h>
+#include <atheme/ratelimit.h>
 #include <atheme/stdheaders.h>
 #include <atheme/structures.h>
 
+// What a user's cached channel access was worked out from (see account.c)
+struct user_acs_key
+{
+	stringref               nick;
+	stringref               user;
+	stringref               host;
+	stringref               chost;
+	stringref               vhost;
+	stringref               ip;
+	struct myuser *         myuser;
+	bool                    waitauth;
+	unsigned int            gen;
+};
+
+/* The parts of a user that only a few code paths look at. They live in a
+ * separate allocation so that the fields walked during bursts, lookups and
+ * flood checks pack more users to a cache line; use the accessors in
+ * atheme/inline/users.h from modules.
+ */
+struct user_cold
+{
+	stringref               gecos;
+	stringref               chost;          // Cloaked host
+	char *                  certfp;         // client certificate fingerprint
+	struct user_acs_key     acskey;
+	struct command_queue *  cmdq;           // messages waiting for their turn (see cmdqueue.c)
+};
+
 struct user
 {
 	struct atheme_object    parent;
 	stringref               nick;
+	stringref               uid;            // Used for TS6, P10, IRCNet ircd
+	unsigned int            flags;
+	unsigned int            offenses;
+	struct myuser *         myuser;
+	struct server *         server;
+	mowgli_list_t           channels;
 	stringref               user;
 	stringref               host;           // Real host
-	stringref               gecos;
-	stringref               chost;          // Cloaked host
 	stringref               vhost;          // Visible host
-	stringref               uid;            // Used for TS6, P10, IRCNet ircd
 	stringref               ip;
-	mowgli_list_t           channels;
-	struct server *         server;
-	struct myuser *         myuser;
-	unsigned int            offenses;
-	unsigned int            msgs;           // times FLOOD_MSGS_FACTOR
-	time_t                  lastmsg;
-	unsigned int            flags;
+	struct cidr_addr        ipaddr;         // ip parsed by user_add(), family 0 if unknown
 	time_t                  ts;
+	struct ratelimit        flood;          // Costs are in FLOOD_MSGS_FACTOR per message
+	time_t                  lastmsg;        // When the current flood ignore started
 	mowgli_node_t           snode;          // for struct server -> userlist
-	char *                  certfp;         // client certificate fingerprint
+	mowgli_node_t           mlnode;         // for struct myuser -> logins
+	mowgli_list_t           burstq;         // enforcement deferred until EOB (see burst.c)
+	struct user_cold *      cold;
 };
 
 #define UF_AWAY        0x00000002U
@@ -57,6 +88,10 @@ struct user
 #define UF_CUSTOM2     0x00040000U
 #define UF_CUSTOM3     0x00080000U
 #define UF_CUSTOM4     0x00100000U
+#define UF_NETSPLIT    0x00200000U /* quitting because its server split */
+#define UF_IGNORESEEN  0x00400000U /* told that they are on services ignore */
+#define UF_STALE       0x00800000U /* on the network before the uplink was lost, not introduced again yet */
+#define UF_RECONCILED  0x01000000U /* kept across an uplink reconnect; skip its next handle_nickchange() */
 
 #define CLIENT_NAME(user)	((user)->uid != NULL ? (user)->uid : (user)->nick)
 
@@ -72,12 +107,16 @@ void init_users(void);
 
 struct user *user_add(const char *nick, const char *user, const char *host, const char *vhost, const char *ip, const char *uid, const char *gecos, struct server *server, time_t ts);
 void user_delete(struct user *u, const char *comment);
+void user_mark_stale(void);
+unsigned int user_purge_stale(void);
 struct user *user_find(const char *nick);
 struct user *user_find_named(const char *nick);
 void user_changeuid(struct user *u, const char *uid);
 bool user_changenick(struct user *u, const char *nick, time_t ts);
 void user_mode(struct user *user, const char *modes);
 void user_sethost(struct user *source, struct user *target, const char *host);
+void user_set_gecos(struct user *u, const char *gecos);
+void user_set_chost(struct user *u, const char *chost);
 const char *user_get_umodestr(struct user *u);
 struct chanuser *find_user_banned_channel(struct user *u, char ban_type);
 
@@ -0,0 +1,65 @@
+/*
+ * SPDX-License-Identifier: ISC
+ * SPDX-URL: https://spdx.org/licenses/ISC.html
+ *
+ * Copyright (C) 2026 Atheme Development Group (https://atheme.github.io/)
+ *
+ * Scanning the whole user list (OperServ RMATCH, RNC, ...) off the main
+ * thread, over a snapshot of it.
+ */
+
+#ifndef ATHEME_INC_USERSCAN_H
+#define ATHEME_INC_USERSCAN_H 1
+
+#include <atheme/stdheaders.h>
+
+enum user_snapshot_field
+{
+	USF_NICK        = 0,
+	USF_USER        = 1,
+	USF_HOST        = 2,
+	USF_IP          = 3,    // "" if unknown
+	USF_GECOS       = 4,
+	USF_COUNT
+};
+
+/* The fields of every user at the time the scan started, stored by column:
+ * offsets[field][i] is where that field of the i-th user starts in strings.
+ * Nothing in here refers to the live user list, so it can be read from any
+ * thread.
+ */
+struct user_snapshot
+{
+	size_t                  count;
+	char *                  strings;
+	size_t *                offsets[USF_COUNT];
+};
+
+static inline const char *
+user_snapshot_get(const struct user_snapshot *const restrict snap, const enum user_snapshot_field field,
+                  const size_t i)
+{
+	return snap->strings + snap->offsets[field][i];
+}
+
+struct user_scan;
+
+/* Called on worker threads (and so must not touch anything but the snapshot
+ * and what priv points to, read-only); decides whether the user matches.
+ */
+typedef bool (*user_scan_match_fn)(const struct user_snapshot *snap, size_t i, void *priv);
+
+// Called on the main thread for every matching user, in user list order
+typedef void (*user_scan_result_fn)(const struct user_snapshot *snap, size_t i, void *priv);
+
+/* Called on the main thread once every result has been delivered, with the
+ * total time spent in the match function in microseconds; the scan is freed
+ * afterwards.
+ */
+typedef void (*user_scan_done_fn)(const struct user_snapshot *snap, unsigned long long match_us, void *priv);
+
+struct user_scan *user_scan_start(user_scan_match_fn match_fn, user_scan_result_fn result_fn,
+                                  user_scan_done_fn done_fn, void *priv, bool background);
+void user_scan_cancel(struct user_scan *scan);
+
+#endif /* !ATHEME_INC_USERSCAN_H */
@@ -0,0 +1,23 @@
+/*
+ * SPDX-License-Identifier: ISC
+ * SPDX-URL: https://spdx.org/licenses/ISC.html
+ *
+ * Copyright (C) 2026 Atheme Development Group (https://atheme.github.io/)
+ *
+ * Warm restart images of the accounts, nicks, channels and channel access
+ * lists (see libathemecore/warmimage.c).
+ */
+
+#ifndef ATHEME_INC_WARMIMAGE_H
+#define ATHEME_INC_WARMIMAGE_H 1
+
+#include <atheme/stdheaders.h>
+
+// The accounts came from an image of a registry that db_check() had already passed
+extern bool warm_image_checked;
+
+// dbpath is the database just written, or about to be read
+bool warm_image_write(const char *dbpath);
+bool warm_image_load(const char *dbpath);
+
+#endif /* !ATHEME_INC_WARMIMAGE_H */
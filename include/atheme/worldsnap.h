@@ -0,0 +1,98 @@
+/*
+ * SPDX-License-Identifier: ISC
+ * SPDX-URL: https://spdx.org/licenses/ISC.html
+ *
+ * Copyright (C) 2026 Atheme Development Group (https://atheme.github.io/)
+ *
+ * Read-only queries (ChanServ LIST, ...) over an immutable copy of the
+ * accounts, channels and channel access lists, run off the main thread.
+ */
+
+#ifndef ATHEME_INC_WORLDSNAP_H
+#define ATHEME_INC_WORLDSNAP_H 1
+
+#include <atheme/stdheaders.h>
+
+// What a snapshot records about an object beyond its own fields
+#define WSM_MARKED      0x01U   // private:mark:setter
+#define WSM_CLOSED      0x02U   // private:close:closer (channels)
+#define WSM_FROZEN      0x04U   // private:freeze:freezer (accounts)
+
+/* Strings are offsets into world_snapshot->strings, see world_snapshot_str();
+ * offset 0 is the empty string.
+ */
+struct world_snapshot_myuser
+{
+	size_t                  name;
+	size_t                  email;
+	size_t                  mark_reason;
+	time_t                  registered;
+	time_t                  lastlogin;
+	unsigned int            flags;          // MU_*
+	unsigned int            marks;          // WSM_*
+	unsigned int            nicks;
+};
+
+struct world_snapshot_mychan
+{
+	size_t                  name;
+	size_t                  founders;       // as mychan_founder_names()
+	size_t                  mark_reason;
+	size_t                  close_reason;
+	time_t                  registered;
+	time_t                  used;
+	unsigned int            flags;          // MC_*
+	unsigned int            marks;          // WSM_*
+	size_t                  chanacs;        // index of the first of its entries in world_snapshot->chanacs
+	size_t                  nchanacs;
+};
+
+struct world_snapshot_chanacs
+{
+	size_t                  target;         // entity name, or host mask
+	unsigned int            level;
+	time_t                  tmodified;
+};
+
+/* Nothing in a snapshot refers to the live objects or changes once it has
+ * been published, so it can be read from any thread. References are only
+ * taken and dropped on the main thread.
+ */
+struct world_snapshot
+{
+	unsigned int                    refcount;
+	unsigned int                    version;        // increases with every snapshot taken
+	time_t                          taken;
+	size_t                          nmyusers;
+	size_t                          nmychans;
+	size_t                          nchanacs;
+	struct world_snapshot_myuser *  myusers;
+	struct world_snapshot_mychan *  mychans;
+	struct world_snapshot_chanacs * chanacs;
+	char *                          strings;
+	size_t                          strings_len;
+	size_t                          strings_alloc;
+};
+
+static inline const char *
+world_snapshot_str(const struct world_snapshot *const restrict snap, const size_t offset)
+{
+	return snap->strings + offset;
+}
+
+struct world_snapshot *world_snapshot_acquire(void);
+void world_snapshot_release(struct world_snapshot *snap);
+
+struct world_query;
+
+// Called on a query thread; must not touch anything but the snapshot and priv
+typedef void (*world_query_fn)(const struct world_snapshot *snap, void *priv);
+
+// Called on the main thread once the query has run; the query is freed afterwards
+typedef void (*world_query_done_fn)(const struct world_snapshot *snap, void *priv);
+
+struct world_query *world_query_start(world_query_fn query_fn, world_query_done_fn done_fn, void *priv,
+                                      bool background);
+void world_query_cancel(struct world_query *query);
+
+#endif /* !ATHEME_INC_WORLDSNAP_H */
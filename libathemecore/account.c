@@ -16,18 +16,64 @@
 #include <atheme.h>
 #include "internal.h"
 
+#ifdef HAVE_USABLE_PTHREAD
+#  include <pthread.h>
+#endif
+
 mowgli_patricia_t *nicklist;
 mowgli_patricia_t *oldnameslist;
 mowgli_patricia_t *mclist;
 
+struct expiry_queue myuser_expiry;
+struct expiry_queue mynick_expiry;
+struct expiry_queue mychan_expiry;
+
 static mowgli_patricia_t *certfplist;
 
-static mowgli_heap_t *myuser_heap;   /* HEAP_USER */
-static mowgli_heap_t *mynick_heap;   /* HEAP_USER */
-static mowgli_heap_t *mycertfp_heap; /* HEAP_USER */
-static mowgli_heap_t *myuser_name_heap;	/* HEAP_USER / 2 */
-static mowgli_heap_t *mychan_heap;	/* HEAP_CHANNEL */
-static mowgli_heap_t *chanacs_heap;	/* HEAP_CHANACS */
+/* The expiry queues are built by the first expire_check() after startup,
+ * once the database has been loaded, and rebuilt whenever the expiry
+ * periods change. Objects created afterwards are looked at by the next
+ * expire_check() and scheduled from there.
+ */
+static bool expiry_queues_built = false;
+static unsigned int expiry_queues_nickexpiry = 0;
+static unsigned int expiry_queues_chanexpiry = 0;
+
+static struct named_heap *myuser_heap;   /* HEAP_USER */
+static struct named_heap *mynick_heap;   /* HEAP_USER */
+static struct named_heap *mycertfp_heap; /* HEAP_USER */
+static struct named_heap *myuser_name_heap;	/* HEAP_USER / 2 */
+static struct named_heap *mychan_heap;	/* HEAP_CHANNEL */
+static struct named_heap *chanacs_heap;	/* HEAP_CHANACS */
+
+// Canonical email address -> mowgli_list_t of the accounts registered to it
+static mowgli_patricia_t *emaillist = NULL;
+
+/* A bulk deletion (see myuser_purge_start()): the IDs of the accounts still
+ * to be dropped, then the channels they left without a founder.
+ */
+struct myuser_purge_channel
+{
+	mowgli_node_t           node;
+	char *                  name;
+	char *                  founder;        // the account it lost
+};
+
+struct myuser_purge
+{
+	char                  (*ids)[IDLEN + 1];
+	unsigned int            count;
+	unsigned int            next;
+	bool                    accounts_done;
+	mowgli_list_t           channels;       // struct myuser_purge_channel
+	unsigned int            dropped;
+	unsigned int            nicks;
+	unsigned int            succeeded;      // channels passed on to a successor
+	unsigned int            chans_dropped;  // channels dropped for want of one
+};
+
+// Set while myuser_delete() is dropping an account for a purge
+static struct myuser_purge *myuser_purging = NULL;
 
 /*
  * init_accounts()
@@ -46,12 +92,12 @@ static mowgli_heap_t *chanacs_heap;	/* HEAP_CHANACS */
 void
 init_accounts(void)
 {
-	myuser_heap = sharedheap_get(sizeof(struct myuser));
-	mynick_heap = sharedheap_get(sizeof(struct myuser));
-	myuser_name_heap = sharedheap_get(sizeof(struct myuser_name));
-	mychan_heap = sharedheap_get(sizeof(struct mychan));
-	chanacs_heap = sharedheap_get(sizeof(struct chanacs));
-	mycertfp_heap = sharedheap_get(sizeof(struct mycertfp));
+	myuser_heap = named_heap_get("myuser", sizeof(struct myuser));
+	mynick_heap = named_heap_get("mynick", sizeof(struct mynick));
+	myuser_name_heap = named_heap_get("myuser_name", sizeof(struct myuser_name));
+	mychan_heap = named_heap_get("mychan", sizeof(struct mychan));
+	chanacs_heap = named_heap_get("chanacs", sizeof(struct chanacs));
+	mycertfp_heap = named_heap_get("mycertfp", sizeof(struct mycertfp));
 
 	if (myuser_heap == NULL || mynick_heap == NULL || mychan_heap == NULL
 			|| chanacs_heap == NULL || mycertfp_heap == NULL)
@@ -64,6 +110,7 @@ init_accounts(void)
 	oldnameslist = mowgli_patricia_create(irccasecanon);
 	mclist = mowgli_patricia_create(irccasecanon);
 	certfplist = mowgli_patricia_create(strcasecanon);
+	emaillist = mowgli_patricia_create(NULL);
 }
 
 /*
@@ -114,13 +161,14 @@ myuser_add_id(const char *id, const char *name, const char *pass, const char *em
 	if (!(runflags & RF_STARTING))
 		slog(LG_DEBUG, "myuser_add(): %s -> %s", name, email);
 
-	mu = mowgli_heap_alloc(myuser_heap);
+	mu = named_heap_alloc(myuser_heap);
 	atheme_object_init(atheme_object(mu), name, (atheme_object_destructor_fn) myuser_delete);
 
 	entity(mu)->type = ENT_USER;
 	entity(mu)->name = strshare_get(name);
 	mu->email = strshare_get(email);
 	mu->email_canonical = canonicalize_email(email);
+	myuser_email_index_add(mu);
 	if (id)
 	{
 		if (myentity_find_uid(id) == NULL)
@@ -149,7 +197,7 @@ myuser_add_id(const char *id, const char *name, const char *pass, const char *em
 	if (flags & MU_CRYPTPASS)
 		mowgli_strlcpy(mu->pass, pass, sizeof mu->pass);
 	else
-		set_password(mu, pass);
+		set_password_initial(mu, pass);
 
 	myentity_put(entity(mu));
 
@@ -162,11 +210,59 @@ myuser_add_id(const char *id, const char *name, const char *pass, const char *em
 
 	myuser_name_restore(entity(mu)->name, mu);
 
+	if (expiry_queues_built)
+		expiry_queue_schedule(&myuser_expiry, &mu->expiry, mu, CURRTIME);
+
 	cnt.myuser++;
+	db_change_note(DB_CHANGE_MYUSER);
+
+	hook_call_myuser_add(mu);
 
 	return mu;
 }
 
+/* Hands a channel that has lost its only founder, former, to a successor,
+ * or drops it if there is none. Returns whether the channel is still there.
+ */
+static bool
+mychan_succession(struct mychan *mc, const char *former)
+{
+	struct myuser *successor;
+
+	if ((successor = mychan_pick_successor(mc)) != NULL)
+	{
+		slog(LG_INFO, "SUCCESSION: \2%s\2 to \2%s\2 from \2%s\2", mc->name, entity(successor)->name, former);
+		slog(LG_VERBOSE, "myuser_delete(): giving channel %s to %s (unused %lds, founder %s, chanacs %zu)",
+				mc->name, entity(successor)->name,
+				(long)(CURRTIME - mc->used),
+				former,
+				MOWGLI_LIST_LENGTH(&mc->chanacs));
+		if (chansvs.me != NULL)
+			verbose(mc, "Foundership changed to \2%s\2 because \2%s\2 was dropped.", entity(successor)->name, former);
+
+		/* CA_FOUNDER | CA_FLAGS is the minimum required for full control; let chanserv take care of assigning the rest via founder_flags */
+		chanacs_change_simple(mc, entity(successor), NULL, CA_FOUNDER | CA_FLAGS, 0, NULL);
+		hook_call_channel_succession((&(struct hook_channel_succession_req){ .mc = mc, .mu = successor }));
+
+		if (chansvs.me != NULL)
+			myuser_notice(chansvs.nick, successor, "You are now founder on \2%s\2 (as \2%s\2).", mc->name, entity(successor)->name);
+		return true;
+	}
+
+	/* no successor found */
+	slog(LG_REGISTER, "DELETE: \2%s\2 from \2%s\2", mc->name, former);
+	slog(LG_VERBOSE, "myuser_delete(): deleting channel %s (unused %lds, founder %s, chanacs %zu)",
+			mc->name, (long)(CURRTIME - mc->used),
+			former,
+			MOWGLI_LIST_LENGTH(&mc->chanacs));
+
+	hook_call_channel_drop(mc);
+	if (mc->chan != NULL && !(mc->chan->flags & CHAN_LOG))
+		part(mc->name, chansvs.nick);
+	atheme_object_unref(mc);
+	return false;
+}
+
 /*
  * myuser_delete(struct myuser *mu)
  *
@@ -184,7 +280,6 @@ myuser_add_id(const char *id, const char *name, const char *pass, const char *em
 void
 myuser_delete(struct myuser *mu)
 {
-	struct myuser *successor;
 	struct mychan *mc;
 	struct mynick *mn;
 	struct user *u;
@@ -208,9 +303,9 @@ myuser_delete(struct myuser *mu)
 		u = (struct user *)n->data;
 		if (!authservice_loaded || !ircd_logout_or_kill(u, entity(mu)->name))
 		{
+			hook_call_user_logout(u);
 			u->myuser = NULL;
 			mowgli_node_delete(n, &mu->logins);
-			mowgli_node_free(n);
 		}
 	}
 
@@ -220,39 +315,23 @@ myuser_delete(struct myuser *mu)
 		ca = n->data;
 		mc = ca->mychan;
 
-		/* attempt succession */
-		if (ca->level & CA_FOUNDER && mychan_num_founders(mc) == 1 && (successor = mychan_pick_successor(mc)) != NULL)
-		{
-			slog(LG_INFO, "SUCCESSION: \2%s\2 to \2%s\2 from \2%s\2", mc->name, entity(successor)->name, entity(mu)->name);
-			slog(LG_VERBOSE, "myuser_delete(): giving channel %s to %s (unused %lds, founder %s, chanacs %zu)",
-					mc->name, entity(successor)->name,
-					(long)(CURRTIME - mc->used),
-					entity(mu)->name,
-					MOWGLI_LIST_LENGTH(&mc->chanacs));
-			if (chansvs.me != NULL)
-				verbose(mc, "Foundership changed to \2%s\2 because \2%s\2 was dropped.", entity(successor)->name, entity(mu)->name);
-
-			/* CA_FOUNDER | CA_FLAGS is the minimum required for full control; let chanserv take care of assigning the rest via founder_flags */
-			chanacs_change_simple(mc, entity(successor), NULL, CA_FOUNDER | CA_FLAGS, 0, NULL);
-			hook_call_channel_succession((&(struct hook_channel_succession_req){ .mc = mc, .mu = successor }));
-
-			if (chansvs.me != NULL)
-				myuser_notice(chansvs.nick, successor, "You are now founder on \2%s\2 (as \2%s\2).", mc->name, entity(successor)->name);
-			atheme_object_unref(ca);
-		}
-		/* no successor found */
-		else if (ca->level & CA_FOUNDER && mychan_num_founders(mc) == 1)
+		if (ca->level & CA_FOUNDER && mychan_num_founders(mc) == 1)
 		{
-			slog(LG_REGISTER, "DELETE: \2%s\2 from \2%s\2", mc->name, entity(mu)->name);
-			slog(LG_VERBOSE, "myuser_delete(): deleting channel %s (unused %lds, founder %s, chanacs %zu)",
-					mc->name, (long)(CURRTIME - mc->used),
-					entity(mu)->name,
-					MOWGLI_LIST_LENGTH(&mc->chanacs));
-
-			hook_call_channel_drop(mc);
-			if (mc->chan != NULL && !(mc->chan->flags & CHAN_LOG))
-				part(mc->name, chansvs.nick);
-			atheme_object_unref(mc);
+			/* a purge runs succession once the whole batch is
+			 * gone, so that the channel does not go to another
+			 * account that is about to be dropped itself
+			 */
+			if (myuser_purging != NULL)
+			{
+				struct myuser_purge_channel *const pc = smalloc(sizeof *pc);
+
+				pc->name = sstrdup(mc->name);
+				pc->founder = sstrdup(entity(mu)->name);
+				mowgli_node_add(pc, &pc->node, &myuser_purging->channels);
+				atheme_object_unref(ca);
+			}
+			else if (mychan_succession(mc, entity(mu)->name))
+				atheme_object_unref(ca);
 		}
 		else /* not founder */
 			atheme_object_unref(ca);
@@ -267,14 +346,16 @@ myuser_delete(struct myuser *mu)
 	/* kill any authcookies */
 	authcookie_destroy_all(mu);
 
+	/* delete memo ignores, theirs and of them */
+	myuser_memo_ignore_delete_all(mu);
+
 	/* delete memos */
 	MOWGLI_ITER_FOREACH_SAFE(n, tn, mu->memos.head)
 	{
 		memo = (struct mymemo *)n->data;
 
 		mowgli_node_delete(n, &mu->memos);
-		mowgli_node_free(n);
-		sfree(memo);
+		memo_free(memo);
 	}
 
 	/* delete access entries */
@@ -290,7 +371,9 @@ myuser_delete(struct myuser *mu)
 	MOWGLI_ITER_FOREACH_SAFE(n, tn, mu->nicks.head)
 	{
 		mn = n->data;
-		if (irccasecmp(mn->nick, entity(mu)->name))
+		if (myuser_purging != NULL)
+			myuser_purging->nicks++;
+		else if (irccasecmp(mn->nick, entity(mu)->name))
 		{
 			slog(LG_VERBOSE, "myuser_delete(): deleting nick %s (unused %lds, owner %s)",
 					mn->nick,
@@ -315,13 +398,170 @@ myuser_delete(struct myuser *mu)
 	/* entity(mu)->name is the index for this dtree */
 	myentity_del(entity(mu));
 
+	myuser_email_index_delete(mu);
 	strshare_unref(mu->email);
 	strshare_unref(mu->email_canonical);
 	strshare_unref(entity(mu)->name);
 
-	mowgli_heap_free(myuser_heap, mu);
+	expiry_queue_cancel(&myuser_expiry, &mu->expiry);
+
+	named_heap_free_deferred(myuser_heap, mu);
 
 	cnt.myuser--;
+	db_change_note(DB_CHANGE_MYUSER);
+}
+
+static void
+myuser_purge_channel(struct myuser_purge *const restrict purge, struct myuser_purge_channel *const restrict pc)
+{
+	struct mychan *const mc = mychan_find(pc->name);
+
+	// Still there and still without a founder
+	if (mc != NULL && mychan_num_founders(mc) == 0)
+	{
+		if (mychan_succession(mc, pc->founder))
+			purge->succeeded++;
+		else
+			purge->chans_dropped++;
+	}
+
+	mowgli_node_delete(&pc->node, &purge->channels);
+	sfree(pc->name);
+	sfree(pc->founder);
+	sfree(pc);
+}
+
+static bool
+myuser_purge_step(struct delivery_job *const restrict job)
+{
+	struct myuser_purge *const purge = job->data;
+	mowgli_node_t *n;
+
+	while (purge->next < purge->count)
+	{
+		struct myuser *const mu = user(myentity_find_uid(purge->ids[purge->next++]));
+
+		// Dropped in the meantime
+		if (mu == NULL)
+			continue;
+
+		hook_call_user_drop(mu);
+
+		if (!nicksvs.no_nick_ownership && nicksvs.me != NULL)
+		{
+			MOWGLI_ITER_FOREACH(n, mu->nicks.head)
+			{
+				struct mynick *const mn = n->data;
+
+				holdnick_sts(nicksvs.me->me, 0, mn->nick, NULL);
+			}
+		}
+
+		myuser_purging = purge;
+		atheme_object_dispose(mu);
+		myuser_purging = NULL;
+
+		purge->dropped++;
+		return true;
+	}
+
+	if (!purge->accounts_done)
+	{
+		purge->accounts_done = true;
+		job->total += MOWGLI_LIST_LENGTH(&purge->channels);
+	}
+
+	if ((n = purge->channels.head) == NULL)
+		return false;
+
+	myuser_purge_channel(purge, n->data);
+	return true;
+}
+
+static void
+myuser_purge_done(struct delivery_job *const restrict job, const bool cancelled)
+{
+	struct myuser_purge *const purge = job->data;
+
+	// Whatever has been dropped so far must not leave channels without a founder
+	while (purge->channels.head != NULL)
+		myuser_purge_channel(purge, purge->channels.head->data);
+
+	slog(LG_REGISTER, "PURGE: \2%u\2 accounts (\2%u\2 nicks) by \2%s\2%s; %u channels passed on, %u dropped",
+			purge->dropped, purge->nicks, job->owner, cancelled ? " (cancelled)" : "",
+			purge->succeeded, purge->chans_dropped);
+
+	sfree(purge->ids);
+	sfree(purge);
+}
+
+/*
+ * myuser_purge_start(const char *owner, struct myuser *const *accounts, unsigned int count)
+ *
+ * Drops a batch of accounts (a wave of spam registrations, say) in the
+ * background: one account per step of a delivery job, so that the work is
+ * spread over passes of the event loop, and with one line in the log for
+ * the whole batch. Channels that the accounts were the only founder of are
+ * only noted as they go; once all of them are gone, succession is run once
+ * for each of those channels, and none of them can be passed on to another
+ * account in the batch. Services operators and held accounts are left out.
+ *
+ * Inputs:
+ *      - who asked for it (for the job listing and the log)
+ *      - the accounts to drop, and how many there are
+ *
+ * Outputs:
+ *      - the job, or NULL if none of the accounts may be dropped
+ *
+ * Side Effects:
+ *      - the myuser_purge hook is called with the accounts that will be
+ *        dropped; myuser_delete is still called for each of them
+ */
+struct delivery_job *
+myuser_purge_start(const char *owner, struct myuser *const *accounts, unsigned int count)
+{
+	struct myuser_purge *purge;
+	struct myuser **keep;
+	unsigned int i, kept = 0;
+	char desc[BUFSIZE];
+
+	return_val_if_fail(owner != NULL, NULL);
+	return_val_if_fail(accounts != NULL || count == 0, NULL);
+
+	keep = smalloc((count ? count : 1) * sizeof *keep);
+
+	for (i = 0; i < count; i++)
+	{
+		struct myuser *const mu = accounts[i];
+
+		if (mu == NULL || is_soper(mu) || (mu->flags & MU_HOLD))
+			continue;
+
+		keep[kept++] = mu;
+	}
+
+	if (kept == 0)
+	{
+		sfree(keep);
+		return NULL;
+	}
+
+	hook_call_myuser_purge((&(struct hook_myuser_purge){ .owner = owner, .accounts = keep, .count = kept }));
+
+	purge = smalloc(sizeof *purge);
+	purge->ids = smalloc(kept * sizeof *purge->ids);
+
+	for (i = 0; i < kept; i++)
+		mowgli_strlcpy(purge->ids[purge->count++], entity(keep[i])->id, IDLEN + 1);
+
+	sfree(keep);
+
+	slog(LG_DEBUG, "myuser_purge_start(): %u accounts by %s", purge->count, owner);
+
+	snprintf(desc, sizeof desc, "PURGE of %u accounts", purge->count);
+
+	return delivery_job_start(owner, desc, PRIV_USER_ADMIN, purge->count, myuser_purge_step,
+			myuser_purge_done, purge);
 }
 
 /*
@@ -383,6 +623,8 @@ myuser_rename(struct myuser *mu, const char *name)
 	data.mu = mu;
 	data.oldname = nb;
 	hook_call_user_rename(&data);
+
+	db_change_note(DB_CHANGE_MYUSER);
 }
 
 /*
@@ -406,11 +648,95 @@ myuser_set_email(struct myuser *mu, const char *newemail)
 	return_if_fail(mu != NULL);
 	return_if_fail(newemail != NULL);
 
+	myuser_email_index_delete(mu);
 	strshare_unref(mu->email);
 	strshare_unref(mu->email_canonical);
 
 	mu->email = strshare_get(newemail);
 	mu->email_canonical = canonicalize_email(newemail);
+	myuser_email_index_add(mu);
+
+	db_change_note(DB_CHANGE_MYUSER);
+	hook_call_myuser_change(mu);
+}
+
+/*
+ * myuser_email_index_add(struct myuser *mu)
+ * myuser_email_index_delete(struct myuser *mu)
+ *
+ * Adds an account to, or removes it from, the accounts for its
+ * mu->email_canonical. Whatever changes mu->email_canonical has to remove
+ * the account first and add it back afterwards.
+ */
+void
+myuser_email_index_add(struct myuser *mu)
+{
+	mowgli_list_t *l;
+
+	return_if_fail(mu != NULL);
+
+	if (mu->email_canonical == NULL)
+		return;
+
+	if ((l = mowgli_patricia_retrieve(emaillist, mu->email_canonical)) == NULL)
+	{
+		l = mowgli_list_create();
+		mowgli_patricia_add(emaillist, mu->email_canonical, l);
+	}
+
+	mowgli_node_add(mu, &mu->email_node, l);
+}
+
+void
+myuser_email_index_delete(struct myuser *mu)
+{
+	mowgli_list_t *l;
+
+	return_if_fail(mu != NULL);
+
+	if (mu->email_canonical == NULL)
+		return;
+
+	return_if_fail((l = mowgli_patricia_retrieve(emaillist, mu->email_canonical)) != NULL);
+
+	mowgli_node_delete(&mu->email_node, l);
+
+	if (MOWGLI_LIST_LENGTH(l) == 0)
+	{
+		mowgli_patricia_delete(emaillist, mu->email_canonical);
+		mowgli_list_free(l);
+	}
+}
+
+/*
+ * myuser_email_accounts(const char *email)
+ *
+ * Finds the accounts registered to an email address, once canonicalized.
+ *
+ * Inputs:
+ *      - email address
+ *
+ * Outputs:
+ *      - list of struct myuser, or NULL if there are none; it must not be
+ *        changed, nor the accounts in it changed or destroyed while
+ *        walking it
+ *
+ * Side Effects:
+ *      - none
+ */
+const mowgli_list_t *
+myuser_email_accounts(const char *email)
+{
+	const mowgli_list_t *l;
+	stringref email_canonical;
+
+	return_val_if_fail(email != NULL, NULL);
+
+	email_canonical = canonicalize_email(email);
+	l = mowgli_patricia_retrieve(emaillist, email_canonical);
+	strshare_unref(email_canonical);
+
+	return l;
 }
 
 /*
@@ -497,6 +823,189 @@ myuser_notice(const char *from, struct myuser *target, const char *fmt, ...)
 	}
 }
 
+/* Access entries are parsed when they are added, so that checking a user
+ * against them compares the user's fields directly. The list itself still
+ * holds the masks as strings (modules list and save them from it); each one
+ * is the tail of a struct myuser_access.
+ */
+enum myuser_access_kind
+{
+	MU_ACCESS_ANY           = 0,    // "*"
+	MU_ACCESS_LITERAL,              // no wildcards
+	MU_ACCESS_SUFFIX,               // "*" and then no wildcards
+	MU_ACCESS_CIDR,                 // address/length (hosts only)
+	MU_ACCESS_PATTERN,              // anything else, for match()
+	MU_ACCESS_WHOLE,                // no '@', so the whole mask is matched against user@host
+	MU_ACCESS_NEVER,                // more than one '@', which no user@host has
+};
+
+struct myuser_access
+{
+	enum myuser_access_kind userkind;
+	enum myuser_access_kind hostkind;
+	const char *            user;           // user part, NUL-terminated after the mask
+	size_t                  userlen;
+	const char *            host;           // host part (for a suffix, both without the '*')
+	size_t                  hostlen;
+	struct cidr_addr        net;
+	char                    mask[];
+};
+
+static inline struct myuser_access *
+myuser_access_of(const char *const mask)
+{
+	/* intermediate cast to suppress gcc -Wcast-qual */
+	return (struct myuser_access *) (uintptr_t) (mask - offsetof(struct myuser_access, mask));
+}
+
+static enum myuser_access_kind
+myuser_access_classify(const char *const part)
+{
+	// These are all special to match(), see libathemecore/match.c
+	const size_t wild = strcspn(part, "*?&#%\\");
+
+	if (part[0] == '*' && part[1] == '\0')
+		return MU_ACCESS_ANY;
+
+	if (part[wild] == '\0')
+		return MU_ACCESS_LITERAL;
+
+	if (wild == 0 && part[0] == '*' && part[1 + strcspn(part + 1, "*?&#%\\")] == '\0')
+		return MU_ACCESS_SUFFIX;
+
+	return MU_ACCESS_PATTERN;
+}
+
+static struct myuser_access *
+myuser_access_parse(const char *const mask)
+{
+	const size_t masklen = strlen(mask);
+	const char *const at = strchr(mask, '@');
+	const size_t userlen = (at != NULL) ? (size_t) (at - mask) : 0;
+	struct myuser_access *const ma = smalloc(sizeof *ma + masklen + 1 + userlen + 1);
+	char *const user = ma->mask + masklen + 1;
+
+	(void) memcpy(ma->mask, mask, masklen + 1);
+	(void) memcpy(user, mask, userlen);
+	user[userlen] = '\0';
+
+	if (at == NULL)
+	{
+		ma->userkind = ma->hostkind = MU_ACCESS_WHOLE;
+		return ma;
+	}
+
+	if (strchr(at + 1, '@') != NULL)
+	{
+		ma->userkind = ma->hostkind = MU_ACCESS_NEVER;
+		return ma;
+	}
+
+	ma->user = user;
+	ma->userlen = userlen;
+
+	if ((ma->userkind = myuser_access_classify(user)) == MU_ACCESS_SUFFIX)
+	{
+		ma->user++;
+		ma->userlen--;
+	}
+
+	ma->host = ma->mask + userlen + 1;
+	ma->hostlen = masklen - userlen - 1;
+
+	if (cidr_parse_mask(ma->host, &ma->net))
+		ma->hostkind = MU_ACCESS_CIDR;
+	else if ((ma->hostkind = myuser_access_classify(ma->host)) == MU_ACCESS_SUFFIX)
+	{
+		ma->host++;
+		ma->hostlen--;
+	}
+
+	return ma;
+}
+
+// Compares as match() does, for strings without wildcards
+static bool
+myuser_access_streq(const char *a, const char *b, size_t len)
+{
+	for (; len; a++, b++, len--)
+		if (ToLower(*a) != ToLower(*b))
+			return false;
+
+	return true;
+}
+
+static bool
+myuser_access_part_matches(const enum myuser_access_kind kind, const char *const part, const size_t partlen,
+                           const char *const str)
+{
+	size_t len;
+
+	if (str == NULL)
+		return false;
+
+	switch (kind)
+	{
+		case MU_ACCESS_ANY:
+			return true;
+
+		case MU_ACCESS_LITERAL:
+			return strlen(str) == partlen && myuser_access_streq(part, str, partlen);
+
+		case MU_ACCESS_SUFFIX:
+			len = strlen(str);
+			return len >= partlen && myuser_access_streq(part, str + len - partlen, partlen);
+
+		default:
+			return !match(part, str);
+	}
+}
+
+static bool
+myuser_access_entry_matches(const struct myuser_access *const ma, const struct user *const u,
+                            const char *const *const hosts, const size_t nhosts, const struct cidr_addr *const ip)
+{
+	if (ma->userkind == MU_ACCESS_NEVER)
+		return false;
+
+	if (ma->userkind == MU_ACCESS_WHOLE)
+	{
+		char buf[USERLEN + 1 + HOSTLEN + 1];
+
+		for (size_t i = 0; i < nhosts; i++)
+		{
+			(void) snprintf(buf, sizeof buf, "%s@%s", u->user, hosts[i]);
+
+			if (!match(ma->mask, buf))
+				return true;
+		}
+
+		return false;
+	}
+
+	if (! myuser_access_part_matches(ma->userkind, ma->user, ma->userlen, u->user))
+		return false;
+
+	if (ma->hostkind == MU_ACCESS_CIDR)
+	{
+		if (ip != NULL && cidr_contains(&ma->net, ip))
+			return true;
+
+		// A vhost could still spell out the mask
+		for (size_t i = 0; i < nhosts; i++)
+			if (myuser_access_part_matches(MU_ACCESS_LITERAL, ma->host, ma->hostlen, hosts[i]))
+				return true;
+
+		return false;
+	}
+
+	for (size_t i = 0; i < nhosts; i++)
+		if (myuser_access_part_matches(ma->hostkind, ma->host, ma->hostlen, hosts[i]))
+			return true;
+
+	return false;
+}
+
 /*
  * myuser_access_verify()
  *
@@ -514,10 +1023,8 @@ bool
 myuser_access_verify(struct user *u, struct myuser *mu)
 {
 	mowgli_node_t *n;
-	char buf[USERLEN + 1 + HOSTLEN + 1];
-	char buf2[USERLEN + 1 + HOSTLEN + 1];
-	char buf3[USERLEN + 1 + HOSTLEN + 1];
-	char buf4[USERLEN + 1 + HOSTLEN + 1];
+	const char *hosts[4];
+	size_t nhosts = 0;
 
 	return_val_if_fail(u != NULL, false);
 	return_val_if_fail(mu != NULL, false);
@@ -528,16 +1035,17 @@ myuser_access_verify(struct user *u, struct myuser *mu)
 	if (metadata_find(mu, "private:freeze:freezer"))
 		return false;
 
-	snprintf(buf, sizeof buf, "%s@%s", u->user, u->vhost);
-	snprintf(buf2, sizeof buf2, "%s@%s", u->user, u->host);
-	snprintf(buf3, sizeof buf3, "%s@%s", u->user, u->ip);
-	snprintf(buf4, sizeof buf4, "%s@%s", u->user, u->chost);
+	hosts[nhosts++] = u->vhost;
+	hosts[nhosts++] = u->host;
+	if (u->ip != NULL)
+		hosts[nhosts++] = u->ip;
+	hosts[nhosts++] = user_chost(u);
 
 	MOWGLI_ITER_FOREACH(n, mu->access_list.head)
 	{
-		char *entry = (char *) n->data;
+		const struct myuser_access *const ma = myuser_access_of(n->data);
 
-		if (!match(entry, buf) || !match(entry, buf2) || !match(entry, buf3) || !match(entry, buf4) || !match_cidr(entry, buf3))
+		if (myuser_access_entry_matches(ma, u, hosts, nhosts, u->ipaddr.family != 0 ? &u->ipaddr : NULL))
 			return true;
 	}
 
@@ -572,11 +1080,12 @@ myuser_access_add(struct myuser *mu, const char *mask)
 		return false;
 	}
 
-	msk = sstrdup(mask);
+	msk = myuser_access_parse(mask)->mask;
 	n = mowgli_node_create();
 	mowgli_node_add(msk, n, &mu->access_list);
 
 	cnt.myuser_access++;
+	db_change_note(DB_CHANGE_MYUSER);
 
 	return true;
 }
@@ -639,9 +1148,10 @@ myuser_access_delete(struct myuser *mu, const char *mask)
 		{
 			mowgli_node_delete(n, &mu->access_list);
 			mowgli_node_free(n);
-			sfree(entry);
+			sfree(myuser_access_of(entry));
 
 			cnt.myuser_access--;
+			db_change_note(DB_CHANGE_MYUSER);
 
 			return;
 		}
@@ -680,7 +1190,7 @@ mynick_add(struct myuser *mu, const char *name)
 	if (!(runflags & RF_STARTING))
 		slog(LG_DEBUG, "mynick_add(): %s -> %s", name, entity(mu)->name);
 
-	mn = mowgli_heap_alloc(mynick_heap);
+	mn = named_heap_alloc(mynick_heap);
 	atheme_object_init(atheme_object(mn), name, (atheme_object_destructor_fn) mynick_delete);
 
 	mowgli_strlcpy(mn->nick, name, sizeof mn->nick);
@@ -689,10 +1199,17 @@ mynick_add(struct myuser *mu, const char *name)
 
 	mowgli_patricia_add(nicklist, mn->nick, mn);
 	mowgli_node_add(mn, &mn->node, &mu->nicks);
+	nickfilter_add(mn->nick);
 
 	myuser_name_restore(mn->nick, mu);
 
+	if (expiry_queues_built)
+		expiry_queue_schedule(&mynick_expiry, &mn->expiry, mn, CURRTIME);
+
 	cnt.mynick++;
+	db_change_note(DB_CHANGE_MYUSER);
+
+	hook_call_mynick_add(mn);
 
 	return mn;
 }
@@ -719,14 +1236,20 @@ mynick_delete(struct mynick *mn)
 	if (!(runflags & RF_STARTING))
 		slog(LG_DEBUG, "mynick_delete(): %s", mn->nick);
 
+	hook_call_mynick_delete(mn);
+
 	myuser_name_remember(mn->nick, mn->owner);
 
 	mowgli_patricia_delete(nicklist, mn->nick);
 	mowgli_node_delete(&mn->node, &mn->owner->nicks);
+	nickfilter_forget();
+
+	expiry_queue_cancel(&mynick_expiry, &mn->expiry);
 
-	mowgli_heap_free(mynick_heap, mn);
+	named_heap_free_deferred(mynick_heap, mn);
 
 	cnt.mynick--;
+	db_change_note(DB_CHANGE_MYUSER);
 }
 
 /*************************
@@ -760,7 +1283,7 @@ myuser_name_add(const char *name)
 	if (!(runflags & RF_STARTING))
 		slog(LG_DEBUG, "myuser_name_add(): %s", name);
 
-	mun = mowgli_heap_alloc(myuser_name_heap);
+	mun = named_heap_alloc(myuser_name_heap);
 	atheme_object_init(atheme_object(mun), name, (atheme_object_destructor_fn) myuser_name_delete);
 
 	mowgli_strlcpy(mun->name, name, sizeof mun->name);
@@ -798,7 +1321,7 @@ myuser_name_delete(struct myuser_name *mun)
 
 	metadata_delete_all(mun);
 
-	mowgli_heap_free(myuser_name_heap, mun);
+	named_heap_free(myuser_name_heap, mun);
 
 	cnt.myuser_name--;
 }
@@ -866,7 +1389,7 @@ myuser_name_restore(const char *name, struct myuser *mu)
 {
 	struct myuser_name *mun;
 	struct metadata *md, *md2;
-	mowgli_patricia_iteration_state_t state;
+	struct metadata_iteration_state state;
 	char *copy;
 
 	mun = myuser_name_find(name);
@@ -891,7 +1414,7 @@ myuser_name_restore(const char *name, struct myuser *mu)
 
 	if (atheme_object(mun)->metadata)
 	{
-		MOWGLI_PATRICIA_FOREACH(md, &state, atheme_object(mun)->metadata)
+		METADATA_FOREACH(md, &state, mun)
 		{
 			/* prefer current metadata to saved */
 			if (!metadata_find(mu, md->name))
@@ -928,13 +1451,15 @@ mycertfp_add(struct myuser *mu, const char *certfp)
 	return_val_if_fail(mu != NULL, NULL);
 	return_val_if_fail(certfp != NULL, NULL);
 
-	mcfp = mowgli_heap_alloc(mycertfp_heap);
+	mcfp = named_heap_alloc(mycertfp_heap);
 	mcfp->mu = mu;
 	mcfp->certfp = sstrdup(certfp);
 
 	mowgli_node_add(mcfp, &mcfp->node, &mu->cert_fingerprints);
 	mowgli_patricia_add(certfplist, mcfp->certfp, mcfp);
 
+	db_change_note(DB_CHANGE_MYUSER);
+
 	return mcfp;
 }
 
@@ -949,7 +1474,9 @@ mycertfp_delete(struct mycertfp *mcfp)
 	mowgli_patricia_delete(certfplist, mcfp->certfp);
 
 	sfree(mcfp->certfp);
-	mowgli_heap_free(mycertfp_heap, mcfp);
+	named_heap_free(mycertfp_heap, mcfp);
+
+	db_change_note(DB_CHANGE_MYUSER);
 }
 
 struct mycertfp *
@@ -964,6 +1491,18 @@ mycertfp_find(const char *certfp)
  * M Y C H A N *
  ***************/
 
+static void
+mychan_mlock_cache_clear(struct mlock_cache *const restrict mlc)
+{
+	sfree(mlc->ext);
+	sfree(mlc->mlock);
+	sfree(mlc->sts_mlock);
+
+	mlc->ext = NULL;
+	mlc->mlock = NULL;
+	mlc->sts_mlock = NULL;
+}
+
 /* private destructor for struct mychan. */
 static void
 mychan_delete(struct mychan *mc)
@@ -975,8 +1514,13 @@ mychan_delete(struct mychan *mc)
 	if (!(runflags & RF_STARTING))
 		slog(LG_DEBUG, "mychan_delete(): %s", mc->name);
 
+	hook_call_mychan_delete(mc);
+
 	if (mc->chan != NULL)
+	{
 		mc->chan->mychan = NULL;
+		channel_fantasy_invalidate(mc->chan);
+	}
 
 	/* remove the chanacs shiz */
 	MOWGLI_ITER_FOREACH_SAFE(n, tn, mc->chanacs.head)
@@ -984,13 +1528,22 @@ mychan_delete(struct mychan *mc)
 
 	metadata_delete_all(mc);
 
+	if (mc->mlock_cache != NULL)
+	{
+		mychan_mlock_cache_clear(mc->mlock_cache);
+		sfree(mc->mlock_cache);
+	}
+
 	mowgli_patricia_delete(mclist, mc->name);
 
 	strshare_unref(mc->name);
 
-	mowgli_heap_free(mychan_heap, mc);
+	expiry_queue_cancel(&mychan_expiry, &mc->expiry);
+
+	named_heap_free_deferred(mychan_heap, mc);
 
 	cnt.mychan--;
+	db_change_note(DB_CHANGE_MYCHAN);
 }
 
 struct mychan *
@@ -1004,7 +1557,7 @@ mychan_add(char *name)
 	if (!(runflags & RF_STARTING))
 		slog(LG_DEBUG, "mychan_add(): %s", name);
 
-	mc = mowgli_heap_alloc(mychan_heap);
+	mc = named_heap_alloc(mychan_heap);
 
 	atheme_object_init(atheme_object(mc), name, (atheme_object_destructor_fn) mychan_delete);
 	mc->name = strshare_get(name);
@@ -1012,11 +1565,20 @@ mychan_add(char *name)
 	mc->chan = channel_find(name);
 
 	if (mc->chan != NULL)
+	{
 		mc->chan->mychan = mc;
+		channel_fantasy_invalidate(mc->chan);
+	}
 
 	mowgli_patricia_add(mclist, mc->name, mc);
 
+	if (expiry_queues_built)
+		expiry_queue_schedule(&mychan_expiry, &mc->expiry, mc, CURRTIME);
+
 	cnt.mychan++;
+	db_change_note(DB_CHANGE_MYCHAN);
+
+	hook_call_mychan_add(mc);
 
 	return mc;
 }
@@ -1202,8 +1764,39 @@ mychan_pick_successor(struct mychan *mc)
 	return mychan_pick_candidate(mc, 0);
 }
 
-const char *
-mychan_get_mlock(struct mychan *mc)
+/* The rendered mode locks are kept in mc->mlock_cache along with the fields
+ * and private:mlockext value they were rendered from. Mode locks are set
+ * from half a dozen modules, so rather than have each of them invalidate
+ * it, the cache checks its key against the channel on every lookup.
+ */
+static struct mlock_cache *
+mychan_mlock_cache(struct mychan *const restrict mc)
+{
+	const struct metadata *const md = metadata_find(mc, "private:mlockext");
+	const char *const ext = (md != NULL) ? md->value : NULL;
+	struct mlock_cache *mlc = mc->mlock_cache;
+
+	if (mlc != NULL && mlc->on == mc->mlock_on && mlc->off == mc->mlock_off && mlc->limit == mc->mlock_limit &&
+	    mlc->key == (mc->mlock_key != NULL) && ((ext == NULL) ? (mlc->ext == NULL) :
+	    (mlc->ext != NULL && strcmp(mlc->ext, ext) == 0)))
+		return mlc;
+
+	if (mlc == NULL)
+		mlc = mc->mlock_cache = smalloc(sizeof *mlc);
+	else
+		mychan_mlock_cache_clear(mlc);
+
+	mlc->on = mc->mlock_on;
+	mlc->off = mc->mlock_off;
+	mlc->limit = mc->mlock_limit;
+	mlc->key = (mc->mlock_key != NULL);
+	mlc->ext = (ext != NULL) ? sstrdup(ext) : NULL;
+
+	return mlc;
+}
+
+static const char *
+mychan_render_mlock(struct mychan *mc)
 {
 	static char buf[BUFSIZE];
 	char params[BUFSIZE];
@@ -1211,8 +1804,6 @@ mychan_get_mlock(struct mychan *mc)
 	char *p, *q, *qq;
 	int dir;
 
-	return_val_if_fail(mc != NULL, NULL);
-
 	*buf = 0;
 	*params = 0;
 
@@ -1333,14 +1924,12 @@ mychan_get_mlock(struct mychan *mc)
 	return buf;
 }
 
-const char *
-mychan_get_sts_mlock(struct mychan *mc)
+static const char *
+mychan_render_sts_mlock(struct mychan *mc)
 {
 	static char mlock[BUFSIZE];
 	struct metadata *md;
 
-	return_val_if_fail(mc != NULL, NULL);
-
 	mlock[0] = '\0';
 
 	if (mc->mlock_on)
@@ -1369,10 +1958,440 @@ mychan_get_sts_mlock(struct mychan *mc)
 	return mlock;
 }
 
+const char *
+mychan_get_mlock(struct mychan *mc)
+{
+	static char buf[BUFSIZE];
+	struct mlock_cache *mlc;
+
+	return_val_if_fail(mc != NULL, NULL);
+
+	mlc = mychan_mlock_cache(mc);
+
+	if (mlc->mlock == NULL)
+		mlc->mlock = sstrdup(mychan_render_mlock(mc));
+
+	// callers may hold on to the result while changing the lock
+	mowgli_strlcpy(buf, mlc->mlock, sizeof buf);
+
+	return buf;
+}
+
+const char *
+mychan_get_sts_mlock(struct mychan *mc)
+{
+	static char buf[BUFSIZE];
+	struct mlock_cache *mlc;
+
+	return_val_if_fail(mc != NULL, NULL);
+
+	mlc = mychan_mlock_cache(mc);
+
+	if (mlc->sts_mlock == NULL)
+		mlc->sts_mlock = sstrdup(mychan_render_sts_mlock(mc));
+
+	mowgli_strlcpy(buf, mlc->sts_mlock, sizeof buf);
+
+	return buf;
+}
+
 /*****************
  * C H A N A C S *
  *****************/
 
+/* Entries for plain accounts are indexed by entity pointer in an
+ * open-addressed table, so literal lookups need not walk the access list.
+ * Everything else (hostmasks, groups, exttargets) can match more than one
+ * entity or user and goes on the short mychan->chanacs_indirect list.
+ */
+#define CHANACS_INDEX_MIN_SIZE          16U
+
+static inline bool
+chanacs_is_indexed(const struct chanacs *const ca)
+{
+	return isuser(ca->entity);
+}
+
+static inline unsigned int
+chanacs_index_slot(const struct myentity *const mt, const unsigned int mask)
+{
+	const uint64_t h = ((uint64_t) (uintptr_t) mt) * UINT64_C(0x9E3779B97F4A7C15);
+
+	return ((unsigned int) (h >> 32)) & mask;
+}
+
+static void
+chanacs_index_insert(struct chanacs **const table, const unsigned int size, struct chanacs *const ca)
+{
+	const unsigned int mask = size - 1U;
+	unsigned int i = chanacs_index_slot(ca->entity, mask);
+
+	while (table[i] != NULL)
+		i = (i + 1U) & mask;
+
+	table[i] = ca;
+}
+
+// Makes room in the index for count entries in all, rehashing at most once
+static void
+chanacs_index_reserve(struct mychan *const mc, const unsigned int count)
+{
+	if (count * 2U <= mc->chanacs_index_size)
+		return;
+
+	unsigned int size = mc->chanacs_index_size ? (mc->chanacs_index_size * 2U) : CHANACS_INDEX_MIN_SIZE;
+
+	while (count * 2U > size)
+		size *= 2U;
+
+	struct chanacs **const table = scalloc(size, sizeof *table);
+
+	for (unsigned int i = 0; i < mc->chanacs_index_size; i++)
+		if (mc->chanacs_index[i] != NULL)
+			chanacs_index_insert(table, size, mc->chanacs_index[i]);
+
+	sfree(mc->chanacs_index);
+
+	mc->chanacs_index = table;
+	mc->chanacs_index_size = size;
+}
+
+static void
+chanacs_index_add(struct mychan *const mc, struct chanacs *const ca)
+{
+	chanacs_index_reserve(mc, mc->chanacs_index_count + 1U);
+
+	chanacs_index_insert(mc->chanacs_index, mc->chanacs_index_size, ca);
+	mc->chanacs_index_count++;
+}
+
+static void
+chanacs_index_remove(struct mychan *const mc, const struct chanacs *const ca)
+{
+	return_if_fail(mc->chanacs_index != NULL);
+
+	const unsigned int mask = mc->chanacs_index_size - 1U;
+	unsigned int i = chanacs_index_slot(ca->entity, mask);
+
+	while (mc->chanacs_index[i] != ca)
+	{
+		return_if_fail(mc->chanacs_index[i] != NULL);
+
+		i = (i + 1U) & mask;
+	}
+
+	// Shift later entries of the probe run back so that lookups never stop early
+	for (unsigned int j = (i + 1U) & mask; mc->chanacs_index[j] != NULL; j = (j + 1U) & mask)
+	{
+		const unsigned int home = chanacs_index_slot(mc->chanacs_index[j]->entity, mask);
+
+		if (((j - home) & mask) >= ((j - i) & mask))
+		{
+			mc->chanacs_index[i] = mc->chanacs_index[j];
+			i = j;
+		}
+	}
+
+	mc->chanacs_index[i] = NULL;
+
+	if (--mc->chanacs_index_count == 0)
+	{
+		sfree(mc->chanacs_index);
+
+		mc->chanacs_index = NULL;
+		mc->chanacs_index_size = 0;
+	}
+}
+
+/* Hostmask entries are matched against every user that joins, so channels
+ * with many of them also file them by the host part of the mask: one whose
+ * host part is literal can only match a user with exactly that host (the
+ * '@' before it has to be the user's), so it is looked up by the user's
+ * hosts, and only the rest (wildcards or CIDR in the host part) have to be
+ * tried one by one.
+ */
+#define CHANACS_HOST_INDEX_MIN          16U
+
+// The literal host part of a hostmask, or NULL if it has none
+static const char *
+chanacs_host_key(const char *const host)
+{
+	const char *p = (host != NULL) ? strrchr(host, '@') : NULL;
+
+	if (p == NULL || *++p == '\0' || strpbrk(p, "*?&#%\\/") != NULL)
+		return NULL;
+
+	return p;
+}
+
+static void
+chanacs_host_index_insert(struct mychan *const mc, struct chanacs *const ca)
+{
+	const char *const key = chanacs_host_key(ca->host);
+
+	if (key == NULL)
+	{
+		mowgli_node_add(ca, &ca->hnode, &mc->chanacs_hostmasks);
+		return;
+	}
+
+	ca->host_next = mowgli_patricia_retrieve(mc->chanacs_hosts, key);
+
+	if (ca->host_next != NULL)
+		(void) mowgli_patricia_delete(mc->chanacs_hosts, key);
+
+	mowgli_patricia_add(mc->chanacs_hosts, key, ca);
+}
+
+static void
+chanacs_host_index_clear(struct mychan *const mc)
+{
+	mowgli_node_t *n, *tn;
+
+	mowgli_patricia_destroy(mc->chanacs_hosts, NULL, NULL);
+	mc->chanacs_hosts = NULL;
+
+	MOWGLI_ITER_FOREACH_SAFE(n, tn, mc->chanacs_hostmasks.head)
+		mowgli_node_delete(n, &mc->chanacs_hostmasks);
+}
+
+static void
+chanacs_host_index_build(struct mychan *const mc)
+{
+	mowgli_node_t *n;
+
+	mc->chanacs_hosts = mowgli_patricia_create(irccasecanon);
+
+	MOWGLI_ITER_FOREACH(n, mc->chanacs_indirect.head)
+	{
+		struct chanacs *const hca = n->data;
+
+		if (hca->entity == NULL)
+			chanacs_host_index_insert(mc, hca);
+	}
+}
+
+static void
+chanacs_host_index_add(struct mychan *const mc, struct chanacs *const ca)
+{
+	mc->chanacs_host_count++;
+
+	if (mc->chanacs_hosts != NULL)
+	{
+		chanacs_host_index_insert(mc, ca);
+		return;
+	}
+
+	if (mc->chanacs_host_count < CHANACS_HOST_INDEX_MIN)
+		return;
+
+	chanacs_host_index_build(mc);
+}
+
+static void
+chanacs_host_index_remove(struct mychan *const mc, struct chanacs *const ca)
+{
+	const char *key;
+	struct chanacs *head;
+
+	mc->chanacs_host_count--;
+
+	if (mc->chanacs_hosts == NULL)
+		return;
+
+	if (mc->chanacs_host_count < CHANACS_HOST_INDEX_MIN / 4U)
+	{
+		chanacs_host_index_clear(mc);
+		return;
+	}
+
+	if ((key = chanacs_host_key(ca->host)) == NULL)
+	{
+		mowgli_node_delete(&ca->hnode, &mc->chanacs_hostmasks);
+		return;
+	}
+
+	if ((head = mowgli_patricia_retrieve(mc->chanacs_hosts, key)) == NULL)
+		return;
+
+	if (head != ca)
+	{
+		for (struct chanacs *prev = head; prev->host_next != NULL; prev = prev->host_next)
+			if (prev->host_next == ca)
+			{
+				prev->host_next = ca->host_next;
+				break;
+			}
+
+		return;
+	}
+
+	(void) mowgli_patricia_delete(mc->chanacs_hosts, key);
+
+	if (ca->host_next != NULL)
+		mowgli_patricia_add(mc->chanacs_hosts, key, ca->host_next);
+}
+
+static struct chanacs_level_count *
+chanacs_counts_find_level(const struct chanacs_counts *const cc, const unsigned int level)
+{
+	// Seldom more than a handful of distinct levels, so a scan will do
+	for (unsigned int i = 0; i < cc->nlevels; i++)
+		if (cc->levels[i].level == level)
+			return &cc->levels[i];
+
+	return NULL;
+}
+
+static void
+chanacs_counts_add(struct mychan *const mc, const unsigned int level)
+{
+	struct chanacs_counts *cc = mc->chanacs_counts;
+	struct chanacs_level_count *lc;
+
+	if (cc == NULL)
+		cc = mc->chanacs_counts = smalloc(sizeof *cc);
+
+	for (unsigned int i = 0; i < ARRAY_SIZE(cc->flags); i++)
+		if (level & (1U << i))
+			cc->flags[i]++;
+
+	if ((lc = chanacs_counts_find_level(cc, level)) != NULL)
+	{
+		lc->count++;
+		return;
+	}
+
+	if (cc->nlevels == cc->levels_size)
+	{
+		cc->levels_size = cc->levels_size ? (cc->levels_size * 2U) : 4U;
+		cc->levels = sreallocarray(cc->levels, cc->levels_size, sizeof *cc->levels);
+	}
+
+	cc->levels[cc->nlevels].level = level;
+	cc->levels[cc->nlevels].count = 1;
+	cc->nlevels++;
+}
+
+static void
+chanacs_counts_remove(struct mychan *const mc, const unsigned int level)
+{
+	struct chanacs_counts *const cc = mc->chanacs_counts;
+	struct chanacs_level_count *lc;
+
+	return_if_fail(cc != NULL);
+
+	for (unsigned int i = 0; i < ARRAY_SIZE(cc->flags); i++)
+		if (level & (1U << i))
+			cc->flags[i]--;
+
+	return_if_fail((lc = chanacs_counts_find_level(cc, level)) != NULL);
+
+	if (--lc->count == 0)
+		*lc = cc->levels[--cc->nlevels];
+}
+
+static void
+chanacs_counts_free(struct mychan *const mc)
+{
+	if (mc->chanacs_counts == NULL)
+		return;
+
+	sfree(mc->chanacs_counts->levels);
+	sfree(mc->chanacs_counts);
+
+	mc->chanacs_counts = NULL;
+}
+
+static void
+chanacs_link(struct mychan *const mc, struct chanacs *const ca)
+{
+	mowgli_node_add(ca, &ca->cnode, &mc->chanacs);
+	chanacs_counts_add(mc, ca->level);
+
+	if (chanacs_is_indexed(ca))
+		chanacs_index_add(mc, ca);
+	else
+		mowgli_node_add(ca, &ca->inode, &mc->chanacs_indirect);
+
+	if (ca->entity == NULL)
+		chanacs_host_index_add(mc, ca);
+
+	if (isdynamic(ca->entity))
+		mc->chanacs_dynamic++;
+
+	chanacs_flags_invalidate();
+}
+
+static void
+chanacs_unlink(struct mychan *const mc, struct chanacs *const ca)
+{
+	mowgli_node_delete(&ca->cnode, &mc->chanacs);
+	chanacs_counts_remove(mc, ca->level);
+
+	if (MOWGLI_LIST_LENGTH(&mc->chanacs) == 0)
+		chanacs_counts_free(mc);
+
+	if (chanacs_is_indexed(ca))
+		chanacs_index_remove(mc, ca);
+	else
+		mowgli_node_delete(&ca->inode, &mc->chanacs_indirect);
+
+	if (ca->entity == NULL)
+		chanacs_host_index_remove(mc, ca);
+
+	if (isdynamic(ca->entity))
+		mc->chanacs_dynamic--;
+
+	chanacs_flags_invalidate();
+}
+
+/*
+ * chanacs_detach()
+ *
+ * Takes an access entry off its channel's list and indexes and off its
+ * entity's list, without destroying it or calling any hooks; for dbverify,
+ * which drops entries it cannot trust.
+ */
+void
+chanacs_detach(struct chanacs *const ca)
+{
+	return_if_fail(ca != NULL);
+	return_if_fail(ca->mychan != NULL);
+
+	chanacs_unlink(ca->mychan, ca);
+
+	if (ca->entity != NULL)
+		mowgli_node_delete(&ca->unode, &ca->entity->chanacs);
+}
+
+/* Returns the next indexed entry for mt after slot *iter, starting a new
+ * search when *iter is UINT_MAX; NULL when there are no more.
+ */
+static struct chanacs *
+chanacs_index_next(const struct mychan *const mc, const struct myentity *const mt, unsigned int *const iter)
+{
+	if (mc->chanacs_index == NULL)
+		return NULL;
+
+	const unsigned int mask = mc->chanacs_index_size - 1U;
+	unsigned int i = (*iter == UINT_MAX) ? chanacs_index_slot(mt, mask) : ((*iter + 1U) & mask);
+
+	for (; mc->chanacs_index[i] != NULL; i = (i + 1U) & mask)
+	{
+		if (mc->chanacs_index[i]->entity == mt)
+		{
+			*iter = i;
+			return mc->chanacs_index[i];
+		}
+	}
+
+	return NULL;
+}
+
+// Set while chanacs_replace() clears out the entries it does not keep
+static bool chanacs_replacing = false;
+
 /* private destructor for struct chanacs */
 static void
 chanacs_delete(struct chanacs *ca)
@@ -1384,7 +2403,12 @@ chanacs_delete(struct chanacs *ca)
 		slog(LG_DEBUG, "chanacs_delete(): %s -> %s [%s]", ca->mychan->name,
 			ca->entity != NULL ? entity(ca->entity)->name : ca->host,
 			ca->entity != NULL ? "entity" : "hostmask");
-	mowgli_node_delete(&ca->cnode, &ca->mychan->chanacs);
+
+	// chanacs_replace() calls its own hook instead
+	if (!chanacs_replacing)
+		hook_call_chanacs_delete(ca);
+
+	chanacs_unlink(ca->mychan, ca);
 
 	if (ca->entity != NULL)
 	{
@@ -1398,9 +2422,42 @@ chanacs_delete(struct chanacs *ca)
 
 	sfree(ca->host);
 
-	mowgli_heap_free(chanacs_heap, ca);
+	named_heap_free_deferred(chanacs_heap, ca);
 
 	cnt.chanacs--;
+	db_change_note(DB_CHANGE_CHANACS);
+}
+
+// A new access entry for an entity or (if mt is NULL) a hostmask, not yet on any list
+static struct chanacs *
+chanacs_alloc(struct mychan *mychan, struct myentity *mt, const char *host, unsigned int level, time_t ts, struct myentity *setter)
+{
+	struct chanacs *ca = named_heap_alloc(chanacs_heap);
+
+	if (mt != NULL)
+	{
+		atheme_object_init(atheme_object(ca), mt->name, (atheme_object_destructor_fn) chanacs_delete);
+		ca->entity = isdynamic(mt) ? atheme_object_ref(mt) : mt;
+		ca->host = NULL;
+	}
+	else
+	{
+		atheme_object_init(atheme_object(ca), host, (atheme_object_destructor_fn) chanacs_delete);
+		ca->entity = NULL;
+		ca->host = sstrdup(host);
+		(void) cidr_parse_hostmask(ca->host, &ca->cidr);
+	}
+
+	ca->mychan = mychan;
+	ca->level = level & ca_all;
+	ca->tmodified = ts;
+
+	if (setter != NULL)
+		mowgli_strlcpy(ca->setter_uid, setter->id, sizeof ca->setter_uid);
+	else
+		ca->setter_uid[0] = '\0';
+
+	return ca;
 }
 
 /*
@@ -1436,24 +2493,15 @@ chanacs_add(struct mychan *mychan, struct myentity *mt, unsigned int level, time
 	if (!(runflags & RF_STARTING))
 		slog(LG_DEBUG, "chanacs_add(): %s -> %s", mychan->name, mt->name);
 
-	ca = mowgli_heap_alloc(chanacs_heap);
-
-	atheme_object_init(atheme_object(ca), mt->name, (atheme_object_destructor_fn) chanacs_delete);
-	ca->mychan = mychan;
-	ca->entity = isdynamic(mt) ? atheme_object_ref(mt) : mt;
-	ca->host = NULL;
-	ca->level = level & ca_all;
-	ca->tmodified = ts;
-
-	if (setter != NULL)
-		mowgli_strlcpy(ca->setter_uid, setter->id, sizeof ca->setter_uid);
-	else
-		ca->setter_uid[0] = '\0';
+	ca = chanacs_alloc(mychan, mt, NULL, level, ts, setter);
 
-	mowgli_node_add(ca, &ca->cnode, &mychan->chanacs);
+	chanacs_link(mychan, ca);
 	mowgli_node_add(ca, &ca->unode, &mt->chanacs);
 
 	cnt.chanacs++;
+	db_change_note(DB_CHANGE_CHANACS);
+
+	hook_call_chanacs_change(ca);
 
 	return ca;
 }
@@ -1491,27 +2539,200 @@ chanacs_add_host(struct mychan *mychan, const char *host, unsigned int level, ti
 	if (!(runflags & RF_STARTING))
 		slog(LG_DEBUG, "chanacs_add_host(): %s -> %s", mychan->name, host);
 
-	ca = mowgli_heap_alloc(chanacs_heap);
-
-	atheme_object_init(atheme_object(ca), host, (atheme_object_destructor_fn) chanacs_delete);
-	ca->mychan = mychan;
-	ca->entity = NULL;
-	ca->host = sstrdup(host);
-	ca->level = level & ca_all;
-	ca->tmodified = ts;
-
-	if (setter != NULL)
-		mowgli_strlcpy(ca->setter_uid, setter->id, sizeof ca->setter_uid);
-	else
-		ca->setter_uid[0] = '\0';
+	ca = chanacs_alloc(mychan, NULL, host, level, ts, setter);
 
-	mowgli_node_add(ca, &ca->cnode, &mychan->chanacs);
+	chanacs_link(mychan, ca);
 
 	cnt.chanacs++;
+	db_change_note(DB_CHANGE_CHANACS);
+
+	hook_call_chanacs_change(ca);
 
 	return ca;
 }
 
+/*
+ * chanacs_replace(struct mychan *mychan, const struct chanacs_import *entries, size_t count, unsigned int keep)
+ *
+ * Replaces a channel's access list in one go, e.g. with a copy of another
+ * channel's.
+ *
+ * Inputs:
+ *       - a channel to replace the access list of
+ *       - the entries to give it (an entity or a hostmask each)
+ *       - a bitmask of privileges whose holders keep their entries; the
+ *         level of an entry given for one of them is added to theirs
+ *
+ * Outputs:
+ *       - how many entries were added
+ *
+ * Side Effects:
+ *       - every other access entry of mychan is removed.
+ *       - the indexes are grown once for the whole list rather than as
+ *         entries are added.
+ *       - instead of a chanacs_change or chanacs_delete hook for each
+ *         entry, the chanacs_replace hook is called once at the end.
+ */
+unsigned int
+chanacs_replace(struct mychan *mychan, const struct chanacs_import *entries, size_t count, unsigned int keep)
+{
+	struct hook_chanacs_replace hdata;
+	mowgli_node_t *n, *tn;
+	struct chanacs *ca;
+	unsigned int indexed = 0, kept = 0, added = 0;
+	size_t i;
+
+	return_val_if_fail(mychan != NULL, 0);
+	return_val_if_fail(entries != NULL || count == 0, 0);
+
+	if (*mychan->name != '#')
+	{
+		slog(LG_DEBUG, "chanacs_replace(): got non #channel: %s", mychan->name);
+		return 0;
+	}
+
+	slog(LG_DEBUG, "chanacs_replace(): %s -> %zu entries", mychan->name, count);
+
+	chanacs_replacing = true;
+
+	MOWGLI_ITER_FOREACH_SAFE(n, tn, mychan->chanacs.head)
+	{
+		ca = n->data;
+
+		if (ca->level & keep)
+			kept++;
+		else
+			atheme_object_unref(ca);
+	}
+
+	chanacs_replacing = false;
+
+	for (i = 0; i < count; i++)
+		if (entries[i].entity != NULL && isuser(entries[i].entity))
+			indexed++;
+
+	chanacs_index_reserve(mychan, mychan->chanacs_index_count + indexed);
+
+	for (i = 0; i < count; i++)
+	{
+		const struct chanacs_import *const ci = &entries[i];
+
+		if ((ci->entity == NULL) == (ci->host == NULL) || !(ci->level & ca_all))
+			continue;
+
+		// only the few entries kept can be there already
+		if (kept != 0 && (ca = (ci->entity != NULL ? chanacs_find_literal(mychan, ci->entity, 0) :
+				chanacs_find_host_literal(mychan, ci->host, 0))) != NULL)
+		{
+			chanacs_set_level(ca, ca->level | (ci->level & ca_all));
+			ca->tmodified = ci->tmodified;
+
+			if (ci->setter != NULL)
+				mowgli_strlcpy(ca->setter_uid, ci->setter->id, sizeof ca->setter_uid);
+			else
+				ca->setter_uid[0] = '\0';
+
+			continue;
+		}
+
+		ca = chanacs_alloc(mychan, ci->entity, ci->host, ci->level, ci->tmodified, ci->setter);
+
+		mowgli_node_add(ca, &ca->cnode, &mychan->chanacs);
+		chanacs_counts_add(mychan, ca->level);
+
+		if (chanacs_is_indexed(ca))
+		{
+			chanacs_index_insert(mychan->chanacs_index, mychan->chanacs_index_size, ca);
+			mychan->chanacs_index_count++;
+		}
+		else
+			mowgli_node_add(ca, &ca->inode, &mychan->chanacs_indirect);
+
+		if (ca->entity != NULL)
+		{
+			mowgli_node_add(ca, &ca->unode, &ca->entity->chanacs);
+
+			if (isdynamic(ca->entity))
+				mychan->chanacs_dynamic++;
+		}
+		else
+		{
+			mychan->chanacs_host_count++;
+
+			if (mychan->chanacs_hosts != NULL)
+				chanacs_host_index_insert(mychan, ca);
+		}
+
+		added++;
+	}
+
+	if (mychan->chanacs_hosts == NULL && mychan->chanacs_host_count >= CHANACS_HOST_INDEX_MIN)
+		chanacs_host_index_build(mychan);
+
+	chanacs_flags_invalidate();
+
+	cnt.chanacs += added;
+	db_change_note(DB_CHANGE_CHANACS);
+
+	hdata.mc = mychan;
+	hdata.keep = keep;
+	hook_call_chanacs_replace(&hdata);
+
+	return added;
+}
+
+/* Changes an entry's level, keeping its channel's counts (see
+ * chanacs_count_level() and chanacs_count_flag()) up to date.
+ */
+void
+chanacs_set_level(struct chanacs *const ca, const unsigned int level)
+{
+	return_if_fail(ca != NULL);
+	return_if_fail(ca->mychan != NULL);
+
+	if (ca->level == level)
+		return;
+
+	chanacs_counts_remove(ca->mychan, ca->level);
+	ca->level = level;
+	chanacs_counts_add(ca->mychan, ca->level);
+
+	chanacs_flags_invalidate();
+}
+
+// How many of the channel's access entries have exactly this level
+unsigned int
+chanacs_count_level(const struct mychan *const mychan, const unsigned int level)
+{
+	const struct chanacs_level_count *lc;
+
+	return_val_if_fail(mychan != NULL, 0);
+
+	if (mychan->chanacs_counts == NULL)
+		return 0;
+
+	if ((lc = chanacs_counts_find_level(mychan->chanacs_counts, level)) == NULL)
+		return 0;
+
+	return lc->count;
+}
+
+// How many of the channel's access entries have this (single) flag
+unsigned int
+chanacs_count_flag(const struct mychan *const mychan, const unsigned int flag)
+{
+	return_val_if_fail(mychan != NULL, 0);
+
+	if (mychan->chanacs_counts == NULL)
+		return 0;
+
+	for (unsigned int i = 0; i < ARRAY_SIZE(mychan->chanacs_counts->flags); i++)
+		if (flag == (1U << i))
+			return mychan->chanacs_counts->flags[i];
+
+	return 0;
+}
+
 struct chanacs *
 chanacs_find(struct mychan *mychan, struct myentity *mt, unsigned int level)
 {
@@ -1523,7 +2744,7 @@ chanacs_find(struct mychan *mychan, struct myentity *mt, unsigned int level)
 	if ((ca = chanacs_find_literal(mychan, mt, level)) != NULL)
 		return ca;
 
-	MOWGLI_ITER_FOREACH(n, mychan->chanacs.head)
+	MOWGLI_ITER_FOREACH(n, mychan->chanacs_indirect.head)
 	{
 		const struct entity_vtable *vt;
 
@@ -1550,11 +2771,15 @@ chanacs_entity_flags(struct mychan *mychan, struct myentity *mt)
 {
 	mowgli_node_t *n;
 	struct chanacs *ca;
+	unsigned int iter = UINT_MAX;
 	unsigned int result = 0;
 
 	return_val_if_fail(mychan != NULL && mt != NULL, 0);
 
-	MOWGLI_ITER_FOREACH(n, mychan->chanacs.head)
+	while ((ca = chanacs_index_next(mychan, mt, &iter)) != NULL)
+		result |= ca->level;
+
+	MOWGLI_ITER_FOREACH(n, mychan->chanacs_indirect.head)
 	{
 		const struct entity_vtable *vt;
 
@@ -1582,10 +2807,20 @@ chanacs_find_literal(struct mychan *mychan, struct myentity *mt, unsigned int le
 {
 	mowgli_node_t *n;
 	struct chanacs *ca;
+	unsigned int iter = UINT_MAX;
 
 	return_val_if_fail(mychan != NULL && mt != NULL, NULL);
 
-	MOWGLI_ITER_FOREACH(n, mychan->chanacs.head)
+	if (isuser(mt))
+	{
+		while ((ca = chanacs_index_next(mychan, mt, &iter)) != NULL)
+			if ((ca->level & level) == level)
+				return ca;
+
+		return NULL;
+	}
+
+	MOWGLI_ITER_FOREACH(n, mychan->chanacs_indirect.head)
 	{
 		ca = (struct chanacs *)n->data;
 
@@ -1609,7 +2844,7 @@ chanacs_find_host(struct mychan *mychan, const char *host, unsigned int level)
 
 	return_val_if_fail(mychan != NULL && host != NULL, NULL);
 
-	MOWGLI_ITER_FOREACH(n, mychan->chanacs.head)
+	MOWGLI_ITER_FOREACH(n, mychan->chanacs_indirect.head)
 	{
 		ca = (struct chanacs *)n->data;
 
@@ -1634,7 +2869,7 @@ chanacs_host_flags(struct mychan *mychan, const char *host)
 
 	return_val_if_fail(mychan != NULL && host != NULL, 0);
 
-	MOWGLI_ITER_FOREACH(n, mychan->chanacs.head)
+	MOWGLI_ITER_FOREACH(n, mychan->chanacs_indirect.head)
 	{
 		ca = (struct chanacs *)n->data;
 
@@ -1654,7 +2889,7 @@ chanacs_find_host_literal(struct mychan *mychan, const char *host, unsigned int
 	if ((!mychan) || (!host))
 		return NULL;
 
-	MOWGLI_ITER_FOREACH(n, mychan->chanacs.head)
+	MOWGLI_ITER_FOREACH(n, mychan->chanacs_indirect.head)
 	{
 		ca = (struct chanacs *)n->data;
 
@@ -1670,38 +2905,103 @@ chanacs_find_host_literal(struct mychan *mychan, const char *host, unsigned int
 	return NULL;
 }
 
-struct chanacs *
-chanacs_find_host_by_user(struct mychan *mychan, struct user *u, unsigned int level)
+/* Calls cb for each hostmask entry that matches u, through the host index,
+ * until it returns true; false if it never did. A protocol module that
+ * matches hostmasks its own way gets the whole list walked as before.
+ */
+static bool
+chanacs_host_foreach_by_user(struct mychan *const mc, struct user *const u,
+                             bool (*const cb)(struct chanacs *, void *), void *const priv)
 {
+	const char *hosts[] = { u->vhost, user_chost(u), u->host, u->ip };
 	mowgli_node_t *n;
 	struct chanacs *ca;
 
-	return_val_if_fail(mychan != NULL && u != NULL, 0);
+	if (mc->chanacs_hosts == NULL || next_matching_host_chanacs != &generic_next_matching_host_chanacs ||
+	    mask_matches_user != &generic_mask_matches_user)
+	{
+		for (n = next_matching_host_chanacs(mc, u, mc->chanacs_indirect.head); n != NULL; n = next_matching_host_chanacs(mc, u, n->next))
+			if (cb(n->data, priv))
+				return true;
+
+		return false;
+	}
+
+	for (size_t i = 0; i < ARRAY_SIZE(hosts); i++)
+	{
+		bool seen = false;
+
+		if (hosts[i] == NULL || *hosts[i] == '\0')
+			continue;
+
+		for (size_t j = 0; j < i && !seen; j++)
+			seen = (hosts[j] != NULL && !irccasecmp(hosts[i], hosts[j]));
+
+		if (seen)
+			continue;
 
-	for (n = next_matching_host_chanacs(mychan, u, mychan->chanacs.head); n != NULL; n = next_matching_host_chanacs(mychan, u, n->next))
+		for (ca = mowgli_patricia_retrieve(mc->chanacs_hosts, hosts[i]); ca != NULL; ca = ca->host_next)
+			if (generic_mask_matches_user_parsed(ca->host, &ca->cidr, u) && cb(ca, priv))
+				return true;
+	}
+
+	MOWGLI_ITER_FOREACH(n, mc->chanacs_hostmasks.head)
 	{
 		ca = n->data;
-		if ((ca->level & level) == level)
-			return ca;
+
+		if (generic_mask_matches_user_parsed(ca->host, &ca->cidr, u) && cb(ca, priv))
+			return true;
 	}
 
-	return NULL;
+	return false;
+}
+
+struct chanacs_host_find
+{
+	unsigned int            level;
+	struct chanacs *        ca;
+};
+
+static bool
+chanacs_host_find_cb(struct chanacs *const ca, void *const priv)
+{
+	struct chanacs_host_find *const hf = priv;
+
+	if ((ca->level & hf->level) != hf->level)
+		return false;
+
+	hf->ca = ca;
+	return true;
+}
+
+static bool
+chanacs_host_flags_cb(struct chanacs *const ca, void *const priv)
+{
+	*((unsigned int *) priv) |= ca->level;
+
+	return false;
+}
+
+struct chanacs *
+chanacs_find_host_by_user(struct mychan *mychan, struct user *u, unsigned int level)
+{
+	struct chanacs_host_find hf = { .level = level, .ca = NULL };
+
+	return_val_if_fail(mychan != NULL && u != NULL, 0);
+
+	(void) chanacs_host_foreach_by_user(mychan, u, &chanacs_host_find_cb, &hf);
+
+	return hf.ca;
 }
 
 static unsigned int
 chanacs_host_flags_by_user(struct mychan *mychan, struct user *u)
 {
-	mowgli_node_t *n;
 	unsigned int result = 0;
-	struct chanacs *ca;
 
 	return_val_if_fail(mychan != NULL && u != NULL, 0);
 
-	for (n = next_matching_host_chanacs(mychan, u, mychan->chanacs.head); n != NULL; n = next_matching_host_chanacs(mychan, u, n->next))
-	{
-		ca = n->data;
-		result |= ca->level;
-	}
+	(void) chanacs_host_foreach_by_user(mychan, u, &chanacs_host_flags_cb, &result);
 
 	slog(LG_DEBUG, "chanacs_host_flags_by_user(%s, %s): return %s", mychan->name, u->nick, bitmask_to_flags(result));
 
@@ -1752,17 +3052,24 @@ static unsigned int
 chanacs_entity_flags_by_user(struct mychan *mychan, struct user *u)
 {
 	mowgli_node_t *n;
+	unsigned int iter = UINT_MAX;
 	unsigned int result = 0;
+	struct chanacs *ca;
 
 	return_val_if_fail(mychan != NULL, 0);
 	return_val_if_fail(u != NULL, 0);
 
-	MOWGLI_ITER_FOREACH(n, mychan->chanacs.head)
+	if (u->myuser != NULL)
+		while ((ca = chanacs_index_next(mychan, entity(u->myuser), &iter)) != NULL)
+			result |= ca->level;
+
+	MOWGLI_ITER_FOREACH(n, mychan->chanacs_indirect.head)
 	{
-		struct chanacs *ca = n->data;
 		struct myentity *mt;
 		const struct entity_vtable *vt;
 
+		ca = n->data;
+
 		if (ca->entity == NULL)
 			continue;
 
@@ -1773,19 +3080,90 @@ chanacs_entity_flags_by_user(struct mychan *mychan, struct user *u)
 			result |= ca->level;
 	}
 
-	slog(LG_DEBUG, "chanacs_entity_flags_by_user(%s, %s): return %s", mychan->name, u->nick, bitmask_to_flags(result));
+	slog(LG_DEBUG, "chanacs_entity_flags_by_user(%s, %s): return %s", mychan->name, u->nick, bitmask_to_flags(result));
+
+	return result;
+}
+
+/* The effective flags of a user on a channel are cached in their chanuser.
+ * An entry is good while chanacs_flags_gen and the user's acskey.gen are
+ * what they were when it was filled. The former is bumped by any change to
+ * channel or group access, the latter whenever the user's names, host or
+ * account turn out to differ from the key; the key holds references to the
+ * strings so that a new string can never reuse the address of an old one.
+ * Exttargets can depend on anything at all, so channels using them are
+ * never cached.
+ */
+static unsigned int chanacs_flags_gen = 1;
+
+void
+chanacs_flags_invalidate(void)
+{
+	if (++chanacs_flags_gen == 0)
+		chanacs_flags_gen = 1;
+}
+
+unsigned int
+chanacs_flags_generation(void)
+{
+	return chanacs_flags_gen;
+}
+
+static void
+chanacs_user_key_set(stringref *const restrict key, const stringref value)
+{
+	if (*key == value)
+		return;
+
+	strshare_unref(*key);
+	*key = strshare_ref(value);
+}
+
+static unsigned int
+chanacs_user_gen(struct user *const restrict u)
+{
+	struct user_acs_key *const key = &u->cold->acskey;
+	const bool waitauth = (u->myuser != NULL && (u->myuser->flags & MU_WAITAUTH));
+
+	if (key->nick != u->nick || key->user != u->user || key->host != u->host || key->chost != user_chost(u) ||
+	    key->vhost != u->vhost || key->ip != u->ip || key->myuser != u->myuser || key->waitauth != waitauth)
+	{
+		chanacs_user_key_set(&key->nick, u->nick);
+		chanacs_user_key_set(&key->user, u->user);
+		chanacs_user_key_set(&key->host, u->host);
+		chanacs_user_key_set(&key->chost, user_chost(u));
+		chanacs_user_key_set(&key->vhost, u->vhost);
+		chanacs_user_key_set(&key->ip, u->ip);
+
+		key->myuser = u->myuser;
+		key->waitauth = waitauth;
+		key->gen++;
+	}
+
+	return key->gen;
+}
+
+void
+chanacs_user_forget(struct user *const restrict u)
+{
+	struct user_acs_key *const key = &u->cold->acskey;
 
-	return result;
+	strshare_unref(key->nick);
+	strshare_unref(key->user);
+	strshare_unref(key->host);
+	strshare_unref(key->chost);
+	strshare_unref(key->vhost);
+	strshare_unref(key->ip);
+
+	(void) memset(key, 0x00, sizeof *key);
 }
 
-unsigned int
-chanacs_user_flags(struct mychan *mychan, struct user *u)
+static unsigned int
+chanacs_user_flags_uncached(struct mychan *mychan, struct user *u)
 {
 	struct myentity *mt;
 	unsigned int result = 0;
 
-	return_val_if_fail(mychan != NULL && u != NULL, 0);
-
 	mt = entity(u->myuser);
 	if (mt != NULL)
 		result |= chanacs_entity_flags(mychan, mt);
@@ -1805,6 +3183,30 @@ chanacs_user_flags(struct mychan *mychan, struct user *u)
 	return result;
 }
 
+unsigned int
+chanacs_user_flags(struct mychan *mychan, struct user *u)
+{
+	struct chanuser *cu;
+	unsigned int usergen;
+
+	return_val_if_fail(mychan != NULL && u != NULL, 0);
+
+	if (mychan->chanacs_dynamic || mychan->chan == NULL || (cu = chanuser_find(mychan->chan, u)) == NULL)
+		return chanacs_user_flags_uncached(mychan, u);
+
+	usergen = chanacs_user_gen(u);
+
+	if (cu->acs_mychan == mychan && cu->acs_gen == chanacs_flags_gen && cu->acs_usergen == usergen)
+		return cu->acs_flags;
+
+	cu->acs_flags = chanacs_user_flags_uncached(mychan, u);
+	cu->acs_mychan = mychan;
+	cu->acs_gen = chanacs_flags_gen;
+	cu->acs_usergen = usergen;
+
+	return cu->acs_flags;
+}
+
 unsigned int
 chanacs_source_flags(struct mychan *mychan, struct sourceinfo *si)
 {
@@ -1880,13 +3282,16 @@ chanacs_modify(struct chanacs *ca, unsigned int *addflags, unsigned int *removef
 	/* attempting to manipulate user with more privs? */
 	if (~restrictflags & ca->level)
 		return false;
-	ca->level = (ca->level | *addflags) & ~*removeflags;
+	chanacs_set_level(ca, (ca->level | *addflags) & ~*removeflags);
 	ca->tmodified = CURRTIME;
 	if (setter != NULL)
 		mowgli_strlcpy(ca->setter_uid, entity(setter)->id, sizeof ca->setter_uid);
 	else
 		ca->setter_uid[0] = '\0';
 
+	db_change_note(DB_CHANGE_CHANACS);
+	hook_call_chanacs_change(ca);
+
 	return true;
 }
 
@@ -1949,7 +3354,7 @@ chanacs_change(struct mychan *mychan, struct myentity *mt, const char *hostmask,
 			/* attempting to manipulate user with more privs? */
 			if (~restrictflags & ca->level)
 				return false;
-			ca->level = (ca->level | *addflags) & ~*removeflags;
+			chanacs_set_level(ca, (ca->level | *addflags) & ~*removeflags);
 			ca->tmodified = CURRTIME;
 			if (setter != NULL)
 				mowgli_strlcpy(ca->setter_uid, setter->id, sizeof ca->setter_uid);
@@ -1958,6 +3363,8 @@ chanacs_change(struct mychan *mychan, struct myentity *mt, const char *hostmask,
 
 			if (ca->level == 0)
 				atheme_object_unref(ca);
+			else
+				hook_call_chanacs_change(ca);
 		}
 	}
 	else /* hostmask != NULL */
@@ -1990,7 +3397,7 @@ chanacs_change(struct mychan *mychan, struct myentity *mt, const char *hostmask,
 			/* attempting to manipulate user with more privs? */
 			if (~restrictflags & ca->level)
 				return false;
-			ca->level = (ca->level | *addflags) & ~*removeflags;
+			chanacs_set_level(ca, (ca->level | *addflags) & ~*removeflags);
 			ca->tmodified = CURRTIME;
 			if (setter != NULL)
 				mowgli_strlcpy(ca->setter_uid, setter->id, sizeof ca->setter_uid);
@@ -1999,6 +3406,8 @@ chanacs_change(struct mychan *mychan, struct myentity *mt, const char *hostmask,
 
 			if (ca->level == 0)
 				atheme_object_unref(ca);
+			else
+				hook_call_chanacs_change(ca);
 		}
 	}
 	return true;
@@ -2015,14 +3424,109 @@ chanacs_change_simple(struct mychan *mychan, struct myentity *mt, const char *ho
 	return chanacs_change(mychan, mt, hostmask, &a, &r, ca_all, setter);
 }
 
+/* Objects spared from expiry by a hold, a hook or similar are looked at
+ * again after this long, as they were when every object was swept hourly.
+ */
+#define EXPIRY_RECHECK_INTERVAL         SECONDS_PER_HOUR
+
+/* Registered channels unused for this long are checked for current users */
+#define MYCHAN_USED_REFRESH             (SECONDS_PER_DAY - SECONDS_PER_HOUR - SECONDS_PER_MINUTE)
+
+/* The *_expiry_due() functions return the earliest time the object could
+ * expire given its current timestamps, or 0 if it cannot expire. Timestamps
+ * only move forward, so a queued time can go stale but never too late.
+ */
+static time_t
+myuser_expiry_due(const struct myuser *mu)
+{
+	time_t due = 0;
+
+	if (nicksvs.expiry > 0)
+		due = mu->lastlogin + nicksvs.expiry;
+
+	if ((mu->flags & MU_WAITAUTH) && (due == 0 || mu->registered + SECONDS_PER_DAY < due))
+		due = mu->registered + SECONDS_PER_DAY;
+
+	return due;
+}
+
+static time_t
+mynick_expiry_due(const struct mynick *mn)
+{
+	if (nicksvs.expiry > 0)
+		return mn->lastseen + nicksvs.expiry;
+
+	return 0;
+}
+
+static time_t
+mychan_expiry_due(const struct mychan *mc)
+{
+	if (chansvs.expiry > 0 && chansvs.expiry < MYCHAN_USED_REFRESH)
+		return mc->used + chansvs.expiry;
+
+	return mc->used + MYCHAN_USED_REFRESH;
+}
+
+static void
+expiry_reschedule(struct expiry_queue *queue, struct expiry_timer *timer, void *owner, time_t due)
+{
+	if (due == 0)
+		expiry_queue_cancel(queue, timer);
+	else
+		expiry_queue_schedule(queue, timer, owner, (due > CURRTIME) ? due : (CURRTIME + EXPIRY_RECHECK_INTERVAL));
+}
+
 static int
-expire_myuser_cb(struct myentity *mt, void *unused)
+expiry_schedule_myuser_cb(struct myentity *mt, void *unused)
 {
-	struct hook_expiry_req req;
 	struct myuser *mu = user(mt);
+	time_t due;
 
 	return_val_if_fail(isuser(mt), 0);
 
+	if ((due = myuser_expiry_due(mu)) != 0)
+		expiry_queue_schedule(&myuser_expiry, &mu->expiry, mu, due);
+
+	return 0;
+}
+
+static void
+expiry_queues_rebuild(void)
+{
+	struct mynick *mn;
+	struct mychan *mc;
+	mowgli_patricia_iteration_state_t state;
+
+	slog(LG_DEBUG, "expire_check(): scheduling expiry for all accounts, nicks and channels");
+
+	expiry_queue_clear(&myuser_expiry);
+	expiry_queue_clear(&mynick_expiry);
+	expiry_queue_clear(&mychan_expiry);
+
+	myentity_foreach_t(ENT_USER, expiry_schedule_myuser_cb, NULL);
+
+	MOWGLI_PATRICIA_FOREACH(mn, &state, nicklist)
+	{
+		const time_t due = mynick_expiry_due(mn);
+
+		if (due != 0)
+			expiry_queue_schedule(&mynick_expiry, &mn->expiry, mn, due);
+	}
+
+	MOWGLI_PATRICIA_FOREACH(mc, &state, mclist)
+		expiry_queue_schedule(&mychan_expiry, &mc->expiry, mc, mychan_expiry_due(mc));
+
+	expiry_queues_built = true;
+	expiry_queues_nickexpiry = nicksvs.expiry;
+	expiry_queues_chanexpiry = chansvs.expiry;
+}
+
+static void
+expire_myuser(struct myuser *mu)
+{
+	struct hook_expiry_req req;
+
 	/* If they're logged in, update lastlogin time.
 	 * To decrease db traffic, may want to only do
 	 * this if the account would otherwise be
@@ -2031,18 +3535,25 @@ expire_myuser_cb(struct myentity *mt, void *unused)
 	if (MOWGLI_LIST_LENGTH(&mu->logins) > 0)
 	{
 		mu->lastlogin = CURRTIME;
-		return 0;
+		expiry_reschedule(&myuser_expiry, &mu->expiry, mu, myuser_expiry_due(mu));
+		return;
 	}
 
 	if (MU_HOLD & mu->flags)
-		return 0;
+	{
+		expiry_queue_schedule(&myuser_expiry, &mu->expiry, mu, CURRTIME + EXPIRY_RECHECK_INTERVAL);
+		return;
+	}
 
 	req.data.mu = mu;
 	req.do_expire = 1;
 	hook_call_user_check_expire(&req);
 
 	if (!req.do_expire)
-		return 0;
+	{
+		expiry_queue_schedule(&myuser_expiry, &mu->expiry, mu, CURRTIME + EXPIRY_RECHECK_INTERVAL);
+		return;
+	}
 
 	if ((nicksvs.expiry > 0 && mu->lastlogin < CURRTIME && (unsigned int)(CURRTIME - mu->lastlogin) >= nicksvs.expiry) ||
 			(mu->flags & MU_WAITAUTH && (CURRTIME - mu->registered) >= SECONDS_PER_DAY))
@@ -2051,7 +3562,10 @@ expire_myuser_cb(struct myentity *mt, void *unused)
 		 * otherwise someone can reregister
 		 * them and take the privs -- jilles */
 		if (is_conf_soper(mu))
-			return 0;
+		{
+			expiry_queue_schedule(&myuser_expiry, &mu->expiry, mu, CURRTIME + EXPIRY_RECHECK_INTERVAL);
+			return;
+		}
 
 		slog(LG_REGISTER, "EXPIRE: \2%s\2 from \2%s\2 ", entity(mu)->name, mu->email);
 		slog(LG_VERBOSE, "expire_check(): expiring account %s (unused %ds, email %s, nicks %zu, chanacs %zu)",
@@ -2059,156 +3573,387 @@ expire_myuser_cb(struct myentity *mt, void *unused)
 				mu->email, MOWGLI_LIST_LENGTH(&mu->nicks),
 				MOWGLI_LIST_LENGTH(&entity(mu)->chanacs));
 		atheme_object_dispose(mu);
+		return;
 	}
 
-	return 0;
+	expiry_reschedule(&myuser_expiry, &mu->expiry, mu, myuser_expiry_due(mu));
 }
 
-void
-expire_check(void *arg)
+static void
+expire_mynick(struct mynick *mn)
 {
-	struct mynick *mn;
-	struct mychan *mc;
-	struct user *u;
-	mowgli_patricia_iteration_state_t state;
 	struct hook_expiry_req req;
+	struct user *u;
 
-	/* Let them know about this and the likely subsequent db_save()
-	 * right away -- jilles */
-	if (curr_uplink != NULL && curr_uplink->conn != NULL)
-		sendq_flush(curr_uplink->conn);
+	req.do_expire = 1;
+	req.data.mn = mn;
 
-	myentity_foreach_t(ENT_USER, expire_myuser_cb, NULL);
+	hook_call_nick_check_expire(&req);
 
-	MOWGLI_PATRICIA_FOREACH(mn, &state, nicklist)
+	if (!req.do_expire)
 	{
-		req.do_expire = 1;
-		req.data.mn = mn;
-
-		hook_call_nick_check_expire(&req);
+		expiry_queue_schedule(&mynick_expiry, &mn->expiry, mn, CURRTIME + EXPIRY_RECHECK_INTERVAL);
+		return;
+	}
 
-		if (!req.do_expire)
-			continue;
+	if (nicksvs.expiry > 0 && mn->lastseen < CURRTIME &&
+			(unsigned int)(CURRTIME - mn->lastseen) >= nicksvs.expiry)
+	{
+		if (MU_HOLD & mn->owner->flags)
+		{
+			expiry_queue_schedule(&mynick_expiry, &mn->expiry, mn, CURRTIME + EXPIRY_RECHECK_INTERVAL);
+			return;
+		}
 
-		if (nicksvs.expiry > 0 && mn->lastseen < CURRTIME &&
-				(unsigned int)(CURRTIME - mn->lastseen) >= nicksvs.expiry)
+		/* do not drop main nick like this */
+		if (!irccasecmp(mn->nick, entity(mn->owner)->name))
 		{
-			if (MU_HOLD & mn->owner->flags)
-				continue;
+			expiry_queue_schedule(&mynick_expiry, &mn->expiry, mn, CURRTIME + SECONDS_PER_DAY);
+			return;
+		}
 
-			/* do not drop main nick like this */
-			if (!irccasecmp(mn->nick, entity(mn->owner)->name))
-				continue;
+		u = user_find_named(mn->nick);
+		if (u != NULL && u->myuser == mn->owner)
+		{
+			/* still logged in, bleh */
+			mn->lastseen = CURRTIME;
+			mn->owner->lastlogin = CURRTIME;
+			expiry_reschedule(&mynick_expiry, &mn->expiry, mn, mynick_expiry_due(mn));
+			return;
+		}
 
-			u = user_find_named(mn->nick);
-			if (u != NULL && u->myuser == mn->owner)
-			{
-				/* still logged in, bleh */
-				mn->lastseen = CURRTIME;
-				mn->owner->lastlogin = CURRTIME;
-				continue;
-			}
+		slog(LG_REGISTER, "EXPIRE: \2%s\2 from \2%s\2", mn->nick, entity(mn->owner)->name);
+		slog(LG_VERBOSE, "expire_check(): expiring nick %s (unused %lds, account %s)",
+				mn->nick, (long)(CURRTIME - mn->lastseen),
+				entity(mn->owner)->name);
 
-			slog(LG_REGISTER, "EXPIRE: \2%s\2 from \2%s\2", mn->nick, entity(mn->owner)->name);
-			slog(LG_VERBOSE, "expire_check(): expiring nick %s (unused %lds, account %s)",
-					mn->nick, (long)(CURRTIME - mn->lastseen),
-					entity(mn->owner)->name);
-			atheme_object_unref(mn);
-		}
+		// In case someone else still holds a reference
+		expiry_queue_schedule(&mynick_expiry, &mn->expiry, mn, CURRTIME + EXPIRY_RECHECK_INTERVAL);
+		atheme_object_unref(mn);
+		return;
 	}
 
-	MOWGLI_PATRICIA_FOREACH(mc, &state, mclist)
-	{
-		req.do_expire = 1;
-		req.data.mc = mc;
+	expiry_reschedule(&mynick_expiry, &mn->expiry, mn, mynick_expiry_due(mn));
+}
 
-		hook_call_channel_check_expire(&req);
+static void
+expire_mychan(struct mychan *mc)
+{
+	struct hook_expiry_req req;
+	time_t next;
 
-		if (!req.do_expire)
-			continue;
+	req.do_expire = 1;
+	req.data.mc = mc;
+
+	hook_call_channel_check_expire(&req);
+
+	if (!req.do_expire)
+	{
+		expiry_queue_schedule(&mychan_expiry, &mc->expiry, mc, CURRTIME + EXPIRY_RECHECK_INTERVAL);
+		return;
+	}
 
-		if ((unsigned int) (CURRTIME - mc->used) >= (SECONDS_PER_DAY - SECONDS_PER_HOUR - SECONDS_PER_MINUTE))
+	if ((unsigned int) (CURRTIME - mc->used) >= MYCHAN_USED_REFRESH)
+	{
+		/* keep last used time accurate to
+		 * within a day, making sure an active
+		 * channel will never get "Last used"
+		 * in /cs info -- jilles */
+		if (mychan_isused(mc))
 		{
-			/* keep last used time accurate to
-			 * within a day, making sure an active
-			 * channel will never get "Last used"
-			 * in /cs info -- jilles */
-			if (mychan_isused(mc))
-			{
-				mc->used = CURRTIME;
-				slog(LG_DEBUG, "expire_check(): updating last used time on %s because it appears to be still in use", mc->name);
-				continue;
-			}
+			mc->used = CURRTIME;
+			slog(LG_DEBUG, "expire_check(): updating last used time on %s because it appears to be still in use", mc->name);
+			expiry_reschedule(&mychan_expiry, &mc->expiry, mc, mychan_expiry_due(mc));
+			return;
 		}
+	}
 
-		if (chansvs.expiry > 0 && mc->used < CURRTIME &&
-				(unsigned int)(CURRTIME - mc->used) >= chansvs.expiry)
+	if (chansvs.expiry > 0 && mc->used < CURRTIME &&
+			(unsigned int)(CURRTIME - mc->used) >= chansvs.expiry)
+	{
+		if (MC_HOLD & mc->flags)
 		{
-			if (MC_HOLD & mc->flags)
-				continue;
+			expiry_queue_schedule(&mychan_expiry, &mc->expiry, mc, CURRTIME + EXPIRY_RECHECK_INTERVAL);
+			return;
+		}
 
-			slog(LG_REGISTER, "EXPIRE: \2%s\2 from \2%s\2", mc->name, mychan_founder_names(mc));
-			slog(LG_VERBOSE, "expire_check(): expiring channel %s (unused %lds, founder %s, chanacs %zu)",
-					mc->name, (long)(CURRTIME - mc->used),
-					mychan_founder_names(mc),
-					MOWGLI_LIST_LENGTH(&mc->chanacs));
+		slog(LG_REGISTER, "EXPIRE: \2%s\2 from \2%s\2", mc->name, mychan_founder_names(mc));
+		slog(LG_VERBOSE, "expire_check(): expiring channel %s (unused %lds, founder %s, chanacs %zu)",
+				mc->name, (long)(CURRTIME - mc->used),
+				mychan_founder_names(mc),
+				MOWGLI_LIST_LENGTH(&mc->chanacs));
 
-			hook_call_channel_drop(mc);
-			if (mc->chan != NULL && !(mc->chan->flags & CHAN_LOG))
-				part(mc->name, chansvs.nick);
+		hook_call_channel_drop(mc);
+		if (mc->chan != NULL && !(mc->chan->flags & CHAN_LOG))
+			part(mc->name, chansvs.nick);
 
-			atheme_object_unref(mc);
-		}
+		// In case someone else still holds a reference
+		expiry_queue_schedule(&mychan_expiry, &mc->expiry, mc, CURRTIME + EXPIRY_RECHECK_INTERVAL);
+		atheme_object_unref(mc);
+		return;
 	}
+
+	// Unused but not yet expired; check for users again in a day
+	next = CURRTIME + MYCHAN_USED_REFRESH;
+
+	if (chansvs.expiry > 0 && mc->used + chansvs.expiry < next)
+		next = mc->used + chansvs.expiry;
+
+	expiry_reschedule(&mychan_expiry, &mc->expiry, mc, next);
 }
 
-static int
-check_myuser_cb(struct myentity *mt, void *unused)
+void
+expire_check(void *arg)
 {
-	struct myuser *mu = user(mt);
-	mowgli_node_t *n;
-	struct mynick *mn, *mn1;
+	struct myuser *mu;
+	struct mynick *mn;
+	struct mychan *mc;
+	struct user *u;
+	mowgli_patricia_iteration_state_t state;
 
-	return_val_if_fail(isuser(mt), 0);
+	// The primary expires them, and we get the drops from its journal
+	if (replica)
+		return;
+
+	/* Let them know about this and the likely subsequent db_save()
+	 * right away -- jilles */
+	if (curr_uplink != NULL && curr_uplink->conn != NULL)
+		sendq_flush(curr_uplink->conn);
+
+	if (!expiry_queues_built || expiry_queues_nickexpiry != nicksvs.expiry ||
+			expiry_queues_chanexpiry != chansvs.expiry)
+		expiry_queues_rebuild();
 
-	if (!nicksvs.no_nick_ownership)
+	// Keep lastlogin of logged in accounts accurate, whether or not they are due
+	MOWGLI_PATRICIA_FOREACH(u, &state, userlist)
 	{
-		mn1 = NULL;
+		if (u->myuser != NULL)
+			u->myuser->lastlogin = CURRTIME;
+	}
+
+	while ((mu = expiry_queue_pop_due(&myuser_expiry, CURRTIME)) != NULL)
+		expire_myuser(mu);
+
+	while ((mn = expiry_queue_pop_due(&mynick_expiry, CURRTIME)) != NULL)
+		expire_mynick(mn);
+
+	while ((mc = expiry_queue_pop_due(&mychan_expiry, CURRTIME)) != NULL)
+		expire_mychan(mc);
+}
+
+/* db_check() goes through every account in two passes. The first only
+ * reads each account's own nicks (and updates its own registration and last
+ * login times from them), so it is split into chunks that worker threads
+ * take in turn on a large database; the second, which may add and replace
+ * nicks, runs on the main thread once they are done.
+ */
+#define DB_CHECK_CHUNK                  4096U
+#define DB_CHECK_THREADS_MAX            4U
+#define DB_CHECK_THREADED_MIN           65536U  // Fewer accounts are not worth starting threads for
+
+struct db_check_pass
+{
+	struct myuser **        users;
+	struct mynick **        own;            // Per account: its nick of the same name, if it is in mu->nicks
+	size_t                  count;
+	size_t                  next;           // The first account of the next chunk to be taken
+#ifdef HAVE_USABLE_PTHREAD
+	pthread_mutex_t         lock;
+#endif
+};
+
+static void
+db_check_range(struct db_check_pass *const restrict pass, const size_t first, const size_t last)
+{
+	for (size_t i = first; i < last; i++)
+	{
+		struct myuser *const mu = pass->users[i];
+		struct mynick *own = NULL;
+		mowgli_node_t *n;
+
 		MOWGLI_ITER_FOREACH(n, mu->nicks.head)
 		{
-			mn = n->data;
+			const struct mynick *const mn = n->data;
+
 			if (mn->registered < mu->registered)
 				mu->registered = mn->registered;
 			if (mn->lastseen > mu->lastlogin)
 				mu->lastlogin = mn->lastseen;
 			if (!irccasecmp(entity(mu)->name, mn->nick))
-				mn1 = mn;
-		}
-		mn = mn1 != NULL ? mn1 : mynick_find(entity(mu)->name);
-		if (mn == NULL)
-		{
-			slog(LG_REGISTER, "db_check(): adding missing nick %s", entity(mu)->name);
-			mn = mynick_add(mu, entity(mu)->name);
-			mn->registered = mu->registered;
-			mn->lastseen = mu->lastlogin;
+				own = n->data;
 		}
-		else if (mn->owner != mu)
+
+		pass->own[i] = own;
+	}
+}
+
+static void *
+db_check_worker(void *const restrict vpass)
+{
+	struct db_check_pass *const pass = vpass;
+
+	for (;;)
+	{
+#ifdef HAVE_USABLE_PTHREAD
+		(void) pthread_mutex_lock(&pass->lock);
+#endif
+		const size_t first = pass->next;
+
+		if (first < pass->count)
+			pass->next += (pass->count - first < DB_CHECK_CHUNK) ? (pass->count - first) : DB_CHECK_CHUNK;
+
+		const size_t last = pass->next;
+#ifdef HAVE_USABLE_PTHREAD
+		(void) pthread_mutex_unlock(&pass->lock);
+#endif
+		if (first >= last)
+			return NULL;
+
+		(void) db_check_range(pass, first, last);
+	}
+}
+
+static void
+db_check_read(struct db_check_pass *const restrict pass)
+{
+#ifdef HAVE_USABLE_PTHREAD
+	pthread_t threads[DB_CHECK_THREADS_MAX];
+	unsigned int nthreads = 0;
+
+	(void) pthread_mutex_init(&pass->lock, NULL);
+
+	if (pass->count >= DB_CHECK_THREADED_MIN)
+	{
+		const long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+		// The main thread is one of them
+		unsigned int want = (ncpus > 1) ? (unsigned int) (ncpus - 1) : 0U;
+
+		if (want > DB_CHECK_THREADS_MAX)
+			want = DB_CHECK_THREADS_MAX;
+
+		// Signals must only ever be delivered to the main thread
+		sigset_t newset;
+		sigset_t oldset;
+
+		(void) sigfillset(&newset);
+		(void) pthread_sigmask(SIG_BLOCK, &newset, &oldset);
+
+		for (unsigned int i = 0; i < want; i++)
 		{
-			slog(LG_REGISTER, "db_check(): replacing nick %s owned by %s with %s", mn->nick, entity(mn->owner)->name, entity(mu)->name);
-			atheme_object_unref(mn);
-			mn = mynick_add(mu, entity(mu)->name);
-			mn->registered = mu->registered;
-			mn->lastseen = mu->lastlogin;
+			const int ret = pthread_create(&threads[nthreads], NULL, &db_check_worker, pass);
+
+			if (ret != 0)
+			{
+				slog(LG_ERROR, "%s: pthread_create(3): %s", MOWGLI_FUNC_NAME, strerror(ret));
+				break;
+			}
+
+			nthreads++;
 		}
+
+		(void) pthread_sigmask(SIG_SETMASK, &oldset, NULL);
 	}
+#endif
 
-	return 0;
+	(void) db_check_worker(pass);
+
+#ifdef HAVE_USABLE_PTHREAD
+	for (unsigned int i = 0; i < nthreads; i++)
+		(void) pthread_join(threads[i], NULL);
+
+	(void) pthread_mutex_destroy(&pass->lock);
+
+	if (nthreads)
+		slog(LG_DEBUG, "db_check(): checked %zu accounts with %u extra thread(s)", pass->count, nthreads);
+#endif
+}
+
+static void
+db_check_fix(struct myuser *const restrict mu, struct mynick *mn)
+{
+	if (mn == NULL)
+		mn = mynick_find(entity(mu)->name);
+
+	if (mn == NULL)
+	{
+		slog(LG_REGISTER, "db_check(): adding missing nick %s", entity(mu)->name);
+		mn = mynick_add(mu, entity(mu)->name);
+		mn->registered = mu->registered;
+		mn->lastseen = mu->lastlogin;
+	}
+	else if (mn->owner != mu)
+	{
+		slog(LG_REGISTER, "db_check(): replacing nick %s owned by %s with %s", mn->nick, entity(mn->owner)->name, entity(mu)->name);
+		atheme_object_unref(mn);
+		mn = mynick_add(mu, entity(mu)->name);
+		mn->registered = mu->registered;
+		mn->lastseen = mu->lastlogin;
+	}
 }
 
 void
 db_check(void)
 {
-	myentity_foreach_t(ENT_USER, check_myuser_cb, NULL);
+	struct myentity_iteration_state state;
+	struct myentity *mt;
+	struct db_check_pass pass;
+
+	if (nicksvs.no_nick_ownership)
+		return;
+
+	size_t count = 0;
+
+	MYENTITY_FOREACH_T(mt, &state, ENT_USER)
+		count++;
+
+	(void) memset(&pass, 0x00, sizeof pass);
+
+	pass.users = smalloc((count ? count : 1) * sizeof *pass.users);
+	pass.own = smalloc((count ? count : 1) * sizeof *pass.own);
+
+	MYENTITY_FOREACH_T(mt, &state, ENT_USER)
+		pass.users[pass.count++] = user(mt);
+
+	db_check_read(&pass);
+
+	for (size_t i = 0; i < pass.count; i++)
+		db_check_fix(pass.users[i], pass.own[i]);
+
+	sfree(pass.users);
+	sfree(pass.own);
+}
+
+/*
+ * db_object_type(void *target)
+ *
+ * Tells which of the objects kept in the database an atheme_object is, so
+ * that hooks given a bare metadata target can tell how to name it.
+ *
+ * Inputs:
+ *      - object to identify
+ *
+ * Outputs:
+ *      - the object's type, or DB_OBJECT_OTHER for anything else
+ *
+ * Side Effects:
+ *      - none
+ */
+enum db_object_type
+db_object_type(void *target)
+{
+	const atheme_object_destructor_fn des = atheme_object(target)->destructor;
+
+	if (des == (atheme_object_destructor_fn) myuser_delete)
+		return DB_OBJECT_MYUSER;
+	if (des == (atheme_object_destructor_fn) myuser_name_delete)
+		return DB_OBJECT_MYUSER_NAME;
+	if (des == (atheme_object_destructor_fn) mychan_delete)
+		return DB_OBJECT_MYCHAN;
+	if (des == (atheme_object_destructor_fn) chanacs_delete)
+		return DB_OBJECT_CHANACS;
+
+	return DB_OBJECT_OTHER;
 }
 
 /* vim:cinoptions=>s,e0,n0,f0,{0,}0,^0,=s,ps,t0,c3,+s,(2s,us,)20,*30,gs,hs
@@ -53,6 +53,7 @@ char *log_path;
 char *datadir;
 bool cold_start = false;
 bool readonly = false;
+bool replica = false;           // following another services' journal (backend/journal)
 bool strict_mode = true;
 bool offline_mode = false;
 bool permissive_mode = false;
@@ -60,6 +61,7 @@ bool database_create = false;
 
 void (*db_save) (void *arg, enum db_save_strategy strategy) = NULL;
 void (*db_load) (const char *name) = NULL;
+struct db_save_stats db_last_save;
 
 /* *INDENT-OFF* */
 static void
@@ -373,17 +375,13 @@ atheme_setup(void)
 
 	authcookie_init();
 	common_ctcp_init();
-}
-
-static void
-db_save_periodic(void *unused)
-{
-	slog(LG_DEBUG, "db_save_periodic(): initiating periodic database write");
-
-	if (config_options.db_save_blocking)
-		db_save(unused, DB_SAVE_BLOCKING);
-	else
-		db_save(unused, DB_SAVE_BG_REGULAR);
+	command_pending_init();
+	netstats_init();
+	cmode_init();
+	memo_ignore_init();
+	memostore_init();
+	mailqueue_init();
+	help_cache_init();
 }
 
 int
@@ -396,6 +394,7 @@ atheme_main(int argc, char *argv[])
 	char buf[32];
 	int pid, r;
 	FILE *pid_file;
+	struct startup_mark sm;
 	const char *pidfilename = RUNDIR "/atheme.pid";
 	char *log_p = NULL;
 	mowgli_getopt_option_t long_opts[] = {
@@ -467,7 +466,9 @@ atheme_main(int argc, char *argv[])
 
 	runflags |= RF_STARTING;
 
+	startup_mark(&sm);
 	atheme_init(argv[0], log_p);
+	startup_record(&sm, "init", STARTUP_PHASE);
 
 	slog(LG_INFO, "%s is starting up...", PACKAGE_STRING);
 
@@ -495,19 +496,27 @@ atheme_main(int argc, char *argv[])
 
 	(void) slog(LG_INFO, "running digest testsuite...");
 
+	startup_mark(&sm);
+
 	if (! digest_testsuite_run())
 	{
 		(void) slog(LG_ERROR, "digest testsuite failed");
 		exit(EXIT_FAILURE);
 	}
 
+	startup_record(&sm, "digest testsuite", STARTUP_PHASE);
+
 	(void) slog(LG_INFO, "digest testsuite passed");
 
 	if (!(runflags & RF_LIVE))
 		daemonize(daemonize_pipe);
 
+	/* none of the phases recorded spans this; the child starts its CPU time from zero */
+	startup_mark(&sm);
 	atheme_setup();
+	startup_record(&sm, "setup", STARTUP_PHASE);
 
+	startup_mark(&sm);
 	conf_init();
 	if (!conf_parse(config_file))
 	{
@@ -523,6 +532,7 @@ atheme_main(int argc, char *argv[])
 			slog(LG_INFO, "Error loading language file %s, continuing",
 					config_options.languagefile);
 	}
+	startup_record(&sm, "conf_parse", STARTUP_PHASE);
 
 	if (!backend_loaded && authservice_loaded)
 	{
@@ -534,6 +544,7 @@ atheme_main(int argc, char *argv[])
 	cold_start = false;
 
 	/* load our db */
+	startup_mark(&sm);
 	if (db_load)
 		db_load(NULL);
 	else if (backend_loaded)
@@ -541,7 +552,24 @@ atheme_main(int argc, char *argv[])
 		slog(LG_ERROR, "atheme: backend module does not provide db_load()!");
 		exit(EXIT_FAILURE);
 	}
-	db_check();
+	startup_record(&sm, "db_load", STARTUP_PHASE);
+
+	startup_mark(&sm);
+	hook_call_db_loaded();
+	startup_record(&sm, "db_loaded hooks", STARTUP_PHASE);
+
+	// an image is only written from a registry that has been through this already
+	startup_mark(&sm);
+	if (! warm_image_checked)
+		db_check();
+	startup_record(&sm, "db_check", STARTUP_PHASE);
+
+	startup_mark(&sm);
+	language_preload();
+	startup_record(&sm, "language_preload", STARTUP_PHASE);
+
+	// loading the database counted every object it created as a change
+	(void) memset(&db_changes, 0x00, sizeof db_changes);
 
 	if (db_save && database_create)
 	{
@@ -579,22 +607,20 @@ atheme_main(int argc, char *argv[])
 	/* we probably have a few open already... */
 	me.maxfd = 3;
 
-	/* DB commit interval is configurable */
+	/* DB commit interval is configurable, and commits are skipped or brought forward by how much changed */
 	if (db_save && !readonly)
-		mowgli_timer_add(base_eventloop, "db_save", db_save_periodic, NULL, config_options.commit_interval);
+		db_commit_init();
 
 	/* check expires every hour */
-	mowgli_timer_add(base_eventloop, "expire_check", expire_check, NULL, SECONDS_PER_HOUR);
+	timer_add("expire_check", expire_check, NULL, SECONDS_PER_HOUR);
 
-	/* check k/x/q line expires every minute */
-	mowgli_timer_add(base_eventloop, "kline_expire", kline_expire, NULL, SECONDS_PER_MINUTE);
-	mowgli_timer_add(base_eventloop, "xline_expire", xline_expire, NULL, SECONDS_PER_MINUTE);
-	mowgli_timer_add(base_eventloop, "qline_expire", qline_expire, NULL, SECONDS_PER_MINUTE);
+	/* k/x/q line, authcookie expiry, akick and enforce timeouts, ... */
+	timerwheel_init();
 
-	/* check authcookie expires every ten minutes */
-	mowgli_timer_add(base_eventloop, "authcookie_expire", authcookie_expire, NULL, 10 * SECONDS_PER_MINUTE);
+	startup_report();
 
 	me.connected = false;
+	startup_uplink_connecting();
 	uplink_connect();
 
 	/* main loop */
@@ -628,6 +654,7 @@ atheme_main(int argc, char *argv[])
 
 	mowgli_eventloop_destroy(base_eventloop);
 	log_shutdown();
+	log_index_sweep();
 
 	return 0;
 }
@@ -18,13 +18,26 @@
 
 bool auth_module_loaded = false;
 bool (*auth_user_custom)(struct myuser *mu, const char *password) ATHEME_FATTR_WUR;
+bool (*auth_user_custom_async)(struct myuser *mu, const char *password, struct pwverify_request *req) ATHEME_FATTR_WUR;
 
-void
-set_password(struct myuser *const restrict mu, const char *const restrict password)
+static void
+password_changed(struct myuser *const restrict mu, const char *const restrict oldpass, const bool oldcrypted)
 {
-	if (! mu || ! password)
-		return;
+	struct hook_myuser_password hdata = {
+		.mu         = mu,
+		.oldpass    = oldpass,
+		.oldcrypted = oldcrypted,
+	};
 
+	(void) hook_call_myuser_password_change(&hdata);
+}
+
+/* For myuser_add_id(): the account is not there yet, so nobody is told; the
+ * myuser_add hook follows.
+ */
+void
+set_password_initial(struct myuser *const restrict mu, const char *const restrict password)
+{
 	const char *const hash = crypt_password(password);
 
 	(void) smemzero(mu->pass, sizeof mu->pass);
@@ -45,6 +58,45 @@ set_password(struct myuser *const restrict mu, const char *const restrict passwo
 	}
 }
 
+void
+set_password(struct myuser *const restrict mu, const char *const restrict password)
+{
+	if (! mu || ! password)
+		return;
+
+	char oldpass[PASSLEN + 1];
+	const bool oldcrypted = (mu->flags & MU_CRYPTPASS);
+
+	(void) mowgli_strlcpy(oldpass, mu->pass, sizeof oldpass);
+	(void) set_password_initial(mu, password);
+	(void) password_changed(mu, oldpass, oldcrypted);
+	(void) smemzero(oldpass, sizeof oldpass);
+
+	(void) hook_call_myuser_change(mu);
+}
+
+void
+replace_password(struct myuser *const restrict mu, const char *const restrict pass, const bool crypted)
+{
+	if (! mu || ! pass)
+		return;
+
+	char oldpass[PASSLEN + 1];
+	const bool oldcrypted = (mu->flags & MU_CRYPTPASS);
+
+	(void) mowgli_strlcpy(oldpass, mu->pass, sizeof oldpass);
+	(void) smemzero(mu->pass, sizeof mu->pass);
+	(void) mowgli_strlcpy(mu->pass, pass, sizeof mu->pass);
+
+	if (crypted)
+		mu->flags |= MU_CRYPTPASS;
+	else
+		mu->flags &= ~MU_CRYPTPASS;
+
+	(void) password_changed(mu, oldpass, oldcrypted);
+	(void) smemzero(oldpass, sizeof oldpass);
+}
+
 bool ATHEME_FATTR_WUR
 verify_password(struct myuser *const restrict mu, const char *const restrict password)
 {
@@ -62,38 +114,49 @@ verify_password(struct myuser *const restrict mu, const char *const restrict pas
 		return (strcmp(mu->pass, password) == 0);
 	}
 
-	const char *new_hash;
-	const struct crypt_impl *ci, *ci_default;
+	const struct crypt_impl *ci;
 	unsigned int verify_flags = PWVERIFY_FLAG_NONE;
 
-	if (! (ci = crypt_verify_password(password, mu->pass, &verify_flags)))
+	ci = crypt_verify_password(password, mu->pass, &verify_flags);
+
+	ATHEME_TRACE2(password__verify, entity(mu)->name, ci != NULL);
+
+	if (! ci)
 		// Verification failure
 		return false;
 
+	(void) password_rehash(mu, password, ci->id, verify_flags);
+
+	// Verification succeeded and user's password (possibly) re-encrypted
+	return true;
+}
+
+/* Called after 'password' was verified against mu->pass by the crypto provider
+ * named 'from_id'; has it re-encrypted with the default provider if that
+ * differs or the provider asked for it. Shared with the asynchronous path
+ * (pwverify.c), which records the provider by name because it may be unloaded
+ * meanwhile. The new hash is computed later, off the login's path (see
+ * pwverify_rehash_submit()), and only replaces mu->pass if that is unchanged.
+ */
+void
+password_rehash(struct myuser *const restrict mu, const char *const restrict password,
+                const char *const restrict from_id, const unsigned int verify_flags)
+{
+	const struct crypt_impl *ci_default;
+
 	if (! (ci_default = crypt_get_default_provider()))
 		// Verification succeeded but we don't have a module that can create new password hashes
-		return true;
+		return;
 
-	if (ci != ci_default)
+	if (strcmp(from_id, ci_default->id) != 0)
 		(void) slog(LG_INFO, "%s: transitioning from crypt scheme '%s' to '%s' for account '%s'",
-		                     MOWGLI_FUNC_NAME, ci->id, ci_default->id, entity(mu)->name);
+		                     MOWGLI_FUNC_NAME, from_id, ci_default->id, entity(mu)->name);
 	else if (verify_flags & PWVERIFY_FLAG_RECRYPT)
 		(void) slog(LG_INFO, "%s: re-encrypting password for account '%s'",
 		                     MOWGLI_FUNC_NAME, entity(mu)->name);
 	else
-		// Verification succeeded and re-encrypting not required, nothing more to do
-		return true;
-
-	if (! (new_hash = ci_default->crypt(password, NULL)))
-	{
-		(void) slog(LG_ERROR, "%s: hash generation failed", MOWGLI_FUNC_NAME);
-	}
-	else
-	{
-		(void) smemzero(mu->pass, sizeof mu->pass);
-		(void) mowgli_strlcpy(mu->pass, new_hash, sizeof mu->pass);
-	}
+		// Re-encrypting not required, nothing more to do
+		return;
 
-	// Verification succeeded and user's password (possibly) re-encrypted
-	return true;
+	(void) pwverify_rehash_submit(mu, password, ci_default);
 }
@@ -16,19 +16,30 @@
 #include <atheme.h>
 #include "internal.h"
 
-static mowgli_list_t authcookie_list;
-static mowgli_heap_t *authcookie_heap = NULL;
+// Every live authcookie by ticket; each account also lists its own
+static mowgli_patricia_t *authcookie_tree = NULL;
+
+unsigned int authcookie_destroyed = 0;
+static struct named_heap *authcookie_heap = NULL;
 
 void
 authcookie_init(void)
 {
-	authcookie_heap = sharedheap_get(sizeof(struct authcookie));
+	authcookie_heap = named_heap_get("authcookie", sizeof(struct authcookie));
 
 	if (!authcookie_heap)
 	{
 		slog(LG_ERROR, "authcookie_init(): cannot initialize block allocator.");
 		exit(EXIT_FAILURE);
 	}
+
+	authcookie_tree = mowgli_patricia_create(NULL);
+}
+
+static void
+authcookie_expire_one(void *const restrict vptr)
+{
+	authcookie_destroy(vptr);
 }
 
 /*
@@ -46,12 +57,20 @@ authcookie_init(void)
 struct authcookie *
 authcookie_create(struct myuser *mu)
 {
-	struct authcookie *const au = mowgli_heap_alloc(authcookie_heap);
-	au->ticket = random_string(AUTHCOOKIE_LENGTH);
+	struct authcookie *const au = named_heap_alloc(authcookie_heap);
+
+	// The tree won't take a ticket twice; it's very unlikely, but pick another
+	do
+	{
+		sfree(au->ticket);
+		au->ticket = random_string(AUTHCOOKIE_LENGTH);
+	} while (! mowgli_patricia_add(authcookie_tree, au->ticket, au));
+
 	au->myuser = mu;
 	au->expire = CURRTIME + SECONDS_PER_HOUR;
 
-	mowgli_node_add(au, &au->node, &authcookie_list);
+	mowgli_node_add(au, &au->node, &mu->authcookies);
+	timerwheel_add(&au->expire_timer, &authcookie_expire_one, au, au->expire);
 
 	return au;
 }
@@ -71,45 +90,20 @@ authcookie_create(struct myuser *mu)
 struct authcookie *
 authcookie_find(const char *ticket, struct myuser *myuser)
 {
-	mowgli_node_t *n;
 	struct authcookie *ac;
 
 	/* at least one must be specified */
 	return_val_if_fail(ticket != NULL || myuser != NULL, NULL);
 
-	if (!myuser)		/* must have ticket */
-	{
-		MOWGLI_ITER_FOREACH(n, authcookie_list.head)
-		{
-			ac = n->data;
+	if (!ticket)		/* must have myuser */
+		return myuser->authcookies.head != NULL ? myuser->authcookies.head->data : NULL;
 
-			if (!strcmp(ac->ticket, ticket))
-				return ac;
-		}
-	}
-	else if (!ticket)	/* must have myuser */
-	{
-		MOWGLI_ITER_FOREACH(n, authcookie_list.head)
-		{
-			ac = n->data;
+	ac = mowgli_patricia_retrieve(authcookie_tree, ticket);
 
-			if (ac->myuser == myuser)
-				return ac;
-		}
-	}
-	else			/* must have both */
-	{
-		MOWGLI_ITER_FOREACH(n, authcookie_list.head)
-		{
-			ac = n->data;
-
-			if (ac->myuser == myuser
-				&& !strcmp(ac->ticket, ticket))
-				return ac;
-		}
-	}
+	if (ac != NULL && myuser != NULL && ac->myuser != myuser)
+		return NULL;
 
-	return NULL;
+	return ac;
 }
 
 /*
@@ -129,9 +123,13 @@ authcookie_destroy(struct authcookie * ac)
 {
 	return_if_fail(ac != NULL);
 
-	mowgli_node_delete(&ac->node, &authcookie_list);
+	timerwheel_cancel(&ac->expire_timer);
+	mowgli_patricia_delete(authcookie_tree, ac->ticket);
+	mowgli_node_delete(&ac->node, &ac->myuser->authcookies);
 	sfree(ac->ticket);
-	mowgli_heap_free(authcookie_heap, ac);
+	named_heap_free(authcookie_heap, ac);
+
+	authcookie_destroyed++;
 }
 
 /*
@@ -150,43 +148,9 @@ void
 authcookie_destroy_all(struct myuser *mu)
 {
 	mowgli_node_t *n, *tn;
-	struct authcookie *ac;
-
-	MOWGLI_ITER_FOREACH_SAFE(n, tn, authcookie_list.head)
-	{
-		ac = n->data;
-
-		if (ac->myuser == mu)
-			authcookie_destroy(ac);
-	}
-}
-
-/*
- * authcookie_expire()
- *
- * Inputs:
- *       unused arg because this is an event function
- *
- * Outputs:
- *       none
- *
- * Side Effects:
- *       expired authcookies are destroyed
- */
-void
-authcookie_expire(void *arg)
-{
-	struct authcookie *ac;
-	mowgli_node_t *n, *tn;
-
-	(void)arg;
-        MOWGLI_ITER_FOREACH_SAFE(n, tn, authcookie_list.head)
-	{
-		ac = n->data;
 
-		if (ac->expire <= CURRTIME)
-			authcookie_destroy(ac);
-	}
+	MOWGLI_ITER_FOREACH_SAFE(n, tn, mu->authcookies.head)
+		authcookie_destroy(n->data);
 }
 
 /*
@@ -210,6 +174,7 @@ authcookie_validate(const char *ticket, struct myuser *myuser)
 	if (ac == NULL)
 		return false;
 
+	// The timer wheel may not have got to it yet
 	if (ac->expire <= CURRTIME)
 	{
 		authcookie_destroy(ac);
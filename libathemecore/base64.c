@@ -70,9 +70,16 @@ base64_alphabet_invert(const char alphabet[const restrict static 65],
 	return true;
 }
 
+// Whether an alphabet is the default one, as far as the vector kernels (which do not look at padding) care
+static inline bool
+base64_alphabet_is_default(const char alphabet[const restrict static 65])
+{
+	return (memcmp(alphabet, alphabet_default, 64) == 0);
+}
+
 static size_t ATHEME_FATTR_WUR
 base64_decode_run(const char *restrict src, void *const restrict out, const size_t out_len,
-                  const unsigned char inverse_alphabet[const restrict static 128])
+                  const unsigned char inverse_alphabet[const restrict static 128], const bool accel)
 {
 	unsigned char *const dst = (unsigned char *) out;
 	const size_t dst_len = out_len;
@@ -80,17 +87,34 @@ base64_decode_run(const char *restrict src, void *const restrict out, const size
 	size_t src_len = strlen(src);
 	size_t written = 0;
 
+	// Runs of valid input go to base64_decode_accel() first, and again after any whitespace
+	bool try_accel = (accel && dst != NULL);
+
 	while (src_len != 0)
 	{
 		unsigned char och[4];
 		size_t done;
 
+		if (try_accel)
+		{
+			const size_t consumed = base64_decode_accel(src, src_len, dst + written, dst_len - written);
+
+			src += consumed;
+			src_len -= consumed;
+			written += ((consumed / 4) * 3);
+			try_accel = false;
+
+			if (src_len == 0)
+				break;
+		}
+
 		for (done = 0; done < 4; done++)
 		{
 			while (isspace((int) src[done]))
 			{
 				src++;
 				src_len--;
+				try_accel = (accel && dst != NULL);
 
 				if (src_len == 0 && done >= 2)
 					// We have consumed enough input to process below
@@ -190,7 +214,7 @@ base64_decode_run(const char *restrict src, void *const restrict out, const size
 size_t ATHEME_FATTR_WUR
 base64_decode(const char *const restrict src, void *const restrict out, const size_t out_len)
 {
-	return base64_decode_run(src, out, out_len, inverse_alphabet_default);
+	return base64_decode_run(src, out, out_len, inverse_alphabet_default, true);
 }
 
 size_t ATHEME_FATTR_WUR
@@ -203,12 +227,12 @@ base64_decode_table(const char *const restrict src, void *const restrict out, co
 		// Duplicated or invalid character in alphabet
 		return BASE64_FAIL;
 
-	return base64_decode_run(src, out, out_len, inverse_alphabet);
+	return base64_decode_run(src, out, out_len, inverse_alphabet, base64_alphabet_is_default(alphabet));
 }
 
 static size_t ATHEME_FATTR_WUR
 base64_encode_run(const void *const restrict in, const size_t in_len, char *const restrict dst, const size_t dst_len,
-                  const char alphabet[const restrict static 65])
+                  const char alphabet[const restrict static 65], const bool accel)
 {
 	const unsigned char *src = (const unsigned char *) in;
 	size_t src_len = in_len;
@@ -219,6 +243,16 @@ base64_encode_run(const void *const restrict in, const size_t in_len, char *cons
 		// Definitely not enough room
 		return BASE64_FAIL;
 
+	if (accel && dst != NULL)
+	{
+		// The vector kernels only do whole blocks that fit; everything else is left for below
+		const size_t consumed = base64_encode_accel(src, src_len, dst, dst_len);
+
+		src += consumed;
+		src_len -= consumed;
+		written = ((consumed / 3) * 4);
+	}
+
 	while (src_len >= 3)
 	{
 		if (dst != NULL)
@@ -309,7 +343,7 @@ base64_encode_run(const void *const restrict in, const size_t in_len, char *cons
 size_t ATHEME_FATTR_WUR
 base64_encode(const void *const restrict in, const size_t in_len, char *const restrict dst, const size_t dst_len)
 {
-	return base64_encode_run(in, in_len, dst, dst_len, alphabet_default);
+	return base64_encode_run(in, in_len, dst, dst_len, alphabet_default, true);
 }
 
 size_t ATHEME_FATTR_WUR
@@ -322,5 +356,5 @@ base64_encode_table(const void *const restrict in, const size_t in_len, char *co
 		// Duplicated or invalid character in alphabet
 		return BASE64_FAIL;
 
-	return base64_encode_run(in, in_len, dst, dst_len, alphabet);
+	return base64_encode_run(in, in_len, dst, dst_len, alphabet, base64_alphabet_is_default(alphabet));
 }
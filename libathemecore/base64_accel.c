@@ -0,0 +1,529 @@
+/*
+ * SPDX-License-Identifier: ISC
+ * SPDX-URL: https://spdx.org/licenses/ISC.html
+ *
+ * Copyright (C) 2026 Atheme Development Group (https://atheme.github.io/)
+ *
+ * Vectorised base64 encoding and decoding for Atheme IRC Services.
+ *
+ * base64.c hands the bulk of its input to whichever of the kernels below is
+ * selected (the best one that the CPU can run, the first time any of them is
+ * needed), and does the rest itself. The kernels only know the RFC 4648
+ * alphabet, only do whole blocks, and stop at the first block that is not
+ * entirely made of alphabet characters, or when the output would not fit;
+ * so whitespace, padding, the end of input and every kind of error are left
+ * to the scalar code, and what is accepted (and what comes out) is exactly
+ * what it would have been without them. Besides the scalar code, there are:
+ *
+ *   - SSE4.1 (and SSSE3), 12 bytes to 16 characters at a time
+ *   - AVX2, 24 bytes to 32 characters at a time
+ *   - NEON (AArch64), 48 bytes to 64 characters at a time
+ *
+ * The x86 translations are the ones described by Wojciech Muła and Daniel
+ * Lemire ("Faster Base64 Encoding and Decoding using AVX2 Instructions",
+ * 2018); the NEON ones use table lookups over the whole alphabet.
+ */
+
+#include <atheme.h>
+#include "internal.h"
+
+#ifdef __has_attribute
+#  if __has_attribute(__target__) && (defined(__GNUC__) || defined(__clang__))
+#    if defined(__x86_64__) || defined(__i386__)
+#      define BASE64_HAVE_ACCEL_X86             1
+#    endif
+#  endif
+#endif
+
+#if defined(__aarch64__) && defined(__ARM_NEON)
+#  define BASE64_HAVE_ACCEL_NEON                1
+#endif
+
+#ifdef BASE64_HAVE_ACCEL_X86
+#  include <immintrin.h>
+#  define BASE64_ACCEL_SSE_ATTR         __attribute__((__target__("sse4.1,ssse3")))
+#  define BASE64_ACCEL_AVX2_ATTR        __attribute__((__target__("avx2")))
+#endif
+
+#ifdef BASE64_HAVE_ACCEL_NEON
+#  include <arm_neon.h>
+#endif
+
+struct base64_kernel
+{
+	const char *    name;
+	bool          (*usable)(void);
+	size_t        (*encode)(const unsigned char *, size_t, char *, size_t);
+	size_t        (*decode)(const char *, size_t, unsigned char *, size_t);
+};
+
+#ifdef BASE64_HAVE_ACCEL_X86
+
+static bool
+base64_accel_x86_have_sse(void)
+{
+	// This only reads what the compiler runtime found out about the CPU at startup
+	return (__builtin_cpu_supports("ssse3") && __builtin_cpu_supports("sse4.1"));
+}
+
+static bool
+base64_accel_x86_have_avx2(void)
+{
+	return __builtin_cpu_supports("avx2");
+}
+
+static inline __m128i BASE64_ACCEL_SSE_ATTR
+base64_encode_block_sse(__m128i in)
+{
+	const __m128i shift_lut = _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+	                                        '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+	                                        '/' - 63, 'A', 0, 0);
+
+	// Spread each 3 bytes over 4, then move each 6 bits to the bottom of its own byte
+	in = _mm_shuffle_epi8(in, _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1));
+
+	const __m128i t0 = _mm_and_si128(in, _mm_set1_epi32(0x0FC0FC00));
+	const __m128i t1 = _mm_mulhi_epu16(t0, _mm_set1_epi32(0x04000040));
+	const __m128i t2 = _mm_and_si128(in, _mm_set1_epi32(0x003F03F0));
+	const __m128i t3 = _mm_mullo_epi16(t2, _mm_set1_epi32(0x01000010));
+	const __m128i indices = _mm_or_si128(t1, t3);
+
+	// 0 for A-Z is made 13; then the index into shift_lut is 0 for a-z, 1-10 for 0-9, 11 for + and 12 for /
+	__m128i result = _mm_subs_epu8(indices, _mm_set1_epi8(51));
+	const __m128i less = _mm_cmpgt_epi8(_mm_set1_epi8(26), indices);
+
+	result = _mm_or_si128(result, _mm_and_si128(less, _mm_set1_epi8(13)));
+	result = _mm_shuffle_epi8(shift_lut, result);
+
+	return _mm_add_epi8(result, indices);
+}
+
+// Decodes 16 characters into the first 12 bytes of *out, or returns false if they are not all in the alphabet
+static inline bool BASE64_ACCEL_SSE_ATTR
+base64_decode_block_sse(__m128i in, __m128i *const restrict out)
+{
+	const __m128i lut_lo = _mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A,
+	                                     0x1B, 0x1B, 0x1B, 0x1A);
+	const __m128i lut_hi = _mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10,
+	                                     0x10, 0x10, 0x10, 0x10);
+	const __m128i lut_roll = _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+	const __m128i mask_2f = _mm_set1_epi8(0x2F);
+
+	// A character is valid when the classes of its low and high nibbles have no bit in common
+	const __m128i hi_nibbles = _mm_and_si128(_mm_srli_epi32(in, 4), mask_2f);
+	const __m128i lo_nibbles = _mm_and_si128(in, mask_2f);
+	const __m128i lo = _mm_shuffle_epi8(lut_lo, lo_nibbles);
+	const __m128i hi = _mm_shuffle_epi8(lut_hi, hi_nibbles);
+
+	if (! _mm_testz_si128(lo, hi))
+		return false;
+
+	// '/' shares its high nibble with '+', and is told apart from it here
+	const __m128i eq_2f = _mm_cmpeq_epi8(in, mask_2f);
+	const __m128i roll = _mm_shuffle_epi8(lut_roll, _mm_add_epi8(eq_2f, hi_nibbles));
+
+	in = _mm_add_epi8(in, roll);
+
+	// Pack each 4 6-bit values into 3 bytes, then put those bytes in order at the front
+	const __m128i merged = _mm_maddubs_epi16(in, _mm_set1_epi32(0x01400140));
+	const __m128i packed = _mm_madd_epi16(merged, _mm_set1_epi32(0x00011000));
+
+	*out = _mm_shuffle_epi8(packed, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+
+	return true;
+}
+
+// Exactly 12 bytes, so that nothing past the output (in the caller's buffer) is touched
+static inline void BASE64_ACCEL_SSE_ATTR
+base64_store12_sse(unsigned char *const restrict dst, const __m128i out)
+{
+	const uint32_t tail = (uint32_t) _mm_cvtsi128_si32(_mm_srli_si128(out, 8));
+
+	(void) _mm_storel_epi64((__m128i *) dst, out);
+	(void) memcpy(dst + 8, &tail, sizeof tail);
+}
+
+static size_t BASE64_ACCEL_SSE_ATTR
+base64_encode_sse(const unsigned char *const restrict src, const size_t src_len, char *const restrict dst,
+                  const size_t dst_len)
+{
+	size_t done = 0;
+	size_t written = 0;
+
+	// Each load is 16 bytes, of which 12 are used
+	while ((src_len - done) >= 16U && (dst_len - written) >= 16U)
+	{
+		const __m128i in = _mm_loadu_si128((const __m128i *) (src + done));
+
+		(void) _mm_storeu_si128((__m128i *) (dst + written), base64_encode_block_sse(in));
+
+		done += 12U;
+		written += 16U;
+	}
+
+	return done;
+}
+
+static size_t BASE64_ACCEL_SSE_ATTR
+base64_decode_sse(const char *const restrict src, const size_t src_len, unsigned char *const restrict dst,
+                  const size_t dst_len)
+{
+	size_t done = 0;
+	size_t written = 0;
+
+	while ((src_len - done) >= 16U && (dst_len - written) >= 12U)
+	{
+		__m128i out;
+
+		if (! base64_decode_block_sse(_mm_loadu_si128((const __m128i *) (src + done)), &out))
+			break;
+
+		(void) base64_store12_sse(dst + written, out);
+
+		done += 16U;
+		written += 12U;
+	}
+
+	return done;
+}
+
+static size_t BASE64_ACCEL_AVX2_ATTR
+base64_encode_avx2(const unsigned char *const restrict src, const size_t src_len, char *const restrict dst,
+                   const size_t dst_len)
+{
+	const __m256i shift_lut = _mm256_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+	                                           '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+	                                           '/' - 63, 'A', 0, 0,
+	                                           'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+	                                           '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+	                                           '/' - 63, 'A', 0, 0);
+	const __m256i spread = _mm256_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10,
+	                                        1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10);
+
+	size_t done = 0;
+	size_t written = 0;
+
+	// The two lanes are loaded 12 bytes apart, so the second load reaches 28 bytes in
+	while ((src_len - done) >= 28U && (dst_len - written) >= 32U)
+	{
+		const __m128i lo = _mm_loadu_si128((const __m128i *) (src + done));
+		const __m128i hi = _mm_loadu_si128((const __m128i *) (src + done + 12U));
+
+		__m256i in = _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+
+		in = _mm256_shuffle_epi8(in, spread);
+
+		const __m256i t0 = _mm256_and_si256(in, _mm256_set1_epi32(0x0FC0FC00));
+		const __m256i t1 = _mm256_mulhi_epu16(t0, _mm256_set1_epi32(0x04000040));
+		const __m256i t2 = _mm256_and_si256(in, _mm256_set1_epi32(0x003F03F0));
+		const __m256i t3 = _mm256_mullo_epi16(t2, _mm256_set1_epi32(0x01000010));
+		const __m256i indices = _mm256_or_si256(t1, t3);
+
+		__m256i result = _mm256_subs_epu8(indices, _mm256_set1_epi8(51));
+		const __m256i less = _mm256_cmpgt_epi8(_mm256_set1_epi8(26), indices);
+
+		result = _mm256_or_si256(result, _mm256_and_si256(less, _mm256_set1_epi8(13)));
+		result = _mm256_shuffle_epi8(shift_lut, result);
+		result = _mm256_add_epi8(result, indices);
+
+		(void) _mm256_storeu_si256((__m256i *) (dst + written), result);
+
+		done += 24U;
+		written += 32U;
+	}
+
+	// Then perhaps one more block of 12 bytes
+	const size_t tail = base64_encode_sse(src + done, src_len - done, dst + written, dst_len - written);
+
+	return done + tail;
+}
+
+static size_t BASE64_ACCEL_AVX2_ATTR
+base64_decode_avx2(const char *const restrict src, const size_t src_len, unsigned char *const restrict dst,
+                   const size_t dst_len)
+{
+	const __m256i lut_lo = _mm256_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13,
+	                                        0x1A, 0x1B, 0x1B, 0x1B, 0x1A,
+	                                        0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13,
+	                                        0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+	const __m256i lut_hi = _mm256_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10,
+	                                        0x10, 0x10, 0x10, 0x10, 0x10,
+	                                        0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10,
+	                                        0x10, 0x10, 0x10, 0x10, 0x10);
+	const __m256i lut_roll = _mm256_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0,
+	                                          0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+	const __m256i pack = _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+	                                      2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+	const __m256i mask_2f = _mm256_set1_epi8(0x2F);
+
+	size_t done = 0;
+	size_t written = 0;
+
+	while ((src_len - done) >= 32U && (dst_len - written) >= 24U)
+	{
+		__m256i in = _mm256_loadu_si256((const __m256i *) (src + done));
+
+		const __m256i hi_nibbles = _mm256_and_si256(_mm256_srli_epi32(in, 4), mask_2f);
+		const __m256i lo_nibbles = _mm256_and_si256(in, mask_2f);
+		const __m256i lo = _mm256_shuffle_epi8(lut_lo, lo_nibbles);
+		const __m256i hi = _mm256_shuffle_epi8(lut_hi, hi_nibbles);
+
+		if (! _mm256_testz_si256(lo, hi))
+			break;
+
+		const __m256i eq_2f = _mm256_cmpeq_epi8(in, mask_2f);
+		const __m256i roll = _mm256_shuffle_epi8(lut_roll, _mm256_add_epi8(eq_2f, hi_nibbles));
+
+		in = _mm256_add_epi8(in, roll);
+
+		const __m256i merged = _mm256_maddubs_epi16(in, _mm256_set1_epi32(0x01400140));
+		const __m256i packed = _mm256_madd_epi16(merged, _mm256_set1_epi32(0x00011000));
+		const __m256i out = _mm256_shuffle_epi8(packed, pack);
+
+		(void) base64_store12_sse(dst + written, _mm256_castsi256_si128(out));
+		(void) base64_store12_sse(dst + written + 12U, _mm256_extracti128_si256(out, 1));
+
+		done += 32U;
+		written += 24U;
+	}
+
+	const size_t tail = base64_decode_sse(src + done, src_len - done, dst + written, dst_len - written);
+
+	return done + tail;
+}
+
+#endif /* BASE64_HAVE_ACCEL_X86 */
+
+#ifdef BASE64_HAVE_ACCEL_NEON
+
+static const unsigned char base64_neon_alphabet[64] = {
+
+	0x41, 0x42, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49, 0x4A, 0x4B, 0x4C, 0x4D, 0x4E, 0x4F, 0x50,
+	0x51, 0x52, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5A, 0x61, 0x62, 0x63, 0x64, 0x65, 0x66,
+	0x67, 0x68, 0x69, 0x6A, 0x6B, 0x6C, 0x6D, 0x6E, 0x6F, 0x70, 0x71, 0x72, 0x73, 0x74, 0x75, 0x76,
+	0x77, 0x78, 0x79, 0x7A, 0x30, 0x31, 0x32, 0x33, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x2B, 0x2F,
+};
+
+// As in base64.c, except that padding and the terminator are just as invalid as anything else (0xFF)
+static const unsigned char base64_neon_inverse[128] = {
+
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x3E, 0xFF, 0xFF, 0xFF, 0x3F,
+	0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3A, 0x3B, 0x3C, 0x3D, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E,
+	0x0F, 0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0x1A, 0x1B, 0x1C, 0x1D, 0x1E, 0x1F, 0x20, 0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27, 0x28,
+	0x29, 0x2A, 0x2B, 0x2C, 0x2D, 0x2E, 0x2F, 0x30, 0x31, 0x32, 0x33, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+};
+
+static inline uint8x16x4_t
+base64_neon_load64(const unsigned char *const restrict table)
+{
+	uint8x16x4_t result;
+
+	result.val[0] = vld1q_u8(table + 0x00U);
+	result.val[1] = vld1q_u8(table + 0x10U);
+	result.val[2] = vld1q_u8(table + 0x20U);
+	result.val[3] = vld1q_u8(table + 0x30U);
+
+	return result;
+}
+
+static size_t
+base64_encode_neon(const unsigned char *const restrict src, const size_t src_len, char *const restrict dst,
+                   const size_t dst_len)
+{
+	const uint8x16x4_t alphabet = base64_neon_load64(base64_neon_alphabet);
+	const uint8x16_t mask = vdupq_n_u8(0x3FU);
+
+	size_t done = 0;
+	size_t written = 0;
+
+	while ((src_len - done) >= 48U && (dst_len - written) >= 64U)
+	{
+		// De-interleaved, so that lane i of each of the 3 vectors is triplet i
+		const uint8x16x3_t in = vld3q_u8(src + done);
+		uint8x16x4_t out;
+
+		out.val[0] = vshrq_n_u8(in.val[0], 2);
+		out.val[1] = vandq_u8(vorrq_u8(vshlq_n_u8(in.val[0], 4), vshrq_n_u8(in.val[1], 4)), mask);
+		out.val[2] = vandq_u8(vorrq_u8(vshlq_n_u8(in.val[1], 2), vshrq_n_u8(in.val[2], 6)), mask);
+		out.val[3] = vandq_u8(in.val[2], mask);
+
+		for (size_t i = 0; i < 4U; i++)
+			out.val[i] = vqtbl4q_u8(alphabet, out.val[i]);
+
+		(void) vst4q_u8((uint8_t *) (dst + written), out);
+
+		done += 48U;
+		written += 64U;
+	}
+
+	return done;
+}
+
+static size_t
+base64_decode_neon(const char *const restrict src, const size_t src_len, unsigned char *const restrict dst,
+                   const size_t dst_len)
+{
+	const uint8x16x4_t inverse_lo = base64_neon_load64(base64_neon_inverse);
+	const uint8x16x4_t inverse_hi = base64_neon_load64(base64_neon_inverse + 0x40U);
+	const uint8x16_t offset = vdupq_n_u8(0x40U);
+
+	size_t done = 0;
+	size_t written = 0;
+
+	while ((src_len - done) >= 64U && (dst_len - written) >= 48U)
+	{
+		const uint8x16x4_t in = vld4q_u8((const uint8_t *) (src + done));
+		uint8x16x4_t val;
+		uint8x16_t error = vdupq_n_u8(0x00U);
+
+		/* Indices past the end of a table give 0 (vqtbl4q) or leave the lane alone (vqtbx4q), so each
+		 * character is looked up in the half of the table it belongs to; characters past 0x7F give 0,
+		 * and are caught with the invalid ones by their top bit.
+		 */
+		for (size_t i = 0; i < 4U; i++)
+		{
+			val.val[i] = vqtbl4q_u8(inverse_lo, in.val[i]);
+			val.val[i] = vqtbx4q_u8(val.val[i], inverse_hi, vsubq_u8(in.val[i], offset));
+			error = vorrq_u8(error, vorrq_u8(val.val[i], in.val[i]));
+		}
+
+		if (vmaxvq_u8(error) & 0x80U)
+			break;
+
+		uint8x16x3_t out;
+
+		out.val[0] = vorrq_u8(vshlq_n_u8(val.val[0], 2), vshrq_n_u8(val.val[1], 4));
+		out.val[1] = vorrq_u8(vshlq_n_u8(val.val[1], 4), vshrq_n_u8(val.val[2], 2));
+		out.val[2] = vorrq_u8(vshlq_n_u8(val.val[2], 6), val.val[3]);
+
+		(void) vst3q_u8(dst + written, out);
+
+		done += 64U;
+		written += 48U;
+	}
+
+	return done;
+}
+
+#endif /* BASE64_HAVE_ACCEL_NEON */
+
+// In order of preference, least preferred first
+static const struct base64_kernel base64_kernels[] = {
+
+	{ "portable", NULL, NULL, NULL },
+#ifdef BASE64_HAVE_ACCEL_X86
+	{ "sse4.1", &base64_accel_x86_have_sse, &base64_encode_sse, &base64_decode_sse },
+	{ "avx2", &base64_accel_x86_have_avx2, &base64_encode_avx2, &base64_decode_avx2 },
+#endif
+#ifdef BASE64_HAVE_ACCEL_NEON
+	{ "neon", NULL, &base64_encode_neon, &base64_decode_neon },
+#endif
+};
+
+static const struct base64_kernel *base64_kernel_active = NULL;
+
+// The idx'th kernel that this CPU can run, or NULL
+static const struct base64_kernel *
+base64_kernel_usable(size_t idx)
+{
+	for (size_t i = 0; i < (sizeof base64_kernels / sizeof base64_kernels[0]); i++)
+	{
+		const struct base64_kernel *const k = &base64_kernels[i];
+
+		if (k->usable && ! k->usable())
+			continue;
+
+		if (! idx--)
+			return k;
+	}
+
+	return NULL;
+}
+
+static const struct base64_kernel *
+base64_kernel_get(void)
+{
+	if (! base64_kernel_active)
+		(void) base64_kernel_select(base64_kernel_count() - 1U);
+
+	return base64_kernel_active;
+}
+
+// Called by base64_encode_run(); returns how much of the input it encoded (a multiple of 3 bytes)
+size_t
+base64_encode_accel(const unsigned char *const restrict src, const size_t src_len, char *const restrict dst,
+                    const size_t dst_len)
+{
+	const struct base64_kernel *const k = base64_kernel_get();
+
+	if (! k->encode)
+		return 0;
+
+	return k->encode(src, src_len, dst, dst_len);
+}
+
+// Called by base64_decode_run(); returns how much of the input it decoded (a multiple of 4 characters)
+size_t
+base64_decode_accel(const char *const restrict src, const size_t src_len, unsigned char *const restrict dst,
+                    const size_t dst_len)
+{
+	const struct base64_kernel *const k = base64_kernel_get();
+
+	if (! k->decode)
+		return 0;
+
+	return k->decode(src, src_len, dst, dst_len);
+}
+
+// How many kernels this CPU can run (always at least 1)
+size_t
+base64_kernel_count(void)
+{
+	size_t count = 0;
+
+	while (base64_kernel_usable(count))
+		count++;
+
+	return count;
+}
+
+const char *
+base64_kernel_name(const size_t idx)
+{
+	const struct base64_kernel *const k = base64_kernel_usable(idx);
+
+	return k ? k->name : NULL;
+}
+
+/* Nothing else should be encoding or decoding while this is called;
+ * crypto-benchmark only calls it before any other threads are started.
+ */
+bool
+base64_kernel_select(const size_t idx)
+{
+	const struct base64_kernel *const k = base64_kernel_usable(idx);
+
+	if (! k)
+		return false;
+
+	base64_kernel_active = k;
+	return true;
+}
+
+// The index of the selected kernel (selecting the best one if none is yet)
+size_t
+base64_kernel_selected(void)
+{
+	const struct base64_kernel *const active = base64_kernel_get();
+	const struct base64_kernel *k;
+
+	for (size_t i = 0; (k = base64_kernel_usable(i)) != NULL; i++)
+		if (k == active)
+			return i;
+
+	return 0;
+}
@@ -0,0 +1,369 @@
+/*
+ * SPDX-License-Identifier: ISC
+ * SPDX-URL: https://spdx.org/licenses/ISC.html
+ *
+ * Copyright (C) 2026 Atheme Development Group (https://atheme.github.io/)
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * atheme-services: A collection of minimalist IRC services
+ * burst.c: Deferring enforcement until a server has finished bursting.
+ *
+ * During a netjoin, every user and channel membership introduced by the
+ * joining server(s) runs through the same enforcement hooks as a client
+ * connecting or joining on its own, and most of the resulting modes or kills
+ * are computed against a network state that is only half there. Modules can
+ * instead queue that work here; it is run from handle_eob(), users first and
+ * then one channel at a time (with one modestack flush per channel), skipping
+ * anyone who has quit or parted in the meantime.
+ */
+
+#include <atheme.h>
+#include "internal.h"
+
+struct burst_item
+{
+	mowgli_node_t           snode;      // For entry into the server's (or a channel group's) queue
+	mowgli_node_t           unode;      // For entry into struct user -> burstq
+	mowgli_list_t *         queue;      // The list snode is currently in
+	struct user *           u;
+	struct chanuser *       cu;         // NULL for per-user items
+	burst_user_fn           user_fn;
+	burst_chanuser_fn       chanuser_fn;
+};
+
+struct burst_channel
+{
+	mowgli_node_t           node;
+	mowgli_list_t           items;
+	struct channel *        chan;
+	char *                  name;
+};
+
+static struct named_heap *burst_heap = NULL;
+
+// The server whose queue is being run; enforcement for its users is no longer deferred
+static struct server *burst_running = NULL;
+
+void
+init_burst(void)
+{
+	burst_heap = named_heap_get("burst", sizeof(struct burst_item));
+
+	if (burst_heap == NULL)
+	{
+		slog(LG_DEBUG, "init_burst(): block allocator failure.");
+		exit(EXIT_FAILURE);
+	}
+}
+
+static inline bool
+burst_deferring(const struct user *const restrict u)
+{
+	const struct server *const s = u->server;
+
+	return s != me.me && s != burst_running && !(s->flags & SF_EOB);
+}
+
+static void
+burst_item_free(struct burst_item *const restrict item)
+{
+	mowgli_node_delete(&item->snode, item->queue);
+	mowgli_node_delete(&item->unode, &item->u->burstq);
+	named_heap_free(burst_heap, item);
+}
+
+static struct burst_item *
+burst_item_create(struct user *const restrict u, struct chanuser *const restrict cu, mowgli_list_t *const queue)
+{
+	struct burst_item *const item = named_heap_alloc(burst_heap);
+
+	item->u = u;
+	item->cu = cu;
+	item->queue = queue;
+
+	mowgli_node_add(item, &item->snode, queue);
+	mowgli_node_add(item, &item->unode, &u->burstq);
+
+	return item;
+}
+
+/*
+ * burst_defer_user(struct user *u, burst_user_fn fn)
+ *
+ * Queues fn(u) to run when u's server finishes bursting.
+ *
+ * Inputs:
+ *     - user to enforce against
+ *     - function to call
+ *
+ * Outputs:
+ *     - true if the call was queued (or already was), false if the
+ *       caller should do the work now
+ *
+ * Side Effects:
+ *     - the call is dropped again if the user quits first
+ */
+bool
+burst_defer_user(struct user *const restrict u, const burst_user_fn fn)
+{
+	mowgli_node_t *n;
+
+	return_val_if_fail(u != NULL, false);
+	return_val_if_fail(fn != NULL, false);
+
+	if (!burst_deferring(u))
+		return false;
+
+	MOWGLI_ITER_FOREACH(n, u->burstq.head)
+	{
+		const struct burst_item *const item = n->data;
+
+		if (item->cu == NULL && item->user_fn == fn)
+			return true;
+	}
+
+	burst_item_create(u, NULL, &u->server->burstq_users)->user_fn = fn;
+
+	return true;
+}
+
+/*
+ * burst_defer_chanuser(struct chanuser *cu, burst_chanuser_fn fn)
+ *
+ * Queues fn(cu) to run when the member's server finishes bursting.
+ *
+ * Inputs:
+ *     - channel membership to enforce against
+ *     - function to call
+ *
+ * Outputs:
+ *     - true if the call was queued (or already was), false if the
+ *       caller should do the work now
+ *
+ * Side Effects:
+ *     - the call is dropped again if the user parts or quits first
+ */
+bool
+burst_defer_chanuser(struct chanuser *const restrict cu, const burst_chanuser_fn fn)
+{
+	mowgli_node_t *n;
+
+	return_val_if_fail(cu != NULL, false);
+	return_val_if_fail(fn != NULL, false);
+
+	if (!burst_deferring(cu->user))
+		return false;
+
+	MOWGLI_ITER_FOREACH(n, cu->user->burstq.head)
+	{
+		const struct burst_item *const item = n->data;
+
+		if (item->cu == cu && item->chanuser_fn == fn)
+			return true;
+	}
+
+	burst_item_create(cu->user, cu, &cu->user->server->burstq_chanusers)->chanuser_fn = fn;
+
+	return true;
+}
+
+/* called by user_delete() */
+void
+burst_forget_user(struct user *const restrict u)
+{
+	mowgli_node_t *n, *tn;
+
+	MOWGLI_ITER_FOREACH_SAFE(n, tn, u->burstq.head)
+		burst_item_free(n->data);
+}
+
+/* called by chanuser_delete() */
+void
+burst_forget_chanuser(struct chanuser *const restrict cu)
+{
+	mowgli_node_t *n, *tn;
+
+	MOWGLI_ITER_FOREACH_SAFE(n, tn, cu->user->burstq.head)
+	{
+		struct burst_item *const item = n->data;
+
+		if (item->cu == cu)
+			burst_item_free(item);
+	}
+}
+
+/*
+ * burst_cancel_user_fn(burst_user_fn fn)
+ * burst_cancel_chanuser_fn(burst_chanuser_fn fn)
+ *
+ * Drops every queued call to fn; modules must do this before unloading.
+ *
+ * Inputs:
+ *     - function that may have been passed to burst_defer_user() or
+ *       burst_defer_chanuser()
+ *
+ * Outputs:
+ *     - nothing
+ *
+ * Side Effects:
+ *     - none
+ */
+void
+burst_cancel_user_fn(const burst_user_fn fn)
+{
+	mowgli_patricia_iteration_state_t state;
+	struct user *u;
+
+	MOWGLI_PATRICIA_FOREACH(u, &state, userlist)
+	{
+		mowgli_node_t *n, *tn;
+
+		MOWGLI_ITER_FOREACH_SAFE(n, tn, u->burstq.head)
+		{
+			struct burst_item *const item = n->data;
+
+			if (item->cu == NULL && item->user_fn == fn)
+				burst_item_free(item);
+		}
+	}
+}
+
+void
+burst_cancel_chanuser_fn(const burst_chanuser_fn fn)
+{
+	mowgli_patricia_iteration_state_t state;
+	struct user *u;
+
+	MOWGLI_PATRICIA_FOREACH(u, &state, userlist)
+	{
+		mowgli_node_t *n, *tn;
+
+		MOWGLI_ITER_FOREACH_SAFE(n, tn, u->burstq.head)
+		{
+			struct burst_item *const item = n->data;
+
+			if (item->cu != NULL && item->chanuser_fn == fn)
+				burst_item_free(item);
+		}
+	}
+}
+
+/* Moves the server's channel queue into per-channel groups, keeping the order
+ * in which the channels were first seen.
+ */
+static void
+burst_group_channels(struct server *const restrict s, mowgli_list_t *const restrict groups)
+{
+	mowgli_patricia_t *const index = mowgli_patricia_create(NULL);
+	mowgli_node_t *n, *tn;
+
+	MOWGLI_ITER_FOREACH_SAFE(n, tn, s->burstq_chanusers.head)
+	{
+		struct burst_item *const item = n->data;
+		struct channel *const chan = item->cu->chan;
+		struct burst_channel *bc = mowgli_patricia_retrieve(index, chan->name);
+
+		if (bc == NULL)
+		{
+			bc = smalloc(sizeof *bc);
+			bc->chan = chan;
+			bc->name = sstrdup(chan->name);
+			mowgli_patricia_add(index, bc->name, bc);
+			mowgli_node_add(bc, &bc->node, groups);
+		}
+
+		mowgli_node_delete(&item->snode, item->queue);
+		mowgli_node_add(item, &item->snode, &bc->items);
+		item->queue = &bc->items;
+	}
+
+	mowgli_patricia_destroy(index, NULL, NULL);
+}
+
+/*
+ * burst_run(struct server *s)
+ *
+ * Runs everything that was deferred while s was bursting. Called by
+ * handle_eob() before s is marked as having finished its burst, so that
+ * the queued functions see the same server state they would have seen
+ * at the time.
+ *
+ * Inputs:
+ *     - server that finished bursting
+ *
+ * Outputs:
+ *     - nothing
+ *
+ * Side Effects:
+ *     - the queued functions are run and the queues are emptied
+ */
+void
+burst_run(struct server *const restrict s)
+{
+	mowgli_list_t groups = { NULL, NULL, 0 };
+	mowgli_node_t *n, *tn;
+	unsigned int nusers = 0, nchanusers = 0, nchans = 0;
+
+	return_if_fail(s != NULL);
+
+	if (!MOWGLI_LIST_LENGTH(&s->burstq_users) && !MOWGLI_LIST_LENGTH(&s->burstq_chanusers))
+		return;
+
+	struct timeval started, elapsed;
+
+	s_time(&started);
+
+	burst_running = s;
+
+	/* Each item is released before its function is called, as that may
+	 * well kill or kick someone and thereby release others.
+	 */
+	while ((n = s->burstq_users.head) != NULL)
+	{
+		struct burst_item *const item = n->data;
+		struct user *const u = item->u;
+		const burst_user_fn fn = item->user_fn;
+
+		burst_item_free(item);
+		fn(u);
+		nusers++;
+	}
+
+	burst_group_channels(s, &groups);
+
+	MOWGLI_ITER_FOREACH_SAFE(n, tn, groups.head)
+	{
+		struct burst_channel *const bc = n->data;
+		mowgli_node_t *in;
+
+		while ((in = bc->items.head) != NULL)
+		{
+			struct burst_item *const item = in->data;
+			struct chanuser *const cu = item->cu;
+			const burst_chanuser_fn fn = item->chanuser_fn;
+
+			burst_item_free(item);
+			fn(cu);
+			nchanusers++;
+		}
+
+		// The channel may have emptied out while we were enforcing on it
+		if (channel_find(bc->name) == bc->chan)
+			modestack_flush_channel(bc->chan);
+
+		mowgli_node_delete(&bc->node, &groups);
+		sfree(bc->name);
+		sfree(bc);
+		nchans++;
+	}
+
+	burst_running = NULL;
+
+	e_time(started, &elapsed);
+
+	slog(LG_NETWORK, "burst_run(): %s: %u deferred user checks, %u deferred joins in %u channels, "
+	                 "done in %d ms (%u users)", s->name, nusers, nchanusers, nchans, tv2ms(&elapsed), s->users);
+}
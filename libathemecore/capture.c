@@ -0,0 +1,419 @@
+/*
+ * SPDX-License-Identifier: ISC
+ * SPDX-URL: https://spdx.org/licenses/ISC.html
+ *
+ * Copyright (C) 2026 Atheme Development Group (https://atheme.github.io/)
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * atheme-services: A collection of minimalist IRC services
+ * capture.c: Capturing uplink traffic to a ring file.
+ *
+ * Every line to and from the uplink is appended to a file of a fixed size,
+ * mapped into memory, with a timestamp to the nanosecond; once it is full,
+ * the oldest lines make way. Since the file is kept up to date as it is
+ * written, it can be read back (by dragon --replay, for example) at any
+ * time, even after a crash.
+ *
+ * The file is a 64-byte header followed by the ring:
+ *
+ *   0  magic ("ATHMCAP1")         32  offset of the oldest record
+ *   8  version (1)                40  records in the ring
+ *  12  header size (64)           48  records written since it was started
+ *  16  size of the ring           56  when it was started (seconds)
+ *  24  offset of the next record
+ *
+ * and each record is 12 bytes of header (the time in nanoseconds, 8 bytes;
+ * the direction, 1; unused, 1; the length of the line, 2) and the line
+ * itself, without a newline. A record that doesn't fit before the end of the
+ * ring goes at the start, behind a direction of 0xFF (if there is room for
+ * one). All numbers are little-endian.
+ */
+
+#include <atheme.h>
+#include "internal.h"
+
+#define CAPTURE_VERSION         1U
+#define CAPTURE_HEADER_SIZE     64U
+#define CAPTURE_RECORD_HEADER   12U
+#define CAPTURE_LINE_MAX        0xFFFFU
+#define CAPTURE_WRAP            0xFFU
+
+struct capture_reader
+{
+	unsigned char *         data;
+	size_t                  size;           // of the ring
+	size_t                  pos;
+	unsigned long long      left;           // records still to be read
+};
+
+struct capture_ring
+{
+	char *                  path;
+	int                     fd;
+	unsigned char *         map;
+	size_t                  map_len;
+	unsigned char *         ring;
+	size_t                  size;
+	size_t                  head;
+	size_t                  tail;
+	unsigned long long      records;
+	unsigned long long      written;
+	time_t                  started;
+};
+
+bool capture_running = false;
+
+static struct capture_ring capture;
+
+static void
+capture_put16(unsigned char *const restrict p, const unsigned int v)
+{
+	p[0] = (unsigned char) (v & 0xFFU);
+	p[1] = (unsigned char) ((v >> 8) & 0xFFU);
+}
+
+static void
+capture_put32(unsigned char *const restrict p, const unsigned int v)
+{
+	for (unsigned int i = 0; i < 4U; i++)
+		p[i] = (unsigned char) ((v >> (8U * i)) & 0xFFU);
+}
+
+static void
+capture_put64(unsigned char *const restrict p, const unsigned long long v)
+{
+	for (unsigned int i = 0; i < 8U; i++)
+		p[i] = (unsigned char) ((v >> (8U * i)) & 0xFFU);
+}
+
+static unsigned int
+capture_get16(const unsigned char *const restrict p)
+{
+	return ((unsigned int) p[0]) | (((unsigned int) p[1]) << 8);
+}
+
+static unsigned int
+capture_get32(const unsigned char *const restrict p)
+{
+	unsigned int v = 0;
+
+	for (unsigned int i = 0; i < 4U; i++)
+		v |= ((unsigned int) p[i]) << (8U * i);
+
+	return v;
+}
+
+static unsigned long long
+capture_get64(const unsigned char *const restrict p)
+{
+	unsigned long long v = 0;
+
+	for (unsigned int i = 0; i < 8U; i++)
+		v |= ((unsigned long long) p[i]) << (8U * i);
+
+	return v;
+}
+
+static void
+capture_header_sync(void)
+{
+	(void) capture_put64(capture.map + 24, capture.head);
+	(void) capture_put64(capture.map + 32, capture.tail);
+	(void) capture_put64(capture.map + 40, capture.records);
+	(void) capture_put64(capture.map + 48, capture.written);
+}
+
+// Makes way for the oldest record (or skips the wrap in front of it)
+static void
+capture_drop_tail(void)
+{
+	const unsigned char *const rec = capture.ring + capture.tail;
+
+	if (capture.size - capture.tail < CAPTURE_RECORD_HEADER || rec[8] == CAPTURE_WRAP)
+	{
+		capture.tail = 0;
+		return;
+	}
+
+	capture.tail += CAPTURE_RECORD_HEADER + capture_get16(rec + 10);
+	capture.records--;
+
+	if (capture.tail >= capture.size)
+		capture.tail = 0;
+
+	if (! capture.records)
+		capture.tail = capture.head;
+}
+
+// Frees up need bytes from the head on, going back to the start if it has to
+static void
+capture_reserve(const size_t need)
+{
+	if (capture.size - capture.head < need)
+	{
+		// Everything from the head to the end of the ring goes
+		while (capture.records && capture.tail >= capture.head)
+			(void) capture_drop_tail();
+
+		if (capture.size - capture.head >= CAPTURE_RECORD_HEADER)
+			capture.ring[capture.head + 8] = CAPTURE_WRAP;
+
+		capture.head = 0;
+
+		if (! capture.records)
+			capture.tail = 0;
+	}
+
+	while (capture.records && capture.tail >= capture.head && capture.tail < capture.head + need)
+		(void) capture_drop_tail();
+}
+
+void
+capture_write(const enum capture_direction direction, const char *const restrict line, size_t len)
+{
+	struct timespec ts;
+
+	return_if_fail(capture_running);
+	return_if_fail(line != NULL);
+
+	while (len && (line[len - 1] == '\n' || line[len - 1] == '\r'))
+		len--;
+
+	if (len > CAPTURE_LINE_MAX)
+		len = CAPTURE_LINE_MAX;
+
+	(void) memset(&ts, 0x00, sizeof ts);
+	(void) clock_gettime(CLOCK_REALTIME, &ts);
+
+	const size_t need = CAPTURE_RECORD_HEADER + len;
+
+	(void) capture_reserve(need);
+
+	unsigned char *const rec = capture.ring + capture.head;
+
+	(void) capture_put64(rec, (((unsigned long long) ts.tv_sec) * 1000000000ULL) + (unsigned long long) ts.tv_nsec);
+	rec[8] = (unsigned char) direction;
+	rec[9] = 0;
+	(void) capture_put16(rec + 10, (unsigned int) len);
+	(void) memcpy(rec + CAPTURE_RECORD_HEADER, line, len);
+
+	capture.head += need;
+	capture.records++;
+	capture.written++;
+
+	(void) capture_header_sync();
+}
+
+bool
+capture_start(const char *const restrict path, const size_t size)
+{
+	return_val_if_fail(path != NULL, false);
+	return_val_if_fail(size >= CAPTURE_SIZE_MIN && size <= CAPTURE_SIZE_MAX, false);
+
+#ifdef HAVE_SYS_MMAN_H
+	if (capture_running)
+		(void) capture_stop();
+
+	const int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+
+	if (fd == -1)
+	{
+		(void) slog(LG_ERROR, "%s: open('%s'): %s", MOWGLI_FUNC_NAME, path, strerror(errno));
+		return false;
+	}
+
+	const size_t map_len = CAPTURE_HEADER_SIZE + size;
+
+	if (ftruncate(fd, (off_t) map_len) != 0)
+	{
+		(void) slog(LG_ERROR, "%s: ftruncate('%s'): %s", MOWGLI_FUNC_NAME, path, strerror(errno));
+		(void) close(fd);
+		return false;
+	}
+
+	void *const map = mmap(NULL, map_len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+	if (map == MAP_FAILED)
+	{
+		(void) slog(LG_ERROR, "%s: mmap('%s'): %s", MOWGLI_FUNC_NAME, path, strerror(errno));
+		(void) close(fd);
+		return false;
+	}
+
+	(void) memset(&capture, 0x00, sizeof capture);
+
+	capture.path = sstrdup(path);
+	capture.fd = fd;
+	capture.map = map;
+	capture.map_len = map_len;
+	capture.ring = capture.map + CAPTURE_HEADER_SIZE;
+	capture.size = size;
+	capture.started = CURRTIME;
+
+	(void) memcpy(capture.map, CAPTURE_MAGIC, 8);
+	(void) capture_put32(capture.map + 8, CAPTURE_VERSION);
+	(void) capture_put32(capture.map + 12, CAPTURE_HEADER_SIZE);
+	(void) capture_put64(capture.map + 16, capture.size);
+	(void) capture_put64(capture.map + 56, (unsigned long long) capture.started);
+	(void) capture_header_sync();
+
+	capture_running = true;
+
+	(void) slog(LG_INFO, "capture_start(): capturing uplink traffic to %s (%zu KiB)", path, size / 1024U);
+
+	return true;
+#else
+	(void) slog(LG_ERROR, "%s: capturing needs mmap(2), which this system does not have", MOWGLI_FUNC_NAME);
+
+	return false;
+#endif
+}
+
+void
+capture_stop(void)
+{
+	if (! capture_running)
+		return;
+
+	capture_running = false;
+
+#ifdef HAVE_SYS_MMAN_H
+	(void) msync(capture.map, capture.map_len, MS_SYNC);
+	(void) munmap(capture.map, capture.map_len);
+#endif
+	(void) close(capture.fd);
+
+	(void) slog(LG_INFO, "capture_stop(): stopped capturing to %s (%llu lines written)", capture.path,
+	            capture.written);
+
+	(void) sfree(capture.path);
+	(void) memset(&capture, 0x00, sizeof capture);
+}
+
+bool
+capture_status_get(struct capture_status *const restrict status)
+{
+	return_val_if_fail(status != NULL, false);
+
+	if (! capture_running)
+		return false;
+
+	status->path = capture.path;
+	status->size = capture.size;
+	status->records = capture.records;
+	status->written = capture.written;
+	status->started = capture.started;
+
+	if (! capture.records)
+		status->used = 0;
+	else if (capture.head > capture.tail)
+		status->used = capture.head - capture.tail;
+	else
+		status->used = capture.size - (capture.tail - capture.head);
+
+	return true;
+}
+
+struct capture_reader *
+capture_open(const char *const restrict path)
+{
+	unsigned char header[CAPTURE_HEADER_SIZE];
+	struct capture_reader *reader;
+	FILE *fp;
+
+	return_val_if_fail(path != NULL, NULL);
+
+	if (! (fp = fopen(path, "rb")))
+		return NULL;
+
+	if (fread(header, sizeof header, 1, fp) != 1 || memcmp(header, CAPTURE_MAGIC, 8) != 0 ||
+	    capture_get32(header + 8) != CAPTURE_VERSION || capture_get32(header + 12) != CAPTURE_HEADER_SIZE)
+	{
+		(void) fclose(fp);
+		return NULL;
+	}
+
+	const unsigned long long size = capture_get64(header + 16);
+	const unsigned long long tail = capture_get64(header + 32);
+
+	if (size < CAPTURE_SIZE_MIN || size > CAPTURE_SIZE_MAX || tail >= size)
+	{
+		(void) fclose(fp);
+		return NULL;
+	}
+
+	reader = smalloc(sizeof *reader);
+	reader->data = smalloc((size_t) size);
+	reader->size = (size_t) size;
+	reader->pos = (size_t) tail;
+	reader->left = capture_get64(header + 40);
+
+	if (fread(reader->data, reader->size, 1, fp) != 1)
+	{
+		(void) fclose(fp);
+		(void) capture_close(reader);
+		return NULL;
+	}
+
+	(void) fclose(fp);
+
+	return reader;
+}
+
+// The records in the ring, oldest first
+bool
+capture_read(struct capture_reader *const restrict reader, struct capture_record *const restrict record)
+{
+	return_val_if_fail(reader != NULL, false);
+	return_val_if_fail(record != NULL, false);
+
+	while (reader->left)
+	{
+		const unsigned char *const rec = reader->data + reader->pos;
+
+		if (reader->size - reader->pos < CAPTURE_RECORD_HEADER || rec[8] == CAPTURE_WRAP)
+		{
+			// A second wrap in a row means the header lied about how many there are
+			if (! reader->pos)
+				break;
+
+			reader->pos = 0;
+			continue;
+		}
+
+		const size_t len = capture_get16(rec + 10);
+
+		if (reader->size - reader->pos - CAPTURE_RECORD_HEADER < len)
+			break;
+
+		record->when = capture_get64(rec);
+		record->direction = (rec[8] == CAPTURE_OUT) ? CAPTURE_OUT : CAPTURE_IN;
+		record->len = len;
+		record->line = (const char *) (rec + CAPTURE_RECORD_HEADER);
+
+		reader->pos += CAPTURE_RECORD_HEADER + len;
+		reader->left--;
+
+		if (reader->pos >= reader->size)
+			reader->pos = 0;
+
+		return true;
+	}
+
+	reader->left = 0;
+
+	return false;
+}
+
+void
+capture_close(struct capture_reader *const restrict reader)
+{
+	if (! reader)
+		return;
+
+	(void) sfree(reader->data);
+	(void) sfree(reader);
+}
@@ -17,10 +17,147 @@
 #include "internal.h"
 
 mowgli_patricia_t *chanlist;
+struct namehash *chanhash;
 
-static mowgli_heap_t *chan_heap = NULL;
-static mowgli_heap_t *chanuser_heap = NULL;
-static mowgli_heap_t *chanban_heap = NULL;
+static struct named_heap *chan_heap = NULL;
+static struct named_heap *chanuser_heap = NULL;
+static struct named_heap *chanban_heap = NULL;
+
+// Channels emptied by a netsplit, waiting for channel_reap_split()
+static mowgli_list_t split_emptied;
+
+/* Channels with at least this many members also index them by user
+ * pointer, so that chanuser_find() does not have to walk either list.
+ * The index is dropped again once the channel shrinks well below this.
+ */
+#define CHANUSER_HASH_MIN_MEMBERS       64U
+
+/* Likewise, channels with this many bans index them by mask, so that
+ * chanban_find() (for every ban in a mode change or burst) does not have
+ * to compare against all of them.
+ */
+#define CHANBAN_INDEX_MIN_BANS          32U
+
+static inline unsigned int
+chanuser_hash_slot(const struct user *const u, const unsigned int mask)
+{
+	const uint64_t h = ((uint64_t) (uintptr_t) u) * UINT64_C(0x9E3779B97F4A7C15);
+
+	return ((unsigned int) (h >> 32)) & mask;
+}
+
+static void
+chanuser_hash_insert(struct channel *const c, struct chanuser *const cu)
+{
+	const unsigned int mask = c->memberhash_size - 1U;
+	unsigned int i = chanuser_hash_slot(cu->user, mask);
+
+	while (c->memberhash[i] != NULL)
+		i = (i + 1U) & mask;
+
+	c->memberhash[i] = cu;
+}
+
+// Sizes the index for at least members members
+static void
+chanuser_hash_reserve(struct channel *const c, const unsigned int members)
+{
+	unsigned int size = CHANUSER_HASH_MIN_MEMBERS * 2U;
+	mowgli_node_t *n;
+
+	while (size < members * 2U)
+		size <<= 1U;
+
+	sfree(c->memberhash);
+
+	c->memberhash = scalloc(size, sizeof *c->memberhash);
+	c->memberhash_size = size;
+
+	MOWGLI_ITER_FOREACH(n, c->members.head)
+		chanuser_hash_insert(c, n->data);
+}
+
+static inline void
+chanuser_hash_rebuild(struct channel *const c)
+{
+	chanuser_hash_reserve(c, c->nummembers);
+}
+
+static void
+chanuser_hash_add(struct channel *const c, struct chanuser *const cu)
+{
+	if (c->memberhash == NULL)
+	{
+		if (c->nummembers >= CHANUSER_HASH_MIN_MEMBERS)
+			chanuser_hash_rebuild(c);
+
+		return;
+	}
+
+	if (c->nummembers * 2U > c->memberhash_size)
+		chanuser_hash_rebuild(c);
+	else
+		chanuser_hash_insert(c, cu);
+}
+
+static void
+chanuser_hash_clear(struct channel *const c)
+{
+	sfree(c->memberhash);
+
+	c->memberhash = NULL;
+	c->memberhash_size = 0;
+}
+
+static void
+chanuser_hash_remove(struct channel *const c, const struct chanuser *const cu)
+{
+	if (c->memberhash == NULL)
+		return;
+
+	if (c->nummembers < CHANUSER_HASH_MIN_MEMBERS / 4U)
+	{
+		chanuser_hash_clear(c);
+		return;
+	}
+
+	const unsigned int mask = c->memberhash_size - 1U;
+	unsigned int i = chanuser_hash_slot(cu->user, mask);
+
+	while (c->memberhash[i] != cu)
+	{
+		if (c->memberhash[i] == NULL)
+			return;
+
+		i = (i + 1U) & mask;
+	}
+
+	// Shift later entries of the probe run back so that lookups never stop early
+	for (unsigned int j = (i + 1U) & mask; c->memberhash[j] != NULL; j = (j + 1U) & mask)
+	{
+		const unsigned int home = chanuser_hash_slot(c->memberhash[j]->user, mask);
+
+		if (((j - home) & mask) >= ((j - i) & mask))
+		{
+			c->memberhash[i] = c->memberhash[j];
+			i = j;
+		}
+	}
+
+	c->memberhash[i] = NULL;
+}
+
+static struct chanuser *
+chanuser_hash_find(const struct channel *const c, const struct user *const u)
+{
+	const unsigned int mask = c->memberhash_size - 1U;
+
+	for (unsigned int i = chanuser_hash_slot(u, mask); c->memberhash[i] != NULL; i = (i + 1U) & mask)
+		if (c->memberhash[i]->user == u)
+			return c->memberhash[i];
+
+	return NULL;
+}
 
 /*
  * init_channels()
@@ -39,9 +176,9 @@ static mowgli_heap_t *chanban_heap = NULL;
 void
 init_channels(void)
 {
-	chan_heap = sharedheap_get(sizeof(struct channel));
-	chanuser_heap = sharedheap_get(sizeof(struct chanuser));
-	chanban_heap = sharedheap_get(sizeof(struct chanban));
+	chan_heap = named_heap_get("channel", sizeof(struct channel));
+	chanuser_heap = named_heap_get("chanuser", sizeof(struct chanuser));
+	chanban_heap = named_heap_get("chanban", sizeof(struct chanban));
 
 	if (chan_heap == NULL || chanuser_heap == NULL || chanban_heap == NULL)
 	{
@@ -50,6 +187,7 @@ init_channels(void)
 	}
 
 	chanlist = mowgli_patricia_create(irccasecanon);
+	chanhash = namehash_create(true);
 }
 
 /*
@@ -96,7 +234,7 @@ channel_add(const char *name, time_t ts, struct server *creator)
 
 	slog(LG_DEBUG, "channel_add(): %s by %s", name, creator->name);
 
-	c = mowgli_heap_alloc(chan_heap);
+	c = named_heap_alloc(chan_heap);
 
 	c->name = sstrdup(name);
 	c->ts = ts;
@@ -115,6 +253,7 @@ channel_add(const char *name, time_t ts, struct server *creator)
 		mc->chan = c;
 
 	mowgli_patricia_add(chanlist, c->name, c);
+	namehash_add(chanhash, c->name, c);
 
 	cnt.chan++;
 
@@ -154,6 +293,9 @@ channel_delete(struct channel *c)
 
 	slog(LG_DEBUG, "channel_delete(): %s", c->name);
 
+	if (c->flags & CHAN_SPLITEMPTY)
+		mowgli_node_delete(&c->splitnode, &split_emptied);
+
 	modestack_finalize_channel(c);
 
 	/* If this is called from uplink_close(), there may still be services
@@ -166,15 +308,17 @@ channel_delete(struct channel *c)
 		soft_assert(is_internal_client(cu->user) && !me.connected);
 		mowgli_node_delete(&cu->cnode, &c->members);
 		mowgli_node_delete(&cu->unode, &cu->user->channels);
-		mowgli_heap_free(chanuser_heap, cu);
+		named_heap_free_deferred(chanuser_heap, cu);
 		cnt.chanuser--;
 	}
 	c->nummembers = 0;
 	c->numsvcmembers = 0;
+	chanuser_hash_clear(c);
 
 	hook_call_channel_delete(c);
 
 	mowgli_patricia_delete(chanlist, c->name);
+	namehash_delete(chanhash, c->name, c);
 
 	if ((mc = mychan_find(c->name)))
 		mc->chan = NULL;
@@ -187,11 +331,141 @@ channel_delete(struct channel *c)
 	sfree(c->topic);
 	sfree(c->topic_setter);
 
-	mowgli_heap_free(chan_heap, c);
+	named_heap_free_deferred(chan_heap, c);
 
 	cnt.chan--;
 }
 
+static void
+chanban_index_insert(struct channel *const chan, struct chanban *const c)
+{
+	c->index_next = mowgli_patricia_retrieve(chan->banindex, c->mask);
+
+	if (c->index_next)
+		(void) mowgli_patricia_delete(chan->banindex, c->mask);
+
+	mowgli_patricia_add(chan->banindex, c->mask, c);
+}
+
+static void
+chanban_index_build(struct channel *const chan)
+{
+	mowgli_node_t *n;
+
+	chan->banindex = mowgli_patricia_create(irccasecanon);
+
+	MOWGLI_ITER_FOREACH(n, chan->bans.head)
+		chanban_index_insert(chan, n->data);
+}
+
+static void
+chanban_index_remove(struct channel *const chan, struct chanban *const c)
+{
+	struct chanban *head;
+
+	if (chan->banindex == NULL)
+		return;
+
+	// Few enough bans left (or none, as chanban_clear() goes) that a walk of the list will do again
+	if (MOWGLI_LIST_LENGTH(&chan->bans) < CHANBAN_INDEX_MIN_BANS / 4U)
+	{
+		mowgli_patricia_destroy(chan->banindex, NULL, NULL);
+		chan->banindex = NULL;
+		return;
+	}
+
+	if ((head = mowgli_patricia_retrieve(chan->banindex, c->mask)) == NULL)
+		return;
+
+	if (head != c)
+	{
+		// Not the head of its chain, so the index entry itself can stay
+		for (struct chanban *prev = head; prev->index_next != NULL; prev = prev->index_next)
+			if (prev->index_next == c)
+			{
+				prev->index_next = c->index_next;
+				break;
+			}
+
+		return;
+	}
+
+	mowgli_patricia_delete(chan->banindex, c->mask);
+
+	if (c->index_next)
+		mowgli_patricia_add(chan->banindex, c->index_next->mask, c->index_next);
+}
+
+/* The longest tail of the mask without wildcards in it, which anything the
+ * mask matches must end with (compared as match() does). CIDR masks are
+ * matched differently, so they get none.
+ */
+static unsigned int
+chanban_suffix_length(const char *const mask)
+{
+	const size_t len = strlen(mask);
+	size_t i = len;
+
+	if (strchr(mask, '/'))
+		return 0;
+
+	while (i > 0 && ! strchr("*?&#%\\", mask[i - 1]))
+		i--;
+
+	return (unsigned int) (len - i);
+}
+
+/*
+ * chanban_may_match(const struct chanban *c, const char **forms,
+ *                   const size_t *lens, size_t count)
+ *
+ * Quickly rules out a ban whose mask cannot match any of a user's
+ * nick!user@host forms, before they are matched against it one by one.
+ *
+ * Inputs:
+ *     - channel ban
+ *     - the forms to be matched, and their lengths
+ *     - how many forms there are
+ *
+ * Outputs:
+ *     - false if match() of the mask against every one of the forms
+ *       would fail, true if it might not (or the mask is a CIDR mask)
+ *
+ * Side Effects:
+ *     - none
+ */
+bool
+chanban_may_match(const struct chanban *c, const char *const *forms, const size_t *lens, size_t count)
+{
+	const unsigned int suffixlen = c->suffixlen;
+	size_t i;
+
+	if (suffixlen == 0)
+		return true;
+
+	const char *const suffix = c->mask + strlen(c->mask) - suffixlen;
+
+	for (i = 0; i < count; i++)
+	{
+		const char *tail;
+		unsigned int j;
+
+		if (lens[i] < suffixlen)
+			continue;
+
+		tail = forms[i] + lens[i] - suffixlen;
+
+		for (j = 0; j < suffixlen; j++)
+			if (ToLower(suffix[j]) != ToLower(tail[j]))
+				break;
+
+		if (j == suffixlen)
+			return true;
+	}
+
+	return false;
+}
+
 /*
  * chanban_add(struct channel *chan, const char *mask, int type)
  *
@@ -234,14 +508,21 @@ chanban_add(struct channel *chan, const char *mask, int type)
 
 	slog(LG_DEBUG, "chanban_add(): %s +%c %s", chan->name, type, mask);
 
-	c = mowgli_heap_alloc(chanban_heap);
+	c = named_heap_alloc(chanban_heap);
 
 	c->chan = chan;
 	c->mask = sstrdup(mask);
 	c->type = type;
+	c->suffixlen = chanban_suffix_length(c->mask);
+	(void) cidr_parse_hostmask(c->mask, &c->cidr);
 
 	mowgli_node_add(c, &c->node, &chan->bans);
 
+	if (chan->banindex != NULL)
+		chanban_index_insert(chan, c);
+	else if (MOWGLI_LIST_LENGTH(&chan->bans) >= CHANBAN_INDEX_MIN_BANS)
+		chanban_index_build(chan);
+
 	return c;
 }
 
@@ -265,9 +546,10 @@ chanban_delete(struct chanban * c)
 	return_if_fail(c != NULL);
 
 	mowgli_node_delete(&c->node, &c->chan->bans);
+	chanban_index_remove(c->chan, c);
 
 	sfree(c->mask);
-	mowgli_heap_free(chanban_heap, c);
+	named_heap_free(chanban_heap, c);
 }
 
 /*
@@ -296,6 +578,15 @@ chanban_find(struct channel *chan, const char *mask, int type)
 	return_val_if_fail(chan != NULL, NULL);
 	return_val_if_fail(mask != NULL, NULL);
 
+	if (chan->banindex != NULL)
+	{
+		for (c = mowgli_patricia_retrieve(chan->banindex, mask); c != NULL; c = c->index_next)
+			if (c->type == type)
+				return c;
+
+		return NULL;
+	}
+
 	MOWGLI_ITER_FOREACH(n, chan->bans.head)
 	{
 		c = n->data;
@@ -307,6 +598,98 @@ chanban_find(struct channel *chan, const char *mask, int type)
 	return NULL;
 }
 
+/*
+ * chanuser_prefix_modes(const char **name)
+ *
+ * Parses the status prefixes (e.g. ~, &, @, %, +) at the start of a member
+ * of a channel burst.
+ *
+ * Inputs:
+ *     - pointer to the member; on return it points past the prefixes
+ *
+ * Outputs:
+ *     - the status modes (CSTATUS_*) the prefixes stand for
+ */
+unsigned int
+chanuser_prefix_modes(const char **name)
+{
+	const char *p = *name;
+	unsigned int flags = 0;
+	int i;
+
+	while (*p != '\0')
+	{
+		for (i = 0; prefix_mode_list[i].mode; i++)
+			if (*p == prefix_mode_list[i].mode)
+			{
+				flags |= prefix_mode_list[i].value;
+				break;
+			}
+		if (!prefix_mode_list[i].mode)
+			break;
+		p++;
+	}
+
+	*name = p;
+	return flags;
+}
+
+// Makes u a member of chan with the given status modes; see chanuser_add()
+static struct chanuser *
+chanuser_add_user(struct channel *chan, struct user *u, unsigned int flags)
+{
+	struct chanuser *cu, *tcu;
+	struct hook_channel_joinpart hdata;
+
+	tcu = chanuser_find(chan, u);
+	if (tcu != NULL)
+	{
+		slog(LG_DEBUG, "chanuser_add(): user is already present: %s -> %s", chan->name, u->nick);
+
+		/* left over from before an uplink reconnect; the burst has the
+		 * current status modes
+		 */
+		if (tcu->stale)
+		{
+			tcu->stale = false;
+			tcu->modes = flags;
+			return tcu;
+		}
+
+		/* could be an OPME or other desyncher... */
+		tcu->modes |= flags;
+
+		return tcu;
+	}
+
+	slog(LG_DEBUG, "chanuser_add(): %s -> %s", chan->name, u->nick);
+
+	cu = named_heap_alloc(chanuser_heap);
+
+	cu->chan = chan;
+	cu->user = u;
+	cu->modes = flags;
+
+	chan->nummembers++;
+	if (is_internal_client(u))
+	{
+		chan->numsvcmembers++;
+		chan->fantasy_gen = 0;
+	}
+
+	mowgli_node_add(cu, &cu->cnode, &chan->members);
+	mowgli_node_add(cu, &cu->unode, &u->channels);
+	chanuser_hash_add(chan, cu);
+
+	cnt.chanuser++;
+
+	hdata.cu = cu;
+	hook_call_channel_join(&hdata);
+
+	/* Return NULL if a hook function kicked the user out */
+	return hdata.cu;
+}
+
 /*
  * chanuser_add(struct channel *chan, const char *nick)
  *
@@ -342,10 +725,7 @@ struct chanuser *
 chanuser_add(struct channel *chan, const char *nick)
 {
 	struct user *u;
-	struct chanuser *cu, *tcu;
-	unsigned int flags = 0;
-	int i = 0;
-	struct hook_channel_joinpart hdata;
+	unsigned int flags;
 
 	return_val_if_fail(chan != NULL, NULL);
 	return_val_if_fail(chan->name != NULL, NULL);
@@ -357,18 +737,7 @@ chanuser_add(struct channel *chan, const char *nick)
 		return NULL;
 	}
 
-	while (*nick != '\0')
-	{
-		for (i = 0; prefix_mode_list[i].mode; i++)
-			if (*nick == prefix_mode_list[i].mode)
-			{
-				flags |= prefix_mode_list[i].value;
-				break;
-			}
-		if (!prefix_mode_list[i].mode)
-			break;
-		nick++;
-	}
+	flags = chanuser_prefix_modes(&nick);
 
 	u = user_find(nick);
 	if (u == NULL)
@@ -377,39 +746,64 @@ chanuser_add(struct channel *chan, const char *nick)
 		return NULL;
 	}
 
-	tcu = chanuser_find(chan, u);
-	if (tcu != NULL)
-	{
-		slog(LG_DEBUG, "chanuser_add(): user is already present: %s -> %s", chan->name, u->nick);
-
-		/* could be an OPME or other desyncher... */
-		tcu->modes |= flags;
-
-		return tcu;
-	}
-
-	slog(LG_DEBUG, "chanuser_add(): %s -> %s", chan->name, u->nick);
+	return chanuser_add_user(chan, u, flags);
+}
 
-	cu = mowgli_heap_alloc(chanuser_heap);
+/*
+ * chanuser_add_many(struct channel *chan, const struct chanuser_add_entry *entries, unsigned int count)
+ *
+ * Adds a batch of members from a channel burst (SJOIN, FJOIN, ...).
+ *
+ * Inputs:
+ *     - channel that the users should belong to
+ *     - the members, as nick/UID (without prefixes) and status modes;
+ *       the names may point straight into the line being parsed
+ *     - how many there are
+ *
+ * Outputs:
+ *     - how many of them are members once it returns
+ *
+ * Side Effects:
+ *     - as chanuser_add() for every member; the membership index is sized
+ *       for the whole batch up front instead of growing as it goes. The
+ *       channel_join hook is still called per member; the services that
+ *       enforce on join already defer that to the end of the burst (see
+ *       burst_defer_chanuser()).
+ */
+unsigned int
+chanuser_add_many(struct channel *chan, const struct chanuser_add_entry *entries, unsigned int count)
+{
+	unsigned int i, added = 0;
+	struct user *u;
 
-	cu->chan = chan;
-	cu->user = u;
-	cu->modes = flags;
+	return_val_if_fail(chan != NULL, 0);
+	return_val_if_fail(chan->name != NULL, 0);
+	return_val_if_fail(entries != NULL || count == 0, 0);
 
-	chan->nummembers++;
-	if (is_internal_client(u))
-		chan->numsvcmembers++;
+	if (!VALID_GLOBAL_CHANNEL_PFX(chan->name))
+	{
+		slog(LG_DEBUG, "chanuser_add_many(): got an invalid global channel prefix: %s", chan->name);
+		return 0;
+	}
 
-	mowgli_node_add(cu, &cu->cnode, &chan->members);
-	mowgli_node_add(cu, &cu->unode, &u->channels);
+	if (chan->nummembers + count >= CHANUSER_HASH_MIN_MEMBERS &&
+			(chan->nummembers + count) * 2U > chan->memberhash_size)
+		chanuser_hash_reserve(chan, chan->nummembers + count);
 
-	cnt.chanuser++;
+	for (i = 0; i < count; i++)
+	{
+		u = user_find(entries[i].name);
+		if (u == NULL)
+		{
+			slog(LG_DEBUG, "chanuser_add_many(): nonexist user: %s", entries[i].name);
+			continue;
+		}
 
-	hdata.cu = cu;
-	hook_call_channel_join(&hdata);
+		if (chanuser_add_user(chan, u, entries[i].modes) != NULL)
+			added++;
+	}
 
-	/* Return NULL if a hook function kicked the user out */
-	return hdata.cu;
+	return added;
 }
 
 /*
@@ -427,7 +821,7 @@ chanuser_add(struct channel *chan, const char *nick)
  * Side Effects:
  *     if the user is on the channel:
  *     - a channel user object is removed from the
- *       channel's userlist and the user's channellist.
+ *       channel's userlist, membership index and the user's channellist.
  *     - channel_part hook is called
  *     - if this empties the channel and the channel is not set permanent
  *       (ircd->perm_mode), channel_delete() is called (q.v.)
@@ -436,7 +830,6 @@ void
 chanuser_delete(struct channel *chan, struct user *user)
 {
 	struct chanuser *cu;
-	struct hook_channel_joinpart hdata;
 
 	return_if_fail(chan != NULL);
 	return_if_fail(user != NULL);
@@ -445,25 +838,59 @@ chanuser_delete(struct channel *chan, struct user *user)
 	if (cu == NULL)
 		return;
 
+	chanuser_delete_member(cu);
+}
+
+/*
+ * chanuser_delete_member(struct chanuser *cu)
+ *
+ * As chanuser_delete(), for a channel user object the caller already has.
+ * If the user is quitting in a netsplit, a channel emptied by this is not
+ * deleted until channel_reap_split() is called.
+ */
+void
+chanuser_delete_member(struct chanuser *cu)
+{
+	struct channel *chan = cu->chan;
+	struct user *user = cu->user;
+	struct hook_channel_joinpart hdata;
+
 	/* this is called BEFORE we remove the user */
 	hdata.cu = cu;
 	hook_call_channel_part(&hdata);
 
+	burst_forget_chanuser(cu);
+
 	slog(LG_DEBUG, "chanuser_delete(): %s -> %s (%u)", cu->chan->name, cu->user->nick, cu->chan->nummembers - 1);
 
 	mowgli_node_delete(&cu->cnode, &chan->members);
 	mowgli_node_delete(&cu->unode, &user->channels);
 
-	mowgli_heap_free(chanuser_heap, cu);
-
 	chan->nummembers--;
 	cnt.chanuser--;
 
+	chanuser_hash_remove(chan, cu);
+	named_heap_free_deferred(chanuser_heap, cu);
+
 	if (is_internal_client(user))
+	{
 		chan->numsvcmembers--;
+		chan->fantasy_gen = 0;
+	}
 
 	if (chan->nummembers == 0 && !(chan->modes & ircd->perm_mode))
 	{
+		if (user->flags & UF_NETSPLIT)
+		{
+			if (!(chan->flags & CHAN_SPLITEMPTY))
+			{
+				chan->flags |= CHAN_SPLITEMPTY;
+				mowgli_node_add(chan, &chan->splitnode, &split_emptied);
+			}
+
+			return;
+		}
+
 		/* empty channels die */
 		slog(LG_DEBUG, "chanuser_delete(): `%s' is empty, removing", chan->name);
 
@@ -471,6 +898,151 @@ chanuser_delete(struct channel *chan, struct user *user)
 	}
 }
 
+/*
+ * channel_reap_split()
+ *
+ * Deletes the channels that were emptied by a netsplit, in one pass once
+ * all of the split users are gone, skipping any that were rejoined (e.g.
+ * by a service) in the meantime.
+ *
+ * Inputs:
+ *     - none
+ *
+ * Outputs:
+ *     - nothing
+ *
+ * Side Effects:
+ *     - channel_delete() is called (q.v.) for each channel still empty
+ */
+void
+channel_reap_split(void)
+{
+	mowgli_node_t *n, *tn;
+	unsigned int reaped = 0;
+
+	MOWGLI_ITER_FOREACH_SAFE(n, tn, split_emptied.head)
+	{
+		struct channel *chan = n->data;
+
+		mowgli_node_delete(&chan->splitnode, &split_emptied);
+		chan->flags &= ~CHAN_SPLITEMPTY;
+
+		if (chan->nummembers == 0 && !(chan->modes & ircd->perm_mode))
+		{
+			channel_delete(chan);
+			reaped++;
+		}
+	}
+
+	if (reaped)
+		slog(LG_DEBUG, "channel_reap_split(): removed %u empty channels", reaped);
+}
+
+/*
+ * channel_mark_stale(void (*rejoin)(struct channel *, struct user *))
+ *
+ * Marks every channel membership as left over from a lost uplink
+ * connection. Services' own memberships are dropped instead, without
+ * calling any hooks, so that they can join again once the new burst is
+ * over; rejoin is called for each of them first.
+ *
+ * Inputs:
+ *     - function to call for each membership of a service
+ *
+ * Outputs:
+ *     - nothing
+ *
+ * Side Effects:
+ *     - channels only services were on are deleted
+ *     - memberships the new burst has again are kept, the others are
+ *       deleted by chanuser_purge_stale()
+ */
+void
+channel_mark_stale(void (*rejoin)(struct channel *, struct user *))
+{
+	struct channel *c;
+	mowgli_patricia_iteration_state_t state;
+	mowgli_node_t *n, *tn;
+
+	MOWGLI_PATRICIA_FOREACH(c, &state, chanlist)
+	{
+		MOWGLI_ITER_FOREACH_SAFE(n, tn, c->members.head)
+		{
+			struct chanuser *const cu = n->data;
+
+			if (!is_internal_client(cu->user))
+			{
+				cu->stale = true;
+				continue;
+			}
+
+			rejoin(c, cu->user);
+
+			burst_forget_chanuser(cu);
+			mowgli_node_delete(&cu->cnode, &c->members);
+			mowgli_node_delete(&cu->unode, &cu->user->channels);
+			chanuser_hash_remove(c, cu);
+			named_heap_free(chanuser_heap, cu);
+
+			c->nummembers--;
+			c->numsvcmembers--;
+			c->fantasy_gen = 0;
+			cnt.chanuser--;
+		}
+
+		if (c->nummembers == 0)
+			channel_delete(c);
+	}
+}
+
+/*
+ * chanuser_purge_stale()
+ *
+ * Deletes the memberships marked by channel_mark_stale() that the new
+ * burst did not have again.
+ *
+ * Inputs:
+ *     - nothing
+ *
+ * Outputs:
+ *     - the number of memberships deleted
+ *
+ * Side Effects:
+ *     - as chanuser_delete_member(); channels that are left empty die
+ */
+unsigned int
+chanuser_purge_stale(void)
+{
+	struct channel *c;
+	mowgli_patricia_iteration_state_t state;
+	mowgli_node_t *n, *tn;
+	unsigned int count = 0;
+
+	MOWGLI_PATRICIA_FOREACH(c, &state, chanlist)
+	{
+		MOWGLI_ITER_FOREACH_SAFE(n, tn, c->members.head)
+		{
+			struct chanuser *const cu = n->data;
+
+			if (!cu->stale)
+				continue;
+
+			count++;
+
+			// the last member going takes the channel with it
+			if (c->nummembers == 1)
+			{
+				chanuser_delete_member(cu);
+				break;
+			}
+
+			chanuser_delete_member(cu);
+		}
+	}
+
+	return count;
+}
+
 /*
  * chanuser_find(struct channel *chan, struct user *user)
  *
@@ -496,6 +1068,9 @@ chanuser_find(struct channel *chan, struct user *user)
 	return_val_if_fail(chan != NULL, NULL);
 	return_val_if_fail(user != NULL, NULL);
 
+	if (chan->memberhash != NULL)
+		return chanuser_hash_find(chan, user);
+
 	/* choose shortest list to search -- jilles */
 	if (MOWGLI_LIST_LENGTH(&user->channels) < MOWGLI_LIST_LENGTH(&chan->members))
 	{
@@ -521,6 +1096,100 @@ chanuser_find(struct channel *chan, struct user *user)
 	return NULL;
 }
 
+/*
+ * Which channel messages are worth handing to the services on a channel is
+ * kept as a bitmap of the first bytes they may act on: the fantasy prefix,
+ * the first letter of each service's nick (for "ChanServ: op") and \001
+ * (for CTCP). It is worked out again when a service joins or parts, and
+ * for every channel when the configuration is reloaded or a channel's
+ * prefix or fantasy setting changes, so that ordinary chatter only costs
+ * one lookup.
+ */
+static unsigned int fantasy_generation = 1;
+
+static inline void
+fantasy_first_set(struct channel *c, unsigned char ch)
+{
+	c->fantasy_first[ch / 8] |= (uint8_t) (1U << (ch % 8));
+}
+
+static void
+channel_fantasy_compute(struct channel *c)
+{
+	struct mychan *mc;
+	const struct metadata *md;
+	const char *p;
+	mowgli_node_t *n;
+
+	(void) memset(c->fantasy_first, 0, sizeof c->fantasy_first);
+	c->fantasy_gen = fantasy_generation;
+
+	if (!c->numsvcmembers)
+		return;
+
+	// ChanServ and BotServ ignore unregistered channels and those with fantasy off
+	if (c->name[0] == '#')
+	{
+		if (!chansvs.fantasy || (mc = c->mychan) == NULL || metadata_find(mc, "disable_fantasy"))
+			return;
+
+		md = metadata_find(mc, "private:prefix");
+		for (p = (md != NULL) ? md->value : chansvs.trigger; p != NULL && *p != '\0'; p++)
+			fantasy_first_set(c, (unsigned char) *p);
+	}
+	else
+	{
+		// anything may be a command there
+		(void) memset(c->fantasy_first, 0xFF, sizeof c->fantasy_first);
+		return;
+	}
+
+	fantasy_first_set(c, '\001');
+
+	MOWGLI_ITER_FOREACH(n, c->members.head)
+	{
+		const struct chanuser *const cu = n->data;
+
+		if (!is_internal_client(cu->user) || cu->user->nick[0] == '\0')
+			continue;
+
+		fantasy_first_set(c, (unsigned char) ToLower(cu->user->nick[0]));
+		fantasy_first_set(c, (unsigned char) ToUpper(cu->user->nick[0]));
+	}
+}
+
+/*
+ * channel_fantasy_invalidate()
+ *
+ * Has the bitmap of interesting first bytes worked out again for c, or for
+ * every channel if c is NULL.
+ */
+void
+channel_fantasy_invalidate(struct channel *c)
+{
+	if (c != NULL)
+		c->fantasy_gen = 0;
+	else if (++fantasy_generation == 0)
+		fantasy_generation = 1;
+}
+
+/*
+ * channel_fantasy_candidate()
+ *
+ * Whether a message to c might be a command for one of the services on it;
+ * if not, it need not be given to them at all.
+ */
+bool
+channel_fantasy_candidate(struct channel *c, const char *message)
+{
+	const unsigned char ch = (unsigned char) message[0];
+
+	if (c->fantasy_gen != fantasy_generation)
+		channel_fantasy_compute(c);
+
+	return c->fantasy_first[ch / 8] & (1U << (ch % 8));
+}
+
 /* vim:cinoptions=>s,e0,n0,f0,{0,}0,^0,=s,ps,t0,c3,+s,(2s,us,)20,*30,gs,hs
  * vim:ts=8
  * vim:sw=8
@@ -35,13 +35,13 @@
 /* compares the first 'mask' bits
  * returns 1 if equal, 0 if not */
 static int
-comp_with_mask(void *addr, void *dest, unsigned int mask)
+comp_with_mask(const void *addr, const void *dest, unsigned int mask)
 {
 	if (memcmp(addr, dest, mask / 8) == 0)
 	{
 		int n = mask / 8;
 		int m = ((-1) << (8 - (mask % 8)));
-		if (mask % 8 == 0 || (((unsigned char *) addr)[n] & m) == (((unsigned char *) dest)[n] & m))
+		if (mask % 8 == 0 || (((const unsigned char *) addr)[n] & m) == (((const unsigned char *) dest)[n] & m))
 		{
 			return (1);
 		}
@@ -394,6 +394,426 @@ valid_ip_or_mask(const char *src)
 		return inet_pton4(ipaddr, buf);
 }
 
+/*
+ * cidr_parse_mask()
+ *
+ * Parses an "address/length" mask the same way match_ips() does, so that
+ * anything accepted here matches exactly the addresses match_ips() would.
+ * Masks match_ips() can never match (or would treat oddly) are rejected.
+ */
+bool
+cidr_parse_mask(const char *mask, struct cidr_addr *ca)
+{
+	char ipmask[BUFSIZE];
+	char *len;
+	int cidrlen;
+
+	return_val_if_fail(mask != NULL, false);
+	return_val_if_fail(ca != NULL, false);
+
+	(void) memset(ca, 0x00, sizeof *ca);
+
+	if (mowgli_strlcpy(ipmask, mask, sizeof ipmask) >= sizeof ipmask)
+		return false;
+
+	if ((len = strrchr(ipmask, '/')) == NULL)
+		return false;
+
+	*len++ = '\0';
+
+	cidrlen = atoi(len);
+	if (cidrlen <= 0)
+		return false;
+
+	if (strchr(ipmask, ':'))
+	{
+		if (cidrlen > 128 || !inet_pton6(ipmask, ca->addr))
+			return false;
+
+		ca->family = AF_INET6;
+	}
+	else
+	{
+		if (cidrlen > 32 || !inet_pton4(ipmask, ca->addr))
+			return false;
+
+		ca->family = AF_INET;
+	}
+
+	ca->prefixlen = (unsigned int) cidrlen;
+	return true;
+}
+
+/*
+ * cidr_parse_address()
+ *
+ * Parses a plain IPv4 or IPv6 address into a host-length prefix.
+ */
+bool
+cidr_parse_address(const char *address, struct cidr_addr *ca)
+{
+	char ip[HOSTLEN + 1];
+
+	return_val_if_fail(address != NULL, false);
+	return_val_if_fail(ca != NULL, false);
+
+	(void) memset(ca, 0x00, sizeof *ca);
+	mowgli_strlcpy(ip, address, sizeof ip);
+
+	if (strchr(ip, ':'))
+	{
+		if (!inet_pton6(ip, ca->addr))
+			return false;
+
+		ca->family = AF_INET6;
+		ca->prefixlen = 128;
+	}
+	else
+	{
+		if (!inet_pton4(ip, ca->addr))
+			return false;
+
+		ca->family = AF_INET;
+		ca->prefixlen = 32;
+	}
+
+	return true;
+}
+
+/*
+ * cidr_contains()
+ *
+ * Whether the address (or the whole of the shorter prefix) addr falls
+ * within the network net, both as parsed above.
+ */
+bool
+cidr_contains(const struct cidr_addr *net, const struct cidr_addr *addr)
+{
+	return_val_if_fail(net != NULL, false);
+	return_val_if_fail(addr != NULL, false);
+
+	if (net->family != addr->family || addr->prefixlen < net->prefixlen)
+		return false;
+
+	return comp_with_mask(addr->addr, net->addr, net->prefixlen) != 0;
+}
+
+/*
+ * match_cidr_parsed()
+ *
+ * match_cidr() for a mask n!u@i/c and address n!u@i whose host parts were
+ * already parsed into net and addr (family 0 if they could not be); only
+ * the n!u parts are still glob-matched, and only if the addresses match.
+ * Output - 0 = Matched 1 = Did not match
+ */
+int
+match_cidr_parsed(const char *mask, const struct cidr_addr *net, const char *address, const struct cidr_addr *addr)
+{
+	char maskbuf[BUFSIZE];
+	char addressbuf[NICKLEN + USERLEN + HOSTLEN + 9];
+	char *p;
+
+	return_val_if_fail(mask != NULL, 1);
+	return_val_if_fail(net != NULL, 1);
+	return_val_if_fail(address != NULL, 1);
+	return_val_if_fail(addr != NULL, 1);
+
+	if (net->family == 0 || !cidr_contains(net, addr))
+		return 1;
+
+	mowgli_strlcpy(maskbuf, mask, sizeof maskbuf);
+	mowgli_strlcpy(addressbuf, address, sizeof addressbuf);
+
+	if ((p = strrchr(maskbuf, '@')) == NULL)
+		return 1;
+	*p = '\0';
+
+	if ((p = strrchr(addressbuf, '@')) == NULL)
+		return 1;
+	*p = '\0';
+
+	return match(maskbuf, addressbuf);
+}
+
+/*
+ * cidr_parse_hostmask()
+ *
+ * Parses the host part of an n!u@i/c mask as cidr_parse_mask() does.
+ */
+bool
+cidr_parse_hostmask(const char *mask, struct cidr_addr *ca)
+{
+	const char *p;
+
+	return_val_if_fail(mask != NULL, false);
+	return_val_if_fail(ca != NULL, false);
+
+	if ((p = strrchr(mask, '@')) == NULL)
+	{
+		(void) memset(ca, 0x00, sizeof *ca);
+		return false;
+	}
+
+	return cidr_parse_mask(p + 1, ca);
+}
+
+/*
+ * A path-compressed binary radix tree keyed on address prefixes, with one
+ * root per address family. Every node carries the list of entries added
+ * with exactly its prefix; nodes with an empty list are glue nodes that only
+ * exist to join two subtrees, and always have both children.
+ */
+
+#define CIDR_BIT_TEST(addr, bit)	((addr)[(bit) >> 3] & (0x80U >> ((bit) & 0x07U)))
+
+static struct named_heap *cidr_tree_node_heap = NULL;
+
+static inline struct cidr_tree_node **
+cidr_tree_root(struct cidr_tree *const tree, const int family)
+{
+	return (family == AF_INET6) ? &tree->root6 : &tree->root4;
+}
+
+static inline unsigned int
+cidr_tree_maxbits(const int family)
+{
+	return (family == AF_INET6) ? 128U : 32U;
+}
+
+static inline struct cidr_tree_node **
+cidr_tree_link(struct cidr_tree *const tree, const int family, struct cidr_tree_node *const node)
+{
+	struct cidr_tree_node *const parent = node->parent;
+
+	if (parent == NULL)
+		return cidr_tree_root(tree, family);
+
+	return (parent->child[1] == node) ? &parent->child[1] : &parent->child[0];
+}
+
+static struct cidr_tree_node *
+cidr_tree_node_create(const int family, const unsigned char *const addr, const unsigned int bitlen)
+{
+	struct cidr_tree_node *const node = named_heap_alloc(cidr_tree_node_heap);
+
+	(void) memset(node, 0x00, sizeof *node);
+	(void) memcpy(node->prefix, addr, sizeof node->prefix);
+	node->family = family;
+	node->bitlen = bitlen;
+
+	return node;
+}
+
+struct cidr_tree *
+cidr_tree_create(void)
+{
+	if (cidr_tree_node_heap == NULL)
+		cidr_tree_node_heap = named_heap_get("cidr_tree_node", sizeof(struct cidr_tree_node));
+
+	return smalloc(sizeof(struct cidr_tree));
+}
+
+static void
+cidr_tree_node_destroy_recursive(struct cidr_tree_node *const node)
+{
+	if (node == NULL)
+		return;
+
+	cidr_tree_node_destroy_recursive(node->child[0]);
+	cidr_tree_node_destroy_recursive(node->child[1]);
+
+	named_heap_free(cidr_tree_node_heap, node);
+}
+
+/* entries are not touched; the caller owns them and their list nodes */
+void
+cidr_tree_destroy(struct cidr_tree *tree)
+{
+	return_if_fail(tree != NULL);
+
+	cidr_tree_node_destroy_recursive(tree->root4);
+	cidr_tree_node_destroy_recursive(tree->root6);
+
+	sfree(tree);
+}
+
+struct cidr_tree_node *
+cidr_tree_add(struct cidr_tree *tree, const struct cidr_addr *ca, void *data, mowgli_node_t *n)
+{
+	struct cidr_tree_node **const root = cidr_tree_root(tree, ca->family);
+	const unsigned int maxbits = cidr_tree_maxbits(ca->family);
+	const unsigned int bitlen = ca->prefixlen;
+	struct cidr_tree_node *node, *new_node;
+	unsigned int check_bit, differ_bit;
+
+	return_val_if_fail(bitlen > 0 && bitlen <= maxbits, NULL);
+
+	if (*root == NULL)
+	{
+		*root = cidr_tree_node_create(ca->family, ca->addr, bitlen);
+		mowgli_node_add(data, n, &(*root)->entries);
+		return *root;
+	}
+
+	// Descend to the closest existing node that carries a real prefix
+	node = *root;
+	while (node->bitlen < bitlen || ! MOWGLI_LIST_LENGTH(&node->entries))
+	{
+		struct cidr_tree_node *const next = (node->bitlen < maxbits && CIDR_BIT_TEST(ca->addr, node->bitlen)) ?
+		                                    node->child[1] : node->child[0];
+		if (next == NULL)
+			break;
+
+		node = next;
+	}
+
+	// Find the first bit where the new prefix and that node's prefix differ
+	check_bit = (node->bitlen < bitlen) ? node->bitlen : bitlen;
+	for (differ_bit = 0; differ_bit < check_bit; differ_bit++)
+		if (CIDR_BIT_TEST(ca->addr, differ_bit) != CIDR_BIT_TEST(node->prefix, differ_bit))
+			break;
+
+	// Climb back up to where the new prefix branches off
+	while (node->parent != NULL && node->parent->bitlen >= differ_bit)
+		node = node->parent;
+
+	if (differ_bit == bitlen && node->bitlen == bitlen)
+	{
+		// Exact prefix already has a node (possibly glue); just append to it
+		if (! MOWGLI_LIST_LENGTH(&node->entries))
+			(void) memcpy(node->prefix, ca->addr, sizeof node->prefix);
+
+		mowgli_node_add(data, n, &node->entries);
+		return node;
+	}
+
+	new_node = cidr_tree_node_create(ca->family, ca->addr, bitlen);
+	mowgli_node_add(data, n, &new_node->entries);
+
+	if (node->bitlen == differ_bit)
+	{
+		// New node hangs directly below this one
+		new_node->parent = node;
+
+		if (node->bitlen < maxbits && CIDR_BIT_TEST(ca->addr, node->bitlen))
+			node->child[1] = new_node;
+		else
+			node->child[0] = new_node;
+
+		return new_node;
+	}
+
+	if (bitlen == differ_bit)
+	{
+		// New node becomes the parent of this one
+		if (bitlen < maxbits && CIDR_BIT_TEST(node->prefix, bitlen))
+			new_node->child[1] = node;
+		else
+			new_node->child[0] = node;
+
+		new_node->parent = node->parent;
+		*cidr_tree_link(tree, ca->family, node) = new_node;
+		node->parent = new_node;
+	}
+	else
+	{
+		// The two prefixes diverge below a common ancestor; join them with glue
+		struct cidr_tree_node *const glue = cidr_tree_node_create(ca->family, ca->addr, differ_bit);
+
+		if (differ_bit < maxbits && CIDR_BIT_TEST(ca->addr, differ_bit))
+		{
+			glue->child[1] = new_node;
+			glue->child[0] = node;
+		}
+		else
+		{
+			glue->child[1] = node;
+			glue->child[0] = new_node;
+		}
+
+		glue->parent = node->parent;
+		new_node->parent = glue;
+		*cidr_tree_link(tree, ca->family, node) = glue;
+		node->parent = glue;
+	}
+
+	return new_node;
+}
+
+void
+cidr_tree_delete(struct cidr_tree *tree, struct cidr_tree_node *node, mowgli_node_t *n)
+{
+	struct cidr_tree_node *parent, *child;
+
+	return_if_fail(tree != NULL);
+	return_if_fail(node != NULL);
+
+	mowgli_node_delete(n, &node->entries);
+
+	if (MOWGLI_LIST_LENGTH(&node->entries))
+		return;
+
+	// Nodes with two children stay around as glue
+	if (node->child[0] != NULL && node->child[1] != NULL)
+		return;
+
+	parent = node->parent;
+	child = (node->child[0] != NULL) ? node->child[0] : node->child[1];
+
+	if (child != NULL)
+	{
+		child->parent = parent;
+		*cidr_tree_link(tree, node->family, node) = child;
+		named_heap_free(cidr_tree_node_heap, node);
+		return;
+	}
+
+	*cidr_tree_link(tree, node->family, node) = NULL;
+	named_heap_free(cidr_tree_node_heap, node);
+
+	// A glue parent left with a single child is no longer needed
+	if (parent == NULL || MOWGLI_LIST_LENGTH(&parent->entries))
+		return;
+
+	child = (parent->child[0] != NULL) ? parent->child[0] : parent->child[1];
+	child->parent = parent->parent;
+	*cidr_tree_link(tree, parent->family, parent) = child;
+	named_heap_free(cidr_tree_node_heap, parent);
+}
+
+/*
+ * cidr_tree_foreach_match()
+ *
+ * Calls `cb' with the entry list of every prefix in the tree that covers
+ * `ca', from the shortest prefix to the longest.
+ */
+void
+cidr_tree_foreach_match(struct cidr_tree *tree, const struct cidr_addr *ca, void (*cb)(mowgli_list_t *entries, void *privdata), void *privdata)
+{
+	const unsigned int maxbits = cidr_tree_maxbits(ca->family);
+	struct cidr_tree_node *node;
+
+	return_if_fail(tree != NULL);
+	return_if_fail(ca != NULL);
+
+	node = *cidr_tree_root(tree, ca->family);
+
+	while (node != NULL && node->bitlen <= ca->prefixlen)
+	{
+		// Nothing below a non-covering prefix can cover the address either
+		if (! comp_with_mask(node->prefix, ca->addr, node->bitlen))
+			break;
+
+		if (MOWGLI_LIST_LENGTH(&node->entries))
+			cb(&node->entries, privdata);
+
+		if (node->bitlen == maxbits)
+			break;
+
+		node = CIDR_BIT_TEST(ca->addr, node->bitlen) ? node->child[1] : node->child[0];
+	}
+}
+
 /* vim:cinoptions=>s,e0,n0,f0,{0,}0,^0,=s,ps,t0,c3,+s,(2s,us,)20,*30,gs,hs
  * vim:ts=8
  * vim:sw=8
@@ -0,0 +1,484 @@
+/*
+ * SPDX-License-Identifier: ISC
+ * SPDX-URL: https://spdx.org/licenses/ISC.html
+ *
+ * Copyright (C) 2026 Atheme Development Group (https://atheme.github.io/)
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * atheme-services: A collection of minimalist IRC services
+ * cmdqueue.c: Fair scheduling of commands sent to services.
+ *
+ * Messages from IRC users to services are handled as they arrive until the
+ * commands run in the current pass of the event loop have taken
+ * general::command_budget milliseconds. After that they are queued per user
+ * and run in later passes, one user's next message at a time in turn, so
+ * that nobody's heavy commands hold everyone else up for long. Of the users
+ * waiting, those whose next command authenticates them (IDENTIFY, ...) go
+ * first and those whose next command is a query (LIST, ...) go last; an
+ * authentication command does not even wait if it is the user's only one.
+ * A user's own messages always run in the order they were sent.
+ *
+ * Commands that may take long can also run in slices, giving way whenever
+ * the budget is spent and carrying on in the next pass (see
+ * command_run_sliced()).
+ */
+
+#include <atheme.h>
+#include "internal.h"
+
+// A message to a service, waiting for its turn
+struct command_queue_entry
+{
+	mowgli_node_t               node;
+	enum command_sched_class    sched_class;
+	struct timeval              queued;
+	char *                      service;    // internal name
+	char *                      target;
+	char                        message[];
+};
+
+// A user's waiting messages
+struct command_queue
+{
+	mowgli_node_t               node;       // in command_queue_ready[] by the class of the first entry
+	struct user *               u;
+	mowgli_list_t               entries;
+	enum command_sched_class    listed;
+};
+
+// A command running in slices, between two of them
+struct command_slice
+{
+	mowgli_node_t               node;
+	mowgli_list_t *             list;       // command_slices, or the ones being run now
+	struct command_pending *    cp;
+	command_slice_fn            fn;
+	command_cancel_fn           cancel;
+	void *                      priv;
+};
+
+// In the order they get their turn
+static const enum command_sched_class command_sched_order[] = {
+	CMD_SCHED_AUTH,
+	CMD_SCHED_NORMAL,
+	CMD_SCHED_QUERY,
+};
+
+static mowgli_list_t command_queue_ready[CMD_SCHED_CLASSES];
+static mowgli_list_t command_slices;
+
+static mowgli_eventloop_timer_t *command_pass_timer = NULL;
+
+// Time taken by commands since the start of this pass, and when the running one started
+static unsigned long long command_pass_us = 0;
+static struct timeval command_run_started;
+static bool command_running = false;
+static bool command_slicing = false;
+
+static struct command_queue_stats command_queue_stats;
+
+static unsigned long long
+command_elapsed_us(const struct timeval *const restrict started)
+{
+	struct timeval elapsed;
+
+	(void) e_time(*started, &elapsed);
+
+	return (((unsigned long long) elapsed.tv_sec) * 1000000ULL) + (unsigned long long) elapsed.tv_usec;
+}
+
+static bool
+command_budget_spent(void)
+{
+	if (! config_options.command_budget)
+		return false;
+
+	unsigned long long used = command_pass_us;
+
+	if (command_running)
+		used += command_elapsed_us(&command_run_started);
+
+	return used >= config_options.command_budget * 1000ULL;
+}
+
+static void command_pass_end(void *);
+
+static void
+command_pass_schedule(const unsigned int delay)
+{
+	if (command_pass_timer == NULL)
+		command_pass_timer = timer_add_once("command_pass_end", &command_pass_end, NULL, delay);
+}
+
+static void
+command_run_begin(void)
+{
+	(void) s_time(&command_run_started);
+
+	command_running = true;
+}
+
+static void
+command_run_end(void)
+{
+	command_pass_us += command_elapsed_us(&command_run_started);
+	command_running = false;
+
+	if (command_pass_us >= config_options.command_budget * 1000ULL && config_options.command_budget)
+		command_queue_stats.passes_over++;
+
+	// Something has used up some of this pass's budget, which is given back at the start of the next
+	(void) command_pass_schedule(0);
+}
+
+static enum command_sched_class
+command_sched_class_of(struct service *const restrict svs, const char *const restrict message)
+{
+	char name[BUFSIZE];
+	size_t len = strcspn(message, " ");
+
+	if (! len || message[0] == '\001' || len >= sizeof name)
+		return CMD_SCHED_NORMAL;
+
+	(void) memcpy(name, message, len);
+	name[len] = '\0';
+
+	// Without loading anything on demand; a command that is still a stub is just normal
+	const char *const resolved = service_resolve_alias(svs, NULL, name);
+	const struct command *const c = mowgli_patricia_retrieve(svs->commands, resolved);
+
+	return c ? c->sched_class : CMD_SCHED_NORMAL;
+}
+
+static void
+command_queue_relist(struct command_queue *const restrict q)
+{
+	(void) mowgli_node_delete(&q->node, &command_queue_ready[q->listed]);
+
+	if (! q->entries.head)
+	{
+		q->u->cold->cmdq = NULL;
+		(void) sfree(q);
+		return;
+	}
+
+	const struct command_queue_entry *const e = q->entries.head->data;
+
+	q->listed = e->sched_class;
+
+	(void) mowgli_node_add(q, &q->node, &command_queue_ready[q->listed]);
+}
+
+static void
+command_deliver(struct sourceinfo *const restrict si, char *const restrict target, char *const restrict message)
+{
+	char *vec[3];
+
+	vec[0] = target;
+	vec[1] = message;
+	vec[2] = NULL;
+
+	(void) command_run_begin();
+	(void) si->service->handler(si, 2, vec);
+	(void) command_run_end();
+}
+
+/*
+ * command_queue_dispatch()
+ *
+ * Hands a (non-notice) message from an IRC user to the service that it was
+ * sent to, now or once it is the user's turn.
+ */
+void
+command_queue_dispatch(struct sourceinfo *const restrict si, char *const restrict target, char *const restrict message)
+{
+	struct command_queue *q = si->su->cold->cmdq;
+
+	if (! q && ! command_budget_spent())
+	{
+		(void) command_deliver(si, target, message);
+		return;
+	}
+
+	const enum command_sched_class sched_class = command_sched_class_of(si->service, message);
+
+	if (! q && sched_class == CMD_SCHED_AUTH)
+	{
+		(void) command_deliver(si, target, message);
+		return;
+	}
+
+	const size_t len = strlen(message) + 1;
+	struct command_queue_entry *const e = smalloc(sizeof *e + len);
+
+	e->sched_class = sched_class;
+	e->service = sstrdup(si->service->internal_name);
+	e->target = sstrdup(target);
+	(void) memcpy(e->message, message, len);
+	(void) s_time(&e->queued);
+
+	if (! q)
+	{
+		q = smalloc(sizeof *q);
+		q->u = si->su;
+		q->listed = sched_class;
+
+		si->su->cold->cmdq = q;
+
+		(void) mowgli_node_add(q, &q->node, &command_queue_ready[q->listed]);
+	}
+
+	(void) mowgli_node_add(e, &e->node, &q->entries);
+
+	command_queue_stats.deferred++;
+	command_queue_stats.waiting++;
+
+	(void) command_pass_schedule(0);
+}
+
+static void
+command_queue_entry_free(struct command_queue_entry *const restrict e)
+{
+	(void) sfree(e->service);
+	(void) sfree(e->target);
+	(void) sfree(e);
+}
+
+// Runs the next message of the first user waiting in the highest class; false if there are none
+static bool
+command_queue_run_one(void)
+{
+	struct command_queue *q = NULL;
+
+	for (size_t i = 0; i < ARRAY_SIZE(command_sched_order) && ! q; i++)
+		if (command_queue_ready[command_sched_order[i]].head)
+			q = command_queue_ready[command_sched_order[i]].head->data;
+
+	if (! q)
+		return false;
+
+	struct command_queue_entry *const e = q->entries.head->data;
+	struct user *const u = q->u;
+
+	(void) mowgli_node_delete(&e->node, &q->entries);
+
+	// To the back of the line (of its next entry's class), or gone if that was its last
+	(void) command_queue_relist(q);
+
+	command_queue_stats.waiting--;
+
+	const unsigned long long waited = command_elapsed_us(&e->queued);
+
+	if (waited > command_queue_stats.max_wait_us)
+		command_queue_stats.max_wait_us = waited;
+
+	// It may have gone away since (e.g. its module was unloaded), in which case the message is dropped
+	struct service *const svs = service_find(e->service);
+
+	if (svs && svs->handler)
+	{
+		struct sourceinfo *const si = sourceinfo_create();
+
+		si->connection = curr_uplink->conn;
+		si->output_limit = MAX_IRC_OUTPUT_LINES;
+		si->su = u;
+		si->smu = u->myuser;
+		si->service = svs;
+
+		(void) command_deliver(si, e->target, e->message);
+		(void) atheme_object_unref(si);
+	}
+
+	(void) command_queue_entry_free(e);
+
+	return true;
+}
+
+// Carries on with every command running in slices; those that are not done yet go on in the next pass
+static void
+command_slices_run(void)
+{
+	mowgli_list_t running = { NULL, NULL, 0 };
+	mowgli_node_t *n, *tn;
+
+	MOWGLI_ITER_FOREACH_SAFE(n, tn, command_slices.head)
+	{
+		struct command_slice *const cs = n->data;
+
+		(void) mowgli_node_move(&cs->node, &command_slices, &running);
+		cs->list = &running;
+	}
+
+	// One slice may cancel others (e.g. by killing their user), taking them off whichever list they are on
+	while ((n = running.head) != NULL)
+	{
+		struct command_slice *const cs = n->data;
+		struct sourceinfo *const si = command_resume(cs->cp);
+
+		(void) mowgli_node_delete(&cs->node, &running);
+		cs->list = NULL;
+
+		if (! si)
+		{
+			(void) cs->cancel(cs->priv);
+			(void) command_finish(cs->cp);
+			(void) sfree(cs);
+			continue;
+		}
+
+		(void) mowgli_node_add(cs, &cs->node, &command_slices);
+		cs->list = &command_slices;
+
+		command_slicing = true;
+		(void) command_run_begin();
+
+		const bool done = cs->fn(si, cs->priv);
+
+		(void) command_run_end();
+		command_slicing = false;
+
+		if (done)
+		{
+			(void) mowgli_node_delete(&cs->node, &command_slices);
+			(void) command_finish(cs->cp);
+			(void) sfree(cs);
+		}
+		else
+			(void) command_yield(cs->cp);
+	}
+}
+
+static void
+command_pass_end(void ATHEME_VATTR_UNUSED *const restrict unused)
+{
+	command_pass_timer = NULL;
+	command_pass_us = 0;
+
+	// No uplink to answer on; wait for one rather than spinning
+	if ((command_queue_stats.waiting || command_slices.head) && (! curr_uplink || ! curr_uplink->conn))
+	{
+		(void) command_pass_schedule(1);
+		return;
+	}
+
+	(void) command_slices_run();
+
+	while (! command_budget_spent() && command_queue_run_one())
+		;
+
+	if (command_queue_stats.waiting || command_slices.head)
+		(void) command_pass_schedule(0);
+}
+
+// Called by user_delete(); whatever the user still had queued is forgotten
+void
+command_queue_forget_user(struct user *const restrict u)
+{
+	struct command_queue *const q = u->cold->cmdq;
+	mowgli_node_t *n;
+
+	if (! q)
+		return;
+
+	while ((n = q->entries.head) != NULL)
+	{
+		struct command_queue_entry *const e = n->data;
+
+		(void) mowgli_node_delete(&e->node, &q->entries);
+		(void) command_queue_entry_free(e);
+
+		command_queue_stats.waiting--;
+		command_queue_stats.dropped++;
+	}
+
+	(void) command_queue_relist(q);
+}
+
+// The cancel function of a sliced command waiting for its next slice
+static void
+command_slice_cancel(void *const restrict priv)
+{
+	struct command_slice *const cs = priv;
+
+	(void) mowgli_node_delete(&cs->node, cs->list);
+	(void) cs->cancel(cs->priv);
+	(void) sfree(cs);
+}
+
+/*
+ * command_slice_expired()
+ *
+ * Whether a command running in slices (see command_run_sliced()) should
+ * give way now. Always false for commands running in one go.
+ */
+bool
+command_slice_expired(void)
+{
+	return command_slicing && command_budget_spent();
+}
+
+/*
+ * command_run_sliced()
+ *
+ * Runs fn(si, priv) until it returns true, which it does once it is done
+ * (having freed priv). Whenever command_slice_expired() it should return
+ * false instead, after doing at least some of its work; the command is
+ * then suspended, and fn is called again in a later pass of the event loop.
+ * If the user goes away in the meantime, cancel(priv) is called instead.
+ *
+ * Sources other than IRC users need their answer in the reply, so for them
+ * it is all done at once.
+ */
+void
+command_run_sliced(struct sourceinfo *const restrict si, const command_slice_fn fn, const command_cancel_fn cancel,
+                   void *const restrict priv)
+{
+	return_if_fail(si != NULL);
+	return_if_fail(fn != NULL);
+	return_if_fail(cancel != NULL);
+
+	if (si->su == NULL || ! config_options.command_budget)
+	{
+		while (! fn(si, priv))
+			;
+
+		return;
+	}
+
+	const bool was_slicing = command_slicing;
+
+	command_slicing = true;
+
+	const bool done = fn(si, priv);
+
+	command_slicing = was_slicing;
+
+	if (done)
+		return;
+
+	struct command_slice *const cs = smalloc(sizeof *cs);
+
+	cs->fn = fn;
+	cs->cancel = cancel;
+	cs->priv = priv;
+	cs->cp = command_suspend(si, &command_slice_cancel, cs);
+	cs->list = &command_slices;
+
+	(void) mowgli_node_add(cs, &cs->node, &command_slices);
+
+	command_queue_stats.sliced++;
+
+	(void) command_pass_schedule(0);
+}
+
+void
+command_queue_get_stats(struct command_queue_stats *const restrict stats)
+{
+	return_if_fail(stats != NULL);
+
+	*stats = command_queue_stats;
+	stats->slices_running = (unsigned int) MOWGLI_LIST_LENGTH(&command_slices);
+}
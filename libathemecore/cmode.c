@@ -33,15 +33,105 @@ flags_to_string(unsigned int flags)
 	return buf;
 }
 
+/*
+ * What each mode character means to the protocol module in use, so that
+ * channel_mode() need not search every mode list for every character.
+ * It is rebuilt whenever the mode lists or the ircd are not the ones it
+ * was built from, which in practice is once, when the protocol module is
+ * loaded. Where a character appears in more than one list, the kind
+ * channel_mode() used to try first wins.
+ */
+enum cmode_kind
+{
+	CMODE_KIND_NONE         = 0,
+	CMODE_KIND_SIMPLE,                      // mode_list[index]
+	CMODE_KIND_EXT,                         // ignore_mode_list[index]; parameter when set
+	CMODE_KIND_LIMIT,                       // parameter when set
+	CMODE_KIND_KEY,                         // parameter when set, and eaten when unset
+	CMODE_KIND_BANLIKE,                     // parameter always
+	CMODE_KIND_STATUS,                      // status_mode_list[index]; parameter always
+};
+
+struct cmode_dispatch
+{
+	unsigned char           kind;
+	unsigned char           index;
+};
+
+static struct cmode_dispatch cmode_dispatch_table[256];
+
+static const struct cmode *cmode_dispatch_modes = NULL;
+static const struct extmode *cmode_dispatch_ext = NULL;
+static size_t cmode_dispatch_ext_size = 0;
+static const struct cmode *cmode_dispatch_status = NULL;
+static const struct ircd *cmode_dispatch_ircd = NULL;
+static bool cmode_dispatch_valid = false;
+
+static void
+cmode_dispatch_set(const char c, const enum cmode_kind kind, const size_t index)
+{
+	struct cmode_dispatch *const cd = &cmode_dispatch_table[(unsigned char) c];
+
+	if (c == '\0' || c == '+' || c == '-' || cd->kind != CMODE_KIND_NONE || index > UCHAR_MAX)
+		return;
+
+	cd->kind = (unsigned char) kind;
+	cd->index = (unsigned char) index;
+}
+
+static void
+cmode_dispatch_build(void)
+{
+	(void) memset(cmode_dispatch_table, 0x00, sizeof cmode_dispatch_table);
+
+	if (mode_list)
+		for (size_t i = 0; mode_list[i].mode != '\0'; i++)
+			(void) cmode_dispatch_set(mode_list[i].mode, CMODE_KIND_SIMPLE, i);
+
+	if (ignore_mode_list)
+		for (size_t i = 0; ignore_mode_list[i].mode != '\0'; i++)
+			(void) cmode_dispatch_set(ignore_mode_list[i].mode, CMODE_KIND_EXT, i);
+
+	(void) cmode_dispatch_set('l', CMODE_KIND_LIMIT, 0);
+	(void) cmode_dispatch_set('k', CMODE_KIND_KEY, 0);
+
+	if (ircd && ircd->ban_like_modes)
+		for (const char *p = ircd->ban_like_modes; *p != '\0'; p++)
+			(void) cmode_dispatch_set(*p, CMODE_KIND_BANLIKE, 0);
+
+	if (status_mode_list)
+		for (size_t i = 0; status_mode_list[i].mode != '\0'; i++)
+			(void) cmode_dispatch_set(status_mode_list[i].mode, CMODE_KIND_STATUS, i);
+
+	cmode_dispatch_modes = mode_list;
+	cmode_dispatch_ext = ignore_mode_list;
+	cmode_dispatch_ext_size = ignore_mode_list_size;
+	cmode_dispatch_status = status_mode_list;
+	cmode_dispatch_ircd = ircd;
+	cmode_dispatch_valid = true;
+}
+
+static inline const struct cmode_dispatch *
+cmode_dispatch(const char c)
+{
+	if (! cmode_dispatch_valid || cmode_dispatch_modes != mode_list || cmode_dispatch_ext != ignore_mode_list ||
+	    cmode_dispatch_ext_size != ignore_mode_list_size || cmode_dispatch_status != status_mode_list ||
+	    cmode_dispatch_ircd != ircd)
+		(void) cmode_dispatch_build();
+
+	return &cmode_dispatch_table[(unsigned char) c];
+}
+
 /* convert a mode character to a flag. */
 int
 mode_to_flag(char c)
 {
-	int i;
+	const struct cmode_dispatch *const cd = cmode_dispatch(c);
 
-	for (i = 0; mode_list[i].mode != 0 && mode_list[i].mode != c; i++);
+	if (cd->kind != CMODE_KIND_SIMPLE)
+		return 0;
 
-	return mode_list[i].value;
+	return mode_list[cd->index].value;
 }
 
 static void
@@ -85,7 +175,6 @@ reop_service(struct channel *chan, struct user *victim, struct user **pfirst_deo
 void
 channel_mode(struct user *source, struct channel *chan, int parc, char *parv[])
 {
-	bool matched = false;
 	bool simple_modes_changed = false;
 	int i, parpos = 0, whatt = MTYPE_NUL;
 	unsigned int newlimit;
@@ -112,8 +201,6 @@ channel_mode(struct user *source, struct channel *chan, int parc, char *parv[])
 
 	for (; *pos != '\0'; pos++)
 	{
-		matched = false;
-
 		if (*pos == '+')
 		{
 			whatt = MTYPE_ADD;
@@ -125,76 +212,64 @@ channel_mode(struct user *source, struct channel *chan, int parc, char *parv[])
 			continue;
 		}
 
-		for (i = 0; mode_list[i].mode != '\0'; i++)
+		const struct cmode_dispatch *const cd = cmode_dispatch(*pos);
+
+		i = cd->index;
+
+		switch (cd->kind)
 		{
-			if (*pos == mode_list[i].mode)
+		case CMODE_KIND_SIMPLE:
+			if (whatt == MTYPE_ADD)
 			{
-				matched = true;
-
-				if (whatt == MTYPE_ADD)
-				{
-					if (!(chan->modes & mode_list[i].value))
-						simple_modes_changed = true;
-					chan->modes |= mode_list[i].value;
-				}
-				else
-				{
-					if (chan->modes & mode_list[i].value)
-						simple_modes_changed = true;
-					chan->modes &= ~mode_list[i].value;
-				}
+				if (!(chan->modes & mode_list[i].value))
+					simple_modes_changed = true;
+				chan->modes |= mode_list[i].value;
+			}
+			else
+			{
+				if (chan->modes & mode_list[i].value)
+					simple_modes_changed = true;
+				chan->modes &= ~mode_list[i].value;
+			}
 
-				if (source)
-					modestack_mode_simple(source->nick, chan, whatt, mode_list[i].value);
+			if (source)
+				modestack_mode_simple(source->nick, chan, whatt, mode_list[i].value);
 
-				break;
-			}
-		}
-		if (matched)
 			continue;
 
-		for (i = 0; ignore_mode_list[i].mode != '\0'; i++)
-		{
-			if (*pos == ignore_mode_list[i].mode)
+		case CMODE_KIND_EXT:
+			if (whatt == MTYPE_ADD)
 			{
-				matched = true;
-				if (whatt == MTYPE_ADD)
+				if (++parpos >= parc)
+					continue;
+				if (source && !ignore_mode_list[i].check(parv[parpos], chan, NULL, NULL, NULL))
+					continue;
+				if (chan->extmodes[i])
 				{
-					if (++parpos >= parc)
-						break;
-					if (source && !ignore_mode_list[i].check(parv[parpos], chan, NULL, NULL, NULL))
-						break;
-					if (chan->extmodes[i])
-					{
-						if (strcmp(chan->extmodes[i], parv[parpos]))
-							simple_modes_changed = true;
-						sfree(chan->extmodes[i]);
-					}
-					else
+					if (strcmp(chan->extmodes[i], parv[parpos]))
 						simple_modes_changed = true;
-					chan->extmodes[i] = sstrdup(parv[parpos]);
-					if (source)
-						modestack_mode_ext(source->nick, chan, MTYPE_ADD, i, chan->extmodes[i]);
+					sfree(chan->extmodes[i]);
 				}
 				else
+					simple_modes_changed = true;
+				chan->extmodes[i] = sstrdup(parv[parpos]);
+				if (source)
+					modestack_mode_ext(source->nick, chan, MTYPE_ADD, i, chan->extmodes[i]);
+			}
+			else
+			{
+				if (chan->extmodes[i])
 				{
-					if (chan->extmodes[i])
-					{
-						simple_modes_changed = true;
-						sfree(chan->extmodes[i]);
-						chan->extmodes[i] = NULL;
-					}
-					if (source)
-						modestack_mode_ext(source->nick, chan, MTYPE_DEL, i, NULL);
+					simple_modes_changed = true;
+					sfree(chan->extmodes[i]);
+					chan->extmodes[i] = NULL;
 				}
-				break;
+				if (source)
+					modestack_mode_ext(source->nick, chan, MTYPE_DEL, i, NULL);
 			}
-		}
-		if (matched)
 			continue;
 
-		if (*pos == 'l')
-		{
+		case CMODE_KIND_LIMIT:
 			if (whatt == MTYPE_ADD)
 			{
 				if (++parpos >= parc)
@@ -222,10 +297,8 @@ channel_mode(struct user *source, struct channel *chan, int parc, char *parv[])
 					modestack_mode_limit(source->nick, chan, MTYPE_DEL, 0);
 			}
 			continue;
-		}
 
-		if (*pos == 'k')
-		{
+		case CMODE_KIND_KEY:
 			if (whatt == MTYPE_ADD)
 			{
 				if (++parpos >= parc)
@@ -258,10 +331,8 @@ channel_mode(struct user *source, struct channel *chan, int parc, char *parv[])
 				parpos++;
 			}
 			continue;
-		}
 
-		if (strchr(ircd->ban_like_modes, *pos))
-		{
+		case CMODE_KIND_BANLIKE:
 			if (++parpos >= parc)
 				continue;
 			if (whatt == MTYPE_ADD)
@@ -282,74 +353,68 @@ channel_mode(struct user *source, struct channel *chan, int parc, char *parv[])
 					modestack_mode_param(source->nick, chan, MTYPE_DEL, *pos, parv[parpos]);
 			}
 			continue;
-		}
 
-		for (i = 0; status_mode_list[i].mode != '\0'; i++)
-		{
-			if (*pos == status_mode_list[i].mode)
+		case CMODE_KIND_STATUS:
+			if (++parpos >= parc)
+				break;
+
+			target = source ? user_find_named(parv[parpos]) : user_find(parv[parpos]);
+			if (target == NULL) {
+				/* This may happen legitimately, e.g.
+				 * if mode and /ns ghost cross.
+				 */
+				slog(LG_DEBUG, "channel_mode(): MODE %s %c%c %s user not found", chan->name, (whatt == MTYPE_ADD) ? '+' : '-', status_mode_list[i].mode, parv[parpos]);
+				continue;
+			}
+			cu = chanuser_find(chan, target);
+			if (cu == NULL)
 			{
-				if (++parpos >= parc)
-					break;
-				matched = true;
-
-				target = source ? user_find_named(parv[parpos]) : user_find(parv[parpos]);
-				if (target == NULL) {
-					/* This may happen legitimately, e.g.
-					 * if mode and /ns ghost cross.
-					 */
-					slog(LG_DEBUG, "channel_mode(): MODE %s %c%c %s user not found", chan->name, (whatt == MTYPE_ADD) ? '+' : '-', status_mode_list[i].mode, parv[parpos]);
-					break;
-				}
-				cu = chanuser_find(chan, target);
-				if (cu == NULL)
-				{
-					/* This may happen legitimately, e.g.
-					 * if mode and /cs kick cross.
-					 */
-					slog(LG_DEBUG, "channel_mode(): MODE %s %c%c %s user not on channel", chan->name, (whatt == MTYPE_ADD) ? '+' : '-', status_mode_list[i].mode, parv[parpos]);
-					break;
-				}
+				/* This may happen legitimately, e.g.
+				 * if mode and /cs kick cross.
+				 */
+				slog(LG_DEBUG, "channel_mode(): MODE %s %c%c %s user not on channel", chan->name, (whatt == MTYPE_ADD) ? '+' : '-', status_mode_list[i].mode, parv[parpos]);
+				continue;
+			}
 
-				if (whatt == MTYPE_ADD)
-				{
-					cu->modes |= status_mode_list[i].value;
+			if (whatt == MTYPE_ADD)
+			{
+				cu->modes |= status_mode_list[i].value;
 
-					if (source)
-						modestack_mode_param(source->nick, chan, MTYPE_ADD, *pos, CLIENT_NAME(cu->user));
+				if (source)
+					modestack_mode_param(source->nick, chan, MTYPE_ADD, *pos, CLIENT_NAME(cu->user));
 
-					/* see if they did something we have to undo */
-					if (source == NULL && cu->user->server != me.me)
-					{
-						struct hook_channel_mode_change hookmsg_chg = {
-							.cu = cu,
-							.mchar = status_mode_list[i].mode,
-							.mvalue = status_mode_list[i].value
-						};
+				/* see if they did something we have to undo */
+				if (source == NULL && cu->user->server != me.me)
+				{
+					struct hook_channel_mode_change hookmsg_chg = {
+						.cu = cu,
+						.mchar = status_mode_list[i].mode,
+						.mvalue = status_mode_list[i].value
+					};
 
-						hook_call_channel_mode_change(&hookmsg_chg);
-					}
+					hook_call_channel_mode_change(&hookmsg_chg);
 				}
-				else
+			}
+			else
+			{
+				if (cu->user->server == me.me && status_mode_list[i].value == CSTATUS_OP)
 				{
-					if (cu->user->server == me.me && status_mode_list[i].value == CSTATUS_OP)
-					{
-						if (source == NULL)
-							reop_service(chan, cu->user, &first_deopped_service);
-						continue;
-					}
-
-					if (source)
-						modestack_mode_param(source->nick, chan, MTYPE_DEL, *pos, CLIENT_NAME(cu->user));
-
-					cu->modes &= ~status_mode_list[i].value;
+					if (source == NULL)
+						reop_service(chan, cu->user, &first_deopped_service);
+					continue;
 				}
 
-				break;
+				if (source)
+					modestack_mode_param(source->nick, chan, MTYPE_DEL, *pos, CLIENT_NAME(cu->user));
+
+				cu->modes &= ~status_mode_list[i].value;
 			}
-		}
-		if (matched)
 			continue;
 
+		default:
+			break;
+		}
+
 		slog(LG_DEBUG, "channel_mode(): mode %c not matched", *pos);
 	}
 
@@ -387,22 +452,39 @@ channel_mode_va(struct user *source, struct channel *chan, int parc, char *parv0
 	channel_mode(source, chan, parc, parv);
 }
 
-static struct modestackdata {
+/* Mode changes are stacked per channel until the end of the current pass
+ * of the event loop (or until a line is full), so that a burst touching
+ * many channels still sends each of them as few MODE lines as possible.
+ */
+struct modestackdata {
+	mowgli_node_t node; /* in modestack_pending */
 	char source[HOSTLEN + 1]; /* name */
 	struct channel *channel;
 	unsigned int modes_on;
 	unsigned int modes_off;
 	unsigned int limit;
-	char extmodes[256][512];
-	bool limitused, extmodesused[256];
+	char **extmodes; /* NULL if unchanged, "" to remove */
+	bool limitused;
 	char pmodes[2*MAXMODES+2];
 	char params[512]; /* includes leading space */
 	int totalparamslen; /* includes leading space */
 	int totallen;
 	int paramcount;
+};
+
+struct modestack_stats modestack_stats;
+
+static mowgli_list_t modestack_pending;
+static struct named_heap *modestack_heap = NULL;
+static mowgli_eventloop_timer_t *modestack_timer = NULL;
 
-	mowgli_eventloop_timer_t *event;
-} modestackdata;
+/* while the uplink's sendq is over its high watermark, the end-of-pass flush
+ * waits for it to drain (see modestack_sendq_resume()), for at most this many
+ * seconds
+ */
+#define MODESTACK_HOLD_MAX 2
+
+static time_t modestack_held_since = 0;
 
 static void modestack_calclen(struct modestackdata *md);
 
@@ -416,7 +498,7 @@ modestack_debugprint(struct modestackdata *md)
 	if (md->limitused)
 		slog(LG_DEBUG, "limit %u", (unsigned)md->limit);
 	for (i = 0; i < ignore_mode_list_size; i++)
-		if (md->extmodesused[i])
+		if (md->extmodes[i] != NULL)
 			slog(LG_DEBUG, "ext %d %s", (int)i, md->extmodes[i]);
 	slog(LG_DEBUG, "pmodes %s%s", md->pmodes, md->params);
 	modestack_calclen(md);
@@ -438,7 +520,7 @@ modestack_calclen(struct modestackdata *md)
 	if (md->limitused && md->limit != 0)
 		md->totalparamslen += 11;
 	for (i = 0; i < ignore_mode_list_size; i++)
-		if (md->extmodesused[i])
+		if (md->extmodes[i] != NULL)
 		{
 			md->paramcount++;
 			if (*md->extmodes[i] != '\0')
@@ -463,8 +545,8 @@ modestack_clear(struct modestackdata *md)
 	md->limitused = 0;
 	for (i = 0; i < ignore_mode_list_size; i++)
 	{
-		md->extmodesused[i] = 0;
-		*md->extmodes[i] = '\0';
+		sfree(md->extmodes[i]);
+		md->extmodes[i] = NULL;
 	}
 	md->pmodes[0] = '\0';
 	md->params[0] = '\0';
@@ -507,7 +589,7 @@ modestack_flush(struct modestackdata *md)
 	}
 	for (i = 0; i < ignore_mode_list_size; i++)
 	{
-		if (md->extmodesused[i] && *md->extmodes[i] == '\0')
+		if (md->extmodes[i] != NULL && *md->extmodes[i] == '\0')
 		{
 			if (dir != MTYPE_DEL)
 			{
@@ -538,7 +620,7 @@ modestack_flush(struct modestackdata *md)
 	}
 	for (i = 0; i < ignore_mode_list_size; i++)
 	{
-		if (md->extmodesused[i] && *md->extmodes[i] != '\0')
+		if (md->extmodes[i] != NULL && *md->extmodes[i] != '\0')
 		{
 			if (dir != MTYPE_ADD)
 			{
@@ -573,7 +655,7 @@ modestack_flush(struct modestackdata *md)
 	}
 	for (i = 0; i < ignore_mode_list_size; i++)
 	{
-		if (md->extmodesused[i] && *md->extmodes[i] != '\0')
+		if (md->extmodes[i] != NULL && *md->extmodes[i] != '\0')
 		{
 			snprintf(p, end - p, " %s", md->extmodes[i]);
 			p += strlen(p);
@@ -585,24 +667,116 @@ modestack_flush(struct modestackdata *md)
 		p += strlen(p);
 	}
 	mode_sts(md->source, md->channel, buf);
+	modestack_stats.lines++;
 	modestack_clear(md);
 }
 
+/* forgets a channel's stack, which must have been flushed or cleared */
+static void
+modestack_release(struct modestackdata *md)
+{
+	mowgli_node_delete(&md->node, &modestack_pending);
+	md->channel->modestack = NULL;
+	sfree(md->extmodes);
+	named_heap_free(modestack_heap, md);
+}
+
+/* flushes every pending channel, at the end of the current pass of the event loop */
+static void
+modestack_flush_callback(void *arg)
+{
+	mowgli_node_t *n, *tn;
+
+	modestack_timer = NULL;
+
+	if (MOWGLI_LIST_LENGTH(&modestack_pending) != 0 && curr_uplink != NULL && curr_uplink->conn != NULL &&
+			sendq_congested(curr_uplink->conn))
+	{
+		if (modestack_held_since == 0)
+		{
+			modestack_held_since = CURRTIME;
+			modestack_stats.holds++;
+		}
+
+		if (CURRTIME - modestack_held_since < MODESTACK_HOLD_MAX)
+		{
+			modestack_timer = timer_add_once("flush_cmode_callback", modestack_flush_callback, NULL, 1);
+			return;
+		}
+	}
+
+	modestack_held_since = 0;
+
+	if (MOWGLI_LIST_LENGTH(&modestack_pending) > modestack_stats.peak_channels)
+		modestack_stats.peak_channels = MOWGLI_LIST_LENGTH(&modestack_pending);
+	modestack_stats.flushes++;
+
+	MOWGLI_ITER_FOREACH_SAFE(n, tn, modestack_pending.head)
+	{
+		struct modestackdata *md = n->data;
+
+		modestack_flush(md);
+		modestack_release(md);
+	}
+}
+
+/* the uplink has caught up; send whatever was held back for it */
+static void
+modestack_sendq_resume(struct connection *cptr)
+{
+	if (modestack_held_since == 0 || curr_uplink == NULL || cptr != curr_uplink->conn)
+		return;
+
+	if (modestack_timer != NULL)
+	{
+		timer_destroy(modestack_timer);
+		modestack_timer = NULL;
+	}
+
+	modestack_flush_callback(NULL);
+}
+
+void
+cmode_init(void)
+{
+	hook_add_sendq_resume(modestack_sendq_resume);
+}
+
 static struct modestackdata *
 modestack_init(const char *source, struct channel *channel)
 {
+	struct modestackdata *md;
+
 	return_val_if_fail(source != NULL, NULL);
 	return_val_if_fail(channel != NULL, NULL);
 
-	if (irccasecmp(source, modestackdata.source) || channel != modestackdata.channel)
+	if ((md = channel->modestack) != NULL)
 	{
-		/*slog(LG_DEBUG, "modestack_init(): new source/channel, flushing");*/
-		modestack_flush(&modestackdata);
+		/* modes from someone else must not overtake these */
+		if (irccasecmp(source, md->source))
+			modestack_flush(md);
 	}
+	else
+	{
+		if (modestack_heap == NULL)
+			modestack_heap = named_heap_get("modestack", sizeof(struct modestackdata));
+
+		md = named_heap_alloc(modestack_heap);
+		md->channel = channel;
+		if (ignore_mode_list_size != 0)
+			md->extmodes = scalloc(ignore_mode_list_size, sizeof(char *));
+
+		channel->modestack = md;
+		mowgli_node_add(md, &md->node, &modestack_pending);
+	}
+
+	mowgli_strlcpy(md->source, source, sizeof md->source);
+
+	if (modestack_timer == NULL)
+		modestack_timer = timer_add_once("flush_cmode_callback", modestack_flush_callback, NULL, 0);
 
-	mowgli_strlcpy(modestackdata.source, source, sizeof modestackdata.source);
-	modestackdata.channel = channel;
-	return &modestackdata;
+	modestack_stats.changes++;
+	return md;
 }
 
 static void
@@ -645,7 +819,8 @@ modestack_add_limit(struct modestackdata *md, int dir, unsigned int limit)
 static void
 modestack_add_ext(struct modestackdata *md, int dir, int i, const char *value)
 {
-	md->extmodesused[i] = 0;
+	sfree(md->extmodes[i]);
+	md->extmodes[i] = NULL;
 	modestack_calclen(md);
 	if (md->paramcount >= MAXMODES)
 		modestack_flush(md);
@@ -653,13 +828,12 @@ modestack_add_ext(struct modestackdata *md, int dir, int i, const char *value)
 	{
 		if (md->totallen + 1 + strlen(value) > 512)
 			modestack_flush(md);
-		mowgli_strlcpy(md->extmodes[i], value, sizeof md->extmodes[i]);
+		md->extmodes[i] = sstrndup(value, 511);
 	}
 	else if (dir == MTYPE_DEL)
-		md->extmodes[i][0] = '\0';
+		md->extmodes[i] = sstrdup("");
 	else
 		slog(LG_ERROR, "modestack_add_ext(): invalid direction");
-	md->extmodesused[i] = 1;
 }
 
 static void
@@ -684,7 +858,7 @@ modestack_add_param(struct modestackdata *md, int dir, char type, const char *va
 	}
 	n += (md->limitused != 0);
 	for (i = 0; i < ignore_mode_list_size; i++)
-		n += (md->extmodesused[i] != 0);
+		n += (md->extmodes[i] != NULL);
 	modestack_calclen(md);
 	if (n >= MAXMODES || md->totallen + (dir != dir2) + 2 + strlen(value) > 512 || (type == 'k' && strchr(md->pmodes, 'k')))
 	{
@@ -707,51 +881,67 @@ modestack_add_param(struct modestackdata *md, int dir, char type, const char *va
 	mowgli_strlcat(md->params, value, sizeof md->params);
 }
 
-static void
-modestack_flush_callback(void *arg)
-{
-	modestack_flush((struct modestackdata *)arg);
-	((struct modestackdata *)arg)->event = 0;
-}
-
-/* flush pending modes for a certain channel */
+/* flush pending modes for a certain channel (or all of them) */
 void
 modestack_flush_channel(struct channel *channel)
 {
-	if (channel == NULL || channel == modestackdata.channel)
-		modestack_flush(&modestackdata);
+	if (channel == NULL)
+		modestack_flush_now();
+	else if (channel->modestack != NULL)
+	{
+		modestack_flush(channel->modestack);
+		modestack_release(channel->modestack);
+	}
 }
 
-/* forget pending modes for a certain channel */
+/* forget pending modes for a certain channel (or all of them) */
 void
 modestack_forget_channel(struct channel *channel)
 {
-	if (channel == NULL || channel == modestackdata.channel)
-		modestack_clear(&modestackdata);
+	mowgli_node_t *n, *tn;
+
+	if (channel != NULL)
+	{
+		if (channel->modestack != NULL)
+		{
+			modestack_clear(channel->modestack);
+			modestack_release(channel->modestack);
+		}
+		return;
+	}
+
+	MOWGLI_ITER_FOREACH_SAFE(n, tn, modestack_pending.head)
+	{
+		modestack_clear(n->data);
+		modestack_release(n->data);
+	}
 }
 
 /* handle a channel that is going to be destroyed */
 void
 modestack_finalize_channel(struct channel *channel)
 {
+	struct modestackdata *md = channel->modestack;
 	struct user *u;
 
-	if (channel == modestackdata.channel)
+	if (md == NULL)
+		return;
+
+	if (md->modes_off & ircd->perm_mode)
 	{
-		if (modestackdata.modes_off & ircd->perm_mode)
-		{
-			/* A mode change is not a good way to destroy a channel */
-			slog(LG_DEBUG, "modestack_finalize_channel(): flushing modes for %s to clear perm mode", channel->name);
-			u = user_find_named(modestackdata.source);
-			if (u != NULL)
-				join_sts(channel, u, false, channel_modes(channel, true));
-			modestack_flush(&modestackdata);
-			if (u != NULL)
-				part_sts(channel, u);
-		}
-		else
-			modestack_clear(&modestackdata);
+		/* A mode change is not a good way to destroy a channel */
+		slog(LG_DEBUG, "modestack_finalize_channel(): flushing modes for %s to clear perm mode", channel->name);
+		u = user_find_named(md->source);
+		if (u != NULL)
+			join_sts(channel, u, false, channel_modes(channel, true));
+		modestack_flush(md);
+		if (u != NULL)
+			part_sts(channel, u);
 	}
+	else
+		modestack_clear(md);
+
+	modestack_release(md);
 }
 
 /* stack simple modes without parameters */
@@ -764,8 +954,6 @@ modestack_mode_simple_real(const char *source, struct channel *channel, int dir,
 		return;
 	md = modestack_init(source, channel);
 	modestack_add_simple(md, dir, flags);
-	if (!md->event)
-		md->event = mowgli_timer_add_once(base_eventloop, "flush_cmode_callback", modestack_flush_callback, md, 0);
 }
 
 void (*modestack_mode_simple)(const char *source, struct channel *channel, int dir, int flags) = modestack_mode_simple_real;
@@ -778,8 +966,6 @@ modestack_mode_limit_real(const char *source, struct channel *channel, int dir,
 
 	md = modestack_init(source, channel);
 	modestack_add_limit(md, dir, limit);
-	if (!md->event)
-		md->event = mowgli_timer_add_once(base_eventloop, "flush_cmode_callback", modestack_flush_callback, md, 0);
 }
 
 void (*modestack_mode_limit)(const char *source, struct channel *channel, int dir, unsigned int limit) = modestack_mode_limit_real;
@@ -790,16 +976,14 @@ modestack_mode_ext_real(const char *source, struct channel *channel, int dir, un
 {
 	struct modestackdata *md;
 
-	md = modestack_init(source, channel);
 	if (i >= ignore_mode_list_size)
 	{
 		slog(LG_ERROR, "modestack_mode_ext(): i=%u out of range (value=\"%s\")",
 				i, value);
 		return;
 	}
+	md = modestack_init(source, channel);
 	modestack_add_ext(md, dir, i, value);
-	if (!md->event)
-		md->event = mowgli_timer_add_once(base_eventloop, "flush_cmode_callback", modestack_flush_callback, md, 0);
 }
 
 void (*modestack_mode_ext)(const char *source, struct channel *channel, int dir, unsigned int i, const char *value) = modestack_mode_ext_real;
@@ -812,8 +996,6 @@ modestack_mode_param_real(const char *source, struct channel *channel, int dir,
 
 	md = modestack_init(source, channel);
 	modestack_add_param(md, dir, type, value);
-	if (!md->event)
-		md->event = mowgli_timer_add_once(base_eventloop, "flush_cmode_callback", modestack_flush_callback, md, 0);
 }
 
 void (*modestack_mode_param)(const char *source, struct channel *channel, int dir, char type, const char *value) = modestack_mode_param_real;
@@ -822,7 +1004,13 @@ void (*modestack_mode_param)(const char *source, struct channel *channel, int di
 void
 modestack_flush_now(void)
 {
-	modestack_flush(&modestackdata);
+	mowgli_node_t *n, *tn;
+
+	MOWGLI_ITER_FOREACH_SAFE(n, tn, modestack_pending.head)
+	{
+		modestack_flush(n->data);
+		modestack_release(n->data);
+	}
 }
 
 /* Clear all simple modes (+imnpstkl etc) on a channel */
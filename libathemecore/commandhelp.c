@@ -52,21 +52,69 @@ help_not_available(struct sourceinfo *const restrict si, const char *const restr
 	(void) help_display_locations(si);
 }
 
-static bool
-help_evaluate_condition(struct sourceinfo *const restrict si, const char *restrict str)
+enum help_cond_kind
+{
+	HELP_COND_FALSE,        // empty or unrecognised; logged when the file is parsed
+	HELP_COND_MODULE,
+	HELP_COND_PRIV,
+	HELP_COND_ANYPRIVS,
+	HELP_COND_AUTH,
+	HELP_COND_HALFOPS,
+	HELP_COND_OWNER,
+	HELP_COND_PROTECT,
+};
+
+enum help_line_kind
+{
+	HELP_LINE_TEXT,
+	HELP_LINE_IF,
+	HELP_LINE_ELSE,
+	HELP_LINE_ENDIF,
+};
+
+struct help_line
 {
-	while (*str == ' ' || *str == '\t')
+	enum help_line_kind     kind;
+	enum help_cond_kind     cond;
+	bool                    negate;
+	bool                    has_nick;       // text contains &nick&
+	char *                  text;           // the text, or the condition's argument
+};
+
+// A help file as it was read from disk; a file that could not be opened is cached too, with no lines
+struct help_file
+{
+	bool                    missing;
+	size_t                  count;
+	struct help_line *      lines;
+};
+
+// Full path -> struct help_file; emptied on rehash, so that edited files are read again
+static mowgli_patricia_t *help_cache = NULL;
+
+static void
+help_cond_parse(struct help_line *const restrict line, const char *restrict str, const char *const restrict path)
+{
+	line->cond = HELP_COND_FALSE;
+
+	for (;;)
+	{
+		while (*str == ' ' || *str == '\t')
+			str++;
+
+		if (*str != '!')
+			break;
+
+		line->negate = !line->negate;
 		str++;
+	}
 
 	if (! *str)
 	{
-		(void) slog(LG_DEBUG, "%s: empty condition", MOWGLI_FUNC_NAME);
-		return false;
+		(void) slog(LG_DEBUG, "%s: empty condition in '%s'", MOWGLI_FUNC_NAME, path);
+		return;
 	}
 
-	if (*str == '!')
-		return !help_evaluate_condition(si, str + 1);
-
 	char condition[BUFSIZE];
 
 	(void) mowgli_strlcpy(condition, str, sizeof condition);
@@ -86,48 +134,171 @@ help_evaluate_condition(struct sourceinfo *const restrict si, const char *restri
 				*end = 0x00;
 
 			if (strcasecmp(condition, "module") == 0)
-				return (module_find_published(arg) != NULL);
+				line->cond = HELP_COND_MODULE;
+			else if (strcasecmp(condition, "priv") == 0)
+				line->cond = HELP_COND_PRIV;
 
-			if (strcasecmp(condition, "priv") == 0)
-				return has_priv(si, arg);
+			if (line->cond != HELP_COND_FALSE)
+			{
+				line->text = sstrdup(arg);
+				return;
+			}
 		}
 	}
 
 	if (strcasecmp(condition, "anyprivs") == 0)
-		return has_any_privs(si);
+		line->cond = HELP_COND_ANYPRIVS;
+	else if (strcasecmp(condition, "auth") == 0)
+		line->cond = HELP_COND_AUTH;
+	else if (strcasecmp(condition, "halfops") == 0)
+		line->cond = HELP_COND_HALFOPS;
+	else if (strcasecmp(condition, "owner") == 0)
+		line->cond = HELP_COND_OWNER;
+	else if (strcasecmp(condition, "protect") == 0)
+		line->cond = HELP_COND_PROTECT;
+	else
+		(void) slog(LG_DEBUG, "%s: unrecognised condition '%s' (string '%s') in '%s'", MOWGLI_FUNC_NAME,
+		                      condition, str, path);
+}
+
+static bool
+help_evaluate_condition(struct sourceinfo *const restrict si, const struct help_line *const restrict line)
+{
+	bool result = false;
+
+	switch (line->cond)
+	{
+		case HELP_COND_FALSE:
+			break;
+		case HELP_COND_MODULE:
+			result = (module_find_published(line->text) != NULL);
+			break;
+		case HELP_COND_PRIV:
+			result = has_priv(si, line->text);
+			break;
+		case HELP_COND_ANYPRIVS:
+			result = has_any_privs(si);
+			break;
+		case HELP_COND_AUTH:
+			result = (me.auth != AUTH_NONE);
+			break;
+		case HELP_COND_HALFOPS:
+			result = ircd->uses_halfops;
+			break;
+		case HELP_COND_OWNER:
+			result = ircd->uses_owner;
+			break;
+		case HELP_COND_PROTECT:
+			result = ircd->uses_protect;
+			break;
+	}
+
+	return line->negate ? !result : result;
+}
+
+static struct help_file *
+help_file_load(const char *const restrict path)
+{
+	struct help_file *const hf = smalloc(sizeof *hf);
+	FILE *const fh = fopen(path, "r");
+
+	if (! fh)
+	{
+		(void) slog(LG_DEBUG, "%s: fopen('%s'): %s", MOWGLI_FUNC_NAME, path, strerror(errno));
+
+		hf->missing = true;
+		return hf;
+	}
+
+	size_t alloc = 0;
+	char buf[BUFSIZE];
+
+	while (fgets(buf, sizeof buf, fh))
+	{
+		(void) strip(buf);
+
+		if (hf->count == alloc)
+		{
+			alloc = alloc ? alloc * 2 : 32;
+			hf->lines = sreallocarray(hf->lines, alloc, sizeof *hf->lines);
+		}
+
+		struct help_line *const line = &hf->lines[hf->count++];
+
+		(void) memset(line, 0x00, sizeof *line);
+
+		if (strncasecmp(buf, "#if", 3) == 0)
+		{
+			line->kind = HELP_LINE_IF;
+			(void) help_cond_parse(line, buf + 3, path);
+		}
+		else if (strncasecmp(buf, "#endif", 6) == 0)
+			line->kind = HELP_LINE_ENDIF;
+		else if (strncasecmp(buf, "#else", 5) == 0)
+			line->kind = HELP_LINE_ELSE;
+		else
+		{
+			line->kind = HELP_LINE_TEXT;
+			line->has_nick = (strstr(buf, "&nick&") != NULL);
+			line->text = sstrdup(buf);
+		}
+	}
 
-	if (strcasecmp(condition, "auth") == 0)
-		return (me.auth != AUTH_NONE);
+	if (ferror(fh))
+		(void) slog(LG_DEBUG, "%s: fgets('%s'): %s", MOWGLI_FUNC_NAME, path, strerror(errno));
 
-	if (strcasecmp(condition, "halfops") == 0)
-		return ircd->uses_halfops;
+	(void) fclose(fh);
 
-	if (strcasecmp(condition, "owner") == 0)
-		return ircd->uses_owner;
+	return hf;
+}
 
-	if (strcasecmp(condition, "protect") == 0)
-		return ircd->uses_protect;
+static void
+help_file_free(const char ATHEME_VATTR_UNUSED *const restrict key, void *const restrict data,
+               void ATHEME_VATTR_UNUSED *const restrict privdata)
+{
+	struct help_file *const hf = data;
+
+	for (size_t i = 0; i < hf->count; i++)
+		(void) sfree(hf->lines[i].text);
 
-	(void) slog(LG_DEBUG, "%s: unrecognised condition '%s' (string '%s')", MOWGLI_FUNC_NAME, condition, str);
-	return false;
+	(void) sfree(hf->lines);
+	(void) sfree(hf);
 }
 
 static void
-help_display_path(struct sourceinfo *const restrict si, const char *const restrict cmd,
-                  const char *const restrict path, const char *const restrict service_name)
+help_cache_flush(void ATHEME_VATTR_UNUSED *const restrict unused)
 {
-	char fullpath[PATH_MAX];
-	FILE *fh = NULL;
+	(void) mowgli_patricia_destroy(help_cache, &help_file_free, NULL);
 
-	if (*path == '/')
+	help_cache = mowgli_patricia_create(noopcanon);
+}
+
+static const struct help_file *
+help_file_get(const char *const restrict path)
+{
+	struct help_file *hf;
+
+	if (! (hf = mowgli_patricia_retrieve(help_cache, path)))
 	{
-		(void) mowgli_strlcpy(fullpath, path, sizeof fullpath);
+		hf = help_file_load(path);
 
-		if (! (fh = fopen(fullpath, "r")))
-			(void) slog(LG_DEBUG, "%s: fopen('%s'): %s", MOWGLI_FUNC_NAME, fullpath, strerror(errno));
+		(void) mowgli_patricia_add(help_cache, path, hf);
 	}
+
+	return hf->missing ? NULL : hf;
+}
+
+static void
+help_display_path(struct sourceinfo *const restrict si, const char *const restrict cmd,
+                  const char *const restrict path, const char *const restrict service_name)
+{
+	const struct help_file *hf = NULL;
+
+	if (*path == '/')
+		hf = help_file_get(path);
 	else
 	{
+		char fullpath[PATH_MAX];
 		char subname[BUFSIZE];
 
 		(void) mowgli_strlcpy(subname, path, sizeof subname);
@@ -144,22 +315,18 @@ help_display_path(struct sourceinfo *const restrict si, const char *const restri
 		{
 			(void) snprintf(fullpath, sizeof fullpath, "%s/help/%s/%s", SHAREDIR, lang, subname);
 
-			if (! (fh = fopen(fullpath, "r")))
-				(void) slog(LG_DEBUG, "%s: fopen('%s'): %s", MOWGLI_FUNC_NAME,
-				                      fullpath, strerror(errno));
+			hf = help_file_get(fullpath);
 		}
 
-		if (! fh)
+		if (! hf)
 		{
 			(void) snprintf(fullpath, sizeof fullpath, "%s/help/%s", SHAREDIR, subname);
 
-			if (! (fh = fopen(fullpath, "r")))
-				(void) slog(LG_DEBUG, "%s: fopen('%s'): %s", MOWGLI_FUNC_NAME,
-				                      fullpath, strerror(errno));
+			hf = help_file_get(fullpath);
 		}
 	}
 
-	if (! fh)
+	if (! hf)
 	{
 		(void) command_fail(si, fault_nosuch_target, _("Could not open help file for \2%s\2."), cmd);
 		(void) help_display_newline(si);
@@ -169,55 +336,56 @@ help_display_path(struct sourceinfo *const restrict si, const char *const restri
 
 	unsigned int ifnest_false = 0;
 	unsigned int ifnest = 0;
-	char buf[BUFSIZE];
 
-	while (fgets(buf, sizeof buf, fh))
+	for (size_t i = 0; i < hf->count; i++)
 	{
-		(void) strip(buf);
-		(void) replace(buf, sizeof buf, "&nick&", service_name);
+		const struct help_line *const line = &hf->lines[i];
 
-		if (strncasecmp(buf, "#if", 3) == 0)
+		switch (line->kind)
 		{
-			if (ifnest_false || ! help_evaluate_condition(si, buf + 3))
-				ifnest_false++;
+			case HELP_LINE_IF:
+				if (ifnest_false || ! help_evaluate_condition(si, line))
+					ifnest_false++;
 
-			ifnest++;
-			continue;
-		}
+				ifnest++;
+				continue;
 
-		if (strncasecmp(buf, "#endif", 6) == 0)
-		{
-			if (ifnest_false)
-				ifnest_false--;
+			case HELP_LINE_ENDIF:
+				if (ifnest_false)
+					ifnest_false--;
 
-			if (ifnest)
-				ifnest--;
+				if (ifnest)
+					ifnest--;
 
-			continue;
-		}
+				continue;
 
-		if (strncasecmp(buf, "#else", 5) == 0)
-		{
-			if (ifnest && ifnest_false < 2)
-				ifnest_false ^= 1;
+			case HELP_LINE_ELSE:
+				if (ifnest && ifnest_false < 2)
+					ifnest_false ^= 1;
 
-			continue;
+				continue;
+
+			case HELP_LINE_TEXT:
+				break;
 		}
 
 		if (ifnest_false)
 			continue;
 
-		if (*buf)
+		if (line->has_nick)
+		{
+			char buf[BUFSIZE];
+
+			(void) mowgli_strlcpy(buf, line->text, sizeof buf);
+			(void) replace(buf, sizeof buf, "&nick&", service_name);
 			(void) command_success_nodata(si, "%s", buf);
+		}
+		else if (*line->text)
+			(void) command_success_nodata(si, "%s", line->text);
 		else
 			(void) help_display_newline(si);
 	}
 
-	if (ferror(fh))
-		(void) slog(LG_DEBUG, "%s: fgets('%s'): %s", MOWGLI_FUNC_NAME, fullpath, strerror(errno));
-
-	(void) fclose(fh);
-
 	(void) help_display_newline(si);
 }
 
@@ -237,7 +405,7 @@ help_display_as_subcmd(struct sourceinfo *const restrict si, const struct servic
 
 	(void) help_display_prefix(si, service);
 
-	const struct command *const command = mowgli_patricia_retrieve(cmd_list, ccmd);
+	const struct command *const command = command_find(cmd_list, ccmd);
 
 	if (command)
 	{
@@ -512,3 +680,11 @@ additional:
 
 	(void) help_display_newline(si);
 }
+
+void
+help_cache_init(void)
+{
+	help_cache = mowgli_patricia_create(noopcanon);
+
+	(void) hook_add_config_ready(&help_cache_flush);
+}
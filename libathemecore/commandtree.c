@@ -18,7 +18,12 @@
 
 static bool permissive_mode_fallback = false;
 
-static int
+static mowgli_patricia_t *command_stats_tree = NULL;
+
+// The command being executed, so subcommands can be named after their parent
+static struct command_stats *command_stats_running = NULL;
+
+int
 text_to_parv(char *text, int maxparc, char **parv)
 {
 	int count = 0;
@@ -119,7 +124,112 @@ command_find(mowgli_patricia_t *commandtree, const char *command)
 	return_val_if_fail(commandtree != NULL, NULL);
 	return_val_if_fail(command != NULL, NULL);
 
-	return mowgli_patricia_retrieve(commandtree, command);
+	struct command *const c = mowgli_patricia_retrieve(commandtree, command);
+
+	// A stub for a module that is loaded on demand (lazymodule{}) loads it now
+	return c ? module_lazy_resolve(commandtree, c) : NULL;
+}
+
+static struct command_stats *
+command_stats_get(const struct service *const restrict svs, struct command *const restrict c)
+{
+	char name[BUFSIZE];
+	struct command_stats *st;
+
+	if (c->stats != NULL)
+		return c->stats;
+
+	if (command_stats_running != NULL)
+		(void) snprintf(name, sizeof name, "%s %s", command_stats_running->name, c->name);
+	else
+		(void) snprintf(name, sizeof name, "%s %s", svs->internal_name, c->name);
+
+	if (command_stats_tree == NULL)
+		command_stats_tree = mowgli_patricia_create(strcasecanon);
+
+	if ((st = mowgli_patricia_retrieve(command_stats_tree, name)) == NULL)
+	{
+		st = smalloc(sizeof *st);
+		st->name = sstrdup(name);
+		(void) mowgli_patricia_add(command_stats_tree, st->name, st);
+	}
+
+	c->stats = st;
+
+	return st;
+}
+
+static void
+command_stats_record(struct command_stats *const restrict st, const struct timeval *const restrict elapsed)
+{
+	const unsigned long long us = (((unsigned long long) elapsed->tv_sec) * 1000000ULL) + elapsed->tv_usec;
+	unsigned int bucket = 0;
+
+	while (bucket < COMMAND_STATS_BUCKETS - 1 && (us >> (bucket + 1)))
+		bucket++;
+
+	st->calls++;
+	st->total_us += us;
+	st->hist[bucket]++;
+
+	if (us > st->max_us)
+		st->max_us = us;
+
+	if (config_options.slow_command_time && us >= config_options.slow_command_time * 1000ULL)
+	{
+		st->slow++;
+
+		// The source may not exist anymore (DROP, KILL, ...), so don't name it
+		slog(LG_INFO, "SLOW: \2%s\2 took %llu ms", st->name, us / 1000ULL);
+	}
+}
+
+/*
+ * command_stats_foreach()
+ *
+ * Calls cb for the statistics of every command that has been executed.
+ */
+void
+command_stats_foreach(void (*const cb)(const struct command_stats *, void *), void *const privdata)
+{
+	mowgli_patricia_iteration_state_t state;
+	struct command_stats *st;
+
+	return_if_fail(cb != NULL);
+
+	if (command_stats_tree == NULL)
+		return;
+
+	MOWGLI_PATRICIA_FOREACH(st, &state, command_stats_tree)
+		cb(st, privdata);
+}
+
+/*
+ * command_stats_percentile()
+ *
+ * Returns the latency (in microseconds) that pct percent of the calls did
+ * not exceed, as far as the histogram can tell.
+ */
+unsigned long long
+command_stats_percentile(const struct command_stats *const restrict st, const unsigned int pct)
+{
+	unsigned long long seen = 0;
+
+	return_val_if_fail(st != NULL, 0);
+
+	for (unsigned int i = 0; i < COMMAND_STATS_BUCKETS; i++)
+	{
+		seen += st->hist[i];
+
+		if (seen * 100U >= ((unsigned long long) st->calls) * pct)
+		{
+			const unsigned long long bound = 1ULL << (i + 1);
+
+			return (bound < st->max_us) ? bound : st->max_us;
+		}
+	}
+
+	return st->max_us;
 }
 
 void
@@ -145,8 +255,25 @@ command_exec(struct service *svs, struct sourceinfo *si, struct command *c, int
 		if (si->force_language != NULL)
 			language_set_active(si->force_language);
 
+		struct command_stats *const st = command_stats_get(svs, c);
+		struct command_stats *const parent = command_stats_running;
+		struct timeval started, elapsed;
+
 		si->command = c;
+
+		s_time(&started);
+		command_stats_running = st;
+
+		/* c may be gone once this returns (e.g. MODRELOAD), st may not */
+		ATHEME_TRACE3(command__entry, svs->name, st->name, parc);
 		c->cmd(si, parc, parv);
+
+		command_stats_running = parent;
+		e_time(started, &elapsed);
+		command_stats_record(st, &elapsed);
+		ATHEME_TRACE3(command__return, svs->name, st->name,
+		              (((unsigned long long) elapsed.tv_sec) * 1000000ULL) + (unsigned long long) elapsed.tv_usec);
+
 		language_set_active(NULL);
 		return;
 	}
@@ -188,21 +315,60 @@ command_exec(struct service *svs, struct sourceinfo *si, struct command *c, int
 		language_set_active(NULL);
 }
 
+/* Runs c with the arguments in leadv (already split off, e.g. a fantasy
+ * command's channel) followed by text, split up the way command_exec_split()
+ * would split "<leadv...> <text>". text is split in place, and nothing is
+ * copied unless c takes fewer arguments than there are in leadv.
+ */
 void
-command_exec_split(struct service *svs, struct sourceinfo *si, const char *cmd, char *text, mowgli_patricia_t *commandtree)
+command_exec_args(struct service *svs, struct sourceinfo *si, struct command *c, int leadc, char *leadv[], char *text)
 {
-	int parc, i;
 	char *parv[20];
+	char joined[BUFSIZE];
+	int parc = 0;
+
+	return_if_fail(c != NULL);
+	return_if_fail(leadc >= 0 && leadc < (int) (ARRAY_SIZE(parv)));
+
+	for (; parc < leadc && parc < c->maxparc - 1; parc++)
+		parv[parc] = leadv[parc];
+
+	if (parc == leadc)
+		parc += text_to_parv(text, c->maxparc - parc, parv + parc);
+	else if (c->maxparc > 0)
+	{
+		// The last argument c takes has to soak up the rest, as it would have in one line
+		(void) mowgli_strlcpy(joined, leadv[parc], sizeof joined);
+
+		for (int i = parc + 1; i < leadc; i++)
+		{
+			(void) mowgli_strlcat(joined, " ", sizeof joined);
+			(void) mowgli_strlcat(joined, leadv[i], sizeof joined);
+		}
+
+		if (text != NULL)
+		{
+			(void) mowgli_strlcat(joined, " ", sizeof joined);
+			(void) mowgli_strlcat(joined, text, sizeof joined);
+		}
+
+		parc += text_to_parv(joined, 1, parv + parc);
+	}
+
+	for (int i = parc; i < (int) (ARRAY_SIZE(parv)); i++)
+		parv[i] = NULL;
+
+	command_exec(svs, si, c, parc, parv);
+}
+
+void
+command_exec_split(struct service *svs, struct sourceinfo *si, const char *cmd, char *text, mowgli_patricia_t *commandtree)
+{
         struct command *c;
 
 	cmd = service_resolve_alias(svs, commandtree == svs->commands ? NULL : "unknown", cmd);
 	if ((c = command_find(commandtree, cmd)))
-	{
-		parc = text_to_parv(text, c->maxparc, parv);
-		for (i = parc; i < (int)(sizeof(parv) / sizeof(parv[0])); i++)
-			parv[i] = NULL;
-		command_exec(svs, si, c, parc, parv);
-	}
+		command_exec_args(svs, si, c, 0, NULL, text);
 	else
 	{
 		if (si->smu != NULL)
@@ -228,4 +394,200 @@ subcommand_dispatch_simple(struct service *const restrict svs, struct sourceinfo
 		(void) help_display_invalid(si, svs, subcmd);
 }
 
+/* Commands that have yielded with command_suspend(), waiting for whatever
+ * they started (a password check, a query thread, ...) to call them back.
+ */
+struct command_pending
+{
+	mowgli_node_t           node;
+	struct sourceinfo *     si;
+	struct command *        command;
+	command_cancel_fn       cancel;
+	void *                  priv;
+	bool                    resumed;    // between command_resume() and command_yield()/command_finish()
+	bool                    lost;       // the source went away while it was resumed
+};
+
+static mowgli_list_t command_pending_list;
+
+static void
+command_pending_free(struct command_pending *const restrict cp)
+{
+	(void) mowgli_node_delete(&cp->node, &command_pending_list);
+	(void) atheme_object_unref(cp->si);
+	(void) sfree(cp);
+}
+
+/*
+ * command_suspend()
+ *
+ * Called by a command handler that cannot finish right away. The sourceinfo
+ * is kept until command_finish(); the handler returns, and whatever it
+ * started later calls command_resume() to carry on with it.
+ *
+ * If the user the command came from goes away in the meantime, cancel(priv)
+ * is called instead: it must stop whatever is outstanding and free priv, and
+ * the command is then gone without command_finish() being called for it.
+ */
+struct command_pending *
+command_suspend(struct sourceinfo *const restrict si, const command_cancel_fn cancel, void *const restrict priv)
+{
+	return_val_if_fail(si != NULL, NULL);
+	return_val_if_fail(cancel != NULL, NULL);
+
+	struct command_pending *const cp = smalloc(sizeof *cp);
+
+	cp->si = atheme_object_ref(si);
+	cp->command = si->command;
+	cp->cancel = cancel;
+	cp->priv = priv;
+
+	(void) mowgli_node_add(cp, &cp->node, &command_pending_list);
+
+	return cp;
+}
+
+/*
+ * command_resume()
+ *
+ * Returns the sourceinfo of a suspended command so that it can carry on,
+ * with the reply language set up as command_exec() would have. Returns NULL
+ * if the user it came from has gone away since it was last resumed; nothing
+ * should be sent then, but the command still has to yield or finish.
+ */
+struct sourceinfo *
+command_resume(struct command_pending *const restrict cp)
+{
+	return_val_if_fail(cp != NULL, NULL);
+
+	struct sourceinfo *const si = cp->si;
+
+	cp->resumed = true;
+
+	if (cp->lost)
+		return NULL;
+
+	// The account it was logged in to may have changed (or been dropped) meanwhile
+	if (si->su != NULL)
+		si->smu = si->su->myuser;
+
+	si->command = cp->command;
+
+	if (si->force_language != NULL)
+		language_set_active(si->force_language);
+	else if (si->smu != NULL)
+		language_set_active(si->smu->language);
+
+	return si;
+}
+
+/*
+ * command_yield()
+ *
+ * Goes back to waiting after command_resume(), when there is more to come.
+ */
+void
+command_yield(struct command_pending *const restrict cp)
+{
+	return_if_fail(cp != NULL);
+
+	cp->resumed = false;
+
+	language_set_active(NULL);
+}
+
+/*
+ * command_finish()
+ *
+ * Ends a suspended command, resumed or not, and lets go of its sourceinfo.
+ * Its cancel function is not called.
+ */
+void
+command_finish(struct command_pending *const restrict cp)
+{
+	return_if_fail(cp != NULL);
+
+	if (cp->resumed)
+		language_set_active(NULL);
+
+	(void) command_pending_free(cp);
+}
+
+/*
+ * command_pending_find()
+ *
+ * Returns the private data of the suspended command c (if any) that user u
+ * is waiting for, e.g. to refuse running it twice at once.
+ */
+void *
+command_pending_find(const struct user *const restrict u, const struct command *const restrict c)
+{
+	mowgli_node_t *n;
+
+	MOWGLI_ITER_FOREACH(n, command_pending_list.head)
+	{
+		const struct command_pending *const cp = n->data;
+
+		if (cp->si->su == u && cp->command == c && ! cp->lost)
+			return cp->priv;
+	}
+
+	return NULL;
+}
+
+/*
+ * command_cancel_all()
+ *
+ * Cancels every suspended command c, as a module providing it must before
+ * it is unloaded.
+ */
+void
+command_cancel_all(const struct command *const restrict c)
+{
+	mowgli_node_t *n, *tn;
+
+	MOWGLI_ITER_FOREACH_SAFE(n, tn, command_pending_list.head)
+	{
+		struct command_pending *const cp = n->data;
+
+		if (cp->command != c)
+			continue;
+
+		(void) cp->cancel(cp->priv);
+		(void) command_pending_free(cp);
+	}
+}
+
+static void
+command_pending_user_delete(struct user *const restrict u)
+{
+	mowgli_node_t *n, *tn;
+
+	MOWGLI_ITER_FOREACH_SAFE(n, tn, command_pending_list.head)
+	{
+		struct command_pending *const cp = n->data;
+
+		if (cp->si->su != u || cp->lost)
+			continue;
+
+		/* A resumed command is in the middle of one of its callbacks (it may
+		 * be what killed the user), where it cannot be cancelled
+		 */
+		if (cp->resumed)
+		{
+			cp->lost = true;
+			continue;
+		}
+
+		(void) cp->cancel(cp->priv);
+		(void) command_pending_free(cp);
+	}
+}
+
+void
+command_pending_init(void)
+{
+	hook_add_user_delete(&command_pending_user_delete);
+}
+
 bool (*command_authorize)(struct service *, struct sourceinfo *, struct command *, const char *) = &default_cmd_auth;
@@ -18,6 +18,7 @@
 
 static int c_uplink(mowgli_config_file_entry_t *);
 static int c_loadmodule(mowgli_config_file_entry_t *);
+static int c_lazymodule(mowgli_config_file_entry_t *);
 static int c_operclass(mowgli_config_file_entry_t *);
 static int c_operator(mowgli_config_file_entry_t *);
 static int c_language(mowgli_config_file_entry_t *);
@@ -205,6 +206,8 @@ conf_parse(const char *file)
 
 	TAINT_ON(config_options.raw, "raw can be used to cause network desyncs and therefore is unsupported.");
 
+	conf_diff_commit();
+	channel_fantasy_invalidate(NULL);
 	hook_call_config_ready();
 	return true;
 }
@@ -239,6 +242,7 @@ init_newconf(void)
 	add_top_conf("UPLINK", c_uplink);
 	add_subblock_top_conf("GENERAL", &conf_gi_table);
 	add_top_conf("LOADMODULE", c_loadmodule);
+	add_top_conf("LAZYMODULE", c_lazymodule);
 	add_top_conf("OPERCLASS", c_operclass);
 	add_top_conf("OPERATOR", c_operator);
 	add_top_conf("LANGUAGE", c_language);
@@ -257,6 +261,9 @@ init_newconf(void)
 	add_dupstr_conf_item("REGISTEREMAIL", &conf_si_table, 0, &me.register_email, NULL);
 	add_bool_conf_item("HIDDEN", &conf_si_table, 0, &me.hidden, false);
 	add_dupstr_conf_item("MTA", &conf_si_table, 0, &me.mta, NULL);
+	add_dupstr_conf_item("SMTPRELAY", &conf_si_table, 0, &me.smtprelay, NULL);
+	add_uint_conf_item("SMTPPORT", &conf_si_table, 0, &me.smtpport, 1, 65535, 25);
+	add_bool_conf_item("LMTP", &conf_si_table, 0, &me.lmtp, false);
 	add_conf_item("LOGLEVEL", &conf_si_table, c_si_loglevel);
 	add_uint_conf_item("MAXLOGINS", &conf_si_table, 0, &me.maxlogins, 3, INT_MAX, 5);
 	add_uint_conf_item("MAXUSERS", &conf_si_table, 0, &me.maxusers, 0, INT_MAX, 0);
@@ -289,7 +296,16 @@ init_newconf(void)
 	add_bool_conf_item("KLINE_VERIFIED_IDENT", &conf_gi_table, 0, &config_options.kline_verified_ident, false);
 	add_duration_conf_item("CLONE_TIME", &conf_gi_table, 0, &config_options.clone_time, "m", 0);
 	add_duration_conf_item("COMMIT_INTERVAL", &conf_gi_table, 0, &config_options.commit_interval, "m", 300);
+	add_uint_conf_item("COMMIT_CHANGE_THRESHOLD", &conf_gi_table, 0, &config_options.commit_change_threshold, 0, 10000000, 5000);
 	add_bool_conf_item("DB_SAVE_BLOCKING", &conf_gi_table, 0, &config_options.db_save_blocking, false);
+	add_bool_conf_item("DB_SAVE_THREADED", &conf_gi_table, 0, &config_options.db_save_threaded, false);
+	add_uint_conf_item("DB_COMPRESS_LEVEL", &conf_gi_table, 0, &config_options.db_compress_level, 0, 9, 0);
+	add_bool_conf_item("DB_WARM_IMAGE", &conf_gi_table, 0, &config_options.db_warm_image, false);
+	add_uint_conf_item("AUTH_THREADS", &conf_gi_table, 0, &config_options.auth_threads, 0, 64, 0);
+	add_uint_conf_item("AUTH_PROCESSES", &conf_gi_table, 0, &config_options.auth_processes, 0, 64, 0);
+	add_uint_conf_item("PASSWORD_UPGRADE_RATE", &conf_gi_table, 0, &config_options.password_upgrade_rate, 0, 60000, 60);
+	add_bool_conf_item("MEMO_COLD_STORAGE", &conf_gi_table, 0, &config_options.memo_cold_storage, false);
+	add_bool_conf_item("IO_URING", &conf_gi_table, 0, &config_options.io_uring, false);
 	add_dupstr_conf_item("OPERSTRING", &conf_gi_table, 0, &config_options.operstring, "is an IRC Operator");
 	add_dupstr_conf_item("SERVICESTRING", &conf_gi_table, 0, &config_options.servicestring, "is a Network Service");
 
@@ -297,8 +313,12 @@ init_newconf(void)
 	add_uint_conf_item("DEFAULT_CLONE_ALLOWED", &conf_gi_table, 0, &config_options.default_clone_allowed, 1, INT_MAX, 5);
 	add_uint_conf_item("DEFAULT_CLONE_WARN", &conf_gi_table, 0, &config_options.default_clone_warn, 1, INT_MAX, 5);
 	add_bool_conf_item("CLONE_IDENTIFIED_INCREASE_LIMIT", &conf_gi_table, 0, &config_options.clone_increase, false);
+	add_uint_conf_item("CLONE_IPV4_PREFIX", &conf_gi_table, 0, &config_options.clone_ipv4_prefix, 24, 32, 32);
+	add_uint_conf_item("CLONE_IPV6_PREFIX", &conf_gi_table, 0, &config_options.clone_ipv6_prefix, 48, 128, 64);
 
 	add_uint_conf_item("UPLINK_SENDQ_LIMIT", &conf_gi_table, 0, &config_options.uplink_sendq_limit, 10240, INT_MAX, 1048576);
+	add_duration_conf_item("UPLINK_RECONCILE_TIME", &conf_gi_table, 0, &config_options.uplink_reconcile_time, "s", 0);
+	add_uint_conf_item("SENDQ_POOL_LIMIT", &conf_gi_table, 0, &config_options.sendq_pool_limit, 0, INT_MAX, 16777216);
 	add_dupstr_conf_item("LANGUAGE", &conf_gi_table, 0, &config_options.language, "en");
 	add_conf_item("EXEMPTS", &conf_gi_table, c_gi_exempts);
 	add_bool_conf_item("ALLOW_TAINT", &conf_gi_table, 0, &config_options.allow_taint, false);
@@ -306,6 +326,13 @@ init_newconf(void)
 	add_bool_conf_item("SHOW_ENTITY_ID", &conf_gi_table, 0, &config_options.show_entity_id, false);
 	add_bool_conf_item("LOAD_DATABASE_MDEPS", &conf_gi_table, 0, &config_options.load_database_mdeps, false);
 	add_bool_conf_item("HIDE_OPERS", &conf_gi_table, 0, &config_options.hide_opers, false);
+	add_uint_conf_item("SLOW_COMMAND_TIME", &conf_gi_table, 0, &config_options.slow_command_time, 0, INT_MAX, 1000);
+	add_uint_conf_item("COMMAND_BUDGET", &conf_gi_table, 0, &config_options.command_budget, 0, INT_MAX, 50);
+	add_bool_conf_item("HOOK_PROFILING", &conf_gi_table, 0, &config_options.hook_profiling, false);
+	add_uint_conf_item("SLOW_LOOP_TIME", &conf_gi_table, 0, &config_options.slow_loop_time, 0, INT_MAX, 2000);
+	add_bool_conf_item("LOG_ASYNC", &conf_gi_table, 0, &config_options.log_async, false);
+	add_uint_conf_item("LOG_FSYNC_INTERVAL", &conf_gi_table, 0, &config_options.log_fsync_interval, 0, INT_MAX, 0);
+	add_bool_conf_item("LOG_INDEX", &conf_gi_table, 0, &config_options.log_index, false);
 
 	/* language:: stuff */
 	add_dupstr_conf_item("NAME", &conf_la_table, 0, &me.language_name, NULL);
@@ -373,6 +400,79 @@ c_loadmodule(mowgli_config_file_entry_t *ce)
 	return 0;
 }
 
+/* lazymodule "foo/bar" {
+ *   command = "service COMMAND";
+ *   row = "TYPE";
+ * };
+ *
+ * Processed after every loadmodule line, so the services named exist.
+ */
+static int
+c_lazymodule(mowgli_config_file_entry_t *ce)
+{
+	mowgli_config_file_entry_t *cce;
+	struct module_lazy *ml;
+	const char *access = NULL;
+	const char *desc = NULL;
+
+	if (!cold_start)
+		return 0;
+
+	if (ce->vardata == NULL)
+	{
+		conf_report_warning(ce, "no parameter for configuration option");
+		return 0;
+	}
+
+	if ((ml = module_lazy_declare(ce->vardata)) == NULL)
+	{
+		conf_report_warning(ce, "module %s is loaded or declared already", ce->vardata);
+		return 0;
+	}
+
+	MOWGLI_ITER_FOREACH(cce, ce->entries)
+	{
+		if (cce->vardata == NULL)
+		{
+			conf_report_warning(cce, "no parameter for configuration option");
+			continue;
+		}
+
+		if (!strcasecmp("COMMAND", cce->varname))
+		{
+			char svsname[BUFSIZE];
+			char *cmd;
+
+			mowgli_strlcpy(svsname, cce->vardata, sizeof svsname);
+
+			if ((cmd = strchr(svsname, ' ')) == NULL)
+			{
+				conf_report_warning(cce, "command must be given as \"service COMMAND\"");
+				continue;
+			}
+
+			*cmd++ = '\0';
+			module_lazy_add_command(ml, svsname, cmd);
+		}
+		else if (!strcasecmp("ROW", cce->varname))
+			module_lazy_add_row(ml, cce->vardata);
+		else if (!strcasecmp("ACCESS", cce->varname))
+			access = cce->vardata;
+		else if (!strcasecmp("DESCRIPTION", cce->varname))
+			desc = cce->vardata;
+		else
+			conf_report_warning(cce, "invalid configuration option");
+	}
+
+	if (!module_lazy_arm(ml, access, desc))
+	{
+		conf_report_warning(ce, "cannot load %s on demand; loading it now", ce->vardata);
+		(void) module_load(ce->vardata);
+	}
+
+	return 0;
+}
+
 static int
 c_uplink(mowgli_config_file_entry_t *ce)
 {
@@ -907,6 +1007,9 @@ copy_me(struct me *src, struct me *dst)
 	dst->adminemail = sstrdup(src->adminemail);
 	dst->register_email = sstrdup(src->register_email);
 	dst->mta = sstrdup(src->mta);
+	dst->smtprelay = sstrdup(src->smtprelay);
+	dst->smtpport = src->smtpport;
+	dst->lmtp = src->lmtp;
 	dst->maxlogins = src->maxlogins;
 	dst->maxusers = src->maxusers;
 	dst->emaillimit = src->emaillimit;
@@ -923,6 +1026,7 @@ free_cstructs(struct me *mesrc)
 	sfree(mesrc->adminemail);
 	sfree(mesrc->register_email);
 	sfree(mesrc->mta);
+	sfree(mesrc->smtprelay);
 }
 
 bool
@@ -976,10 +1080,16 @@ conf_rehash(void)
 		return false;
 	}
 
+	conf_diff_commit();
+	channel_fantasy_invalidate(NULL);
 	hook_call_config_ready();
 
 	if (curr_uplink && curr_uplink->conn)
+	{
 		sendq_set_limit(curr_uplink->conn, config_options.uplink_sendq_limit);
+		sendq_set_watermarks(curr_uplink->conn, config_options.uplink_sendq_limit / 4,
+				config_options.uplink_sendq_limit / 8);
+	}
 
 	remove_illegals();
 
@@ -1042,9 +1152,9 @@ conf_check(void)
 		slog(LG_INFO, "conf_check(): no `registeremail' set in %s, using `%s' based on `adminemail'", config_file, me.register_email);
 	}
 
-	if (!me.mta && me.auth == AUTH_EMAIL)
+	if (!me.mta && !me.smtprelay && me.auth == AUTH_EMAIL)
 	{
-		slog(LG_INFO, "conf_check(): no `mta' set in %s (but `auth' is email)", config_file);
+		slog(LG_INFO, "conf_check(): no `mta' or `smtprelay' set in %s (but `auth' is email)", config_file);
 		return false;
 	}
 
@@ -0,0 +1,277 @@
+/*
+ * SPDX-License-Identifier: ISC
+ * SPDX-URL: https://spdx.org/licenses/ISC.html
+ *
+ * Copyright (C) 2026 Atheme Development Group (https://atheme.github.io/)
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * atheme-services: A collection of minimalist IRC services
+ * confdiff.c: Which configuration blocks a rehash changed.
+ *
+ * conf_process() fingerprints every top-level block of the file it is
+ * given (its name and parameter, and a hash of everything in it), and once
+ * the configuration has passed its checks, the fingerprints are compared
+ * with the ones from the last time that file took effect. Each block that
+ * was added, changed or removed is announced through the
+ * config_block_changed hook, and config_ready handlers can ask
+ * conf_block_changed() whether there is anything for them to redo.
+ *
+ * Only blocks from the file being processed are compared, so parsing the
+ * language file does not make everything in the main file look removed.
+ * Repeated blocks with the same name and parameter are told apart by the
+ * order they come in.
+ */
+
+#include <atheme.h>
+#include "internal.h"
+
+#define CONF_DIFF_FNV_OFFSET    0xCBF29CE484222325ULL
+#define CONF_DIFF_FNV_PRIME     0x100000001B3ULL
+
+struct conf_block_print
+{
+	char *          key;            // file, name, parameter, and which repeat
+	char *          file;
+	char *          name;
+	char *          param;
+	uint64_t        hash;
+};
+
+// As of the last time each file took effect
+static mowgli_patricia_t *conf_prints = NULL;
+
+// From the file conf_process() last saw, until it takes effect or another one is processed
+static mowgli_patricia_t *conf_prints_pending = NULL;
+static char *conf_pending_file = NULL;
+
+// Names of the blocks that changed when the configuration last took effect
+static mowgli_patricia_t *conf_changed = NULL;
+
+static void
+conf_block_print_free(const char ATHEME_VATTR_UNUSED *const restrict key, void *const restrict data,
+                      void ATHEME_VATTR_UNUSED *const restrict privdata)
+{
+	struct conf_block_print *const bp = data;
+
+	(void) sfree(bp->key);
+	(void) sfree(bp->file);
+	(void) sfree(bp->name);
+	(void) sfree(bp->param);
+	(void) sfree(bp);
+}
+
+static uint64_t
+conf_diff_hash_byte(uint64_t hash, const unsigned char c)
+{
+	hash ^= c;
+	hash *= CONF_DIFF_FNV_PRIME;
+
+	return hash;
+}
+
+static uint64_t
+conf_diff_hash_str(uint64_t hash, const char *const restrict str, const bool fold)
+{
+	// Tells a missing parameter from an empty one
+	if (! str)
+		return conf_diff_hash_byte(hash, 0x01U);
+
+	for (const char *p = str; *p; p++)
+		hash = conf_diff_hash_byte(hash, fold ? (unsigned char) toupper((unsigned char) *p) : (unsigned char) *p);
+
+	return conf_diff_hash_byte(hash, 0x00U);
+}
+
+static uint64_t
+conf_diff_hash_entry(uint64_t hash, const mowgli_config_file_entry_t *const restrict ce)
+{
+	// Option names are matched case-insensitively, so a change of case does not count
+	hash = conf_diff_hash_str(hash, ce->varname, true);
+	hash = conf_diff_hash_str(hash, ce->vardata, false);
+
+	if (! ce->entries)
+		return hash;
+
+	hash = conf_diff_hash_byte(hash, '{');
+
+	for (const mowgli_config_file_entry_t *cce = ce->entries; cce; cce = cce->next)
+		hash = conf_diff_hash_entry(hash, cce);
+
+	return conf_diff_hash_byte(hash, '}');
+}
+
+// Called by conf_process() for the file it is about to process
+void
+conf_diff_scan(mowgli_config_file_t *const restrict cfp)
+{
+	return_if_fail(cfp != NULL);
+
+	if (conf_prints_pending)
+		(void) mowgli_patricia_destroy(conf_prints_pending, &conf_block_print_free, NULL);
+
+	(void) sfree(conf_pending_file);
+
+	conf_prints_pending = mowgli_patricia_create(NULL);
+	conf_pending_file = sstrdup(cfp->filename ? cfp->filename : "");
+
+	for (const mowgli_config_file_t *cfptr = cfp; cfptr; cfptr = cfptr->next)
+	{
+		for (const mowgli_config_file_entry_t *ce = cfptr->entries; ce; ce = ce->next)
+		{
+			char name[BUFSIZE];
+			char key[BUFSIZE * 2];
+
+			(void) mowgli_strlcpy(name, ce->varname ? ce->varname : "", sizeof name);
+
+			for (char *p = name; *p; p++)
+				*p = (char) toupper((unsigned char) *p);
+
+			(void) snprintf(key, sizeof key, "%s\n%s %s", conf_pending_file, name,
+			                ce->vardata ? ce->vardata : "");
+
+			if (mowgli_patricia_retrieve(conf_prints_pending, key))
+			{
+				const size_t len = strlen(key);
+
+				for (unsigned int i = 2; i != 0; i++)
+				{
+					(void) snprintf(key + len, sizeof key - len, "\n#%u", i);
+
+					if (! mowgli_patricia_retrieve(conf_prints_pending, key))
+						break;
+				}
+			}
+
+			struct conf_block_print *const bp = smalloc(sizeof *bp);
+
+			bp->key = sstrdup(key);
+			bp->file = sstrdup(conf_pending_file);
+			bp->name = sstrdup(name);
+			bp->param = ce->vardata ? sstrdup(ce->vardata) : NULL;
+			bp->hash = conf_diff_hash_entry(CONF_DIFF_FNV_OFFSET, ce);
+
+			(void) mowgli_patricia_add(conf_prints_pending, bp->key, bp);
+		}
+	}
+}
+
+static void
+conf_diff_announce(const struct conf_block_print *const restrict bp, const enum hook_config_block_change_kind kind)
+{
+	static const char *const kind_names[] = { "added", "changed", "removed" };
+
+	struct hook_config_block_change hdata = {
+		.name   = bp->name,
+		.param  = bp->param,
+		.file   = bp->file,
+		.kind   = kind,
+	};
+
+	(void) slog(LG_DEBUG, "conf_diff_commit(): %s %s%s%s", kind_names[kind], bp->name, bp->param ? " " : "",
+	                      bp->param ? bp->param : "");
+
+	(void) mowgli_patricia_add(conf_changed, bp->name, conf_changed);
+	(void) hook_call_config_block_changed(&hdata);
+}
+
+/*
+ * conf_diff_commit(void)
+ *
+ * Called just before config_ready, once the file last given to
+ * conf_process() has taken effect: announces what changed since the last
+ * time, and makes that what conf_block_changed() answers from.
+ */
+void
+conf_diff_commit(void)
+{
+	mowgli_patricia_iteration_state_t state;
+	struct conf_block_print *bp;
+	mowgli_list_t gone = { NULL, NULL, 0 };
+	mowgli_node_t *n, *tn;
+	unsigned int added = 0, changed = 0, removed = 0;
+
+	if (! conf_prints_pending)
+		return;
+
+	if (! conf_prints)
+		conf_prints = mowgli_patricia_create(NULL);
+
+	if (conf_changed)
+		(void) mowgli_patricia_destroy(conf_changed, NULL, NULL);
+
+	conf_changed = mowgli_patricia_create(&strcasecanon);
+
+	MOWGLI_PATRICIA_FOREACH(bp, &state, conf_prints_pending)
+	{
+		const struct conf_block_print *const was = mowgli_patricia_retrieve(conf_prints, bp->key);
+
+		if (! was)
+		{
+			(void) conf_diff_announce(bp, HOOK_CONFIG_BLOCK_ADDED);
+			added++;
+		}
+		else if (was->hash != bp->hash)
+		{
+			(void) conf_diff_announce(bp, HOOK_CONFIG_BLOCK_CHANGED);
+			changed++;
+		}
+	}
+
+	MOWGLI_PATRICIA_FOREACH(bp, &state, conf_prints)
+	{
+		if (strcmp(bp->file, conf_pending_file) != 0)
+			continue;
+
+		if (! mowgli_patricia_retrieve(conf_prints_pending, bp->key))
+		{
+			(void) conf_diff_announce(bp, HOOK_CONFIG_BLOCK_REMOVED);
+			removed++;
+		}
+
+		(void) mowgli_node_add(bp, mowgli_node_create(), &gone);
+	}
+
+	MOWGLI_ITER_FOREACH_SAFE(n, tn, gone.head)
+	{
+		bp = n->data;
+
+		(void) mowgli_patricia_delete(conf_prints, bp->key);
+		(void) conf_block_print_free(NULL, bp, NULL);
+		(void) mowgli_node_delete(n, &gone);
+		(void) mowgli_node_free(n);
+	}
+
+	MOWGLI_PATRICIA_FOREACH(bp, &state, conf_prints_pending)
+		(void) mowgli_patricia_add(conf_prints, bp->key, bp);
+
+	(void) mowgli_patricia_destroy(conf_prints_pending, NULL, NULL);
+
+	conf_prints_pending = NULL;
+
+	if (runflags & RF_REHASHING)
+		(void) slog(LG_INFO, "conf_rehash(): %u block(s) added, %u changed, %u removed", added, changed, removed);
+}
+
+/*
+ * conf_block_changed(const char *name)
+ *
+ * Inputs:
+ *      - the name of a top-level block, e.g. "httpd"
+ *
+ * Outputs:
+ *      - whether any block of that name was added, changed or removed when
+ *        the configuration last took effect; true before it first has
+ */
+bool
+conf_block_changed(const char *const restrict name)
+{
+	return_val_if_fail(name != NULL, true);
+
+	if (! conf_changed)
+		return true;
+
+	return mowgli_patricia_retrieve(conf_changed, name) != NULL;
+}
@@ -65,7 +65,7 @@ struct ConfTable
 };
 
 static mowgli_list_t confblocks;
-static mowgli_heap_t *conftable_heap = NULL;
+static struct named_heap *conftable_heap = NULL;
 
 bool conf_need_rehash;
 
@@ -304,6 +304,8 @@ conf_process(mowgli_config_file_t *cfp)
 
 	return_if_fail(cfp != NULL);
 
+	conf_diff_scan(cfp);
+
 	MOWGLI_ITER_FOREACH(tn, confblocks.head)
 	{
 		ct = tn->data;
@@ -437,7 +439,7 @@ add_top_conf(const char *name, int (*handler) (mowgli_config_file_entry_t *ce))
 		return;
 	}
 
-	struct ConfTable *const ct = mowgli_heap_alloc(conftable_heap);
+	struct ConfTable *const ct = named_heap_alloc(conftable_heap);
 	ct->name = sstrdup(name);
 	ct->type = CONF_HANDLER;
 	ct->flags = 0;
@@ -459,7 +461,7 @@ add_subblock_top_conf(const char *name, mowgli_list_t *list)
 		return;
 	}
 
-	struct ConfTable *const ct = mowgli_heap_alloc(conftable_heap);
+	struct ConfTable *const ct = named_heap_alloc(conftable_heap);
 	ct->name = sstrdup(name);
 	ct->type = CONF_SUBBLOCK;
 	ct->flags = 0;
@@ -482,7 +484,7 @@ add_conf_item(const char *name, mowgli_list_t *conflist, int (*handler) (mowgli_
 		return;
 	}
 
-	struct ConfTable *const ct = mowgli_heap_alloc(conftable_heap);
+	struct ConfTable *const ct = named_heap_alloc(conftable_heap);
 	ct->name = sstrdup(name);
 	ct->type = CONF_HANDLER;
 	ct->flags = 0;
@@ -501,7 +503,7 @@ add_uint_conf_item(const char *name, mowgli_list_t *conflist, unsigned int flags
 		return;
 	}
 
-	struct ConfTable *const ct = mowgli_heap_alloc(conftable_heap);
+	struct ConfTable *const ct = named_heap_alloc(conftable_heap);
 	ct->name = sstrdup(name);
 	ct->type = CONF_UINT;
 	ct->flags = flags;
@@ -523,7 +525,7 @@ add_duration_conf_item(const char *name, mowgli_list_t *conflist, unsigned int f
 		return;
 	}
 
-	struct ConfTable *const ct = mowgli_heap_alloc(conftable_heap);
+	struct ConfTable *const ct = named_heap_alloc(conftable_heap);
 	ct->name = sstrdup(name);
 	ct->type = CONF_DURATION;
 	ct->flags = flags;
@@ -544,7 +546,7 @@ add_dupstr_conf_item(const char *name, mowgli_list_t *conflist, unsigned int fla
 		return;
 	}
 
-	struct ConfTable *const ct = mowgli_heap_alloc(conftable_heap);
+	struct ConfTable *const ct = named_heap_alloc(conftable_heap);
 	ct->name = sstrdup(name);
 	ct->type = CONF_DUPSTR;
 	ct->flags = flags;
@@ -564,7 +566,7 @@ add_bool_conf_item(const char *name, mowgli_list_t *conflist, unsigned int flags
 		return;
 	}
 
-	struct ConfTable *const ct = mowgli_heap_alloc(conftable_heap);
+	struct ConfTable *const ct = named_heap_alloc(conftable_heap);
 	ct->name = sstrdup(name);
 	ct->type = CONF_BOOL;
 	ct->flags = flags;
@@ -592,7 +594,7 @@ del_top_conf(const char *name)
 
 	sfree(ct->name);
 
-	mowgli_heap_free(conftable_heap, ct);
+	named_heap_free(conftable_heap, ct);
 }
 
 void
@@ -618,7 +620,7 @@ del_conf_item(const char *name, mowgli_list_t *conflist)
 
 	sfree(ct->name);
 
-	mowgli_heap_free(conftable_heap, ct);
+	named_heap_free(conftable_heap, ct);
 }
 
 conf_handler_fn
@@ -653,7 +655,7 @@ token_to_value(struct Token token_table[], const char *token)
 void
 init_confprocess(void)
 {
-	conftable_heap = sharedheap_get(sizeof(struct ConfTable));
+	conftable_heap = named_heap_get("conftable", sizeof(struct ConfTable));
 
 	if (!conftable_heap)
 	{
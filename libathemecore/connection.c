@@ -46,6 +46,87 @@ socket_setnonblocking(mowgli_descriptor_t sck)
 #endif
 }
 
+/* How many deferred events each lane handles per pass of the event loop,
+ * before the uplink gets another look; whatever is left goes first in the
+ * next pass, so a lane is never starved.
+ */
+#define CONNECTION_LANE_CAP     32U
+
+static mowgli_list_t connection_lanes[CONNECTION_LANES];
+static struct connection_lane_stats connection_lane_stats[CONNECTION_LANES];
+
+// When the first event of this pass was seen; the uplink's wait is counted from there
+static struct timeval connection_lane_woke;
+static bool connection_lane_awake = false;
+
+static mowgli_eventloop_timer_t *connection_lane_timer = NULL;
+
+static const char *const connection_lane_names[CONNECTION_LANES] = {
+	[CONNECTION_LANE_UPLINK]        = "uplink",
+	[CONNECTION_LANE_CLIENT]        = "clients",
+	[CONNECTION_LANE_TIMER]         = "timers",
+};
+
+static unsigned long long
+connection_lane_since(const struct timeval *const restrict tv)
+{
+	struct timeval elapsed;
+
+	(void) e_time(*tv, &elapsed);
+
+	return (((unsigned long long) elapsed.tv_sec) * 1000000ULL) + (unsigned long long) elapsed.tv_usec;
+}
+
+static void
+connection_lane_wake(void)
+{
+	if (connection_lane_awake)
+		return;
+
+	(void) s_time(&connection_lane_woke);
+	connection_lane_awake = true;
+}
+
+static void
+connection_lane_record(const enum connection_lane_id lane, const unsigned long long wait_us)
+{
+	struct connection_lane_stats *const st = &connection_lane_stats[lane];
+
+	st->runs++;
+	st->total_wait_us += wait_us;
+
+	if (wait_us > st->max_wait_us)
+		st->max_wait_us = wait_us;
+}
+
+static void
+connection_dispatch(struct connection *cptr, mowgli_eventloop_io_dir_t dir)
+{
+	struct timer_io_sample sample;
+
+	timer_io_begin(cptr, &sample);
+
+	switch (dir) {
+	case MOWGLI_EVENTLOOP_IO_READ:
+		cptr->read_handler(cptr);
+		break;
+	case MOWGLI_EVENTLOOP_IO_WRITE:
+	case MOWGLI_EVENTLOOP_IO_ERROR:
+		cptr->write_handler(cptr);
+		break;
+	}
+
+	// cptr may have been closed (and freed) by now
+	timer_io_end(&sample, dir != MOWGLI_EVENTLOOP_IO_READ);
+}
+
+static bool
+connection_is_uplink(const struct connection *cptr)
+{
+	// including the one still connecting, before it is flagged
+	return CF_IS_UPLINK(cptr) || (curr_uplink != NULL && curr_uplink->conn == cptr);
+}
+
 /*
  * connection_trampoline()
  *
@@ -59,7 +140,9 @@ socket_setnonblocking(mowgli_descriptor_t sck)
  *       none
  *
  * side effects:
- *       whatever happens from the struct connection i/o handlers
+ *       whatever happens from the struct connection i/o handlers: right
+ *       away for the uplink, otherwise once connection_lanes_run() gets to
+ *       it (poll keeps reporting it until then, which is harmless)
  */
 static void
 connection_trampoline(mowgli_eventloop_t *eventloop, mowgli_eventloop_io_t *io,
@@ -67,13 +150,166 @@ connection_trampoline(mowgli_eventloop_t *eventloop, mowgli_eventloop_io_t *io,
 {
 	struct connection *cptr = userdata;
 
-	switch (dir) {
-	case MOWGLI_EVENTLOOP_IO_READ:
-		return cptr->read_handler(cptr);
-	case MOWGLI_EVENTLOOP_IO_WRITE:
-	case MOWGLI_EVENTLOOP_IO_ERROR:
-		return cptr->write_handler(cptr);
+	connection_lane_wake();
+
+	if (!connection_is_uplink(cptr))
+	{
+		connection_lane_defer(dir == MOWGLI_EVENTLOOP_IO_READ ? &cptr->lane_read : &cptr->lane_write);
+		return;
 	}
+
+	connection_lane_record(CONNECTION_LANE_UPLINK, connection_lane_since(&connection_lane_woke));
+	connection_dispatch(cptr, dir);
+}
+
+static void
+connection_lane_run_read(struct connection_lane_entry *le)
+{
+	struct connection *cptr = (struct connection *) (void *) ((char *) le - offsetof(struct connection, lane_read));
+
+	// it may have lost interest (or moved to io_uring) since
+	if (cptr->read_handler != NULL && cptr->uring == NULL)
+		connection_dispatch(cptr, MOWGLI_EVENTLOOP_IO_READ);
+}
+
+static void
+connection_lane_run_write(struct connection_lane_entry *le)
+{
+	struct connection *cptr = (struct connection *) (void *) ((char *) le - offsetof(struct connection, lane_write));
+
+	if (cptr->write_handler != NULL)
+		connection_dispatch(cptr, MOWGLI_EVENTLOOP_IO_WRITE);
+}
+
+/*
+ * connection_lane_defer()
+ *
+ * inputs:
+ *       a lane entry (with its run function and lane set)
+ *
+ * outputs:
+ *       none
+ *
+ * side effects:
+ *       the entry is queued on its lane, unless it already is, for
+ *       connection_lanes_run() to run
+ */
+void
+connection_lane_defer(struct connection_lane_entry *le)
+{
+	return_if_fail(le != NULL);
+	return_if_fail(le->run != NULL);
+	return_if_fail(le->lane < CONNECTION_LANES);
+
+	if (le->listed)
+		return;
+
+	s_time(&le->queued);
+	le->listed = true;
+
+	mowgli_node_add(le, &le->node, &connection_lanes[le->lane]);
+	connection_lane_stats[le->lane].waiting++;
+}
+
+/*
+ * connection_lane_cancel()
+ *
+ * inputs:
+ *       a lane entry
+ *
+ * outputs:
+ *       none
+ *
+ * side effects:
+ *       the entry is taken off its lane if it is queued, e.g. before
+ *       whatever it is part of is freed
+ */
+void
+connection_lane_cancel(struct connection_lane_entry *le)
+{
+	return_if_fail(le != NULL);
+
+	if (!le->listed)
+		return;
+
+	mowgli_node_delete(&le->node, &connection_lanes[le->lane]);
+	le->listed = false;
+	connection_lane_stats[le->lane].waiting--;
+}
+
+// Only there so that the next pass does not wait for an event
+static void
+connection_lane_timer_cb(void ATHEME_VATTR_UNUSED *unused)
+{
+	connection_lane_timer = NULL;
+}
+
+/*
+ * connection_lanes_run()
+ *
+ * inputs:
+ *       none
+ *
+ * outputs:
+ *       none
+ *
+ * side effects:
+ *       called by io_loop() after each pass of the event loop, once the
+ *       uplink's events have been handled: runs up to CONNECTION_LANE_CAP
+ *       of the events deferred on each of the other lanes, in the order
+ *       they were first seen
+ */
+void
+connection_lanes_run(void)
+{
+	bool left = false;
+
+	for (unsigned int lane = CONNECTION_LANE_CLIENT; lane < CONNECTION_LANES; lane++)
+	{
+		mowgli_list_t *const list = &connection_lanes[lane];
+		unsigned int ran = 0;
+		mowgli_node_t *n;
+
+		while (ran < CONNECTION_LANE_CAP && (n = list->head) != NULL)
+		{
+			struct connection_lane_entry *const le = n->data;
+
+			// off the lane before it runs; it may defer itself again, or be freed
+			connection_lane_cancel(le);
+			connection_lane_record(lane, connection_lane_since(&le->queued));
+
+			le->run(le);
+			ran++;
+		}
+
+		if (list->head != NULL)
+		{
+			connection_lane_stats[lane].carried += MOWGLI_LIST_LENGTH(list);
+			left = true;
+		}
+	}
+
+	connection_lane_awake = false;
+
+	if (left && connection_lane_timer == NULL)
+		connection_lane_timer = timer_add_once("connection_lanes", &connection_lane_timer_cb, NULL, 0);
+}
+
+const char *
+connection_lane_name(enum connection_lane_id lane)
+{
+	return_val_if_fail(lane < CONNECTION_LANES, NULL);
+
+	return connection_lane_names[lane];
+}
+
+void
+connection_lane_stats_get(enum connection_lane_id lane, struct connection_lane_stats *st)
+{
+	return_if_fail(lane < CONNECTION_LANES);
+	return_if_fail(st != NULL);
+
+	*st = connection_lane_stats[lane];
 }
 
 /*
@@ -112,6 +348,10 @@ connection_add(const char *name, int fd, unsigned int flags,
 	cptr->first_recv = CURRTIME;
 	cptr->last_recv = CURRTIME;
 	cptr->pollable = mowgli_pollable_create(base_eventloop, fd, cptr);
+	cptr->lane_read.run = &connection_lane_run_read;
+	cptr->lane_read.lane = CONNECTION_LANE_CLIENT;
+	cptr->lane_write.run = &connection_lane_run_write;
+	cptr->lane_write.lane = CONNECTION_LANE_CLIENT;
 
 	connection_setselect_read(cptr, read_handler);
 	connection_setselect_write(cptr, write_handler);
@@ -219,9 +459,15 @@ connection_close(struct connection *cptr)
 	if (cptr->close_handler)
 		cptr->close_handler(cptr);
 
+	/* before the fd goes away, see uring_connection_close() */
+	uring_connection_close(cptr);
+
 	/* close the fd */
 	mowgli_pollable_destroy(base_eventloop, cptr->pollable);
 
+	connection_lane_cancel(&cptr->lane_read);
+	connection_lane_cancel(&cptr->lane_write);
+
 	shutdown(cptr->fd, SHUT_RDWR);
 	close(cptr->fd);
 
@@ -630,7 +876,8 @@ connection_accept_tcp(struct connection *cptr,
 	struct connection *newptr;
 	int s;
 
-	if (!(s = accept(cptr->fd, NULL, NULL)))
+	/* a socket io_uring has accepted for us, if there is one */
+	if ((s = uring_connection_accepted(cptr)) < 0 && (s = accept(cptr->fd, NULL, NULL)) < 0)
 	{
 		slog(LG_INFO, "connection_accept_tcp(): accept failed");
 		return NULL;
@@ -666,6 +913,16 @@ connection_setselect_read(struct connection *cptr,
 	void (*read_handler)(struct connection *))
 {
 	cptr->read_handler = read_handler;
+
+	if (read_handler == NULL)
+		connection_lane_cancel(&cptr->lane_read);
+
+	if (uring_connection_read(cptr))
+	{
+		mowgli_pollable_setselect(base_eventloop, cptr->pollable, MOWGLI_EVENTLOOP_IO_READ, NULL);
+		return;
+	}
+
 	mowgli_pollable_setselect(base_eventloop, cptr->pollable, MOWGLI_EVENTLOOP_IO_READ, cptr->read_handler != NULL ? connection_trampoline : NULL);
 }
 
@@ -687,6 +944,16 @@ connection_setselect_write(struct connection *cptr,
 	void (*write_handler)(struct connection *))
 {
 	cptr->write_handler = write_handler;
+
+	if (write_handler == NULL)
+		connection_lane_cancel(&cptr->lane_write);
+
+	if (cptr->uring != NULL && uring_connection_write(cptr))
+	{
+		mowgli_pollable_setselect(base_eventloop, cptr->pollable, MOWGLI_EVENTLOOP_IO_WRITE, NULL);
+		return;
+	}
+
 	mowgli_pollable_setselect(base_eventloop, cptr->pollable, MOWGLI_EVENTLOOP_IO_WRITE, cptr->write_handler != NULL ? connection_trampoline : NULL);
 }
 
@@ -719,6 +986,8 @@ connection_stats(void (*stats_cb)(const char *, void *), void *privdata)
 			snprintf(buf2, sizeof buf2, " listener %d", c->listener->fd);
 			mowgli_strlcat(buf, buf2, sizeof buf);
 		}
+		if (c->uring != NULL)
+			mowgli_strlcat(buf, " io_uring", sizeof buf);
 		if (c->flags & (CF_CONNECTING | CF_DEAD | CF_NONEWLINE | CF_SEND_EOF | CF_SEND_DEAD))
 		{
 			mowgli_strlcat(buf, " status", sizeof buf);
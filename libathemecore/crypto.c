@@ -16,8 +16,126 @@
 #include <atheme.h>
 #include "internal.h"
 
+#ifdef HAVE_USABLE_PTHREAD
+#  include <pthread.h>
+#endif
+
+// Longest "$tag$" a provider may declare
+#define CRYPT_PREFIX_MAX        32U
+
 static mowgli_list_t crypt_impl_list = { NULL, NULL, 0 };
 
+/* Which provider owns each hash prefix, so that a hash that has one is only
+ * ever given to that provider. Hashes without a known prefix are tried against
+ * every provider that did not declare any (the legacy formats with none).
+ */
+static mowgli_patricia_t *crypt_prefix_tree = NULL;
+
+static struct crypt_verify_stats crypt_stats;
+
+#ifdef HAVE_USABLE_PTHREAD
+// The password verification threads update crypt_stats too
+static pthread_mutex_t crypt_stats_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Providers return new hashes in a static buffer; see crypt_password_using()
+static pthread_mutex_t crypt_output_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+static void
+crypt_stats_add(const unsigned int dispatched, const unsigned int probed, const unsigned int probe_calls)
+{
+#ifdef HAVE_USABLE_PTHREAD
+	(void) pthread_mutex_lock(&crypt_stats_lock);
+#endif
+
+	crypt_stats.dispatched += dispatched;
+	crypt_stats.probed += probed;
+	crypt_stats.probe_calls += probe_calls;
+
+#ifdef HAVE_USABLE_PTHREAD
+	(void) pthread_mutex_unlock(&crypt_stats_lock);
+#endif
+}
+
+// Copies the "$tag$" that parameters starts with into tag; false if it does not start with one
+static bool
+crypt_hash_tag(const char *const restrict parameters, char *const restrict tag, const size_t taglen)
+{
+	if (! parameters || parameters[0] != '$')
+		return false;
+
+	const char *const end = strchr(parameters + 1, '$');
+
+	if (! end || end == parameters + 1)
+		return false;
+
+	const size_t len = (size_t) (end - parameters) + 1;
+
+	if (len >= taglen)
+		return false;
+
+	(void) memcpy(tag, parameters, len);
+
+	tag[len] = 0x00;
+	return true;
+}
+
+static const struct crypt_impl *
+crypt_prefix_owner(const char *const restrict parameters)
+{
+	char tag[CRYPT_PREFIX_MAX + 1];
+
+	if (! crypt_prefix_tree || ! crypt_hash_tag(parameters, tag, sizeof tag))
+		return NULL;
+
+	return mowgli_patricia_retrieve(crypt_prefix_tree, tag);
+}
+
+static void
+crypt_prefixes_add(const struct crypt_impl *const restrict impl)
+{
+	if (! impl->prefixes)
+		return;
+
+	if (! crypt_prefix_tree)
+		crypt_prefix_tree = mowgli_patricia_create(&strcasecanon);
+
+	for (const char *const *prefix = impl->prefixes; *prefix; prefix++)
+	{
+		char tag[CRYPT_PREFIX_MAX + 1];
+
+		if (! crypt_hash_tag(*prefix, tag, sizeof tag) || strcmp(tag, *prefix) != 0)
+		{
+			(void) slog(LG_ERROR, "%s: provider '%s' declares invalid prefix '%s' (BUG)",
+			                      MOWGLI_FUNC_NAME, impl->id, *prefix);
+			continue;
+		}
+
+		const struct crypt_impl *const owner = mowgli_patricia_retrieve(crypt_prefix_tree, tag);
+
+		if (owner)
+		{
+			(void) slog(LG_ERROR, "%s: provider '%s' declares prefix '%s', which provider '%s' already owns",
+			                      MOWGLI_FUNC_NAME, impl->id, tag, owner->id);
+			continue;
+		}
+
+		// See the comment in crypt_register() about the cast
+		(void) mowgli_patricia_add(crypt_prefix_tree, tag, (void *) ((uintptr_t) impl));
+	}
+}
+
+static void
+crypt_prefixes_del(const struct crypt_impl *const restrict impl)
+{
+	if (! impl->prefixes || ! crypt_prefix_tree)
+		return;
+
+	for (const char *const *prefix = impl->prefixes; *prefix; prefix++)
+		if (mowgli_patricia_retrieve(crypt_prefix_tree, *prefix) == impl)
+			(void) mowgli_patricia_delete(crypt_prefix_tree, *prefix);
+}
+
 static inline void
 crypt_log_modchg(const char *const restrict caller, const char *const restrict which,
                  const struct crypt_impl *const restrict impl)
@@ -57,7 +175,10 @@ crypt_register(const struct crypt_impl *const restrict impl)
 	 * To avoid the cast generating a diagnostic due to dropping a const qualifier, we first cast to uintptr_t.
 	 * This is not unprecedented in this codebase; libathemecore/strshare.c does the same thing.
 	 */
+	(void) pwverify_pool_pause();
 	(void) mowgli_node_add((void *) ((uintptr_t) impl), n, &crypt_impl_list);
+	(void) crypt_prefixes_add(impl);
+	(void) pwverify_pool_resume();
 	(void) crypt_log_modchg(MOWGLI_FUNC_NAME, "registered", impl);
 }
 
@@ -76,7 +197,11 @@ crypt_unregister(const struct crypt_impl *const restrict impl)
 	{
 		if (n->data == impl)
 		{
+			// Password verification threads may be walking this list, or running impl's code
+			(void) pwverify_pool_pause();
 			(void) mowgli_node_delete(n, &crypt_impl_list);
+			(void) crypt_prefixes_del(impl);
+			(void) pwverify_pool_resume();
 			(void) mowgli_node_free(n);
 
 			(void) crypt_log_modchg(MOWGLI_FUNC_NAME, "unregistered", impl);
@@ -119,53 +244,236 @@ crypt_get_named_provider(const char *const restrict id)
 	return NULL;
 }
 
+// Whether the provider ci verifies password against parameters
+static bool
+crypt_impl_try(const struct crypt_impl *const restrict ci, const char *const restrict password,
+               const char *const restrict parameters, unsigned int *const restrict flags)
+{
+	if (ci->verify)
+		return ci->verify(password, parameters, flags);
+
+	const char *const result = ci->crypt(password, parameters);
+
+	return (result && strcmp(result, parameters) == 0);
+}
+
 const struct crypt_impl * ATHEME_FATTR_WUR
 crypt_verify_password(const char *const restrict password, const char *const restrict parameters,
                       unsigned int *const restrict flags)
 {
+	const struct crypt_impl *const owner = crypt_prefix_owner(parameters);
+	unsigned int myflags = PWVERIFY_FLAG_NONE;
+	unsigned int probe_calls = 0;
 	mowgli_node_t *n;
 
 	if (flags)
 		*flags = PWVERIFY_FLAG_NONE;
 
+	if (owner)
+	{
+		(void) crypt_stats_add(1, 0, 0);
+
+		if (! crypt_impl_try(owner, password, parameters, &myflags))
+			return NULL;
+
+		if (flags)
+			*flags = myflags;
+
+		return owner;
+	}
+
 	MOWGLI_ITER_FOREACH(n, crypt_impl_list.head)
 	{
 		const struct crypt_impl *const ci = n->data;
 
-		if (ci->verify)
+		// It would have owned the prefix
+		if (ci->prefixes)
+			continue;
+
+		myflags = PWVERIFY_FLAG_NONE;
+		probe_calls++;
+
+		if (crypt_impl_try(ci, password, parameters, &myflags))
 		{
-			unsigned int myflags = PWVERIFY_FLAG_NONE;
+			if (flags)
+				*flags = myflags;
 
-			if (ci->verify(password, parameters, &myflags))
-			{
-				if (flags)
-					*flags = myflags;
+			(void) crypt_stats_add(0, 1, probe_calls);
+			return ci;
+		}
+
+		/* If password verification failed and the password hash was produced
+		 * by the module we just tried, there's no point continuing to test it
+		 * against the other modules. This saves some CPU time.
+		 */
+		if (myflags & PWVERIFY_FLAG_MYMODULE)
+			break;
+	}
+
+	(void) crypt_stats_add(0, 1, probe_calls);
+	return NULL;
+}
+
+/* Variant of crypt_verify_password() for the password verification threads,
+ * for several passwords at once. results[i] is the provider that verified
+ * passwords[i], or NULL. Providers that are not marked threadsafe are skipped;
+ * if one of them could have been the one that produced a hash, decided[i] is
+ * set to false and the caller must verify that password again on the main
+ * thread. Providers with a verify_multi function get every password that is
+ * still undecided in one call, which lets them share work between the hashes
+ * (see digest_oneshot_pbkdf2_multi()); the others are asked one at a time.
+ * As in crypt_verify_password(), a hash with a known prefix is only given to
+ * the provider that owns it.
+ */
+void
+crypt_verify_password_threadsafe_multi(const char *const *const restrict passwords,
+                                       const char *const *const restrict parameters,
+                                       unsigned int *const restrict flags, bool *const restrict decided,
+                                       const struct crypt_impl **const restrict results, const size_t count)
+{
+	const char **const mpasswords = smalloc(count * sizeof *mpasswords);
+	const char **const mparameters = smalloc(count * sizeof *mparameters);
+	unsigned int *const mflags = smalloc(count * sizeof *mflags);
+	bool *const mresults = smalloc(count * sizeof *mresults);
+	size_t *const index = smalloc(count * sizeof *index);
+	bool *const finished = smalloc(count * sizeof *finished);
+	bool *const skipped = smalloc(count * sizeof *skipped);
+	const struct crypt_impl **const owners = smalloc(count * sizeof *owners);
+	unsigned int dispatched = 0, probed = 0, probe_calls = 0;
+
+	for (size_t i = 0; i < count; i++)
+	{
+		flags[i] = PWVERIFY_FLAG_NONE;
+		results[i] = NULL;
+		owners[i] = crypt_prefix_owner(parameters[i]);
+	}
+
+	mowgli_node_t *n;
+
+	MOWGLI_ITER_FOREACH(n, crypt_impl_list.head)
+	{
+		const struct crypt_impl *const ci = n->data;
+
+		// Verifying through ci->crypt() would use the provider's static result buffer
+		const bool usable = (ci->threadsafe && ci->verify);
+
+		size_t remaining = 0;
 
-				return ci;
+		for (size_t i = 0; i < count; i++)
+		{
+			if (finished[i] || (owners[i] ? (owners[i] != ci) : (ci->prefixes != NULL)))
+				continue;
+
+			if (! usable)
+			{
+				skipped[i] = true;
+				continue;
 			}
 
-			/* If password verification failed and the password hash was produced
-			 * by the module we just tried, there's no point continuing to test it
-			 * against the other modules. This saves some CPU time.
-			 */
-			if (myflags & PWVERIFY_FLAG_MYMODULE)
-				return NULL;
+			mpasswords[remaining] = passwords[i];
+			mparameters[remaining] = parameters[i];
+			mflags[remaining] = PWVERIFY_FLAG_NONE;
+			mresults[remaining] = false;
+			index[remaining] = i;
+			remaining++;
+		}
 
+		if (! remaining)
 			continue;
-		}
 
-		if (ci->crypt)
+		if (ci->verify_multi && remaining > 1)
+			(void) ci->verify_multi((const char *const *) mpasswords, (const char *const *) mparameters, mflags,
+			                        mresults, remaining);
+		else
+			for (size_t j = 0; j < remaining; j++)
+				mresults[j] = ci->verify(mpasswords[j], mparameters[j], &mflags[j]);
+
+		for (size_t j = 0; j < remaining; j++)
 		{
-			const char *const result = ci->crypt(password, parameters);
+			const size_t i = index[j];
 
-			if (result && strcmp(result, parameters) == 0)
-				return ci;
+			if (owners[i])
+			{
+				finished[i] = true;
+			}
+			else
+			{
+				probe_calls++;
 
-			continue;
+				if (mresults[j] || (mflags[j] & PWVERIFY_FLAG_MYMODULE))
+					finished[i] = true;
+			}
+
+			if (mresults[j])
+			{
+				flags[i] = mflags[j];
+				results[i] = ci;
+			}
 		}
 	}
 
-	return NULL;
+	for (size_t i = 0; i < count; i++)
+	{
+		decided[i] = (finished[i] || ! skipped[i]);
+
+		// Those left to the main thread are counted there
+		if (! decided[i])
+			continue;
+
+		if (owners[i])
+			dispatched++;
+		else
+			probed++;
+	}
+
+	(void) crypt_stats_add(dispatched, probed, probe_calls);
+
+	(void) sfree(mpasswords);
+	(void) sfree(mparameters);
+	(void) sfree(mflags);
+	(void) sfree(mresults);
+	(void) sfree(index);
+	(void) sfree(finished);
+	(void) sfree(skipped);
+	(void) sfree(owners);
+}
+
+/* Encrypts password with the provider ci into buf. The provider's own result
+ * buffer is only used with crypt_output_lock held, so that this can be called
+ * from a password verification thread (for a provider marked threadsafe) while
+ * the main thread encrypts other passwords.
+ */
+bool ATHEME_FATTR_WUR
+crypt_password_using(const struct crypt_impl *const restrict ci, const char *const restrict password,
+                     char *const restrict buf, const size_t buflen)
+{
+	return_val_if_fail(ci != NULL, false);
+	return_val_if_fail(ci->crypt != NULL, false);
+	return_val_if_fail(buf != NULL, false);
+
+#ifdef HAVE_USABLE_PTHREAD
+	(void) pthread_mutex_lock(&crypt_output_lock);
+#endif
+
+	const char *const result = ci->crypt(password, NULL);
+	const bool ok = (result && mowgli_strlcpy(buf, result, buflen) < buflen);
+
+#ifdef HAVE_USABLE_PTHREAD
+	(void) pthread_mutex_unlock(&crypt_output_lock);
+#endif
+
+	return ok;
+}
+
+/* Which provider owns the prefix of the hash in parameters, or NULL if none
+ * does (the legacy formats without one, or the owner is not loaded).
+ */
+const struct crypt_impl *
+crypt_get_hash_provider(const char *const restrict parameters)
+{
+	return_val_if_fail(parameters != NULL, NULL);
+
+	return crypt_prefix_owner(parameters);
 }
 
 const char *
@@ -187,9 +495,9 @@ crypt_password(const char *const restrict password)
 
 		encryption_capable_module = true;
 
-		const char *const result = ci->crypt(password, NULL);
+		static char result[PASSLEN + 1];
 
-		if (! result)
+		if (! crypt_password_using(ci, password, result, sizeof result))
 		{
 			(void) slog(LG_ERROR, "%s: ci->crypt() failed for provider '%s'", MOWGLI_FUNC_NAME, ci->id);
 			continue;
@@ -206,3 +514,19 @@ crypt_password(const char *const restrict password)
 
 	return NULL;
 }
+
+void
+crypt_get_verify_stats(struct crypt_verify_stats *const restrict stats)
+{
+	return_if_fail(stats != NULL);
+
+#ifdef HAVE_USABLE_PTHREAD
+	(void) pthread_mutex_lock(&crypt_stats_lock);
+#endif
+
+	*stats = crypt_stats;
+
+#ifdef HAVE_USABLE_PTHREAD
+	(void) pthread_mutex_unlock(&crypt_stats_lock);
+#endif
+}
@@ -18,8 +18,82 @@
 
 static mowgli_patricia_t *itranslation_tree; /* internal translations, userserv/nickserv etc */
 static mowgli_patricia_t *translation_tree; /* language translations */
+static struct translation_cache translation_get_cache; /* translation_get() results */
 
 static bool languages_available = false;
+static struct language *language_active = NULL;
+static mowgli_list_t language_list;
+
+/* The same few hundred format strings are translated over and over (every
+ * line of LIST, INFO or HELP output), so each language remembers what it
+ * translated them to, by the address of the untranslated string: a repeat
+ * costs one probe of an open-addressed table. Those addresses are only
+ * stable while the module they are in stays loaded, so module_unload()
+ * throws everything away with translation_cache_flush().
+ */
+#define TRANSLATION_CACHE_MIN   64U
+
+static inline size_t
+translation_cache_slot(const struct translation_cache *const tc, const char *const key)
+{
+	// Fibonacci hashing; the low bits of an address are mostly alignment
+	return (size_t) (((uint64_t) (uintptr_t) key * UINT64_C(0x9E3779B97F4A7C15)) >> 32U) & (tc->size - 1U);
+}
+
+static const char *
+translation_cache_find(const struct translation_cache *const tc, const char *const key)
+{
+	if (! tc->count)
+		return NULL;
+
+	for (size_t i = translation_cache_slot(tc, key); tc->entries[i].key != NULL; i = (i + 1U) & (tc->size - 1U))
+		if (tc->entries[i].key == key)
+			return tc->entries[i].value;
+
+	return NULL;
+}
+
+static void
+translation_cache_insert(struct translation_cache *const tc, const char *const key, const char *const value)
+{
+	size_t i = translation_cache_slot(tc, key);
+
+	while (tc->entries[i].key != NULL)
+		i = (i + 1U) & (tc->size - 1U);
+
+	tc->entries[i].key = key;
+	tc->entries[i].value = value;
+	tc->count++;
+}
+
+static void
+translation_cache_add(struct translation_cache *const tc, const char *const key, const char *const value)
+{
+	// Kept at most half full, so that misses stay short too
+	if ((tc->count + 1U) * 2U > tc->size)
+	{
+		const struct translation_cache old = *tc;
+
+		tc->size = old.size ? (old.size * 2U) : TRANSLATION_CACHE_MIN;
+		tc->entries = scalloc(tc->size, sizeof *tc->entries);
+		tc->count = 0;
+
+		for (size_t i = 0; i < old.size; i++)
+			if (old.entries[i].key != NULL)
+				translation_cache_insert(tc, old.entries[i].key, old.entries[i].value);
+
+		sfree(old.entries);
+	}
+
+	translation_cache_insert(tc, key, value);
+}
+
+static void
+translation_cache_clear(struct translation_cache *const tc)
+{
+	sfree(tc->entries);
+	(void) memset(tc, 0x00, sizeof *tc);
+}
 
 /*
  * translation_init()
@@ -59,18 +133,54 @@ translation_init(void)
 const char *
 translation_get(const char *str)
 {
+	const char *const orig = str;
+	const char *cached;
 	struct translation *t;
 
+	if ((cached = translation_cache_find(&translation_get_cache, orig)) != NULL)
+		return cached;
+
 	/* See if an internal substitution is present. */
 	if ((t = mowgli_patricia_retrieve(itranslation_tree, str)) != NULL)
 		str = t->replacement;
 
 	if ((t = mowgli_patricia_retrieve(translation_tree, str)) != NULL)
-		return t->replacement;
+		str = t->replacement;
 
+	translation_cache_add(&translation_get_cache, orig, str);
 	return str;
 }
 
+/*
+ * translation_cache_flush()
+ *
+ * Forgets every translation looked up so far, by translation_get() and
+ * in every language.
+ *
+ * Inputs:
+ *     - none
+ *
+ * Outputs:
+ *     - none
+ *
+ * Side Effects:
+ *     - the translation caches are emptied
+ */
+void
+translation_cache_flush(void)
+{
+	mowgli_node_t *n;
+
+	translation_cache_clear(&translation_get_cache);
+
+	MOWGLI_ITER_FOREACH(n, language_list.head)
+	{
+		struct language *const lang = n->data;
+
+		translation_cache_clear(&lang->cache);
+	}
+}
+
 /*
  * itranslation_create(const char *str, const char *trans)
  *
@@ -92,6 +202,7 @@ itranslation_create(const char *str, const char *trans)
 	t->replacement = sstrdup(trans);
 
 	mowgli_patricia_add(itranslation_tree, t->name, t);
+	translation_cache_clear(&translation_get_cache);
 }
 
 /*
@@ -114,6 +225,8 @@ itranslation_destroy(const char *str)
 	if (t == NULL)
 		return;
 
+	translation_cache_clear(&translation_get_cache);
+
 	sfree(t->name);
 	sfree(t->replacement);
 	sfree(t);
@@ -148,6 +261,7 @@ translation_create(const char *str, const char *trans)
 	t->replacement = sstrdup(buf);
 
 	mowgli_patricia_add(translation_tree, t->name, t);
+	translation_cache_clear(&translation_get_cache);
 }
 
 /*
@@ -170,6 +284,8 @@ translation_destroy(const char *str)
 	if (t == NULL)
 		return;
 
+	translation_cache_clear(&translation_get_cache);
+
 	sfree(t->name);
 	sfree(t->replacement);
 	sfree(t);
@@ -177,11 +293,10 @@ translation_destroy(const char *str)
 
 enum
 {
-	LANG_VALID = 1		/* have catalogs for this */
+	LANG_VALID = 1,		/* have catalogs for this */
+	LANG_PRELOAD = 2	/* in use, see language_preload() */
 };
 
-static mowgli_list_t language_list;
-
 void
 language_init(void)
 {
@@ -298,24 +413,119 @@ language_set_active(struct language *lang)
 	if (! languages_available)
 		return;
 
-	static struct language *currlang;
-
 	if (lang == NULL)
 	{
 		lang = language_find(config_options.language);
 		if (lang == NULL)
 			lang = language_find("en");
 	}
-	if (currlang == lang)
+	if (language_active == lang)
 		return;
 	slog(LG_DEBUG, "language_set_active(): changing language from [%s] to [%s]",
-			currlang != NULL ? currlang->name : "default",
+			language_active != NULL ? language_active->name : "default",
 			lang->name);
 	setlocale(LC_MESSAGES, lang->name);
 	textdomain(PACKAGE_TARNAME);
 	bindtextdomain(PACKAGE_TARNAME, LOCALEDIR);
-	currlang = lang;
-	setenv("LANGUAGE", currlang->name, 1);
+	language_active = lang;
+	setenv("LANGUAGE", language_active->name, 1);
+#endif
+}
+
+#ifdef ENABLE_NLS
+/*
+ * language_gettext(const char *msgid)
+ *
+ * What _() expands to: gettext(3), remembered per language.
+ *
+ * Inputs:
+ *     - string to translate into the active language
+ *
+ * Outputs:
+ *     - the translated string, or msgid if there is none
+ *
+ * Side Effects:
+ *     - the translation is cached on the active language
+ */
+const char *
+language_gettext(const char *const msgid)
+{
+	struct language *const lang = language_active;
+	const char *str;
+
+	// Nothing chosen yet; the process locale applies
+	if (lang == NULL)
+		return gettext(msgid);
+
+	if ((str = translation_cache_find(&lang->cache, msgid)) != NULL)
+		return str;
+
+	str = gettext(msgid);
+	translation_cache_add(&lang->cache, msgid, str);
+
+	return str;
+}
+#endif /* ENABLE_NLS */
+
+/*
+ * language_preload()
+ *
+ * Loads the message catalogs of the default language and of every language
+ * an account has chosen, so that the first user of each does not wait for
+ * it. Called once the database is loaded.
+ *
+ * Inputs:
+ *     - none
+ *
+ * Outputs:
+ *     - none
+ *
+ * Side Effects:
+ *     - the languages in use are made active in turn, then the default
+ */
+void
+language_preload(void)
+{
+#ifdef ENABLE_NLS
+	struct myentity_iteration_state state;
+	struct myentity *mt;
+	struct language *lang;
+	mowgli_node_t *n;
+
+	if (! languages_available)
+		return;
+
+	if ((lang = language_find(config_options.language)) != NULL)
+		lang->flags |= LANG_PRELOAD;
+
+	MYENTITY_FOREACH_T(mt, &state, ENT_USER)
+	{
+		struct myuser *const mu = user(mt);
+
+		if (mu->language != NULL)
+			mu->language->flags |= LANG_PRELOAD;
+	}
+
+	MOWGLI_ITER_FOREACH(n, language_list.head)
+	{
+		lang = n->data;
+
+		if (! (lang->flags & LANG_PRELOAD))
+			continue;
+
+		lang->flags &= ~LANG_PRELOAD;
+
+		if (! (lang->flags & LANG_VALID))
+			continue;
+
+		slog(LG_DEBUG, "language_preload(): %s", lang->name);
+
+		// The catalog header; looking anything up loads the whole catalog
+		language_set_active(lang);
+		(void) gettext("");
+	}
+
+	language_set_active(NULL);
 #endif
 }
 
@@ -11,8 +11,69 @@
 #include <atheme.h>
 #include "internal.h"
 
+#ifdef HAVE_LIBZ
+#  include <zlib.h>
+#endif
+
+#define DB_TYPE_CACHE_SIZE      64U
+#define DB_TYPE_CACHE_NAMELEN   16U
+
 static mowgli_patricia_t *db_types = NULL;
 
+/* A loaded database is tens of millions of rows of a few dozen types, so
+ * db_process() remembers which handler each type token resolved to (the
+ * ??? handler included) in a small direct-mapped cache, instead of walking
+ * db_types for every row. Registering or unregistering a handler empties it.
+ */
+struct db_type_cache_entry
+{
+	char                    name[DB_TYPE_CACHE_NAMELEN];
+	database_handler_fn     fun;
+};
+
+static struct db_type_cache_entry db_type_cache[DB_TYPE_CACHE_SIZE];
+
+#define DB_LOAD_STATS_MAX       64U
+
+/* While db_parse() runs, the time between row type changes is charged to the
+ * type of the run that just ended (its handlers and the reading of its rows),
+ * and logged per type once the load is over; types past the first
+ * DB_LOAD_STATS_MAX are counted together.
+ */
+struct db_load_stat
+{
+	char                    name[DB_TYPE_CACHE_NAMELEN];
+	unsigned long long      rows;
+	unsigned long long      usec;
+};
+
+static struct db_load_stat *db_load_stats = NULL;
+static unsigned int db_load_nstats = 0;
+static struct db_load_stat *db_load_cur = NULL;
+static struct timeval db_load_mark;
+
+static inline void
+db_type_cache_flush(void)
+{
+	(void) memset(db_type_cache, 0x00, sizeof db_type_cache);
+}
+
+// Case-insensitive like db_types itself; returns NULL for names too long to cache
+static inline struct db_type_cache_entry *
+db_type_cache_slot(const char *const restrict type)
+{
+	unsigned int hash = 0x811C9DC5U;
+	size_t len = 0;
+
+	for (; type[len] != '\0'; len++)
+		hash = (hash ^ (unsigned char) tolower((unsigned char) type[len])) * 0x01000193U;
+
+	if (len >= DB_TYPE_CACHE_NAMELEN)
+		return NULL;
+
+	return &db_type_cache[(hash ^ (hash >> 16)) % DB_TYPE_CACHE_SIZE];
+}
+
 const struct database_module *db_mod = NULL;
 
 struct database_handle *
@@ -33,13 +94,101 @@ db_close(struct database_handle *db)
 	return db_mod->db_close(db);
 }
 
+static void
+db_load_charge(void)
+{
+	struct timeval now, elapsed;
+
+	s_time(&now);
+
+	if (db_load_cur != NULL)
+	{
+		timersub(&now, &db_load_mark, &elapsed);
+		db_load_cur->usec += (unsigned long long) elapsed.tv_sec * 1000000ULL + (unsigned long long) elapsed.tv_usec;
+	}
+
+	db_load_mark = now;
+}
+
+static void
+db_load_count(const char *const restrict type)
+{
+	if (db_load_cur != NULL && strcasecmp(db_load_cur->name, type) == 0)
+	{
+		db_load_cur->rows++;
+		return;
+	}
+
+	db_load_charge();
+
+	unsigned int i;
+
+	for (i = 0; i < db_load_nstats; i++)
+		if (strcasecmp(db_load_stats[i].name, type) == 0)
+			break;
+
+	if (i == db_load_nstats)
+	{
+		if (db_load_nstats < DB_LOAD_STATS_MAX - 1U && strlen(type) < DB_TYPE_CACHE_NAMELEN)
+			(void) mowgli_strlcpy(db_load_stats[db_load_nstats++].name, type, DB_TYPE_CACHE_NAMELEN);
+		else
+		{
+			i = DB_LOAD_STATS_MAX - 1U;
+			(void) mowgli_strlcpy(db_load_stats[i].name, "(other)", DB_TYPE_CACHE_NAMELEN);
+		}
+	}
+
+	db_load_cur = &db_load_stats[i];
+	db_load_cur->rows++;
+}
+
+static int
+db_load_stat_cmp(const void *const restrict a, const void *const restrict b)
+{
+	const struct db_load_stat *const sa = a;
+	const struct db_load_stat *const sb = b;
+
+	if (sa->usec != sb->usec)
+		return (sa->usec < sb->usec) - (sa->usec > sb->usec);
+
+	return (sa->rows < sb->rows) - (sa->rows > sb->rows);
+}
+
 void
 db_parse(struct database_handle *db)
 {
 	return_if_fail(db_mod != NULL);
 	return_if_fail(db_mod->db_parse != NULL);
 
-	return db_mod->db_parse(db);
+	if (db_load_stats != NULL)
+		return db_mod->db_parse(db);
+
+	struct timeval started, elapsed;
+	unsigned long long rows = 0;
+
+	db_load_stats = smalloc(DB_LOAD_STATS_MAX * sizeof *db_load_stats);
+	db_load_nstats = 0;
+	db_load_cur = NULL;
+
+	s_time(&started);
+	db_mod->db_parse(db);
+	db_load_charge();
+	e_time(started, &elapsed);
+
+	qsort(db_load_stats, DB_LOAD_STATS_MAX, sizeof *db_load_stats, &db_load_stat_cmp);
+
+	for (unsigned int i = 0; i < DB_LOAD_STATS_MAX; i++)
+		rows += db_load_stats[i].rows;
+
+	slog(LG_INFO, "db_parse(): loaded %llu rows from %s in %d ms", rows, db->file, tv2ms(&elapsed));
+
+	for (unsigned int i = 0; i < DB_LOAD_STATS_MAX && db_load_stats[i].rows; i++)
+		slog(LG_INFO, "db_parse():     %-8s %10llu rows %8llu ms", db_load_stats[i].name,
+		              db_load_stats[i].rows, db_load_stats[i].usec / 1000ULL);
+
+	sfree(db_load_stats);
+	db_load_stats = NULL;
+	db_load_cur = NULL;
 }
 
 bool
@@ -251,6 +400,7 @@ db_register_type_handler(const char *type, database_handler_fn fun)
 	return_if_fail(fun != NULL);
 
 	mowgli_patricia_add(db_types, type, fun);
+	db_type_cache_flush();
 }
 
 void
@@ -260,6 +410,19 @@ db_unregister_type_handler(const char *type)
 	return_if_fail(type != NULL);
 
 	mowgli_patricia_delete(db_types, type);
+	db_type_cache_flush();
+}
+
+/* Returns the handler for a row type, or NULL if there is none; backends
+ * that number their row types can look each one up only once.
+ */
+database_handler_fn
+db_resolve_type_handler(const char *type)
+{
+	return_val_if_fail(db_types != NULL, NULL);
+	return_val_if_fail(type != NULL, NULL);
+
+	return mowgli_patricia_retrieve(db_types, type);
 }
 
 void
@@ -271,6 +434,17 @@ db_process(struct database_handle *db, const char *type)
 	return_if_fail(db != NULL);
 	return_if_fail(type != NULL);
 
+	if (db_load_stats != NULL)
+		db_load_count(type);
+
+	struct db_type_cache_entry *const slot = db_type_cache_slot(type);
+
+	if (slot != NULL && slot->fun != NULL && strcasecmp(slot->name, type) == 0)
+	{
+		slot->fun(db, type);
+		return;
+	}
+
 	fun = mowgli_patricia_retrieve(db_types, type);
 
 	if (!fun)
@@ -278,6 +452,27 @@ db_process(struct database_handle *db, const char *type)
 		fun = mowgli_patricia_retrieve(db_types, "???");
 	}
 
+	if (slot != NULL)
+	{
+		(void) mowgli_strlcpy(slot->name, type, sizeof slot->name);
+		slot->fun = fun;
+	}
+
+	fun(db, type);
+}
+
+// For backends that resolved the row's handler themselves
+void
+db_process_resolved(struct database_handle *const restrict db, const char *const restrict type,
+                    const database_handler_fn fun)
+{
+	return_if_fail(db != NULL);
+	return_if_fail(type != NULL);
+	return_if_fail(fun != NULL);
+
+	if (db_load_stats != NULL)
+		db_load_count(type);
+
 	fun(db, type);
 }
 
@@ -294,14 +489,431 @@ db_write_format(struct database_handle *db, const char *fmt, ...)
 	return db_write_word(db, buf);
 }
 
+/* Backends write through a struct db_output, which gzip-compresses the
+ * stream on its way to the file when general::db_compress_level is set, and
+ * read through db_input_decompress(), so that either kind of file loads.
+ */
+#define DB_OUTPUT_GZBUFSIZE     (256U * 1024U)
+
+// Uncompressed size of the database most recently written, for corestorage
+unsigned long long db_output_last_bytes = 0;
+
+bool
+db_output_open(struct db_output *const restrict out, const int fd, const char *const restrict path)
+{
+	return_val_if_fail(out != NULL, false);
+
+	(void) memset(out, 0x00, sizeof *out);
+
+#ifdef HAVE_LIBZ
+	if (config_options.db_compress_level)
+	{
+		// "wb" and any unsigned int
+		char mode[16];
+		const int ret = snprintf(mode, sizeof mode, "wb%u", config_options.db_compress_level);
+
+		if (ret < 0 || (size_t) ret >= sizeof mode || ! (out->gz = gzdopen(fd, mode)))
+		{
+			slog(LG_ERROR, "db_output_open(): cannot start compressing '%s'", path);
+			return false;
+		}
+
+		(void) gzbuffer(out->gz, DB_OUTPUT_GZBUFSIZE);
+		return true;
+	}
+#else
+	(void) path;
+#endif
+
+	return (out->f = fdopen(fd, "wb")) != NULL;
+}
+
+void
+db_output_write(struct db_output *const restrict out, const void *const restrict data, const size_t len)
+{
+	if (! len)
+		return;
+
+	out->bytes += len;
+
+#ifdef HAVE_LIBZ
+	if (out->gz != NULL)
+	{
+		if (gzwrite(out->gz, data, (unsigned int) len) != (int) len)
+			out->error = true;
+
+		return;
+	}
+#endif
+
+	if (fwrite(data, 1, len, out->f) != len)
+		out->error = true;
+}
+
+// Returns false if anything written could not be
+bool
+db_output_close(struct db_output *const restrict out)
+{
+	bool ok = ! out->error;
+
+#ifdef HAVE_LIBZ
+	if (out->gz != NULL)
+	{
+		if (gzclose(out->gz) != Z_OK)
+			ok = false;
+	}
+	else
+#endif
+	if (fflush(out->f) != 0 || ferror(out->f) || fclose(out->f) != 0)
+		ok = false;
+
+	out->f = NULL;
+	out->gz = NULL;
+	db_output_last_bytes = out->bytes;
+
+	return ok;
+}
+
+/*
+ * db_input_decompress(FILE *f, const char *path, size_t *len)
+ *
+ * If f (open at its start) holds a gzip-compressed database, decompresses
+ * all of it into memory and returns that; otherwise rewinds f and returns
+ * NULL, and the backend reads f as usual. We exit if the file cannot be
+ * decompressed, rather than load half a database and save that over it.
+ *
+ * The buffer is NUL-terminated (not counted in len) and must be freed.
+ */
+char *
+db_input_decompress(FILE *const restrict f, const char *const restrict path, size_t *const restrict len)
+{
+	unsigned char magic[2];
+
+	return_val_if_fail(f != NULL, NULL);
+	return_val_if_fail(len != NULL, NULL);
+
+	const bool gzipped = (fread(magic, 1, sizeof magic, f) == sizeof magic && magic[0] == 0x1FU && magic[1] == 0x8BU);
+
+	rewind(f);
+
+	if (! gzipped)
+		return NULL;
+
+#ifdef HAVE_LIBZ
+	const int fd = dup(fileno(f));
+	gzFile gz;
+
+	if (fd < 0 || ! (gz = gzdopen(fd, "rb")))
+	{
+		slog(LG_ERROR, "db-open-read: cannot decompress '%s': %s", path, strerror(errno));
+		exit(EXIT_FAILURE);
+	}
+
+	(void) gzbuffer(gz, DB_OUTPUT_GZBUFSIZE);
+
+	size_t size = DB_OUTPUT_GZBUFSIZE;
+	char *buf = smalloc(size + 1);
+	int n;
+
+	*len = 0;
+
+	while ((n = gzread(gz, buf + *len, (unsigned int) (size - *len))) > 0)
+	{
+		*len += (size_t) n;
+
+		if (*len == size)
+		{
+			size *= 2U;
+			buf = srealloc(buf, size + 1);
+		}
+	}
+
+	if (n < 0)
+	{
+		int zerr;
+
+		slog(LG_ERROR, "db-open-read: cannot decompress '%s': %s", path, gzerror(gz, &zerr));
+		exit(EXIT_FAILURE);
+	}
+
+	(void) gzclose(gz);
+
+	buf[*len] = '\0';
+
+	slog(LG_DEBUG, "db-open-read: decompressed '%s' to %zu bytes", path, *len);
+
+	return buf;
+#else
+	slog(LG_ERROR, "db-open-read: database '%s' is compressed, but services were built without zlib", path);
+	exit(EXIT_FAILURE);
+#endif
+}
+
+static mowgli_patricia_t *db_shards = NULL;
+static bool db_shards_loaded = false;
+static char db_shards_base[BUFSIZE] = "services.db";
+
+static struct db_shard *
+db_shard_get(const char *const restrict name)
+{
+	struct db_shard *shard;
+
+	if ((shard = mowgli_patricia_retrieve(db_shards, name)) != NULL)
+		return shard;
+
+	shard = smalloc(sizeof *shard);
+	shard->name = sstrdup(name);
+
+	(void) mowgli_patricia_add(db_shards, shard->name, shard);
+
+	return shard;
+}
+
+// relative to datadir, as db_open() wants it, or absolute; false if it does not fit
+static bool
+db_shard_path(const struct db_shard *const restrict shard, char *const restrict buf, const size_t bufsize,
+              const bool absolute)
+{
+	int ret;
+
+	if (absolute)
+		ret = snprintf(buf, bufsize, "%s/%s.%s", datadir, db_shards_base, shard->name);
+	else
+		ret = snprintf(buf, bufsize, "%s.%s", db_shards_base, shard->name);
+
+	if (ret < 0 || (size_t) ret >= bufsize)
+	{
+		slog(LG_ERROR, "db_shard_path(): the path of shard %s is too long", shard->name);
+		return false;
+	}
+
+	return true;
+}
+
+static void
+db_shards_set_base(const char *const restrict filename)
+{
+	(void) mowgli_strlcpy(db_shards_base, (filename != NULL) ? filename : "services.db", sizeof db_shards_base);
+}
+
+// Opens a listed shard's file, or returns NULL if there is nothing to load
+static struct database_handle *
+db_shard_open_read(const struct db_shard *const restrict shard)
+{
+	char path[BUFSIZE];
+
+	if (! shard->listed)
+		return NULL;
+
+	if (! db_shard_path(shard, path, sizeof path, true))
+		return NULL;
+
+	if (access(path, F_OK) != 0)
+	{
+		slog(LG_ERROR, "db_shards_load(): %s is listed in the database but missing", path);
+		return NULL;
+	}
+
+	if (! db_shard_path(shard, path, sizeof path, false))
+		return NULL;
+
+	return db_open(path, DB_READ);
+}
+
+static void
+db_h_shard(struct database_handle *const restrict db, const char ATHEME_VATTR_UNUSED *const restrict type)
+{
+	db_shard_get(db_sread_word(db))->listed = true;
+}
+
+// db_write hook: every shard we know of, registered or not, so that none is forgotten while its module is unloaded
+static void
+db_shards_write_list(struct database_handle *const restrict db)
+{
+	mowgli_patricia_iteration_state_t state;
+	struct db_shard *shard;
+
+	MOWGLI_PATRICIA_FOREACH(shard, &state, db_shards)
+	{
+		if (shard->fun == NULL && ! shard->listed)
+			continue;
+
+		db_start_row(db, "SHARD");
+		db_write_word(db, shard->name);
+		db_commit_row(db);
+	}
+}
+
+/*
+ * db_shard_register(const char *name, database_shard_write_fn fun)
+ *
+ * Gives the calling module a shard; fun writes all of its rows, the way a
+ * db_write hook would, whenever the shard has been marked dirty. A module
+ * loaded after the database calls db_shard_load() once its row handlers
+ * are registered, unless it kept its data across a reload.
+ *
+ * Returns the shard, or NULL if one of that name is already registered.
+ */
+struct db_shard *
+db_shard_register(const char *const restrict name, const database_shard_write_fn fun)
+{
+	return_val_if_fail(name != NULL, NULL);
+	return_val_if_fail(fun != NULL, NULL);
+
+	struct db_shard *const shard = db_shard_get(name);
+
+	if (shard->fun != NULL)
+	{
+		slog(LG_ERROR, "db_shard_register(): shard '%s' is already registered", name);
+		return NULL;
+	}
+
+	shard->fun = fun;
+
+	// until loaded (or if never written), its rows are only in memory or in the main database
+	shard->dirty = true;
+
+	return shard;
+}
+
+// Loads a shard registered after the database was; its rows would otherwise wait for the next restart
+void
+db_shard_load(struct db_shard *const restrict shard)
+{
+	return_if_fail(shard != NULL);
+
+	if (! db_shards_loaded)
+		return;
+
+	struct database_handle *const db = db_shard_open_read(shard);
+
+	if (db == NULL)
+		return;
+
+	db_parse(db);
+	db_close(db);
+
+	shard->dirty = false;
+}
+
+// Unsaved changes are lost, as they were with a db_write hook; the file stays for the next load
+void
+db_shard_unregister(struct db_shard *const restrict shard)
+{
+	return_if_fail(shard != NULL);
+
+	shard->fun = NULL;
+	shard->dirty = false;
+}
+
+void
+db_shard_dirty(struct db_shard *const restrict shard)
+{
+	return_if_fail(shard != NULL);
+
+	shard->dirty = true;
+	db_change_note(DB_CHANGE_OTHER);
+}
+
+/*
+ * db_shards_load(const char *filename)
+ *
+ * Called by the storage layer once the main database has been loaded.
+ * All the shard files are opened before any of them is parsed, so that
+ * the backends' readers (the opensex row scanner thread, or the kernel's
+ * readahead) fetch them all at once; the rows themselves are handled one
+ * shard at a time, since the handlers build core state.
+ */
+void
+db_shards_load(const char *const restrict filename)
+{
+	mowgli_patricia_iteration_state_t state;
+	struct database_handle **dbs;
+	struct db_shard **shards;
+	struct db_shard *shard;
+	unsigned int count = 0;
+
+	db_shards_set_base(filename);
+
+	dbs = smalloc((mowgli_patricia_size(db_shards) + 1) * sizeof *dbs);
+	shards = smalloc((mowgli_patricia_size(db_shards) + 1) * sizeof *shards);
+
+	MOWGLI_PATRICIA_FOREACH(shard, &state, db_shards)
+	{
+		if (shard->fun == NULL)
+			continue;
+
+		if ((dbs[count] = db_shard_open_read(shard)) != NULL)
+			shards[count++] = shard;
+	}
+
+	for (unsigned int i = 0; i < count; i++)
+	{
+		db_parse(dbs[i]);
+		db_close(dbs[i]);
+
+		// handlers may have marked it while recreating its rows
+		shards[i]->dirty = false;
+	}
+
+	slog(LG_DEBUG, "db_shards_load(): loaded %u shard(s)", count);
+
+	sfree(shards);
+	sfree(dbs);
+
+	db_shards_loaded = true;
+}
+
+/*
+ * db_shards_save(const char *filename)
+ *
+ * Rewrites the dirty shards. The storage layer calls this on the main
+ * loop before it writes the main database, and never while a write of
+ * its own is still open.
+ */
+void
+db_shards_save(const char *const restrict filename)
+{
+	mowgli_patricia_iteration_state_t state;
+	struct db_shard *shard;
+	char path[BUFSIZE];
+
+	db_shards_set_base(filename);
+
+	MOWGLI_PATRICIA_FOREACH(shard, &state, db_shards)
+	{
+		if (shard->fun == NULL || ! shard->dirty)
+			continue;
+
+		if (! db_shard_path(shard, path, sizeof path, false))
+			continue;
+
+		struct database_handle *const db = db_open(path, DB_WRITE);
+
+		if (db == NULL)
+			continue;
+
+		// cleared before fun runs, so that anything it marks dirty again is written next time
+		shard->dirty = false;
+		shard->fun(db);
+		db_close(db);
+
+		slog(LG_DEBUG, "db_shards_save(): wrote %s", path);
+	}
+}
+
 void
 db_init(void)
 {
 	db_types = mowgli_patricia_create(strcasecanon);
+	db_shards = mowgli_patricia_create(NULL);
 
-	if (db_types == NULL)
+	if (db_types == NULL || db_shards == NULL)
 	{
 		slog(LG_ERROR, "db_init(): object allocator failure");
 		exit(EXIT_FAILURE);
 	}
+
+	db_register_type_handler("SHARD", &db_h_shard);
+	(void) hook_add_db_write(&db_shards_write_list);
 }
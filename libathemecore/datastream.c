@@ -18,6 +18,18 @@
 
 #define SENDQSIZE (4096 - 40)
 
+/* the uplink's recvq is read in much larger blocks, so that a burst is
+ * parsed in place (see recvq_peekline()) with few recv() calls and few
+ * lines split across two blocks
+ */
+#define RECVQSIZE_UPLINK (65536 - 40)
+
+/* most slabs sendq_flush() hands to a single writev() */
+#define SENDQ_IOV_MAX 64
+
+/* longest line sendq_add_vline() formats, excluding the \r\n */
+#define SENDQ_LINE_MAX 510
+
 #ifdef MOWGLI_OS_WIN
 # define EWOULDBLOCK	WSAEWOULDBLOCK
 # define EALREADY	WSAEALREADY
@@ -29,9 +41,144 @@ struct sendq {
 	mowgli_node_t node;
 	int firstused; /* offset of first used byte */
 	int firstfree; /* 1 + offset of last used byte */
-	char buf[SENDQSIZE];
+	int size; /* size of buf; always SENDQSIZE in a sendq */
+	bool pooled; /* counted in sendq_pool.bytes */
+	char buf[];
 };
 
+/* Slabs of SENDQSIZE that are freed go on a free list, up to SENDQ_POOL_KEEP
+ * of them, for the next sendq or recvq that needs one; the uplink's larger
+ * recvq blocks are not kept. What the slabs of connections other than the
+ * uplink hold is counted in sendq_pool, and those connections are dropped
+ * rather than let the total go over general::sendq_pool_limit, or hold more
+ * than 1/SENDQ_POOL_SHARE of it themselves.
+ */
+#define SENDQ_POOL_KEEP 256U
+#define SENDQ_POOL_SHARE 4U
+
+struct sendq_pool_stats sendq_pool = { 0, 0, 0, 0 };
+static mowgli_list_t sendq_pool_free = { NULL, NULL, 0 };
+
+static mowgli_eventloop_timer_t *sendq_resume_timer = NULL;
+
+static struct sendq *
+sendq_chunk_new(const struct connection *cptr, int size)
+{
+	struct sendq *sq;
+
+	if (size == SENDQSIZE && sendq_pool_free.head != NULL)
+	{
+		sq = sendq_pool_free.head->data;
+		mowgli_node_delete(&sq->node, &sendq_pool_free);
+		sendq_pool.cached--;
+
+		sq->firstused = sq->firstfree = 0;
+	}
+	else
+	{
+		sq = smalloc(sizeof *sq + (size_t) size);
+		sq->size = size;
+	}
+
+	sq->pooled = !CF_IS_UPLINK(cptr);
+
+	if (sq->pooled)
+	{
+		sendq_pool.bytes += (size_t) size;
+		if (sendq_pool.bytes > sendq_pool.peak)
+			sendq_pool.peak = sendq_pool.bytes;
+	}
+
+	return sq;
+}
+
+static void
+sendq_chunk_free(struct sendq *sq)
+{
+	if (sq->pooled)
+		sendq_pool.bytes -= (size_t) sq->size;
+
+	if (sq->size == SENDQSIZE && sendq_pool.cached < SENDQ_POOL_KEEP)
+	{
+		mowgli_node_add(sq, &sq->node, &sendq_pool_free);
+		sendq_pool.cached++;
+		return;
+	}
+
+	sfree(sq);
+}
+
+/* whether len more bytes would put the connection over its own sendq limit
+ * or its share of the pool; if so, it is marked dead
+ */
+static bool
+sendq_over_quota(struct connection *cptr, size_t len)
+{
+	const size_t queued = MOWGLI_LIST_LENGTH(&cptr->sendq) * SENDQSIZE;
+	const size_t pool_limit = config_options.sendq_pool_limit;
+
+	if (cptr->sendq_limit != 0 && queued + len > cptr->sendq_limit)
+	{
+		slog(LG_INFO, "sendq_add(): sendq limit exceeded on connection %s[%d]",
+				cptr->name, cptr->fd);
+		cptr->flags |= CF_DEAD;
+		return true;
+	}
+
+	if (pool_limit != 0 && !CF_IS_UPLINK(cptr) &&
+			(sendq_pool.bytes + len > pool_limit || queued + len > pool_limit / SENDQ_POOL_SHARE))
+	{
+		slog(LG_INFO, "sendq_add(): sendq pool limit exceeded on connection %s[%d] (%zu bytes in use)",
+				cptr->name, cptr->fd, sendq_pool.bytes);
+		sendq_pool.refused++;
+		cptr->flags |= CF_DEAD;
+		return true;
+	}
+
+	return false;
+}
+
+/* adds a slab to the end of the sendq, noting when that takes the sendq
+ * over its high watermark
+ */
+static struct sendq *
+sendq_chunk_append(struct connection *cptr)
+{
+	struct sendq *sq = sendq_chunk_new(cptr, SENDQSIZE);
+
+	mowgli_node_add(sq, &sq->node, &cptr->sendq);
+
+	if (cptr->sendq_high != 0 && sendq_length(cptr) >= cptr->sendq_high)
+		cptr->flags = (cptr->flags | CF_SENDQ_FULL) & ~CF_SENDQ_RESUME;
+
+	return sq;
+}
+
+/* calls sendq_resume for the connections whose sendq has drained down to
+ * the low watermark; done from a timer, as that is noticed in the middle of
+ * writing it out
+ */
+static void
+sendq_resume_callback(void *arg)
+{
+	mowgli_node_t *n, *tn;
+
+	(void) arg;
+	sendq_resume_timer = NULL;
+
+	MOWGLI_ITER_FOREACH_SAFE(n, tn, connection_list.head)
+	{
+		struct connection *cptr = n->data;
+
+		if (!(cptr->flags & CF_SENDQ_RESUME))
+			continue;
+
+		cptr->flags &= ~CF_SENDQ_RESUME;
+		if (!CF_IS_DEAD(cptr))
+			hook_call_sendq_resume(cptr);
+	}
+}
+
 void
 sendq_add(struct connection * cptr, char *buf, size_t len)
 {
@@ -51,18 +198,14 @@ sendq_add(struct connection * cptr, char *buf, size_t len)
 	if (len == 0)
 		return;
 
-	if (cptr->sendq_limit != 0 &&
-			MOWGLI_LIST_LENGTH(&cptr->sendq) * SENDQSIZE + len > cptr->sendq_limit)
-	{
-		slog(LG_INFO, "sendq_add(): sendq limit exceeded on connection %s[%d]",
-				cptr->name, cptr->fd);
-		cptr->flags |= CF_DEAD;
+	if (sendq_over_quota(cptr, len))
 		return;
-	}
 
 	if (!sendq_nonempty(cptr))
 		connection_setselect_write(cptr, sendq_flush);
 
+	cnt.sendq += len;
+
 	n = cptr->sendq.tail;
 	if (n != NULL)
 	{
@@ -78,8 +221,7 @@ sendq_add(struct connection * cptr, char *buf, size_t len)
 
 	while (len > 0)
 	{
-		sq = smalloc(sizeof *sq);
-		mowgli_node_add(sq, &sq->node, &cptr->sendq);
+		sq = sendq_chunk_append(cptr);
 		l = SENDQSIZE;
 		if (l > len)
 			l = len;
@@ -90,6 +232,246 @@ sendq_add(struct connection * cptr, char *buf, size_t len)
 	}
 }
 
+/* Formats one line (truncated to SENDQ_LINE_MAX bytes, plus \r\n) straight
+ * into the tail of the sendq, instead of into a buffer that sendq_add()
+ * would then copy.  Returns the queued line, which stays valid until the
+ * next sendq operation on this connection, or NULL if nothing was queued.
+ */
+const char *
+sendq_add_vline(struct connection *cptr, size_t *lenp, const char *fmt, va_list ap)
+{
+	mowgli_node_t *n;
+	struct sendq *sq = NULL;
+	char *line;
+	size_t len;
+
+	return_val_if_fail(cptr != NULL, NULL);
+	return_val_if_fail(lenp != NULL, NULL);
+
+	if (cptr->flags & (CF_DEAD | CF_SEND_EOF))
+	{
+		slog(LG_DEBUG, "sendq_add(): attempted to send to fd %d which is already dead", cptr->fd);
+		return NULL;
+	}
+
+	if (sendq_over_quota(cptr, SENDQ_LINE_MAX + 2))
+		return NULL;
+
+	if (!sendq_nonempty(cptr))
+		connection_setselect_write(cptr, sendq_flush);
+
+	if ((n = cptr->sendq.tail) != NULL && SENDQSIZE - ((struct sendq *) n->data)->firstfree > 2)
+	{
+		size_t room;
+		va_list aq;
+
+		sq = n->data;
+		line = sq->buf + sq->firstfree;
+		room = SENDQSIZE - sq->firstfree;
+
+		/* try the tail slab first; a line that doesn't fit (including
+		 * one that vsnprintf had to cut short) goes into a new slab
+		 */
+		va_copy(aq, ap);
+		(void) vsnprintf(line, room < SENDQ_LINE_MAX + 1 ? room : SENDQ_LINE_MAX + 1, fmt, aq);
+		va_end(aq);
+
+		len = strlen(line);
+		if (len + 2 > room)
+			sq = NULL;
+	}
+
+	if (sq == NULL)
+	{
+		sq = sendq_chunk_append(cptr);
+
+		line = sq->buf;
+		(void) vsnprintf(line, SENDQ_LINE_MAX + 1, fmt, ap);
+		len = strlen(line);
+	}
+
+	line[len++] = '\r';
+	line[len++] = '\n';
+	sq->firstfree += len;
+	cnt.sendq += len;
+
+	*lenp = len;
+	return line;
+}
+
+/* The line builder: sendq_line_begin() points the line at the free space in the
+ * tail slab, the appenders write straight into it, and sendq_line_end() adds
+ * the \r\n and makes it part of the sendq.  A line that outgrows the tail slab
+ * is moved to a new one; past SENDQ_LINE_MAX bytes it is cut short.  Nothing
+ * else may be queued on the connection while a line is being built.
+ */
+bool
+sendq_line_begin(struct connection *cptr, struct sendq_line *l)
+{
+	mowgli_node_t *n;
+	struct sendq *sq;
+
+	return_val_if_fail(cptr != NULL, false);
+	return_val_if_fail(l != NULL, false);
+
+	if (cptr->flags & (CF_DEAD | CF_SEND_EOF))
+	{
+		slog(LG_DEBUG, "sendq_add(): attempted to send to fd %d which is already dead", cptr->fd);
+		return false;
+	}
+
+	if (sendq_over_quota(cptr, SENDQ_LINE_MAX + 2))
+		return false;
+
+	if (!sendq_nonempty(cptr))
+		connection_setselect_write(cptr, sendq_flush);
+
+	if ((n = cptr->sendq.tail) == NULL || SENDQSIZE - ((struct sendq *) n->data)->firstfree <= 2)
+	{
+		sq = sendq_chunk_append(cptr);
+	}
+	else
+		sq = n->data;
+
+	l->cptr = cptr;
+	l->slab = sq;
+	l->buf = sq->buf + sq->firstfree;
+	l->room = SENDQSIZE - sq->firstfree - 2;
+	l->len = 0;
+
+	return true;
+}
+
+/* makes room for len more bytes if the line may still grow by that much;
+ * returns how many of them fit
+ */
+static size_t
+sendq_line_reserve(struct sendq_line *l, size_t len)
+{
+	struct sendq *sq;
+
+	if (l->len + len > SENDQ_LINE_MAX)
+		len = SENDQ_LINE_MAX - l->len;
+
+	if (l->len + len <= l->room)
+		return len;
+
+	sq = sendq_chunk_append(l->cptr);
+	memcpy(sq->buf, l->buf, l->len);
+
+	l->slab = sq;
+	l->buf = sq->buf;
+	l->room = SENDQSIZE - 2;
+
+	return len;
+}
+
+void
+sendq_line_strn(struct sendq_line *l, const char *str, size_t len)
+{
+	len = sendq_line_reserve(l, len);
+	memcpy(l->buf + l->len, str, len);
+	l->len += len;
+}
+
+void
+sendq_line_str(struct sendq_line *l, const char *str)
+{
+	sendq_line_strn(l, str, strlen(str));
+}
+
+void
+sendq_line_char(struct sendq_line *l, char c)
+{
+	if (sendq_line_reserve(l, 1) == 1)
+		l->buf[l->len++] = c;
+}
+
+void
+sendq_line_uint(struct sendq_line *l, unsigned long long value)
+{
+	char buf[24];
+	char *p = buf + sizeof buf;
+
+	do
+	{
+		*--p = (char) ('0' + (value % 10));
+		value /= 10;
+	} while (value != 0);
+
+	sendq_line_strn(l, p, (size_t) (buf + sizeof buf - p));
+}
+
+const char *
+sendq_line_end(struct sendq_line *l, size_t *lenp)
+{
+	struct sendq *sq = l->slab;
+
+	l->buf[l->len++] = '\r';
+	l->buf[l->len++] = '\n';
+	sq->firstfree += l->len;
+	cnt.sendq += l->len;
+
+	*lenp = l->len;
+	return l->buf;
+}
+
+/* Lets a producer write straight into the sendq: returns the free space at
+ * the end of its last slab (a fresh slab if that has less than min bytes
+ * free), with how long it is in *roomp, and sendq_commit() then queues the
+ * first len bytes written there.  Nothing else may be queued on the
+ * connection in between.  NULL if nothing may be queued.
+ */
+char *
+sendq_reserve(struct connection *cptr, size_t min, size_t *roomp)
+{
+	mowgli_node_t *n;
+	struct sendq *sq;
+
+	return_val_if_fail(cptr != NULL, NULL);
+	return_val_if_fail(roomp != NULL, NULL);
+	return_val_if_fail(min > 0 && min <= SENDQSIZE, NULL);
+
+	if (cptr->flags & (CF_DEAD | CF_SEND_EOF))
+	{
+		slog(LG_DEBUG, "sendq_add(): attempted to send to fd %d which is already dead", cptr->fd);
+		return NULL;
+	}
+
+	if (sendq_over_quota(cptr, min))
+		return NULL;
+
+	if ((n = cptr->sendq.tail) == NULL || (size_t) (SENDQSIZE - ((struct sendq *) n->data)->firstfree) < min)
+		sq = sendq_chunk_append(cptr);
+	else
+		sq = n->data;
+
+	*roomp = (size_t) (SENDQSIZE - sq->firstfree);
+	return sq->buf + sq->firstfree;
+}
+
+void
+sendq_commit(struct connection *cptr, size_t len)
+{
+	struct sendq *sq;
+
+	return_if_fail(cptr != NULL);
+	return_if_fail(cptr->sendq.tail != NULL);
+
+	sq = cptr->sendq.tail->data;
+
+	return_if_fail(len <= (size_t) (SENDQSIZE - sq->firstfree));
+
+	if (len == 0)
+		return;
+
+	if (!sendq_nonempty(cptr))
+		connection_setselect_write(cptr, sendq_flush);
+
+	sq->firstfree += len;
+	cnt.sendq += len;
+}
+
 void
 sendq_add_eof(struct connection * cptr)
 {
@@ -105,52 +487,92 @@ sendq_add_eof(struct connection * cptr)
 	cptr->flags |= CF_SEND_EOF;
 }
 
-void
-sendq_flush(struct connection * cptr)
+/* drop l bytes that have been written from the head of the sendq */
+static void
+sendq_consume(struct connection *cptr, size_t l)
+{
+	mowgli_node_t *n, *tn;
+	struct sendq *sq;
+	size_t ll;
+
+	cnt.sendq -= l;
+
+	MOWGLI_ITER_FOREACH_SAFE(n, tn, cptr->sendq.head)
+	{
+		sq = n->data;
+
+		ll = sq->firstfree - sq->firstused;
+		if (ll > l)
+		{
+			sq->firstused += l;
+			return;
+		}
+
+		l -= ll;
+
+		if (MOWGLI_LIST_LENGTH(&cptr->sendq) > 1)
+		{
+			mowgli_node_delete(&sq->node, &cptr->sendq);
+			sendq_chunk_free(sq);
+		}
+		else
+			/* keep one struct sendq */
+			sq->firstused = sq->firstfree = 0;
+
+		if ((cptr->flags & CF_SENDQ_FULL) && sendq_length(cptr) <= cptr->sendq_low)
+		{
+			cptr->flags = (cptr->flags & ~CF_SENDQ_FULL) | CF_SENDQ_RESUME;
+			if (sendq_resume_timer == NULL)
+				sendq_resume_timer = timer_add_once("sendq_resume", sendq_resume_callback, NULL, 0);
+		}
+
+		if (l == 0)
+			return;
+	}
+}
+
+#ifdef HAVE_SYS_UIO_H
+/* describe the head of the sendq, at most max slabs of it, for writev() */
+int
+sendq_iov(struct connection *cptr, struct iovec *iov, int max, size_t *total)
 {
-        mowgli_node_t *n, *tn;
-        struct sendq *sq;
-        int l;
+	mowgli_node_t *n;
+	struct sendq *sq;
+	int iovcnt = 0;
 
-	return_if_fail(cptr != NULL);
+	*total = 0;
 
-        MOWGLI_ITER_FOREACH_SAFE(n, tn, cptr->sendq.head)
-        {
-                sq = (struct sendq *)n->data;
+	MOWGLI_ITER_FOREACH(n, cptr->sendq.head)
+	{
+		sq = n->data;
 
-                if (sq->firstused == sq->firstfree)
-                        break;
+		if (sq->firstused == sq->firstfree || iovcnt == max)
+			break;
 
-                if ((l = send(cptr->fd, sq->buf + sq->firstused, sq->firstfree - sq->firstused, 0)) == -1)
-                {
-                        int err = ioerrno();
+		iov[iovcnt].iov_base = sq->buf + sq->firstused;
+		iov[iovcnt].iov_len = sq->firstfree - sq->firstused;
+		*total += iov[iovcnt].iov_len;
+		iovcnt++;
+	}
 
-                        if (!mowgli_eventloop_ignore_errno(err))
-			{
-				slog(LG_DEBUG, "sendq_flush(): write error %d (%s) on connection %s[%d]",
-						err, strerror(err),
-						cptr->name, cptr->fd);
-				cptr->flags |= CF_DEAD;
-			}
+	return iovcnt;
+}
+#endif
 
-                        return;
-                }
+/* l bytes from the head of the sendq have been written */
+void
+sendq_written(struct connection *cptr, size_t l)
+{
+	cnt.bout_writes++;
+	cnt.bout_written += l;
 
-                sq->firstused += l;
-                if (sq->firstused == sq->firstfree)
-                {
-			if (MOWGLI_LIST_LENGTH(&cptr->sendq) > 1)
-			{
-                        	mowgli_node_delete(&sq->node, &cptr->sendq);
-				sfree(sq);
-			}
-			else
-				/* keep one struct sendq */
-				sq->firstused = sq->firstfree = 0;
-                }
-                else
-                        return;
-        }
+	sendq_consume(cptr, l);
+}
+
+/* the sendq has been written out */
+void
+sendq_drained(struct connection *cptr)
+{
 	if (cptr->flags & CF_SEND_EOF)
 	{
 		/* shut down write end, kill entire connection
@@ -162,6 +584,72 @@ sendq_flush(struct connection * cptr)
 #endif
 		cptr->flags |= CF_SEND_DEAD;
 	}
+}
+
+void
+sendq_flush(struct connection * cptr)
+{
+#ifndef HAVE_SYS_UIO_H
+	mowgli_node_t *n;
+	struct sendq *sq;
+#endif
+	ssize_t l;
+	size_t total;
+
+	return_if_fail(cptr != NULL);
+
+	ATHEME_TRACE3(sendq__flush, cptr->name, cptr->fd, cptr->sendq.count);
+
+	/* anything handed to io_uring must be written (or waited for) there */
+	if (cptr->uring != NULL && uring_connection_flush(cptr))
+		return;
+
+	for (;;)
+	{
+#ifdef HAVE_SYS_UIO_H
+		/* hand as many slabs as we can to one writev() */
+		struct iovec iov[SENDQ_IOV_MAX];
+		const int iovcnt = sendq_iov(cptr, iov, SENDQ_IOV_MAX, &total);
+
+		if (iovcnt == 0)
+			break;
+
+		l = writev(cptr->fd, iov, iovcnt);
+#else
+		n = cptr->sendq.head;
+		if (n == NULL)
+			break;
+
+		sq = n->data;
+		if (sq->firstused == sq->firstfree)
+			break;
+
+		total = sq->firstfree - sq->firstused;
+		l = send(cptr->fd, sq->buf + sq->firstused, total, 0);
+#endif
+
+		if (l == -1)
+		{
+			int err = ioerrno();
+
+			if (!mowgli_eventloop_ignore_errno(err))
+			{
+				slog(LG_DEBUG, "sendq_flush(): write error %d (%s) on connection %s[%d]",
+						err, strerror(err),
+						cptr->name, cptr->fd);
+				cptr->flags |= CF_DEAD;
+			}
+
+			return;
+		}
+
+		sendq_written(cptr, (size_t) l);
+
+		if ((size_t) l < total)
+			return;
+	}
+
+	sendq_drained(cptr);
 	connection_setselect_write(cptr, NULL);
 }
 
@@ -182,12 +670,48 @@ sendq_nonempty(struct connection *cptr)
 	return sq->firstfree > sq->firstused;
 }
 
+/* Roughly how much is queued, counted the same way as against the limit:
+ * whole slabs, so this costs nothing to ask.
+ */
+size_t
+sendq_length(const struct connection *cptr)
+{
+	return MOWGLI_LIST_LENGTH(&cptr->sendq) * SENDQSIZE;
+}
+
 void
 sendq_set_limit(struct connection *cptr, size_t len)
 {
 	cptr->sendq_limit = len;
 }
 
+/* Producers that can wait (stacked modes, delivery jobs, event streams)
+ * should hold back while the sendq is over high, and carry on from the
+ * sendq_resume hook once it has drained down to low; 0 turns this off.
+ */
+void
+sendq_set_watermarks(struct connection *cptr, size_t high, size_t low)
+{
+	return_if_fail(cptr != NULL);
+	return_if_fail(low <= high);
+
+	/* the sendq never gets shorter than the one slab it keeps */
+	if (low < SENDQSIZE)
+		low = SENDQSIZE;
+
+	cptr->sendq_high = high;
+	cptr->sendq_low = low;
+
+	if (high == 0)
+		cptr->flags &= ~(CF_SENDQ_FULL | CF_SENDQ_RESUME);
+}
+
+bool
+sendq_congested(const struct connection *cptr)
+{
+	return cptr->flags & CF_SENDQ_FULL;
+}
+
 int
 recvq_length(struct connection *cptr)
 {
@@ -206,9 +730,9 @@ recvq_length(struct connection *cptr)
 void
 recvq_put(struct connection *cptr)
 {
-	mowgli_node_t *n;
-	struct sendq *sq = NULL;
-	int l = 0, ll = 0;
+	char *buf;
+	size_t len;
+	ssize_t l;
 
 	return_if_fail(cptr != NULL);
 
@@ -226,34 +750,64 @@ recvq_put(struct connection *cptr)
 		return;
 	}
 
+	buf = recvq_buffer(cptr, &len);
+	errno = 0;
+
+	l = recv(cptr->fd, buf, len, 0);
+	if (l == 0 || (l < 0 && !mowgli_eventloop_ignore_errno(ioerrno())))
+	{
+		if (l == 0)
+			slog(LG_DEBUG, "recvq_put(): fd %d closed the connection", cptr->fd);
+		else
+			slog(LG_DEBUG, "recvq_put(): lost connection on fd %d", cptr->fd);
+		connection_close(cptr);
+		return;
+	}
+
+	recvq_received(cptr, l > 0 ? (size_t) l : 0);
+}
+
+/* where the next bytes received go: the free end of the last block of the
+ * recvq, which is added if there is none with room left
+ */
+char *
+recvq_buffer(struct connection *cptr, size_t *lenp)
+{
+	mowgli_node_t *n;
+	struct sendq *sq = NULL;
+
 	n = cptr->recvq.tail;
 	if (n != NULL)
 	{
 		sq = n->data;
-		l = SENDQSIZE - sq->firstfree;
-		if (l == 0)
+		if (sq->size == sq->firstfree)
 			sq = NULL;
 	}
 	if (sq == NULL)
 	{
-		sq = smalloc(sizeof *sq);
+		sq = sendq_chunk_new(cptr, cptr->flags & CF_UPLINK ? RECVQSIZE_UPLINK : SENDQSIZE);
 		mowgli_node_add(sq, &sq->node, &cptr->recvq);
-		l = SENDQSIZE;
 	}
-	errno = 0;
 
-	l = recv(cptr->fd, sq->buf + sq->firstfree, l, 0);
-	if (l == 0 || (l < 0 && !mowgli_eventloop_ignore_errno(ioerrno())))
+	*lenp = sq->size - sq->firstfree;
+	return sq->buf + sq->firstfree;
+}
+
+/* l bytes have been received into recvq_buffer(); hand them to the
+ * connection's recvq handler
+ */
+void
+recvq_received(struct connection *cptr, size_t len)
+{
+	struct sendq *sq;
+	int l = 0, ll = 0;
+
+	if (len != 0 && cptr->recvq.tail != NULL)
 	{
-		if (l == 0)
-			slog(LG_DEBUG, "recvq_put(): fd %d closed the connection", cptr->fd);
-		else
-			slog(LG_DEBUG, "recvq_put(): lost connection on fd %d", cptr->fd);
-		connection_close(cptr);
-		return;
+		sq = cptr->recvq.tail->data;
+		sq->firstfree += len;
+		cnt.recvq += len;
 	}
-	else if (l > 0)
-		sq->firstfree += l;
 
 	if (cptr->recvq_handler)
 	{
@@ -265,7 +819,6 @@ recvq_put(struct connection *cptr)
 			l = recvq_length(cptr);
 		} while (ll != l && l != 0);
 	}
-	return;
 }
 
 int
@@ -293,12 +846,13 @@ recvq_get(struct connection *cptr, char *buf, size_t len)
 		p += l;
 		len -= l;
 		sq->firstused += l;
+		cnt.recvq -= l;
 		if (sq->firstused == sq->firstfree)
 		{
 			if (MOWGLI_LIST_LENGTH(&cptr->recvq) > 1)
 			{
 				mowgli_node_delete(&sq->node, &cptr->recvq);
-				sfree(sq);
+				sendq_chunk_free(sq);
 			}
 			else
 				/* keep one struct sendq */
@@ -353,12 +907,13 @@ recvq_getline(struct connection *cptr, char *buf, size_t len)
 		p += l;
 		len -= l;
 		sq->firstused += l;
+		cnt.recvq -= l;
 		if (sq->firstused == sq->firstfree)
 		{
 			if (MOWGLI_LIST_LENGTH(&cptr->recvq) > 1)
 			{
 				mowgli_node_delete(&sq->node, &cptr->recvq);
-				sfree(sq);
+				sendq_chunk_free(sq);
 			}
 			else
 				/* keep one struct sendq */
@@ -370,8 +925,76 @@ recvq_getline(struct connection *cptr, char *buf, size_t len)
 	return p - buf;
 }
 
+/* Returns the next line of the recvq, including its newline, in place in the
+ * recvq's first block, or NULL if there is no complete line of at most len
+ * bytes there (a line still being received, too long, or split across two
+ * blocks; use recvq_getline() for those).  The caller may modify the line,
+ * and must recvq_consume() it once done.
+ */
+char *
+recvq_peekline(struct connection *cptr, size_t len, size_t *lenp)
+{
+	mowgli_node_t *n;
+	struct sendq *sq;
+	char *line, *newline;
+	size_t l;
+
+	return_val_if_fail(cptr != NULL, NULL);
+	return_val_if_fail(lenp != NULL, NULL);
+
+	if ((n = cptr->recvq.head) == NULL)
+		return NULL;
+
+	sq = n->data;
+	line = sq->buf + sq->firstused;
+	l = sq->firstfree - sq->firstused;
+	if (l > len)
+		l = len;
+
+	if ((newline = memchr(line, '\n', l)) == NULL)
+		return NULL;
+
+	*lenp = newline - line + 1;
+	return line;
+}
+
+/* discards the first len bytes of the first block of the recvq */
 void
-sendqrecvq_free(struct connection *cptr)
+recvq_consume(struct connection *cptr, size_t len)
+{
+	mowgli_node_t *n;
+	struct sendq *sq;
+
+	return_if_fail(cptr != NULL);
+
+	if ((n = cptr->recvq.head) == NULL)
+		return;
+
+	sq = n->data;
+	return_if_fail(len <= (size_t) (sq->firstfree - sq->firstused));
+
+	sq->firstused += len;
+	cnt.recvq -= len;
+	if (sq->firstused == sq->firstfree)
+	{
+		if (MOWGLI_LIST_LENGTH(&cptr->recvq) > 1)
+		{
+			mowgli_node_delete(&sq->node, &cptr->recvq);
+			sendq_chunk_free(sq);
+		}
+		else
+			/* keep one struct sendq */
+			sq->firstused = sq->firstfree = 0;
+	}
+}
+
+/* Takes the recvq and sendq away from a connection that is going away; if
+ * keep is not NULL, the blocks are moved there rather than freed, for
+ * io_uring operations that may still be using them (see
+ * sendqrecvq_free_blocks()).
+ */
+void
+sendqrecvq_release(struct connection *cptr, mowgli_list_t *keep)
 {
 	mowgli_node_t *nptr, *nptr2;
 	struct sendq *sq;
@@ -379,17 +1002,46 @@ sendqrecvq_free(struct connection *cptr)
 	MOWGLI_ITER_FOREACH_SAFE(nptr, nptr2, cptr->recvq.head)
 	{
 		sq = nptr->data;
+		cnt.recvq -= sq->firstfree - sq->firstused;
 
 		mowgli_node_delete(&sq->node, &cptr->recvq);
-		sfree(sq);
+		if (keep != NULL)
+			mowgli_node_add(sq, &sq->node, keep);
+		else
+			sendq_chunk_free(sq);
 	}
 
 	MOWGLI_ITER_FOREACH_SAFE(nptr, nptr2, cptr->sendq.head)
 	{
 		sq = nptr->data;
+		cnt.sendq -= sq->firstfree - sq->firstused;
 
 		mowgli_node_delete(&sq->node, &cptr->sendq);
-		sfree(sq);
+		if (keep != NULL)
+			mowgli_node_add(sq, &sq->node, keep);
+		else
+			sendq_chunk_free(sq);
+	}
+}
+
+void
+sendqrecvq_free(struct connection *cptr)
+{
+	sendqrecvq_release(cptr, NULL);
+}
+
+void
+sendqrecvq_free_blocks(mowgli_list_t *blocks)
+{
+	mowgli_node_t *nptr, *nptr2;
+	struct sendq *sq;
+
+	MOWGLI_ITER_FOREACH_SAFE(nptr, nptr2, blocks->head)
+	{
+		sq = nptr->data;
+
+		mowgli_node_delete(&sq->node, blocks);
+		sendq_chunk_free(sq);
 	}
 }
 
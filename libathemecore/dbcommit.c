@@ -0,0 +1,107 @@
+/*
+ * SPDX-License-Identifier: ISC
+ * SPDX-URL: https://spdx.org/licenses/ISC.html
+ *
+ * Copyright (C) 2026 Atheme Development Group (https://atheme.github.io/)
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * atheme-services: A collection of minimalist IRC services
+ * dbcommit.c: Deciding when to write the database.
+ *
+ * The core object functions count their changes here. Every
+ * general::commit_interval the database is written if anything changed,
+ * and sooner once general::commit_change_threshold changes have piled up.
+ *
+ * Some fields (last login times, most flags) are assigned by modules
+ * directly and never counted, so a quiet network still gets a save every
+ * DB_COMMIT_MAX_SKIPS + 1 intervals.
+ */
+
+#include <atheme.h>
+#include "internal.h"
+
+#define DB_COMMIT_CHECK_INTERVAL        15U
+#define DB_COMMIT_MAX_SKIPS             5U
+
+// An early save never follows the previous save more closely than this
+#define DB_COMMIT_MIN_GAP               SECONDS_PER_MINUTE
+
+struct db_change_stats db_changes;
+
+static time_t db_commit_last = 0;
+
+void
+db_change_note(const enum db_change_kind kind)
+{
+	return_if_fail(kind < DB_CHANGE_KINDS);
+
+	db_changes.total++;
+
+	if (! db_changes.unsaved++)
+		db_changes.oldest_unsaved = CURRTIME;
+
+	db_changes.unsaved_by[kind]++;
+}
+
+// The storage layer calls this as it takes what it is about to write
+void
+db_changes_saving(void)
+{
+	db_changes.unsaved = 0;
+	db_changes.oldest_unsaved = 0;
+	db_changes.skipped = 0;
+
+	(void) memset(db_changes.unsaved_by, 0x00, sizeof db_changes.unsaved_by);
+
+	db_commit_last = CURRTIME;
+}
+
+static void
+db_commit_save(const char *const restrict why)
+{
+	slog(LG_DEBUG, "db_commit_check(): initiating %s database write (%u changes)", why, db_changes.unsaved);
+
+	// stays put if the save is skipped (one still running), so we come back next time round
+	if (config_options.db_save_blocking)
+		db_save(NULL, DB_SAVE_BLOCKING);
+	else
+		db_save(NULL, DB_SAVE_BG_REGULAR);
+}
+
+static void
+db_commit_check(void ATHEME_VATTR_UNUSED *const restrict unused)
+{
+	const time_t since = CURRTIME - db_commit_last;
+
+	if (config_options.commit_change_threshold && db_changes.unsaved >= config_options.commit_change_threshold &&
+	    since >= DB_COMMIT_MIN_GAP)
+	{
+		db_commit_save("early");
+		return;
+	}
+
+	if (since < (time_t) config_options.commit_interval)
+		return;
+
+	if (! db_changes.unsaved && db_changes.skipped < DB_COMMIT_MAX_SKIPS)
+	{
+		slog(LG_DEBUG, "db_commit_check(): nothing changed, skipping periodic database write");
+
+		db_changes.skipped++;
+		db_commit_last = CURRTIME;
+		return;
+	}
+
+	db_commit_save("periodic");
+}
+
+void
+db_commit_init(void)
+{
+	db_commit_last = CURRTIME;
+
+	(void) timer_add("db_commit_check", &db_commit_check, NULL, DB_COMMIT_CHECK_INTERVAL);
+}
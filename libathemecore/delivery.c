@@ -0,0 +1,157 @@
+/*
+ * SPDX-License-Identifier: ISC
+ * SPDX-URL: https://spdx.org/licenses/ISC.html
+ *
+ * Copyright (C) 2026 Atheme Development Group (https://atheme.github.io/)
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * atheme-services: A collection of minimalist IRC services
+ * delivery.c: Background delivery to many recipients.
+ *
+ * After every pass of the event loop, the running jobs take turns to
+ * deliver to one recipient each, until DELIVERY_SLICE recipients have been
+ * handled or the uplink's sendq goes over its high watermark (a quarter of
+ * uplink_sendq_limit), after which they wait until it is back down to the
+ * low one. A full sendq drains as the uplink reads it, and every write
+ * wakes the event loop again; a timer makes sure that the loop does not
+ * sleep for long while jobs are waiting.
+ */
+
+#include <atheme.h>
+#include "internal.h"
+
+#define DELIVERY_SLICE          256U
+
+mowgli_list_t delivery_jobs = { NULL, NULL, 0 };
+
+static unsigned int delivery_next_id = 1;
+static mowgli_eventloop_timer_t *delivery_timer = NULL;
+
+static bool
+delivery_congested(void)
+{
+	if (! me.connected || curr_uplink == NULL || curr_uplink->conn == NULL)
+		return true;
+
+	return sendq_congested(curr_uplink->conn);
+}
+
+static void
+delivery_job_free(struct delivery_job *const restrict job, const bool cancelled)
+{
+	mowgli_node_delete(&job->node, &delivery_jobs);
+
+	if (job->done_fn != NULL)
+		job->done_fn(job, cancelled);
+
+	sfree(job->owner);
+	sfree(job->desc);
+	sfree(job);
+}
+
+static void
+delivery_wakeup(void ATHEME_VATTR_UNUSED *const restrict unused)
+{
+	delivery_timer = NULL;
+
+	delivery_run();
+}
+
+void
+delivery_run(void)
+{
+	unsigned int budget = DELIVERY_SLICE;
+	mowgli_node_t *n, *tn;
+
+	while (budget > 0 && MOWGLI_LIST_LENGTH(&delivery_jobs) > 0 && ! delivery_congested())
+	{
+		MOWGLI_ITER_FOREACH_SAFE(n, tn, delivery_jobs.head)
+		{
+			struct delivery_job *const job = n->data;
+
+			if (job->step(job))
+				job->done++;
+			else
+				delivery_job_free(job, false);
+
+			if (! --budget || delivery_congested())
+				break;
+		}
+	}
+
+	if (MOWGLI_LIST_LENGTH(&delivery_jobs) > 0)
+	{
+		if (delivery_timer == NULL)
+			delivery_timer = timer_add_once("delivery_wakeup", &delivery_wakeup, NULL, 1);
+	}
+	else if (delivery_timer != NULL)
+	{
+		timer_destroy(delivery_timer);
+		delivery_timer = NULL;
+	}
+}
+
+/*
+ * delivery_job_start()
+ *
+ * inputs:
+ *       who started it and what it is (for listings), the privilege needed
+ *       to see or cancel it, how many recipients there are (0 if unknown),
+ *       and the callbacks and their data
+ *
+ * outputs:
+ *       the job, which starts after the current pass of the event loop
+ */
+struct delivery_job *
+delivery_job_start(const char *const restrict owner, const char *const restrict desc,
+                   const char *const restrict privilege, const unsigned int total, const delivery_step_fn step,
+                   const delivery_done_fn done_fn, void *const restrict data)
+{
+	return_val_if_fail(owner != NULL, NULL);
+	return_val_if_fail(desc != NULL, NULL);
+	return_val_if_fail(step != NULL, NULL);
+
+	struct delivery_job *const job = smalloc(sizeof *job);
+
+	job->id = delivery_next_id++;
+	job->owner = sstrdup(owner);
+	job->desc = sstrdup(desc);
+	job->privilege = privilege;
+	job->started = CURRTIME;
+	job->total = total;
+	job->step = step;
+	job->done_fn = done_fn;
+	job->data = data;
+
+	mowgli_node_add(job, &job->node, &delivery_jobs);
+
+	return job;
+}
+
+struct delivery_job *
+delivery_job_find(const unsigned int id)
+{
+	mowgli_node_t *n;
+
+	MOWGLI_ITER_FOREACH(n, delivery_jobs.head)
+	{
+		struct delivery_job *const job = n->data;
+
+		if (job->id == id)
+			return job;
+	}
+
+	return NULL;
+}
+
+// Stops the job where it is; its done callback is called before this returns
+void
+delivery_job_cancel(struct delivery_job *const restrict job)
+{
+	return_if_fail(job != NULL);
+
+	delivery_job_free(job, true);
+}
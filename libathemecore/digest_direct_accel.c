@@ -0,0 +1,723 @@
+/*
+ * SPDX-License-Identifier: ISC
+ * SPDX-URL: https://spdx.org/licenses/ISC.html
+ *
+ * Copyright (C) 2026 Atheme Development Group (https://atheme.github.io/)
+ *
+ * Hardware-accelerated SHA1 and SHA2 compression for Atheme IRC Services.
+ *
+ * The SHA1 and SHA2 backends hand every whole block they have to whichever
+ * of the kernels below is selected for their algorithm; the first time any
+ * of them is used (which is the digest testsuite, at startup), the best one
+ * that the CPU can run is selected for each. Besides the portable C code,
+ * there are:
+ *
+ *   - SHA1 and SHA2-256 with the x86 SHA extensions (which also need
+ *     SSSE3 and SSE4.1, as every such CPU has)
+ *   - SHA1 and SHA2-256 with the ARMv8 cryptography extensions
+ *   - SHA2-512 as the portable code built for AVX2 and BMI2 (see
+ *     digest_direct_sha2.c); neither ISA has SHA2-512 instructions of its
+ *     own on the CPUs that we can count on
+ *
+ * The digest testsuite runs every test vector through every kernel this CPU
+ * can use, and crypto-benchmark can select each kernel in turn to measure
+ * its throughput.
+ */
+
+#include <atheme/digest/direct.h>       // self-declarations
+#include <atheme/digest/types.h>        // DIGALG_*
+#include <atheme/stdheaders.h>          // size_t, snprintf(3), uint32_t
+
+#ifdef ATHEME_DIGEST_HAVE_ACCEL_X86
+#  include <cpuid.h>
+#  include <immintrin.h>
+#  define DIGEST_ACCEL_X86_ATTR         __attribute__((__target__("sha,sse4.1,ssse3")))
+#endif
+
+#ifdef ATHEME_DIGEST_HAVE_ACCEL_ARMV8
+#  include <arm_neon.h>
+#  include <asm/hwcap.h>
+#  include <sys/auxv.h>
+#  ifdef __ARM_FEATURE_CRYPTO
+#    define DIGEST_ACCEL_ARMV8_ATTR     /* nothing */
+#  else
+#    define DIGEST_ACCEL_ARMV8_ATTR     __attribute__((__target__("+crypto")))
+#  endif
+#endif
+
+struct digest_direct_kernel
+{
+	const char *                name;
+	digest_direct_blocks_fn     fn;
+	bool                      (*usable)(void);
+};
+
+struct digest_direct_kernel_set
+{
+	const struct digest_direct_kernel * kernels;
+	size_t                              count;
+	digest_direct_blocks_fn *           active;
+};
+
+#if defined(ATHEME_DIGEST_HAVE_ACCEL_X86) || defined(ATHEME_DIGEST_HAVE_ACCEL_ARMV8)
+
+static const uint32_t digest_accel_K256[] = {
+
+	UINT32_C(0x428A2F98), UINT32_C(0x71374491), UINT32_C(0xB5C0FBCF), UINT32_C(0xE9B5DBA5),
+	UINT32_C(0x3956C25B), UINT32_C(0x59F111F1), UINT32_C(0x923F82A4), UINT32_C(0xAB1C5ED5),
+	UINT32_C(0xD807AA98), UINT32_C(0x12835B01), UINT32_C(0x243185BE), UINT32_C(0x550C7DC3),
+	UINT32_C(0x72BE5D74), UINT32_C(0x80DEB1FE), UINT32_C(0x9BDC06A7), UINT32_C(0xC19BF174),
+	UINT32_C(0xE49B69C1), UINT32_C(0xEFBE4786), UINT32_C(0x0FC19DC6), UINT32_C(0x240CA1CC),
+	UINT32_C(0x2DE92C6F), UINT32_C(0x4A7484AA), UINT32_C(0x5CB0A9DC), UINT32_C(0x76F988DA),
+	UINT32_C(0x983E5152), UINT32_C(0xA831C66D), UINT32_C(0xB00327C8), UINT32_C(0xBF597FC7),
+	UINT32_C(0xC6E00BF3), UINT32_C(0xD5A79147), UINT32_C(0x06CA6351), UINT32_C(0x14292967),
+	UINT32_C(0x27B70A85), UINT32_C(0x2E1B2138), UINT32_C(0x4D2C6DFC), UINT32_C(0x53380D13),
+	UINT32_C(0x650A7354), UINT32_C(0x766A0ABB), UINT32_C(0x81C2C92E), UINT32_C(0x92722C85),
+	UINT32_C(0xA2BFE8A1), UINT32_C(0xA81A664B), UINT32_C(0xC24B8B70), UINT32_C(0xC76C51A3),
+	UINT32_C(0xD192E819), UINT32_C(0xD6990624), UINT32_C(0xF40E3585), UINT32_C(0x106AA070),
+	UINT32_C(0x19A4C116), UINT32_C(0x1E376C08), UINT32_C(0x2748774C), UINT32_C(0x34B0BCB5),
+	UINT32_C(0x391C0CB3), UINT32_C(0x4ED8AA4A), UINT32_C(0x5B9CCA4F), UINT32_C(0x682E6FF3),
+	UINT32_C(0x748F82EE), UINT32_C(0x78A5636F), UINT32_C(0x84C87814), UINT32_C(0x8CC70208),
+	UINT32_C(0x90BEFFFA), UINT32_C(0xA4506CEB), UINT32_C(0xBEF9A3F7), UINT32_C(0xC67178F2),
+};
+
+#endif /* ATHEME_DIGEST_HAVE_ACCEL_X86 || ATHEME_DIGEST_HAVE_ACCEL_ARMV8 */
+
+#ifdef ATHEME_DIGEST_HAVE_ACCEL_X86
+
+static bool digest_accel_x86_probed = false;
+static bool digest_accel_x86_sha = false;
+static bool digest_accel_x86_avx2 = false;
+
+static void
+digest_accel_x86_probe(void)
+{
+	unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+
+	if (digest_accel_x86_probed)
+		return;
+
+	digest_accel_x86_probed = true;
+
+	if (__get_cpuid_max(0x00U, NULL) < 0x07U)
+		return;
+
+	if (! __get_cpuid(0x01U, &eax, &ebx, &ecx, &edx))
+		return;
+
+	// SSSE3 (ECX bit 9) and SSE4.1 (ECX bit 19)
+	const bool have_sse = ((ecx & (1U << 9)) && (ecx & (1U << 19)));
+
+	__cpuid_count(0x07U, 0x00U, eax, ebx, ecx, edx);
+
+	// SHA (EBX bit 29)
+	digest_accel_x86_sha = (have_sse && (ebx & (1U << 29)));
+
+	// This only reads what the compiler runtime found out about the CPU at startup
+	digest_accel_x86_avx2 = (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("bmi2"));
+}
+
+static bool
+digest_accel_x86_have_sha(void)
+{
+	(void) digest_accel_x86_probe();
+
+	return digest_accel_x86_sha;
+}
+
+static bool
+digest_accel_x86_have_avx2(void)
+{
+	(void) digest_accel_x86_probe();
+
+	return digest_accel_x86_avx2;
+}
+
+static void DIGEST_ACCEL_X86_ATTR
+digest_blocks_sha1_shani(union digest_direct_ctx *const restrict ctx, const unsigned char *in, size_t nblocks)
+{
+	const __m128i mask = _mm_set_epi64x(0x0001020304050607LL, 0x08090A0B0C0D0E0FLL);
+
+	__m128i abcd = _mm_shuffle_epi32(_mm_loadu_si128((const void *) ctx->sha1.state), 0x1B);
+	__m128i e0 = _mm_set_epi32((int) ctx->sha1.state[0x04U], 0, 0, 0);
+	__m128i e1, m0, m1, m2, m3;
+
+	for ( ; nblocks; nblocks--, in += DIGEST_BKLEN_SHA1)
+	{
+		const __m128i abcd_save = abcd;
+		const __m128i e0_save = e0;
+
+		// Rounds 0-3
+		m0 = _mm_shuffle_epi8(_mm_loadu_si128((const void *) (in + 0x00U)), mask);
+		e0 = _mm_add_epi32(e0, m0);
+		e1 = abcd;
+		abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+
+		// Rounds 4-7
+		m1 = _mm_shuffle_epi8(_mm_loadu_si128((const void *) (in + 0x10U)), mask);
+		e1 = _mm_sha1nexte_epu32(e1, m1);
+		e0 = abcd;
+		abcd = _mm_sha1rnds4_epu32(abcd, e1, 0);
+		m0 = _mm_sha1msg1_epu32(m0, m1);
+
+		// Rounds 8-11
+		m2 = _mm_shuffle_epi8(_mm_loadu_si128((const void *) (in + 0x20U)), mask);
+		e0 = _mm_sha1nexte_epu32(e0, m2);
+		e1 = abcd;
+		abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+		m1 = _mm_sha1msg1_epu32(m1, m2);
+		m0 = _mm_xor_si128(m0, m2);
+
+		// Rounds 12-15
+		m3 = _mm_shuffle_epi8(_mm_loadu_si128((const void *) (in + 0x30U)), mask);
+
+/* Rounds 12 to 67 (four at a time) all look the same, with the message words
+ * and the E values trading places each time; cur holds the schedule for these
+ * four rounds, nxt gets finished for the next four, and the other two get
+ * started on.
+ */
+#define SHA1_NI_QROUND(ein, eout, cur, nxt, prv, prv2, f)                                                          \
+    do {                                                                                                            \
+        ein = _mm_sha1nexte_epu32(ein, cur);                                                                        \
+        eout = abcd;                                                                                                \
+        nxt = _mm_sha1msg2_epu32(nxt, cur);                                                                         \
+        abcd = _mm_sha1rnds4_epu32(abcd, ein, f);                                                                   \
+        prv = _mm_sha1msg1_epu32(prv, cur);                                                                         \
+        prv2 = _mm_xor_si128(prv2, cur);                                                                            \
+    } while (0)
+
+		SHA1_NI_QROUND(e1, e0, m3, m0, m2, m1, 0);      // 12-15
+		SHA1_NI_QROUND(e0, e1, m0, m1, m3, m2, 0);      // 16-19
+		SHA1_NI_QROUND(e1, e0, m1, m2, m0, m3, 1);      // 20-23
+		SHA1_NI_QROUND(e0, e1, m2, m3, m1, m0, 1);      // 24-27
+		SHA1_NI_QROUND(e1, e0, m3, m0, m2, m1, 1);      // 28-31
+		SHA1_NI_QROUND(e0, e1, m0, m1, m3, m2, 1);      // 32-35
+		SHA1_NI_QROUND(e1, e0, m1, m2, m0, m3, 1);      // 36-39
+		SHA1_NI_QROUND(e0, e1, m2, m3, m1, m0, 2);      // 40-43
+		SHA1_NI_QROUND(e1, e0, m3, m0, m2, m1, 2);      // 44-47
+		SHA1_NI_QROUND(e0, e1, m0, m1, m3, m2, 2);      // 48-51
+		SHA1_NI_QROUND(e1, e0, m1, m2, m0, m3, 2);      // 52-55
+		SHA1_NI_QROUND(e0, e1, m2, m3, m1, m0, 2);      // 56-59
+		SHA1_NI_QROUND(e1, e0, m3, m0, m2, m1, 3);      // 60-63
+		SHA1_NI_QROUND(e0, e1, m0, m1, m3, m2, 3);      // 64-67
+
+#undef SHA1_NI_QROUND
+
+		// Rounds 68-71
+		e1 = _mm_sha1nexte_epu32(e1, m1);
+		e0 = abcd;
+		m2 = _mm_sha1msg2_epu32(m2, m1);
+		abcd = _mm_sha1rnds4_epu32(abcd, e1, 3);
+		m3 = _mm_xor_si128(m3, m1);
+
+		// Rounds 72-75
+		e0 = _mm_sha1nexte_epu32(e0, m2);
+		e1 = abcd;
+		m3 = _mm_sha1msg2_epu32(m3, m2);
+		abcd = _mm_sha1rnds4_epu32(abcd, e0, 3);
+
+		// Rounds 76-79
+		e1 = _mm_sha1nexte_epu32(e1, m3);
+		e0 = abcd;
+		abcd = _mm_sha1rnds4_epu32(abcd, e1, 3);
+
+		e0 = _mm_sha1nexte_epu32(e0, e0_save);
+		abcd = _mm_add_epi32(abcd, abcd_save);
+	}
+
+	(void) _mm_storeu_si128((void *) ctx->sha1.state, _mm_shuffle_epi32(abcd, 0x1B));
+
+	ctx->sha1.state[0x04U] = (uint32_t) _mm_extract_epi32(e0, 3);
+}
+
+static void DIGEST_ACCEL_X86_ATTR
+digest_blocks_sha2_256_shani(union digest_direct_ctx *const restrict ctx, const unsigned char *in, size_t nblocks)
+{
+	const __m128i mask = _mm_set_epi64x(0x0C0D0E0F08090A0BLL, 0x0405060700010203LL);
+
+	__m128i tmp, msg, m0, m1, m2, m3;
+
+	// The instructions want the state as ABEF and CDGH
+	tmp = _mm_shuffle_epi32(_mm_loadu_si128((const void *) &ctx->sha2_256.state[0x00U]), 0xB1);
+	__m128i s1 = _mm_shuffle_epi32(_mm_loadu_si128((const void *) &ctx->sha2_256.state[0x04U]), 0x1B);
+	__m128i s0 = _mm_alignr_epi8(tmp, s1, 8);
+	s1 = _mm_blend_epi16(s1, tmp, 0xF0);
+
+#define SHA2_256_NI_K(i)        _mm_loadu_si128((const void *) &digest_accel_K256[(i) * 0x04U])
+
+#define SHA2_256_NI_ROUNDS(cur, i)                                                                                  \
+    do {                                                                                                            \
+        msg = _mm_add_epi32(cur, SHA2_256_NI_K(i));                                                                 \
+        s1 = _mm_sha256rnds2_epu32(s1, s0, msg);                                                                    \
+        msg = _mm_shuffle_epi32(msg, 0x0E);                                                                         \
+        s0 = _mm_sha256rnds2_epu32(s0, s1, msg);                                                                    \
+    } while (0)
+
+/* As in SHA1 above, most groups of four rounds finish the schedule for the
+ * next four and start on the group after that as they go.
+ */
+#define SHA2_256_NI_QROUND(cur, nxt, prv, i)                                                                        \
+    do {                                                                                                            \
+        msg = _mm_add_epi32(cur, SHA2_256_NI_K(i));                                                                 \
+        s1 = _mm_sha256rnds2_epu32(s1, s0, msg);                                                                    \
+        tmp = _mm_alignr_epi8(cur, prv, 4);                                                                         \
+        nxt = _mm_add_epi32(nxt, tmp);                                                                              \
+        nxt = _mm_sha256msg2_epu32(nxt, cur);                                                                       \
+        msg = _mm_shuffle_epi32(msg, 0x0E);                                                                         \
+        s0 = _mm_sha256rnds2_epu32(s0, s1, msg);                                                                    \
+        prv = _mm_sha256msg1_epu32(prv, cur);                                                                       \
+    } while (0)
+
+	for ( ; nblocks; nblocks--, in += DIGEST_BKLEN_SHA2_256)
+	{
+		const __m128i s0_save = s0;
+		const __m128i s1_save = s1;
+
+		m0 = _mm_shuffle_epi8(_mm_loadu_si128((const void *) (in + 0x00U)), mask);
+		m1 = _mm_shuffle_epi8(_mm_loadu_si128((const void *) (in + 0x10U)), mask);
+		m2 = _mm_shuffle_epi8(_mm_loadu_si128((const void *) (in + 0x20U)), mask);
+		m3 = _mm_shuffle_epi8(_mm_loadu_si128((const void *) (in + 0x30U)), mask);
+
+		SHA2_256_NI_ROUNDS(m0, 0);                      // 0-3
+
+		SHA2_256_NI_ROUNDS(m1, 1);                      // 4-7
+		m0 = _mm_sha256msg1_epu32(m0, m1);
+
+		SHA2_256_NI_ROUNDS(m2, 2);                      // 8-11
+		m1 = _mm_sha256msg1_epu32(m1, m2);
+
+		SHA2_256_NI_QROUND(m3, m0, m2, 3);              // 12-15
+		SHA2_256_NI_QROUND(m0, m1, m3, 4);              // 16-19
+		SHA2_256_NI_QROUND(m1, m2, m0, 5);              // 20-23
+		SHA2_256_NI_QROUND(m2, m3, m1, 6);              // 24-27
+		SHA2_256_NI_QROUND(m3, m0, m2, 7);              // 28-31
+		SHA2_256_NI_QROUND(m0, m1, m3, 8);              // 32-35
+		SHA2_256_NI_QROUND(m1, m2, m0, 9);              // 36-39
+		SHA2_256_NI_QROUND(m2, m3, m1, 10);             // 40-43
+		SHA2_256_NI_QROUND(m3, m0, m2, 11);             // 44-47
+		SHA2_256_NI_QROUND(m0, m1, m3, 12);             // 48-51
+
+		// Rounds 52-55
+		msg = _mm_add_epi32(m1, SHA2_256_NI_K(13));
+		s1 = _mm_sha256rnds2_epu32(s1, s0, msg);
+		tmp = _mm_alignr_epi8(m1, m0, 4);
+		m2 = _mm_add_epi32(m2, tmp);
+		m2 = _mm_sha256msg2_epu32(m2, m1);
+		msg = _mm_shuffle_epi32(msg, 0x0E);
+		s0 = _mm_sha256rnds2_epu32(s0, s1, msg);
+
+		// Rounds 56-59
+		msg = _mm_add_epi32(m2, SHA2_256_NI_K(14));
+		s1 = _mm_sha256rnds2_epu32(s1, s0, msg);
+		tmp = _mm_alignr_epi8(m2, m1, 4);
+		m3 = _mm_add_epi32(m3, tmp);
+		m3 = _mm_sha256msg2_epu32(m3, m2);
+		msg = _mm_shuffle_epi32(msg, 0x0E);
+		s0 = _mm_sha256rnds2_epu32(s0, s1, msg);
+
+		SHA2_256_NI_ROUNDS(m3, 15);                     // 60-63
+
+		s0 = _mm_add_epi32(s0, s0_save);
+		s1 = _mm_add_epi32(s1, s1_save);
+	}
+
+#undef SHA2_256_NI_QROUND
+#undef SHA2_256_NI_ROUNDS
+#undef SHA2_256_NI_K
+
+	// Back to ABCD and EFGH
+	tmp = _mm_shuffle_epi32(s0, 0x1B);
+	s1 = _mm_shuffle_epi32(s1, 0xB1);
+	s0 = _mm_blend_epi16(tmp, s1, 0xF0);
+	s1 = _mm_alignr_epi8(s1, tmp, 8);
+
+	(void) _mm_storeu_si128((void *) &ctx->sha2_256.state[0x00U], s0);
+	(void) _mm_storeu_si128((void *) &ctx->sha2_256.state[0x04U], s1);
+}
+
+#endif /* ATHEME_DIGEST_HAVE_ACCEL_X86 */
+
+#ifdef ATHEME_DIGEST_HAVE_ACCEL_ARMV8
+
+static bool
+digest_accel_armv8_have_sha1(void)
+{
+	return ((getauxval(AT_HWCAP) & HWCAP_SHA1) != 0);
+}
+
+static bool
+digest_accel_armv8_have_sha2(void)
+{
+	return ((getauxval(AT_HWCAP) & HWCAP_SHA2) != 0);
+}
+
+static inline uint32x4_t
+digest_accel_armv8_load(const unsigned char *const restrict in)
+{
+	return vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(in)));
+}
+
+static void DIGEST_ACCEL_ARMV8_ATTR
+digest_blocks_sha1_armv8(union digest_direct_ctx *const restrict ctx, const unsigned char *in, size_t nblocks)
+{
+	const uint32x4_t k0 = vdupq_n_u32(UINT32_C(0x5A827999));
+	const uint32x4_t k1 = vdupq_n_u32(UINT32_C(0x6ED9EBA1));
+	const uint32x4_t k2 = vdupq_n_u32(UINT32_C(0x8F1BBCDC));
+	const uint32x4_t k3 = vdupq_n_u32(UINT32_C(0xCA62C1D6));
+
+	uint32x4_t abcd = vld1q_u32(ctx->sha1.state);
+	uint32_t e0 = ctx->sha1.state[0x04U];
+	uint32_t e1;
+
+	for ( ; nblocks; nblocks--, in += DIGEST_BKLEN_SHA1)
+	{
+		const uint32x4_t abcd_save = abcd;
+		const uint32_t e0_save = e0;
+
+		uint32x4_t m0 = digest_accel_armv8_load(in + 0x00U);
+		uint32x4_t m1 = digest_accel_armv8_load(in + 0x10U);
+		uint32x4_t m2 = digest_accel_armv8_load(in + 0x20U);
+		uint32x4_t m3 = digest_accel_armv8_load(in + 0x30U);
+
+		uint32x4_t t0 = vaddq_u32(m0, k0);
+		uint32x4_t t1 = vaddq_u32(m1, k0);
+
+/* Four rounds at a time: op is the round function's instruction, and each
+ * group queues up the words (plus constant) for the group after next in tn,
+ * and works on the schedule of the words after that.
+ */
+#define SHA1_CE_QROUND(op, ein, eout, tc, tn, knext, nxt2)                                                          \
+    do {                                                                                                            \
+        eout = vsha1h_u32(vgetq_lane_u32(abcd, 0));                                                                 \
+        abcd = op(abcd, ein, tc);                                                                                   \
+        tn = vaddq_u32(nxt2, knext);                                                                                \
+    } while (0)
+
+		SHA1_CE_QROUND(vsha1cq_u32, e0, e1, t0, t0, k0, m2);         // 0-3
+		m0 = vsha1su0q_u32(m0, m1, m2);
+
+		SHA1_CE_QROUND(vsha1cq_u32, e1, e0, t1, t1, k0, m3);         // 4-7
+		m0 = vsha1su1q_u32(m0, m3);
+		m1 = vsha1su0q_u32(m1, m2, m3);
+
+		SHA1_CE_QROUND(vsha1cq_u32, e0, e1, t0, t0, k0, m0);         // 8-11
+		m1 = vsha1su1q_u32(m1, m0);
+		m2 = vsha1su0q_u32(m2, m3, m0);
+
+		SHA1_CE_QROUND(vsha1cq_u32, e1, e0, t1, t1, k1, m1);         // 12-15
+		m2 = vsha1su1q_u32(m2, m1);
+		m3 = vsha1su0q_u32(m3, m0, m1);
+
+		SHA1_CE_QROUND(vsha1cq_u32, e0, e1, t0, t0, k1, m2);         // 16-19
+		m3 = vsha1su1q_u32(m3, m2);
+		m0 = vsha1su0q_u32(m0, m1, m2);
+
+		SHA1_CE_QROUND(vsha1pq_u32, e1, e0, t1, t1, k1, m3);         // 20-23
+		m0 = vsha1su1q_u32(m0, m3);
+		m1 = vsha1su0q_u32(m1, m2, m3);
+
+		SHA1_CE_QROUND(vsha1pq_u32, e0, e1, t0, t0, k1, m0);         // 24-27
+		m1 = vsha1su1q_u32(m1, m0);
+		m2 = vsha1su0q_u32(m2, m3, m0);
+
+		SHA1_CE_QROUND(vsha1pq_u32, e1, e0, t1, t1, k1, m1);         // 28-31
+		m2 = vsha1su1q_u32(m2, m1);
+		m3 = vsha1su0q_u32(m3, m0, m1);
+
+		SHA1_CE_QROUND(vsha1pq_u32, e0, e1, t0, t0, k2, m2);         // 32-35
+		m3 = vsha1su1q_u32(m3, m2);
+		m0 = vsha1su0q_u32(m0, m1, m2);
+
+		SHA1_CE_QROUND(vsha1pq_u32, e1, e0, t1, t1, k2, m3);         // 36-39
+		m0 = vsha1su1q_u32(m0, m3);
+		m1 = vsha1su0q_u32(m1, m2, m3);
+
+		SHA1_CE_QROUND(vsha1mq_u32, e0, e1, t0, t0, k2, m0);         // 40-43
+		m1 = vsha1su1q_u32(m1, m0);
+		m2 = vsha1su0q_u32(m2, m3, m0);
+
+		SHA1_CE_QROUND(vsha1mq_u32, e1, e0, t1, t1, k2, m1);         // 44-47
+		m2 = vsha1su1q_u32(m2, m1);
+		m3 = vsha1su0q_u32(m3, m0, m1);
+
+		SHA1_CE_QROUND(vsha1mq_u32, e0, e1, t0, t0, k2, m2);         // 48-51
+		m3 = vsha1su1q_u32(m3, m2);
+		m0 = vsha1su0q_u32(m0, m1, m2);
+
+		SHA1_CE_QROUND(vsha1mq_u32, e1, e0, t1, t1, k3, m3);         // 52-55
+		m0 = vsha1su1q_u32(m0, m3);
+		m1 = vsha1su0q_u32(m1, m2, m3);
+
+		SHA1_CE_QROUND(vsha1mq_u32, e0, e1, t0, t0, k3, m0);         // 56-59
+		m1 = vsha1su1q_u32(m1, m0);
+		m2 = vsha1su0q_u32(m2, m3, m0);
+
+		SHA1_CE_QROUND(vsha1pq_u32, e1, e0, t1, t1, k3, m1);         // 60-63
+		m2 = vsha1su1q_u32(m2, m1);
+		m3 = vsha1su0q_u32(m3, m0, m1);
+
+		SHA1_CE_QROUND(vsha1pq_u32, e0, e1, t0, t0, k3, m2);         // 64-67
+		m3 = vsha1su1q_u32(m3, m2);
+
+		SHA1_CE_QROUND(vsha1pq_u32, e1, e0, t1, t1, k3, m3);         // 68-71
+
+#undef SHA1_CE_QROUND
+
+		// Rounds 72-75
+		e1 = vsha1h_u32(vgetq_lane_u32(abcd, 0));
+		abcd = vsha1pq_u32(abcd, e0, t0);
+
+		// Rounds 76-79
+		e0 = vsha1h_u32(vgetq_lane_u32(abcd, 0));
+		abcd = vsha1pq_u32(abcd, e1, t1);
+
+		e0 += e0_save;
+		abcd = vaddq_u32(abcd_save, abcd);
+	}
+
+	(void) vst1q_u32(ctx->sha1.state, abcd);
+
+	ctx->sha1.state[0x04U] = e0;
+}
+
+static void DIGEST_ACCEL_ARMV8_ATTR
+digest_blocks_sha2_256_armv8(union digest_direct_ctx *const restrict ctx, const unsigned char *in,
+                             size_t nblocks)
+{
+	uint32x4_t s0 = vld1q_u32(&ctx->sha2_256.state[0x00U]);
+	uint32x4_t s1 = vld1q_u32(&ctx->sha2_256.state[0x04U]);
+
+	for ( ; nblocks; nblocks--, in += DIGEST_BKLEN_SHA2_256)
+	{
+		const uint32x4_t s0_save = s0;
+		const uint32x4_t s1_save = s1;
+
+		uint32x4_t m[0x04U] = {
+			digest_accel_armv8_load(in + 0x00U),
+			digest_accel_armv8_load(in + 0x10U),
+			digest_accel_armv8_load(in + 0x20U),
+			digest_accel_armv8_load(in + 0x30U),
+		};
+
+		uint32x4_t wk = vaddq_u32(m[0], vld1q_u32(&digest_accel_K256[0x00U]));
+
+		// The compiler unrolls this; the array indices are all constant then
+		for (unsigned int i = 0x00U; i < 0x10U; i++)
+		{
+			const uint32x4_t cur = wk;
+			const uint32x4_t s0_prev = s0;
+
+			if (i < 0x0CU)
+				m[i & 0x03U] = vsha256su0q_u32(m[i & 0x03U], m[(i + 0x01U) & 0x03U]);
+
+			if (i < 0x0FU)
+				wk = vaddq_u32(m[(i + 0x01U) & 0x03U], vld1q_u32(&digest_accel_K256[(i + 0x01U) * 0x04U]));
+
+			s0 = vsha256hq_u32(s0, s1, cur);
+			s1 = vsha256h2q_u32(s1, s0_prev, cur);
+
+			if (i < 0x0CU)
+				m[i & 0x03U] = vsha256su1q_u32(m[i & 0x03U], m[(i + 0x02U) & 0x03U],
+				                               m[(i + 0x03U) & 0x03U]);
+		}
+
+		s0 = vaddq_u32(s0, s0_save);
+		s1 = vaddq_u32(s1, s1_save);
+	}
+
+	(void) vst1q_u32(&ctx->sha2_256.state[0x00U], s0);
+	(void) vst1q_u32(&ctx->sha2_256.state[0x04U], s1);
+}
+
+#endif /* ATHEME_DIGEST_HAVE_ACCEL_ARMV8 */
+
+// Each list goes from worst to best
+static const struct digest_direct_kernel digest_kernels_sha1[] = {
+
+	{ "portable",   &digest_direct_blocks_sha1_portable,        NULL                            },
+#ifdef ATHEME_DIGEST_HAVE_ACCEL_X86
+	{ "SHA-NI",     &digest_blocks_sha1_shani,                  &digest_accel_x86_have_sha      },
+#endif
+#ifdef ATHEME_DIGEST_HAVE_ACCEL_ARMV8
+	{ "ARMv8-CE",   &digest_blocks_sha1_armv8,                  &digest_accel_armv8_have_sha1   },
+#endif
+};
+
+static const struct digest_direct_kernel digest_kernels_sha2_256[] = {
+
+	{ "portable",   &digest_direct_blocks_sha2_256_portable,    NULL                            },
+#ifdef ATHEME_DIGEST_HAVE_ACCEL_X86
+	{ "SHA-NI",     &digest_blocks_sha2_256_shani,              &digest_accel_x86_have_sha      },
+#endif
+#ifdef ATHEME_DIGEST_HAVE_ACCEL_ARMV8
+	{ "ARMv8-CE",   &digest_blocks_sha2_256_armv8,              &digest_accel_armv8_have_sha2   },
+#endif
+};
+
+static const struct digest_direct_kernel digest_kernels_sha2_512[] = {
+
+	{ "portable",   &digest_direct_blocks_sha2_512_portable,    NULL                            },
+#ifdef ATHEME_DIGEST_HAVE_ACCEL_X86
+	{ "AVX2+BMI2",  &digest_direct_blocks_sha2_512_avx2,        &digest_accel_x86_have_avx2     },
+#endif
+};
+
+static void digest_blocks_sha1_first(union digest_direct_ctx *, const unsigned char *, size_t);
+static void digest_blocks_sha2_256_first(union digest_direct_ctx *, const unsigned char *, size_t);
+static void digest_blocks_sha2_512_first(union digest_direct_ctx *, const unsigned char *, size_t);
+
+// These start out pointing at functions that select the best kernels and then hand over to them
+digest_direct_blocks_fn digest_direct_blocks_sha1 = &digest_blocks_sha1_first;
+digest_direct_blocks_fn digest_direct_blocks_sha2_256 = &digest_blocks_sha2_256_first;
+digest_direct_blocks_fn digest_direct_blocks_sha2_512 = &digest_blocks_sha2_512_first;
+
+static const struct digest_direct_kernel_set *
+digest_kernel_set(const enum digest_algorithm alg)
+{
+	static const struct digest_direct_kernel_set sets[] = {
+
+		{ digest_kernels_sha1, sizeof digest_kernels_sha1 / sizeof digest_kernels_sha1[0],
+		  &digest_direct_blocks_sha1 },
+
+		{ digest_kernels_sha2_256, sizeof digest_kernels_sha2_256 / sizeof digest_kernels_sha2_256[0],
+		  &digest_direct_blocks_sha2_256 },
+
+		{ digest_kernels_sha2_512, sizeof digest_kernels_sha2_512 / sizeof digest_kernels_sha2_512[0],
+		  &digest_direct_blocks_sha2_512 },
+	};
+
+	switch (alg)
+	{
+		case DIGALG_SHA1:
+			return &sets[0];
+		case DIGALG_SHA2_256:
+			return &sets[1];
+		case DIGALG_SHA2_512:
+			return &sets[2];
+		default:
+			return NULL;
+	}
+}
+
+// The idx'th kernel in the set that this CPU can run, or NULL
+static const struct digest_direct_kernel *
+digest_kernel_usable(const struct digest_direct_kernel_set *const restrict set, size_t idx)
+{
+	for (size_t i = 0; i < set->count; i++)
+	{
+		const struct digest_direct_kernel *const k = &set->kernels[i];
+
+		if (k->usable && ! k->usable())
+			continue;
+
+		if (! idx--)
+			return k;
+	}
+
+	return NULL;
+}
+
+static void
+digest_kernel_select_best(const enum digest_algorithm alg)
+{
+	const size_t count = digest_direct_kernel_count(alg);
+
+	if (count)
+		(void) digest_direct_kernel_select(alg, count - 1U);
+}
+
+static void
+digest_blocks_sha1_first(union digest_direct_ctx *const restrict state, const unsigned char *const restrict in,
+                         const size_t nblocks)
+{
+	(void) digest_kernel_select_best(DIGALG_SHA1);
+	(void) digest_direct_blocks_sha1(state, in, nblocks);
+}
+
+static void
+digest_blocks_sha2_256_first(union digest_direct_ctx *const restrict state, const unsigned char *const restrict in,
+                             const size_t nblocks)
+{
+	(void) digest_kernel_select_best(DIGALG_SHA2_256);
+	(void) digest_direct_blocks_sha2_256(state, in, nblocks);
+}
+
+static void
+digest_blocks_sha2_512_first(union digest_direct_ctx *const restrict state, const unsigned char *const restrict in,
+                             const size_t nblocks)
+{
+	(void) digest_kernel_select_best(DIGALG_SHA2_512);
+	(void) digest_direct_blocks_sha2_512(state, in, nblocks);
+}
+
+// How many kernels this CPU can run for alg (0 if alg has no choice of them)
+size_t
+digest_direct_kernel_count(const enum digest_algorithm alg)
+{
+	const struct digest_direct_kernel_set *const set = digest_kernel_set(alg);
+	size_t count = 0;
+
+	if (! set)
+		return 0;
+
+	while (digest_kernel_usable(set, count))
+		count++;
+
+	return count;
+}
+
+const char *
+digest_direct_kernel_name(const enum digest_algorithm alg, const size_t idx)
+{
+	const struct digest_direct_kernel_set *const set = digest_kernel_set(alg);
+	const struct digest_direct_kernel *const k = set ? digest_kernel_usable(set, idx) : NULL;
+
+	return k ? k->name : NULL;
+}
+
+/* Nothing else should be hashing while this is called; the testsuite and
+ * crypto-benchmark only call it before any other threads are started.
+ */
+bool
+digest_direct_kernel_select(const enum digest_algorithm alg, const size_t idx)
+{
+	const struct digest_direct_kernel_set *const set = digest_kernel_set(alg);
+	const struct digest_direct_kernel *const k = set ? digest_kernel_usable(set, idx) : NULL;
+
+	if (! k)
+		return false;
+
+	*set->active = k->fn;
+	return true;
+}
+
+// The index of the selected kernel for alg (selecting the best one if none is yet)
+size_t
+digest_direct_kernel_selected(const enum digest_algorithm alg)
+{
+	const struct digest_direct_kernel_set *const set = digest_kernel_set(alg);
+	const struct digest_direct_kernel *k;
+
+	if (! set)
+		return 0;
+
+	for (size_t i = 0; (k = digest_kernel_usable(set, i)) != NULL; i++)
+		if (k->fn == *set->active)
+			return i;
+
+	(void) digest_kernel_select_best(alg);
+	return digest_direct_kernel_selected(alg);
+}
+
+const char *
+digest_direct_get_kernels(void)
+{
+	static char result[0x80U];
+
+	(void) snprintf(result, sizeof result, "SHA1: %s, SHA2-256: %s, SHA2-512: %s",
+	                digest_direct_kernel_name(DIGALG_SHA1, digest_direct_kernel_selected(DIGALG_SHA1)),
+	                digest_direct_kernel_name(DIGALG_SHA2_256, digest_direct_kernel_selected(DIGALG_SHA2_256)),
+	                digest_direct_kernel_name(DIGALG_SHA2_512, digest_direct_kernel_selected(DIGALG_SHA2_512)));
+
+	return result;
+}
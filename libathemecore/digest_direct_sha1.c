@@ -193,6 +193,14 @@ digest_transform_block_sha1(union digest_direct_ctx *const restrict state,
 	(void) smemzero(s, sizeof s);
 }
 
+void
+digest_direct_blocks_sha1_portable(union digest_direct_ctx *const restrict state, const unsigned char *in,
+                                   size_t nblocks)
+{
+	for ( ; nblocks; nblocks--, in += DIGEST_BKLEN_SHA1)
+		(void) digest_transform_block_sha1(state, in);
+}
+
 void
 digest_direct_init_sha1(union digest_direct_ctx *const restrict state)
 {
@@ -227,10 +235,16 @@ digest_direct_update_sha1(union digest_direct_ctx *const restrict state, const v
 		i = 0x40U - j;
 
 		(void) memcpy(state->sha1.buf + j, ptr, i);
-		(void) digest_transform_block_sha1(state, state->sha1.buf);
+		(void) digest_direct_blocks_sha1(state, state->sha1.buf, 0x01U);
+
+		const size_t nblocks = (len - i) / 0x40U;
+
+		if (nblocks)
+		{
+			(void) digest_direct_blocks_sha1(state, ptr + i, nblocks);
 
-		for ( ; (i + 0x3FU) < len; i += 0x40U)
-			(void) digest_transform_block_sha1(state, ptr + i);
+			i += (uint32_t) (nblocks * 0x40U);
+		}
 
 		j = 0x00U;
 	}
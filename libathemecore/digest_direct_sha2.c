@@ -208,7 +208,14 @@ digest_transform_block_sha2_256(union digest_direct_ctx *const state, const uint
 	(void) smemzero(s, sizeof s);
 }
 
-static void
+/* Built into both the portable and the AVX2 block functions below; the
+ * latter lets the compiler use BMI2's rotates and the wider registers.
+ */
+#ifdef ATHEME_DIGEST_HAVE_ACCEL_X86
+static inline void __attribute__((__always_inline__))
+#else
+static inline void
+#endif
 digest_transform_block_sha2_512(union digest_direct_ctx *const state, const uint64_t *data)
 {
 	static const uint64_t K[] = {
@@ -292,6 +299,32 @@ digest_transform_block_sha2_512(union digest_direct_ctx *const state, const uint
 	(void) smemzero(s, sizeof s);
 }
 
+void
+digest_direct_blocks_sha2_256_portable(union digest_direct_ctx *const restrict state, const unsigned char *in,
+                                       size_t nblocks)
+{
+	for ( ; nblocks; nblocks--, in += DIGEST_BKLEN_SHA2_256)
+		(void) digest_transform_block_sha2_256(state, (const void *) in);
+}
+
+void
+digest_direct_blocks_sha2_512_portable(union digest_direct_ctx *const restrict state, const unsigned char *in,
+                                       size_t nblocks)
+{
+	for ( ; nblocks; nblocks--, in += DIGEST_BKLEN_SHA2_512)
+		(void) digest_transform_block_sha2_512(state, (const void *) in);
+}
+
+#ifdef ATHEME_DIGEST_HAVE_ACCEL_X86
+void __attribute__((__target__("avx2,bmi2")))
+digest_direct_blocks_sha2_512_avx2(union digest_direct_ctx *const restrict state, const unsigned char *in,
+                                   size_t nblocks)
+{
+	for ( ; nblocks; nblocks--, in += DIGEST_BKLEN_SHA2_512)
+		(void) digest_transform_block_sha2_512(state, (const void *) in);
+}
+#endif /* ATHEME_DIGEST_HAVE_ACCEL_X86 */
+
 void
 digest_direct_init_sha2_256(union digest_direct_ctx *const restrict state)
 {
@@ -339,7 +372,7 @@ digest_direct_update_sha2_256(union digest_direct_ctx *const restrict state,
 		if (rem >= freespace)
 		{
 			(void) memcpy(state->sha2_256.buf + usedspace, ptr, (size_t) freespace);
-			(void) digest_transform_block_sha2_256(state, (const void *) state->sha2_256.buf);
+			(void) digest_direct_blocks_sha2_256(state, state->sha2_256.buf, 0x01U);
 
 			state->sha2_256.count += (freespace << 0x03U);
 
@@ -356,14 +389,17 @@ digest_direct_update_sha2_256(union digest_direct_ctx *const restrict state,
 		}
 	}
 
-	while (rem >= DIGEST_BKLEN_SHA2_256)
+	if (rem >= DIGEST_BKLEN_SHA2_256)
 	{
-		(void) digest_transform_block_sha2_256(state, (const void *) ptr);
+		const size_t nblocks = (rem / DIGEST_BKLEN_SHA2_256);
+		const size_t nbytes = (nblocks * DIGEST_BKLEN_SHA2_256);
+
+		(void) digest_direct_blocks_sha2_256(state, ptr, nblocks);
 
-		state->sha2_256.count += (DIGEST_BKLEN_SHA2_256 << 0x03U);
+		state->sha2_256.count += (((uint64_t) nbytes) << 0x03U);
 
-		ptr += DIGEST_BKLEN_SHA2_256;
-		rem -= DIGEST_BKLEN_SHA2_256;
+		ptr += nbytes;
+		rem -= nbytes;
 	}
 
 	if (rem)
@@ -393,7 +429,7 @@ digest_direct_update_sha2_512(union digest_direct_ctx *const restrict state,
 		if (rem >= freespace)
 		{
 			(void) memcpy(state->sha2_512.buf + usedspace, ptr, (size_t) freespace);
-			(void) digest_transform_block_sha2_512(state, (const void *) state->sha2_512.buf);
+			(void) digest_direct_blocks_sha2_512(state, state->sha2_512.buf, 0x01U);
 
 			SHA2_512_ADDINC128(state->sha2_512.count, (freespace << 0x03U));
 
@@ -410,14 +446,17 @@ digest_direct_update_sha2_512(union digest_direct_ctx *const restrict state,
 		}
 	}
 
-	while (rem >= DIGEST_BKLEN_SHA2_512)
+	if (rem >= DIGEST_BKLEN_SHA2_512)
 	{
-		(void) digest_transform_block_sha2_512(state, (const void *) ptr);
+		const size_t nblocks = (rem / DIGEST_BKLEN_SHA2_512);
+		const size_t nbytes = (nblocks * DIGEST_BKLEN_SHA2_512);
+
+		(void) digest_direct_blocks_sha2_512(state, ptr, nblocks);
 
-		SHA2_512_ADDINC128(state->sha2_512.count, (DIGEST_BKLEN_SHA2_512 << 0x03U));
+		SHA2_512_ADDINC128(state->sha2_512.count, (((uint64_t) nbytes) << 0x03U));
 
-		ptr += DIGEST_BKLEN_SHA2_512;
-		rem -= DIGEST_BKLEN_SHA2_512;
+		ptr += nbytes;
+		rem -= nbytes;
 	}
 
 	if (rem)
@@ -451,7 +490,7 @@ digest_direct_final_sha2_256(union digest_direct_ctx *const restrict state, void
 				(void) memset(state->sha2_256.buf + usedspace, 0x00U,
 				              (DIGEST_BKLEN_SHA2_256 - usedspace));
 
-			(void) digest_transform_block_sha2_256(state, (const void *) state->sha2_256.buf);
+			(void) digest_direct_blocks_sha2_256(state, state->sha2_256.buf, 0x01U);
 			(void) memset(state->sha2_256.buf, 0x00U, DIGEST_SHORT_BKLEN_SHA2_256);
 		}
 	}
@@ -464,7 +503,7 @@ digest_direct_final_sha2_256(union digest_direct_ctx *const restrict state, void
 
 	*((uint64_t *) ((void *) &state->sha2_256.buf[DIGEST_SHORT_BKLEN_SHA2_256])) = state->sha2_256.count;
 
-	(void) digest_transform_block_sha2_256(state, (const void *) state->sha2_256.buf);
+	(void) digest_direct_blocks_sha2_256(state, state->sha2_256.buf, 0x01U);
 
 	uint32_t *d = (uint32_t *) out;
 
@@ -502,7 +541,7 @@ digest_direct_final_sha2_512(union digest_direct_ctx *const restrict state, void
 				(void) memset(state->sha2_512.buf + usedspace, 0x00U,
 				              (DIGEST_BKLEN_SHA2_512 - usedspace));
 
-			(void) digest_transform_block_sha2_512(state, (const void *) state->sha2_512.buf);
+			(void) digest_direct_blocks_sha2_512(state, state->sha2_512.buf, 0x01U);
 			(void) memset(state->sha2_512.buf, 0x00U, (DIGEST_BKLEN_SHA2_512 - 0x02U));
 		}
 	}
@@ -516,7 +555,7 @@ digest_direct_final_sha2_512(union digest_direct_ctx *const restrict state, void
 	*((uint64_t *) ((void *) &state->sha2_512.buf[DIGEST_SHORT_BKLEN_SHA2_512])) = state->sha2_512.count[0x01U];
 	*((uint64_t *) ((void *) &state->sha2_512.buf[DIGEST_SHORT_BKLEN_SHA2_512 + 0x08U])) = state->sha2_512.count[0x00U];
 
-	(void) digest_transform_block_sha2_512(state, (const void *) state->sha2_512.buf);
+	(void) digest_direct_blocks_sha2_512(state, state->sha2_512.buf, 0x01U);
 
 	uint64_t *d = (uint64_t *) out;
 
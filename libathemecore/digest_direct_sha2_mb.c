@@ -0,0 +1,187 @@
+/*
+ * SPDX-License-Identifier: ISC
+ * SPDX-URL: https://spdx.org/licenses/ISC.html
+ *
+ * Copyright (C) 2026 Atheme Development Group (https://atheme.github.io/)
+ *
+ * Multi-buffer PBKDF2-HMAC-SHA2 backend for Atheme IRC Services.
+ *
+ * PBKDF2 spends practically all of its time in the loop that computes
+ * U(j) = HMAC(P, U(j - 1)); each pass is two compressions of a single, fixed
+ * layout block, and each pass depends on the one before it, so one password
+ * cannot use more than one SIMD lane. Several passwords at once can, though:
+ * these kernels run that loop for up to DIGEST_MB_LANES_SHA2_* independent
+ * derivations (with the same iteration count) side by side, one per SIMD
+ * lane, using the compiler's generic vector extensions. The compiler lowers
+ * those to whatever the target has (SSE2 or NEON, for instance); on x86-64 a
+ * second copy is built for AVX2 and selected at runtime when the CPU has it.
+ *
+ * The callers (see digest_fe_internal.c) compute the HMAC key states and the
+ * first U block with the scalar code and only hand the iterations to us.
+ */
+
+#include <atheme/attributes.h>          // ATHEME_VATTR_*
+#include <atheme/digest/direct.h>       // self-declarations
+#include <atheme/memory.h>              // smemzero()
+#include <atheme/stdheaders.h>          // size_t, uint32_t, uint64_t
+
+#ifdef ATHEME_DIGEST_HAVE_MB_SHA2
+
+#define ATHEME_LAC_DIGEST_DIRECT_SHA2_MB_C 1
+
+typedef uint32_t digest_mb_v32 __attribute__((__vector_size__(DIGEST_MB_LANES_SHA2_256 * sizeof(uint32_t))));
+typedef uint64_t digest_mb_v64 __attribute__((__vector_size__(DIGEST_MB_LANES_SHA2_512 * sizeof(uint64_t))));
+
+#define DIGEST_MB_V32_SPLAT(x)          (((digest_mb_v32) { 0 }) + ((uint32_t) (x)))
+#define DIGEST_MB_V64_SPLAT(x)          (((digest_mb_v64) { 0 }) + ((uint64_t) (x)))
+
+#define SHA2_MB_SHR(b, x)               ((x) >> (b))
+#define SHA2_MB_256_S32(b, x)           (((x) >> (b)) | ((x) << (0x20U - (b))))
+#define SHA2_MB_512_S64(b, x)           (((x) >> (b)) | ((x) << (0x40U - (b))))
+
+#define SHA2_MB_256_Sigma0(x)           (SHA2_MB_256_S32(0x02U, (x)) ^ SHA2_MB_256_S32(0x0DU, (x)) ^ SHA2_MB_256_S32(0x16U, (x)))
+#define SHA2_MB_256_Sigma1(x)           (SHA2_MB_256_S32(0x06U, (x)) ^ SHA2_MB_256_S32(0x0BU, (x)) ^ SHA2_MB_256_S32(0x19U, (x)))
+#define SHA2_MB_256_sigma0(x)           (SHA2_MB_256_S32(0x07U, (x)) ^ SHA2_MB_256_S32(0x12U, (x)) ^ SHA2_MB_SHR(0x03U, (x)))
+#define SHA2_MB_256_sigma1(x)           (SHA2_MB_256_S32(0x11U, (x)) ^ SHA2_MB_256_S32(0x13U, (x)) ^ SHA2_MB_SHR(0x0AU, (x)))
+
+#define SHA2_MB_512_Sigma0(x)           (SHA2_MB_512_S64(0x1CU, (x)) ^ SHA2_MB_512_S64(0x22U, (x)) ^ SHA2_MB_512_S64(0x27U, (x)))
+#define SHA2_MB_512_Sigma1(x)           (SHA2_MB_512_S64(0x0EU, (x)) ^ SHA2_MB_512_S64(0x12U, (x)) ^ SHA2_MB_512_S64(0x29U, (x)))
+#define SHA2_MB_512_sigma0(x)           (SHA2_MB_512_S64(0x01U, (x)) ^ SHA2_MB_512_S64(0x08U, (x)) ^ SHA2_MB_SHR(0x07U, (x)))
+#define SHA2_MB_512_sigma1(x)           (SHA2_MB_512_S64(0x13U, (x)) ^ SHA2_MB_512_S64(0x3DU, (x)) ^ SHA2_MB_SHR(0x06U, (x)))
+
+#define SHA2_MB_Ch(x, y, z)             (((x) & (y)) ^ ((~(x)) & (z)))
+#define SHA2_MB_Maj(x, y, z)            (((x) & (y)) ^ ((x) & (z)) ^ ((y) & (z)))
+
+static const uint32_t digest_mb_K256[] = {
+
+	UINT32_C(0x428A2F98), UINT32_C(0x71374491), UINT32_C(0xB5C0FBCF), UINT32_C(0xE9B5DBA5),
+	UINT32_C(0x3956C25B), UINT32_C(0x59F111F1), UINT32_C(0x923F82A4), UINT32_C(0xAB1C5ED5),
+	UINT32_C(0xD807AA98), UINT32_C(0x12835B01), UINT32_C(0x243185BE), UINT32_C(0x550C7DC3),
+	UINT32_C(0x72BE5D74), UINT32_C(0x80DEB1FE), UINT32_C(0x9BDC06A7), UINT32_C(0xC19BF174),
+	UINT32_C(0xE49B69C1), UINT32_C(0xEFBE4786), UINT32_C(0x0FC19DC6), UINT32_C(0x240CA1CC),
+	UINT32_C(0x2DE92C6F), UINT32_C(0x4A7484AA), UINT32_C(0x5CB0A9DC), UINT32_C(0x76F988DA),
+	UINT32_C(0x983E5152), UINT32_C(0xA831C66D), UINT32_C(0xB00327C8), UINT32_C(0xBF597FC7),
+	UINT32_C(0xC6E00BF3), UINT32_C(0xD5A79147), UINT32_C(0x06CA6351), UINT32_C(0x14292967),
+	UINT32_C(0x27B70A85), UINT32_C(0x2E1B2138), UINT32_C(0x4D2C6DFC), UINT32_C(0x53380D13),
+	UINT32_C(0x650A7354), UINT32_C(0x766A0ABB), UINT32_C(0x81C2C92E), UINT32_C(0x92722C85),
+	UINT32_C(0xA2BFE8A1), UINT32_C(0xA81A664B), UINT32_C(0xC24B8B70), UINT32_C(0xC76C51A3),
+	UINT32_C(0xD192E819), UINT32_C(0xD6990624), UINT32_C(0xF40E3585), UINT32_C(0x106AA070),
+	UINT32_C(0x19A4C116), UINT32_C(0x1E376C08), UINT32_C(0x2748774C), UINT32_C(0x34B0BCB5),
+	UINT32_C(0x391C0CB3), UINT32_C(0x4ED8AA4A), UINT32_C(0x5B9CCA4F), UINT32_C(0x682E6FF3),
+	UINT32_C(0x748F82EE), UINT32_C(0x78A5636F), UINT32_C(0x84C87814), UINT32_C(0x8CC70208),
+	UINT32_C(0x90BEFFFA), UINT32_C(0xA4506CEB), UINT32_C(0xBEF9A3F7), UINT32_C(0xC67178F2),
+};
+
+static const uint64_t digest_mb_K512[] = {
+
+	UINT64_C(0x428A2F98D728AE22), UINT64_C(0x7137449123EF65CD),
+	UINT64_C(0xB5C0FBCFEC4D3B2F), UINT64_C(0xE9B5DBA58189DBBC),
+	UINT64_C(0x3956C25BF348B538), UINT64_C(0x59F111F1B605D019),
+	UINT64_C(0x923F82A4AF194F9B), UINT64_C(0xAB1C5ED5DA6D8118),
+	UINT64_C(0xD807AA98A3030242), UINT64_C(0x12835B0145706FBE),
+	UINT64_C(0x243185BE4EE4B28C), UINT64_C(0x550C7DC3D5FFB4E2),
+	UINT64_C(0x72BE5D74F27B896F), UINT64_C(0x80DEB1FE3B1696B1),
+	UINT64_C(0x9BDC06A725C71235), UINT64_C(0xC19BF174CF692694),
+	UINT64_C(0xE49B69C19EF14AD2), UINT64_C(0xEFBE4786384F25E3),
+	UINT64_C(0x0FC19DC68B8CD5B5), UINT64_C(0x240CA1CC77AC9C65),
+	UINT64_C(0x2DE92C6F592B0275), UINT64_C(0x4A7484AA6EA6E483),
+	UINT64_C(0x5CB0A9DCBD41FBD4), UINT64_C(0x76F988DA831153B5),
+	UINT64_C(0x983E5152EE66DFAB), UINT64_C(0xA831C66D2DB43210),
+	UINT64_C(0xB00327C898FB213F), UINT64_C(0xBF597FC7BEEF0EE4),
+	UINT64_C(0xC6E00BF33DA88FC2), UINT64_C(0xD5A79147930AA725),
+	UINT64_C(0x06CA6351E003826F), UINT64_C(0x142929670A0E6E70),
+	UINT64_C(0x27B70A8546D22FFC), UINT64_C(0x2E1B21385C26C926),
+	UINT64_C(0x4D2C6DFC5AC42AED), UINT64_C(0x53380D139D95B3DF),
+	UINT64_C(0x650A73548BAF63DE), UINT64_C(0x766A0ABB3C77B2A8),
+	UINT64_C(0x81C2C92E47EDAEE6), UINT64_C(0x92722C851482353B),
+	UINT64_C(0xA2BFE8A14CF10364), UINT64_C(0xA81A664BBC423001),
+	UINT64_C(0xC24B8B70D0F89791), UINT64_C(0xC76C51A30654BE30),
+	UINT64_C(0xD192E819D6EF5218), UINT64_C(0xD69906245565A910),
+	UINT64_C(0xF40E35855771202A), UINT64_C(0x106AA07032BBD1B8),
+	UINT64_C(0x19A4C116B8D2D0C8), UINT64_C(0x1E376C085141AB53),
+	UINT64_C(0x2748774CDF8EEB99), UINT64_C(0x34B0BCB5E19B48A8),
+	UINT64_C(0x391C0CB3C5C95A63), UINT64_C(0x4ED8AA4AE3418ACB),
+	UINT64_C(0x5B9CCA4F7763E373), UINT64_C(0x682E6FF3D6B2B8A3),
+	UINT64_C(0x748F82EE5DEFB2FC), UINT64_C(0x78A5636F43172F60),
+	UINT64_C(0x84C87814A1F0AB72), UINT64_C(0x8CC702081A6439EC),
+	UINT64_C(0x90BEFFFA23631E28), UINT64_C(0xA4506CEBDE82BDE9),
+	UINT64_C(0xBEF9A3F7B2C67915), UINT64_C(0xC67178F2E372532B),
+	UINT64_C(0xCA273ECEEA26619C), UINT64_C(0xD186B8C721C0C207),
+	UINT64_C(0xEADA7DD6CDE0EB1E), UINT64_C(0xF57D4F7FEE6ED178),
+	UINT64_C(0x06F067AA72176FBA), UINT64_C(0x0A637DC5A2C898A6),
+	UINT64_C(0x113F9804BEF90DAE), UINT64_C(0x1B710B35131C471B),
+	UINT64_C(0x28DB77F523047D84), UINT64_C(0x32CAAB7B40C72493),
+	UINT64_C(0x3C9EBE0A15C9BEBC), UINT64_C(0x431D67C49C100D4C),
+	UINT64_C(0x4CC5D4BECB3E42B6), UINT64_C(0x597F299CFC657E2A),
+	UINT64_C(0x5FCB6FAB3AD6FAEC), UINT64_C(0x6C44198C4A475817),
+};
+
+// Baseline ISA
+#define DIGEST_MB_FN(name)      name##_generic
+#define DIGEST_MB_ATTR          /* nothing */
+#include "digest_direct_sha2_mb_kernel.c"
+#undef DIGEST_MB_ATTR
+#undef DIGEST_MB_FN
+
+#ifdef ATHEME_DIGEST_HAVE_MB_SHA2_AVX2
+#  define DIGEST_MB_FN(name)    name##_avx2
+#  define DIGEST_MB_ATTR        __attribute__((__target__("avx2")))
+#  include "digest_direct_sha2_mb_kernel.c"
+#  undef DIGEST_MB_ATTR
+#  undef DIGEST_MB_FN
+#endif /* ATHEME_DIGEST_HAVE_MB_SHA2_AVX2 */
+
+static bool
+digest_mb_have_avx2(void)
+{
+#ifdef ATHEME_DIGEST_HAVE_MB_SHA2_AVX2
+	// This only reads what the compiler runtime found out about the CPU at startup
+	return (__builtin_cpu_supports("avx2") != 0);
+#else
+	return false;
+#endif
+}
+
+const char *
+digest_direct_mb_get_isa(void)
+{
+	return digest_mb_have_avx2() ? "AVX2" : "baseline SIMD";
+}
+
+void
+digest_direct_pbkdf2_mb_sha2_256(struct digest_direct_pbkdf2_lane_sha2_256 *const restrict lanes,
+                                 const size_t nlanes, const size_t iterations)
+{
+	if (! (lanes && nlanes && nlanes <= DIGEST_MB_LANES_SHA2_256))
+		return;
+
+#ifdef ATHEME_DIGEST_HAVE_MB_SHA2_AVX2
+	if (digest_mb_have_avx2())
+	{
+		(void) digest_pbkdf2_mb_sha2_256_avx2(lanes, nlanes, iterations);
+		return;
+	}
+#endif
+
+	(void) digest_pbkdf2_mb_sha2_256_generic(lanes, nlanes, iterations);
+}
+
+void
+digest_direct_pbkdf2_mb_sha2_512(struct digest_direct_pbkdf2_lane_sha2_512 *const restrict lanes,
+                                 const size_t nlanes, const size_t iterations)
+{
+	if (! (lanes && nlanes && nlanes <= DIGEST_MB_LANES_SHA2_512))
+		return;
+
+#ifdef ATHEME_DIGEST_HAVE_MB_SHA2_AVX2
+	if (digest_mb_have_avx2())
+	{
+		(void) digest_pbkdf2_mb_sha2_512_avx2(lanes, nlanes, iterations);
+		return;
+	}
+#endif
+
+	(void) digest_pbkdf2_mb_sha2_512_generic(lanes, nlanes, iterations);
+}
+
+#endif /* ATHEME_DIGEST_HAVE_MB_SHA2 */
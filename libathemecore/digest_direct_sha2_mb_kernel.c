@@ -0,0 +1,203 @@
+/*
+ * SPDX-License-Identifier: ISC
+ * SPDX-URL: https://spdx.org/licenses/ISC.html
+ *
+ * Copyright (C) 2026 Atheme Development Group (https://atheme.github.io/)
+ *
+ * Multi-buffer PBKDF2-HMAC-SHA2 iteration kernels.
+ *
+ * This file is included (possibly more than once) by digest_direct_sha2_mb.c,
+ * with DIGEST_MB_FN(name) naming the functions and DIGEST_MB_ATTR giving
+ * their attributes (e.g. a target ISA), so that the same source can be built
+ * both for the baseline ISA and for a wider one selected at runtime.
+ */
+
+#ifndef ATHEME_LAC_DIGEST_DIRECT_SHA2_MB_C
+#  error "Do not compile me directly; compile digest_direct_sha2_mb.c instead"
+#endif /* !ATHEME_LAC_DIGEST_DIRECT_SHA2_MB_C */
+
+static void DIGEST_MB_ATTR
+DIGEST_MB_FN(digest_pbkdf2_mb_sha2_256)(struct digest_direct_pbkdf2_lane_sha2_256 *const restrict lanes,
+                                        const size_t nlanes, const size_t iterations)
+{
+	digest_mb_v32 istate[DIGEST_IVLEN_SHA2_256];
+	digest_mb_v32 ostate[DIGEST_IVLEN_SHA2_256];
+	digest_mb_v32 u[DIGEST_IVLEN_SHA2_256];
+	digest_mb_v32 t[DIGEST_IVLEN_SHA2_256];
+	digest_mb_v32 W[0x10U];
+	digest_mb_v32 s[DIGEST_IVLEN_SHA2_256];
+
+	for (size_t x = 0x00U; x < DIGEST_IVLEN_SHA2_256; x++)
+	{
+		for (size_t l = 0x00U; l < DIGEST_MB_LANES_SHA2_256; l++)
+		{
+			// Unused lanes just repeat the first one; their results are thrown away
+			const struct digest_direct_pbkdf2_lane_sha2_256 *const lane = &lanes[(l < nlanes) ? l : 0x00U];
+
+			istate[x][l] = lane->istate[x];
+			ostate[x][l] = lane->ostate[x];
+			u[x][l] = lane->u[x];
+			t[x][l] = lane->t[x];
+		}
+	}
+
+	for (size_t i = 0x00U; i < iterations; i++)
+	{
+		// Inner hash: H(istate, U || padding), where the message is one block of key plus one digest
+		for (unsigned int pass = 0x00U; pass < 0x02U; pass++)
+		{
+			const digest_mb_v32 *const init = pass ? ostate : istate;
+
+			for (size_t x = 0x00U; x < DIGEST_IVLEN_SHA2_256; x++)
+			{
+				W[x] = u[x];
+				s[x] = init[x];
+			}
+
+			W[0x08U] = DIGEST_MB_V32_SPLAT(UINT32_C(0x80000000));
+
+			for (size_t x = 0x09U; x < 0x0FU; x++)
+				W[x] = DIGEST_MB_V32_SPLAT(0x00U);
+
+			W[0x0FU] = DIGEST_MB_V32_SPLAT((DIGEST_BKLEN_SHA2_256 + DIGEST_MDLEN_SHA2_256) << 0x03U);
+
+			for (uint32_t j = 0x00U; j < 0x40U; j++)
+			{
+				if (j >= 0x10U)
+				{
+					const digest_mb_v32 s0 = SHA2_MB_256_sigma0(W[(j + 0x01U) & 0x0FU]);
+					const digest_mb_v32 s1 = SHA2_MB_256_sigma1(W[(j + 0x0EU) & 0x0FU]);
+
+					W[j & 0x0FU] += s1 + W[(j + 0x09U) & 0x0FU] + s0;
+				}
+
+				const digest_mb_v32 t1 = s[7] + SHA2_MB_256_Sigma1(s[4]) + SHA2_MB_Ch(s[4], s[5], s[6]) +
+				                         DIGEST_MB_V32_SPLAT(digest_mb_K256[j]) + W[j & 0x0FU];
+				const digest_mb_v32 t2 = SHA2_MB_256_Sigma0(s[0]) + SHA2_MB_Maj(s[0], s[1], s[2]);
+
+				s[7] = s[6];
+				s[6] = s[5];
+				s[5] = s[4];
+				s[4] = s[3] + t1;
+				s[3] = s[2];
+				s[2] = s[1];
+				s[1] = s[0];
+				s[0] = t1 + t2;
+			}
+
+			for (size_t x = 0x00U; x < DIGEST_IVLEN_SHA2_256; x++)
+				u[x] = init[x] + s[x];
+		}
+
+		for (size_t x = 0x00U; x < DIGEST_IVLEN_SHA2_256; x++)
+			t[x] ^= u[x];
+	}
+
+	for (size_t l = 0x00U; l < nlanes; l++)
+	{
+		for (size_t x = 0x00U; x < DIGEST_IVLEN_SHA2_256; x++)
+		{
+			lanes[l].u[x] = u[x][l];
+			lanes[l].t[x] = t[x][l];
+		}
+	}
+
+	(void) smemzero(istate, sizeof istate);
+	(void) smemzero(ostate, sizeof ostate);
+	(void) smemzero(u, sizeof u);
+	(void) smemzero(t, sizeof t);
+	(void) smemzero(W, sizeof W);
+	(void) smemzero(s, sizeof s);
+}
+
+static void DIGEST_MB_ATTR
+DIGEST_MB_FN(digest_pbkdf2_mb_sha2_512)(struct digest_direct_pbkdf2_lane_sha2_512 *const restrict lanes,
+                                        const size_t nlanes, const size_t iterations)
+{
+	digest_mb_v64 istate[DIGEST_IVLEN_SHA2_512];
+	digest_mb_v64 ostate[DIGEST_IVLEN_SHA2_512];
+	digest_mb_v64 u[DIGEST_IVLEN_SHA2_512];
+	digest_mb_v64 t[DIGEST_IVLEN_SHA2_512];
+	digest_mb_v64 W[0x10U];
+	digest_mb_v64 s[DIGEST_IVLEN_SHA2_512];
+
+	for (size_t x = 0x00U; x < DIGEST_IVLEN_SHA2_512; x++)
+	{
+		for (size_t l = 0x00U; l < DIGEST_MB_LANES_SHA2_512; l++)
+		{
+			const struct digest_direct_pbkdf2_lane_sha2_512 *const lane = &lanes[(l < nlanes) ? l : 0x00U];
+
+			istate[x][l] = lane->istate[x];
+			ostate[x][l] = lane->ostate[x];
+			u[x][l] = lane->u[x];
+			t[x][l] = lane->t[x];
+		}
+	}
+
+	for (size_t i = 0x00U; i < iterations; i++)
+	{
+		for (unsigned int pass = 0x00U; pass < 0x02U; pass++)
+		{
+			const digest_mb_v64 *const init = pass ? ostate : istate;
+
+			for (size_t x = 0x00U; x < DIGEST_IVLEN_SHA2_512; x++)
+			{
+				W[x] = u[x];
+				s[x] = init[x];
+			}
+
+			W[0x08U] = DIGEST_MB_V64_SPLAT(UINT64_C(0x8000000000000000));
+
+			for (size_t x = 0x09U; x < 0x0FU; x++)
+				W[x] = DIGEST_MB_V64_SPLAT(0x00U);
+
+			W[0x0FU] = DIGEST_MB_V64_SPLAT((DIGEST_BKLEN_SHA2_512 + DIGEST_MDLEN_SHA2_512) << 0x03U);
+
+			for (uint32_t j = 0x00U; j < 0x50U; j++)
+			{
+				if (j >= 0x10U)
+				{
+					const digest_mb_v64 s0 = SHA2_MB_512_sigma0(W[(j + 0x01U) & 0x0FU]);
+					const digest_mb_v64 s1 = SHA2_MB_512_sigma1(W[(j + 0x0EU) & 0x0FU]);
+
+					W[j & 0x0FU] += s1 + W[(j + 0x09U) & 0x0FU] + s0;
+				}
+
+				const digest_mb_v64 t1 = s[7] + SHA2_MB_512_Sigma1(s[4]) + SHA2_MB_Ch(s[4], s[5], s[6]) +
+				                         DIGEST_MB_V64_SPLAT(digest_mb_K512[j]) + W[j & 0x0FU];
+				const digest_mb_v64 t2 = SHA2_MB_512_Sigma0(s[0]) + SHA2_MB_Maj(s[0], s[1], s[2]);
+
+				s[7] = s[6];
+				s[6] = s[5];
+				s[5] = s[4];
+				s[4] = s[3] + t1;
+				s[3] = s[2];
+				s[2] = s[1];
+				s[1] = s[0];
+				s[0] = t1 + t2;
+			}
+
+			for (size_t x = 0x00U; x < DIGEST_IVLEN_SHA2_512; x++)
+				u[x] = init[x] + s[x];
+		}
+
+		for (size_t x = 0x00U; x < DIGEST_IVLEN_SHA2_512; x++)
+			t[x] ^= u[x];
+	}
+
+	for (size_t l = 0x00U; l < nlanes; l++)
+	{
+		for (size_t x = 0x00U; x < DIGEST_IVLEN_SHA2_512; x++)
+		{
+			lanes[l].u[x] = u[x][l];
+			lanes[l].t[x] = t[x][l];
+		}
+	}
+
+	(void) smemzero(istate, sizeof istate);
+	(void) smemzero(ostate, sizeof ostate);
+	(void) smemzero(u, sizeof u);
+	(void) smemzero(t, sizeof t);
+	(void) smemzero(W, sizeof W);
+	(void) smemzero(s, sizeof s);
+}
@@ -19,7 +19,18 @@ static bool _digest_oneshot(enum digest_algorithm, const void *, size_t, void *,
 const char *
 digest_get_frontend_info(void)
 {
-	return "Internal MD5/SHA1/SHA2/HMAC/PBKDF2 Fallback";
+	static char result[BUFSIZE];
+
+	// Not cached; crypto-benchmark can select other compression kernels
+#ifdef ATHEME_DIGEST_HAVE_MB_SHA2
+	(void) snprintf(result, sizeof result, "Internal MD5/SHA1/SHA2/HMAC/PBKDF2 Fallback "
+	                "(%s; multi-buffer PBKDF2-SHA2: %s)", digest_direct_get_kernels(), digest_direct_mb_get_isa());
+#else /* ATHEME_DIGEST_HAVE_MB_SHA2 */
+	(void) snprintf(result, sizeof result, "Internal MD5/SHA1/SHA2/HMAC/PBKDF2 Fallback (%s)",
+	                digest_direct_get_kernels());
+#endif /* !ATHEME_DIGEST_HAVE_MB_SHA2 */
+
+	return result;
 }
 
 static bool
@@ -237,3 +248,183 @@ _digest_oneshot_pbkdf2(const enum digest_algorithm alg, const void *const restri
 	(void) smemzero(tmp, sizeof tmp);
 	return true;
 }
+
+#ifdef ATHEME_DIGEST_HAVE_MB_SHA2
+
+#define ATHEME_LAC_DIGEST_HAVE_PBKDF2_MULTI 1
+
+static size_t
+_digest_pbkdf2_lanes(const enum digest_algorithm alg)
+{
+	switch (alg)
+	{
+		case DIGALG_SHA2_256:
+			return DIGEST_MB_LANES_SHA2_256;
+
+		case DIGALG_SHA2_512:
+			return DIGEST_MB_LANES_SHA2_512;
+
+		default:
+			return 1U;
+	}
+}
+
+/* Sets up one lane: the HMAC key states and U(i, 0) for T(1) are computed
+ * exactly as _digest_oneshot_pbkdf2() does, leaving only the iterations for
+ * the multi-buffer kernel. Returns the state words of U(i, 0) in 'u'.
+ */
+static void
+_digest_pbkdf2_mb_setup(const enum digest_algorithm alg, const struct digest_pbkdf2_job *const restrict job,
+                        union digest_direct_ctx *const restrict istate, union digest_direct_ctx *const restrict ostate,
+                        unsigned char *const restrict u)
+{
+	struct digest_context ctx;
+	const uint32_t ibe = htonl(UINT32_C(1));
+
+	(void) _digest_init_hmac(&ctx, alg, job->pass, job->passLen);
+	(void) memcpy(istate, &ctx.state, sizeof *istate);
+
+	(void) ctx.init(ostate);
+	(void) ctx.update(ostate, ctx.okey, ctx.blksz);
+
+	(void) ctx.update(&ctx.state, job->salt, job->saltLen);
+	(void) ctx.update(&ctx.state, &ibe, sizeof ibe);
+	(void) _digest_final(&ctx, u, NULL);
+
+	(void) smemzero(&ctx, sizeof ctx);
+}
+
+static void
+_digest_pbkdf2_mb_run_sha2_256(const struct digest_pbkdf2_job *const *const restrict batch, const size_t count)
+{
+	struct digest_direct_pbkdf2_lane_sha2_256 lanes[DIGEST_MB_LANES_SHA2_256];
+	union digest_direct_ctx istate;
+	union digest_direct_ctx ostate;
+	unsigned char u[DIGEST_MDLEN_SHA2_256];
+
+	for (size_t l = 0; l < count; l++)
+	{
+		(void) _digest_pbkdf2_mb_setup(DIGALG_SHA2_256, batch[l], &istate, &ostate, u);
+		(void) memcpy(lanes[l].istate, istate.sha2_256.state, sizeof lanes[l].istate);
+		(void) memcpy(lanes[l].ostate, ostate.sha2_256.state, sizeof lanes[l].ostate);
+
+		for (size_t x = 0; x < DIGEST_IVLEN_SHA2_256; x++)
+		{
+			uint32_t w;
+
+			(void) memcpy(&w, u + (x * sizeof w), sizeof w);
+			lanes[l].u[x] = lanes[l].t[x] = ntohl(w);
+		}
+	}
+
+	(void) digest_direct_pbkdf2_mb_sha2_256(lanes, count, batch[0]->c - 1U);
+
+	for (size_t l = 0; l < count; l++)
+	{
+		for (size_t x = 0; x < DIGEST_IVLEN_SHA2_256; x++)
+		{
+			const uint32_t w = htonl(lanes[l].t[x]);
+
+			(void) memcpy(u + (x * sizeof w), &w, sizeof w);
+		}
+
+		(void) memcpy(batch[l]->dk, u, batch[l]->dkLen);
+	}
+
+	(void) smemzero(lanes, sizeof lanes);
+	(void) smemzero(&istate, sizeof istate);
+	(void) smemzero(&ostate, sizeof ostate);
+	(void) smemzero(u, sizeof u);
+}
+
+static void
+_digest_pbkdf2_mb_run_sha2_512(const struct digest_pbkdf2_job *const *const restrict batch, const size_t count)
+{
+	struct digest_direct_pbkdf2_lane_sha2_512 lanes[DIGEST_MB_LANES_SHA2_512];
+	union digest_direct_ctx istate;
+	union digest_direct_ctx ostate;
+	unsigned char u[DIGEST_MDLEN_SHA2_512];
+
+	for (size_t l = 0; l < count; l++)
+	{
+		(void) _digest_pbkdf2_mb_setup(DIGALG_SHA2_512, batch[l], &istate, &ostate, u);
+		(void) memcpy(lanes[l].istate, istate.sha2_512.state, sizeof lanes[l].istate);
+		(void) memcpy(lanes[l].ostate, ostate.sha2_512.state, sizeof lanes[l].ostate);
+
+		for (size_t x = 0; x < DIGEST_IVLEN_SHA2_512; x++)
+		{
+			uint64_t w = 0;
+
+			for (size_t b = 0; b < sizeof w; b++)
+				w = (w << 0x08U) | u[(x * sizeof w) + b];
+
+			lanes[l].u[x] = lanes[l].t[x] = w;
+		}
+	}
+
+	(void) digest_direct_pbkdf2_mb_sha2_512(lanes, count, batch[0]->c - 1U);
+
+	for (size_t l = 0; l < count; l++)
+	{
+		for (size_t x = 0; x < DIGEST_IVLEN_SHA2_512; x++)
+			for (size_t b = 0; b < sizeof(uint64_t); b++)
+				u[(x * sizeof(uint64_t)) + b] = (unsigned char) (lanes[l].t[x] >> (0x38U - (b * 0x08U)));
+
+		(void) memcpy(batch[l]->dk, u, batch[l]->dkLen);
+	}
+
+	(void) smemzero(lanes, sizeof lanes);
+	(void) smemzero(&istate, sizeof istate);
+	(void) smemzero(&ostate, sizeof ostate);
+	(void) smemzero(u, sizeof u);
+}
+
+static bool ATHEME_FATTR_WUR
+_digest_oneshot_pbkdf2_multi(const enum digest_algorithm alg, const struct digest_pbkdf2_job *const restrict jobs,
+                             const size_t count)
+{
+	const struct digest_pbkdf2_job *batch[DIGEST_MB_LANES_SHA2_256];
+	const size_t lanes = _digest_pbkdf2_lanes(alg);
+	const size_t hLen = digest_size_alg(alg);
+	bool *const done = smalloc(count * sizeof *done);
+
+	for (size_t i = 0; i < count; i++)
+	{
+		if (done[i])
+			continue;
+
+		done[i] = true;
+
+		// Only T(1) is done in lanes; longer outputs (never used by PBKDF2v2) are derived the normal way
+		if (lanes < 2U || jobs[i].dkLen > hLen)
+		{
+			(void) _digest_oneshot_pbkdf2(alg, jobs[i].pass, jobs[i].passLen, jobs[i].salt, jobs[i].saltLen,
+			                              jobs[i].c, jobs[i].dk, jobs[i].dkLen);
+			continue;
+		}
+
+		// Fill a batch with the following jobs that need the same number of iterations
+		size_t n = 0;
+
+		batch[n++] = &jobs[i];
+
+		for (size_t j = i + 1; j < count && n < lanes; j++)
+		{
+			if (done[j] || jobs[j].c != jobs[i].c || jobs[j].dkLen > hLen)
+				continue;
+
+			done[j] = true;
+			batch[n++] = &jobs[j];
+		}
+
+		if (alg == DIGALG_SHA2_256)
+			(void) _digest_pbkdf2_mb_run_sha2_256(batch, n);
+		else
+			(void) _digest_pbkdf2_mb_run_sha2_512(batch, n);
+	}
+
+	(void) sfree(done);
+	return true;
+}
+
+#endif /* ATHEME_DIGEST_HAVE_MB_SHA2 */
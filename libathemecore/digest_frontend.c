@@ -28,6 +28,28 @@
 #  error "No Digest API frontend was selected by the build system"
 #endif
 
+#ifndef ATHEME_LAC_DIGEST_HAVE_PBKDF2_MULTI
+
+static size_t
+_digest_pbkdf2_lanes(const enum digest_algorithm ATHEME_VATTR_UNUSED alg)
+{
+	return 1U;
+}
+
+static bool ATHEME_FATTR_WUR
+_digest_oneshot_pbkdf2_multi(const enum digest_algorithm alg, const struct digest_pbkdf2_job *const restrict jobs,
+                             const size_t count)
+{
+	for (size_t i = 0; i < count; i++)
+		if (! _digest_oneshot_pbkdf2(alg, jobs[i].pass, jobs[i].passLen, jobs[i].salt, jobs[i].saltLen,
+		                             jobs[i].c, jobs[i].dk, jobs[i].dkLen))
+			return false;
+
+	return true;
+}
+
+#endif /* !ATHEME_LAC_DIGEST_HAVE_PBKDF2_MULTI */
+
 static bool ATHEME_FATTR_WUR
 _digest_update_vector(struct digest_context *const restrict ctx, const struct digest_vector *const restrict vec,
                       const size_t vecLen)
@@ -616,3 +638,40 @@ digest_oneshot_pbkdf2(const enum digest_algorithm alg, const void *const restric
 
 	return _digest_oneshot_pbkdf2(alg, pass, passLen, salt, saltLen, c, dk, dkLen);
 }
+
+size_t
+digest_pbkdf2_lanes(const enum digest_algorithm alg)
+{
+	if (! digest_size_alg(alg))
+		return 0;
+
+	return _digest_pbkdf2_lanes(alg);
+}
+
+bool ATHEME_FATTR_WUR
+digest_oneshot_pbkdf2_multi(const enum digest_algorithm alg, const struct digest_pbkdf2_job *const restrict jobs,
+                            const size_t count)
+{
+	if (! digest_size_alg(alg))
+	{
+		(void) slog(LG_ERROR, "%s: called with malformed/uninitialised 'alg' (BUG)", MOWGLI_FUNC_NAME);
+		return false;
+	}
+	if (! (jobs && count))
+	{
+		(void) slog(LG_ERROR, "%s: called with no jobs (BUG)", MOWGLI_FUNC_NAME);
+		return false;
+	}
+
+	for (size_t i = 0; i < count; i++)
+	{
+		if (! (jobs[i].pass && jobs[i].passLen && jobs[i].salt && jobs[i].saltLen && jobs[i].c &&
+		       jobs[i].dk && jobs[i].dkLen))
+		{
+			(void) slog(LG_ERROR, "%s: called with an incomplete job (BUG)", MOWGLI_FUNC_NAME);
+			return false;
+		}
+	}
+
+	return _digest_oneshot_pbkdf2_multi(alg, jobs, count);
+}
@@ -4626,6 +4626,47 @@ digest_testsuite_run_hkdf_sha2_512(void)
 	return true;
 }
 
+/* Runs the same derivation through digest_oneshot_pbkdf2_multi() as one more
+ * job than fits in a batch, so that both a full and a partial batch of the
+ * multi-buffer kernel (if there is one) are checked against T(1).
+ */
+static bool
+digest_testsuite_run_pbkdf2_multi(const enum digest_algorithm alg, const void *const restrict key,
+                                  const size_t keyLen, const void *const restrict salt, const size_t saltLen,
+                                  const size_t iter, const unsigned char *const restrict vector,
+                                  const size_t vectorLen)
+{
+	struct digest_pbkdf2_job jobs[DIGEST_MB_LANES_SHA2_256 + 1U];
+	unsigned char results[DIGEST_MB_LANES_SHA2_256 + 1U][DIGEST_MDLEN_MAX];
+	const size_t dkLen = (vectorLen < digest_size_alg(alg)) ? vectorLen : digest_size_alg(alg);
+	size_t count = digest_pbkdf2_lanes(alg) + 1U;
+
+	if (count > (sizeof jobs / sizeof jobs[0]))
+		count = (sizeof jobs / sizeof jobs[0]);
+
+	(void) slog(LG_DEBUG, "%s: %zu jobs", MOWGLI_FUNC_NAME, count);
+
+	for (size_t i = 0; i < count; i++)
+	{
+		jobs[i].pass = key;
+		jobs[i].passLen = keyLen;
+		jobs[i].salt = salt;
+		jobs[i].saltLen = saltLen;
+		jobs[i].c = iter;
+		jobs[i].dk = results[i];
+		jobs[i].dkLen = dkLen;
+	}
+
+	if (! digest_oneshot_pbkdf2_multi(alg, jobs, count))
+		return false;
+
+	for (size_t i = 0; i < count; i++)
+		if (memcmp(results[i], vector, dkLen) != 0)
+			return false;
+
+	return true;
+}
+
 static bool
 digest_testsuite_run_pbkdf2_md5(void)
 {
@@ -4681,6 +4722,12 @@ digest_testsuite_run_pbkdf2_md5(void)
 	if (memcmp(result, vector, sizeof vector) != 0)
 		return false;
 
+	(void) slog(LG_DEBUG, "%s: vector 1 (multi)", MOWGLI_FUNC_NAME);
+
+	if (! digest_testsuite_run_pbkdf2_multi(DIGALG_MD5, key, sizeof key, salt, sizeof salt, iter,
+	                                        vector, sizeof vector))
+		return false;
+
 	return true;
 }
 
@@ -4739,6 +4786,12 @@ digest_testsuite_run_pbkdf2_sha1(void)
 	if (memcmp(result, vector, sizeof vector) != 0)
 		return false;
 
+	(void) slog(LG_DEBUG, "%s: vector 1 (multi)", MOWGLI_FUNC_NAME);
+
+	if (! digest_testsuite_run_pbkdf2_multi(DIGALG_SHA1, key, sizeof key, salt, sizeof salt, iter,
+	                                        vector, sizeof vector))
+		return false;
+
 	return true;
 }
 
@@ -4845,6 +4898,12 @@ digest_testsuite_run_pbkdf2_sha2_256(void)
 	if (memcmp(result, vector, sizeof vector) != 0)
 		return false;
 
+	(void) slog(LG_DEBUG, "%s: vector 1 (multi)", MOWGLI_FUNC_NAME);
+
+	if (! digest_testsuite_run_pbkdf2_multi(DIGALG_SHA2_256, key, sizeof key, salt, sizeof salt, iter,
+	                                        vector, sizeof vector))
+		return false;
+
 	return true;
 }
 
@@ -4951,9 +5010,51 @@ digest_testsuite_run_pbkdf2_sha2_512(void)
 	if (memcmp(result, vector, sizeof vector) != 0)
 		return false;
 
+	(void) slog(LG_DEBUG, "%s: vector 1 (multi)", MOWGLI_FUNC_NAME);
+
+	if (! digest_testsuite_run_pbkdf2_multi(DIGALG_SHA2_512, key, sizeof key, salt, sizeof salt, iter,
+	                                        vector, sizeof vector))
+		return false;
+
 	return true;
 }
 
+/* With the internal frontend, SHA1 and SHA2 have a choice of compression
+ * kernels (see digest_direct_accel.c); runs a test through every one of them
+ * that this CPU can use, and then goes back to the one that was selected.
+ */
+static bool
+digest_testsuite_run_kernels(const enum digest_algorithm alg, bool (*const test)(void))
+{
+#if (ATHEME_API_DIGEST_FRONTEND == ATHEME_API_DIGEST_FRONTEND_INTERNAL)
+	const size_t count = digest_direct_kernel_count(alg);
+
+	if (count < 2U)
+		return test();
+
+	const size_t selected = digest_direct_kernel_selected(alg);
+	bool result = true;
+
+	for (size_t i = 0; result && i < count; i++)
+	{
+		(void) digest_direct_kernel_select(alg, i);
+		(void) slog(LG_DEBUG, "%s: %s kernel", MOWGLI_FUNC_NAME, digest_direct_kernel_name(alg, i));
+
+		if (! (result = test()))
+			(void) slog(LG_ERROR, "%s: the %s kernel failed (BUG)", MOWGLI_FUNC_NAME,
+			                      digest_direct_kernel_name(alg, i));
+	}
+
+	(void) digest_direct_kernel_select(alg, selected);
+
+	return result;
+#else
+	(void) alg;
+
+	return test();
+#endif
+}
+
 bool
 digest_testsuite_run(void)
 {
@@ -4970,39 +5071,39 @@ digest_testsuite_run(void)
 		return false;
 
 
-	if (! digest_testsuite_run_sha1())
+	if (! digest_testsuite_run_kernels(DIGALG_SHA1, &digest_testsuite_run_sha1))
 		return false;
 
-	if (! digest_testsuite_run_hmac_sha1())
+	if (! digest_testsuite_run_kernels(DIGALG_SHA1, &digest_testsuite_run_hmac_sha1))
 		return false;
 
-	if (! digest_testsuite_run_hkdf_sha1())
+	if (! digest_testsuite_run_kernels(DIGALG_SHA1, &digest_testsuite_run_hkdf_sha1))
 		return false;
 
 	if (! digest_testsuite_run_pbkdf2_sha1())
 		return false;
 
 
-	if (! digest_testsuite_run_sha2_256())
+	if (! digest_testsuite_run_kernels(DIGALG_SHA2_256, &digest_testsuite_run_sha2_256))
 		return false;
 
-	if (! digest_testsuite_run_hmac_sha2_256())
+	if (! digest_testsuite_run_kernels(DIGALG_SHA2_256, &digest_testsuite_run_hmac_sha2_256))
 		return false;
 
-	if (! digest_testsuite_run_hkdf_sha2_256())
+	if (! digest_testsuite_run_kernels(DIGALG_SHA2_256, &digest_testsuite_run_hkdf_sha2_256))
 		return false;
 
 	if (! digest_testsuite_run_pbkdf2_sha2_256())
 		return false;
 
 
-	if (! digest_testsuite_run_sha2_512())
+	if (! digest_testsuite_run_kernels(DIGALG_SHA2_512, &digest_testsuite_run_sha2_512))
 		return false;
 
-	if (! digest_testsuite_run_hmac_sha2_512())
+	if (! digest_testsuite_run_kernels(DIGALG_SHA2_512, &digest_testsuite_run_hmac_sha2_512))
 		return false;
 
-	if (! digest_testsuite_run_hkdf_sha2_512())
+	if (! digest_testsuite_run_kernels(DIGALG_SHA2_512, &digest_testsuite_run_hkdf_sha2_512))
 		return false;
 
 	if (! digest_testsuite_run_pbkdf2_sha2_512())
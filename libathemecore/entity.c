@@ -11,8 +11,19 @@
 #include <atheme.h>
 #include "internal.h"
 
+/* Each type's entities, densely packed so that walking one type doesn't visit
+ * the others; removing one moves the last into its place.
+ */
+struct myentity_table
+{
+	struct myentity **      ents;
+	unsigned int            count;
+	unsigned int            size;
+};
+
 static mowgli_patricia_t *entities = NULL;
-static mowgli_patricia_t *entities_by_id = NULL;
+static struct namehash *entities_by_id = NULL;
+static struct myentity_table entity_tables[ENT_EXTTARGET + 1];
 
 static char last_entity_uid[IDLEN + 1];
 
@@ -20,7 +31,7 @@ void
 init_entities(void)
 {
 	entities = mowgli_patricia_create(irccasecanon);
-	entities_by_id = mowgli_patricia_create(noopcanon);
+	entities_by_id = namehash_create(false);
 
 	memset(last_entity_uid, 0x00, sizeof last_entity_uid);
 	memset(last_entity_uid, 'A', IDLEN);
@@ -73,6 +84,49 @@ myentity_alloc_uid(void)
 	return last_entity_uid;
 }
 
+static struct myentity_table *
+myentity_table_get(const enum myentity_type type)
+{
+	if (type <= ENT_ANY || type > ENT_EXTTARGET)
+		return NULL;
+
+	return &entity_tables[type];
+}
+
+static void
+myentity_table_add(struct myentity *const restrict mt)
+{
+	struct myentity_table *const tbl = myentity_table_get(mt->type);
+
+	if (! tbl || mt->type_slot)
+		return;
+
+	if (tbl->count == tbl->size)
+	{
+		tbl->size = tbl->size ? (tbl->size * 2U) : 1024U;
+		tbl->ents = srealloc(tbl->ents, tbl->size * sizeof *tbl->ents);
+	}
+
+	tbl->ents[tbl->count++] = mt;
+	mt->type_slot = tbl->count;
+}
+
+static void
+myentity_table_remove(struct myentity *const restrict mt)
+{
+	struct myentity_table *const tbl = myentity_table_get(mt->type);
+
+	if (! tbl || ! mt->type_slot)
+		return;
+
+	const unsigned int idx = mt->type_slot - 1U;
+	struct myentity *const last = tbl->ents[--tbl->count];
+
+	tbl->ents[idx] = last;
+	last->type_slot = idx + 1U;
+	mt->type_slot = 0;
+}
+
 void
 myentity_put(struct myentity *mt)
 {
@@ -81,14 +135,20 @@ myentity_put(struct myentity *mt)
 		mowgli_strlcpy(mt->id, myentity_alloc_uid(), sizeof mt->id);
 
 	mowgli_patricia_add(entities, mt->name, mt);
-	mowgli_patricia_add(entities_by_id, mt->id, mt);
+	namehash_add(entities_by_id, mt->id, mt);
+	myentity_table_add(mt);
+
+	nickfilter_add(mt->name);
 }
 
 void
 myentity_del(struct myentity *mt)
 {
 	mowgli_patricia_delete(entities, mt->name);
-	mowgli_patricia_delete(entities_by_id, mt->id);
+	(void) namehash_delete(entities_by_id, mt->id, mt);
+	myentity_table_remove(mt);
+
+	nickfilter_forget();
 }
 
 struct myentity *
@@ -99,7 +159,7 @@ myentity_find(const char *name)
 
 	return_val_if_fail(name != NULL, NULL);
 
-	if ((ent = mowgli_patricia_retrieve(entities, name)) != NULL)
+	if (nickfilter_maybe(name) && (ent = mowgli_patricia_retrieve(entities, name)) != NULL)
 		return ent;
 
 	req.name = name;
@@ -114,7 +174,7 @@ myentity_find_uid(const char *uid)
 {
 	return_val_if_fail(uid != NULL, NULL);
 
-	return mowgli_patricia_retrieve(entities_by_id, uid);
+	return namehash_find(entities_by_id, uid);
 }
 
 struct myentity *
@@ -134,33 +194,55 @@ myentity_find_ext(const char *name)
 void
 myentity_foreach_start(struct myentity_iteration_state *state, enum myentity_type type)
 {
-	struct myentity *e;
+	const struct myentity_table *tbl;
 
 	state->type = type;
-	mowgli_patricia_foreach_start(entities, &state->st);
+	state->idx = 0;
+	state->cur = NULL;
 
-	e = mowgli_patricia_foreach_cur(entities, &state->st);
-	while (e && state->type != ENT_ANY && state->type != e->type)
+	if (type == ENT_ANY)
 	{
-		mowgli_patricia_foreach_next(entities, &state->st);
-		e = mowgli_patricia_foreach_cur(entities, &state->st);
+		mowgli_patricia_foreach_start(entities, &state->st);
+		return;
 	}
+
+	if ((tbl = myentity_table_get(type)) != NULL && tbl->count)
+		state->cur = tbl->ents[0];
 }
 
 struct myentity *
 myentity_foreach_cur(struct myentity_iteration_state *state)
 {
-	return mowgli_patricia_foreach_cur(entities, &state->st);
+	if (state->type == ENT_ANY)
+		return mowgli_patricia_foreach_cur(entities, &state->st);
+
+	return state->cur;
 }
 
 void
 myentity_foreach_next(struct myentity_iteration_state *state)
 {
-	struct myentity *e;
-	do {
+	const struct myentity_table *tbl;
+
+	if (state->type == ENT_ANY)
+	{
 		mowgli_patricia_foreach_next(entities, &state->st);
-		e = mowgli_patricia_foreach_cur(entities, &state->st);
-	} while (e && state->type != ENT_ANY && state->type != e->type);
+		return;
+	}
+
+	if ((tbl = myentity_table_get(state->type)) == NULL)
+	{
+		state->cur = NULL;
+		return;
+	}
+
+	/* If the current entity was deleted, the one moved into its slot has not
+	 * been seen yet.
+	 */
+	if (state->idx < tbl->count && tbl->ents[state->idx] == state->cur)
+		state->idx++;
+
+	state->cur = (state->idx < tbl->count) ? tbl->ents[state->idx] : NULL;
 }
 
 void
@@ -184,7 +266,14 @@ myentity_foreach_t(enum myentity_type type, int (*cb)(struct myentity *mt, void
 void
 myentity_stats(void (*cb)(const char *line, void *privdata), void *privdata)
 {
+	char buf[BUFSIZE];
+
 	mowgli_patricia_stats(entities, cb, privdata);
+
+	(void) snprintf(buf, sizeof buf, "%u accounts, %u groups, %u other entities by type",
+	                entity_tables[ENT_USER].count, entity_tables[ENT_GROUP].count,
+	                entity_tables[ENT_EXTTARGET].count);
+	cb(buf, privdata);
 }
 
 /* validation */
@@ -0,0 +1,170 @@
+/*
+ * SPDX-License-Identifier: ISC
+ * SPDX-URL: https://spdx.org/licenses/ISC.html
+ *
+ * Copyright (C) 2026 Atheme Development Group (https://atheme.github.io/)
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * atheme-services: A collection of minimalist IRC services
+ * expiry.c: Expiry scheduling queues.
+ */
+
+#include <atheme.h>
+#include "internal.h"
+
+static inline void
+expiry_queue_place(struct expiry_queue *const queue, struct expiry_timer *const timer, const unsigned int idx)
+{
+	queue->heap[idx] = timer;
+	timer->slot = idx + 1U;
+}
+
+static void
+expiry_queue_sift_up(struct expiry_queue *const queue, unsigned int idx)
+{
+	struct expiry_timer *const timer = queue->heap[idx];
+
+	while (idx > 0)
+	{
+		const unsigned int parent = (idx - 1U) / 2U;
+
+		if (queue->heap[parent]->due <= timer->due)
+			break;
+
+		expiry_queue_place(queue, queue->heap[parent], idx);
+		idx = parent;
+	}
+
+	expiry_queue_place(queue, timer, idx);
+}
+
+static void
+expiry_queue_sift_down(struct expiry_queue *const queue, unsigned int idx)
+{
+	struct expiry_timer *const timer = queue->heap[idx];
+
+	for (;;)
+	{
+		unsigned int child = (idx * 2U) + 1U;
+
+		if (child >= queue->count)
+			break;
+
+		if (child + 1U < queue->count && queue->heap[child + 1U]->due < queue->heap[child]->due)
+			child++;
+
+		if (timer->due <= queue->heap[child]->due)
+			break;
+
+		expiry_queue_place(queue, queue->heap[child], idx);
+		idx = child;
+	}
+
+	expiry_queue_place(queue, timer, idx);
+}
+
+/*
+ * expiry_queue_schedule()
+ *
+ * Queues an object to be looked at once `due' has passed, or moves it if
+ * it was already queued.
+ */
+void
+expiry_queue_schedule(struct expiry_queue *const queue, struct expiry_timer *const timer, void *const owner, const time_t due)
+{
+	return_if_fail(queue != NULL);
+	return_if_fail(timer != NULL);
+
+	timer->owner = owner;
+
+	if (timer->slot != 0)
+	{
+		const time_t old = timer->due;
+
+		timer->due = due;
+
+		if (due < old)
+			expiry_queue_sift_up(queue, timer->slot - 1U);
+		else
+			expiry_queue_sift_down(queue, timer->slot - 1U);
+
+		return;
+	}
+
+	if (queue->count == queue->alloc)
+	{
+		queue->alloc = queue->alloc ? (queue->alloc * 2U) : 64U;
+		queue->heap = sreallocarray(queue->heap, queue->alloc, sizeof *queue->heap);
+	}
+
+	timer->due = due;
+
+	expiry_queue_place(queue, timer, queue->count++);
+	expiry_queue_sift_up(queue, queue->count - 1U);
+}
+
+void
+expiry_queue_cancel(struct expiry_queue *const queue, struct expiry_timer *const timer)
+{
+	return_if_fail(queue != NULL);
+	return_if_fail(timer != NULL);
+
+	if (timer->slot == 0)
+		return;
+
+	const unsigned int idx = timer->slot - 1U;
+	struct expiry_timer *const last = queue->heap[--queue->count];
+
+	timer->slot = 0;
+
+	if (last == timer)
+		return;
+
+	expiry_queue_place(queue, last, idx);
+
+	if (last->due < timer->due)
+		expiry_queue_sift_up(queue, idx);
+	else
+		expiry_queue_sift_down(queue, idx);
+}
+
+/*
+ * expiry_queue_pop_due()
+ *
+ * Unqueues and returns the owner of the earliest timer, if it is due at
+ * or before `now'; returns NULL otherwise.
+ */
+void *
+expiry_queue_pop_due(struct expiry_queue *const queue, const time_t now)
+{
+	return_val_if_fail(queue != NULL, NULL);
+
+	if (queue->count == 0 || queue->heap[0]->due > now)
+		return NULL;
+
+	struct expiry_timer *const timer = queue->heap[0];
+
+	(void) expiry_queue_cancel(queue, timer);
+
+	return timer->owner;
+}
+
+void
+expiry_queue_clear(struct expiry_queue *const queue)
+{
+	return_if_fail(queue != NULL);
+
+	for (unsigned int i = 0; i < queue->count; i++)
+		queue->heap[i]->slot = 0;
+
+	queue->count = 0;
+}
+
+/* vim:cinoptions=>s,e0,n0,f0,{0,}0,^0,=s,ps,t0,c3,+s,(2s,us,)20,*30,gs,hs
+ * vim:ts=8
+ * vim:sw=8
+ * vim:noexpandtab
+ */
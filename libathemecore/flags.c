@@ -24,6 +24,51 @@ static unsigned int ca_all_enable = CA_ALL_ALL;
 
 static char flags_buf[128];
 
+/* chanacs_flags[] is indexed by letter, which makes parsing a lookup but
+ * leaves rendering and name lookups walking all 256 slots for the twenty
+ * or so that are set. These list just the letters in use, in the same
+ * (ascending) order, and are rebuilt whenever the table changes.
+ */
+struct flags_letter
+{
+	unsigned char           ch;
+	unsigned int            value;
+	const char *            name;
+};
+
+static struct flags_letter flags_letters[ARRAY_SIZE(chanacs_flags)];
+static struct flags_letter flags_named[ARRAY_SIZE(chanacs_flags)];
+static unsigned int flags_letters_count = 0;
+static unsigned int flags_named_count = 0;
+static bool flags_letters_built = false;
+
+static void
+flags_letters_rebuild(void)
+{
+	flags_letters_built = true;
+	flags_letters_count = 0;
+	flags_named_count = 0;
+
+	for (unsigned int i = 0; i < ARRAY_SIZE(chanacs_flags); i++)
+	{
+		const struct flags_letter fl = { (unsigned char) i, chanacs_flags[i].value, chanacs_flags[i].name };
+
+		if (fl.value)
+			flags_letters[flags_letters_count++] = fl;
+
+		if (fl.name != NULL)
+			flags_named[flags_named_count++] = fl;
+	}
+}
+
+// for anything rendered before the configuration has been read
+static inline void
+flags_letters_check(void)
+{
+	if (! flags_letters_built)
+		flags_letters_rebuild();
+}
+
 struct flags_table chanacs_flags[256] = {
 	['v'] = {CA_VOICE, 0, true,      "voice"},
 	['V'] = {CA_AUTOVOICE, 0, true,  "autovoice"},
@@ -135,6 +180,8 @@ flags_clear(unsigned char flag)
 	chanacs_flags[flag].restrictflags = 0;
 	chanacs_flags[flag].def = false;
 	chanacs_flags[flag].name = NULL;
+
+	flags_letters_rebuild();
 }
 
 unsigned int
@@ -291,13 +338,15 @@ bitmask_to_flags(unsigned int flags)
 	char *bptr;
 	unsigned int i = 0;
 
+	flags_letters_check();
+
 	bptr = flags_buf;
 
 	*bptr++ = '+';
 
-	for (i = 0; i < ARRAY_SIZE(chanacs_flags); i++)
-		if (chanacs_flags[i].value & flags)
-			*bptr++ = (char) i;
+	for (i = 0; i < flags_letters_count; i++)
+		if (flags_letters[i].value & flags)
+			*bptr++ = (char) flags_letters[i].ch;
 
 	*bptr++ = '\0';
 
@@ -310,21 +359,23 @@ bitmask_to_flags2(unsigned int addflags, unsigned int removeflags)
 	char *bptr;
 	unsigned int i = 0;
 
+	flags_letters_check();
+
 	bptr = flags_buf;
 
 	if (removeflags)
 	{
 		*bptr++ = '-';
-		for (i = 0; i < ARRAY_SIZE(chanacs_flags); i++)
-			if (chanacs_flags[i].value & removeflags)
-				*bptr++ = (char) i;
+		for (i = 0; i < flags_letters_count; i++)
+			if (flags_letters[i].value & removeflags)
+				*bptr++ = (char) flags_letters[i].ch;
 	}
 	if (addflags)
 	{
 		*bptr++ = '+';
-		for (i = 0; i < ARRAY_SIZE(chanacs_flags); i++)
-			if (chanacs_flags[i].value & addflags)
-				*bptr++ = (char) i;
+		for (i = 0; i < flags_letters_count; i++)
+			if (flags_letters[i].value & addflags)
+				*bptr++ = (char) flags_letters[i].ch;
 	}
 
 	*bptr++ = '\0';
@@ -363,6 +414,9 @@ update_chanacs_flags(void)
 {
 	unsigned int i;
 
+	chanacs_flags_invalidate();
+	flags_letters_rebuild();
+
 	ca_all = ca_all_enable = 0;
 	for (i = 0; i < ARRAY_SIZE(chanacs_flags); i++)
 	{
@@ -387,14 +441,11 @@ xflag_lookup(const char *name)
 {
 	unsigned int i;
 
-	for (i = 0; i < ARRAY_SIZE(chanacs_flags); i++)
-	{
-		if (chanacs_flags[i].name == NULL)
-			continue;
+	flags_letters_check();
 
-		if (!strcasecmp(chanacs_flags[i].name, name))
-			return chanacs_flags[i].value;
-	}
+	for (i = 0; i < flags_named_count; i++)
+		if (!strcasecmp(flags_named[i].name, name))
+			return flags_named[i].value;
 
 	return 0;
 }
@@ -437,18 +488,17 @@ xflag_tostr(unsigned int flags)
 
 	*buf = '\0';
 
-	for (i = 0; i < ARRAY_SIZE(chanacs_flags); i++)
-	{
-		if (chanacs_flags[i].name == NULL)
-			continue;
+	flags_letters_check();
 
-		if (!(flags & chanacs_flags[i].value))
+	for (i = 0; i < flags_named_count; i++)
+	{
+		if (!(flags & flags_named[i].value))
 			continue;
 
 		if (*buf != '\0')
 			mowgli_strlcat(buf, ", ", sizeof buf);
 
-		mowgli_strlcat(buf, chanacs_flags[i].name, sizeof buf);
+		mowgli_strlcat(buf, flags_named[i].name, sizeof buf);
 	}
 
 	return buf;
@@ -353,22 +353,150 @@ validemail(const char *email)
 
 static mowgli_list_t email_canonicalizers;
 
+/* The same addresses are canonicalized over and over (registration, SET
+ * EMAIL, LISTMAIL, ...), so the most recently used ones are remembered,
+ * by the address as given; all of it is forgotten whenever the list of
+ * canonicalizers changes.
+ */
+#define EMAIL_CANON_CACHE_MAX   1024U
+
+struct email_canon_entry
+{
+	char *                  email;
+	stringref               canonical;
+	mowgli_node_t           node;           // in email_canon_lru, most recently used first
+};
+
+static struct namehash *email_canon_cache = NULL;
+static mowgli_list_t email_canon_lru;
+
+// Accounts re-canonicalized per event loop iteration once services are running
+#define EMAIL_RECANON_SLICE     4096U
+
+/* A re-canonicalization in progress: the IDs of the accounts that were there
+ * when it started (the ones registered since got the current canonicalizers
+ * anyway), and how far it has got. Until it is done, some accounts are
+ * indexed under the old canonical form of their address and some under the
+ * new one.
+ */
+static char (*email_recanon_ids)[IDLEN + 1] = NULL;
+static size_t email_recanon_count = 0;
+static size_t email_recanon_next = 0;
+static mowgli_eventloop_timer_t *email_recanon_timer = NULL;
+static struct timeval email_recanon_started;
+
+static void
+canonicalize_myuser_email(struct myuser *const restrict mu)
+{
+	myuser_email_index_delete(mu);
+	strshare_unref(mu->email_canonical);
+	mu->email_canonical = canonicalize_email(mu->email);
+	myuser_email_index_add(mu);
+}
+
+static void
+email_recanon_step(void ATHEME_VATTR_UNUSED *const restrict unused)
+{
+	email_recanon_timer = NULL;
+
+	for (size_t i = 0; i < EMAIL_RECANON_SLICE && email_recanon_next < email_recanon_count; i++)
+	{
+		struct myuser *const mu = user(myentity_find_uid(email_recanon_ids[email_recanon_next++]));
+
+		// Dropped in the meantime
+		if (mu != NULL)
+			canonicalize_myuser_email(mu);
+	}
+
+	if (email_recanon_next < email_recanon_count)
+	{
+		email_recanon_timer = timer_add_once("canonicalize_emails", &email_recanon_step, NULL, 0);
+		return;
+	}
+
+	struct timeval elapsed;
+
+	e_time(email_recanon_started, &elapsed);
+	slog(LG_DEBUG, "canonicalize_emails(): %zu accounts done in %d ms", email_recanon_count, tv2ms(&elapsed));
+
+	sfree(email_recanon_ids);
+
+	email_recanon_ids = NULL;
+	email_recanon_count = email_recanon_next = 0;
+}
+
 /* Re-canonicalize email addresses.
  * Call this after adding or removing an email_canonicalize hook.
+ *
+ * While starting up (or for a few accounts) this is done at once; otherwise
+ * a slice of the accounts is done per event loop iteration, so that loading
+ * a canonicalizer on a large network does not hold everything else up. A
+ * call while that is going on starts it over.
  */
 static void
 canonicalize_emails(void)
 {
 	struct myentity_iteration_state state;
 	struct myentity *mt;
+	struct startup_mark sm;
+
+	size_t count = 0;
 
 	MYENTITY_FOREACH_T(mt, &state, ENT_USER)
+		count++;
+
+	if (!(runflags & RF_STARTING) && count > EMAIL_RECANON_SLICE)
 	{
-		struct myuser *mu = user(mt);
+		sfree(email_recanon_ids);
+
+		email_recanon_ids = smalloc(count * sizeof *email_recanon_ids);
+		email_recanon_count = email_recanon_next = 0;
+
+		MYENTITY_FOREACH_T(mt, &state, ENT_USER)
+			mowgli_strlcpy(email_recanon_ids[email_recanon_count++], mt->id, IDLEN + 1);
+
+		s_time(&email_recanon_started);
+
+		if (email_recanon_timer == NULL)
+			email_recanon_timer = timer_add_once("canonicalize_emails", &email_recanon_step, NULL, 0);
+
+		return;
+	}
 
-		strshare_unref(mu->email_canonical);
-		mu->email_canonical = canonicalize_email(mu->email);
+	if (email_recanon_timer != NULL)
+	{
+		timer_destroy(email_recanon_timer);
+		email_recanon_timer = NULL;
 	}
+
+	sfree(email_recanon_ids);
+
+	email_recanon_ids = NULL;
+	email_recanon_count = email_recanon_next = 0;
+
+	startup_mark(&sm);
+
+	MYENTITY_FOREACH_T(mt, &state, ENT_USER)
+		canonicalize_myuser_email(user(mt));
+
+	startup_record(&sm, "canonicalize_emails", STARTUP_PHASE);
+}
+
+static void
+email_canon_entry_free(struct email_canon_entry *const restrict ce)
+{
+	(void) namehash_delete(email_canon_cache, ce->email, ce);
+	mowgli_node_delete(&ce->node, &email_canon_lru);
+	strshare_unref(ce->canonical);
+	sfree(ce->email);
+	sfree(ce);
+}
+
+static void
+email_canon_cache_clear(void)
+{
+	while (email_canon_lru.tail != NULL)
+		email_canon_entry_free(email_canon_lru.tail->data);
 }
 
 void
@@ -380,6 +508,7 @@ register_email_canonicalizer(email_canonicalizer_fn func, void *user_data)
 
 	mowgli_node_add(item, &item->node, &email_canonicalizers);
 
+	email_canon_cache_clear();
 	canonicalize_emails();
 }
 
@@ -397,6 +526,7 @@ unregister_email_canonicalizer(email_canonicalizer_fn func, void *user_data)
 			mowgli_node_delete(&item->node, &email_canonicalizers);
 			sfree(item);
 
+			email_canon_cache_clear();
 			canonicalize_emails();
 
 			return;
@@ -407,22 +537,57 @@ unregister_email_canonicalizer(email_canonicalizer_fn func, void *user_data)
 stringref
 canonicalize_email(const char *email)
 {
+	struct email_canon_entry *ce;
 	mowgli_node_t *n, *tn;
 	char buf[EMAILLEN + 1];
+	size_t len = 0;
 
 	if (email == NULL)
 		return NULL;
 
-	mowgli_strlcpy(buf, email, sizeof buf);
+	if (email_canon_cache == NULL)
+		email_canon_cache = namehash_create(false);
 
-	MOWGLI_LIST_FOREACH_SAFE(n, tn, email_canonicalizers.head)
+	if ((ce = namehash_find(email_canon_cache, email)) != NULL)
+	{
+		mowgli_node_delete(&ce->node, &email_canon_lru);
+		mowgli_node_add_head(ce, &ce->node, &email_canon_lru);
+
+		return strshare_ref(ce->canonical);
+	}
+
+	n = email_canonicalizers.head;
+
+	// The built-in case canonicalizer usually comes first; do it while copying
+	if (n != NULL && ((struct email_canonicalizer_item *) n->data)->func == &canonicalize_email_case)
+	{
+		for (; email[len] != '\0' && len < sizeof buf - 1; len++)
+			buf[len] = (char) toupper((unsigned char) email[len]);
+
+		buf[len] = '\0';
+		n = n->next;
+	}
+	else
+		mowgli_strlcpy(buf, email, sizeof buf);
+
+	MOWGLI_LIST_FOREACH_SAFE(n, tn, n)
 	{
 		struct email_canonicalizer_item *item = n->data;
 
 		item->func(buf, item->user_data);
 	}
 
-	return strshare_get(buf);
+	ce = smalloc(sizeof *ce);
+	ce->email = sstrdup(email);
+	ce->canonical = strshare_get(buf);
+
+	namehash_add(email_canon_cache, ce->email, ce);
+	mowgli_node_add_head(ce, &ce->node, &email_canon_lru);
+
+	if (MOWGLI_LIST_LENGTH(&email_canon_lru) > EMAIL_CANON_CACHE_MAX)
+		email_canon_entry_free(email_canon_lru.tail->data);
+
+	return strshare_ref(ce->canonical);
 }
 
 void
@@ -435,11 +600,7 @@ bool
 email_within_limits(const char *email)
 {
 	mowgli_node_t *n;
-	struct myentity_iteration_state state;
-	struct myentity *mt;
-	unsigned int tcnt = 0;
-	stringref email_canonical;
-	bool result = true;
+	const mowgli_list_t *accounts;
 
 	if (me.maxusers <= 0)
 		return true;
@@ -450,24 +611,173 @@ email_within_limits(const char *email)
 			return true;
 	}
 
-	email_canonical = canonicalize_email(email);
+	accounts = myuser_email_accounts(email);
 
-	MYENTITY_FOREACH_T(mt, &state, ENT_USER)
+	return accounts == NULL || MOWGLI_LIST_LENGTH(accounts) < me.maxusers;
+}
+
+/* The module (if any) that looks further into e-mail addresses than
+ * validemail() can, e.g. whether the domain exists (nickserv/mxcheck).
+ */
+static const struct email_checker *email_checker = NULL;
+
+// A command suspended by command_check_email(), until its address has been checked
+struct email_check_wait
+{
+	mowgli_node_t               node;
+	struct command_pending *    cp;
+	void *                      handle;
+	char                        email[EMAILLEN + 1];
+	int                         parc;
+	char *                      parv[20];
+};
+
+static mowgli_list_t email_check_waits;
+
+// The address that a command is being run again for, having passed its check
+static const char *email_check_passed = NULL;
+
+static void
+email_check_wait_free(struct email_check_wait *const restrict ecw)
+{
+	(void) mowgli_node_delete(&ecw->node, &email_check_waits);
+
+	for (int i = 0; i < ecw->parc; i++)
+		(void) sfree(ecw->parv[i]);
+
+	(void) sfree(ecw);
+}
+
+static void
+email_check_cancel(void *const restrict priv)
+{
+	struct email_check_wait *const ecw = priv;
+
+	(void) email_checker->cancel(ecw->handle);
+	(void) email_check_wait_free(ecw);
+}
+
+static void
+email_check_done(const bool valid, void *const restrict priv)
+{
+	struct email_check_wait *const ecw = priv;
+	struct sourceinfo *const si = command_resume(ecw->cp);
+
+	if (! si)
+		;
+	else if (! valid)
+		(void) command_fail(si, fault_badparams, _("\2%s\2 is not a deliverable e-mail address."), ecw->email);
+	else if (si->command != NULL)
 	{
-		struct myuser *mu = user(mt);
+		// The same command again, with the same arguments; it gets past the check this time
+		email_check_passed = ecw->email;
+		(void) si->command->cmd(si, ecw->parc, ecw->parv);
+		email_check_passed = NULL;
+	}
 
-		if (mu->email_canonical == email_canonical)
-			tcnt++;
+	(void) command_finish(ecw->cp);
+	(void) email_check_wait_free(ecw);
+}
 
-		/* optimization: if tcnt >= me.maxusers, quit iterating. -nenolod */
-		if (tcnt >= me.maxusers) {
-			result = false;
+void
+email_checker_register(const struct email_checker *const restrict checker)
+{
+	return_if_fail(checker != NULL);
+	return_if_fail(email_checker == NULL);
+
+	email_checker = checker;
+}
+
+/* Commands still waiting for the checker are told to try again; they can
+ * not be allowed through unchecked after the fact.
+ */
+void
+email_checker_unregister(const struct email_checker *const restrict checker)
+{
+	mowgli_node_t *n;
+
+	return_if_fail(checker != NULL);
+	return_if_fail(email_checker == checker);
+
+	while ((n = email_check_waits.head) != NULL)
+	{
+		struct email_check_wait *const ecw = n->data;
+		struct sourceinfo *const si = command_resume(ecw->cp);
+
+		(void) checker->cancel(ecw->handle);
+
+		if (si)
+			(void) command_fail(si, fault_emailfail, _("Your e-mail address could not be checked, "
+			                                           "please try again."));
+
+		(void) command_finish(ecw->cp);
+		(void) email_check_wait_free(ecw);
+	}
+
+	email_checker = NULL;
+}
+
+/*
+ * command_check_email()
+ *
+ * Asks the e-mail checker (if there is one) about an address given to a
+ * command, whose arguments are parc and parv. Returns true if the command
+ * can go on with it right away. Otherwise the command must return: it was
+ * either told why the address is no good, or suspended until the checker
+ * has made up its mind, and is then run again with the same arguments.
+ *
+ * Only IRC users are waited for; other sources need their answer in the
+ * reply, and just get what the checker already knows.
+ */
+bool
+command_check_email(struct sourceinfo *const restrict si, const char *const restrict email, const int parc,
+                    char *parv[])
+{
+	return_val_if_fail(si != NULL, true);
+	return_val_if_fail(email != NULL, true);
+
+	if (! email_checker)
+		return true;
+
+	if (email_check_passed && strcasecmp(email_check_passed, email) == 0)
+		return true;
+
+	struct email_check_wait *ecw = NULL;
+	void *handle = NULL;
+
+	if (si->su != NULL && si->command != NULL && parc >= 0 && (size_t) parc <= ARRAY_SIZE(ecw->parv))
+		ecw = smalloc(sizeof *ecw);
+
+	switch (email_checker->start(email, ecw ? &email_check_done : NULL, ecw, &handle))
+	{
+		case EMAIL_CHECK_VALID:
+			(void) sfree(ecw);
+			return true;
+
+		case EMAIL_CHECK_INVALID:
+			(void) sfree(ecw);
+			(void) command_fail(si, fault_badparams, _("\2%s\2 is not a deliverable e-mail address."), email);
+			return false;
+
+		case EMAIL_CHECK_PENDING:
 			break;
-		}
 	}
 
-	strshare_unref(email_canonical);
-	return result;
+	return_val_if_fail(ecw != NULL, true);
+
+	ecw->handle = handle;
+	ecw->parc = parc;
+
+	(void) mowgli_strlcpy(ecw->email, email, sizeof ecw->email);
+
+	for (int i = 0; i < parc; i++)
+		ecw->parv[i] = (parv[i] ? sstrdup(parv[i]) : NULL);
+
+	(void) mowgli_node_add(ecw, &ecw->node, &email_check_waits);
+
+	ecw->cp = command_suspend(si, &email_check_cancel, ecw);
+
+	return false;
 }
 
 bool
@@ -702,11 +1012,12 @@ sendemail(struct user *u, struct myuser *mu, const char *type, const char *email
 	static time_t period_start = 0, lastwallops = 0;
 	static unsigned int emailcount = 0;
 	struct service *svs;
+	mowgli_string_t *body;
 
 	if (u == NULL || mu == NULL)
 		return 0;
 
-	if (me.mta == NULL)
+	if (me.mta == NULL && me.smtprelay == NULL)
 	{
 		if (strcmp(type, EMAIL_MEMO) && !is_internal_client(u))
 		{
@@ -774,27 +1085,8 @@ sendemail(struct user *u, struct myuser *mu, const char *type, const char *email
 	replace(to, sizeof to, "\\", "\\\\");
 	snprintf(sourceinfo, sizeof sourceinfo, "%s[%s@%s]", u->nick, u->user, u->vhost);
 
-	/* now set up the email */
-	if (pipe(pipfds) < 0)
-	{
-		fclose(in);
-		return 0;
-	}
-	switch (pid = fork())
-	{
-		case -1:
-			fclose(in);
-			return 0;
-		case 0:
-			connection_close_all_fds();
-			close(pipfds[1]);
-			dup2(pipfds[0], 0);
-			execl(me.mta, me.mta, "-t", "-f", me.register_email, NULL);
-			_exit(255);
-	}
-	close(pipfds[0]);
-	childproc_add(pid, "email", sendemail_waited, sstrdup(email));
-	out = fdopen(pipfds[1], "w");
+	/* render the email */
+	body = mowgli_string_create();
 
 	while (fgets(buf, BUFSIZE, in))
 	{
@@ -852,18 +1144,51 @@ sendemail(struct user *u, struct myuser *mu, const char *type, const char *email
 		if ((svs = service_find("statserv")) != NULL)
 			replace(buf, sizeof buf, "&statsvs&", svs->me->nick);
 
-		fprintf(out, "%s\n", buf);
+		mowgli_string_append(body, buf, strlen(buf));
+		mowgli_string_append_char(body, '\n');
 	}
 
 	fclose(in);
 
+	/* queue it for the relay if there is one, else hand it to the mta */
+	if (me.smtprelay != NULL)
+	{
+		rc = mailqueue_submit(me.register_email, email, body->str, body->pos) ? 1 : 0;
+		mowgli_string_destroy(body);
+		return rc;
+	}
+
+	if (pipe(pipfds) < 0)
+	{
+		mowgli_string_destroy(body);
+		return 0;
+	}
+	switch (pid = fork())
+	{
+		case -1:
+			close(pipfds[0]);
+			close(pipfds[1]);
+			mowgli_string_destroy(body);
+			return 0;
+		case 0:
+			connection_close_all_fds();
+			close(pipfds[1]);
+			dup2(pipfds[0], 0);
+			execl(me.mta, me.mta, "-t", "-f", me.register_email, NULL);
+			_exit(255);
+	}
+	close(pipfds[0]);
+	childproc_add(pid, "email", sendemail_waited, sstrdup(email));
+	out = fdopen(pipfds[1], "w");
+
 	rc = 1;
-	if (ferror(out))
+	if (fwrite(body->str, 1, body->pos, out) != body->pos || ferror(out))
 		rc = 0;
 	if (fclose(out) < 0)
 		rc = 0;
 	if (rc == 0)
 		slog(LG_ERROR, "sendemail(): mta failure");
+	mowgli_string_destroy(body);
 	return rc;
 #else
 # warning implement me :(
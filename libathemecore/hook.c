@@ -18,34 +18,36 @@
 #include "internal.h"
 
 static mowgli_patricia_t *hooks = NULL;
-static mowgli_heap_t *hook_heap = NULL;
-static mowgli_heap_t *hook_privfn_heap = NULL;
+static struct named_heap *hook_heap = NULL;
 
+/*
+ * One of these lives on the stack for every hook that is currently being
+ * dispatched, so that handlers added or removed from inside a handler can
+ * fix up the iteration of any dispatch in progress on the same hook.
+ */
 typedef struct {
 	struct hook *hook;
 	void *dptr;
 	mowgli_node_t node;
 	unsigned int flags;
+	size_t idx;
+	size_t count;
 } hook_run_ctx_t;
 
-typedef struct {
-	hook_fn hookfn;
-	mowgli_node_t node;
-} hook_privfn_ctx_t;
-
 #define HF_RUN		0x1
 #define HF_STOP		0x2
 
 static mowgli_list_t hook_run_stack = { NULL, NULL, 0 };
 
+static mowgli_list_t hook_stats_list = { NULL, NULL, 0 };
+
 void
 hooks_init(void)
 {
 	hooks = mowgli_patricia_create(strcasecanon);
-	hook_heap = sharedheap_get(sizeof(struct hook));
-	hook_privfn_heap = sharedheap_get(sizeof(hook_privfn_ctx_t));
+	hook_heap = named_heap_get("hook", sizeof(struct hook));
 
-	if (hook_heap == NULL || hook_privfn_heap == NULL || hooks == NULL)
+	if (hook_heap == NULL || hooks == NULL)
 	{
 		slog(LG_INFO, "hooks_init(): block allocator failed.");
 		exit(EXIT_SUCCESS);
@@ -58,131 +60,271 @@ hook_find(const char *name)
 	return mowgli_patricia_retrieve(hooks, name);
 }
 
-static struct hook *
-hook_add_event(const char *name)
+/*
+ * hook_get()
+ *
+ * Returns the handle for the named hook, creating it if necessary. Handles
+ * are never freed, so callers may cache the result for as long as they like.
+ */
+struct hook *
+hook_get(const char *name)
 {
 	struct hook *nh;
 
-	if((nh = hook_find(name)) != NULL)
+	return_val_if_fail(name != NULL, NULL);
+
+	if ((nh = hook_find(name)) != NULL)
 		return nh;
 
-	nh = mowgli_heap_alloc(hook_heap);
+	nh = named_heap_alloc(hook_heap);
 	nh->name = strshare_get(name);
+	nh->handlers = NULL;
+	nh->stats = NULL;
+	nh->count = 0;
+	nh->alloc = 0;
 
 	mowgli_patricia_add(hooks, nh->name, nh);
 
 	return nh;
 }
 
-static inline void
-hook_destroy(struct hook *hook, hook_privfn_ctx_t *priv)
+static struct hook_handler_stats *
+hook_stats_get(const struct hook *const restrict hook, const hook_fn handler)
 {
-	mowgli_node_delete(&priv->node, &hook->hooks);
-	mowgli_heap_free(hook_privfn_heap, priv);
+	const struct module *const m = module_current();
+	struct hook_handler_stats *st;
+	mowgli_node_t *n;
+
+	// Handlers that come back (e.g. re-added on demand) keep their counters
+	MOWGLI_ITER_FOREACH(n, hook_stats_list.head)
+	{
+		st = n->data;
+
+		if (st->hook == hook->name && st->handler == handler && ! st->installed)
+		{
+			if (m != NULL && (st->module == NULL || strcmp(st->module, m->name) != 0))
+			{
+				(void) sfree(st->module);
+				st->module = sstrdup(m->name);
+			}
+
+			return st;
+		}
+	}
+
+	st = smalloc(sizeof *st);
+	st->hook = hook->name;
+	st->handler = handler;
+	st->module = (m != NULL) ? sstrdup(m->name) : NULL;
+
+	(void) mowgli_node_add(st, mowgli_node_create(), &hook_stats_list);
+
+	return st;
 }
 
-void
-hook_del_hook(const char *event, hook_fn handler)
+static void
+hook_insert(struct hook *const restrict hook, const size_t pos, const hook_fn handler)
 {
-	mowgli_node_t *n, *n2;
-	struct hook *h;
+	mowgli_node_t *n;
 
-	return_if_fail(event != NULL);
-	return_if_fail(handler != NULL);
+	if (hook->count == hook->alloc)
+	{
+		hook->alloc = hook->alloc ? (hook->alloc * 2) : 4;
+		hook->handlers = sreallocarray(hook->handlers, hook->alloc, sizeof *hook->handlers);
+		hook->stats = sreallocarray(hook->stats, hook->alloc, sizeof *hook->stats);
+	}
 
-	h = hook_find(event);
-	if (h == NULL)
-		return;
+	(void) memmove(&hook->handlers[pos + 1], &hook->handlers[pos], (hook->count - pos) * sizeof *hook->handlers);
+	(void) memmove(&hook->stats[pos + 1], &hook->stats[pos], (hook->count - pos) * sizeof *hook->stats);
 
-	MOWGLI_ITER_FOREACH_SAFE(n, n2, h->hooks.head)
-	{
-		hook_privfn_ctx_t *priv = n->data;
+	hook->handlers[pos] = handler;
+	hook->stats[pos] = hook_stats_get(hook, handler);
+	hook->stats[pos]->installed = true;
+	hook->count++;
 
-		if (handler == priv->hookfn)
-			hook_destroy(h, n->data);
+	MOWGLI_ITER_FOREACH(n, hook_run_stack.head)
+	{
+		hook_run_ctx_t *const ctx = n->data;
+
+		if (ctx->hook != hook)
+			continue;
+
+		if (pos <= ctx->idx)
+		{
+			ctx->idx++;
+			ctx->count++;
+		}
+		else if (pos < ctx->count)
+			ctx->count++;
 	}
 }
 
-static inline hook_privfn_ctx_t *
-hook_create_and_add(struct hook *hook, hook_fn handler,
-	void (*addfn)(void *data, mowgli_node_t *node, mowgli_list_t *list))
+static void
+hook_remove(struct hook *const restrict hook, const size_t pos)
 {
-	hook_privfn_ctx_t *priv;
+	mowgli_node_t *n;
 
-	return_val_if_fail(hook != NULL, NULL);
-	return_val_if_fail(handler != NULL, NULL);
-	return_val_if_fail(addfn != NULL, NULL);
+	hook->stats[pos]->installed = false;
+	hook->count--;
 
-	priv = mowgli_heap_alloc(hook_privfn_heap);
-	priv->hookfn = handler;
+	(void) memmove(&hook->handlers[pos], &hook->handlers[pos + 1], (hook->count - pos) * sizeof *hook->handlers);
+	(void) memmove(&hook->stats[pos], &hook->stats[pos + 1], (hook->count - pos) * sizeof *hook->stats);
 
-	addfn(priv, &priv->node, &hook->hooks);
+	MOWGLI_ITER_FOREACH(n, hook_run_stack.head)
+	{
+		hook_run_ctx_t *const ctx = n->data;
+
+		if (ctx->hook != hook)
+			continue;
 
-	return priv;
+		if (pos < ctx->count)
+			ctx->count--;
+
+		// The loop in hook_handle_dispatch() will step past this again
+		if (pos <= ctx->idx)
+			ctx->idx--;
+	}
 }
 
 void
-hook_add_hook(const char *event, hook_fn handler)
+hook_handle_del(struct hook *hook, hook_fn handler)
 {
-	struct hook *h;
-	hook_privfn_ctx_t *priv;
+	size_t i;
 
-	return_if_fail(event != NULL);
+	return_if_fail(hook != NULL);
 	return_if_fail(handler != NULL);
 
-	h = hook_find(event);
-	if (h == NULL)
-		h = hook_add_event(event);
-
-	hook_create_and_add(h, handler, mowgli_node_add);
+	for (i = hook->count; i > 0; i--)
+		if (hook->handlers[i - 1] == handler)
+			hook_remove(hook, i - 1);
 }
 
 void
-hook_add_hook_first(const char *event, hook_fn handler)
+hook_handle_add(struct hook *hook, hook_fn handler)
 {
-	struct hook *h;
+	return_if_fail(hook != NULL);
+	return_if_fail(handler != NULL);
 
-	return_if_fail(event != NULL);
+	hook_insert(hook, hook->count, handler);
+}
+
+void
+hook_handle_add_first(struct hook *hook, hook_fn handler)
+{
+	return_if_fail(hook != NULL);
 	return_if_fail(handler != NULL);
 
-	h = hook_find(event);
-	if (h == NULL)
-		h = hook_add_event(event);
+	hook_insert(hook, 0, handler);
+}
+
+static void
+hook_handler_profile(const hook_fn handler, struct hook_handler_stats *const restrict st, void *const dptr)
+{
+	struct timeval started, elapsed;
+
+	(void) s_time(&started);
+
+	handler(dptr);
+
+	(void) e_time(started, &elapsed);
+
+	const unsigned long long us = (((unsigned long long) elapsed.tv_sec) * 1000000ULL) + elapsed.tv_usec;
+	unsigned int bucket = 0;
+
+	while (bucket < HOOK_STATS_BUCKETS - 1 && (us >> (bucket + 1)))
+		bucket++;
 
-	hook_create_and_add(h, handler, mowgli_node_add_head);
+	/* st outlives the handler being removed; the time includes any hooks
+	 * that the handler itself called
+	 */
+	st->calls++;
+	st->total_us += us;
+	st->hist[bucket]++;
+
+	if (us > st->max_us)
+		st->max_us = us;
 }
 
 void
-hook_call_event(const char *event, void *dptr)
+hook_handle_dispatch(struct hook *hook, void *dptr)
 {
 	hook_run_ctx_t ctx;
-	mowgli_node_t *n, *tn;
-	void (*func)(void *data);
 
-	return_if_fail(event != NULL);
+	return_if_fail(hook != NULL);
 
-	ctx.hook = hook_find(event);
-	if (ctx.hook == NULL)
-		return;
+	ATHEME_TRACE2(hook__call, hook->name, hook->count);
 
+	ctx.hook = hook;
 	ctx.dptr = dptr;
 	ctx.flags = HF_RUN;
+	ctx.count = hook->count;
 
 	mowgli_node_add_head(&ctx, &ctx.node, &hook_run_stack);
 
-	MOWGLI_ITER_FOREACH_SAFE(n, tn, ctx.hook->hooks.head)
+	/* ctx.idx wraps around to SIZE_MAX and back to 0 if the first
+	 * handler removes itself; that is intentional.
+	 */
+	for (ctx.idx = 0; ctx.idx < ctx.count; ctx.idx++)
 	{
-		hook_privfn_ctx_t *priv = n->data;
+		if (config_options.hook_profiling)
+			hook_handler_profile(hook->handlers[ctx.idx], hook->stats[ctx.idx], ctx.dptr);
+		else
+			hook->handlers[ctx.idx](ctx.dptr);
 
-		priv->hookfn(ctx.dptr);
 		if (ctx.flags & HF_STOP)
-			goto out;
+			break;
 	}
 
-out:
 	mowgli_node_delete(&ctx.node, &hook_run_stack);
 }
 
+void
+hook_del_hook(const char *event, hook_fn handler)
+{
+	struct hook *h;
+
+	return_if_fail(event != NULL);
+	return_if_fail(handler != NULL);
+
+	h = hook_find(event);
+	if (h == NULL)
+		return;
+
+	hook_handle_del(h, handler);
+}
+
+void
+hook_add_hook(const char *event, hook_fn handler)
+{
+	return_if_fail(event != NULL);
+	return_if_fail(handler != NULL);
+
+	hook_handle_add(hook_get(event), handler);
+}
+
+void
+hook_add_hook_first(const char *event, hook_fn handler)
+{
+	return_if_fail(event != NULL);
+	return_if_fail(handler != NULL);
+
+	hook_handle_add_first(hook_get(event), handler);
+}
+
+void
+hook_call_event(const char *event, void *dptr)
+{
+	struct hook *h;
+
+	return_if_fail(event != NULL);
+
+	h = hook_find(event);
+	if (h == NULL)
+		return;
+
+	hook_handle_call(h, dptr);
+}
+
 static inline hook_run_ctx_t *
 hook_run_stack_highest(void)
 {
@@ -217,6 +359,50 @@ hook_continue(void *newptr)
 	ctx->flags &= ~HF_STOP;
 }
 
+/*
+ * hook_stats_foreach()
+ *
+ * Calls cb for the statistics of every hook handler that has ever been
+ * added, whether or not it has been called (or is still installed).
+ */
+void
+hook_stats_foreach(void (*const cb)(const struct hook_handler_stats *, void *), void *const privdata)
+{
+	mowgli_node_t *n;
+
+	return_if_fail(cb != NULL);
+
+	MOWGLI_ITER_FOREACH(n, hook_stats_list.head)
+		cb(n->data, privdata);
+}
+
+/*
+ * hook_stats_dump()
+ *
+ * Writes the statistics of every hook handler that has been called to the
+ * log.
+ */
+void
+hook_stats_dump(void)
+{
+	mowgli_node_t *n;
+
+	slog(LG_INFO, "HOOKSTATS: %-24s %-24s %10s %10s %8s %8s", "hook", "module", "calls", "total ms", "avg us",
+	     "max us");
+
+	MOWGLI_ITER_FOREACH(n, hook_stats_list.head)
+	{
+		const struct hook_handler_stats *const st = n->data;
+
+		if (! st->calls)
+			continue;
+
+		slog(LG_INFO, "HOOKSTATS: %-24s %-24s %10u %10llu %8llu %8llu%s", st->hook,
+		     (st->module != NULL) ? st->module : "-", st->calls, st->total_us / 1000ULL,
+		     st->total_us / st->calls, st->max_us, st->installed ? "" : " (removed)");
+	}
+}
+
 /* vim:cinoptions=>s,e0,n0,f0,{0,}0,^0,=s,ps,t0,c3,+s,(2s,us,)20,*30,gs,hs
  * vim:ts=8
  * vim:sw=8
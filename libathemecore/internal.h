@@ -14,7 +14,12 @@
 #include <atheme/stdheaders.h>
 
 /* internal functions */
+void cmode_init(void);
+void command_pending_init(void);
+void db_commit_init(void);
+void delivery_run(void);
 void event_init(void);
+void help_cache_init(void);
 void hooks_init(void);
 void init_dlink_nodes(void);
 void init_netio(void);
@@ -22,5 +27,83 @@ void init_socket_queues(void);
 void init_signal_handlers(void);
 
 void language_init(void);
+void mailqueue_init(void);
+void memo_ignore_init(void);
+void memostore_init(void);
+void netstats_init(void);
+void timerwheel_init(void);
+
+struct module *module_current(void);
+void module_lazy_disarm(const char *filespec);
+struct command *module_lazy_resolve(mowgli_patricia_t *commandtree, struct command *c);
+
+void channel_reap_split(void);
+
+char *recvq_buffer(struct connection *cptr, size_t *lenp);
+void recvq_received(struct connection *cptr, size_t len);
+#ifdef HAVE_SYS_UIO_H
+int sendq_iov(struct connection *cptr, struct iovec *iov, int max, size_t *total);
+#endif
+void sendq_written(struct connection *cptr, size_t len);
+void sendq_drained(struct connection *cptr);
+void sendqrecvq_release(struct connection *cptr, mowgli_list_t *keep);
+void sendqrecvq_free_blocks(mowgli_list_t *blocks);
+
+bool uring_connection_read(struct connection *cptr);
+bool uring_connection_write(struct connection *cptr);
+bool uring_connection_flush(struct connection *cptr);
+int uring_connection_accepted(struct connection *cptr);
+void uring_connection_close(struct connection *cptr);
+
+size_t base64_encode_accel(const unsigned char *src, size_t src_len, char *dst, size_t dst_len);
+size_t base64_decode_accel(const char *src, size_t src_len, unsigned char *dst, size_t dst_len);
+
+void conf_diff_scan(mowgli_config_file_t *cfp);
+void conf_diff_commit(void);
+
+void log_flush_deferred(void);
+void log_writer_drain(void);
+
+void log_index_update(struct logfile *lf);
+void log_index_detach(struct logfile *lf);
+void log_index_sweep(void);
+void log_index_line(struct logfile *lf, const char *datetime, const char *buf, size_t len);
+
+void chanacs_user_forget(struct user *u);
+
+void server_p10_client_add(struct user *u);
+void server_p10_client_delete(const struct user *u);
+struct user *server_p10_client_find(const char *uid);
+
+struct service *service_target_remove(struct user *u);
+void service_target_add(struct service *sptr);
+
+void myuser_email_index_add(struct myuser *mu);
+void myuser_email_index_delete(struct myuser *mu);
+
+void nickfilter_add(const char *name);
+void nickfilter_forget(void);
+
+void set_password_initial(struct myuser *mu, const char *password);
+void password_rehash(struct myuser *mu, const char *password, const char *from_id, unsigned int verify_flags);
+void crypt_verify_password_threadsafe_multi(const char *const *passwords, const char *const *parameters,
+                                            unsigned int *flags, bool *decided, const struct crypt_impl **results,
+                                            size_t count);
+void pwverify_pool_pause(void);
+void pwverify_pool_resume(void);
+void pwverify_rehash_submit(struct myuser *mu, const char *password, const struct crypt_impl *ci);
+
+// connection_trampoline() may see the connection freed by its handler, so copy what we need
+struct timer_io_sample
+{
+	struct timeval          started;
+	unsigned int            kind;
+	char                    name[HOSTLEN + 1];
+};
+
+void timer_io_begin(const struct connection *cptr, struct timer_io_sample *sample);
+void timer_io_end(struct timer_io_sample *sample, bool write);
+void timer_loop_begin(void);
+void timer_loop_end(void);
 
 #endif /* !ATHEME_LAC_INTERNAL_H */
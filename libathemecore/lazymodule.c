@@ -0,0 +1,321 @@
+/*
+ * SPDX-License-Identifier: ISC
+ * SPDX-URL: https://spdx.org/licenses/ISC.html
+ *
+ * Copyright (C) 2026 Atheme Development Group (https://atheme.github.io/)
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * atheme-services: A collection of minimalist IRC services
+ * lazymodule.c: Modules that are loaded when they are first needed.
+ *
+ * A lazymodule{} block names a module along with the commands and database
+ * row types it provides. Instead of loading it, we put a stub command into
+ * each of those services' command trees, and a stub handler in place of each
+ * row type. The first lookup of a stub command (through command_find()) or
+ * the first row of one of the types then loads the module, which replaces
+ * the stubs with the real things. Loading it any other way (MODLOAD, or as a
+ * dependency) takes the stubs out first, too.
+ */
+
+#include <atheme.h>
+#include "internal.h"
+
+struct module_lazy_command
+{
+	struct command          cmd;            // first, so that a stub can be found from its command
+	struct module_lazy *    owner;
+	struct service *        svs;            // where it is bound, or NULL
+	char *                  svsname;
+	mowgli_node_t           node;
+};
+
+struct module_lazy
+{
+	char *                  path;
+	char *                  access;
+	char *                  desc;
+	mowgli_list_t           commands;
+	mowgli_list_t           rows;           // of row type names
+	bool                    armed;
+	mowgli_node_t           node;
+};
+
+static mowgli_list_t module_lazy_list;
+static mowgli_patricia_t *module_lazy_rows = NULL;
+
+static struct module_lazy *
+module_lazy_find(const char *const restrict path)
+{
+	mowgli_node_t *n;
+
+	MOWGLI_ITER_FOREACH(n, module_lazy_list.head)
+	{
+		struct module_lazy *const ml = n->data;
+
+		if (strcasecmp(ml->path, path) == 0)
+			return ml;
+	}
+
+	return NULL;
+}
+
+// Only command_find() should ever hand this out; it is here in case something looks in a tree itself
+static void
+module_lazy_stub_cmd(struct sourceinfo *const restrict si, const int ATHEME_VATTR_UNUSED parc,
+                     char ATHEME_VATTR_UNUSED **const restrict parv)
+{
+	(void) command_fail(si, fault_unimplemented, _("This command is not available right now."));
+}
+
+static void
+module_lazy_disarm_one(struct module_lazy *const restrict ml)
+{
+	mowgli_node_t *n;
+
+	MOWGLI_ITER_FOREACH(n, ml->commands.head)
+	{
+		struct module_lazy_command *const mlc = n->data;
+
+		if (mlc->svs && mowgli_patricia_retrieve(mlc->svs->commands, mlc->cmd.name) == &mlc->cmd)
+			(void) service_unbind_command(mlc->svs, &mlc->cmd);
+
+		mlc->svs = NULL;
+	}
+
+	MOWGLI_ITER_FOREACH(n, ml->rows.head)
+	{
+		const char *const type = n->data;
+
+		if (mowgli_patricia_retrieve(module_lazy_rows, type) != ml)
+			continue;
+
+		(void) mowgli_patricia_delete(module_lazy_rows, type);
+		(void) db_unregister_type_handler(type);
+	}
+
+	ml->armed = false;
+}
+
+static bool
+module_lazy_load(struct module_lazy *const restrict ml, const char *const restrict why, const char *const restrict what)
+{
+	(void) slog(LG_INFO, "lazymodule: loading \2%s\2 for %s \2%s\2", ml->path, why, what);
+
+	// This disarms it, however it turns out
+	if (module_load(ml->path))
+		return true;
+
+	(void) slog(LG_ERROR, "lazymodule: \2%s\2 could not be loaded; what it provides is unavailable", ml->path);
+	return false;
+}
+
+static void
+module_lazy_stub_row(struct database_handle *const restrict db, const char *const restrict type)
+{
+	struct module_lazy *const ml = mowgli_patricia_retrieve(module_lazy_rows, type);
+
+	if (ml)
+		(void) module_lazy_load(ml, "database rows of type", type);
+
+	const database_handler_fn fun = db_resolve_type_handler(type);
+
+	if (! fun || fun == &module_lazy_stub_row)
+	{
+		(void) slog(LG_ERROR, "db %s:%u: nothing took rows of type '%s' after loading the module declared "
+		                      "for them", db->file, db->line, type);
+		(void) slog(LG_ERROR, "lazymodule: exiting to avoid data loss");
+
+		exit(EXIT_FAILURE);
+	}
+
+	fun(db, type);
+}
+
+/*
+ * module_lazy_declare(const char *path)
+ *
+ * Starts a declaration for a module that is to be loaded on demand; it
+ * does nothing until module_lazy_arm() is called for it.
+ *
+ * Outputs:
+ *      - the declaration, or NULL if the module is already loaded or
+ *        declared
+ */
+struct module_lazy *
+module_lazy_declare(const char *const restrict path)
+{
+	return_val_if_fail(path != NULL, NULL);
+
+	if (module_find_published(path) || module_lazy_find(path))
+		return NULL;
+
+	if (! module_lazy_rows)
+		module_lazy_rows = mowgli_patricia_create(&strcasecanon);
+
+	struct module_lazy *const ml = smalloc(sizeof *ml);
+
+	ml->path = sstrdup(path);
+
+	(void) mowgli_node_add(ml, &ml->node, &module_lazy_list);
+
+	return ml;
+}
+
+void
+module_lazy_add_command(struct module_lazy *const restrict ml, const char *const restrict svsname,
+                        const char *const restrict name)
+{
+	return_if_fail(ml != NULL);
+	return_if_fail(svsname != NULL);
+	return_if_fail(name != NULL);
+
+	struct module_lazy_command *const mlc = smalloc(sizeof *mlc);
+	char *const cmdname = sstrdup(name);
+
+	for (char *p = cmdname; *p; p++)
+		*p = (char) toupper((unsigned char) *p);
+
+	mlc->cmd.name = cmdname;
+	mlc->cmd.maxparc = 1;
+	mlc->cmd.cmd = &module_lazy_stub_cmd;
+	mlc->owner = ml;
+	mlc->svsname = sstrdup(svsname);
+
+	(void) mowgli_node_add(mlc, &mlc->node, &ml->commands);
+}
+
+void
+module_lazy_add_row(struct module_lazy *const restrict ml, const char *const restrict type)
+{
+	return_if_fail(ml != NULL);
+	return_if_fail(type != NULL);
+
+	(void) mowgli_node_add(sstrdup(type), mowgli_node_create(), &ml->rows);
+}
+
+/*
+ * module_lazy_arm(struct module_lazy *ml, const char *access, const char *desc)
+ *
+ * Binds the stubs for everything the declaration lists; until the module
+ * loads, its commands are listed with desc and need the privilege access
+ * (if not NULL).
+ *
+ * Outputs:
+ *      - true if every stub is in place; false (with none in place) if a
+ *        service does not exist, or a command or row type is already
+ *        taken, in which case the module should just be loaded.
+ */
+bool
+module_lazy_arm(struct module_lazy *const restrict ml, const char *const restrict access,
+                const char *const restrict desc)
+{
+	mowgli_node_t *n;
+
+	return_val_if_fail(ml != NULL, false);
+
+	if (! MOWGLI_LIST_LENGTH(&ml->commands) && ! MOWGLI_LIST_LENGTH(&ml->rows))
+		return false;
+
+	ml->access = access ? sstrdup(access) : NULL;
+	ml->desc = sstrdup(desc ? desc : N_("Loaded on first use."));
+	ml->armed = true;
+
+	MOWGLI_ITER_FOREACH(n, ml->commands.head)
+	{
+		struct module_lazy_command *const mlc = n->data;
+		struct service *const svs = service_find(mlc->svsname);
+
+		if (! svs || mowgli_patricia_retrieve(svs->commands, mlc->cmd.name))
+		{
+			(void) slog(LG_ERROR, "lazymodule: cannot put %s \2%s\2 off until \2%s\2 is needed: %s",
+			                      mlc->svsname, mlc->cmd.name, ml->path, svs ? "the command exists already" :
+			                      "no such service");
+			(void) module_lazy_disarm_one(ml);
+			return false;
+		}
+
+		mlc->cmd.access = ml->access;
+		mlc->cmd.desc = ml->desc;
+		mlc->svs = svs;
+
+		(void) service_bind_command(svs, &mlc->cmd);
+	}
+
+	MOWGLI_ITER_FOREACH(n, ml->rows.head)
+	{
+		const char *const type = n->data;
+
+		if (db_resolve_type_handler(type) || mowgli_patricia_retrieve(module_lazy_rows, type))
+		{
+			(void) slog(LG_ERROR, "lazymodule: cannot put \2%s\2 off until rows of type \2%s\2 come up: the "
+			                      "type is handled already", ml->path, type);
+			(void) module_lazy_disarm_one(ml);
+			return false;
+		}
+
+		(void) db_register_type_handler(type, &module_lazy_stub_row);
+		(void) mowgli_patricia_add(module_lazy_rows, type, ml);
+	}
+
+	(void) slog(LG_DEBUG, "lazymodule: \2%s\2 will be loaded on demand (%zu command(s), %zu row type(s))",
+	                      ml->path, MOWGLI_LIST_LENGTH(&ml->commands), MOWGLI_LIST_LENGTH(&ml->rows));
+
+	return true;
+}
+
+/*
+ * module_lazy_declared(const char *name, bool *has_rows)
+ *
+ * Outputs:
+ *      - true if name is a module that has not been loaded yet because it
+ *        is declared to be loaded on demand; has_rows is then set to
+ *        whether rows of one of its types would load it
+ */
+bool
+module_lazy_declared(const char *const restrict name, bool *const restrict has_rows)
+{
+	return_val_if_fail(name != NULL, false);
+
+	const struct module_lazy *const ml = module_lazy_find(name);
+
+	if (! ml || ! ml->armed)
+		return false;
+
+	if (has_rows)
+		*has_rows = (MOWGLI_LIST_LENGTH(&ml->rows) != 0);
+
+	return true;
+}
+
+// Called by module_load(), so that the module finds its command names and row types free
+void
+module_lazy_disarm(const char *const restrict filespec)
+{
+	struct module_lazy *const ml = module_lazy_find(filespec);
+
+	if (ml && ml->armed)
+		(void) module_lazy_disarm_one(ml);
+}
+
+// Called by command_find(); returns c, or what took its place if it was a stub
+struct command *
+module_lazy_resolve(mowgli_patricia_t *const restrict commandtree, struct command *const restrict c)
+{
+	if (c->cmd != &module_lazy_stub_cmd)
+		return c;
+
+	struct module_lazy_command *const mlc = (struct module_lazy_command *) c;
+
+	if (! module_lazy_load(mlc->owner, "command", mlc->cmd.name))
+		return NULL;
+
+	struct command *const real = mowgli_patricia_retrieve(commandtree, mlc->cmd.name);
+
+	if (! real || real->cmd == &module_lazy_stub_cmd)
+		return NULL;
+
+	return real;
+}
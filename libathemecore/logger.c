@@ -16,11 +16,80 @@
 #include <atheme.h>
 #include "internal.h"
 
+#ifdef HAVE_USABLE_PTHREAD
+#  include <pthread.h>
+#endif
+
 static struct logfile *log_file;
 int log_force;
 
+// Union of the masks of all registered log files; see slog_enabled()
+unsigned int log_mask_active = 0;
+
 static mowgli_list_t log_files = { NULL, NULL, 0 };
 
+#ifdef HAVE_USABLE_PTHREAD
+
+/* Messages logged from threads other than the main one (password verification
+ * workers, the threaded database writer) cannot touch the log files or the IRC
+ * connection, so they are queued here and written out by the main thread.
+ */
+struct log_deferred
+{
+	struct log_deferred *   next;
+	enum log_type           type;
+	unsigned int            level;
+	char                    buf[];
+};
+
+static pthread_t log_main_thread;
+static bool log_main_thread_known = false;
+static pthread_mutex_t log_deferred_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct log_deferred *log_deferred_head = NULL;
+static struct log_deferred **log_deferred_tail = &log_deferred_head;
+
+/* With general::log_async, lines for log files are formatted on the main
+ * thread into a ring of slots and written out by a writer thread, so that a
+ * slow disk (or LG_DEBUG) doesn't hold up the event loop. There is a single
+ * producer (the main thread; other threads defer to it, above) and a single
+ * consumer, so each slot is owned by one side at a time and the lock is only
+ * taken to move the indices, never while formatting or writing.
+ *
+ * If the ring is full, debugging output is dropped (and counted); anything
+ * else waits for the writer to make room.
+ */
+#define LOG_RING_SLOTS          1024U   // Must be a power of two
+#define LOG_RING_DROPPABLE      (LG_DEBUG | LG_RAWDATA | LG_VERBOSE)
+
+struct log_ring_slot
+{
+	FILE *                  fp;
+	size_t                  len;
+	char                    line[BUFSIZE + 32];
+};
+
+static struct log_ring_slot *log_ring = NULL;
+static size_t log_ring_head = 0;            // Next slot to fill; only the main thread moves it
+static size_t log_ring_tail = 0;            // Next slot to write; only the writer moves it
+static size_t log_ring_tail_seen = 0;       // The main thread's last look at log_ring_tail
+static pthread_mutex_t log_ring_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t log_ring_fill_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t log_ring_drain_cond = PTHREAD_COND_INITIALIZER;
+static pthread_t log_writer;
+static bool log_writer_running = false;
+static bool log_writer_stopping = false;
+static bool log_writer_idle = false;
+static bool log_writer_failed = false;     // Couldn't start it; don't retry until the next rehash
+static unsigned int log_writer_fsync_interval = 0;
+
+static unsigned int log_write_level = 0;    // Level of the message log_write_all() is writing out
+static unsigned int log_ring_dropped = 0;   // Not yet reported
+static unsigned int log_ring_dropped_total = 0;
+
+#endif /* HAVE_USABLE_PTHREAD */
+
+static void log_irc_queue_free(struct log_irc_queue *);
+
 /* private destructor function for struct logfile. */
 static void
 logfile_delete_file(void *vdata)
@@ -29,6 +98,10 @@ logfile_delete_file(void *vdata)
 
 	logfile_unregister(lf);
 
+	// The writer thread may still have lines for this file
+	(void) log_writer_drain();
+	(void) log_index_detach(lf);
+
 	fclose(lf->log_file);
 	sfree(lf->log_path);
 	metadata_delete_all(lf);
@@ -42,6 +115,7 @@ logfile_delete_channel(void *vdata)
 
 	logfile_unregister(lf);
 
+	log_irc_queue_free(lf->irc_queue);
 	sfree(lf->log_path);
 	metadata_delete_all(lf);
 	sfree(lf);
@@ -184,6 +258,279 @@ logfile_strip_control_codes(const char *buf)
 	return outbuf;
 }
 
+#ifdef HAVE_USABLE_PTHREAD
+
+static void *
+log_writer_thread(void ATHEME_VATTR_UNUSED *const restrict arg)
+{
+	time_t last_sync = time(NULL);
+
+	(void) pthread_mutex_lock(&log_ring_lock);
+
+	for (;;)
+	{
+		while (log_ring_tail == log_ring_head && ! log_writer_stopping)
+		{
+			log_writer_idle = true;
+			(void) pthread_cond_wait(&log_ring_fill_cond, &log_ring_lock);
+		}
+
+		log_writer_idle = false;
+
+		if (log_ring_tail == log_ring_head)
+			break;
+
+		const size_t head = log_ring_head;
+		size_t tail = log_ring_tail;
+
+		(void) pthread_mutex_unlock(&log_ring_lock);
+
+		/* Write out everything queued so far as one batch, flushing each
+		 * file once when the batch moves on to another one (or ends).
+		 */
+		FILE *fp = NULL;
+		bool sync = false;
+
+		if (log_writer_fsync_interval && time(NULL) - last_sync >= log_writer_fsync_interval)
+		{
+			sync = true;
+			last_sync = time(NULL);
+		}
+
+		for (/* No initialization */; tail != head; tail++)
+		{
+			const struct log_ring_slot *const slot = &log_ring[tail & (LOG_RING_SLOTS - 1U)];
+
+			if (fp && fp != slot->fp)
+			{
+				(void) fflush(fp);
+
+				if (sync)
+					(void) fsync(fileno(fp));
+			}
+
+			fp = slot->fp;
+			(void) fwrite(slot->line, 1, slot->len, fp);
+		}
+
+		if (fp)
+		{
+			(void) fflush(fp);
+
+			if (sync)
+				(void) fsync(fileno(fp));
+		}
+
+		(void) pthread_mutex_lock(&log_ring_lock);
+
+		log_ring_tail = tail;
+		(void) pthread_cond_broadcast(&log_ring_drain_cond);
+	}
+
+	(void) pthread_mutex_unlock(&log_ring_lock);
+	return NULL;
+}
+
+static bool
+log_writer_start(void)
+{
+	if (! log_ring)
+		log_ring = smalloc(LOG_RING_SLOTS * sizeof *log_ring);
+
+	log_ring_head = log_ring_tail = log_ring_tail_seen = 0;
+	log_writer_stopping = false;
+	log_writer_fsync_interval = config_options.log_fsync_interval;
+
+	// Signals must only ever be delivered to the main thread
+	sigset_t newset;
+	sigset_t oldset;
+
+	(void) sigfillset(&newset);
+	(void) pthread_sigmask(SIG_BLOCK, &newset, &oldset);
+
+	const int ret = pthread_create(&log_writer, NULL, &log_writer_thread, NULL);
+
+	(void) pthread_sigmask(SIG_SETMASK, &oldset, NULL);
+
+	if (ret != 0)
+	{
+		(void) fprintf(stderr, "%s: pthread_create(3): %s\n", MOWGLI_FUNC_NAME, strerror(ret));
+		log_writer_failed = true;
+		return false;
+	}
+
+	log_writer_running = true;
+	return true;
+}
+
+static void
+log_writer_stop(void)
+{
+	if (! log_writer_running)
+		return;
+
+	(void) pthread_mutex_lock(&log_ring_lock);
+	log_writer_stopping = true;
+	(void) pthread_cond_signal(&log_ring_fill_cond);
+	(void) pthread_mutex_unlock(&log_ring_lock);
+
+	(void) pthread_join(log_writer, NULL);
+
+	log_writer_running = false;
+}
+
+// Returns how many bytes the line will take up in the file
+static size_t
+log_ring_put(size_t *const restrict fill, FILE *const restrict fp, const char *const restrict datetime,
+             const char *const restrict buf)
+{
+	struct log_ring_slot *const slot = &log_ring[*fill & (LOG_RING_SLOTS - 1U)];
+	const int len = snprintf(slot->line, sizeof slot->line, "%s %s\n", datetime, buf);
+
+	if (len < 0)
+		return 0;
+
+	slot->fp = fp;
+	slot->len = ((size_t) len < sizeof slot->line) ? (size_t) len : (sizeof slot->line - 1);
+
+	// Not visible to the writer until log_ring_head is moved past it
+	(*fill)++;
+
+	return slot->len;
+}
+
+/* Queues a line for the writer thread. Returns false if the line should be
+ * written synchronously instead.
+ */
+static bool
+log_writer_queue(struct logfile *const restrict lf, const char *const restrict datetime, const char *const restrict buf)
+{
+	FILE *const fp = lf->log_file;
+
+	if (! config_options.log_async || (runflags & RF_STARTING))
+	{
+		if (log_writer_running)
+			(void) log_writer_stop();
+
+		return false;
+	}
+
+	if (! log_writer_running && (log_writer_failed || ! log_writer_start()))
+		return false;
+
+	if (log_ring_head - log_ring_tail_seen == LOG_RING_SLOTS)
+	{
+		(void) pthread_mutex_lock(&log_ring_lock);
+
+		log_ring_tail_seen = log_ring_tail;
+
+		if (log_ring_head - log_ring_tail_seen == LOG_RING_SLOTS && (log_write_level & ~LOG_RING_DROPPABLE))
+		{
+			while (log_ring_head - log_ring_tail == LOG_RING_SLOTS)
+				(void) pthread_cond_wait(&log_ring_drain_cond, &log_ring_lock);
+
+			log_ring_tail_seen = log_ring_tail;
+		}
+
+		(void) pthread_mutex_unlock(&log_ring_lock);
+
+		if (log_ring_head - log_ring_tail_seen == LOG_RING_SLOTS)
+		{
+			log_ring_dropped++;
+			log_ring_dropped_total++;
+			return true;
+		}
+	}
+
+	size_t fill = log_ring_head;
+
+	if (log_ring_dropped && fill - log_ring_tail_seen < LOG_RING_SLOTS - 1U)
+	{
+		char dropnote[BUFSIZE];
+
+		(void) snprintf(dropnote, sizeof dropnote, "%u debug or verbose messages were dropped because the log "
+		                "writer fell behind", log_ring_dropped);
+		(void) log_index_line(lf, datetime, dropnote, log_ring_put(&fill, fp, datetime, dropnote));
+
+		log_ring_dropped = 0;
+	}
+
+	(void) log_index_line(lf, datetime, buf, log_ring_put(&fill, fp, datetime, buf));
+
+	if (fill == log_ring_head)
+		return true;
+
+	(void) pthread_mutex_lock(&log_ring_lock);
+
+	log_ring_head = fill;
+	log_ring_tail_seen = log_ring_tail;
+
+	if (log_writer_idle)
+		(void) pthread_cond_signal(&log_ring_fill_cond);
+
+	(void) pthread_mutex_unlock(&log_ring_lock);
+
+	return true;
+}
+
+#endif /* HAVE_USABLE_PTHREAD */
+
+/* Whether a file is indexed depends on general::log_index, which may come
+ * after its logfile block; so this waits until the whole configuration has
+ * been read.
+ */
+static void
+logfile_index_update(void *unused)
+{
+	mowgli_node_t *n;
+
+	MOWGLI_ITER_FOREACH(n, log_files.head)
+		log_index_update(n->data);
+
+	// Whatever nobody picked up again (rotated away, or no longer logged to)
+	log_index_sweep();
+}
+
+/*
+ * log_writer_drain(void)
+ *
+ * Waits until the writer thread (if any) has written out every line queued
+ * so far. Must only be called from the main thread.
+ */
+void
+log_writer_drain(void)
+{
+#ifdef HAVE_USABLE_PTHREAD
+	if (! log_writer_running)
+		return;
+
+	(void) pthread_mutex_lock(&log_ring_lock);
+
+	while (log_ring_tail != log_ring_head)
+		(void) pthread_cond_wait(&log_ring_drain_cond, &log_ring_lock);
+
+	log_ring_tail_seen = log_ring_tail;
+
+	(void) pthread_mutex_unlock(&log_ring_lock);
+#endif /* HAVE_USABLE_PTHREAD */
+}
+
+/*
+ * log_writer_dropped(void)
+ *
+ * Returns how many debugging messages have been dropped because the writer
+ * thread could not keep up.
+ */
+unsigned int
+log_writer_dropped(void)
+{
+#ifdef HAVE_USABLE_PTHREAD
+	return log_ring_dropped_total;
+#else
+	return 0;
+#endif
+}
+
 /*
  * logfile_write(struct logfile *lf, const char *buf)
  *
@@ -203,8 +550,10 @@ static void
 logfile_write(struct logfile *lf, const char *buf)
 {
 	char datetime[BUFSIZE];
+	const char *stripped;
 	time_t t;
 	struct tm *tm;
+	int len;
 
 	return_if_fail(lf != NULL);
 	return_if_fail(lf->log_file != NULL);
@@ -213,47 +562,243 @@ logfile_write(struct logfile *lf, const char *buf)
 	time(&t);
 	tm = localtime(&t);
 	strftime(datetime, sizeof datetime, "[%Y-%m-%d %H:%M:%S]", tm);
+	stripped = logfile_strip_control_codes(buf);
+
+#ifdef HAVE_USABLE_PTHREAD
+	if (log_writer_queue(lf, datetime, stripped))
+		return;
+#endif
 
-	fprintf((FILE *) lf->log_file, "%s %s\n", datetime, logfile_strip_control_codes(buf));
+	len = fprintf((FILE *) lf->log_file, "%s %s\n", datetime, stripped);
 	fflush((FILE *) lf->log_file);
+
+	log_index_line(lf, datetime, stripped, (len > 0) ? (size_t) len : 0);
 }
 
-/*
- * logfile_write_irc(struct logfile *lf, const char *buf)
- *
- * Writes an I/O stream to an IRC target.
- *
- * Inputs:
- *       - struct logfile representing the I/O stream.
- *       - data to write to the IRC target
- *
- * Outputs:
- *       - none
- *
- * Side Effects:
- *       - none
+/* Lines for log channels and snotices are queued per log target and sent at
+ * no more than LOG_IRC_BURST lines per LOG_IRC_PERIOD seconds, so that a wave
+ * of registrations or spam doesn't flood the uplink (and get services
+ * throttled). A line that is the same as the one before it is only counted,
+ * and reported as repeated once a different line comes along or the target
+ * goes quiet; a target that falls LOG_IRC_QUEUE_MAX lines behind drops the
+ * rest, and says how many it dropped once it has caught up. The log files
+ * are unaffected.
  */
+#define LOG_IRC_BURST           10U
+#define LOG_IRC_PERIOD          5U
+#define LOG_IRC_QUEUE_MAX       100U
+
+struct log_irc_line
+{
+	mowgli_node_t           node;
+	char                    text[];
+};
+
+struct log_irc_queue
+{
+	void                  (*send)(struct logfile *lf, const char *buf);
+	mowgli_list_t           lines;          // of struct log_irc_line, oldest first
+	struct ratelimit        rate;
+	char *                  last;           // the last line accepted, to spot repeats
+	unsigned int            repeats;        // of it, not yet reported
+	time_t                  last_seen;      // when it was last logged
+	unsigned int            dropped;        // since the queue was last empty, not yet reported
+};
+
+static mowgli_eventloop_timer_t *log_irc_timer = NULL;
+static bool log_irc_sending = false;
+
 static void
-logfile_write_irc(struct logfile *lf, const char *buf)
+log_irc_line_add(struct log_irc_queue *const restrict q, const char *const restrict buf)
 {
-	struct channel *c;
+	if (MOWGLI_LIST_LENGTH(&q->lines) >= LOG_IRC_QUEUE_MAX)
+	{
+		q->dropped++;
+		return;
+	}
 
-	return_if_fail(lf != NULL);
-	return_if_fail(lf->log_path != NULL);
-	return_if_fail(buf != NULL);
+	const size_t len = strlen(buf) + 1U;
+	struct log_irc_line *const line = smalloc(sizeof *line + len);
 
-	if (!me.connected || me.bursting)
+	(void) memcpy(line->text, buf, len);
+	(void) mowgli_node_add(line, &line->node, &q->lines);
+}
+
+static void
+log_irc_repeats_report(struct log_irc_queue *const restrict q)
+{
+	char buf[BUFSIZE];
+
+	if (! q->repeats)
+		return;
+
+	(void) snprintf(buf, sizeof buf, "last message repeated %u time%s", q->repeats, (q->repeats == 1) ? "" : "s");
+	(void) log_irc_line_add(q, buf);
+
+	q->repeats = 0;
+}
+
+static void
+log_irc_queue_clear(struct log_irc_queue *const restrict q)
+{
+	mowgli_node_t *n, *tn;
+
+	MOWGLI_ITER_FOREACH_SAFE(n, tn, q->lines.head)
+	{
+		(void) mowgli_node_delete(n, &q->lines);
+		(void) sfree(n->data);
+	}
+
+	q->repeats = 0;
+	q->dropped = 0;
+}
+
+static void
+log_irc_queue_free(struct log_irc_queue *const restrict q)
+{
+	if (! q)
 		return;
 
+	(void) log_irc_queue_clear(q);
+	(void) sfree(q->last);
+	(void) sfree(q);
+}
+
+// Sends what the rate allows; returns true if anything is left to send later
+static bool
+log_irc_queue_run(struct logfile *const restrict lf)
+{
+	struct log_irc_queue *const q = lf->irc_queue;
+
+	if (! me.connected || me.bursting)
+	{
+		(void) log_irc_queue_clear(q);
+		return false;
+	}
+
+	log_irc_sending = true;
+
+	while (MOWGLI_LIST_LENGTH(&q->lines) && ratelimit_take(&q->rate, RATELIMIT_UNIT, LOG_IRC_BURST, LOG_IRC_PERIOD))
+	{
+		struct log_irc_line *const line = q->lines.head->data;
+
+		(void) mowgli_node_delete(&line->node, &q->lines);
+		(void) q->send(lf, line->text);
+		(void) sfree(line);
+
+		if (! MOWGLI_LIST_LENGTH(&q->lines) && q->dropped)
+		{
+			char buf[BUFSIZE];
+
+			(void) snprintf(buf, sizeof buf, "%u log line%s not shown here (too many at once); see the log "
+			                "files", q->dropped, (q->dropped == 1) ? "" : "s");
+
+			q->dropped = 0;
+			(void) log_irc_line_add(q, buf);
+		}
+	}
+
+	log_irc_sending = false;
+
+	return (MOWGLI_LIST_LENGTH(&q->lines) || q->repeats);
+}
+
+static void log_irc_schedule(void);
+
+static void
+log_irc_flush(void ATHEME_VATTR_UNUSED *const restrict arg)
+{
+	mowgli_node_t *n;
+	bool pending = false;
+
+	log_irc_timer = NULL;
+
+	MOWGLI_ITER_FOREACH(n, log_files.head)
+	{
+		struct logfile *const lf = n->data;
+		struct log_irc_queue *const q = lf->irc_queue;
+
+		if (! q)
+			continue;
+
+		// A while without the line ends a run of repeats
+		if (! MOWGLI_LIST_LENGTH(&q->lines) && q->last_seen + LOG_IRC_PERIOD <= CURRTIME)
+			(void) log_irc_repeats_report(q);
+
+		if (log_irc_queue_run(lf))
+			pending = true;
+	}
+
+	if (pending)
+		(void) log_irc_schedule();
+}
+
+static void
+log_irc_schedule(void)
+{
+	if (! log_irc_timer)
+		log_irc_timer = timer_add_once("log_irc_flush", &log_irc_flush, NULL, 1);
+}
+
+static void
+log_irc_queue_write(struct logfile *const restrict lf, void (*const send)(struct logfile *, const char *),
+                    const char *const restrict buf)
+{
+	struct log_irc_queue *q = lf->irc_queue;
+
+	if (! q)
+	{
+		q = lf->irc_queue = smalloc(sizeof *q);
+		q->send = send;
+	}
+
+	if (q->last && strcmp(q->last, buf) == 0)
+	{
+		q->repeats++;
+		q->last_seen = CURRTIME;
+		(void) log_irc_schedule();
+		return;
+	}
+
+	(void) log_irc_repeats_report(q);
+	(void) log_irc_line_add(q, buf);
+	(void) sfree(q->last);
+
+	q->last = sstrdup(buf);
+	q->last_seen = CURRTIME;
+
+	// Lines logged while sending (by sending, even) wait for the timer
+	if (log_irc_sending || log_irc_queue_run(lf))
+		(void) log_irc_schedule();
+}
+
+static void
+logfile_send_snotice(struct logfile ATHEME_VATTR_UNUSED *const restrict lf, const char *const restrict buf)
+{
+	(void) wallops("%s", buf);
+}
+
+/*
+ * logfile_send_irc(struct logfile *lf, const char *buf)
+ *
+ * Sends a line to a log channel, from the service named at its start (or
+ * from OperServ, or any service at all).
+ */
+static void
+logfile_send_irc(struct logfile *lf, const char *buf)
+{
+	struct channel *c;
+
 	c = channel_find(lf->log_path);
 	if (c != NULL && c->flags & CHAN_LOG)
 	{
 		size_t targetlen;
 		char targetbuf[NICKLEN + 1];
 		struct service *svs = NULL;
+		const char *const sp = strchr(buf, ' ');
 
 		memset(targetbuf, '\0', sizeof targetbuf);
-		targetlen = (strchr(buf, ' ') - buf);
+		targetlen = sp ? (size_t) (sp - buf) : sizeof targetbuf;
 
 		if (targetlen < sizeof targetbuf)
 		{
@@ -282,6 +827,34 @@ logfile_write_irc(struct logfile *lf, const char *buf)
 	}
 }
 
+/*
+ * logfile_write_irc(struct logfile *lf, const char *buf)
+ *
+ * Writes an I/O stream to an IRC target.
+ *
+ * Inputs:
+ *       - struct logfile representing the I/O stream.
+ *       - data to write to the IRC target
+ *
+ * Outputs:
+ *       - none
+ *
+ * Side Effects:
+ *       - the line is queued; see log_irc_queue_write()
+ */
+static void
+logfile_write_irc(struct logfile *lf, const char *buf)
+{
+	return_if_fail(lf != NULL);
+	return_if_fail(lf->log_path != NULL);
+	return_if_fail(buf != NULL);
+
+	if (!me.connected || me.bursting)
+		return;
+
+	(void) log_irc_queue_write(lf, &logfile_send_irc, buf);
+}
+
 /*
  * logfile_write_snotices(struct logfile *lf, const char *buf)
  *
@@ -295,13 +868,11 @@ logfile_write_irc(struct logfile *lf, const char *buf)
  *       - none
  *
  * Side Effects:
- *       - none
+ *       - the line is queued; see log_irc_queue_write()
  */
 static void
 logfile_write_snotices(struct logfile *lf, const char *buf)
 {
-	struct channel *c;
-
 	return_if_fail(lf != NULL);
 	return_if_fail(lf->log_path != NULL);
 	return_if_fail(buf != NULL);
@@ -309,7 +880,40 @@ logfile_write_snotices(struct logfile *lf, const char *buf)
 	if (!me.connected || me.bursting)
 		return;
 
-	wallops("%s", buf);
+	(void) log_irc_queue_write(lf, &logfile_send_snotice, buf);
+}
+
+/*
+ * log_mask_update(void)
+ *
+ * Recomputes log_mask_active after a log file was added or removed, or its
+ * mask changed.
+ *
+ * Inputs:
+ *       - none
+ *
+ * Outputs:
+ *       - none
+ *
+ * Side Effects:
+ *       - log_mask_active is updated
+ */
+static void
+log_mask_update(void)
+{
+	mowgli_node_t *n;
+	unsigned int mask = 0;
+
+	MOWGLI_ITER_FOREACH(n, log_files.head)
+		mask |= ((struct logfile *) n->data)->log_mask;
+
+	/* without a master log file, log_write_all() still shows errors and
+	 * general info on the terminal while starting up.
+	 */
+	if (log_file == NULL)
+		mask |= LG_ERROR | LG_INFO;
+
+	log_mask_active = mask;
 }
 
 /*
@@ -330,6 +934,7 @@ void
 logfile_register(struct logfile *lf)
 {
 	mowgli_node_add(lf, &lf->node, &log_files);
+	log_mask_update();
 }
 
 /*
@@ -350,6 +955,7 @@ void
 logfile_unregister(struct logfile *lf)
 {
 	mowgli_node_delete(&lf->node, &log_files);
+	log_mask_update();
 }
 
 /*
@@ -454,6 +1060,19 @@ logfile_new(const char *path, unsigned int log_mask)
 void
 log_open(void)
 {
+	static bool hooked = false;
+
+#ifdef HAVE_USABLE_PTHREAD
+	log_main_thread = pthread_self();
+	log_main_thread_known = true;
+#endif
+
+	if (!hooked)
+	{
+		hook_add_config_ready(logfile_index_update);
+		hooked = true;
+	}
+
 	log_file = logfile_new(log_path, LG_ERROR | LG_INFO | LG_CMD_ADMIN);
 }
 
@@ -476,6 +1095,13 @@ log_shutdown(void)
 {
 	mowgli_node_t *n, *tn;
 
+#ifdef HAVE_USABLE_PTHREAD
+	// Everything queued is written out before the files are closed
+	(void) log_writer_stop();
+
+	log_writer_failed = false;
+#endif
+
 	MOWGLI_ITER_FOREACH_SAFE(n, tn, log_files.head)
 		atheme_object_unref(n->data);
 }
@@ -532,6 +1158,7 @@ log_master_set_mask(unsigned int mask)
 	if (log_file == NULL)
 		return;
 	log_file->log_mask = mask;
+	log_mask_update();
 }
 
 /*
@@ -575,21 +1202,14 @@ logfile_find_mask(unsigned int log_mask)
 	return NULL;
 }
 
-static void ATHEME_FATTR_PRINTF(3, 0)
-vslog_ext(enum log_type type, unsigned int level, const char *fmt, va_list args)
+static void
+log_write_all(enum log_type type, unsigned int level, const char *buf)
 {
-	static bool in_vslog_ext = false;
-
-	// Detect infinite logging recursion
-	if (in_vslog_ext)
-		return;
-
-	in_vslog_ext = true;
-
-	char buf[BUFSIZE];
-	(void) vsnprintf(buf, sizeof buf, fmt, args);
-
 	const mowgli_node_t *n;
+
+#ifdef HAVE_USABLE_PTHREAD
+	log_write_level = level;
+#endif
 	MOWGLI_ITER_FOREACH(n, log_files.head)
 	{
 		struct logfile *const lf = n->data;
@@ -619,6 +1239,84 @@ vslog_ext(enum log_type type, unsigned int level, const char *fmt, va_list args)
 		(void) strftime(datetime, sizeof datetime, "[%Y-%m-%d %H:%M:%S]", tm);
 		(void) fprintf(stderr, "%s %s\n", datetime, logfile_strip_control_codes(buf));
 	}
+}
+
+/*
+ * log_flush_deferred(void)
+ *
+ * Writes out messages that other threads have logged since the last call.
+ * Must only be called from the main thread.
+ */
+void
+log_flush_deferred(void)
+{
+#ifdef HAVE_USABLE_PTHREAD
+	(void) pthread_mutex_lock(&log_deferred_lock);
+
+	struct log_deferred *ld = log_deferred_head;
+
+	log_deferred_head = NULL;
+	log_deferred_tail = &log_deferred_head;
+
+	(void) pthread_mutex_unlock(&log_deferred_lock);
+
+	while (ld != NULL)
+	{
+		struct log_deferred *const next = ld->next;
+
+		(void) log_write_all(ld->type, ld->level, ld->buf);
+		(void) sfree(ld);
+
+		ld = next;
+	}
+#endif /* HAVE_USABLE_PTHREAD */
+}
+
+static void ATHEME_FATTR_PRINTF(3, 0)
+vslog_ext(enum log_type type, unsigned int level, const char *fmt, va_list args)
+{
+	static bool in_vslog_ext = false;
+
+	char buf[BUFSIZE];
+
+	// Nobody would write it out; don't bother formatting it
+	if (! slog_enabled(level))
+		return;
+
+#ifdef HAVE_USABLE_PTHREAD
+	if (log_main_thread_known && ! pthread_equal(pthread_self(), log_main_thread))
+	{
+		const int len = vsnprintf(buf, sizeof buf, fmt, args);
+
+		if (len < 0)
+			return;
+
+		const size_t buflen = (((size_t) len < sizeof buf) ? (size_t) len : (sizeof buf - 1)) + 1;
+		struct log_deferred *const ld = smalloc(sizeof *ld + buflen);
+
+		ld->type = type;
+		ld->level = level;
+		(void) memcpy(ld->buf, buf, buflen);
+
+		(void) pthread_mutex_lock(&log_deferred_lock);
+		*log_deferred_tail = ld;
+		log_deferred_tail = &ld->next;
+		(void) pthread_mutex_unlock(&log_deferred_lock);
+		return;
+	}
+#endif /* HAVE_USABLE_PTHREAD */
+
+	// Detect infinite logging recursion
+	if (in_vslog_ext)
+		return;
+
+	in_vslog_ext = true;
+
+	// Keep messages from other threads in order with this one
+	(void) log_flush_deferred();
+
+	(void) vsnprintf(buf, sizeof buf, fmt, args);
+	(void) log_write_all(type, level, buf);
 
 	in_vslog_ext = false;
 }
@@ -742,6 +1440,9 @@ logcommand(struct sourceinfo *si, int level, const char *fmt, ...)
 	va_list args;
 	char lbuf[BUFSIZE];
 
+	if (! slog_enabled(level))
+		return;
+
 	va_start(args, fmt);
 	vsnprintf(lbuf, BUFSIZE, fmt, args);
 	va_end(args);
@@ -779,6 +1480,9 @@ logcommand_user(struct service *svs, struct user *source, int level, const char
 	va_list args;
 	char lbuf[BUFSIZE];
 
+	if (! slog_enabled(level))
+		return;
+
 	va_start(args, fmt);
 	vsnprintf(lbuf, BUFSIZE, fmt, args);
 	va_end(args);
@@ -821,6 +1525,9 @@ logcommand_external(struct service *svs, const char *type, struct connection *so
 	va_list args;
 	char lbuf[BUFSIZE];
 
+	if (! slog_enabled(level))
+		return;
+
 	va_start(args, fmt);
 	vsnprintf(lbuf, BUFSIZE, fmt, args);
 	va_end(args);
@@ -0,0 +1,918 @@
+/*
+ * SPDX-License-Identifier: ISC
+ * SPDX-URL: https://spdx.org/licenses/ISC.html
+ *
+ * Copyright (C) 2026 Atheme Development Group (https://atheme.github.io/)
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * atheme-services: A collection of minimalist IRC services
+ * logindex.c: Word indexes of the log files, for searching them.
+ *
+ * With general::log_index, every line written to a command or registration
+ * log file has its words casefolded and noted, along with where the line
+ * starts, in an index kept next to the struct logfile. A search for a
+ * pattern then only has to read the lines containing a word that contains
+ * the pattern's longest literal run, instead of the whole file.
+ *
+ * Log files are reopened on every rehash, so an index is handed over to the
+ * new struct logfile for the same file (same device and inode); whatever
+ * was written in between is read back in. Indexes nobody picked up (the
+ * file was rotated, or is no longer logged to) are saved next to the log
+ * file as <log file>.<inode>.idx, where searches of the rotated copies find
+ * them again by the inode of the copy.
+ */
+
+#include <atheme.h>
+#include "internal.h"
+
+#define LOG_INDEX_MASK          (LG_CMD_ALL | LG_REGISTER)
+#define LOG_INDEX_MAGIC         "atheme-log-index 1"
+#define LOG_INDEX_STAMP_LEN     21U                     // "[YYYY-mm-dd HH:MM:SS]"
+#define LOG_INDEX_OFFSETS_MAX   (16U * 1024U * 1024U)   // Per file; lines past that are left uncovered
+#define LOG_INDEX_CATCHUP_MAX   (16U * 1024U * 1024U)   // Bytes written unindexed that are read back in
+
+struct log_index_word
+{
+	uint32_t *              offsets;        // Relative to the start of the index, ascending
+	uint32_t                count;
+	uint32_t                alloc;
+};
+
+struct log_index
+{
+	mowgli_node_t           node;
+	struct logfile *        owner;          // NULL once its struct logfile is gone
+	char *                  base;           // Path of the log file it was written to
+	dev_t                   dev;
+	ino_t                   ino;
+	uint64_t                start;          // First byte covered
+	uint64_t                end;            // First byte not covered
+	uint64_t                pos;            // Where the next line will be written
+	char                    stamp[LOG_INDEX_STAMP_LEN + 1];    // How the line at start begins
+	mowgli_patricia_t *     words;
+	size_t                  noffsets;
+};
+
+struct log_index_header
+{
+	uintmax_t               dev;
+	uintmax_t               ino;
+	uint64_t                start;
+	uint64_t                end;
+	char                    stamp[LOG_INDEX_STAMP_LEN + 1];
+};
+
+// Gathers the offsets of every word containing the key
+struct log_index_search
+{
+	const char *            key;
+	uint32_t                limit;          // end - start; larger offsets are bogus
+	uint32_t *              offsets;
+	size_t                  count;
+	size_t                  alloc;
+};
+
+typedef bool (*log_index_word_fn)(const char *word, void *priv);
+typedef void (*log_index_offset_fn)(uint32_t rel, void *priv);
+
+static mowgli_list_t log_indexes = { NULL, NULL, 0 };
+
+/* A casefolding that is never finer than match()'s under either mapping, so a
+ * key folded with it is found in any word that match() would have matched.
+ */
+static inline unsigned char
+log_index_fold(const unsigned char c)
+{
+	return ToLowerTab[(unsigned char) tolower(c)];
+}
+
+static void
+log_index_path(const char *const restrict base, const uintmax_t ino, char *const restrict buf, const size_t bufsz)
+{
+	(void) snprintf(buf, bufsz, "%s.%ju.idx", base, ino);
+}
+
+static void
+log_index_word_free(const char ATHEME_VATTR_UNUSED *const restrict key, void *const restrict data,
+                    void ATHEME_VATTR_UNUSED *const restrict privdata)
+{
+	struct log_index_word *const w = data;
+
+	(void) sfree(w->offsets);
+	(void) sfree(w);
+}
+
+static struct log_index *
+log_index_create(const char *const restrict base, const struct stat *const restrict sb)
+{
+	struct log_index *const idx = smalloc(sizeof *idx);
+
+	idx->base = sstrdup(base);
+	idx->dev = sb->st_dev;
+	idx->ino = sb->st_ino;
+	idx->start = idx->end = idx->pos = (uint64_t) sb->st_size;
+	idx->words = mowgli_patricia_create(NULL);
+
+	(void) mowgli_node_add(idx, &idx->node, &log_indexes);
+
+	return idx;
+}
+
+static void
+log_index_free(struct log_index *const restrict idx)
+{
+	(void) mowgli_node_delete(&idx->node, &log_indexes);
+	(void) mowgli_patricia_destroy(idx->words, &log_index_word_free, NULL);
+	(void) sfree(idx->base);
+	(void) sfree(idx);
+}
+
+// Throws everything away and starts over from the current end of the file
+static void
+log_index_reset(struct log_index *const restrict idx, const uint64_t size)
+{
+	(void) mowgli_patricia_destroy(idx->words, &log_index_word_free, NULL);
+
+	idx->words = mowgli_patricia_create(NULL);
+	idx->start = idx->end = idx->pos = size;
+	idx->stamp[0] = '\0';
+	idx->noffsets = 0;
+}
+
+static void
+log_index_add_word(struct log_index *const restrict idx, const char *const restrict word, const uint32_t rel)
+{
+	struct log_index_word *w = mowgli_patricia_retrieve(idx->words, word);
+
+	if (! w)
+	{
+		w = smalloc(sizeof *w);
+		(void) mowgli_patricia_add(idx->words, word, w);
+	}
+	else if (w->count && w->offsets[w->count - 1U] == rel)
+		// Already noted for this line
+		return;
+
+	if (w->count == w->alloc)
+	{
+		w->alloc = w->alloc ? (w->alloc * 2U) : 4U;
+		w->offsets = sreallocarray(w->offsets, w->alloc, sizeof *w->offsets);
+	}
+
+	w->offsets[w->count++] = rel;
+	idx->noffsets++;
+}
+
+/* Notes the words of the line of len bytes at pos, whose message (the part
+ * after the timestamp) is text. Lines only ever extend the covered range; once
+ * one could not be added, the rest of the file is left uncovered.
+ */
+static void
+log_index_add_line(struct log_index *const restrict idx, const char *const restrict text, const size_t len)
+{
+	if (idx->end != idx->pos || idx->pos - idx->start > UINT32_MAX || idx->noffsets >= LOG_INDEX_OFFSETS_MAX)
+	{
+		idx->pos += len;
+		return;
+	}
+
+	const uint32_t rel = (uint32_t) (idx->pos - idx->start);
+	const unsigned char *p = (const unsigned char *) text;
+	char word[BUFSIZE];
+
+	while (*p)
+	{
+		size_t wlen = 0;
+
+		while (*p == ' ')
+			p++;
+
+		while (*p && *p != ' ' && *p != '\n')
+		{
+			if (wlen < sizeof word - 1U)
+				word[wlen++] = (char) log_index_fold(*p);
+
+			p++;
+		}
+
+		if (*p == '\n')
+			p++;
+
+		if (wlen < LOG_INDEX_KEY_MIN)
+			continue;
+
+		word[wlen] = '\0';
+		(void) log_index_add_word(idx, word, rel);
+	}
+
+	idx->pos += len;
+	idx->end = idx->pos;
+}
+
+// The message of a line read back from a log file, or NULL if it doesn't look like one
+static const char *
+log_index_line_message(const char *const restrict line)
+{
+	if (line[0] != '[' || strlen(line) < LOG_INDEX_STAMP_LEN + 1U || line[LOG_INDEX_STAMP_LEN - 1U] != ']')
+		return NULL;
+
+	return line + LOG_INDEX_STAMP_LEN + 1U;
+}
+
+/* Indexes what was written to the file after idx->pos without going through
+ * log_index_line(), up to size.
+ */
+static void
+log_index_catch_up(struct log_index *const restrict idx, const char *const restrict path, const uint64_t size)
+{
+	if (idx->end != idx->pos)
+	{
+		// Nothing past end is covered anyway
+		idx->pos = size;
+		return;
+	}
+
+	FILE *const fp = fopen(path, "r");
+
+	if (! fp || fseeko(fp, (off_t) idx->pos, SEEK_SET) != 0)
+	{
+		if (fp)
+			(void) fclose(fp);
+
+		(void) log_index_reset(idx, size);
+		return;
+	}
+
+	char line[BUFSIZE * 2];
+
+	while (idx->pos < size && fgets(line, sizeof line, fp) != NULL)
+	{
+		size_t len = strlen(line);
+		bool whole = (len && line[len - 1U] == '\n');
+
+		// A line too long for the buffer; only its beginning is indexed, but all of it counts
+		while (! whole)
+		{
+			char rest[BUFSIZE];
+
+			if (fgets(rest, sizeof rest, fp) == NULL)
+				break;
+
+			const size_t restlen = strlen(rest);
+
+			len += restlen;
+			whole = (restlen && rest[restlen - 1U] == '\n');
+		}
+
+		if (idx->start == idx->end && idx->end == idx->pos)
+		{
+			if (len <= LOG_INDEX_STAMP_LEN)
+			{
+				idx->start = idx->end = idx->pos = idx->pos + len;
+				continue;
+			}
+
+			(void) memcpy(idx->stamp, line, LOG_INDEX_STAMP_LEN);
+			idx->stamp[LOG_INDEX_STAMP_LEN] = '\0';
+		}
+
+		// Garbage matches nothing, so it is covered without any words
+		const char *const text = log_index_line_message(line);
+
+		(void) log_index_add_line(idx, text ? text : "", len);
+	}
+
+	(void) fclose(fp);
+
+	if (idx->pos != size)
+		(void) log_index_reset(idx, size);
+}
+
+static bool
+log_index_read_header(FILE *const restrict fp, struct log_index_header *const restrict hdr)
+{
+	char line[BUFSIZE];
+	int n = 0;
+
+	if (fgets(line, sizeof line, fp) == NULL)
+		return false;
+
+	if (sscanf(line, LOG_INDEX_MAGIC " %ju %ju %" SCNu64 " %" SCNu64 " %n", &hdr->dev, &hdr->ino, &hdr->start,
+	           &hdr->end, &n) != 4 || n <= 0)
+		return false;
+
+	if (strlen(line + n) < LOG_INDEX_STAMP_LEN || hdr->start >= hdr->end || hdr->end - hdr->start > UINT32_MAX)
+		return false;
+
+	(void) memcpy(hdr->stamp, line + n, LOG_INDEX_STAMP_LEN);
+	hdr->stamp[LOG_INDEX_STAMP_LEN] = '\0';
+
+	return true;
+}
+
+// Whether the line at start of the (readable) log file begins as the index says
+static bool
+log_index_check_stamp(FILE *const restrict fp, const struct log_index_header *const restrict hdr)
+{
+	char stamp[LOG_INDEX_STAMP_LEN];
+
+	if (fseeko(fp, (off_t) hdr->start, SEEK_SET) != 0 || fread(stamp, 1, sizeof stamp, fp) != sizeof stamp)
+		return false;
+
+	return memcmp(stamp, hdr->stamp, sizeof stamp) == 0;
+}
+
+/* Walks the words of a saved index, after the header. Each line is a word
+ * followed by the offsets of the lines it is in, each one given as the
+ * difference to the previous one; word_fn decides whether offset_fn gets to
+ * see them. Returns false if the file is truncated or garbled.
+ */
+static bool
+log_index_read_words(FILE *const restrict fp, const log_index_word_fn word_fn, const log_index_offset_fn offset_fn,
+                     void *const restrict priv)
+{
+	char word[BUFSIZE];
+	int c;
+
+	for (;;)
+	{
+		size_t wlen = 0;
+
+		while ((c = getc(fp)) != EOF && c != ' ' && c != '\n')
+			if (wlen < sizeof word - 1U)
+				word[wlen++] = (char) c;
+
+		if (c == EOF && ! wlen)
+			return true;
+
+		if (c != ' ' || ! wlen)
+			return false;
+
+		word[wlen] = '\0';
+
+		if (! word_fn(word, priv))
+		{
+			while ((c = getc(fp)) != EOF && c != '\n')
+				continue;
+
+			if (c == EOF)
+				return false;
+
+			continue;
+		}
+
+		uint64_t rel = 0;
+		uint64_t delta = 0;
+		bool digits = false;
+
+		while ((c = getc(fp)) != EOF)
+		{
+			if (c >= '0' && c <= '9')
+			{
+				delta = (delta * 10U) + (uint64_t) (c - '0');
+				digits = true;
+
+				if (delta > UINT32_MAX)
+					return false;
+
+				continue;
+			}
+
+			if ((c != ' ' && c != '\n') || ! digits)
+				return false;
+
+			rel += delta;
+
+			if (rel > UINT32_MAX)
+				return false;
+
+			offset_fn((uint32_t) rel, priv);
+
+			delta = 0;
+			digits = false;
+
+			if (c == '\n')
+				break;
+		}
+
+		if (c == EOF)
+			return false;
+	}
+}
+
+struct log_index_loader
+{
+	struct log_index *      idx;
+	const char *            word;
+};
+
+static bool
+log_index_load_word(const char *const restrict word, void *const restrict priv)
+{
+	struct log_index_loader *const loader = priv;
+
+	loader->word = word;
+	return true;
+}
+
+static void
+log_index_load_offset(const uint32_t rel, void *const restrict priv)
+{
+	struct log_index_loader *const loader = priv;
+
+	(void) log_index_add_word(loader->idx, loader->word, rel);
+}
+
+// Picks a saved index for the log file back up, if it still fits it
+static struct log_index *
+log_index_load(const char *const restrict base, const struct stat *const restrict sb)
+{
+	char path[BUFSIZE];
+
+	(void) log_index_path(base, (uintmax_t) sb->st_ino, path, sizeof path);
+
+	FILE *const fp = fopen(path, "r");
+
+	if (! fp)
+		return NULL;
+
+	FILE *const data = fopen(base, "r");
+	struct log_index_header hdr;
+	struct log_index *idx = NULL;
+
+	if (data && log_index_read_header(fp, &hdr) && hdr.dev == (uintmax_t) sb->st_dev &&
+	    hdr.ino == (uintmax_t) sb->st_ino && hdr.end <= (uint64_t) sb->st_size && log_index_check_stamp(data, &hdr))
+	{
+		idx = log_index_create(base, sb);
+		idx->start = hdr.start;
+		idx->end = idx->pos = hdr.end;
+		(void) mowgli_strlcpy(idx->stamp, hdr.stamp, sizeof idx->stamp);
+
+		struct log_index_loader loader = { .idx = idx };
+
+		if (! log_index_read_words(fp, &log_index_load_word, &log_index_load_offset, &loader))
+		{
+			(void) slog(LG_ERROR, "%s: %s is corrupt, ignoring it", MOWGLI_FUNC_NAME, path);
+			(void) log_index_reset(idx, (uint64_t) sb->st_size);
+		}
+	}
+
+	if (data)
+		(void) fclose(data);
+
+	(void) fclose(fp);
+
+	/* The file now belongs to this index again, and the copy on disk will
+	 * be out of date as soon as anything is logged.
+	 */
+	if (idx)
+		(void) unlink(path);
+
+	return idx;
+}
+
+static int
+log_index_save_word(const char *const restrict key, void *const restrict data, void *const restrict privdata)
+{
+	const struct log_index_word *const w = data;
+	FILE *const fp = privdata;
+	uint32_t prev = 0;
+
+	(void) fputs(key, fp);
+
+	for (uint32_t i = 0; i < w->count; i++)
+	{
+		(void) fprintf(fp, " %" PRIu32, w->offsets[i] - prev);
+		prev = w->offsets[i];
+	}
+
+	(void) fputc('\n', fp);
+	return 0;
+}
+
+static void
+log_index_save(const struct log_index *const restrict idx)
+{
+	char path[BUFSIZE];
+	char tmppath[BUFSIZE];
+
+	(void) log_index_path(idx->base, (uintmax_t) idx->ino, path, sizeof path);
+
+	const int ret = snprintf(tmppath, sizeof tmppath, "%s.new", path);
+
+	if (ret < 0 || (size_t) ret >= sizeof tmppath)
+	{
+		(void) slog(LG_ERROR, "%s: the path of the index for %s is too long", MOWGLI_FUNC_NAME, idx->base);
+		return;
+	}
+
+	FILE *const fp = fopen(tmppath, "w");
+
+	if (! fp)
+	{
+		(void) slog(LG_ERROR, "%s: fopen(%s): %s", MOWGLI_FUNC_NAME, tmppath, strerror(errno));
+		return;
+	}
+
+	(void) fprintf(fp, LOG_INDEX_MAGIC " %ju %ju %" PRIu64 " %" PRIu64 " %s\n", (uintmax_t) idx->dev,
+	               (uintmax_t) idx->ino, idx->start, idx->end, idx->stamp);
+
+	(void) mowgli_patricia_foreach(idx->words, &log_index_save_word, fp);
+
+	if (ferror(fp) | fclose(fp))
+	{
+		(void) slog(LG_ERROR, "%s: failed to write out %s", MOWGLI_FUNC_NAME, tmppath);
+		(void) unlink(tmppath);
+		return;
+	}
+
+	if (rename(tmppath, path) != 0)
+	{
+		(void) slog(LG_ERROR, "%s: rename(%s, %s): %s", MOWGLI_FUNC_NAME, tmppath, path, strerror(errno));
+		(void) unlink(tmppath);
+	}
+}
+
+/*
+ * log_index_update(struct logfile *lf)
+ *
+ * Gives a log file an index, or takes it away, according to the current
+ * configuration. Called for every log file once the configuration has been
+ * (re)loaded.
+ */
+void
+log_index_update(struct logfile *const restrict lf)
+{
+	return_if_fail(lf != NULL);
+
+	if (! config_options.log_index || lf->log_type != LOG_NONINTERACTIVE || ! (lf->log_mask & LOG_INDEX_MASK))
+	{
+		(void) log_index_detach(lf);
+		return;
+	}
+
+	if (lf->index)
+		return;
+
+	// Anything still queued has to be in the file before it is looked at
+	(void) log_writer_drain();
+
+	struct stat sb;
+
+	if (fstat(fileno((FILE *) lf->log_file), &sb) != 0)
+		return;
+
+	struct log_index *idx = NULL;
+	mowgli_node_t *n;
+
+	MOWGLI_ITER_FOREACH(n, log_indexes.head)
+	{
+		struct log_index *const cand = n->data;
+
+		if (cand->dev != sb.st_dev || cand->ino != sb.st_ino)
+			continue;
+
+		// Two logfile blocks for the same file; offsets would be anybody's guess
+		if (cand->owner)
+			return;
+
+		idx = cand;
+		break;
+	}
+
+	if (! idx)
+		idx = log_index_load(lf->log_path, &sb);
+
+	if (! idx)
+		idx = log_index_create(lf->log_path, &sb);
+
+	if (strcmp(idx->base, lf->log_path) != 0)
+	{
+		(void) sfree(idx->base);
+		idx->base = sstrdup(lf->log_path);
+	}
+
+	const uint64_t size = (uint64_t) sb.st_size;
+
+	if (idx->pos > size || size - idx->pos > LOG_INDEX_CATCHUP_MAX)
+		(void) log_index_reset(idx, size);
+	else if (idx->pos < size)
+		(void) log_index_catch_up(idx, lf->log_path, size);
+
+	idx->owner = lf;
+	lf->index = idx;
+}
+
+/*
+ * log_index_detach(struct logfile *lf)
+ *
+ * Takes a log file's index away from it (it is going away, or shouldn't be
+ * indexed any more). The index is kept around until log_index_sweep(), in
+ * case a new struct logfile for the same file turns up by then.
+ */
+void
+log_index_detach(struct logfile *const restrict lf)
+{
+	return_if_fail(lf != NULL);
+
+	if (! lf->index)
+		return;
+
+	lf->index->owner = NULL;
+	lf->index = NULL;
+}
+
+/*
+ * log_index_sweep(void)
+ *
+ * Saves (if they cover anything) and frees the indexes that no log file has
+ * picked up again.
+ */
+void
+log_index_sweep(void)
+{
+	mowgli_node_t *n, *tn;
+
+	MOWGLI_ITER_FOREACH_SAFE(n, tn, log_indexes.head)
+	{
+		struct log_index *const idx = n->data;
+
+		if (idx->owner)
+			continue;
+
+		if (idx->end > idx->start && idx->stamp[0])
+			(void) log_index_save(idx);
+
+		(void) log_index_free(idx);
+	}
+}
+
+/*
+ * log_index_line(struct logfile *lf, const char *datetime, const char *buf, size_t len)
+ *
+ * Notes a line just written (or queued for the writer thread) to a log file:
+ * the timestamp and message it was made of, and its length in bytes as it
+ * will be in the file, or 0 if nothing was written after all.
+ */
+void
+log_index_line(struct logfile *const restrict lf, const char *const restrict datetime,
+               const char *const restrict buf, const size_t len)
+{
+	struct log_index *const idx = lf->index;
+
+	if (! idx || ! len)
+		return;
+
+	if (idx->start == idx->end && idx->end == idx->pos)
+	{
+		if (strlen(datetime) != LOG_INDEX_STAMP_LEN)
+		{
+			// Can't be told apart from a different file later on
+			idx->start = idx->end = idx->pos = idx->pos + len;
+			return;
+		}
+
+		(void) mowgli_strlcpy(idx->stamp, datetime, sizeof idx->stamp);
+	}
+
+	(void) log_index_add_line(idx, buf, len);
+}
+
+/*
+ * log_index_key()
+ *
+ * Returns the key to look a match() pattern up with, see logindex.h.
+ */
+bool
+log_index_key(const char *const restrict pattern, char *const restrict key, const size_t keysz)
+{
+	return_val_if_fail(pattern != NULL, false);
+	return_val_if_fail(key != NULL, false);
+
+	struct match_pattern *const mp = match_compile(pattern);
+
+	if (! mp)
+		return false;
+
+	const char *const runs[] = { mp->prefix, mp->inner, mp->suffix };
+	size_t best = 0;
+
+	for (size_t i = 0; i < ARRAY_SIZE(runs); i++)
+	{
+		const char *p = runs[i];
+
+		while (p && *p)
+		{
+			const size_t len = strcspn(p, " ");
+
+			if (len > best && len < keysz)
+			{
+				for (size_t j = 0; j < len; j++)
+					key[j] = (char) log_index_fold((const unsigned char) p[j]);
+
+				key[len] = '\0';
+				best = len;
+			}
+
+			p += len;
+
+			while (*p == ' ')
+				p++;
+		}
+	}
+
+	(void) match_pattern_free(mp);
+
+	return best >= LOG_INDEX_KEY_MIN;
+}
+
+static void
+log_index_search_add(struct log_index_search *const restrict search, const uint32_t rel)
+{
+	if (rel >= search->limit)
+		return;
+
+	if (search->count == search->alloc)
+	{
+		search->alloc = search->alloc ? (search->alloc * 2U) : 64U;
+		search->offsets = sreallocarray(search->offsets, search->alloc, sizeof *search->offsets);
+	}
+
+	search->offsets[search->count++] = rel;
+}
+
+static int
+log_index_search_cmp(const void *const restrict a, const void *const restrict b)
+{
+	const uint32_t x = *((const uint32_t *) a);
+	const uint32_t y = *((const uint32_t *) b);
+
+	return (x > y) - (x < y);
+}
+
+// Turns the offsets gathered into the plan for [start, end)
+static void
+log_index_search_finish(struct log_index_search *const restrict search, const uint64_t start, const uint64_t end,
+                        struct log_index_plan *const restrict plan)
+{
+	plan->indexed = true;
+	plan->start = start;
+	plan->end = end;
+
+	if (! search->count)
+		return;
+
+	(void) qsort(search->offsets, search->count, sizeof *search->offsets, &log_index_search_cmp);
+
+	plan->offsets = smalloc(search->count * sizeof *plan->offsets);
+
+	for (size_t i = 0; i < search->count; i++)
+		if (! i || search->offsets[i] != search->offsets[i - 1U])
+			plan->offsets[plan->count++] = start + search->offsets[i];
+
+	(void) sfree(search->offsets);
+}
+
+static int
+log_index_search_live(const char *const restrict word, void *const restrict data, void *const restrict privdata)
+{
+	const struct log_index_word *const w = data;
+	struct log_index_search *const search = privdata;
+
+	if (strstr(word, search->key) == NULL)
+		return 0;
+
+	for (uint32_t i = 0; i < w->count; i++)
+		(void) log_index_search_add(search, w->offsets[i]);
+
+	return 0;
+}
+
+/*
+ * log_index_plan_live()
+ *
+ * Works out which lines of the file lf writes to need to be read for a key
+ * (see logindex.h). Everything queued for the writer thread is written out
+ * first, so that the index and the file agree.
+ */
+void
+log_index_plan_live(struct logfile *const restrict lf, const char *const restrict key,
+                    struct log_index_plan *const restrict plan)
+{
+	(void) memset(plan, 0x00, sizeof *plan);
+
+	return_if_fail(lf != NULL);
+	return_if_fail(key != NULL);
+
+	struct log_index *const idx = lf->index;
+
+	if (! idx || lf->log_type != LOG_NONINTERACTIVE)
+		return;
+
+	(void) log_writer_drain();
+
+	struct stat fsb;
+	struct stat psb;
+
+	if (fstat(fileno((FILE *) lf->log_file), &fsb) != 0)
+		return;
+
+	// Somebody moved the file away without telling us to reopen it
+	if (stat(lf->log_path, &psb) != 0 || psb.st_dev != fsb.st_dev || psb.st_ino != fsb.st_ino)
+		return;
+
+	if ((uint64_t) fsb.st_size != idx->pos)
+	{
+		(void) slog(LG_DEBUG, "%s: index of %s is out of step with it, starting over", MOWGLI_FUNC_NAME,
+		            lf->log_path);
+		(void) log_index_reset(idx, (uint64_t) fsb.st_size);
+		return;
+	}
+
+	struct log_index_search search = {
+		.key    = key,
+		.limit  = (uint32_t) (idx->end - idx->start),
+	};
+
+	(void) mowgli_patricia_foreach(idx->words, &log_index_search_live, &search);
+	(void) log_index_search_finish(&search, idx->start, idx->end, plan);
+}
+
+static bool
+log_index_search_word(const char *const restrict word, void *const restrict priv)
+{
+	const struct log_index_search *const search = priv;
+
+	return strstr(word, search->key) != NULL;
+}
+
+static void
+log_index_search_offset(const uint32_t rel, void *const restrict priv)
+{
+	(void) log_index_search_add(priv, rel);
+}
+
+/*
+ * log_index_plan_file()
+ *
+ * Like log_index_plan_live(), for a rotated copy (path) of the log file base,
+ * from the index saved when it was rotated. Thread-safe.
+ */
+void
+log_index_plan_file(const char *const restrict base, const char *const restrict path, const char *const restrict key,
+                    struct log_index_plan *const restrict plan)
+{
+	(void) memset(plan, 0x00, sizeof *plan);
+
+	return_if_fail(base != NULL);
+	return_if_fail(path != NULL);
+	return_if_fail(key != NULL);
+
+	FILE *const data = fopen(path, "r");
+
+	if (! data)
+		return;
+
+	struct stat sb;
+	char idxpath[BUFSIZE];
+	FILE *fp = NULL;
+
+	if (fstat(fileno(data), &sb) == 0)
+	{
+		(void) log_index_path(base, (uintmax_t) sb.st_ino, idxpath, sizeof idxpath);
+		fp = fopen(idxpath, "r");
+	}
+
+	struct log_index_header hdr;
+
+	if (fp && log_index_read_header(fp, &hdr) && hdr.dev == (uintmax_t) sb.st_dev &&
+	    hdr.ino == (uintmax_t) sb.st_ino && hdr.end <= (uint64_t) sb.st_size && log_index_check_stamp(data, &hdr))
+	{
+		struct log_index_search search = {
+			.key    = key,
+			.limit  = (uint32_t) (hdr.end - hdr.start),
+		};
+
+		if (log_index_read_words(fp, &log_index_search_word, &log_index_search_offset, &search))
+			(void) log_index_search_finish(&search, hdr.start, hdr.end, plan);
+		else
+			(void) sfree(search.offsets);
+	}
+
+	if (fp)
+		(void) fclose(fp);
+
+	(void) fclose(data);
+}
+
+void
+log_index_plan_free(struct log_index_plan *const restrict plan)
+{
+	return_if_fail(plan != NULL);
+
+	(void) sfree(plan->offsets);
+	(void) memset(plan, 0x00, sizeof *plan);
+}
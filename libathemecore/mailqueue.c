@@ -0,0 +1,666 @@
+/*
+ * SPDX-License-Identifier: ISC
+ * SPDX-URL: https://spdx.org/licenses/ISC.html
+ *
+ * Copyright (C) 2026 Atheme Development Group (https://atheme.github.io/)
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * atheme-services: A collection of minimalist IRC services
+ * mailqueue.c: Outgoing email queue and SMTP/LMTP client.
+ *
+ * Messages are kept in memory, already dot-stuffed and with CRLF line
+ * endings, and sent over one connection to the relay that stays open while
+ * there is mail and for a while after. Every command sent is noted in a
+ * ring of the replies we still expect, so that with PIPELINING the envelope
+ * of a message goes out in one write, and the next envelope follows its
+ * predecessor's body without waiting for the reply to it. A message that
+ * meets a temporary failure, or whose connection goes away, waits a while
+ * longer each time before it is tried again; a permanent failure drops it.
+ * Whatever is still queued at shutdown is lost.
+ */
+
+#include <atheme.h>
+#include "internal.h"
+
+#define MQ_MAX_QUEUED           4096U
+#define MQ_EXPECT_MAX           16U
+#define MQ_MAX_ATTEMPTS         8U
+#define MQ_RETRY_MIN            30U
+#define MQ_RETRY_MAX            SECONDS_PER_HOUR
+#define MQ_REPLY_TIMEOUT        120
+#define MQ_IDLE_TIMEOUT         60
+#define MQ_WATCHDOG_PERIOD      15
+
+enum mq_state
+{
+	MQ_DISCONNECTED = 0,
+	MQ_CONNECTING,
+	MQ_GREETING,
+	MQ_HELLO,
+	MQ_READY,
+	MQ_QUITTING,
+};
+
+enum mq_reply
+{
+	MQ_R_GREETING = 0,
+	MQ_R_HELLO,
+	MQ_R_MAIL,
+	MQ_R_RCPT,
+	MQ_R_DATA,
+	MQ_R_DOT,
+	MQ_R_RSET,
+	MQ_R_QUIT,
+};
+
+struct mq_msg
+{
+	mowgli_node_t           node;
+	char *                  sender;
+	char *                  rcpt;
+	char *                  data;           // dot-stuffed, CRLF, ending in ".\r\n"
+	size_t                  len;
+	time_t                  next_try;
+	unsigned int            attempts;
+	unsigned int            failcode;       // first failed reply of this attempt, when pipelining
+};
+
+struct mq_expect
+{
+	enum mq_reply           kind;
+	struct mq_msg *         qm;
+};
+
+struct mailqueue_stats mailqueue_stats;
+
+static mowgli_list_t mq_waiting = { NULL, NULL, 0 };
+
+static struct connection *mq_conn = NULL;
+static enum mq_state mq_state = MQ_DISCONNECTED;
+static char *mq_conn_host = NULL;               // where mq_conn goes, to notice a rehash
+static unsigned int mq_conn_port = 0;
+static bool mq_pipelining = false;
+static bool mq_tried_helo = false;
+static time_t mq_last_activity = 0;
+static time_t mq_retry_at = 0;
+static unsigned int mq_conn_failures = 0;
+
+// The message whose envelope has been sent but whose DATA has not been answered
+static struct mq_msg *mq_current = NULL;
+
+static struct mq_expect mq_expect[MQ_EXPECT_MAX];
+static unsigned int mq_expect_head = 0;
+static unsigned int mq_expect_count = 0;
+
+static mowgli_eventloop_timer_t *mq_kick_timer = NULL;
+
+static void mq_pump(void);
+
+static unsigned int
+mq_backoff(const unsigned int attempts)
+{
+	unsigned int delay = MQ_RETRY_MIN;
+
+	for (unsigned int i = 1; i < attempts && delay < MQ_RETRY_MAX; i++)
+		delay *= 2;
+
+	return (delay < MQ_RETRY_MAX) ? delay : MQ_RETRY_MAX;
+}
+
+static void
+mq_msg_free(struct mq_msg *const restrict qm)
+{
+	mailqueue_stats.queued--;
+
+	sfree(qm->sender);
+	sfree(qm->rcpt);
+	sfree(qm->data);
+	sfree(qm);
+}
+
+static void
+mq_defer(struct mq_msg *const restrict qm, const char *const restrict why)
+{
+	if (++qm->attempts >= MQ_MAX_ATTEMPTS)
+	{
+		slog(LG_ERROR, "mailqueue: giving up on email to %s after %u attempts: %s", qm->rcpt, qm->attempts,
+		     why);
+
+		mailqueue_stats.failed++;
+		mq_msg_free(qm);
+		return;
+	}
+
+	slog(LG_INFO, "mailqueue: email to %s deferred: %s", qm->rcpt, why);
+
+	qm->next_try = CURRTIME + mq_backoff(qm->attempts);
+	qm->failcode = 0;
+
+	mailqueue_stats.deferred++;
+	mowgli_node_add(qm, &qm->node, &mq_waiting);
+}
+
+// Settles one attempt at a message on the relay's reply; 0 means there was none
+static void
+mq_finish(struct mq_msg *const restrict qm, const unsigned int code, const char *const restrict text)
+{
+	if (code >= 200 && code < 300)
+	{
+		slog(LG_DEBUG, "mailqueue: email to %s delivered", qm->rcpt);
+
+		mailqueue_stats.delivered++;
+		mq_msg_free(qm);
+	}
+	else if (code >= 500)
+	{
+		slog(LG_ERROR, "mailqueue: email to %s rejected: %s", qm->rcpt, text);
+
+		mailqueue_stats.failed++;
+		mq_msg_free(qm);
+	}
+	else
+		mq_defer(qm, text);
+}
+
+static void ATHEME_FATTR_PRINTF(1, 2)
+mq_send(const char *const restrict fmt, ...)
+{
+	va_list ap;
+	size_t len;
+
+	va_start(ap, fmt);
+	(void) sendq_add_vline(mq_conn, &len, fmt, ap);
+	va_end(ap);
+}
+
+static void
+mq_expect_push(const enum mq_reply kind, struct mq_msg *const restrict qm)
+{
+	return_if_fail(mq_expect_count < MQ_EXPECT_MAX);
+
+	struct mq_expect *const e = &mq_expect[(mq_expect_head + mq_expect_count) % MQ_EXPECT_MAX];
+
+	e->kind = kind;
+	e->qm = qm;
+
+	mq_expect_count++;
+	mq_last_activity = CURRTIME;
+}
+
+static struct mq_expect
+mq_expect_pop(void)
+{
+	const struct mq_expect e = mq_expect[mq_expect_head];
+
+	mq_expect_head = (mq_expect_head + 1) % MQ_EXPECT_MAX;
+	mq_expect_count--;
+
+	return e;
+}
+
+// Puts everything in flight back in the queue; the connection is gone or going
+static void
+mq_requeue_inflight(const char *const restrict why)
+{
+	while (mq_expect_count > 0)
+	{
+		struct mq_msg *const qm = mq_expect_pop().qm;
+
+		if (qm == NULL)
+			continue;
+
+		// A message is in the ring up to three times (MAIL, RCPT, DATA)
+		for (unsigned int i = 0; i < mq_expect_count; i++)
+		{
+			struct mq_expect *const e = &mq_expect[(mq_expect_head + i) % MQ_EXPECT_MAX];
+
+			if (e->qm == qm)
+				e->qm = NULL;
+		}
+
+		if (qm->failcode)
+			mq_finish(qm, qm->failcode, why);
+		else
+			mq_defer(qm, why);
+	}
+
+	mq_expect_head = 0;
+	mq_current = NULL;
+}
+
+static void
+mq_kick_cb(void ATHEME_VATTR_UNUSED *const restrict unused)
+{
+	mq_kick_timer = NULL;
+
+	mq_pump();
+}
+
+// Pumps the queue once the current pass of the event loop is over
+static void
+mq_kick(void)
+{
+	if (mq_kick_timer == NULL)
+		mq_kick_timer = timer_add_once("mailqueue_kick", &mq_kick_cb, NULL, 0);
+}
+
+static void
+mq_disconnected(void)
+{
+	mq_conn = NULL;
+	mq_state = MQ_DISCONNECTED;
+
+	sfree(mq_conn_host);
+	mq_conn_host = NULL;
+}
+
+static void
+mq_abort(const char *const restrict why)
+{
+	struct connection *const cptr = mq_conn;
+
+	slog(LG_ERROR, "mailqueue: dropping connection to %s: %s", cptr->name, why);
+
+	mq_requeue_inflight(why);
+	mq_disconnected();
+
+	mq_retry_at = CURRTIME + mq_backoff(++mq_conn_failures);
+
+	cptr->close_handler = NULL;
+	connection_close_soon(cptr);
+}
+
+static void
+mq_close_handler(struct connection *const restrict cptr)
+{
+	if (cptr != mq_conn)
+		return;
+
+	if (mq_state != MQ_QUITTING)
+	{
+		slog(LG_ERROR, "mailqueue: lost connection to %s", cptr->name);
+
+		mq_retry_at = CURRTIME + mq_backoff(++mq_conn_failures);
+	}
+
+	mq_requeue_inflight("connection to the relay lost");
+	mq_disconnected();
+	mq_kick();
+}
+
+static void
+mq_begin(struct mq_msg *const restrict qm)
+{
+	mq_current = qm;
+
+	mq_send("MAIL FROM:<%s>", qm->sender);
+	mq_expect_push(MQ_R_MAIL, qm);
+
+	if (! mq_pipelining)
+		return;
+
+	mq_send("RCPT TO:<%s>", qm->rcpt);
+	mq_expect_push(MQ_R_RCPT, qm);
+	mq_send("DATA");
+	mq_expect_push(MQ_R_DATA, qm);
+}
+
+// A failed MAIL or RCPT; without PIPELINING nothing further was sent for it
+static void
+mq_envelope_failed(struct mq_msg *const restrict qm, const unsigned int code, const char *const restrict text)
+{
+	if (mq_pipelining)
+	{
+		if (! qm->failcode)
+			qm->failcode = code;
+
+		return;
+	}
+
+	mq_current = NULL;
+	mq_finish(qm, code, text);
+
+	mq_send("RSET");
+	mq_expect_push(MQ_R_RSET, NULL);
+}
+
+static void
+mq_reply(const struct mq_expect *const restrict e, const unsigned int code, const char *const restrict text)
+{
+	struct mq_msg *const qm = e->qm;
+	const bool ok = (code >= 200 && code < 300);
+
+	switch (e->kind)
+	{
+		case MQ_R_GREETING:
+			if (code != 220)
+			{
+				mq_abort(text);
+				return;
+			}
+
+			mq_state = MQ_HELLO;
+			mq_send("%s %s", me.lmtp ? "LHLO" : "EHLO", me.name);
+			mq_expect_push(MQ_R_HELLO, NULL);
+			break;
+
+		case MQ_R_HELLO:
+			if (ok)
+			{
+				mq_state = MQ_READY;
+				mq_conn_failures = 0;
+				break;
+			}
+
+			if (me.lmtp || mq_tried_helo)
+			{
+				mq_abort(text);
+				return;
+			}
+
+			mq_tried_helo = true;
+			mq_pipelining = false;
+			mq_send("HELO %s", me.name);
+			mq_expect_push(MQ_R_HELLO, NULL);
+			break;
+
+		case MQ_R_MAIL:
+			if (! ok)
+				mq_envelope_failed(qm, code, text);
+			else if (! mq_pipelining)
+			{
+				mq_send("RCPT TO:<%s>", qm->rcpt);
+				mq_expect_push(MQ_R_RCPT, qm);
+			}
+			break;
+
+		case MQ_R_RCPT:
+			if (! ok)
+				mq_envelope_failed(qm, code, text);
+			else if (! mq_pipelining)
+			{
+				mq_send("DATA");
+				mq_expect_push(MQ_R_DATA, qm);
+			}
+			break;
+
+		case MQ_R_DATA:
+			mq_current = NULL;
+
+			if (code == 354)
+			{
+				static char empty_data[] = ".\r\n";
+
+				// A server should not take DATA after a failed envelope; end it empty if it does
+				if (qm->failcode)
+					sendq_add(mq_conn, empty_data, sizeof empty_data - 1);
+				else
+					sendq_add(mq_conn, qm->data, qm->len);
+
+				mq_expect_push(MQ_R_DOT, qm);
+				break;
+			}
+
+			mq_finish(qm, qm->failcode ? qm->failcode : code, text);
+			mq_send("RSET");
+			mq_expect_push(MQ_R_RSET, NULL);
+			break;
+
+		case MQ_R_DOT:
+			mq_finish(qm, qm->failcode ? qm->failcode : code, text);
+			break;
+
+		case MQ_R_RSET:
+		case MQ_R_QUIT:
+			break;
+	}
+
+	mq_pump();
+}
+
+static void
+mq_recvq_handler(struct connection *const restrict cptr)
+{
+	char buf[BUFSIZE];
+	int count;
+
+	count = recvq_getline(cptr, buf, sizeof buf - 1);
+	if (count <= 0)
+		return;
+
+	if (cptr->flags & CF_NONEWLINE)
+	{
+		mq_abort("reply line too long");
+		return;
+	}
+
+	cnt.bin += count;
+	if (buf[count - 1] == '\n')
+		count--;
+	if (count > 0 && buf[count - 1] == '\r')
+		count--;
+	buf[count] = '\0';
+
+	mq_last_activity = CURRTIME;
+
+	if (count < 3 || ! isdigit((unsigned char) buf[0]) || ! isdigit((unsigned char) buf[1]) ||
+	    ! isdigit((unsigned char) buf[2]) || (buf[3] != '\0' && buf[3] != ' ' && buf[3] != '-'))
+	{
+		mq_abort("malformed reply");
+		return;
+	}
+
+	if (! mq_expect_count)
+	{
+		mq_abort("unexpected reply");
+		return;
+	}
+
+	const char *const text = (buf[3] != '\0') ? (buf + 4) : "";
+
+	// Continuation lines only matter for the extensions offered in reply to EHLO/LHLO
+	if (buf[3] == '-')
+	{
+		if (mq_expect[mq_expect_head].kind == MQ_R_HELLO && strcasecmp(text, "PIPELINING") == 0)
+			mq_pipelining = true;
+
+		return;
+	}
+
+	const unsigned int code = (buf[0] - '0') * 100U + (buf[1] - '0') * 10U + (buf[2] - '0');
+	const struct mq_expect e = mq_expect_pop();
+
+	if (e.kind == MQ_R_HELLO && strcasecmp(text, "PIPELINING") == 0)
+		mq_pipelining = true;
+
+	mq_reply(&e, code, buf);
+}
+
+static void
+mq_connected(struct connection *const restrict cptr)
+{
+	cptr->flags &= ~CF_CONNECTING;
+	cptr->recvq_handler = &mq_recvq_handler;
+
+	connection_setselect_write(cptr, NULL);
+	connection_setselect_read(cptr, recvq_put);
+
+	slog(LG_DEBUG, "mailqueue: connected to %s", cptr->name);
+
+	mq_state = MQ_GREETING;
+	mq_expect_push(MQ_R_GREETING, NULL);
+}
+
+static void
+mq_connect(void)
+{
+	mq_pipelining = false;
+	mq_tried_helo = false;
+	mq_expect_head = 0;
+	mq_expect_count = 0;
+
+	mq_conn = connection_open_tcp(me.smtprelay, me.vhost, me.smtpport, NULL, &mq_connected);
+
+	if (mq_conn == NULL)
+	{
+		slog(LG_ERROR, "mailqueue: cannot connect to %s port %u", me.smtprelay, me.smtpport);
+
+		mq_retry_at = CURRTIME + mq_backoff(++mq_conn_failures);
+		return;
+	}
+
+	mailqueue_stats.connections++;
+
+	mq_conn->close_handler = &mq_close_handler;
+	mq_conn_host = sstrdup(me.smtprelay);
+	mq_conn_port = me.smtpport;
+	mq_state = MQ_CONNECTING;
+	mq_last_activity = CURRTIME;
+}
+
+static void
+mq_quit(void)
+{
+	mq_state = MQ_QUITTING;
+
+	mq_send("QUIT");
+	mq_expect_push(MQ_R_QUIT, NULL);
+	sendq_add_eof(mq_conn);
+}
+
+static struct mq_msg *
+mq_next_due(void)
+{
+	mowgli_node_t *n;
+
+	MOWGLI_ITER_FOREACH(n, mq_waiting.head)
+	{
+		struct mq_msg *const qm = n->data;
+
+		if (qm->next_try <= CURRTIME)
+			return qm;
+	}
+
+	return NULL;
+}
+
+static void
+mq_pump(void)
+{
+	struct mq_msg *qm;
+
+	if (me.smtprelay == NULL || (qm = mq_next_due()) == NULL)
+		return;
+
+	if (mq_conn == NULL)
+	{
+		if (mq_retry_at <= CURRTIME)
+			mq_connect();
+
+		return;
+	}
+
+	if (mq_state != MQ_READY)
+		return;
+
+	// Room for: the DOT reply of the message whose body goes out next, and an envelope after it
+	while (qm != NULL && mq_current == NULL && mq_expect_count + 4 <= MQ_EXPECT_MAX &&
+	       (mq_pipelining || ! mq_expect_count))
+	{
+		mowgli_node_delete(&qm->node, &mq_waiting);
+		mq_begin(qm);
+
+		qm = mq_next_due();
+	}
+}
+
+static void
+mq_watchdog(void ATHEME_VATTR_UNUSED *const restrict unused)
+{
+	if (mq_conn != NULL)
+	{
+		const bool moved = (me.smtprelay == NULL || mq_conn_port != me.smtpport ||
+		                    (mq_conn_host != NULL && strcasecmp(mq_conn_host, me.smtprelay) != 0));
+
+		if ((mq_expect_count > 0 || mq_state == MQ_CONNECTING) && CURRTIME - mq_last_activity > MQ_REPLY_TIMEOUT)
+			mq_abort("timed out waiting for a reply");
+		else if (mq_state == MQ_READY && ! mq_expect_count)
+		{
+			if (moved || (mq_next_due() == NULL && CURRTIME - mq_last_activity > MQ_IDLE_TIMEOUT))
+				mq_quit();
+		}
+	}
+
+	mq_pump();
+}
+
+bool
+mailqueue_submit(const char *const restrict sender, const char *const restrict rcpt, const char *const restrict body,
+                 const size_t len)
+{
+	return_val_if_fail(sender != NULL, false);
+	return_val_if_fail(rcpt != NULL, false);
+	return_val_if_fail(body != NULL, false);
+
+	if (mailqueue_stats.queued >= MQ_MAX_QUEUED)
+	{
+		slog(LG_ERROR, "mailqueue: queue is full, dropping email to %s", rcpt);
+		return false;
+	}
+
+	// Every line may gain a leading dot, a CR and (the last one) an LF; then the final ".\r\n"
+	size_t lines = 1;
+
+	for (size_t i = 0; i < len; i++)
+		if (body[i] == '\n')
+			lines++;
+
+	struct mq_msg *const qm = smalloc(sizeof *qm);
+	char *p = qm->data = smalloc(len + (lines * 3) + 4);
+	bool bol = true;
+
+	for (size_t i = 0; i < len; i++)
+	{
+		if (bol && body[i] == '.')
+			*p++ = '.';
+
+		if (body[i] == '\n')
+			*p++ = '\r';
+
+		*p++ = body[i];
+		bol = (body[i] == '\n');
+	}
+
+	if (! bol)
+	{
+		*p++ = '\r';
+		*p++ = '\n';
+	}
+
+	*p++ = '.';
+	*p++ = '\r';
+	*p++ = '\n';
+	*p = '\0';
+
+	qm->len = (size_t) (p - qm->data);
+	qm->sender = sstrdup(sender);
+	qm->rcpt = sstrdup(rcpt);
+	qm->next_try = CURRTIME;
+
+	mailqueue_stats.queued++;
+	mailqueue_stats.submitted++;
+
+	mowgli_node_add(qm, &qm->node, &mq_waiting);
+	mq_kick();
+
+	return true;
+}
+
+void
+mailqueue_init(void)
+{
+	(void) timer_add("mailqueue_watchdog", &mq_watchdog, NULL, MQ_WATCHDOG_PERIOD);
+}
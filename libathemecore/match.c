@@ -16,8 +16,20 @@
 #include <atheme.h>
 #include "internal.h"
 
-#ifdef HAVE_LIBPCRE
-#  include <pcre.h>
+#ifdef HAVE_USABLE_PTHREAD
+#  include <pthread.h>
+#endif
+
+#if defined(__SSE2__)
+#  include <emmintrin.h>
+#  define CASEMAP_VECTOR_SSE2
+#elif defined(__ARM_NEON)
+#  include <arm_neon.h>
+#  define CASEMAP_VECTOR_NEON
+#endif
+
+#if defined(CASEMAP_VECTOR_SSE2) || defined(CASEMAP_VECTOR_NEON)
+#  define CASEMAP_VECTOR_WIDTH  16U
 #endif
 
 #define BadPtr(x) (!(x) || (*(x) == '\0'))
@@ -207,6 +219,207 @@ match(const char *mask, const char *name)
 }
 
 
+/*
+ * Compiled masks
+ *
+ * match_compile() takes a mask apart once, the same way match() walks it,
+ * and keeps the casefolded literal runs that any matching name must contain:
+ * the prefix before the first wildcard, the suffix after the last '*', and
+ * the longest literal run in between. match_compiled() checks those (and the
+ * minimum length) first, which rejects the vast majority of names without
+ * running the wildcard walk at all. Names that survive are handed to match()
+ * itself, so the result is always exactly what match() would have returned.
+ */
+
+#define MATCH_LITERAL_FAST_MAX  256
+
+static inline unsigned char
+match_fold(const int mapping, const unsigned char c)
+{
+	if (mapping == MATCH_ASCII)
+		return (unsigned char) tolower(c);
+
+	return ToLowerTab[c];
+}
+
+static inline bool
+match_is_single_wildcard(const unsigned char c)
+{
+	return c == '?' || c == '&' || c == '#' || c == '%';
+}
+
+static inline bool
+match_is_escapable(const unsigned char c)
+{
+	return c == '*' || match_is_single_wildcard(c);
+}
+
+static char *
+match_copy_run(const unsigned char *const run, const size_t runlen)
+{
+	char *const copy = smalloc(runlen + 1);
+
+	(void) memcpy(copy, run, runlen);
+
+	return copy;
+}
+
+struct match_pattern * ATHEME_FATTR_MALLOC
+match_compile(const char *mask)
+{
+	return_val_if_fail(mask != NULL, NULL);
+
+	struct match_pattern *const mp = smalloc(sizeof *mp);
+	const unsigned char *m = (const unsigned char *) mask;
+
+	// The current literal run can never be longer than the mask itself
+	unsigned char *const run = smalloc(strlen(mask) + 1);
+	size_t runlen = 0;
+	bool wildcards = false;
+
+	mp->mask = sstrdup(mask);
+	mp->mapping = match_mapping;
+	mp->fixedlen = true;
+
+	if (m[0] == '*' && m[1] == '\0')
+	{
+		mp->matchall = true;
+		sfree(run);
+		return mp;
+	}
+
+	for (;;)
+	{
+		if (*m == '\\' && match_is_escapable(m[1]))
+		{
+			run[runlen++] = match_fold(match_mapping, m[1]);
+			mp->minlen++;
+			m += 2;
+			continue;
+		}
+
+		if (*m != '\0' && *m != '*' && ! match_is_single_wildcard(*m))
+		{
+			run[runlen++] = match_fold(match_mapping, *m);
+			mp->minlen++;
+			m++;
+			continue;
+		}
+
+		// A literal run just ended, by a wildcard or by the end of the mask
+		if (! wildcards)
+		{
+			mp->prefix = match_copy_run(run, runlen);
+			mp->prefixlen = runlen;
+		}
+		else if (*m == '\0')
+		{
+			/* Whatever follows the last wildcard has to line up with
+			 * the end of the name; the odd end-of-mask handling in
+			 * match() only applies to masks ending in a wildcard.
+			 */
+			mp->suffix = match_copy_run(run, runlen);
+			mp->suffixlen = runlen;
+		}
+		else if (runlen > mp->innerlen)
+		{
+			sfree(mp->inner);
+			mp->inner = match_copy_run(run, runlen);
+			mp->innerlen = runlen;
+		}
+
+		if (*m == '\0')
+			break;
+
+		wildcards = true;
+		runlen = 0;
+
+		if (*m == '*')
+		{
+			mp->fixedlen = false;
+
+			while (*m == '*')
+				m++;
+		}
+		else
+		{
+			mp->minlen++;
+			m++;
+		}
+	}
+
+	mp->literal = ! wildcards;
+
+	sfree(run);
+	return mp;
+}
+
+/*
+ * match_compiled()
+ *  Like match(), but takes a mask compiled by match_compile().
+ *  Returns 0 on match, 1 otherwise.
+ */
+int
+match_compiled(const struct match_pattern *mp, const char *name)
+{
+	const unsigned char *const n = (const unsigned char *) name;
+	size_t namelen, i;
+
+	if (mp == NULL || name == NULL)
+		return 1;
+
+	if (mp->matchall)
+		return 0;
+
+	// The mask was folded under a different casemapping; don't second-guess it
+	if (mp->mapping != match_mapping)
+		return match(mp->mask, name);
+
+	namelen = strlen(name);
+
+	if (namelen < mp->minlen || (mp->fixedlen && namelen != mp->minlen))
+		return 1;
+
+	for (i = 0; i < mp->prefixlen; i++)
+		if (match_fold(mp->mapping, n[i]) != (unsigned char) mp->prefix[i])
+			return 1;
+
+	if (mp->literal && namelen < MATCH_LITERAL_FAST_MAX)
+		return 0;
+
+	for (i = 0; i < mp->suffixlen; i++)
+		if (match_fold(mp->mapping, n[namelen - mp->suffixlen + i]) != (unsigned char) mp->suffix[i])
+			return 1;
+
+	if (mp->innerlen && namelen < BUFSIZE)
+	{
+		char folded[BUFSIZE];
+
+		for (i = 0; i < namelen; i++)
+			folded[i] = (char) match_fold(mp->mapping, n[i]);
+
+		folded[namelen] = '\0';
+
+		if (strstr(folded + mp->prefixlen, mp->inner) == NULL)
+			return 1;
+	}
+
+	return match(mp->mask, name);
+}
+
+void
+match_pattern_free(struct match_pattern *mp)
+{
+	if (mp == NULL)
+		return;
+
+	sfree(mp->mask);
+	sfree(mp->prefix);
+	sfree(mp->suffix);
+	sfree(mp->inner);
+	sfree(mp);
+}
+
 /*
 ** collapse a pattern string into minimal components.
 ** This particular version is "in place", so that it changes the pattern
@@ -243,6 +456,110 @@ collapse(char *pattern)
 	return pattern;
 }
 
+#ifdef CASEMAP_VECTOR_WIDTH
+
+/* Both casemappings fold a single contiguous byte range down by 0x20:
+ * 'a'..'z' for ascii, and 'a'..'~' for rfc1459 (which adds {|}~ to [\]^).
+ * Everything below 0x80 outside that range maps to itself, as does every
+ * byte from 0x80 up in the rfc1459 table. Bytes from 0x80 up are left to
+ * toupper(3) in ascii mode, since its result depends on the locale.
+ */
+#define CASEMAP_UPPER_ASCII     ((unsigned char) 'z' + 1U)
+#define CASEMAP_UPPER_RFC1459   ((unsigned char) '~' + 1U)
+
+#ifdef CASEMAP_VECTOR_SSE2
+
+static inline __m128i
+casemap_vector_fold(const __m128i v, const __m128i limit)
+{
+	// Signed compares; bytes from 0x80 up are negative and fall outside
+	const __m128i in = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8(0x60)), _mm_cmplt_epi8(v, limit));
+
+	return _mm_sub_epi8(v, _mm_and_si128(in, _mm_set1_epi8(0x20)));
+}
+
+static inline bool
+casemap_vector_canon(unsigned char *const p, const unsigned char upper, const bool ascii_only)
+{
+	const __m128i v = _mm_loadu_si128((const void *) p);
+
+	if (ascii_only && _mm_movemask_epi8(v))
+		return false;
+
+	_mm_storeu_si128((void *) p, casemap_vector_fold(v, _mm_set1_epi8((char) upper)));
+	return true;
+}
+
+static inline bool
+casemap_vector_equal(const unsigned char *const p1, const unsigned char *const p2, const unsigned char upper)
+{
+	const __m128i limit = _mm_set1_epi8((char) upper);
+	const __m128i v1 = casemap_vector_fold(_mm_loadu_si128((const void *) p1), limit);
+	const __m128i v2 = casemap_vector_fold(_mm_loadu_si128((const void *) p2), limit);
+
+	return _mm_movemask_epi8(_mm_cmpeq_epi8(v1, v2)) == 0xFFFF;
+}
+
+#else /* CASEMAP_VECTOR_SSE2 */
+
+static inline uint8x16_t
+casemap_vector_fold(const uint8x16_t v, const uint8x16_t limit)
+{
+	const uint8x16_t in = vandq_u8(vcgtq_u8(v, vdupq_n_u8(0x60)), vcltq_u8(v, limit));
+
+	return vsubq_u8(v, vandq_u8(in, vdupq_n_u8(0x20)));
+}
+
+static inline uint64_t
+casemap_vector_reduce(const uint8x16_t v)
+{
+	const uint64x2_t w = vreinterpretq_u64_u8(v);
+
+	return vgetq_lane_u64(w, 0) & vgetq_lane_u64(w, 1);
+}
+
+static inline bool
+casemap_vector_canon(unsigned char *const p, const unsigned char upper, const bool ascii_only)
+{
+	const uint8x16_t v = vld1q_u8(p);
+
+	if (ascii_only && ~casemap_vector_reduce(vcltq_u8(v, vdupq_n_u8(0x80))))
+		return false;
+
+	vst1q_u8(p, casemap_vector_fold(v, vdupq_n_u8(upper)));
+	return true;
+}
+
+static inline bool
+casemap_vector_equal(const unsigned char *const p1, const unsigned char *const p2, const unsigned char upper)
+{
+	const uint8x16_t limit = vdupq_n_u8(upper);
+	const uint8x16_t v1 = casemap_vector_fold(vld1q_u8(p1), limit);
+	const uint8x16_t v2 = casemap_vector_fold(vld1q_u8(p2), limit);
+
+	return casemap_vector_reduce(vceqq_u8(v1, v2)) == UINT64_MAX;
+}
+
+#endif /* !CASEMAP_VECTOR_SSE2 */
+
+/* Skip the leading run of whole blocks that compare equal under rfc1459.
+ * At least one byte (or the terminator) is always left for the caller's
+ * scalar loop, which then decides the result exactly as before.
+ */
+static inline size_t
+casemap_vector_skip_equal(const unsigned char *const s1, const unsigned char *const s2, const size_t len)
+{
+	size_t off = 0;
+
+	while (len - off > CASEMAP_VECTOR_WIDTH &&
+	       casemap_vector_equal(s1 + off, s2 + off, CASEMAP_UPPER_RFC1459))
+		off += CASEMAP_VECTOR_WIDTH;
+
+	return off;
+}
+
+#endif /* CASEMAP_VECTOR_WIDTH */
+
 /*
 **  Case insensitive comparison of two null terminated strings.
 **
@@ -260,10 +577,22 @@ irccasecmp(const char *s1, const char *s2)
 	if (!s1 || !s2)
 		return -1;
 
+	// The C library already ships tuned strcasecmp(3) implementations
 	if (match_mapping == MATCH_ASCII)
 		return strcasecmp(s1, s2);
 
-	while ((res = ToUpper(*str1) - ToUpper(*str2)) == 0)
+#ifdef CASEMAP_VECTOR_WIDTH
+	{
+		const size_t len1 = strlen(s1);
+		const size_t len2 = strlen(s2);
+		const size_t off = casemap_vector_skip_equal(str1, str2, (len1 < len2) ? len1 : len2);
+
+		str1 += off;
+		str2 += off;
+	}
+#endif
+
+	while ((res = ToUpperTab[*str1] - ToUpperTab[*str2]) == 0)
 	{
 		if (*str1 == '\0')
 			return 0;
@@ -283,7 +612,20 @@ ircncasecmp(const char *str1, const char *str2, size_t n)
 	if (match_mapping == MATCH_ASCII)
 		return strncasecmp(str1, str2, n);
 
-	while ((res = ToUpper(*s1) - ToUpper(*s2)) == 0)
+#ifdef CASEMAP_VECTOR_WIDTH
+	if (n > CASEMAP_VECTOR_WIDTH)
+	{
+		const size_t len1 = strnlen(str1, n);
+		const size_t len2 = strnlen(str2, n);
+		const size_t off = casemap_vector_skip_equal(s1, s2, (len1 < len2) ? len1 : len2);
+
+		s1 += off;
+		s2 += off;
+		n -= off;
+	}
+#endif
+
+	while ((res = ToUpperTab[*s1] - ToUpperTab[*s2]) == 0)
 	{
 		s1++;
 		s2++;
@@ -297,6 +639,21 @@ ircncasecmp(const char *str1, const char *str2, size_t n)
 void
 irccasecanon(char *str)
 {
+#ifdef CASEMAP_VECTOR_WIDTH
+	const bool ascii = (match_mapping == MATCH_ASCII);
+	const unsigned char upper = ascii ? CASEMAP_UPPER_ASCII : CASEMAP_UPPER_RFC1459;
+	size_t len = strlen(str);
+
+	for (; len >= CASEMAP_VECTOR_WIDTH; len -= CASEMAP_VECTOR_WIDTH, str += CASEMAP_VECTOR_WIDTH)
+	{
+		if (casemap_vector_canon((unsigned char *) str, upper, ascii))
+			continue;
+
+		for (size_t i = 0; i < CASEMAP_VECTOR_WIDTH; i++)
+			str[i] = toupper((unsigned char) str[i]);
+	}
+#endif
+
 	while (*str)
 	{
 		*str = ToUpper(*str);
@@ -581,9 +938,115 @@ const unsigned int charattrs[] = {
 	/* 0xFF */ 0,
 };
 
+#ifdef HAVE_LIBPCRE2
+
+/* Bound the work a single match may do, so that a pathological pattern (or
+ * subject) can't stall services; running into a limit counts as no match.
+ */
+#define REGEX_PCRE2_MATCH_LIMIT         1000000U
+#define REGEX_PCRE2_JIT_STACK_MIN       (32U * 1024U)
+#define REGEX_PCRE2_JIT_STACK_MAX       (512U * 1024U)
+
+/* Everything pcre2_match() needs apart from the pattern; none of it may be
+ * used by two threads at once, so there is one of these per thread.
+ */
+struct regex_pcre2_state
+{
+	pcre2_match_data *      match_data;
+	pcre2_match_context *   match_context;
+	pcre2_jit_stack *       jit_stack;
+};
+
+static void
+regex_pcre2_state_free(void *const restrict vstate)
+{
+	struct regex_pcre2_state *const state = vstate;
+
+	if (! state)
+		return;
+
+	pcre2_match_data_free(state->match_data);
+	pcre2_match_context_free(state->match_context);
+	pcre2_jit_stack_free(state->jit_stack);
+	sfree(state);
+}
+
+static struct regex_pcre2_state *
+regex_pcre2_state_create(void)
+{
+	struct regex_pcre2_state *const state = smalloc(sizeof *state);
+
+	// A match only has to be reported, not where it is
+	state->match_data = pcre2_match_data_create(1, NULL);
+	state->match_context = pcre2_match_context_create(NULL);
+	state->jit_stack = pcre2_jit_stack_create(REGEX_PCRE2_JIT_STACK_MIN, REGEX_PCRE2_JIT_STACK_MAX, NULL);
+
+	if (! state->match_data || ! state->match_context)
+	{
+		slog(LG_ERROR, "regex_match(): could not allocate PCRE2 match data");
+		regex_pcre2_state_free(state);
+		return NULL;
+	}
+
+	(void) pcre2_set_match_limit(state->match_context, REGEX_PCRE2_MATCH_LIMIT);
+
+	// Without a JIT stack of its own, PCRE2 uses a small one on the machine stack
+	if (state->jit_stack)
+		pcre2_jit_stack_assign(state->match_context, NULL, state->jit_stack);
+
+	return state;
+}
+
+#ifdef HAVE_USABLE_PTHREAD
+
+static pthread_key_t regex_pcre2_key;
+static pthread_once_t regex_pcre2_once = PTHREAD_ONCE_INIT;
+static bool regex_pcre2_key_valid = false;
+
+static void
+regex_pcre2_key_create(void)
+{
+	regex_pcre2_key_valid = (pthread_key_create(&regex_pcre2_key, &regex_pcre2_state_free) == 0);
+}
+
+static struct regex_pcre2_state *
+regex_pcre2_state_get(void)
+{
+	struct regex_pcre2_state *state;
+
+	(void) pthread_once(&regex_pcre2_once, &regex_pcre2_key_create);
+
+	if (! regex_pcre2_key_valid)
+		return NULL;
+
+	if ((state = pthread_getspecific(regex_pcre2_key)) == NULL && (state = regex_pcre2_state_create()) != NULL)
+		(void) pthread_setspecific(regex_pcre2_key, state);
+
+	return state;
+}
+
+#else /* HAVE_USABLE_PTHREAD */
+
+static struct regex_pcre2_state *
+regex_pcre2_state_get(void)
+{
+	static struct regex_pcre2_state *state = NULL;
+
+	if (! state)
+		state = regex_pcre2_state_create();
+
+	return state;
+}
+
+#endif /* !HAVE_USABLE_PTHREAD */
+
+#endif /* HAVE_LIBPCRE2 */
+
 /*
  * regex_compile()
  *  Compile a regex of `pattern' and return it.
+ *  PCRE patterns use PCRE2, JIT-compiled unless AREGEX_NOJIT is given or the
+ *  library can't, if it is available, and legacy PCRE otherwise.
  */
 struct atheme_regex * ATHEME_FATTR_MALLOC
 regex_create(char *pattern, int flags)
@@ -600,7 +1063,26 @@ regex_create(char *pattern, int flags)
 
 	if (flags & AREGEX_PCRE)
 	{
-#ifdef HAVE_LIBPCRE
+#if defined(HAVE_LIBPCRE2)
+		PCRE2_SIZE erroffset;
+
+		preg->un.pcre2 = pcre2_compile((PCRE2_SPTR) pattern, PCRE2_ZERO_TERMINATED,
+		                               (flags & AREGEX_ICASE ? PCRE2_CASELESS : 0) | PCRE2_NO_AUTO_CAPTURE,
+		                               &errnum, &erroffset, NULL);
+		if (preg->un.pcre2 == NULL)
+		{
+			(void) pcre2_get_error_message(errnum, (PCRE2_UCHAR *) errmsg, sizeof errmsg);
+			slog(LG_ERROR, "regex_match(): %s at offset %zu in %s",
+					errmsg, (size_t) erroffset, pattern);
+			sfree(preg);
+			return NULL;
+		}
+		preg->type = at_pcre2;
+
+		// Falls back to the interpreter if the library was built without JIT support
+		if (! (flags & AREGEX_NOJIT) && pcre2_jit_compile(preg->un.pcre2, PCRE2_JIT_COMPLETE) == 0)
+			preg->jit = true;
+#elif defined(HAVE_LIBPCRE)
 		const char *errptr;
 		int erroffset;
 
@@ -696,13 +1178,38 @@ regex_match(struct atheme_regex *preg, char *string)
 		case at_posix:
 			return regexec(&preg->un.posix, string, 0, NULL, 0) == 0;
 		case at_pcre:
-#ifdef HAVE_LIBPCRE
+#if defined(HAVE_LIBPCRE) && ! defined(HAVE_LIBPCRE2)
 			return pcre_exec(preg->un.pcre, NULL, string, strlen(string), 0, 0, NULL, 0) >= 0;
 #else
 			slog(LG_ERROR, "regex_match(): we were given a PCRE pattern without PCRE support!");
 			return false;
+#endif
+		case at_pcre2:
+#ifdef HAVE_LIBPCRE2
+		{
+			struct regex_pcre2_state *const state = regex_pcre2_state_get();
+
+			if (state == NULL)
+				return false;
+
+			const int ret = pcre2_match(preg->un.pcre2, (PCRE2_SPTR) string, strlen(string), 0, 0,
+			                            state->match_data, state->match_context);
+
+			if (ret >= 0)
+				return true;
+
+			if (ret != PCRE2_ERROR_NOMATCH)
+				slog(LG_DEBUG, "regex_match(): PCRE2 error %d matching %s", ret, string);
+
+			return false;
+		}
+#else
+			slog(LG_ERROR, "regex_match(): we were given a PCRE2 pattern without PCRE2 support!");
+			return false;
 #endif
 	}
+
+	return false;
 }
 
 /*
@@ -718,18 +1225,220 @@ regex_destroy(struct atheme_regex *preg)
 			regfree(&preg->un.posix);
 			break;
 		case at_pcre:
-#ifdef HAVE_LIBPCRE
+#if defined(HAVE_LIBPCRE) && ! defined(HAVE_LIBPCRE2)
 			pcre_free(preg->un.pcre);
 			break;
 #else
 			slog(LG_ERROR, "regex_destroy(): we were given a PCRE pattern without PCRE support!");
 			return false;
+#endif
+		case at_pcre2:
+#ifdef HAVE_LIBPCRE2
+			pcre2_code_free(preg->un.pcre2);
+			break;
+#else
+			slog(LG_ERROR, "regex_destroy(): we were given a PCRE2 pattern without PCRE2 support!");
+			return false;
 #endif
 	}
 	sfree(preg);
 	return true;
 }
 
+/* Members of a regex set are combined into alternations of at most this many
+ * patterns each; a string that matches none of an alternation needs no
+ * further work for its members, and one that does only has to be checked
+ * against the members of that alternation.
+ */
+#define REGEX_SET_GROUP_MAX     64U
+
+struct regex_set_group
+{
+	struct atheme_regex *   combined;       // NULL to match the members one by one
+	size_t                  first;          // Index of the first member in regex_set::members
+	size_t                  count;
+};
+
+struct regex_set
+{
+	struct atheme_regex **  regexes;        // As given to regex_set_create(), by index
+	size_t                  nregexes;
+	size_t *                members;        // Indexes into regexes, grouped
+	size_t                  count;
+	struct regex_set_group *groups;
+	size_t                  ngroups;
+};
+
+/* Whether pattern keeps its meaning when wrapped in parentheses and put in
+ * an alternation with others. Back-references and anything that changes how
+ * the rest of the pattern is parsed rule a pattern out; it is then matched on
+ * its own.
+ */
+static bool
+regex_set_combinable(const char *const restrict pattern, const int flags)
+{
+	for (const char *p = pattern; *p != '\0'; p++)
+	{
+		if (*p == '\\')
+		{
+			if (*++p == '\0')
+				return false;
+
+			if (isdigit((unsigned char) *p))
+				return false;
+
+			if ((flags & AREGEX_PCRE) && strchr("QEgk", *p))
+				return false;
+		}
+		else if ((flags & AREGEX_PCRE) && *p == '(' && (p[1] == '*' || (p[1] == '?' && ! strchr(":=!", p[2]) &&
+		         ! (p[2] == '<' && (p[3] == '=' || p[3] == '!')))))
+			return false;
+	}
+
+	return true;
+}
+
+static void
+regex_set_add_group(struct regex_set *const restrict set, char *const *const patterns, const int flags,
+                    const size_t first, const size_t count)
+{
+	struct regex_set_group *const grp = &set->groups[set->ngroups++];
+
+	grp->combined = NULL;
+	grp->first = first;
+	grp->count = count;
+
+	if (count < 2)
+		return;
+
+	size_t len = 0;
+
+	for (size_t i = first; i < first + count; i++)
+		len += strlen(patterns[set->members[i]]) + 3;
+
+	char *const combined = smalloc(len);
+	char *p = combined;
+
+	for (size_t i = first; i < first + count; i++)
+		p += sprintf(p, "%s(%s)", (i == first) ? "" : "|", patterns[set->members[i]]);
+
+	// On failure (which regex_create() logs) the members are matched one by one
+	grp->combined = regex_create(combined, flags & (AREGEX_ICASE | AREGEX_PCRE));
+
+	(void) sfree(combined);
+}
+
+/*
+ * regex_set_create()
+ *  Prepare `count' regexes for being matched against the same strings with
+ *  regex_set_match(). `patterns' and `flags' are what `regexes' were
+ *  compiled from with regex_create(); entries of `regexes' may be NULL, and
+ *  then never match. The regexes themselves still belong to the caller and
+ *  must outlive the set, which has to be rebuilt whenever they change.
+ */
+struct regex_set * ATHEME_FATTR_MALLOC
+regex_set_create(char *const *const patterns, const int *const flags, struct atheme_regex *const *const regexes,
+                 const size_t count)
+{
+	// Engine and case sensitivity must be the same throughout an alternation
+	static const int kinds[] = { 0, AREGEX_ICASE, AREGEX_PCRE, AREGEX_PCRE | AREGEX_ICASE };
+
+	struct regex_set *const set = smalloc(sizeof *set);
+
+	set->regexes = smalloc(count ? (count * sizeof *set->regexes) : 1);
+	set->members = smalloc(count ? (count * sizeof *set->members) : 1);
+	set->groups = smalloc(count ? (count * sizeof *set->groups) : 1);
+
+	for (size_t i = 0; i < count; i++)
+		set->regexes[i] = regexes[i];
+
+	set->nregexes = count;
+
+	for (size_t k = 0; k < ARRAY_SIZE(kinds); k++)
+	{
+		const size_t first = set->count;
+
+		for (size_t i = 0; i < count; i++)
+		{
+			if (! regexes[i] || (flags[i] & (AREGEX_ICASE | AREGEX_PCRE)) != kinds[k])
+				continue;
+
+			if (regex_set_combinable(patterns[i], flags[i]))
+				set->members[set->count++] = i;
+		}
+
+		for (size_t i = first; i < set->count; i += REGEX_SET_GROUP_MAX)
+		{
+			const size_t n = (set->count - i < REGEX_SET_GROUP_MAX) ? (set->count - i) : REGEX_SET_GROUP_MAX;
+
+			(void) regex_set_add_group(set, patterns, kinds[k], i, n);
+		}
+	}
+
+	// Whatever could not be combined is matched on its own
+	for (size_t i = 0; i < count; i++)
+	{
+		if (! regexes[i] || regex_set_combinable(patterns[i], flags[i]))
+			continue;
+
+		set->members[set->count] = i;
+		(void) regex_set_add_group(set, patterns, 0, set->count++, 1);
+	}
+
+	return set;
+}
+
+/*
+ * regex_set_match()
+ *  Match `string' against every regex in `set'. `matches' must have room for
+ *  as many entries as were given to regex_set_create(); each is set to
+ *  whether the regex of the same index matches.
+ */
+void
+regex_set_match(const struct regex_set *const restrict set, char *const restrict string, bool *const restrict matches)
+{
+	return_if_fail(set != NULL);
+	return_if_fail(string != NULL);
+	return_if_fail(matches != NULL);
+
+	for (size_t i = 0; i < set->nregexes; i++)
+		matches[i] = false;
+
+	for (size_t g = 0; g < set->ngroups; g++)
+	{
+		const struct regex_set_group *const grp = &set->groups[g];
+
+		if (grp->combined && ! regex_match(grp->combined, string))
+			continue;
+
+		for (size_t i = grp->first; i < grp->first + grp->count; i++)
+		{
+			const size_t idx = set->members[i];
+
+			matches[idx] = regex_match(set->regexes[idx], string);
+		}
+	}
+}
+
+/*
+ * regex_set_destroy()
+ *  Free a regex set. The regexes it was created from are left alone.
+ */
+void
+regex_set_destroy(struct regex_set *const restrict set)
+{
+	return_if_fail(set != NULL);
+
+	for (size_t g = 0; g < set->ngroups; g++)
+		if (set->groups[g].combined)
+			(void) regex_destroy(set->groups[g].combined);
+
+	(void) sfree(set->groups);
+	(void) sfree(set->members);
+	(void) sfree(set->regexes);
+	(void) sfree(set);
+}
+
 /* vim:cinoptions=>s,e0,n0,f0,{0,}0,^0,=s,ps,t0,c3,+s,(2s,us,)20,*30,gs,hs
  * vim:ts=8
  * vim:sw=8
@@ -0,0 +1,227 @@
+/*
+ * SPDX-License-Identifier: ISC
+ * SPDX-URL: https://spdx.org/licenses/ISC.html
+ *
+ * Copyright (C) 2026 Atheme Development Group (https://atheme.github.io/)
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * atheme-services: A collection of minimalist IRC services
+ * memoignore.c: Accounts ignoring memos from other accounts.
+ *
+ * Each ignore is one struct memo_ignore, on the ignoring account's
+ * memo_ignores list (in the order they were added, for MemoServ IGNORE
+ * LIST), on the ignored account's memo_ignored_by list (so that dropping
+ * either account removes it), and in a hash table keyed by the pair of
+ * account pointers, so that a memo send can tell whether its recipient
+ * ignores the sender without comparing any names.
+ *
+ * The database stores ignores by name. Those loaded before the account
+ * they name are resolved once the whole database has been loaded.
+ */
+
+#include <atheme.h>
+#include "internal.h"
+
+#define MEMO_IGNORE_BUCKETS_MIN         256U
+
+struct memo_ignore_pending
+{
+	char                    owner[IDLEN + 1];
+	char *                  name;
+	mowgli_node_t           node;
+};
+
+static mowgli_list_t *memo_ignore_buckets = NULL;
+static size_t memo_ignore_nbuckets = 0;
+static size_t memo_ignore_count = 0;
+
+static mowgli_list_t memo_ignore_pending;
+static bool memo_ignore_loaded = false;
+
+static inline size_t
+memo_ignore_bucket(const struct myuser *const owner, const struct myuser *const target, const size_t nbuckets)
+{
+	uint64_t h = ((uint64_t) (uintptr_t) owner) * UINT64_C(0x9E3779B97F4A7C15);
+
+	h ^= ((uint64_t) (uintptr_t) target) + UINT64_C(0x7F4A7C159E3779B9) + (h << 6) + (h >> 2);
+	h *= UINT64_C(0xBF58476D1CE4E5B9);
+
+	return (size_t) (h >> 32) & (nbuckets - 1U);
+}
+
+static void
+memo_ignore_resize(const size_t nbuckets)
+{
+	mowgli_list_t *const buckets = scalloc(nbuckets, sizeof *buckets);
+
+	for (size_t i = 0; i < memo_ignore_nbuckets; i++)
+	{
+		mowgli_node_t *n, *tn;
+
+		MOWGLI_ITER_FOREACH_SAFE(n, tn, memo_ignore_buckets[i].head)
+		{
+			struct memo_ignore *const mi = n->data;
+
+			mowgli_node_delete(&mi->hnode, &memo_ignore_buckets[i]);
+			mowgli_node_add(mi, &mi->hnode, &buckets[memo_ignore_bucket(mi->owner, mi->target, nbuckets)]);
+		}
+	}
+
+	sfree(memo_ignore_buckets);
+
+	memo_ignore_buckets = buckets;
+	memo_ignore_nbuckets = nbuckets;
+}
+
+struct memo_ignore *
+myuser_memo_ignore_find(const struct myuser *const restrict mu, const struct myuser *const restrict target)
+{
+	mowgli_node_t *n;
+
+	return_val_if_fail(mu != NULL, NULL);
+	return_val_if_fail(target != NULL, NULL);
+
+	if (! memo_ignore_count)
+		return NULL;
+
+	MOWGLI_ITER_FOREACH(n, memo_ignore_buckets[memo_ignore_bucket(mu, target, memo_ignore_nbuckets)].head)
+	{
+		struct memo_ignore *const mi = n->data;
+
+		if (mi->owner == mu && mi->target == target)
+			return mi;
+	}
+
+	return NULL;
+}
+
+// mu stops getting memos from target; NULL if they already had
+struct memo_ignore *
+myuser_memo_ignore_add(struct myuser *const restrict mu, struct myuser *const restrict target)
+{
+	struct memo_ignore *mi;
+
+	return_val_if_fail(mu != NULL, NULL);
+	return_val_if_fail(target != NULL, NULL);
+
+	if (myuser_memo_ignore_find(mu, target))
+		return NULL;
+
+	if (memo_ignore_count >= memo_ignore_nbuckets)
+		(void) memo_ignore_resize(memo_ignore_nbuckets ? (memo_ignore_nbuckets * 2U) : MEMO_IGNORE_BUCKETS_MIN);
+
+	mi = smalloc(sizeof *mi);
+	mi->owner = mu;
+	mi->target = target;
+
+	mowgli_node_add(mi, &mi->node, &mu->memo_ignores);
+	mowgli_node_add(mi, &mi->tnode, &target->memo_ignored_by);
+	mowgli_node_add(mi, &mi->hnode, &memo_ignore_buckets[memo_ignore_bucket(mu, target, memo_ignore_nbuckets)]);
+
+	memo_ignore_count++;
+
+	return mi;
+}
+
+void
+myuser_memo_ignore_delete(struct memo_ignore *const restrict mi)
+{
+	return_if_fail(mi != NULL);
+
+	mowgli_node_delete(&mi->node, &mi->owner->memo_ignores);
+	mowgli_node_delete(&mi->tnode, &mi->target->memo_ignored_by);
+	mowgli_node_delete(&mi->hnode, &memo_ignore_buckets[memo_ignore_bucket(mi->owner, mi->target,
+	                                                                         memo_ignore_nbuckets)]);
+
+	memo_ignore_count--;
+
+	sfree(mi);
+}
+
+// Everyone mu ignores, and everyone ignoring mu; for when it is dropped
+void
+myuser_memo_ignore_delete_all(struct myuser *const restrict mu)
+{
+	mowgli_node_t *n, *tn;
+
+	return_if_fail(mu != NULL);
+
+	MOWGLI_ITER_FOREACH_SAFE(n, tn, mu->memo_ignores.head)
+		(void) myuser_memo_ignore_delete(n->data);
+
+	MOWGLI_ITER_FOREACH_SAFE(n, tn, mu->memo_ignored_by.head)
+		(void) myuser_memo_ignore_delete(n->data);
+}
+
+// The account an ignore stored by name refers to, as MemoServ has always looked it up
+static struct myuser *
+memo_ignore_resolve(const char *const restrict name)
+{
+	struct mynick *mn;
+
+	if (nicksvs.no_nick_ownership)
+		return myuser_find(name);
+
+	mn = mynick_find(name);
+
+	return (mn != NULL) ? mn->owner : NULL;
+}
+
+// For the database backends
+void
+myuser_memo_ignore_add_name(struct myuser *const restrict mu, const char *const restrict name)
+{
+	struct myuser *target;
+
+	return_if_fail(mu != NULL);
+	return_if_fail(name != NULL);
+
+	if ((target = memo_ignore_resolve(name)) != NULL)
+	{
+		(void) myuser_memo_ignore_add(mu, target);
+		return;
+	}
+
+	if (memo_ignore_loaded)
+	{
+		slog(LG_DEBUG, "myuser_memo_ignore_add_name(): %s ignores unknown account %s", entity(mu)->name, name);
+		return;
+	}
+
+	struct memo_ignore_pending *const mp = smalloc(sizeof *mp);
+
+	(void) mowgli_strlcpy(mp->owner, entity(mu)->id, sizeof mp->owner);
+	mp->name = sstrdup(name);
+
+	mowgli_node_add(mp, &mp->node, &memo_ignore_pending);
+}
+
+static void
+memo_ignore_db_loaded(void ATHEME_VATTR_UNUSED *const restrict unused)
+{
+	mowgli_node_t *n, *tn;
+
+	memo_ignore_loaded = true;
+
+	MOWGLI_ITER_FOREACH_SAFE(n, tn, memo_ignore_pending.head)
+	{
+		struct memo_ignore_pending *const mp = n->data;
+		struct myuser *const mu = myuser_find_uid(mp->owner);
+
+		if (mu != NULL)
+			(void) myuser_memo_ignore_add_name(mu, mp->name);
+
+		mowgli_node_delete(&mp->node, &memo_ignore_pending);
+		sfree(mp->name);
+		sfree(mp);
+	}
+}
+
+void
+memo_ignore_init(void)
+{
+	hook_add_db_loaded(&memo_ignore_db_loaded);
+}
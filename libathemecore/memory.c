@@ -40,6 +40,8 @@
 #  endif
 #endif /* !HAVE_MEMSET_S && !HAVE_EXPLICIT_BZERO && !HAVE_EXPLICIT_MEMSET */
 
+unsigned long long memory_allocations = 0;
+
 void
 sfree(void *const restrict ptr)
 {
@@ -58,6 +60,8 @@ scalloc(const size_t num, const size_t len)
 {
 	void *const buf = calloc(num, len);
 
+	memory_allocations++;
+
 	if (! buf)
 		RAISE_EXCEPTION;
 
@@ -69,6 +73,9 @@ srealloc(void *const restrict ptr, const size_t len)
 {
 	void *const buf = realloc(ptr, len);
 
+	if (len)
+		memory_allocations++;
+
 	if (len && ! buf)
 		RAISE_EXCEPTION;
 
@@ -0,0 +1,451 @@
+/*
+ * SPDX-License-Identifier: ISC
+ * SPDX-URL: https://spdx.org/licenses/ISC.html
+ *
+ * Copyright (C) 2026 Atheme Development Group (https://atheme.github.io/)
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * atheme-services: A collection of minimalist IRC services
+ * memostore.c: Memo texts kept on disk.
+ *
+ * With general::memo_cold_storage, the text of every new memo is appended
+ * to services.db.memos.<generation> as a "<entity id> <length>" line
+ * followed by the text, and only its offset stays in memory; the database
+ * then stores offsets instead of texts (MO rows, with the generation in an
+ * MEG row). The file is never rewritten while services run. At startup,
+ * if more of it is dead than alive, the live records are copied to the
+ * next generation and the database is saved to point at it; older
+ * generations are removed at the following startup, when the database
+ * that was loaded says which one it uses.
+ */
+
+#include <atheme.h>
+#include "internal.h"
+
+#define MEMOSTORE_DB_NAME       "services.db"
+
+// "<entity id> <length>\n<text>\n"
+#define MEMOSTORE_RECORD_MAX    (IDLEN + 1U + 10U + 1U + MEMOLEN + 1U)
+
+// compact at startup once this much of the file is dead, and more of it than is alive
+#define MEMOSTORE_COMPACT_MIN   (1024U * 1024U)
+
+static const char memostore_unavailable[] = "(the text of this memo could not be read)";
+
+static int memostore_fd = -1;
+static unsigned int memostore_gen;
+static uint64_t memostore_size;         // where the next record goes
+static uint64_t memostore_live;         // bytes used by memos that still exist
+static bool memostore_failed;           // could not open or write it; new memos stay in memory
+
+static void
+memostore_path(char *const restrict buf, const size_t bufsize, const unsigned int gen)
+{
+	(void) snprintf(buf, bufsize, "%s/%s.memos.%u", datadir, MEMOSTORE_DB_NAME, gen);
+}
+
+static bool
+memostore_open(void)
+{
+	char path[BUFSIZE];
+	struct stat sb;
+
+	if (memostore_fd != -1)
+		return true;
+
+	if (memostore_failed)
+		return false;
+
+	memostore_path(path, sizeof path, memostore_gen);
+
+	if ((memostore_fd = open(path, O_RDWR | O_CREAT | O_APPEND, S_IRUSR | S_IWUSR)) == -1 ||
+	    fstat(memostore_fd, &sb) != 0)
+	{
+		const int errno1 = errno;
+
+		slog(LG_ERROR, "memostore: cannot open %s: %s", path, strerror(errno1));
+		wallops("\2DATABASE ERROR\2: memostore: cannot open %s: %s", path, strerror(errno1));
+
+		if (memostore_fd != -1)
+			(void) close(memostore_fd);
+
+		memostore_fd = -1;
+		memostore_failed = true;
+		return false;
+	}
+
+	memostore_size = (uint64_t) sb.st_size;
+
+	return true;
+}
+
+static bool
+memostore_write_all(const int fd, const char *data, size_t len)
+{
+	while (len > 0)
+	{
+		const ssize_t ret = write(fd, data, len);
+
+		if (ret < 0)
+		{
+			if (errno == EINTR)
+				continue;
+
+			return false;
+		}
+
+		data += ret;
+		len -= (size_t) ret;
+	}
+
+	return true;
+}
+
+// Reads the record of memo into rec (MEMOSTORE_RECORD_MAX + 1 bytes) and returns where its text starts
+static const char *
+memostore_read(const struct mymemo *const restrict memo, char *const restrict rec, size_t *const restrict textlen)
+{
+	const size_t len = memo->store_len;
+	const char *text;
+	char *end;
+	size_t done = 0;
+
+	if (len < 4 || len > MEMOSTORE_RECORD_MAX || ! memostore_open())
+		return NULL;
+
+	while (done < len)
+	{
+		const ssize_t ret = pread(memostore_fd, rec + done, len - done, (off_t) (memo->store_offset + done));
+
+		if (ret < 0 && errno == EINTR)
+			continue;
+
+		if (ret <= 0)
+			return NULL;
+
+		done += (size_t) ret;
+	}
+
+	rec[len] = '\0';
+
+	if (rec[len - 1] != '\n' || (text = memchr(rec, '\n', len)) == NULL || ! memchr(rec, ' ', (size_t) (text - rec)))
+		return NULL;
+
+	text++;
+	*textlen = (size_t) strtoul(strchr(rec, ' ') + 1, &end, 10);
+
+	if (*end != '\n' || *textlen != len - (size_t) (text - rec) - 1)
+		return NULL;
+
+	return text;
+}
+
+static void memostore_compact(void *);
+
+static bool
+memostore_append(struct mymemo *const restrict memo, const struct myuser *const restrict owner,
+                 const char *const restrict text)
+{
+	char rec[MEMOSTORE_RECORD_MAX + 1];
+	const size_t textlen = strnlen(text, MEMOLEN);
+	const int len = snprintf(rec, sizeof rec, "%s %zu\n%.*s\n", ((const struct myentity *) owner)->id, textlen, (int) textlen, text);
+
+	if (len <= 0 || (size_t) len > MEMOSTORE_RECORD_MAX || ! memostore_open())
+		return false;
+
+	if (! memostore_write_all(memostore_fd, rec, (size_t) len))
+	{
+		const int errno1 = errno;
+
+		slog(LG_ERROR, "memostore: cannot write generation %u: %s; keeping new memos in memory",
+		     memostore_gen, strerror(errno1));
+		wallops("\2DATABASE ERROR\2: memostore: cannot write generation %u: %s", memostore_gen, strerror(errno1));
+
+		memostore_failed = true;
+
+		// don't leave half a record for the next one to be appended to
+		if (ftruncate(memostore_fd, (off_t) memostore_size) != 0)
+		{
+			const int errno2 = errno;
+
+			slog(LG_ERROR, "memostore: cannot truncate generation %u back to %llu bytes: %s; "
+			     "compacting it", memostore_gen, (unsigned long long) memostore_size, strerror(errno2));
+
+			// the live records go to a new generation, leaving the partial one behind
+			(void) timer_add_once("memostore_compact", &memostore_compact, NULL, 1);
+		}
+
+		return false;
+	}
+
+	memo->store_offset = memostore_size;
+	memo->store_len = (unsigned int) len;
+
+	memostore_size += (uint64_t) len;
+	memostore_live += (uint64_t) len;
+
+	return true;
+}
+
+void
+memo_set_text(struct mymemo *const restrict memo, const struct myuser *const restrict owner,
+              const char *const restrict text)
+{
+	return_if_fail(memo != NULL);
+	return_if_fail(owner != NULL);
+	return_if_fail(text != NULL);
+
+	if (config_options.memo_cold_storage && ! memostore_failed && memostore_append(memo, owner, text))
+		return;
+
+	memo->text = sstrndup(text, MEMOLEN);
+}
+
+const char *
+memo_text(const struct mymemo *const restrict memo)
+{
+	static char buf[MEMOLEN + 1];
+	char rec[MEMOSTORE_RECORD_MAX + 1];
+	const char *text;
+	size_t textlen;
+
+	return_val_if_fail(memo != NULL, memostore_unavailable);
+
+	if (memo->text != NULL)
+		return memo->text;
+
+	if ((text = memostore_read(memo, rec, &textlen)) == NULL)
+	{
+		slog(LG_ERROR, "memostore: cannot read the memo at offset %llu of generation %u",
+		     (unsigned long long) memo->store_offset, memostore_gen);
+
+		return memostore_unavailable;
+	}
+
+	(void) mowgli_strlcpy(buf, text, (textlen < sizeof buf) ? textlen + 1 : sizeof buf);
+
+	return buf;
+}
+
+void
+memo_free(struct mymemo *const restrict memo)
+{
+	return_if_fail(memo != NULL);
+
+	if (memo->store_len)
+		memostore_live -= memo->store_len;
+
+	(void) sfree(memo->text);
+	(void) sfree(memo);
+}
+
+unsigned int
+memostore_generation(void)
+{
+	return memostore_gen;
+}
+
+// Whether the database has to say which generation of the store it uses
+bool
+memostore_in_use(void)
+{
+	return memostore_live > 0 || memostore_gen > 0;
+}
+
+void
+memostore_set_generation(const unsigned int gen)
+{
+	if (gen == memostore_gen)
+		return;
+
+	if (memostore_fd != -1)
+		(void) close(memostore_fd);
+
+	memostore_fd = -1;
+	memostore_gen = gen;
+	memostore_size = 0;
+	memostore_failed = false;
+}
+
+/*
+ * memo_set_stored()
+ *
+ * Points a memo being loaded from the database at its record in the store.
+ * Without general::memo_cold_storage, the text is read back into memory
+ * straight away, and the memo is written out in full with the next save.
+ *
+ * Returns false if the record cannot be used.
+ */
+bool
+memo_set_stored(struct mymemo *const restrict memo, const uint64_t offset, const unsigned int len)
+{
+	return_val_if_fail(memo != NULL, false);
+
+	if (len < 4 || len > MEMOSTORE_RECORD_MAX)
+		return false;
+
+	memo->store_offset = offset;
+	memo->store_len = len;
+	memostore_live += len;
+
+	if (! config_options.memo_cold_storage)
+	{
+		char rec[MEMOSTORE_RECORD_MAX + 1];
+		const char *text;
+		size_t textlen;
+
+		if ((text = memostore_read(memo, rec, &textlen)) == NULL)
+			return true;
+
+		memo->text = sstrndup(text, textlen);
+		memo->store_len = 0;
+		memostore_live -= len;
+	}
+
+	return true;
+}
+
+// Called before the database is written, so that it never points past what is on disk
+void
+memostore_sync(void)
+{
+	if (memostore_fd != -1 && fsync(memostore_fd) != 0)
+		slog(LG_ERROR, "memostore: cannot fsync generation %u: %s", memostore_gen, strerror(errno));
+}
+
+static bool
+memostore_unlink(const unsigned int gen)
+{
+	char path[BUFSIZE];
+
+	memostore_path(path, sizeof path, gen);
+
+	if (unlink(path) != 0)
+		return false;
+
+	slog(LG_DEBUG, "memostore: removed superseded %s", path);
+	return true;
+}
+
+static void
+memostore_compact(void ATHEME_VATTR_UNUSED *const restrict unused)
+{
+	struct myentity_iteration_state state;
+	struct myentity *mt;
+	mowgli_node_t *n;
+	char path[BUFSIZE];
+	char rec[MEMOSTORE_RECORD_MAX + 1];
+	const unsigned int gen = memostore_gen + 1;
+	const uint64_t oldsize = memostore_size;
+	uint64_t size = 0;
+	int fd;
+
+	memostore_path(path, sizeof path, gen);
+
+	if ((fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, S_IRUSR | S_IWUSR)) == -1)
+	{
+		slog(LG_ERROR, "memostore: cannot compact into %s: %s", path, strerror(errno));
+		return;
+	}
+
+	// The offsets are only changed once the new file is complete
+	MYENTITY_FOREACH_T(mt, &state, ENT_USER)
+	{
+		MOWGLI_ITER_FOREACH(n, user(mt)->memos.head)
+		{
+			const struct mymemo *const memo = n->data;
+			size_t textlen;
+
+			if (! memo->store_len)
+				continue;
+
+			if (! memostore_read(memo, rec, &textlen) || ! memostore_write_all(fd, rec, memo->store_len))
+			{
+				slog(LG_ERROR, "memostore: cannot compact into %s: cannot copy the memos of %s",
+				     path, mt->name);
+				goto fail;
+			}
+		}
+	}
+
+	if (fsync(fd) != 0)
+	{
+		slog(LG_ERROR, "memostore: cannot compact into %s: %s", path, strerror(errno));
+		goto fail;
+	}
+
+	MYENTITY_FOREACH_T(mt, &state, ENT_USER)
+	{
+		MOWGLI_ITER_FOREACH(n, user(mt)->memos.head)
+		{
+			struct mymemo *const memo = n->data;
+
+			if (! memo->store_len)
+				continue;
+
+			memo->store_offset = size;
+			size += memo->store_len;
+		}
+	}
+
+	(void) close(memostore_fd);
+
+	(void) close(fd);
+
+	memostore_gen = gen;
+	memostore_fd = -1;
+	memostore_size = size;
+	memostore_live = size;
+	memostore_failed = false;
+
+	(void) memostore_open();
+
+	slog(LG_INFO, "memostore: compacted from %llu to %llu bytes (generation %u)",
+	     (unsigned long long) oldsize, (unsigned long long) size, gen);
+
+	// the database must know about the new generation before the old one goes
+	if (db_save)
+		db_save(NULL, DB_SAVE_BLOCKING);
+
+	return;
+
+fail:
+	(void) close(fd);
+	(void) unlink(path);
+}
+
+static void
+memostore_db_loaded(void ATHEME_VATTR_UNUSED *const restrict unused)
+{
+	if (readonly || database_create)
+		return;
+
+	/* The generation the database uses is known now; older ones and a
+	 * compaction that was never saved can go.
+	 */
+	for (unsigned int gen = memostore_gen; gen-- > 0; )
+		if (! memostore_unlink(gen))
+			break;
+
+	(void) memostore_unlink(memostore_gen + 1);
+
+	if (! config_options.memo_cold_storage || ! memostore_open())
+		return;
+
+	const uint64_t dead = memostore_size - memostore_live;
+
+	/* Not from here: other modules (backend/journal) are still loading,
+	 * and the save that follows a compaction has to see all they loaded.
+	 */
+	if (dead >= MEMOSTORE_COMPACT_MIN && dead > memostore_live)
+		(void) timer_add_once("memostore_compact", &memostore_compact, NULL, 1);
+}
+
+void
+memostore_init(void)
+{
+	hook_add_db_loaded(&memostore_db_loaded);
+}
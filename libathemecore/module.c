@@ -22,15 +22,26 @@
 #endif
 
 static mowgli_list_t modules_being_loaded;
-static mowgli_heap_t *module_heap = NULL;
+static struct named_heap *module_heap = NULL;
 static struct module *current_module = NULL;
 
 mowgli_list_t modules;
 
+/*
+ * module_current()
+ *
+ * Returns the module whose initialisation is running right now, if any.
+ */
+struct module *
+module_current(void)
+{
+	return current_module;
+}
+
 void
 modules_init(void)
 {
-	if (! (module_heap = sharedheap_get(sizeof(struct module))))
+	if (! (module_heap = named_heap_get("module", sizeof(struct module))))
 	{
 		(void) slog(LG_ERROR, "%s: block allocator failed", MOWGLI_FUNC_NAME);
 
@@ -111,7 +122,7 @@ module_load_internal(const char *const restrict pathname, char *const restrict e
 		return NULL;
 	}
 
-	struct module *const m = mowgli_heap_alloc(module_heap);
+	struct module *const m = named_heap_alloc(module_heap);
 
 	(void) mowgli_strlcpy(m->modpath, pathname, sizeof m->modpath);
 	(void) mowgli_strlcpy(m->name, h->name, sizeof m->name);
@@ -169,8 +180,12 @@ module_load_internal(const char *const restrict pathname, char *const restrict e
 
 		current_module = m;
 
+		struct startup_mark sm;
+
 		(void) mowgli_node_add(m, &m->mbl_node, &modules_being_loaded);
+		(void) startup_mark(&sm);
 		(void) h->modinit(m);
+		(void) startup_record(&sm, m->name, STARTUP_MODULE);
 		(void) mowgli_node_delete(&m->mbl_node, &modules_being_loaded);
 
 		current_module = cmt;
@@ -238,6 +253,9 @@ module_load(const char *const restrict filespec)
 		return NULL;
 	}
 
+	// A module declared in lazymodule{} may be loaded some other way before it is needed
+	(void) module_lazy_disarm(filespec);
+
 	struct module *m;
 	if ((m = module_find(pathname)))
 	{
@@ -337,7 +355,10 @@ module_unload(struct module *const restrict m, const enum module_unload_intent i
 	if (m->handle)
 	{
 		(void) mowgli_module_close(m->handle);
-		(void) mowgli_heap_free(module_heap, m);
+		(void) named_heap_free(module_heap, m);
+
+		// Its strings may have been cached by address
+		(void) translation_cache_flush();
 	}
 	else if (m->unload_handler)
 		(void) m->unload_handler(m, intent);
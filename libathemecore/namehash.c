@@ -0,0 +1,190 @@
+/*
+ * SPDX-License-Identifier: ISC
+ * SPDX-URL: https://spdx.org/licenses/ISC.html
+ *
+ * Copyright (C) 2026 Atheme Development Group (https://atheme.github.io/)
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * atheme-services: A collection of minimalist IRC services
+ * namehash.c: Open-addressing hash tables for name lookups.
+ *
+ * Linear probing over a power-of-two table kept at most 3/4 full, with the
+ * hash of every key stored next to it so that probes only compare strings
+ * that are very likely to match. Deletion shifts the following entries of
+ * the run back instead of leaving tombstones, so lookups never slow down
+ * as users and channels come and go.
+ *
+ * A folding table hashes through the same casemapping as irccasecanon, so
+ * it agrees with the patricia trees about which names are the same.
+ */
+
+#include <atheme.h>
+#include "internal.h"
+
+#define NAMEHASH_MIN_SLOTS      256U
+
+#define FNV1A_OFFSET            0x811C9DC5U
+#define FNV1A_PRIME             0x01000193U
+
+unsigned int
+namehash_key(const char *const restrict key, const bool fold)
+{
+	const unsigned char *p = (const unsigned char *) key;
+	unsigned int hash = FNV1A_OFFSET;
+
+	if (! fold)
+	{
+		for (; *p != '\0'; p++)
+			hash = (hash ^ *p) * FNV1A_PRIME;
+	}
+	else if (match_mapping == MATCH_ASCII)
+	{
+		for (; *p != '\0'; p++)
+			hash = (hash ^ (unsigned char) toupper(*p)) * FNV1A_PRIME;
+	}
+	else
+	{
+		for (; *p != '\0'; p++)
+			hash = (hash ^ ToUpperTab[*p]) * FNV1A_PRIME;
+	}
+
+	return hash;
+}
+
+static inline unsigned int
+namehash_hash(const struct namehash *const restrict h, const char *const restrict key)
+{
+	return namehash_key(key, h->fold);
+}
+
+static inline bool
+namehash_equal(const struct namehash *const restrict h, const char *const restrict a, const char *const restrict b)
+{
+	return (h->fold ? irccasecmp(a, b) : strcmp(a, b)) == 0;
+}
+
+static void
+namehash_insert_slot(struct namehash *const restrict h, const char *const restrict key, void *const restrict value,
+                     const unsigned int hash)
+{
+	unsigned int i = hash & h->mask;
+
+	while (h->slots[i].key != NULL)
+		i = (i + 1) & h->mask;
+
+	h->slots[i].key = key;
+	h->slots[i].value = value;
+	h->slots[i].hash = hash;
+}
+
+static void
+namehash_resize(struct namehash *const restrict h, const unsigned int size)
+{
+	struct namehash_slot *const old = h->slots;
+	const unsigned int oldsize = h->mask + 1;
+
+	h->slots = scalloc(size, sizeof *h->slots);
+	h->mask = size - 1;
+
+	for (unsigned int i = 0; i < oldsize; i++)
+		if (old[i].key != NULL)
+			namehash_insert_slot(h, old[i].key, old[i].value, old[i].hash);
+
+	sfree(old);
+}
+
+struct namehash *
+namehash_create(const bool fold)
+{
+	struct namehash *const h = smalloc(sizeof *h);
+
+	h->slots = scalloc(NAMEHASH_MIN_SLOTS, sizeof *h->slots);
+	h->mask = NAMEHASH_MIN_SLOTS - 1;
+	h->count = 0;
+	h->fold = fold;
+
+	return h;
+}
+
+void
+namehash_destroy(struct namehash *const restrict h)
+{
+	return_if_fail(h != NULL);
+
+	sfree(h->slots);
+	sfree(h);
+}
+
+void
+namehash_add(struct namehash *const restrict h, const char *const restrict key, void *const restrict value)
+{
+	return_if_fail(h != NULL);
+	return_if_fail(key != NULL);
+
+	if ((h->count + 1) * 4 > (h->mask + 1) * 3)
+		namehash_resize(h, (h->mask + 1) * 2);
+
+	namehash_insert_slot(h, key, value, namehash_hash(h, key));
+	h->count++;
+}
+
+/*
+ * namehash_delete()
+ *
+ * Removes the entry for value, which was added under key. Entries are
+ * matched by value rather than by comparing keys, so that a duplicate key
+ * (a nick collision being resolved) cannot take the wrong entry out.
+ */
+bool
+namehash_delete(struct namehash *const restrict h, const char *const restrict key, const void *const restrict value)
+{
+	return_val_if_fail(h != NULL, false);
+	return_val_if_fail(key != NULL, false);
+
+	const unsigned int hash = namehash_hash(h, key);
+	unsigned int i = hash & h->mask;
+
+	while (h->slots[i].key != NULL && (h->slots[i].value != value || h->slots[i].hash != hash))
+		i = (i + 1) & h->mask;
+
+	if (h->slots[i].key == NULL)
+		return false;
+
+	// Move later members of the run back into the hole whenever their home slot allows it
+	for (unsigned int j = (i + 1) & h->mask; h->slots[j].key != NULL; j = (j + 1) & h->mask)
+	{
+		const unsigned int home = h->slots[j].hash & h->mask;
+
+		if (((j - home) & h->mask) >= ((j - i) & h->mask))
+		{
+			h->slots[i] = h->slots[j];
+			i = j;
+		}
+	}
+
+	h->slots[i].key = NULL;
+	h->slots[i].value = NULL;
+	h->count--;
+
+	return true;
+}
+
+void *
+namehash_find(const struct namehash *const restrict h, const char *const restrict key)
+{
+	return_val_if_fail(h != NULL, NULL);
+
+	if (key == NULL)
+		return NULL;
+
+	const unsigned int hash = namehash_hash(h, key);
+
+	for (unsigned int i = hash & h->mask; h->slots[i].key != NULL; i = (i + 1) & h->mask)
+		if (h->slots[i].hash == hash && namehash_equal(h, h->slots[i].key, key))
+			return h->slots[i].value;
+
+	return NULL;
+}
@@ -0,0 +1,327 @@
+/*
+ * SPDX-License-Identifier: ISC
+ * SPDX-URL: https://spdx.org/licenses/ISC.html
+ *
+ * Copyright (C) 2026 Atheme Development Group (https://atheme.github.io/)
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * atheme-services: A collection of minimalist IRC services
+ * netstats.c: Network size over time.
+ *
+ * The hooks only bump the counters of the minute in progress. Once a minute
+ * that sample is finished and pushed onto the minute ring, and folded into
+ * the hour in progress; an hour is pushed and folded into its day when a
+ * minute from the next hour arrives, and likewise for days. Nothing here
+ * ever walks the user, channel or server lists.
+ */
+
+#include <atheme.h>
+#include "internal.h"
+
+struct netstats_ring
+{
+	const char *                    name;
+	unsigned int                    period;         // seconds
+	unsigned int                    size;
+	unsigned int                    head;           // where the next sample goes
+	unsigned int                    count;
+	struct netstats_sample *        samples;
+	struct netstats_sample          pending;
+	bool                            have_pending;
+};
+
+static struct netstats_sample netstats_minutes[NETSTATS_MINUTES];
+static struct netstats_sample netstats_hours[NETSTATS_HOURS];
+static struct netstats_sample netstats_days[NETSTATS_DAYS];
+
+static struct netstats_ring netstats_rings[NETSTATS_RESOLUTION_COUNT] = {
+	[NETSTATS_MINUTE] = { "MINUTE", SECONDS_PER_MINUTE, NETSTATS_MINUTES, 0, 0, netstats_minutes, { 0 }, false },
+	[NETSTATS_HOUR]   = { "HOUR",   SECONDS_PER_HOUR,   NETSTATS_HOURS,   0, 0, netstats_hours,   { 0 }, false },
+	[NETSTATS_DAY]    = { "DAY",    SECONDS_PER_DAY,    NETSTATS_DAYS,    0, 0, netstats_days,    { 0 }, false },
+};
+
+static const char *const netstats_metric_names[NETSTATS_METRIC_COUNT] = {
+	[NETSTATS_USERS]    = "users",
+	[NETSTATS_CHANNELS] = "channels",
+	[NETSTATS_SERVERS]  = "servers",
+};
+
+static unsigned int
+netstats_level(const enum netstats_metric metric)
+{
+	switch (metric)
+	{
+		case NETSTATS_USERS:
+			return cnt.user;
+		case NETSTATS_CHANNELS:
+			return cnt.chan;
+		case NETSTATS_SERVERS:
+			return cnt.server;
+		case NETSTATS_METRIC_COUNT:
+			break;
+	}
+
+	return 0;
+}
+
+// The minute in progress; started on first use
+static struct netstats_sample *
+netstats_minute(void)
+{
+	struct netstats_ring *const ring = &netstats_rings[NETSTATS_MINUTE];
+
+	if (! ring->have_pending)
+	{
+		(void) memset(&ring->pending, 0x00, sizeof ring->pending);
+
+		ring->pending.start = CURRTIME;
+
+		for (unsigned int i = 0; i < NETSTATS_METRIC_COUNT; i++)
+			ring->pending.values[i].peak = netstats_level(i);
+
+		ring->have_pending = true;
+	}
+
+	return &ring->pending;
+}
+
+static void
+netstats_added(const enum netstats_metric metric)
+{
+	struct netstats_value *const v = &netstats_minute()->values[metric];
+	const unsigned int level = netstats_level(metric);
+
+	v->added++;
+
+	if (level > v->peak)
+		v->peak = level;
+}
+
+static void
+netstats_removed(const enum netstats_metric metric)
+{
+	netstats_minute()->values[metric].removed++;
+}
+
+static void
+netstats_user_add(struct hook_user_nick ATHEME_VATTR_UNUSED *const restrict data)
+{
+	netstats_added(NETSTATS_USERS);
+}
+
+static void
+netstats_user_delete(struct user ATHEME_VATTR_UNUSED *const restrict u)
+{
+	netstats_removed(NETSTATS_USERS);
+}
+
+static void
+netstats_channel_add(struct channel ATHEME_VATTR_UNUSED *const restrict c)
+{
+	netstats_added(NETSTATS_CHANNELS);
+}
+
+static void
+netstats_channel_delete(struct channel ATHEME_VATTR_UNUSED *const restrict c)
+{
+	netstats_removed(NETSTATS_CHANNELS);
+}
+
+static void
+netstats_server_add(struct server ATHEME_VATTR_UNUSED *const restrict s)
+{
+	netstats_added(NETSTATS_SERVERS);
+}
+
+static void
+netstats_server_delete(struct hook_server_delete ATHEME_VATTR_UNUSED *const restrict data)
+{
+	netstats_removed(NETSTATS_SERVERS);
+}
+
+static void
+netstats_push(struct netstats_ring *const restrict ring, const struct netstats_sample *const restrict sample)
+{
+	ring->samples[ring->head] = *sample;
+	ring->head = (ring->head + 1) % ring->size;
+
+	if (ring->count < ring->size)
+		ring->count++;
+}
+
+static void
+netstats_fold(const enum netstats_resolution res, const struct netstats_sample *const restrict sample)
+{
+	if (res >= NETSTATS_RESOLUTION_COUNT)
+		return;
+
+	struct netstats_ring *const ring = &netstats_rings[res];
+
+	if (ring->have_pending && sample->start / ring->period != ring->pending.start / ring->period)
+	{
+		netstats_push(ring, &ring->pending);
+		netstats_fold(res + 1, &ring->pending);
+
+		ring->have_pending = false;
+	}
+
+	if (! ring->have_pending)
+	{
+		ring->pending = *sample;
+		ring->have_pending = true;
+		return;
+	}
+
+	ring->pending.end = sample->end;
+
+	for (unsigned int i = 0; i < NETSTATS_METRIC_COUNT; i++)
+	{
+		struct netstats_value *const into = &ring->pending.values[i];
+		const struct netstats_value *const from = &sample->values[i];
+
+		into->last = from->last;
+		into->added += from->added;
+		into->removed += from->removed;
+
+		if (from->peak > into->peak)
+			into->peak = from->peak;
+	}
+}
+
+static void
+netstats_finish_minute(void)
+{
+	struct netstats_ring *const ring = &netstats_rings[NETSTATS_MINUTE];
+	struct netstats_sample *const sample = netstats_minute();
+
+	sample->end = CURRTIME;
+
+	for (unsigned int i = 0; i < NETSTATS_METRIC_COUNT; i++)
+	{
+		struct netstats_value *const v = &sample->values[i];
+
+		v->last = netstats_level(i);
+
+		if (v->last > v->peak)
+			v->peak = v->last;
+	}
+
+	ring->have_pending = false;
+
+	netstats_push(ring, sample);
+	netstats_fold(NETSTATS_HOUR, sample);
+}
+
+static void
+netstats_tick(void ATHEME_VATTR_UNUSED *const restrict unused)
+{
+	netstats_finish_minute();
+	(void) netstats_minute();
+}
+
+const char *
+netstats_metric_name(const enum netstats_metric metric)
+{
+	return_val_if_fail(metric < NETSTATS_METRIC_COUNT, "unknown");
+
+	return netstats_metric_names[metric];
+}
+
+const char *
+netstats_resolution_name(const enum netstats_resolution res)
+{
+	return_val_if_fail(res < NETSTATS_RESOLUTION_COUNT, "UNKNOWN");
+
+	return netstats_rings[res].name;
+}
+
+bool
+netstats_resolution_parse(const char *const restrict name, enum netstats_resolution *const restrict res)
+{
+	return_val_if_fail(name != NULL, false);
+	return_val_if_fail(res != NULL, false);
+
+	for (unsigned int i = 0; i < NETSTATS_RESOLUTION_COUNT; i++)
+	{
+		if (strcasecmp(name, netstats_rings[i].name) != 0)
+			continue;
+
+		*res = i;
+		return true;
+	}
+
+	return false;
+}
+
+unsigned int
+netstats_resolution_size(const enum netstats_resolution res)
+{
+	return_val_if_fail(res < NETSTATS_RESOLUTION_COUNT, 0);
+
+	return netstats_rings[res].size;
+}
+
+bool
+netstats_current(const enum netstats_resolution res, struct netstats_sample *const restrict sample)
+{
+	return_val_if_fail(res < NETSTATS_RESOLUTION_COUNT, false);
+	return_val_if_fail(sample != NULL, false);
+
+	const struct netstats_ring *const ring = &netstats_rings[res];
+
+	if (! ring->have_pending)
+		return false;
+
+	*sample = ring->pending;
+
+	if (res != NETSTATS_MINUTE)
+		return true;
+
+	sample->end = CURRTIME;
+
+	for (unsigned int i = 0; i < NETSTATS_METRIC_COUNT; i++)
+	{
+		struct netstats_value *const v = &sample->values[i];
+
+		v->last = netstats_level(i);
+
+		if (v->last > v->peak)
+			v->peak = v->last;
+	}
+
+	return true;
+}
+
+unsigned int
+netstats_history_foreach(const enum netstats_resolution res, const unsigned int max,
+                         void (*cb)(const struct netstats_sample *, void *), void *const restrict privdata)
+{
+	return_val_if_fail(res < NETSTATS_RESOLUTION_COUNT, 0);
+	return_val_if_fail(cb != NULL, 0);
+
+	const struct netstats_ring *const ring = &netstats_rings[res];
+	const unsigned int count = (max < ring->count) ? max : ring->count;
+
+	for (unsigned int i = 0; i < count; i++)
+		cb(&ring->samples[(ring->head + ring->size - 1 - i) % ring->size], privdata);
+
+	return count;
+}
+
+void
+netstats_init(void)
+{
+	hook_add_user_add(&netstats_user_add);
+	hook_add_user_delete(&netstats_user_delete);
+	hook_add_channel_add(&netstats_channel_add);
+	hook_add_channel_delete(&netstats_channel_delete);
+	hook_add_server_add(&netstats_server_add);
+	hook_add_server_delete(&netstats_server_delete);
+
+	(void) netstats_minute();
+
+	(void) timer_add("netstats_tick", &netstats_tick, NULL, SECONDS_PER_MINUTE);
+}
@@ -20,9 +20,37 @@ mowgli_list_t klnlist;
 mowgli_list_t xlnlist;
 mowgli_list_t qlnlist;
 
-static mowgli_heap_t *kline_heap = NULL;	/* 16 */
-static mowgli_heap_t *xline_heap = NULL;	/* 16 */
-static mowgli_heap_t *qline_heap = NULL;	/* 16 */
+static struct named_heap *kline_heap = NULL;	/* 16 */
+static struct named_heap *xline_heap = NULL;	/* 16 */
+static struct named_heap *qline_heap = NULL;	/* 16 */
+
+static mowgli_patricia_t *kline_hosts = NULL;
+static mowgli_patricia_t *kline_numbers = NULL;
+static struct cidr_tree *kline_cidrs = NULL;
+static mowgli_list_t kline_wildlist;
+static unsigned long kline_serial = 0;
+static unsigned int kline_number_dups = 0;
+
+// Klines from kline_add_bulk() still to be sent, KLINE_PROPAGATE_RATE a second
+#define KLINE_PROPAGATE_RATE    50U
+
+static mowgli_list_t kline_propagate_queue;
+static mowgli_eventloop_timer_t *kline_propagate_timer = NULL;
+
+// See the mask index section below
+#define MASK_INDEX_PREFIX_MAX   64U
+
+struct mask_index
+{
+	mowgli_patricia_t *     exact;
+	mowgli_patricia_t *     prefixes;
+	unsigned int            prefix_lens[MASK_INDEX_PREFIX_MAX + 1U];
+	mowgli_list_t           wild;
+	unsigned long           serial;
+};
+
+static struct mask_index xline_index;
+static struct mask_index qline_index;
 
 /*************
  * L I S T S *
@@ -31,9 +59,9 @@ static mowgli_heap_t *qline_heap = NULL;	/* 16 */
 void
 init_nodes(void)
 {
-	kline_heap = sharedheap_get(sizeof(struct kline));
-	xline_heap = sharedheap_get(sizeof(struct xline));
-	qline_heap = sharedheap_get(sizeof(struct qline));
+	kline_heap = named_heap_get("kline", sizeof(struct kline));
+	xline_heap = named_heap_get("xline", sizeof(struct xline));
+	qline_heap = named_heap_get("qline", sizeof(struct qline));
 
 	if (kline_heap == NULL || xline_heap == NULL || qline_heap == NULL)
 	{
@@ -41,12 +69,21 @@ init_nodes(void)
 		exit(EXIT_FAILURE);
 	}
 
+	kline_hosts = mowgli_patricia_create(irccasecanon);
+	kline_numbers = mowgli_patricia_create(noopcanon);
+	kline_cidrs = cidr_tree_create();
+	xline_index.exact = mowgli_patricia_create(irccasecanon);
+	xline_index.prefixes = mowgli_patricia_create(irccasecanon);
+	qline_index.exact = mowgli_patricia_create(irccasecanon);
+	qline_index.prefixes = mowgli_patricia_create(irccasecanon);
+
 	init_uplinks();
 	init_servers();
 	init_metadata();
 	init_accounts();
 	init_entities();
 	init_users();
+	init_burst();
 	init_channels();
 	init_privs();
 }
@@ -114,15 +151,255 @@ remove_illegals()
  * K L I N E *
  *************/
 
-struct kline *
-kline_add_with_id(const char *user, const char *host, const char *reason, long duration, const char *setby, unsigned long id)
+/*
+ * K-lines are indexed by host mask so that kline_find_user() does not have
+ * to glob-match every entry for every connecting user:
+ *
+ *   - masks without wildcards are kept in per-host buckets in kline_hosts,
+ *   - those that are also valid CIDR masks are kept in kline_cidrs too,
+ *   - everything else lives in kline_wildlist and is matched the slow way.
+ *
+ * Every list involved is kept in insertion order and each kline carries a
+ * serial number, so that when several klines match a user, the one returned
+ * is the one that came first in klnlist, as it always has been.
+ */
+static inline bool
+kline_host_is_literal(const char *host)
+{
+	// These are all special to match(), see libathemecore/match.c
+	return *host != '\0' && strpbrk(host, "*?&#%\\") == NULL;
+}
+
+static void
+kline_index_add(struct kline *k)
+{
+	char numbuf[BUFSIZE];
+
+	k->serial = ++kline_serial;
+	k->userpat = match_compile(k->user);
+
+	if (kline_host_is_literal(k->host))
+	{
+		mowgli_list_t *bucket = mowgli_patricia_retrieve(kline_hosts, k->host);
+		struct cidr_addr ca;
+
+		if (bucket == NULL)
+		{
+			bucket = mowgli_list_create();
+			mowgli_patricia_add(kline_hosts, k->host, bucket);
+		}
+
+		mowgli_node_add(k, &k->hostnode, bucket);
+
+		if (cidr_parse_mask(k->host, &ca))
+			k->cidrleaf = cidr_tree_add(kline_cidrs, &ca, k, &k->cidrnode);
+	}
+	else
+	{
+		k->hostpat = match_compile(k->host);
+		mowgli_node_add(k, &k->hostnode, &kline_wildlist);
+	}
+
+	(void) snprintf(numbuf, sizeof numbuf, "%lu", k->number);
+
+	if (! mowgli_patricia_add(kline_numbers, numbuf, k))
+		kline_number_dups++;
+}
+
+static void
+kline_index_delete(struct kline *k)
+{
+	char numbuf[BUFSIZE];
+
+	if (kline_host_is_literal(k->host))
+	{
+		mowgli_list_t *const bucket = mowgli_patricia_retrieve(kline_hosts, k->host);
+
+		mowgli_node_delete(&k->hostnode, bucket);
+
+		if (! MOWGLI_LIST_LENGTH(bucket))
+		{
+			(void) mowgli_patricia_delete(kline_hosts, k->host);
+			mowgli_list_free(bucket);
+		}
+
+		if (k->cidrleaf != NULL)
+		{
+			cidr_tree_delete(kline_cidrs, k->cidrleaf, &k->cidrnode);
+			k->cidrleaf = NULL;
+		}
+	}
+	else
+	{
+		mowgli_node_delete(&k->hostnode, &kline_wildlist);
+		match_pattern_free(k->hostpat);
+		k->hostpat = NULL;
+	}
+
+	match_pattern_free(k->userpat);
+	k->userpat = NULL;
+
+	(void) snprintf(numbuf, sizeof numbuf, "%lu", k->number);
+
+	if (mowgli_patricia_retrieve(kline_numbers, numbuf) != k)
+		return;
+
+	(void) mowgli_patricia_delete(kline_numbers, numbuf);
+
+	// Hand the number over to the next kline that shares it, if any
+	if (kline_number_dups)
+	{
+		mowgli_node_t *n;
+
+		MOWGLI_ITER_FOREACH(n, klnlist.head)
+		{
+			struct kline *const dup = n->data;
+
+			if (dup != k && dup->number == k->number)
+			{
+				(void) mowgli_patricia_add(kline_numbers, numbuf, dup);
+				kline_number_dups--;
+				break;
+			}
+		}
+	}
+}
+
+static inline bool
+kline_matches_user(const struct kline *k, const struct user *u)
+{
+	if (k->duration != 0 && k->expires <= CURRTIME)
+		return false;
+
+	return !match_compiled(k->userpat, u->user);
+}
+
+static inline struct kline *
+kline_first_of(struct kline *best, struct kline *k)
+{
+	return (best == NULL || k->serial < best->serial) ? k : best;
+}
+
+struct kline_user_search
+{
+	const struct user *     u;
+	struct kline *          best;
+};
+
+static void
+kline_find_user_cidr_cb(mowgli_list_t *entries, void *privdata)
+{
+	struct kline_user_search *const search = privdata;
+	mowgli_node_t *n;
+
+	MOWGLI_ITER_FOREACH(n, entries->head)
+	{
+		struct kline *const k = n->data;
+
+		if (search->best != NULL && k->serial > search->best->serial)
+			break;
+
+		if (kline_matches_user(k, search->u))
+		{
+			search->best = kline_first_of(search->best, k);
+			break;
+		}
+	}
+}
+
+static struct kline *
+kline_find_user_bucket(struct kline *best, const char *host, const struct user *u)
+{
+	mowgli_list_t *bucket;
+	mowgli_node_t *n;
+
+	if (host == NULL || *host == '\0' || (bucket = mowgli_patricia_retrieve(kline_hosts, host)) == NULL)
+		return best;
+
+	MOWGLI_ITER_FOREACH(n, bucket->head)
+	{
+		struct kline *const k = n->data;
+
+		if (best != NULL && k->serial > best->serial)
+			break;
+
+		if (kline_matches_user(k, u))
+			return kline_first_of(best, k);
+	}
+
+	return best;
+}
+
+static void
+kline_expire_one(void *const restrict vptr)
+{
+	struct kline *const k = vptr;
+
+	if (k->expires > CURRTIME)
+	{
+		(void) timerwheel_add(&k->expire_timer, &kline_expire_one, k, k->expires);
+		return;
+	}
+
+	/* TODO: determine validity of k->reason */
+	const char *const reason = k->reason ? k->reason : "(none)";
+
+	slog(LG_INFO, "KLINE:EXPIRE: \2%s@%s\2 set \2%s\2 ago by \2%s\2 (reason: %s)",
+		k->user, k->host, time_ago(k->settime), k->setby, reason);
+
+	verbose_wallops("AKILL expired on \2%s@%s\2, set by \2%s\2 (reason: %s)",
+		k->user, k->host, k->setby, reason);
+
+	kline_delete(k);
+}
+
+static void
+kline_send(const struct kline *const restrict k)
+{
+	char treason[BUFSIZE];
+
+	(void) snprintf(treason, sizeof treason, "[#%lu] %s", k->number, k->reason);
+
+	if (k->duration == 0)
+		kline_sts("*", k->user, k->host, 0, treason);
+	else if (k->expires > CURRTIME)
+		kline_sts("*", k->user, k->host, k->expires - CURRTIME, treason);
+}
+
+static void
+kline_propagate_run(void ATHEME_VATTR_UNUSED *const restrict unused)
+{
+	mowgli_node_t *n;
+	unsigned int sent = 0;
+
+	kline_propagate_timer = NULL;
+
+	while ((n = kline_propagate_queue.head) != NULL)
+	{
+		struct kline *const k = n->data;
+
+		if (me.connected && sent++ == KLINE_PROPAGATE_RATE)
+		{
+			kline_propagate_timer = timer_add_once("kline_propagate", &kline_propagate_run, NULL, 1);
+			return;
+		}
+
+		mowgli_node_delete(&k->propnode, &kline_propagate_queue);
+		k->propagating = false;
+
+		// Anyone they match who connects after a relink gets one from operserv/akill
+		if (me.connected)
+			(void) kline_send(k);
+	}
+}
+
+static struct kline *
+kline_create(const char *user, const char *host, const char *reason, long duration, const char *setby, unsigned long id)
 {
 	struct kline *k;
 	mowgli_node_t *n = mowgli_node_create();
 
-	slog(LG_DEBUG, "kline_add(): %s@%s -> %s (%ld)", user, host, reason, duration);
-
-	k = mowgli_heap_alloc(kline_heap);
+	k = named_heap_alloc(kline_heap);
 
 	mowgli_node_add(k, n, &klnlist);
 
@@ -135,18 +412,81 @@ kline_add_with_id(const char *user, const char *host, const char *reason, long d
 	k->expires = CURRTIME + duration;
 	k->number = id;
 
+	kline_index_add(k);
+
+	if (duration != 0)
+		(void) timerwheel_add(&k->expire_timer, &kline_expire_one, k, k->expires);
+
 	cnt.kline++;
+	db_change_note(DB_CHANGE_OTHER);
+
+	return k;
+}
 
+struct kline *
+kline_add_with_id(const char *user, const char *host, const char *reason, long duration, const char *setby, unsigned long id)
+{
+	slog(LG_DEBUG, "kline_add(): %s@%s -> %s (%ld)", user, host, reason, duration);
 
-	char treason[BUFSIZE];
-	snprintf(treason, sizeof(treason), "[#%lu] %s", k->number, k->reason);
+	struct kline *const k = kline_create(user, host, reason, duration, setby, id);
 
 	if (me.connected)
-		kline_sts("*", user, host, duration, treason);
+		(void) kline_send(k);
 
 	return k;
 }
 
+/* Adds count klines in one go, all with the same reason and duration. Masks
+ * already matched by a kline (including one earlier in the same batch) are
+ * skipped and counted in *dups. The rest are sent to the network a few at a
+ * time rather than all at once, so that a large import does not flood the
+ * uplink. Returns how many were added.
+ */
+unsigned int
+kline_add_bulk(const struct kline_mask *const restrict masks, const size_t count, const char *const restrict reason,
+               const long duration, const char *const restrict setby, unsigned int *const restrict dups)
+{
+	unsigned int added = 0;
+
+	if (dups)
+		*dups = 0;
+
+	return_val_if_fail(masks != NULL, 0);
+	return_val_if_fail(reason != NULL, 0);
+	return_val_if_fail(setby != NULL, 0);
+
+	for (size_t i = 0; i < count; i++)
+	{
+		const struct kline_mask *const km = &masks[i];
+
+		if (kline_find(km->user, km->host))
+		{
+			if (dups)
+				(*dups)++;
+
+			continue;
+		}
+
+		struct kline *const k = kline_create(km->user, km->host, reason, duration, setby, ++me.kline_id);
+
+		added++;
+
+		if (! me.connected)
+			continue;
+
+		mowgli_node_add(k, &k->propnode, &kline_propagate_queue);
+		k->propagating = true;
+	}
+
+	slog(LG_DEBUG, "kline_add_bulk(): %u of %zu added, %u queued to be sent", added, count,
+	     (unsigned int) MOWGLI_LIST_LENGTH(&kline_propagate_queue));
+
+	if (kline_propagate_queue.head != NULL && kline_propagate_timer == NULL)
+		(void) kline_propagate_run(NULL);
+
+	return added;
+}
+
 struct kline *
 kline_add(const char *user, const char *host, const char *reason, long duration, const char *setby)
 {
@@ -171,74 +511,121 @@ kline_delete(struct kline *k)
 	slog(LG_DEBUG, "kline_delete(): %s@%s -> %s", k->user, k->host, k->reason);
 
 	/* only unkline if ircd has not already removed this -- jilles */
-	if (me.connected && (k->duration == 0 || k->expires > CURRTIME))
+	if (k->propagating)
+	{
+		// ... or never had it at all
+		mowgli_node_delete(&k->propnode, &kline_propagate_queue);
+		k->propagating = false;
+	}
+	else if (me.connected && (k->duration == 0 || k->expires > CURRTIME))
 		unkline_sts("*", k->user, k->host);
 
 	n = mowgli_node_find(k, &klnlist);
 	mowgli_node_delete(n, &klnlist);
 	mowgli_node_free(n);
 
+	kline_index_delete(k);
+	(void) timerwheel_cancel(&k->expire_timer);
+
 	sfree(k->user);
 	sfree(k->host);
 	sfree(k->reason);
 	sfree(k->setby);
 
-	mowgli_heap_free(kline_heap, k);
+	named_heap_free(kline_heap, k);
 
 	cnt.kline--;
+	db_change_note(DB_CHANGE_OTHER);
+}
+
+// For backends restoring a kline; its expiry is rescheduled accordingly
+void
+kline_set_settime(struct kline *k, time_t settime)
+{
+	return_if_fail(k != NULL);
+
+	k->settime = settime;
+	k->expires = k->settime + k->duration;
+
+	if (k->duration != 0)
+		(void) timerwheel_add(&k->expire_timer, &kline_expire_one, k, k->expires);
 }
 
 struct kline *
 kline_find(const char *user, const char *host)
 {
-	struct kline *k;
+	struct kline *best = NULL;
+	mowgli_list_t *bucket;
 	mowgli_node_t *n;
 
-	MOWGLI_ITER_FOREACH(n, klnlist.head)
+	if (host == NULL)
+		return NULL;
+
+	if (*host != '\0' && (bucket = mowgli_patricia_retrieve(kline_hosts, host)) != NULL)
 	{
-		k = (struct kline *)n->data;
+		MOWGLI_ITER_FOREACH(n, bucket->head)
+		{
+			struct kline *const k = n->data;
+
+			if (!match_compiled(k->userpat, user))
+			{
+				best = k;
+				break;
+			}
+		}
+	}
+
+	MOWGLI_ITER_FOREACH(n, kline_wildlist.head)
+	{
+		struct kline *const k = n->data;
 
-		if ((!match(k->user, user)) && (!match(k->host, host)))
+		if (best != NULL && k->serial > best->serial)
+			break;
+
+		if ((!match_compiled(k->userpat, user)) && (!match_compiled(k->hostpat, host)))
 			return k;
 	}
 
-	return NULL;
+	return best;
 }
 
 struct kline *
 kline_find_num(unsigned long number)
 {
-	struct kline *k;
-	mowgli_node_t *n;
-
-	MOWGLI_ITER_FOREACH(n, klnlist.head)
-	{
-		k = (struct kline *)n->data;
+	char numbuf[BUFSIZE];
 
-		if (k->number == number)
-			return k;
-	}
+	(void) snprintf(numbuf, sizeof numbuf, "%lu", number);
 
-	return NULL;
+	return mowgli_patricia_retrieve(kline_numbers, numbuf);
 }
 
 struct kline *
 kline_find_user(struct user *u)
 {
-	struct kline *k;
+	struct kline_user_search search = { .u = u, .best = NULL };
 	mowgli_node_t *n;
 
-	MOWGLI_ITER_FOREACH(n, klnlist.head)
+	search.best = kline_find_user_bucket(search.best, u->host, u);
+	search.best = kline_find_user_bucket(search.best, u->ip, u);
+
+	if (u->ipaddr.family != 0)
+		cidr_tree_foreach_match(kline_cidrs, &u->ipaddr, &kline_find_user_cidr_cb, &search);
+
+	MOWGLI_ITER_FOREACH(n, kline_wildlist.head)
 	{
-		k = (struct kline *)n->data;
+		struct kline *const k = n->data;
 
-		if (k->duration != 0 && k->expires <= CURRTIME)
+		if (search.best != NULL && k->serial > search.best->serial)
+			break;
+
+		if (!kline_matches_user(k, u))
 			continue;
-		if (!match(k->user, u->user) && (!match(k->host, u->host) || !match(k->host, u->ip) || !match_ips(k->host, u->ip)))
+		// no CIDR check here, a host with wildcards never parses as one
+		if (!match_compiled(k->hostpat, u->host) || !match_compiled(k->hostpat, u->ip))
 			return k;
 	}
 
-	return NULL;
+	return search.best;
 }
 
 void
@@ -271,10 +658,240 @@ kline_expire(void *arg)
 	}
 }
 
+/*************************
+ * M A S K   I N D E X *
+ *************************/
+
+/*
+ * Q-lines and X-lines are matched against every connecting user, every
+ * nick change and every new channel, so they are indexed by mask:
+ *
+ *   - every mask is kept in a per-mask bucket in exact, which answers the
+ *     exact lookups outright and the matches of masks without wildcards,
+ *   - masks that are a literal prefix followed by '*' are kept in
+ *     per-prefix buckets in prefixes, and a name is only looked up under
+ *     the prefix lengths that some mask actually has,
+ *   - everything else lives in wild and is matched the slow way.
+ *
+ * As with K-lines, every entry carries a serial number so that when
+ * several match, the one returned is the first one in the list.
+ */
+// The length of the literal part of a prefix* mask, or 0 if it is something else
+static unsigned int
+mask_index_prefix_length(const char *const mask)
+{
+	const char *const star = strchr(mask, '*');
+	size_t len;
+
+	if (star == NULL || star == mask || star[strspn(star, "*")] != '\0')
+		return 0;
+
+	len = (size_t) (star - mask);
+
+	if (len > MASK_INDEX_PREFIX_MAX || strcspn(mask, "?&#%\\") < len)
+		return 0;
+
+	return (unsigned int) len;
+}
+
+static void
+mask_index_bucket_add(mowgli_patricia_t *const dict, const char *const key, struct mask_index_entry *const e,
+                      mowgli_node_t *const node)
+{
+	mowgli_list_t *bucket = mowgli_patricia_retrieve(dict, key);
+
+	if (bucket == NULL)
+	{
+		bucket = mowgli_list_create();
+		mowgli_patricia_add(dict, key, bucket);
+	}
+
+	mowgli_node_add(e, node, bucket);
+}
+
+static void
+mask_index_bucket_delete(mowgli_patricia_t *const dict, const char *const key, mowgli_node_t *const node)
+{
+	mowgli_list_t *const bucket = mowgli_patricia_retrieve(dict, key);
+
+	return_if_fail(bucket != NULL);
+
+	mowgli_node_delete(node, bucket);
+
+	if (! MOWGLI_LIST_LENGTH(bucket))
+	{
+		(void) mowgli_patricia_delete(dict, key);
+		mowgli_list_free(bucket);
+	}
+}
+
+static void
+mask_index_add(struct mask_index *const mi, struct mask_index_entry *const e, void *const owner, const char *const mask)
+{
+	e->owner = owner;
+	e->serial = ++mi->serial;
+	e->prefixlen = mask_index_prefix_length(mask);
+
+	mask_index_bucket_add(mi->exact, mask, e, &e->exactnode);
+
+	if (e->prefixlen)
+	{
+		char prefix[MASK_INDEX_PREFIX_MAX + 1U];
+
+		(void) mowgli_strlcpy(prefix, mask, e->prefixlen + 1U);
+
+		mask_index_bucket_add(mi->prefixes, prefix, e, &e->matchnode);
+		mi->prefix_lens[e->prefixlen]++;
+	}
+	else if (strpbrk(mask, "*?&#%\\") != NULL)
+		mowgli_node_add(e, &e->matchnode, &mi->wild);
+}
+
+static void
+mask_index_delete(struct mask_index *const mi, struct mask_index_entry *const e, const char *const mask)
+{
+	mask_index_bucket_delete(mi->exact, mask, &e->exactnode);
+
+	if (e->prefixlen)
+	{
+		char prefix[MASK_INDEX_PREFIX_MAX + 1U];
+
+		(void) mowgli_strlcpy(prefix, mask, e->prefixlen + 1U);
+
+		mask_index_bucket_delete(mi->prefixes, prefix, &e->matchnode);
+		mi->prefix_lens[e->prefixlen]--;
+	}
+	else if (strpbrk(mask, "*?&#%\\") != NULL)
+		mowgli_node_delete(&e->matchnode, &mi->wild);
+}
+
+// The first entry with exactly this mask, whether or not it has expired
+static void *
+mask_index_find_exact(const struct mask_index *const mi, const char *const mask)
+{
+	const mowgli_list_t *const bucket = mowgli_patricia_retrieve(mi->exact, mask);
+
+	if (bucket == NULL || bucket->head == NULL)
+		return NULL;
+
+	return ((const struct mask_index_entry *) bucket->head->data)->owner;
+}
+
+static const struct mask_index_entry *
+mask_index_find_bucket(const struct mask_index_entry *best, const mowgli_list_t *const bucket, const char *const name,
+                       bool (*const accept)(void *, const char *))
+{
+	mowgli_node_t *n;
+
+	if (bucket == NULL)
+		return best;
+
+	MOWGLI_ITER_FOREACH(n, bucket->head)
+	{
+		const struct mask_index_entry *const e = n->data;
+
+		if (best != NULL && e->serial > best->serial)
+			break;
+
+		if (accept(e->owner, name))
+			return e;
+	}
+
+	return best;
+}
+
+/* The first entry (in list order) that accept() takes for name; accept()
+ * is what does the matching, the index only narrows down what it is
+ * asked about.
+ */
+static void *
+mask_index_find(const struct mask_index *const mi, const char *const name, bool (*const accept)(void *, const char *))
+{
+	const struct mask_index_entry *best = NULL;
+	const size_t namelen = strlen(name);
+	mowgli_node_t *n;
+
+	best = mask_index_find_bucket(best, mowgli_patricia_retrieve(mi->exact, name), name, accept);
+
+	for (size_t len = 1; len <= namelen && len <= MASK_INDEX_PREFIX_MAX; len++)
+	{
+		char prefix[MASK_INDEX_PREFIX_MAX + 1U];
+
+		if (! mi->prefix_lens[len])
+			continue;
+
+		(void) mowgli_strlcpy(prefix, name, len + 1U);
+
+		best = mask_index_find_bucket(best, mowgli_patricia_retrieve(mi->prefixes, prefix), name, accept);
+	}
+
+	MOWGLI_ITER_FOREACH(n, mi->wild.head)
+	{
+		const struct mask_index_entry *const e = n->data;
+
+		if (best != NULL && e->serial > best->serial)
+			break;
+
+		if (accept(e->owner, name))
+			return e->owner;
+	}
+
+	return (best != NULL) ? best->owner : NULL;
+}
+
 /*************
  * X L I N E *
  *************/
 
+static void
+xline_destroy(struct xline *x)
+{
+	mowgli_node_t *n;
+
+	slog(LG_DEBUG, "xline_delete(): %s -> %s", x->realname, x->reason);
+
+	/* only unxline if ircd has not already removed this -- jilles */
+	if (me.connected && (x->duration == 0 || x->expires > CURRTIME))
+		unxline_sts("*", x->realname);
+
+	n = mowgli_node_find(x, &xlnlist);
+	mowgli_node_delete(n, &xlnlist);
+	mowgli_node_free(n);
+
+	mask_index_delete(&xline_index, &x->index, x->realname);
+	(void) timerwheel_cancel(&x->expire_timer);
+
+	match_pattern_free(x->realnamepat);
+	sfree(x->realname);
+	sfree(x->reason);
+	sfree(x->setby);
+
+	named_heap_free(xline_heap, x);
+
+	cnt.xline--;
+	db_change_note(DB_CHANGE_OTHER);
+}
+
+static void
+xline_expire_one(void *const restrict vptr)
+{
+	struct xline *const x = vptr;
+
+	if (x->expires > CURRTIME)
+	{
+		(void) timerwheel_add(&x->expire_timer, &xline_expire_one, x, x->expires);
+		return;
+	}
+
+	slog(LG_INFO, "XLINE:EXPIRE: \2%s\2 set \2%s\2 ago by \2%s\2",
+		x->realname, time_ago(x->settime), x->setby);
+
+	verbose_wallops("XLINE expired on \2%s\2, set by \2%s\2",
+		x->realname, x->setby);
+
+	xline_destroy(x);
+}
+
 struct xline *
 xline_add(const char *realname, const char *reason, long duration, const char *setby)
 {
@@ -284,11 +901,12 @@ xline_add(const char *realname, const char *reason, long duration, const char *s
 
 	slog(LG_DEBUG, "xline_add(): %s -> %s (%ld)", realname, reason, duration);
 
-	x = mowgli_heap_alloc(xline_heap);
+	x = named_heap_alloc(xline_heap);
 
 	mowgli_node_add(x, n, &xlnlist);
 
 	x->realname = sstrdup(realname);
+	x->realnamepat = match_compile(realname);
 	x->reason = sstrdup(reason);
 	x->setby = sstrdup(setby);
 	x->duration = duration;
@@ -296,7 +914,13 @@ xline_add(const char *realname, const char *reason, long duration, const char *s
 	x->expires = CURRTIME + duration;
 	x->number = ++xcnt;
 
+	mask_index_add(&xline_index, &x->index, x, x->realname);
+
 	cnt.xline++;
+	db_change_note(DB_CHANGE_OTHER);
+
+	if (duration != 0)
+		(void) timerwheel_add(&x->expire_timer, &xline_expire_one, x, x->expires);
 
 	if (me.connected)
 		xline_sts("*", realname, duration, reason);
@@ -307,8 +931,7 @@ xline_add(const char *realname, const char *reason, long duration, const char *s
 void
 xline_delete(const char *realname)
 {
-	struct xline *x = xline_find(realname);
-	mowgli_node_t *n;
+	struct xline *x = mask_index_find_exact(&xline_index, realname);
 
 	if (!x)
 	{
@@ -316,40 +939,51 @@ xline_delete(const char *realname)
 		return;
 	}
 
-	slog(LG_DEBUG, "xline_delete(): %s -> %s", x->realname, x->reason);
+	xline_destroy(x);
+}
 
-	/* only unxline if ircd has not already removed this -- jilles */
-	if (me.connected && (x->duration == 0 || x->expires > CURRTIME))
-		unxline_sts("*", x->realname);
+// For backends restoring an xline; its expiry is rescheduled accordingly
+void
+xline_set_settime(struct xline *x, time_t settime)
+{
+	return_if_fail(x != NULL);
 
-	n = mowgli_node_find(x, &xlnlist);
-	mowgli_node_delete(n, &xlnlist);
-	mowgli_node_free(n);
+	x->settime = settime;
+	x->expires = x->settime + x->duration;
 
-	sfree(x->realname);
-	sfree(x->reason);
-	sfree(x->setby);
+	if (x->duration != 0)
+		(void) timerwheel_add(&x->expire_timer, &xline_expire_one, x, x->expires);
+}
 
-	mowgli_heap_free(xline_heap, x);
+static bool
+xline_matches(void *const vptr, const char *const realname)
+{
+	const struct xline *const x = vptr;
 
-	cnt.xline--;
+	return !match_compiled(x->realnamepat, realname);
 }
 
+static bool
+xline_matches_active(void *const vptr, const char *const realname)
+{
+	const struct xline *const x = vptr;
+
+	if (x->duration != 0 && x->expires <= CURRTIME)
+		return false;
+
+	return !match_compiled(x->realnamepat, realname);
+}
+
+// An xline for exactly this realname if there is one, otherwise the first that matches it
 struct xline *
 xline_find(const char *realname)
 {
 	struct xline *x;
-	mowgli_node_t *n;
 
-	MOWGLI_ITER_FOREACH(n, xlnlist.head)
-	{
-		x = (struct xline *)n->data;
-
-		if (!match(x->realname, realname))
-			return x;
-	}
+	if ((x = mask_index_find_exact(&xline_index, realname)) != NULL)
+		return x;
 
-	return NULL;
+	return mask_index_find(&xline_index, realname, &xline_matches);
 }
 
 struct xline *
@@ -372,21 +1006,7 @@ xline_find_num(unsigned int number)
 struct xline *
 xline_find_user(struct user *u)
 {
-	struct xline *x;
-	mowgli_node_t *n;
-
-	MOWGLI_ITER_FOREACH(n, xlnlist.head)
-	{
-		x = (struct xline *)n->data;
-
-		if (x->duration != 0 && x->expires <= CURRTIME)
-			continue;
-
-		if (!match(x->realname, u->gecos))
-			return x;
-	}
-
-	return NULL;
+	return mask_index_find(&xline_index, user_gecos(u), &xline_matches_active);
 }
 
 void
@@ -419,6 +1039,55 @@ xline_expire(void *arg)
  * Q L I N E *
  *************/
 
+static void
+qline_destroy(struct qline *q)
+{
+	mowgli_node_t *n;
+
+	slog(LG_DEBUG, "qline_delete(): %s -> %s", q->mask, q->reason);
+
+	/* only unqline if ircd has not already removed this -- jilles */
+	if (me.connected && (q->duration == 0 || q->expires > CURRTIME))
+		unqline_sts("*", q->mask);
+
+	n = mowgli_node_find(q, &qlnlist);
+	mowgli_node_delete(n, &qlnlist);
+	mowgli_node_free(n);
+
+	mask_index_delete(&qline_index, &q->index, q->mask);
+	(void) timerwheel_cancel(&q->expire_timer);
+
+	match_pattern_free(q->maskpat);
+	sfree(q->mask);
+	sfree(q->reason);
+	sfree(q->setby);
+
+	named_heap_free(qline_heap, q);
+
+	cnt.qline--;
+	db_change_note(DB_CHANGE_OTHER);
+}
+
+static void
+qline_expire_one(void *const restrict vptr)
+{
+	struct qline *const q = vptr;
+
+	if (q->expires > CURRTIME)
+	{
+		(void) timerwheel_add(&q->expire_timer, &qline_expire_one, q, q->expires);
+		return;
+	}
+
+	slog(LG_INFO, "QLINE:EXPIRE: \2%s\2 set \2%s\2 ago by \2%s\2",
+		q->mask, time_ago(q->settime), q->setby);
+
+	verbose_wallops("QLINE expired on \2%s\2, set by \2%s\2",
+		q->mask, q->setby);
+
+	qline_destroy(q);
+}
+
 struct qline *
 qline_add(const char *mask, const char *reason, long duration, const char *setby)
 {
@@ -428,10 +1097,11 @@ qline_add(const char *mask, const char *reason, long duration, const char *setby
 
 	slog(LG_DEBUG, "qline_add(): %s -> %s (%ld)", mask, reason, duration);
 
-	q = mowgli_heap_alloc(qline_heap);
+	q = named_heap_alloc(qline_heap);
 	mowgli_node_add(q, n, &qlnlist);
 
 	q->mask = sstrdup(mask);
+	q->maskpat = match_compile(mask);
 	q->reason = sstrdup(reason);
 	q->setby = sstrdup(setby);
 	q->duration = duration;
@@ -439,7 +1109,13 @@ qline_add(const char *mask, const char *reason, long duration, const char *setby
 	q->expires = CURRTIME + duration;
 	q->number = ++qcnt;
 
+	mask_index_add(&qline_index, &q->index, q, q->mask);
+
 	cnt.qline++;
+	db_change_note(DB_CHANGE_OTHER);
+
+	if (duration != 0)
+		(void) timerwheel_add(&q->expire_timer, &qline_expire_one, q, q->expires);
 
 	if (me.connected)
 		qline_sts("*", mask, duration, reason);
@@ -451,7 +1127,6 @@ void
 qline_delete(const char *mask)
 {
 	struct qline *q = qline_find(mask);
-	mowgli_node_t *n;
 
 	if (!q)
 	{
@@ -459,59 +1134,54 @@ qline_delete(const char *mask)
 		return;
 	}
 
-	slog(LG_DEBUG, "qline_delete(): %s -> %s", q->mask, q->reason);
+	qline_destroy(q);
+}
 
-	/* only unqline if ircd has not already removed this -- jilles */
-	if (me.connected && (q->duration == 0 || q->expires > CURRTIME))
-		unqline_sts("*", q->mask);
+// For backends restoring a qline; its expiry is rescheduled accordingly
+void
+qline_set_settime(struct qline *q, time_t settime)
+{
+	return_if_fail(q != NULL);
 
-	n = mowgli_node_find(q, &qlnlist);
-	mowgli_node_delete(n, &qlnlist);
-	mowgli_node_free(n);
+	q->settime = settime;
+	q->expires = q->settime + q->duration;
 
-	sfree(q->mask);
-	sfree(q->reason);
-	sfree(q->setby);
+	if (q->duration != 0)
+		(void) timerwheel_add(&q->expire_timer, &qline_expire_one, q, q->expires);
+}
+
+static bool
+qline_matches_active(void *const vptr, const char *const name)
+{
+	const struct qline *const q = vptr;
 
-	mowgli_heap_free(qline_heap, q);
+	if (q->duration != 0 && q->expires <= CURRTIME)
+		return false;
 
-	cnt.qline--;
+	return !match_compiled(q->maskpat, name);
 }
 
-struct qline *
-qline_find(const char *mask)
+static bool
+qline_matches_nick(void *const vptr, const char *const nick)
 {
-	struct qline *q;
-	mowgli_node_t *n;
+	const struct qline *const q = vptr;
 
-	MOWGLI_ITER_FOREACH(n, qlnlist.head)
-	{
-		q = (struct qline *)n->data;
+	if (q->mask[0] == '#' || q->mask[0] == '&')
+		return false;
 
-		if (!irccasecmp(q->mask, mask))
-			return q;
-	}
+	return qline_matches_active(vptr, nick);
+}
 
-	return NULL;
+struct qline *
+qline_find(const char *mask)
+{
+	return mask_index_find_exact(&qline_index, mask);
 }
 
 struct qline *
 qline_find_match(const char *mask)
 {
-	struct qline *q;
-	mowgli_node_t *n;
-
-	MOWGLI_ITER_FOREACH(n, qlnlist.head)
-	{
-		q = (struct qline *)n->data;
-
-		if (q->duration != 0 && q->expires <= CURRTIME)
-			continue;
-		if (!match(q->mask, mask))
-			return q;
-	}
-
-	return NULL;
+	return mask_index_find(&qline_index, mask, &qline_matches_active);
 }
 
 struct qline *
@@ -534,37 +1204,24 @@ qline_find_num(unsigned int number)
 struct qline *
 qline_find_user(struct user *u)
 {
-	struct qline *q;
-	mowgli_node_t *n;
-
-	MOWGLI_ITER_FOREACH(n, qlnlist.head)
-	{
-		q = (struct qline *)n->data;
-
-		if (q->duration != 0 && q->expires <= CURRTIME)
-			continue;
-		if (q->mask[0] == '#' || q->mask[0] == '&')
-			continue;
-		if (!match(q->mask, u->nick))
-			return q;
-	}
-
-	return NULL;
+	return mask_index_find(&qline_index, u->nick, &qline_matches_nick);
 }
 
+// Channel qlines are compared as strings, wildcards and all
 struct qline *
 qline_find_channel(struct channel *c)
 {
-	struct qline *q;
+	const mowgli_list_t *const bucket = mowgli_patricia_retrieve(qline_index.exact, c->name);
 	mowgli_node_t *n;
 
-	MOWGLI_ITER_FOREACH(n, qlnlist.head)
+	if (bucket == NULL)
+		return NULL;
+
+	MOWGLI_ITER_FOREACH(n, bucket->head)
 	{
-		q = (struct qline *)n->data;
+		struct qline *const q = ((const struct mask_index_entry *) n->data)->owner;
 
-		if (q->duration != 0 && q->expires <= CURRTIME)
-			continue;
-		if (!irccasecmp(q->mask, c->name))
+		if (q->duration == 0 || q->expires > CURRTIME)
 			return q;
 	}
 
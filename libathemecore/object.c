@@ -20,12 +20,12 @@
 mowgli_list_t object_list = { NULL, NULL, 0 };
 #endif
 
-static mowgli_heap_t *metadata_heap = NULL;	/* HEAP_CHANUSER */
+static struct named_heap *metadata_heap = NULL;	/* HEAP_CHANUSER */
 
 void
 init_metadata(void)
 {
-	metadata_heap = sharedheap_get(sizeof(struct metadata));
+	metadata_heap = named_heap_get("metadata", sizeof(struct metadata));
 
 	if (metadata_heap == NULL)
 	{
@@ -179,7 +179,8 @@ void
 atheme_object_dispose(void *object)
 {
 	struct atheme_object *obj;
-	mowgli_patricia_t *privatedata, *metadata;
+	struct privatedata_table *privatedata;
+	struct metadata_table *metadata;
 
 	return_if_fail(object != NULL);
 	obj = atheme_object(object);
@@ -208,18 +209,114 @@ atheme_object_dispose(void *object)
 		sfree(obj);
 	}
 
-	if (privatedata != NULL)
-		mowgli_patricia_destroy(privatedata, NULL, NULL);
+	sfree(privatedata);
 
 	if (metadata != NULL)
-		mowgli_patricia_destroy(metadata, NULL, NULL);
+	{
+		if (metadata->tree != NULL)
+			mowgli_patricia_destroy(metadata->tree, NULL, NULL);
+
+		sfree(metadata);
+	}
+}
+
+/* Returns the index of name in the inline array, or (when not found) the
+ * index it would be inserted at with *found set to false.
+ */
+static unsigned int
+metadata_inline_search(const struct metadata_table *const table, const char *const name, bool *const found)
+{
+	unsigned int lo = 0;
+	unsigned int hi = table->count;
+
+	while (lo < hi)
+	{
+		const unsigned int mid = lo + ((hi - lo) / 2U);
+		const int ret = strcasecmp(table->entries[mid]->name, name);
+
+		if (ret == 0)
+		{
+			*found = true;
+			return mid;
+		}
+
+		if (ret < 0)
+			lo = mid + 1U;
+		else
+			hi = mid;
+	}
+
+	*found = false;
+	return lo;
+}
+
+static void
+metadata_promote(struct atheme_object *const obj)
+{
+	struct metadata_table *table = obj->metadata;
+
+	table->tree = mowgli_patricia_create(strcasecanon);
+
+	for (unsigned int i = 0; i < table->count; i++)
+		mowgli_patricia_add(table->tree, table->entries[i]->name, table->entries[i]);
+
+	table = srealloc(table, sizeof *table);
+	table->alloc = 0;
+
+	obj->metadata = table;
+}
+
+static void
+metadata_remove(void *target, const char *name)
+{
+	struct atheme_object *obj;
+	struct metadata_table *table;
+	struct metadata *md = metadata_find(target, name);
+
+	if (!md)
+		return;
+
+	obj = atheme_object(target);
+	table = obj->metadata;
+
+	return_if_fail(table != NULL);
+
+	if (table->tree != NULL)
+		mowgli_patricia_delete(table->tree, name);
+	else
+	{
+		bool found;
+		const unsigned int idx = metadata_inline_search(table, name, &found);
+
+		(void) memmove(&table->entries[idx], &table->entries[idx + 1U], (table->count - idx - 1U) * sizeof table->entries[0]);
+	}
+
+	table->count--;
+
+	strshare_unref(md->name);
+	sfree(md->value);
+
+	named_heap_free_deferred(metadata_heap, md);
+}
+
+// a channel's fantasy prefix or setting decides which of its messages services look at
+static inline void
+metadata_fantasy_check(void *target, const char *name)
+{
+	if ((!strcmp(name, "private:prefix") || !strcmp(name, "disable_fantasy")) &&
+	    db_object_type(target) == DB_OBJECT_MYCHAN && ((struct mychan *) target)->chan != NULL)
+		channel_fantasy_invalidate(((struct mychan *) target)->chan);
 }
 
 struct metadata *
 metadata_add(void *target, const char *name, const char *value)
 {
 	struct atheme_object *obj;
+	struct metadata_table *table;
 	struct metadata *md;
+	struct hook_metadata_req req;
+	unsigned int idx;
+	bool found;
 
 	return_val_if_fail(name != NULL, NULL);
 	return_val_if_fail(value != NULL, NULL);
@@ -227,16 +324,55 @@ metadata_add(void *target, const char *name, const char *value)
 	obj = atheme_object(target);
 
 	if (obj->metadata == NULL)
-		obj->metadata = mowgli_patricia_create(strcasecanon);
+		obj->metadata = smalloc(sizeof *obj->metadata);
 	else if (metadata_find(target, name))
-		metadata_delete(target, name);
+		metadata_remove(target, name);
 
-	md = mowgli_heap_alloc(metadata_heap);
+	md = named_heap_alloc(metadata_heap);
 
 	md->name = strshare_get(name);
 	md->value = sstrdup(value);
 
-	mowgli_patricia_add(obj->metadata, md->name, md);
+	table = obj->metadata;
+
+	if (table->tree == NULL && table->count == METADATA_INLINE_MAX)
+	{
+		metadata_promote(obj);
+		table = obj->metadata;
+	}
+
+	if (table->tree != NULL)
+	{
+		mowgli_patricia_add(table->tree, md->name, md);
+		table->count++;
+	}
+	else
+	{
+		idx = metadata_inline_search(table, md->name, &found);
+
+		if (table->count == table->alloc)
+		{
+			const unsigned int alloc = table->alloc ? (table->alloc * 2U) : 2U;
+
+			table->alloc = (alloc < METADATA_INLINE_MAX) ? alloc : METADATA_INLINE_MAX;
+			table = srealloc(table, sizeof *table + (table->alloc * sizeof table->entries[0]));
+			obj->metadata = table;
+		}
+
+		(void) memmove(&table->entries[idx + 1U], &table->entries[idx], (table->count - idx) * sizeof table->entries[0]);
+
+		table->entries[idx] = md;
+		table->count++;
+	}
+
+	db_change_note(DB_CHANGE_METADATA);
+
+	metadata_fantasy_check(target, md->name);
+
+	req.target = target;
+	req.name = md->name;
+	req.value = md->value;
+	hook_call_metadata_add(&req);
 
 	return md;
 }
@@ -244,38 +380,53 @@ metadata_add(void *target, const char *name, const char *value)
 void
 metadata_delete(void *target, const char *name)
 {
-	struct atheme_object *obj;
-	struct metadata *md = metadata_find(target, name);
+	struct hook_metadata_req req;
+	stringref key;
 
-	if (!md)
+	if (!metadata_find(target, name))
 		return;
 
-	obj = atheme_object(target);
+	/* name may be the key being freed (see metadata_delete_all()),
+	 * so hold a reference for the hook.
+	 */
+	key = strshare_get(name);
 
-	return_if_fail(obj->metadata != NULL);
+	metadata_remove(target, key);
 
-	mowgli_patricia_delete(obj->metadata, name);
+	db_change_note(DB_CHANGE_METADATA);
+	metadata_fantasy_check(target, key);
 
-	strshare_unref(md->name);
-	sfree(md->value);
+	req.target = target;
+	req.name = key;
+	req.value = NULL;
+	hook_call_metadata_delete(&req);
 
-	mowgli_heap_free(metadata_heap, md);
+	strshare_unref(key);
 }
 
 struct metadata *
 metadata_find(void *target, const char *name)
 {
 	struct atheme_object *obj;
+	const struct metadata_table *table;
+	unsigned int idx;
+	bool found;
 
 	return_val_if_fail(target != NULL, NULL);
 	return_val_if_fail(name != NULL, NULL);
 
 	obj = atheme_object(target);
+	table = obj->metadata;
 
-	if (obj->metadata == NULL)
+	if (table == NULL)
 		return NULL;
 
-	return mowgli_patricia_retrieve(obj->metadata, name);
+	if (table->tree != NULL)
+		return mowgli_patricia_retrieve(table->tree, name);
+
+	idx = metadata_inline_search(table, name, &found);
+
+	return found ? table->entries[idx] : NULL;
 }
 
 void
@@ -283,41 +434,155 @@ metadata_delete_all(void *target)
 {
 	struct atheme_object *obj;
 	struct metadata *md;
-	mowgli_patricia_iteration_state_t state;
+	struct metadata_iteration_state state;
 
 	obj = atheme_object(target);
 
 	if (obj->metadata == NULL)
 		return;
 
-	MOWGLI_PATRICIA_FOREACH(md, &state, obj->metadata)
+	METADATA_FOREACH(md, &state, obj)
 	{
 		metadata_delete(obj, md->name);
 	}
 }
 
+unsigned int
+metadata_count(void *target)
+{
+	const struct atheme_object *const obj = atheme_object(target);
+
+	return (obj->metadata != NULL) ? obj->metadata->count : 0;
+}
+
+void
+metadata_foreach_start(struct metadata_iteration_state *state, void *target)
+{
+	state->obj = atheme_object(target);
+	state->table = state->obj->metadata;
+	state->tree = state->table != NULL && state->table->tree != NULL;
+	state->cur = NULL;
+	state->idx = 0;
+
+	if (state->tree)
+		mowgli_patricia_foreach_start(state->table->tree, &state->st);
+}
+
+struct metadata *
+metadata_foreach_cur(struct metadata_iteration_state *state)
+{
+	if (state->table == NULL)
+		return NULL;
+
+	// metadata was added during METADATA_FOREACH
+	return_val_if_fail(state->obj->metadata == state->table && (state->table->tree != NULL) == state->tree, NULL);
+
+	if (state->table->tree != NULL)
+		return mowgli_patricia_foreach_cur(state->table->tree, &state->st);
+
+	state->cur = (state->idx < state->table->count) ? state->table->entries[state->idx] : NULL;
+
+	return state->cur;
+}
+
+void
+metadata_foreach_next(struct metadata_iteration_state *state)
+{
+	// metadata_foreach_cur() ends it if the table has changed under us
+	if (state->table == NULL || state->obj->metadata != state->table)
+		return;
+
+	if (state->table->tree != NULL)
+	{
+		mowgli_patricia_foreach_next(state->table->tree, &state->st);
+		return;
+	}
+
+	// If the current entry was deleted, the next one has already moved into its slot
+	if (state->idx < state->table->count && state->table->entries[state->idx] == state->cur)
+		state->idx++;
+}
+
+/* Slots are given out by key, once for the life of the process, so that a
+ * module that is reloaded gets its old slot back.
+ */
+static mowgli_patricia_t *privatedata_slots = NULL;
+static unsigned int privatedata_slot_count = 0;
+
+unsigned int
+privatedata_slot_register(const char *key)
+{
+	void *slot;
+
+	return_val_if_fail(key != NULL, 0);
+
+	if (privatedata_slots == NULL)
+		privatedata_slots = mowgli_patricia_create(noopcanon);
+
+	// stored off by one, as NULL means it isn't there
+	if ((slot = mowgli_patricia_retrieve(privatedata_slots, key)) != NULL)
+		return (unsigned int) ((uintptr_t) slot - 1U);
+
+	mowgli_patricia_add(privatedata_slots, key, (void *) (uintptr_t) (privatedata_slot_count + 1U));
+
+	return privatedata_slot_count++;
+}
+
 void *
-privatedata_get(void *target, const char *key)
+privatedata_slot_get(void *target, unsigned int slot)
 {
-	struct atheme_object *obj;
+	const struct privatedata_table *table;
 
-	obj = atheme_object(target);
-	if (obj->privatedata == NULL)
+	table = atheme_object(target)->privatedata;
+	if (table == NULL || slot >= table->size)
 		return NULL;
 
-	return mowgli_patricia_retrieve(obj->privatedata, key);
+	return table->slots[slot];
 }
 
 void
-privatedata_set(void *target, const char *key, void *data)
+privatedata_slot_set(void *target, unsigned int slot, void *data)
 {
 	struct atheme_object *obj;
+	struct privatedata_table *table;
+
+	return_if_fail(slot < privatedata_slot_count);
 
 	obj = atheme_object(target);
-	if (obj->privatedata == NULL)
-		obj->privatedata = mowgli_patricia_create(noopcanon);
+	table = obj->privatedata;
+
+	if (table == NULL || slot >= table->size)
+	{
+		const unsigned int oldsize = table ? table->size : 0U;
 
-	mowgli_patricia_add(obj->privatedata, key, data);
+		if (data == NULL)
+			return;
+
+		// room for every slot there is, since objects tend to get most of them
+		table = srealloc(table, sizeof *table + (privatedata_slot_count * sizeof table->slots[0]));
+		(void) memset(&table->slots[oldsize], 0x00, (privatedata_slot_count - oldsize) * sizeof table->slots[0]);
+		table->size = privatedata_slot_count;
+		obj->privatedata = table;
+	}
+
+	table->slots[slot] = data;
+}
+
+void *
+privatedata_get(void *target, const char *key)
+{
+	void *slot;
+
+	if (privatedata_slots == NULL || (slot = mowgli_patricia_retrieve(privatedata_slots, key)) == NULL)
+		return NULL;
+
+	return privatedata_slot_get(target, (unsigned int) ((uintptr_t) slot - 1U));
+}
+
+void
+privatedata_set(void *target, const char *key, void *data)
+{
+	privatedata_slot_set(target, privatedata_slot_register(key), data);
 }
 
 /* vim:cinoptions=>s,e0,n0,f0,{0,}0,^0,=s,ps,t0,c3,+s,(2s,us,)20,*30,gs,hs
@@ -22,8 +22,11 @@ struct timeval burstime;
 
 static mowgli_eventloop_timer_t *ping_uplink_timer = NULL;
 
-static void
-irc_recvq_handler(struct connection *cptr)
+/* copies one line out of the recvq and parses it; for lines that
+ * recvq_peekline() can't hand us in place
+ */
+static bool
+irc_recvq_copyline(struct connection *cptr)
 {
 	bool wasnonl;
 	char parsebuf[BUFSIZE + 1];
@@ -32,18 +35,52 @@ irc_recvq_handler(struct connection *cptr)
 	wasnonl = cptr->flags & CF_NONEWLINE ? true : false;
 	count = recvq_getline(cptr, parsebuf, sizeof parsebuf - 1);
 	if (count <= 0)
-		return;
+		return false;
 	cnt.bin += count;
 	/* ignore the excessive part of a too long line */
 	if (wasnonl)
-		return;
+		return true;
 	me.uplinkpong = CURRTIME;
 	if (parsebuf[count - 1] == '\n')
 		count--;
 	if (count > 0 && parsebuf[count - 1] == '\r')
 		count--;
 	parsebuf[count] = '\0';
+	capture_line(CAPTURE_IN, parsebuf, (size_t) count);
 	parse(parsebuf);
+	return true;
+}
+
+/* parses everything received so far, in place where possible */
+static void
+irc_recvq_handler(struct connection *cptr)
+{
+	char *line;
+	size_t count, len;
+
+	/* stop if a line got the connection closed (which resets recvq_handler) */
+	while (cptr->recvq_handler == irc_recvq_handler)
+	{
+		if (cptr->flags & CF_NONEWLINE || (line = recvq_peekline(cptr, BUFSIZE, &count)) == NULL)
+		{
+			if (!irc_recvq_copyline(cptr))
+				return;
+
+			continue;
+		}
+
+		cnt.bin += count;
+		me.uplinkpong = CURRTIME;
+
+		len = count - 1;
+		if (len > 0 && line[len - 1] == '\r')
+			len--;
+		line[len] = '\0';
+
+		capture_line(CAPTURE_IN, line, (size_t) len);
+		parse(line);
+		recvq_consume(cptr, count);
+	}
 }
 
 static void
@@ -84,6 +121,7 @@ irc_handle_connect(struct connection *cptr)
 		connection_setselect_read(cptr, recvq_put);
 		slog(LG_INFO, "irc_handle_connect(): connection to uplink established");
 		me.connected = true;
+		startup_uplink_connected();
 		/* no SERVER message received */
 		me.recvsvr = false;
 
@@ -100,9 +138,9 @@ irc_handle_connect(struct connection *cptr)
 
 		/* ping our uplink every 5 minutes */
 		if (ping_uplink_timer != NULL)
-			mowgli_timer_destroy(base_eventloop, ping_uplink_timer);
+			timer_destroy(ping_uplink_timer);
 
-		ping_uplink_timer = mowgli_timer_add(base_eventloop, "ping_uplink", ping_uplink, NULL, 300);
+		ping_uplink_timer = timer_add("ping_uplink", ping_uplink, NULL, 300);
 
 		me.uplinkpong = time(NULL);
 	}
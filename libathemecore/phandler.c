@@ -20,8 +20,10 @@ unsigned int(*server_login) (void) = generic_server_login;
 void (*introduce_nick) (struct user *u) = generic_introduce_nick;
 void (*wallops_sts) (const char *text) = generic_wallops_sts;
 void (*join_sts) (struct channel *c, struct user *u, bool isnew, char *modes) = generic_join_sts;
+void (*join_batch_sts) (struct user *u, struct channel **chans, const bool *isnew, size_t count) = generic_join_batch_sts;
 void (*chan_lowerts) (struct channel *c, struct user *u) = generic_chan_lowerts;
 void (*kick) (struct user *source, struct channel *c, struct user *u, const char *reason) = generic_kick;
+void (*kick_batch_sts) (struct user *source, struct channel *c, struct user **users, size_t count, const char *reason) = generic_kick_batch_sts;
 void (*msg) (const char *from, const char *target, const char *fmt, ...) = generic_msg;
 void (*msg_global_sts) (struct user *from, const char *mask, const char *text) = generic_msg_global_sts;
 void (*notice_user_sts) (struct user *from, struct user *target, const char *text) = generic_notice_user_sts;
@@ -53,6 +55,7 @@ void (*sasl_sts) (const char *target, char mode, const char *data) = generic_sas
 void (*sasl_mechlist_sts) (const char *mechlist) = generic_sasl_mechlist_sts;
 bool (*mask_matches_user)(const char *mask, struct user *u) = generic_mask_matches_user;
 mowgli_node_t *(*next_matching_ban)(struct channel *c, struct user *u, int type, mowgli_node_t *first) = generic_next_matching_ban;
+size_t (*matching_bans)(struct channel *c, struct user *u, const char *types, struct chanban **bans) = generic_matching_bans;
 mowgli_node_t *(*next_matching_host_chanacs)(struct mychan *mc, struct user *u, mowgli_node_t *first) = generic_next_matching_host_chanacs;
 bool (*is_valid_nick)(const char *nick) = generic_is_valid_nick;
 bool (*is_valid_host)(const char *host) = generic_is_valid_host;
@@ -102,6 +105,15 @@ generic_join_sts(struct channel *c, struct user *u, bool isnew, char *modes)
 	/* We can't do anything here. Bail. */
 }
 
+void
+generic_join_batch_sts(struct user *u, struct channel **chans, const bool *isnew, size_t count)
+{
+	size_t i;
+
+	for (i = 0; i < count; i++)
+		join_sts(chans[i], u, isnew[i], channel_modes(chans[i], true));
+}
+
 void
 generic_chan_lowerts(struct channel *c, struct user *u)
 {
@@ -115,6 +127,15 @@ generic_kick(struct user *source, struct channel *c, struct user *u, const char
 	/* We can't do anything here. Bail. */
 }
 
+void
+generic_kick_batch_sts(struct user *source, struct channel *c, struct user **users, size_t count, const char *reason)
+{
+	size_t i;
+
+	for (i = 0; i < count; i++)
+		kick(source, c, users[i], reason);
+}
+
 void ATHEME_FATTR_PRINTF(3, 4)
 generic_msg(const char *from, const char *target, const char *fmt, ...)
 {
@@ -334,38 +355,137 @@ generic_sasl_mechlist_sts(const char *mechlist)
 	/* nothing to do here. */
 }
 
+#define GENERIC_MASK_FORMS      4U
+
+struct generic_mask_forms
+{
+	char            buf[GENERIC_MASK_FORMS][NICKLEN + 1 + USERLEN + 1 + HOSTLEN + 1];
+	const char *    forms[GENERIC_MASK_FORMS];
+	size_t          lens[GENERIC_MASK_FORMS];
+	const struct cidr_addr *ipaddr;
+};
+
+static void
+generic_mask_forms_build(struct generic_mask_forms *const mf, struct user *const u)
+{
+	snprintf(mf->buf[0], sizeof mf->buf[0], "%s!%s@%s", u->nick, u->user, u->vhost);
+	snprintf(mf->buf[1], sizeof mf->buf[1], "%s!%s@%s", u->nick, u->user, user_chost(u));
+	snprintf(mf->buf[2], sizeof mf->buf[2], "%s!%s@%s", u->nick, u->user, u->host);
+	/* will be nick!user@ if ip unknown, doesn't matter */
+	snprintf(mf->buf[3], sizeof mf->buf[3], "%s!%s@%s", u->nick, u->user, u->ip);
+
+	for (unsigned int i = 0; i < GENERIC_MASK_FORMS; i++)
+	{
+		mf->forms[i] = mf->buf[i];
+		mf->lens[i] = strlen(mf->buf[i]);
+	}
+
+	mf->ipaddr = &u->ipaddr;
+}
+
+// net is the host part of mask as parsed by cidr_parse_hostmask()
+static bool
+generic_mask_matches_forms(const char *mask, const struct cidr_addr *const net, const struct generic_mask_forms *const mf)
+{
+	return !match(mask, mf->buf[0]) || !match(mask, mf->buf[1]) || !match(mask, mf->buf[2]) || !match(mask, mf->buf[3]) || (ircd->flags & IRCD_CIDR_BANS && !match_cidr_parsed(mask, net, mf->buf[3], mf->ipaddr));
+}
+
 bool
 generic_mask_matches_user(const char *mask, struct user *u)
 {
-	char hostbuf[NICKLEN + 1 + USERLEN + 1 + HOSTLEN + 1];
-	char cloakbuf[NICKLEN + 1 + USERLEN + 1 + HOSTLEN + 1];
-	char realbuf[NICKLEN + 1 + USERLEN + 1 + HOSTLEN + 1];
-	char ipbuf[NICKLEN + 1 + USERLEN + 1 + HOSTLEN + 1];
+	struct cidr_addr net;
 
-	snprintf(hostbuf, sizeof hostbuf, "%s!%s@%s", u->nick, u->user, u->vhost);
-	snprintf(cloakbuf, sizeof cloakbuf, "%s!%s@%s", u->nick, u->user, u->chost);
-	snprintf(realbuf, sizeof realbuf, "%s!%s@%s", u->nick, u->user, u->host);
-	/* will be nick!user@ if ip unknown, doesn't matter */
-	snprintf(ipbuf, sizeof ipbuf, "%s!%s@%s", u->nick, u->user, u->ip);
+	(void) cidr_parse_hostmask(mask, &net);
+
+	return generic_mask_matches_user_parsed(mask, &net, u);
+}
+
+bool
+generic_mask_matches_user_parsed(const char *mask, const struct cidr_addr *net, struct user *u)
+{
+	struct generic_mask_forms mf;
 
-	return !match(mask, hostbuf) || !match(mask, cloakbuf) || !match(mask, realbuf) || !match(mask, ipbuf) || (ircd->flags & IRCD_CIDR_BANS && !match_cidr(mask, ipbuf));
+	generic_mask_forms_build(&mf, u);
+
+	return generic_mask_matches_forms(mask, net, &mf);
 }
 
 mowgli_node_t *
 generic_next_matching_ban(struct channel *c, struct user *u, int type, mowgli_node_t *first)
 {
+	struct generic_mask_forms mf;
 	mowgli_node_t *n;
 
+	/* someone else's mask_matches_user() may match more than the
+	 * user's hosts, so only the generic one can be short-cut
+	 */
+	if (mask_matches_user != &generic_mask_matches_user)
+	{
+		MOWGLI_ITER_FOREACH(n, first)
+		{
+			struct chanban *cb = n->data;
+
+			if (cb->type == type && mask_matches_user(cb->mask, u))
+				return n;
+		}
+		return NULL;
+	}
+
+	generic_mask_forms_build(&mf, u);
+
 	MOWGLI_ITER_FOREACH(n, first)
 	{
 		struct chanban *cb = n->data;
 
-		if (cb->type == type && mask_matches_user(cb->mask, u))
+		if (cb->type == type && chanban_may_match(cb, mf.forms, mf.lens, GENERIC_MASK_FORMS) && generic_mask_matches_forms(cb->mask, &cb->cidr, &mf))
 			return n;
 	}
 	return NULL;
 }
 
+size_t
+generic_matching_bans(struct channel *c, struct user *u, const char *types, struct chanban **bans)
+{
+	struct generic_mask_forms mf;
+	mowgli_node_t *n;
+	size_t count = 0;
+
+	/* a protocol module that only provides next_matching_ban() is
+	 * asked about one type at a time
+	 */
+	if (next_matching_ban != &generic_next_matching_ban)
+	{
+		for (const char *t = types; *t != '\0'; t++)
+			for (n = next_matching_ban(c, u, *t, c->bans.head); n != NULL; n = next_matching_ban(c, u, *t, n->next))
+				bans[count++] = n->data;
+
+		return count;
+	}
+
+	if (mask_matches_user != &generic_mask_matches_user)
+	{
+		MOWGLI_ITER_FOREACH(n, c->bans.head)
+		{
+			struct chanban *cb = n->data;
+
+			if (cb->type != 0 && strchr(types, cb->type) != NULL && mask_matches_user(cb->mask, u))
+				bans[count++] = cb;
+		}
+		return count;
+	}
+
+	generic_mask_forms_build(&mf, u);
+
+	MOWGLI_ITER_FOREACH(n, c->bans.head)
+	{
+		struct chanban *cb = n->data;
+
+		if (cb->type != 0 && strchr(types, cb->type) != NULL && chanban_may_match(cb, mf.forms, mf.lens, GENERIC_MASK_FORMS) && generic_mask_matches_forms(cb->mask, &cb->cidr, &mf))
+			bans[count++] = cb;
+	}
+	return count;
+}
+
 mowgli_node_t *
 generic_next_matching_host_chanacs(struct mychan *mc, struct user *u, mowgli_node_t *first)
 {
@@ -377,7 +497,7 @@ generic_next_matching_host_chanacs(struct mychan *mc, struct user *u, mowgli_nod
 
 		if (ca->entity != NULL)
 		       continue;
-		if (mask_matches_user(ca->host, u))
+		if (mask_matches_user == &generic_mask_matches_user ? generic_mask_matches_user_parsed(ca->host, &ca->cidr, u) : mask_matches_user(ca->host, u))
 			return n;
 	}
 	return NULL;
@@ -18,7 +18,7 @@
 
 mowgli_patricia_t *pcommands;
 
-mowgli_heap_t *pcommand_heap;
+struct named_heap *pcommand_heap;
 mowgli_heap_t *messagetree_heap;
 
 const struct cmode *mode_list = NULL;
@@ -30,10 +30,96 @@ const struct cmode *user_mode_list = NULL;
 struct ircd *ircd = NULL;
 bool backend_loaded = false;
 
+/* Protocol commands are also indexed by a small table whose hash seed (and
+ * size, if need be) is chosen whenever a command is added or removed, so that
+ * no two registered tokens share a slot. Looking up a command for a line read
+ * from the uplink is then one hash of the token and one string comparison.
+ */
+#define PCOMMAND_TABLE_SEEDS    64U
+
+static struct proto_cmd **pcommand_table = NULL;
+static size_t pcommand_table_mask = 0;
+static uint32_t pcommand_table_seed = 0;
+
+static inline uint32_t
+pcommand_hash(const char *token, const uint32_t seed)
+{
+	// FNV-1a, with the seed folded into the offset basis
+	uint32_t h = UINT32_C(0x811C9DC5) ^ (seed * UINT32_C(0x9E3779B9));
+
+	for (; *token != '\0'; token++)
+	{
+		h ^= (unsigned char) *token;
+		h *= UINT32_C(0x01000193);
+	}
+
+	return h ^ (h >> 16);
+}
+
+static bool
+pcommand_table_fill(struct proto_cmd **const table, const size_t mask, const uint32_t seed)
+{
+	mowgli_patricia_iteration_state_t state;
+	struct proto_cmd *pcmd;
+
+	(void) memset(table, 0x00, (mask + 1) * sizeof *table);
+
+	MOWGLI_PATRICIA_FOREACH(pcmd, &state, pcommands)
+	{
+		const size_t slot = pcommand_hash(pcmd->token, seed) & mask;
+
+		if (table[slot] != NULL)
+			return false;
+
+		table[slot] = pcmd;
+	}
+
+	return true;
+}
+
+static void
+pcommand_table_rebuild(void)
+{
+	const size_t count = mowgli_patricia_size(pcommands);
+	size_t size = 16;
+
+	sfree(pcommand_table);
+	pcommand_table = NULL;
+	pcommand_table_mask = 0;
+
+	if (!count)
+		return;
+
+	while (size < count * 4)
+		size <<= 1;
+
+	for (;;)
+	{
+		struct proto_cmd **const table = smalloc(size * sizeof *table);
+
+		for (uint32_t seed = 0; seed < PCOMMAND_TABLE_SEEDS; seed++)
+		{
+			if (pcommand_table_fill(table, size - 1, seed))
+			{
+				pcommand_table = table;
+				pcommand_table_mask = size - 1;
+				pcommand_table_seed = seed;
+
+				slog(LG_DEBUG, "pcommand_table_rebuild(): %zu commands in %zu slots (seed %u)",
+				     count, size, seed);
+				return;
+			}
+		}
+
+		sfree(table);
+		size <<= 1;
+	}
+}
+
 void
 pcommand_init(void)
 {
-	pcommand_heap = sharedheap_get(sizeof(struct proto_cmd));
+	pcommand_heap = named_heap_get("pcommand", sizeof(struct proto_cmd));
 
 	if (!pcommand_heap)
 	{
@@ -55,13 +141,18 @@ pcommand_add(const char *token, void (*handler) (struct sourceinfo *si, int parc
 		return;
 	}
 
-	pcmd = mowgli_heap_alloc(pcommand_heap);
+	pcmd = named_heap_alloc(pcommand_heap);
 	pcmd->token = sstrdup(token);
 	pcmd->handler = handler;
 	pcmd->minparc = minparc;
 	pcmd->sourcetype = sourcetype;
+	pcmd->lines = 0;
+	pcmd->bytes = 0;
+	pcmd->total_us = 0;
+	pcmd->max_us = 0;
 
 	mowgli_patricia_add(pcommands, pcmd->token, pcmd);
+	pcommand_table_rebuild();
 }
 
 void
@@ -76,16 +167,78 @@ pcommand_delete(const char *token)
 	}
 
 	mowgli_patricia_delete(pcommands, pcmd->token);
+	pcommand_table_rebuild();
 
 	sfree(pcmd->token);
 	pcmd->handler = NULL;
-	mowgli_heap_free(pcommand_heap, pcmd);
+
+	// This may be the handler running now (a module unloaded by a PRIVMSG to a service)
+	named_heap_free_deferred(pcommand_heap, pcmd);
 }
 
 struct proto_cmd *
 pcommand_find(const char *token)
 {
-	return mowgli_patricia_retrieve(pcommands, token);
+	struct proto_cmd *pcmd;
+
+	if (pcommand_table == NULL)
+		return NULL;
+
+	pcmd = pcommand_table[pcommand_hash(token, pcommand_table_seed) & pcommand_table_mask];
+
+	if (pcmd == NULL || strcmp(pcmd->token, token) != 0)
+		return NULL;
+
+	return pcmd;
+}
+
+/*
+ * pcommand_dispatch()
+ *
+ * Runs a protocol command's handler for a line the transport has already
+ * checked the source and parameters of, adding the time it took to the
+ * command's statistics. pcmd stays valid until the end of the loop pass
+ * even if the handler deletes it.
+ */
+void
+pcommand_dispatch(struct proto_cmd *const restrict pcmd, struct sourceinfo *const restrict si, const int parc,
+                  char *parv[])
+{
+	struct timeval started, elapsed;
+
+	return_if_fail(pcmd != NULL);
+	return_if_fail(pcmd->handler != NULL);
+
+	s_time(&started);
+	pcmd->handler(si, parc, parv);
+	e_time(started, &elapsed);
+
+	const unsigned long long us = (((unsigned long long) elapsed.tv_sec) * 1000000ULL) + elapsed.tv_usec;
+
+	pcmd->total_us += us;
+
+	if (us > pcmd->max_us)
+		pcmd->max_us = us;
+}
+
+/*
+ * pcommand_stats_foreach()
+ *
+ * Calls cb for every registered protocol command, in token order.
+ */
+void
+pcommand_stats_foreach(void (*const cb)(const struct proto_cmd *, void *), void *const privdata)
+{
+	mowgli_patricia_iteration_state_t state;
+	struct proto_cmd *pcmd;
+
+	return_if_fail(cb != NULL);
+
+	if (pcommands == NULL)
+		return;
+
+	MOWGLI_PATRICIA_FOREACH(pcmd, &state, pcommands)
+		cb(pcmd, privdata);
 }
 
 /* vim:cinoptions=>s,e0,n0,f0,{0,}0,^0,=s,ps,t0,c3,+s,(2s,us,)20,*30,gs,hs
@@ -19,18 +19,102 @@
 mowgli_list_t operclasslist;
 mowgli_list_t soperlist;
 
-static mowgli_heap_t *operclass_heap = NULL;
-static mowgli_heap_t *soper_heap = NULL;
+static struct named_heap *operclass_heap = NULL;
+static struct named_heap *soper_heap = NULL;
 
 static struct operclass *user_r = NULL;
 static struct operclass *authenticated_r = NULL;
 static struct operclass *ircop_r = NULL;
 
+/* Every privilege named by an operclass gets a small numeric ID, and each
+ * operclass keeps its privileges (inherited ones included, as conf.c folds
+ * those into the string) as a bitset of those IDs. A check then only has to
+ * look the name up once and test a bit in each operclass it consults. A
+ * name no operclass has ever listed has no ID, and nobody has it.
+ */
+#define PRIV_ID_NONE                    UINT_MAX
+#define PRIVSET_WORD_BITS               64U
+
+static mowgli_patricia_t *priv_ids = NULL;
+static unsigned int priv_id_count = 0;
+
+static unsigned int
+priv_id_find(const char *const restrict priv)
+{
+	if (priv == NULL || ! *priv)
+		return PRIV_ID_NONE;
+
+	const void *const id = mowgli_patricia_retrieve(priv_ids, priv);
+
+	return (id != NULL) ? ((unsigned int) (uintptr_t) id - 1U) : PRIV_ID_NONE;
+}
+
+static unsigned int
+priv_id_intern(const char *const restrict priv)
+{
+	unsigned int id = priv_id_find(priv);
+
+	if (id != PRIV_ID_NONE)
+		return id;
+
+	id = priv_id_count++;
+
+	(void) mowgli_patricia_add(priv_ids, priv, (void *) (uintptr_t) (id + 1U));
+
+	return id;
+}
+
+static void
+operclass_set_privs(struct operclass *const restrict operclass, const char *const restrict privs)
+{
+	sfree(operclass->privs);
+	sfree(operclass->privset);
+
+	operclass->privs = sstrdup(privs);
+	operclass->privset = NULL;
+	operclass->privset_words = 0;
+
+	char *const buf = sstrdup(privs);
+	char *saveptr = NULL;
+
+	for (const char *priv = strtok_r(buf, " \t\r\n", &saveptr); priv != NULL; priv = strtok_r(NULL, " \t\r\n", &saveptr))
+	{
+		const unsigned int id = priv_id_intern(priv);
+		const unsigned int word = id / PRIVSET_WORD_BITS;
+
+		if (word >= operclass->privset_words)
+		{
+			operclass->privset = srealloc(operclass->privset, (word + 1U) * sizeof *operclass->privset);
+			(void) memset(operclass->privset + operclass->privset_words, 0x00,
+			              (word + 1U - operclass->privset_words) * sizeof *operclass->privset);
+			operclass->privset_words = word + 1U;
+		}
+
+		operclass->privset[word] |= (UINT64_C(1) << (id % PRIVSET_WORD_BITS));
+	}
+
+	sfree(buf);
+}
+
+static inline bool
+operclass_has_priv_id(const struct operclass *const restrict operclass, const unsigned int id)
+{
+	if (operclass == NULL || id == PRIV_ID_NONE)
+		return false;
+
+	const unsigned int word = id / PRIVSET_WORD_BITS;
+
+	if (word >= operclass->privset_words)
+		return false;
+
+	return (operclass->privset[word] & (UINT64_C(1) << (id % PRIVSET_WORD_BITS))) != 0;
+}
+
 void
 init_privs(void)
 {
-	operclass_heap = sharedheap_get(sizeof(struct operclass));
-	soper_heap = sharedheap_get(sizeof(struct soper));
+	operclass_heap = named_heap_get("operclass", sizeof(struct operclass));
+	soper_heap = named_heap_get("soper", sizeof(struct soper));
 
 	if (!operclass_heap || !soper_heap)
 	{
@@ -38,6 +122,8 @@ init_privs(void)
 		exit(EXIT_FAILURE);
 	}
 
+	priv_ids = mowgli_patricia_create(strcasecanon);
+
 	/* create built-in operclasses. */
 	user_r = operclass_add("user", "", OPERCLASS_BUILTIN);
 	authenticated_r = operclass_add("authenticated", AC_AUTHENTICATED, OPERCLASS_BUILTIN);
@@ -66,8 +152,7 @@ operclass_add(const char *name, const char *privs, int flags)
 
 		slog(LG_DEBUG, "operclass_add(): update %s [%s]", name, privs);
 
-		sfree(operclass->privs);
-		operclass->privs = sstrdup(privs);
+		operclass_set_privs(operclass, privs);
 		operclass->flags = flags | (builtin ? OPERCLASS_BUILTIN : 0);
 
 		return operclass;
@@ -75,11 +160,12 @@ operclass_add(const char *name, const char *privs, int flags)
 
 	slog(LG_DEBUG, "operclass_add(): create %s [%s]", name, privs);
 
-	operclass = mowgli_heap_alloc(operclass_heap);
+	operclass = named_heap_alloc(operclass_heap);
 	operclass->name = sstrdup(name);
-	operclass->privs = sstrdup(privs);
 	operclass->flags = flags;
 
+	operclass_set_privs(operclass, privs);
+
 	mowgli_node_add(operclass, &operclass->node, &operclasslist);
 
 	cnt.operclass++;
@@ -118,8 +204,9 @@ operclass_delete(struct operclass *operclass)
 
 	sfree(operclass->name);
 	sfree(operclass->privs);
+	sfree(operclass->privset);
 
-	mowgli_heap_free(operclass_heap, operclass);
+	named_heap_free(operclass_heap, operclass);
 	cnt.operclass--;
 }
 
@@ -175,7 +262,7 @@ soper_add(const char *name, const char *classname, int flags, const char *passwo
 
 	slog(LG_DEBUG, "soper_add(): %s -> %s", (mu) ? entity(mu)->name : name, operclass ? operclass->name : "<null>");
 
-	soper = mowgli_heap_alloc(soper_heap);
+	soper = named_heap_alloc(soper_heap);
 	n = mowgli_node_create();
 
 	mowgli_node_add(soper, n, &soperlist);
@@ -227,7 +314,7 @@ soper_delete(struct soper *soper)
 	sfree(soper->classname);
 	sfree(soper->password);
 
-	mowgli_heap_free(soper_heap, soper);
+	named_heap_free(soper_heap, soper);
 
 	cnt.soper--;
 }
@@ -293,11 +380,7 @@ is_conf_soper(struct myuser *myuser)
 bool
 has_priv_operclass(struct operclass *operclass, const char *priv)
 {
-	if (operclass == NULL)
-		return false;
-	if (string_in_list(priv, operclass->privs))
-		return true;
-	return false;
+	return operclass_has_priv_id(operclass, priv_id_find(priv));
 }
 
 bool
@@ -322,31 +405,21 @@ has_any_privs_user(struct user *u)
 	return false;
 }
 
-bool
-has_priv(struct sourceinfo *si, const char *priv)
-{
-	return si->su != NULL ? has_priv_user(si->su, priv) :
-		has_priv_myuser(si->smu, priv);
-}
-
-bool
-has_priv_user(struct user *u, const char *priv)
+static bool
+has_priv_user_id(struct user *u, unsigned int id)
 {
 	struct operclass *operclass;
 
-	if (priv == NULL)
-		return true;
-
-	if (u == NULL)
+	if (u == NULL || id == PRIV_ID_NONE)
 		return false;
 
-	if (has_priv_operclass(user_r, priv))
+	if (operclass_has_priv_id(user_r, id))
 		return true;
 
-	if (is_ircop(u) && has_priv_operclass(ircop_r, priv))
+	if (is_ircop(u) && operclass_has_priv_id(ircop_r, id))
 		return true;
 
-	if (u->myuser != NULL && has_priv_operclass(authenticated_r, priv))
+	if (u->myuser != NULL && operclass_has_priv_id(authenticated_r, id))
 		return true;
 
 	if (u->myuser && is_soper(u->myuser))
@@ -358,24 +431,22 @@ has_priv_user(struct user *u, const char *priv)
 			return false;
 		if (u->myuser->soper->password != NULL && !(u->flags & UF_SOPER_PASS))
 			return false;
-		if (has_priv_operclass(operclass, priv))
+		if (operclass_has_priv_id(operclass, id))
 			return true;
 	}
 
 	return false;
 }
 
-bool
-has_priv_myuser(struct myuser *mu, const char *priv)
+static bool
+has_priv_myuser_id(struct myuser *mu, unsigned int id)
 {
 	struct operclass *operclass;
 
-	if (priv == NULL)
-		return true;
-	if (mu == NULL)
+	if (mu == NULL || id == PRIV_ID_NONE)
 		return false;
 
-	if (has_priv_operclass(authenticated_r, priv))
+	if (operclass_has_priv_id(authenticated_r, id))
 		return true;
 
 	if (!is_soper(mu))
@@ -383,30 +454,54 @@ has_priv_myuser(struct myuser *mu, const char *priv)
 	operclass = mu->soper->operclass;
 	if (operclass == NULL)
 		return false;
-	if (has_priv_operclass(operclass, priv))
+	if (operclass_has_priv_id(operclass, id))
 		return true;
 
 	return false;
 }
 
 bool
-has_all_operclass(struct sourceinfo *si, struct operclass *operclass)
+has_priv(struct sourceinfo *si, const char *priv)
 {
-	char *privs2;
-	char *priv;
+	return si->su != NULL ? has_priv_user(si->su, priv) :
+		has_priv_myuser(si->smu, priv);
+}
 
-	privs2 = sstrdup(operclass->privs);
-	priv = strtok(privs2, " ");
-	while (priv != NULL)
+bool
+has_priv_user(struct user *u, const char *priv)
+{
+	if (priv == NULL)
+		return true;
+
+	return has_priv_user_id(u, priv_id_find(priv));
+}
+
+bool
+has_priv_myuser(struct myuser *mu, const char *priv)
+{
+	if (priv == NULL)
+		return true;
+
+	return has_priv_myuser_id(mu, priv_id_find(priv));
+}
+
+bool
+has_all_operclass(struct sourceinfo *si, struct operclass *operclass)
+{
+	for (unsigned int word = 0; word < operclass->privset_words; word++)
 	{
-		if (!has_priv(si, priv))
+		for (unsigned int bit = 0; bit < PRIVSET_WORD_BITS; bit++)
 		{
-			sfree(privs2);
-			return false;
+			const unsigned int id = (word * PRIVSET_WORD_BITS) + bit;
+
+			if (!(operclass->privset[word] & (UINT64_C(1) << bit)))
+				continue;
+
+			if (si->su != NULL ? !has_priv_user_id(si->su, id) : !has_priv_myuser_id(si->smu, id))
+				return false;
 		}
-		priv = strtok(NULL, " ");
 	}
-	sfree(privs2);
+
 	return true;
 }
 
@@ -107,6 +107,38 @@ connection_stats_cb(const char *line, void *privdata)
 	numeric_sts(me.me, 249, ((struct user *)privdata), "F :%s", line);
 }
 
+static void
+timer_stats_cb(const struct timer_stats *st, void *privdata)
+{
+	numeric_sts(me.me, 249, ((struct user *)privdata), "E :%-28s %7u runs, %7llu us avg, %7llu us max, %u slow",
+			st->name, st->runs, st->total_us / (st->runs ? st->runs : 1), st->max_us, st->slow);
+}
+
+static void
+named_heap_stats_cb(const struct named_heap *nh, void *privdata)
+{
+	numeric_sts(me.me, 249, ((struct user *)privdata), "Z :%-16s %5zu B %8zu live %8zu peak %8zu KB used %8zu KB reserved",
+			nh->name, nh->size, nh->live, nh->peak, (nh->live * nh->size) / 1024, named_heap_reserved(nh) / 1024);
+}
+
+static void
+command_stats_cb(const struct command_stats *st, void *privdata)
+{
+	numeric_sts(me.me, 249, ((struct user *)privdata), "M :%-32s %7u calls, %7llu us avg, %7llu us p99, %7llu us max, %u slow",
+			st->name, st->calls, st->total_us / (st->calls ? st->calls : 1),
+			command_stats_percentile(st, 99), st->max_us, st->slow);
+}
+
+static void
+pcommand_stats_cb(const struct proto_cmd *pcmd, void *privdata)
+{
+	if (! pcmd->lines)
+		return;
+
+	numeric_sts(me.me, 249, ((struct user *)privdata), "P :%-12s %9llu lines, %11llu bytes, %7llu us avg, %7llu us max",
+			pcmd->token, pcmd->lines, pcmd->bytes, pcmd->total_us / pcmd->lines, pcmd->max_us);
+}
+
 void
 handle_stats(struct user *u, char req)
 {
@@ -165,6 +197,8 @@ handle_stats(struct user *u, char req)
 				  numeric_sts(me.me, 249, u, "E :%-28s %4ld seconds (%ld)", timer->name, (long)(timer->deadline - mowgli_eventloop_get_time(base_eventloop)), (long)timer->frequency);
 		  }
 
+		  timer_stats_foreach(timer_stats_cb, u);
+
 		  break;
 
 	  case 'f':
@@ -220,6 +254,14 @@ handle_stats(struct user *u, char req)
 
 		  break;
 
+	  case 'M':
+	  case 'm':
+		  if (!has_priv_user(u, PRIV_SERVER_AUSPEX))
+			  break;
+
+		  command_stats_foreach(command_stats_cb, u);
+		  break;
+
 	  case 'o':
 	  case 'O':
 		  if (!has_priv_user(u, PRIV_VIEWPRIVS))
@@ -243,6 +285,14 @@ handle_stats(struct user *u, char req)
 		  }
 		  break;
 
+	  case 'P':
+	  case 'p':
+		  if (!has_priv_user(u, PRIV_SERVER_AUSPEX))
+			  break;
+
+		  pcommand_stats_foreach(pcommand_stats_cb, u);
+		  break;
+
 	  case 'T':
 	  case 't':
 		  if (!has_priv_user(u, PRIV_SERVER_AUSPEX))
@@ -266,6 +316,9 @@ handle_stats(struct user *u, char req)
 		  numeric_sts(me.me, 249, u, "T :myuser_nam %7u", cnt.myuser_name);
 		  numeric_sts(me.me, 249, u, "T :mychan     %7u", cnt.mychan);
 		  numeric_sts(me.me, 249, u, "T :chanacs    %7u", cnt.chanacs);
+		  numeric_sts(me.me, 249, u, "T :expq_user  %7u", myuser_expiry.count);
+		  numeric_sts(me.me, 249, u, "T :expq_nick  %7u", mynick_expiry.count);
+		  numeric_sts(me.me, 249, u, "T :expq_chan  %7u", mychan_expiry.count);
 
 #ifdef OBJECT_DEBUG
 		  numeric_sts(me.me, 249, u, "T :objects    %7zu", MOWGLI_LIST_LENGTH(&object_list));
@@ -273,6 +326,23 @@ handle_stats(struct user *u, char req)
 
 		  numeric_sts(me.me, 249, u, "T :bytes sent %7.2f%s", (double) bytes(cnt.bout), sbytes(cnt.bout));
 		  numeric_sts(me.me, 249, u, "T :bytes recv %7.2f%s", (double) bytes(cnt.bin), sbytes(cnt.bin));
+		  numeric_sts(me.me, 249, u, "T :writes     %7u (%.1f bytes each)", cnt.bout_writes,
+				  (double) cnt.bout_written / (cnt.bout_writes ? cnt.bout_writes : 1));
+		  numeric_sts(me.me, 249, u, "T :sendq pool %7.2f%s (peak %.2f%s, %u slabs cached, %u refused)",
+				  (double) bytes(sendq_pool.bytes), sbytes(sendq_pool.bytes),
+				  (double) bytes(sendq_pool.peak), sbytes(sendq_pool.peak),
+				  sendq_pool.cached, sendq_pool.refused);
+
+		  struct pwverify_stats pws;
+		  pwverify_get_stats(&pws);
+		  numeric_sts(me.me, 249, u, "T :pwverify   %7u (threads %u, processes %u, queued %u, running %u)",
+				  pws.completed, pws.threads, pws.processes, pws.queued, pws.running);
+		  numeric_sts(me.me, 249, u, "T :pwv. lat.  %7ums avg, %ums max", pws.latency_avg, pws.latency_max);
+
+		  struct crypt_verify_stats cvs;
+		  crypt_get_verify_stats(&cvs);
+		  numeric_sts(me.me, 249, u, "T :pw hashes  %7u by prefix, %u probed (%u provider calls)", cvs.dispatched,
+				  cvs.probed, cvs.probe_calls);
 		  break;
 
 	  case 'u':
@@ -334,6 +404,16 @@ handle_stats(struct user *u, char req)
 				  me.recontime, config_options.uplink_sendq_limit);
 		  break;
 
+	  case 'z':
+	  case 'Z':
+		  if (!has_priv_user(u, PRIV_SERVER_AUSPEX))
+			  break;
+
+		  named_heap_foreach(named_heap_stats_cb, u);
+		  numeric_sts(me.me, 249, u, "Z :%zu freed objects waiting, %zu peak, %llu handed back",
+				  named_heap_deferred.pending, named_heap_deferred.peak, named_heap_deferred.reclaimed);
+		  break;
+
 	  default:
 		  break;
 	}
@@ -353,7 +433,7 @@ handle_whois(struct user *u, const char *target)
 
 	if (t != NULL)
 	{
-		numeric_sts(me.me, 311, u, "%s %s %s * :%s", t->nick, t->user, t->vhost, t->gecos);
+		numeric_sts(me.me, 311, u, "%s %s %s * :%s", t->nick, t->user, t->vhost, user_gecos(t));
 		/* channels purposely omitted */
 		numeric_sts(me.me, 312, u, "%s %s :%s", t->nick, t->server->name, t->server->desc);
 		if (t->flags & UF_AWAY)
@@ -513,6 +593,10 @@ handle_channel_message(struct sourceinfo *si, char *target, bool is_notice, char
 
 	hook_call_channel_message(&cdata);
 
+	// most channel messages are not for us
+	if (!channel_fantasy_candidate(cdata.c, message))
+		return;
+
 	vec[0] = target;
 	vec[1] = message;
 	vec[2] = NULL;
@@ -607,6 +691,8 @@ handle_message(struct sourceinfo *si, char *target, bool is_notice, char *messag
 			}
 		}
 	}
+	else if ((si->service = service_find_target(target)) != NULL)
+		target_u = si->service->me;
 	else
 	{
 		target_u = user_find(target);
@@ -651,13 +737,16 @@ handle_message(struct sourceinfo *si, char *target, bool is_notice, char *messag
 	if (sentinel != NULL)
 		*sentinel = '\0';
 
+	if (!is_notice)
+	{
+		command_queue_dispatch(si, target, message);
+		return;
+	}
+
 	vec[0] = target;
 	vec[1] = message;
 	vec[2] = NULL;
-	if (is_notice)
-		si->service->notice_handler(si, 2, vec);
-	else
-		si->service->handler(si, 2, vec);
+	si->service->notice_handler(si, 2, vec);
 }
 
 void
@@ -832,7 +921,7 @@ handle_server(struct sourceinfo *si, const char *name, const char *sid,
 		/* A server introducing another server */
 		s = server_add(name, hops, si->s, sid, desc);
 	}
-	else if (cnt.server == 1)
+	else if (me.actual == NULL)
 	{
 		/* Our uplink introducing itself */
 		if (irccasecmp(name, curr_uplink->name))
@@ -859,7 +948,13 @@ handle_eob(struct server *s)
 	slog(LG_NETWORK, "handle_eob(): end of burst from %s (%u users)",
 			s->name, s->users);
 	hook_call_server_eob(s);
+	burst_run(s);
 	s->flags |= SF_EOB;
+	if (s->uplink == me.me)
+	{
+		uplink_reconcile_done();
+		startup_uplink_synced();
+	}
 	/* convert P10 style EOB to ircnet/ratbox style */
 	MOWGLI_ITER_FOREACH(n, s->children.head)
 	{
@@ -880,7 +975,6 @@ floodcheck(struct user *u, struct user *t)
 {
 	const char *from;
 	static time_t last_ignore_notice = 0;
-	unsigned int reduction;
 
 	if (t == NULL)
 		from = me.name;
@@ -895,10 +989,10 @@ floodcheck(struct user *u, struct user *t)
 	/* Check if we match a services ignore */
 	if (svsignore_find(u) && !has_priv_user(u, PRIV_ADMIN))
 	{
-		if (u->msgs == 0 && last_ignore_notice != CURRTIME)
+		if (!(u->flags & UF_IGNORESEEN) && last_ignore_notice != CURRTIME)
 		{
 			/* tell them once per session, don't flood */
-			u->msgs = 1;
+			u->flags |= UF_IGNORESEEN;
 			last_ignore_notice = CURRTIME;
 			notice(from, u->nick, _("You are on services ignore. You may not use any service."));
 		}
@@ -914,37 +1008,26 @@ floodcheck(struct user *u, struct user *t)
 			{
 				u->offenses -= 10;
 				u->lastmsg = CURRTIME;
-				u->msgs = 0;
+				ratelimit_reset(&u->flood);
 			}
 			else
 				return 1;
 		}
 
-		if (u->lastmsg != 0 && CURRTIME > u->lastmsg)
-		{
-			reduction = (CURRTIME - u->lastmsg) * (config_options.flood_msgs * FLOOD_MSGS_FACTOR / config_options.flood_time);
-			if (u->msgs > reduction)
-				u->msgs -= reduction;
-			else
-				u->msgs = 0;
-		}
-		u->lastmsg = CURRTIME;
-		u->msgs += FLOOD_MSGS_FACTOR;
-
-		if (u->msgs > config_options.flood_msgs * FLOOD_MSGS_FACTOR)
+		if (!ratelimit_take(&u->flood, FLOOD_MSGS_FACTOR, config_options.flood_msgs, config_options.flood_time))
 		{
 			/* they're flooding. */
 			/* perhaps allowed to? -- jilles */
 			if (has_priv_user(u, PRIV_FLOOD))
 			{
-				u->msgs = 0;
+				ratelimit_reset(&u->flood);
 				return 0;
 			}
 			if (!u->offenses)
 			{
 				/* ignore them the first time */
 				u->lastmsg = CURRTIME;
-				u->msgs = 0;
+				ratelimit_reset(&u->flood);
 				u->offenses = 11;
 
 				notice(from, u->nick, _("You have triggered services flood protection."));
@@ -959,7 +1042,7 @@ floodcheck(struct user *u, struct user *t)
 			{
 				/* ignore them the second time */
 				u->lastmsg = CURRTIME;
-				u->msgs = 0;
+				ratelimit_reset(&u->flood);
 				u->offenses = 12;
 
 				notice(from, u->nick, _("You have triggered services flood protection."));
@@ -988,7 +1071,7 @@ void
 command_add_flood(struct sourceinfo *si, unsigned int amount)
 {
 	if (si->su != NULL)
-		si->su->msgs += amount;
+		ratelimit_charge(&si->su->flood, amount, config_options.flood_msgs, config_options.flood_time);
 }
 
 bool
@@ -0,0 +1,1502 @@
+/*
+ * SPDX-License-Identifier: ISC
+ * SPDX-URL: https://spdx.org/licenses/ISC.html
+ *
+ * Copyright (C) 2026 Atheme Development Group (https://atheme.github.io/)
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * atheme-services: A collection of minimalist IRC services
+ * pwverify.c: Asynchronous password verification.
+ *
+ * Modern password hashes are deliberately expensive; verifying one on the
+ * main thread stalls every other client for tens of milliseconds. Requests
+ * made through verify_password_async() are handed to a small pool of worker
+ * threads that only run the crypto providers' verify functions. Everything
+ * that touches services state (looking the account up again, re-encrypting
+ * the password, the caller's callback) happens back on the main thread when
+ * the worker signals completion through a pipe.
+ *
+ * Custom authentication modules that provide auth_user_custom_async() take
+ * the request over instead and hand it back when their server has answered.
+ *
+ * Other public-key work that SASL mechanisms would otherwise do on the main
+ * thread (signature verification, for instance) can be handed to the same
+ * workers with crypto_job_submit(); such jobs are run one at a time rather
+ * than batched, and their completion functions likewise run on the main
+ * thread.
+ *
+ * Re-encrypting a password after a successful login (a new default provider,
+ * or higher costs) is queued here too, at low priority: at most one worker
+ * does it at a time, only when no login is waiting, and at most
+ * general::password_upgrade_rate of them are started per minute, so that a
+ * mass migration to new hash costs does not take over the CPU.
+ *
+ * With general::auth_processes, logins can also be checked by forked worker
+ * processes, one socket each; these take the hashes the threads cannot (the
+ * providers that are not thread-safe) and, without threads, all of them.
+ * Each request carries the hash it is checked against, so the workers need
+ * no copy of the database; they only inherit the crypto providers, and are
+ * replaced whenever the list of providers changes. A worker that dies has
+ * its outstanding requests verified here instead, and is replaced after
+ * PWVERIFY_PROC_RESPAWN seconds.
+ *
+ * Without threads or processes (auth_threads = 0 or no POSIX threads), and
+ * for accounts the workers cannot handle (custom auth modules without an
+ * asynchronous interface, unencrypted passwords, hashes from providers that
+ * are not thread-safe when there are no worker processes), the request is
+ * verified synchronously on the next pass through the event loop instead,
+ * so callers see the same behaviour either way.
+ */
+
+#include <atheme.h>
+#include "internal.h"
+
+#ifdef HAVE_USABLE_PTHREAD
+#  include <pthread.h>
+#endif
+
+#define PWVERIFY_THREADS_MAX    64U
+#define PWVERIFY_BATCH_MAX      8U      // Enough to fill the widest multi-buffer PBKDF2 kernel
+#define PWVERIFY_REHASH_MAX     4096U   // Re-encryptions waiting; more are dropped until the next login
+#define PWVERIFY_PROC_DEPTH     8U      // Requests written to a worker process ahead of its answers
+#define PWVERIFY_PROC_RESPAWN   10      // Seconds before a worker process that died is replaced
+
+enum pwverify_state
+{
+	PWVERIFY_QUEUED     = 0,    // Waiting for a worker
+	PWVERIFY_RUNNING    = 1,    // A worker is verifying it
+	PWVERIFY_DONE       = 2,    // Waiting for the main thread
+	PWVERIFY_CUSTOM     = 3,    // A custom authentication module is verifying it
+	PWVERIFY_PROCESS    = 4,    // Waiting for, or written to, a worker process
+};
+
+struct pwverify_request
+{
+	struct pwverify_request *   next;
+	verify_password_cb          cb;
+	void *                      priv;
+	enum pwverify_state         state;
+	bool                        cancelled;      // Caller went away; free without calling cb
+	bool                        decided;        // A worker produced the result below
+	bool                        custom;         // ... or a custom authentication module did
+	bool                        verified;
+	bool                        rehash;         // Re-encryption rather than verification; cb is NULL
+	bool                        job;            // crypto_job_submit(); cb is NULL, run and done are used
+	crypto_job_run_fn           run;
+	crypto_job_done_fn          done;
+	unsigned int                verify_flags;
+	char                        ci_id[BUFSIZE]; // Provider that verified it, for password_rehash()
+	char                        eid[IDLEN + 1];
+	char                        password[PASSLEN + 1];
+	char                        parameters[PASSLEN + 1];   // mu->pass when the request was made
+	char                        result[PASSLEN + 1];       // Re-encryptions: the new hash, if verified
+#ifdef HAVE_GETTIMEOFDAY
+	struct timeval              submitted;
+#endif
+};
+
+struct pwverify_queue
+{
+	struct pwverify_request *   head;
+	struct pwverify_request *   tail;
+};
+
+static struct pwverify_queue pwverify_done = { NULL, NULL };
+static mowgli_eventloop_timer_t *pwverify_timer = NULL;
+
+static unsigned int pwverify_completed = 0;
+static unsigned int pwverify_latency_max = 0;
+static unsigned long long pwverify_latency_total = 0;
+
+// Main thread only: re-encryptions not yet handed to a worker or run
+static struct pwverify_queue pwverify_rehash_waiting = { NULL, NULL };
+static mowgli_eventloop_timer_t *pwverify_rehash_timer = NULL;
+static unsigned int pwverify_rehash_nwaiting = 0;
+static unsigned int pwverify_rehash_ninflight = 0;
+static unsigned long long pwverify_rehash_credit = 0;
+static time_t pwverify_rehash_credited = 0;
+static unsigned int pwverify_rehash_done = 0;
+static unsigned int pwverify_rehash_dropped = 0;
+static unsigned int pwverify_rehash_stale = 0;
+
+#ifdef HAVE_USABLE_PTHREAD
+static pthread_mutex_t pwverify_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pwverify_work_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t pwverify_idle_cond = PTHREAD_COND_INITIALIZER;
+
+static struct pwverify_queue pwverify_pending = { NULL, NULL };
+static struct pwverify_queue pwverify_rehash_ready = { NULL, NULL };
+static bool pwverify_rehash_running = false;
+static pthread_t *pwverify_threads = NULL;
+static unsigned int pwverify_nthreads = 0;
+static unsigned int pwverify_nqueued = 0;
+static unsigned int pwverify_nrunning = 0;
+static unsigned int pwverify_paused = 0;
+static bool pwverify_stopping = false;
+
+static int pwverify_pipe[2] = { -1, -1 };
+static mowgli_eventloop_pollable_t *pwverify_pollable = NULL;
+#endif /* HAVE_USABLE_PTHREAD */
+
+#ifndef MOWGLI_OS_WIN
+// What goes over a worker process's socket; both ends are the same binary
+struct pwverify_proc_request
+{
+	char                        password[PASSLEN + 1];
+	char                        parameters[PASSLEN + 1];
+};
+
+struct pwverify_proc_result
+{
+	unsigned int                verify_flags;
+	bool                        verified;
+	char                        ci_id[BUFSIZE];
+};
+
+struct pwverify_proc
+{
+	pid_t                       pid;            // 0 once it has been reaped
+	int                         fd;             // -1 once it has been lost
+	mowgli_eventloop_pollable_t *pollable;
+	struct pwverify_queue       inflight;       // Written to it; it answers them in the same order
+	unsigned int                ninflight;
+	size_t                      rlen;
+	unsigned char               rbuf[sizeof(struct pwverify_proc_result)];
+};
+
+// Main thread only
+static struct pwverify_proc pwverify_procs[PWVERIFY_THREADS_MAX];
+static struct pwverify_queue pwverify_proc_waiting = { NULL, NULL };
+static unsigned int pwverify_nprocs = 0;        // Configured
+static unsigned int pwverify_nprocs_up = 0;     // ... of which are running
+static unsigned int pwverify_proc_nwaiting = 0;
+static unsigned int pwverify_proc_nrunning = 0;
+static time_t pwverify_procs_respawn = 0;
+static bool pwverify_procs_stale = false;
+#endif /* !MOWGLI_OS_WIN */
+
+static void
+pwverify_queue_push(struct pwverify_queue *const restrict q, struct pwverify_request *const restrict req)
+{
+	req->next = NULL;
+
+	if (q->tail)
+		q->tail->next = req;
+	else
+		q->head = req;
+
+	q->tail = req;
+}
+
+static struct pwverify_request *
+pwverify_queue_pop(struct pwverify_queue *const restrict q)
+{
+	struct pwverify_request *const req = q->head;
+
+	if (req && ! (q->head = req->next))
+		q->tail = NULL;
+
+	return req;
+}
+
+static bool
+pwverify_queue_remove(struct pwverify_queue *const restrict q, struct pwverify_request *const restrict req)
+{
+	struct pwverify_request *prev = NULL;
+
+	for (struct pwverify_request *iter = q->head; iter != NULL; prev = iter, iter = iter->next)
+	{
+		if (iter != req)
+			continue;
+
+		if (prev)
+			prev->next = req->next;
+		else
+			q->head = req->next;
+
+		if (q->tail == req)
+			q->tail = prev;
+
+		return true;
+	}
+
+	return false;
+}
+
+static void
+pwverify_request_free(struct pwverify_request *const restrict req)
+{
+	(void) smemzerofree(req, sizeof *req);
+}
+
+// Does the work of a re-encryption; on a worker only if the provider is threadsafe
+static void
+pwverify_rehash_run(struct pwverify_request *const restrict req)
+{
+	const struct crypt_impl *const ci = crypt_get_named_provider(req->ci_id);
+
+	req->verified = (ci && ci->crypt && crypt_password_using(ci, req->password, req->result, sizeof req->result));
+	req->decided = true;
+}
+
+static void
+pwverify_rehash_finish(struct pwverify_request *const restrict req)
+{
+	struct myuser *const mu = user(myentity_find_uid(req->eid));
+
+	pwverify_rehash_ninflight--;
+
+	if (! mu || strcmp(mu->pass, req->parameters) != 0)
+	{
+		// Dropped or changed its password while we were busy
+		pwverify_rehash_stale++;
+		return;
+	}
+
+	// The pool was stopped before a worker got to it
+	if (! req->decided)
+		(void) pwverify_rehash_run(req);
+
+	if (! req->verified)
+	{
+		(void) slog(LG_ERROR, "%s: hash generation failed for account '%s'", MOWGLI_FUNC_NAME,
+		                      entity(mu)->name);
+		pwverify_rehash_stale++;
+		return;
+	}
+
+	(void) replace_password(mu, req->result, true);
+
+	pwverify_rehash_done++;
+}
+
+static void
+pwverify_complete_one(struct pwverify_request *const restrict req)
+{
+	if (req->rehash)
+	{
+		(void) pwverify_rehash_finish(req);
+		return;
+	}
+
+	if (req->job)
+	{
+		// No worker got to it
+		if (! req->decided)
+			(void) req->run(req->priv);
+
+		(void) req->done(req->priv);
+		return;
+	}
+
+	struct myentity *const mt = myentity_find_uid(req->eid);
+	struct myuser *const mu = user(mt);
+	bool verified = false;
+
+	if (! mu)
+		verified = false;
+	else if (req->custom)
+		verified = req->verified;
+	else if (! req->decided || strcmp(mu->pass, req->parameters) != 0 || (auth_module_loaded && auth_user_custom))
+		// Not something a worker could check, or the account changed underneath it
+		verified = verify_password(mu, req->password);
+	else if ((verified = req->verified))
+		(void) password_rehash(mu, req->password, req->ci_id, req->verify_flags);
+
+#ifdef HAVE_GETTIMEOFDAY
+	struct timeval elapsed;
+
+	(void) e_time(req->submitted, &elapsed);
+
+	const unsigned int ms = (unsigned int) tv2ms(&elapsed);
+
+	if (ms > pwverify_latency_max)
+		pwverify_latency_max = ms;
+
+	pwverify_latency_total += ms;
+#endif
+
+	pwverify_completed++;
+
+	(void) req->cb(mu, verified, req->priv);
+}
+
+/* Runs all of the requests that have finished, on the main thread. Callbacks
+ * may submit or cancel other requests; cancellation only marks a finished
+ * request, so walking our private copy of the list stays safe.
+ */
+static void
+pwverify_complete_all(void)
+{
+#ifdef HAVE_USABLE_PTHREAD
+	(void) pthread_mutex_lock(&pwverify_lock);
+#endif
+
+	struct pwverify_request *req = pwverify_done.head;
+
+	pwverify_done.head = NULL;
+	pwverify_done.tail = NULL;
+
+#ifdef HAVE_USABLE_PTHREAD
+	(void) pthread_mutex_unlock(&pwverify_lock);
+#endif
+
+	(void) log_flush_deferred();
+
+	while (req != NULL)
+	{
+		struct pwverify_request *const next = req->next;
+
+		if (! req->cancelled)
+			(void) pwverify_complete_one(req);
+
+		(void) pwverify_request_free(req);
+
+		req = next;
+	}
+}
+
+static void
+pwverify_timer_cb(void ATHEME_VATTR_UNUSED *const restrict unused)
+{
+	// The event loop frees once-only timers after running them
+	pwverify_timer = NULL;
+
+	(void) pwverify_complete_all();
+}
+
+// Main thread only: make sure pwverify_complete_all() runs on the next loop iteration
+static void
+pwverify_schedule(void)
+{
+	if (! pwverify_timer)
+		pwverify_timer = timer_add_once("pwverify_complete", &pwverify_timer_cb, NULL, 0);
+}
+
+#ifdef HAVE_USABLE_PTHREAD
+
+static void
+pwverify_pipe_cb(mowgli_eventloop_t ATHEME_VATTR_UNUSED *const restrict eventloop,
+                 mowgli_eventloop_io_t ATHEME_VATTR_UNUSED *const restrict io,
+                 const mowgli_eventloop_io_dir_t ATHEME_VATTR_UNUSED dir,
+                 void ATHEME_VATTR_UNUSED *const restrict userdata)
+{
+	char buf[64];
+
+	while (read(pwverify_pipe[0], buf, sizeof buf) > 0)
+		continue;
+
+	(void) pwverify_complete_all();
+}
+
+/* Verifies a batch of requests together, so that providers which can hash
+ * several passwords at once (see crypt_impl::verify_multi) get to do so.
+ * Jobs from crypto_job_submit() that were taken along are run on their own.
+ */
+static void
+pwverify_run(struct pwverify_request *const *const restrict batch, const size_t count)
+{
+	struct pwverify_request *reqs[PWVERIFY_BATCH_MAX];
+	const char *passwords[PWVERIFY_BATCH_MAX];
+	const char *parameters[PWVERIFY_BATCH_MAX];
+	unsigned int flags[PWVERIFY_BATCH_MAX];
+	bool decided[PWVERIFY_BATCH_MAX];
+	const struct crypt_impl *results[PWVERIFY_BATCH_MAX];
+	size_t npasswords = 0;
+
+	for (size_t i = 0; i < count; i++)
+	{
+		if (batch[i]->job)
+		{
+			(void) batch[i]->run(batch[i]->priv);
+
+			batch[i]->decided = true;
+			continue;
+		}
+
+		reqs[npasswords] = batch[i];
+		passwords[npasswords] = batch[i]->password;
+		parameters[npasswords] = batch[i]->parameters;
+		npasswords++;
+	}
+
+	if (! npasswords)
+		return;
+
+	(void) crypt_verify_password_threadsafe_multi(passwords, parameters, flags, decided, results, npasswords);
+
+	for (size_t i = 0; i < npasswords; i++)
+	{
+		struct pwverify_request *const req = reqs[i];
+
+		req->verify_flags = flags[i];
+		req->decided = decided[i];
+
+		if (results[i])
+		{
+			req->verified = true;
+			(void) mowgli_strlcpy(req->ci_id, results[i]->id, sizeof req->ci_id);
+		}
+	}
+}
+
+static void *
+pwverify_worker(void ATHEME_VATTR_UNUSED *const restrict unused)
+{
+	(void) pthread_mutex_lock(&pwverify_lock);
+
+	for (;;)
+	{
+		while (! pwverify_stopping && (pwverify_paused || ! (pwverify_pending.head ||
+		       (pwverify_rehash_ready.head && ! pwverify_rehash_running))))
+			(void) pthread_cond_wait(&pwverify_work_cond, &pwverify_lock);
+
+		if (pwverify_stopping)
+			break;
+
+		// Logins always go first; re-encryptions only use an otherwise idle worker
+		if (! pwverify_pending.head)
+		{
+			struct pwverify_request *const req = pwverify_queue_pop(&pwverify_rehash_ready);
+
+			req->state = PWVERIFY_RUNNING;
+			pwverify_rehash_running = true;
+			pwverify_nrunning++;
+
+			(void) pthread_mutex_unlock(&pwverify_lock);
+			(void) pwverify_rehash_run(req);
+			(void) pthread_mutex_lock(&pwverify_lock);
+
+			const bool wake = (pwverify_done.head == NULL);
+
+			req->state = PWVERIFY_DONE;
+			(void) pwverify_queue_push(&pwverify_done, req);
+
+			pwverify_rehash_running = false;
+
+			if (! --pwverify_nrunning)
+				(void) pthread_cond_broadcast(&pwverify_idle_cond);
+
+			if (wake)
+			{
+				const ssize_t ret = write(pwverify_pipe[1], "", 1);
+
+				(void) ret;
+			}
+
+			continue;
+		}
+
+		/* Take our share of the queue, so that a burst of logins is spread over
+		 * all of the workers rather than batched up on the first one to wake.
+		 */
+		struct pwverify_request *batch[PWVERIFY_BATCH_MAX];
+		size_t want = ((pwverify_nqueued + pwverify_nthreads - 1U) / pwverify_nthreads);
+		size_t count = 0;
+
+		if (want > PWVERIFY_BATCH_MAX)
+			want = PWVERIFY_BATCH_MAX;
+
+		while (count < want && pwverify_pending.head)
+		{
+			struct pwverify_request *const req = pwverify_queue_pop(&pwverify_pending);
+
+			req->state = PWVERIFY_RUNNING;
+			pwverify_nqueued--;
+			batch[count++] = req;
+		}
+
+		pwverify_nrunning += (unsigned int) count;
+
+		(void) pthread_mutex_unlock(&pwverify_lock);
+		(void) pwverify_run(batch, count);
+		(void) pthread_mutex_lock(&pwverify_lock);
+
+		const bool wake = (pwverify_done.head == NULL);
+		bool jobs = false;
+
+		for (size_t i = 0; i < count; i++)
+		{
+			jobs |= batch[i]->job;
+			batch[i]->state = PWVERIFY_DONE;
+			(void) pwverify_queue_push(&pwverify_done, batch[i]);
+		}
+
+		// crypto_job_cancel() may be waiting for one of the jobs in particular
+		if (! (pwverify_nrunning -= (unsigned int) count) || jobs)
+			(void) pthread_cond_broadcast(&pwverify_idle_cond);
+
+		// One byte is enough to get the main thread to drain the whole list
+		if (wake)
+		{
+			const ssize_t ret = write(pwverify_pipe[1], "", 1);
+
+			(void) ret;
+		}
+	}
+
+	(void) pthread_mutex_unlock(&pwverify_lock);
+	return NULL;
+}
+
+static void
+pwverify_pool_stop(void)
+{
+	if (! pwverify_nthreads)
+		return;
+
+	(void) pthread_mutex_lock(&pwverify_lock);
+	pwverify_stopping = true;
+	(void) pthread_cond_broadcast(&pwverify_work_cond);
+	(void) pthread_mutex_unlock(&pwverify_lock);
+
+	for (unsigned int i = 0; i < pwverify_nthreads; i++)
+		(void) pthread_join(pwverify_threads[i], NULL);
+
+	// Whatever no worker got to is verified on the main thread instead
+	struct pwverify_request *req;
+
+	while ((req = pwverify_queue_pop(&pwverify_pending)) != NULL)
+	{
+		req->state = PWVERIFY_DONE;
+		(void) pwverify_queue_push(&pwverify_done, req);
+	}
+
+	// ... and re-encryptions that no worker got to likewise, undecided
+	while ((req = pwverify_queue_pop(&pwverify_rehash_ready)) != NULL)
+	{
+		req->state = PWVERIFY_DONE;
+		(void) pwverify_queue_push(&pwverify_done, req);
+	}
+
+	(void) slog(LG_DEBUG, "%s: stopped %u password verification threads", MOWGLI_FUNC_NAME, pwverify_nthreads);
+
+	(void) sfree(pwverify_threads);
+
+	pwverify_threads = NULL;
+	pwverify_nthreads = 0;
+	pwverify_nqueued = 0;
+	pwverify_stopping = false;
+
+	(void) pwverify_schedule();
+}
+
+static void
+pwverify_pool_start(const unsigned int count)
+{
+	if (pwverify_pipe[0] == -1)
+	{
+		if (pipe(pwverify_pipe) != 0)
+		{
+			(void) slog(LG_ERROR, "%s: pipe(2): %s", MOWGLI_FUNC_NAME, strerror(errno));
+			pwverify_pipe[0] = pwverify_pipe[1] = -1;
+			return;
+		}
+
+		for (size_t i = 0; i < 2; i++)
+		{
+			const int flags = fcntl(pwverify_pipe[i], F_GETFL, 0);
+
+			if (flags == -1 || fcntl(pwverify_pipe[i], F_SETFL, flags | O_NONBLOCK) == -1)
+				(void) slog(LG_ERROR, "%s: fcntl(2): %s", MOWGLI_FUNC_NAME, strerror(errno));
+		}
+
+		pwverify_pollable = mowgli_pollable_create(base_eventloop, pwverify_pipe[0], NULL);
+
+		(void) mowgli_pollable_setselect(base_eventloop, pwverify_pollable, MOWGLI_EVENTLOOP_IO_READ,
+		                                 &pwverify_pipe_cb);
+	}
+
+	/* Block every signal while creating the workers so that they inherit that
+	 * mask; signals then only ever get delivered to the main thread.
+	 */
+	sigset_t newset;
+	sigset_t oldset;
+
+	(void) sigfillset(&newset);
+	(void) pthread_sigmask(SIG_BLOCK, &newset, &oldset);
+
+	pwverify_threads = smalloc(count * sizeof *pwverify_threads);
+
+	for (unsigned int i = 0; i < count; i++)
+	{
+		const int ret = pthread_create(&pwverify_threads[pwverify_nthreads], NULL, &pwverify_worker, NULL);
+
+		if (ret != 0)
+		{
+			(void) slog(LG_ERROR, "%s: pthread_create(3): %s", MOWGLI_FUNC_NAME, strerror(ret));
+			break;
+		}
+
+		pwverify_nthreads++;
+	}
+
+	(void) pthread_sigmask(SIG_SETMASK, &oldset, NULL);
+
+	if (! pwverify_nthreads)
+	{
+		(void) sfree(pwverify_threads);
+		pwverify_threads = NULL;
+		return;
+	}
+
+	(void) slog(LG_DEBUG, "%s: started %u password verification threads", MOWGLI_FUNC_NAME, pwverify_nthreads);
+}
+
+// Brings the pool in line with general::auth_threads (which may have changed on rehash)
+static void
+pwverify_pool_configure(void)
+{
+	static unsigned int configured = 0;
+
+	unsigned int want = config_options.auth_threads;
+
+	if (want > PWVERIFY_THREADS_MAX)
+		want = PWVERIFY_THREADS_MAX;
+
+	if (want == configured)
+		return;
+
+	(void) pwverify_pool_stop();
+
+	if (want)
+		(void) pwverify_pool_start(want);
+
+	configured = want;
+}
+
+#endif /* HAVE_USABLE_PTHREAD */
+
+static void
+pwverify_threads_hold(void)
+{
+#ifdef HAVE_USABLE_PTHREAD
+	(void) pthread_mutex_lock(&pwverify_lock);
+
+	pwverify_paused++;
+
+	while (pwverify_nrunning)
+		(void) pthread_cond_wait(&pwverify_idle_cond, &pwverify_lock);
+
+	(void) pthread_mutex_unlock(&pwverify_lock);
+#endif
+}
+
+static void
+pwverify_threads_release(void)
+{
+#ifdef HAVE_USABLE_PTHREAD
+	(void) pthread_mutex_lock(&pwverify_lock);
+
+	if (pwverify_paused && ! --pwverify_paused)
+		(void) pthread_cond_broadcast(&pwverify_work_cond);
+
+	(void) pthread_mutex_unlock(&pwverify_lock);
+#endif
+}
+
+/* Crypto providers are only added to or removed from the list while no worker
+ * is verifying a password, so the workers never see a half-updated list or run
+ * code from a module that is being unloaded. Calls nest. Worker processes have
+ * their own copy of the list, and are replaced before they are used again.
+ */
+void
+pwverify_pool_pause(void)
+{
+	(void) pwverify_threads_hold();
+
+#ifndef MOWGLI_OS_WIN
+	pwverify_procs_stale = true;
+#endif
+}
+
+void
+pwverify_pool_resume(void)
+{
+	(void) pwverify_threads_release();
+}
+
+#ifndef MOWGLI_OS_WIN
+
+// Worker process only: moves exactly len bytes, blocking; false on EOF or error
+static bool
+pwverify_proc_io(const int fd, void *const restrict buf, const size_t len, const bool out)
+{
+	unsigned char *const ptr = buf;
+	size_t done = 0;
+
+	while (done < len)
+	{
+		const ssize_t ret = out ? write(fd, ptr + done, len - done) : read(fd, ptr + done, len - done);
+
+		if (ret == -1 && errno == EINTR)
+			continue;
+
+		if (ret <= 0)
+			return false;
+
+		done += (size_t) ret;
+	}
+
+	return true;
+}
+
+static void ATHEME_FATTR_NORETURN
+pwverify_proc_main(const int fd)
+{
+	struct pwverify_proc_request rq;
+	struct pwverify_proc_result rs;
+
+	// Signals are for the main process; it closes our socket when it wants us gone
+	(void) signal(SIGHUP, SIG_IGN);
+	(void) signal(SIGINT, SIG_IGN);
+	(void) signal(SIGUSR1, SIG_IGN);
+	(void) signal(SIGUSR2, SIG_IGN);
+	(void) signal(SIGTERM, SIG_DFL);
+
+	while (pwverify_proc_io(fd, &rq, sizeof rq, false))
+	{
+		rq.password[sizeof rq.password - 1] = 0x00;
+		rq.parameters[sizeof rq.parameters - 1] = 0x00;
+
+		(void) memset(&rs, 0x00, sizeof rs);
+
+		const struct crypt_impl *const ci = crypt_verify_password(rq.password, rq.parameters, &rs.verify_flags);
+
+		if (ci)
+		{
+			rs.verified = true;
+			(void) mowgli_strlcpy(rs.ci_id, ci->id, sizeof rs.ci_id);
+		}
+
+		(void) smemzero(&rq, sizeof rq);
+
+		if (! pwverify_proc_io(fd, &rs, sizeof rs, true))
+			break;
+	}
+
+	_exit(EXIT_SUCCESS);
+}
+
+// Main thread only: the requests it had are verified here instead
+static void
+pwverify_proc_lost(struct pwverify_proc *const restrict proc, const char *const restrict reason)
+{
+	if (proc->fd == -1)
+		return;
+
+	if (reason)
+		(void) slog(LG_ERROR, "%s: password verification process %ld %s; %u requests outstanding",
+		            MOWGLI_FUNC_NAME, (long) proc->pid, reason, proc->ninflight);
+
+	(void) mowgli_pollable_destroy(base_eventloop, proc->pollable);
+	(void) close(proc->fd);
+
+	proc->pollable = NULL;
+	proc->fd = -1;
+	proc->rlen = 0;
+
+#ifdef HAVE_USABLE_PTHREAD
+	(void) pthread_mutex_lock(&pwverify_lock);
+#endif
+
+	struct pwverify_request *req;
+
+	while ((req = pwverify_queue_pop(&proc->inflight)) != NULL)
+	{
+		req->decided = false;
+		req->state = PWVERIFY_DONE;
+		(void) pwverify_queue_push(&pwverify_done, req);
+	}
+
+#ifdef HAVE_USABLE_PTHREAD
+	(void) pthread_mutex_unlock(&pwverify_lock);
+#endif
+
+	pwverify_proc_nrunning -= proc->ninflight;
+	proc->ninflight = 0;
+	pwverify_nprocs_up--;
+
+	if (reason)
+		pwverify_procs_respawn = CURRTIME + PWVERIFY_PROC_RESPAWN;
+
+	(void) pwverify_schedule();
+}
+
+static void
+pwverify_proc_reaped(const pid_t pid, const int status, void *const restrict data)
+{
+	struct pwverify_proc *const proc = data;
+
+	// The slot may have been given to a new worker since this one was let go
+	if (proc->pid != pid)
+		return;
+
+	proc->pid = 0;
+
+	if (proc->fd == -1)
+		return;
+
+	char reason[BUFSIZE];
+
+	if (WIFSIGNALED(status))
+		(void) snprintf(reason, sizeof reason, "was killed by signal %d", WTERMSIG(status));
+	else
+		(void) snprintf(reason, sizeof reason, "exited with status %d", WEXITSTATUS(status));
+
+	(void) pwverify_proc_lost(proc, reason);
+}
+
+static bool
+pwverify_proc_write(struct pwverify_proc *const restrict proc, struct pwverify_request *const restrict req)
+{
+	struct pwverify_proc_request rq;
+
+	(void) memcpy(rq.password, req->password, sizeof rq.password);
+	(void) memcpy(rq.parameters, req->parameters, sizeof rq.parameters);
+
+	/* At most PWVERIFY_PROC_DEPTH requests are ever unanswered, far less than a
+	 * socket buffer, so a short write means the worker has gone
+	 */
+	const ssize_t ret = write(proc->fd, &rq, sizeof rq);
+
+	(void) smemzero(&rq, sizeof rq);
+
+	if (ret != (ssize_t) sizeof rq)
+	{
+		(void) pwverify_proc_lost(proc, (ret == -1) ? strerror(errno) : "took a partial request");
+		return false;
+	}
+
+	req->state = PWVERIFY_PROCESS;
+	(void) pwverify_queue_push(&proc->inflight, req);
+
+	proc->ninflight++;
+	pwverify_proc_nrunning++;
+
+	return true;
+}
+
+// Main thread only: hands waiting requests to whichever workers have room
+static void
+pwverify_proc_feed(void)
+{
+	while (pwverify_proc_waiting.head)
+	{
+		struct pwverify_proc *best = NULL;
+
+		for (unsigned int i = 0; i < pwverify_nprocs; i++)
+		{
+			struct pwverify_proc *const proc = &pwverify_procs[i];
+
+			if (proc->fd != -1 && proc->ninflight < PWVERIFY_PROC_DEPTH &&
+			    (! best || proc->ninflight < best->ninflight))
+				best = proc;
+		}
+
+		if (! best)
+			break;
+
+		struct pwverify_request *const req = pwverify_queue_pop(&pwverify_proc_waiting);
+
+		pwverify_proc_nwaiting--;
+
+		if (! pwverify_proc_write(best, req))
+		{
+			// Put it back; the next worker gets it, or the main thread once there are none
+			req->next = pwverify_proc_waiting.head;
+			pwverify_proc_waiting.head = req;
+
+			if (! pwverify_proc_waiting.tail)
+				pwverify_proc_waiting.tail = req;
+
+			pwverify_proc_nwaiting++;
+		}
+	}
+
+	if (pwverify_nprocs_up || ! pwverify_proc_waiting.head)
+		return;
+
+#ifdef HAVE_USABLE_PTHREAD
+	(void) pthread_mutex_lock(&pwverify_lock);
+#endif
+
+	struct pwverify_request *req;
+
+	while ((req = pwverify_queue_pop(&pwverify_proc_waiting)) != NULL)
+	{
+		req->state = PWVERIFY_DONE;
+		(void) pwverify_queue_push(&pwverify_done, req);
+	}
+
+#ifdef HAVE_USABLE_PTHREAD
+	(void) pthread_mutex_unlock(&pwverify_lock);
+#endif
+
+	pwverify_proc_nwaiting = 0;
+
+	(void) pwverify_schedule();
+}
+
+static void
+pwverify_proc_read_cb(mowgli_eventloop_t ATHEME_VATTR_UNUSED *const restrict eventloop,
+                      mowgli_eventloop_io_t ATHEME_VATTR_UNUSED *const restrict io,
+                      const mowgli_eventloop_io_dir_t ATHEME_VATTR_UNUSED dir,
+                      void *const restrict userdata)
+{
+	struct pwverify_proc *const proc = userdata;
+
+	while (proc->fd != -1)
+	{
+		const ssize_t ret = read(proc->fd, proc->rbuf + proc->rlen, sizeof proc->rbuf - proc->rlen);
+
+		if (ret == -1 && (errno == EAGAIN || errno == EINTR))
+			break;
+
+		if (ret <= 0)
+		{
+			(void) pwverify_proc_lost(proc, (ret == -1) ? strerror(errno) : "closed its socket");
+			break;
+		}
+
+		if ((proc->rlen += (size_t) ret) < sizeof proc->rbuf)
+			continue;
+
+		struct pwverify_proc_result rs;
+		struct pwverify_request *const req = pwverify_queue_pop(&proc->inflight);
+
+		(void) memcpy(&rs, proc->rbuf, sizeof rs);
+		proc->rlen = 0;
+
+		if (! req)
+		{
+			(void) pwverify_proc_lost(proc, "answered a request it was not given");
+			break;
+		}
+
+		proc->ninflight--;
+		pwverify_proc_nrunning--;
+
+		rs.ci_id[sizeof rs.ci_id - 1] = 0x00;
+
+		req->decided = true;
+		req->verified = rs.verified;
+		req->verify_flags = rs.verify_flags;
+		(void) mowgli_strlcpy(req->ci_id, rs.ci_id, sizeof req->ci_id);
+
+#ifdef HAVE_USABLE_PTHREAD
+		(void) pthread_mutex_lock(&pwverify_lock);
+#endif
+
+		req->state = PWVERIFY_DONE;
+		(void) pwverify_queue_push(&pwverify_done, req);
+
+#ifdef HAVE_USABLE_PTHREAD
+		(void) pthread_mutex_unlock(&pwverify_lock);
+#endif
+	}
+
+	(void) pwverify_proc_feed();
+	(void) pwverify_complete_all();
+}
+
+static bool
+pwverify_proc_spawn(struct pwverify_proc *const restrict proc)
+{
+	int sv[2];
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != 0)
+	{
+		(void) slog(LG_ERROR, "%s: socketpair(2): %s", MOWGLI_FUNC_NAME, strerror(errno));
+		return false;
+	}
+
+	// No thread may be inside a crypto provider (or holding its locks) as we fork
+	(void) pwverify_threads_hold();
+
+	const pid_t pid = fork();
+
+	if (pid == 0)
+	{
+		(void) close(sv[0]);
+		(void) connection_close_all_fds();
+
+		// Otherwise the other workers would not see EOF when we exit
+		for (unsigned int i = 0; i < PWVERIFY_THREADS_MAX; i++)
+			if (pwverify_procs[i].fd != -1)
+				(void) close(pwverify_procs[i].fd);
+
+		(void) pwverify_proc_main(sv[1]);
+	}
+
+	(void) pwverify_threads_release();
+	(void) close(sv[1]);
+
+	if (pid == -1)
+	{
+		(void) slog(LG_ERROR, "%s: fork(2): %s", MOWGLI_FUNC_NAME, strerror(errno));
+		(void) close(sv[0]);
+		return false;
+	}
+
+	const int flags = fcntl(sv[0], F_GETFL, 0);
+
+	if (flags == -1 || fcntl(sv[0], F_SETFL, flags | O_NONBLOCK) == -1 || fcntl(sv[0], F_SETFD, FD_CLOEXEC) == -1)
+		(void) slog(LG_ERROR, "%s: fcntl(2): %s", MOWGLI_FUNC_NAME, strerror(errno));
+
+	proc->pid = pid;
+	proc->fd = sv[0];
+	proc->rlen = 0;
+	proc->pollable = mowgli_pollable_create(base_eventloop, proc->fd, proc);
+
+	(void) mowgli_pollable_setselect(base_eventloop, proc->pollable, MOWGLI_EVENTLOOP_IO_READ,
+	                                 &pwverify_proc_read_cb);
+	(void) childproc_add(pid, "pwverify", &pwverify_proc_reaped, proc);
+
+	pwverify_nprocs_up++;
+
+	return true;
+}
+
+// Brings the workers in line with general::auth_processes and the crypto providers loaded
+static void
+pwverify_procs_configure(void)
+{
+	static bool initialised = false;
+	static unsigned int configured = 0;
+
+	if (! initialised)
+	{
+		for (unsigned int i = 0; i < PWVERIFY_THREADS_MAX; i++)
+			pwverify_procs[i].fd = -1;
+
+		initialised = true;
+	}
+
+	unsigned int want = config_options.auth_processes;
+
+	if (want > PWVERIFY_THREADS_MAX)
+		want = PWVERIFY_THREADS_MAX;
+
+	if (want != configured || (pwverify_procs_stale && pwverify_nprocs_up))
+	{
+		// Closing the socket is all it takes; they exit on EOF and are reaped later
+		for (unsigned int i = 0; i < pwverify_nprocs; i++)
+			(void) pwverify_proc_lost(&pwverify_procs[i], NULL);
+
+		if (pwverify_nprocs)
+			(void) slog(LG_DEBUG, "%s: stopped %u password verification processes", MOWGLI_FUNC_NAME,
+			            pwverify_nprocs);
+
+		pwverify_nprocs = configured = want;
+		pwverify_procs_respawn = 0;
+	}
+
+	pwverify_procs_stale = false;
+
+	if (pwverify_nprocs_up == pwverify_nprocs || CURRTIME < pwverify_procs_respawn)
+		return;
+
+	const unsigned int before = pwverify_nprocs_up;
+
+	for (unsigned int i = 0; i < pwverify_nprocs; i++)
+	{
+		if (pwverify_procs[i].fd != -1)
+			continue;
+
+		if (! pwverify_proc_spawn(&pwverify_procs[i]))
+		{
+			pwverify_procs_respawn = CURRTIME + PWVERIFY_PROC_RESPAWN;
+			break;
+		}
+	}
+
+	if (pwverify_nprocs_up != before)
+		(void) slog(LG_DEBUG, "%s: started %u password verification processes", MOWGLI_FUNC_NAME,
+		            pwverify_nprocs_up - before);
+}
+
+// Main thread only: false if there are no worker processes to give it to
+static bool
+pwverify_proc_submit(struct pwverify_request *const restrict req)
+{
+	if (! pwverify_nprocs_up)
+		return false;
+
+	req->state = PWVERIFY_PROCESS;
+	(void) pwverify_queue_push(&pwverify_proc_waiting, req);
+	pwverify_proc_nwaiting++;
+
+	(void) pwverify_proc_feed();
+
+	return true;
+}
+
+#endif /* !MOWGLI_OS_WIN */
+
+struct pwverify_request *
+verify_password_async(struct myuser *const restrict mu, const char *const restrict password,
+                      const verify_password_cb cb, void *const restrict priv)
+{
+	return_val_if_fail(mu != NULL, NULL);
+	return_val_if_fail(password != NULL, NULL);
+	return_val_if_fail(cb != NULL, NULL);
+
+	struct pwverify_request *const req = smalloc(sizeof *req);
+
+	req->cb = cb;
+	req->priv = priv;
+
+	(void) mowgli_strlcpy(req->eid, entity(mu)->id, sizeof req->eid);
+	(void) mowgli_strlcpy(req->password, password, sizeof req->password);
+	(void) mowgli_strlcpy(req->parameters, mu->pass, sizeof req->parameters);
+
+#ifdef HAVE_GETTIMEOFDAY
+	(void) s_time(&req->submitted);
+#endif
+
+	if (auth_module_loaded && auth_user_custom && auth_user_custom_async)
+	{
+		req->state = PWVERIFY_CUSTOM;
+
+		if (auth_user_custom_async(mu, password, req))
+			return req;
+	}
+
+	const bool offload = ((mu->flags & MU_CRYPTPASS) && ! (auth_module_loaded && auth_user_custom));
+
+#ifndef MOWGLI_OS_WIN
+	(void) pwverify_procs_configure();
+#endif
+
+#ifdef HAVE_USABLE_PTHREAD
+	(void) pwverify_pool_configure();
+
+	// With worker processes about, the threads only get what they can verify themselves
+	const struct crypt_impl *const ci = (offload ? crypt_get_hash_provider(mu->pass) : NULL);
+
+	if (pwverify_nthreads && offload && (! config_options.auth_processes || (ci && ci->threadsafe)))
+	{
+		(void) pthread_mutex_lock(&pwverify_lock);
+
+		req->state = PWVERIFY_QUEUED;
+		(void) pwverify_queue_push(&pwverify_pending, req);
+		pwverify_nqueued++;
+
+		(void) pthread_cond_signal(&pwverify_work_cond);
+		(void) pthread_mutex_unlock(&pwverify_lock);
+
+		return req;
+	}
+#endif
+
+#ifndef MOWGLI_OS_WIN
+	if (offload && config_options.auth_processes && pwverify_proc_submit(req))
+		return req;
+#endif
+
+#ifdef HAVE_USABLE_PTHREAD
+	(void) pthread_mutex_lock(&pwverify_lock);
+#endif
+
+	req->state = PWVERIFY_DONE;
+	(void) pwverify_queue_push(&pwverify_done, req);
+
+#ifdef HAVE_USABLE_PTHREAD
+	(void) pthread_mutex_unlock(&pwverify_lock);
+#endif
+
+	(void) pwverify_schedule();
+
+	return req;
+}
+
+void
+verify_password_async_cancel(struct pwverify_request *const restrict req)
+{
+	return_if_fail(req != NULL);
+
+#ifndef MOWGLI_OS_WIN
+	if (req->state == PWVERIFY_PROCESS && pwverify_queue_remove(&pwverify_proc_waiting, req))
+	{
+		pwverify_proc_nwaiting--;
+
+		(void) pwverify_request_free(req);
+		return;
+	}
+#endif
+
+#ifdef HAVE_USABLE_PTHREAD
+	(void) pthread_mutex_lock(&pwverify_lock);
+
+	if (req->state == PWVERIFY_QUEUED)
+	{
+		(void) pwverify_queue_remove(&pwverify_pending, req);
+		pwverify_nqueued--;
+
+		(void) pthread_mutex_unlock(&pwverify_lock);
+		(void) pwverify_request_free(req);
+		return;
+	}
+#endif
+
+	/* A worker or custom authentication module still owns it, or it is on the
+	 * done list; it is freed once it reaches the main thread
+	 */
+	req->cancelled = true;
+
+#ifdef HAVE_USABLE_PTHREAD
+	(void) pthread_mutex_unlock(&pwverify_lock);
+#endif
+}
+
+/*
+ * crypto_job_submit(crypto_job_run_fn run, crypto_job_done_fn done,
+ *                   void *priv)
+ *
+ * Has run(priv) called on a worker thread (or, without any, on the next
+ * pass through the event loop), and then done(priv) on the main thread.
+ * run must not touch services state, only what priv points to; it may use
+ * the digest interfaces and OpenSSL objects that nothing else is using at
+ * the same time. done is never called from within crypto_job_submit().
+ *
+ * The job may be cancelled with crypto_job_cancel() until done has been
+ * called, which a module with jobs outstanding must do before it unloads.
+ */
+struct pwverify_request *
+crypto_job_submit(const crypto_job_run_fn run, const crypto_job_done_fn done, void *const restrict priv)
+{
+	return_val_if_fail(run != NULL, NULL);
+	return_val_if_fail(done != NULL, NULL);
+
+	struct pwverify_request *const req = smalloc(sizeof *req);
+
+	req->job = true;
+	req->run = run;
+	req->done = done;
+	req->priv = priv;
+
+#ifdef HAVE_USABLE_PTHREAD
+	(void) pwverify_pool_configure();
+	(void) pthread_mutex_lock(&pwverify_lock);
+
+	if (pwverify_nthreads)
+	{
+		req->state = PWVERIFY_QUEUED;
+		(void) pwverify_queue_push(&pwverify_pending, req);
+		pwverify_nqueued++;
+
+		(void) pthread_cond_signal(&pwverify_work_cond);
+		(void) pthread_mutex_unlock(&pwverify_lock);
+
+		return req;
+	}
+#endif
+
+	req->state = PWVERIFY_DONE;
+	(void) pwverify_queue_push(&pwverify_done, req);
+
+#ifdef HAVE_USABLE_PTHREAD
+	(void) pthread_mutex_unlock(&pwverify_lock);
+#endif
+
+	(void) pwverify_schedule();
+
+	return req;
+}
+
+/* Once this returns, neither of the job's functions will be called (again);
+ * if a worker is in the middle of running it, that is waited for.
+ */
+void
+crypto_job_cancel(struct pwverify_request *const restrict req)
+{
+	return_if_fail(req != NULL);
+	return_if_fail(req->job);
+
+#ifdef HAVE_USABLE_PTHREAD
+	(void) pthread_mutex_lock(&pwverify_lock);
+
+	while (req->state == PWVERIFY_RUNNING)
+		(void) pthread_cond_wait(&pwverify_idle_cond, &pwverify_lock);
+
+	(void) pthread_mutex_unlock(&pwverify_lock);
+#endif
+
+	(void) verify_password_async_cancel(req);
+}
+
+void
+auth_user_custom_async_done(struct pwverify_request *const restrict req, const bool verified)
+{
+	return_if_fail(req != NULL);
+	return_if_fail(req->state == PWVERIFY_CUSTOM);
+
+	req->custom = true;
+	req->verified = verified;
+
+#ifdef HAVE_USABLE_PTHREAD
+	(void) pthread_mutex_lock(&pwverify_lock);
+#endif
+
+	req->state = PWVERIFY_DONE;
+	(void) pwverify_queue_push(&pwverify_done, req);
+
+#ifdef HAVE_USABLE_PTHREAD
+	(void) pthread_mutex_unlock(&pwverify_lock);
+#endif
+
+	// Callers expect the callback after the module's own event handler has returned
+	(void) pwverify_schedule();
+}
+
+// Hands waiting re-encryptions to the workers (or runs them) as the configured rate allows
+static void
+pwverify_rehash_release(void)
+{
+	const unsigned long long rate = config_options.password_upgrade_rate;
+
+	/* Credit is kept in 1/60ths of a re-encryption, and accrues at the rate
+	 * per minute; up to one second's worth (at least one) can be saved up.
+	 */
+	if (rate)
+	{
+		const unsigned long long cap = 60ULL * ((rate + 59ULL) / 60ULL);
+
+		if (CURRTIME > pwverify_rehash_credited)
+			pwverify_rehash_credit += ((unsigned long long) (CURRTIME - pwverify_rehash_credited)) * rate;
+
+		if (pwverify_rehash_credit > cap || ! pwverify_rehash_credited)
+			pwverify_rehash_credit = cap;
+
+		pwverify_rehash_credited = CURRTIME;
+	}
+
+	while (pwverify_rehash_waiting.head && (! rate || pwverify_rehash_credit >= 60ULL))
+	{
+		struct pwverify_request *const req = pwverify_queue_pop(&pwverify_rehash_waiting);
+		const struct crypt_impl *const ci = crypt_get_named_provider(req->ci_id);
+
+		pwverify_rehash_nwaiting--;
+
+		if (rate)
+			pwverify_rehash_credit -= 60ULL;
+
+#ifdef HAVE_USABLE_PTHREAD
+		(void) pwverify_pool_configure();
+
+		if (pwverify_nthreads && ci && ci->threadsafe)
+		{
+			(void) pthread_mutex_lock(&pwverify_lock);
+
+			req->state = PWVERIFY_QUEUED;
+			(void) pwverify_queue_push(&pwverify_rehash_ready, req);
+
+			(void) pthread_cond_signal(&pwverify_work_cond);
+			(void) pthread_mutex_unlock(&pwverify_lock);
+
+			continue;
+		}
+#else
+		(void) ci;
+#endif
+
+		// No worker can do it; at least it is not in the middle of someone's login any more
+		(void) pwverify_rehash_run(req);
+		(void) pwverify_rehash_finish(req);
+		(void) pwverify_request_free(req);
+	}
+}
+
+static void
+pwverify_rehash_timer_cb(void ATHEME_VATTR_UNUSED *const restrict unused)
+{
+	pwverify_rehash_timer = NULL;
+
+	(void) pwverify_rehash_release();
+
+	// Out of credit; more accrues every second
+	if (pwverify_rehash_waiting.head)
+		pwverify_rehash_timer = timer_add_once("pwverify_rehash", &pwverify_rehash_timer_cb, NULL, 1);
+}
+
+/*
+ * pwverify_rehash_submit(struct myuser *mu, const char *password,
+ *                        const struct crypt_impl *ci)
+ *
+ * Queues the re-encryption of mu's (just verified) password with the
+ * provider ci. It is started on a later pass through the event loop, never
+ * within the caller's login.
+ */
+void
+pwverify_rehash_submit(struct myuser *const restrict mu, const char *const restrict password,
+                       const struct crypt_impl *const restrict ci)
+{
+	return_if_fail(mu != NULL);
+	return_if_fail(password != NULL);
+	return_if_fail(ci != NULL);
+
+	for (const struct pwverify_request *iter = pwverify_rehash_waiting.head; iter != NULL; iter = iter->next)
+		if (strcmp(iter->eid, entity(mu)->id) == 0)
+			return;
+
+	if (pwverify_rehash_nwaiting >= PWVERIFY_REHASH_MAX)
+	{
+		// It will be tried again the next time they log in
+		pwverify_rehash_dropped++;
+		return;
+	}
+
+	struct pwverify_request *const req = smalloc(sizeof *req);
+
+	req->rehash = true;
+
+	(void) mowgli_strlcpy(req->eid, entity(mu)->id, sizeof req->eid);
+	(void) mowgli_strlcpy(req->ci_id, ci->id, sizeof req->ci_id);
+	(void) mowgli_strlcpy(req->password, password, sizeof req->password);
+	(void) mowgli_strlcpy(req->parameters, mu->pass, sizeof req->parameters);
+	(void) pwverify_queue_push(&pwverify_rehash_waiting, req);
+
+	pwverify_rehash_nwaiting++;
+	pwverify_rehash_ninflight++;
+
+	if (! pwverify_rehash_timer)
+		pwverify_rehash_timer = timer_add_once("pwverify_rehash", &pwverify_rehash_timer_cb, NULL, 0);
+}
+
+void
+pwverify_get_stats(struct pwverify_stats *const restrict stats)
+{
+	return_if_fail(stats != NULL);
+
+	(void) memset(stats, 0x00, sizeof *stats);
+
+#ifdef HAVE_USABLE_PTHREAD
+	(void) pthread_mutex_lock(&pwverify_lock);
+
+	stats->threads = pwverify_nthreads;
+	stats->queued = pwverify_nqueued;
+	stats->running = pwverify_nrunning;
+
+	(void) pthread_mutex_unlock(&pwverify_lock);
+#endif
+
+#ifndef MOWGLI_OS_WIN
+	stats->processes = pwverify_nprocs_up;
+	stats->queued += pwverify_proc_nwaiting;
+	stats->running += pwverify_proc_nrunning;
+#endif
+
+	stats->completed = pwverify_completed;
+	stats->latency_max = pwverify_latency_max;
+	stats->rehash_queued = pwverify_rehash_ninflight;
+	stats->rehash_done = pwverify_rehash_done;
+	stats->rehash_dropped = pwverify_rehash_dropped;
+	stats->rehash_stale = pwverify_rehash_stale;
+
+	if (pwverify_completed)
+		stats->latency_avg = (unsigned int) (pwverify_latency_total / pwverify_completed);
+}
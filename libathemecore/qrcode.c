@@ -31,11 +31,27 @@ qrcode_margin(char *buffer, size_t bufsize, size_t width)
 	memset(buffer + prologuelen, ' ', width);
 }
 
+/* The module matrix of one row, one bit per module, so that runs of the same
+ * colour can be emitted a word at a time instead of module by module.
+ */
+#define QRCODE_ROW_WORDBITS     64U
+#define QRCODE_ROW_WORDS(w)     (((w) + QRCODE_ROW_WORDBITS - 1) / QRCODE_ROW_WORDBITS)
+
+static void
+qrcode_pack_row(uint64_t *words, const unsigned char *row, size_t width)
+{
+	memset(words, 0, QRCODE_ROW_WORDS(width) * sizeof *words);
+
+	for (size_t x = 0; x < width; x++)
+		if (row[x] & 0x1)
+			words[x / QRCODE_ROW_WORDBITS] |= (UINT64_C(1) << (x % QRCODE_ROW_WORDBITS));
+}
+
 static void
-qrcode_scanline(char *buffer, size_t bufsize, unsigned char *row, size_t width)
+qrcode_scanline(char *buffer, size_t bufsize, const uint64_t *words, size_t width)
 {
 	size_t x;
-	char last;
+	bool last;
 	char *p = buffer;
 
 	memset(buffer, 0, bufsize);
@@ -50,17 +66,34 @@ qrcode_scanline(char *buffer, size_t bufsize, unsigned char *row, size_t width)
 	*p++ = ' ';
 	*p++ = ' ';
 
-	last = 0;
+	last = false;
 
-	for (x = 0; x < width; x++)
+	for (x = 0; x < width; x += QRCODE_ROW_WORDBITS)
 	{
-		if ((row[x] & 0x1) != (last & 0x1))
-			*p++ = invert;
-
-		*p++ = ' ';
-		*p++ = ' ';
-
-		last = row[x];
+		const size_t n = ((width - x) < QRCODE_ROW_WORDBITS) ? (width - x) : QRCODE_ROW_WORDBITS;
+		const uint64_t mask = (n == QRCODE_ROW_WORDBITS) ? ~UINT64_C(0) : ((UINT64_C(1) << n) - 1);
+		const uint64_t word = words[x / QRCODE_ROW_WORDBITS] & mask;
+
+		/* a whole word of the colour we are already drawing needs no toggles */
+		if (word == (last ? mask : 0))
+		{
+			memset(p, ' ', n * 2);
+			p += n * 2;
+			continue;
+		}
+
+		for (size_t i = 0; i < n; i++)
+		{
+			const bool bit = (word >> i) & 0x1;
+
+			if (bit != last)
+				*p++ = invert;
+
+			*p++ = ' ';
+			*p++ = ' ';
+
+			last = bit;
+		}
 	}
 
 	*p++ = reset;
@@ -76,43 +109,136 @@ qrcode_scanline(char *buffer, size_t bufsize, unsigned char *row, size_t width)
 	*p++ = ' ';
 }
 
-void
-command_success_qrcode(struct sourceinfo *si, const char *data)
+/* Recently rendered codes, most recently used first. The same payload (e.g. a
+ * user's public key) tends to be asked for repeatedly, and there is only one
+ * render style, so the payload alone identifies the output.
+ */
+#define QRCODE_CACHE_MAX        8U
+
+struct qrcode_render
+{
+	mowgli_node_t   node;
+	char *          data;
+	char **         lines;
+	size_t          nlines;
+};
+
+static mowgli_list_t qrcode_cache;
+
+static void
+qrcode_render_free(struct qrcode_render *const render)
+{
+	for (size_t i = 0; i < render->nlines; i++)
+		sfree(render->lines[i]);
+
+	sfree(render->lines);
+	sfree(render->data);
+	sfree(render);
+}
+
+static struct qrcode_render *
+qrcode_render(const char *const data)
 {
 	char *buf;
 	QRcode *code;
-	size_t bufsize, realwidth;
+	uint64_t *words;
+	size_t bufsize, realwidth, n = 0;
+	struct qrcode_render *render;
 
-	return_if_fail(si != NULL);
-	return_if_fail(data != NULL);
-
-	code = QRcode_encodeData(strlen(data), (const void *) data, 4, QR_ECLEVEL_L);
+	if (! (code = QRcode_encodeData(strlen(data), (const void *) data, 4, QR_ECLEVEL_L)))
+	{
+		(void) slog(LG_ERROR, "%s: QRcode_encodeData() failed: %s", MOWGLI_FUNC_NAME, strerror(errno));
+		return NULL;
+	}
 
 	realwidth = (code->width + 3 * 2) * 2;
 	bufsize = strlen(prologue) + (realwidth * 3) + strlen(prologue);
 	buf = smalloc(bufsize);
+	words = smalloc(QRCODE_ROW_WORDS((size_t) code->width) * sizeof *words);
+
+	render = smalloc(sizeof *render);
+	render->data = sstrdup(data);
+	render->nlines = (size_t) code->width + 6;
+	render->lines = smalloc(render->nlines * sizeof *render->lines);
 
 	/* header */
 	for (int y = 0; y < 3; y++)
 	{
 		qrcode_margin(buf, bufsize, realwidth);
-		command_success_nodata(si, "%s", buf);
+		render->lines[n++] = sstrdup(buf);
 	}
 
 	/* qrcode contents + side margins */
 	for (int y = 0; y < code->width; y++)
 	{
-		qrcode_scanline(buf, bufsize, code->data + (y * code->width), (size_t) code->width);
-		command_success_nodata(si, "%s", buf);
+		qrcode_pack_row(words, code->data + (y * code->width), (size_t) code->width);
+		qrcode_scanline(buf, bufsize, words, (size_t) code->width);
+		render->lines[n++] = sstrdup(buf);
 	}
 
 	/* footer */
 	for (int y = 0; y < 3; y++)
 	{
 		qrcode_margin(buf, bufsize, realwidth);
-		command_success_nodata(si, "%s", buf);
+		render->lines[n++] = sstrdup(buf);
 	}
 
+	sfree(words);
 	sfree(buf);
 	QRcode_free(code);
+
+	return render;
+}
+
+static const struct qrcode_render *
+qrcode_render_cached(const char *const data)
+{
+	mowgli_node_t *n;
+	struct qrcode_render *render;
+
+	MOWGLI_ITER_FOREACH(n, qrcode_cache.head)
+	{
+		render = n->data;
+
+		if (strcmp(render->data, data) != 0)
+			continue;
+
+		if (n != qrcode_cache.head)
+		{
+			mowgli_node_delete(n, &qrcode_cache);
+			(void) mowgli_node_add_head(render, n, &qrcode_cache);
+		}
+
+		return render;
+	}
+
+	if (! (render = qrcode_render(data)))
+		return NULL;
+
+	if (MOWGLI_LIST_LENGTH(&qrcode_cache) >= QRCODE_CACHE_MAX)
+	{
+		struct qrcode_render *const oldest = qrcode_cache.tail->data;
+
+		mowgli_node_delete(&oldest->node, &qrcode_cache);
+		qrcode_render_free(oldest);
+	}
+
+	(void) mowgli_node_add_head(render, &render->node, &qrcode_cache);
+
+	return render;
+}
+
+void
+command_success_qrcode(struct sourceinfo *si, const char *data)
+{
+	const struct qrcode_render *render;
+
+	return_if_fail(si != NULL);
+	return_if_fail(data != NULL);
+
+	if (! (render = qrcode_render_cached(data)))
+		return;
+
+	for (size_t i = 0; i < render->nlines; i++)
+		command_success_nodata(si, "%s", render->lines[i]);
 }
@@ -43,37 +43,9 @@ atheme_random_mbedtls_strerror(const int err)
 	return errbuf;
 }
 
-uint32_t
-atheme_random(void)
-{
-	uint32_t val;
-
-	(void) atheme_random_buf(&val, sizeof val);
-
-	return val;
-}
-
-uint32_t
-atheme_random_uniform(const uint32_t bound)
-{
-	if (bound < 2)
-		return 0;
-
-	const uint32_t min = -bound % bound;
-
-	for (;;)
-	{
-		uint32_t candidate;
-
-		(void) atheme_random_buf(&candidate, sizeof candidate);
-
-		if (candidate >= min)
-			return candidate % bound;
-	}
-}
-
-void
-atheme_random_buf(void *const restrict out, const size_t len)
+// Only called to seed the buffer in random_pool.c, so the getpid(2) here is rare
+static bool ATHEME_FATTR_WUR
+random_backend_buf(void *const restrict out, const size_t len)
 {
 	if (rs_stir_pid == -1)
 	{
@@ -90,7 +62,7 @@ atheme_random_buf(void *const restrict out, const size_t len)
 		{
 			(void) slog(LG_ERROR, "%s: mbedtls_hmac_drbg_reseed(3): error %s", MOWGLI_FUNC_NAME,
 			                      atheme_random_mbedtls_strerror(ret));
-			exit(EXIT_FAILURE);
+			return false;
 		}
 
 		rs_stir_pid = getpid();
@@ -102,12 +74,14 @@ atheme_random_buf(void *const restrict out, const size_t len)
 	{
 		(void) slog(LG_ERROR, "%s: mbedtls_hmac_drbg_random(3): error %s", MOWGLI_FUNC_NAME,
 		                      atheme_random_mbedtls_strerror(ret));
-		exit(EXIT_FAILURE);
+		return false;
 	}
+
+	return true;
 }
 
-bool ATHEME_FATTR_WUR
-libathemecore_random_early_init(void)
+static bool ATHEME_FATTR_WUR
+random_backend_init(void)
 {
 	(void) mbedtls_entropy_init(&seed_ctx);
 	(void) mbedtls_hmac_drbg_init(&drbg_ctx);
@@ -133,8 +107,8 @@ libathemecore_random_early_init(void)
 	return true;
 }
 
-const char *
-random_get_frontend_info(void)
+static const char *
+random_backend_info(void)
 {
 	char verbuf[BUFSIZE];
 	(void) memset(verbuf, 0x00, sizeof verbuf);
@@ -11,34 +11,29 @@
 #  error "Do not compile me directly; compile random_frontend.c instead"
 #endif /* !ATHEME_LAC_RANDOM_FRONTEND_C */
 
-uint32_t
-atheme_random(void)
-{
-	return arc4random();
-}
+// arc4random(3) is already a buffered ChaCha20 generator that knows about fork(2)
+#define RANDOM_BACKEND_BUFFERED 1
 
-uint32_t
-atheme_random_uniform(const uint32_t bound)
+static bool ATHEME_FATTR_WUR
+random_backend_init(void)
 {
-	return arc4random_uniform(bound);
-}
+	uint32_t val;
 
-void
-atheme_random_buf(void *const restrict out, const size_t len)
-{
-	(void) arc4random_buf(out, len);
+	(void) arc4random_buf(&val, sizeof val);
+
+	return true;
 }
 
-bool ATHEME_FATTR_WUR
-libathemecore_random_early_init(void)
+static bool ATHEME_FATTR_WUR
+random_backend_buf(void *const restrict out, const size_t len)
 {
-	(void) atheme_random();
+	(void) arc4random_buf(out, len);
 
 	return true;
 }
 
-const char *
-random_get_frontend_info(void)
+static const char *
+random_backend_info(void)
 {
 	return "OpenBSD arc4random(3)";
 }
@@ -49,37 +49,8 @@ atheme_openssl_get_strerror(void)
 	return res;
 }
 
-uint32_t
-atheme_random(void)
-{
-	uint32_t val;
-
-	(void) atheme_random_buf(&val, sizeof val);
-
-	return val;
-}
-
-uint32_t
-atheme_random_uniform(const uint32_t bound)
-{
-	if (bound < 2)
-		return 0;
-
-	const uint32_t min = -bound % bound;
-
-	for (;;)
-	{
-		uint32_t candidate;
-
-		(void) atheme_random_buf(&candidate, sizeof candidate);
-
-		if (candidate >= min)
-			return candidate % bound;
-	}
-}
-
-void
-atheme_random_buf(void *const restrict out, const size_t len)
+static bool ATHEME_FATTR_WUR
+random_backend_buf(void *const restrict out, const size_t len)
 {
 	if (! rng_init_done)
 		abort();
@@ -89,12 +60,14 @@ atheme_random_buf(void *const restrict out, const size_t len)
 	if (RAND_bytes(out, (const int) len) != 1)
 	{
 		(void) slog(LG_ERROR, "%s: RAND_bytes(3): %s", MOWGLI_FUNC_NAME, atheme_openssl_get_strerror());
-		abort();
+		return false;
 	}
+
+	return true;
 }
 
-bool ATHEME_FATTR_WUR
-libathemecore_random_early_init(void)
+static bool ATHEME_FATTR_WUR
+random_backend_init(void)
 {
 	(void) atheme_openssl_clear_errors();
 
@@ -115,8 +88,8 @@ libathemecore_random_early_init(void)
 	return true;
 }
 
-const char *
-random_get_frontend_info(void)
+static const char *
+random_backend_info(void)
 {
 	return OPENSSL_VERSION_TEXT;
 }
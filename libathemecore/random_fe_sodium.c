@@ -15,34 +15,24 @@
 #include <sodium/randombytes.h>
 #include <sodium/version.h>
 
-uint32_t
-atheme_random(void)
+static bool ATHEME_FATTR_WUR
+random_backend_init(void)
 {
-	return randombytes_random();
-}
+	(void) randombytes_random();
 
-uint32_t
-atheme_random_uniform(const uint32_t bound)
-{
-	return randombytes_uniform(bound);
+	return true;
 }
 
-void
-atheme_random_buf(void *const restrict out, const size_t len)
+static bool ATHEME_FATTR_WUR
+random_backend_buf(void *const restrict out, const size_t len)
 {
 	(void) randombytes_buf(out, len);
-}
-
-bool ATHEME_FATTR_WUR
-libathemecore_random_early_init(void)
-{
-	(void) atheme_random();
 
 	return true;
 }
 
-const char *
-random_get_frontend_info(void)
+static const char *
+random_backend_info(void)
 {
 	static char result[BUFSIZE];
 	(void) snprintf(result, sizeof result, "libsodium (compiled %s, library %s)",
@@ -5,6 +5,14 @@
  * Copyright (C) 2019 Aaron M. D. Jones <aaronmdjones@gmail.com>
  *
  * Frontend routines for the random interface.
+ *
+ * The backend selected by the build system (random_fe_*.c) provides
+ * random_backend_init(), random_backend_buf() and random_backend_info().
+ * Unless it says it is buffered already, what it gives us only keys the
+ * ChaCha20 generator in random_pool.c, which everything here reads from;
+ * so the small requests that make up nearly all of our use (salts, nonces,
+ * atheme_random_uniform()) do not each cost a system call or a trip through
+ * a cryptographic library.
  */
 
 #include <atheme.h>
@@ -32,6 +40,79 @@
 #  error "No RNG API frontend was selected by the build system"
 #endif
 
+#ifndef RANDOM_BACKEND_BUFFERED
+#  include "random_pool.c"
+#endif
+
+uint32_t
+atheme_random(void)
+{
+	uint32_t val;
+
+	(void) atheme_random_buf(&val, sizeof val);
+
+	return val;
+}
+
+uint32_t
+atheme_random_uniform(const uint32_t bound)
+{
+	if (bound < 2)
+		return 0;
+
+	const uint32_t min = -bound % bound;
+
+	for (;;)
+	{
+		uint32_t candidate;
+
+		(void) atheme_random_buf(&candidate, sizeof candidate);
+
+		if (candidate >= min)
+			return candidate % bound;
+	}
+}
+
+void
+atheme_random_buf(void *const restrict out, const size_t len)
+{
+#ifdef RANDOM_BACKEND_BUFFERED
+	if (! random_backend_buf(out, len))
+		abort();
+#else
+	(void) random_pool_read(out, len);
+#endif
+}
+
+bool ATHEME_FATTR_WUR
+libathemecore_random_early_init(void)
+{
+	if (! random_backend_init())
+		return false;
+
+#ifndef RANDOM_BACKEND_BUFFERED
+	if (! random_pool_init())
+		return false;
+#endif
+
+	return true;
+}
+
+const char *
+random_get_frontend_info(void)
+{
+#if defined(RANDOM_BACKEND_BUFFERED) || (ATHEME_API_RANDOM_FRONTEND == ATHEME_API_RANDOM_FRONTEND_INTERNAL)
+	// Nothing to add: the internal backend's description covers the buffer already
+	return random_backend_info();
+#else
+	static char result[BUFSIZE];
+
+	(void) snprintf(result, sizeof result, "%s, buffered through ChaCha20", random_backend_info());
+
+	return result;
+#endif
+}
+
 /* Note that this function generates a random printable string of length "len", and so it
  * actually requires a buffer of at least "len + 1" bytes, to write a terminating NULL
  * byte too. Thus, DO NOT use the size of the buffer as an argument to this function.    -- amdj
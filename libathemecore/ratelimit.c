@@ -0,0 +1,102 @@
+/*
+ * SPDX-License-Identifier: ISC
+ * SPDX-URL: https://spdx.org/licenses/ISC.html
+ *
+ * Copyright (C) 2026 Atheme Development Group (https://atheme.github.io/)
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * atheme-services: A collection of minimalist IRC services
+ * ratelimit.c: Rate limiting with the generic cell rate algorithm.
+ *
+ * Instead of a count and a timestamp to decay it from, a limiter keeps the
+ * time at which the next event would be due if events had arrived at exactly
+ * the permitted rate. Every event pushes that time forward by its share of
+ * the period; an event is over the limit if it would push it further than a
+ * whole period past now.
+ */
+
+#include <atheme.h>
+
+#define RATELIMIT_US_PER_SEC    1000000ULL
+
+static inline unsigned long long
+ratelimit_now(void)
+{
+	return (unsigned long long) CURRTIME * RATELIMIT_US_PER_SEC;
+}
+
+static unsigned long long
+ratelimit_advance(const struct ratelimit *const restrict rl, const unsigned long long now, const unsigned int cost,
+                  const unsigned int count, const unsigned int period)
+{
+	const unsigned long long interval = ((unsigned long long) period * RATELIMIT_US_PER_SEC) / count;
+	const unsigned long long tat = (rl->tat > now) ? rl->tat : now;
+
+	return tat + ((interval * cost) / RATELIMIT_UNIT);
+}
+
+/*
+ * ratelimit_take()
+ *
+ * inputs:
+ *       limiter, cost of the event (RATELIMIT_UNIT for one event), and the
+ *       limit (count events per period seconds)
+ *
+ * outputs:
+ *       true if the event is within the limit, false if not
+ *
+ * side effects:
+ *       the event is only counted if it is within the limit
+ */
+bool
+ratelimit_take(struct ratelimit *const restrict rl, const unsigned int cost, const unsigned int count,
+               const unsigned int period)
+{
+	return_val_if_fail(rl != NULL, false);
+
+	if (! count || ! period)
+		return true;
+
+	const unsigned long long now = ratelimit_now();
+	const unsigned long long tat = ratelimit_advance(rl, now, cost, count, period);
+
+	if (tat - now > (unsigned long long) period * RATELIMIT_US_PER_SEC)
+		return false;
+
+	rl->tat = tat;
+	return true;
+}
+
+/*
+ * ratelimit_charge()
+ *
+ * Counts an event whether or not it is within the limit, e.g. to make a
+ * costly request weigh more on the next ratelimit_take().
+ */
+void
+ratelimit_charge(struct ratelimit *const restrict rl, const unsigned int cost, const unsigned int count,
+                 const unsigned int period)
+{
+	return_if_fail(rl != NULL);
+
+	if (! count || ! period)
+		return;
+
+	rl->tat = ratelimit_advance(rl, ratelimit_now(), cost, count, period);
+}
+
+/*
+ * ratelimit_reset()
+ *
+ * Forgets every event counted so far.
+ */
+void
+ratelimit_reset(struct ratelimit *const restrict rl)
+{
+	return_if_fail(rl != NULL);
+
+	rl->tat = 0;
+}
@@ -20,8 +20,8 @@ int ATHEME_FATTR_PRINTF(1, 2)
 sts(const char *fmt, ...)
 {
 	va_list ap;
-	char buf[513];
-	int len;
+	const char *line;
+	size_t len;
 
 	if (!me.connected)
 		return 0;
@@ -31,23 +31,103 @@ sts(const char *fmt, ...)
 	return_val_if_fail(fmt != NULL, 0);
 
 	va_start(ap, fmt);
-	vsnprintf(buf, 511, fmt, ap); /* leave two bytes for \r\n */
+	line = sendq_add_vline(curr_uplink->conn, &len, fmt, ap);
 	va_end(ap);
 
-	len = strlen(buf);
-	buf[len++] = '\r';
-	buf[len++] = '\n';
-	buf[len] = '\0';
+	if (line == NULL)
+		return 0;
 
 	cnt.bout += len;
 
-	sendq_add(curr_uplink->conn, buf, len);
-
-	slog(LG_RAWDATA, "<- %.*s", len, buf);
+	slog_lazy(LG_RAWDATA, "<- %.*s", (int) len, line);
+	capture_line(CAPTURE_OUT, line, len);
 
 	return 0;
 }
 
+/* The same as sts(), for a line built a word at a time straight into the
+ * uplink's sendq instead of through a format string:
+ *
+ *   if (sts_begin(&l, ME)) { sts_word(&l, "PING"); ...; sts_end(&l); }
+ *
+ * Every appender after sts_begin() puts a space before what it adds.
+ */
+bool
+sts_begin(struct sendq_line *l, const char *source)
+{
+	if (!me.connected)
+		return false;
+
+	return_val_if_fail(curr_uplink != NULL, false);
+	return_val_if_fail(curr_uplink->conn != NULL, false);
+
+	if (!sendq_line_begin(curr_uplink->conn, l))
+		return false;
+
+	if (source != NULL)
+	{
+		sendq_line_char(l, ':');
+		sendq_line_str(l, source);
+	}
+
+	return true;
+}
+
+static inline void
+sts_space(struct sendq_line *l)
+{
+	if (l->len != 0)
+		sendq_line_char(l, ' ');
+}
+
+void
+sts_word(struct sendq_line *l, const char *word)
+{
+	sts_space(l);
+	sendq_line_str(l, word);
+}
+
+void
+sts_uint(struct sendq_line *l, unsigned long long value)
+{
+	sts_space(l);
+	sendq_line_uint(l, value);
+}
+
+void
+sts_time(struct sendq_line *l, time_t ts)
+{
+	sts_uint(l, (unsigned long long) ts);
+}
+
+void
+sts_client(struct sendq_line *l, const struct user *u)
+{
+	sts_word(l, CLIENT_NAME(u));
+}
+
+void
+sts_trailing(struct sendq_line *l, const char *text)
+{
+	sts_space(l);
+	sendq_line_char(l, ':');
+	sendq_line_str(l, text);
+}
+
+void
+sts_end(struct sendq_line *l)
+{
+	const char *line;
+	size_t len;
+
+	line = sendq_line_end(l, &len);
+
+	cnt.bout += len;
+
+	slog_lazy(LG_RAWDATA, "<- %.*s", (int) len, line);
+	capture_line(CAPTURE_OUT, line, len);
+}
+
 /*
  * io_loop()
  *
@@ -66,7 +146,12 @@ io_loop(void)
 	while (!(runflags & (RF_SHUTDOWN | RF_RESTART)))
 	{
 		CURRTIME = mowgli_eventloop_get_time(base_eventloop);
+		timer_loop_begin();
 		mowgli_eventloop_run_once(base_eventloop);
+		connection_lanes_run();
+		delivery_run();
+		named_heap_reclaim();
+		timer_loop_end();
 		check_signals();
 	}
 }
@@ -17,10 +17,18 @@
 #include "internal.h"
 
 static void server_delete_serv(struct server *s);
+static void server_delete_tree(struct server *s);
+static void server_split_mark(struct server *s, mowgli_list_t *users);
+
+/* TS6-style SIDs (a digit and two of 0-9A-Z) are looked up directly in
+ * sidtable; any other kind of SID goes in sidlist.
+ */
+#define SERVER_SIDTABLE_SIZE    (10U * 36U * 36U)
 
 static mowgli_patricia_t *sidlist = NULL;
-static mowgli_heap_t *serv_heap = NULL;
-static mowgli_heap_t *tld_heap = NULL;
+static struct server **sidtable = NULL;
+static struct named_heap *serv_heap = NULL;
+static struct named_heap *tld_heap = NULL;
 
 mowgli_patricia_t *servlist;
 mowgli_list_t tldlist;
@@ -43,8 +51,8 @@ mowgli_list_t tldlist;
 void
 init_servers(void)
 {
-	serv_heap = sharedheap_get(sizeof(struct server));
-	tld_heap = sharedheap_get(sizeof(struct tld));
+	serv_heap = named_heap_get("server", sizeof(struct server));
+	tld_heap = named_heap_get("tld", sizeof(struct tld));
 
 	if (serv_heap == NULL || tld_heap == NULL)
 	{
@@ -56,6 +64,320 @@ init_servers(void)
 	sidlist = mowgli_patricia_create(noopcanon);
 }
 
+static unsigned int
+server_sid36(const char c)
+{
+	if (c >= '0' && c <= '9')
+		return (unsigned int) (c - '0');
+
+	if (c >= 'A' && c <= 'Z')
+		return (unsigned int) (c - 'A') + 10U;
+
+	return 36U;
+}
+
+/* P10 numerics are base64 in an alphabet of their own: two characters for a
+ * server and three for each of its clients. The values here are off by one,
+ * so that 0 is any character that isn't a digit.
+ */
+static const unsigned char p10_digits[256] = {
+	['A'] =  1, ['B'] =  2, ['C'] =  3, ['D'] =  4, ['E'] =  5, ['F'] =  6, ['G'] =  7, ['H'] =  8,
+	['I'] =  9, ['J'] = 10, ['K'] = 11, ['L'] = 12, ['M'] = 13, ['N'] = 14, ['O'] = 15, ['P'] = 16,
+	['Q'] = 17, ['R'] = 18, ['S'] = 19, ['T'] = 20, ['U'] = 21, ['V'] = 22, ['W'] = 23, ['X'] = 24,
+	['Y'] = 25, ['Z'] = 26, ['a'] = 27, ['b'] = 28, ['c'] = 29, ['d'] = 30, ['e'] = 31, ['f'] = 32,
+	['g'] = 33, ['h'] = 34, ['i'] = 35, ['j'] = 36, ['k'] = 37, ['l'] = 38, ['m'] = 39, ['n'] = 40,
+	['o'] = 41, ['p'] = 42, ['q'] = 43, ['r'] = 44, ['s'] = 45, ['t'] = 46, ['u'] = 47, ['v'] = 48,
+	['w'] = 49, ['x'] = 50, ['y'] = 51, ['z'] = 52, ['0'] = 53, ['1'] = 54, ['2'] = 55, ['3'] = 56,
+	['4'] = 57, ['5'] = 58, ['6'] = 59, ['7'] = 60, ['8'] = 61, ['9'] = 62, ['['] = 63, [']'] = 64,
+};
+
+// The value of a P10 numeric len characters long, or UINT_MAX if it isn't one
+static unsigned int
+p10_numeric_decode(const char *const restrict numeric, const size_t len)
+{
+	unsigned int value = 0;
+
+	for (size_t i = 0; i < len; i++)
+	{
+		const unsigned int digit = p10_digits[(unsigned char) numeric[i]];
+
+		if (! digit)
+			return UINT_MAX;
+
+		value = (value << 6) | (digit - 1U);
+	}
+
+	return value;
+}
+
+/* Where a SID lives in sidtable, or SERVER_SIDTABLE_SIZE if it is neither
+ * TS6-style nor (on P10 networks) a two-character P10 numeric.
+ */
+static unsigned int
+server_sid_slot(const char *const restrict sid)
+{
+	if (ircd != NULL && ircd->uses_p10)
+	{
+		const unsigned int slot = p10_numeric_decode(sid, 2);
+
+		if (slot == UINT_MAX || sid[2] != '\0')
+			return SERVER_SIDTABLE_SIZE;
+
+		return slot;
+	}
+
+	if (sid[0] < '0' || sid[0] > '9' || sid[1] == '\0' || sid[2] == '\0' || sid[3] != '\0')
+		return SERVER_SIDTABLE_SIZE;
+
+	const unsigned int b = server_sid36(sid[1]);
+	const unsigned int c = server_sid36(sid[2]);
+
+	if (b == 36U || c == 36U)
+		return SERVER_SIDTABLE_SIZE;
+
+	return ((unsigned int) (sid[0] - '0') * 36U * 36U) + (b * 36U) + c;
+}
+
+static void
+server_sid_add(struct server *const restrict s)
+{
+	const unsigned int slot = server_sid_slot(s->sid);
+
+	if (slot == SERVER_SIDTABLE_SIZE)
+	{
+		(void) mowgli_patricia_add(sidlist, s->sid, s);
+		return;
+	}
+
+	if (! sidtable)
+		sidtable = scalloc(SERVER_SIDTABLE_SIZE, sizeof *sidtable);
+
+	// Like the patricia, the first server with a SID keeps it
+	if (! sidtable[slot])
+		sidtable[slot] = s;
+}
+
+static void
+server_sid_delete(const struct server *const restrict s)
+{
+	const unsigned int slot = server_sid_slot(s->sid);
+
+	if (slot == SERVER_SIDTABLE_SIZE)
+	{
+		if (mowgli_patricia_retrieve(sidlist, s->sid) == s)
+			(void) mowgli_patricia_delete(sidlist, s->sid);
+
+		return;
+	}
+
+	if (sidtable && sidtable[slot] == s)
+		sidtable[slot] = NULL;
+}
+
+/* On P10 networks each server also has its clients in an array, indexed by
+ * the last three characters of their numeric, so that a numeric is looked
+ * up with sidtable and that array and nothing else.
+ */
+void
+server_p10_client_add(struct user *const restrict u)
+{
+	struct server *const s = u->server;
+
+	if (! ircd->uses_p10 || u->uid == NULL || s->sid == NULL || strlen(s->sid) != 2 ||
+	    strncmp(u->uid, s->sid, 2) != 0)
+		return;
+
+	const unsigned int idx = p10_numeric_decode(u->uid + 2, 3);
+
+	if (idx == UINT_MAX || u->uid[5] != '\0')
+		return;
+
+	if (idx >= s->p10_clients_size)
+	{
+		unsigned int size = s->p10_clients_size ? s->p10_clients_size : 64U;
+
+		while (size <= idx)
+			size *= 2U;
+
+		s->p10_clients = sreallocarray(s->p10_clients, size, sizeof *s->p10_clients);
+		(void) memset(&s->p10_clients[s->p10_clients_size], 0x00,
+		              (size - s->p10_clients_size) * sizeof *s->p10_clients);
+		s->p10_clients_size = size;
+	}
+
+	// Like the namehash, the first user with a numeric keeps it
+	if (! s->p10_clients[idx])
+		s->p10_clients[idx] = u;
+}
+
+void
+server_p10_client_delete(const struct user *const restrict u)
+{
+	struct server *const s = u->server;
+
+	if (! ircd->uses_p10 || u->uid == NULL || s->p10_clients == NULL || strncmp(u->uid, s->sid, 2) != 0)
+		return;
+
+	const unsigned int idx = p10_numeric_decode(u->uid + 2, 3);
+
+	if (idx < s->p10_clients_size && s->p10_clients[idx] == u)
+		s->p10_clients[idx] = NULL;
+}
+
+struct user *
+server_p10_client_find(const char *const restrict uid)
+{
+	const unsigned int slot = p10_numeric_decode(uid, 2);
+
+	if (slot == UINT_MAX || sidtable == NULL || sidtable[slot] == NULL)
+		return NULL;
+
+	const struct server *const s = sidtable[slot];
+	const unsigned int idx = p10_numeric_decode(uid + 2, 3);
+
+	if (idx >= s->p10_clients_size || uid[5] != '\0')
+		return NULL;
+
+	return s->p10_clients[idx];
+}
+
+/* A server that was linked before the uplink connection was lost, and is
+ * introduced again by the new burst, is taken over as it is rather than
+ * deleted and added again, as long as it has the same name and SID. Its
+ * users and channel memberships are then reconciled one by one; see
+ * uplink_close().
+ */
+static struct server *
+server_reconcile(struct server *s, const char *name, unsigned int hops, struct server *uplink, const char *id,
+		const char *desc)
+{
+	mowgli_node_t *n;
+
+	if ((id != NULL) != (s->sid != NULL) || (id != NULL && strcmp(id, s->sid)) ||
+			(name != NULL) == ((s->flags & SF_MASKED) != 0) || (name != NULL && irccasecmp(name, s->name)))
+	{
+		slog(LG_DEBUG, "server_add(): %s is not the server it was before the reconnect", s->name);
+		server_delete_tree(s);
+		return NULL;
+	}
+
+	slog(LG_DEBUG, "server_add(): %s was linked before the reconnect, keeping it", s->name);
+
+	s->flags &= ~(SF_STALE | SF_EOB | SF_EOB2);
+	s->hops = hops;
+
+	s->flags &= ~SF_HIDE;
+
+	if (!strncmp(desc, "(H)", 3))
+	{
+		s->flags |= SF_HIDE;
+		desc += 3;
+		if (*desc == ' ')
+			desc++;
+	}
+
+	if (strcmp(s->desc, desc))
+	{
+		sfree(s->desc);
+		s->desc = sstrdup(desc);
+	}
+
+	if (s->uplink != uplink)
+	{
+		if (s->uplink != NULL && (n = mowgli_node_find(s, &s->uplink->children)) != NULL)
+		{
+			mowgli_node_delete(n, &s->uplink->children);
+			mowgli_node_free(n);
+		}
+
+		s->uplink = uplink;
+
+		if (uplink)
+			mowgli_node_add(s, mowgli_node_create(), &uplink->children);
+	}
+
+	return s;
+}
+
+static void
+server_mark_stale_tree(struct server *s)
+{
+	mowgli_node_t *n;
+
+	MOWGLI_ITER_FOREACH(n, s->children.head)
+	{
+		struct server *const child = n->data;
+
+		child->flags |= SF_STALE;
+		server_mark_stale_tree(child);
+	}
+}
+
+/*
+ * server_mark_stale()
+ *
+ * Marks every server but ourselves as left over from a lost uplink
+ * connection.
+ *
+ * Inputs:
+ *     - nothing
+ *
+ * Outputs:
+ *     - nothing
+ *
+ * Side Effects:
+ *     - servers introduced again by the next burst are kept, the others
+ *       are deleted by server_purge_stale()
+ */
+void
+server_mark_stale(void)
+{
+	server_mark_stale_tree(me.me);
+}
+
+static unsigned int
+server_purge_stale_tree(struct server *s)
+{
+	mowgli_node_t *n, *tn;
+	unsigned int count = 0;
+
+	MOWGLI_ITER_FOREACH_SAFE(n, tn, s->children.head)
+	{
+		struct server *const child = n->data;
+
+		if (child->flags & SF_STALE)
+		{
+			server_delete_tree(child);
+			count++;
+		}
+		else
+			count += server_purge_stale_tree(child);
+	}
+
+	return count;
+}
+
+/*
+ * server_purge_stale()
+ *
+ * Deletes the servers marked by server_mark_stale() that the new burst
+ * did not introduce again, with everything behind them.
+ *
+ * Inputs:
+ *     - nothing
+ *
+ * Outputs:
+ *     - the number of servers split off
+ *
+ * Side Effects:
+ *     - as server_delete()
+ */
+unsigned int
+server_purge_stale(void)
+{
+	return server_purge_stale_tree(me.me);
+}
+
 /*
  * server_add(const char *name, unsigned int hops, const char *uplink,
  *            const char *id, const char *desc)
@@ -86,6 +408,14 @@ server_add(const char *name, unsigned int hops, struct server *uplink, const cha
 	/* Masked servers must be behind something else */
 	return_val_if_fail(name != NULL || uplink != NULL, NULL);
 
+	if (id != NULL && (s = server_find(id)) != NULL && (s->flags & SF_STALE) &&
+			(s = server_reconcile(s, name, hops, uplink, id, desc)) != NULL)
+		return s;
+
+	if (name != NULL && (s = mowgli_patricia_retrieve(servlist, name)) != NULL && (s->flags & SF_STALE) &&
+			(s = server_reconcile(s, name, hops, uplink, id, desc)) != NULL)
+		return s;
+
 	if (uplink)
 	{
 		if (name == NULL)
@@ -98,12 +428,12 @@ server_add(const char *name, unsigned int hops, struct server *uplink, const cha
 	else
 		slog(LG_DEBUG, "server_add(): %s, root", name);
 
-	s = mowgli_heap_alloc(serv_heap);
+	s = named_heap_alloc(serv_heap);
 
 	if (id != NULL)
 	{
 		s->sid = sstrdup(id);
-		mowgli_patricia_add(sidlist, s->sid, s);
+		server_sid_add(s);
 	}
 
 	/* check to see if it's hidden */
@@ -172,7 +502,58 @@ server_delete(const char *name)
 
 		return;
 	}
+
+	if (s == me.me)
+	{
+		server_delete_serv(s);
+		return;
+	}
+
+	server_delete_tree(s);
+}
+
+static void
+server_delete_tree(struct server *s)
+{
+	mowgli_list_t users = { NULL, NULL, 0 };
+	mowgli_node_t *n, *tn;
+
+	/* Mark everyone behind the split first, so that modules can drop
+	 * them in bulk here and skip them as they are deleted one by one,
+	 * and so that channels they empty are only deleted at the end.
+	 */
+	server_split_mark(s, &users);
+
+	if (MOWGLI_LIST_LENGTH(&users))
+		hook_call_user_netsplit((&(struct hook_user_netsplit){ .s = s, .users = &users }));
+
 	server_delete_serv(s);
+
+	/* The users are gone by now, only free the list nodes */
+	MOWGLI_ITER_FOREACH_SAFE(n, tn, users.head)
+	{
+		mowgli_node_delete(n, &users);
+		mowgli_node_free(n);
+	}
+
+	channel_reap_split();
+}
+
+static void
+server_split_mark(struct server *s, mowgli_list_t *users)
+{
+	mowgli_node_t *n;
+
+	MOWGLI_ITER_FOREACH(n, s->userlist.head)
+	{
+		struct user *u = n->data;
+
+		u->flags |= UF_NETSPLIT;
+		mowgli_node_add(u, mowgli_node_create(), users);
+	}
+
+	MOWGLI_ITER_FOREACH(n, s->children.head)
+		server_split_mark(n->data, users);
 }
 
 static void
@@ -227,7 +608,7 @@ server_delete_serv(struct server *s)
 		mowgli_patricia_delete(servlist, s->name);
 
 	if (s->sid)
-		mowgli_patricia_delete(sidlist, s->sid);
+		server_sid_delete(s);
 
 	if (s->uplink)
 	{
@@ -245,8 +626,9 @@ server_delete_serv(struct server *s)
 	sfree(s->name);
 	sfree(s->desc);
 	sfree(s->sid);
+	sfree(s->p10_clients);
 
-	mowgli_heap_free(serv_heap, s);
+	named_heap_free(serv_heap, s);
 
 	cnt.server--;
 }
@@ -270,8 +652,13 @@ struct server *
 server_find(const char *name)
 {
 	struct server *s;
+	const unsigned int slot = server_sid_slot(name);
+
+	if (slot != SERVER_SIDTABLE_SIZE)
+		s = sidtable ? sidtable[slot] : NULL;
+	else
+		s = mowgli_patricia_retrieve(sidlist, name);
 
-	s = mowgli_patricia_retrieve(sidlist, name);
 	if (s != NULL)
 		return s;
 
@@ -301,7 +688,7 @@ tld_add(const char *name)
 
         slog(LG_DEBUG, "tld_add(): %s", name);
 
-        tld = mowgli_heap_alloc(tld_heap);
+        tld = named_heap_alloc(tld_heap);
 
         mowgli_node_add(tld, n, &tldlist);
 
@@ -346,7 +733,7 @@ tld_delete(const char *name)
         mowgli_node_free(n);
 
         sfree(tld->name);
-        mowgli_heap_free(tld_heap, tld);
+        named_heap_free(tld_heap, tld);
 
         cnt.tld--;
 }
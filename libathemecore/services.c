@@ -16,7 +16,7 @@
 #include <atheme.h>
 #include "internal.h"
 
-static mowgli_heap_t *sourceinfo_heap = NULL;
+static struct named_heap *sourceinfo_heap = NULL;
 
 int authservice_loaded = 0;
 int use_myuser_access = 0;
@@ -49,7 +49,7 @@ ban(struct user *sender, struct channel *c, struct user *user)
 	chanban_add(c, mask, 'b');
 
 	modestack_mode_param(sender->nick, c, MTYPE_ADD, 'b', mask);
-	modestack_flush_now();
+	modestack_flush_channel(c);
 
 	return 1;
 }
@@ -77,7 +77,7 @@ remove_banlike(struct user *source, struct channel *chan, int type, struct user
 		count++;
 	}
 
-	modestack_flush_now();
+	modestack_flush_channel(chan);
 
 	return count;
 }
@@ -89,21 +89,10 @@ remove_ban_exceptions(struct user *source, struct channel *chan, struct user *ta
 	return remove_banlike(source, chan, ircd->except_mchar, target);
 }
 
-// returns true if user was actually kicked, false otherwise (or on assertion failure)
-// If the user was kicked, their chanuser is deleted; if the user was *not* kicked,
-// their chanuser remains. This currently only happens due to kick immunity.
-bool
-try_kick_real(struct user *source, struct channel *chan, struct user *target, const char *reason)
+// refuses (and says so) to kick opers from oper-immune channels and immune users
+static bool
+kick_refused(struct user *source, struct channel *chan, struct user *target, struct chanuser *cu, const char *reason)
 {
-	return_val_if_fail(source != NULL, false);
-	return_val_if_fail(chan != NULL, false);
-	return_val_if_fail(target != NULL, false);
-	return_val_if_fail(reason != NULL, false);
-
-	struct chanuser *cu = chanuser_find(chan, target);
-
-	return_val_if_fail(cu != NULL, false);
-
 	if ((chan->modes & ircd->oimmune_mode || cu->modes & CSTATUS_IMMUNE) && is_ircop(target))
 	{
 		wallops("Not kicking oper %s!%s@%s from protected %s (%s: %s)",
@@ -112,7 +101,7 @@ try_kick_real(struct user *source, struct channel *chan, struct user *target, co
 		notice(source->nick, chan->name,
 				"Not kicking oper %s (%s)",
 				target->nick, reason);
-		return false;
+		return true;
 	}
 	if (target->flags & config_options.immune_level)
 	{
@@ -122,14 +111,93 @@ try_kick_real(struct user *source, struct channel *chan, struct user *target, co
 		notice(source->nick, chan->name,
 				"Not kicking immune user %s (%s)",
 				target->nick, reason);
-		return false;
+		return true;
 	}
+	return false;
+}
+
+// returns true if user was actually kicked, false otherwise (or on assertion failure)
+// If the user was kicked, their chanuser is deleted; if the user was *not* kicked,
+// their chanuser remains. This currently only happens due to kick immunity.
+bool
+try_kick_real(struct user *source, struct channel *chan, struct user *target, const char *reason)
+{
+	return_val_if_fail(source != NULL, false);
+	return_val_if_fail(chan != NULL, false);
+	return_val_if_fail(target != NULL, false);
+	return_val_if_fail(reason != NULL, false);
+
+	struct chanuser *cu = chanuser_find(chan, target);
+
+	return_val_if_fail(cu != NULL, false);
+
+	if (kick_refused(source, chan, target, cu, reason))
+		return false;
 	kick(source, chan, target, reason);
 	return true;
 }
 
 bool (*try_kick)(struct user *source, struct channel *chan, struct user *target, const char *reason) = try_kick_real;
 
+/* Kicks many users from one channel with the same reason, KICK_BATCH_MAX at
+ * a time through kick_batch_sts(), which protocol modules may turn into
+ * fewer lines. Users that try_kick() would not kick are left alone, and so
+ * are services' own clients: with only users in a batch, the channel cannot
+ * go away before its last one is removed.
+ *
+ * Returns how many were kicked. The channel may be gone afterwards (as
+ * after any kick of its last members); look it up again.
+ */
+#define KICK_BATCH_MAX 64
+
+unsigned int
+kick_users_real(struct user *source, struct channel *chan, struct user **targets, size_t count, const char *reason)
+{
+	struct user *batch[KICK_BATCH_MAX];
+	char name[CHANNELLEN + 1];
+	unsigned int kicked = 0;
+	size_t n = 0;
+
+	return_val_if_fail(source != NULL, 0);
+	return_val_if_fail(chan != NULL, 0);
+	return_val_if_fail(targets != NULL || count == 0, 0);
+	return_val_if_fail(reason != NULL, 0);
+
+	mowgli_strlcpy(name, chan->name, sizeof name);
+
+	for (size_t i = 0; i < count; i++)
+	{
+		struct chanuser *cu = chanuser_find(chan, targets[i]);
+
+		if (cu == NULL || is_internal_client(targets[i]) || kick_refused(source, chan, targets[i], cu, reason))
+			continue;
+
+		batch[n++] = targets[i];
+
+		if (n < KICK_BATCH_MAX && i + 1 < count)
+			continue;
+
+		kick_batch_sts(source, chan, batch, n, reason);
+		kicked += n;
+		n = 0;
+
+		// emptied (and destroyed) by that batch; nobody is left to kick
+		if ((chan = channel_find(name)) == NULL)
+			return kicked;
+	}
+
+	if (n != 0)
+	{
+		kick_batch_sts(source, chan, batch, n, reason);
+		kicked += n;
+	}
+
+	return kicked;
+}
+
+unsigned int (*kick_users)(struct user *source, struct channel *chan, struct user **targets, size_t count,
+                           const char *reason) = kick_users_real;
+
 /* sends a KILL message for a user and removes the user from the userlist
  * source should be a service user or NULL for a server kill
  */
@@ -177,21 +245,17 @@ introduce_enforcer(const char *nick)
 	introduce_nick(u);
 }
 
-/* join a channel, creating it if necessary */
-void
-join(const char *chan, const char *nick)
+/* find or create a channel for u to join; NULL if it is already on it */
+static struct channel *
+join_prepare(const char *chan, struct user *u, bool *isnew)
 {
 	struct channel *c;
-	struct user *u;
-	struct chanuser *cu;
-	bool isnew = false;
 	struct mychan *mc;
 	struct metadata *md;
 	time_t ts;
 
-	u = user_find_named(nick);
-	if (!u)
-		return;
+	*isnew = false;
+
 	c = channel_find(chan);
 	if (c == NULL)
 	{
@@ -214,14 +278,23 @@ join(const char *chan, const char *nick)
 		c->modes |= CMODE_NOEXT | CMODE_TOPIC;
 		if (mc != NULL)
 			check_modes(mc, false);
-		isnew = true;
+		*isnew = true;
 	}
 	else if (chanuser_find(c, u))
 	{
 		slog(LG_DEBUG, "join(): i'm already in `%s'", c->name);
-		return;
+		return NULL;
 	}
-	join_sts(c, u, isnew, channel_modes(c, true));
+
+	return c;
+}
+
+/* record the join once it has been sent */
+static void
+join_finish(struct channel *c, struct user *u, bool isnew)
+{
+	struct chanuser *cu;
+
 	cu = chanuser_add(c, CLIENT_NAME(u));
 	cu->modes |= CSTATUS_OP;
 	if (isnew)
@@ -230,6 +303,181 @@ join(const char *chan, const char *nick)
 	}
 }
 
+/* join a channel, creating it if necessary */
+void
+join(const char *chan, const char *nick)
+{
+	struct channel *c;
+	struct user *u;
+	bool isnew;
+
+	u = user_find_named(nick);
+	if (!u)
+		return;
+	if ((c = join_prepare(chan, u, &isnew)) == NULL)
+		return;
+	join_sts(c, u, isnew, channel_modes(c, true));
+	join_finish(c, u, isnew);
+}
+
+/*
+ * Queued joins, for when a service has to join a great many channels at
+ * once (BotServ at startup, for example). They are sent a batch per
+ * service at a time through join_batch_sts(), which protocol modules may
+ * turn into fewer lines, as a background delivery job and so paced
+ * against the uplink's sendq.
+ */
+#define JOIN_BATCH_MAX 32
+
+struct join_queued
+{
+	mowgli_node_t           node;
+	char *                  chan;
+	join_queued_fn          joined;
+};
+
+struct join_queue_client
+{
+	mowgli_node_t           node;
+	char *                  nick;
+	mowgli_list_t           chans;
+};
+
+static mowgli_list_t join_queue_clients;
+static struct delivery_job *join_queue_job = NULL;
+static unsigned int join_queue_total = 0;
+
+static void
+join_queued_free(struct join_queue_client *jc, struct join_queued *jq)
+{
+	mowgli_node_delete(&jq->node, &jc->chans);
+	sfree(jq->chan);
+	sfree(jq);
+}
+
+static void
+join_queue_client_free(struct join_queue_client *jc)
+{
+	mowgli_node_t *n, *tn;
+
+	MOWGLI_ITER_FOREACH_SAFE(n, tn, jc->chans.head)
+		join_queued_free(jc, n->data);
+
+	mowgli_node_delete(&jc->node, &join_queue_clients);
+	sfree(jc->nick);
+	sfree(jc);
+}
+
+static bool
+join_queue_step(struct delivery_job *job)
+{
+	struct channel *chans[JOIN_BATCH_MAX];
+	bool isnew[JOIN_BATCH_MAX];
+	join_queued_fn joined[JOIN_BATCH_MAX];
+	struct join_queue_client *jc;
+	struct user *u;
+	size_t count = 0;
+	size_t i;
+
+	if (join_queue_clients.head == NULL)
+		return false;
+
+	jc = join_queue_clients.head->data;
+
+	// the client may have been removed or renamed since its joins were queued
+	if ((u = user_find_named(jc->nick)) == NULL || !is_internal_client(u))
+	{
+		join_queue_client_free(jc);
+		return true;
+	}
+
+	while (count < JOIN_BATCH_MAX && jc->chans.head != NULL)
+	{
+		struct join_queued *jq = jc->chans.head->data;
+		struct channel *c = join_prepare(jq->chan, u, &isnew[count]);
+
+		if (c != NULL)
+		{
+			chans[count] = c;
+			joined[count] = jq->joined;
+			count++;
+		}
+		else if (jq->joined != NULL && (c = channel_find(jq->chan)) != NULL)
+			jq->joined(c, u);
+
+		join_queued_free(jc, jq);
+	}
+
+	if (count != 0)
+		join_batch_sts(u, chans, isnew, count);
+
+	for (i = 0; i < count; i++)
+	{
+		join_finish(chans[i], u, isnew[i]);
+		if (joined[i] != NULL)
+			joined[i](chans[i], u);
+	}
+
+	if (jc->chans.head == NULL)
+		join_queue_client_free(jc);
+
+	return true;
+}
+
+static void
+join_queue_done(struct delivery_job *job, bool cancelled)
+{
+	mowgli_node_t *n, *tn;
+
+	MOWGLI_ITER_FOREACH_SAFE(n, tn, join_queue_clients.head)
+		join_queue_client_free(n->data);
+
+	slog(LG_INFO, "join_queue(): %s %u joins in %lds", cancelled ? "cancelled after" : "sent",
+			join_queue_total, (long) (CURRTIME - job->started));
+
+	join_queue_job = NULL;
+	join_queue_total = 0;
+}
+
+/* join a channel like join(), but later and batched with the other joins
+ * queued for the same client; joined is called once it is on the channel */
+void
+join_queue(const char *chan, const char *nick, join_queued_fn joined)
+{
+	struct join_queue_client *jc = NULL;
+	struct join_queued *jq;
+	mowgli_node_t *n;
+
+	return_if_fail(chan != NULL);
+	return_if_fail(nick != NULL);
+
+	MOWGLI_ITER_FOREACH(n, join_queue_clients.head)
+	{
+		if (!irccasecmp(((struct join_queue_client *) n->data)->nick, nick))
+		{
+			jc = n->data;
+			break;
+		}
+	}
+
+	if (jc == NULL)
+	{
+		jc = smalloc(sizeof *jc);
+		jc->nick = sstrdup(nick);
+		mowgli_node_add(jc, &jc->node, &join_queue_clients);
+	}
+
+	jq = smalloc(sizeof *jq);
+	jq->chan = sstrdup(chan);
+	jq->joined = joined;
+	mowgli_node_add(jq, &jq->node, &jc->chans);
+	join_queue_total++;
+
+	if (join_queue_job == NULL)
+		join_queue_job = delivery_job_start(me.name, "queued service joins", PRIV_ADMIN, 0,
+				&join_queue_step, &join_queue_done, NULL);
+}
+
 /* part a channel */
 void
 part(const char *chan, const char *nick)
@@ -382,6 +630,13 @@ handle_nickchange(struct user *const restrict u)
 	return_if_fail(u != NULL);
 	return_if_fail(!is_internal_client(u));
 
+	// Already checked before the uplink was lost
+	if (u->flags & UF_RECONCILED)
+	{
+		u->flags &= ~UF_RECONCILED;
+		return;
+	}
+
 	const struct service *const svs = service_find("global");
 	const char *const source = (svs != NULL) ? svs->me->nick : me.name;
 
@@ -438,7 +693,6 @@ handle_burstlogin(struct user *u, const char *login, time_t ts)
 {
 	struct mynick *mn;
 	struct myuser *mu;
-	mowgli_node_t *n;
 
 	if (login != NULL)
 		/* don't allow alias nicks here -- jilles */
@@ -495,8 +749,7 @@ handle_burstlogin(struct user *u, const char *login, time_t ts)
 	}
 	u->myuser = mu;
 	u->flags &= ~UF_SOPER_PASS;
-	n = mowgli_node_create();
-	mowgli_node_add(u, n, &mu->logins);
+	mowgli_node_add(u, &u->mlnode, &mu->logins);
 	slog(LG_DEBUG, "handle_burstlogin(): automatically identified %s as %s", u->nick, login);
 
 	/* XXX: ugh, this is a lame hack but I can't think of anything better... --nenolod */
@@ -513,7 +766,6 @@ handle_setlogin(struct sourceinfo *si, struct user *u, const char *login, time_t
 {
 	struct mynick *mn;
 	struct myuser *mu;
-	mowgli_node_t *n;
 
 	if (login != NULL)
 		/* don't allow alias nicks here -- jilles */
@@ -531,12 +783,8 @@ handle_setlogin(struct sourceinfo *si, struct user *u, const char *login, time_t
 
 	if (u->myuser != NULL)
 	{
-		n = mowgli_node_find(u, &u->myuser->logins);
-		if (n != NULL)
-		{
-			mowgli_node_delete(n, &u->myuser->logins);
-			mowgli_node_free(n);
-		}
+		mowgli_node_delete(&u->mlnode, &u->myuser->logins);
+		hook_call_user_logout(u);
 		u->myuser = NULL;
 	}
 	if (mu == NULL)
@@ -571,8 +819,7 @@ handle_setlogin(struct sourceinfo *si, struct user *u, const char *login, time_t
 	}
 	u->myuser = mu;
 	u->flags &= ~UF_SOPER_PASS;
-	n = mowgli_node_create();
-	mowgli_node_add(u, n, &mu->logins);
+	mowgli_node_add(u, &u->mlnode, &mu->logins);
 	slog(LG_DEBUG, "handle_setlogin(): %s set %s logged in as %s",
 			get_oper_name(si), u->nick, login);
 }
@@ -580,8 +827,6 @@ handle_setlogin(struct sourceinfo *si, struct user *u, const char *login, time_t
 void
 handle_clearlogin(struct sourceinfo *si, struct user *u)
 {
-	mowgli_node_t *n;
-
 	if (authservice_loaded)
 	{
 		wallops("Ignoring attempt from %s to clear login name for %s",
@@ -594,12 +839,8 @@ handle_clearlogin(struct sourceinfo *si, struct user *u)
 
 	slog(LG_DEBUG, "handle_clearlogin(): %s cleared login for %s (%s)",
 			get_oper_name(si), u->nick, entity(u->myuser)->name);
-	n = mowgli_node_find(u, &u->myuser->logins);
-	if (n != NULL)
-	{
-		mowgli_node_delete(n, &u->myuser->logins);
-		mowgli_node_free(n);
-	}
+	mowgli_node_delete(&u->mlnode, &u->myuser->logins);
+	hook_call_user_logout(u);
 	u->myuser = NULL;
 }
 
@@ -611,8 +852,8 @@ handle_certfp(struct sourceinfo *si, struct user *u, const char *certfp)
 	struct service *svs;
 	struct hook_user_login_check req;
 
-	sfree(u->certfp);
-	u->certfp = sstrdup(certfp);
+	sfree(u->cold->certfp);
+	u->cold->certfp = sstrdup(certfp);
 
 	if (u->myuser != NULL)
 		return;
@@ -671,7 +912,7 @@ myuser_login(struct service *svs, struct user *u, struct myuser *mu, bool sendac
 	myuser_notice(svs->me->nick, mu, "%s!%s@%s has just authenticated as you (%s)", u->nick, u->user, u->vhost, entity(mu)->name);
 
 	u->myuser = mu;
-	mowgli_node_add(u, mowgli_node_create(), &mu->logins);
+	mowgli_node_add(u, &u->mlnode, &mu->logins);
 	u->flags &= ~UF_SOPER_PASS;
 
 	/* check for previous login and let them know, unless they have opt'd OUT */
@@ -893,7 +1134,7 @@ bad_password(struct sourceinfo *si, struct myuser *mu)
 static void
 sourceinfo_delete(struct sourceinfo *si)
 {
-	mowgli_heap_free(sourceinfo_heap, si);
+	named_heap_free(sourceinfo_heap, si);
 }
 
 struct sourceinfo *
@@ -902,9 +1143,9 @@ sourceinfo_create(void)
 	struct sourceinfo *out;
 
 	if (sourceinfo_heap == NULL)
-		sourceinfo_heap = sharedheap_get(sizeof(struct sourceinfo));
+		sourceinfo_heap = named_heap_get("sourceinfo", sizeof(struct sourceinfo));
 
-	out = mowgli_heap_alloc(sourceinfo_heap);
+	out = named_heap_alloc(sourceinfo_heap);
 	atheme_object_init(atheme_object(out), "<sourceinfo>", (atheme_object_destructor_fn) sourceinfo_delete);
 
 	return out;
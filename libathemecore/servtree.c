@@ -16,11 +16,17 @@
 #include <atheme.h>
 #include "internal.h"
 
-static mowgli_heap_t *service_heap = NULL;
+static struct named_heap *service_heap = NULL;
 
 mowgli_patricia_t *services_name;
 mowgli_patricia_t *services_nick;
 
+/* The services that are on the network, by the UID and (IRC casefolded) nick
+ * their users have there; what a message to a service is addressed to.
+ */
+static struct namehash *services_target_uid = NULL;
+static struct namehash *services_target_nick = NULL;
+
 void servtree_update(void *dummy);
 
 static void
@@ -34,7 +40,7 @@ service_default_handler(struct sourceinfo *si, int parc, char *parv[])
 {
 	char *cmd;
         char *text;
-	char orig[BUFSIZE];
+	bool ctcp;
 
 	/* this should never happen */
 	if (parv[0][0] == '&')
@@ -43,8 +49,7 @@ service_default_handler(struct sourceinfo *si, int parc, char *parv[])
 		return;
 	}
 
-	/* make a copy of the original for debugging */
-	mowgli_strlcpy(orig, parv[parc - 1], BUFSIZE);
+	ctcp = parv[parc - 1][0] == '\001';
 
 	/* lets go through this to get the command */
 	cmd = strtok(parv[parc - 1], " ");
@@ -52,7 +57,7 @@ service_default_handler(struct sourceinfo *si, int parc, char *parv[])
 
 	if (!cmd)
 		return;
-	if (*orig == '\001')
+	if (ctcp)
 	{
 		handle_ctcp_common(si, cmd, text);
 		return;
@@ -65,9 +70,11 @@ service_default_handler(struct sourceinfo *si, int parc, char *parv[])
 void
 servtree_init(void)
 {
-	service_heap = sharedheap_get(sizeof(struct service));
+	service_heap = named_heap_get("service", sizeof(struct service));
 	services_name = mowgli_patricia_create(strcasecanon);
 	services_nick = mowgli_patricia_create(strcasecanon);
+	services_target_uid = namehash_create(false);
+	services_target_nick = namehash_create(true);
 
 	if (!service_heap)
 	{
@@ -291,7 +298,7 @@ service_add(const char *name, void (*handler)(struct sourceinfo *si, int parc, c
 	return_val_if_fail(name != NULL, NULL);
 	return_val_if_fail(service_find(name) == NULL, NULL);
 
-	if (! (sptr = mowgli_heap_alloc(service_heap)))
+	if (! (sptr = named_heap_alloc(service_heap)))
 		return NULL;
 
 	sptr->internal_name = sstrdup(name);
@@ -389,7 +396,7 @@ service_delete(struct service *sptr)
 	sfree(sptr->host);
 	sfree(sptr->real);
 
-	mowgli_heap_free(service_heap, sptr);
+	named_heap_free(service_heap, sptr);
 }
 
 struct service *
@@ -438,6 +445,56 @@ service_find_nick(const char *nick)
 	return mowgli_patricia_retrieve(services_nick, nick);
 }
 
+/* A service by the UID or nick its user is addressed by on the network,
+ * or NULL if it is not one (or not introduced at the moment).
+ */
+struct service *
+service_find_target(const char *target)
+{
+	struct service *sptr;
+
+	return_val_if_fail(target != NULL, NULL);
+
+	if (ircd->uses_uid && (sptr = namehash_find(services_target_uid, target)) != NULL)
+		return sptr;
+
+	return namehash_find(services_target_nick, target);
+}
+
+/* Called by users.c whenever the UID or nick of a service's user is about to
+ * change, or the user is going away; returns the service, so that it can be
+ * put back with service_target_add() once the change is made.
+ */
+struct service *
+service_target_remove(struct user *u)
+{
+	struct service *sptr;
+
+	return_val_if_fail(u != NULL, NULL);
+
+	if ((sptr = namehash_find(services_target_nick, u->nick)) == NULL || sptr->me != u)
+		return NULL;
+
+	(void) namehash_delete(services_target_nick, u->nick, sptr);
+
+	if (u->uid != NULL)
+		(void) namehash_delete(services_target_uid, u->uid, sptr);
+
+	return sptr;
+}
+
+void
+service_target_add(struct service *sptr)
+{
+	return_if_fail(sptr != NULL);
+	return_if_fail(sptr->me != NULL);
+
+	namehash_add(services_target_nick, sptr->me->nick, sptr);
+
+	if (sptr->me->uid != NULL)
+		namehash_add(services_target_uid, sptr->me->uid, sptr);
+}
+
 void
 servtree_update(void *dummy)
 {
@@ -465,7 +522,7 @@ servtree_update(void *dummy)
 			if (!strcmp(sptr->nick, sptr->me->nick) &&
 					!strcmp(sptr->user, sptr->me->user) &&
 					!strcmp(sptr->host, sptr->me->host) &&
-					!strcmp(sptr->real, sptr->me->gecos))
+					!strcmp(sptr->real, user_gecos(sptr->me)))
 				continue;
 			if (me.connected)
 				quit_sts(sptr->me, "Updating information");
@@ -477,12 +534,10 @@ servtree_update(void *dummy)
 			sptr->me->user = strshare_get(sptr->user);
 			strshare_unref(sptr->me->host);
 			sptr->me->host = strshare_get(sptr->host);
-			strshare_unref(sptr->me->chost);
-			sptr->me->chost = strshare_ref(sptr->me->host);
+			user_set_chost(sptr->me, sptr->me->host);
 			strshare_unref(sptr->me->vhost);
 			sptr->me->vhost = strshare_ref(sptr->me->host);
-			strshare_unref(sptr->me->gecos);
-			sptr->me->gecos = strshare_get(sptr->real);
+			user_set_gecos(sptr->me, sptr->real);
 			if (me.connected)
 				reintroduce_user(sptr->me);
 		}
@@ -495,6 +550,7 @@ servtree_update(void *dummy)
 			sptr->me->flags |= UF_IRCOP | UF_INVIS | UF_SERVICE;
 			if ((sptr == chansvs.me) && !chansvs.fantasy)
 				sptr->me->flags |= UF_DEAF;
+			service_target_add(sptr);
 
 			if (me.connected)
 			{
@@ -178,12 +178,68 @@ sharedheap_unref(mowgli_heap_t *const restrict heap)
 	(void) atheme_object_unref(s);
 }
 
+// Elements per block of the heap that sharedheap_get(size) hands out, and their size
+static void
+sharedheap_block_geometry(const size_t size, size_t *const restrict elems, size_t *const restrict elem_size)
+{
+	*elem_size = sharedheap_normalize_size(size);
+	*elems = sharedheap_prealloc_size(*elem_size);
+}
+
+/* Swaps the heap for one whose blocks hold elems objects each, if nothing but
+ * the caller uses it and nothing has been allocated from it (the caller
+ * knows that much); returns the new heap, or NULL if it was left alone.
+ */
+static mowgli_heap_t *
+sharedheap_resize_blocks(mowgli_heap_t *const restrict heap, const size_t ATHEME_VATTR_UNUSED size,
+                         const size_t elems)
+{
+	struct sharedheap *const s = sharedheap_find_by_heap(heap);
+
+	if (! s || atheme_object(s)->refcount != 1)
+		return NULL;
+
+	mowgli_heap_t *const resized = mowgli_heap_create(s->size, elems, BH_NOW);
+
+	if (! resized)
+		return NULL;
+
+	(void) mowgli_heap_destroy(s->heap);
+
+	s->heap = resized;
+
+	return resized;
+}
+
 #else /* ATHEME_ENABLE_HEAP_ALLOCATOR */
 
+#define SHAREDHEAP_PREALLOC_ELEMS       2U
+
+static void
+sharedheap_block_geometry(const size_t size, size_t *const restrict elems, size_t *const restrict elem_size)
+{
+	*elem_size = size;
+	*elems = SHAREDHEAP_PREALLOC_ELEMS;
+}
+
+// Every named heap has a heap of its own here
+static mowgli_heap_t *
+sharedheap_resize_blocks(mowgli_heap_t *const restrict heap, const size_t size, const size_t elems)
+{
+	mowgli_heap_t *const resized = mowgli_heap_create(size, elems, BH_NOW);
+
+	if (! resized)
+		return NULL;
+
+	(void) mowgli_heap_destroy(heap);
+
+	return resized;
+}
+
 mowgli_heap_t *
 sharedheap_get(const size_t size)
 {
-	mowgli_heap_t *const heap = mowgli_heap_create(size, 2, BH_NOW);
+	mowgli_heap_t *const heap = mowgli_heap_create(size, SHAREDHEAP_PREALLOC_ELEMS, BH_NOW);
 
 	if (! heap)
 		return NULL;
@@ -200,3 +256,338 @@ sharedheap_unref(mowgli_heap_t *const restrict heap)
 }
 
 #endif /* !ATHEME_ENABLE_HEAP_ALLOCATOR */
+
+static mowgli_list_t named_heap_list;
+
+/* Objects freed in bulk (a netsplit, a mass drop) are handed back to their
+ * heaps after the event loop pass that freed them, at most
+ * NAMED_HEAP_RECLAIM_BATCH per pass and one heap at a time, so that the
+ * pass itself only unlinks them.
+ */
+#define NAMED_HEAP_RECLAIM_BATCH        4096U
+
+struct named_heap_deferred_stats named_heap_deferred = { 0, 0, 0 };
+static mowgli_list_t named_heap_deferred_list;
+static mowgli_eventloop_timer_t *named_heap_reclaim_timer = NULL;
+
+// Hands back up to budget of the heap's deferred objects; returns how many it did
+static size_t
+named_heap_reclaim_heap(struct named_heap *const restrict nh, size_t budget)
+{
+	size_t done = 0;
+
+	while (done < budget && nh->deferred != NULL)
+	{
+		void *const ptr = nh->deferred;
+
+		nh->deferred = *(void **) ptr;
+
+		(void) mowgli_heap_free(nh->heap, ptr);
+		done++;
+	}
+
+	nh->deferred_count -= done;
+
+	if (nh->deferred == NULL)
+		(void) mowgli_node_delete(&nh->deferred_node, &named_heap_deferred_list);
+
+	named_heap_deferred.pending -= done;
+	named_heap_deferred.reclaimed += done;
+
+	return done;
+}
+
+/*
+ * named_heap_get()
+ *
+ * Returns the named heap for objects of the given size, creating it (on
+ * top of sharedheap_get()) if necessary, or NULL if the underlying heap
+ * could not be created. Every call must be balanced by named_heap_release().
+ */
+struct named_heap *
+named_heap_get(const char *const restrict name, const size_t size)
+{
+	mowgli_node_t *n;
+
+	return_val_if_fail(name != NULL, NULL);
+	return_val_if_fail(size != 0, NULL);
+
+	MOWGLI_ITER_FOREACH(n, named_heap_list.head)
+	{
+		struct named_heap *const nh = n->data;
+
+		if (nh->heap && nh->size == size && ! strcmp(nh->name, name))
+		{
+			nh->refcount++;
+			return nh;
+		}
+	}
+
+	mowgli_heap_t *const heap = sharedheap_get(size);
+
+	if (! heap)
+		return NULL;
+
+	struct named_heap *const nh = smalloc(sizeof *nh);
+
+	size_t elem_size;
+
+	nh->heap = heap;
+	nh->name = sstrdup(name);
+	nh->size = size;
+	nh->refcount = 1;
+
+	(void) sharedheap_block_geometry(size, &nh->block_elems, &elem_size);
+
+	(void) mowgli_node_add(nh, &nh->node, &named_heap_list);
+
+	return nh;
+}
+
+/*
+ * named_heap_get_external()
+ *
+ * Returns a named heap for accounting memory that the caller allocates
+ * itself, in units of the given size (e.g. large working buffers that
+ * would be wasted in a mowgli heap). There is no underlying heap to
+ * allocate from; the caller keeps live (and peak) up to date, from the
+ * main thread. Every call must be balanced by named_heap_release().
+ */
+struct named_heap *
+named_heap_get_external(const char *const restrict name, const size_t size)
+{
+	mowgli_node_t *n;
+
+	return_val_if_fail(name != NULL, NULL);
+	return_val_if_fail(size != 0, NULL);
+
+	MOWGLI_ITER_FOREACH(n, named_heap_list.head)
+	{
+		struct named_heap *const nh = n->data;
+
+		if (! nh->heap && nh->size == size && ! strcmp(nh->name, name))
+		{
+			nh->refcount++;
+			return nh;
+		}
+	}
+
+	struct named_heap *const nh = smalloc(sizeof *nh);
+
+	nh->name = sstrdup(name);
+	nh->size = size;
+	nh->refcount = 1;
+
+	(void) mowgli_node_add(nh, &nh->node, &named_heap_list);
+
+	return nh;
+}
+
+void
+named_heap_release(struct named_heap *const restrict nh)
+{
+	return_if_fail(nh != NULL);
+	return_if_fail(nh->refcount != 0);
+
+	if (--nh->refcount)
+		return;
+
+	if (nh->live)
+		(void) slog(LG_DEBUG, "%s: %s: %zu objects still allocated", MOWGLI_FUNC_NAME, nh->name, nh->live);
+
+	if (nh->deferred != NULL)
+		(void) named_heap_reclaim_heap(nh, nh->deferred_count);
+
+	(void) mowgli_node_delete(&nh->node, &named_heap_list);
+
+	if (nh->heap)
+		(void) sharedheap_unref(nh->heap);
+
+	(void) sfree(nh->name);
+	(void) sfree(nh);
+}
+
+/*
+ * named_heap_reserved()
+ *
+ * Returns how many bytes of heap blocks the live objects of this named
+ * heap take up at least: the heap carves whole blocks at a time, and
+ * rounds element sizes up. Fragmentation (partly used blocks) and blocks
+ * shared with other named heaps of the same size are not counted.
+ */
+size_t
+named_heap_reserved(const struct named_heap *const restrict nh)
+{
+	size_t elems, elem_size;
+
+	return_val_if_fail(nh != NULL, 0);
+
+	// Caller-allocated; nothing is carved out of blocks
+	if (! nh->heap)
+		return nh->live * nh->size;
+
+	(void) sharedheap_block_geometry(nh->size, &elems, &elem_size);
+
+	if (! (elems = nh->block_elems))
+		elems = 1;
+
+	return ((nh->live + elems - 1) / elems) * elems * elem_size;
+}
+
+/*
+ * named_heap_count()
+ *
+ * Returns how many objects the named heaps of this name (whatever their
+ * element size) have handed out.
+ */
+size_t
+named_heap_count(const char *const restrict name)
+{
+	mowgli_node_t *n;
+	size_t count = 0;
+
+	return_val_if_fail(name != NULL, 0);
+
+	MOWGLI_ITER_FOREACH(n, named_heap_list.head)
+	{
+		const struct named_heap *const nh = n->data;
+
+		if (! strcmp(nh->name, name))
+			count += nh->live;
+	}
+
+	return count;
+}
+
+/*
+ * named_heap_presize()
+ *
+ * Makes room for count objects in the named heap of this name before any
+ * are allocated (a database about to be loaded says how many there will
+ * be), by giving it a heap whose blocks hold that many and an eighth more,
+ * up to NAMED_HEAP_PRESIZE_MAX bytes per block, so that they are carved
+ * out of one or a few allocations instead of thousands of page-sized ones.
+ * Heaps that are already in use, or shared with other object types, are
+ * left as they are. Returns whether it was resized.
+ */
+#define NAMED_HEAP_PRESIZE_MAX          (16U * 1024U * 1024U)
+
+bool
+named_heap_presize(const char *const restrict name, const size_t count)
+{
+	mowgli_node_t *n;
+	size_t elems, elem_size;
+
+	return_val_if_fail(name != NULL, false);
+
+	MOWGLI_ITER_FOREACH(n, named_heap_list.head)
+	{
+		struct named_heap *const nh = n->data;
+
+		if (! nh->heap || nh->live || strcmp(nh->name, name) != 0)
+			continue;
+
+		(void) sharedheap_block_geometry(nh->size, &elems, &elem_size);
+
+		const size_t want = count + (count / 8U);
+		const size_t most = NAMED_HEAP_PRESIZE_MAX / elem_size;
+
+		if (want <= elems)
+			return false;
+
+		elems = (want < most) ? want : most;
+
+		mowgli_heap_t *const heap = sharedheap_resize_blocks(nh->heap, nh->size, elems);
+
+		if (! heap)
+			return false;
+
+		nh->heap = heap;
+		nh->block_elems = elems;
+
+#ifdef HEAP_DEBUG
+		(void) slog(LG_DEBUG, "%s: %s: %zu objects per block for %zu", MOWGLI_FUNC_NAME, name, elems, count);
+#endif
+
+		return true;
+	}
+
+	return false;
+}
+
+/*
+ * named_heap_foreach()
+ *
+ * Calls cb for every named heap.
+ */
+void
+named_heap_foreach(void (*const cb)(const struct named_heap *, void *), void *const privdata)
+{
+	mowgli_node_t *n;
+
+	return_if_fail(cb != NULL);
+
+	MOWGLI_ITER_FOREACH(n, named_heap_list.head)
+		cb(n->data, privdata);
+}
+
+/*
+ * named_heap_free_deferred()
+ *
+ * Like named_heap_free(), for an object that nothing refers to any more,
+ * but the memory is only handed back to the heap by named_heap_reclaim().
+ * The object's first word is overwritten at once.
+ */
+void
+named_heap_free_deferred(struct named_heap *const restrict nh, void *const restrict ptr)
+{
+	return_if_fail(nh != NULL);
+	return_if_fail(ptr != NULL);
+
+	if (! nh->heap || nh->size < sizeof(void *))
+	{
+		(void) named_heap_free(nh, ptr);
+		return;
+	}
+
+	nh->live--;
+
+	*(void **) ptr = nh->deferred;
+	nh->deferred = ptr;
+
+	if (nh->deferred_count++ == 0)
+		(void) mowgli_node_add(nh, &nh->deferred_node, &named_heap_deferred_list);
+
+	if (++named_heap_deferred.pending > named_heap_deferred.peak)
+		named_heap_deferred.peak = named_heap_deferred.pending;
+}
+
+// Only there so that the next pass does not wait for an event
+static void
+named_heap_reclaim_timer_cb(void ATHEME_VATTR_UNUSED *const restrict unused)
+{
+	named_heap_reclaim_timer = NULL;
+}
+
+/*
+ * named_heap_reclaim()
+ *
+ * Called by io_loop() after each pass of the event loop: hands back up to
+ * NAMED_HEAP_RECLAIM_BATCH deferred objects, all of one heap before those
+ * of the next.
+ */
+void
+named_heap_reclaim(void)
+{
+	size_t budget = NAMED_HEAP_RECLAIM_BATCH;
+	mowgli_node_t *n, *tn;
+
+	MOWGLI_ITER_FOREACH_SAFE(n, tn, named_heap_deferred_list.head)
+	{
+		if (! (budget -= named_heap_reclaim_heap(n->data, budget)))
+			break;
+	}
+
+	if (named_heap_deferred_list.head != NULL && named_heap_reclaim_timer == NULL)
+		named_heap_reclaim_timer = timer_add_once("named_heap_reclaim", &named_heap_reclaim_timer_cb, NULL, 0);
+}
@@ -131,6 +131,9 @@ check_signals(void)
 
 		wallops("Got SIGHUP; reloading \2%s\2.", config_file);
 
+		if (config_options.hook_profiling)
+			hook_stats_dump();
+
 		if (db_save && !readonly)
 		{
 			slog(LG_INFO, "UPDATE: \2%s\2", "system console");
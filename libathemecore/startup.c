@@ -0,0 +1,334 @@
+/*
+ * SPDX-License-Identifier: ISC
+ * SPDX-URL: https://spdx.org/licenses/ISC.html
+ *
+ * Copyright (C) 2026 Atheme Development Group (https://atheme.github.io/)
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * atheme-services: A collection of minimalist IRC services
+ * startup.c: Where the time went while starting up.
+ *
+ * atheme_main() wraps each phase of startup in a startup_mark() and a
+ * startup_record(), and module_load() does the same around each mod_init.
+ * A module's figures are its own: the time spent loading the modules it
+ * depends on is taken back out and booked to them. Recording stops once
+ * the first burst from the uplink is over, so that later MODLOADs do not
+ * muddle the picture.
+ *
+ * CPU time comes from getrusage(), and is only comparable within one
+ * process; nothing is timed across daemonize(), which forks.
+ */
+
+#include <atheme.h>
+#include "internal.h"
+
+#define STARTUP_REPORT_MODULES  5U
+
+enum startup_uplink_state
+{
+	STARTUP_UPLINK_NONE     = 0,
+	STARTUP_UPLINK_CONNECTING,
+	STARTUP_UPLINK_BURSTING,
+	STARTUP_UPLINK_SYNCED,
+};
+
+static struct startup_entry *startup_entries = NULL;
+static size_t startup_entries_count = 0;
+static size_t startup_entries_alloc = 0;
+
+static bool startup_recording = true;
+static bool startup_began_set = false;
+static struct timeval startup_began;
+static unsigned long long startup_total_us = 0;
+
+// Time spent in the mod_init of modules that have finished, for taking out of the ones that loaded them
+static unsigned long long startup_nested_wall_us = 0;
+static unsigned long long startup_nested_cpu_us = 0;
+
+static enum startup_uplink_state startup_uplink = STARTUP_UPLINK_NONE;
+static struct startup_mark startup_uplink_mark;
+
+static unsigned long long
+startup_tv_us(const struct timeval *const restrict tv)
+{
+	return ((unsigned long long) tv->tv_sec * 1000000ULL) + (unsigned long long) tv->tv_usec;
+}
+
+static unsigned long long
+startup_since_us(const struct timeval *const restrict then, const struct timeval *const restrict now)
+{
+	const unsigned long long a = startup_tv_us(then);
+	const unsigned long long b = startup_tv_us(now);
+
+	return (b > a) ? (b - a) : 0;
+}
+
+// The resident size now where the system tells us (Linux), otherwise the largest it has been
+static long
+startup_rss_kb(const struct rusage *const restrict ru)
+{
+	FILE *const f = fopen("/proc/self/statm", "r");
+
+	if (f)
+	{
+		unsigned long size, resident;
+		const bool ok = (fscanf(f, "%lu %lu", &size, &resident) == 2);
+
+		(void) fclose(f);
+
+		if (ok)
+			return (long) ((resident * (unsigned long) sysconf(_SC_PAGESIZE)) / 1024UL);
+	}
+
+	return ru->ru_maxrss;
+}
+
+void
+startup_mark(struct startup_mark *const restrict mark)
+{
+	struct rusage ru;
+
+	return_if_fail(mark != NULL);
+
+	(void) memset(mark, 0x00, sizeof *mark);
+
+	if (! startup_recording)
+		return;
+
+	(void) s_time(&mark->wall);
+	(void) memset(&ru, 0x00, sizeof ru);
+	(void) getrusage(RUSAGE_SELF, &ru);
+
+	mark->cpu_us = startup_tv_us(&ru.ru_utime) + startup_tv_us(&ru.ru_stime);
+	mark->rss_kb = startup_rss_kb(&ru);
+	mark->nested_wall_us = startup_nested_wall_us;
+	mark->nested_cpu_us = startup_nested_cpu_us;
+
+	if (! startup_began_set)
+	{
+		startup_began = mark->wall;
+		startup_began_set = true;
+	}
+}
+
+static struct startup_entry *
+startup_entry_get(const char *const restrict name, const enum startup_entry_kind kind)
+{
+	for (size_t i = 0; i < startup_entries_count; i++)
+		if (startup_entries[i].kind == kind && strcmp(startup_entries[i].name, name) == 0)
+			return &startup_entries[i];
+
+	if (startup_entries_count == startup_entries_alloc)
+	{
+		startup_entries_alloc = startup_entries_alloc ? (startup_entries_alloc * 2) : 64;
+		startup_entries = sreallocarray(startup_entries, startup_entries_alloc, sizeof *startup_entries);
+	}
+
+	struct startup_entry *const se = &startup_entries[startup_entries_count++];
+
+	(void) memset(se, 0x00, sizeof *se);
+
+	se->name = sstrdup(name);
+	se->kind = kind;
+
+	return se;
+}
+
+/*
+ * startup_record(const struct startup_mark *mark, const char *name,
+ *                enum startup_entry_kind kind)
+ *
+ * Books what happened since mark to the phase or module name; phases
+ * recorded more than once add up.
+ */
+void
+startup_record(const struct startup_mark *const restrict mark, const char *const restrict name,
+               const enum startup_entry_kind kind)
+{
+	struct startup_mark now;
+
+	return_if_fail(mark != NULL);
+	return_if_fail(name != NULL);
+
+	// Not recording, or not when the mark was taken
+	if (! startup_recording || ! mark->wall.tv_sec)
+		return;
+
+	(void) startup_mark(&now);
+
+	unsigned long long wall_us = startup_since_us(&mark->wall, &now.wall);
+	unsigned long long cpu_us = (now.cpu_us > mark->cpu_us) ? (now.cpu_us - mark->cpu_us) : 0;
+
+	if (kind == STARTUP_MODULE)
+	{
+		const unsigned long long child_wall_us = startup_nested_wall_us - mark->nested_wall_us;
+		const unsigned long long child_cpu_us = startup_nested_cpu_us - mark->nested_cpu_us;
+
+		// The module that loaded this one sees all of it as nested
+		startup_nested_wall_us = mark->nested_wall_us + wall_us;
+		startup_nested_cpu_us = mark->nested_cpu_us + cpu_us;
+
+		wall_us = (wall_us > child_wall_us) ? (wall_us - child_wall_us) : 0;
+		cpu_us = (cpu_us > child_cpu_us) ? (cpu_us - child_cpu_us) : 0;
+	}
+
+	struct startup_entry *const se = startup_entry_get(name, kind);
+
+	se->runs++;
+	se->wall_us += wall_us;
+	se->cpu_us += cpu_us;
+
+	if (kind == STARTUP_MODULE)
+	{
+		se->rss_kb += now.rss_kb - mark->rss_kb;
+		return;
+	}
+
+	se->rss_kb = now.rss_kb;
+	se->myusers = cnt.myuser;
+	se->mynicks = cnt.mynick;
+	se->mychans = cnt.mychan;
+	se->chanacs = cnt.chanacs;
+}
+
+/*
+ * startup_report(void)
+ *
+ * Logs the phases recorded so far and the slowest modules; called just
+ * before the uplink is first connected to.
+ */
+void
+startup_report(void)
+{
+	const struct startup_entry *slowest[STARTUP_REPORT_MODULES] = { NULL };
+	unsigned long long modules_us = 0;
+	size_t nmodules = 0;
+	struct timeval now;
+
+	if (! startup_began_set)
+		return;
+
+	for (size_t i = 0; i < startup_entries_count; i++)
+	{
+		const struct startup_entry *se = &startup_entries[i];
+
+		if (se->kind == STARTUP_PHASE)
+		{
+			(void) slog(LG_INFO, "startup: %-20s %7llu ms (%llu ms CPU), %ld KB resident, %u accounts, "
+			                     "%u channels%s", se->name, se->wall_us / 1000ULL, se->cpu_us / 1000ULL,
+			                     se->rss_kb, se->myusers, se->mychans, (se->runs > 1) ? " (in parts)" : "");
+			continue;
+		}
+
+		nmodules++;
+		modules_us += se->wall_us;
+
+		// Insertion into the few slowest
+		for (size_t j = 0; j < STARTUP_REPORT_MODULES && se; j++)
+		{
+			if (slowest[j] && slowest[j]->wall_us >= se->wall_us)
+				continue;
+
+			const struct startup_entry *const displaced = slowest[j];
+
+			slowest[j] = se;
+			se = displaced;
+		}
+	}
+
+	if (nmodules)
+	{
+		char buf[BUFSIZE] = "";
+
+		for (size_t j = 0; j < STARTUP_REPORT_MODULES && slowest[j]; j++)
+		{
+			char item[BUFSIZE];
+
+			(void) snprintf(item, sizeof item, "%s%s (%llu ms)", j ? ", " : "", slowest[j]->name,
+			                slowest[j]->wall_us / 1000ULL);
+			(void) mowgli_strlcat(buf, item, sizeof buf);
+		}
+
+		(void) slog(LG_INFO, "startup: %zu modules spent %llu ms in mod_init; slowest: %s", nmodules,
+		                     modules_us / 1000ULL, buf);
+	}
+
+	(void) s_time(&now);
+	(void) slog(LG_INFO, "startup: ready to connect %llu ms after starting (see OperServ STATS STARTUP)",
+	                     startup_since_us(&startup_began, &now) / 1000ULL);
+}
+
+void
+startup_uplink_connecting(void)
+{
+	if (startup_uplink != STARTUP_UPLINK_NONE)
+		return;
+
+	(void) startup_mark(&startup_uplink_mark);
+
+	startup_uplink = STARTUP_UPLINK_CONNECTING;
+}
+
+// Called on every connection to the uplink; only the first one counts
+void
+startup_uplink_connected(void)
+{
+	if (startup_uplink != STARTUP_UPLINK_CONNECTING)
+		return;
+
+	(void) startup_record(&startup_uplink_mark, "uplink connect", STARTUP_PHASE);
+	(void) startup_mark(&startup_uplink_mark);
+
+	startup_uplink = STARTUP_UPLINK_BURSTING;
+}
+
+// Called at the end of burst of a server that links to us directly
+void
+startup_uplink_synced(void)
+{
+	struct timeval now;
+
+	if (startup_uplink != STARTUP_UPLINK_BURSTING)
+		return;
+
+	(void) startup_record(&startup_uplink_mark, "uplink burst", STARTUP_PHASE);
+	(void) s_time(&now);
+
+	startup_total_us = startup_since_us(&startup_began, &now);
+	startup_uplink = STARTUP_UPLINK_SYNCED;
+	startup_recording = false;
+
+	(void) slog(LG_INFO, "startup: synchronised with the uplink %llu ms after starting", startup_total_us / 1000ULL);
+}
+
+/*
+ * startup_complete(unsigned long long *total_us)
+ *
+ * Outputs:
+ *      - true once the first burst from the uplink is over, with total_us
+ *        (if not NULL) set to how long it took to get there
+ */
+bool
+startup_complete(unsigned long long *const restrict total_us)
+{
+	if (startup_uplink != STARTUP_UPLINK_SYNCED)
+		return false;
+
+	if (total_us)
+		*total_us = startup_total_us;
+
+	return true;
+}
+
+// In the order each one was first recorded, which for modules is the order their mod_init finished
+void
+startup_entry_foreach(void (*const cb)(const struct startup_entry *, void *), void *const restrict privdata)
+{
+	return_if_fail(cb != NULL);
+
+	for (size_t i = 0; i < startup_entries_count; i++)
+		(void) cb(&startup_entries[i], privdata);
+}
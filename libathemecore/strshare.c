@@ -16,38 +16,190 @@
 #include <atheme.h>
 #include "internal.h"
 
-static mowgli_patricia_t *strshare_dict = NULL;
+/* Strings are interned in an open-addressed hash table, with the hash kept
+ * in each string's header so that lookups compare it (and the length)
+ * before the text, and growing the table never rehashes anything. Strings
+ * short enough for one of a few size classes are carved out of heaps
+ * rather than allocated one by one; the rest come from smalloc().
+ */
+#define STRSHARE_TABLE_MIN_SIZE         1024U
+#define STRSHARE_CLASS_STEP             16U
+#define STRSHARE_CLASSES                8U
+#define STRSHARE_CLASS_NONE             STRSHARE_CLASSES
+
+#define STRSHARE_FNV_OFFSET             0x811C9DC5U
+#define STRSHARE_FNV_PRIME              0x01000193U
 
 struct strshare
 {
-	int refcount;
+	unsigned int    refcount;
+	unsigned int    hash;
+	unsigned int    len;
+	unsigned int    sclass;         // index into strshare_heaps, or STRSHARE_CLASS_NONE
 };
 
+static struct strshare **strshare_table = NULL;
+static unsigned int strshare_table_size = 0;
+static unsigned int strshare_count = 0;
+
+// Size class i holds strings whose header and text fit in (i + 1) * STRSHARE_CLASS_STEP bytes
+static struct named_heap *strshare_heaps[STRSHARE_CLASSES];
+
+static size_t strshare_refs = 0;
+static size_t strshare_bytes = 0;
+static size_t strshare_saved = 0;
+
+static inline unsigned int
+strshare_hash(const char *const restrict str, size_t *const restrict len)
+{
+	unsigned int hash = STRSHARE_FNV_OFFSET;
+	const char *p;
+
+	for (p = str; *p != '\0'; p++)
+	{
+		hash ^= (unsigned char) *p;
+		hash *= STRSHARE_FNV_PRIME;
+	}
+
+	*len = (size_t) (p - str);
+
+	return hash;
+}
+
+static inline size_t
+strshare_alloc_size(const struct strshare *const restrict ss)
+{
+	if (ss->sclass == STRSHARE_CLASS_NONE)
+		return sizeof *ss + ss->len + 1;
+
+	return (ss->sclass + 1U) * STRSHARE_CLASS_STEP;
+}
+
+static void
+strshare_table_insert(struct strshare **const table, const unsigned int size, struct strshare *const ss)
+{
+	const unsigned int mask = size - 1U;
+	unsigned int i = ss->hash & mask;
+
+	while (table[i] != NULL)
+		i = (i + 1U) & mask;
+
+	table[i] = ss;
+}
+
+static void
+strshare_table_resize(const unsigned int size)
+{
+	struct strshare **const table = scalloc(size, sizeof *table);
+
+	for (unsigned int i = 0; i < strshare_table_size; i++)
+		if (strshare_table[i] != NULL)
+			strshare_table_insert(table, size, strshare_table[i]);
+
+	sfree(strshare_table);
+
+	strshare_table = table;
+	strshare_table_size = size;
+}
+
+static inline void
+strshare_table_grow(void)
+{
+	strshare_table_resize(strshare_table_size * 2U);
+}
+
+static void
+strshare_table_remove(const struct strshare *const ss)
+{
+	const unsigned int mask = strshare_table_size - 1U;
+	unsigned int i = ss->hash & mask;
+
+	while (strshare_table[i] != ss)
+	{
+		return_if_fail(strshare_table[i] != NULL);
+
+		i = (i + 1U) & mask;
+	}
+
+	// Shift later entries of the probe run back so that lookups never stop early
+	for (unsigned int j = (i + 1U) & mask; strshare_table[j] != NULL; j = (j + 1U) & mask)
+	{
+		const unsigned int home = strshare_table[j]->hash & mask;
+
+		if (((j - home) & mask) >= ((j - i) & mask))
+		{
+			strshare_table[i] = strshare_table[j];
+			i = j;
+		}
+	}
+
+	strshare_table[i] = NULL;
+}
+
 void
 strshare_init(void)
 {
-	strshare_dict = mowgli_patricia_create(noopcanon);
+	strshare_table = scalloc(STRSHARE_TABLE_MIN_SIZE, sizeof *strshare_table);
+	strshare_table_size = STRSHARE_TABLE_MIN_SIZE;
+
+	for (unsigned int i = 0; i < STRSHARE_CLASSES; i++)
+		strshare_heaps[i] = named_heap_get("strshare", (i + 1U) * STRSHARE_CLASS_STEP);
 }
 
 stringref
 strshare_get(const char *str)
 {
 	struct strshare *ss;
+	size_t len;
+	unsigned int hash, mask, i;
 
 	if (str == NULL)
 		return NULL;
 
-	ss = mowgli_patricia_retrieve(strshare_dict, str);
-	if (ss != NULL)
-		ss->refcount++;
+	hash = strshare_hash(str, &len);
+	mask = strshare_table_size - 1U;
+
+	for (i = hash & mask; (ss = strshare_table[i]) != NULL; i = (i + 1U) & mask)
+	{
+		if (ss->hash == hash && ss->len == len && memcmp(ss + 1, str, len) == 0)
+		{
+			ss->refcount++;
+			strshare_refs++;
+			strshare_saved += len + 1;
+
+			return (char *)(ss + 1);
+		}
+	}
+
+	const size_t need = (sizeof *ss) + len + 1;
+	const unsigned int sclass = (unsigned int) ((need - 1) / STRSHARE_CLASS_STEP);
+
+	if (sclass < STRSHARE_CLASSES && strshare_heaps[sclass] != NULL)
+	{
+		ss = named_heap_alloc(strshare_heaps[sclass]);
+		ss->sclass = sclass;
+	}
 	else
 	{
-		ss = smalloc((sizeof *ss) + strlen(str) + 1);
-		ss->refcount = 1;
-		strcpy((char *)(ss + 1), str);
-		mowgli_patricia_add(strshare_dict, (char *)(ss + 1), ss);
+		ss = smalloc(need);
+		ss->sclass = STRSHARE_CLASS_NONE;
 	}
 
+	ss->refcount = 1;
+	ss->hash = hash;
+	ss->len = (unsigned int) len;
+	memcpy(ss + 1, str, len + 1);
+
+	// Still at most half full afterwards
+	if ((strshare_count + 1U) * 2U > strshare_table_size)
+		strshare_table_grow();
+
+	strshare_table_insert(strshare_table, strshare_table_size, ss);
+
+	strshare_count++;
+	strshare_refs++;
+	strshare_bytes += strshare_alloc_size(ss);
+
 	return (char *)(ss + 1);
 }
 
@@ -63,6 +215,9 @@ strshare_ref(stringref str)
 	ss = (struct strshare *)(uintptr_t)str - 1;
 	ss->refcount++;
 
+	strshare_refs++;
+	strshare_saved += ss->len + 1;
+
 	return str;
 }
 
@@ -77,11 +232,70 @@ strshare_unref(stringref str)
 	/* intermediate cast to suppress gcc -Wcast-qual */
 	ss = (struct strshare *)(uintptr_t)str - 1;
 	ss->refcount--;
-	if (ss->refcount == 0)
+	strshare_refs--;
+
+	if (ss->refcount != 0)
 	{
-		mowgli_patricia_delete(strshare_dict, str);
-		sfree(ss);
+		strshare_saved -= ss->len + 1;
+		return;
 	}
+
+	strshare_table_remove(ss);
+
+	strshare_count--;
+	strshare_bytes -= strshare_alloc_size(ss);
+
+	if (ss->sclass == STRSHARE_CLASS_NONE)
+		sfree(ss);
+	else
+		named_heap_free(strshare_heaps[ss->sclass], ss);
+}
+
+/*
+ * strshare_reserve()
+ *
+ * Sizes the table for count strings in one go (a database about to be
+ * loaded says how many it holds), rather than doubling it over and over as
+ * they come in.
+ */
+void
+strshare_reserve(const size_t count)
+{
+	unsigned int size = strshare_table_size;
+
+	while (size < (1U << 31) && (size_t) size < count * 2U)
+		size *= 2U;
+
+	if (size != strshare_table_size)
+		strshare_table_resize(size);
+}
+
+void
+strshare_get_stats(struct strshare_stats *const restrict stats)
+{
+	return_if_fail(stats != NULL);
+
+	stats->unique = strshare_count;
+	stats->refs = strshare_refs;
+	stats->bytes = strshare_bytes;
+	stats->saved = strshare_saved;
+	stats->table_size = strshare_table_size;
+}
+
+/*
+ * strshare_foreach()
+ *
+ * Calls cb for every string held, in no particular order. The callback
+ * may not get or release strings.
+ */
+void
+strshare_foreach(void (*const cb)(stringref, unsigned int, void *), void *const privdata)
+{
+	return_if_fail(cb != NULL);
+
+	for (unsigned int i = 0; i < strshare_table_size; i++)
+		if (strshare_table[i] != NULL)
+			cb((const char *)(strshare_table[i] + 1), strshare_table[i]->refcount, privdata);
 }
 
 /* vim:cinoptions=>s,e0,n0,f0,{0,}0,^0,=s,ps,t0,c3,+s,(2s,us,)20,*30,gs,hs
@@ -18,6 +18,129 @@
 
 mowgli_list_t svs_ignore_list;
 
+/*
+ * svsignore_find() runs for every message sent to a service, so ignores
+ * are indexed by host:
+ *
+ *   - a mask of the form nick!user@host is split into its three parts,
+ *     which are matched separately; no user has a '!' or '@' in any of
+ *     them, so this is the same as matching the whole mask,
+ *   - if the host part is literal, the ignore goes in the bucket for that
+ *     host; if it ends in a literal suffix with a dot in it (the usual
+ *     "*.example.org"), in the bucket for the suffix from its first dot,
+ *   - everything else lives in svsignore_wildlist and is matched against
+ *     the whole nick!user@host the slow way.
+ *
+ * A user's host then only has to be looked up as a whole and from each of
+ * its dots on.
+ */
+static mowgli_patricia_t *svsignore_hosts = NULL;
+static mowgli_list_t svsignore_wildlist;
+
+static char *
+svsignore_host_key(const char *const host)
+{
+	const char *suffix = host;
+
+	if (*host == '\0')
+		return NULL;
+
+	// These are all special to match(), see libathemecore/match.c
+	for (const char *p = host; *p != '\0'; p++)
+		if (strchr("*?&#%\\", *p))
+			suffix = p + 1;
+
+	if (suffix != host && ((suffix = strchr(suffix, '.')) == NULL || suffix[1] == '\0'))
+		return NULL;
+
+	return sstrdup(suffix);
+}
+
+static void
+svsignore_index_add(struct svsignore *const svsignore)
+{
+	const char *const bang = strchr(svsignore->mask, '!');
+	const char *const at = strchr(svsignore->mask, '@');
+	mowgli_list_t *bucket;
+
+	if (bang == NULL || at == NULL || at < bang || strchr(bang + 1, '!') || strchr(at + 1, '@') ||
+	    (svsignore->hostkey = svsignore_host_key(at + 1)) == NULL)
+	{
+		mowgli_node_add(svsignore, &svsignore->indexnode, &svsignore_wildlist);
+		return;
+	}
+
+	char *const nick = sstrndup(svsignore->mask, (size_t) (bang - svsignore->mask));
+	char *const user = sstrndup(bang + 1, (size_t) (at - bang - 1));
+
+	svsignore->nickpat = match_compile(nick);
+	svsignore->userpat = match_compile(user);
+	svsignore->hostpat = match_compile(at + 1);
+
+	sfree(nick);
+	sfree(user);
+
+	if (svsignore_hosts == NULL)
+		svsignore_hosts = mowgli_patricia_create(irccasecanon);
+
+	if ((bucket = mowgli_patricia_retrieve(svsignore_hosts, svsignore->hostkey)) == NULL)
+	{
+		bucket = mowgli_list_create();
+		mowgli_patricia_add(svsignore_hosts, svsignore->hostkey, bucket);
+	}
+
+	mowgli_node_add(svsignore, &svsignore->indexnode, bucket);
+}
+
+static void
+svsignore_index_delete(struct svsignore *const svsignore)
+{
+	mowgli_list_t *bucket;
+
+	if (svsignore->hostkey == NULL)
+	{
+		mowgli_node_delete(&svsignore->indexnode, &svsignore_wildlist);
+		return;
+	}
+
+	if ((bucket = mowgli_patricia_retrieve(svsignore_hosts, svsignore->hostkey)) != NULL)
+	{
+		mowgli_node_delete(&svsignore->indexnode, bucket);
+
+		if (! MOWGLI_LIST_LENGTH(bucket))
+		{
+			(void) mowgli_patricia_delete(svsignore_hosts, svsignore->hostkey);
+			mowgli_list_free(bucket);
+		}
+	}
+
+	match_pattern_free(svsignore->nickpat);
+	match_pattern_free(svsignore->userpat);
+	match_pattern_free(svsignore->hostpat);
+	sfree(svsignore->hostkey);
+}
+
+static struct svsignore *
+svsignore_find_bucket(const char *const key, const struct user *const source)
+{
+	const mowgli_list_t *bucket;
+	mowgli_node_t *n;
+
+	if ((bucket = mowgli_patricia_retrieve(svsignore_hosts, key)) == NULL)
+		return NULL;
+
+	MOWGLI_ITER_FOREACH(n, bucket->head)
+	{
+		struct svsignore *const svsignore = n->data;
+
+		if (!match_compiled(svsignore->hostpat, source->host) && !match_compiled(svsignore->nickpat, source->nick) &&
+		    !match_compiled(svsignore->userpat, source->user))
+			return svsignore;
+	}
+
+	return NULL;
+}
+
 /*
  * svsignore_add(const char *mask, const char *reason)
  *
@@ -42,13 +165,17 @@ svsignore_add(const char *mask, const char *reason)
         struct svsignore *const svsignore = smalloc(sizeof *svsignore);
 
         svsignore->mask = sstrdup(mask);
+        svsignore->maskpat = match_compile(mask);
         svsignore->settime = CURRTIME;
         svsignore->reason = sstrdup(reason);
 
         mowgli_node_t *n = mowgli_node_create();
         mowgli_node_add(svsignore, n, &svs_ignore_list);
 
+        svsignore_index_add(svsignore);
+
         cnt.svsignore++;
+        db_change_note(DB_CHANGE_OTHER);
         return svsignore;
 }
 
@@ -61,7 +188,7 @@ svsignore_add(const char *mask, const char *reason)
  *     - user object to check
  *
  * Outputs:
- *     - if any ignores match, the ignore that matches
+ *     - if any ignores match, one of the ignores that match
  *     - if none match, NULL
  *
  * Side Effects:
@@ -77,6 +204,19 @@ svsignore_find(struct user *source)
 	if (!use_svsignore)
 		return NULL;
 
+	if (svsignore_hosts != NULL)
+	{
+		if ((svsignore = svsignore_find_bucket(source->host, source)) != NULL)
+			return svsignore;
+
+		for (const char *p = strchr(source->host, '.'); p != NULL; p = strchr(p + 1, '.'))
+			if ((svsignore = svsignore_find_bucket(p, source)) != NULL)
+				return svsignore;
+	}
+
+	if (svsignore_wildlist.head == NULL)
+		return NULL;
+
         *host = '\0';
         mowgli_strlcpy(host, source->nick, BUFSIZE);
         mowgli_strlcat(host, "!", BUFSIZE);
@@ -84,11 +224,11 @@ svsignore_find(struct user *source)
         mowgli_strlcat(host, "@", BUFSIZE);
         mowgli_strlcat(host, source->host, BUFSIZE);
 
-        MOWGLI_ITER_FOREACH(n, svs_ignore_list.head)
+        MOWGLI_ITER_FOREACH(n, svsignore_wildlist.head)
         {
                 svsignore = (struct svsignore *)n->data;
 
-                if (!match(svsignore->mask, host))
+                if (!match_compiled(svsignore->maskpat, host))
                         return svsignore;
         }
 
@@ -116,10 +256,17 @@ svsignore_delete(struct svsignore *svsignore)
 
 	n = mowgli_node_find(svsignore, &svs_ignore_list);
 	mowgli_node_delete(n, &svs_ignore_list);
+	mowgli_node_free(n);
 
+	svsignore_index_delete(svsignore);
+	match_pattern_free(svsignore->maskpat);
 	sfree(svsignore->mask);
+	sfree(svsignore->setby);
 	sfree(svsignore->reason);
 	sfree(svsignore);
+
+	cnt.svsignore--;
+	db_change_note(DB_CHANGE_OTHER);
 }
 
 /* vim:cinoptions=>s,e0,n0,f0,{0,}0,^0,=s,ps,t0,c3,+s,(2s,us,)20,*30,gs,hs
@@ -0,0 +1,312 @@
+/*
+ * SPDX-License-Identifier: ISC
+ * SPDX-URL: https://spdx.org/licenses/ISC.html
+ *
+ * Copyright (C) 2026 Atheme Development Group (https://atheme.github.io/)
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * atheme-services: A collection of minimalist IRC services
+ * timer.c: Profiled timers and event loop stall detection.
+ */
+
+#include <atheme.h>
+#include "internal.h"
+
+// Don't wallop about stalls more often than this
+#define TIMER_STALL_WALLOPS_INTERVAL    SECONDS_PER_MINUTE
+
+struct timer_closure
+{
+	struct connection_lane_entry    lane;       // first, see timer_lane_run()
+	mowgli_event_dispatch_func_t *  func;
+	void *                          arg;
+	struct timer_stats *            stats;
+	bool                            once;
+};
+
+static mowgli_patricia_t *timer_stats_tree = NULL;
+
+// Time spent in callbacks during the current io_loop() iteration, and the slowest of them
+static unsigned long long timer_loop_busy_us = 0;
+static unsigned long long timer_loop_worst_us = 0;
+static char timer_loop_worst[BUFSIZE];
+
+static time_t timer_stall_wallops_last = 0;
+
+static struct timer_stats *
+timer_stats_get(const char *const restrict name)
+{
+	struct timer_stats *st;
+
+	if (timer_stats_tree == NULL)
+		timer_stats_tree = mowgli_patricia_create(&strcasecanon);
+
+	if ((st = mowgli_patricia_retrieve(timer_stats_tree, name)) == NULL)
+	{
+		st = smalloc(sizeof *st);
+		st->name = sstrdup(name);
+		(void) mowgli_patricia_add(timer_stats_tree, st->name, st);
+	}
+
+	return st;
+}
+
+static unsigned long long
+timer_stats_record(struct timer_stats *const restrict st, const struct timeval *const restrict started)
+{
+	struct timeval elapsed;
+
+	(void) e_time(*started, &elapsed);
+
+	const unsigned long long us = (((unsigned long long) elapsed.tv_sec) * 1000000ULL) + elapsed.tv_usec;
+
+	st->runs++;
+	st->total_us += us;
+
+	if (us > st->max_us)
+		st->max_us = us;
+
+	if (config_options.slow_loop_time && us >= config_options.slow_loop_time * 1000ULL)
+		st->slow++;
+
+	timer_loop_busy_us += us;
+
+	return us;
+}
+
+static void
+timer_run(struct timer_closure *const restrict tc)
+{
+	// The callback may destroy its own (periodic) timer, and with it tc
+	struct timer_stats *const st = tc->stats;
+	struct timeval started;
+
+	(void) s_time(&started);
+
+	tc->func(tc->arg);
+
+	const unsigned long long us = timer_stats_record(st, &started);
+
+	if (us > timer_loop_worst_us)
+	{
+		timer_loop_worst_us = us;
+		(void) mowgli_strlcpy(timer_loop_worst, st->name, sizeof timer_loop_worst);
+	}
+}
+
+static void
+timer_lane_run(struct connection_lane_entry *const restrict le)
+{
+	(void) timer_run((struct timer_closure *) le);
+}
+
+/* Periodic timers are housekeeping, and wait on their lane until the uplink
+ * and clients have had their turn (see connection_lanes_run()). One-shot
+ * timers mostly finish off work already under way (stacked modes and the
+ * like), and are run at once; the event loop also destroys them as soon as
+ * this returns, so they could not wait anyway.
+ */
+static void
+timer_trampoline(void *const restrict vptr)
+{
+	struct timer_closure *const tc = vptr;
+
+	if (! tc->once)
+	{
+		(void) connection_lane_defer(&tc->lane);
+		return;
+	}
+
+	(void) timer_run(tc);
+	(void) sfree(tc);
+}
+
+static mowgli_eventloop_timer_t *
+timer_add_common(const char *const restrict name, mowgli_event_dispatch_func_t *const func, void *const arg,
+                 const time_t when, const bool once)
+{
+	mowgli_eventloop_timer_t *timer;
+
+	return_val_if_fail(name != NULL, NULL);
+	return_val_if_fail(func != NULL, NULL);
+
+	struct timer_closure *const tc = smalloc(sizeof *tc);
+
+	tc->lane.run = &timer_lane_run;
+	tc->lane.lane = CONNECTION_LANE_TIMER;
+	tc->func = func;
+	tc->arg = arg;
+	tc->stats = timer_stats_get(name);
+	tc->once = once;
+
+	if (once)
+		timer = mowgli_timer_add_once(base_eventloop, name, &timer_trampoline, tc, when);
+	else
+		timer = mowgli_timer_add(base_eventloop, name, &timer_trampoline, tc, when);
+
+	if (timer == NULL)
+		(void) sfree(tc);
+
+	return timer;
+}
+
+/*
+ * timer_add()
+ * timer_add_once()
+ *
+ * inputs:
+ *       timer name, callback, callback argument, interval (or delay)
+ *
+ * outputs:
+ *       the new timer, or NULL on failure
+ *
+ * side effects:
+ *       like mowgli_timer_add() and mowgli_timer_add_once() on
+ *       base_eventloop, but every run of the callback is timed and counted
+ *       under the timer's name
+ */
+mowgli_eventloop_timer_t *
+timer_add(const char *const restrict name, mowgli_event_dispatch_func_t *const func, void *const arg,
+          const time_t when)
+{
+	return timer_add_common(name, func, arg, when, false);
+}
+
+mowgli_eventloop_timer_t *
+timer_add_once(const char *const restrict name, mowgli_event_dispatch_func_t *const func, void *const arg,
+               const time_t when)
+{
+	return timer_add_common(name, func, arg, when, true);
+}
+
+/*
+ * timer_destroy()
+ *
+ * inputs:
+ *       a timer returned by timer_add() or timer_add_once() that has not
+ *       yet fired (if it is a one-shot timer)
+ *
+ * outputs:
+ *       none
+ *
+ * side effects:
+ *       the timer is removed from base_eventloop
+ */
+void
+timer_destroy(mowgli_eventloop_timer_t *const restrict timer)
+{
+	return_if_fail(timer != NULL);
+
+	if (timer->func == &timer_trampoline)
+	{
+		struct timer_closure *const tc = timer->arg;
+
+		(void) connection_lane_cancel(&tc->lane);
+		(void) sfree(tc);
+	}
+
+	(void) mowgli_timer_destroy(base_eventloop, timer);
+}
+
+/*
+ * timer_stats_foreach()
+ *
+ * Calls cb for the statistics of every timer and kind of connection I/O
+ * that has run.
+ */
+void
+timer_stats_foreach(void (*const cb)(const struct timer_stats *, void *), void *const privdata)
+{
+	mowgli_patricia_iteration_state_t state;
+	struct timer_stats *st;
+
+	return_if_fail(cb != NULL);
+
+	if (timer_stats_tree == NULL)
+		return;
+
+	MOWGLI_PATRICIA_FOREACH(st, &state, timer_stats_tree)
+		cb(st, privdata);
+}
+
+/*
+ * timer_io_begin()
+ * timer_io_end()
+ *
+ * Bracket a connection's read or write handler in connection_trampoline().
+ * The statistics are kept per kind of connection rather than per
+ * connection; the stall report names the connection itself.
+ */
+void
+timer_io_begin(const struct connection *const restrict cptr, struct timer_io_sample *const restrict sample)
+{
+	sample->kind = CF_IS_UPLINK(cptr) ? 0 : (CF_IS_LISTENING(cptr) ? 1 : 2);
+	(void) mowgli_strlcpy(sample->name, cptr->name, sizeof sample->name);
+	(void) s_time(&sample->started);
+}
+
+void
+timer_io_end(struct timer_io_sample *const restrict sample, const bool write)
+{
+	static struct timer_stats *io_stats[3][2] = { { NULL } };
+	static const char *const io_kinds[3] = { "uplink", "listener", "connection" };
+
+	struct timer_stats **const st = &io_stats[sample->kind][write];
+
+	if (*st == NULL)
+	{
+		char name[BUFSIZE];
+
+		(void) snprintf(name, sizeof name, "%s %s", io_kinds[sample->kind], write ? "write" : "read");
+		*st = timer_stats_get(name);
+	}
+
+	const unsigned long long us = timer_stats_record(*st, &sample->started);
+
+	if (us > timer_loop_worst_us)
+	{
+		timer_loop_worst_us = us;
+		(void) snprintf(timer_loop_worst, sizeof timer_loop_worst, "%s (%s)", (*st)->name, sample->name);
+	}
+}
+
+/*
+ * timer_loop_begin()
+ * timer_loop_end()
+ *
+ * Bracket one iteration of io_loop(). If the callbacks that ran in it took
+ * at least config_options.slow_loop_time between them, everything else
+ * (including the uplink) had to wait that long; say so, and name the
+ * slowest of them. Time spent waiting for events is not counted.
+ */
+void
+timer_loop_begin(void)
+{
+	timer_loop_busy_us = 0;
+	timer_loop_worst_us = 0;
+	timer_loop_worst[0] = '\0';
+}
+
+void
+timer_loop_end(void)
+{
+	if (! config_options.slow_loop_time || timer_loop_busy_us < config_options.slow_loop_time * 1000ULL)
+		return;
+
+	const unsigned long long busy_ms = timer_loop_busy_us / 1000ULL;
+	const unsigned long long worst_ms = timer_loop_worst_us / 1000ULL;
+
+	(void) slog(LG_INFO, "STALL: event loop iteration took %llu ms; slowest callback: \2%s\2 (%llu ms)",
+	            busy_ms, timer_loop_worst, worst_ms);
+
+	if (CURRTIME - timer_stall_wallops_last < TIMER_STALL_WALLOPS_INTERVAL)
+		return;
+
+	timer_stall_wallops_last = CURRTIME;
+
+	(void) wallops("Services stalled for %llu ms; slowest callback: %s (%llu ms)", busy_ms, timer_loop_worst,
+	               worst_ms);
+}
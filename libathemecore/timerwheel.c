@@ -0,0 +1,194 @@
+/*
+ * SPDX-License-Identifier: ISC
+ * SPDX-URL: https://spdx.org/licenses/ISC.html
+ *
+ * Copyright (C) 2026 Atheme Development Group (https://atheme.github.io/)
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * atheme-services: A collection of minimalist IRC services
+ * timerwheel.c: A hierarchical timer wheel.
+ *
+ * Level 0 has a slot for each of the next 64 seconds, level 1 one for each
+ * of the next 64 spans of 64 seconds, and so on. An entry is filed in the
+ * lowest level whose range covers it; whenever the level below has been
+ * through all of its slots, the next slot up is emptied and its entries are
+ * filed again, now closer to the bottom. Entries due further away than the
+ * top level reaches wait in its furthest slot and are filed again from
+ * there.
+ */
+
+#include <atheme.h>
+#include "internal.h"
+
+#define TIMERWHEEL_BITS         6U
+#define TIMERWHEEL_SLOTS        (1U << TIMERWHEEL_BITS)
+#define TIMERWHEEL_MASK         (TIMERWHEEL_SLOTS - 1U)
+#define TIMERWHEEL_LEVELS       4U
+
+// About 194 days
+#define TIMERWHEEL_SPAN         (1ULL << (TIMERWHEEL_BITS * TIMERWHEEL_LEVELS))
+
+static mowgli_list_t timerwheel_slots[TIMERWHEEL_LEVELS][TIMERWHEEL_SLOTS];
+
+// Entries taken off level 0 whose callbacks have not run yet
+static mowgli_list_t timerwheel_due;
+
+// The next second to be processed
+static time_t timerwheel_next = 0;
+static unsigned int timerwheel_count = 0;
+
+static void
+timerwheel_file(struct timerwheel_entry *const restrict te)
+{
+	time_t when = (te->expires < timerwheel_next) ? timerwheel_next : te->expires;
+	unsigned long long delta = (unsigned long long) (when - timerwheel_next);
+
+	if (delta >= TIMERWHEEL_SPAN)
+	{
+		delta = TIMERWHEEL_SPAN - 1U;
+		when = timerwheel_next + (time_t) delta;
+	}
+
+	unsigned int level = 0;
+
+	while (level < TIMERWHEEL_LEVELS - 1U && delta >= (1ULL << (TIMERWHEEL_BITS * (level + 1U))))
+		level++;
+
+	const unsigned int idx = (unsigned int) (((unsigned long long) when >> (TIMERWHEEL_BITS * level)) & TIMERWHEEL_MASK);
+
+	te->slot = &timerwheel_slots[level][idx];
+	(void) mowgli_node_add(te, &te->node, te->slot);
+}
+
+static void
+timerwheel_cascade(const unsigned int level, const time_t t)
+{
+	const unsigned int idx = (unsigned int) (((unsigned long long) t >> (TIMERWHEEL_BITS * level)) & TIMERWHEEL_MASK);
+	mowgli_list_t *const slot = &timerwheel_slots[level][idx];
+	mowgli_node_t *n, *tn;
+
+	MOWGLI_ITER_FOREACH_SAFE(n, tn, slot->head)
+	{
+		struct timerwheel_entry *const te = n->data;
+
+		(void) mowgli_node_delete(&te->node, slot);
+		(void) timerwheel_file(te);
+	}
+}
+
+static void
+timerwheel_run(void *const ATHEME_VATTR_UNUSED unused)
+{
+	while (timerwheel_count && timerwheel_next <= CURRTIME)
+	{
+		const time_t t = timerwheel_next;
+		mowgli_node_t *n, *tn;
+
+		// Every level whose slot turns over at t, from the top down
+		unsigned int top = 0;
+
+		while (top < TIMERWHEEL_LEVELS - 1U &&
+		       ! ((unsigned long long) t & ((1ULL << (TIMERWHEEL_BITS * (top + 1U))) - 1U)))
+			top++;
+
+		for (unsigned int level = top; level > 0; level--)
+			(void) timerwheel_cascade(level, t);
+
+		/* Move everything due now aside before running any of it; entries
+		 * scheduled by the callbacks can land in the same slot again.
+		 */
+		mowgli_list_t *const slot = &timerwheel_slots[0][t & TIMERWHEEL_MASK];
+
+		MOWGLI_ITER_FOREACH_SAFE(n, tn, slot->head)
+		{
+			struct timerwheel_entry *const te = n->data;
+
+			(void) mowgli_node_delete(&te->node, slot);
+			(void) mowgli_node_add(te, &te->node, &timerwheel_due);
+			te->slot = &timerwheel_due;
+		}
+
+		timerwheel_next = t + 1;
+
+		while (timerwheel_due.head != NULL)
+		{
+			struct timerwheel_entry *const te = timerwheel_due.head->data;
+
+			(void) mowgli_node_delete(&te->node, &timerwheel_due);
+			te->slot = NULL;
+			timerwheel_count--;
+
+			te->func(te->arg);
+		}
+	}
+}
+
+/*
+ * timerwheel_add()
+ *
+ * inputs:
+ *       an entry, callback, callback argument, and when to run it
+ *
+ * outputs:
+ *       none
+ *
+ * side effects:
+ *       the entry is scheduled, or rescheduled if it already was
+ */
+void
+timerwheel_add(struct timerwheel_entry *const restrict te, mowgli_event_dispatch_func_t *const func,
+               void *const arg, const time_t expires)
+{
+	return_if_fail(te != NULL);
+	return_if_fail(func != NULL);
+
+	if (timerwheel_pending(te))
+		(void) timerwheel_cancel(te);
+
+	// Nothing is filed relative to the old position of an empty wheel
+	if (! timerwheel_count)
+		timerwheel_next = CURRTIME;
+
+	te->func = func;
+	te->arg = arg;
+	te->expires = expires;
+
+	(void) timerwheel_file(te);
+
+	timerwheel_count++;
+}
+
+/*
+ * timerwheel_cancel()
+ *
+ * inputs:
+ *       an entry
+ *
+ * outputs:
+ *       none
+ *
+ * side effects:
+ *       the entry is no longer scheduled, if it was
+ */
+void
+timerwheel_cancel(struct timerwheel_entry *const restrict te)
+{
+	return_if_fail(te != NULL);
+
+	if (! timerwheel_pending(te))
+		return;
+
+	(void) mowgli_node_delete(&te->node, te->slot);
+
+	te->slot = NULL;
+	timerwheel_count--;
+}
+
+void
+timerwheel_init(void)
+{
+	(void) timer_add("timerwheel", &timerwheel_run, NULL, 1);
+}
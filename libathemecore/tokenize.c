@@ -158,6 +158,77 @@ tokenize(char *message, char **parv)
 	return count;
 }
 
+/*
+ * irc_tokenize(char *line, char **origin, char **command, char **parv)
+ *
+ * Splits a complete RFC1459-style line into its prefix, command and
+ * parameters in place, in a single pass over it.
+ *
+ * Inputs:
+ *     - the line, with no trailing CR/LF
+ *     - where to store the prefix (without ':'), or NULL if there is none
+ *     - where to store the command
+ *     - a parameter vector with room for MAXPARC entries
+ *
+ * Outputs:
+ *     - the number of parameters, or -1 if there is no command
+ *
+ * Side Effects:
+ *     - separating spaces in the line are overwritten with NULs
+ *     - past MAXPARC - 1 parameters, the rest of the line is the last one
+ */
+int
+irc_tokenize(char *line, char **origin, char **command, char **parv)
+{
+	char *p = line;
+	int parc = 0;
+
+	*origin = NULL;
+	*command = NULL;
+
+	if (*p == ':')
+	{
+		*origin = ++p;
+		while (*p != '\0' && *p != ' ')
+			p++;
+		while (*p == ' ')
+			*p++ = '\0';
+	}
+
+	if (*p == '\0')
+		return -1;
+
+	*command = p;
+	while (*p != '\0' && *p != ' ')
+		p++;
+	while (*p == ' ')
+		*p++ = '\0';
+
+	while (*p != '\0')
+	{
+		if (*p == ':')
+		{
+			parv[parc++] = p + 1;
+			break;
+		}
+
+		if (parc == MAXPARC - 1)
+		{
+			slog(LG_DEBUG, "irc_tokenize(): reached para limit");
+			parv[parc++] = p;
+			break;
+		}
+
+		parv[parc++] = p;
+		while (*p != '\0' && *p != ' ')
+			p++;
+		while (*p == ' ')
+			*p++ = '\0';
+	}
+
+	return parc;
+}
+
 /* vim:cinoptions=>s,e0,n0,f0,{0,}0,^0,=s,ps,t0,c3,+s,(2s,us,)20,*30,gs,hs
  * vim:ts=8
  * vim:sw=8
@@ -18,7 +18,19 @@
 
 static void uplink_close(struct connection *cptr);
 
-static mowgli_heap_t *uplink_heap = NULL;
+static struct named_heap *uplink_heap = NULL;
+
+// A service that was on a channel when the uplink was lost, to join it again after the new burst
+struct uplink_rejoin
+{
+	mowgli_node_t   node;
+	char *          chan;
+	char *          nick;
+};
+
+static mowgli_list_t uplink_rejoins;
+static mowgli_eventloop_timer_t *uplink_reconcile_timer = NULL;
+static bool uplink_reconciling = false;
 
 mowgli_list_t uplinks;
 struct uplink *curr_uplink;
@@ -28,7 +40,7 @@ void (*parse)(char *line) = NULL;
 void
 init_uplinks(void)
 {
-	uplink_heap = sharedheap_get(sizeof(struct uplink));
+	uplink_heap = named_heap_get("uplink", sizeof(struct uplink));
 	if (!uplink_heap)
 	{
 		slog(LG_INFO, "init_uplinks(): block allocator failed.");
@@ -63,7 +75,7 @@ uplink_add(const char *name, const char *host, const char *send_password, const
 	}
 	else
 	{
-		u = mowgli_heap_alloc(uplink_heap);
+		u = named_heap_alloc(uplink_heap);
 		mowgli_node_add(u, &u->node, &uplinks);
 		cnt.uplink++;
 	}
@@ -88,7 +100,7 @@ uplink_delete(struct uplink * u)
 	sfree(u->vhost);
 
 	mowgli_node_delete(&u->node, &uplinks);
-	mowgli_heap_free(uplink_heap, u);
+	named_heap_free(uplink_heap, u);
 
 	cnt.uplink--;
 }
@@ -153,9 +165,11 @@ uplink_connect(void)
 	{
 		curr_uplink->conn->close_handler = uplink_close;
 		sendq_set_limit(curr_uplink->conn, config_options.uplink_sendq_limit);
+		sendq_set_watermarks(curr_uplink->conn, config_options.uplink_sendq_limit / 4,
+				config_options.uplink_sendq_limit / 8);
 	}
 	else
-		mowgli_timer_add_once(base_eventloop, "reconn", reconn, NULL, me.recontime);
+		timer_add_once("reconn", reconn, NULL, me.recontime);
 }
 
 /*
@@ -173,13 +187,84 @@ uplink_connect(void)
  *       uplink marked dead
  *       uplink deleted if it had been removed from configuration
  */
+static void
+uplink_rejoin_add(struct channel *c, struct user *u)
+{
+	struct uplink_rejoin *const rj = smalloc(sizeof *rj);
+
+	rj->chan = sstrdup(c->name);
+	rj->nick = sstrdup(u->nick);
+	mowgli_node_add(rj, &rj->node, &uplink_rejoins);
+}
+
+// Deletes what the new burst did not bring back, and puts the services back on their channels
+static void
+uplink_reconcile_finish(void)
+{
+	mowgli_node_t *n, *tn;
+
+	if (uplink_reconcile_timer != NULL)
+		timer_destroy(uplink_reconcile_timer);
+	uplink_reconcile_timer = NULL;
+	uplink_reconciling = false;
+
+	const unsigned int servers = server_purge_stale();
+	const unsigned int users = user_purge_stale();
+	const unsigned int chanusers = chanuser_purge_stale();
+
+	channel_reap_split();
+
+	slog(LG_INFO, "uplink_reconcile(): %u servers, %u more users and %u more channel memberships were gone",
+			servers, users, chanusers);
+
+	MOWGLI_ITER_FOREACH_SAFE(n, tn, uplink_rejoins.head)
+	{
+		struct uplink_rejoin *const rj = n->data;
+		struct user *const u = user_find_named(rj->nick);
+
+		if (me.connected && u != NULL && is_internal_client(u) && channel_find(rj->chan) != NULL)
+			join(rj->chan, rj->nick);
+
+		mowgli_node_delete(&rj->node, &uplink_rejoins);
+		sfree(rj->chan);
+		sfree(rj->nick);
+		sfree(rj);
+	}
+}
+
+static void
+uplink_reconcile_expire(void *arg)
+{
+	uplink_reconcile_timer = NULL;
+
+	slog(LG_INFO, "uplink_reconcile(): no new burst within %u seconds, dropping the old network state",
+			config_options.uplink_reconcile_time);
+
+	uplink_reconcile_finish();
+}
+
+/*
+ * uplink_reconcile_done()
+ *
+ * Called when the uplink has finished its burst. The servers, users and
+ * channel memberships that were kept from before the connection was lost
+ * and that the burst did not introduce again are deleted now; for the
+ * others, no hooks have been called again.
+ */
+void
+uplink_reconcile_done(void)
+{
+	if (uplink_reconciling)
+		uplink_reconcile_finish();
+}
+
 static void
 uplink_close(struct connection *cptr)
 {
 	struct channel *c;
 	mowgli_patricia_iteration_state_t state;
 
-	mowgli_timer_add_once(base_eventloop, "reconn", reconn, NULL, me.recontime);
+	timer_add_once("reconn", reconn, NULL, me.recontime);
 
 	me.connected = false;
 
@@ -196,6 +281,30 @@ uplink_close(struct connection *cptr)
 	}
 	curr_uplink->conn = NULL;
 
+	/* Keep everything, marked as stale, and see what the next burst brings
+	 * back; a brief hub flap then does not cost a rebuild of the world.
+	 */
+	if (config_options.uplink_reconcile_time && me.actual != NULL)
+	{
+		slog(LG_DEBUG, "uplink_close(): keeping the network state for up to %u seconds",
+				config_options.uplink_reconcile_time);
+
+		server_mark_stale();
+		user_mark_stale();
+		channel_mark_stale(&uplink_rejoin_add);
+		me.actual = NULL;
+
+		uplink_reconciling = true;
+		if (uplink_reconcile_timer == NULL)
+			uplink_reconcile_timer = timer_add_once("uplink_reconcile", uplink_reconcile_expire, NULL,
+					config_options.uplink_reconcile_time);
+		return;
+	}
+
+	// Lost again before anything was introduced; what was kept is of no more use
+	if (uplink_reconciling)
+		uplink_reconcile_finish();
+
 	slog(LG_DEBUG, "uplink_close(): ----------------------- clearing -----------------------");
 
 	/* we have to kill everything.
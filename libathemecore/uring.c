@@ -0,0 +1,1057 @@
+/*
+ * SPDX-License-Identifier: ISC
+ * SPDX-URL: https://spdx.org/licenses/ISC.html
+ *
+ * Copyright (C) 2026 Atheme Development Group (https://atheme.github.io/)
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * atheme-services: A collection of minimalist IRC services
+ * uring.c: Completion-based socket I/O on Linux io_uring.
+ *
+ * With general::io_uring set, connections that read through recvq_put()
+ * (the uplink, httpd clients, the mail relay) and listening sockets are
+ * driven by an io_uring instead of readiness callbacks from the event
+ * loop: a recv into the free end of the recvq is always outstanding, the
+ * sendq is handed over a writev at a time, and listeners keep an accept
+ * armed (a multishot one where the kernel has them). Completions are
+ * signalled on an eventfd that the event loop polls, and everything asked
+ * for while handling them, or anywhere else in the same iteration of the
+ * loop, is submitted together with one io_uring_enter().
+ *
+ * Buffers the kernel may still be reading or writing stay allocated until
+ * the operation's completion arrives, even if the connection has been
+ * closed in the meantime. Where the ring cannot be set up, or the kernel
+ * lacks one of the operations used here, everything stays on the event
+ * loop as before.
+ */
+
+#include <atheme.h>
+#include "internal.h"
+
+#if defined(HAVE_LINUX_IO_URING_H) && defined(HAVE_SYS_EVENTFD_H) && defined(HAVE_SYS_SYSCALL_H) && \
+    defined(HAVE_SYS_UIO_H)
+#  include <linux/io_uring.h>
+#  include <sys/eventfd.h>
+#  include <sys/syscall.h>
+#  if defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter) && defined(__NR_io_uring_register) && \
+      defined(IO_URING_OP_SUPPORTED) && defined(IORING_CQE_F_MORE) && defined(IORING_FEAT_NODROP)
+#    define ATHEME_IO_URING 1
+#  endif
+#endif
+
+#ifdef ATHEME_IO_URING
+
+#define URING_SQ_ENTRIES        256U
+#define URING_CQ_ENTRIES        1024U
+#define URING_IOV_MAX           64      // as many slabs as sendq_flush() gives one writev()
+#define URING_ACCEPT_MAX        16U     // accepted sockets waiting for connection_accept_tcp()
+
+struct uring_op
+{
+	void                  (*done)(struct uring_op *op, int res, unsigned int flags);
+	struct uring_connection *uc;
+	bool                    busy;
+};
+
+struct uring_connection
+{
+	struct connection *     cptr;           // NULL once the connection has been closed
+	struct uring_op         recv;
+	struct uring_op         send;
+	struct uring_op         accept;
+	bool                    reading;
+	bool                    writing;
+	bool                    queued;         // on uring_queue, for uring_run() to start a writev
+	unsigned int            depth;          // completions of ours being handled; not freed until 0
+	mowgli_node_t           qnode;
+	struct iovec            iov[URING_IOV_MAX];
+	int                     accepted[URING_ACCEPT_MAX];
+	unsigned int            naccepted;
+	mowgli_list_t           orphans;        // recvq and sendq blocks of a closed connection
+};
+
+struct uring_ring
+{
+	int                     fd;
+	unsigned int *          sq_head;
+	unsigned int *          sq_tail;
+	unsigned int *          sq_array;
+	unsigned int            sq_mask;
+	unsigned int            sq_entries;
+	unsigned int *          cq_head;
+	unsigned int *          cq_tail;
+	unsigned int            cq_mask;
+	struct io_uring_sqe *   sqes;
+	struct io_uring_cqe *   cqes;
+	void *                  sq_map;
+	size_t                  sq_map_len;
+	void *                  cq_map;
+	size_t                  cq_map_len;
+	size_t                  sqes_len;
+	unsigned int            unsubmitted;
+};
+
+static struct uring_ring uring = { .fd = -1 };
+static bool uring_ok = false;
+static bool uring_failed = false;
+static bool uring_multishot_accept = false;
+
+static int uring_eventfd = -1;
+static mowgli_eventloop_pollable_t *uring_pollable = NULL;
+static mowgli_eventloop_timer_t *uring_timer = NULL;
+
+// Connections with a writev to start
+static mowgli_list_t uring_queue = { NULL, NULL, 0 };
+
+// Completions reaped while waiting for a particular one (see uring_wait())
+static struct io_uring_cqe *uring_deferred = NULL;
+static size_t uring_deferred_count = 0;
+static size_t uring_deferred_alloc = 0;
+
+static void uring_run(void);
+
+static int
+uring_sys_setup(const unsigned int entries, struct io_uring_params *const restrict p)
+{
+	return (int) syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int
+uring_sys_enter(const unsigned int to_submit, const unsigned int min_complete, const unsigned int flags)
+{
+	return (int) syscall(__NR_io_uring_enter, uring.fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static int
+uring_sys_register(const unsigned int opcode, const void *const restrict arg, const unsigned int nr_args)
+{
+	return (int) syscall(__NR_io_uring_register, uring.fd, opcode, arg, nr_args);
+}
+
+static void
+uring_teardown(void)
+{
+	if (uring.sqes && uring.sqes != MAP_FAILED)
+		(void) munmap(uring.sqes, uring.sqes_len);
+
+	if (uring.cq_map && uring.cq_map != MAP_FAILED && uring.cq_map != uring.sq_map)
+		(void) munmap(uring.cq_map, uring.cq_map_len);
+
+	if (uring.sq_map && uring.sq_map != MAP_FAILED)
+		(void) munmap(uring.sq_map, uring.sq_map_len);
+
+	if (uring.fd != -1)
+		(void) close(uring.fd);
+
+	if (uring_eventfd != -1)
+		(void) close(uring_eventfd);
+
+	(void) memset(&uring, 0x00, sizeof uring);
+
+	uring.fd = -1;
+	uring_eventfd = -1;
+}
+
+static bool
+uring_probe(void)
+{
+	static const unsigned char needed[] = {
+		IORING_OP_RECV, IORING_OP_WRITEV, IORING_OP_ACCEPT, IORING_OP_ASYNC_CANCEL,
+	};
+
+	const size_t len = sizeof(struct io_uring_probe) + (256 * sizeof(struct io_uring_probe_op));
+	struct io_uring_probe *const probe = smalloc(len);
+	bool ok = true;
+
+	if (uring_sys_register(IORING_REGISTER_PROBE, probe, 256) != 0)
+	{
+		(void) sfree(probe);
+		return false;
+	}
+
+	for (size_t i = 0; i < ARRAY_SIZE(needed); i++)
+		if (needed[i] > probe->last_op || ! (probe->ops[needed[i]].flags & IO_URING_OP_SUPPORTED))
+			ok = false;
+
+	(void) sfree(probe);
+	return ok;
+}
+
+static void uring_eventfd_cb(mowgli_eventloop_t *, mowgli_eventloop_io_t *, mowgli_eventloop_io_dir_t, void *);
+
+static bool
+uring_start(void)
+{
+	struct io_uring_params p;
+	const char *why = NULL;
+	unsigned char *sq, *cq;
+
+	(void) memset(&p, 0x00, sizeof p);
+
+	p.flags = IORING_SETUP_CQSIZE;
+	p.cq_entries = URING_CQ_ENTRIES;
+
+	if ((uring.fd = uring_sys_setup(URING_SQ_ENTRIES, &p)) < 0)
+	{
+		why = "io_uring_setup";
+		goto fail;
+	}
+
+	// Without this, completions can be lost when the CQ ring fills up
+	if (! (p.features & IORING_FEAT_NODROP))
+	{
+		errno = ENOTSUP;
+		why = "IORING_FEAT_NODROP";
+		goto fail;
+	}
+
+	uring.sq_map_len = p.sq_off.array + (p.sq_entries * sizeof(unsigned int));
+	uring.cq_map_len = p.cq_off.cqes + (p.cq_entries * sizeof(struct io_uring_cqe));
+
+	if (p.features & IORING_FEAT_SINGLE_MMAP)
+	{
+		if (uring.cq_map_len > uring.sq_map_len)
+			uring.sq_map_len = uring.cq_map_len;
+
+		uring.cq_map_len = uring.sq_map_len;
+	}
+
+	uring.sq_map = mmap(NULL, uring.sq_map_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, uring.fd,
+	                    IORING_OFF_SQ_RING);
+
+	if (uring.sq_map == MAP_FAILED)
+	{
+		why = "mmap";
+		goto fail;
+	}
+
+	if (p.features & IORING_FEAT_SINGLE_MMAP)
+		uring.cq_map = uring.sq_map;
+	else
+	{
+		uring.cq_map = mmap(NULL, uring.cq_map_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+		                    uring.fd, IORING_OFF_CQ_RING);
+
+		if (uring.cq_map == MAP_FAILED)
+		{
+			why = "mmap";
+			goto fail;
+		}
+	}
+
+	uring.sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+	uring.sqes = mmap(NULL, uring.sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, uring.fd,
+	                  IORING_OFF_SQES);
+
+	if (uring.sqes == MAP_FAILED)
+	{
+		why = "mmap";
+		goto fail;
+	}
+
+	sq = uring.sq_map;
+	cq = uring.cq_map;
+
+	uring.sq_head = (unsigned int *) (void *) (sq + p.sq_off.head);
+	uring.sq_tail = (unsigned int *) (void *) (sq + p.sq_off.tail);
+	uring.sq_array = (unsigned int *) (void *) (sq + p.sq_off.array);
+	uring.sq_mask = *(unsigned int *) (void *) (sq + p.sq_off.ring_mask);
+	uring.sq_entries = p.sq_entries;
+	uring.cq_head = (unsigned int *) (void *) (cq + p.cq_off.head);
+	uring.cq_tail = (unsigned int *) (void *) (cq + p.cq_off.tail);
+	uring.cq_mask = *(unsigned int *) (void *) (cq + p.cq_off.ring_mask);
+	uring.cqes = (struct io_uring_cqe *) (void *) (cq + p.cq_off.cqes);
+
+	if (! uring_probe())
+	{
+		errno = ENOTSUP;
+		why = "IORING_REGISTER_PROBE";
+		goto fail;
+	}
+
+	if ((uring_eventfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0)
+	{
+		why = "eventfd";
+		goto fail;
+	}
+
+	if (uring_sys_register(IORING_REGISTER_EVENTFD, &uring_eventfd, 1) != 0)
+	{
+		why = "IORING_REGISTER_EVENTFD";
+		goto fail;
+	}
+
+#ifdef IORING_ACCEPT_MULTISHOT
+	// Tried on the first accept; turned off if the kernel turns it down
+	uring_multishot_accept = true;
+#endif
+
+	uring_pollable = mowgli_pollable_create(base_eventloop, uring_eventfd, NULL);
+	(void) mowgli_pollable_setselect(base_eventloop, uring_pollable, MOWGLI_EVENTLOOP_IO_READ, &uring_eventfd_cb);
+
+	(void) slog(LG_INFO, "io_uring: using a ring of %u/%u entries for socket I/O", p.sq_entries, p.cq_entries);
+	return true;
+
+fail:
+	(void) slog(LG_INFO, "io_uring: not available (%s: %s), using the event loop", why, strerror(errno));
+	(void) uring_teardown();
+	return false;
+}
+
+static bool
+uring_ready(void)
+{
+	if (uring_ok)
+		return true;
+
+	if (uring_failed || ! config_options.io_uring)
+		return false;
+
+	if (! uring_start())
+	{
+		uring_failed = true;
+		return false;
+	}
+
+	uring_ok = true;
+	return true;
+}
+
+static void
+uring_timer_cb(void ATHEME_VATTR_UNUSED *const restrict unused)
+{
+	uring_timer = NULL;
+
+	(void) uring_run();
+}
+
+// Anything queued is submitted before the event loop next waits
+static void
+uring_schedule(void)
+{
+	if (! uring_timer)
+		uring_timer = timer_add_once("uring_run", &uring_timer_cb, NULL, 0);
+}
+
+static int
+uring_submit(void)
+{
+	while (uring.unsubmitted)
+	{
+		const int ret = uring_sys_enter(uring.unsubmitted, 0, 0);
+
+		if (ret < 0)
+		{
+			if (errno == EINTR)
+				continue;
+
+			return -1;
+		}
+
+		uring.unsubmitted -= (unsigned int) ret;
+
+		if (ret == 0)
+			break;
+	}
+
+	return 0;
+}
+
+static bool
+uring_next_cqe(struct io_uring_cqe *const restrict cqe)
+{
+	const unsigned int head = *uring.cq_head;
+
+	if (head == __atomic_load_n(uring.cq_tail, __ATOMIC_ACQUIRE))
+		return false;
+
+	*cqe = uring.cqes[head & uring.cq_mask];
+
+	(void) __atomic_store_n(uring.cq_head, head + 1U, __ATOMIC_RELEASE);
+	return true;
+}
+
+static void
+uring_defer(const struct io_uring_cqe *const restrict cqe)
+{
+	if (uring_deferred_count == uring_deferred_alloc)
+	{
+		uring_deferred_alloc = uring_deferred_alloc ? (uring_deferred_alloc * 2) : 64;
+		uring_deferred = sreallocarray(uring_deferred, uring_deferred_alloc, sizeof *uring_deferred);
+	}
+
+	uring_deferred[uring_deferred_count++] = *cqe;
+
+	(void) uring_schedule();
+}
+
+static struct io_uring_sqe *
+uring_get_sqe(void)
+{
+	unsigned int tail = *uring.sq_tail;
+
+	if (tail - __atomic_load_n(uring.sq_head, __ATOMIC_ACQUIRE) >= uring.sq_entries)
+	{
+		struct io_uring_cqe cqe;
+
+		/* The kernel refuses more while completions it could not post
+		 * are waiting; take those off it, for handling later.
+		 */
+		if (uring_submit() != 0 && errno == EBUSY)
+		{
+			while (uring_next_cqe(&cqe))
+				(void) uring_defer(&cqe);
+
+			(void) uring_submit();
+		}
+
+		if (tail - __atomic_load_n(uring.sq_head, __ATOMIC_ACQUIRE) >= uring.sq_entries)
+			return NULL;
+	}
+
+	const unsigned int idx = tail & uring.sq_mask;
+	struct io_uring_sqe *const sqe = &uring.sqes[idx];
+
+	(void) memset(sqe, 0x00, sizeof *sqe);
+
+	uring.sq_array[idx] = idx;
+	return sqe;
+}
+
+static void
+uring_commit(struct io_uring_sqe ATHEME_VATTR_UNUSED *const restrict sqe)
+{
+	(void) __atomic_store_n(uring.sq_tail, *uring.sq_tail + 1U, __ATOMIC_RELEASE);
+
+	uring.unsubmitted++;
+
+	(void) uring_schedule();
+}
+
+static void
+uring_cancel(struct uring_op *const restrict op)
+{
+	struct io_uring_sqe *sqe;
+
+	if (! op->busy || ! (sqe = uring_get_sqe()))
+		return;
+
+	sqe->opcode = IORING_OP_ASYNC_CANCEL;
+	sqe->fd = -1;
+	sqe->addr = (uint64_t) (uintptr_t) op;
+	sqe->user_data = 0;
+
+	(void) uring_commit(sqe);
+}
+
+static void
+uring_connection_free(struct uring_connection *const restrict uc)
+{
+	(void) sendqrecvq_free_blocks(&uc->orphans);
+	(void) sfree(uc);
+}
+
+static void
+uring_dispatch(const struct io_uring_cqe *const restrict cqe)
+{
+	struct uring_op *const op = (struct uring_op *) (uintptr_t) cqe->user_data;
+
+	// Cancellations, which need no answer
+	if (! op)
+		return;
+
+	struct uring_connection *const uc = op->uc;
+
+	if (! (cqe->flags & IORING_CQE_F_MORE))
+		op->busy = false;
+
+	uc->depth++;
+
+	if (uc->cptr)
+		(void) op->done(op, cqe->res, cqe->flags);
+
+	uc->depth--;
+
+	if (! uc->cptr && ! uc->depth && ! uc->recv.busy && ! uc->send.busy && ! uc->accept.busy)
+		(void) uring_connection_free(uc);
+}
+
+static void
+uring_reap(void)
+{
+	struct io_uring_cqe cqe;
+
+	if (uring_deferred_count)
+	{
+		struct io_uring_cqe *const deferred = uring_deferred;
+		const size_t count = uring_deferred_count;
+
+		// What these lead to may defer more
+		uring_deferred = NULL;
+		uring_deferred_count = 0;
+		uring_deferred_alloc = 0;
+
+		for (size_t i = 0; i < count; i++)
+			(void) uring_dispatch(&deferred[i]);
+
+		(void) sfree(deferred);
+	}
+
+	while (uring_next_cqe(&cqe))
+		(void) uring_dispatch(&cqe);
+}
+
+/* Waits for one operation to finish, leaving the other completions that
+ * arrive in the meantime for later, so that nothing else runs in between.
+ */
+static bool
+uring_wait(struct uring_op *const restrict op)
+{
+	const uint64_t user_data = (uint64_t) (uintptr_t) op;
+	struct io_uring_cqe cqe;
+
+	// An earlier wait may have put it aside
+	for (size_t i = 0; i < uring_deferred_count; i++)
+	{
+		if (uring_deferred[i].user_data != user_data)
+			continue;
+
+		cqe = uring_deferred[i];
+
+		(void) memmove(&uring_deferred[i], &uring_deferred[i + 1],
+		               (uring_deferred_count - i - 1) * sizeof *uring_deferred);
+
+		uring_deferred_count--;
+
+		(void) uring_dispatch(&cqe);
+		break;
+	}
+
+	while (op->busy)
+	{
+		if (uring_submit() != 0 && errno != EBUSY)
+			return false;
+
+		if (uring_sys_enter(0, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR)
+			return false;
+
+		while (uring_next_cqe(&cqe))
+		{
+			if (cqe.user_data == user_data)
+				(void) uring_dispatch(&cqe);
+			else
+				(void) uring_defer(&cqe);
+		}
+	}
+
+	return true;
+}
+
+static void
+uring_recv_arm(struct uring_connection *const restrict uc)
+{
+	struct connection *const cptr = uc->cptr;
+	struct io_uring_sqe *sqe;
+	size_t len;
+
+	if (! cptr || ! uc->reading || uc->recv.busy)
+		return;
+
+	if (! (sqe = uring_get_sqe()))
+	{
+		(void) slog(LG_ERROR, "io_uring: submission queue full, dropping connection %s[%d]", cptr->name, cptr->fd);
+
+		cptr->flags |= CF_DEAD;
+		return;
+	}
+
+	char *const buf = recvq_buffer(cptr, &len);
+
+	sqe->opcode = IORING_OP_RECV;
+	sqe->fd = cptr->fd;
+	sqe->addr = (uint64_t) (uintptr_t) buf;
+	sqe->len = (unsigned int) len;
+	sqe->user_data = (uint64_t) (uintptr_t) &uc->recv;
+
+	uc->recv.busy = true;
+
+	(void) uring_commit(sqe);
+}
+
+static void
+uring_recv_done(struct uring_op *const restrict op, const int res, const unsigned int ATHEME_VATTR_UNUSED flags)
+{
+	struct uring_connection *const uc = op->uc;
+	struct connection *const cptr = uc->cptr;
+	struct timer_io_sample sample;
+
+	if (res == -ECANCELED && ! uc->reading)
+		return;
+
+	if (res == -EAGAIN || res == -EINTR)
+	{
+		(void) uring_recv_arm(uc);
+		return;
+	}
+
+	// As recvq_put() would have done on being called
+	if (cptr->flags & (CF_DEAD | CF_SEND_DEAD))
+	{
+		errno = 0;
+		(void) connection_close(cptr);
+		return;
+	}
+
+	if (res <= 0)
+	{
+		if (res == 0)
+			(void) slog(LG_DEBUG, "recvq_put(): fd %d closed the connection", cptr->fd);
+		else
+			(void) slog(LG_DEBUG, "recvq_put(): lost connection on fd %d", cptr->fd);
+
+		errno = -res;
+		(void) connection_close(cptr);
+		return;
+	}
+
+	(void) timer_io_begin(cptr, &sample);
+	(void) recvq_received(cptr, (size_t) res);
+	(void) timer_io_end(&sample, false);
+
+	// The handler may have closed the connection, or stopped reading it
+	if (uc->cptr && uc->cptr->read_handler == &recvq_put)
+		(void) uring_recv_arm(uc);
+	else
+		uc->reading = false;
+}
+
+static void
+uring_send_queue(struct uring_connection *const restrict uc)
+{
+	if (uc->queued)
+		return;
+
+	uc->queued = true;
+
+	(void) mowgli_node_add(uc, &uc->qnode, &uring_queue);
+	(void) uring_schedule();
+}
+
+static void
+uring_send_start(struct uring_connection *const restrict uc)
+{
+	struct connection *const cptr = uc->cptr;
+	struct io_uring_sqe *sqe;
+	size_t total;
+
+	if (! cptr || ! uc->writing || uc->send.busy)
+		return;
+
+	if (cptr->write_handler != &sendq_flush)
+	{
+		uc->writing = false;
+		return;
+	}
+
+	const int iovcnt = sendq_iov(cptr, uc->iov, URING_IOV_MAX, &total);
+
+	if (iovcnt == 0)
+	{
+		(void) sendq_drained(cptr);
+		(void) connection_setselect_write(cptr, NULL);
+		return;
+	}
+
+	if (! (sqe = uring_get_sqe()))
+	{
+		// Try again on the next pass through the event loop
+		(void) uring_send_queue(uc);
+		return;
+	}
+
+	sqe->opcode = IORING_OP_WRITEV;
+	sqe->fd = cptr->fd;
+	sqe->addr = (uint64_t) (uintptr_t) uc->iov;
+	sqe->len = (unsigned int) iovcnt;
+	sqe->user_data = (uint64_t) (uintptr_t) &uc->send;
+
+	uc->send.busy = true;
+
+	(void) uring_commit(sqe);
+}
+
+static void
+uring_send_done(struct uring_op *const restrict op, const int res, const unsigned int ATHEME_VATTR_UNUSED flags)
+{
+	struct uring_connection *const uc = op->uc;
+	struct connection *const cptr = uc->cptr;
+
+	if (res < 0 && res != -EAGAIN && res != -EINTR)
+	{
+		(void) slog(LG_DEBUG, "sendq_flush(): write error %d (%s) on connection %s[%d]", -res, strerror(-res),
+		                      cptr->name, cptr->fd);
+
+		cptr->flags |= CF_DEAD;
+		uc->writing = false;
+		return;
+	}
+
+	if (res > 0)
+		(void) sendq_written(cptr, (size_t) res);
+
+	// Not started from here, so that a synchronous sendq_flush() can finish the job itself
+	if (uc->writing)
+		(void) uring_send_queue(uc);
+}
+
+static void
+uring_accept_arm(struct uring_connection *const restrict uc)
+{
+	struct connection *const cptr = uc->cptr;
+	struct io_uring_sqe *sqe;
+
+	if (! cptr || ! uc->reading || uc->accept.busy || ! (sqe = uring_get_sqe()))
+		return;
+
+	sqe->opcode = IORING_OP_ACCEPT;
+	sqe->fd = cptr->fd;
+	sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+	sqe->user_data = (uint64_t) (uintptr_t) &uc->accept;
+
+#ifdef IORING_ACCEPT_MULTISHOT
+	if (uring_multishot_accept)
+		sqe->ioprio |= IORING_ACCEPT_MULTISHOT;
+#endif
+
+	uc->accept.busy = true;
+
+	(void) uring_commit(sqe);
+}
+
+static void
+uring_accept_done(struct uring_op *const restrict op, const int res, const unsigned int ATHEME_VATTR_UNUSED flags)
+{
+	struct uring_connection *const uc = op->uc;
+	struct connection *const cptr = uc->cptr;
+	struct timer_io_sample sample;
+
+	if (res == -ECANCELED && ! uc->reading)
+		return;
+
+	if (res < 0)
+	{
+		if (res == -EINVAL && uring_multishot_accept)
+			uring_multishot_accept = false;
+		else
+			(void) slog(LG_DEBUG, "connection_accept_tcp(): accept failed on %s[%d]: %s", cptr->name, cptr->fd,
+			                      strerror(-res));
+
+		(void) uring_accept_arm(uc);
+		return;
+	}
+
+	if (uc->naccepted == URING_ACCEPT_MAX)
+		(void) close(res);
+	else
+		uc->accepted[uc->naccepted++] = res;
+
+	(void) timer_io_begin(cptr, &sample);
+
+	while (uc->cptr && uc->naccepted && uc->cptr->read_handler)
+	{
+		const unsigned int before = uc->naccepted;
+
+		(void) uc->cptr->read_handler(uc->cptr);
+
+		// It did not take it
+		if (uc->naccepted == before)
+			break;
+	}
+
+	(void) timer_io_end(&sample, false);
+
+	if (! uc->cptr)
+		return;
+
+	while (uc->naccepted)
+		(void) close(uc->accepted[--uc->naccepted]);
+
+	(void) uring_accept_arm(uc);
+}
+
+static void
+uring_eventfd_cb(mowgli_eventloop_t ATHEME_VATTR_UNUSED *const restrict eventloop,
+                 mowgli_eventloop_io_t ATHEME_VATTR_UNUSED *const restrict io,
+                 const mowgli_eventloop_io_dir_t ATHEME_VATTR_UNUSED dir,
+                 void ATHEME_VATTR_UNUSED *const restrict userdata)
+{
+	uint64_t value;
+
+	while (read(uring_eventfd, &value, sizeof value) > 0)
+		continue;
+
+	(void) uring_run();
+}
+
+// Handles what has completed, starts the writes asked for since, and submits it all
+static void
+uring_run(void)
+{
+	mowgli_node_t *n, *tn;
+
+	if (! uring_ok)
+		return;
+
+	(void) uring_reap();
+
+	MOWGLI_ITER_FOREACH_SAFE(n, tn, uring_queue.head)
+	{
+		struct uring_connection *const uc = n->data;
+
+		(void) mowgli_node_delete(&uc->qnode, &uring_queue);
+
+		uc->queued = false;
+
+		(void) uring_send_start(uc);
+	}
+
+	if (uring_submit() != 0 && errno != EBUSY && errno != EAGAIN)
+		(void) slog(LG_ERROR, "io_uring: io_uring_enter: %s", strerror(errno));
+
+	// EBUSY and EAGAIN clear up as completions are reaped
+	if (uring.unsubmitted)
+		(void) uring_schedule();
+}
+
+static struct uring_connection *
+uring_connection_get(struct connection *const restrict cptr)
+{
+	if (cptr->uring)
+		return cptr->uring;
+
+	struct uring_connection *const uc = smalloc(sizeof *uc);
+
+	uc->cptr = cptr;
+	uc->recv.done = &uring_recv_done;
+	uc->recv.uc = uc;
+	uc->send.done = &uring_send_done;
+	uc->send.uc = uc;
+	uc->accept.done = &uring_accept_done;
+	uc->accept.uc = uc;
+
+	cptr->uring = uc;
+	return uc;
+}
+
+/*
+ * uring_connection_read(struct connection *cptr)
+ *
+ * Called by connection_setselect_read() once the read handler has been
+ * changed: takes reading over for recvq_put() and listeners.
+ *
+ * Outputs:
+ *      - true if the event loop should not watch the connection for reading
+ */
+bool
+uring_connection_read(struct connection *const restrict cptr)
+{
+	struct uring_connection *uc = cptr->uring;
+	const bool want = cptr->read_handler && cptr->fd > -1 &&
+	                  (cptr->read_handler == &recvq_put || CF_IS_LISTENING(cptr));
+
+	if (! want)
+	{
+		if (uc)
+		{
+			uc->reading = false;
+
+			(void) uring_cancel(&uc->recv);
+			(void) uring_cancel(&uc->accept);
+		}
+
+		return false;
+	}
+
+	if (! uc && ! uring_ready())
+		return false;
+
+	uc = uring_connection_get(cptr);
+	uc->reading = true;
+
+	if (CF_IS_LISTENING(cptr))
+		(void) uring_accept_arm(uc);
+	else
+		(void) uring_recv_arm(uc);
+
+	return true;
+}
+
+/*
+ * uring_connection_write(struct connection *cptr)
+ *
+ * Called by connection_setselect_write() once the write handler has been
+ * changed, for connections that read through the ring.
+ *
+ * Outputs:
+ *      - true if the event loop should not watch the connection for writing
+ */
+bool
+uring_connection_write(struct connection *const restrict cptr)
+{
+	struct uring_connection *const uc = cptr->uring;
+
+	if (cptr->write_handler != &sendq_flush)
+	{
+		uc->writing = false;
+		return false;
+	}
+
+	// Started later, so that whatever else is added to the sendq goes in the same writev
+	uc->writing = true;
+
+	(void) uring_send_queue(uc);
+	return true;
+}
+
+/*
+ * uring_connection_flush(struct connection *cptr)
+ *
+ * Called by sendq_flush() for connections that read through the ring: a
+ * writev already handed to the kernel is waited for, so that sendq_flush()
+ * can write the rest out itself.
+ *
+ * Outputs:
+ *      - true if the sendq must be left alone
+ */
+bool
+uring_connection_flush(struct connection *const restrict cptr)
+{
+	struct uring_connection *const uc = cptr->uring;
+
+	if (! uc->send.busy)
+		return false;
+
+	if (! uring_wait(&uc->send))
+	{
+		(void) slog(LG_ERROR, "io_uring: waiting for a write on %s[%d]: %s", cptr->name, cptr->fd, strerror(errno));
+
+		cptr->flags |= CF_DEAD;
+		return true;
+	}
+
+	return false;
+}
+
+// The next socket given to the listener by the ring, or -1
+int
+uring_connection_accepted(struct connection *const restrict cptr)
+{
+	struct uring_connection *const uc = cptr->uring;
+
+	if (! uc || ! uc->naccepted)
+		return -1;
+
+	const int fd = uc->accepted[0];
+
+	uc->naccepted--;
+
+	(void) memmove(&uc->accepted[0], &uc->accepted[1], uc->naccepted * sizeof uc->accepted[0]);
+	return fd;
+}
+
+/*
+ * uring_connection_close(struct connection *cptr)
+ *
+ * Called by connection_close() before the socket is closed. Operations
+ * still outstanding are cancelled, and the recvq and sendq are kept for
+ * them until they have finished.
+ */
+void
+uring_connection_close(struct connection *const restrict cptr)
+{
+	struct uring_connection *const uc = cptr->uring;
+
+	if (! uc)
+		return;
+
+	cptr->uring = NULL;
+	uc->cptr = NULL;
+	uc->reading = false;
+	uc->writing = false;
+
+	if (uc->queued)
+	{
+		(void) mowgli_node_delete(&uc->qnode, &uring_queue);
+		uc->queued = false;
+	}
+
+	while (uc->naccepted)
+		(void) close(uc->accepted[--uc->naccepted]);
+
+	// Freed by uring_dispatch() if one of its completions is being handled
+	if (! uc->recv.busy && ! uc->send.busy && ! uc->accept.busy)
+	{
+		if (! uc->depth)
+			(void) uring_connection_free(uc);
+
+		return;
+	}
+
+	(void) uring_cancel(&uc->recv);
+	(void) uring_cancel(&uc->send);
+	(void) uring_cancel(&uc->accept);
+
+	(void) sendqrecvq_release(cptr, &uc->orphans);
+
+	/* Anything still queued for this socket must reach the kernel before
+	 * the descriptor is closed and perhaps reused.
+	 */
+	(void) uring_submit();
+}
+
+#else /* ATHEME_IO_URING */
+
+bool
+uring_connection_read(struct connection ATHEME_VATTR_UNUSED *const restrict cptr)
+{
+	if (config_options.io_uring)
+	{
+		static bool warned = false;
+
+		if (! warned)
+			(void) slog(LG_INFO, "io_uring: not supported on this system, using the event loop");
+
+		warned = true;
+	}
+
+	return false;
+}
+
+bool
+uring_connection_write(struct connection ATHEME_VATTR_UNUSED *const restrict cptr)
+{
+	return false;
+}
+
+bool
+uring_connection_flush(struct connection ATHEME_VATTR_UNUSED *const restrict cptr)
+{
+	return false;
+}
+
+int
+uring_connection_accepted(struct connection ATHEME_VATTR_UNUSED *const restrict cptr)
+{
+	return -1;
+}
+
+void
+uring_connection_close(struct connection ATHEME_VATTR_UNUSED *const restrict cptr)
+{
+	return;
+}
+
+#endif /* !ATHEME_IO_URING */
@@ -16,11 +16,16 @@
 #include <atheme.h>
 #include "internal.h"
 
-static mowgli_heap_t *user_heap = NULL;
+static struct named_heap *user_heap = NULL;
+static struct named_heap *user_cold_heap = NULL;
 
 mowgli_patricia_t *userlist;
 mowgli_patricia_t *uidlist;
 
+// Point lookups go through these; the trees above are kept for iteration
+static struct namehash *userhash = NULL;
+static struct namehash *uidhash = NULL;
+
 static void
 user_delete_cb(void *const restrict user)
 {
@@ -44,9 +49,10 @@ user_delete_cb(void *const restrict user)
 void
 init_users(void)
 {
-	user_heap = sharedheap_get(sizeof(struct user));
+	user_heap = named_heap_get("user", sizeof(struct user));
+	user_cold_heap = named_heap_get("user_cold", sizeof(struct user_cold));
 
-	if (user_heap == NULL)
+	if (user_heap == NULL || user_cold_heap == NULL)
 	{
 		slog(LG_DEBUG, "init_users(): block allocator failure.");
 		exit(EXIT_FAILURE);
@@ -54,6 +60,66 @@ init_users(void)
 
 	userlist = mowgli_patricia_create(irccasecanon);
 	uidlist = mowgli_patricia_create(noopcanon);
+
+	userhash = namehash_create(true);
+	uidhash = namehash_create(false);
+}
+
+/* Takes over a user left over from before an uplink reconnect if the new
+ * burst introduces the same client again; otherwise it must have quit or
+ * changed nick meanwhile, and is deleted. A user that is kept gets no
+ * user_add hook and no second handle_nickchange(); its umodes are cleared
+ * so that the modes in the burst apply afresh and are counted again.
+ */
+static bool
+user_reconcile(struct user *u, const char *nick, const char *user, const char *host, const char *vhost,
+		const char *uid, const char *gecos, struct server *server, time_t ts)
+{
+	unsigned int umodes = 0;
+	int iter;
+
+	if (u->ts != ts || irccasecmp(u->nick, nick) || (uid != NULL) != (u->uid != NULL) ||
+			(uid != NULL ? strcmp(u->uid, uid) : (irccasecmp(u->user, user) || irccasecmp(u->host, host))))
+	{
+		user_delete(u, "*.net *.split");
+		return false;
+	}
+
+	slog(LG_DEBUG, "user_add(): %s was on the network before the reconnect, keeping it", u->nick);
+
+	u->flags &= ~UF_STALE;
+	u->flags |= UF_RECONCILED;
+
+	if (is_ircop(u))
+		u->server->opers--;
+	if (u->flags & UF_INVIS)
+		u->server->invis--;
+
+	for (iter = 0; user_mode_list[iter].mode != '\0'; iter++)
+		umodes |= user_mode_list[iter].value;
+	u->flags &= ~umodes;
+
+	if (u->server != server)
+	{
+		u->server->users--;
+		mowgli_node_delete(&u->snode, &u->server->userlist);
+
+		u->server = server;
+
+		u->server->users++;
+		mowgli_node_add(u, &u->snode, &u->server->userlist);
+	}
+
+	if (gecos != NULL && strcmp(user_gecos(u), gecos))
+		user_set_gecos(u, gecos);
+
+	if (vhost != NULL && strcmp(u->vhost, vhost))
+	{
+		strshare_unref(u->vhost);
+		u->vhost = strshare_get(vhost);
+	}
+
+	return true;
 }
 
 /*
@@ -91,6 +157,16 @@ user_add(const char *nick, const char *user, const char *host,
 
 	slog(LG_DEBUG, "user_add(): %s (%s@%s) -> %s", nick, user, host, server->name);
 
+	ATHEME_TRACE3(user__add, nick, uid ? uid : "", server->name);
+
+	if (uid != NULL && (u2 = user_find(uid)) != NULL && (u2->flags & UF_STALE) &&
+			user_reconcile(u2, nick, user, host, vhost, uid, gecos, server, ts))
+		return u2;
+
+	if ((u2 = user_find_named(nick)) != NULL && (u2->flags & UF_STALE) &&
+			user_reconcile(u2, nick, user, host, vhost, uid, gecos, server, ts))
+		return u2;
+
 	u2 = user_find_named(nick);
 	if (u2 != NULL)
 	{
@@ -151,32 +227,41 @@ user_add(const char *nick, const char *user, const char *host,
 		}
 	}
 
-	u = mowgli_heap_alloc(user_heap);
+	u = named_heap_alloc(user_heap);
+	u->cold = named_heap_alloc(user_cold_heap);
 	atheme_object_init(atheme_object(u), nick, &user_delete_cb);
 
 	if (uid != NULL)
 	{
 		u->uid = strshare_get(uid);
 		mowgli_patricia_add(uidlist, u->uid, u);
+		namehash_add(uidhash, u->uid, u);
 	}
 
 	u->nick = strshare_get(nick);
 	u->user = strshare_get(user);
 	u->host = strshare_get(host);
-	u->gecos = strshare_get(gecos);
-	u->chost = strshare_get(vhost ? vhost : host);
+	u->cold->gecos = strshare_get(gecos);
+	u->cold->chost = strshare_get(vhost ? vhost : host);
 	u->vhost = strshare_get(vhost ? vhost : host);
 
 	if (ip && strcmp(ip, "0") && strcmp(ip, "0.0.0.0") && strcmp(ip, "255.255.255.255"))
+	{
 		u->ip = strshare_get(ip);
+		(void) cidr_parse_address(u->ip, &u->ipaddr);
+	}
 
 	u->server = server;
 	u->server->users++;
 	mowgli_node_add(u, &u->snode, &u->server->userlist);
 
+	if (u->uid != NULL)
+		server_p10_client_add(u);
+
 	u->ts = ts ? ts : CURRTIME;
 
 	mowgli_patricia_add(userlist, u->nick, u);
+	namehash_add(userhash, u->nick, u);
 
 	cnt.user++;
 
@@ -187,6 +272,70 @@ user_add(const char *nick, const char *user, const char *host,
 	return hdata.u;
 }
 
+/*
+ * user_mark_stale()
+ *
+ * Marks every user not on services as left over from a lost uplink
+ * connection.
+ *
+ * Inputs:
+ *     - nothing
+ *
+ * Outputs:
+ *     - nothing
+ *
+ * Side Effects:
+ *     - users introduced again by the next burst (same UID, or without
+ *       UIDs the same user@host, and the same nick and TS) are kept with
+ *       their logins, the others are deleted by user_purge_stale()
+ */
+void
+user_mark_stale(void)
+{
+	struct user *u;
+	mowgli_patricia_iteration_state_t state;
+
+	MOWGLI_PATRICIA_FOREACH(u, &state, userlist)
+	{
+		if (u->server != me.me)
+			u->flags |= UF_STALE;
+	}
+}
+
+/*
+ * user_purge_stale()
+ *
+ * Deletes the users marked by user_mark_stale() that the new burst did not
+ * introduce again.
+ *
+ * Inputs:
+ *     - nothing
+ *
+ * Outputs:
+ *     - the number of users deleted
+ *
+ * Side Effects:
+ *     - as user_delete()
+ */
+unsigned int
+user_purge_stale(void)
+{
+	struct user *u;
+	mowgli_patricia_iteration_state_t state;
+	unsigned int count = 0;
+
+	MOWGLI_PATRICIA_FOREACH(u, &state, userlist)
+	{
+		if (!(u->flags & UF_STALE))
+			continue;
+
+		user_delete(u, "*.net *.split");
+		count++;
+	}
+
+	return count;
+}
+
 /*
  * user_delete(struct user *u, const char *comment)
  *
@@ -225,60 +374,69 @@ user_delete(struct user *u, const char *comment)
 
 	slog(LG_DEBUG, "user_delete(): removing user: %s -> %s (%s)", u->nick, u->server->name, comment);
 
+	ATHEME_TRACE2(user__delete, u->nick, u->uid);
+
 	hook_call_user_delete_info((&(struct hook_user_delete_info){.u = u, .comment = comment}));
 	hook_call_user_delete(u);
 
+	burst_forget_user(u);
+	command_queue_forget_user(u);
+
 	u->server->users--;
 	if (is_ircop(u))
 		u->server->opers--;
 	if (u->flags & UF_INVIS)
 		u->server->invis--;
 
-	sfree(u->certfp);
+	sfree(u->cold->certfp);
 
 	/* remove the user from each channel */
 	MOWGLI_ITER_FOREACH_SAFE(n, tn, u->channels.head)
 	{
 		cu = (struct chanuser *)n->data;
 
-		chanuser_delete(cu->chan, u);
+		chanuser_delete_member(cu);
 	}
 
+	if (u->flags & UF_SERVICE)
+		(void) service_target_remove(u);
+
 	mowgli_patricia_delete(userlist, u->nick);
+	namehash_delete(userhash, u->nick, u);
 
 	if (u->uid != NULL)
+	{
 		mowgli_patricia_delete(uidlist, u->uid);
+		namehash_delete(uidhash, u->uid, u);
+		server_p10_client_delete(u);
+	}
 
 	mowgli_node_delete(&u->snode, &u->server->userlist);
 
 	if (u->myuser)
 	{
-		MOWGLI_ITER_FOREACH_SAFE(n, tn, u->myuser->logins.head)
-		{
-			if (n->data == u)
-			{
-				mowgli_node_delete(n, &u->myuser->logins);
-				mowgli_node_free(n);
-				break;
-			}
-		}
+		mowgli_node_delete(&u->mlnode, &u->myuser->logins);
 		u->myuser->lastlogin = CURRTIME;
 		if ((mn = mynick_find(u->nick)) != NULL &&
 				mn->owner == u->myuser)
 			mn->lastseen = CURRTIME;
+		hook_call_user_logout(u);
 		u->myuser = NULL;
 	}
 
+	chanacs_user_forget(u);
+
 	strshare_unref(u->uid);
 	strshare_unref(u->nick);
 	strshare_unref(u->user);
 	strshare_unref(u->host);
-	strshare_unref(u->gecos);
+	strshare_unref(u->cold->gecos);
 	strshare_unref(u->vhost);
-	strshare_unref(u->chost);
+	strshare_unref(u->cold->chost);
 	strshare_unref(u->ip);
 
-	mowgli_heap_free(user_heap, u);
+	named_heap_free_deferred(user_cold_heap, u->cold);
+	named_heap_free_deferred(user_heap, u);
 
 	cnt.user--;
 
@@ -308,15 +466,18 @@ user_find(const char *nick)
 
 	return_val_if_fail(nick != NULL, NULL);
 
+	if (ircd->uses_p10 && (u = server_p10_client_find(nick)) != NULL)
+		return u;
+
 	if (ircd->uses_uid)
 	{
-		u = mowgli_patricia_retrieve(uidlist, nick);
+		u = namehash_find(uidhash, nick);
 
 		if (u != NULL)
 			return u;
 	}
 
-	u = mowgli_patricia_retrieve(userlist, nick);
+	u = namehash_find(userhash, nick);
 
 	if (u != NULL)
 	{
@@ -346,7 +507,7 @@ user_find(const char *nick)
 struct user *
 user_find_named(const char *nick)
 {
-	return mowgli_patricia_retrieve(userlist, nick);
+	return namehash_find(userhash, nick);
 }
 
 /*
@@ -367,16 +528,31 @@ user_find_named(const char *nick)
 void
 user_changeuid(struct user *u, const char *uid)
 {
+	struct service *svs;
+
 	return_if_fail(u != NULL);
 
+	svs = (u->flags & UF_SERVICE) ? service_target_remove(u) : NULL;
+
 	if (u->uid != NULL)
+	{
 		mowgli_patricia_delete(uidlist, u->uid);
+		namehash_delete(uidhash, u->uid, u);
+		server_p10_client_delete(u);
+	}
 
 	strshare_unref(u->uid);
 	u->uid = strshare_get(uid);
 
 	if (u->uid != NULL)
+	{
 		mowgli_patricia_add(uidlist, u->uid, u);
+		namehash_add(uidhash, u->uid, u);
+		server_p10_client_add(u);
+	}
+
+	if (svs != NULL)
+		service_target_add(svs);
 }
 
 /*
@@ -404,10 +580,13 @@ user_changenick(struct user *u, const char *nick, time_t ts)
 	char oldnick[NICKLEN + 1];
 	bool doenforcer = false;
 	struct hook_user_nick hdata;
+	struct service *svs;
 
 	return_val_if_fail(u != NULL, false);
 	return_val_if_fail(nick != NULL, false);
 
+	u->flags &= ~UF_RECONCILED;
+
 	mowgli_strlcpy(oldnick, u->nick, sizeof oldnick);
 	u2 = user_find_named(nick);
 	if (u->flags & UF_DOENFORCE && u2 != u)
@@ -438,7 +617,7 @@ user_changenick(struct user *u, const char *nick, time_t ts)
 				user_delete(u, "Nick change collision with services");
 				return true;
 			}
-			if (ts == u2->ts || ((ts < u2->ts) ^ (!irccasecmp(u->user, u2->user) && !irccasecmp(u->host, u2->host))))
+			if (ts == u2->ts || ((ts < u2->ts) ^ ((u->user == u2->user || !irccasecmp(u->user, u2->user)) && (u->host == u2->host || !irccasecmp(u->host, u2->host)))))
 			{
 				/* If the TSes are equal, or if their TS
 				 * is less than our TS and the u@h differs,
@@ -493,7 +672,10 @@ user_changenick(struct user *u, const char *nick, time_t ts)
 	if (u->myuser != NULL && (mn = mynick_find(u->nick)) != NULL &&
 			mn->owner == u->myuser)
 		mn->lastseen = CURRTIME;
+	svs = (u->flags & UF_SERVICE) ? service_target_remove(u) : NULL;
+
 	mowgli_patricia_delete(userlist, u->nick);
+	namehash_delete(userhash, u->nick, u);
 
 	strshare_unref(u->nick);
 	u->nick = strshare_get(nick);
@@ -501,6 +683,10 @@ user_changenick(struct user *u, const char *nick, time_t ts)
 	u->ts = ts;
 
 	mowgli_patricia_add(userlist, u->nick, u);
+	namehash_add(userhash, u->nick, u);
+
+	if (svs != NULL)
+		service_target_add(svs);
 
 	if (doenforcer)
 		introduce_enforcer(oldnick);
@@ -620,13 +806,39 @@ user_sethost(struct user *source, struct user *target, stringref host)
 		return;
 	}
 
-	strshare_unref(target->vhost);
+	// host may be target's own vhost, so take the new reference first
+	const stringref oldhost = target->vhost;
+
 	target->vhost = strshare_get(host);
+	strshare_unref(oldhost);
 
 	sethost_sts(source, target, target->vhost);
 	hook_call_user_sethost(target);
 }
 
+// Record a user's realname or cloaked host as the ircd reports it; nothing is sent
+void
+user_set_gecos(struct user *const restrict u, const char *const restrict gecos)
+{
+	return_if_fail(u != NULL);
+
+	const stringref old = u->cold->gecos;
+
+	u->cold->gecos = strshare_get(gecos);
+	strshare_unref(old);
+}
+
+void
+user_set_chost(struct user *const restrict u, const char *const restrict chost)
+{
+	return_if_fail(u != NULL);
+
+	const stringref old = u->cold->chost;
+
+	u->cold->chost = strshare_get(chost);
+	strshare_unref(old);
+}
+
 const char *
 user_get_umodestr(struct user *u)
 {
@@ -0,0 +1,471 @@
+/*
+ * SPDX-License-Identifier: ISC
+ * SPDX-URL: https://spdx.org/licenses/ISC.html
+ *
+ * Copyright (C) 2026 Atheme Development Group (https://atheme.github.io/)
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * atheme-services: A collection of minimalist IRC services
+ * userscan.c: Scanning the user list off the main thread.
+ *
+ * A scan copies the fields of every user into a snapshot, and then has
+ * worker threads run the match function over it a chunk at a time. The main
+ * thread hands the results to the caller in user list order as chunks are
+ * finished, but only so many per event loop iteration, so that a scan of a
+ * large network never holds up everything else for long.
+ *
+ * Without POSIX threads (or if the workers can't be started), the main
+ * thread matches the chunks itself, still a slice at a time.
+ */
+
+#include <atheme.h>
+#include "internal.h"
+
+#ifdef HAVE_USABLE_PTHREAD
+#  include <pthread.h>
+#endif
+
+#define USER_SCAN_CHUNK                 512U    // Users matched at a time
+#define USER_SCAN_THREADS_MAX           4U
+#define USER_SCAN_SLICE_USERS           8192U   // Users the main thread goes through per iteration
+#define USER_SCAN_SLICE_RESULTS         256U    // ... and results it delivers
+
+enum user_scan_progress
+{
+	USER_SCAN_DONE      = 0,    // Every result has been delivered
+	USER_SCAN_WAITING   = 1,    // Waiting for a worker to finish the next chunk
+	USER_SCAN_MORE      = 2,    // Ran out of time in this slice
+};
+
+struct user_scan
+{
+	mowgli_node_t           node;
+	struct user_snapshot    snap;
+	user_scan_match_fn      match_fn;
+	user_scan_result_fn     result_fn;
+	user_scan_done_fn       done_fn;
+	void *                  priv;
+	unsigned char *         matched;        // Per user
+	unsigned char *         chunk_done;     // Per chunk; matched is final for it
+	size_t                  nchunks;
+	size_t                  next_chunk;     // The next one for a worker to take
+	size_t                  delivered;      // Users the main thread has gone past
+	unsigned long long      match_us;
+	bool                    cancelled;
+#ifdef HAVE_USABLE_PTHREAD
+	pthread_t               threads[USER_SCAN_THREADS_MAX];
+	unsigned int            nthreads;
+#endif
+};
+
+static mowgli_list_t user_scans = { NULL, NULL, 0 };
+
+static int user_scan_pipe[2] = { -1, -1 };
+static mowgli_eventloop_pollable_t *user_scan_pollable = NULL;
+
+#ifdef HAVE_USABLE_PTHREAD
+// Protects next_chunk, chunk_done, match_us and cancelled of every scan
+static pthread_mutex_t user_scan_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+static void
+user_snapshot_build(struct user_snapshot *const restrict snap)
+{
+	static const size_t fields = USF_COUNT;
+
+	mowgli_patricia_iteration_state_t state;
+	struct user *u;
+	size_t len = 0;
+	size_t i = 0;
+
+	snap->count = mowgli_patricia_size(userlist);
+
+	MOWGLI_PATRICIA_FOREACH(u, &state, userlist)
+	{
+		len += strlen(u->nick) + strlen(u->user) + strlen(u->host) + strlen(user_gecos(u)) + fields;
+
+		if (u->ip)
+			len += strlen(u->ip);
+	}
+
+	snap->strings = smalloc(len ? len : 1);
+
+	for (size_t f = 0; f < fields; f++)
+		snap->offsets[f] = smalloc((snap->count ? snap->count : 1) * sizeof *snap->offsets[f]);
+
+	len = 0;
+
+	MOWGLI_PATRICIA_FOREACH(u, &state, userlist)
+	{
+		const char *values[USF_COUNT];
+
+		values[USF_NICK] = u->nick;
+		values[USF_USER] = u->user;
+		values[USF_HOST] = u->host;
+		values[USF_IP] = u->ip ? u->ip : "";
+		values[USF_GECOS] = user_gecos(u);
+
+		for (size_t f = 0; f < fields; f++)
+		{
+			const size_t flen = strlen(values[f]) + 1;
+
+			snap->offsets[f][i] = len;
+			(void) memcpy(snap->strings + len, values[f], flen);
+			len += flen;
+		}
+
+		i++;
+	}
+}
+
+static void
+user_snapshot_free(struct user_snapshot *const restrict snap)
+{
+	for (size_t f = 0; f < USF_COUNT; f++)
+		(void) sfree(snap->offsets[f]);
+
+	(void) sfree(snap->strings);
+}
+
+// Matches one chunk; returns how long that took, in microseconds
+static unsigned long long
+user_scan_run_chunk(struct user_scan *const restrict scan, const size_t chunk)
+{
+	struct timeval started, elapsed;
+	const size_t first = chunk * USER_SCAN_CHUNK;
+	size_t last = first + USER_SCAN_CHUNK;
+
+	if (last > scan->snap.count)
+		last = scan->snap.count;
+
+	(void) s_time(&started);
+
+	for (size_t i = first; i < last; i++)
+		scan->matched[i] = scan->match_fn(&scan->snap, i, scan->priv) ? 1 : 0;
+
+	(void) e_time(started, &elapsed);
+
+	return ((unsigned long long) elapsed.tv_sec * 1000000ULL) + (unsigned long long) elapsed.tv_usec;
+}
+
+static void
+user_scan_wake(void)
+{
+	const ssize_t ret = write(user_scan_pipe[1], "", 1);
+
+	(void) ret;
+}
+
+#ifdef HAVE_USABLE_PTHREAD
+
+static void *
+user_scan_worker(void *const restrict vscan)
+{
+	struct user_scan *const scan = vscan;
+
+	(void) pthread_mutex_lock(&user_scan_lock);
+
+	while (! scan->cancelled && scan->next_chunk < scan->nchunks)
+	{
+		const size_t chunk = scan->next_chunk++;
+
+		(void) pthread_mutex_unlock(&user_scan_lock);
+
+		const unsigned long long us = user_scan_run_chunk(scan, chunk);
+
+		(void) pthread_mutex_lock(&user_scan_lock);
+
+		scan->chunk_done[chunk] = 1;
+		scan->match_us += us;
+
+		(void) user_scan_wake();
+	}
+
+	(void) pthread_mutex_unlock(&user_scan_lock);
+	return NULL;
+}
+
+static void
+user_scan_threads_start(struct user_scan *const restrict scan)
+{
+	long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+	size_t want = (ncpus > 0) ? (size_t) ncpus : 1U;
+
+	if (want > USER_SCAN_THREADS_MAX)
+		want = USER_SCAN_THREADS_MAX;
+
+	if (want > scan->nchunks)
+		want = scan->nchunks;
+
+	// Signals must only ever be delivered to the main thread
+	sigset_t newset;
+	sigset_t oldset;
+
+	(void) sigfillset(&newset);
+	(void) pthread_sigmask(SIG_BLOCK, &newset, &oldset);
+
+	for (size_t i = 0; i < want; i++)
+	{
+		const int ret = pthread_create(&scan->threads[scan->nthreads], NULL, &user_scan_worker, scan);
+
+		if (ret != 0)
+		{
+			(void) slog(LG_ERROR, "%s: pthread_create(3): %s", MOWGLI_FUNC_NAME, strerror(ret));
+			break;
+		}
+
+		scan->nthreads++;
+	}
+
+	(void) pthread_sigmask(SIG_SETMASK, &oldset, NULL);
+}
+
+static void
+user_scan_threads_stop(struct user_scan *const restrict scan)
+{
+	for (unsigned int i = 0; i < scan->nthreads; i++)
+		(void) pthread_join(scan->threads[i], NULL);
+
+	scan->nthreads = 0;
+}
+
+#endif /* HAVE_USABLE_PTHREAD */
+
+static bool
+user_scan_chunk_ready(struct user_scan *const restrict scan, const size_t chunk)
+{
+#ifdef HAVE_USABLE_PTHREAD
+	if (scan->nthreads)
+	{
+		(void) pthread_mutex_lock(&user_scan_lock);
+
+		const bool ready = scan->chunk_done[chunk];
+
+		(void) pthread_mutex_unlock(&user_scan_lock);
+
+		return ready;
+	}
+#endif
+
+	// Nobody else is going to match it
+	if (! scan->chunk_done[chunk])
+	{
+		scan->match_us += user_scan_run_chunk(scan, chunk);
+		scan->chunk_done[chunk] = 1;
+	}
+
+	return true;
+}
+
+// Delivers as many results as one slice allows
+static enum user_scan_progress
+user_scan_step(struct user_scan *const restrict scan, const bool unlimited)
+{
+	size_t users = 0;
+	size_t results = 0;
+
+	while (scan->delivered < scan->snap.count)
+	{
+		if (! unlimited && (users >= USER_SCAN_SLICE_USERS || results >= USER_SCAN_SLICE_RESULTS))
+			return USER_SCAN_MORE;
+
+		const size_t chunk = scan->delivered / USER_SCAN_CHUNK;
+
+		if (! user_scan_chunk_ready(scan, chunk))
+			return USER_SCAN_WAITING;
+
+		size_t last = (chunk + 1U) * USER_SCAN_CHUNK;
+
+		if (last > scan->snap.count)
+			last = scan->snap.count;
+
+		for (/* No initialization */; scan->delivered < last; scan->delivered++, users++)
+		{
+			if (! unlimited && results >= USER_SCAN_SLICE_RESULTS)
+				break;
+
+			if (! scan->matched[scan->delivered])
+				continue;
+
+			results++;
+
+			if (scan->result_fn)
+				scan->result_fn(&scan->snap, scan->delivered, scan->priv);
+		}
+	}
+
+	return USER_SCAN_DONE;
+}
+
+static void
+user_scan_free(struct user_scan *const restrict scan)
+{
+#ifdef HAVE_USABLE_PTHREAD
+	(void) user_scan_threads_stop(scan);
+#endif
+
+	(void) user_snapshot_free(&scan->snap);
+	(void) sfree(scan->matched);
+	(void) sfree(scan->chunk_done);
+	(void) sfree(scan);
+}
+
+static void
+user_scan_finish(struct user_scan *const restrict scan)
+{
+#ifdef HAVE_USABLE_PTHREAD
+	(void) user_scan_threads_stop(scan);
+#endif
+
+	if (scan->done_fn)
+		scan->done_fn(&scan->snap, scan->match_us, scan->priv);
+
+	(void) user_scan_free(scan);
+}
+
+static void
+user_scan_pipe_cb(mowgli_eventloop_t ATHEME_VATTR_UNUSED *const restrict eventloop,
+                  mowgli_eventloop_io_t ATHEME_VATTR_UNUSED *const restrict io,
+                  const mowgli_eventloop_io_dir_t ATHEME_VATTR_UNUSED dir,
+                  void ATHEME_VATTR_UNUSED *const restrict userdata)
+{
+	mowgli_node_t *n, *tn;
+	bool more = false;
+	char buf[64];
+
+	while (read(user_scan_pipe[0], buf, sizeof buf) > 0)
+		continue;
+
+	(void) log_flush_deferred();
+
+	MOWGLI_ITER_FOREACH_SAFE(n, tn, user_scans.head)
+	{
+		struct user_scan *const scan = n->data;
+
+		switch (user_scan_step(scan, false))
+		{
+			case USER_SCAN_DONE:
+				(void) mowgli_node_delete(&scan->node, &user_scans);
+				(void) user_scan_finish(scan);
+				break;
+
+			case USER_SCAN_MORE:
+				more = true;
+				break;
+
+			case USER_SCAN_WAITING:
+				break;
+		}
+	}
+
+	// Come back after everything else waiting in the event loop has had a go
+	if (more)
+		(void) user_scan_wake();
+}
+
+static bool
+user_scan_pipe_open(void)
+{
+	if (user_scan_pipe[0] != -1)
+		return true;
+
+	if (pipe(user_scan_pipe) != 0)
+	{
+		(void) slog(LG_ERROR, "%s: pipe(2): %s", MOWGLI_FUNC_NAME, strerror(errno));
+		user_scan_pipe[0] = user_scan_pipe[1] = -1;
+		return false;
+	}
+
+	for (size_t i = 0; i < 2; i++)
+	{
+		const int flags = fcntl(user_scan_pipe[i], F_GETFL, 0);
+
+		if (flags == -1 || fcntl(user_scan_pipe[i], F_SETFL, flags | O_NONBLOCK) == -1)
+			(void) slog(LG_ERROR, "%s: fcntl(2): %s", MOWGLI_FUNC_NAME, strerror(errno));
+	}
+
+	user_scan_pollable = mowgli_pollable_create(base_eventloop, user_scan_pipe[0], NULL);
+
+	(void) mowgli_pollable_setselect(base_eventloop, user_scan_pollable, MOWGLI_EVENTLOOP_IO_READ,
+	                                 &user_scan_pipe_cb);
+	return true;
+}
+
+/*
+ * user_scan_start()
+ *
+ * inputs:
+ *       match function, result function and done function (either of the
+ *       latter may be NULL), their argument, and whether the scan may run in
+ *       the background
+ *
+ * outputs:
+ *       the scan, for user_scan_cancel(); or NULL if it has already finished
+ *
+ * side effects:
+ *       the user list is copied, and the callbacks are called as described
+ *       in atheme/userscan.h. Without background (e.g. because the results
+ *       have to be in the reply to an RPC call), or if the main loop can't
+ *       be woken up, everything happens before this returns.
+ */
+struct user_scan *
+user_scan_start(const user_scan_match_fn match_fn, const user_scan_result_fn result_fn,
+                const user_scan_done_fn done_fn, void *const priv, const bool background)
+{
+	return_val_if_fail(match_fn != NULL, NULL);
+
+	struct user_scan *const scan = smalloc(sizeof *scan);
+
+	scan->match_fn = match_fn;
+	scan->result_fn = result_fn;
+	scan->done_fn = done_fn;
+	scan->priv = priv;
+
+	(void) user_snapshot_build(&scan->snap);
+
+	scan->nchunks = (scan->snap.count + USER_SCAN_CHUNK - 1U) / USER_SCAN_CHUNK;
+	scan->matched = smalloc(scan->snap.count ? scan->snap.count : 1);
+	scan->chunk_done = smalloc(scan->nchunks ? scan->nchunks : 1);
+
+	if (! background || ! user_scan_pipe_open())
+	{
+		(void) user_scan_step(scan, true);
+		(void) user_scan_finish(scan);
+		return NULL;
+	}
+
+	(void) mowgli_node_add(scan, &scan->node, &user_scans);
+
+#ifdef HAVE_USABLE_PTHREAD
+	(void) user_scan_threads_start(scan);
+#endif
+
+	// Get started on the next iteration (even before a worker has finished a chunk)
+	(void) user_scan_wake();
+
+	return scan;
+}
+
+/*
+ * user_scan_cancel()
+ *
+ * Stops a scan started with user_scan_start(); none of its callbacks are
+ * called any more. Must not be called from them.
+ */
+void
+user_scan_cancel(struct user_scan *const restrict scan)
+{
+	return_if_fail(scan != NULL);
+
+#ifdef HAVE_USABLE_PTHREAD
+	(void) pthread_mutex_lock(&user_scan_lock);
+	scan->cancelled = true;
+	(void) pthread_mutex_unlock(&user_scan_lock);
+#endif
+
+	(void) mowgli_node_delete(&scan->node, &user_scans);
+	(void) user_scan_free(scan);
+}
@@ -0,0 +1,714 @@
+/*
+ * SPDX-License-Identifier: ISC
+ * SPDX-URL: https://spdx.org/licenses/ISC.html
+ *
+ * Copyright (C) 2026 Atheme Development Group (https://atheme.github.io/)
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * atheme-services: A collection of minimalist IRC services
+ * warmimage.c: Warm restart images of the account and channel registry.
+ *
+ * With general::db_warm_image on, services write the accounts, their nicks,
+ * the registered channels, their access lists and the metadata of all of
+ * these to services.db.warm when shutting down (or restarting), right after
+ * the final database save. The image is a header followed by arrays of
+ * fixed-size records and a string table. Nothing in it is a pointer:
+ * strings are offsets into the string table, and records refer to each
+ * other by their index in the other array. The next process maps the file
+ * and creates the objects in one pass, with no parsing and no name lookups,
+ * before reading the database for everything else; the backend skips the
+ * rows the image covered.
+ *
+ * An image is only used with the database it was written alongside (the
+ * header has the database's size, modification time and inode) and by a
+ * build of the same ABI revision; it is removed as soon as it has been
+ * opened, so it is never used twice.
+ *
+ * Access entries for entities other than accounts (groups, chiefly) are left
+ * to the database, as those entities only exist once it has been read.
+ */
+
+#include <atheme.h>
+#include "internal.h"
+
+#define WARM_IMAGE_MAGIC                "ATHWARM\n"
+#define WARM_IMAGE_SUFFIX               ".warm"
+#define WARM_IMAGE_ALIGN                8U
+
+#define WARM_IMAGE_NICKOWNERSHIP        0x01U   // written with nick ownership in effect
+
+enum warm_image_section_id
+{
+	WIS_MYUSER      = 0,
+	WIS_MYNICK      = 1,
+	WIS_MYCHAN      = 2,
+	WIS_CHANACS     = 3,
+	WIS_METADATA    = 4,
+	WIS_STRINGS     = 5,
+	WIS_COUNT       = 6,
+};
+
+struct warm_image_section
+{
+	uint64_t                        offset;         // from the start of the file
+	uint64_t                        count;
+	uint64_t                        size;           // of one record
+};
+
+struct warm_image_header
+{
+	char                            magic[8];
+	uint32_t                        abirev;
+	uint32_t                        flags;          // WARM_IMAGE_*
+	uint64_t                        db_size;
+	int64_t                         db_mtime;
+	uint64_t                        db_ino;
+	struct warm_image_section       sections[WIS_COUNT];
+};
+
+// Strings are offsets into the string table, which starts with an empty string
+struct warm_image_myuser
+{
+	uint64_t                        id;
+	uint64_t                        name;
+	uint64_t                        pass;
+	uint64_t                        email;
+	uint64_t                        language;
+	int64_t                         registered;
+	int64_t                         lastlogin;
+	uint64_t                        metadata;       // index of the first of its entries
+	uint32_t                        nmetadata;
+	uint32_t                        flags;
+};
+
+struct warm_image_mynick
+{
+	uint64_t                        nick;
+	uint64_t                        owner;          // index into the accounts
+	int64_t                         registered;
+	int64_t                         lastseen;
+};
+
+struct warm_image_mychan
+{
+	uint64_t                        name;
+	uint64_t                        mlock_key;
+	int64_t                         registered;
+	int64_t                         used;
+	uint64_t                        metadata;
+	uint32_t                        nmetadata;
+	uint32_t                        flags;
+	uint32_t                        mlock_on;
+	uint32_t                        mlock_off;
+	uint32_t                        mlock_limit;
+	uint32_t                        unused;
+};
+
+struct warm_image_chanacs
+{
+	uint64_t                        mychan;         // index into the channels
+	uint64_t                        myuser;         // index into the accounts + 1, or 0 for a host mask
+	uint64_t                        host;
+	uint64_t                        setter_uid;
+	int64_t                         tmodified;
+	uint64_t                        metadata;
+	uint32_t                        nmetadata;
+	uint32_t                        level;
+};
+
+struct warm_image_metadata
+{
+	uint64_t                        name;
+	uint64_t                        value;
+};
+
+struct warm_image_buf
+{
+	unsigned char *                 data;
+	size_t                          len;
+	size_t                          alloc;
+};
+
+struct warm_image_writer
+{
+	struct warm_image_buf           sections[WIS_COUNT];
+	mowgli_patricia_t *             myusers;        // entity ID -> index + 1
+};
+
+bool warm_image_checked = false;
+
+static const size_t warm_image_record_sizes[WIS_COUNT] = {
+	[WIS_MYUSER]    = sizeof(struct warm_image_myuser),
+	[WIS_MYNICK]    = sizeof(struct warm_image_mynick),
+	[WIS_MYCHAN]    = sizeof(struct warm_image_mychan),
+	[WIS_CHANACS]   = sizeof(struct warm_image_chanacs),
+	[WIS_METADATA]  = sizeof(struct warm_image_metadata),
+	[WIS_STRINGS]   = 1U,
+};
+
+static void
+warm_image_put(struct warm_image_buf *const restrict buf, const void *const restrict data, const size_t len)
+{
+	if (buf->len + len > buf->alloc)
+	{
+		size_t alloc = buf->alloc ? buf->alloc : 4096U;
+
+		while (alloc < buf->len + len)
+			alloc *= 2U;
+
+		buf->data = srealloc(buf->data, alloc);
+		buf->alloc = alloc;
+	}
+
+	(void) memcpy(buf->data + buf->len, data, len);
+	buf->len += len;
+}
+
+static uint64_t
+warm_image_put_str(struct warm_image_writer *const restrict w, const char *const restrict str)
+{
+	if (str == NULL || *str == '\0')
+		return 0;
+
+	const uint64_t offset = w->sections[WIS_STRINGS].len;
+
+	(void) warm_image_put(&w->sections[WIS_STRINGS], str, strlen(str) + 1U);
+
+	return offset;
+}
+
+static void
+warm_image_put_metadata(struct warm_image_writer *const restrict w, void *const restrict target,
+                        uint64_t *const restrict first, uint32_t *const restrict count)
+{
+	struct metadata_iteration_state state;
+	struct metadata *md;
+
+	*first = w->sections[WIS_METADATA].len / sizeof(struct warm_image_metadata);
+	*count = 0;
+
+	if (! atheme_object(target)->metadata)
+		return;
+
+	METADATA_FOREACH(md, &state, target)
+	{
+		const struct warm_image_metadata rec = {
+			.name   = warm_image_put_str(w, md->name),
+			.value  = warm_image_put_str(w, md->value),
+		};
+
+		(void) warm_image_put(&w->sections[WIS_METADATA], &rec, sizeof rec);
+		(*count)++;
+	}
+}
+
+static void
+warm_image_put_myusers(struct warm_image_writer *const restrict w)
+{
+	struct myentity_iteration_state state;
+	struct myentity *mt;
+	uint64_t index = 0;
+
+	MYENTITY_FOREACH_T(mt, &state, ENT_USER)
+	{
+		struct myuser *const mu = user(mt);
+		mowgli_node_t *n;
+
+		// As the database has it
+		const unsigned int flags = MOWGLI_LIST_LENGTH(&mu->logins) ? (mu->flags & ~MU_NOBURSTLOGIN) : mu->flags;
+
+		struct warm_image_myuser rec = {
+			.id             = warm_image_put_str(w, mt->id),
+			.name           = warm_image_put_str(w, mt->name),
+			.pass           = warm_image_put_str(w, mu->pass),
+			.email          = warm_image_put_str(w, mu->email),
+			.language       = warm_image_put_str(w, language_get_name(mu->language)),
+			.registered     = (int64_t) mu->registered,
+			.lastlogin      = (int64_t) mu->lastlogin,
+			.flags          = flags,
+		};
+
+		(void) warm_image_put_metadata(w, mu, &rec.metadata, &rec.nmetadata);
+		(void) warm_image_put(&w->sections[WIS_MYUSER], &rec, sizeof rec);
+
+		MOWGLI_ITER_FOREACH(n, mu->nicks.head)
+		{
+			const struct mynick *const mn = n->data;
+
+			const struct warm_image_mynick nrec = {
+				.nick           = warm_image_put_str(w, mn->nick),
+				.owner          = index,
+				.registered     = (int64_t) mn->registered,
+				.lastseen       = (int64_t) mn->lastseen,
+			};
+
+			(void) warm_image_put(&w->sections[WIS_MYNICK], &nrec, sizeof nrec);
+		}
+
+		(void) mowgli_patricia_add(w->myusers, mt->id, (void *) (uintptr_t) (++index));
+	}
+}
+
+static void
+warm_image_put_mychans(struct warm_image_writer *const restrict w)
+{
+	mowgli_patricia_iteration_state_t state;
+	struct mychan *mc;
+	uint64_t index = 0;
+
+	MOWGLI_PATRICIA_FOREACH(mc, &state, mclist)
+	{
+		mowgli_node_t *n;
+
+		struct warm_image_mychan rec = {
+			.name           = warm_image_put_str(w, mc->name),
+			.mlock_key      = warm_image_put_str(w, mc->mlock_key),
+			.registered     = (int64_t) mc->registered,
+			.used           = (int64_t) mc->used,
+			.flags          = mc->flags,
+			.mlock_on       = mc->mlock_on,
+			.mlock_off      = mc->mlock_off,
+			.mlock_limit    = mc->mlock_limit,
+		};
+
+		(void) warm_image_put_metadata(w, mc, &rec.metadata, &rec.nmetadata);
+		(void) warm_image_put(&w->sections[WIS_MYCHAN], &rec, sizeof rec);
+
+		MOWGLI_ITER_FOREACH(n, mc->chanacs.head)
+		{
+			struct chanacs *const ca = n->data;
+			uint64_t myuser = 0;
+
+			if (ca->entity != NULL)
+			{
+				if (! isuser(ca->entity))
+					continue;
+
+				const void *const idx = mowgli_patricia_retrieve(w->myusers, ca->entity->id);
+
+				myuser = (uint64_t) (uintptr_t) idx;
+
+				if (! myuser)
+					continue;
+			}
+
+			struct warm_image_chanacs carec = {
+				.mychan         = index,
+				.myuser         = myuser,
+				.host           = warm_image_put_str(w, ca->host),
+				.setter_uid     = warm_image_put_str(w, ca->setter_uid),
+				.tmodified      = (int64_t) ca->tmodified,
+				.level          = ca->level,
+			};
+
+			(void) warm_image_put_metadata(w, ca, &carec.metadata, &carec.nmetadata);
+			(void) warm_image_put(&w->sections[WIS_CHANACS], &carec, sizeof carec);
+		}
+
+		index++;
+	}
+}
+
+static bool
+warm_image_write_all(const int fd, const void *const restrict data, const size_t len)
+{
+	const unsigned char *p = data;
+	size_t left = len;
+
+	while (left)
+	{
+		const ssize_t ret = write(fd, p, left);
+
+		if (ret < 0 && errno == EINTR)
+			continue;
+
+		if (ret <= 0)
+			return false;
+
+		p += ret;
+		left -= (size_t) ret;
+	}
+
+	return true;
+}
+
+bool
+warm_image_write(const char *const restrict dbpath)
+{
+	static const unsigned char zeroes[WARM_IMAGE_ALIGN] = { 0 };
+
+	struct warm_image_writer w;
+	struct warm_image_header hdr;
+	struct timeval started, elapsed;
+	struct stat sb;
+	char path[BUFSIZE];
+	char newpath[BUFSIZE];
+	char dbnewpath[BUFSIZE];
+	bool ok = false;
+
+	return_val_if_fail(dbpath != NULL, false);
+
+	(void) snprintf(path, sizeof path, "%s%s", dbpath, WARM_IMAGE_SUFFIX);
+	(void) snprintf(newpath, sizeof newpath, "%s%s.new", dbpath, WARM_IMAGE_SUFFIX);
+	(void) snprintf(dbnewpath, sizeof dbnewpath, "%s.new", dbpath);
+
+	// A database left as .new was not renamed into place; what is there is older than us
+	if (stat(dbpath, &sb) != 0 || access(dbnewpath, F_OK) == 0)
+	{
+		(void) slog(LG_ERROR, "%s: the database was not saved; not writing %s", MOWGLI_FUNC_NAME, path);
+		(void) unlink(path);
+		return false;
+	}
+
+	s_time(&started);
+
+	(void) memset(&w, 0x00, sizeof w);
+	(void) memset(&hdr, 0x00, sizeof hdr);
+
+	w.myusers = mowgli_patricia_create(NULL);
+
+	// Offset 0 is the empty string
+	(void) warm_image_put(&w.sections[WIS_STRINGS], "", 1U);
+
+	(void) warm_image_put_myusers(&w);
+	(void) warm_image_put_mychans(&w);
+
+	(void) memcpy(hdr.magic, WARM_IMAGE_MAGIC, sizeof hdr.magic);
+	hdr.abirev = CURRENT_ABI_REVISION;
+	hdr.flags = nicksvs.no_nick_ownership ? 0 : WARM_IMAGE_NICKOWNERSHIP;
+	hdr.db_size = (uint64_t) sb.st_size;
+	hdr.db_mtime = (int64_t) sb.st_mtime;
+	hdr.db_ino = (uint64_t) sb.st_ino;
+
+	uint64_t offset = sizeof hdr;
+
+	for (unsigned int i = 0; i < WIS_COUNT; i++)
+	{
+		offset = (offset + WARM_IMAGE_ALIGN - 1U) & ~((uint64_t) WARM_IMAGE_ALIGN - 1U);
+
+		hdr.sections[i].offset = offset;
+		hdr.sections[i].size = warm_image_record_sizes[i];
+		hdr.sections[i].count = w.sections[i].len / warm_image_record_sizes[i];
+
+		offset += w.sections[i].len;
+	}
+
+	const int fd = open(newpath, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+
+	if (fd == -1)
+	{
+		(void) slog(LG_ERROR, "%s: open('%s'): %s", MOWGLI_FUNC_NAME, newpath, strerror(errno));
+		goto cleanup;
+	}
+
+	ok = warm_image_write_all(fd, &hdr, sizeof hdr);
+	offset = sizeof hdr;
+
+	for (unsigned int i = 0; ok && i < WIS_COUNT; i++)
+	{
+		if (offset < hdr.sections[i].offset)
+			ok = warm_image_write_all(fd, zeroes, (size_t) (hdr.sections[i].offset - offset));
+
+		if (ok && w.sections[i].len)
+			ok = warm_image_write_all(fd, w.sections[i].data, w.sections[i].len);
+
+		offset = hdr.sections[i].offset + w.sections[i].len;
+	}
+
+	if (ok && fsync(fd) != 0)
+		ok = false;
+
+	if (! ok)
+		(void) slog(LG_ERROR, "%s: write('%s'): %s", MOWGLI_FUNC_NAME, newpath, strerror(errno));
+
+	(void) close(fd);
+
+	if (ok && rename(newpath, path) != 0)
+	{
+		(void) slog(LG_ERROR, "%s: rename('%s', '%s'): %s", MOWGLI_FUNC_NAME, newpath, path, strerror(errno));
+		ok = false;
+	}
+
+	if (! ok)
+		(void) unlink(newpath);
+
+	e_time(started, &elapsed);
+
+	if (ok)
+		(void) slog(LG_INFO, "%s: wrote %llu accounts and %llu channels to %s (%llu bytes) in %d ms",
+		            MOWGLI_FUNC_NAME, (unsigned long long) hdr.sections[WIS_MYUSER].count,
+		            (unsigned long long) hdr.sections[WIS_MYCHAN].count, path, (unsigned long long) offset,
+		            tv2ms(&elapsed));
+
+cleanup:
+	for (unsigned int i = 0; i < WIS_COUNT; i++)
+		(void) sfree(w.sections[i].data);
+
+	(void) mowgli_patricia_destroy(w.myusers, NULL, NULL);
+
+	return ok;
+}
+
+// Why the image at map cannot be used with the database at dbpath, or NULL if it can
+static const char *
+warm_image_check(const unsigned char *const restrict map, const size_t len, const char *const restrict dbpath)
+{
+	struct warm_image_header hdr;
+	struct stat sb;
+
+	if (len < sizeof hdr)
+		return "it is truncated";
+
+	(void) memcpy(&hdr, map, sizeof hdr);
+
+	if (memcmp(hdr.magic, WARM_IMAGE_MAGIC, sizeof hdr.magic) != 0)
+		return "it is not a warm restart image";
+
+	if (hdr.abirev != CURRENT_ABI_REVISION)
+		return "it was written by a different version of services";
+
+	if (stat(dbpath, &sb) != 0 || hdr.db_size != (uint64_t) sb.st_size ||
+	    hdr.db_mtime != (int64_t) sb.st_mtime || hdr.db_ino != (uint64_t) sb.st_ino)
+		return "the database has changed since it was written";
+
+	for (unsigned int i = 0; i < WIS_COUNT; i++)
+	{
+		const struct warm_image_section *const s = &hdr.sections[i];
+
+		if (s->size != warm_image_record_sizes[i] || s->offset % WARM_IMAGE_ALIGN || s->offset > len ||
+		    s->count > (len - s->offset) / s->size)
+			return "it is truncated";
+	}
+
+	const uint64_t nstrings = hdr.sections[WIS_STRINGS].count;
+	const uint64_t nmyusers = hdr.sections[WIS_MYUSER].count;
+	const uint64_t nmychans = hdr.sections[WIS_MYCHAN].count;
+	const uint64_t nmetadata = hdr.sections[WIS_METADATA].count;
+
+	// Every string offset below nstrings then reads up to a terminator
+	if (! nstrings || map[hdr.sections[WIS_STRINGS].offset + nstrings - 1U] != '\0')
+		return "its strings are corrupt";
+
+#define WIS_RECORDS(type, id)   ((const struct warm_image_##type *) (map + hdr.sections[id].offset))
+#define WIS_STR_OK(off)         ((off) < nstrings)
+#define WIS_MD_OK(rec)          ((rec)->metadata <= nmetadata && (rec)->nmetadata <= nmetadata - (rec)->metadata)
+
+	const struct warm_image_myuser *const myusers = WIS_RECORDS(myuser, WIS_MYUSER);
+	const struct warm_image_mynick *const mynicks = WIS_RECORDS(mynick, WIS_MYNICK);
+	const struct warm_image_mychan *const mychans = WIS_RECORDS(mychan, WIS_MYCHAN);
+	const struct warm_image_chanacs *const chanacs = WIS_RECORDS(chanacs, WIS_CHANACS);
+	const struct warm_image_metadata *const metadata = WIS_RECORDS(metadata, WIS_METADATA);
+
+	for (uint64_t i = 0; i < nmyusers; i++)
+		if (! WIS_STR_OK(myusers[i].id) || ! WIS_STR_OK(myusers[i].name) || ! WIS_STR_OK(myusers[i].pass) ||
+		    ! WIS_STR_OK(myusers[i].email) || ! WIS_STR_OK(myusers[i].language) || ! WIS_MD_OK(&myusers[i]))
+			return "an account in it is corrupt";
+
+	for (uint64_t i = 0; i < hdr.sections[WIS_MYNICK].count; i++)
+		if (! WIS_STR_OK(mynicks[i].nick) || mynicks[i].owner >= nmyusers)
+			return "a nick in it is corrupt";
+
+	for (uint64_t i = 0; i < nmychans; i++)
+		if (! WIS_STR_OK(mychans[i].name) || ! WIS_STR_OK(mychans[i].mlock_key) || ! WIS_MD_OK(&mychans[i]))
+			return "a channel in it is corrupt";
+
+	for (uint64_t i = 0; i < hdr.sections[WIS_CHANACS].count; i++)
+		if (chanacs[i].mychan >= nmychans || chanacs[i].myuser > nmyusers || ! WIS_STR_OK(chanacs[i].host) ||
+		    ! WIS_STR_OK(chanacs[i].setter_uid) || ! WIS_MD_OK(&chanacs[i]) ||
+		    (! chanacs[i].myuser && ! chanacs[i].host))
+			return "a channel access entry in it is corrupt";
+
+	for (uint64_t i = 0; i < nmetadata; i++)
+		if (! WIS_STR_OK(metadata[i].name) || ! WIS_STR_OK(metadata[i].value))
+			return "its metadata is corrupt";
+
+#undef WIS_MD_OK
+#undef WIS_STR_OK
+#undef WIS_RECORDS
+
+	return NULL;
+}
+
+static void
+warm_image_add_metadata(void *const restrict target, const struct warm_image_metadata *const restrict md,
+                        const uint64_t first, const uint32_t count, const char *const restrict strings)
+{
+	for (uint32_t i = 0; i < count; i++)
+		(void) metadata_add(target, strings + md[first + i].name, strings + md[first + i].value);
+}
+
+// Only called on an image warm_image_check() has passed
+static void
+warm_image_build(const unsigned char *const restrict map)
+{
+	struct warm_image_header hdr;
+	char buf[BUFSIZE];
+
+	(void) memcpy(&hdr, map, sizeof hdr);
+
+	const char *const strings = (const char *) (map + hdr.sections[WIS_STRINGS].offset);
+	const struct warm_image_myuser *const myusers = (const void *) (map + hdr.sections[WIS_MYUSER].offset);
+	const struct warm_image_mynick *const mynicks = (const void *) (map + hdr.sections[WIS_MYNICK].offset);
+	const struct warm_image_mychan *const mychans = (const void *) (map + hdr.sections[WIS_MYCHAN].offset);
+	const struct warm_image_chanacs *const chanacs = (const void *) (map + hdr.sections[WIS_CHANACS].offset);
+	const struct warm_image_metadata *const metadata = (const void *) (map + hdr.sections[WIS_METADATA].offset);
+
+	const size_t nmyusers = (size_t) hdr.sections[WIS_MYUSER].count;
+	const size_t nmychans = (size_t) hdr.sections[WIS_MYCHAN].count;
+
+	struct myuser **const mus = smalloc((nmyusers ? nmyusers : 1U) * sizeof *mus);
+	struct mychan **const mcs = smalloc((nmychans ? nmychans : 1U) * sizeof *mcs);
+
+	for (size_t i = 0; i < nmyusers; i++)
+	{
+		const struct warm_image_myuser *const rec = &myusers[i];
+		const char *const id = strings + rec->id;
+
+		struct myuser *const mu = myuser_add_id(*id ? id : NULL, strings + rec->name, strings + rec->pass,
+		                                        strings + rec->email, rec->flags);
+
+		mu->registered = (time_t) rec->registered;
+		mu->lastlogin = (time_t) rec->lastlogin;
+
+		if (rec->language)
+			mu->language = language_add(strings + rec->language);
+
+		(void) warm_image_add_metadata(mu, metadata, rec->metadata, rec->nmetadata, strings);
+
+		mus[i] = mu;
+	}
+
+	for (uint64_t i = 0; i < hdr.sections[WIS_MYNICK].count; i++)
+	{
+		const struct warm_image_mynick *const rec = &mynicks[i];
+		struct mynick *const mn = mynick_add(mus[rec->owner], strings + rec->nick);
+
+		mn->registered = (time_t) rec->registered;
+		mn->lastseen = (time_t) rec->lastseen;
+	}
+
+	for (size_t i = 0; i < nmychans; i++)
+	{
+		const struct warm_image_mychan *const rec = &mychans[i];
+
+		(void) mowgli_strlcpy(buf, strings + rec->name, sizeof buf);
+
+		struct mychan *const mc = mychan_add(buf);
+
+		mc->registered = (time_t) rec->registered;
+		mc->used = (time_t) rec->used;
+		mc->flags = rec->flags;
+		mc->mlock_on = rec->mlock_on;
+		mc->mlock_off = rec->mlock_off;
+		mc->mlock_limit = rec->mlock_limit;
+
+		if (rec->mlock_key)
+			mc->mlock_key = sstrdup(strings + rec->mlock_key);
+
+		(void) warm_image_add_metadata(mc, metadata, rec->metadata, rec->nmetadata, strings);
+
+		mcs[i] = mc;
+	}
+
+	for (uint64_t i = 0; i < hdr.sections[WIS_CHANACS].count; i++)
+	{
+		const struct warm_image_chanacs *const rec = &chanacs[i];
+		struct chanacs *ca;
+
+		if (rec->myuser)
+			ca = chanacs_add(mcs[rec->mychan], entity(mus[rec->myuser - 1U]), rec->level,
+			                 (time_t) rec->tmodified, NULL);
+		else
+			ca = chanacs_add_host(mcs[rec->mychan], strings + rec->host, rec->level,
+			                      (time_t) rec->tmodified, NULL);
+
+		if (ca == NULL)
+			continue;
+
+		// The setter may be a group, which doesn't exist yet
+		(void) mowgli_strlcpy(ca->setter_uid, strings + rec->setter_uid, sizeof ca->setter_uid);
+
+		(void) warm_image_add_metadata(ca, metadata, rec->metadata, rec->nmetadata, strings);
+	}
+
+	(void) sfree(mus);
+	(void) sfree(mcs);
+
+	warm_image_checked = (hdr.flags & WARM_IMAGE_NICKOWNERSHIP) != 0;
+}
+
+bool
+warm_image_load(const char *const restrict dbpath)
+{
+	char path[BUFSIZE];
+
+	return_val_if_fail(dbpath != NULL, false);
+
+	(void) snprintf(path, sizeof path, "%s%s", dbpath, WARM_IMAGE_SUFFIX);
+
+#ifdef HAVE_SYS_MMAN_H
+	struct timeval started, elapsed;
+	struct stat sb;
+
+	const int fd = open(path, O_RDONLY);
+
+	if (fd == -1)
+	{
+		if (errno != ENOENT)
+			(void) slog(LG_ERROR, "%s: open('%s'): %s", MOWGLI_FUNC_NAME, path, strerror(errno));
+
+		return false;
+	}
+
+	// Whatever happens now, the image has had its chance
+	(void) unlink(path);
+
+	if (fstat(fd, &sb) != 0 || sb.st_size <= 0)
+	{
+		(void) close(fd);
+		return false;
+	}
+
+	const size_t len = (size_t) sb.st_size;
+	void *const map = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+
+	(void) close(fd);
+
+	if (map == MAP_FAILED)
+	{
+		(void) slog(LG_ERROR, "%s: mmap('%s'): %s", MOWGLI_FUNC_NAME, path, strerror(errno));
+		return false;
+	}
+
+	const char *const why = warm_image_check(map, len, dbpath);
+
+	if (why != NULL)
+	{
+		(void) slog(LG_INFO, "%s: not using %s, as %s; loading the database as usual", MOWGLI_FUNC_NAME, path, why);
+		(void) munmap(map, len);
+		return false;
+	}
+
+	s_time(&started);
+
+	(void) warm_image_build(map);
+	(void) munmap(map, len);
+
+	e_time(started, &elapsed);
+
+	(void) slog(LG_INFO, "%s: started from %s in %d ms", MOWGLI_FUNC_NAME, path, tv2ms(&elapsed));
+
+	return true;
+#else
+	if (access(path, F_OK) == 0)
+	{
+		(void) slog(LG_INFO, "%s: not using %s, as this system does not have mmap(2)", MOWGLI_FUNC_NAME, path);
+		(void) unlink(path);
+	}
+
+	return false;
+#endif
+}
@@ -0,0 +1,486 @@
+/*
+ * SPDX-License-Identifier: ISC
+ * SPDX-URL: https://spdx.org/licenses/ISC.html
+ *
+ * Copyright (C) 2026 Atheme Development Group (https://atheme.github.io/)
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * atheme-services: A collection of minimalist IRC services
+ * worldsnap.c: Read-only queries over a snapshot, off the main thread.
+ *
+ * A snapshot copies what read-only queries need to know about every account,
+ * channel and channel access entry. It is taken on the main thread when a
+ * query needs one and the last is too old, and, once published, never
+ * changes; every query holds a reference to the version it started with.
+ *
+ * Queries run on a small pool of threads and are handed back to the main
+ * thread, through a pipe, to deliver their results. Without POSIX threads
+ * (or if none can be started), a query runs before world_query_start()
+ * returns.
+ */
+
+#include <atheme.h>
+#include "internal.h"
+
+#ifdef HAVE_USABLE_PTHREAD
+#  include <pthread.h>
+#endif
+
+#define WORLD_SNAPSHOT_MAX_AGE          10      // Seconds a snapshot is used for before taking another
+#define WORLD_QUERY_THREADS             2U
+
+enum world_query_state
+{
+	WORLD_QUERY_QUEUED      = 0,
+	WORLD_QUERY_RUNNING     = 1,
+	WORLD_QUERY_FINISHED    = 2,    // Waiting for the main thread
+};
+
+struct world_query
+{
+	mowgli_node_t           node;           // In world_query_queue or world_query_finished
+	struct world_snapshot * snap;
+	world_query_fn          query_fn;
+	world_query_done_fn     done_fn;
+	void *                  priv;
+	enum world_query_state  state;
+	bool                    cancelled;
+};
+
+static struct world_snapshot *world_snapshot_current = NULL;
+static unsigned int world_snapshot_version = 0;
+
+static int world_query_pipe[2] = { -1, -1 };
+static mowgli_eventloop_pollable_t *world_query_pollable = NULL;
+
+#ifdef HAVE_USABLE_PTHREAD
+// Protects both lists and the state and cancelled fields of every query
+static pthread_mutex_t world_query_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t world_query_queued = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t world_query_ran = PTHREAD_COND_INITIALIZER;
+
+static mowgli_list_t world_query_queue = { NULL, NULL, 0 };
+static mowgli_list_t world_query_finished = { NULL, NULL, 0 };
+
+static unsigned int world_query_nthreads = 0;
+static bool world_query_threads_tried = false;
+#endif
+
+static size_t
+world_snapshot_add_str(struct world_snapshot *const restrict snap, const char *const restrict str)
+{
+	if (str == NULL || *str == '\0')
+		return 0;
+
+	const size_t len = strlen(str) + 1;
+	const size_t offset = snap->strings_len;
+
+	if (snap->strings_alloc - snap->strings_len < len)
+	{
+		while (snap->strings_alloc - snap->strings_len < len)
+			snap->strings_alloc *= 2U;
+
+		snap->strings = srealloc(snap->strings, snap->strings_alloc);
+	}
+
+	(void) memcpy(snap->strings + offset, str, len);
+	snap->strings_len += len;
+
+	return offset;
+}
+
+static const char *
+world_snapshot_metadata(void *const restrict target, const char *const restrict name)
+{
+	const struct metadata *const md = metadata_find(target, name);
+
+	return md ? md->value : NULL;
+}
+
+static void
+world_snapshot_take_myusers(struct world_snapshot *const restrict snap)
+{
+	struct myentity_iteration_state state;
+	struct myentity *mt;
+	size_t i = 0;
+
+	MYENTITY_FOREACH_T(mt, &state, ENT_USER)
+		snap->nmyusers++;
+
+	snap->myusers = smalloc((snap->nmyusers ? snap->nmyusers : 1U) * sizeof *snap->myusers);
+
+	MYENTITY_FOREACH_T(mt, &state, ENT_USER)
+	{
+		// Iterating ENT_USER, so every entity is an account
+		struct myuser *const mu = (struct myuser *) mt;
+		struct world_snapshot_myuser *const wmu = &snap->myusers[i++];
+
+		wmu->name = world_snapshot_add_str(snap, mt->name);
+		wmu->email = world_snapshot_add_str(snap, mu->email);
+		wmu->mark_reason = world_snapshot_add_str(snap, world_snapshot_metadata(mu, "private:mark:reason"));
+		wmu->registered = mu->registered;
+		wmu->lastlogin = mu->lastlogin;
+		wmu->flags = mu->flags;
+		wmu->nicks = MOWGLI_LIST_LENGTH(&mu->nicks);
+
+		if (metadata_find(mu, "private:mark:setter"))
+			wmu->marks |= WSM_MARKED;
+
+		if (metadata_find(mu, "private:freeze:freezer"))
+			wmu->marks |= WSM_FROZEN;
+	}
+}
+
+static void
+world_snapshot_take_mychans(struct world_snapshot *const restrict snap)
+{
+	mowgli_patricia_iteration_state_t state;
+	struct mychan *mc;
+	size_t i = 0, nchanacs = 0;
+
+	snap->nmychans = mowgli_patricia_size(mclist);
+	snap->mychans = smalloc((snap->nmychans ? snap->nmychans : 1U) * sizeof *snap->mychans);
+
+	MOWGLI_PATRICIA_FOREACH(mc, &state, mclist)
+		nchanacs += MOWGLI_LIST_LENGTH(&mc->chanacs);
+
+	snap->chanacs = smalloc((nchanacs ? nchanacs : 1U) * sizeof *snap->chanacs);
+
+	MOWGLI_PATRICIA_FOREACH(mc, &state, mclist)
+	{
+		struct world_snapshot_mychan *const wmc = &snap->mychans[i++];
+		mowgli_node_t *n;
+
+		wmc->name = world_snapshot_add_str(snap, mc->name);
+		wmc->founders = world_snapshot_add_str(snap, mychan_founder_names(mc));
+		wmc->mark_reason = world_snapshot_add_str(snap, world_snapshot_metadata(mc, "private:mark:reason"));
+		wmc->close_reason = world_snapshot_add_str(snap, world_snapshot_metadata(mc, "private:close:reason"));
+		wmc->registered = mc->registered;
+		wmc->used = mc->used;
+		wmc->flags = mc->flags;
+		wmc->chanacs = snap->nchanacs;
+
+		if (metadata_find(mc, "private:mark:setter"))
+			wmc->marks |= WSM_MARKED;
+
+		if (metadata_find(mc, "private:close:closer"))
+			wmc->marks |= WSM_CLOSED;
+
+		MOWGLI_ITER_FOREACH(n, mc->chanacs.head)
+		{
+			const struct chanacs *const ca = n->data;
+			struct world_snapshot_chanacs *const wca = &snap->chanacs[snap->nchanacs++];
+
+			wca->target = world_snapshot_add_str(snap, ca->entity ? ca->entity->name : ca->host);
+			wca->level = ca->level;
+			wca->tmodified = ca->tmodified;
+		}
+
+		wmc->nchanacs = snap->nchanacs - wmc->chanacs;
+	}
+}
+
+static struct world_snapshot *
+world_snapshot_take(void)
+{
+	struct world_snapshot *const snap = smalloc(sizeof *snap);
+
+	snap->refcount = 1;
+	snap->version = ++world_snapshot_version;
+	snap->taken = CURRTIME;
+	snap->strings_alloc = 4096U;
+	snap->strings_len = 1;
+	snap->strings = smalloc(snap->strings_alloc);
+
+	(void) world_snapshot_take_myusers(snap);
+	(void) world_snapshot_take_mychans(snap);
+
+	return snap;
+}
+
+/*
+ * world_snapshot_acquire()
+ *
+ * outputs:
+ *       a reference to a snapshot taken within the last few seconds, for
+ *       world_snapshot_release()
+ *
+ * side effects:
+ *       if the current snapshot is too old, a new one is taken and published
+ */
+struct world_snapshot *
+world_snapshot_acquire(void)
+{
+	if (world_snapshot_current && CURRTIME - world_snapshot_current->taken >= WORLD_SNAPSHOT_MAX_AGE)
+	{
+		(void) world_snapshot_release(world_snapshot_current);
+		world_snapshot_current = NULL;
+	}
+
+	if (! world_snapshot_current)
+		world_snapshot_current = world_snapshot_take();
+
+	world_snapshot_current->refcount++;
+
+	return world_snapshot_current;
+}
+
+void
+world_snapshot_release(struct world_snapshot *const restrict snap)
+{
+	return_if_fail(snap != NULL);
+	return_if_fail(snap->refcount != 0);
+
+	if (--snap->refcount)
+		return;
+
+	(void) sfree(snap->myusers);
+	(void) sfree(snap->mychans);
+	(void) sfree(snap->chanacs);
+	(void) sfree(snap->strings);
+	(void) sfree(snap);
+}
+
+static void
+world_query_free(struct world_query *const restrict query)
+{
+	(void) world_snapshot_release(query->snap);
+	(void) sfree(query);
+}
+
+static void
+world_query_finish(struct world_query *const restrict query)
+{
+	if (query->done_fn && ! query->cancelled)
+		query->done_fn(query->snap, query->priv);
+
+	(void) world_query_free(query);
+}
+
+#ifdef HAVE_USABLE_PTHREAD
+
+static void
+world_query_wake(void)
+{
+	const ssize_t ret = write(world_query_pipe[1], "", 1);
+
+	(void) ret;
+}
+
+static void *
+world_query_worker(void ATHEME_VATTR_UNUSED *const restrict arg)
+{
+	(void) pthread_mutex_lock(&world_query_lock);
+
+	for (;;)
+	{
+		while (! world_query_queue.head)
+			(void) pthread_cond_wait(&world_query_queued, &world_query_lock);
+
+		struct world_query *const query = world_query_queue.head->data;
+
+		(void) mowgli_node_delete(&query->node, &world_query_queue);
+		query->state = WORLD_QUERY_RUNNING;
+
+		(void) pthread_mutex_unlock(&world_query_lock);
+
+		query->query_fn(query->snap, query->priv);
+
+		(void) pthread_mutex_lock(&world_query_lock);
+
+		query->state = WORLD_QUERY_FINISHED;
+		(void) mowgli_node_add(query, &query->node, &world_query_finished);
+		(void) pthread_cond_broadcast(&world_query_ran);
+
+		(void) world_query_wake();
+	}
+
+	return NULL;
+}
+
+static void
+world_query_pipe_cb(mowgli_eventloop_t ATHEME_VATTR_UNUSED *const restrict eventloop,
+                    mowgli_eventloop_io_t ATHEME_VATTR_UNUSED *const restrict io,
+                    const mowgli_eventloop_io_dir_t ATHEME_VATTR_UNUSED dir,
+                    void ATHEME_VATTR_UNUSED *const restrict userdata)
+{
+	mowgli_list_t finished = { NULL, NULL, 0 };
+	mowgli_node_t *n, *tn;
+	char buf[64];
+
+	while (read(world_query_pipe[0], buf, sizeof buf) > 0)
+		continue;
+
+	(void) pthread_mutex_lock(&world_query_lock);
+
+	MOWGLI_ITER_FOREACH_SAFE(n, tn, world_query_finished.head)
+	{
+		(void) mowgli_node_delete(n, &world_query_finished);
+		(void) mowgli_node_add(n->data, n, &finished);
+	}
+
+	(void) pthread_mutex_unlock(&world_query_lock);
+
+	MOWGLI_ITER_FOREACH_SAFE(n, tn, finished.head)
+	{
+		(void) mowgli_node_delete(n, &finished);
+		(void) world_query_finish(n->data);
+	}
+}
+
+static bool
+world_query_pipe_open(void)
+{
+	if (world_query_pipe[0] != -1)
+		return true;
+
+	if (pipe(world_query_pipe) != 0)
+	{
+		(void) slog(LG_ERROR, "%s: pipe(2): %s", MOWGLI_FUNC_NAME, strerror(errno));
+		world_query_pipe[0] = world_query_pipe[1] = -1;
+		return false;
+	}
+
+	for (size_t i = 0; i < 2; i++)
+	{
+		const int flags = fcntl(world_query_pipe[i], F_GETFL, 0);
+
+		if (flags == -1 || fcntl(world_query_pipe[i], F_SETFL, flags | O_NONBLOCK) == -1)
+			(void) slog(LG_ERROR, "%s: fcntl(2): %s", MOWGLI_FUNC_NAME, strerror(errno));
+	}
+
+	world_query_pollable = mowgli_pollable_create(base_eventloop, world_query_pipe[0], NULL);
+
+	(void) mowgli_pollable_setselect(base_eventloop, world_query_pollable, MOWGLI_EVENTLOOP_IO_READ,
+	                                 &world_query_pipe_cb);
+	return true;
+}
+
+// The pool lives as long as the process; its threads wait for queries
+static bool
+world_query_threads_start(void)
+{
+	if (world_query_threads_tried)
+		return world_query_nthreads != 0;
+
+	world_query_threads_tried = true;
+
+	if (! world_query_pipe_open())
+		return false;
+
+	// Signals must only ever be delivered to the main thread
+	sigset_t newset;
+	sigset_t oldset;
+
+	(void) sigfillset(&newset);
+	(void) pthread_sigmask(SIG_BLOCK, &newset, &oldset);
+
+	for (unsigned int i = 0; i < WORLD_QUERY_THREADS; i++)
+	{
+		pthread_t thread;
+
+		const int ret = pthread_create(&thread, NULL, &world_query_worker, NULL);
+
+		if (ret != 0)
+		{
+			(void) slog(LG_ERROR, "%s: pthread_create(3): %s", MOWGLI_FUNC_NAME, strerror(ret));
+			break;
+		}
+
+		(void) pthread_detach(thread);
+		world_query_nthreads++;
+	}
+
+	(void) pthread_sigmask(SIG_SETMASK, &oldset, NULL);
+
+	return world_query_nthreads != 0;
+}
+
+#endif /* HAVE_USABLE_PTHREAD */
+
+/*
+ * world_query_start()
+ *
+ * inputs:
+ *       query function, done function (may be NULL), their argument, and
+ *       whether the query may run in the background
+ *
+ * outputs:
+ *       the query, for world_query_cancel(); or NULL if it has already
+ *       finished
+ *
+ * side effects:
+ *       a snapshot is acquired for the query, and the callbacks are called
+ *       as described in atheme/worldsnap.h. Without background (e.g.
+ *       because the results have to be in the reply to an RPC call), or if
+ *       there are no query threads, everything happens before this returns.
+ */
+struct world_query *
+world_query_start(const world_query_fn query_fn, const world_query_done_fn done_fn, void *const priv,
+                  const bool background)
+{
+	return_val_if_fail(query_fn != NULL, NULL);
+
+	struct world_query *const query = smalloc(sizeof *query);
+
+	query->snap = world_snapshot_acquire();
+	query->query_fn = query_fn;
+	query->done_fn = done_fn;
+	query->priv = priv;
+
+#ifdef HAVE_USABLE_PTHREAD
+	if (background && world_query_threads_start())
+	{
+		(void) pthread_mutex_lock(&world_query_lock);
+
+		query->state = WORLD_QUERY_QUEUED;
+		(void) mowgli_node_add(query, &query->node, &world_query_queue);
+		(void) pthread_cond_signal(&world_query_queued);
+
+		(void) pthread_mutex_unlock(&world_query_lock);
+
+		return query;
+	}
+#else
+	(void) background;
+#endif
+
+	query->query_fn(query->snap, query->priv);
+	(void) world_query_finish(query);
+
+	return NULL;
+}
+
+/*
+ * world_query_cancel()
+ *
+ * Stops a query started with world_query_start(); its done function is not
+ * called. If a thread is running it, this waits for that to finish. Must
+ * not be called from the callbacks.
+ */
+void
+world_query_cancel(struct world_query *const restrict query)
+{
+	return_if_fail(query != NULL);
+
+#ifdef HAVE_USABLE_PTHREAD
+	(void) pthread_mutex_lock(&world_query_lock);
+
+	query->cancelled = true;
+
+	while (query->state == WORLD_QUERY_RUNNING)
+		(void) pthread_cond_wait(&world_query_ran, &world_query_lock);
+
+	if (query->state == WORLD_QUERY_QUEUED)
+		(void) mowgli_node_delete(&query->node, &world_query_queue);
+	else
+		(void) mowgli_node_delete(&query->node, &world_query_finished);
+
+	(void) pthread_mutex_unlock(&world_query_lock);
+#endif
+
+	(void) world_query_free(query);
+}
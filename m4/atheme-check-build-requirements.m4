@@ -23,6 +23,7 @@ AC_DEFUN([ATHEME_CHECK_BUILD_REQUIREMENTS], [
     AC_CHECK_HEADERS([inttypes.h], [], [], [])
     AC_CHECK_HEADERS([libintl.h], [], [], [])
     AC_CHECK_HEADERS([limits.h], [], [], [])
+    AC_CHECK_HEADERS([linux/io_uring.h], [], [], [])
     AC_CHECK_HEADERS([locale.h], [], [], [])
     AC_CHECK_HEADERS([netdb.h], [], [], [])
     AC_CHECK_HEADERS([netinet/in.h], [], [], [])
@@ -36,10 +37,15 @@ AC_DEFUN([ATHEME_CHECK_BUILD_REQUIREMENTS], [
     AC_CHECK_HEADERS([stdlib.h], [], [], [])
     AC_CHECK_HEADERS([string.h], [], [], [])
     AC_CHECK_HEADERS([strings.h], [], [], [])
+    AC_CHECK_HEADERS([sys/eventfd.h], [], [], [])
     AC_CHECK_HEADERS([sys/file.h], [], [], [])
+    AC_CHECK_HEADERS([sys/mman.h], [], [], [])
     AC_CHECK_HEADERS([sys/resource.h], [], [], [])
+    AC_CHECK_HEADERS([sys/sendfile.h], [], [], [])
     AC_CHECK_HEADERS([sys/stat.h], [], [], [])
+    AC_CHECK_HEADERS([sys/syscall.h], [], [], [])
     AC_CHECK_HEADERS([sys/time.h], [], [], [])
+    AC_CHECK_HEADERS([sys/uio.h], [], [], [])
     AC_CHECK_HEADERS([sys/types.h], [], [], [])
     AC_CHECK_HEADERS([sys/wait.h], [], [], [])
     AC_CHECK_HEADERS([time.h], [], [], [])
@@ -52,6 +58,7 @@ AC_DEFUN([ATHEME_CHECK_BUILD_REQUIREMENTS], [
     AC_CHECK_FUNCS([explicit_memset], [], [])
     AC_CHECK_FUNCS([fileno], [], [ATHEME_REQUIRED_FUNC_MISSING])
     AC_CHECK_FUNCS([flock], [], [ATHEME_REQUIRED_FUNC_MISSING])
+    AC_CHECK_FUNCS([fmemopen], [], [])
     AC_CHECK_FUNCS([fork], [], [])
     AC_CHECK_FUNCS([fsync], [], [ATHEME_REQUIRED_FUNC_MISSING])
     AC_CHECK_FUNCS([gethostbyname], [], [ATHEME_REQUIRED_FUNC_MISSING])
@@ -0,0 +1,33 @@
+# SPDX-License-Identifier: ISC
+# SPDX-URL: https://spdx.org/licenses/ISC.html
+#
+# Copyright (C) 2026 Atheme Development Group (https://atheme.github.io/)
+#
+# -*- Atheme IRC Services -*-
+# Atheme Build System Component
+
+AC_DEFUN([ATHEME_FEATURETEST_USDT], [
+
+    USDT_PROBES="No"
+
+    AC_ARG_ENABLE([usdt],
+        [AS_HELP_STRING([--enable-usdt], [Enable USDT probes for perf, bpftrace, etc. (needs <sys/sdt.h>)])],
+        [], [enable_usdt="no"])
+
+    case "x${enable_usdt}" in
+        xyes)
+            AC_CHECK_HEADER([sys/sdt.h], [
+                USDT_PROBES="Yes"
+                AC_DEFINE([ATHEME_ENABLE_USDT], [1], [Define to 1 if --enable-usdt was given to ./configure])
+            ], [
+                AC_MSG_ERROR([--enable-usdt needs <sys/sdt.h> (e.g. from SystemTap's development package)])
+            ])
+            ;;
+        xno)
+            USDT_PROBES="No"
+            ;;
+        *)
+            AC_MSG_ERROR([invalid option for --enable-usdt])
+            ;;
+    esac
+])
@@ -0,0 +1,98 @@
+# SPDX-License-Identifier: ISC
+# SPDX-URL: https://spdx.org/licenses/ISC.html
+#
+# Copyright (C) 2026 Atheme Development Group (https://atheme.github.io/)
+#
+# -*- Atheme IRC Services -*-
+# Atheme Build System Component
+
+AC_DEFUN([ATHEME_LIBTEST_PCRE2], [
+
+    CFLAGS_SAVED="${CFLAGS}"
+    LIBS_SAVED="${LIBS}"
+
+    LIBPCRE2="No"
+    LIBPCRE2_PATH=""
+
+    AC_ARG_WITH([pcre2],
+        [AS_HELP_STRING([--without-pcre2], [Do not attempt to detect libpcre2 (Perl-Compatible Regular Expressions, version 2)])],
+        [], [with_pcre2="auto"])
+
+    case "x${with_pcre2}" in
+        xno | xyes | xauto)
+            ;;
+        x/*)
+            LIBPCRE2_PATH="${with_pcre2}"
+            with_pcre2="yes"
+            ;;
+        *)
+            AC_MSG_ERROR([invalid option for --with-pcre2])
+            ;;
+    esac
+
+    AS_IF([test "${with_pcre2}" != "no"], [
+        AS_IF([test -n "${LIBPCRE2_PATH}"], [
+            # Allow for user to provide custom installation directory
+            AS_IF([test -d "${LIBPCRE2_PATH}/include" -a -d "${LIBPCRE2_PATH}/lib"], [
+                LIBPCRE2_CFLAGS="-I${LIBPCRE2_PATH}/include"
+                LIBPCRE2_LIBS="-L${LIBPCRE2_PATH}/lib -lpcre2-8"
+            ], [
+                AC_MSG_ERROR([${LIBPCRE2_PATH} is not a suitable directory for libpcre2])
+            ])
+        ], [test -n "${PKG_CONFIG}"], [
+            # Allow for the user to "override" pkg-config without it being installed
+            PKG_CHECK_MODULES([LIBPCRE2], [libpcre2-8], [], [LIBPCRE2="No"])
+        ])
+        AS_IF([test -n "${LIBPCRE2_CFLAGS+set}" -a -n "${LIBPCRE2_LIBS+set}"], [
+            # Only proceed with library tests if custom paths were given or pkg-config succeeded
+            LIBPCRE2="Yes"
+        ], [
+            LIBPCRE2="No"
+            AS_IF([test "${with_pcre2}" != "no" && test "${with_pcre2}" != "auto"], [
+                AC_MSG_FAILURE([--with-pcre2 was given but libpcre2 could not be found])
+            ])
+        ])
+    ])
+
+    AS_IF([test "${LIBPCRE2}" = "Yes"], [
+        CFLAGS="${LIBPCRE2_CFLAGS} ${CFLAGS}"
+        LIBS="${LIBPCRE2_LIBS} ${LIBS}"
+
+        AC_MSG_CHECKING([if libpcre2 appears to be usable])
+        AC_LINK_IFELSE([
+            AC_LANG_PROGRAM([[
+                #ifdef HAVE_STDDEF_H
+                #  include <stddef.h>
+                #endif
+                #define PCRE2_CODE_UNIT_WIDTH 8
+                #include <pcre2.h>
+            ]], [[
+                (void) pcre2_compile(NULL, 0, 0, NULL, NULL, NULL);
+                (void) pcre2_jit_compile(NULL, PCRE2_JIT_COMPLETE);
+                (void) pcre2_match(NULL, NULL, 0, 0, 0, NULL, NULL);
+                (void) pcre2_code_free(NULL);
+            ]])
+        ], [
+            AC_MSG_RESULT([yes])
+            LIBPCRE2="Yes"
+            AC_DEFINE([HAVE_LIBPCRE2], [1], [Define to 1 if libpcre2 appears to be usable])
+        ], [
+            AC_MSG_RESULT([no])
+            LIBPCRE2="No"
+            AS_IF([test "${with_pcre2}" != "no" && test "${with_pcre2}" != "auto"], [
+                AC_MSG_FAILURE([--with-pcre2 was given but libpcre2 does not appear to be usable])
+            ])
+        ])
+    ])
+
+    AS_IF([test "${LIBPCRE2}" = "No"], [
+        LIBPCRE2_CFLAGS=""
+        LIBPCRE2_LIBS=""
+    ])
+
+    AC_SUBST([LIBPCRE2_CFLAGS])
+    AC_SUBST([LIBPCRE2_LIBS])
+
+    CFLAGS="${CFLAGS_SAVED}"
+    LIBS="${LIBS_SAVED}"
+])
@@ -0,0 +1,48 @@
+# SPDX-License-Identifier: ISC
+# SPDX-URL: https://spdx.org/licenses/ISC.html
+#
+# Copyright (C) 2026 Atheme Development Group (https://atheme.github.io/)
+#
+# -*- Atheme IRC Services -*-
+# Atheme Build System Component
+
+AC_DEFUN([ATHEME_LIBTEST_PTHREAD], [
+
+    LIBS_SAVED="${LIBS}"
+
+    LIBPTHREAD_LIBS=""
+
+    AC_SEARCH_LIBS([pthread_create], [pthread], [
+        AC_CHECK_HEADERS([pthread.h], [], [], [])
+        AC_MSG_CHECKING([if POSIX threads appear to be usable])
+        AC_LINK_IFELSE([
+            AC_LANG_PROGRAM([[
+                #ifdef HAVE_STDDEF_H
+                #  include <stddef.h>
+                #endif
+                #ifdef HAVE_PTHREAD_H
+                #  include <pthread.h>
+                #endif
+            ]], [[
+                pthread_mutex_t mtx = PTHREAD_MUTEX_INITIALIZER;
+                pthread_t thr;
+                (void) pthread_mutex_lock(&mtx);
+                (void) pthread_mutex_unlock(&mtx);
+                (void) pthread_create(&thr, NULL, NULL, NULL);
+                (void) pthread_join(thr, NULL);
+            ]])
+        ], [
+            AC_MSG_RESULT([yes])
+            AC_DEFINE([HAVE_USABLE_PTHREAD], [1], [Define to 1 if POSIX threads appear to be usable])
+            AS_IF([test "x${ac_cv_search_pthread_create}" != "xnone required"], [
+                LIBPTHREAD_LIBS="${ac_cv_search_pthread_create}"
+            ])
+        ], [
+            AC_MSG_RESULT([no])
+        ])
+    ], [])
+
+    AC_SUBST([LIBPTHREAD_LIBS])
+
+    LIBS="${LIBS_SAVED}"
+])
@@ -66,9 +66,11 @@ Configuration of ${PACKAGE_STRING}:
     OpenSSL support .........: ${LIBCRYPTO}
     passwdqc support ........: ${LIBPASSWDQC}
     PCRE support ............: ${LIBPCRE}
+    PCRE2 support ...........: ${LIBPCRE2}
     Perl support ............: ${LIBPERL}
     QR Code support .........: ${LIBQRENCODE}
     Sodium support ..........: ${LIBSODIUM}
+    zlib support ............: ${LIBZ}
 
   Password Cryptography:
     Argon2 support ..........: ${LIBARGON2}
@@ -95,6 +97,7 @@ Configuration of ${PACKAGE_STRING}:
     Legacy Crypto Modules ...: ${LEGACY_PWCRYPTO}
     Reproducible Builds .....: ${REPRODUCIBLE_BUILDS}
     RNG Frontend ............: ${RANDOM_FRONTEND}
+    USDT Probes .............: ${USDT_PROBES}
 
   Build Features:
     Build Warnings ..........: ${BUILD_WARNINGS}
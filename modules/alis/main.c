@@ -44,6 +44,14 @@
 #define ALIS_MAXMATCH_DEF       64U
 #define ALIS_MAXMATCH_MAX       128U
 
+#define ALIS_MAXSCAN_DEF        20000U
+#define ALIS_MAXTIME_DEF        100U    // Milliseconds
+#define ALIS_MAXTIME_MAX        10000U
+
+#define ALIS_GRAM_LEN           3U
+#define ALIS_MEMBER_CLASSES     33U     // alis_member_class() of 0 to UINT_MAX
+#define ALIS_BUDGET_INTERVAL    64U     // Channels looked at between checks of the clock
+
 enum alis_mode_cmp
 {
 	MODECMP_NONE            = 0,
@@ -70,8 +78,242 @@ struct alis_query
 	char                    topic[BUFSIZE];
 };
 
+// One of the case-folded trigrams of a channel's name or topic
+struct alis_gram
+{
+	mowgli_node_t           node;
+	mowgli_list_t *         list;       // Every channel with the trigram, in the index
+	char                    key[ALIS_GRAM_LEN + 1];
+};
+
+struct alis_grams
+{
+	struct alis_gram *      grams;
+	size_t                  count;
+};
+
+// Where a channel is in the indexes, keyed by name in alis_channels
+struct alis_channel
+{
+	struct channel *        chptr;
+	mowgli_node_t           member_node;
+	unsigned int            member_class;
+	struct alis_grams       name;
+	struct alis_grams       topic;
+};
+
+enum alis_plan_type
+{
+	ALIS_PLAN_SCAN,         // Every channel
+	ALIS_PLAN_GRAM,         // The channels with a trigram of the mask or topic pattern
+	ALIS_PLAN_MEMBERS,      // The channels of a member count class or above
+};
+
+struct alis_plan
+{
+	enum alis_plan_type     type;
+	size_t                  cost;
+	const mowgli_list_t *   gram;
+	unsigned int            min_class;
+};
+
+struct alis_search
+{
+	struct sourceinfo *     si;
+	struct alis_query *     query;
+	struct timeval          started;
+	unsigned int            scanned;
+	unsigned int            max_scan;   // 0 is no limit
+	unsigned int            max_time;   // 0 is no limit
+};
+
 static struct service *alissvs = NULL;
 static unsigned int alis_max_matches = ALIS_MAXMATCH_DEF;
+static unsigned int alis_max_scan = ALIS_MAXSCAN_DEF;
+static unsigned int alis_max_time = ALIS_MAXTIME_DEF;
+
+static mowgli_heap_t *alis_channel_heap = NULL;
+static mowgli_patricia_t *alis_channels = NULL;
+static mowgli_patricia_t *alis_name_grams = NULL;
+static mowgli_patricia_t *alis_topic_grams = NULL;
+
+/* Channels by the number of bits in their member count, so those with at
+ * least some number of members are in that number's class or above.
+ */
+static mowgli_list_t alis_members[ALIS_MEMBER_CLASSES];
+
+// Characters match() gives a meaning to
+static const char alis_metachars[] = "*?&#%\\";
+
+static unsigned int
+alis_member_class(unsigned int members)
+{
+	unsigned int class = 0;
+
+	while (members)
+	{
+		class++;
+		members >>= 1;
+	}
+
+	return class;
+}
+
+static void
+alis_gram_key(char key[static ALIS_GRAM_LEN + 1], const char *const restrict str)
+{
+	for (size_t i = 0; i < ALIS_GRAM_LEN; i++)
+		key[i] = (char) ToLower((unsigned char) str[i]);
+
+	key[ALIS_GRAM_LEN] = '\0';
+}
+
+static void
+alis_grams_add(struct alis_grams *const restrict g, mowgli_patricia_t *const restrict index,
+               struct alis_channel *const restrict ac, const char *const restrict str)
+{
+	const size_t len = str ? strlen(str) : 0;
+
+	if (len < ALIS_GRAM_LEN)
+		return;
+
+	g->grams = smalloc((len - ALIS_GRAM_LEN + 1) * sizeof *g->grams);
+
+	for (size_t i = 0; i + ALIS_GRAM_LEN <= len; i++)
+	{
+		struct alis_gram *const gram = &g->grams[g->count];
+
+		(void) alis_gram_key(gram->key, str + i);
+
+		if (! (gram->list = mowgli_patricia_retrieve(index, gram->key)))
+		{
+			gram->list = mowgli_list_create();
+			(void) mowgli_patricia_add(index, gram->key, gram->list);
+		}
+		else if (gram->list->tail && gram->list->tail->data == ac)
+			// Repeated in the string; its trigrams are all added in one go
+			continue;
+
+		(void) mowgli_node_add(ac, &gram->node, gram->list);
+		g->count++;
+	}
+}
+
+static void
+alis_grams_delete(struct alis_grams *const restrict g, mowgli_patricia_t *const restrict index)
+{
+	for (size_t i = 0; i < g->count; i++)
+	{
+		struct alis_gram *const gram = &g->grams[i];
+
+		(void) mowgli_node_delete(&gram->node, gram->list);
+
+		if (! MOWGLI_LIST_LENGTH(gram->list))
+		{
+			(void) mowgli_patricia_delete(index, gram->key);
+			(void) mowgli_list_free(gram->list);
+		}
+	}
+
+	(void) sfree(g->grams);
+
+	g->grams = NULL;
+	g->count = 0;
+}
+
+static void
+alis_channel_set_members(struct alis_channel *const restrict ac, const unsigned int members)
+{
+	const unsigned int class = alis_member_class(members);
+
+	if (class == ac->member_class)
+		return;
+
+	(void) mowgli_node_delete(&ac->member_node, &alis_members[ac->member_class]);
+	(void) mowgli_node_add(ac, &ac->member_node, &alis_members[class]);
+
+	ac->member_class = class;
+}
+
+static void
+alis_channel_add(struct channel *const restrict chptr)
+{
+	struct alis_channel *const ac = mowgli_heap_alloc(alis_channel_heap);
+
+	ac->chptr = chptr;
+	ac->member_class = alis_member_class(chptr->nummembers);
+
+	(void) mowgli_node_add(ac, &ac->member_node, &alis_members[ac->member_class]);
+	(void) alis_grams_add(&ac->name, alis_name_grams, ac, chptr->name);
+	(void) alis_grams_add(&ac->topic, alis_topic_grams, ac, chptr->topic);
+	(void) mowgli_patricia_add(alis_channels, chptr->name, ac);
+}
+
+static void
+alis_channel_free(struct alis_channel *const restrict ac)
+{
+	(void) mowgli_node_delete(&ac->member_node, &alis_members[ac->member_class]);
+	(void) alis_grams_delete(&ac->name, alis_name_grams);
+	(void) alis_grams_delete(&ac->topic, alis_topic_grams);
+	(void) mowgli_heap_free(alis_channel_heap, ac);
+}
+
+static void
+alis_channel_add_hook(struct channel *const restrict chptr)
+{
+	(void) alis_channel_add(chptr);
+}
+
+static void
+alis_channel_delete_hook(struct channel *const restrict chptr)
+{
+	struct alis_channel *const ac = mowgli_patricia_delete(alis_channels, chptr->name);
+
+	if (ac)
+		(void) alis_channel_free(ac);
+}
+
+static void
+alis_channel_join_hook(struct hook_channel_joinpart *const restrict hdata)
+{
+	// A hook before us may have kicked the user already
+	if (! hdata->cu)
+		return;
+
+	struct alis_channel *const ac = mowgli_patricia_retrieve(alis_channels, hdata->cu->chan->name);
+
+	if (ac)
+		(void) alis_channel_set_members(ac, hdata->cu->chan->nummembers);
+}
+
+static void
+alis_channel_part_hook(struct hook_channel_joinpart *const restrict hdata)
+{
+	// Called before the user is removed
+	struct alis_channel *const ac = mowgli_patricia_retrieve(alis_channels, hdata->cu->chan->name);
+
+	if (ac && hdata->cu->chan->nummembers)
+		(void) alis_channel_set_members(ac, hdata->cu->chan->nummembers - 1U);
+}
+
+static void
+alis_channel_topic_hook(struct channel *const restrict chptr)
+{
+	struct alis_channel *const ac = mowgli_patricia_retrieve(alis_channels, chptr->name);
+
+	if (! ac)
+		return;
+
+	(void) alis_grams_delete(&ac->topic, alis_topic_grams);
+	(void) alis_grams_add(&ac->topic, alis_topic_grams, ac, chptr->topic);
+}
+
+static void
+alis_channel_destroy_cb(const char ATHEME_VATTR_UNUSED *const restrict key, void *const restrict data,
+                        void ATHEME_VATTR_UNUSED *const restrict privdata)
+{
+	(void) alis_channel_free(data);
+}
 
 static void
 alis_parse_mode(const char *restrict arg, struct alis_query *const restrict query)
@@ -337,6 +579,180 @@ alis_show_channel(const struct alis_query *const restrict query, const struct ch
 	return true;
 }
 
+/* Every channel a pattern matches has all the trigrams of the literal runs
+ * in it; pick the one fewest channels have. Returns false if the pattern
+ * has none.
+ */
+static bool
+alis_plan_pattern(struct alis_plan *const restrict plan, mowgli_patricia_t *const restrict index,
+                  const char *const restrict pattern)
+{
+	char key[ALIS_GRAM_LEN + 1];
+	bool found = false;
+
+	plan->type = ALIS_PLAN_GRAM;
+	plan->cost = SIZE_MAX;
+	plan->gram = NULL;
+
+	for (const char *p = pattern; *p != '\0'; )
+	{
+		const size_t run = strcspn(p, alis_metachars);
+
+		for (size_t i = 0; i + ALIS_GRAM_LEN <= run; i++)
+		{
+			(void) alis_gram_key(key, p + i);
+
+			const mowgli_list_t *const list = mowgli_patricia_retrieve(index, key);
+			const size_t cost = list ? MOWGLI_LIST_LENGTH(list) : 0;
+
+			found = true;
+
+			if (cost < plan->cost)
+			{
+				plan->gram = list;
+				plan->cost = cost;
+			}
+		}
+
+		p += run;
+
+		if (*p != '\0')
+			p++;
+	}
+
+	return found;
+}
+
+static void
+alis_plan_query(struct alis_plan *const restrict plan, const struct alis_query *const restrict query)
+{
+	struct alis_plan candidate;
+
+	*plan = (struct alis_plan) {
+		.type   = ALIS_PLAN_SCAN,
+		.cost   = mowgli_patricia_size(chanlist),
+	};
+
+	if (alis_plan_pattern(&candidate, alis_name_grams, query->mask) && candidate.cost < plan->cost)
+		*plan = candidate;
+
+	if (*query->topic && alis_plan_pattern(&candidate, alis_topic_grams, query->topic) &&
+	    candidate.cost < plan->cost)
+		*plan = candidate;
+
+	if (query->min)
+	{
+		candidate = (struct alis_plan) {
+			.type       = ALIS_PLAN_MEMBERS,
+			.min_class  = alis_member_class(query->min),
+		};
+
+		for (unsigned int i = candidate.min_class; i < ALIS_MEMBER_CLASSES; i++)
+			candidate.cost += MOWGLI_LIST_LENGTH(&alis_members[i]);
+
+		if (candidate.cost < plan->cost)
+			*plan = candidate;
+	}
+}
+
+// Returns false once the search should stop
+static bool
+alis_search_channel(struct alis_search *const restrict search, const struct channel *const restrict chptr)
+{
+	struct alis_query *const query = search->query;
+
+	search->scanned++;
+
+	if (search->max_scan && search->scanned > search->max_scan)
+	{
+		(void) command_success_nodata(search->si, _("Search limit reached; please narrow your query"));
+		return false;
+	}
+
+	if (search->max_time && ! (search->scanned % ALIS_BUDGET_INTERVAL))
+	{
+		struct timeval elapsed;
+
+		(void) e_time(search->started, &elapsed);
+
+		if (tv2ms(&elapsed) >= (int) search->max_time)
+		{
+			(void) command_success_nodata(search->si, _("Search limit reached; please narrow your query"));
+			return false;
+		}
+	}
+
+	if (! alis_show_channel(query, chptr))
+		return true;
+
+	if (query->skip)
+	{
+		query->skip--;
+		return true;
+	}
+
+	(void) alis_print_channel(search->si, query, chptr);
+
+	if (--query->match_limit)
+		return true;
+
+	(void) command_success_nodata(search->si, _("Maximum channel output reached"));
+	return false;
+}
+
+static void
+alis_search_run(struct alis_search *const restrict search, const struct alis_plan *const restrict plan)
+{
+	mowgli_patricia_iteration_state_t state;
+	struct channel *chptr;
+	mowgli_node_t *n;
+
+	switch (plan->type)
+	{
+		case ALIS_PLAN_SCAN:
+			MOWGLI_PATRICIA_FOREACH(chptr, &state, chanlist)
+				if (! alis_search_channel(search, chptr))
+					return;
+			break;
+
+		case ALIS_PLAN_GRAM:
+			MOWGLI_ITER_FOREACH(n, plan->gram ? plan->gram->head : NULL)
+				if (! alis_search_channel(search, ((const struct alis_channel *) n->data)->chptr))
+					return;
+			break;
+
+		case ALIS_PLAN_MEMBERS:
+			// Biggest first
+			for (unsigned int i = ALIS_MEMBER_CLASSES; i-- > plan->min_class; )
+				MOWGLI_ITER_FOREACH(n, alis_members[i].head)
+					if (! alis_search_channel(search, ((const struct alis_channel *) n->data)->chptr))
+						return;
+			break;
+	}
+}
+
+/* Only looks at the channels an index says might match, and stops if that
+ * still takes too long; staff can search without limits.
+ */
+static void
+alis_search_query(struct sourceinfo *const restrict si, struct alis_query *const restrict query)
+{
+	struct alis_search search = {
+		.si         = si,
+		.query      = query,
+		.max_scan   = alis_max_scan,
+		.max_time   = alis_max_time,
+	};
+	struct alis_plan plan;
+
+	if (! si->su || has_priv(si, PRIV_CHAN_AUSPEX))
+		search.max_scan = search.max_time = 0;
+
+	(void) s_time(&search.started);
+	(void) alis_plan_query(&plan, query);
+	(void) alis_search_run(&search, &plan);
+}
+
 static void
 alis_cmd_list_func(struct sourceinfo *const restrict si, const int parc, char **const restrict parv)
 {
@@ -360,28 +776,7 @@ alis_cmd_list_func(struct sourceinfo *const restrict si, const int parc, char **
 		goto end;
 	}
 
-	struct channel *chptr;
-	mowgli_patricia_iteration_state_t state;
-
-	MOWGLI_PATRICIA_FOREACH(chptr, &state, chanlist)
-	{
-		if (! alis_show_channel(&query, chptr))
-			continue;
-
-		if (query.skip)
-		{
-			query.skip--;
-			continue;
-		}
-
-		(void) alis_print_channel(si, &query, chptr);
-
-		if (--query.match_limit)
-			continue;
-
-		(void) command_success_nodata(si, _("Maximum channel output reached"));
-		break;
-	}
+	(void) alis_search_query(si, &query);
 
 end:
 	(void) command_success_nodata(si, _("End of output."));
@@ -420,6 +815,7 @@ static struct command alis_cmd_list = {
 	.maxparc        = 10,
 	.cmd            = &alis_cmd_list_func,
 	.help           = { .path = "alis/list" },
+	.sched_class    = CMD_SCHED_QUERY,
 };
 
 static struct command alis_cmd_help = {
@@ -444,6 +840,27 @@ mod_init(struct module *const restrict m)
 
 	(void) add_uint_conf_item("MAXMATCHES", &alissvs->conf_table, 0, &alis_max_matches,
 	                          ALIS_MAXMATCH_MIN, ALIS_MAXMATCH_MAX, ALIS_MAXMATCH_DEF);
+	(void) add_uint_conf_item("MAXSCAN", &alissvs->conf_table, 0, &alis_max_scan,
+	                          0, UINT_MAX, ALIS_MAXSCAN_DEF);
+	(void) add_uint_conf_item("MAXTIME", &alissvs->conf_table, 0, &alis_max_time,
+	                          0, ALIS_MAXTIME_MAX, ALIS_MAXTIME_DEF);
+
+	alis_channel_heap = mowgli_heap_create(sizeof(struct alis_channel), 256, BH_NOW);
+	alis_channels = mowgli_patricia_create(irccasecanon);
+	alis_name_grams = mowgli_patricia_create(NULL);
+	alis_topic_grams = mowgli_patricia_create(NULL);
+
+	struct channel *chptr;
+	mowgli_patricia_iteration_state_t state;
+
+	MOWGLI_PATRICIA_FOREACH(chptr, &state, chanlist)
+		(void) alis_channel_add(chptr);
+
+	(void) hook_add_channel_add(&alis_channel_add_hook);
+	(void) hook_add_channel_delete(&alis_channel_delete_hook);
+	(void) hook_add_channel_join(&alis_channel_join_hook);
+	(void) hook_add_channel_part(&alis_channel_part_hook);
+	(void) hook_add_channel_topic(&alis_channel_topic_hook);
 
 	(void) service_bind_command(alissvs, &alis_cmd_list);
 	(void) service_bind_command(alissvs, &alis_cmd_help);
@@ -452,7 +869,20 @@ mod_init(struct module *const restrict m)
 static void
 mod_deinit(const enum module_unload_intent ATHEME_VATTR_UNUSED intent)
 {
+	(void) hook_del_channel_add(&alis_channel_add_hook);
+	(void) hook_del_channel_delete(&alis_channel_delete_hook);
+	(void) hook_del_channel_join(&alis_channel_join_hook);
+	(void) hook_del_channel_part(&alis_channel_part_hook);
+	(void) hook_del_channel_topic(&alis_channel_topic_hook);
+
+	(void) mowgli_patricia_destroy(alis_channels, &alis_channel_destroy_cb, NULL);
+	(void) mowgli_patricia_destroy(alis_name_grams, NULL, NULL);
+	(void) mowgli_patricia_destroy(alis_topic_grams, NULL, NULL);
+	(void) mowgli_heap_destroy(alis_channel_heap);
+
 	(void) del_conf_item("MAXMATCHES", &alissvs->conf_table);
+	(void) del_conf_item("MAXSCAN", &alissvs->conf_table);
+	(void) del_conf_item("MAXTIME", &alissvs->conf_table);
 	(void) service_delete(alissvs);
 }
 
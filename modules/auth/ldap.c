@@ -23,6 +23,21 @@
  *   binddn    -- distinguished name to bind to for searching (optional)
  *   bindauth  -- password for the distinguished name
  *                (optional, must specify if binddn given)
+ *
+ * and optionally:
+ *
+ *   connections -- number of persistent connections used for logins (default 4)
+ *   timeout     -- seconds to wait for the server to answer a login (default 5)
+ *   cache_time  -- seconds to remember a successful login for (default 60, 0 disables)
+ *
+ * Logins made through verify_password_async() are spread over a pool of
+ * persistent connections using the asynchronous libldap calls, with the
+ * sockets watched by the event loop, so a slow directory server no longer
+ * stalls services. A connection carries one login at a time, because LDAP
+ * does not allow anything else to be sent on a connection while a bind is
+ * outstanding (RFC 4511, section 4.2.1); further logins wait in a queue for
+ * the next free connection. Callers of the plain verify_password() still get
+ * the old blocking behaviour on a separate connection.
  */
 
 #include <atheme.h>
@@ -31,6 +46,49 @@
 
 #include <ldap.h>
 
+#define LDAP_POOL_MAX           32U
+#define LDAP_POOL_DEF           4U
+#define LDAP_TIMEOUT_DEF        5U
+#define LDAP_CACHE_TIME_DEF     60U
+
+enum ldap_stage
+{
+	LDAP_STAGE_SERVICE_BIND = 0,    // Binding as binddn (or anonymously) to search for the user
+	LDAP_STAGE_SEARCH       = 1,    // Searching for the user's DN
+	LDAP_STAGE_USER_BIND    = 2,    // Binding as the user with the given password
+};
+
+struct ldap_login
+{
+	mowgli_node_t               node;
+	struct pwverify_request *   req;
+	time_t                      deadline;
+	bool                        retried;
+	char                        name[NICKLEN + 1];
+	char                        eid[IDLEN + 1];
+	char                        password[PASSLEN + 1];
+	char **                     dns;            // DNs found by the search, tried in order
+	size_t                      dncount;
+	size_t                      dnpos;
+};
+
+struct ldap_pool_conn
+{
+	LDAP *                          ld;
+	mowgli_eventloop_pollable_t *   pollable;
+	struct ldap_login *             login;
+	enum ldap_stage                 stage;
+	int                             msgid;
+	bool                            service_bound;  // Last successful bind was the one used for searching
+};
+
+struct ldap_cache_entry
+{
+	time_t          expires;
+	unsigned char   mac[DIGEST_MDLEN_SHA2_256];
+	char            eid[IDLEN + 1];
+};
+
 static struct
 {
 	char *url;
@@ -40,22 +98,631 @@ static struct
 	char *binddn;
 	char *bindauth;
 	bool useDN;
+	unsigned int connections;
+	unsigned int timeout;
+	unsigned int cache_time;
 } ldap_config;
 
 static LDAP *ldap_conn;
+static bool ldap_config_ok = false;
+
+static struct ldap_pool_conn ldap_pool[LDAP_POOL_MAX];
+static mowgli_list_t ldap_login_queue;
+static mowgli_eventloop_timer_t *ldap_tick_timer = NULL;
+
+static mowgli_patricia_t *ldap_cache = NULL;
+static unsigned char ldap_cache_key[DIGEST_MDLEN_SHA2_256];
 
 static mowgli_list_t conf_ldap_table;
 
+static void ldap_pool_dispatch(void);
+
 static void
-ldap_config_ready(void *unused)
+ldap_warn(const char *const restrict what, const int res)
+{
+	static time_t lastwarning;
+
+	slog(LG_ERROR, "%s failed: %s", what, ldap_err2string(res));
+	if (CURRTIME > lastwarning + 300)
+	{
+		slog(LG_INFO, "LDAP:ERROR: \2%s\2", ldap_err2string(res));
+		wallops("Problem with LDAP server: %s", ldap_err2string(res));
+		lastwarning = CURRTIME;
+	}
+}
+
+static bool
+ldap_name_ok(const char *const restrict name)
 {
+	if (strchr(name, ' '))
+	{
+		slog(LG_INFO, "ldap_auth_user(%s): bad name: found space", name);
+		return false;
+	}
+	if (strchr(name, ','))
+	{
+		slog(LG_INFO, "ldap_auth_user(%s): bad name: found comma", name);
+		return false;
+	}
+	if (strchr(name, '/'))
+	{
+		slog(LG_INFO, "ldap_auth_user(%s): bad name: found /", name);
+		return false;
+	}
+
+	return true;
+}
+
+static LDAP *
+ldap_open(void)
+{
+	LDAP *ld = NULL;
 	int res;
+
+	if (! ldap_config_ok)
+		return NULL;
+
+	res = ldap_initialize(&ld, ldap_config.url);
+	if (res != LDAP_SUCCESS)
+	{
+		ldap_warn("ldap_config_ready(): ldap_initialize()", res);
+		return NULL;
+	}
+
+	// short timeouts, because the blocking calls stall atheme as a whole
+	ldap_set_option(ld, LDAP_OPT_TIMEOUT, &(const struct timeval){1, 0});
+	ldap_set_option(ld, LDAP_OPT_NETWORK_TIMEOUT, &(const struct timeval){1, 0});
+	ldap_set_option(ld, LDAP_OPT_DEREF, &(const int){false});
+	ldap_set_option(ld, LDAP_OPT_REFERRALS, &(const int){false});
+
+	return ld;
+}
+
+/* Positive-result cache: a successful login is remembered for cache_time
+ * seconds as an HMAC of the password (keyed with a secret generated when the
+ * module is loaded), so that clients identifying again and again don't each
+ * cost a round trip to the directory server.
+ */
+static bool
+ldap_cache_mac(const char *const restrict password, unsigned char *const restrict mac)
+{
+	return digest_oneshot_hmac(DIGALG_SHA2_256, ldap_cache_key, sizeof ldap_cache_key,
+	                           password, strlen(password), mac, NULL);
+}
+
+static bool
+ldap_cache_check(const char *const restrict eid, const char *const restrict password)
+{
+	unsigned char mac[DIGEST_MDLEN_SHA2_256];
+	struct ldap_cache_entry *ce;
+	bool ret = false;
+
+	if (! ldap_config.cache_time || ! (ce = mowgli_patricia_retrieve(ldap_cache, eid)))
+		return false;
+
+	if (ce->expires <= CURRTIME)
+	{
+		(void) mowgli_patricia_delete(ldap_cache, eid);
+		(void) sfree(ce);
+		return false;
+	}
+
+	if (ldap_cache_mac(password, mac))
+		ret = (smemcmp(mac, ce->mac, sizeof mac) == 0);
+
+	(void) smemzero(mac, sizeof mac);
+	return ret;
+}
+
+static void
+ldap_cache_add(const char *const restrict eid, const char *const restrict password)
+{
+	struct ldap_cache_entry *ce;
+
+	if (! ldap_config.cache_time)
+		return;
+
+	if (! (ce = mowgli_patricia_retrieve(ldap_cache, eid)))
+	{
+		ce = smalloc(sizeof *ce);
+		(void) mowgli_strlcpy(ce->eid, eid, sizeof ce->eid);
+		(void) mowgli_patricia_add(ldap_cache, ce->eid, ce);
+	}
+
+	if (! ldap_cache_mac(password, ce->mac))
+	{
+		(void) mowgli_patricia_delete(ldap_cache, eid);
+		(void) sfree(ce);
+		return;
+	}
+
+	ce->expires = CURRTIME + (time_t) ldap_config.cache_time;
+}
+
+static void
+ldap_cache_entry_free(const char ATHEME_VATTR_UNUSED *const restrict key, void *const restrict data,
+                      void ATHEME_VATTR_UNUSED *const restrict privdata)
+{
+	(void) sfree(data);
+}
+
+static void
+ldap_cache_clear(void)
+{
+	if (ldap_cache)
+		(void) mowgli_patricia_destroy(ldap_cache, &ldap_cache_entry_free, NULL);
+
+	ldap_cache = mowgli_patricia_create(NULL);
+}
+
+static void
+ldap_cache_expire(void)
+{
+	mowgli_patricia_iteration_state_t state;
+	struct ldap_cache_entry *ce;
+
+	MOWGLI_PATRICIA_FOREACH(ce, &state, ldap_cache)
+	{
+		if (ce->expires > CURRTIME)
+			continue;
+
+		(void) mowgli_patricia_delete(ldap_cache, ce->eid);
+		(void) sfree(ce);
+	}
+}
+
+static void
+ldap_login_clear_dns(struct ldap_login *const restrict login)
+{
+	for (size_t i = 0; i < login->dncount; i++)
+		(void) sfree(login->dns[i]);
+
+	(void) sfree(login->dns);
+
+	login->dns = NULL;
+	login->dncount = 0;
+	login->dnpos = 0;
+}
+
+static void
+ldap_login_free(struct ldap_login *const restrict login)
+{
+	(void) ldap_login_clear_dns(login);
+	(void) smemzerofree(login, sizeof *login);
+}
+
+static void
+ldap_login_finish(struct ldap_login *const restrict login, const bool verified)
+{
+	if (verified)
+		(void) ldap_cache_add(login->eid, login->password);
+
+	(void) auth_user_custom_async_done(login->req, verified);
+	(void) ldap_login_free(login);
+}
+
+static void
+ldap_pool_conn_close(struct ldap_pool_conn *const restrict pc)
+{
+	if (pc->pollable)
+		(void) mowgli_pollable_destroy(base_eventloop, pc->pollable);
+
+	if (pc->ld)
+	{
+		if (pc->login && pc->msgid != -1)
+			(void) ldap_abandon_ext(pc->ld, pc->msgid, NULL, NULL);
+
+		(void) ldap_unbind_ext(pc->ld, NULL, NULL);
+	}
+
+	pc->ld = NULL;
+	pc->pollable = NULL;
+	pc->msgid = -1;
+	pc->service_bound = false;
+}
+
+static void ldap_pool_conn_readable(mowgli_eventloop_t *, mowgli_eventloop_io_t *, mowgli_eventloop_io_dir_t, void *);
+
+// The socket only exists once libldap has connected, which happens when the first request is sent
+static void
+ldap_pool_conn_watch(struct ldap_pool_conn *const restrict pc)
+{
+	int fd = -1;
+
+	if (ldap_get_option(pc->ld, LDAP_OPT_DESC, &fd) != LDAP_OPT_SUCCESS || fd < 0)
+		return;
+
+	if (pc->pollable)
+	{
+		if (pc->pollable->fd == fd)
+			return;
+
+		(void) mowgli_pollable_destroy(base_eventloop, pc->pollable);
+	}
+
+	pc->pollable = mowgli_pollable_create(base_eventloop, fd, pc);
+
+	(void) mowgli_pollable_setselect(base_eventloop, pc->pollable, MOWGLI_EVENTLOOP_IO_READ,
+	                                 &ldap_pool_conn_readable);
+}
+
+static int
+ldap_pool_conn_bind(struct ldap_pool_conn *const restrict pc, const char *const restrict dn,
+                    char *const restrict password)
+{
+	struct berval cred = {
+		.bv_len = password ? strlen(password) : 0,
+		.bv_val = password,
+	};
+
+	return ldap_sasl_bind(pc->ld, dn, LDAP_SASL_SIMPLE, &cred, NULL, NULL, &pc->msgid);
+}
+
+// Sends the next request for the login on this connection
+static int
+ldap_pool_conn_step(struct ldap_pool_conn *const restrict pc)
+{
+	struct ldap_login *const login = pc->login;
+
+	if (! pc->ld && ! (pc->ld = ldap_open()))
+		return LDAP_SERVER_DOWN;
+
+	int res;
+
+	switch (pc->stage)
+	{
+		case LDAP_STAGE_SERVICE_BIND:
+			res = ldap_pool_conn_bind(pc, ldap_config.binddn, ldap_config.binddn ? ldap_config.bindauth : NULL);
+			break;
+
+		case LDAP_STAGE_SEARCH:
+		{
+			char what[512];
+			char *attrs[] = { LDAP_NO_ATTRS, NULL };
+
+			snprintf(what, sizeof what, "%s=%s", ldap_config.attribute, login->name);
+			res = ldap_search_ext(pc->ld, ldap_config.base, LDAP_SCOPE_SUBTREE, what, attrs, 0,
+			                      NULL, NULL, NULL, 0, &pc->msgid);
+			break;
+		}
+
+		case LDAP_STAGE_USER_BIND:
+		default:
+		{
+			if (ldap_config.useDN)
+			{
+				char dn[512];
+
+				snprintf(dn, sizeof dn, ldap_config.dnformat, login->name);
+				res = ldap_pool_conn_bind(pc, dn, login->password);
+			}
+			else
+				res = ldap_pool_conn_bind(pc, login->dns[login->dnpos], login->password);
+
+			pc->service_bound = false;
+			break;
+		}
+	}
+
+	if (res == LDAP_SUCCESS)
+		(void) ldap_pool_conn_watch(pc);
+	else
+		pc->msgid = -1;
+
+	return res;
+}
+
+static void
+ldap_pool_conn_begin(struct ldap_pool_conn *const restrict pc, struct ldap_login *const restrict login)
+{
+	pc->login = login;
+
+	(void) ldap_login_clear_dns(login);
+
+	if (ldap_config.useDN)
+		pc->stage = LDAP_STAGE_USER_BIND;
+	else if (pc->service_bound)
+		pc->stage = LDAP_STAGE_SEARCH;
+	else
+		pc->stage = LDAP_STAGE_SERVICE_BIND;
+
+	int res = ldap_pool_conn_step(pc);
+
+	if (res == LDAP_SERVER_DOWN || res == LDAP_CONNECT_ERROR)
+	{
+		// The persistent connection went away; try once more on a fresh one
+		(void) ldap_pool_conn_close(pc);
+
+		pc->stage = ldap_config.useDN ? LDAP_STAGE_USER_BIND : LDAP_STAGE_SERVICE_BIND;
+		res = ldap_pool_conn_step(pc);
+	}
+
+	if (res == LDAP_SUCCESS)
+		return;
+
+	ldap_warn("ldap_auth_user(): sending request", res);
+
+	(void) ldap_pool_conn_close(pc);
+	pc->login = NULL;
+
+	(void) ldap_login_finish(login, false);
+}
+
+// Handles the server's answer to the request outstanding on this connection
+static void
+ldap_pool_conn_result(struct ldap_pool_conn *const restrict pc, LDAPMessage *const restrict message)
+{
+	struct ldap_login *const login = pc->login;
+	int err = LDAP_OTHER;
+
+	pc->msgid = -1;
+
+	if (pc->stage == LDAP_STAGE_SEARCH)
+	{
+		for (LDAPMessage *entry = ldap_first_entry(pc->ld, message); entry; entry = ldap_next_entry(pc->ld, entry))
+		{
+			char *const dn = ldap_get_dn(pc->ld, entry);
+
+			if (! dn)
+				continue;
+
+			login->dns = srealloc(login->dns, (login->dncount + 1) * sizeof *login->dns);
+			login->dns[login->dncount++] = sstrdup(dn);
+
+			(void) ldap_memfree(dn);
+		}
+	}
+
+	(void) ldap_parse_result(pc->ld, message, &err, NULL, NULL, NULL, NULL, 1);
+
+	bool verified = false;
+
+	switch (pc->stage)
+	{
+		case LDAP_STAGE_SERVICE_BIND:
+			if (err != LDAP_SUCCESS)
+			{
+				slog(LG_INFO, "ldap_auth_user(): ldap_bind failed: %s", ldap_err2string(err));
+				goto done;
+			}
+
+			pc->service_bound = true;
+			pc->stage = LDAP_STAGE_SEARCH;
+			goto next;
+
+		case LDAP_STAGE_SEARCH:
+			if (err != LDAP_SUCCESS)
+			{
+				slog(LG_INFO, "ldap_auth_user(%s): ldap search failed: %s", login->name, ldap_err2string(err));
+				goto done;
+			}
+			if (! login->dncount)
+			{
+				slog(LG_INFO, "ldap_auth_user(%s): no matching entry", login->name);
+				goto done;
+			}
+
+			pc->stage = LDAP_STAGE_USER_BIND;
+			goto next;
+
+		case LDAP_STAGE_USER_BIND:
+		default:
+			if (err == LDAP_SUCCESS)
+			{
+				verified = true;
+				goto done;
+			}
+			if (! ldap_config.useDN && ++login->dnpos < login->dncount)
+				goto next;
+
+			slog(LG_INFO, "ldap_auth_user(%s): ldap auth bind failed: %s", login->name, ldap_err2string(err));
+			goto done;
+	}
+
+next:
+	if ((err = ldap_pool_conn_step(pc)) == LDAP_SUCCESS)
+		return;
+
+	ldap_warn("ldap_auth_user(): sending request", err);
+	(void) ldap_pool_conn_close(pc);
+
+done:
+	pc->login = NULL;
+	(void) ldap_login_finish(login, verified);
+}
+
+// Collects whatever the server has answered so far; false if the connection had to be dropped
+static bool
+ldap_pool_conn_poll(struct ldap_pool_conn *const restrict pc)
+{
+	while (pc->login && pc->msgid != -1)
+	{
+		LDAPMessage *message = NULL;
+		struct timeval zero = { 0, 0 };
+
+		const int res = ldap_result(pc->ld, pc->msgid, LDAP_MSG_ALL, &zero, &message);
+
+		if (res == 0)
+			return true;
+
+		if (res == -1)
+		{
+			int err = LDAP_SERVER_DOWN;
+
+			(void) ldap_get_option(pc->ld, LDAP_OPT_RESULT_CODE, &err);
+			ldap_warn("ldap_auth_user(): ldap_result()", err);
+
+			struct ldap_login *const login = pc->login;
+
+			(void) ldap_pool_conn_close(pc);
+			pc->login = NULL;
+
+			if (login->retried)
+			{
+				(void) ldap_login_finish(login, false);
+				return false;
+			}
+
+			// Start it over from the beginning on a fresh connection
+			login->retried = true;
+			(void) mowgli_node_add_head(login, &login->node, &ldap_login_queue);
+			return false;
+		}
+
+		(void) ldap_pool_conn_result(pc, message);
+	}
+
+	return true;
+}
+
+static void
+ldap_pool_conn_readable(mowgli_eventloop_t ATHEME_VATTR_UNUSED *const restrict eventloop,
+                        mowgli_eventloop_io_t ATHEME_VATTR_UNUSED *const restrict io,
+                        const mowgli_eventloop_io_dir_t ATHEME_VATTR_UNUSED dir, void *const restrict userdata)
+{
+	struct ldap_pool_conn *const pc = userdata;
+
+	if (! pc->login)
+	{
+		/* Nothing is outstanding, so this is the server closing an idle connection
+		 * (or sending a notice of disconnection); reconnect when next needed.
+		 */
+		(void) ldap_pool_conn_close(pc);
+		return;
+	}
+
+	(void) ldap_pool_conn_poll(pc);
+	(void) ldap_pool_dispatch();
+}
+
+// Hands queued logins to idle connections
+static void
+ldap_pool_dispatch(void)
+{
+	const unsigned int count = ldap_config.connections;
+
+	for (unsigned int i = 0; i < count && MOWGLI_LIST_LENGTH(&ldap_login_queue); i++)
+	{
+		struct ldap_pool_conn *const pc = &ldap_pool[i];
+
+		if (pc->login)
+			continue;
+
+		struct ldap_login *const login = ldap_login_queue.head->data;
+
+		(void) mowgli_node_delete(&login->node, &ldap_login_queue);
+		(void) ldap_pool_conn_begin(pc, login);
+	}
+}
+
+/* Runs every second: picks up answers libldap has already buffered, gives
+ * up on logins the server has not answered in time, and expires the cache.
+ */
+static void
+ldap_tick(void ATHEME_VATTR_UNUSED *const restrict unused)
+{
+	for (unsigned int i = 0; i < LDAP_POOL_MAX; i++)
+	{
+		struct ldap_pool_conn *const pc = &ldap_pool[i];
+
+		if (! pc->login || ! ldap_pool_conn_poll(pc) || ! pc->login)
+			continue;
+
+		if (pc->login->deadline > CURRTIME)
+			continue;
+
+		struct ldap_login *const login = pc->login;
+
+		slog(LG_INFO, "ldap_auth_user(%s): timed out waiting for the LDAP server", login->name);
+
+		(void) ldap_pool_conn_close(pc);
+		pc->login = NULL;
+
+		(void) ldap_login_finish(login, false);
+	}
+
+	(void) ldap_pool_dispatch();
+	(void) ldap_cache_expire();
+}
+
+static bool ATHEME_FATTR_WUR
+ldap_auth_user_async(struct myuser *const restrict mu, const char *const restrict password,
+                     struct pwverify_request *const restrict req)
+{
+	if (! ldap_config_ok || ! ldap_config.connections)
+		return false;
+
+	struct ldap_login *const login = smalloc(sizeof *login);
+
+	login->req = req;
+	login->deadline = CURRTIME + (time_t) ldap_config.timeout;
+
+	(void) mowgli_strlcpy(login->name, entity(mu)->name, sizeof login->name);
+	(void) mowgli_strlcpy(login->eid, entity(mu)->id, sizeof login->eid);
+	(void) mowgli_strlcpy(login->password, password, sizeof login->password);
+
+	if (! ldap_name_ok(login->name))
+	{
+		(void) ldap_login_finish(login, false);
+		return true;
+	}
+
+	if (ldap_cache_check(login->eid, password))
+	{
+		(void) ldap_login_finish(login, true);
+		return true;
+	}
+
+	(void) mowgli_node_add(login, &login->node, &ldap_login_queue);
+	(void) ldap_pool_dispatch();
+
+	return true;
+}
+
+// Fails everything in flight; used when the configuration changes or the module goes away
+static void
+ldap_pool_shutdown(void)
+{
+	mowgli_node_t *n, *tn;
+
+	for (unsigned int i = 0; i < LDAP_POOL_MAX; i++)
+	{
+		struct ldap_pool_conn *const pc = &ldap_pool[i];
+		struct ldap_login *const login = pc->login;
+
+		(void) ldap_pool_conn_close(pc);
+		pc->login = NULL;
+
+		if (login)
+			(void) ldap_login_finish(login, false);
+	}
+
+	MOWGLI_ITER_FOREACH_SAFE(n, tn, ldap_login_queue.head)
+	{
+		struct ldap_login *const login = n->data;
+
+		(void) mowgli_node_delete(&login->node, &ldap_login_queue);
+		(void) ldap_login_finish(login, false);
+	}
+}
+
+static void
+ldap_config_ready(void *unused)
+{
 	char *p;
-	static time_t lastwarning;
+
+	// Keep the connections and cached logins unless the ldap{} block changed
+	if (ldap_config_ok && ! conf_block_changed("ldap"))
+		return;
+
+	(void) ldap_pool_shutdown();
+	(void) ldap_cache_clear();
 
 	if (ldap_conn != NULL)
 		ldap_unbind_ext_s(ldap_conn, NULL, NULL);
 	ldap_conn = NULL;
+	ldap_config_ok = false;
+
 	if (ldap_config.url == NULL)
 	{
 		slog(LG_ERROR, "ldap_config_ready(): ldap {} missing url definition");
@@ -85,80 +752,59 @@ ldap_config_ready(void *unused)
 	else
 		ldap_config.useDN = false;
 
+	ldap_config_ok = true;
+
 	ldap_set_option(NULL, LDAP_OPT_PROTOCOL_VERSION, &(const int)
 			{
 			3});
-	res = ldap_initialize(&ldap_conn, ldap_config.url);
-	if (res != LDAP_SUCCESS)
-	{
-		slog(LG_ERROR, "ldap_config_ready(): ldap_initialize(%s) failed: %s", ldap_config.url, ldap_err2string(res));
-		if (CURRTIME > lastwarning + 300)
-		{
-			slog(LG_INFO, "LDAP:ERROR: \2%s\2", ldap_err2string(res));
-			wallops("Problem with LDAP server: %s", ldap_err2string(res));
-			lastwarning = CURRTIME;
-		}
-		return;
-	}
-
-	// short timeouts, because this blocks atheme as a whole
-	ldap_set_option(ldap_conn, LDAP_OPT_TIMEOUT, &(const struct timeval){1, 0});
-	ldap_set_option(ldap_conn, LDAP_OPT_NETWORK_TIMEOUT, &(const struct timeval){1, 0});
-	ldap_set_option(ldap_conn, LDAP_OPT_DEREF, &(const int){false});
-	ldap_set_option(ldap_conn, LDAP_OPT_REFERRALS, &(const int){false});
+	ldap_conn = ldap_open();
 }
 
 static bool
-ldap_auth_user(struct myuser *mu, const char *password)
+ldap_auth_user_blocking(struct myuser *mu, char *password)
 {
 	int res;
 	struct berval cred;
 	LDAPMessage *message, *entry;
 
-	if (ldap_conn == NULL)
-	{
+	if (! ldap_name_ok(entity(mu)->name))
+		return false;
+
+	if (ldap_cache_check(entity(mu)->id, password))
+		return true;
+
+	if (! ldap_config_ok)
 		ldap_config_ready(NULL);
-	}
+	else if (ldap_conn == NULL)
+		ldap_conn = ldap_open();
 	if (ldap_conn == NULL)
 	{
 		slog(LG_INFO, "ldap_auth_user(): no connection");
 		return false;
 	}
 
-	if (strchr(entity(mu)->name, ' '))
-	{
-		slog(LG_INFO, "ldap_auth_user(%s): bad name: found space", entity(mu)->name);
-		return false;
-	}
-	if (strchr(entity(mu)->name, ','))
-	{
-		slog(LG_INFO, "ldap_auth_user(%s): bad name: found comma", entity(mu)->name);
-		return false;
-	}
-	if (strchr(entity(mu)->name, '/'))
-	{
-		slog(LG_INFO, "ldap_auth_user(%s): bad name: found /", entity(mu)->name);
-		return false;
-	}
-
 	if (ldap_config.useDN)
 	{
 		// Use DN to find exact match
 		char dn[512];
 		cred.bv_len = strlen(password);
 
-		// sstrdup it to remove the const
-		cred.bv_val = sstrdup(password);
+		cred.bv_val = password;
 
 		snprintf(dn, sizeof dn, ldap_config.dnformat, entity(mu)->name);
 		res = ldap_sasl_bind_s(ldap_conn, dn, LDAP_SASL_SIMPLE, &cred, NULL, NULL, NULL);
 		if (res == LDAP_SERVER_DOWN)
 		{
-			ldap_config_ready(NULL);
+			ldap_unbind_ext_s(ldap_conn, NULL, NULL);
+			if ((ldap_conn = ldap_open()) == NULL)
+				return false;
 			res = ldap_sasl_bind_s(ldap_conn, dn, LDAP_SASL_SIMPLE, &cred, NULL, NULL, NULL);
 		}
 		if (res == LDAP_SUCCESS)
+		{
+			ldap_cache_add(entity(mu)->id, password);
 			return true;
+		}
 		else if (res == LDAP_INVALID_CREDENTIALS)
 		{
 			slog(LG_INFO, "ldap_auth_user(%s): ldap auth bind failed: %s", entity(mu)->name, ldap_err2string(res));
@@ -173,6 +819,7 @@ ldap_auth_user(struct myuser *mu, const char *password)
 		char what[512];
 		char *binddn = NULL;
 
+		cred.bv_val = NULL;
 		cred.bv_len = 0;
 
 		if (ldap_config.binddn != NULL && ldap_config.bindauth != NULL)
@@ -185,7 +832,9 @@ ldap_auth_user(struct myuser *mu, const char *password)
 		res = ldap_sasl_bind_s(ldap_conn, binddn, LDAP_SASL_SIMPLE, &cred, NULL, NULL, NULL);
 		if (res == LDAP_SERVER_DOWN)
 		{
-			ldap_config_ready(NULL);
+			ldap_unbind_ext_s(ldap_conn, NULL, NULL);
+			if ((ldap_conn = ldap_open()) == NULL)
+				return false;
 			res = ldap_sasl_bind_s(ldap_conn, binddn, LDAP_SASL_SIMPLE, &cred, NULL, NULL, NULL);
 		}
 		if (res != LDAP_SUCCESS)
@@ -194,7 +843,7 @@ ldap_auth_user(struct myuser *mu, const char *password)
 			return false;
 		}
 
-		sprintf(what, "%s=%s", ldap_config.attribute, entity(mu)->name);
+		snprintf(what, sizeof what, "%s=%s", ldap_config.attribute, entity(mu)->name);
 		if ((res = ldap_search_ext_s(ldap_conn, ldap_config.base, LDAP_SCOPE_SUBTREE, what, NULL, 0, NULL, NULL, NULL, 0, &message)) != LDAP_SUCCESS)
 		{
 			slog(LG_INFO, "ldap_auth_user(%s): ldap search failed: %s", entity(mu)->name, ldap_err2string(res));
@@ -203,16 +852,18 @@ ldap_auth_user(struct myuser *mu, const char *password)
 
 		cred.bv_len = strlen(password);
 
-		// sstrdup it to remove the const
-		cred.bv_val = sstrdup(password);
+		cred.bv_val = password;
 
 		for (entry = ldap_first_message(ldap_conn, message); entry && ldap_msgtype(entry) == LDAP_RES_SEARCH_ENTRY; entry = ldap_next_message(ldap_conn, entry))
 		{
+			char *const dn = ldap_get_dn(ldap_conn, entry);
 
-			res = ldap_sasl_bind_s(ldap_conn, ldap_get_dn(ldap_conn, entry), LDAP_SASL_SIMPLE, &cred, NULL, NULL, NULL);
+			res = ldap_sasl_bind_s(ldap_conn, dn, LDAP_SASL_SIMPLE, &cred, NULL, NULL, NULL);
+			ldap_memfree(dn);
 			if (res == LDAP_SUCCESS)
 			{
 				ldap_msgfree(message);
+				ldap_cache_add(entity(mu)->id, password);
 				return true;
 			}
 		}
@@ -224,9 +875,29 @@ ldap_auth_user(struct myuser *mu, const char *password)
 	return false;
 }
 
+static bool ATHEME_FATTR_WUR
+ldap_auth_user(struct myuser *const restrict mu, const char *const restrict password)
+{
+	// libldap wants a modifiable buffer for the credentials
+	char secret[PASSLEN + 1];
+
+	(void) mowgli_strlcpy(secret, password, sizeof secret);
+
+	const bool ret = ldap_auth_user_blocking(mu, secret);
+
+	(void) smemzero(secret, sizeof secret);
+	return ret;
+}
+
 static void
 mod_init(struct module ATHEME_VATTR_UNUSED *const restrict m)
 {
+	for (unsigned int i = 0; i < LDAP_POOL_MAX; i++)
+		ldap_pool[i].msgid = -1;
+
+	(void) atheme_random_buf(ldap_cache_key, sizeof ldap_cache_key);
+	(void) ldap_cache_clear();
+
 	hook_add_config_ready(ldap_config_ready);
 
 	add_subblock_top_conf("LDAP", &conf_ldap_table);
@@ -236,8 +907,14 @@ mod_init(struct module ATHEME_VATTR_UNUSED *const restrict m)
 	add_dupstr_conf_item("ATTRIBUTE", &conf_ldap_table, 0, &ldap_config.attribute, NULL);
 	add_dupstr_conf_item("BINDDN", &conf_ldap_table, 0, &ldap_config.binddn, NULL);
 	add_dupstr_conf_item("BINDAUTH", &conf_ldap_table, 0, &ldap_config.bindauth, NULL);
+	add_uint_conf_item("CONNECTIONS", &conf_ldap_table, 0, &ldap_config.connections, 0, LDAP_POOL_MAX, LDAP_POOL_DEF);
+	add_uint_conf_item("TIMEOUT", &conf_ldap_table, 0, &ldap_config.timeout, 1, 60, LDAP_TIMEOUT_DEF);
+	add_duration_conf_item("CACHE_TIME", &conf_ldap_table, 0, &ldap_config.cache_time, "s", LDAP_CACHE_TIME_DEF);
+
+	ldap_tick_timer = timer_add("ldap_tick", &ldap_tick, NULL, 1);
 
 	auth_user_custom = &ldap_auth_user;
+	auth_user_custom_async = &ldap_auth_user_async;
 
 	auth_module_loaded = true;
 }
@@ -246,9 +923,15 @@ static void
 mod_deinit(const enum module_unload_intent ATHEME_VATTR_UNUSED intent)
 {
 	auth_user_custom = NULL;
+	auth_user_custom_async = NULL;
 
 	auth_module_loaded = false;
 
+	(void) timer_destroy(ldap_tick_timer);
+	(void) ldap_pool_shutdown();
+	(void) mowgli_patricia_destroy(ldap_cache, &ldap_cache_entry_free, NULL);
+	(void) smemzero(ldap_cache_key, sizeof ldap_cache_key);
+
 	if (ldap_conn != NULL)
 		ldap_unbind_ext_s(ldap_conn, NULL, NULL);
 
@@ -259,6 +942,9 @@ mod_deinit(const enum module_unload_intent ATHEME_VATTR_UNUSED intent)
 	del_conf_item("ATTRIBUTE", &conf_ldap_table);
 	del_conf_item("BINDDN", &conf_ldap_table);
 	del_conf_item("BINDAUTH", &conf_ldap_table);
+	del_conf_item("CONNECTIONS", &conf_ldap_table);
+	del_conf_item("TIMEOUT", &conf_ldap_table);
+	del_conf_item("CACHE_TIME", &conf_ldap_table);
 	del_top_conf("LDAP");
 }
 
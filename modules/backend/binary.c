@@ -0,0 +1,959 @@
+/*
+ * SPDX-License-Identifier: ISC
+ * SPDX-URL: https://spdx.org/licenses/ISC.html
+ *
+ * Copyright (C) 2026 Atheme Development Group (https://atheme.github.io/)
+ *
+ * This file contains a binary database backend for Atheme.  It holds the
+ * same rows as OpenSEX, but every row is length-prefixed and every cell is
+ * tagged, numbers are stored as varints, and row types are numbered the
+ * first time they are written, so loading never has to scan for separators
+ * or look a row type up more than once.
+ *
+ * File layout:  BINARY_MAGIC, then records of <varint length> <payload>.
+ * A payload starts with the varint type ID; ID 0 defines a new type (its
+ * varint ID followed by the type name), anything else is a row of cells.
+ * Cells are a tag byte followed by a varint (numbers) or by a varint
+ * length and that many bytes (words and strings).
+ *
+ * Use dbverify -o binary to convert an OpenSEX database (and -i binary
+ * -o opensex to convert back).
+ */
+
+#include <atheme.h>
+
+#define BINARY_MAGIC            "\x89" "ATHBDB\n"
+#define BINARY_MAGIC_LEN        8U
+
+#define BINARY_CELL_WORD        'w'
+#define BINARY_CELL_STR         's'
+#define BINARY_CELL_INT         'i'
+#define BINARY_CELL_UINT        'u'
+#define BINARY_CELL_TIME        't'
+
+#define BINARY_TYPE_DEFINE      0U
+
+#define BINARY_TYPEID_BUCKETS   64U
+
+struct binary_cell
+{
+	unsigned char   kind;
+	char *          str;
+	uint64_t        num;
+	char            text[24];
+};
+
+struct binary_type
+{
+	char *                  name;
+	database_handler_fn     fun;
+};
+
+/* The writer keeps its own small hash of type names instead of a patricia, so
+ * that it never touches the (unlocked) mowgli heaps and can run on the
+ * corestorage writer thread.
+ */
+struct binary_typeid
+{
+	struct binary_typeid *  next;
+	unsigned int            id;
+	char                    name[];
+};
+
+struct binary
+{
+	FILE *                  f;
+	struct db_output        out;
+
+	// Reading state
+	char *                  inflated;       // the decompressed file f reads from, if it was compressed
+	unsigned char *         buf;
+	size_t                  bufsize;
+	struct binary_cell *    cells;
+	unsigned int            ncells;
+	unsigned int            cellsalloc;
+	unsigned int            cur;
+	char *                  rest;
+	size_t                  restsize;
+	struct binary_type *    types;
+	unsigned int            ntypes;
+	unsigned int            rowtype;
+
+	// Writing state
+	struct binary_typeid *  typeids[BINARY_TYPEID_BUCKETS];
+	unsigned int            nexttype;
+	const char *            lasttype;
+	unsigned int            lasttypeid;
+	unsigned char *         row;
+	size_t                  rowlen;
+	size_t                  rowsize;
+};
+
+#ifdef HAVE_FLOCK
+static int lockfd;
+#endif
+
+static inline uint64_t
+binary_zigzag(const int64_t num)
+{
+	return ((uint64_t) num << 1) ^ (uint64_t) (num >> 63);
+}
+
+static inline int64_t
+binary_unzigzag(const uint64_t num)
+{
+	return (int64_t) (num >> 1) ^ -(int64_t) (num & 1U);
+}
+
+/*****************
+ * R E A D I N G *
+ *****************/
+
+static bool
+binary_decode_varint(const unsigned char **const restrict p, const unsigned char *const restrict end, uint64_t *const restrict res)
+{
+	uint64_t num = 0;
+	unsigned int shift;
+
+	for (shift = 0; *p < end && shift < 64U; shift += 7U)
+	{
+		const unsigned char c = *(*p)++;
+
+		num |= (uint64_t) (c & 0x7FU) << shift;
+
+		if (! (c & 0x80U))
+		{
+			*res = num;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static bool
+binary_getc_varint(FILE *const restrict f, uint64_t *const restrict res)
+{
+	uint64_t num = 0;
+	unsigned int shift;
+	int c;
+
+	for (shift = 0; shift < 64U && (c = getc(f)) != EOF; shift += 7U)
+	{
+		num |= (uint64_t) (c & 0x7F) << shift;
+
+		if (! (c & 0x80))
+		{
+			*res = num;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static void ATHEME_FATTR_NORETURN
+binary_corrupt(struct database_handle *const restrict db, const char *const restrict what)
+{
+	slog(LG_ERROR, "binary-read-next-row: %s at %s record %u", what, db->file, db->line);
+	slog(LG_ERROR, "binary-read-next-row: exiting to avoid data loss");
+	exit(EXIT_FAILURE);
+}
+
+static void
+binary_define_type(struct database_handle *const restrict db, const unsigned char *p, const unsigned char *const end)
+{
+	struct binary *const bs = db->priv;
+	uint64_t id;
+
+	if (! binary_decode_varint(&p, end, &id) || id == BINARY_TYPE_DEFINE || id > bs->ntypes + 1U || p == end)
+		binary_corrupt(db, "bad type definition");
+
+	if (id > bs->ntypes)
+	{
+		bs->types = srealloc(bs->types, (id + 1U) * sizeof *bs->types);
+		bs->types[id].name = NULL;
+		bs->ntypes = (unsigned int) id;
+	}
+
+	sfree(bs->types[id].name);
+
+	bs->types[id].name = smalloc((size_t) (end - p) + 1U);
+	(void) memcpy(bs->types[id].name, p, (size_t) (end - p));
+	bs->types[id].name[end - p] = '\0';
+
+	// NULL (not the ??? handler), so that rows of a type whose module an MDEP loads later can still find it
+	bs->types[id].fun = db_resolve_type_handler(bs->types[id].name);
+}
+
+static bool
+binary_read_next_row(struct database_handle *const restrict hdl)
+{
+	struct binary *const bs = hdl->priv;
+
+	for (;;)
+	{
+		const unsigned char *p, *end;
+		uint64_t len, type;
+
+		if (! binary_getc_varint(bs->f, &len))
+		{
+			if (ferror(bs->f))
+			{
+				slog(LG_ERROR, "binary-read-next-row: error at %s record %u: %s", hdl->file, hdl->line, strerror(errno));
+				slog(LG_ERROR, "binary-read-next-row: exiting to avoid data loss");
+				exit(EXIT_FAILURE);
+			}
+
+			return false;
+		}
+
+		hdl->line++;
+		hdl->token = 0;
+
+		if (len >= SIZE_MAX / 2U)
+			binary_corrupt(hdl, "bad record length");
+
+		// one spare byte so the last cell can be terminated in place
+		if (len + 1U > bs->bufsize)
+		{
+			while (len + 1U > bs->bufsize)
+				bs->bufsize *= 2U;
+
+			bs->buf = srealloc(bs->buf, bs->bufsize);
+		}
+
+		if (fread(bs->buf, 1, (size_t) len, bs->f) != (size_t) len)
+			binary_corrupt(hdl, "truncated record");
+
+		p = bs->buf;
+		end = bs->buf + len;
+
+		if (! binary_decode_varint(&p, end, &type))
+			binary_corrupt(hdl, "bad row type");
+
+		if (type == BINARY_TYPE_DEFINE)
+		{
+			binary_define_type(hdl, p, end);
+			continue;
+		}
+
+		if (type > bs->ntypes || bs->types[type].name == NULL)
+			binary_corrupt(hdl, "undefined row type");
+
+		bs->rowtype = (unsigned int) type;
+		bs->ncells = 0;
+		bs->cur = 0;
+
+		while (p < end)
+		{
+			struct binary_cell *cell;
+			uint64_t num;
+
+			if (bs->ncells == bs->cellsalloc)
+			{
+				bs->cellsalloc *= 2U;
+				bs->cells = srealloc(bs->cells, bs->cellsalloc * sizeof *bs->cells);
+			}
+
+			cell = &bs->cells[bs->ncells++];
+			cell->kind = *p++;
+
+			if (! binary_decode_varint(&p, end, &num))
+				binary_corrupt(hdl, "bad cell");
+
+			switch (cell->kind)
+			{
+				case BINARY_CELL_WORD:
+				case BINARY_CELL_STR:
+					if (num > (uint64_t) (end - p))
+						binary_corrupt(hdl, "bad cell length");
+
+					cell->str = (char *) bs->buf + (p - bs->buf);
+					cell->num = num;
+					p += num;
+					break;
+
+				case BINARY_CELL_INT:
+				case BINARY_CELL_UINT:
+				case BINARY_CELL_TIME:
+					cell->str = NULL;
+					cell->num = num;
+					break;
+
+				default:
+					binary_corrupt(hdl, "bad cell type");
+			}
+		}
+
+		// every tag byte has been decoded, so terminate the strings over them
+		for (unsigned int i = 0; i < bs->ncells; i++)
+			if (bs->cells[i].str != NULL)
+				bs->cells[i].str[bs->cells[i].num] = '\0';
+
+		return true;
+	}
+}
+
+static void
+binary_db_parse(struct database_handle *const restrict db)
+{
+	struct binary *const bs = db->priv;
+
+	while (db_read_next_row(db))
+	{
+		struct binary_type *const type = &bs->types[bs->rowtype];
+
+		if (type->fun != NULL || (type->fun = db_resolve_type_handler(type->name)) != NULL)
+			db_process_resolved(db, type->name, type->fun);
+		else
+			db_process(db, type->name);
+	}
+}
+
+// The text of a cell, as OpenSEX would have read it
+static char *
+binary_cell_text(struct binary_cell *const restrict cell)
+{
+	switch (cell->kind)
+	{
+		case BINARY_CELL_INT:
+			(void) snprintf(cell->text, sizeof cell->text, "%d", (int) binary_unzigzag(cell->num));
+			break;
+
+		case BINARY_CELL_UINT:
+			(void) snprintf(cell->text, sizeof cell->text, "%u", (unsigned int) cell->num);
+			break;
+
+		case BINARY_CELL_TIME:
+			(void) snprintf(cell->text, sizeof cell->text, "%lu", (unsigned long) cell->num);
+			break;
+
+		default:
+			return cell->str;
+	}
+
+	return cell->text;
+}
+
+static const char *
+binary_read_word(struct database_handle *const restrict db)
+{
+	struct binary *const bs = db->priv;
+	struct binary_cell *cell;
+	char *res, *ptr;
+
+	if (bs->cur >= bs->ncells)
+		return NULL;
+
+	cell = &bs->cells[bs->cur];
+	db->token++;
+
+	if (cell->kind != BINARY_CELL_STR)
+	{
+		bs->cur++;
+		return binary_cell_text(cell);
+	}
+
+	// a multi-word string read word by word, like OpenSEX allows
+	res = cell->str;
+
+	if ((ptr = strchr(res, ' ')) != NULL)
+	{
+		*ptr++ = '\0';
+		cell->str = ptr;
+	}
+	else
+		bs->cur++;
+
+	return res;
+}
+
+static const char *
+binary_read_str(struct database_handle *const restrict db)
+{
+	struct binary *const bs = db->priv;
+	size_t len = 0;
+
+	if (bs->cur >= bs->ncells)
+		return NULL;
+
+	db->token++;
+
+	if (bs->cur + 1U == bs->ncells)
+		return binary_cell_text(&bs->cells[bs->cur]);
+
+	// words written one by one but read back as the rest of the row
+	for (unsigned int i = bs->cur; i < bs->ncells; i++)
+	{
+		const char *const text = binary_cell_text(&bs->cells[i]);
+		const size_t textlen = strlen(text);
+
+		if (len + textlen + 2U > bs->restsize)
+		{
+			bs->restsize = (len + textlen + 2U) * 2U;
+			bs->rest = srealloc(bs->rest, bs->restsize);
+		}
+
+		if (len)
+			bs->rest[len++] = ' ';
+
+		(void) memcpy(bs->rest + len, text, textlen);
+		len += textlen;
+	}
+
+	bs->rest[len] = '\0';
+
+	return bs->rest;
+}
+
+static bool
+binary_read_num(struct database_handle *const restrict db, const unsigned char kind, uint64_t *const restrict res)
+{
+	struct binary *const bs = db->priv;
+	struct binary_cell *cell;
+
+	if (bs->cur >= bs->ncells)
+		return false;
+
+	cell = &bs->cells[bs->cur];
+
+	if (cell->kind != kind)
+		return false;
+
+	bs->cur++;
+	db->token++;
+
+	*res = cell->num;
+	return true;
+}
+
+static bool
+binary_read_int(struct database_handle *const restrict db, int *const restrict res)
+{
+	uint64_t num;
+	const char *s;
+	char *rp;
+
+	if (binary_read_num(db, BINARY_CELL_INT, &num))
+	{
+		*res = (int) binary_unzigzag(num);
+		return true;
+	}
+
+	if (! (s = db_read_word(db)))
+		return false;
+
+	*res = strtol(s, &rp, 0);
+	return *s && !*rp;
+}
+
+static bool
+binary_read_uint(struct database_handle *const restrict db, unsigned int *const restrict res)
+{
+	uint64_t num;
+	const char *s;
+	char *rp;
+
+	if (binary_read_num(db, BINARY_CELL_UINT, &num))
+	{
+		*res = (unsigned int) num;
+		return true;
+	}
+
+	if (! (s = db_read_word(db)))
+		return false;
+
+	*res = strtoul(s, &rp, 0);
+	return *s && !*rp;
+}
+
+static bool
+binary_read_time(struct database_handle *const restrict db, time_t *const restrict res)
+{
+	uint64_t num;
+	const char *s;
+	char *rp;
+
+	if (binary_read_num(db, BINARY_CELL_TIME, &num))
+	{
+		*res = (time_t) num;
+		return true;
+	}
+
+	if (! (s = db_read_word(db)))
+		return false;
+
+	*res = strtoul(s, &rp, 0);
+	return *s && !*rp;
+}
+
+/*****************
+ * W R I T I N G *
+ *****************/
+
+static void
+binary_put(struct binary *const restrict bs, const void *const restrict data, const size_t len)
+{
+	if (bs->rowlen + len > bs->rowsize)
+	{
+		while (bs->rowlen + len > bs->rowsize)
+			bs->rowsize *= 2U;
+
+		bs->row = srealloc(bs->row, bs->rowsize);
+	}
+
+	(void) memcpy(bs->row + bs->rowlen, data, len);
+	bs->rowlen += len;
+}
+
+static void
+binary_put_varint(struct binary *const restrict bs, uint64_t num)
+{
+	unsigned char buf[10];
+	size_t len = 0;
+
+	do
+	{
+		buf[len] = num & 0x7FU;
+		num >>= 7;
+
+		if (num)
+			buf[len] |= 0x80U;
+
+		len++;
+	} while (num);
+
+	binary_put(bs, buf, len);
+}
+
+static void
+binary_flush_row(struct binary *const restrict bs)
+{
+	unsigned char buf[10];
+	size_t len = 0;
+	uint64_t num = bs->rowlen;
+
+	do
+	{
+		buf[len++] = (num & 0x7FU) | ((num > 0x7FU) ? 0x80U : 0U);
+		num >>= 7;
+	} while (num);
+
+	db_output_write(&bs->out, buf, len);
+	db_output_write(&bs->out, bs->row, bs->rowlen);
+
+	bs->rowlen = 0;
+}
+
+static unsigned int
+binary_typeid_bucket(const char *type)
+{
+	// FNV-1a
+	uint32_t hash = 0x811C9DC5U;
+
+	for (; *type; type++)
+		hash = (hash ^ (unsigned char) *type) * 0x01000193U;
+
+	return hash % BINARY_TYPEID_BUCKETS;
+}
+
+static bool
+binary_start_row(struct database_handle *const restrict db, const char *const restrict type)
+{
+	struct binary *bs;
+	struct binary_typeid *ti;
+	unsigned int bucket;
+	unsigned int id;
+
+	return_val_if_fail(db != NULL, false);
+	return_val_if_fail(type != NULL, false);
+	bs = db->priv;
+
+	// rows of the same type usually come in runs
+	if (type == bs->lasttype)
+		goto start;
+
+	bucket = binary_typeid_bucket(type);
+
+	for (ti = bs->typeids[bucket]; ti != NULL; ti = ti->next)
+		if (strcmp(ti->name, type) == 0)
+			break;
+
+	if (ti != NULL)
+		id = ti->id;
+	else
+	{
+		const size_t len = strlen(type);
+
+		id = ++bs->nexttype;
+
+		ti = smalloc(sizeof *ti + len + 1U);
+		ti->id = id;
+		(void) memcpy(ti->name, type, len + 1U);
+		ti->next = bs->typeids[bucket];
+		bs->typeids[bucket] = ti;
+
+		bs->rowlen = 0;
+		binary_put_varint(bs, BINARY_TYPE_DEFINE);
+		binary_put_varint(bs, id);
+		binary_put(bs, type, len);
+		binary_flush_row(bs);
+	}
+
+	bs->lasttype = type;
+	bs->lasttypeid = id;
+
+start:
+	bs->rowlen = 0;
+	binary_put_varint(bs, bs->lasttypeid);
+
+	return true;
+}
+
+static bool
+binary_write_cell(struct database_handle *const restrict db, const unsigned char kind, const char *data)
+{
+	struct binary *bs;
+	size_t len;
+
+	return_val_if_fail(db != NULL, false);
+	bs = db->priv;
+
+	if (data == NULL)
+		data = "*";
+
+	len = strlen(data);
+
+	binary_put(bs, &kind, 1);
+	binary_put_varint(bs, len);
+	binary_put(bs, data, len);
+
+	return true;
+}
+
+static bool
+binary_write_word(struct database_handle *const restrict db, const char *const restrict word)
+{
+	return binary_write_cell(db, BINARY_CELL_WORD, word);
+}
+
+static bool
+binary_write_str(struct database_handle *const restrict db, const char *const restrict str)
+{
+	return binary_write_cell(db, BINARY_CELL_STR, str);
+}
+
+static bool
+binary_write_num(struct database_handle *const restrict db, const unsigned char kind, const uint64_t num)
+{
+	struct binary *bs;
+
+	return_val_if_fail(db != NULL, false);
+	bs = db->priv;
+
+	binary_put(bs, &kind, 1);
+	binary_put_varint(bs, num);
+
+	return true;
+}
+
+static bool
+binary_write_int(struct database_handle *const restrict db, const int num)
+{
+	return binary_write_num(db, BINARY_CELL_INT, binary_zigzag(num));
+}
+
+static bool
+binary_write_uint(struct database_handle *const restrict db, const unsigned int num)
+{
+	return binary_write_num(db, BINARY_CELL_UINT, num);
+}
+
+static bool
+binary_write_time(struct database_handle *const restrict db, const time_t tm)
+{
+	return binary_write_num(db, BINARY_CELL_TIME, (unsigned long) tm);
+}
+
+static bool
+binary_commit_row(struct database_handle *const restrict db)
+{
+	return_val_if_fail(db != NULL, false);
+
+	binary_flush_row(db->priv);
+
+	return true;
+}
+
+static const struct database_vtable binary_vt = {
+	.name = "binary",
+	.read_next_row = binary_read_next_row,
+	.read_word = binary_read_word,
+	.read_str = binary_read_str,
+	.read_int = binary_read_int,
+	.read_uint = binary_read_uint,
+	.read_time = binary_read_time,
+	.start_row = binary_start_row,
+	.write_word = binary_write_word,
+	.write_str = binary_write_str,
+	.write_int = binary_write_int,
+	.write_uint = binary_write_uint,
+	.write_time = binary_write_time,
+	.commit_row = binary_commit_row
+};
+
+static struct database_handle * ATHEME_FATTR_MALLOC
+binary_db_open_read(const char *filename)
+{
+	struct database_handle *db;
+	struct binary *bs;
+	FILE *f;
+	int errno1;
+	char path[BUFSIZE];
+	char magic[BINARY_MAGIC_LEN];
+
+	snprintf(path, BUFSIZE, "%s/%s", datadir, filename != NULL ? filename : "services.db");
+	f = fopen(path, "rb");
+	if (!f)
+	{
+		errno1 = errno;
+
+		// ENOENT can happen if the database does not exist yet.
+		if (errno == ENOENT)
+		{
+			if (database_create)
+			{
+				slog(LG_INFO, "db-open-read: database '%s' does not yet exist; a new one will be created.", path);
+				return NULL;
+			}
+			else
+			{
+				slog(LG_ERROR, "db-open-read: database '%s' does not yet exist; please specify the -b option to create a new one.", path);
+				exit(EXIT_FAILURE);
+			}
+		}
+
+		slog(LG_ERROR, "db-open-read: cannot open '%s' for reading: %s", path, strerror(errno1));
+		wallops("\2DATABASE ERROR\2: db-open-read: cannot open '%s' for reading: %s", path, strerror(errno1));
+		exit(EXIT_FAILURE);
+	}
+	else if (database_create)
+	{
+		slog(LG_ERROR, "db-open-read: database '%s' already exists, but you specified the -b option to create a new one; please remove the old database first", path);
+		exit(EXIT_FAILURE);
+	}
+
+	size_t inflatedlen;
+	char *const inflated = db_input_decompress(f, path, &inflatedlen);
+
+	if (inflated != NULL)
+	{
+		(void) fclose(f);
+
+#ifdef HAVE_FMEMOPEN
+		f = fmemopen(inflated, inflatedlen, "rb");
+#else
+		if ((f = tmpfile()) != NULL && (fwrite(inflated, 1, inflatedlen, f) != inflatedlen || fseek(f, 0, SEEK_SET) != 0))
+		{
+			(void) fclose(f);
+			f = NULL;
+		}
+#endif
+
+		if (! f)
+		{
+			slog(LG_ERROR, "db-open-read: cannot read decompressed '%s': %s", path, strerror(errno));
+			exit(EXIT_FAILURE);
+		}
+
+#ifndef HAVE_FMEMOPEN
+		sfree(inflated);
+#endif
+	}
+
+	if (fread(magic, 1, sizeof magic, f) != sizeof magic || memcmp(magic, BINARY_MAGIC, sizeof magic) != 0)
+	{
+		slog(LG_ERROR, "db-open-read: database '%s' is not in the binary format; convert it with dbverify -o binary first", path);
+		exit(EXIT_FAILURE);
+	}
+
+	bs = smalloc(sizeof *bs);
+	bs->f = f;
+#ifdef HAVE_FMEMOPEN
+	bs->inflated = inflated;
+#endif
+	bs->bufsize = 512;
+	bs->buf = smalloc(bs->bufsize);
+	bs->cellsalloc = 16;
+	bs->cells = smalloc(bs->cellsalloc * sizeof *bs->cells);
+	bs->types = smalloc(sizeof *bs->types);
+
+	db = smalloc(sizeof *db);
+	db->priv = bs;
+	db->vt = &binary_vt;
+	db->txn = DB_READ;
+	db->file = sstrdup(path);
+
+	return db;
+}
+
+static struct database_handle * ATHEME_FATTR_MALLOC
+binary_db_open_write(const char *filename)
+{
+	struct database_handle *db;
+	struct binary *bs;
+	struct db_output out;
+	int fd;
+	int errno1;
+	char bpath[BUFSIZE], path[BUFSIZE];
+#ifdef HAVE_FLOCK
+	char lpath[BUFSIZE];
+#endif
+
+	snprintf(bpath, BUFSIZE, "%s/%s", datadir, filename != NULL ? filename : "services.db");
+
+	mowgli_strlcpy(path, bpath, sizeof path);
+	mowgli_strlcat(path, ".new", sizeof path);
+
+#ifdef HAVE_FLOCK
+	mowgli_strlcpy(lpath, bpath, sizeof lpath);
+	mowgli_strlcat(lpath, ".lock", sizeof lpath);
+
+	lockfd = open(lpath, O_RDONLY | O_CREAT, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
+
+	flock(lockfd, LOCK_EX);
+#endif
+
+	fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
+	if (fd < 0 || ! db_output_open(&out, fd, path))
+	{
+		errno1 = errno;
+		slog(LG_ERROR, "db-open-write: cannot open '%s' for writing: %s", path, strerror(errno1));
+		wallops("\2DATABASE ERROR\2: db-open-write: cannot open '%s' for writing: %s", path, strerror(errno1));
+#ifdef HAVE_FLOCK
+		close(lockfd);
+#endif
+		return NULL;
+	}
+
+	bs = smalloc(sizeof *bs);
+	bs->out = out;
+	bs->rowsize = 512;
+	bs->row = smalloc(bs->rowsize);
+
+	db = smalloc(sizeof *db);
+	db->priv = bs;
+	db->vt = &binary_vt;
+	db->txn = DB_WRITE;
+	db->file = sstrdup(bpath);
+
+	db_output_write(&bs->out, BINARY_MAGIC, BINARY_MAGIC_LEN);
+
+	return db;
+}
+
+static struct database_handle *
+binary_db_open(const char *filename, enum database_transaction txn)
+{
+	if (txn == DB_WRITE)
+		return binary_db_open_write(filename);
+	return binary_db_open_read(filename);
+}
+
+static void
+binary_db_close(struct database_handle *db)
+{
+	struct binary *bs;
+	int errno1;
+	char oldpath[BUFSIZE], newpath[BUFSIZE];
+
+	return_if_fail(db != NULL);
+	bs = db->priv;
+
+	mowgli_strlcpy(oldpath, db->file, sizeof oldpath);
+	mowgli_strlcat(oldpath, ".new", sizeof oldpath);
+
+	mowgli_strlcpy(newpath, db->file, sizeof newpath);
+
+	if (db->txn == DB_WRITE)
+	{
+		if (! db_output_close(&bs->out))
+		{
+			errno1 = errno;
+			slog(LG_ERROR, "db_save(): cannot write %s: %s", oldpath, strerror(errno1));
+			wallops("\2DATABASE ERROR\2: db_save(): cannot write %s: %s", oldpath, strerror(errno1));
+		}
+	}
+	else
+		fclose(bs->f);
+
+	if (db->txn == DB_WRITE)
+	{
+		// now, replace the old database with the new one, using an atomic rename
+		if (srename(oldpath, newpath) < 0)
+		{
+			errno1 = errno;
+			slog(LG_ERROR, "db_save(): cannot rename services.db.new to services.db: %s", strerror(errno1));
+			wallops("\2DATABASE ERROR\2: db_save(): cannot rename services.db.new to services.db: %s", strerror(errno1));
+		}
+
+		hook_call_db_saved();
+#ifdef HAVE_FLOCK
+		close(lockfd);
+#endif
+		for (unsigned int i = 0; i < BINARY_TYPEID_BUCKETS; i++)
+		{
+			struct binary_typeid *ti, *next;
+
+			for (ti = bs->typeids[i]; ti != NULL; ti = next)
+			{
+				next = ti->next;
+				sfree(ti);
+			}
+		}
+
+		sfree(bs->row);
+	}
+	else
+	{
+		for (unsigned int i = 1; i <= bs->ntypes; i++)
+			sfree(bs->types[i].name);
+
+		sfree(bs->types);
+		sfree(bs->cells);
+		sfree(bs->rest);
+		sfree(bs->buf);
+		sfree(bs->inflated);
+	}
+
+	sfree(bs);
+	sfree(db->file);
+	sfree(db);
+}
+
+static const struct database_module binary_mod = {
+	.db_open = binary_db_open,
+	.db_close = binary_db_close,
+	.db_parse = binary_db_parse,
+};
+
+static void
+mod_init(struct module *const restrict m)
+{
+	MODULE_TRY_REQUEST_DEPENDENCY(m, "backend/corestorage")
+
+	db_mod = &binary_mod;
+
+	backend_loaded = true;
+
+	m->mflags |= MODFLAG_DBHANDLER;
+}
+
+static void
+mod_deinit(const enum module_unload_intent ATHEME_VATTR_UNUSED intent)
+{
+
+}
+
+SIMPLE_DECLARE_MODULE_V1("backend/binary", MODULE_UNLOAD_CAPABILITY_NEVER)
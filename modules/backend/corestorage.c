@@ -20,6 +20,10 @@
 
 #include <atheme.h>
 
+#ifdef HAVE_USABLE_PTHREAD
+#  include <pthread.h>
+#endif
+
 // MDEPs to write to the database on commit, for reloading on startup
 #define MODFLAG_PRIV_MDEP       (MODFLAG_DBCRYPTO | MODFLAG_DBHANDLER)
 
@@ -28,10 +32,72 @@ static unsigned int their_ca_all;
 
 static bool mdep_load_mdeps = true;
 
+// While reading the database: the rows for what the warm restart image had are skipped
+static bool corestorage_warm = false;
+
 #ifdef HAVE_FORK
 static pid_t child_pid;
+static struct timeval child_started;
+static enum db_save_strategy child_strategy;
 #endif
 
+#ifdef HAVE_USABLE_PTHREAD
+
+/* A threaded save serializes every row into one of these on the main loop
+ * (cheap: no formatting and no I/O, so the snapshot is consistent), then
+ * replays it into the real backend handle on the writer thread.
+ */
+enum corestorage_snapshot_op
+{
+	SNAPSHOT_ROW = 'R',
+	SNAPSHOT_WORD = 'w',
+	SNAPSHOT_WORD_NULL = 'W',
+	SNAPSHOT_STR = 's',
+	SNAPSHOT_STR_NULL = 'S',
+	SNAPSHOT_INT = 'i',
+	SNAPSHOT_UINT = 'u',
+	SNAPSHOT_TIME = 't',
+	SNAPSHOT_COMMIT = 'E',
+};
+
+struct corestorage_snapshot
+{
+	unsigned char *         buf;
+	size_t                  len;
+	size_t                  size;
+
+	// row types are interned so the backend sees one pointer per type
+	mowgli_patricia_t *     typeids;
+	char **                 types;
+	unsigned int            ntypes;
+	unsigned int            typesalloc;
+};
+
+struct corestorage_writer
+{
+	pthread_t                       thread;
+	pthread_mutex_t                 lock;
+	bool                            done;       // protected by lock
+	struct corestorage_snapshot     snap;
+	struct database_handle *        db;
+	char *                          filename;
+	mowgli_eventloop_timer_t *      timer;
+	struct timeval                  started;
+	enum db_save_strategy           strategy;
+};
+
+static struct corestorage_writer *writer = NULL;
+
+#endif /* HAVE_USABLE_PTHREAD */
+
+/* The heaps whose object counts are written to the CNT row, so that loading
+ * can size them up front (see named_heap_presize()); the strshare table is
+ * sized from the "strings" count.
+ */
+static const char *const corestorage_presize_heaps[] = {
+	"myuser", "mynick", "myuser_name", "mycertfp", "mychan", "chanacs", "metadata",
+};
+
 // write atheme.db (core fields)
 static void
 corestorage_db_save(struct database_handle *db)
@@ -50,6 +116,7 @@ corestorage_db_save(struct database_handle *db)
 	mowgli_node_t *n, *tn;
 	mowgli_patricia_iteration_state_t state;
 	struct myentity_iteration_state mestate;
+	struct metadata_iteration_state mdstate;
 
 	errno = 0;
 
@@ -58,6 +125,21 @@ corestorage_db_save(struct database_handle *db)
 	db_write_uint(db, 12);
 	db_commit_row(db);
 
+	// how many objects of each kind follow
+	struct strshare_stats ss;
+
+	strshare_get_stats(&ss);
+
+	db_start_row(db, "CNT");
+	for (size_t i = 0; i < ARRAY_SIZE(corestorage_presize_heaps); i++)
+	{
+		db_write_word(db, corestorage_presize_heaps[i]);
+		db_write_uint(db, (unsigned int) named_heap_count(corestorage_presize_heaps[i]));
+	}
+	db_write_word(db, "strings");
+	db_write_uint(db, (unsigned int) ss.unique);
+	db_commit_row(db);
+
 	MOWGLI_ITER_FOREACH(n, modules.head)
 	{
 		const struct module *const m = n->data;
@@ -74,6 +156,16 @@ corestorage_db_save(struct database_handle *db)
 	db_write_word(db, myentity_get_last_uid());
 	db_commit_row(db);
 
+	// memos in the store are written as offsets into it; these must be on disk first
+	if (memostore_in_use())
+	{
+		memostore_sync();
+
+		db_start_row(db, "MEG");
+		db_write_uint(db, memostore_generation());
+		db_commit_row(db);
+	}
+
 	db_start_row(db, "CF");
 	db_write_word(db, bitmask_to_flags(ca_all));
 	db_commit_row(db);
@@ -102,7 +194,7 @@ corestorage_db_save(struct database_handle *db)
 
 		if (atheme_object(mu)->metadata)
 		{
-			MOWGLI_PATRICIA_FOREACH(md, &state, atheme_object(mu)->metadata)
+			METADATA_FOREACH(md, &mdstate, mu)
 			{
 				db_start_row(db, "MDU");
 				db_write_word(db, entity(mu)->name);
@@ -116,6 +208,23 @@ corestorage_db_save(struct database_handle *db)
 		{
 			struct mymemo *mz = (struct mymemo *)tn->data;
 
+			if (mz->text == NULL)
+			{
+				char offset[BUFSIZE];
+
+				(void) snprintf(offset, sizeof offset, "%llu", (unsigned long long) mz->store_offset);
+
+				db_start_row(db, "MO");
+				db_write_word(db, entity(mu)->name);
+				db_write_word(db, mz->sender);
+				db_write_time(db, mz->sent);
+				db_write_uint(db, mz->status);
+				db_write_word(db, offset);
+				db_write_uint(db, mz->store_len);
+				db_commit_row(db);
+				continue;
+			}
+
 			db_start_row(db, "ME");
 			db_write_word(db, entity(mu)->name);
 			db_write_word(db, mz->sender);
@@ -127,9 +236,11 @@ corestorage_db_save(struct database_handle *db)
 
 		MOWGLI_ITER_FOREACH(tn, mu->memo_ignores.head)
 		{
+			const struct memo_ignore *const mi = tn->data;
+
 			db_start_row(db, "MI");
 			db_write_word(db, entity(mu)->name);
-			db_write_word(db, (char *)tn->data);
+			db_write_word(db, entity(mi->target)->name);
 			db_commit_row(db);
 		}
 
@@ -171,7 +282,6 @@ corestorage_db_save(struct database_handle *db)
 
 	MOWGLI_PATRICIA_FOREACH(mc, &state, mclist)
 	{
-		mowgli_patricia_iteration_state_t state2;
 
 		char *flags = gflags_tostr(mc_flags, mc->flags);
 
@@ -219,7 +329,7 @@ corestorage_db_save(struct database_handle *db)
 
 			if (atheme_object(ca)->metadata)
 			{
-				MOWGLI_PATRICIA_FOREACH(md, &state2, atheme_object(ca)->metadata)
+				METADATA_FOREACH(md, &mdstate, ca)
 				{
 					db_start_row(db, "MDA");
 					db_write_word(db, ca->mychan->name);
@@ -233,7 +343,7 @@ corestorage_db_save(struct database_handle *db)
 
 		if (atheme_object(mc)->metadata)
 		{
-			MOWGLI_PATRICIA_FOREACH(md, &state2, atheme_object(mc)->metadata)
+			METADATA_FOREACH(md, &mdstate, mc)
 			{
 				db_start_row(db, "MDC");
 				db_write_word(db, mc->name);
@@ -247,7 +357,6 @@ corestorage_db_save(struct database_handle *db)
 	// Old names
 	MOWGLI_PATRICIA_FOREACH(mun, &state, oldnameslist)
 	{
-		mowgli_patricia_iteration_state_t state2;
 
 		db_start_row(db, "NAM");
 		db_write_word(db, mun->name);
@@ -255,7 +364,7 @@ corestorage_db_save(struct database_handle *db)
 
 		if (atheme_object(mun)->metadata)
 		{
-			MOWGLI_PATRICIA_FOREACH(md, &state2, atheme_object(mun)->metadata)
+			METADATA_FOREACH(md, &mdstate, mun)
 			{
 				db_start_row(db, "MDN");
 				db_write_word(db, mun->name);
@@ -384,6 +493,25 @@ corestorage_h_dbv(struct database_handle *db, const char *type)
 	slog(LG_INFO, "corestorage: data schema version is %u.", dbv);
 }
 
+static void
+corestorage_h_cnt(struct database_handle *db, const char *type)
+{
+	const char *name;
+	unsigned int count;
+
+	// Only worth doing before anything is loaded
+	if (cnt.myuser || cnt.mychan)
+		return;
+
+	while ((name = db_read_word(db)) != NULL && db_read_uint(db, &count))
+	{
+		if (! strcmp(name, "strings"))
+			strshare_reserve(count);
+		else
+			(void) named_heap_presize(name, count);
+	}
+}
+
 static void
 corestorage_h_mdep(struct database_handle *const restrict db, const char ATHEME_VATTR_UNUSED *const restrict type)
 {
@@ -405,6 +533,20 @@ corestorage_h_mdep(struct database_handle *const restrict db, const char ATHEME_
 	if (module_find_published(modname))
 		return;
 
+	bool has_rows = false;
+
+	// Declared in lazymodule{}: the first row of one of its types loads it, if any are given
+	if (module_lazy_declared(modname, &has_rows))
+	{
+		if (has_rows || module_request(modname))
+			return;
+
+		(void) slog(LG_ERROR, "db %s:%u: cannot load module '%s'", db->file, db->line, modname);
+		(void) slog(LG_ERROR, "corestorage: exiting to avoid data loss");
+
+		exit(EXIT_FAILURE);
+	}
+
 	if (config_options.load_database_mdeps)
 	{
 		(void) slog(LG_INFO, "corestorage: auto-loading module '%s' (database depends on it)", modname);
@@ -457,6 +599,9 @@ corestorage_h_mu(struct database_handle *db, const char *type)
 	unsigned int flags = 0;
 	struct myuser *mu;
 
+	if (corestorage_warm)
+		return;
+
 	if (dbv >= 10)
 		uid = db_sread_word(db);
 
@@ -518,14 +663,71 @@ corestorage_h_me(struct database_handle *db, const char *type)
 
 	mz = smalloc(sizeof *mz);
 	mowgli_strlcpy(mz->sender, src, sizeof mz->sender);
-	mowgli_strlcpy(mz->text, text, sizeof mz->text);
+	memo_set_text(mz, mu, text);
+	mz->sent = sent;
+	mz->status = status;
+
+	if (!(mz->status & MEMO_READ))
+		mu->memoct_new++;
+
+	mowgli_node_add(mz, &mz->node, &mu->memos);
+}
+
+static void
+corestorage_h_meg(struct database_handle *db, const char *type)
+{
+	memostore_set_generation(db_sread_uint(db));
+}
+
+static void
+corestorage_h_mo(struct database_handle *db, const char *type)
+{
+	const char *dest, *src, *offset;
+	unsigned long long off;
+	unsigned int status, len;
+	time_t sent;
+	struct myuser *mu;
+	struct mymemo *mz;
+	char *end;
+
+	dest = db_sread_word(db);
+	src = db_sread_word(db);
+	sent = db_sread_time(db);
+	status = db_sread_uint(db);
+	offset = db_sread_word(db);
+	len = db_sread_uint(db);
+
+	if (!(mu = myuser_find(dest)))
+	{
+		slog(LG_DEBUG, "db-h-mo: line %u: memo for unknown account %s", db->line, dest);
+		return;
+	}
+
+	errno = 0;
+	off = strtoull(offset, &end, 10);
+
+	if (errno || *end)
+	{
+		slog(LG_ERROR, "db-h-mo: line %u: invalid memo store offset %s", db->line, offset);
+		return;
+	}
+
+	mz = smalloc(sizeof *mz);
+	mowgli_strlcpy(mz->sender, src, sizeof mz->sender);
 	mz->sent = sent;
 	mz->status = status;
 
+	if (!memo_set_stored(mz, off, len))
+	{
+		slog(LG_ERROR, "db-h-mo: line %u: invalid memo store record length %u", db->line, len);
+		sfree(mz);
+		return;
+	}
+
 	if (!(mz->status & MEMO_READ))
 		mu->memoct_new++;
 
-	mowgli_node_add(mz, mowgli_node_create(), &mu->memos);
+	mowgli_node_add(mz, &mz->node, &mu->memos);
 }
 
 static void
@@ -544,7 +746,7 @@ corestorage_h_mi(struct database_handle *db, const char *type)
 		return;
 	}
 
-	mowgli_node_add(sstrdup(target), mowgli_node_create(), &mu->memo_ignores);
+	myuser_memo_ignore_add_name(mu, target);
 }
 
 static void
@@ -574,6 +776,9 @@ corestorage_h_mn(struct database_handle *db, const char *type)
 	const char *user, *nick;
 	time_t reg, seen;
 
+	if (corestorage_warm)
+		return;
+
 	user = db_sread_word(db);
 	nick = db_sread_word(db);
 	reg = db_sread_time(db);
@@ -670,11 +875,15 @@ static void
 corestorage_h_mc(struct database_handle *db, const char *type)
 {
 	char buf[4096];
-	const char *name = db_sread_word(db);
+	const char *name;
 	const char *key;
 	const char *sflags;
 	unsigned int flags = 0;
 
+	if (corestorage_warm)
+		return;
+
+	name = db_sread_word(db);
 	mowgli_strlcpy(buf, name, sizeof buf);
 	struct mychan *mc = mychan_add(buf);
 
@@ -734,12 +943,17 @@ convert_templates(const char *value)
 static void
 corestorage_h_md(struct database_handle *db, const char *type)
 {
-	const char *name = db_sread_word(db);
-	const char *prop = db_sread_word(db);
-	const char *value = db_sread_str(db);
+	const char *name, *prop, *value;
 	char *newvalue = NULL;
 	void *obj = NULL;
 
+	if (corestorage_warm && (!strcmp(type, "MDU") || !strcmp(type, "MDC")))
+		return;
+
+	name = db_sread_word(db);
+	prop = db_sread_word(db);
+	value = db_sread_str(db);
+
 	if (!strcmp(type, "MDU"))
 	{
 		obj = myuser_find(name);
@@ -785,6 +999,15 @@ corestorage_h_md(struct database_handle *db, const char *type)
 	sfree(newvalue);
 }
 
+// The warm restart image has the access entries of host masks and accounts
+static bool
+corestorage_warm_chanacs(const char *const restrict target)
+{
+	const struct myentity *const mt = myentity_find(target);
+
+	return mt == NULL || mt->type == ENT_USER;
+}
+
 static void
 corestorage_h_mda(struct database_handle *db, const char *type)
 {
@@ -796,6 +1019,10 @@ corestorage_h_mda(struct database_handle *db, const char *type)
 
 	name = db_sread_word(db);
 	mask = db_sread_word(db);
+
+	if (corestorage_warm && corestorage_warm_chanacs(mask))
+		return;
+
 	prop = db_sread_word(db);
 	value = db_sread_str(db);
 
@@ -823,6 +1050,10 @@ corestorage_h_ca(struct database_handle *db, const char *type)
 
 	chan = db_sread_word(db);
 	target = db_sread_word(db);
+
+	if (corestorage_warm && corestorage_warm_chanacs(target))
+		return;
+
 	flags = flags_to_bitmask(db_sread_word(db), 0);
 
 	// UNBAN self and akick exempt have been split to +e per GitHub #75
@@ -914,8 +1145,7 @@ corestorage_h_kl(struct database_handle *db, const char *type)
 	strip(buf);
 
 	k = kline_add_with_id(user, host, buf, duration, setby, id ? id : ++me.kline_id);
-	k->settime = settime;
-	k->expires = k->settime + k->duration;
+	kline_set_settime(k, settime);
 }
 
 static void
@@ -947,8 +1177,7 @@ corestorage_h_xl(struct database_handle *db, const char *type)
 	strip(buf);
 
 	x = xline_add(realname, buf, duration, setby);
-	x->settime = settime;
-	x->expires = x->settime + x->duration;
+	xline_set_settime(x, settime);
 
 	if (id)
 		x->number = id;
@@ -983,8 +1212,7 @@ corestorage_h_ql(struct database_handle *db, const char *type)
 	strip(buf);
 
 	q = qline_add(mask, buf, duration, setby);
-	q->settime = settime;
-	q->expires = q->settime + q->duration;
+	qline_set_settime(q, settime);
 
 	if (id)
 		q->number = id;
@@ -1000,19 +1228,67 @@ static void
 corestorage_db_load(const char *filename)
 {
 	struct database_handle *db;
+	char path[BUFSIZE];
+
+	// backends all read from the same path
+	(void) snprintf(path, sizeof path, "%s/%s", datadir, filename != NULL ? filename : "services.db");
+
+	if (config_options.db_warm_image)
+		corestorage_warm = warm_image_load(path);
 
 	db = db_open(filename, DB_READ);
-	if (db == NULL)
-		return;
+	if (db != NULL)
+	{
+		db_parse(db);
+		db_close(db);
+	}
 
-	db_parse(db);
-	db_close(db);
+	// journals replayed later are changes the image doesn't have
+	corestorage_warm = false;
+
+	db_shards_load(filename);
+}
+
+static void
+corestorage_db_save_finished(void *filename, const enum db_save_strategy strategy, struct timeval started)
+{
+	struct timeval elapsed;
+	struct stat sb;
+	char path[BUFSIZE];
+
+	// backends all write to the same path
+	(void) snprintf(path, sizeof path, "%s/%s", datadir, filename != NULL ? (const char *) filename : "services.db");
+
+	e_time(started, &elapsed);
+
+	db_last_save.strategy = strategy;
+	db_last_save.finished = CURRTIME;
+	db_last_save.duration = (unsigned int) tv2ms(&elapsed);
+	db_last_save.bytes = (stat(path, &sb) == 0) ? (size_t) sb.st_size : 0;
+
+	// a forked child wrote it in its own copy of this, so it stays 0 (unknown) for those
+	db_last_save.uncompressed = db_output_last_bytes;
+	db_output_last_bytes = 0;
+
+	if (config_options.db_compress_level && db_last_save.uncompressed && db_last_save.bytes)
+		slog(LG_INFO, "db_save(): wrote %zu bytes (%llu uncompressed, ratio %.2f) in %u ms", db_last_save.bytes,
+		     db_last_save.uncompressed, (double) db_last_save.uncompressed / (double) db_last_save.bytes,
+		     db_last_save.duration);
+	else if (config_options.db_compress_level)
+		slog(LG_INFO, "db_save(): wrote %zu bytes in %u ms", db_last_save.bytes, db_last_save.duration);
+	else
+		slog(LG_DEBUG, "db_save(): wrote %zu bytes in %u ms", db_last_save.bytes, db_last_save.duration);
+
+	ATHEME_TRACE3(db__save__done, (int) strategy, db_last_save.duration, db_last_save.bytes);
 }
 
 static void
 corestorage_db_write_blocking(void *filename)
 {
 	struct database_handle *db;
+	struct timeval started;
+
+	s_time(&started);
 
 	db = db_open(filename, DB_WRITE);
 
@@ -1026,8 +1302,344 @@ corestorage_db_write_blocking(void *filename)
 	hook_call_db_write(db);
 
 	db_close(db);
+
+	corestorage_db_save_finished(filename, DB_SAVE_BLOCKING, started);
+
+	// the last save before exiting; the next start can pick up from here
+	if ((runflags & (RF_SHUTDOWN | RF_RESTART)) && config_options.db_warm_image)
+	{
+		char path[BUFSIZE];
+
+		(void) snprintf(path, sizeof path, "%s/%s", datadir, filename != NULL ? (const char *) filename : "services.db");
+		(void) warm_image_write(path);
+	}
+}
+
+#ifdef HAVE_USABLE_PTHREAD
+static void
+snapshot_put(struct corestorage_snapshot *const restrict snap, const void *const restrict data, const size_t len)
+{
+	if (snap->len + len > snap->size)
+	{
+		while (snap->len + len > snap->size)
+			snap->size *= 2U;
+
+		snap->buf = srealloc(snap->buf, snap->size);
+	}
+
+	(void) memcpy(snap->buf + snap->len, data, len);
+	snap->len += len;
+}
+
+static void
+snapshot_put_op(struct corestorage_snapshot *const restrict snap, const enum corestorage_snapshot_op op)
+{
+	const unsigned char c = (unsigned char) op;
+
+	snapshot_put(snap, &c, 1);
+}
+
+static bool
+snapshot_start_row(struct database_handle *const restrict db, const char *const restrict type)
+{
+	struct corestorage_snapshot *snap;
+	unsigned int id;
+	void *known;
+
+	return_val_if_fail(db != NULL, false);
+	return_val_if_fail(type != NULL, false);
+	snap = db->priv;
+
+	if ((known = mowgli_patricia_retrieve(snap->typeids, type)) != NULL)
+		id = (unsigned int) (uintptr_t) known - 1U;
+	else
+	{
+		if (snap->ntypes == snap->typesalloc)
+		{
+			snap->typesalloc *= 2U;
+			snap->types = srealloc(snap->types, snap->typesalloc * sizeof *snap->types);
+		}
+
+		id = snap->ntypes++;
+		snap->types[id] = sstrdup(type);
+		mowgli_patricia_add(snap->typeids, type, (void *) (uintptr_t) (id + 1U));
+	}
+
+	snapshot_put_op(snap, SNAPSHOT_ROW);
+	snapshot_put(snap, &id, sizeof id);
+
+	return true;
+}
+
+static bool
+snapshot_write_cell(struct database_handle *const restrict db, const enum corestorage_snapshot_op op, const enum corestorage_snapshot_op nullop, const char *const restrict data)
+{
+	struct corestorage_snapshot *snap;
+
+	return_val_if_fail(db != NULL, false);
+	snap = db->priv;
+
+	if (data == NULL)
+	{
+		snapshot_put_op(snap, nullop);
+		return true;
+	}
+
+	snapshot_put_op(snap, op);
+	snapshot_put(snap, data, strlen(data) + 1U);
+
+	return true;
+}
+
+static bool
+snapshot_write_word(struct database_handle *const restrict db, const char *const restrict word)
+{
+	return snapshot_write_cell(db, SNAPSHOT_WORD, SNAPSHOT_WORD_NULL, word);
+}
+
+static bool
+snapshot_write_str(struct database_handle *const restrict db, const char *const restrict str)
+{
+	return snapshot_write_cell(db, SNAPSHOT_STR, SNAPSHOT_STR_NULL, str);
+}
+
+static bool
+snapshot_write_int(struct database_handle *const restrict db, const int num)
+{
+	return_val_if_fail(db != NULL, false);
+
+	snapshot_put_op(db->priv, SNAPSHOT_INT);
+	snapshot_put(db->priv, &num, sizeof num);
+
+	return true;
+}
+
+static bool
+snapshot_write_uint(struct database_handle *const restrict db, const unsigned int num)
+{
+	return_val_if_fail(db != NULL, false);
+
+	snapshot_put_op(db->priv, SNAPSHOT_UINT);
+	snapshot_put(db->priv, &num, sizeof num);
+
+	return true;
+}
+
+static bool
+snapshot_write_time(struct database_handle *const restrict db, const time_t tm)
+{
+	return_val_if_fail(db != NULL, false);
+
+	snapshot_put_op(db->priv, SNAPSHOT_TIME);
+	snapshot_put(db->priv, &tm, sizeof tm);
+
+	return true;
+}
+
+static bool
+snapshot_commit_row(struct database_handle *const restrict db)
+{
+	return_val_if_fail(db != NULL, false);
+
+	snapshot_put_op(db->priv, SNAPSHOT_COMMIT);
+
+	return true;
+}
+
+static const struct database_vtable snapshot_vt = {
+	.name           = "snapshot",
+	.start_row      = snapshot_start_row,
+	.write_word     = snapshot_write_word,
+	.write_str      = snapshot_write_str,
+	.write_int      = snapshot_write_int,
+	.write_uint     = snapshot_write_uint,
+	.write_time     = snapshot_write_time,
+	.commit_row     = snapshot_commit_row,
+};
+
+/* Runs on the writer thread.  It must not log, call hooks, or touch anything
+ * but the snapshot and the backend handle; the backend's own write functions
+ * only do stdio (and smalloc) on their private state.
+ */
+static void *
+corestorage_writer_run(void *const restrict arg)
+{
+	struct corestorage_writer *const w = arg;
+	const unsigned char *p = w->snap.buf;
+	const unsigned char *const end = w->snap.buf + w->snap.len;
+
+	while (p < end)
+	{
+		const unsigned char op = *p++;
+		unsigned int id, unum;
+		time_t tm;
+		int num;
+
+		switch (op)
+		{
+			case SNAPSHOT_ROW:
+				(void) memcpy(&id, p, sizeof id);
+				p += sizeof id;
+				(void) db_start_row(w->db, w->snap.types[id]);
+				break;
+
+			case SNAPSHOT_WORD:
+				(void) db_write_word(w->db, (const char *) p);
+				p += strlen((const char *) p) + 1U;
+				break;
+
+			case SNAPSHOT_WORD_NULL:
+				(void) db_write_word(w->db, NULL);
+				break;
+
+			case SNAPSHOT_STR:
+				(void) db_write_str(w->db, (const char *) p);
+				p += strlen((const char *) p) + 1U;
+				break;
+
+			case SNAPSHOT_STR_NULL:
+				(void) db_write_str(w->db, NULL);
+				break;
+
+			case SNAPSHOT_INT:
+				(void) memcpy(&num, p, sizeof num);
+				p += sizeof num;
+				(void) db_write_int(w->db, num);
+				break;
+
+			case SNAPSHOT_UINT:
+				(void) memcpy(&unum, p, sizeof unum);
+				p += sizeof unum;
+				(void) db_write_uint(w->db, unum);
+				break;
+
+			case SNAPSHOT_TIME:
+				(void) memcpy(&tm, p, sizeof tm);
+				p += sizeof tm;
+				(void) db_write_time(w->db, tm);
+				break;
+
+			case SNAPSHOT_COMMIT:
+				(void) db_commit_row(w->db);
+				break;
+		}
+	}
+
+	(void) pthread_mutex_lock(&w->lock);
+	w->done = true;
+	(void) pthread_mutex_unlock(&w->lock);
+
+	return NULL;
+}
+
+static void
+corestorage_writer_free(struct corestorage_writer *const restrict w)
+{
+	for (unsigned int i = 0; i < w->snap.ntypes; i++)
+		sfree(w->snap.types[i]);
+
+	mowgli_patricia_destroy(w->snap.typeids, NULL, NULL);
+	sfree(w->snap.types);
+	sfree(w->snap.buf);
+	sfree(w->filename);
+	sfree(w);
+}
+
+// back on the main loop: the backend closes (and renames) the file and calls the db_saved hooks
+static void
+corestorage_writer_finish(void)
+{
+	struct corestorage_writer *const w = writer;
+
+	(void) pthread_join(w->thread, NULL);
+	(void) pthread_mutex_destroy(&w->lock);
+
+	if (w->timer != NULL)
+		timer_destroy(w->timer);
+
+	writer = NULL;
+
+	db_close(w->db);
+	slog(LG_DEBUG, "db_save(): finished threaded DB write");
+	corestorage_db_save_finished(w->filename, w->strategy, w->started);
+	corestorage_writer_free(w);
+}
+
+static void
+corestorage_writer_poll(void *const restrict unused)
+{
+	bool done;
+
+	// this once-only timer is destroyed by the eventloop after we return
+	writer->timer = NULL;
+
+	(void) pthread_mutex_lock(&writer->lock);
+	done = writer->done;
+	(void) pthread_mutex_unlock(&writer->lock);
+
+	if (done)
+		corestorage_writer_finish();
+	else
+		writer->timer = timer_add_once("db_save_writer", corestorage_writer_poll, NULL, 1);
 }
 
+static bool
+corestorage_db_write_threaded(void *filename, const enum db_save_strategy strategy)
+{
+	struct corestorage_writer *w;
+	struct database_handle snapdb;
+
+	w = smalloc(sizeof *w);
+	w->filename = (filename != NULL) ? sstrdup(filename) : NULL;
+	w->strategy = strategy;
+	w->snap.size = 1048576;
+	w->snap.buf = smalloc(w->snap.size);
+	w->snap.typeids = mowgli_patricia_create(NULL);
+	w->snap.typesalloc = 64;
+	w->snap.types = smalloc(w->snap.typesalloc * sizeof *w->snap.types);
+
+	s_time(&w->started);
+
+	(void) memset(&snapdb, 0x00, sizeof snapdb);
+	snapdb.priv = &w->snap;
+	snapdb.vt = &snapshot_vt;
+	snapdb.txn = DB_WRITE;
+	snapdb.file = filename;
+
+	corestorage_db_save(&snapdb);
+	hook_call_db_write(&snapdb);
+
+	slog(LG_DEBUG, "db_save(): took a %zu byte snapshot for the writer thread", w->snap.len);
+
+	if (! (w->db = db_open(filename, DB_WRITE)))
+	{
+		slog(LG_ERROR, "db_write_threaded(): db_open() failed, aborting save");
+		goto fail;
+	}
+
+	(void) pthread_mutex_init(&w->lock, NULL);
+
+	if (pthread_create(&w->thread, NULL, &corestorage_writer_run, w) != 0)
+	{
+		// nothing has been written yet, so write it synchronously from here
+		slog(LG_ERROR, "db_save(): pthread_create() failed; writing database synchronously");
+		(void) corestorage_writer_run(w);
+		(void) pthread_mutex_destroy(&w->lock);
+		db_close(w->db);
+		corestorage_db_save_finished(filename, DB_SAVE_BLOCKING, w->started);
+		goto fail;
+	}
+
+	writer = w;
+	w->timer = timer_add_once("db_save_writer", corestorage_writer_poll, NULL, 1);
+	return true;
+
+fail:
+	corestorage_writer_free(w);
+	return false;
+}
+#endif /* HAVE_USABLE_PTHREAD */
+
 #ifdef HAVE_FORK
 static void
 corestorage_db_saved_cb(pid_t pid, int status, void *data)
@@ -1038,6 +1650,7 @@ corestorage_db_saved_cb(pid_t pid, int status, void *data)
 	{
 		child_pid = 0;
 		slog(LG_DEBUG, "db_save(): finished asynchronous DB write");
+		corestorage_db_save_finished(data, child_strategy, child_started);
 	}
 }
 #endif
@@ -1045,7 +1658,37 @@ corestorage_db_saved_cb(pid_t pid, int status, void *data)
 static void
 corestorage_db_write(void *filename, enum db_save_strategy strategy)
 {
+#ifdef HAVE_USABLE_PTHREAD
+	if (writer != NULL)
+	{
+		if (strategy == DB_SAVE_BG_REGULAR)
+		{
+			slog(LG_DEBUG, "db_save(): previous save unfinished, skipping save");
+			return;
+		}
+
+		// the thread can't be cancelled without leaving a half-written file behind
+		slog(LG_DEBUG, "db_save(): waiting for unfinished previous save before forced save");
+		corestorage_writer_finish();
+	}
+#endif
+
+	// small, and written here on the main loop before the main database that lists them
+	db_shards_save(filename);
+
+	ATHEME_TRACE1(db__save__start, (int) strategy);
+
+#ifdef HAVE_USABLE_PTHREAD
+	if (strategy != DB_SAVE_BLOCKING && config_options.db_save_threaded)
+	{
+		db_changes_saving();
+		(void) corestorage_db_write_threaded(filename, strategy);
+		return;
+	}
+#endif
+
 #ifndef HAVE_FORK
+	db_changes_saving();
 	corestorage_db_write_blocking(filename);
 #else
 
@@ -1065,12 +1708,17 @@ corestorage_db_write(void *filename, enum db_save_strategy strategy)
 		}
 	}
 
+	db_changes_saving();
+
 	if (strategy == DB_SAVE_BLOCKING)
 	{
 		corestorage_db_write_blocking(filename);
 		return;
 	}
 
+	s_time(&child_started);
+	child_strategy = strategy;
+
 	pid_t pid = fork();
 	switch (pid)
 	{
@@ -1085,7 +1733,7 @@ corestorage_db_write(void *filename, enum db_save_strategy strategy)
 
 		default:
 			child_pid = pid;
-			childproc_add(pid, "db_save", corestorage_db_saved_cb, NULL);
+			childproc_add(pid, "db_save", corestorage_db_saved_cb, filename);
 			return;
 	}
 #endif
@@ -1098,12 +1746,15 @@ mod_init(struct module *const restrict m)
 	db_save = &corestorage_db_write;
 
 	db_register_type_handler("DBV", corestorage_h_dbv);
+	db_register_type_handler("CNT", corestorage_h_cnt);
 	db_register_type_handler("MDEP", corestorage_h_mdep);
 	db_register_type_handler("LUID", corestorage_h_luid);
 	db_register_type_handler("CF", corestorage_h_cf);
 	db_register_type_handler("MU", corestorage_h_mu);
 	db_register_type_handler("ME", corestorage_h_me);
+	db_register_type_handler("MEG", corestorage_h_meg);
 	db_register_type_handler("MI", corestorage_h_mi);
+	db_register_type_handler("MO", corestorage_h_mo);
 	db_register_type_handler("AC", corestorage_h_ac);
 	db_register_type_handler("MN", corestorage_h_mn);
 	db_register_type_handler("MCFP", corestorage_h_mcfp);
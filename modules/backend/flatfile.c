@@ -212,19 +212,19 @@ flatfile_db_load(const char *filename)
 			mz = smalloc(sizeof *mz);
 
 			mowgli_strlcpy(mz->sender, sender, sizeof mz->sender);
-			mowgli_strlcpy(mz->text, text, sizeof mz->text);
+			memo_set_text(mz, mu, text);
 			mz->sent = mtime;
 			mz->status = status;
 
 			if (!(mz->status & MEMO_READ))
 				mu->memoct_new++;
 
-			mowgli_node_add(mz, mowgli_node_create(), &mu->memos);
+			mowgli_node_add(mz, &mz->node, &mu->memos);
 		}
 		else if (!strcmp("MI", item))
 		{
 			// memo ignore
-			char *user, *target, *strbuf;
+			char *user, *target;
 
 			user = strtok(NULL, " ");
 			target = strtok(NULL, "\n");
@@ -237,9 +237,7 @@ flatfile_db_load(const char *filename)
 				continue;
 			}
 
-			strbuf = sstrdup(target);
-
-			mowgli_node_add(strbuf, mowgli_node_create(), &mu->memo_ignores);
+			myuser_memo_ignore_add_name(mu, target);
 		}
 		else if (!strcmp("AC", item))
 		{
@@ -619,10 +617,7 @@ flatfile_db_load(const char *filename)
 			strip(reason);
 
 			k = kline_add(user, host, reason, duration, setby);
-			k->settime = settime;
-
-			// XXX this is not nice, oh well -- jilles
-			k->expires = k->settime + k->duration;
+			kline_set_settime(k, settime);
 
 			kin++;
 		}
@@ -649,10 +644,7 @@ flatfile_db_load(const char *filename)
 			strip(reason);
 
 			x = xline_add(realname, reason, duration, setby);
-			x->settime = settime;
-
-			// XXX this is not nice, oh well -- jilles
-			x->expires = x->settime + x->duration;
+			xline_set_settime(x, settime);
 
 			xin++;
 		}
@@ -679,10 +671,7 @@ flatfile_db_load(const char *filename)
 			strip(reason);
 
 			q = qline_add(mask, reason, duration, setby);
-			q->settime = settime;
-
-			// XXX this is not nice, oh well -- jilles
-			q->expires = q->settime + q->duration;
+			qline_set_settime(q, settime);
 
 			qin++;
 		}
@@ -0,0 +1,1408 @@
+/*
+ * SPDX-License-Identifier: ISC
+ * SPDX-URL: https://spdx.org/licenses/ISC.html
+ *
+ * Copyright (C) 2026 Atheme Development Group (https://atheme.github.io/)
+ *
+ * This is an append-only journal sitting in front of the snapshot backend.
+ * Changes to accounts, nicks, channels, their access lists and metadata are
+ * appended to <database>.journal.<generation> as they happen and fsync()ed
+ * in batches; the full snapshot is then only written every
+ * general::journal_compact_interval.  Each snapshot starts a new generation
+ * and records it in a JGEN row, so that at startup exactly the journals
+ * written after it are replayed on top of it.
+ *
+ * Only changes that go through the core object API are journaled.  Fields
+ * that modules assign directly (most account and channel flags, lastlogin,
+ * ...) reach the disk with the next snapshot or the next journaled change
+ * of the same object, as they did before.  Neither are the records kept
+ * for old account names (NAM rows and their MDN metadata): they are
+ * created and removed without hooks, so they too wait for the snapshot.
+ *
+ * A second services process started read-only (-r) on the same data
+ * directory, with general::journal_follow set and usually no uplink, is a
+ * replica: it loads the snapshot as usual and then keeps reading the
+ * journals the primary appends to, applying the rows as they appear, so
+ * that its RPC interfaces can answer queries with data at most that many
+ * seconds old.
+ */
+
+#include <atheme.h>
+
+#define JOURNAL_BUFSIZE         65536U
+
+// compact early if the journal grows past this, whatever the interval
+#define JOURNAL_COMPACT_SIZE    (64U * 1024U * 1024U)
+
+static int journal_fd = -1;
+static char journal_buf[JOURNAL_BUFSIZE];
+static size_t journal_buflen;
+static size_t journal_size;
+static bool journal_unsynced;
+static time_t journal_last_compact;
+
+static unsigned int journal_gen;
+static unsigned int journal_snapshot_gen;
+static bool journal_snapshot_has_gen;
+
+static unsigned int journal_sync_interval;
+static unsigned int journal_compact_interval;
+static mowgli_eventloop_timer_t *journal_sync_timer;
+
+static void (*journal_next_db_save)(void *arg, enum db_save_strategy strategy) = NULL;
+static void (*journal_next_db_load)(const char *arg) = NULL;
+
+// the snapshot the journals go with, as given to db_load() and db_save()
+static char journal_db_name[256] = "services.db";
+
+static unsigned int journal_follow_interval;
+static mowgli_eventloop_timer_t *journal_follow_timer;
+static int journal_follow_fd = -1;
+static bool journal_following;
+static unsigned int journal_follow_gen;
+static char *journal_follow_buf;
+static size_t journal_follow_buflen;
+static size_t journal_follow_bufsize;
+static char *journal_follow_token;
+
+static void
+journal_set_db_name(const char *restrict filename)
+{
+	if (filename == NULL)
+		filename = "services.db";
+
+	if (mowgli_strlcpy(journal_db_name, filename, sizeof journal_db_name) >= sizeof journal_db_name)
+		slog(LG_ERROR, "journal: database name %s is too long; its journals go in %s.journal.*",
+		     filename, journal_db_name);
+}
+
+static void
+journal_path(char *const restrict buf, const size_t bufsize, const unsigned int gen, const bool absolute)
+{
+	if (absolute)
+		(void) snprintf(buf, bufsize, "%s/%s.journal.%u", datadir, journal_db_name, gen);
+	else
+		(void) snprintf(buf, bufsize, "%s.journal.%u", journal_db_name, gen);
+}
+
+static bool
+journal_exists(const unsigned int gen)
+{
+	char path[BUFSIZE];
+
+	journal_path(path, sizeof path, gen, true);
+
+	return access(path, F_OK) == 0;
+}
+
+// remove the journals older than gen, which a snapshot has superseded
+static void
+journal_unlink_before(unsigned int gen)
+{
+	char path[BUFSIZE];
+
+	while (gen-- > 0)
+	{
+		journal_path(path, sizeof path, gen, true);
+
+		if (unlink(path) != 0)
+			break;
+
+		slog(LG_DEBUG, "journal: removed superseded %s", path);
+	}
+}
+
+static void
+journal_fail(const int errno1)
+{
+	slog(LG_ERROR, "journal: cannot write generation %u: %s; falling back to periodic snapshots",
+	     journal_gen, strerror(errno1));
+	wallops("\2DATABASE ERROR\2: journal: cannot write generation %u: %s", journal_gen, strerror(errno1));
+
+	(void) close(journal_fd);
+	journal_fd = -1;
+	journal_buflen = 0;
+	journal_unsynced = false;
+}
+
+static void
+journal_write_all(const char *data, size_t len)
+{
+	while (len > 0 && journal_fd != -1)
+	{
+		const ssize_t ret = write(journal_fd, data, len);
+
+		if (ret < 0)
+		{
+			if (errno != EINTR)
+				journal_fail(errno);
+
+			continue;
+		}
+
+		data += ret;
+		len -= (size_t) ret;
+		journal_size += (size_t) ret;
+		journal_unsynced = true;
+	}
+}
+
+static void
+journal_flush(void)
+{
+	const size_t len = journal_buflen;
+
+	journal_buflen = 0;
+	journal_write_all(journal_buf, len);
+}
+
+static void
+journal_sync(void)
+{
+	journal_flush();
+
+	if (journal_fd == -1 || ! journal_unsynced)
+		return;
+
+#ifdef HAVE_FSYNC
+	if (fsync(journal_fd) != 0)
+	{
+		journal_fail(errno);
+		return;
+	}
+#endif
+
+	journal_unsynced = false;
+}
+
+static void
+journal_append(const char *const restrict data, const size_t len)
+{
+	if (journal_fd == -1)
+		return;
+
+	if (journal_buflen + len > sizeof journal_buf)
+		journal_flush();
+
+	if (len > sizeof journal_buf)
+	{
+		journal_write_all(data, len);
+		return;
+	}
+
+	(void) memcpy(journal_buf + journal_buflen, data, len);
+	journal_buflen += len;
+}
+
+/* The journal is written through the usual row API with this vtable, in the
+ * same format as OpenSEX, so that OpenSEX can read it back.  It does not use
+ * stdio because a forked snapshot writer would flush a copy of the buffer
+ * on exit.
+ */
+static bool
+journal_start_row(struct database_handle ATHEME_VATTR_UNUSED *const restrict db, const char *const restrict type)
+{
+	journal_append(type, strlen(type));
+	journal_append(" ", 1);
+
+	return true;
+}
+
+static bool
+journal_write_cell(const char *data, const bool multiword)
+{
+	if (data == NULL)
+		data = "*";
+
+	journal_append(data, strlen(data));
+
+	if (! multiword)
+		journal_append(" ", 1);
+
+	return true;
+}
+
+static bool
+journal_write_word(struct database_handle ATHEME_VATTR_UNUSED *const restrict db, const char *const restrict word)
+{
+	return journal_write_cell(word, false);
+}
+
+static bool
+journal_write_str(struct database_handle ATHEME_VATTR_UNUSED *const restrict db, const char *const restrict str)
+{
+	return journal_write_cell(str, true);
+}
+
+static bool
+journal_write_int(struct database_handle ATHEME_VATTR_UNUSED *const restrict db, const int num)
+{
+	char buf[32];
+
+	(void) snprintf(buf, sizeof buf, "%d", num);
+
+	return journal_write_cell(buf, false);
+}
+
+static bool
+journal_write_uint(struct database_handle ATHEME_VATTR_UNUSED *const restrict db, const unsigned int num)
+{
+	char buf[32];
+
+	(void) snprintf(buf, sizeof buf, "%u", num);
+
+	return journal_write_cell(buf, false);
+}
+
+static bool
+journal_write_time(struct database_handle ATHEME_VATTR_UNUSED *const restrict db, const time_t tm)
+{
+	char buf[32];
+
+	(void) snprintf(buf, sizeof buf, "%lu", (unsigned long) tm);
+
+	return journal_write_cell(buf, false);
+}
+
+static bool
+journal_commit_row(struct database_handle ATHEME_VATTR_UNUSED *const restrict db)
+{
+	journal_append("\n", 1);
+
+	if (! journal_sync_interval)
+		journal_sync();
+
+	return true;
+}
+
+static const struct database_vtable journal_vt = {
+	.name = "journal",
+	.start_row = journal_start_row,
+	.write_word = journal_write_word,
+	.write_str = journal_write_str,
+	.write_int = journal_write_int,
+	.write_uint = journal_write_uint,
+	.write_time = journal_write_time,
+	.commit_row = journal_commit_row,
+};
+
+static char journal_file[BUFSIZE];
+
+static struct database_handle journal_db = {
+	.vt = &journal_vt,
+	.txn = DB_WRITE,
+	.file = journal_file,
+};
+
+static void
+journal_open(const unsigned int gen)
+{
+	journal_gen = gen;
+	journal_size = 0;
+	journal_buflen = 0;
+	journal_unsynced = false;
+
+	journal_path(journal_file, sizeof journal_file, gen, true);
+
+	journal_fd = open(journal_file, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
+
+	if (journal_fd == -1)
+	{
+		const int errno1 = errno;
+
+		slog(LG_ERROR, "journal: cannot open '%s' for writing: %s", journal_file, strerror(errno1));
+		wallops("\2DATABASE ERROR\2: journal: cannot open '%s' for writing: %s", journal_file, strerror(errno1));
+		return;
+	}
+
+	// the MDA rows we append are in the current schema
+	db_start_row(&journal_db, "DBV");
+	db_write_uint(&journal_db, 12);
+	db_commit_row(&journal_db);
+}
+
+static void
+journal_close(void)
+{
+	if (journal_fd == -1)
+		return;
+
+	journal_sync();
+
+	if (journal_fd != -1)
+		(void) close(journal_fd);
+
+	journal_fd = -1;
+}
+
+/* A crash can leave half a row at the end of the journal; drop it rather
+ * than have the strict row readers bail out on it.
+ */
+static void
+journal_trim(const char *const restrict path)
+{
+	char buf[BUFSIZE];
+	struct stat sb;
+	off_t end;
+	int fd;
+
+	if ((fd = open(path, O_RDWR)) == -1)
+		return;
+
+	if (fstat(fd, &sb) != 0 || sb.st_size == 0)
+	{
+		(void) close(fd);
+		return;
+	}
+
+	for (end = sb.st_size; end > 0; )
+	{
+		const size_t len = (end > (off_t) sizeof buf) ? sizeof buf : (size_t) end;
+		ssize_t i;
+
+		if (pread(fd, buf, len, end - (off_t) len) != (ssize_t) len)
+			break;
+
+		for (i = (ssize_t) len - 1; i >= 0 && buf[i] != '\n'; i--)
+			;
+
+		if (i >= 0)
+		{
+			end = end - (off_t) len + i + 1;
+			break;
+		}
+
+		end -= (off_t) len;
+	}
+
+	if (end != sb.st_size)
+	{
+		slog(LG_INFO, "journal: discarding incomplete last row of %s", path);
+
+		if (ftruncate(fd, end) != 0)
+			slog(LG_ERROR, "journal: cannot truncate %s: %s", path, strerror(errno));
+	}
+
+	(void) close(fd);
+}
+
+static void
+journal_replay(const unsigned int gen)
+{
+	struct database_handle *db;
+	char path[BUFSIZE];
+	char name[BUFSIZE];
+
+	journal_path(path, sizeof path, gen, true);
+	journal_path(name, sizeof name, gen, false);
+
+	journal_trim(path);
+
+	slog(LG_INFO, "journal: replaying %s", path);
+
+	if ((db = db_open(name, DB_READ)) == NULL)
+		return;
+
+	db_parse(db);
+	db_close(db);
+}
+
+static void
+journal_sync_cb(void ATHEME_VATTR_UNUSED *const restrict unused)
+{
+	journal_sync();
+}
+
+static void
+journal_start_timer(void)
+{
+	if (journal_sync_timer != NULL)
+		timer_destroy(journal_sync_timer);
+
+	journal_sync_timer = NULL;
+
+	if (journal_sync_interval)
+		journal_sync_timer = timer_add("journal_sync", journal_sync_cb, NULL,
+		                               journal_sync_interval);
+}
+
+/*****************
+ * W R I T I N G *
+ *****************/
+
+static void
+journal_write_myuser(struct myuser *const restrict mu)
+{
+	// set_password() runs before the account is in the entity table
+	if (journal_fd == -1 || myuser_find(entity(mu)->name) != mu)
+		return;
+
+	const char *const flags = gflags_tostr(mu_flags, MOWGLI_LIST_LENGTH(&mu->logins) ? mu->flags & ~MU_NOBURSTLOGIN : mu->flags);
+
+	// JU <uid> <name> <pass> <email> <registered> <lastlogin> <flags> <language>
+	db_start_row(&journal_db, "JU");
+	db_write_word(&journal_db, entity(mu)->id);
+	db_write_word(&journal_db, entity(mu)->name);
+	db_write_word(&journal_db, mu->pass);
+	db_write_word(&journal_db, mu->email);
+	db_write_time(&journal_db, mu->registered);
+	db_write_time(&journal_db, mu->lastlogin);
+	db_write_word(&journal_db, flags);
+	db_write_word(&journal_db, language_get_name(mu->language));
+	db_commit_row(&journal_db);
+}
+
+static void
+journal_write_mychan(struct mychan *const restrict mc)
+{
+	if (journal_fd == -1)
+		return;
+
+	// JC <name> <registered> <used> <flags> <mlock_on> <mlock_off> <mlock_limit> [mlock_key]
+	db_start_row(&journal_db, "JC");
+	db_write_word(&journal_db, mc->name);
+	db_write_time(&journal_db, mc->registered);
+	db_write_time(&journal_db, mc->used);
+	db_write_word(&journal_db, gflags_tostr(mc_flags, mc->flags));
+	db_write_uint(&journal_db, mc->mlock_on);
+	db_write_uint(&journal_db, mc->mlock_off);
+	db_write_uint(&journal_db, mc->mlock_limit);
+	db_write_word(&journal_db, mc->mlock_key ? mc->mlock_key : "");
+	db_commit_row(&journal_db);
+}
+
+static void
+journal_myuser_add(struct myuser *const restrict mu)
+{
+	journal_write_myuser(mu);
+}
+
+static void
+journal_myuser_delete(struct myuser *const restrict mu)
+{
+	if (journal_fd == -1)
+		return;
+
+	db_start_row(&journal_db, "JUD");
+	db_write_word(&journal_db, entity(mu)->name);
+	db_commit_row(&journal_db);
+}
+
+static void
+journal_user_rename(struct hook_user_rename *const restrict data)
+{
+	if (journal_fd == -1)
+		return;
+
+	db_start_row(&journal_db, "JUR");
+	db_write_word(&journal_db, data->oldname);
+	db_write_word(&journal_db, entity(data->mu)->name);
+	db_commit_row(&journal_db);
+}
+
+static void
+journal_mynick_add(struct mynick *const restrict mn)
+{
+	if (journal_fd == -1)
+		return;
+
+	// JN <nick> <owner> <registered> <lastseen>
+	db_start_row(&journal_db, "JN");
+	db_write_word(&journal_db, mn->nick);
+	db_write_word(&journal_db, entity(mn->owner)->name);
+	db_write_time(&journal_db, mn->registered);
+	db_write_time(&journal_db, mn->lastseen);
+	db_commit_row(&journal_db);
+}
+
+static void
+journal_mynick_delete(struct mynick *const restrict mn)
+{
+	// nicks going away with their account are covered by its JUD
+	if (journal_fd == -1 || atheme_object(mn->owner)->refcount == -1)
+		return;
+
+	db_start_row(&journal_db, "JND");
+	db_write_word(&journal_db, mn->nick);
+	db_commit_row(&journal_db);
+}
+
+static void
+journal_mychan_add(struct mychan *const restrict mc)
+{
+	journal_write_mychan(mc);
+}
+
+static void
+journal_channel_register(struct hook_channel_req *const restrict hdata)
+{
+	journal_write_mychan(hdata->mc);
+}
+
+static void
+journal_mychan_delete(struct mychan *const restrict mc)
+{
+	if (journal_fd == -1)
+		return;
+
+	db_start_row(&journal_db, "JCD");
+	db_write_word(&journal_db, mc->name);
+	db_commit_row(&journal_db);
+}
+
+static void
+journal_chanacs_change(struct chanacs *const restrict ca)
+{
+	const struct myentity *setter = NULL;
+
+	if (journal_fd == -1)
+		return;
+
+	if (*ca->setter_uid != '\0')
+		setter = myentity_find_uid(ca->setter_uid);
+
+	// JCA <channel> <target> <flags> <modified> <setter>
+	db_start_row(&journal_db, "JCA");
+	db_write_word(&journal_db, ca->mychan->name);
+	db_write_word(&journal_db, ca->entity ? ca->entity->name : ca->host);
+	db_write_word(&journal_db, bitmask_to_flags(ca->level));
+	db_write_time(&journal_db, ca->tmodified);
+	db_write_word(&journal_db, setter ? setter->name : "*");
+	db_commit_row(&journal_db);
+}
+
+// The entries not kept are dropped by the JCAR row, and the rest written out anew
+static void
+journal_chanacs_replace(struct hook_chanacs_replace *const restrict hdata)
+{
+	mowgli_node_t *n;
+
+	if (journal_fd == -1)
+		return;
+
+	// JCAR <channel> <keep>
+	db_start_row(&journal_db, "JCAR");
+	db_write_word(&journal_db, hdata->mc->name);
+	db_write_word(&journal_db, bitmask_to_flags(hdata->keep));
+	db_commit_row(&journal_db);
+
+	MOWGLI_ITER_FOREACH(n, hdata->mc->chanacs.head)
+		journal_chanacs_change(n->data);
+}
+
+static void
+journal_chanacs_delete(struct chanacs *const restrict ca)
+{
+	if (journal_fd == -1 || atheme_object(ca->mychan)->refcount == -1)
+		return;
+
+	if (ca->entity != NULL && atheme_object(ca->entity)->refcount == -1)
+		return;
+
+	db_start_row(&journal_db, "JCAD");
+	db_write_word(&journal_db, ca->mychan->name);
+	db_write_word(&journal_db, ca->entity ? ca->entity->name : ca->host);
+	db_commit_row(&journal_db);
+}
+
+/* Writes the row type and key columns naming a metadata target, the same
+ * way corestorage does in MDU/MDC/MDA rows.  Returns false for objects
+ * which are not journaled.
+ */
+static bool
+journal_start_metadata_row(void *const restrict target, const char *const restrict type)
+{
+	char row[BUFSIZE];
+
+	switch (db_object_type(target))
+	{
+		case DB_OBJECT_MYUSER:
+		{
+			struct myuser *const mu = target;
+
+			if (myuser_find(entity(mu)->name) != mu)
+				return false;
+
+			(void) snprintf(row, sizeof row, "%sU", type);
+			db_start_row(&journal_db, row);
+			db_write_word(&journal_db, entity(mu)->name);
+			return true;
+		}
+
+		// see the top of this file
+		case DB_OBJECT_MYUSER_NAME:
+			break;
+
+		case DB_OBJECT_MYCHAN:
+			(void) snprintf(row, sizeof row, "%sC", type);
+			db_start_row(&journal_db, row);
+			db_write_word(&journal_db, ((struct mychan *) target)->name);
+			return true;
+
+		case DB_OBJECT_CHANACS:
+		{
+			const struct chanacs *const ca = target;
+
+			if (atheme_object(ca->mychan)->refcount == -1)
+				return false;
+
+			(void) snprintf(row, sizeof row, "%sA", type);
+			db_start_row(&journal_db, row);
+			db_write_word(&journal_db, ca->mychan->name);
+			db_write_word(&journal_db, ca->entity ? ca->entity->name : ca->host);
+			return true;
+		}
+
+		case DB_OBJECT_OTHER:
+			break;
+	}
+
+	return false;
+}
+
+static void
+journal_metadata_add(struct hook_metadata_req *const restrict req)
+{
+	if (journal_fd == -1 || ! journal_start_metadata_row(req->target, "MD"))
+		return;
+
+	db_write_word(&journal_db, req->name);
+	db_write_str(&journal_db, req->value);
+	db_commit_row(&journal_db);
+}
+
+static void
+journal_metadata_delete(struct hook_metadata_req *const restrict req)
+{
+	// the object itself is being destroyed
+	if (journal_fd == -1 || atheme_object(req->target)->refcount == -1)
+		return;
+
+	if (! journal_start_metadata_row(req->target, "JMDD"))
+		return;
+
+	db_write_word(&journal_db, req->name);
+	db_commit_row(&journal_db);
+}
+
+/*********************
+ * R E P L A Y I N G *
+ *********************/
+
+static void
+journal_h_jgen(struct database_handle *const restrict db, const char ATHEME_VATTR_UNUSED *const restrict type)
+{
+	journal_snapshot_gen = db_sread_uint(db);
+	journal_snapshot_has_gen = true;
+}
+
+static void
+journal_h_ju(struct database_handle *const restrict db, const char ATHEME_VATTR_UNUSED *const restrict type)
+{
+	const char *const uid = db_sread_word(db);
+	const char *const name = db_sread_word(db);
+	const char *const pass = db_sread_word(db);
+	const char *const email = db_sread_word(db);
+	const time_t reg = db_sread_time(db);
+	const time_t login = db_sread_time(db);
+	const char *const sflags = db_sread_word(db);
+	const char *const language = db_read_word(db);
+	unsigned int flags = 0;
+	struct myuser *mu;
+
+	if (! gflags_fromstr(mu_flags, sflags, &flags))
+		slog(LG_INFO, "journal-h-ju: line %u: confused by flags: %s", db->line, sflags);
+
+	if ((mu = myuser_find(name)) == NULL)
+		mu = myuser_add_id(uid, name, pass, email, flags);
+	else
+	{
+		if (strcmp(mu->pass, pass) != 0)
+			(void) replace_password(mu, pass, (flags & MU_CRYPTPASS));
+
+		if (strcmp(mu->email, email) != 0)
+			myuser_set_email(mu, email);
+
+		mu->flags = flags;
+	}
+
+	mu->registered = reg;
+	mu->lastlogin = login;
+
+	if (language)
+		mu->language = language_add(language);
+}
+
+static void
+journal_h_jud(struct database_handle *const restrict db, const char ATHEME_VATTR_UNUSED *const restrict type)
+{
+	struct myuser *const mu = myuser_find(db_sread_word(db));
+
+	if (mu != NULL)
+		atheme_object_dispose(mu);
+}
+
+static void
+journal_h_jur(struct database_handle *const restrict db, const char ATHEME_VATTR_UNUSED *const restrict type)
+{
+	const char *const oldname = db_sread_word(db);
+	const char *const newname = db_sread_word(db);
+	struct myuser *const mu = myuser_find(oldname);
+
+	if (mu == NULL || myuser_find(newname) != NULL)
+	{
+		slog(LG_INFO, "journal-h-jur: line %u: cannot rename %s to %s", db->line, oldname, newname);
+		return;
+	}
+
+	myuser_rename(mu, newname);
+}
+
+static void
+journal_h_jn(struct database_handle *const restrict db, const char ATHEME_VATTR_UNUSED *const restrict type)
+{
+	const char *const nick = db_sread_word(db);
+	const char *const owner = db_sread_word(db);
+	const time_t reg = db_sread_time(db);
+	const time_t seen = db_sread_time(db);
+	struct myuser *const mu = myuser_find(owner);
+	struct mynick *mn;
+
+	if (mu == NULL)
+	{
+		slog(LG_DEBUG, "journal-h-jn: line %u: nick %s for unknown account %s", db->line, nick, owner);
+		return;
+	}
+
+	if ((mn = mynick_find(nick)) != NULL && mn->owner != mu)
+	{
+		atheme_object_unref(mn);
+		mn = NULL;
+	}
+
+	if (mn == NULL)
+		mn = mynick_add(mu, nick);
+
+	mn->registered = reg;
+	mn->lastseen = seen;
+}
+
+static void
+journal_h_jnd(struct database_handle *const restrict db, const char ATHEME_VATTR_UNUSED *const restrict type)
+{
+	struct mynick *const mn = mynick_find(db_sread_word(db));
+
+	if (mn != NULL)
+		atheme_object_unref(mn);
+}
+
+static void
+journal_h_jc(struct database_handle *const restrict db, const char ATHEME_VATTR_UNUSED *const restrict type)
+{
+	char buf[4096];
+	const char *const name = db_sread_word(db);
+	const char *sflags;
+	const char *key;
+	unsigned int flags = 0;
+	struct mychan *mc;
+
+	(void) mowgli_strlcpy(buf, name, sizeof buf);
+
+	if ((mc = mychan_find(buf)) == NULL)
+		mc = mychan_add(buf);
+
+	mc->registered = db_sread_time(db);
+	mc->used = db_sread_time(db);
+
+	sflags = db_sread_word(db);
+	if (! gflags_fromstr(mc_flags, sflags, &flags))
+		slog(LG_INFO, "journal-h-jc: line %u: confused by flags %s", db->line, sflags);
+
+	mc->flags = flags;
+	mc->mlock_on = db_sread_uint(db);
+	mc->mlock_off = db_sread_uint(db);
+	mc->mlock_limit = db_sread_uint(db);
+
+	sfree(mc->mlock_key);
+	mc->mlock_key = NULL;
+
+	if ((key = db_read_word(db)) && *key)
+		mc->mlock_key = sstrdup(key);
+}
+
+static void
+journal_h_jcd(struct database_handle *const restrict db, const char ATHEME_VATTR_UNUSED *const restrict type)
+{
+	struct mychan *const mc = mychan_find(db_sread_word(db));
+
+	if (mc != NULL)
+		atheme_object_unref(mc);
+}
+
+static struct chanacs *
+journal_find_chanacs(struct mychan *const restrict mc, const char *const restrict target, struct myentity **const restrict mt)
+{
+	if ((*mt = myentity_find(target)) != NULL)
+		return chanacs_find_literal(mc, *mt, 0);
+
+	return chanacs_find_host_literal(mc, target, 0);
+}
+
+static void
+journal_h_jca(struct database_handle *const restrict db, const char ATHEME_VATTR_UNUSED *const restrict type)
+{
+	const char *const chan = db_sread_word(db);
+	const char *const target = db_sread_word(db);
+	const unsigned int level = flags_to_bitmask(db_sread_word(db), 0) & ca_all;
+	const time_t tmod = db_sread_time(db);
+	struct myentity *const setter = myentity_find(db_sread_word(db));
+	struct mychan *const mc = mychan_find(chan);
+	struct myentity *mt;
+	struct chanacs *ca;
+
+	if (mc == NULL)
+	{
+		slog(LG_DEBUG, "journal-h-jca: line %u: access entry for unknown channel %s", db->line, chan);
+		return;
+	}
+
+	ca = journal_find_chanacs(mc, target, &mt);
+
+	if (mt == NULL && ! validhostmask(target))
+	{
+		slog(LG_DEBUG, "journal-h-jca: line %u: access entry for unknown target %s", db->line, target);
+		return;
+	}
+
+	if (ca == NULL)
+	{
+		if (! level)
+			return;
+
+		if (mt != NULL)
+			(void) chanacs_add(mc, mt, level, tmod, setter);
+		else
+			(void) chanacs_add_host(mc, target, level, tmod, setter);
+
+		return;
+	}
+
+	if (! level)
+	{
+		atheme_object_unref(ca);
+		return;
+	}
+
+	chanacs_set_level(ca, level);
+	ca->tmodified = tmod;
+
+	if (setter != NULL)
+		(void) mowgli_strlcpy(ca->setter_uid, setter->id, sizeof ca->setter_uid);
+	else
+		ca->setter_uid[0] = '\0';
+}
+
+static void
+journal_h_jcad(struct database_handle *const restrict db, const char ATHEME_VATTR_UNUSED *const restrict type)
+{
+	struct mychan *const mc = mychan_find(db_sread_word(db));
+	const char *const target = db_sread_word(db);
+	struct myentity *mt;
+	struct chanacs *ca;
+
+	if (mc != NULL && (ca = journal_find_chanacs(mc, target, &mt)) != NULL)
+		atheme_object_unref(ca);
+}
+
+static void
+journal_h_jcar(struct database_handle *const restrict db, const char ATHEME_VATTR_UNUSED *const restrict type)
+{
+	struct mychan *const mc = mychan_find(db_sread_word(db));
+	const unsigned int keep = flags_to_bitmask(db_sread_word(db), 0) & ca_all;
+
+	// the JCA rows that follow bring back the rest
+	if (mc != NULL)
+		(void) chanacs_replace(mc, NULL, 0, keep);
+}
+
+static void
+journal_h_jmdd(struct database_handle *const restrict db, const char *const restrict type)
+{
+	const char *const name = db_sread_word(db);
+	void *obj = NULL;
+
+	if (! strcmp(type, "JMDDU"))
+		obj = myuser_find(name);
+	else if (! strcmp(type, "JMDDN"))
+		obj = myuser_name_find(name);
+	else if (! strcmp(type, "JMDDC"))
+		obj = mychan_find(name);
+	else
+	{
+		struct mychan *const mc = mychan_find(name);
+		const char *const mask = db_sread_word(db);
+
+		if (mc != NULL)
+			obj = chanacs_find_by_mask(mc, mask, CA_NONE);
+	}
+
+	if (obj != NULL)
+		metadata_delete(obj, db_sread_word(db));
+}
+
+/*********************
+ * F O L L O W I N G *
+ *********************/
+
+/* Rows from the primary's journal are read into journal_follow_buf and
+ * tokenized in place, the same way OpenSEX reads them, through this
+ * vtable.
+ */
+static bool
+journal_follow_read_next_row(struct database_handle *const restrict db)
+{
+	char *const row = db->priv;
+	char *const nl = strchr(row, '\n');
+
+	if (! *row)
+		return false;
+
+	if (nl)
+	{
+		*nl = '\0';
+		db->priv = nl + 1;
+	}
+	else
+		db->priv = row + strlen(row);
+
+	journal_follow_token = row;
+	db->line++;
+	db->token = 0;
+
+	return true;
+}
+
+static const char *
+journal_follow_read_word(struct database_handle *const restrict db)
+{
+	char *const res = journal_follow_token;
+
+	if (res == NULL)
+		return NULL;
+
+	char *const ptr = strchr(res, ' ');
+
+	if (ptr != NULL)
+	{
+		*ptr = '\0';
+		journal_follow_token = ptr + 1;
+	}
+	else
+		journal_follow_token = NULL;
+
+	db->token++;
+
+	return res;
+}
+
+static const char *
+journal_follow_read_str(struct database_handle *const restrict db)
+{
+	db->token++;
+
+	return journal_follow_token;
+}
+
+static bool
+journal_follow_read_uint(struct database_handle *const restrict db, unsigned int *const restrict res)
+{
+	const char *const s = db_read_word(db);
+	char *rp;
+
+	if (! s)
+		return false;
+
+	*res = (unsigned int) strtoul(s, &rp, 0);
+
+	return *s && ! *rp;
+}
+
+static bool
+journal_follow_read_int(struct database_handle *const restrict db, int *const restrict res)
+{
+	const char *const s = db_read_word(db);
+	char *rp;
+
+	if (! s)
+		return false;
+
+	*res = (int) strtol(s, &rp, 0);
+
+	return *s && ! *rp;
+}
+
+static bool
+journal_follow_read_time(struct database_handle *const restrict db, time_t *const restrict res)
+{
+	const char *const s = db_read_word(db);
+	char *rp;
+
+	if (! s)
+		return false;
+
+	*res = (time_t) strtoul(s, &rp, 0);
+
+	return *s && ! *rp;
+}
+
+static const struct database_vtable journal_follow_vt = {
+	.name = "journal",
+	.read_next_row = journal_follow_read_next_row,
+	.read_word = journal_follow_read_word,
+	.read_str = journal_follow_read_str,
+	.read_int = journal_follow_read_int,
+	.read_uint = journal_follow_read_uint,
+	.read_time = journal_follow_read_time,
+};
+
+// the timer is left to the shutdown, as this may run from it
+static void
+journal_follow_stop(void)
+{
+	if (journal_follow_fd != -1)
+		(void) close(journal_follow_fd);
+
+	journal_following = false;
+	journal_follow_fd = -1;
+	journal_follow_buflen = 0;
+}
+
+// applies the complete rows read so far, keeping a trailing partial one
+static void
+journal_follow_apply(void)
+{
+	size_t len = journal_follow_buflen;
+
+	while (len > 0 && journal_follow_buf[len - 1] != '\n')
+		len--;
+
+	if (len == 0)
+		return;
+
+	const char saved = journal_follow_buf[len];
+	char path[BUFSIZE];
+
+	journal_path(path, sizeof path, journal_follow_gen, true);
+
+	journal_follow_buf[len] = '\0';
+
+	struct database_handle db = {
+		.priv = journal_follow_buf,
+		.vt = &journal_follow_vt,
+		.txn = DB_READ,
+		.file = path,
+	};
+
+	while (db_read_next_row(&db))
+	{
+		const char *const cmd = db_read_word(&db);
+
+		if (! cmd || ! *cmd || strchr("#\n\t \r", *cmd))
+			continue;
+
+		db_process(&db, cmd);
+	}
+
+	journal_follow_buf[len] = saved;
+	journal_follow_buflen -= len;
+
+	(void) memmove(journal_follow_buf, journal_follow_buf + len, journal_follow_buflen);
+}
+
+// reads what has been appended to the generation being followed
+static bool
+journal_follow_read(void)
+{
+	for (;;)
+	{
+		if (journal_follow_bufsize - journal_follow_buflen < JOURNAL_BUFSIZE + 1)
+		{
+			journal_follow_bufsize = journal_follow_buflen + JOURNAL_BUFSIZE + 1;
+			journal_follow_buf = srealloc(journal_follow_buf, journal_follow_bufsize);
+		}
+
+		const ssize_t ret = read(journal_follow_fd, journal_follow_buf + journal_follow_buflen, JOURNAL_BUFSIZE);
+
+		if (ret < 0)
+		{
+			if (errno == EINTR)
+				continue;
+
+			slog(LG_ERROR, "journal: cannot read generation %u: %s", journal_follow_gen, strerror(errno));
+			return false;
+		}
+
+		if (ret == 0)
+			return true;
+
+		journal_follow_buflen += (size_t) ret;
+
+		journal_follow_apply();
+	}
+}
+
+static void
+journal_follow_poll(void ATHEME_VATTR_UNUSED *const restrict unused)
+{
+	char path[BUFSIZE];
+
+	while (journal_following)
+	{
+		if (journal_follow_fd == -1)
+		{
+			journal_path(path, sizeof path, journal_follow_gen, true);
+
+			if ((journal_follow_fd = open(path, O_RDONLY)) == -1)
+			{
+				if (errno == ENOENT && ! journal_exists(journal_follow_gen + 1))
+					// the primary has not started it yet
+					return;
+
+				slog(LG_ERROR, "journal: lost track of the primary at generation %u: %s; "
+				     "restart this replica to load its latest snapshot", journal_follow_gen,
+				     (errno == ENOENT) ? "it has been compacted away" : strerror(errno));
+				wallops("\2DATABASE ERROR\2: journal: replica lost track of the primary at generation %u",
+				        journal_follow_gen);
+
+				journal_follow_stop();
+				return;
+			}
+
+			slog(LG_DEBUG, "journal: following %s", path);
+		}
+
+		/* The primary closes a generation before it starts the next, so once
+		 * that exists, reading this one to the end gets all of it.
+		 */
+		const bool finished = journal_exists(journal_follow_gen + 1);
+
+		if (! journal_follow_read())
+		{
+			journal_follow_stop();
+			return;
+		}
+
+		if (! finished)
+			return;
+
+		if (journal_follow_buflen)
+			slog(LG_INFO, "journal: discarding incomplete last row of generation %u", journal_follow_gen);
+
+		(void) close(journal_follow_fd);
+
+		journal_follow_fd = -1;
+		journal_follow_buflen = 0;
+		journal_follow_gen++;
+	}
+}
+
+static void
+journal_follow_start(const unsigned int gen)
+{
+	replica = true;
+	journal_following = true;
+	journal_follow_gen = gen;
+
+	slog(LG_INFO, "journal: running as a replica, following the journal from generation %u every %u seconds",
+	     gen, journal_follow_interval);
+
+	journal_follow_poll(NULL);
+
+	if (journal_following)
+		journal_follow_timer = timer_add("journal_follow", journal_follow_poll, NULL, journal_follow_interval);
+}
+
+/***************************
+ * S N A P S H O T T I N G *
+ ***************************/
+
+static void
+journal_db_loaded(void ATHEME_VATTR_UNUSED *const restrict unused)
+{
+	unsigned int gen = journal_snapshot_gen;
+
+	if (database_create)
+		return;
+
+	if (readonly && journal_follow_interval)
+	{
+		// the primary's journals are still being written and must not be trimmed
+		journal_follow_start(journal_snapshot_has_gen ? journal_snapshot_gen : 0);
+		return;
+	}
+
+	if (journal_snapshot_has_gen)
+	{
+		for (; journal_exists(gen); gen++)
+			journal_replay(gen);
+
+		journal_unlink_before(journal_snapshot_gen);
+	}
+	else if (journal_exists(0))
+	{
+		// written before this snapshot was, which didn't know about them
+		slog(LG_INFO, "journal: database has no journal generation; ignoring existing journals");
+
+		for (; journal_exists(gen); gen++)
+			;
+
+		journal_unlink_before(gen);
+		gen = 0;
+	}
+
+	if (readonly)
+		return;
+
+	journal_open(gen);
+	journal_last_compact = CURRTIME;
+	journal_start_timer();
+}
+
+static void
+journal_db_load(const char *const restrict filename)
+{
+	journal_set_db_name(filename);
+	journal_next_db_load(filename);
+}
+
+static void
+journal_db_save(void *const restrict filename, const enum db_save_strategy strategy)
+{
+	journal_set_db_name(filename);
+
+	if (strategy == DB_SAVE_BG_REGULAR && journal_fd != -1 &&
+	    journal_size + journal_buflen < JOURNAL_COMPACT_SIZE &&
+	    CURRTIME < journal_last_compact + (time_t) journal_compact_interval)
+	{
+		db_shards_save(filename);
+		journal_sync();
+		db_changes_saving();
+		return;
+	}
+
+	slog(LG_DEBUG, "journal: compacting generation %u into a snapshot", journal_gen);
+
+	// the snapshot covers everything before the generation started here
+	journal_close();
+	journal_open(journal_gen + 1);
+	journal_last_compact = CURRTIME;
+
+	journal_next_db_save(filename, strategy);
+}
+
+static void
+journal_db_write(struct database_handle *const restrict db)
+{
+	journal_snapshot_gen = journal_gen;
+
+	db_start_row(db, "JGEN");
+	db_write_uint(db, journal_gen);
+	db_commit_row(db);
+}
+
+static void
+journal_db_saved(void ATHEME_VATTR_UNUSED *const restrict unused)
+{
+	char path[BUFSIZE];
+
+	// runs in the snapshot writer; a leftover .new means the rename failed
+	(void) snprintf(path, sizeof path, "%s/%s.new", datadir, journal_db_name);
+
+	if (access(path, F_OK) == 0)
+		return;
+
+	journal_unlink_before(journal_snapshot_gen);
+}
+
+static void
+journal_config_ready(void ATHEME_VATTR_UNUSED *const restrict unused)
+{
+	if (journal_fd != -1)
+		journal_start_timer();
+}
+
+static void
+journal_shutdown(void ATHEME_VATTR_UNUSED *const restrict unused)
+{
+	journal_sync();
+	journal_follow_stop();
+
+	if (journal_follow_timer != NULL)
+		timer_destroy(journal_follow_timer);
+
+	journal_follow_timer = NULL;
+}
+
+static void
+mod_init(struct module *const restrict m)
+{
+	MODULE_TRY_REQUEST_DEPENDENCY(m, "backend/corestorage")
+	MODULE_TRY_REQUEST_DEPENDENCY(m, "backend/opensex")
+
+	journal_next_db_save = db_save;
+	db_save = &journal_db_save;
+	journal_next_db_load = db_load;
+	db_load = &journal_db_load;
+
+	db_register_type_handler("JGEN", journal_h_jgen);
+	db_register_type_handler("JU", journal_h_ju);
+	db_register_type_handler("JUD", journal_h_jud);
+	db_register_type_handler("JUR", journal_h_jur);
+	db_register_type_handler("JN", journal_h_jn);
+	db_register_type_handler("JND", journal_h_jnd);
+	db_register_type_handler("JC", journal_h_jc);
+	db_register_type_handler("JCD", journal_h_jcd);
+	db_register_type_handler("JCA", journal_h_jca);
+	db_register_type_handler("JCAD", journal_h_jcad);
+	db_register_type_handler("JCAR", journal_h_jcar);
+	db_register_type_handler("JMDDU", journal_h_jmdd);
+	db_register_type_handler("JMDDN", journal_h_jmdd);
+	db_register_type_handler("JMDDC", journal_h_jmdd);
+	db_register_type_handler("JMDDA", journal_h_jmdd);
+
+	hook_add_db_loaded(journal_db_loaded);
+	hook_add_db_write(journal_db_write);
+	hook_add_db_saved(journal_db_saved);
+	hook_add_config_ready(journal_config_ready);
+	hook_add_shutdown(journal_shutdown);
+
+	hook_add_myuser_add(journal_myuser_add);
+	hook_add_myuser_change(journal_myuser_add);
+	hook_add_user_register(journal_myuser_add);
+	hook_add_myuser_delete(journal_myuser_delete);
+	hook_add_user_rename(journal_user_rename);
+	hook_add_mynick_add(journal_mynick_add);
+	hook_add_mynick_delete(journal_mynick_delete);
+	hook_add_mychan_add(journal_mychan_add);
+	hook_add_channel_register(journal_channel_register);
+	hook_add_mychan_delete(journal_mychan_delete);
+	hook_add_chanacs_change(journal_chanacs_change);
+	hook_add_chanacs_delete(journal_chanacs_delete);
+	hook_add_chanacs_replace(journal_chanacs_replace);
+	hook_add_metadata_add(journal_metadata_add);
+	hook_add_metadata_delete(journal_metadata_delete);
+
+	add_duration_conf_item("JOURNAL_SYNC_INTERVAL", &conf_gi_table, 0, &journal_sync_interval, "s", 1);
+	add_duration_conf_item("JOURNAL_COMPACT_INTERVAL", &conf_gi_table, 0, &journal_compact_interval, "m", SECONDS_PER_HOUR);
+	add_duration_conf_item("JOURNAL_FOLLOW", &conf_gi_table, 0, &journal_follow_interval, "s", 0);
+
+	m->mflags |= MODFLAG_DBHANDLER;
+}
+
+static void
+mod_deinit(const enum module_unload_intent ATHEME_VATTR_UNUSED intent)
+{
+
+}
+
+SIMPLE_DECLARE_MODULE_V1("backend/journal", MODULE_UNLOAD_CAPABILITY_NEVER)
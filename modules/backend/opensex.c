@@ -12,6 +12,52 @@
 
 #include <atheme.h>
 
+#if defined(HAVE_SYS_MMAN_H) && defined(HAVE_USABLE_PTHREAD)
+#  include <pthread.h>
+#  define OPENSEX_SCANNER 1
+#endif
+
+#ifdef OPENSEX_SCANNER
+
+#define OPENSEX_BATCH_ROWS      4096U
+#define OPENSEX_BATCHES         4U
+
+/* While the main thread runs the row handlers, a scanner thread walks ahead
+ * through the mapped file finding row boundaries, a batch of rows at a time.
+ * It takes the page faults (disk reads, after a crash with a cold cache)
+ * and the newline scan off the main thread, which only ever reads and
+ * writes bytes of rows the scanner has already handed over.
+ */
+struct opensex_row_batch
+{
+	size_t                  off[OPENSEX_BATCH_ROWS];
+	size_t                  len[OPENSEX_BATCH_ROWS];   // without the newline
+	unsigned int            count;
+};
+
+struct opensex_scanner
+{
+	pthread_t               thread;
+	pthread_mutex_t         lock;
+	pthread_cond_t          cond;
+	const char *            map;
+	size_t                  maplen;
+
+	// protected by lock
+	unsigned int            filled;         // batches handed over so far
+	unsigned int            consumed;       // batches given back so far
+	bool                    eof;
+	bool                    stop;
+
+	// main thread only
+	struct opensex_row_batch *cur;
+	unsigned int            pos;
+
+	struct opensex_row_batch batches[OPENSEX_BATCHES];
+};
+
+#endif /* OPENSEX_SCANNER */
+
 struct opensex
 {
 	// Lexing state
@@ -19,6 +65,18 @@ struct opensex
 	unsigned int bufsize;
 	char *token;
 	FILE *f;
+	struct db_output out;
+
+	/* Memory-mapped or decompressed input (map is NULL when reading
+	 * through stdio); a decompressed file is in a heap buffer instead.
+	 */
+	char *map;
+	size_t maplen;
+	size_t mappos;
+	bool mapheap;
+#ifdef OPENSEX_SCANNER
+	struct opensex_scanner *scan;
+#endif
 
 	// Interpreting state
 	unsigned int grver;
@@ -51,6 +109,201 @@ opensex_h_grver(struct database_handle *db, const char *type)
 		slog(LG_ERROR, "opensex: grammar version %u is unsupported.  dazed and confused, but trying to continue.", rs->grver);
 }
 
+/* Rows are split and tokenized in place: the mapping is private, so writing
+ * the terminators only dirties our copy of each page, never the file.
+ */
+static bool
+opensex_read_next_row_mapped(struct database_handle *hdl)
+{
+	struct opensex *rs = (struct opensex *)hdl->priv;
+	char *row, *nl;
+	size_t len;
+
+	if (rs->mappos >= rs->maplen)
+		return false;
+
+	row = rs->map + rs->mappos;
+	len = rs->maplen - rs->mappos;
+
+	if ((nl = memchr(row, '\n', len)) != NULL)
+	{
+		*nl = '\0';
+		rs->mappos += (size_t) (nl - row) + 1;
+		rs->token = row;
+	}
+	else
+	{
+		// last row has no newline and there may be no byte after it to terminate it with
+		if (len >= rs->bufsize)
+		{
+			rs->bufsize = len + 1;
+			rs->buf = srealloc(rs->buf, rs->bufsize);
+		}
+
+		(void) memcpy(rs->buf, row, len);
+		rs->buf[len] = '\0';
+		rs->mappos = rs->maplen;
+		rs->token = rs->buf;
+	}
+
+	hdl->line++;
+	hdl->token = 0;
+	return true;
+}
+
+#ifdef OPENSEX_SCANNER
+// Runs on the scanner thread; it touches nothing but the scanner
+static void *
+opensex_scanner_run(void *const restrict arg)
+{
+	struct opensex_scanner *const sc = arg;
+	size_t pos = 0;
+
+	while (pos < sc->maplen)
+	{
+		(void) pthread_mutex_lock(&sc->lock);
+
+		while (sc->filled - sc->consumed == OPENSEX_BATCHES && ! sc->stop)
+			(void) pthread_cond_wait(&sc->cond, &sc->lock);
+
+		const bool stop = sc->stop;
+
+		(void) pthread_mutex_unlock(&sc->lock);
+
+		if (stop)
+			break;
+
+		struct opensex_row_batch *const b = &sc->batches[sc->filled % OPENSEX_BATCHES];
+
+		for (b->count = 0; b->count < OPENSEX_BATCH_ROWS && pos < sc->maplen; b->count++)
+		{
+			const char *const nl = memchr(sc->map + pos, '\n', sc->maplen - pos);
+			const size_t len = (nl != NULL) ? (size_t) (nl - (sc->map + pos)) : sc->maplen - pos;
+
+			b->off[b->count] = pos;
+			b->len[b->count] = len;
+			pos += len + ((nl != NULL) ? 1U : 0U);
+		}
+
+		(void) pthread_mutex_lock(&sc->lock);
+		sc->filled++;
+		(void) pthread_cond_broadcast(&sc->cond);
+		(void) pthread_mutex_unlock(&sc->lock);
+	}
+
+	(void) pthread_mutex_lock(&sc->lock);
+	sc->eof = true;
+	(void) pthread_cond_broadcast(&sc->cond);
+	(void) pthread_mutex_unlock(&sc->lock);
+
+	return NULL;
+}
+
+static void
+opensex_scanner_start(struct opensex *const restrict rs)
+{
+	struct opensex_scanner *const sc = smalloc(sizeof *sc);
+
+	sc->map = rs->map;
+	sc->maplen = rs->maplen;
+
+	(void) pthread_mutex_init(&sc->lock, NULL);
+	(void) pthread_cond_init(&sc->cond, NULL);
+
+	if (pthread_create(&sc->thread, NULL, &opensex_scanner_run, sc) != 0)
+	{
+		slog(LG_DEBUG, "db-open-read: pthread_create() failed; scanning rows on the main thread");
+
+		(void) pthread_cond_destroy(&sc->cond);
+		(void) pthread_mutex_destroy(&sc->lock);
+		sfree(sc);
+		return;
+	}
+
+	rs->scan = sc;
+}
+
+static void
+opensex_scanner_stop(struct opensex *const restrict rs)
+{
+	struct opensex_scanner *const sc = rs->scan;
+
+	(void) pthread_mutex_lock(&sc->lock);
+	sc->stop = true;
+	(void) pthread_cond_broadcast(&sc->cond);
+	(void) pthread_mutex_unlock(&sc->lock);
+
+	(void) pthread_join(sc->thread, NULL);
+	(void) pthread_cond_destroy(&sc->cond);
+	(void) pthread_mutex_destroy(&sc->lock);
+
+	sfree(sc);
+	rs->scan = NULL;
+}
+
+static bool
+opensex_read_next_row_scanned(struct database_handle *hdl)
+{
+	struct opensex *rs = (struct opensex *)hdl->priv;
+	struct opensex_scanner *const sc = rs->scan;
+
+	if (sc->cur == NULL || sc->pos == sc->cur->count)
+	{
+		(void) pthread_mutex_lock(&sc->lock);
+
+		if (sc->cur != NULL)
+		{
+			sc->consumed++;
+			sc->cur = NULL;
+			(void) pthread_cond_broadcast(&sc->cond);
+		}
+
+		while (sc->filled == sc->consumed && ! sc->eof)
+			(void) pthread_cond_wait(&sc->cond, &sc->lock);
+
+		if (sc->filled != sc->consumed)
+		{
+			sc->cur = &sc->batches[sc->consumed % OPENSEX_BATCHES];
+			sc->pos = 0;
+		}
+
+		(void) pthread_mutex_unlock(&sc->lock);
+
+		if (sc->cur == NULL)
+			return false;
+	}
+
+	const size_t off = sc->cur->off[sc->pos];
+	const size_t len = sc->cur->len[sc->pos];
+	char *const row = rs->map + off;
+
+	sc->pos++;
+
+	if (off + len < rs->maplen)
+	{
+		row[len] = '\0';
+		rs->token = row;
+	}
+	else
+	{
+		// last row has no newline and there may be no byte after it to terminate it with
+		if (len >= rs->bufsize)
+		{
+			rs->bufsize = len + 1;
+			rs->buf = srealloc(rs->buf, rs->bufsize);
+		}
+
+		(void) memcpy(rs->buf, row, len);
+		rs->buf[len] = '\0';
+		rs->token = rs->buf;
+	}
+
+	hdl->line++;
+	hdl->token = 0;
+	return true;
+}
+#endif /* OPENSEX_SCANNER */
+
 static bool
 opensex_read_next_row(struct database_handle *hdl)
 {
@@ -58,6 +311,14 @@ opensex_read_next_row(struct database_handle *hdl)
 	unsigned int n = 0;
 	struct opensex *rs = (struct opensex *)hdl->priv;
 
+#ifdef OPENSEX_SCANNER
+	if (rs->scan != NULL)
+		return opensex_read_next_row_scanned(hdl);
+#endif
+
+	if (rs->map != NULL)
+		return opensex_read_next_row_mapped(hdl);
+
 	while ((c = getc(rs->f)) != EOF && c != '\n')
 	{
 		rs->buf[n++] = c;
@@ -168,7 +429,8 @@ opensex_start_row(struct database_handle *db, const char *type)
 	return_val_if_fail(type != NULL, false);
 	rs = (struct opensex *)db->priv;
 
-	fprintf(rs->f, "%s ", type);
+	db_output_write(&rs->out, type, strlen(type));
+	db_output_write(&rs->out, " ", 1);
 
 	return true;
 }
@@ -183,7 +445,13 @@ opensex_write_cell(struct database_handle *db, const char *data, bool multiword)
 	return_val_if_fail(db != NULL, false);
 	rs = (struct opensex *)db->priv;
 
-	fprintf(rs->f, "%s%s", data != NULL ? data : "*", !multiword ? " " : "");
+	if (data == NULL)
+		data = "*";
+
+	db_output_write(&rs->out, data, strlen(data));
+
+	if (!multiword)
+		db_output_write(&rs->out, " ", 1);
 
 	return true;
 }
@@ -232,7 +500,7 @@ opensex_commit_row(struct database_handle *db)
 	return_val_if_fail(db != NULL, false);
 	rs = (struct opensex *)db->priv;
 
-	fprintf(rs->f, "\n");
+	db_output_write(&rs->out, "\n", 1);
 
 	return true;
 }
@@ -300,6 +568,42 @@ opensex_db_open_read(const char *filename)
 	rs->buf = smalloc(rs->bufsize);
 	rs->f = f;
 
+	if ((rs->map = db_input_decompress(f, path, &rs->maplen)) != NULL)
+	{
+		rs->mapheap = true;
+
+#ifdef OPENSEX_SCANNER
+		opensex_scanner_start(rs);
+#endif
+	}
+
+#ifdef HAVE_SYS_MMAN_H
+	/* Map the whole file if we can, so that loading does not go through
+	 * stdio a byte at a time and copy every row; fall back to stdio if not.
+	 */
+	struct stat sb;
+
+	if (rs->map == NULL && fstat(fileno(f), &sb) == 0 && S_ISREG(sb.st_mode) && sb.st_size > 0 && (uintmax_t) sb.st_size < SIZE_MAX)
+	{
+		void *const map = mmap(NULL, (size_t) sb.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fileno(f), 0);
+
+		if (map != MAP_FAILED)
+		{
+#ifdef MADV_SEQUENTIAL
+			(void) madvise(map, (size_t) sb.st_size, MADV_SEQUENTIAL);
+#endif
+			rs->map = map;
+			rs->maplen = (size_t) sb.st_size;
+
+#ifdef OPENSEX_SCANNER
+			opensex_scanner_start(rs);
+#endif
+		}
+		else
+			slog(LG_DEBUG, "db-open-read: cannot map '%s', reading it through stdio: %s", path, strerror(errno));
+	}
+#endif /* HAVE_SYS_MMAN_H */
+
 	db = smalloc(sizeof *db);
 	db->priv = rs;
 	db->vt = &opensex_vt;
@@ -314,8 +618,8 @@ opensex_db_open_write(const char *filename)
 {
 	struct database_handle *db;
 	struct opensex *rs;
+	struct db_output out;
 	int fd;
-	FILE *f;
 	int errno1;
 	char bpath[BUFSIZE], path[BUFSIZE];
 #ifdef HAVE_FLOCK
@@ -336,8 +640,8 @@ opensex_db_open_write(const char *filename)
 	flock(lockfd, LOCK_EX);
 #endif
 
-	fd = open(path, O_WRONLY | O_CREAT, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
-	if (fd < 0 || ! (f = fdopen(fd, "w")))
+	fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
+	if (fd < 0 || ! db_output_open(&out, fd, path))
 	{
 		errno1 = errno;
 		slog(LG_ERROR, "db-open-write: cannot open '%s' for writing: %s", path, strerror(errno1));
@@ -349,7 +653,7 @@ opensex_db_open_write(const char *filename)
 	}
 
 	rs = smalloc(sizeof *rs);
-	rs->f = f;
+	rs->out = out;
 	rs->grver = 1;
 
 	db = smalloc(sizeof *db);
@@ -388,7 +692,17 @@ opensex_db_close(struct database_handle *db)
 
 	mowgli_strlcpy(newpath, db->file, sizeof newpath);
 
-	fclose(rs->f);
+	if (db->txn == DB_WRITE)
+	{
+		if (! db_output_close(&rs->out))
+		{
+			errno1 = errno;
+			slog(LG_ERROR, "db_save(): cannot write %s: %s", oldpath, strerror(errno1));
+			wallops("\2DATABASE ERROR\2: db_save(): cannot write %s: %s", oldpath, strerror(errno1));
+		}
+	}
+	else
+		fclose(rs->f);
 
 	if (db->txn == DB_WRITE)
 	{
@@ -406,6 +720,18 @@ opensex_db_close(struct database_handle *db)
 #endif
 	}
 
+#ifdef OPENSEX_SCANNER
+	if (rs->scan != NULL)
+		opensex_scanner_stop(rs);
+#endif
+
+	if (rs->mapheap)
+		sfree(rs->map);
+#ifdef HAVE_SYS_MMAN_H
+	else if (rs->map != NULL)
+		(void) munmap(rs->map, rs->maplen);
+#endif
+
 	sfree(rs->buf);
 	sfree(rs);
 	sfree(db->file);
@@ -17,6 +17,7 @@ static struct service *botsvs = NULL;
 static unsigned int min_users = 0;
 
 static mowgli_list_t bs_bots;
+static struct db_shard *bs_shard = NULL;
 
 static struct botserv_bot *
 botserv_bot_find(const char *name)
@@ -234,36 +235,46 @@ bs_try_kick(struct user *source, struct channel *chan, struct user *target, cons
 	return try_kick_real(bot ? bot : source, chan, target, reason);
 }
 
+static unsigned int
+bs_kick_users(struct user *source, struct channel *chan, struct user **targets, size_t count, const char *reason)
+{
+	struct mychan *mc;
+	struct metadata *bs;
+	struct user *bot = NULL;
+
+	return_val_if_fail(source != NULL, 0);
+	return_val_if_fail(chan != NULL, 0);
+
+	if (source != chansvs.me->me)
+		return kick_users_real(source, chan, targets, count, reason);
+
+	if ((mc = mychan_from(chan)) != NULL && (bs = metadata_find(mc, "private:botserv:bot-assigned")) != NULL)
+		bot = user_find_named(bs->value);
+
+	return kick_users_real(bot ? bot : source, chan, targets, count, reason);
+}
+
+static void
+bs_join_registered_cb(struct channel *c, struct user *u)
+{
+	if (chansvs.me != NULL && chansvs.me->me != NULL && chanuser_find(c, chansvs.me->me))
+		part(c->name, chansvs.nick);
+}
+
 static void
 bs_join_registered(bool all)
 {
 	struct mychan *mc;
 	mowgli_patricia_iteration_state_t state;
 	struct metadata *md;
-	int cs = 0;
-
-	if ((chansvs.me != NULL) && (chansvs.me->me != NULL))
-		cs = 1;
 
 	MOWGLI_PATRICIA_FOREACH(mc, &state, mclist)
 	{
 		if ((md = metadata_find(mc, "private:botserv:bot-assigned")) == NULL)
 			continue;
 
-		if (all)
-		{
-			join(mc->name, md->value);
-			if (mc->chan && cs && chanuser_find(mc->chan, chansvs.me->me))
-				part(mc->name, chansvs.nick);
-			continue;
-		}
-		else if (mc->chan != NULL && mc->chan->members.count != 0)
-		{
-			join(mc->name, md->value);
-			if (mc->chan && cs && chanuser_find(mc->chan, chansvs.me->me))
-				part(mc->name, chansvs.nick);
-			continue;
-		}
+		if (all || (mc->chan != NULL && mc->chan->members.count != 0))
+			join_queue(mc->name, md->value, &bs_join_registered_cb);
 	}
 }
 
@@ -286,10 +297,10 @@ botserv_channel_handler(struct sourceinfo *si, int parc, char *parv[])
 {
 	struct metadata *md;
 	struct mychan *mc = NULL;
-	char orig[BUFSIZE];
-	char newargs[BUFSIZE];
+	struct command *c;
+	char *chan;
+	bool ctcp;
 	char *cmd;
-	char *args;
 	struct service *sptr = NULL;
 
 	// this should never happen
@@ -333,15 +344,14 @@ botserv_channel_handler(struct sourceinfo *si, int parc, char *parv[])
 	if (md == NULL || irccasecmp(si->service->me->nick, md->value))
 		return;
 
-	// make a copy of the original for debugging
-	mowgli_strlcpy(orig, parv[parc - 1], BUFSIZE);
+	ctcp = parv[parc - 1][0] == '\001';
 
 	// lets go through this to get the command
 	cmd = strtok(parv[parc - 1], " ");
 
 	if (!cmd)
 		return;
-	if (*orig == '\001')
+	if (ctcp)
 	{
 		handle_ctcp_common(si, cmd, strtok(NULL, ""));
 		return;
@@ -358,19 +368,10 @@ botserv_channel_handler(struct sourceinfo *si, int parc, char *parv[])
 	{
 		const char *realcmd = service_resolve_alias(chansvs.me, NULL, cmd);
 
-		// XXX not really nice to look up the command twice -- jilles
-		if (command_find(sptr->commands, realcmd) == NULL)
+		if ((c = command_find(sptr->commands, realcmd)) == NULL)
 			return;
 		if (floodcheck(si->su, si->service->me))
 			return;
-		// construct <channel> <args>
-		mowgli_strlcpy(newargs, parv[parc - 2], sizeof newargs);
-		args = strtok(NULL, "");
-		if (args != NULL)
-		{
-			mowgli_strlcat(newargs, " ", sizeof newargs);
-			mowgli_strlcat(newargs, args, sizeof newargs);
-		}
 
 		// let the command know it's called as fantasy cmd
 		si->c = mc->chan;
@@ -379,7 +380,8 @@ botserv_channel_handler(struct sourceinfo *si, int parc, char *parv[])
 		 * (a little ugly but this way we can !set verbose)
 		 */
 		mc->flags |= MC_FORCEVERBOSE;
-		command_exec_split(si->service, si, realcmd, newargs, sptr->commands);
+		chan = parv[parc - 2];
+		command_exec_args(si->service, si, c, 1, &chan, strtok(NULL, ""));
 		mc->flags &= ~MC_FORCEVERBOSE;
 	}
 	else if (!strncasecmp(cmd, si->service->me->nick, strlen(si->service->me->nick)) && (cmd = strtok(NULL, "")) != NULL)
@@ -387,18 +389,12 @@ botserv_channel_handler(struct sourceinfo *si, int parc, char *parv[])
 		const char *realcmd;
 		char *pptr;
 
-		mowgli_strlcpy(newargs, parv[parc - 2], sizeof newargs);
 		if ((pptr = strchr(cmd, ' ')) != NULL)
-		{
-			*pptr = '\0';
-
-			mowgli_strlcat(newargs, " ", sizeof newargs);
-			mowgli_strlcat(newargs, ++pptr, sizeof newargs);
-		}
+			*pptr++ = '\0';
 
 		realcmd = service_resolve_alias(chansvs.me, NULL, cmd);
 
-		if (command_find(sptr->commands, realcmd) == NULL)
+		if ((c = command_find(sptr->commands, realcmd)) == NULL)
 			return;
 		if (floodcheck(si->su, si->service->me))
 			return;
@@ -409,7 +405,8 @@ botserv_channel_handler(struct sourceinfo *si, int parc, char *parv[])
 		 * (a little ugly but this way we can !set verbose)
 		 */
 		mc->flags |= MC_FORCEVERBOSE;
-		command_exec_split(si->service, si, realcmd, newargs, sptr->commands);
+		chan = parv[parc - 2];
+		command_exec_args(si->service, si, c, 1, &chan, pptr);
 		mc->flags &= ~MC_FORCEVERBOSE;
 	}
 }
@@ -547,6 +544,7 @@ bs_cmd_add(struct sourceinfo *si, int parc, char *parv[])
 	mowgli_node_add(bot, &bot->bnode, &bs_bots);
 
 	logcommand(si, CMDLOG_ADMIN, "BOT:ADD: \2%s\2 (\2%s\2@\2%s\2) [\2%s\2]", bot->nick, bot->user, bot->host, bot->real);
+	db_shard_dirty(bs_shard);
 	command_success_nodata(si, _("Bot \2%s\2 (\2%s\2@\2%s\2) [\2%s\2] created."), bot->nick, bot->user, bot->host, bot->real);
 }
 
@@ -658,6 +656,7 @@ bs_cmd_change(struct sourceinfo *si, int parc, char *parv[])
 	}
 
 	logcommand(si, CMDLOG_ADMIN, "BOT:CHANGE: \2%s\2 (\2%s\2@\2%s\2) [\2%s\2]", bot->nick, bot->user, bot->host, bot->real);
+	db_shard_dirty(bs_shard);
 	command_success_nodata(si, _("Bot \2%s\2 (\2%s\2@\2%s\2) [\2%s\2] changed."), bot->nick, bot->user, bot->host, bot->real);
 }
 
@@ -710,6 +709,7 @@ bs_cmd_delete(struct sourceinfo *si, int parc, char *parv[])
 	sfree(bot);
 
 	logcommand(si, CMDLOG_ADMIN, "BOT:DEL: \2%s\2", parv[0]);
+	db_shard_dirty(bs_shard);
 	command_success_nodata(si, _("Bot \2%s\2 deleted."), parv[0]);
 }
 
@@ -1071,9 +1071,10 @@ mod_init(struct module *const restrict m)
 
 	hook_add_config_ready(botserv_config_ready);
 
-	hook_add_db_write(botserv_save_database);
 	db_register_type_handler("BOT", db_h_bot);
 	db_register_type_handler("BOT-COUNT", db_h_bot_count);
+	bs_shard = db_shard_register("botserv", botserv_save_database);
+	db_shard_load(bs_shard);
 
 	hook_add_channel_drop(bs_channel_drop);
 	hook_add_shutdown(on_shutdown);
@@ -1093,6 +1094,7 @@ mod_init(struct module *const restrict m)
 	modestack_mode_ext    = bs_modestack_mode_ext;
 	modestack_mode_param  = bs_modestack_mode_param;
 	try_kick              = bs_try_kick;
+	kick_users            = bs_kick_users;
 	topic_sts_real        = topic_sts;
 	topic_sts             = bs_topic_sts;
 	msg_real              = msg;
@@ -30,13 +30,63 @@
  */
 #define CHANFIX_EXPIRE_DIVISOR  672U
 
+/* Oprecords are kept by value in an array per channel and move around
+ * within it, so pointers to them are only good until the next record is
+ * created or deleted.
+ */
+struct chanfix_oprecord
+{
+	struct myentity *entity;
+
+	stringref user;
+	stringref host;
+
+	time_t firstseen;
+	time_t lastevent;
+	time_t settled;         // age includes gains and decay up to this time
+	unsigned int age;
+
+	unsigned int nopped;    // users opped in the channel who count towards this
+
+	unsigned int score;     // weighted age, as of the channel's last ranking
+};
+
+struct chanfix_rank
+{
+	unsigned int score;
+	unsigned int record;
+};
+
+// A user opped in the channel, counting towards records[record]
+struct chanfix_op
+{
+	mowgli_node_t node;
+
+	struct user *u;
+	unsigned int record;
+};
+
 struct chanfix_channel
 {
 	struct atheme_object parent;
 
 	char *name;
 
-	mowgli_list_t oprecords;
+	struct chanfix_oprecord *records;
+	unsigned int nrecords;
+	unsigned int records_alloc;
+
+	// Record index + 1 by account and by user@host, 2 * records_alloc slots each
+	unsigned int *byentity;
+	unsigned int *bymask;
+	bool index_stale;
+
+	// Records by score, best first, records_alloc slots; see chanfix_channel_rank()
+	struct chanfix_rank *ranked;
+	time_t ranked_until;
+
+	mowgli_list_t opped;
+
 	time_t ts;
 	time_t lastupdate;
 
@@ -44,22 +94,14 @@ struct chanfix_channel
 
 	time_t fix_started;
 	bool fix_requested;
-};
 
-struct chanfix_oprecord
-{
-	mowgli_node_t node;
-
-	struct chanfix_channel *chan;
-
-	struct myentity *entity;
+	mowgli_node_t fix_node;
+	bool fixing;
 
-	char user[USERLEN + 1];
-	char host[HOSTLEN + 1];
+	struct timerwheel_entry expire_timer;
 
-	time_t firstseen;
-	time_t lastevent;
-	unsigned int age;
+	mowgli_node_t dirty_node;
+	bool dirty;
 };
 
 struct chanfix_persist_record
@@ -67,29 +109,32 @@ struct chanfix_persist_record
 	int version;
 
 	mowgli_heap_t *chanfix_channel_heap;
-	mowgli_heap_t *chanfix_oprecord_heap;
 
 	mowgli_patricia_t *chanfix_channels;
 };
 
 extern struct service *chanfix;
 extern mowgli_patricia_t *chanfix_channels;
+extern struct db_shard *chanfix_shard;
 
 void chanfix_gather_init(struct chanfix_persist_record *);
 void chanfix_gather_deinit(struct chanfix_persist_record *);
 
-void chanfix_oprecord_update(struct chanfix_channel *chan, struct user *u);
-void chanfix_oprecord_delete(struct chanfix_oprecord *orec);
+void chanfix_oprecord_settle(struct chanfix_channel *chan, struct chanfix_oprecord *orec);
+void chanfix_oprecord_delete(struct chanfix_channel *chan, struct chanfix_oprecord *orec);
 struct chanfix_oprecord *chanfix_oprecord_create(struct chanfix_channel *chan, struct user *u);
 struct chanfix_oprecord *chanfix_oprecord_find(struct chanfix_channel *chan, struct user *u);
 struct chanfix_channel *chanfix_channel_create(const char *name, struct channel *chan);
 struct chanfix_channel *chanfix_channel_find(const char *name);
 struct chanfix_channel *chanfix_channel_get(struct channel *chan);
-void chanfix_gather(void *unused);
-void chanfix_expire(void *unused);
+void chanfix_channel_settle(struct chanfix_channel *chan);
+void chanfix_channel_rank(struct chanfix_channel *chan);
+void chanfix_channel_touch(struct chanfix_channel *chan);
 
 extern bool chanfix_do_autofix;
 void chanfix_autofix_ev(void *unused);
+void chanfix_fix_queue(struct chanfix_channel *chan);
+void chanfix_fix_dequeue(struct chanfix_channel *chan);
 void chanfix_can_register(struct hook_channel_register_check *req);
 
 extern struct command cmd_list;
@@ -14,6 +14,33 @@
 
 bool chanfix_do_autofix;
 
+// Channels that are, or have been, opless; the autofix timer looks at nothing else
+static mowgli_list_t chanfix_fixing = { NULL, NULL, 0 };
+
+void
+chanfix_fix_queue(struct chanfix_channel *chan)
+{
+	return_if_fail(chan != NULL);
+
+	if (chan->fixing)
+		return;
+
+	chan->fixing = true;
+	mowgli_node_add(chan, &chan->fix_node, &chanfix_fixing);
+}
+
+void
+chanfix_fix_dequeue(struct chanfix_channel *chan)
+{
+	return_if_fail(chan != NULL);
+
+	if (! chan->fixing)
+		return;
+
+	chan->fixing = false;
+	mowgli_node_delete(&chan->fix_node, &chanfix_fixing);
+}
+
 static unsigned int
 count_ops(struct channel *c)
 {
@@ -67,17 +94,13 @@ chanfix_should_handle(struct chanfix_channel *cfchan, struct channel *c)
 }
 
 static unsigned int
-chanfix_calculate_score(struct chanfix_oprecord *orec)
+chanfix_calculate_score(struct chanfix_channel *chan, struct chanfix_oprecord *orec)
 {
-	unsigned int base;
-
 	return_val_if_fail(orec != NULL, 0);
 
-	base = orec->age;
-	if (orec->entity != NULL)
-		base *= CHANFIX_ACCOUNT_WEIGHT;
+	chanfix_channel_rank(chan);
 
-	return base;
+	return orec->score;
 }
 
 static void
@@ -103,6 +126,8 @@ chanfix_lower_ts(struct chanfix_channel *chan)
 		cu->modes = 0;
 	}
 
+	chanfix_channel_touch(chan);
+
 	chan_lowerts(ch, chanfix->me);
 	cfu = chanuser_add(ch, CLIENT_NAME(chanfix->me));
 	cfu->modes |= CSTATUS_OP;
@@ -115,20 +140,9 @@ chanfix_lower_ts(struct chanfix_channel *chan)
 static unsigned int
 chanfix_get_highscore(struct chanfix_channel *chan)
 {
-	unsigned int highscore = 0;
-	mowgli_node_t *n;
-
-	MOWGLI_ITER_FOREACH(n, chan->oprecords.head)
-	{
-		unsigned int score;
-		struct chanfix_oprecord *orec = n->data;
+	chanfix_channel_rank(chan);
 
-		score = chanfix_calculate_score(orec);
-		if (score > highscore)
-			highscore = score;
-	}
-
-	return highscore;
+	return chan->nrecords ? chan->ranked[0].score : 0;
 }
 
 static unsigned int
@@ -177,7 +191,7 @@ chanfix_fix_channel(struct chanfix_channel *chan)
 		if (orec == NULL)
 			continue;
 
-		score = chanfix_calculate_score(orec);
+		score = chanfix_calculate_score(chan, orec);
 
 		if (score >= threshold)
 		{
@@ -194,6 +208,7 @@ chanfix_fix_channel(struct chanfix_channel *chan)
 
 	// flush the modestacker.
 	modestack_flush_channel(ch);
+	chanfix_channel_touch(chan);
 
 	// now report the damage
 	msg(chanfix->me->nick, chan->name, "\2%u\2 clients should have been opped.", opped);
@@ -235,7 +250,7 @@ chanfix_can_start_fix(struct chanfix_channel *chan)
 		if (orec == NULL)
 			continue;
 
-		score = chanfix_calculate_score(orec);
+		score = chanfix_calculate_score(chan, orec);
 		if (score >= threshold)
 			return true;
 	}
@@ -304,11 +319,11 @@ chanfix_clear_bans(struct channel *ch)
 void
 chanfix_autofix_ev(void *unused)
 {
-	struct chanfix_channel *chan;
-	mowgli_patricia_iteration_state_t state;
+	mowgli_node_t *n, *tn;
 
-	MOWGLI_PATRICIA_FOREACH(chan, &state, chanfix_channels)
+	MOWGLI_ITER_FOREACH_SAFE(n, tn, chanfix_fixing.head)
 	{
+		struct chanfix_channel *chan = n->data;
 
 		if (!chanfix_do_autofix && !chan->fix_requested)
 			continue;
@@ -352,6 +367,7 @@ chanfix_autofix_ev(void *unused)
 		{
 			chan->fix_requested = false;
 			chan->fix_started = 0;
+			chanfix_fix_dequeue(chan);
 		}
 	}
 }
@@ -479,27 +495,18 @@ chanfix_cmd_fix(struct sourceinfo *si, int parc, char *parv[])
 
 	chanfix_lower_ts(chan);
 	chan->fix_requested = true;
+	chanfix_fix_queue(chan);
 
 	logcommand(si, CMDLOG_ADMIN, "CHANFIX: \2%s\2", parv[0]);
 
 	command_success_nodata(si, _("Fix request has been acknowledged for \2%s\2."), parv[0]);
 }
 
-static int
-chanfix_compare_records(mowgli_node_t *a, mowgli_node_t *b, void *unused)
-{
-	struct chanfix_oprecord *ta = a->data;
-	struct chanfix_oprecord *tb = b->data;
-
-	return tb->age - ta->age;
-}
-
 static void
 chanfix_cmd_scores(struct sourceinfo *si, int parc, char *parv[])
 {
-	mowgli_node_t *n;
 	struct chanfix_channel *chan;
-	unsigned int i = 0;
+	unsigned int i;
 	unsigned int count = 20;
 
 	if (parv[0] == NULL)
@@ -516,11 +523,11 @@ chanfix_cmd_scores(struct sourceinfo *si, int parc, char *parv[])
 		return;
 	}
 
-	// sort records by score.
-	mowgli_list_sort(&chan->oprecords, chanfix_compare_records, NULL);
+	chanfix_channel_settle(chan);
+	chanfix_channel_rank(chan);
 
-	if (count > MOWGLI_LIST_LENGTH(&chan->oprecords))
-		count = MOWGLI_LIST_LENGTH(&chan->oprecords);
+	if (count > chan->nrecords)
+		count = chan->nrecords;
 
 	if (count == 0)
 	{
@@ -539,17 +546,15 @@ chanfix_cmd_scores(struct sourceinfo *si, int parc, char *parv[])
 	command_success_nodata(si, _("%-8s %-50s %s"), _("Num"), _("Account/Hostmask"), _("Score"));
 	command_success_nodata(si, "----------------------------------------------------------------");
 
-	MOWGLI_ITER_FOREACH(n, chan->oprecords.head)
+	for (i = 0; i < count; i++)
 	{
 		char buf[BUFSIZE];
-		unsigned int score;
-		struct chanfix_oprecord *orec = n->data;
-
-		score = chanfix_calculate_score(orec);
+		const struct chanfix_oprecord *orec = &chan->records[chan->ranked[i].record];
 
 		snprintf(buf, BUFSIZE, "%s@%s", orec->user, orec->host);
 
-		command_success_nodata(si, _("%-8u %-50s %u"), ++i, orec->entity ? orec->entity->name : buf, score);
+		command_success_nodata(si, _("%-8u %-50s %u"), i + 1, orec->entity ? orec->entity->name : buf,
+		                       chan->ranked[i].score);
 	}
 
 	command_success_nodata(si, "----------------------------------------------------------------");
@@ -559,11 +564,10 @@ chanfix_cmd_scores(struct sourceinfo *si, int parc, char *parv[])
 static void
 chanfix_cmd_info(struct sourceinfo *si, int parc, char *parv[])
 {
-	struct chanfix_oprecord *orec;
 	struct chanfix_channel *chan;
 	struct tm *tm;
 	char strfbuf[BUFSIZE];
-	unsigned int highscore = 0;
+	unsigned int highscore;
 	struct metadata *md;
 
 	if (parv[0] == NULL)
@@ -580,8 +584,7 @@ chanfix_cmd_info(struct sourceinfo *si, int parc, char *parv[])
 		return;
 	}
 
-	// sort records by score.
-	mowgli_list_sort(&chan->oprecords, chanfix_compare_records, NULL);
+	chanfix_channel_settle(chan);
 
 	command_success_nodata(si, _("Information on \2%s\2:"), chan->name);
 
@@ -590,11 +593,7 @@ chanfix_cmd_info(struct sourceinfo *si, int parc, char *parv[])
 
 	command_success_nodata(si, _("Creation time: %s"), strfbuf);
 
-	if (chan->oprecords.head != NULL)
-	{
-		orec = chan->oprecords.head->data;
-		highscore = chanfix_calculate_score(orec);
-	}
+	highscore = chanfix_get_highscore(chan);
 
 	command_success_nodata(si, _("Highest score: \2%u\2"), highscore);
 	command_success_nodata(si, _("Usercount    : \2%zu\2"),
@@ -696,6 +695,7 @@ chanfix_cmd_mark(struct sourceinfo *si, int parc, char *parv[])
 		metadata_add(chan, "private:mark:reason", info);
 		metadata_add(chan, "private:mark:timestamp", number_to_string(CURRTIME));
 
+		db_shard_dirty(chanfix_shard);
 		logcommand(si, CMDLOG_ADMIN, "MARK:ON: \2%s\2 (reason: \2%s\2)", chan->name, info);
 		command_success_nodata(si, _("\2%s\2 is now marked."), target);
 	}
@@ -711,6 +711,7 @@ chanfix_cmd_mark(struct sourceinfo *si, int parc, char *parv[])
 		metadata_delete(chan, "private:mark:reason");
 		metadata_delete(chan, "private:mark:timestamp");
 
+		db_shard_dirty(chanfix_shard);
 		logcommand(si, CMDLOG_ADMIN, "MARK:OFF: \2%s\2", chan->name);
 		command_success_nodata(si, _("\2%s\2 is now unmarked."), target);
 	}
@@ -769,6 +770,7 @@ chanfix_cmd_nofix(struct sourceinfo *si, int parc, char *parv[])
 		metadata_add(chan, "private:nofix:reason", info);
 		metadata_add(chan, "private:nofix:timestamp", number_to_string(CURRTIME));
 
+		db_shard_dirty(chanfix_shard);
 		logcommand(si, CMDLOG_ADMIN, "NOFIX:ON: \2%s\2 (reason: \2%s\2)", chan->name, info);
 		command_success_nodata(si, _("\2%s\2 is now set to NOFIX."), target);
 	}
@@ -784,6 +786,10 @@ chanfix_cmd_nofix(struct sourceinfo *si, int parc, char *parv[])
 		metadata_delete(chan, "private:nofix:reason");
 		metadata_delete(chan, "private:nofix:timestamp");
 
+		if (chan->chan != NULL)
+			chanfix_fix_queue(chan);
+
+		db_shard_dirty(chanfix_shard);
 		logcommand(si, CMDLOG_ADMIN, "NOFIX:OFF: \2%s\2", chan->name);
 		command_success_nodata(si, _("\2%s\2 is no longer set to NOFIX."), target);
 	}
@@ -839,7 +845,7 @@ chanfix_can_register(struct hook_channel_register_check *req)
 		orec = chanfix_oprecord_find(chan, req->si->su);
 	else
 		orec = NULL;
-	score = orec != NULL ? chanfix_calculate_score(orec) : 0;
+	score = orec != NULL ? chanfix_calculate_score(chan, orec) : 0;
 
 	if (score < highscore * CHANFIX_FINAL_STEP)
 	{
@@ -15,121 +15,591 @@
 static unsigned int loading_cfdbv = 0;
 
 static mowgli_heap_t *chanfix_channel_heap = NULL;
-static mowgli_heap_t *chanfix_oprecord_heap = NULL;
-static mowgli_eventloop_timer_t *chanfix_gather_timer = NULL;
-static mowgli_eventloop_timer_t *chanfix_expire_timer = NULL;
+static mowgli_eventloop_timer_t *chanfix_sync_timer = NULL;
+
+// Channels whose ops may have changed without a join or part
+static mowgli_list_t chanfix_dirty = { NULL, NULL, 0 };
 
 mowgli_patricia_t *chanfix_channels = NULL;
+struct db_shard *chanfix_shard = NULL;
 
-struct chanfix_oprecord *
-chanfix_oprecord_create(struct chanfix_channel *chan, struct user *u)
+static void chanfix_channel_schedule(struct chanfix_channel *chan);
+
+static bool
+chanfix_channel_gathered(const struct chanfix_channel *chan)
 {
-	struct chanfix_oprecord *orec;
+	// Ops in registered channels are ChanServ's business, not ours
+	return mychan_find(chan->name) == NULL;
+}
 
-	return_val_if_fail(chan != NULL, NULL);
+/* Scores are never touched by a timer; instead, every oprecord remembers
+ * how far its score has been worked out, and catches up when it is read.
+ * The result is the same as if ops had been counted every
+ * CHANFIX_GATHER_INTERVAL and scores decayed every CHANFIX_EXPIRE_INTERVAL,
+ * on the same boundaries, while the record was opped.
+ */
+static void
+chanfix_oprecord_advance(struct chanfix_oprecord *orec, const time_t now, const bool gathered)
+{
+	const bool opped = gathered && orec->nopped > 0;
+	time_t from = orec->settled;
+	time_t hour;
 
-	if (u != NULL)
+	if (from >= now)
+		return;
+
+	for (hour = (from / CHANFIX_EXPIRE_INTERVAL + 1) * CHANFIX_EXPIRE_INTERVAL; hour <= now;
+	     hour += CHANFIX_EXPIRE_INTERVAL)
 	{
-		return_val_if_fail((orec = chanfix_oprecord_find(chan, u)) == NULL, orec);
+		if (opped)
+			orec->age += hour / CHANFIX_GATHER_INTERVAL - from / CHANFIX_GATHER_INTERVAL;
+
+		from = hour;
+
+		/* Simple exponential decay, rounding the decay up
+		 * so that low scores expire sooner.
+		 */
+		orec->age -= (orec->age + CHANFIX_EXPIRE_DIVISOR - 1) / CHANFIX_EXPIRE_DIVISOR;
+
+		// Nothing further can change
+		if (! orec->age && ! opped)
+			break;
 	}
 
-	orec = mowgli_heap_alloc(chanfix_oprecord_heap);
+	if (opped)
+	{
+		orec->age += now / CHANFIX_GATHER_INTERVAL - from / CHANFIX_GATHER_INTERVAL;
+		orec->lastevent = now;
+	}
 
-	orec->chan = chan;
+	orec->settled = now;
+}
 
-	orec->firstseen = CURRTIME;
-	orec->lastevent = CURRTIME;
+static bool
+chanfix_oprecord_expired(const struct chanfix_oprecord *orec)
+{
+	if (orec->nopped > 0)
+		return false;
+
+	return orec->age == 0 || CURRTIME - orec->lastevent >= CHANFIX_RETENTION_TIME;
+}
+
+/* The records of a channel are looked up through two small open-addressed
+ * tables of record index + 1, one keyed on the account and one on the
+ * user@host; they are rebuilt whenever records move.
+ */
+static unsigned int
+chanfix_hash_entity(const struct myentity *mt)
+{
+	return (unsigned int) (((uintptr_t) mt >> 4) * 2654435761U);
+}
+
+static unsigned int
+chanfix_hash_mask(const char *user, const char *host)
+{
+	unsigned int h = 2166136261U;
+
+	for (; *user != '\0'; user++)
+		h = (h ^ (unsigned char) ToLower(*user)) * 16777619U;
+
+	h = (h ^ '@') * 16777619U;
+
+	for (; *host != '\0'; host++)
+		h = (h ^ (unsigned char) ToLower(*host)) * 16777619U;
+
+	return h;
+}
+
+static void
+chanfix_index_insert(unsigned int *table, const unsigned int mask, unsigned int slot, const unsigned int i)
+{
+	while (table[slot & mask] != 0)
+		slot++;
+
+	table[slot & mask] = i + 1;
+}
+
+static void
+chanfix_index_add(struct chanfix_channel *chan, const unsigned int i)
+{
+	const struct chanfix_oprecord *orec = &chan->records[i];
+	const unsigned int mask = 2 * chan->records_alloc - 1;
+
+	chanfix_index_insert(chan->bymask, mask, chanfix_hash_mask(orec->user, orec->host), i);
+
+	if (orec->entity != NULL)
+		chanfix_index_insert(chan->byentity, mask, chanfix_hash_entity(orec->entity), i);
+}
+
+static void
+chanfix_index_rebuild(struct chanfix_channel *chan)
+{
+	const size_t size = 2 * chan->records_alloc;
+	unsigned int i;
+
+	memset(chan->bymask, 0, size * sizeof *chan->bymask);
+	memset(chan->byentity, 0, size * sizeof *chan->byentity);
+
+	for (i = 0; i < chan->nrecords; i++)
+		chanfix_index_add(chan, i);
+
+	chan->index_stale = false;
+}
+
+void
+chanfix_oprecord_settle(struct chanfix_channel *chan, struct chanfix_oprecord *orec)
+{
+	mowgli_node_t *n;
+
+	return_if_fail(chan != NULL);
+	return_if_fail(orec != NULL);
+
+	chanfix_oprecord_advance(orec, CURRTIME, chanfix_channel_gathered(chan));
 
-	orec->age = 1;
+	if (orec->entity != NULL || ! orec->nopped)
+		return;
 
-	if (u != NULL)
+	MOWGLI_ITER_FOREACH(n, chan->opped.head)
 	{
-		orec->entity = entity(u->myuser);
+		struct chanfix_op *op = n->data;
 
-		mowgli_strlcpy(orec->user, u->user, sizeof orec->user);
-		mowgli_strlcpy(orec->host, u->vhost, sizeof orec->host);
+		if (&chan->records[op->record] != orec || op->u->myuser == NULL)
+			continue;
+
+		orec->entity = entity(op->u->myuser);
+		chan->index_stale = true;
+		chan->ranked_until = 0;
+		break;
 	}
+}
+
+static int
+chanfix_rank_compare(const void *a, const void *b)
+{
+	const struct chanfix_rank *ra = a;
+	const struct chanfix_rank *rb = b;
+
+	if (ra->score != rb->score)
+		return (rb->score > ra->score) - (rb->score < ra->score);
+
+	return (ra->record > rb->record) - (ra->record < rb->record);
+}
 
-	mowgli_node_add(orec, &orec->node, &chan->oprecords);
+/* Scores only change on CHANFIX_GATHER_INTERVAL boundaries (the hourly
+ * decay falls on one too), or when a record comes, goes or gains an
+ * account; until then, the records of a channel stay ranked as they were
+ * when last sorted, and a fix can read the highest score off the top.
+ */
+void
+chanfix_channel_rank(struct chanfix_channel *chan)
+{
+	unsigned int i;
+
+	return_if_fail(chan != NULL);
+
+	if (CURRTIME < chan->ranked_until)
+		return;
+
+	for (i = 0; i < chan->nrecords; i++)
+		chanfix_oprecord_settle(chan, &chan->records[i]);
+
+	for (i = 0; i < chan->nrecords; i++)
+	{
+		struct chanfix_oprecord *orec = &chan->records[i];
+
+		orec->score = orec->age;
+		if (orec->entity != NULL)
+			orec->score *= CHANFIX_ACCOUNT_WEIGHT;
+
+		chan->ranked[i].score = orec->score;
+		chan->ranked[i].record = i;
+	}
+
+	if (chan->nrecords > 1)
+		qsort(chan->ranked, chan->nrecords, sizeof *chan->ranked, &chanfix_rank_compare);
+
+	chan->ranked_until = (CURRTIME / CHANFIX_GATHER_INTERVAL + 1) * CHANFIX_GATHER_INTERVAL;
+}
+
+static struct chanfix_oprecord *
+chanfix_oprecord_add(struct chanfix_channel *chan, struct myentity *mt, const char *user, const char *host)
+{
+	struct chanfix_oprecord *orec;
+
+	if (chan->nrecords == chan->records_alloc)
+	{
+		chan->records_alloc = chan->records_alloc ? 2 * chan->records_alloc : 4;
+		chan->records = srealloc(chan->records, chan->records_alloc * sizeof *chan->records);
+
+		sfree(chan->bymask);
+		sfree(chan->byentity);
+		sfree(chan->ranked);
+		chan->bymask = smalloc(2 * chan->records_alloc * sizeof *chan->bymask);
+		chan->byentity = smalloc(2 * chan->records_alloc * sizeof *chan->byentity);
+		chan->ranked = smalloc(chan->records_alloc * sizeof *chan->ranked);
+		chan->index_stale = true;
+	}
+
+	orec = &chan->records[chan->nrecords++];
+	memset(orec, 0x00, sizeof *orec);
+
+	orec->entity = mt;
+	orec->user = strshare_get(user);
+	orec->host = strshare_get(host);
+
+	orec->firstseen = CURRTIME;
+	orec->lastevent = CURRTIME;
+	orec->settled = CURRTIME;
+
+	chan->ranked_until = 0;
+
+	if (chan->index_stale)
+		chanfix_index_rebuild(chan);
+	else
+		chanfix_index_add(chan, chan->nrecords - 1);
 
 	return orec;
 }
 
+struct chanfix_oprecord *
+chanfix_oprecord_create(struct chanfix_channel *chan, struct user *u)
+{
+	struct chanfix_oprecord *orec;
+
+	return_val_if_fail(chan != NULL, NULL);
+	return_val_if_fail(u != NULL, NULL);
+	return_val_if_fail((orec = chanfix_oprecord_find(chan, u)) == NULL, orec);
+
+	return chanfix_oprecord_add(chan, entity(u->myuser), u->user, u->vhost);
+}
+
 struct chanfix_oprecord *
 chanfix_oprecord_find(struct chanfix_channel *chan, struct user *u)
 {
-	mowgli_node_t *n;
+	unsigned int mask, slot;
 
 	return_val_if_fail(chan != NULL, NULL);
 	return_val_if_fail(u != NULL, NULL);
 
-	MOWGLI_ITER_FOREACH(n, chan->oprecords.head)
+	if (! chan->nrecords)
+		return NULL;
+
+	if (chan->index_stale)
+		chanfix_index_rebuild(chan);
+
+	mask = 2 * chan->records_alloc - 1;
+
+	if (u->myuser != NULL)
 	{
-		struct chanfix_oprecord *orec = n->data;
+		const struct myentity *mt = entity(u->myuser);
 
-		if (orec->entity != NULL && orec->entity == entity(u->myuser))
-			return orec;
+		for (slot = chanfix_hash_entity(mt); chan->byentity[slot & mask] != 0; slot++)
+		{
+			struct chanfix_oprecord *orec = &chan->records[chan->byentity[slot & mask] - 1];
+
+			if (orec->entity == mt)
+				return orec;
+		}
+	}
+
+	for (slot = chanfix_hash_mask(u->user, u->vhost); chan->bymask[slot & mask] != 0; slot++)
+	{
+		struct chanfix_oprecord *orec = &chan->records[chan->bymask[slot & mask] - 1];
 
-		if (!irccasecmp(orec->user, u->user) && !irccasecmp(orec->host, u->vhost))
+		if ((orec->user == u->user || !irccasecmp(orec->user, u->user)) &&
+		    (orec->host == u->vhost || !irccasecmp(orec->host, u->vhost)))
 			return orec;
 	}
 
 	return NULL;
 }
 
+// Records move; the last one takes the place of the one deleted
 void
-chanfix_oprecord_update(struct chanfix_channel *chan, struct user *u)
+chanfix_oprecord_delete(struct chanfix_channel *chan, struct chanfix_oprecord *orec)
+{
+	const unsigned int i = orec - chan->records;
+	const unsigned int last = chan->nrecords - 1;
+	mowgli_node_t *n;
+
+	return_if_fail(i < chan->nrecords);
+	return_if_fail(orec->nopped == 0);
+
+	strshare_unref(orec->user);
+	strshare_unref(orec->host);
+
+	if (i != last)
+	{
+		chan->records[i] = chan->records[last];
+
+		MOWGLI_ITER_FOREACH(n, chan->opped.head)
+		{
+			struct chanfix_op *op = n->data;
+
+			if (op->record == last)
+				op->record = i;
+		}
+	}
+
+	chan->nrecords--;
+	chan->index_stale = true;
+	chan->ranked_until = 0;
+}
+
+// Who is being counted towards which record, if they are opped in chan
+static struct chanfix_op *
+chanfix_op_find(struct chanfix_channel *chan, const struct user *u)
+{
+	mowgli_node_t *n;
+
+	MOWGLI_ITER_FOREACH(n, chan->opped.head)
+	{
+		struct chanfix_op *op = n->data;
+
+		if (op->u == u)
+			return op;
+	}
+
+	return NULL;
+}
+
+static void
+chanfix_op_delete(struct chanfix_channel *chan, struct chanfix_op *op)
+{
+	chan->records[op->record].nopped--;
+
+	mowgli_node_delete(&op->node, &chan->opped);
+	sfree(op);
+
+	// Opless now; it may want fixing
+	if (! MOWGLI_LIST_LENGTH(&chan->opped))
+		chanfix_fix_queue(chan);
+}
+
+static void
+chanfix_op_start(struct chanfix_channel *chan, struct user *u)
 {
 	struct chanfix_oprecord *orec;
+	struct chanfix_op *op;
+
+	if (chanfix_op_find(chan, u) != NULL)
+		return;
+
+	if ((orec = chanfix_oprecord_find(chan, u)) == NULL)
+	{
+		orec = chanfix_oprecord_create(chan, u);
+		chan->lastupdate = CURRTIME;
+		chanfix_channel_schedule(chan);
+	}
+	else
+		chanfix_oprecord_settle(chan, orec);
+
+	op = smalloc(sizeof *op);
+	op->u = u;
+	op->record = orec - chan->records;
+	mowgli_node_add(op, &op->node, &chan->opped);
+
+	db_shard_dirty(chanfix_shard);
+
+	orec->nopped++;
+
+	if (orec->entity == NULL && u->myuser != NULL)
+	{
+		orec->entity = entity(u->myuser);
+		chan->index_stale = true;
+		chan->ranked_until = 0;
+	}
+}
+
+static void
+chanfix_op_end(struct chanfix_channel *chan, struct user *u)
+{
+	struct chanfix_op *op;
+
+	if ((op = chanfix_op_find(chan, u)) == NULL)
+		return;
+
+	chanfix_oprecord_settle(chan, &chan->records[op->record]);
+	chanfix_op_delete(chan, op);
+
+	db_shard_dirty(chanfix_shard);
+}
+
+// Settles every score, and forgets the records that have run out
+void
+chanfix_channel_settle(struct chanfix_channel *chan)
+{
+	unsigned int i;
 
 	return_if_fail(chan != NULL);
-	return_if_fail(u != NULL);
 
-	orec = chanfix_oprecord_find(chan, u);
-	if (orec != NULL)
+	// Backwards, as deleting a record moves the last one into its place
+	for (i = chan->nrecords; i-- > 0; )
+	{
+		struct chanfix_oprecord *orec = &chan->records[i];
+
+		chanfix_oprecord_settle(chan, orec);
+
+		if (chanfix_oprecord_expired(orec))
+			chanfix_oprecord_delete(chan, orec);
+	}
+}
+
+static void
+chanfix_channel_untrack_all(struct chanfix_channel *chan)
+{
+	mowgli_node_t *n, *tn;
+	unsigned int i;
+
+	for (i = 0; i < chan->nrecords; i++)
+		chanfix_oprecord_settle(chan, &chan->records[i]);
+
+	MOWGLI_ITER_FOREACH_SAFE(n, tn, chan->opped.head)
+		chanfix_op_delete(chan, n->data);
+}
+
+// Brings the set of opped users being counted in line with the channel
+static void
+chanfix_channel_resync(struct chanfix_channel *chan)
+{
+	struct channel *ch = chan->chan;
+	const bool gathered = chanfix_channel_gathered(chan);
+	mowgli_node_t *n, *tn;
+	unsigned int i;
+
+	for (i = 0; i < chan->nrecords; i++)
+		if (chan->records[i].nopped > 0)
+			chanfix_oprecord_settle(chan, &chan->records[i]);
+
+	MOWGLI_ITER_FOREACH_SAFE(n, tn, chan->opped.head)
 	{
-		orec->age++;
-		orec->lastevent = CURRTIME;
+		struct chanfix_op *op = n->data;
+		struct chanuser *cu = NULL;
+
+		if (gathered && ch != NULL)
+			cu = chanuser_find(ch, op->u);
 
-		if (orec->entity == NULL && u->myuser != NULL)
-			orec->entity = entity(u->myuser);
+		if (cu != NULL && (cu->modes & CSTATUS_OP))
+			continue;
+
+		chanfix_op_delete(chan, op);
+	}
 
+	if (! gathered || ch == NULL)
 		return;
+
+	MOWGLI_ITER_FOREACH(n, ch->members.head)
+	{
+		struct chanuser *cu = n->data;
+
+		if (cu->modes & CSTATUS_OP)
+			chanfix_op_start(chan, cu->user);
 	}
 
-	chanfix_oprecord_create(chan, u);
-	chan->lastupdate = CURRTIME;
+	if (! MOWGLI_LIST_LENGTH(&chan->opped))
+		chanfix_fix_queue(chan);
+}
+
+static void
+chanfix_sync(void *unused)
+{
+	mowgli_node_t *n, *tn;
+
+	chanfix_sync_timer = NULL;
+
+	MOWGLI_ITER_FOREACH_SAFE(n, tn, chanfix_dirty.head)
+	{
+		struct chanfix_channel *chan = n->data;
+
+		mowgli_node_delete(&chan->dirty_node, &chanfix_dirty);
+		chan->dirty = false;
+
+		chanfix_channel_resync(chan);
+	}
 }
 
+/* Op changes through modes are picked up a moment later, so that a burst of
+ * them on one channel costs a single pass over its members.
+ */
 void
-chanfix_oprecord_delete(struct chanfix_oprecord *orec)
+chanfix_channel_touch(struct chanfix_channel *chan)
 {
-	return_if_fail(orec != NULL);
+	return_if_fail(chan != NULL);
 
-	mowgli_node_delete(&orec->node, &orec->chan->oprecords);
-	mowgli_heap_free(chanfix_oprecord_heap, orec);
+	if (chan->dirty)
+		return;
+
+	chan->dirty = true;
+	mowgli_node_add(chan, &chan->dirty_node, &chanfix_dirty);
+
+	if (chanfix_sync_timer == NULL)
+		chanfix_sync_timer = timer_add_once("chanfix_sync", &chanfix_sync, NULL, 1);
 }
 
 static void
 chanfix_channel_delete(struct chanfix_channel *c)
 {
 	mowgli_node_t *n, *tn;
+	unsigned int i;
 
 	return_if_fail(c != NULL);
 
 	mowgli_patricia_delete(chanfix_channels, c->name);
 
-	MOWGLI_ITER_FOREACH_SAFE(n, tn, c->oprecords.head)
-	{
-		struct chanfix_oprecord *orec = n->data;
+	timerwheel_cancel(&c->expire_timer);
+
+	db_shard_dirty(chanfix_shard);
 
-		chanfix_oprecord_delete(orec);
+	if (c->dirty)
+		mowgli_node_delete(&c->dirty_node, &chanfix_dirty);
+
+	chanfix_fix_dequeue(c);
+
+	MOWGLI_ITER_FOREACH_SAFE(n, tn, c->opped.head)
+		sfree(n->data);
+
+	for (i = 0; i < c->nrecords; i++)
+	{
+		strshare_unref(c->records[i].user);
+		strshare_unref(c->records[i].host);
 	}
 
+	sfree(c->records);
+	sfree(c->bymask);
+	sfree(c->byentity);
+	sfree(c->ranked);
 	sfree(c->name);
 	mowgli_heap_free(chanfix_channel_heap, c);
 }
 
+static void
+chanfix_channel_expire(void *arg)
+{
+	struct chanfix_channel *chan = arg;
+	struct channel *ch = chan->chan;
+
+	chanfix_channel_settle(chan);
+
+	if (chan->nrecords > 0 && CURRTIME - chan->lastupdate < CHANFIX_RETENTION_TIME)
+	{
+		chanfix_channel_schedule(chan);
+		return;
+	}
+
+	atheme_object_unref(chan);
+
+	// Start over on a channel that still exists, as if it had just been seen
+	if (ch != NULL && mychan_find(ch->name) == NULL)
+		chanfix_channel_resync(chanfix_channel_create(ch->name, ch));
+}
+
+static void
+chanfix_channel_schedule(struct chanfix_channel *chan)
+{
+	timerwheel_add(&chan->expire_timer, &chanfix_channel_expire, chan,
+	               chan->lastupdate + CHANFIX_RETENTION_TIME);
+}
+
 struct chanfix_channel *
 chanfix_channel_create(const char *name, struct channel *chan)
 {
@@ -144,10 +614,18 @@ chanfix_channel_create(const char *name, struct channel *chan)
 	c->chan = chan;
 	c->fix_started = 0;
 
+	mowgli_patricia_add(chanfix_channels, c->name, c);
+
+	// It has no ops we know of yet
 	if (c->chan != NULL)
+	{
 		c->ts = c->chan->ts;
+		chanfix_fix_queue(c);
+	}
 
-	mowgli_patricia_add(chanfix_channels, c->name, c);
+	chanfix_channel_schedule(c);
+
+	db_shard_dirty(chanfix_shard);
 
 	return c;
 }
@@ -166,6 +644,17 @@ chanfix_channel_get(struct channel *chan)
 	return mowgli_patricia_retrieve(chanfix_channels, chan->name);
 }
 
+static struct chanfix_channel *
+chanfix_channel_get_or_create(struct channel *ch)
+{
+	struct chanfix_channel *chan;
+
+	if ((chan = chanfix_channel_get(ch)) != NULL)
+		return chan;
+
+	return chanfix_channel_create(ch->name, ch);
+}
+
 static void
 chanfix_channel_add_ev(struct channel *ch)
 {
@@ -176,6 +665,7 @@ chanfix_channel_add_ev(struct channel *ch)
 	if ((chan = chanfix_channel_get(ch)) != NULL)
 	{
 		chan->chan = ch;
+		chanfix_fix_queue(chan);
 		return;
 	}
 
@@ -189,8 +679,10 @@ chanfix_channel_delete_ev(struct channel *ch)
 
 	return_if_fail(ch != NULL);
 
+	// The members go without channel_part
 	if ((chan = chanfix_channel_get(ch)) != NULL)
 	{
+		chanfix_channel_untrack_all(chan);
 		chan->chan = NULL;
 		return;
 	}
@@ -198,81 +690,77 @@ chanfix_channel_delete_ev(struct channel *ch)
 	chanfix_channel_create(ch->name, NULL);
 }
 
-void
-chanfix_gather(void *unused)
+static void
+chanfix_channel_join_ev(struct hook_channel_joinpart *hdata)
 {
-	struct channel *ch;
-	mowgli_patricia_iteration_state_t state;
-	unsigned int chans = 0, oprecords = 0;
+	struct chanuser *cu = hdata->cu;
 
-	MOWGLI_PATRICIA_FOREACH(ch, &state, chanlist)
-	{
-		struct mychan *mc;
-		mowgli_node_t *n;
-		struct chanfix_channel *chan;
-
-		if ((mc = mychan_find(ch->name)) != NULL)
-			continue;
+	if (cu == NULL || ! (cu->modes & CSTATUS_OP))
+		return;
 
-		chan = chanfix_channel_get(ch);
-		if (chan == NULL)
-			chan = chanfix_channel_create(ch->name, ch);
+	if (mychan_find(cu->chan->name) != NULL)
+		return;
 
-		MOWGLI_ITER_FOREACH(n, ch->members.head)
-		{
-			struct chanuser *cu = n->data;
+	chanfix_op_start(chanfix_channel_get_or_create(cu->chan), cu->user);
+}
 
-			if (cu->modes & CSTATUS_OP)
-			{
-				chanfix_oprecord_update(chan, cu->user);
-				oprecords++;
-			}
-		}
+static void
+chanfix_channel_part_ev(struct hook_channel_joinpart *hdata)
+{
+	struct chanuser *cu = hdata->cu;
+	struct chanfix_channel *chan;
 
-		chans++;
-	}
+	if (cu == NULL || (chan = chanfix_channel_get(cu->chan)) == NULL)
+		return;
 
-	slog(LG_DEBUG, "chanfix_gather(): gathered %u channels and %u oprecords.", chans, oprecords);
+	chanfix_op_end(chan, cu->user);
 }
 
-void
-chanfix_expire(void *unused)
+static void
+chanfix_channel_mode_ev(struct hook_channel_mode *hdata)
 {
-	struct chanfix_channel *chan;
-	mowgli_patricia_iteration_state_t state;
+	chanfix_channel_touch(chanfix_channel_get_or_create(hdata->c));
+}
 
-	MOWGLI_PATRICIA_FOREACH(chan, &state, chanfix_channels)
-	{
-		mowgli_node_t *n, *tn;
+static void
+chanfix_channel_tschange_ev(struct channel *ch)
+{
+	chanfix_channel_touch(chanfix_channel_get_or_create(ch));
+}
 
-		MOWGLI_ITER_FOREACH_SAFE(n, tn, chan->oprecords.head)
-		{
-			struct chanfix_oprecord *orec = n->data;
+static void
+chanfix_channel_register_ev(struct hook_channel_req *hdata)
+{
+	struct chanfix_channel *chan;
+	unsigned int i;
 
-			/* Simple exponential decay, rounding the decay up
-			 * so that low scores expire sooner.
-			 */
-			orec->age -= (orec->age + CHANFIX_EXPIRE_DIVISOR - 1) /
-				CHANFIX_EXPIRE_DIVISOR;
+	if ((chan = chanfix_channel_find(hdata->mc->name)) == NULL)
+		return;
 
-			if (orec->age > 0 && CURRTIME - orec->lastevent < CHANFIX_RETENTION_TIME)
-				continue;
+	// Count the ops up to now; the channel is registered from here on
+	for (i = 0; i < chan->nrecords; i++)
+		chanfix_oprecord_advance(&chan->records[i], CURRTIME, true);
 
-			chanfix_oprecord_delete(orec);
-		}
+	chanfix_channel_touch(chan);
+}
 
-		if (MOWGLI_LIST_LENGTH(&chan->oprecords) > 0 &&
-				CURRTIME - chan->lastupdate < CHANFIX_RETENTION_TIME)
-			continue;
+static void
+chanfix_channel_drop_ev(struct mychan *mc)
+{
+	struct chanfix_channel *chan;
 
-		atheme_object_unref(chan);
-	}
+	if ((chan = chanfix_channel_find(mc->name)) != NULL)
+		chanfix_channel_touch(chan);
+	else if (mc->chan != NULL)
+		chanfix_channel_touch(chanfix_channel_create(mc->name, mc->chan));
 }
 
 static void
 write_chanfixdb(struct database_handle *db)
 {
 	struct chanfix_channel *chan;
+	bool gathered;
+	bool opped = false;
 	mowgli_patricia_iteration_state_t state;
 
 	return_if_fail(db != NULL);
@@ -283,7 +771,10 @@ write_chanfixdb(struct database_handle *db)
 
 	MOWGLI_PATRICIA_FOREACH(chan, &state, chanfix_channels)
 	{
-		mowgli_node_t *n;
+		unsigned int i;
+
+		gathered = chanfix_channel_gathered(chan);
+		opped |= MOWGLI_LIST_LENGTH(&chan->opped) != 0;
 
 		db_start_row(db, "CFCHAN");
 		db_write_word(db, chan->name);
@@ -291,9 +782,16 @@ write_chanfixdb(struct database_handle *db)
 		db_write_time(db, chan->lastupdate);
 		db_commit_row(db);
 
-		MOWGLI_ITER_FOREACH(n, chan->oprecords.head)
+		for (i = 0; i < chan->nrecords; i++)
 		{
-			struct chanfix_oprecord *orec = n->data;
+			// This may be running in a child process; work on a copy
+			struct chanfix_oprecord orec_settled = chan->records[i];
+			struct chanfix_oprecord *const orec = &orec_settled;
+
+			chanfix_oprecord_advance(orec, CURRTIME, gathered);
+
+			if (chanfix_oprecord_expired(orec))
+				continue;
 
 			db_start_row(db, "CFOP");
 			db_write_word(db, chan->name);
@@ -316,10 +814,10 @@ write_chanfixdb(struct database_handle *db)
 
 		if (atheme_object(chan)->metadata != NULL)
 		{
-			mowgli_patricia_iteration_state_t state2;
+			struct metadata_iteration_state state2;
 			struct metadata *md;
 
-			MOWGLI_PATRICIA_FOREACH(md, &state2, atheme_object(chan)->metadata)
+			METADATA_FOREACH(md, &state2, chan)
 			{
 				db_start_row(db, "CFMD");
 				db_write_word(db, chan->name);
@@ -329,6 +827,10 @@ write_chanfixdb(struct database_handle *db)
 			}
 		}
 	}
+
+	// the scores of ops still holding their status go up with time alone
+	if (opped)
+		db_shard_dirty(chanfix_shard);
 }
 
 static void
@@ -352,6 +854,8 @@ db_h_cfchan(struct database_handle *db, const char *type)
 	chan = chanfix_channel_create(name, NULL);
 	chan->ts = ts;
 	chan->lastupdate = lastupdate;
+
+	chanfix_channel_schedule(chan);
 }
 
 static void
@@ -373,12 +877,13 @@ db_h_cfop(struct database_handle *db, const char *type)
 
 	age = db_sread_uint(db);
 
-	chan = chanfix_channel_find(name);
-	orec = chanfix_oprecord_create(chan, NULL);
+	if ((chan = chanfix_channel_find(name)) == NULL)
+	{
+		slog(LG_INFO, "db_h_cfop(): oprecord for unknown channel %s", name);
+		return;
+	}
 
-	orec->entity = myentity_find(entity);
-	mowgli_strlcpy(orec->user, user, sizeof orec->user);
-	mowgli_strlcpy(orec->host, host, sizeof orec->host);
+	orec = chanfix_oprecord_add(chan, myentity_find(entity), user, host);
 
 	orec->firstseen = firstseen;
 	orec->lastevent = lastevent;
@@ -403,49 +908,81 @@ db_h_cfmd(struct database_handle *db, const char *type)
 void
 chanfix_gather_init(struct chanfix_persist_record *rec)
 {
-	hook_add_db_write(write_chanfixdb);
+	chanfix_shard = db_shard_register("chanfix", write_chanfixdb);
 	hook_add_channel_add(chanfix_channel_add_ev);
 	hook_add_channel_delete(chanfix_channel_delete_ev);
+	hook_add_channel_join(chanfix_channel_join_ev);
+	hook_add_channel_part(chanfix_channel_part_ev);
+	hook_add_channel_mode(chanfix_channel_mode_ev);
+	hook_add_channel_tschange(chanfix_channel_tschange_ev);
+	hook_add_channel_register(chanfix_channel_register_ev);
+	hook_add_channel_drop(chanfix_channel_drop_ev);
 
 	db_register_type_handler("CFDBV", db_h_cfdbv);
 	db_register_type_handler("CFCHAN", db_h_cfchan);
 	db_register_type_handler("CFOP", db_h_cfop);
 	db_register_type_handler("CFMD", db_h_cfmd);
 
-	chanfix_expire_timer = mowgli_timer_add(base_eventloop, "chanfix_expire", chanfix_expire, NULL, CHANFIX_EXPIRE_INTERVAL);
-	chanfix_gather_timer = mowgli_timer_add(base_eventloop, "chanfix_gather", chanfix_gather, NULL, CHANFIX_GATHER_INTERVAL);
-
 	if (rec != NULL)
 	{
+		struct chanfix_channel *chan;
+		mowgli_patricia_iteration_state_t state;
+
 		chanfix_channel_heap = rec->chanfix_channel_heap;
-		chanfix_oprecord_heap = rec->chanfix_oprecord_heap;
 
 		chanfix_channels = rec->chanfix_channels;
+
+		// The expiry timers and the list of channels to fix were in the old copy of this module
+		MOWGLI_PATRICIA_FOREACH(chan, &state, chanfix_channels)
+		{
+			chanfix_channel_schedule(chan);
+
+			chan->fixing = false;
+			if (chan->chan != NULL)
+				chanfix_fix_queue(chan);
+		}
+
 		return;
 	}
 
 	chanfix_channel_heap = mowgli_heap_create(sizeof(struct chanfix_channel), 32, BH_LAZY);
-	chanfix_oprecord_heap = mowgli_heap_create(sizeof(struct chanfix_oprecord), 32, BH_LAZY);
 
 	chanfix_channels = mowgli_patricia_create(irccasecanon);
+
+	db_shard_load(chanfix_shard);
 }
 
 void
 chanfix_gather_deinit(struct chanfix_persist_record *rec)
 {
-	hook_del_db_write(write_chanfixdb);
+	struct chanfix_channel *chan;
+	mowgli_patricia_iteration_state_t state;
+
+	db_shard_unregister(chanfix_shard);
+	chanfix_shard = NULL;
 	hook_del_channel_add(chanfix_channel_add_ev);
 	hook_del_channel_delete(chanfix_channel_delete_ev);
+	hook_del_channel_join(chanfix_channel_join_ev);
+	hook_del_channel_part(chanfix_channel_part_ev);
+	hook_del_channel_mode(chanfix_channel_mode_ev);
+	hook_del_channel_tschange(chanfix_channel_tschange_ev);
+	hook_del_channel_register(chanfix_channel_register_ev);
+	hook_del_channel_drop(chanfix_channel_drop_ev);
 
 	db_unregister_type_handler("CFDBV");
 	db_unregister_type_handler("CFCHAN");
 	db_unregister_type_handler("CFOP");
 	db_unregister_type_handler("CFMD");
 
-	mowgli_timer_destroy(base_eventloop, chanfix_expire_timer);
-	mowgli_timer_destroy(base_eventloop, chanfix_gather_timer);
+	if (chanfix_sync_timer != NULL)
+	{
+		timer_destroy(chanfix_sync_timer);
+		chanfix_sync(NULL);
+	}
+
+	MOWGLI_PATRICIA_FOREACH(chan, &state, chanfix_channels)
+		timerwheel_cancel(&chan->expire_timer);
 
 	rec->chanfix_channel_heap  = chanfix_channel_heap;
-	rec->chanfix_oprecord_heap = chanfix_oprecord_heap;
 	rec->chanfix_channels      = chanfix_channels;
 }
@@ -12,7 +12,7 @@
 #include "chanfix.h"
 
 #define CHANFIX_PERSIST_STORAGE_NAME "atheme.chanfix.main.persist"
-#define CHANFIX_PERSIST_VERSION      2
+#define CHANFIX_PERSIST_VERSION      5
 
 static mowgli_eventloop_timer_t *chanfix_autofix_timer = NULL;
 
@@ -23,6 +23,17 @@ mod_init(struct module *const restrict m)
 {
 	struct chanfix_persist_record *rec = mowgli_global_storage_get(CHANFIX_PERSIST_STORAGE_NAME);
 
+	if (rec && rec->version < CHANFIX_PERSIST_VERSION)
+	{
+		slog(LG_ERROR, "chanfix/main: reloading over an older version is not supported (from %d to %d)", rec->version, CHANFIX_PERSIST_VERSION);
+		m->mflags = MODFLAG_FAIL;
+
+		sfree(rec);
+		mowgli_global_storage_free(CHANFIX_PERSIST_STORAGE_NAME);
+
+		return;
+	}
+
 	if (rec && rec->version > CHANFIX_PERSIST_VERSION)
 	{
 		slog(LG_ERROR, "chanfix/main: attempted downgrade is not supported (from %d to %d)", rec->version, CHANFIX_PERSIST_VERSION);
@@ -56,7 +67,7 @@ mod_init(struct module *const restrict m)
 
 	add_bool_conf_item("AUTOFIX", &chanfix->conf_table, 0, &chanfix_do_autofix, false);
 
-	chanfix_autofix_timer = mowgli_timer_add(base_eventloop, "chanfix_autofix", chanfix_autofix_ev, NULL, SECONDS_PER_MINUTE);
+	chanfix_autofix_timer = timer_add("chanfix_autofix", chanfix_autofix_ev, NULL, SECONDS_PER_MINUTE);
 
 	m->mflags |= MODFLAG_DBHANDLER;
 }
@@ -66,7 +77,7 @@ mod_deinit(const enum module_unload_intent intent)
 {
 	hook_del_channel_can_register(chanfix_can_register);
 
-	mowgli_timer_destroy(base_eventloop, chanfix_autofix_timer);
+	timer_destroy(chanfix_autofix_timer);
 
 	service_unbind_command(chanfix, &cmd_list);
 	service_unbind_command(chanfix, &cmd_chanfix);
@@ -76,7 +76,7 @@ cs_cmd_wrapper(struct sourceinfo *const restrict si, const int parc, char **cons
 		return;
 	}
 
-	const struct command *const cmd = command_find(cmdlist, subcmd);
+	struct command *const cmd = command_find(cmdlist, subcmd);
 
 	if (! cmd)
 	{
@@ -84,14 +84,7 @@ cs_cmd_wrapper(struct sourceinfo *const restrict si, const int parc, char **cons
 		return;
 	}
 
-	char buf[BUFSIZE];
-
-	if (parc > 2)
-		(void) snprintf(buf, sizeof buf, "%s %s", target, parv[2]);
-	else
-		(void) mowgli_strlcpy(buf, target, sizeof buf);
-
-	(void) command_exec_split(chansvs.me, si, cmd->name, buf, cmdlist);
+	(void) command_exec_args(chansvs.me, si, cmd, 1, &target, (parc > 2) ? parv[2] : NULL);
 }
 
 static void
@@ -11,22 +11,24 @@
 
 struct akick_timeout
 {
-	time_t expiration;
-
 	struct myentity *entity;
 	struct mychan *chan;
 
 	char host[NICKLEN + 1 + USERLEN + 1 + HOSTLEN + 1 + 4];
+	struct match_pattern *hostpat;
 
 	mowgli_node_t node;
+	struct timerwheel_entry timer;
 };
 
-static time_t akickdel_next;
 static mowgli_list_t akickdel_list;
 
+// Users checked against an AKICK list, and how many of them it applied to; read by misc/metrics
+unsigned long long akick_checks = 0;
+unsigned long long akick_matches = 0;
+
 static mowgli_heap_t *akick_timeout_heap = NULL;
 static mowgli_patricia_t *cs_akick_cmds = NULL;
-static mowgli_eventloop_timer_t *akick_timeout_check_timer = NULL;
 
 static void
 clear_bans_matching_entity(struct mychan *mc, struct myentity *mt)
@@ -103,92 +105,70 @@ cs_cmd_akick(struct sourceinfo *const restrict si, const int parc, char **const
 	(void) subcommand_dispatch_simple(chansvs.me, si, parc, parv, cs_akick_cmds, "AKICK");
 }
 
-static struct akick_timeout *
-akick_add_timeout(struct mychan *mc, struct myentity *mt, const char *host, time_t expireson)
+static void
+akick_timeout_free(struct akick_timeout *timeout)
 {
-	mowgli_node_t *n;
-	struct akick_timeout *timeout, *timeout2;
-
-	timeout = mowgli_heap_alloc(akick_timeout_heap);
-
-	timeout->entity = mt;
-	timeout->chan = mc;
-	timeout->expiration = expireson;
+	mowgli_node_delete(&timeout->node, &akickdel_list);
+	timerwheel_cancel(&timeout->timer);
+	match_pattern_free(timeout->hostpat);
+	mowgli_heap_free(akick_timeout_heap, timeout);
+}
 
-	mowgli_strlcpy(timeout->host, host, sizeof timeout->host);
+static void
+akick_timeout_expire(void *arg)
+{
+	struct akick_timeout *timeout = arg;
+	struct mychan *mc = timeout->chan;
+	struct chanacs *ca = NULL;
+	struct chanban *cb;
 
-	MOWGLI_ITER_FOREACH_PREV(n, akickdel_list.tail)
+	if (timeout->entity == NULL)
 	{
-		timeout2 = n->data;
-		if (timeout2->expiration <= timeout->expiration)
-			break;
+		if ((ca = chanacs_find_host_literal(mc, timeout->host, CA_AKICK)) && mc->chan != NULL && (cb = chanban_find(mc->chan, ca->host, 'b')))
+		{
+			modestack_mode_param(chansvs.nick, mc->chan, MTYPE_DEL, cb->type, cb->mask);
+			chanban_delete(cb);
+		}
 	}
-	if (n == NULL)
-		mowgli_node_add_head(timeout, &timeout->node, &akickdel_list);
-	else if (n->next == NULL)
-		mowgli_node_add(timeout, &timeout->node, &akickdel_list);
 	else
-		mowgli_node_add_before(timeout, &timeout->node, &akickdel_list, n->next);
-
-	return timeout;
-}
+	{
+		ca = chanacs_find_literal(mc, timeout->entity, CA_AKICK);
+		if (ca == NULL)
+		{
+			akick_timeout_free(timeout);
 
-static void
-akick_timeout_check(void *arg)
-{
-	mowgli_node_t *n, *tn;
-	struct akick_timeout *timeout;
-	struct chanacs *ca;
-	struct mychan *mc;
+			return;
+		}
 
-	struct chanban *cb;
-	akickdel_next = 0;
+		clear_bans_matching_entity(mc, timeout->entity);
+	}
 
-	MOWGLI_ITER_FOREACH_SAFE(n, tn, akickdel_list.head)
+	if (ca)
 	{
-		timeout = n->data;
-		mc = timeout->chan;
+		chanacs_modify_simple(ca, 0, CA_AKICK, NULL);
+		chanacs_close(ca);
+	}
 
-		if (timeout->expiration > CURRTIME)
-		{
-			akickdel_next = timeout->expiration;
-			akick_timeout_check_timer = mowgli_timer_add_once(base_eventloop, "akick_timeout_check", akick_timeout_check, NULL, akickdel_next - CURRTIME);
-			break;
-		}
+	akick_timeout_free(timeout);
+}
 
-		ca = NULL;
+static struct akick_timeout *
+akick_add_timeout(struct mychan *mc, struct myentity *mt, const char *host, time_t expireson)
+{
+	struct akick_timeout *timeout;
 
-		if (timeout->entity == NULL)
-		{
-			if ((ca = chanacs_find_host_literal(mc, timeout->host, CA_AKICK)) && mc->chan != NULL && (cb = chanban_find(mc->chan, ca->host, 'b')))
-			{
-				modestack_mode_param(chansvs.nick, mc->chan, MTYPE_DEL, cb->type, cb->mask);
-				chanban_delete(cb);
-			}
-		}
-		else
-		{
-			ca = chanacs_find_literal(mc, timeout->entity, CA_AKICK);
-			if (ca == NULL)
-			{
-				mowgli_node_delete(&timeout->node, &akickdel_list);
-				mowgli_heap_free(akick_timeout_heap, timeout);
+	timeout = mowgli_heap_alloc(akick_timeout_heap);
 
-				continue;
-			}
+	timeout->entity = mt;
+	timeout->chan = mc;
 
-			clear_bans_matching_entity(mc, timeout->entity);
-		}
+	mowgli_strlcpy(timeout->host, host, sizeof timeout->host);
+	timeout->hostpat = match_compile(timeout->host);
 
-		if (ca)
-		{
-			chanacs_modify_simple(ca, 0, CA_AKICK, NULL);
-			chanacs_close(ca);
-		}
+	mowgli_node_add(timeout, &timeout->node, &akickdel_list);
+	timerwheel_add(&timeout->timer, akick_timeout_expire, timeout, expireson);
 
-		mowgli_node_delete(&timeout->node, &akickdel_list);
-		mowgli_heap_free(akick_timeout_heap, timeout);
-	}
+	return timeout;
 }
 
 static void
@@ -363,7 +343,6 @@ cs_cmd_akick_add(struct sourceinfo *si, int parc, char *parv[])
 
 		if (duration > 0)
 		{
-			struct akick_timeout *timeout;
 			time_t expireson = ca2->tmodified+duration;
 
 			snprintf(expiry, sizeof expiry, "%ld", expireson);
@@ -373,16 +352,7 @@ cs_cmd_akick_add(struct sourceinfo *si, int parc, char *parv[])
 			logcommand(si, CMDLOG_SET, "AKICK:ADD: \2%s\2 on \2%s\2, expires in %s.", uname, mc->name,timediff(duration));
 			command_success_nodata(si, _("AKICK on \2%s\2 was successfully added for \2%s\2 and will expire in %s."), uname, mc->name,timediff(duration) );
 
-			timeout = akick_add_timeout(mc, NULL, uname, expireson);
-
-			if (akickdel_next == 0 || akickdel_next > timeout->expiration)
-			{
-				if (akickdel_next != 0)
-					mowgli_timer_destroy(base_eventloop, akick_timeout_check_timer);
-
-				akickdel_next = timeout->expiration;
-				akick_timeout_check_timer = mowgli_timer_add_once(base_eventloop, "akick_timeout_check", akick_timeout_check, NULL, akickdel_next - CURRTIME);
-			}
+			akick_add_timeout(mc, NULL, uname, expireson);
 		}
 		else
 		{
@@ -429,7 +399,6 @@ cs_cmd_akick_add(struct sourceinfo *si, int parc, char *parv[])
 
 		if (duration > 0)
 		{
-			struct akick_timeout *timeout;
 			time_t expireson = ca2->tmodified+duration;
 
 			snprintf(expiry, sizeof expiry, "%ld", expireson);
@@ -439,16 +408,7 @@ cs_cmd_akick_add(struct sourceinfo *si, int parc, char *parv[])
 			verbose(mc, "\2%s\2 added \2%s\2 to the AKICK list, expires in %s.", get_source_name(si), mt->name, timediff(duration));
 			logcommand(si, CMDLOG_SET, "AKICK:ADD: \2%s\2 on \2%s\2, expires in %s", mt->name, mc->name, timediff(duration));
 
-			timeout = akick_add_timeout(mc, mt, mt->name, expireson);
-
-			if (akickdel_next == 0 || akickdel_next > timeout->expiration)
-			{
-				if (akickdel_next != 0)
-					mowgli_timer_destroy(base_eventloop, akick_timeout_check_timer);
-
-				akickdel_next = timeout->expiration;
-				akick_timeout_check_timer = mowgli_timer_add_once(base_eventloop, "akick_timeout_check", akick_timeout_check, NULL, akickdel_next - CURRTIME);
-			}
+			akick_add_timeout(mc, mt, mt->name, expireson);
 		}
 		else
 		{
@@ -536,10 +496,9 @@ cs_cmd_akick_del(struct sourceinfo *si, int parc, char *parv[])
 		MOWGLI_ITER_FOREACH_SAFE(n, tn, akickdel_list.head)
 		{
 			timeout = n->data;
-			if (!match(timeout->host, uname) && timeout->chan == mc)
+			if (timeout->chan == mc && !match_compiled(timeout->hostpat, uname))
 			{
-				mowgli_node_delete(&timeout->node, &akickdel_list);
-				mowgli_heap_free(akick_timeout_heap, timeout);
+				akick_timeout_free(timeout);
 			}
 		}
 
@@ -565,8 +524,7 @@ cs_cmd_akick_del(struct sourceinfo *si, int parc, char *parv[])
 		timeout = n->data;
 		if (timeout->entity == mt && timeout->chan == mc)
 		{
-			mowgli_node_delete(&timeout->node, &akickdel_list);
-			mowgli_heap_free(akick_timeout_heap, timeout);
+			akick_timeout_free(timeout);
 		}
 	}
 
@@ -761,8 +719,12 @@ chanuser_sync(struct hook_chanuser_sync *hdata)
 
 	return_if_fail(mc != NULL);
 
+	akick_checks++;
+
 	if (flags & CA_AKICK && !(flags & CA_EXEMPT))
 	{
+		akick_matches++;
+
 		// Stay on channel if this would empty it -- jilles
 		if (chan->nummembers - chan->numsvcmembers == 1)
 		{
@@ -784,8 +746,9 @@ chanuser_sync(struct hook_chanuser_sync *hdata)
 		}
 		else
 		{
-			// XXX this could be done more efficiently
-			ca = chanacs_find(mc, entity(u->myuser), CA_AKICK);
+			// the user's own entry is an index lookup; only groups and exttargets get walked
+			if (u->myuser != NULL)
+				ca = chanacs_find(mc, entity(u->myuser), CA_AKICK);
 			ban(chansvs.me->me, chan, u);
 		}
 		remove_ban_exceptions(chansvs.me->me, chan, u);
@@ -885,7 +848,7 @@ mod_init(struct module *const restrict m)
 
 	(void) service_named_bind_command("chanserv", &cs_akick);
 
-	(void) mowgli_timer_add_once(base_eventloop, "akickdel_list_create", &akickdel_list_create, NULL, 0);
+	(void) timer_add_once("akickdel_list_create", &akickdel_list_create, NULL, 0);
 
 	(void) hook_add_first_chanuser_sync(&chanuser_sync);
 }
@@ -893,8 +856,7 @@ mod_init(struct module *const restrict m)
 static void
 mod_deinit(const enum module_unload_intent ATHEME_VATTR_UNUSED intent)
 {
-	if (akick_timeout_check_timer)
-		(void) mowgli_timer_destroy(base_eventloop, akick_timeout_check_timer);
+	mowgli_node_t *n, *tn;
 
 	(void) hook_del_chanuser_sync(&chanuser_sync);
 
@@ -902,6 +864,9 @@ mod_deinit(const enum module_unload_intent ATHEME_VATTR_UNUSED intent)
 
 	(void) mowgli_patricia_destroy(cs_akick_cmds, &command_delete_trie_cb, cs_akick_cmds);
 
+	MOWGLI_ITER_FOREACH_SAFE(n, tn, akickdel_list.head)
+		akick_timeout_free(n->data);
+
 	(void) mowgli_heap_destroy(akick_timeout_heap);
 }
 
@@ -20,11 +20,11 @@ enum antiflood_enforce_method
 	ANTIFLOOD_ENFORCE_KLINE,
 };
 
-enum mqueue_enforce_strategy
+enum antiflood_enforce_reason
 {
-	MQ_ENFORCE_NONE = 0,
-	MQ_ENFORCE_MSG,
-	MQ_ENFORCE_LINE,
+	ANTIFLOOD_REASON_NONE = 0,
+	ANTIFLOOD_REASON_MSG,           // The same line, from anyone
+	ANTIFLOOD_REASON_LINE,          // Too many lines from one user
 };
 
 struct antiflood_enforce_method_impl
@@ -33,188 +33,119 @@ struct antiflood_enforce_method_impl
 	void (*unenforce)(struct channel *);
 };
 
-struct flood_message_queue
-{
-	char *name;
-	size_t max;
-	time_t last_used;
-	mowgli_list_t entries;
-};
-
-struct flood_message
-{
-	stringref source;
-	char *message;
-	time_t time;
-	mowgli_node_t node;
-};
-
 static struct chanban *(*place_quietmask)(struct channel *, int, const char *) = NULL;
 
 static enum antiflood_enforce_method antiflood_enforce_method = ANTIFLOOD_ENFORCE_QUIET;
 
-static mowgli_heap_t *msg_heap = NULL;
-static mowgli_heap_t *mqueue_heap = NULL;
-static mowgli_patricia_t *mqueue_trie = NULL;
 static mowgli_patricia_t **cs_set_cmdtree = NULL;
-static mowgli_eventloop_timer_t *mqueue_gc_timer = NULL;
 static mowgli_eventloop_timer_t *antiflood_unenforce_timer = NULL;
 
 static time_t antiflood_msg_time = SECONDS_PER_MINUTE;
-static size_t antiflood_msg_count = 10;
-
-static void
-msg_destroy(struct flood_message *mesg, struct flood_message_queue *mq)
-{
-	sfree(mesg->message);
-	strshare_unref(mesg->source);
-	mowgli_node_delete(&mesg->node, &mq->entries);
 
-	mowgli_heap_free(msg_heap, mesg);
-}
+// How many of the latest lines in a channel are looked at
+#define ANTIFLOOD_MSG_COUNT     10U
 
-static struct flood_message *
-msg_create(struct flood_message_queue *mq, struct user *u, const char *message)
+struct antiflood_line
 {
-	struct flood_message *mesg;
-
-	mesg = mowgli_heap_alloc(msg_heap);
-	mesg->message = sstrdup(message);
-	mesg->time = CURRTIME;
-	mesg->source = u->uid != NULL ? strshare_ref(u->uid) : strshare_ref(u->nick);
-
-	if (MOWGLI_LIST_LENGTH(&mq->entries) > mq->max)
-	{
-		struct flood_message *head_mesg = mq->entries.head->data;
-		msg_destroy(head_mesg, mq);
-	}
-
-	mowgli_node_add(mesg, &mesg->node, &mq->entries);
-	mq->last_used = CURRTIME;
-
-	return mesg;
-}
+	time_t          time;
+	unsigned int    source;         // hash of the sender's UID (or nick)
+	unsigned int    hash;           // hash of the line
+};
 
-static struct flood_message_queue *
-mqueue_create(const char *name)
+/* The last ANTIFLOOD_MSG_COUNT lines in a channel, oldest at head once the
+ * ring is full. Allocated once per channel, when it first sees a line.
+ */
+struct antiflood_ring
 {
-	struct flood_message_queue *mq;
-
-	mq = mowgli_heap_alloc(mqueue_heap);
-	mq->name = sstrdup(name);
-	mq->last_used = CURRTIME;
-	mq->max = antiflood_msg_count;
-
-	mowgli_patricia_add(mqueue_trie, mq->name, mq);
+	struct antiflood_line   lines[ANTIFLOOD_MSG_COUNT];
+	unsigned int            head;
+	unsigned int            count;
+};
 
-	return mq;
-}
+static mowgli_heap_t *antiflood_ring_heap = NULL;
 
-static void
-mqueue_free(struct flood_message_queue *mq)
+// Lines are compared without regard to case
+static unsigned int
+antiflood_hash(const char *line)
 {
-	mowgli_node_t *n, *tn;
+	unsigned int hash = 2166136261U;
 
-	MOWGLI_ITER_FOREACH_SAFE(n, tn, mq->entries.head)
+	for (/* No initialization */; *line; line++)
 	{
-		struct flood_message *mesg = n->data;
-
-		msg_destroy(mesg, mq);
+		hash ^= (unsigned char) tolower((unsigned char) *line);
+		hash *= 16777619U;
 	}
 
-	sfree(mq->name);
-	mowgli_heap_free(mqueue_heap, mq);
+	return hash;
 }
 
-static struct flood_message_queue *
-mqueue_get(struct mychan *mc)
+static void
+antiflood_ring_free(struct mychan *mc)
 {
-	struct flood_message_queue *mq;
-
-	mq = mowgli_patricia_retrieve(mqueue_trie, mc->name);
-	if (mq == NULL)
-		mq = mqueue_create(mc->name);
+	if (mc->flood_ring == NULL)
+		return;
 
-	return mq;
+	mowgli_heap_free(antiflood_ring_heap, mc->flood_ring);
+	mc->flood_ring = NULL;
 }
 
-static void
-mqueue_destroy(struct flood_message_queue *mq)
+static enum antiflood_enforce_reason
+antiflood_should_enforce(struct mychan *mc, struct user *u, const char *line)
 {
-	mowgli_patricia_delete(mqueue_trie, mq->name);
+	struct antiflood_ring *ring = mc->flood_ring;
 
-	mqueue_free(mq);
-}
+	if (ring == NULL)
+	{
+		ring = mc->flood_ring = mowgli_heap_alloc(antiflood_ring_heap);
+		(void) memset(ring, 0x00, sizeof *ring);
+	}
 
-static void
-mqueue_trie_destroy_cb(const char *key, void *data, void *privdata)
-{
-	struct flood_message_queue *mq = data;
+	struct antiflood_line *const newest = &ring->lines[ring->head];
 
-	mqueue_free(mq);
-}
+	newest->time = CURRTIME;
+	newest->source = antiflood_hash(u->uid != NULL ? u->uid : u->nick);
+	newest->hash = antiflood_hash(line);
 
-static void
-mqueue_gc(void *unused)
-{
-	mowgli_patricia_iteration_state_t iter;
-	struct flood_message_queue *mq;
+	ring->head = (ring->head + 1) % ANTIFLOOD_MSG_COUNT;
 
-	MOWGLI_PATRICIA_FOREACH(mq, &iter, mqueue_trie)
+	if (ring->count < ANTIFLOOD_MSG_COUNT)
 	{
-		if ((mq->last_used + SECONDS_PER_HOUR) < CURRTIME)
-			mqueue_destroy(mq);
+		ring->count++;
+		return ANTIFLOOD_REASON_NONE;
 	}
-}
-
-static enum mqueue_enforce_strategy
-mqueue_should_enforce(struct flood_message_queue *mq)
-{
-	struct flood_message *oldest, *newest;
-	time_t age_delta;
 
-	if (MOWGLI_LIST_LENGTH(&mq->entries) < mq->max)
-		return MQ_ENFORCE_NONE;
+	const struct antiflood_line *const oldest = &ring->lines[ring->head];
 
-	oldest = mq->entries.head->data;
-	newest = mq->entries.tail->data;
+	if (newest->time - oldest->time > antiflood_msg_time)
+		return ANTIFLOOD_REASON_NONE;
 
-	if (oldest == NULL || newest == NULL || oldest == newest)
-		return MQ_ENFORCE_NONE;
+	unsigned int msg_matches = 0, usr_matches = 0;
+	time_t usr_first_seen = 0;
 
-	age_delta = newest->time - oldest->time;
-
-	if (age_delta <= antiflood_msg_time)
+	for (unsigned int i = 0; i < ANTIFLOOD_MSG_COUNT; i++)
 	{
-		mowgli_node_t *n;
-		size_t msg_matches = 0, usr_matches = 0;
-		time_t usr_first_seen = 0;
-
-		MOWGLI_ITER_FOREACH(n, mq->entries.head)
-		{
-			struct flood_message *mesg = n->data;
+		const struct antiflood_line *const al = &ring->lines[(ring->head + i) % ANTIFLOOD_MSG_COUNT];
 
-			if (!strcasecmp(mesg->message, newest->message))
-				msg_matches++;
+		if (al->hash == newest->hash)
+			msg_matches++;
 
-			if (mesg->source == newest->source)
-			{
-				usr_matches++;
+		if (al->source == newest->source)
+		{
+			usr_matches++;
 
-				if (!usr_first_seen)
-					usr_first_seen = mesg->time;
-			}
+			if (!usr_first_seen)
+				usr_first_seen = al->time;
 		}
+	}
 
-		if (msg_matches > (antiflood_msg_count / 2))
-			return MQ_ENFORCE_MSG;
+	if (msg_matches > (ANTIFLOOD_MSG_COUNT / 2))
+		return ANTIFLOOD_REASON_MSG;
 
-		if (usr_matches > (antiflood_msg_count / 2) &&
-			((newest->time - usr_first_seen) < antiflood_msg_time / 4))
-			return MQ_ENFORCE_LINE;
-	}
+	if (usr_matches > (ANTIFLOOD_MSG_COUNT / 2) &&
+		((newest->time - usr_first_seen) < antiflood_msg_time / 4))
+		return ANTIFLOOD_REASON_LINE;
 
-	return MQ_ENFORCE_NONE;
+	return ANTIFLOOD_REASON_NONE;
 }
 
 // this requires `chanserv/quiet` to be loaded.
@@ -332,7 +263,6 @@ on_channel_message(struct hook_channel_message *data)
 {
 	struct chanuser *cu;
 	struct mychan *mc;
-	struct flood_message_queue *mq;
 
 	return_if_fail(data != NULL);
 	return_if_fail(data->msg != NULL);
@@ -347,20 +277,17 @@ on_channel_message(struct hook_channel_message *data)
 	if (mc == NULL)
 		return;
 
-	mq = mqueue_get(mc);
-	return_if_fail(mq != NULL);
+	// do not enforce unless enforcement is specifically enabled
+	if (!(mc->flags & MC_ANTIFLOOD))
+		return;
 
-	msg_create(mq, data->u, data->msg);
+	const enum antiflood_enforce_reason reason = antiflood_should_enforce(mc, data->u, data->msg);
 
 	// never enforce against any user who has special CSTATUS flags.
 	if (cu->modes)
 		return;
 
-	// do not enforce unless enforcement is specifically enabled
-	if (!(mc->flags & MC_ANTIFLOOD))
-		return;
-
-	if (mqueue_should_enforce(mq) != MQ_ENFORCE_NONE)
+	if (reason != ANTIFLOOD_REASON_NONE)
 	{
 		const struct antiflood_enforce_method_impl *enf = antiflood_enforce_method_impl_get(mc);
 
@@ -371,17 +298,6 @@ on_channel_message(struct hook_channel_message *data)
 	}
 }
 
-static void
-on_channel_drop(struct mychan *mc)
-{
-	struct flood_message_queue *mq;
-
-	mq = mqueue_get(mc);
-	return_if_fail(mq != NULL);
-
-	mqueue_destroy(mq);
-}
-
 static void
 cs_set_cmd_antiflood(struct sourceinfo *si, int parc, char *parv[])
 {
@@ -495,6 +411,12 @@ static struct command cs_set_antiflood = {
 	.help           = { .path = "cservice/set_antiflood" },
 };
 
+static void
+on_channel_drop(struct mychan *mc)
+{
+	antiflood_ring_free(mc);
+}
+
 static void
 mod_init(struct module *m)
 {
@@ -513,13 +435,9 @@ mod_init(struct module *m)
 	hook_add_channel_message(on_channel_message);
 	hook_add_channel_drop(on_channel_drop);
 
-	msg_heap = sharedheap_get(sizeof(struct flood_message));
+	antiflood_ring_heap = sharedheap_get(sizeof(struct antiflood_ring));
 
-	mqueue_heap = sharedheap_get(sizeof(struct flood_message_queue));
-	mqueue_trie = mowgli_patricia_create(irccasecanon);
-	mqueue_gc_timer = mowgli_timer_add(base_eventloop, "mqueue_gc", mqueue_gc, NULL, 5 * SECONDS_PER_MINUTE);
-
-	antiflood_unenforce_timer = mowgli_timer_add(base_eventloop, "antiflood_unenforce", antiflood_unenforce_timer_cb, NULL, SECONDS_PER_HOUR);
+	antiflood_unenforce_timer = timer_add("antiflood_unenforce", antiflood_unenforce_timer_cb, NULL, SECONDS_PER_HOUR);
 
 	command_add(&cs_set_antiflood, *cs_set_cmdtree);
 
@@ -533,10 +451,15 @@ mod_deinit(const enum module_unload_intent ATHEME_VATTR_UNUSED intent)
 
 	hook_del_channel_message(on_channel_message);
 	hook_del_channel_drop(on_channel_drop);
+	timer_destroy(antiflood_unenforce_timer);
+
+	mowgli_patricia_iteration_state_t state;
+	struct mychan *mc;
+
+	MOWGLI_PATRICIA_FOREACH(mc, &state, mclist)
+		antiflood_ring_free(mc);
 
-	mowgli_patricia_destroy(mqueue_trie, mqueue_trie_destroy_cb, NULL);
-	mowgli_timer_destroy(base_eventloop, mqueue_gc_timer);
-	mowgli_timer_destroy(base_eventloop, antiflood_unenforce_timer);
+	sharedheap_unref(antiflood_ring_heap);
 
 	del_conf_item("ANTIFLOOD_ENFORCE_METHOD", &chansvs.me->conf_table);
 }
@@ -134,25 +134,36 @@ cs_cmd_unban(struct sourceinfo *si, int parc, char *parv[])
 
 	if ((tu = user_find_named(target)))
 	{
-		mowgli_node_t *n, *tn;
 		char hostbuf2[BUFSIZE];
-		unsigned int count = 0;
+		struct chanban **bans;
+		size_t count = 0;
 
 		snprintf(hostbuf2, BUFSIZE, "%s!%s@%s", tu->nick, tu->user, tu->vhost);
-		for (n = next_matching_ban(c, tu, 'b', c->bans.head); n != NULL; n = next_matching_ban(c, tu, 'b', tn))
+
+		if (MOWGLI_LIST_LENGTH(&c->bans) != 0)
 		{
-			tn = n->next;
-			cb = n->data;
+			bans = smalloc(MOWGLI_LIST_LENGTH(&c->bans) * sizeof *bans);
+			count = matching_bans(c, tu, "b", bans);
 
-			logcommand(si, CMDLOG_DO, "UNBAN: \2%s\2 on \2%s\2 (for user \2%s\2)", cb->mask, mc->name, hostbuf2);
-			modestack_mode_param(chansvs.nick, c, MTYPE_DEL, cb->type, cb->mask);
-			chanban_delete(cb);
-			count++;
+			for (size_t i = 0; i < count; i++)
+			{
+				cb = bans[i];
+
+				logcommand(si, CMDLOG_DO, "UNBAN: \2%s\2 on \2%s\2 (for user \2%s\2)", cb->mask, mc->name, hostbuf2);
+				modestack_mode_param(chansvs.nick, c, MTYPE_DEL, cb->type, cb->mask);
+				chanban_delete(cb);
+			}
+
+			sfree(bans);
 		}
 		if (count > 0)
+		{
+			// so that the unbans are out before the user tries to rejoin
+			modestack_flush_channel(c);
 			command_success_nodata(si, ngettext(N_("Unbanned \2%s\2 on \2%s\2 (%u ban removed)."),
 			                                    N_("Unbanned \2%s\2 on \2%s\2 (%u bans removed)."),
-			                                    count), target, channel, count);
+			                                    count), target, channel, (unsigned int) count);
+		}
 		else
 			command_success_nodata(si, _("No bans found matching \2%s\2 on \2%s\2."), target, channel);
 		return;
@@ -9,6 +9,27 @@
 
 #include "atheme.h"
 
+static unsigned int
+cs_bansearch_count(struct chanban *const *const restrict bans, const size_t nbans, const int type)
+{
+	unsigned int count = 0;
+
+	for (size_t i = 0; i < nbans; i++)
+		if (bans[i]->type == type)
+			count++;
+
+	return count;
+}
+
+static void
+cs_bansearch_list(struct sourceinfo *const restrict si, struct chanban *const *const restrict bans, const size_t nbans,
+                  const int type)
+{
+	for (size_t i = 0; i < nbans; i++)
+		if (bans[i]->type == type)
+			(void) command_success_nodata(si, "- %s", bans[i]->mask);
+}
+
 static void
 cs_cmd_bansearch_func(struct sourceinfo *const restrict si, const int parc, char **const restrict parv)
 {
@@ -59,42 +80,64 @@ cs_cmd_bansearch_func(struct sourceinfo *const restrict si, const int parc, char
 		return;
 	}
 
-	unsigned int count = 0;
-	mowgli_node_t *n;
+	// Quiets are their own list mode only on some ircds
+	const bool has_quiets = ! (ircd->type == PROTOCOL_UNREAL || ircd->type == PROTOCOL_INSPIRCD ||
+	                           ircd->type == PROTOCOL_NGIRCD);
+
+	char types[4] = "b";
+	size_t ntypes = 1;
+
+	if (has_quiets)
+		types[ntypes++] = 'q';
+	if (ircd->except_mchar)
+		types[ntypes++] = ircd->except_mchar;
 
-	for (n = next_matching_ban(c, tu, 'b', c->bans.head); n; n = next_matching_ban(c, tu, 'b', n->next))
+	struct chanban **bans = NULL;
+	size_t nbans = 0;
+
+	if (MOWGLI_LIST_LENGTH(&c->bans))
 	{
-		if (! count)
-			(void) command_success_nodata(si, _("Bans matching \2%s\2 in \2%s\2:"), tu->nick, channel);
+		bans = smalloc(MOWGLI_LIST_LENGTH(&c->bans) * sizeof *bans);
+		nbans = matching_bans(c, tu, types, bans);
+	}
 
-		const struct chanban *const cb = n->data;
-		count++;
+	unsigned int count = cs_bansearch_count(bans, nbans, 'b');
 
-		(void) command_success_nodata(si, "- %s", cb->mask);
+	if (count)
+	{
+		(void) command_success_nodata(si, _("Bans matching \2%s\2 in \2%s\2:"), tu->nick, channel);
+		(void) cs_bansearch_list(si, bans, nbans, 'b');
 	}
 
 	(void) command_success_nodata(si, ngettext(N_("\2%u\2 ban found."), N_("\2%u\2 bans found."), count), count);
 
-	if (! (ircd->type == PROTOCOL_UNREAL || ircd->type == PROTOCOL_INSPIRCD || ircd->type == PROTOCOL_NGIRCD))
+	if (has_quiets)
 	{
-		count = 0;
-
-		for (n = next_matching_ban(c, tu, 'q', c->bans.head); n; n = next_matching_ban(c, tu, 'q', n->next))
+		if ((count = cs_bansearch_count(bans, nbans, 'q')))
 		{
-			if (! count)
-				(void) command_success_nodata(si, _("Quiets matching \2%s\2 in \2%s\2:"),
-				                              tu->nick, channel);
-
-			const struct chanban *const cb = n->data;
-			count++;
-
-			(void) command_success_nodata(si, "- %s", cb->mask);
+			(void) command_success_nodata(si, _("Quiets matching \2%s\2 in \2%s\2:"), tu->nick, channel);
+			(void) cs_bansearch_list(si, bans, nbans, 'q');
 		}
 
 		(void) command_success_nodata(si, ngettext(N_("\2%u\2 quiet found."), N_("\2%u\2 quiets found."),
 		                              count), count);
 	}
 
+	if (ircd->except_mchar)
+	{
+		if ((count = cs_bansearch_count(bans, nbans, ircd->except_mchar)))
+		{
+			(void) command_success_nodata(si, _("Exceptions matching \2%s\2 in \2%s\2:"),
+			                              tu->nick, channel);
+			(void) cs_bansearch_list(si, bans, nbans, ircd->except_mchar);
+		}
+
+		(void) command_success_nodata(si, ngettext(N_("\2%u\2 exception found."),
+		                              N_("\2%u\2 exceptions found."), count), count);
+	}
+
+	(void) sfree(bans);
+
 	if (ircd->type == PROTOCOL_CHARYBDIS && (c->modes & mode_to_flag('r')))
 		if (! tu->myuser || (tu->myuser && (tu->myuser->flags & MU_WAITAUTH)))
 			(void) command_success_nodata(si, _("\2%s\2 is blocking unidentified users from joining, "
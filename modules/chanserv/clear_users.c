@@ -9,24 +9,123 @@
 
 #include <atheme.h>
 
+// How many users are kicked between checks for whether to give way
+#define CS_CLEAR_USERS_STEP     256U
+
 static mowgli_patricia_t **cs_clear_cmds = NULL;
 
+/* On a big channel the kicks go out a slice at a time (see
+ * command_run_sliced()), so the channel is looked up again for each.
+ */
+struct cs_clear_users_state
+{
+	char            channel[CHANNELLEN + 1];
+	char            reason[200];
+	int             oldlimit;
+};
+
+static void
+cs_clear_users_done(struct cs_clear_users_state *const restrict st, struct user *const restrict requester)
+{
+	struct mychan *const mc = mychan_find(st->channel);
+	struct channel *c;
+
+	// the channel may be empty now, so our pointer may be bogus!
+	if ((c = channel_find(st->channel)) == NULL)
+		return;
+
+	if (mc != NULL && (mc->flags & MC_GUARD) && !config_options.leave_chans &&
+			(requester == NULL || !chanuser_find(c, requester)))
+	{
+		/* Always cycle it if the requester is not on channel
+		 * -- jilles */
+		part(st->channel, chansvs.nick);
+	}
+
+	// could be permanent channel, blah
+	c = channel_find(st->channel);
+	if (c != NULL)
+	{
+		if (st->oldlimit == 0)
+			modestack_mode_limit(chansvs.nick, c, MTYPE_DEL, 0);
+		else if (st->oldlimit != 1)
+			modestack_mode_limit(chansvs.nick, c, MTYPE_ADD, st->oldlimit);
+	}
+}
+
+// The requester has gone; the kicks stop, but the limit is still put back
+static void
+cs_clear_users_cancel(void *const restrict priv)
+{
+	struct cs_clear_users_state *const st = priv;
+
+	cs_clear_users_done(st, NULL);
+	sfree(st);
+}
+
+static bool
+cs_clear_users_slice(struct sourceinfo *si, void *priv)
+{
+	struct cs_clear_users_state *const st = priv;
+	struct channel *c = channel_find(st->channel);
+	struct user **targets;
+	mowgli_node_t *n;
+	size_t count = 0;
+
+	if (c != NULL)
+	{
+		targets = smalloc(MOWGLI_LIST_LENGTH(&c->members) * sizeof *targets);
+
+		MOWGLI_ITER_FOREACH(n, c->members.head)
+		{
+			struct chanuser *cu = n->data;
+
+			// don't kick the user who requested the masskick
+			if (cu->user != si->su && !is_internal_client(cu->user))
+				targets[count++] = cu->user;
+		}
+
+		for (size_t i = 0; i < count; i += CS_CLEAR_USERS_STEP)
+		{
+			/* The rest go in the next slice, found anew; also wait for
+			 * the uplink to take what has been sent so far.
+			 */
+			if (i != 0 && (command_slice_expired() || (curr_uplink != NULL && curr_uplink->conn != NULL &&
+					sendq_congested(curr_uplink->conn))))
+			{
+				sfree(targets);
+				return false;
+			}
+
+			kick_users(chansvs.me->me, c, targets + i, count - i < CS_CLEAR_USERS_STEP ? count - i :
+					CS_CLEAR_USERS_STEP, st->reason);
+
+			/* Kicking the last users may have emptied the channel (or
+			 * left only chanserv, who parts if leave_chans is enabled),
+			 * in which case it is gone.
+			 */
+			if ((c = channel_find(st->channel)) == NULL)
+				break;
+		}
+
+		sfree(targets);
+	}
+
+	cs_clear_users_done(st, si->su);
+
+	command_success_nodata(si, _("Cleared users from \2%s\2."), st->channel);
+
+	sfree(st);
+	return true;
+}
+
 static void
 cs_cmd_clear_users(struct sourceinfo *si, int parc, char *parv[])
 {
-	char fullreason[200];
+	struct cs_clear_users_state *st;
 	struct channel *c;
 	char *channel = parv[0];
 	struct mychan *mc = mychan_find(channel);
-	struct chanuser *cu;
-	mowgli_node_t *n, *tn;
-	int oldlimit;
-	unsigned int nmembers;
-
-	if (parc >= 2)
-		snprintf(fullreason, sizeof fullreason, "CLEAR USERS used by %s: %s", get_source_name(si), parv[1]);
-	else
-		snprintf(fullreason, sizeof fullreason, "CLEAR USERS used by %s", get_source_name(si));
 
 	if (!mc)
 	{
@@ -54,66 +153,23 @@ cs_cmd_clear_users(struct sourceinfo *si, int parc, char *parv[])
 
 	command_add_flood(si, MOWGLI_LIST_LENGTH(&c->members) > 3 ? FLOOD_HEAVY : FLOOD_MODERATE);
 
+	st = smalloc(sizeof *st);
+	mowgli_strlcpy(st->channel, c->name, sizeof st->channel);
+
+	if (parc >= 2)
+		snprintf(st->reason, sizeof st->reason, "CLEAR USERS used by %s: %s", get_source_name(si), parv[1]);
+	else
+		snprintf(st->reason, sizeof st->reason, "CLEAR USERS used by %s", get_source_name(si));
+
 	// stop a race condition where users can rejoin
-	oldlimit = c->limit;
-	if (oldlimit != 1)
+	st->oldlimit = c->limit;
+	if (st->oldlimit != 1)
 		modestack_mode_limit(chansvs.nick, c, MTYPE_ADD, 1);
 	modestack_flush_channel(c);
 
-	MOWGLI_ITER_FOREACH_SAFE(n, tn, c->members.head)
-	{
-		cu = n->data;
-
-		// don't kick the user who requested the masskick
-		if (cu->user == si->su || is_internal_client(cu->user))
-			continue;
-
-		nmembers = MOWGLI_LIST_LENGTH(&c->members);
-		try_kick(chansvs.me->me, c, cu->user, fullreason);
-
-		/* If there are only two users remaining before the kick,
-		 * it is possible that the last user is chanserv which will
-		 * part if leave_chans is enabled. If it is a permanent
-		 * channel this will leave an empty channel, otherwise the
-		 * channel will have been destroyed. In either case, it is
-		 * not safe to continue.
-		 *
-		 * Kicking the last user is safe, tn will be NULL and
-		 * MOWGLI_ITER_FOREACH_SAFE will stop without touching any part
-		 * of the channel structure.
-		 */
-		if (nmembers == 2 && ((c = channel_find(channel)) == NULL ||
-					MOWGLI_LIST_LENGTH(&c->members) == 0))
-			break;
-	}
-
-	// the channel may be empty now, so our pointer may be bogus!
-	c = channel_find(channel);
-	if (c != NULL)
-	{
-		if ((mc->flags & MC_GUARD) && !config_options.leave_chans
-				&& c != NULL &&
-				(si->su == NULL || !chanuser_find(c, si->su)))
-		{
-			/* Always cycle it if the requester is not on channel
-			 * -- jilles */
-			part(channel, chansvs.nick);
-		}
-
-		// could be permanent channel, blah
-		c = channel_find(channel);
-		if (c != NULL)
-		{
-			if (oldlimit == 0)
-				modestack_mode_limit(chansvs.nick, c, MTYPE_DEL, 0);
-			else if (oldlimit != 1)
-				modestack_mode_limit(chansvs.nick, c, MTYPE_ADD, oldlimit);
-		}
-	}
-
 	logcommand(si, CMDLOG_DO, "CLEAR:USERS: \2%s\2", mc->name);
 
-	command_success_nodata(si, _("Cleared users from \2%s\2."), channel);
+	command_run_sliced(si, &cs_clear_users_slice, &cs_clear_users_cancel, st);
 }
 
 static struct command cs_clear_users = {
@@ -136,6 +192,7 @@ mod_init(struct module *const restrict m)
 static void
 mod_deinit(const enum module_unload_intent ATHEME_VATTR_UNUSED intent)
 {
+	command_cancel_all(&cs_clear_users);
 	command_delete(&cs_clear_users, *cs_clear_cmds);
 }
 
@@ -13,8 +13,10 @@ static void
 cs_cmd_clone(struct sourceinfo *si, int parc, char *parv[])
 {
 	struct mychan *mc, *mc2;
-	mowgli_node_t *n, *tn;
-	mowgli_patricia_iteration_state_t state;
+	mowgli_node_t *n;
+	struct chanacs_import *entries;
+	size_t count = 0;
+	struct metadata_iteration_state state;
 	struct metadata *md;
 	struct chanacs *ca;
 	char *source = parv[0];
@@ -81,30 +83,25 @@ cs_cmd_clone(struct sourceinfo *si, int parc, char *parv[])
 		return;
 	}
 
-	// Delete almost all chanacs of the target first
-	MOWGLI_ITER_FOREACH_SAFE(n, tn, mc2->chanacs.head)
-	{
-		ca = n->data;
-
-		if (ca->level & CA_FOUNDER)
-			continue;
-
-		atheme_object_unref(ca);
-	}
-
-	// Copy source chanacs to target
+	// Replace all but the founders' chanacs of the target with the source's
+	entries = smalloc(MOWGLI_LIST_LENGTH(&mc->chanacs) * sizeof *entries);
 	MOWGLI_ITER_FOREACH(n, mc->chanacs.head)
 	{
 		ca = n->data;
 
-		if (!ca->host)
-			chanacs_change_simple(mc2, ca->entity, NULL, ca->level, 0, *ca->setter_uid != '\0' ? myentity_find_uid(ca->setter_uid) : NULL);
-		else if (ca->host != NULL)
-			chanacs_change_simple(mc2, NULL, ca->host, ca->level, 0, *ca->setter_uid != '\0' ? myentity_find_uid(ca->setter_uid) : NULL);
+		entries[count].entity = ca->entity;
+		entries[count].host = ca->entity == NULL ? ca->host : NULL;
+		entries[count].level = ca->level;
+		entries[count].tmodified = CURRTIME;
+		entries[count].setter = *ca->setter_uid != '\0' ? myentity_find_uid(ca->setter_uid) : NULL;
+		count++;
 	}
 
+	chanacs_replace(mc2, entries, count, CA_FOUNDER);
+	sfree(entries);
+
 	// Copy ze metadata!
-	MOWGLI_PATRICIA_FOREACH(md, &state, atheme_object(mc)->metadata)
+	METADATA_FOREACH(md, &state, mc)
 	{
 		if(!strncmp(md->name, "private:topic:", 14))
 		{
@@ -49,7 +49,9 @@ cs_cmd_close(struct sourceinfo *si, int parc, char *parv[])
 	struct mychan *mc;
 	struct channel *c;
 	struct chanuser *cu;
-	mowgli_node_t *n, *tn;
+	struct user **targets;
+	size_t count = 0;
+	mowgli_node_t *n;
 
 	if (!target || !action)
 	{
@@ -101,13 +103,16 @@ cs_cmd_close(struct sourceinfo *si, int parc, char *parv[])
 			channel_mode_va(chansvs.me->me, c, 3, "+isbl", "*!*@*", "1");
 
 			// clear the channel
-			MOWGLI_ITER_FOREACH_SAFE(n, tn, c->members.head)
+			targets = smalloc(MOWGLI_LIST_LENGTH(&c->members) * sizeof *targets);
+			MOWGLI_ITER_FOREACH(n, c->members.head)
 			{
 				cu = (struct chanuser *)n->data;
 
 				if (!is_internal_client(cu->user))
-					try_kick(chansvs.me->me, c, cu->user, "This channel has been closed");
+					targets[count++] = cu->user;
 			}
+			kick_users(chansvs.me->me, c, targets, count, "This channel has been closed");
+			sfree(targets);
 		}
 
 		wallops("\2%s\2 closed the channel \2%s\2 (%s).", get_oper_name(si), target, reason);
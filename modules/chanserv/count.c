@@ -13,13 +13,11 @@ static void
 cs_cmd_count(struct sourceinfo *si, int parc, char *parv[])
 {
 	char *chan = parv[0];
-	struct chanacs *ca;
 	struct mychan *mc = mychan_find(chan);
 	unsigned int ca_sop, ca_aop, ca_hop, ca_vop;
 	unsigned int vopcnt = 0, aopcnt = 0, hopcnt = 0, sopcnt = 0, akickcnt = 0;
 	unsigned int othercnt = 0;
 	unsigned int i;
-	mowgli_node_t *n;
 	char str[512];
 	bool operoverride = false;
 
@@ -63,23 +61,21 @@ cs_cmd_count(struct sourceinfo *si, int parc, char *parv[])
 	if (chansvs.hide_pubacl_akicks)
 		show_akicks = ( chanacs_source_has_flag(mc, si, CA_ACLVIEW) || has_priv(si, PRIV_CHAN_AUSPEX) );
 
-	MOWGLI_ITER_FOREACH(n, mc->chanacs.head)
-	{
-		ca = (struct chanacs *)n->data;
-
-		if (ca->level == ca_vop)
-			vopcnt++;
-		else if (ca->level == ca_hop)
-			hopcnt++;
-		else if (ca->level == ca_aop)
-			aopcnt++;
-		else if (ca->level == ca_sop)
-			sopcnt++;
-		else if (ca->level == CA_AKICK)
-			akickcnt++;
-		else
-			othercnt++;
-	}
+	/* Each entry is counted under the first of these its level is, as
+	 * though walking the list; what's left over is "Other".
+	 */
+	vopcnt = chanacs_count_level(mc, ca_vop);
+	if (ca_hop != ca_vop)
+		hopcnt = chanacs_count_level(mc, ca_hop);
+	if (ca_aop != ca_vop && ca_aop != ca_hop)
+		aopcnt = chanacs_count_level(mc, ca_aop);
+	if (ca_sop != ca_vop && ca_sop != ca_hop && ca_sop != ca_aop)
+		sopcnt = chanacs_count_level(mc, ca_sop);
+	if (CA_AKICK != ca_vop && CA_AKICK != ca_hop && CA_AKICK != ca_aop && CA_AKICK != ca_sop)
+		akickcnt = chanacs_count_level(mc, CA_AKICK);
+
+	othercnt = MOWGLI_LIST_LENGTH(&mc->chanacs) - vopcnt - hopcnt - aopcnt - sopcnt - akickcnt;
+
 	if (show_akicks)
 	{
 		if (ca_hop == ca_vop)
@@ -105,16 +101,8 @@ cs_cmd_count(struct sourceinfo *si, int parc, char *parv[])
 			continue;
 		if (chanacs_flags[i].value == CA_AKICK && !show_akicks)
 			continue;
-		othercnt = 0;
-		MOWGLI_ITER_FOREACH(n, mc->chanacs.head)
-		{
-			ca = (struct chanacs *)n->data;
-
-			if (ca->level & chanacs_flags[i].value)
-				othercnt++;
-		}
 		snprintf(str + strlen(str), sizeof str - strlen(str),
-				"%c:%u ", (char) i, othercnt);
+				"%c:%u ", (char) i, chanacs_count_flag(mc, chanacs_flags[i].value));
 	}
 	command_success_nodata(si, "%s", str);
 
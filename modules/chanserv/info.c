@@ -20,7 +20,7 @@ cs_cmd_info(struct sourceinfo *si, int parc, char *parv[])
 	struct tm *tm;
 	struct myuser *mu;
 	struct metadata *md;
-	mowgli_patricia_iteration_state_t state;
+	struct metadata_iteration_state state;
 	struct hook_channel_req req;
 	bool hide_info, hide_acl;
 
@@ -117,7 +117,7 @@ cs_cmd_info(struct sourceinfo *si, int parc, char *parv[])
 	{
 		unsigned int mdcount = 0;
 
-		MOWGLI_PATRICIA_FOREACH(md, &state, atheme_object(mc)->metadata)
+		METADATA_FOREACH(md, &state, mc)
 		{
 			if (!strncmp(md->name, "private:", 8))
 				continue;
@@ -328,6 +328,7 @@ static struct command cs_info = {
 	.maxparc        = 2,
 	.cmd            = &cs_cmd_info,
 	.help           = { .path = "cservice/info" },
+	.replica_safe   = true,
 };
 
 static void
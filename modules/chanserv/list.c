@@ -118,20 +118,163 @@ build_criteriastr(char *buf, int parc, char *parv[])
 	}
 }
 
+struct cs_list_request
+{
+	struct command_pending *    cp;
+	struct sourceinfo *         si;         // Held by cp until the command finishes
+	struct world_query *        query;
+	char *                      chanpattern;
+	char *                      markpattern;
+	char *                      closedpattern;
+	char                        criteriastr[BUFSIZE];
+	unsigned int                flagset;
+	unsigned int                aclsize;
+	time_t                      age;
+	time_t                      lastused;
+	time_t                      now;
+	bool                        closed;
+	bool                        marked;
+	size_t *                    matches;    // Indices into the snapshot's channels
+	size_t                      nmatches;
+};
+
+static struct command cs_list;
+
+static void
+cs_list_request_free(struct cs_list_request *const restrict lr)
+{
+	(void) sfree(lr->chanpattern);
+	(void) sfree(lr->markpattern);
+	(void) sfree(lr->closedpattern);
+	(void) sfree(lr->matches);
+	(void) sfree(lr);
+}
+
+// The user quit while the query was running
+static void
+cs_list_cancel(void *const restrict priv)
+{
+	struct cs_list_request *const lr = priv;
+
+	// The user is still there while its deletion is hooked, so this can be logged
+	(void) logcommand(lr->si, CMDLOG_ADMIN, "LIST: \2%s\2 (cancelled)", lr->criteriastr);
+
+	if (lr->query)
+		(void) world_query_cancel(lr->query);
+
+	(void) cs_list_request_free(lr);
+}
+
+// Runs on a query thread, so it may only look at the snapshot and the request
+static void
+cs_list_query(const struct world_snapshot *const restrict snap, void *const restrict priv)
+{
+	struct cs_list_request *const lr = priv;
+
+	lr->matches = smalloc((snap->nmychans ? snap->nmychans : 1U) * sizeof *lr->matches);
+
+	for (size_t i = 0; i < snap->nmychans; i++)
+	{
+		const struct world_snapshot_mychan *const wmc = &snap->mychans[i];
+
+		if (lr->chanpattern && match(lr->chanpattern, world_snapshot_str(snap, wmc->name)))
+			continue;
+
+		if (lr->markpattern && (! wmc->mark_reason ||
+		                        match(lr->markpattern, world_snapshot_str(snap, wmc->mark_reason))))
+			continue;
+
+		if (lr->closedpattern && (! wmc->close_reason ||
+		                          match(lr->closedpattern, world_snapshot_str(snap, wmc->close_reason))))
+			continue;
+
+		if (lr->marked && ! (wmc->marks & WSM_MARKED))
+			continue;
+
+		if (lr->closed && ! (wmc->marks & WSM_CLOSED))
+			continue;
+
+		if (lr->flagset && (wmc->flags & lr->flagset) != lr->flagset)
+			continue;
+
+		if (lr->aclsize && wmc->nchanacs < lr->aclsize)
+			continue;
+
+		if (lr->age && (lr->now - wmc->registered) < lr->age)
+			continue;
+
+		if (lr->lastused && (lr->now - wmc->used) < lr->lastused)
+			continue;
+
+		lr->matches[lr->nmatches++] = i;
+	}
+}
+
+static void
+cs_list_done(const struct world_snapshot *const restrict snap, void *const restrict priv)
+{
+	struct cs_list_request *const lr = priv;
+	struct sourceinfo *const si = command_resume(lr->cp);
+	char buf[BUFSIZE];
+
+	lr->query = NULL;
+
+	if (! si)
+	{
+		(void) command_finish(lr->cp);
+		(void) cs_list_request_free(lr);
+		return;
+	}
+
+	(void) logcommand(si, CMDLOG_ADMIN, "LIST: \2%s\2 (\2%zu\2 matches)", lr->criteriastr, lr->nmatches);
+
+	for (size_t i = 0; i < lr->nmatches; i++)
+	{
+		const struct world_snapshot_mychan *const wmc = &snap->mychans[lr->matches[i]];
+
+		// in the future we could add a LIMIT parameter
+		*buf = '\0';
+
+		if (wmc->marks & WSM_MARKED) {
+			mowgli_strlcat(buf, "\2[marked]\2", BUFSIZE);
+		}
+		if (wmc->marks & WSM_CLOSED) {
+			if (*buf)
+				mowgli_strlcat(buf, " ", BUFSIZE);
+
+			mowgli_strlcat(buf, "\2[closed]\2", BUFSIZE);
+		}
+		if (wmc->flags & MC_HOLD) {
+			if (*buf)
+				mowgli_strlcat(buf, " ", BUFSIZE);
+
+			mowgli_strlcat(buf, "\2[held]\2", BUFSIZE);
+		}
+
+		command_success_nodata(si, "- %s (%s) %s", world_snapshot_str(snap, wmc->name),
+		                       world_snapshot_str(snap, wmc->founders), buf);
+	}
+
+	if (lr->nmatches == 0)
+		command_success_nodata(si, _("No channel matched criteria \2%s\2"), lr->criteriastr);
+	else
+		command_success_nodata(si, ngettext(N_("\2%zu\2 match for criteria \2%s\2."),
+		                                    N_("\2%zu\2 matches for criteria \2%s\2."),
+		                                    lr->nmatches), lr->nmatches, lr->criteriastr);
+
+	(void) command_finish(lr->cp);
+	(void) cs_list_request_free(lr);
+}
+
 static void
 cs_cmd_list(struct sourceinfo *si, int parc, char *parv[])
 {
-	struct mychan *mc;
-	struct metadata *md, *mdclosed;
 	char *chanpattern = NULL, *markpattern = NULL, *closedpattern = NULL;
-	char buf[BUFSIZE];
 	char criteriastr[BUFSIZE];
-	unsigned int matches = 0;
 	unsigned int flagset = 0;
 	int aclsize = 0;
 	time_t age = 0, lastused = 0;
-	bool closed = false, marked = false, markmatch, closedmatch;
-	mowgli_patricia_iteration_state_t state;
+	bool closed = false, marked = false;
 	struct list_option optstable[] = {
 		{"pattern",	OPT_STRING,	{.strval = &chanpattern}, 0},
 		{"mark-reason", OPT_STRING,	{.strval = &markpattern}, 0},
@@ -169,81 +312,32 @@ cs_cmd_list(struct sourceinfo *si, int parc, char *parv[])
 
 	command_success_nodata(si, _("Channels matching \2%s\2:"), criteriastr);
 
-	MOWGLI_PATRICIA_FOREACH(mc, &state, mclist)
-	{
-		if (chanpattern != NULL && match(chanpattern, mc->name))
-			continue;
-
-		if (markpattern)
-		{
-			markmatch = false;
-			md = metadata_find(mc, "private:mark:reason");
-			if (md != NULL && !match(markpattern, md->value))
-				markmatch = true;
+	struct cs_list_request *const lr = smalloc(sizeof *lr);
 
-			if (!markmatch)
-				continue;
-		}
+	lr->chanpattern = chanpattern ? sstrdup(chanpattern) : NULL;
+	lr->markpattern = markpattern ? sstrdup(markpattern) : NULL;
+	lr->closedpattern = closedpattern ? sstrdup(closedpattern) : NULL;
+	lr->flagset = flagset;
+	lr->aclsize = (aclsize > 0) ? (unsigned int) aclsize : 0;
+	lr->age = age;
+	lr->lastused = lastused;
+	lr->now = CURRTIME;
+	lr->closed = closed;
+	lr->marked = marked;
 
-		if (closedpattern)
-		{
-			closedmatch = false;
-			mdclosed = metadata_find(mc, "private:close:reason");
-			if (mdclosed != NULL && !match(closedpattern, mdclosed->value))
-				closedmatch = true;
+	(void) mowgli_strlcpy(lr->criteriastr, criteriastr, sizeof lr->criteriastr);
 
-			if (!closedmatch)
-				continue;
-		}
+	lr->cp = command_suspend(si, &cs_list_cancel, lr);
+	lr->si = si;
 
-		if (marked && !metadata_find(mc, "private:mark:setter"))
-			continue;
-
-		if (closed && !metadata_find(mc, "private:close:closer"))
-			continue;
+	/* Channels are matched against a snapshot on another thread; without a
+	 * user to send the output to later (e.g. over RPC), it all has to be in
+	 * the reply, so the query is run right away.
+	 */
+	struct world_query *const query = world_query_start(&cs_list_query, &cs_list_done, lr, si->su != NULL);
 
-		if (flagset && (mc->flags & flagset) != flagset)
-			continue;
-
-		if (aclsize && MOWGLI_LIST_LENGTH(&mc->chanacs) < (unsigned int)aclsize)
-			continue;
-
-		if (age && (CURRTIME - mc->registered) < age)
-			continue;
-
-		if (lastused && (CURRTIME - mc->used) < lastused)
-			continue;
-
-		// in the future we could add a LIMIT parameter
-		*buf = '\0';
-
-		if (metadata_find(mc, "private:mark:setter")) {
-			mowgli_strlcat(buf, "\2[marked]\2", BUFSIZE);
-		}
-		if (metadata_find(mc, "private:close:closer")) {
-			if (*buf)
-				mowgli_strlcat(buf, " ", BUFSIZE);
-
-			mowgli_strlcat(buf, "\2[closed]\2", BUFSIZE);
-		}
-		if (mc->flags & MC_HOLD) {
-			if (*buf)
-				mowgli_strlcat(buf, " ", BUFSIZE);
-
-			mowgli_strlcat(buf, "\2[held]\2", BUFSIZE);
-		}
-
-		command_success_nodata(si, "- %s (%s) %s", mc->name, mychan_founder_names(mc), buf);
-		matches++;
-	}
-
-	logcommand(si, CMDLOG_ADMIN, "LIST: \2%s\2 (\2%u\2 matches)", criteriastr, matches);
-	if (matches == 0)
-		command_success_nodata(si, _("No channel matched criteria \2%s\2"), criteriastr);
-	else
-		command_success_nodata(si, ngettext(N_("\2%u\2 match for criteria \2%s\2."),
-		                                    N_("\2%u\2 matches for criteria \2%s\2."),
-		                                    matches), matches, criteriastr);
+	if (query)
+		lr->query = query;
 }
 
 static struct command cs_list = {
@@ -253,6 +347,7 @@ static struct command cs_list = {
 	.maxparc        = 10,
 	.cmd            = &cs_cmd_list,
 	.help           = { .path = "cservice/list" },
+	.sched_class    = CMD_SCHED_QUERY,
 };
 
 static void
@@ -266,6 +361,8 @@ mod_init(struct module *const restrict m)
 static void
 mod_deinit(const enum module_unload_intent ATHEME_VATTR_UNUSED intent)
 {
+	(void) command_cancel_all(&cs_list);
+
 	service_named_unbind_command("chanserv", &cs_list);
 }
 
@@ -43,10 +43,10 @@ static void
 chanserv(struct sourceinfo *si, int parc, char *parv[])
 {
 	struct mychan *mc = NULL;
-	char orig[BUFSIZE];
-	char newargs[BUFSIZE];
+	struct command *c;
+	char *chan;
+	bool ctcp;
 	char *cmd;
-	char *args;
 
 	// this should never happen
 	if (parv[parc - 2][0] == '&')
@@ -81,15 +81,14 @@ chanserv(struct sourceinfo *si, int parc, char *parv[])
 		}
 	}
 
-	// make a copy of the original for debugging
-	mowgli_strlcpy(orig, parv[parc - 1], BUFSIZE);
+	ctcp = parv[parc - 1][0] == '\001';
 
 	// lets go through this to get the command
 	cmd = strtok(parv[parc - 1], " ");
 
 	if (!cmd)
 		return;
-	if (*orig == '\001')
+	if (ctcp)
 	{
 		handle_ctcp_common(si, cmd, strtok(NULL, ""));
 		return;
@@ -107,20 +106,10 @@ chanserv(struct sourceinfo *si, int parc, char *parv[])
 		{
 			const char *realcmd = service_resolve_alias(si->service, NULL, cmd);
 
-			/* XXX not really nice to look up the command twice
-			 * -- jilles */
-			if (command_find(si->service->commands, realcmd) == NULL)
+			if ((c = command_find(si->service->commands, realcmd)) == NULL)
 				return;
 			if (floodcheck(si->su, si->service->me))
 				return;
-			// construct <channel> <args>
-			mowgli_strlcpy(newargs, parv[parc - 2], sizeof newargs);
-			args = strtok(NULL, "");
-			if (args != NULL)
-			{
-				mowgli_strlcat(newargs, " ", sizeof newargs);
-				mowgli_strlcat(newargs, args, sizeof newargs);
-			}
 
 			// let the command know it's called as fantasy cmd
 			si->c = mc->chan;
@@ -129,7 +118,8 @@ chanserv(struct sourceinfo *si, int parc, char *parv[])
 			 * (a little ugly but this way we can !set verbose)
 			 */
 			mc->flags |= MC_FORCEVERBOSE;
-			command_exec_split(si->service, si, realcmd, newargs, si->service->commands);
+			chan = parv[parc - 2];
+			command_exec_args(si->service, si, c, 1, &chan, strtok(NULL, ""));
 			mc->flags &= ~MC_FORCEVERBOSE;
 		}
 		else if (!ircncasecmp(cmd, chansvs.nick, strlen(chansvs.nick)) && !isalnum((unsigned char)cmd[strlen(chansvs.nick)]) && (cmd = strtok(NULL, "")) != NULL)
@@ -137,18 +127,14 @@ chanserv(struct sourceinfo *si, int parc, char *parv[])
 			const char *realcmd;
 			char *pptr;
 
-			mowgli_strlcpy(newargs, parv[parc - 2], sizeof newargs);
 			while (*cmd == ' ')
 				cmd++;
 			if ((pptr = strchr(cmd, ' ')) != NULL)
-			{
-				mowgli_strlcat(newargs, pptr, sizeof newargs);
-				*pptr = '\0';
-			}
+				*pptr++ = '\0';
 
 			realcmd = service_resolve_alias(si->service, NULL, cmd);
 
-			if (command_find(si->service->commands, realcmd) == NULL)
+			if ((c = command_find(si->service->commands, realcmd)) == NULL)
 				return;
 			if (floodcheck(si->su, si->service->me))
 				return;
@@ -159,7 +145,8 @@ chanserv(struct sourceinfo *si, int parc, char *parv[])
 			 * (a little ugly but this way we can !set verbose)
 			 */
 			mc->flags |= MC_FORCEVERBOSE;
-			command_exec_split(si->service, si, realcmd, newargs, si->service->commands);
+			chan = parv[parc - 2];
+			command_exec_args(si->service, si, c, 1, &chan, pptr);
 			mc->flags &= ~MC_FORCEVERBOSE;
 		}
 	}
@@ -175,7 +162,8 @@ chanserv_config_ready(void *unused)
 
 	service_set_chanmsg(chansvs.me, true);
 
-	if (me.connected)
+	// Nothing that decides which channels to be in can have changed otherwise
+	if (me.connected && (conf_block_changed("chanserv") || conf_block_changed("general")))
 		join_registered(false); // !config_options.leave_chans
 }
 
@@ -352,28 +340,23 @@ chanuser_sync(struct hook_chanuser_sync *hdata)
 	}
 }
 
-static void
-cs_join(struct hook_channel_joinpart *hdata)
+/* Returns NULL if the user was kicked */
+static struct chanuser *
+cs_join_enforce(struct chanuser *cu)
 {
-	struct chanuser *cu = hdata->cu;
 	struct user *u;
 	struct channel *chan;
 	struct mychan *mc;
 	unsigned int flags;
 	bool noop;
 	bool secure;
-	struct metadata *md;
-	struct chanacs *ca2;
 
-	if (cu == NULL || is_internal_client(cu->user))
-		return;
 	u = cu->user;
 	chan = cu->chan;
 
-	// first check if this is a registered channel at all
 	mc = mychan_find(chan->name);
 	if (mc == NULL)
-		return;
+		return cu;
 
 	flags = chanacs_user_flags(mc, u);
 	noop = mc->flags & MC_NOOP || (u->myuser != NULL &&
@@ -383,10 +366,6 @@ cs_join(struct hook_channel_joinpart *hdata)
 	secure = mc->flags & MC_SECURE || (!chansvs.changets &&
 			chan->nummembers == 1 && chan->ts > CURRTIME - 300);
 
-	if (chan->nummembers == 1 && mc->flags & MC_GUARD &&
-		metadata_find(mc, "private:botserv:bot-assigned") == NULL)
-		join(chan->name, chansvs.nick);
-
 	/* Kick out users who may be recreating channels mlocked +i.
 	 * Users with +i flag are allowed to join, as are users matching
 	 * an invite exception (the latter only works if the channel already
@@ -413,10 +392,7 @@ cs_join(struct hook_channel_joinpart *hdata)
 			check_modes(mc, true);
 		modestack_flush_channel(chan);
 		if (try_kick(chansvs.me->me, chan, u, "Invite only channel"))
-		{
-			hdata->cu = NULL;
-			return;
-		}
+			return NULL;
 	}
 
 	struct hook_chanuser_sync sync_hdata = {
@@ -427,10 +403,7 @@ cs_join(struct hook_channel_joinpart *hdata)
 	hook_call_chanuser_sync(&sync_hdata);
 
 	if (!sync_hdata.cu)
-	{
-		hdata->cu = NULL;
-		return;
-	}
+		return NULL;
 
 	/* A second user joined and was not kicked; we do not need
 	 * to stay on the channel artificially.
@@ -447,6 +420,45 @@ cs_join(struct hook_channel_joinpart *hdata)
 
 	if (flags & CA_USEDUPDATE)
 		mc->used = CURRTIME;
+
+	return cu;
+}
+
+static void
+cs_join_deferred(struct chanuser *cu)
+{
+	(void) cs_join_enforce(cu);
+}
+
+static void
+cs_join(struct hook_channel_joinpart *hdata)
+{
+	struct chanuser *cu = hdata->cu;
+	struct channel *chan;
+	struct mychan *mc;
+
+	if (cu == NULL || is_internal_client(cu->user))
+		return;
+	chan = cu->chan;
+
+	// first check if this is a registered channel at all
+	mc = mychan_find(chan->name);
+	if (mc == NULL)
+		return;
+
+	if (chan->nummembers == 1 && mc->flags & MC_GUARD &&
+		metadata_find(mc, "private:botserv:bot-assigned") == NULL)
+		join(chan->name, chansvs.nick);
+
+	/* Users and channel memberships introduced by a server that is
+	 * still bursting are synced once it has finished, a channel at a
+	 * time -- most of them would otherwise be opped or kicked against
+	 * half of the channel.
+	 */
+	if (burst_defer_chanuser(cu, &cs_join_deferred))
+		return;
+
+	hdata->cu = cs_join_enforce(cu);
 }
 
 static void
@@ -838,7 +850,7 @@ mod_init(struct module ATHEME_VATTR_UNUSED *const restrict m)
 	hook_add_chanuser_sync(chanuser_sync);
 	hook_add_shutdown(on_shutdown);
 
-	cs_leave_empty_timer = mowgli_timer_add(base_eventloop, "cs_leave_empty", cs_leave_empty, NULL, 5 * SECONDS_PER_MINUTE);
+	cs_leave_empty_timer = timer_add("cs_leave_empty", cs_leave_empty, NULL, 5 * SECONDS_PER_MINUTE);
 
 	// chanserv{} block
 	add_bool_conf_item("FANTASY", &chansvs.me->conf_table, 0, &chansvs.fantasy, false);
@@ -19,7 +19,7 @@ cs_cmd_set_property(struct sourceinfo *si, int parc, char *parv[])
 	char *property = strtok(parv[1], " ");
 	char *value = strtok(NULL, "");
 	unsigned int count;
-	mowgli_patricia_iteration_state_t state;
+	struct metadata_iteration_state state;
 	struct metadata *md;
 
 	if (!property)
@@ -70,7 +70,7 @@ cs_cmd_set_property(struct sourceinfo *si, int parc, char *parv[])
 	count = 0;
 	if (atheme_object(mc)->metadata)
 	{
-		MOWGLI_PATRICIA_FOREACH(md, &state, atheme_object(mc)->metadata)
+		METADATA_FOREACH(md, &state, mc)
 		{
 			if (strncmp(md->name, "private:", 8))
 				count++;
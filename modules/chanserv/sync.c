@@ -12,10 +12,41 @@
 // Imported by modules/contrib/cs_modesync
 extern void do_channel_sync(struct mychan *, struct chanacs *);
 
+/* Automatic resyncs (access changes, logins, vhost and oper changes) are
+ * not done straight away. The memberships they touch are collected, each
+ * only once, and synced together at the end of the current pass of the
+ * event loop, so that a popular account logging in or a group's flags
+ * changing costs one chanacs_user_flags() per membership rather than one
+ * per event, and the resulting modes are stacked per channel.
+ */
+#define SYNC_TABLE_MIN          64U
+
+struct sync_pending
+{
+	struct chanuser *       cu;         // NULL if free, &sync_gone if it has parted since
+	bool                    take;
+};
+
 static mowgli_patricia_t **cs_set_cmdtree = NULL;
 
 static bool no_vhost_sync = false;
 
+static struct chanuser sync_gone;
+static struct sync_pending *sync_table = NULL;
+static unsigned int sync_size = 0;          // a power of two, or 0
+static unsigned int sync_used = 0;          // including those that have parted
+static struct sync_pending *sync_running = NULL;
+static unsigned int sync_running_size = 0;
+static mowgli_eventloop_timer_t *sync_timer = NULL;
+
+static inline unsigned int
+sync_slot(const struct chanuser *const cu, const unsigned int mask)
+{
+	const uint64_t h = ((uint64_t) (uintptr_t) cu) * UINT64_C(0x9E3779B97F4A7C15);
+
+	return ((unsigned int) (h >> 32)) & mask;
+}
+
 static void
 do_chanuser_sync(struct chanuser *cu, bool take)
 {
@@ -32,6 +63,124 @@ do_chanuser_sync(struct chanuser *cu, bool take)
 	hook_call_chanuser_sync(&sync_hdata);
 }
 
+static void
+sync_run(void ATHEME_VATTR_UNUSED *unused)
+{
+	sync_timer = NULL;
+	sync_running = sync_table;
+	sync_running_size = sync_size;
+
+	sync_table = NULL;
+	sync_size = 0;
+	sync_used = 0;
+
+	// syncing one membership may kick it; sync_forget() marks those in sync_running
+	for (unsigned int i = 0; i < sync_running_size; i++)
+	{
+		struct chanuser *const cu = sync_running[i].cu;
+
+		if (cu == NULL || cu == &sync_gone || cu->chan->mychan == NULL)
+			continue;
+
+		sync_running[i].cu = &sync_gone;
+		do_chanuser_sync(cu, sync_running[i].take);
+	}
+
+	sfree(sync_running);
+	sync_running = NULL;
+	sync_running_size = 0;
+}
+
+static void
+sync_insert(struct sync_pending *const table, const unsigned int size, struct chanuser *const cu, const bool take)
+{
+	const unsigned int mask = size - 1U;
+	unsigned int i = sync_slot(cu, mask);
+
+	while (table[i].cu != NULL)
+	{
+		if (table[i].cu == cu)
+		{
+			table[i].take |= take;
+			return;
+		}
+
+		i = (i + 1U) & mask;
+	}
+
+	table[i].cu = cu;
+	table[i].take = take;
+	sync_used++;
+}
+
+// queue a membership for syncing at the end of this pass of the event loop
+static void
+sync_queue(struct chanuser *const cu, const bool take)
+{
+	if ((sync_used + 1U) * 2U > sync_size)
+	{
+		struct sync_pending *const old = sync_table;
+		const unsigned int oldsize = sync_size;
+		unsigned int size = SYNC_TABLE_MIN;
+
+		while (size < (sync_used + 1U) * 4U)
+			size *= 2U;
+
+		sync_table = scalloc(size, sizeof *sync_table);
+		sync_size = size;
+		sync_used = 0;
+
+		for (unsigned int i = 0; i < oldsize; i++)
+			if (old[i].cu != NULL && old[i].cu != &sync_gone)
+				sync_insert(sync_table, sync_size, old[i].cu, old[i].take);
+
+		sfree(old);
+	}
+
+	sync_insert(sync_table, sync_size, cu, take);
+
+	if (sync_timer == NULL)
+		sync_timer = timer_add_once("chanserv_sync", &sync_run, NULL, 0);
+}
+
+static void
+sync_forget(struct sync_pending *const table, const unsigned int size, const struct chanuser *const cu)
+{
+	if (table == NULL)
+		return;
+
+	const unsigned int mask = size - 1U;
+
+	for (unsigned int i = sync_slot(cu, mask); table[i].cu != NULL; i = (i + 1U) & mask)
+	{
+		if (table[i].cu == cu)
+		{
+			table[i].cu = &sync_gone;
+			return;
+		}
+	}
+}
+
+static void
+sync_channel_part(struct hook_channel_joinpart *hdata)
+{
+	sync_forget(sync_table, sync_size, hdata->cu);
+	sync_forget(sync_running, sync_running_size, hdata->cu);
+}
+
+static bool
+sync_chanacs_matches(struct chanacs *ca, struct user *u)
+{
+	if (ca->entity)
+	{
+		const struct entity_vtable *vt = myentity_get_vtable(ca->entity);
+
+		return vt->match_user && vt->match_user(ca->entity, u);
+	}
+
+	return mask_matches_user(ca->host, u);
+}
+
 void
 do_channel_sync(struct mychan *mc, struct chanacs *ca)
 {
@@ -46,20 +195,8 @@ do_channel_sync(struct mychan *mc, struct chanacs *ca)
 	{
 		cu = (struct chanuser *)n->data;
 
-		if (ca)
-		{
-			if (ca->entity)
-			{
-				const struct entity_vtable *vt = myentity_get_vtable(ca->entity);
-				if (!(vt->match_user && vt->match_user(ca->entity, cu->user)))
-					continue;
-			}
-			else
-			{
-				if (!mask_matches_user(ca->host, cu->user))
-					continue;
-			}
-		}
+		if (ca && !sync_chanacs_matches(ca, cu->user))
+			continue;
 
 		do_chanuser_sync(cu, true);
 	}
@@ -85,7 +222,7 @@ sync_user(struct user *u)
 		if (mc == NULL)
 			continue;
 
-		do_chanuser_sync(cu, !(mc->flags & MC_NOSYNC));
+		sync_queue(cu, !(mc->flags & MC_NOSYNC));
 	}
 }
 
@@ -106,6 +243,7 @@ static void
 sync_channel_acl_change(struct hook_channel_acl_req *hookdata)
 {
 	struct mychan *mc;
+	mowgli_node_t *n;
 
 	return_if_fail(hookdata != NULL);
 	return_if_fail(hookdata->ca != NULL);
@@ -121,7 +259,16 @@ sync_channel_acl_change(struct hook_channel_acl_req *hookdata)
 	     CA_OP | CA_AUTOHALFOP | CA_HALFOP | CA_AUTOVOICE | CA_VOICE)) == 0)
 		return;
 
-	do_channel_sync(mc, hookdata->ca);
+	if (mc->chan == NULL)
+		return;
+
+	MOWGLI_ITER_FOREACH(n, mc->chan->members.head)
+	{
+		struct chanuser *const cu = n->data;
+
+		if (sync_chanacs_matches(hookdata->ca, cu->user))
+			sync_queue(cu, true);
+	}
 }
 
 static void
@@ -265,6 +412,7 @@ mod_init(struct module *const restrict m)
 	hook_add_user_deoper(sync_user);
 	hook_add_user_identify(sync_user);
 	hook_add_user_register(sync_myuser);
+	hook_add_channel_part(sync_channel_part);
 }
 
 static void
@@ -276,6 +424,13 @@ mod_deinit(const enum module_unload_intent ATHEME_VATTR_UNUSED intent)
 	hook_del_user_deoper(sync_user);
 	hook_del_user_identify(sync_user);
 	hook_del_user_register(sync_myuser);
+	hook_del_channel_part(sync_channel_part);
+
+	// whatever is still queued is dropped; the next change will sync it
+	if (sync_timer != NULL)
+		timer_destroy(sync_timer);
+
+	sfree(sync_table);
 
 	service_named_unbind_command("chanserv", &cs_sync);
 	command_delete(&cs_set_nosync, *cs_set_cmdtree);
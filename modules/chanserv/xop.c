@@ -173,7 +173,7 @@ cs_xop_do_del(struct sourceinfo *si, struct mychan *mc, struct myentity *mt, cha
 		req.ca = ca;
 		req.oldlevel = ca->level;
 
-		ca->level = 0;
+		chanacs_set_level(ca, 0);
 
 		req.newlevel = ca->level;
 
@@ -195,7 +195,7 @@ cs_xop_do_del(struct sourceinfo *si, struct mychan *mc, struct myentity *mt, cha
 	req.ca = ca;
 	req.oldlevel = ca->level;
 
-	ca->level = 0;
+	chanacs_set_level(ca, 0);
 
 	req.newlevel = ca->level;
 
@@ -17,6 +17,13 @@
 
 #include <argon2.h>
 
+#ifdef HAVE_USABLE_PTHREAD
+#  include <pthread.h>
+#  define ATHEME_ARGON2_SIGMASK pthread_sigmask
+#else
+#  define ATHEME_ARGON2_SIGMASK sigprocmask
+#endif
+
 #define MODULE_SAVEHASH_FORMAT  "$%s$v=%u$m=%u,t=%u,p=%u$%s$%s"
 #define MODULE_LOADHASH_FORMAT  "$%*[A-Za-z0-9]$v=%" SCNu32 "$m=%" SCNu32 ",t=%" SCNu32 ",p=%" SCNu32 "$" \
                                 "%[" BASE64_ALPHABET_RFC4648 "]$%[" BASE64_ALPHABET_RFC4648 "]"
@@ -46,6 +53,246 @@ static unsigned int atheme_argon2_timecost = ATHEME_ARGON2_TIMECOST_DEF;
 static unsigned int atheme_argon2_threads = ATHEME_ARGON2_THREADS_DEF;
 static unsigned int atheme_argon2_saltlen = ATHEME_ARGON2_SALTLEN_DEF;
 static unsigned int atheme_argon2_hashlen = ATHEME_ARGON2_HASHLEN_DEF;
+static unsigned int atheme_argon2_mempool = 0;
+static bool atheme_argon2_mempool_auto = true;
+
+/* Each computation needs 2^memcost KiB of working memory, which the library
+ * would otherwise allocate and free every time; that is an mmap(2), a page
+ * fault for every page, and a munmap(2) per login. Instead, a few buffers of
+ * the configured size are allocated up front (with every page touched) and
+ * lent out to computations, including those on the password verification
+ * threads. Hashes with a larger memory cost than configured, and
+ * computations that find every buffer in use, get memory of their own as
+ * before.
+ *
+ * Buffers are only allocated, freed and accounted for on the main thread;
+ * the callbacks that the library calls (possibly from worker threads) only
+ * borrow and return them, wiping them on return. One that was in use when
+ * the configuration changed is freed later, from a timer.
+ */
+struct atheme_argon2_buffer
+{
+	uint8_t *       mem;
+	size_t          len;
+	bool            busy;           // Lent out to a computation
+	bool            stale;          // To be freed (or replaced) once it is returned
+};
+
+static struct atheme_argon2_buffer atheme_argon2_buffers[ATHEME_ARGON2_MEMPOOL_MAX];
+static struct named_heap *atheme_argon2_buffers_heap = NULL;
+static mowgli_eventloop_timer_t *atheme_argon2_mempool_timer = NULL;
+
+#ifdef HAVE_USABLE_PTHREAD
+static pthread_mutex_t atheme_argon2_mempool_lock = PTHREAD_MUTEX_INITIALIZER;
+#  define ATHEME_ARGON2_MEMPOOL_LOCK()      (void) pthread_mutex_lock(&atheme_argon2_mempool_lock)
+#  define ATHEME_ARGON2_MEMPOOL_UNLOCK()    (void) pthread_mutex_unlock(&atheme_argon2_mempool_lock)
+#else
+#  define ATHEME_ARGON2_MEMPOOL_LOCK()      do { } while (0)
+#  define ATHEME_ARGON2_MEMPOOL_UNLOCK()    do { } while (0)
+#endif
+
+static int
+atheme_argon2_mempool_borrow(uint8_t **const restrict memory, const size_t len)
+{
+	ATHEME_ARGON2_MEMPOOL_LOCK();
+
+	for (size_t i = 0; i < ATHEME_ARGON2_MEMPOOL_MAX; i++)
+	{
+		struct atheme_argon2_buffer *const buf = &atheme_argon2_buffers[i];
+
+		if (buf->mem && ! buf->busy && ! buf->stale && buf->len >= len)
+		{
+			buf->busy = true;
+			*memory = buf->mem;
+
+			ATHEME_ARGON2_MEMPOOL_UNLOCK();
+			return ARGON2_OK;
+		}
+	}
+
+	ATHEME_ARGON2_MEMPOOL_UNLOCK();
+
+	if (! (*memory = malloc(len)))
+		return ARGON2_MEMORY_ALLOCATION_ERROR;
+
+	return ARGON2_OK;
+}
+
+static void
+atheme_argon2_mempool_return(uint8_t *const restrict memory, const size_t len)
+{
+	ATHEME_ARGON2_MEMPOOL_LOCK();
+
+	for (size_t i = 0; i < ATHEME_ARGON2_MEMPOOL_MAX; i++)
+	{
+		struct atheme_argon2_buffer *const buf = &atheme_argon2_buffers[i];
+
+		if (buf->mem != memory)
+			continue;
+
+		ATHEME_ARGON2_MEMPOOL_UNLOCK();
+
+		// Still ours until it is marked as not busy, so this can go on without the lock
+		(void) smemzero(memory, len);
+
+		ATHEME_ARGON2_MEMPOOL_LOCK();
+
+		buf->busy = false;
+
+		ATHEME_ARGON2_MEMPOOL_UNLOCK();
+		return;
+	}
+
+	ATHEME_ARGON2_MEMPOOL_UNLOCK();
+
+	(void) smemzero(memory, len);
+	(void) free(memory);
+}
+
+static void atheme_argon2_mempool_configure(void);
+
+static void
+atheme_argon2_mempool_timer_cb(void ATHEME_VATTR_UNUSED *const restrict unused)
+{
+	// The event loop frees once-only timers after running them
+	atheme_argon2_mempool_timer = NULL;
+
+	(void) atheme_argon2_mempool_configure();
+}
+
+// Main thread only: brings the buffers in line with the configuration
+static void
+atheme_argon2_mempool_configure(void)
+{
+	unsigned int want = atheme_argon2_mempool;
+	const size_t len = ((size_t) 1U << atheme_argon2_memcost) * 1024U;
+	bool pending = false;
+
+	if (atheme_argon2_mempool_auto)
+	{
+#ifdef HAVE_USABLE_PTHREAD
+		want = config_options.auth_threads ? config_options.auth_threads : 1U;
+#else
+		want = 1U;
+#endif
+	}
+
+	if (want > ATHEME_ARGON2_MEMPOOL_MAX)
+		want = ATHEME_ARGON2_MEMPOOL_MAX;
+
+	// Buffers of the old size are accounted separately until they are gone
+	struct named_heap *const nh = named_heap_get_external("argon2 buffers", len);
+
+	for (size_t i = 0; i < ATHEME_ARGON2_MEMPOOL_MAX; i++)
+	{
+		struct atheme_argon2_buffer *const buf = &atheme_argon2_buffers[i];
+		const bool keep = (i < want);
+
+		ATHEME_ARGON2_MEMPOOL_LOCK();
+
+		// Decided afresh below; the configuration may have changed back
+		if (! buf->busy)
+			buf->stale = false;
+
+		if (buf->mem && (! keep || buf->len != len))
+		{
+			if (buf->busy)
+			{
+				buf->stale = true;
+				pending = true;
+
+				ATHEME_ARGON2_MEMPOOL_UNLOCK();
+				continue;
+			}
+
+			struct named_heap *const oldnh = named_heap_get_external("argon2 buffers", buf->len);
+
+			oldnh->live--;
+
+			// Once for this lookup, once for the reference the buffer held
+			(void) named_heap_release(oldnh);
+			(void) named_heap_release(oldnh);
+			(void) free(buf->mem);
+
+			buf->mem = NULL;
+			buf->len = 0;
+			buf->stale = false;
+		}
+
+		ATHEME_ARGON2_MEMPOOL_UNLOCK();
+
+		if (! keep || buf->mem)
+			continue;
+
+		uint8_t *const mem = malloc(len);
+
+		if (! mem)
+		{
+			(void) slog(LG_ERROR, "%s: could not allocate %u of %u working buffers (%zu KiB each)",
+			                      MOWGLI_FUNC_NAME, want - (unsigned int) i, want, len / 1024U);
+			break;
+		}
+
+		// Fault every page in now, rather than during someone's login
+		(void) memset(mem, 0x00, len);
+
+		ATHEME_ARGON2_MEMPOOL_LOCK();
+
+		buf->mem = mem;
+		buf->len = len;
+
+		ATHEME_ARGON2_MEMPOOL_UNLOCK();
+
+		(void) named_heap_get_external("argon2 buffers", len);
+
+		if (++nh->live > nh->peak)
+			nh->peak = nh->live;
+	}
+
+	(void) named_heap_release(nh);
+
+	if (pending && ! atheme_argon2_mempool_timer)
+		atheme_argon2_mempool_timer = timer_add_once("argon2_mempool", &atheme_argon2_mempool_timer_cb, NULL, 1);
+}
+
+static void
+atheme_argon2_config_ready(void ATHEME_VATTR_UNUSED *const restrict unused)
+{
+	(void) atheme_argon2_mempool_configure();
+}
+
+static int
+c_ci_argon2_mempool(mowgli_config_file_entry_t *const restrict ce)
+{
+	char *end = NULL;
+
+	atheme_argon2_mempool_auto = true;
+	atheme_argon2_mempool = 0;
+
+	if (! ce->vardata)
+	{
+		(void) conf_report_warning(ce, "no parameter for configuration option -- using default");
+		return 0;
+	}
+
+	if (strcasecmp(ce->vardata, "auto") == 0)
+		return 0;
+
+	errno = 0;
+
+	const unsigned long val = strtoul(ce->vardata, &end, 10);
+
+	if (errno || ! *ce->vardata || *end || val > ATHEME_ARGON2_MEMPOOL_MAX)
+	{
+		(void) conf_report_warning(ce, "invalid parameter for configuration option -- using default");
+		return 0;
+	}
+
+	atheme_argon2_mempool_auto = false;
+	atheme_argon2_mempool = (unsigned int) val;
+
+	return 0;
+}
 
 static int
 c_ci_argon2_type(mowgli_config_file_entry_t *const restrict ce)
@@ -205,13 +452,16 @@ atheme_argon2_compute(argon2_context *const restrict ctx, const enum atheme_argo
 	 * and then will only be handled by the main thread (this one).
 	 *
 	 *     -- amdj
+	 *
+	 * This may also run in a password verification thread (which has all
+	 * signals blocked already), where only pthread_sigmask(3) is defined.
 	 */
 	if (sigfillset(&newset) != 0)
 	{
 		(void) slog(LG_ERROR, "%s: sigfillset(3): %s", MOWGLI_FUNC_NAME, strerror(errno));
 		return false;
 	}
-	if (sigprocmask(SIG_BLOCK, &newset, &oldset) != 0)
+	if (ATHEME_ARGON2_SIGMASK(SIG_BLOCK, &newset, &oldset) != 0)
 	{
 		(void) slog(LG_ERROR, "%s: sigprocmask(2): %s", MOWGLI_FUNC_NAME, strerror(errno));
 		return false;
@@ -227,13 +477,15 @@ atheme_argon2_compute(argon2_context *const restrict ctx, const enum atheme_argo
 	ctx->pwd = pass;
 	ctx->pwdlen = passlen;
 	ctx->lanes = ctx->threads;
+	ctx->allocate_cbk = &atheme_argon2_mempool_borrow;
+	ctx->free_cbk = &atheme_argon2_mempool_return;
 
 	if ((ret = argon2_ctx(ctx, inttype)) != (int) ARGON2_OK)
 		(void) slog(LG_ERROR, "%s: argon2_ctx() failed: %s", MOWGLI_FUNC_NAME, argon2_error_message(ret));
 	else
 		result = true;
 
-	if (sigprocmask(SIG_SETMASK, &oldset, NULL) != 0)
+	if (ATHEME_ARGON2_SIGMASK(SIG_SETMASK, &oldset, NULL) != 0)
 		(void) slog(LG_ERROR, "%s: sigprocmask(2): %s", MOWGLI_FUNC_NAME, strerror(errno));
 
 	(void) smemzero(pass, sizeof pass);
@@ -388,11 +640,15 @@ cleanup:
 	return result;
 }
 
+static const char *const crypto_argon2_prefixes[] = { "$argon2d$", "$argon2i$", "$argon2id$", NULL };
+
 static const struct crypt_impl crypto_argon2_impl = {
 
 	.id         = CRYPTO_MODULE_NAME,
 	.crypt      = &atheme_argon2_crypt,
 	.verify     = &atheme_argon2_verify,
+	.threadsafe = true,
+	.prefixes   = crypto_argon2_prefixes,
 };
 
 static void
@@ -417,8 +673,14 @@ mod_init(struct module *const restrict m)
 	(void) add_uint_conf_item("argon2_hashlen", *crypto_conf_table, 0, &atheme_argon2_hashlen,
 	                          ATHEME_ARGON2_HASHLEN_MIN, ATHEME_ARGON2_HASHLEN_MAX, ATHEME_ARGON2_HASHLEN_DEF);
 
+	(void) add_conf_item("argon2_mempool", *crypto_conf_table, &c_ci_argon2_mempool);
+	(void) hook_add_config_ready(&atheme_argon2_config_ready);
+
 	(void) crypt_register(&crypto_argon2_impl);
 
+	// Until the configuration is (re)read, and when loaded at runtime
+	(void) atheme_argon2_mempool_configure();
+
 #ifndef HAVE_LIBARGON2_TYPE_ID
 	(void) slog(LG_INFO, "%s: WARNING: your libargon2 does not support the Argon2id algorithm type; please "
 	                     "consider upgrading!", m->name);
@@ -431,7 +693,18 @@ static void
 mod_deinit(const enum module_unload_intent ATHEME_VATTR_UNUSED intent)
 {
 	(void) crypt_unregister(&crypto_argon2_impl);
+	(void) hook_del_config_ready(&atheme_argon2_config_ready);
+
+	// No computation can be running now that we are unregistered, so every buffer is back
+	atheme_argon2_mempool = 0;
+	atheme_argon2_mempool_auto = false;
+
+	(void) atheme_argon2_mempool_configure();
+
+	if (atheme_argon2_mempool_timer)
+		(void) timer_destroy(atheme_argon2_mempool_timer);
 
+	(void) del_conf_item("argon2_mempool", *crypto_conf_table);
 	(void) del_conf_item("argon2_type", *crypto_conf_table);
 	(void) del_conf_item("argon2_memcost", *crypto_conf_table);
 	(void) del_conf_item("argon2_timecost", *crypto_conf_table);
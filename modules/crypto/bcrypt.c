@@ -157,11 +157,15 @@ cleanup:
 	return retval;
 }
 
+static const char *const crypto_bcrypt_prefixes[] = { "$2a$", "$2b$", NULL };
+
 static const struct crypt_impl crypto_bcrypt_impl = {
 
 	.id        = CRYPTO_MODULE_NAME,
 	.crypt     = &atheme_bcrypt_crypt,
 	.verify    = &atheme_bcrypt_verify,
+	.threadsafe = true,
+	.prefixes  = crypto_bcrypt_prefixes,
 };
 
 static void
@@ -105,11 +105,14 @@ atheme_crypt3_sha2_256_verify(const char *const restrict password, const char *c
 	return true;
 }
 
+static const char *const crypto_crypt3_prefixes[] = { "$5$", NULL };
+
 static const struct crypt_impl crypto_crypt3_impl = {
 
 	.id        = CRYPTO_MODULE_NAME,
 	.crypt     = &atheme_crypt3_sha2_256_crypt,
 	.verify    = &atheme_crypt3_sha2_256_verify,
+	.prefixes  = crypto_crypt3_prefixes,
 };
 
 static void
@@ -86,10 +86,13 @@ anope_enc_sha256_verify(const char *const restrict password, const char *const r
 	return (ret == 0);
 }
 
+static const char *const crypto_prefixes[] = { "$anope$", NULL };
+
 static const struct crypt_impl crypto_impl = {
 
 	.id         = CRYPTO_MODULE_NAME,
 	.verify     = &anope_enc_sha256_verify,
+	.prefixes   = crypto_prefixes,
 };
 
 static bool ATHEME_FATTR_WUR
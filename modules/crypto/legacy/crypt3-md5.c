@@ -53,10 +53,13 @@ atheme_crypt3_md5_verify(const char *const restrict password, const char *const
 	return true;
 }
 
+static const char *const crypto_crypt3_prefixes[] = { "$1$", NULL };
+
 static const struct crypt_impl crypto_crypt3_impl = {
 
 	.id        = CRYPTO_MODULE_NAME,
 	.verify    = &atheme_crypt3_md5_verify,
+	.prefixes  = crypto_crypt3_prefixes,
 };
 
 static void
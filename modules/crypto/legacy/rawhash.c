@@ -54,10 +54,13 @@ atheme_rawhash_verify(const char *const restrict password, const char *const res
 	return (ret == 0);
 }
 
+static const char *const crypto_rawhash_prefixes[] = { RAWHASH_PREFIX_STR, NULL };
+
 static const struct crypt_impl crypto_rawhash_impl = {
 
 	.id         = "crypto/" RAWHASH_MODULE_NAME,
 	.verify     = &atheme_rawhash_verify,
+	.prefixes   = crypto_rawhash_prefixes,
 };
 
 static void
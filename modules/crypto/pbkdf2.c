@@ -70,6 +70,7 @@ static const struct crypt_impl crypto_pbkdf2_impl = {
 
 	.id         = CRYPTO_MODULE_NAME,
 	.verify     = &atheme_pbkdf2_verify,
+	.threadsafe = true,
 };
 
 static void
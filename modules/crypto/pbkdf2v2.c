@@ -440,30 +440,44 @@ const struct pbkdf2v2_scram_functions pbkdf2v2_scram_functions = {
 
 #endif /* HAVE_LIBIDN */
 
+// Normalises the password (if necessary) into the key that goes into PBKDF2
 static bool ATHEME_FATTR_WUR
-atheme_pbkdf2v2_compute(const char *const restrict password, struct pbkdf2v2_dbentry *const restrict dbe)
+atheme_pbkdf2v2_make_key(const char *const restrict password, const struct pbkdf2v2_dbentry *const restrict dbe,
+                         char *const restrict key, const size_t keysz, size_t *const restrict kl)
 {
-	char key[PASSLEN + 1];
-	(void) mowgli_strlcpy(key, password, sizeof key);
+	(void) mowgli_strlcpy(key, password, keysz);
 
 #ifdef HAVE_LIBIDN
-	if (dbe->scram && ! atheme_pbkdf2v2_scram_normalize(key, sizeof key))
+	if (dbe->scram && ! atheme_pbkdf2v2_scram_normalize(key, keysz))
 	{
 		(void) slog(LG_DEBUG, "%s: SASLprep normalization of password failed", MOWGLI_FUNC_NAME);
-		(void) smemzero(key, sizeof key);
+		(void) smemzero(key, keysz);
 		return false;
 	}
-#endif /* HAVE_LIBIDN */
-
-	const size_t kl = strlen(key);
+#else /* HAVE_LIBIDN */
+	(void) dbe;
+#endif /* !HAVE_LIBIDN */
 
-	if (! kl)
+	if (! (*kl = strlen(key)))
 	{
 		(void) slog(LG_DEBUG, "%s: password length == 0", MOWGLI_FUNC_NAME);
-		(void) smemzero(key, sizeof key);
+		(void) smemzero(key, keysz);
 		return false;
 	}
 
+	return true;
+}
+
+static bool ATHEME_FATTR_WUR
+atheme_pbkdf2v2_compute(const char *const restrict password, struct pbkdf2v2_dbentry *const restrict dbe)
+{
+	char key[PASSLEN + 1];
+	size_t kl;
+
+	if (! atheme_pbkdf2v2_make_key(password, dbe, key, sizeof key, &kl))
+		// This function logs messages on failure
+		return false;
+
 	if (! digest_oneshot_pbkdf2(dbe->md, key, kl, dbe->salt, dbe->sl, dbe->c, dbe->cdg, dbe->dl))
 	{
 		(void) slog(LG_ERROR, "%s: digest_oneshot_pbkdf2() for cdg failed (BUG)", MOWGLI_FUNC_NAME);
@@ -561,54 +575,54 @@ done:
 	return retval;
 }
 
+// Parses the stored parameters and decodes the salt; true if they are ours
 static bool ATHEME_FATTR_WUR
-atheme_pbkdf2v2_verify(const char *const restrict password, const char *const restrict parameters,
-                       unsigned int *const restrict flags)
+atheme_pbkdf2v2_verify_prepare(const char *const restrict parameters, struct pbkdf2v2_dbentry *const restrict dbe)
 {
-	unsigned char csk[DIGEST_MDLEN_MAX];
-	struct pbkdf2v2_dbentry dbe;
-	bool retval = false;
-
-	if (! atheme_pbkdf2v2_parse_dbentry(&dbe, parameters))
+	if (! atheme_pbkdf2v2_parse_dbentry(dbe, parameters))
 		// This function logs messages on failure
-		goto end;
+		return false;
 
-	if (atheme_pbkdf2v2_salt_is_b64(dbe.a))
+	if (atheme_pbkdf2v2_salt_is_b64(dbe->a))
 	{
-		if ((dbe.sl = base64_decode(dbe.salt64, dbe.salt, sizeof dbe.salt)) == BASE64_FAIL)
+		if ((dbe->sl = base64_decode(dbe->salt64, dbe->salt, sizeof dbe->salt)) == BASE64_FAIL)
 		{
-			(void) slog(LG_ERROR, "%s: base64_decode('%s') for salt failed", MOWGLI_FUNC_NAME, dbe.salt64);
-			goto end;
+			(void) slog(LG_ERROR, "%s: base64_decode('%s') for salt failed", MOWGLI_FUNC_NAME, dbe->salt64);
+			return false;
 		}
 
-		if (! atheme_pbkdf2v2_parameters_sane(&dbe))
+		if (! atheme_pbkdf2v2_parameters_sane(dbe))
 			// This function logs messages on failure
-			goto end;
+			return false;
 	}
 	else
 	{
-		dbe.sl = strlen(dbe.salt64);
+		dbe->sl = strlen(dbe->salt64);
 
-		if (! atheme_pbkdf2v2_parameters_sane(&dbe))
+		if (! atheme_pbkdf2v2_parameters_sane(dbe))
 			// This function logs messages on failure
-			goto end;
+			return false;
 
-		(void) memcpy(dbe.salt, dbe.salt64, dbe.sl);
+		(void) memcpy(dbe->salt, dbe->salt64, dbe->sl);
 	}
 
-	*flags |= PWVERIFY_FLAG_MYMODULE;
+	return true;
+}
 
-	if (! atheme_pbkdf2v2_compute(password, &dbe))
-		// This function logs messages on failure
-		goto end;
+// Compares the computed digest (dbe->cdg) against the stored credentials
+static bool ATHEME_FATTR_WUR
+atheme_pbkdf2v2_verify_check(const struct pbkdf2v2_dbentry *const restrict dbe, unsigned int *const restrict flags)
+{
+	unsigned char csk[DIGEST_MDLEN_MAX];
+	bool retval = false;
 
-	if (dbe.scram)
+	if (dbe->scram)
 	{
-		if (! atheme_pbkdf2v2_scram_derive(&dbe, dbe.cdg, csk, NULL))
+		if (! atheme_pbkdf2v2_scram_derive(dbe, dbe->cdg, csk, NULL))
 			// This function logs messages on failure
 			goto end;
 
-		if (smemcmp(dbe.ssk, csk, dbe.dl) != 0)
+		if (smemcmp(dbe->ssk, csk, dbe->dl) != 0)
 		{
 			(void) slog(LG_DEBUG, "%s: smemcmp() mismatch on ssk (invalid password?)", MOWGLI_FUNC_NAME);
 			goto end;
@@ -616,24 +630,121 @@ atheme_pbkdf2v2_verify(const char *const restrict password, const char *const re
 	}
 	else
 	{
-		if (smemcmp(dbe.sdg, dbe.cdg, dbe.dl) != 0)
+		if (smemcmp(dbe->sdg, dbe->cdg, dbe->dl) != 0)
 		{
 			(void) slog(LG_DEBUG, "%s: smemcmp() mismatch on sdg (invalid password?)", MOWGLI_FUNC_NAME);
 			goto end;
 		}
 	}
 
-	if (atheme_pbkdf2v2_recrypt(&dbe))
+	if (atheme_pbkdf2v2_recrypt(dbe))
 		*flags |= PWVERIFY_FLAG_RECRYPT;
 
 	retval = true;
 
 end:
 	(void) smemzero(csk, sizeof csk);
+	return retval;
+}
+
+static bool ATHEME_FATTR_WUR
+atheme_pbkdf2v2_verify(const char *const restrict password, const char *const restrict parameters,
+                       unsigned int *const restrict flags)
+{
+	struct pbkdf2v2_dbentry dbe;
+	bool retval = false;
+
+	if (! atheme_pbkdf2v2_verify_prepare(parameters, &dbe))
+		// This function logs messages on failure
+		goto end;
+
+	*flags |= PWVERIFY_FLAG_MYMODULE;
+
+	if (! atheme_pbkdf2v2_compute(password, &dbe))
+		// This function logs messages on failure
+		goto end;
+
+	retval = atheme_pbkdf2v2_verify_check(&dbe, flags);
+
+end:
 	(void) smemzero(&dbe, sizeof dbe);
 	return retval;
 }
 
+/* Verifies a batch of passwords for the password verification threads. The
+ * derivations for each digest algorithm are handed to the digest frontend in
+ * one go, so that hashes with the same iteration count (which, being set by
+ * the configuration, most of them are) share its multi-buffer kernels.
+ */
+static void
+atheme_pbkdf2v2_verify_multi(const char *const *const restrict passwords,
+                             const char *const *const restrict parameters, unsigned int *const restrict flags,
+                             bool *const restrict results, const size_t count)
+{
+	static const enum digest_algorithm algs[] = { DIGALG_MD5, DIGALG_SHA1, DIGALG_SHA2_256, DIGALG_SHA2_512 };
+
+	struct pbkdf2v2_dbentry *const dbe = smalloc(count * sizeof *dbe);
+	struct digest_pbkdf2_job *const jobs = smalloc(count * sizeof *jobs);
+	char (*const keys)[PASSLEN + 1] = smalloc(count * sizeof *keys);
+	size_t *const kl = smalloc(count * sizeof *kl);
+	bool *const ready = smalloc(count * sizeof *ready);
+
+	for (size_t i = 0; i < count; i++)
+	{
+		results[i] = false;
+
+		if (! atheme_pbkdf2v2_verify_prepare(parameters[i], &dbe[i]))
+			// This function logs messages on failure
+			continue;
+
+		flags[i] |= PWVERIFY_FLAG_MYMODULE;
+
+		ready[i] = atheme_pbkdf2v2_make_key(passwords[i], &dbe[i], keys[i], sizeof keys[i], &kl[i]);
+	}
+
+	for (size_t a = 0; a < ARRAY_SIZE(algs); a++)
+	{
+		size_t njobs = 0;
+
+		for (size_t i = 0; i < count; i++)
+		{
+			if (! ready[i] || dbe[i].md != algs[a])
+				continue;
+
+			jobs[njobs].pass = keys[i];
+			jobs[njobs].passLen = kl[i];
+			jobs[njobs].salt = dbe[i].salt;
+			jobs[njobs].saltLen = dbe[i].sl;
+			jobs[njobs].c = dbe[i].c;
+			jobs[njobs].dk = dbe[i].cdg;
+			jobs[njobs].dkLen = dbe[i].dl;
+			njobs++;
+		}
+
+		if (! njobs)
+			continue;
+
+		if (digest_oneshot_pbkdf2_multi(algs[a], jobs, njobs))
+			continue;
+
+		(void) slog(LG_ERROR, "%s: digest_oneshot_pbkdf2_multi() for cdg failed (BUG)", MOWGLI_FUNC_NAME);
+
+		for (size_t i = 0; i < count; i++)
+			if (dbe[i].md == algs[a])
+				ready[i] = false;
+	}
+
+	for (size_t i = 0; i < count; i++)
+		if (ready[i])
+			results[i] = atheme_pbkdf2v2_verify_check(&dbe[i], &flags[i]);
+
+	(void) smemzerofree(dbe, count * sizeof *dbe);
+	(void) smemzerofree(jobs, count * sizeof *jobs);
+	(void) smemzerofree(keys, count * sizeof *keys);
+	(void) sfree(kl);
+	(void) sfree(ready);
+}
+
 static int
 c_ci_pbkdf2v2_digest(mowgli_config_file_entry_t *const restrict ce)
 {
@@ -699,11 +810,16 @@ c_ci_pbkdf2v2_digest(mowgli_config_file_entry_t *const restrict ce)
 	return 0;
 }
 
+static const char *const crypto_pbkdf2v2_prefixes[] = { "$z$", NULL };
+
 static const struct crypt_impl crypto_pbkdf2v2_impl = {
 
-	.id         = CRYPTO_MODULE_NAME,
-	.crypt      = &atheme_pbkdf2v2_crypt,
-	.verify     = &atheme_pbkdf2v2_verify,
+	.id             = CRYPTO_MODULE_NAME,
+	.crypt          = &atheme_pbkdf2v2_crypt,
+	.verify         = &atheme_pbkdf2v2_verify,
+	.threadsafe     = true,
+	.verify_multi   = &atheme_pbkdf2v2_verify_multi,
+	.prefixes       = crypto_pbkdf2v2_prefixes,
 };
 
 static void
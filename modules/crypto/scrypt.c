@@ -82,11 +82,15 @@ atheme_scrypt_verify(const char *const restrict password, const char *const rest
 	return true;
 }
 
+static const char *const crypto_scrypt_prefixes[] = { "$7$", NULL };
+
 static const struct crypt_impl crypto_scrypt_impl = {
 
 	.id        = CRYPTO_MODULE_NAME,
 	.crypt     = &atheme_scrypt_crypt,
 	.verify    = &atheme_scrypt_verify,
+	.threadsafe = true,
+	.prefixes  = crypto_scrypt_prefixes,
 };
 
 static void
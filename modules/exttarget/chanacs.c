@@ -21,9 +21,11 @@ struct this_exttarget
 static mowgli_heap_t *chanacs_ext_heap = NULL;
 static mowgli_patricia_t *chanacs_exttarget_tree = NULL;
 static mowgli_patricia_t **exttarget_tree = NULL;
+static exttarget_cached_match_fn exttarget_cached_match = NULL;
+static exttarget_cache_forget_fn exttarget_cache_forget = NULL;
 
 static bool
-chanacs_ext_match_user(struct myentity *self, struct user *u)
+chanacs_ext_match_user_uncached(struct myentity *self, struct user *u)
 {
 	struct this_exttarget *ent;
 	struct mychan *mc;
@@ -50,6 +52,12 @@ chanacs_ext_match_user(struct myentity *self, struct user *u)
 	return false;
 }
 
+static bool
+chanacs_ext_match_user(struct myentity *self, struct user *u)
+{
+	return exttarget_cached_match(self, u, &chanacs_ext_match_user_uncached);
+}
+
 static bool
 chanacs_ext_match_entity(struct myentity *self, struct myentity *mt)
 {
@@ -74,6 +82,7 @@ chanacs_ext_delete(struct this_exttarget *e)
 	return_if_fail(e != NULL);
 
 	mowgli_patricia_delete(chanacs_exttarget_tree, e->channel);
+	exttarget_cache_forget();
 	strshare_unref(e->channel);
 	strshare_unref(entity(e)->name);
 
@@ -138,6 +147,8 @@ static void
 mod_init(struct module *const restrict m)
 {
 	MODULE_TRY_REQUEST_SYMBOL(m, exttarget_tree, "exttarget/main", "exttarget_tree")
+	MODULE_TRY_REQUEST_SYMBOL(m, exttarget_cached_match, "exttarget/main", "exttarget_cached_match")
+	MODULE_TRY_REQUEST_SYMBOL(m, exttarget_cache_forget, "exttarget/main", "exttarget_cache_forget")
 
 	mowgli_patricia_add(*exttarget_tree, "chanacs", chanacs_validate_f);
 
@@ -22,18 +22,14 @@ static bool
 channel_ext_match_user(struct myentity *self, struct user *u)
 {
 	struct this_exttarget *ent;
-	mowgli_node_t *n;
+	struct channel *c;
 
 	ent = (struct this_exttarget *) self;
-	MOWGLI_LIST_FOREACH(n, u->channels.head)
-	{
-		struct chanuser *cu = n->data;
 
-		if (!irccasecmp(cu->chan->name, ent->channel))
-			return true;
-	}
+	if (!(c = channel_find(ent->channel)))
+		return false;
 
-	return false;
+	return chanuser_find(c, u) != NULL;
 }
 
 static bool
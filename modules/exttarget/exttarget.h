@@ -12,4 +12,13 @@
 
 typedef struct myentity *(*entity_validate_f)(const char *name);
 
+/* Exttargets whose match_user() is costly wrap it in exttarget_cached_match(),
+ * which keeps each answer until the end of the event loop pass or until a
+ * join, part, login, logout, nick or host change, oper-up, quit or access
+ * list change might have changed it.
+ */
+typedef bool (*exttarget_match_user_fn)(struct myentity *self, struct user *u);
+typedef bool (*exttarget_cached_match_fn)(struct myentity *self, struct user *u, exttarget_match_user_fn match_fn);
+typedef void (*exttarget_cache_forget_fn)(void);
+
 #endif /* !ATHEME_MOD_EXTTARGET_EXTTARGET_H */
@@ -12,6 +12,165 @@
 extern mowgli_patricia_t *exttarget_tree;
 mowgli_patricia_t *exttarget_tree = NULL;
 
+extern bool exttarget_cached_match(struct myentity *self, struct user *u, exttarget_match_user_fn match_fn);
+extern void exttarget_cache_forget(void);
+
+#define EXTTARGET_CACHE_MIN_SIZE        64U
+
+struct exttarget_cache_entry
+{
+	struct myentity *       self;
+	struct user *           u;
+	bool                    result;
+};
+
+static struct exttarget_cache_entry *exttarget_cache = NULL;
+static unsigned int exttarget_cache_size = 0;
+static unsigned int exttarget_cache_count = 0;
+static unsigned int exttarget_cache_acsgen = 0;
+static unsigned int exttarget_cache_depth = 0;
+static mowgli_eventloop_timer_t *exttarget_cache_timer = NULL;
+
+static unsigned int exttarget_cache_hits = 0;
+static unsigned int exttarget_cache_misses = 0;
+
+static inline unsigned int
+exttarget_cache_slot(const struct myentity *const self, const struct user *const u, const unsigned int mask)
+{
+	const uint64_t h = (((uint64_t) (uintptr_t) self) ^ ((uint64_t) (uintptr_t) u << 1)) * UINT64_C(0x9E3779B97F4A7C15);
+
+	return ((unsigned int) (h >> 32)) & mask;
+}
+
+static struct exttarget_cache_entry *
+exttarget_cache_probe(struct exttarget_cache_entry *const table, const unsigned int size,
+                      const struct myentity *const self, const struct user *const u)
+{
+	const unsigned int mask = size - 1U;
+	unsigned int i = exttarget_cache_slot(self, u, mask);
+
+	while (table[i].self != NULL && (table[i].self != self || table[i].u != u))
+		i = (i + 1U) & mask;
+
+	return &table[i];
+}
+
+void
+exttarget_cache_forget(void)
+{
+	if (! exttarget_cache_count)
+		return;
+
+	(void) memset(exttarget_cache, 0x00, exttarget_cache_size * sizeof *exttarget_cache);
+
+	exttarget_cache_count = 0;
+}
+
+static void
+exttarget_cache_expire(void ATHEME_VATTR_UNUSED *const restrict unused)
+{
+	exttarget_cache_timer = NULL;
+
+	exttarget_cache_forget();
+}
+
+static void
+exttarget_cache_add(struct myentity *const self, struct user *const u, const bool result)
+{
+	if ((exttarget_cache_count + 1U) * 2U > exttarget_cache_size)
+	{
+		const unsigned int size = exttarget_cache_size ? (exttarget_cache_size * 2U) : EXTTARGET_CACHE_MIN_SIZE;
+		struct exttarget_cache_entry *const table = scalloc(size, sizeof *table);
+
+		for (unsigned int i = 0; i < exttarget_cache_size; i++)
+			if (exttarget_cache[i].self != NULL)
+				*exttarget_cache_probe(table, size, exttarget_cache[i].self, exttarget_cache[i].u) = exttarget_cache[i];
+
+		sfree(exttarget_cache);
+
+		exttarget_cache = table;
+		exttarget_cache_size = size;
+	}
+
+	struct exttarget_cache_entry *const ce = exttarget_cache_probe(exttarget_cache, exttarget_cache_size, self, u);
+
+	if (ce->self == NULL)
+		exttarget_cache_count++;
+
+	ce->self = self;
+	ce->u = u;
+	ce->result = result;
+
+	if (exttarget_cache_timer == NULL)
+		exttarget_cache_timer = timer_add_once("exttarget_cache_expire", &exttarget_cache_expire, NULL, 0);
+}
+
+bool
+exttarget_cached_match(struct myentity *const self, struct user *const u, const exttarget_match_user_fn match_fn)
+{
+	return_val_if_fail(self != NULL, false);
+	return_val_if_fail(u != NULL, false);
+	return_val_if_fail(match_fn != NULL, false);
+
+	if (exttarget_cache_acsgen != chanacs_flags_generation())
+	{
+		exttarget_cache_forget();
+		exttarget_cache_acsgen = chanacs_flags_generation();
+	}
+
+	if (exttarget_cache_count)
+	{
+		const struct exttarget_cache_entry *const ce = exttarget_cache_probe(exttarget_cache,
+		                                                                     exttarget_cache_size, self, u);
+
+		if (ce->self != NULL)
+		{
+			exttarget_cache_hits++;
+			return ce->result;
+		}
+	}
+
+	exttarget_cache_misses++;
+
+	exttarget_cache_depth++;
+	const bool result = match_fn(self, u);
+	exttarget_cache_depth--;
+
+	/* An answer worked out inside another one (e.g. $chanacs: on a channel
+	 * with $chanacs: entries of its own) may have hit a recursion limit, so
+	 * only the outermost answers are kept.
+	 */
+	if (! exttarget_cache_depth)
+		exttarget_cache_add(self, u, result);
+
+	return result;
+}
+
+static void
+exttarget_cache_joinpart(struct hook_channel_joinpart ATHEME_VATTR_UNUSED *const restrict hdata)
+{
+	exttarget_cache_forget();
+}
+
+static void
+exttarget_cache_nickchange(struct hook_user_nick ATHEME_VATTR_UNUSED *const restrict hdata)
+{
+	exttarget_cache_forget();
+}
+
+static void
+exttarget_cache_user(struct user ATHEME_VATTR_UNUSED *const restrict u)
+{
+	exttarget_cache_forget();
+}
+
+static void
+exttarget_osinfo(struct sourceinfo *const restrict si)
+{
+	(void) command_success_nodata(si, _("Exttarget matches answered from cache: %u (worked out: %u)"),
+	                              exttarget_cache_hits, exttarget_cache_misses);
+}
+
 static void
 exttarget_find(struct hook_myentity_req *req)
 {
@@ -42,6 +201,16 @@ mod_init(struct module ATHEME_VATTR_UNUSED *const restrict m)
 	exttarget_tree = mowgli_patricia_create(strcasecanon);
 
 	hook_add_myentity_find(exttarget_find);
+
+	hook_add_channel_join(exttarget_cache_joinpart);
+	hook_add_channel_part(exttarget_cache_joinpart);
+	hook_add_user_nickchange(exttarget_cache_nickchange);
+	hook_add_user_delete(exttarget_cache_user);
+	hook_add_user_identify(exttarget_cache_user);
+	hook_add_user_logout(exttarget_cache_user);
+	hook_add_user_oper(exttarget_cache_user);
+	hook_add_user_sethost(exttarget_cache_user);
+	hook_add_operserv_info(exttarget_osinfo);
 }
 
 static void
@@ -49,6 +218,21 @@ mod_deinit(const enum module_unload_intent ATHEME_VATTR_UNUSED intent)
 {
 	hook_del_myentity_find(exttarget_find);
 
+	hook_del_channel_join(exttarget_cache_joinpart);
+	hook_del_channel_part(exttarget_cache_joinpart);
+	hook_del_user_nickchange(exttarget_cache_nickchange);
+	hook_del_user_delete(exttarget_cache_user);
+	hook_del_user_identify(exttarget_cache_user);
+	hook_del_user_logout(exttarget_cache_user);
+	hook_del_user_oper(exttarget_cache_user);
+	hook_del_user_sethost(exttarget_cache_user);
+	hook_del_operserv_info(exttarget_osinfo);
+
+	if (exttarget_cache_timer != NULL)
+		timer_destroy(exttarget_cache_timer);
+
+	sfree(exttarget_cache);
+
 	mowgli_patricia_destroy(exttarget_tree, NULL, NULL);
 }
 
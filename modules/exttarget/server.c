@@ -17,6 +17,8 @@ struct this_exttarget
 static mowgli_heap_t *server_ext_heap = NULL;
 static mowgli_patricia_t *server_exttarget_tree = NULL;
 static mowgli_patricia_t **exttarget_tree = NULL;
+static exttarget_cached_match_fn exttarget_cached_match = NULL;
+static exttarget_cache_forget_fn exttarget_cache_forget = NULL;
 
 static void
 server_ext_delete(struct this_exttarget *e)
@@ -24,6 +26,7 @@ server_ext_delete(struct this_exttarget *e)
 	return_if_fail(e != NULL);
 
 	mowgli_patricia_delete(server_exttarget_tree, e->server);
+	exttarget_cache_forget();
 	strshare_unref(e->server);
 	strshare_unref(entity(e)->name);
 
@@ -31,7 +34,7 @@ server_ext_delete(struct this_exttarget *e)
 }
 
 static bool
-server_ext_match_user(struct myentity *self, struct user *u)
+server_ext_match_user_uncached(struct myentity *self, struct user *u)
 {
 	struct this_exttarget *ent;
 	mowgli_node_t *n;
@@ -43,6 +46,12 @@ server_ext_match_user(struct myentity *self, struct user *u)
 	return false;
 }
 
+static bool
+server_ext_match_user(struct myentity *self, struct user *u)
+{
+	return exttarget_cached_match(self, u, &server_ext_match_user_uncached);
+}
+
 static bool
 server_ext_match_entity(struct myentity *self, struct myentity *mt)
 {
@@ -118,6 +127,8 @@ static void
 mod_init(struct module *const restrict m)
 {
 	MODULE_TRY_REQUEST_SYMBOL(m, exttarget_tree, "exttarget/main", "exttarget_tree")
+	MODULE_TRY_REQUEST_SYMBOL(m, exttarget_cached_match, "exttarget/main", "exttarget_cached_match")
+	MODULE_TRY_REQUEST_SYMBOL(m, exttarget_cache_forget, "exttarget/main", "exttarget_cache_forget")
 
 	mowgli_patricia_add(*exttarget_tree, "server", server_validate_f);
 
@@ -15,8 +15,47 @@ struct global_ {
 	char *text;
 };
 
+// a GLOBAL SEND being written out by the delivery queue
+struct global_delivery {
+	char **lines;
+	unsigned int nlines;
+	unsigned int next;
+};
+
 static struct service *globsvs = NULL;
 
+static bool
+gs_delivery_step(struct delivery_job *const restrict job)
+{
+	struct global_delivery *const gd = job->data;
+
+	if (gd->next >= gd->nlines)
+		return false;
+
+	/* Cannot use si->service->me here, global notices
+	 * should come from global even if /os global was
+	 * used. */
+	notice_global_sts(globsvs->me, "*", gd->lines[gd->next++]);
+
+	return true;
+}
+
+static void
+gs_delivery_done(struct delivery_job *const restrict job, const bool cancelled)
+{
+	struct global_delivery *const gd = job->data;
+
+	if (cancelled)
+		slog(LG_INFO, "GLOBAL: job %u by %s cancelled after %u of %u lines", job->id, job->owner,
+		     gd->next, gd->nlines);
+
+	for (unsigned int i = 0; i < gd->nlines; i++)
+		sfree(gd->lines[i]);
+
+	sfree(gd->lines);
+	sfree(gd);
+}
+
 static void
 gs_cmd_help(struct sourceinfo *const restrict si, const int ATHEME_VATTR_UNUSED parc, char **const restrict parv)
 {
@@ -37,6 +76,7 @@ gs_cmd_global(struct sourceinfo *si, const int parc, char *parv[])
 {
 	static mowgli_heap_t *glob_heap = NULL;
 	struct global_ *global;
+	struct global_delivery *gd;
 	static mowgli_list_t globlist;
 	mowgli_node_t *n, *tn;
 	char *params = parv[0];
@@ -87,6 +127,9 @@ gs_cmd_global(struct sourceinfo *si, const int parc, char *parv[])
 			return;
 		}
 
+		gd = smalloc(sizeof *gd);
+		gd->lines = smalloc(MOWGLI_LIST_LENGTH(&globlist) * sizeof *gd->lines);
+
 		isfirst = true;
 		MOWGLI_ITER_FOREACH(n, globlist.head)
 		{
@@ -97,10 +140,7 @@ gs_cmd_global(struct sourceinfo *si, const int parc, char *parv[])
 					isfirst ? " - " : "",
 					global->text);
 
-			/* Cannot use si->service->me here, global notices
-			 * should come from global even if /os global was
-			 * used. */
-			notice_global_sts(globsvs->me, "*", buf);
+			gd->lines[gd->nlines++] = sstrdup(buf);
 			isfirst = false;
 
 			// log everything
@@ -123,7 +163,10 @@ gs_cmd_global(struct sourceinfo *si, const int parc, char *parv[])
 		sfree(sender);
 		sender = NULL;
 
-		command_success_nodata(si, _("The global notice has been sent."));
+		(void) delivery_job_start(get_source_name(si), "GLOBAL", PRIV_GLOBAL, gd->nlines,
+		                          &gs_delivery_step, &gs_delivery_done, gd);
+
+		command_success_nodata(si, _("The global notice is being sent."));
 
 		return;
 	}
@@ -222,8 +265,18 @@ mod_init(struct module *const restrict m)
 static void
 mod_deinit(const enum module_unload_intent ATHEME_VATTR_UNUSED intent)
 {
+	mowgli_node_t *n, *tn;
+
 	(void) service_named_unbind_command("operserv", &gs_global);
 
+	MOWGLI_ITER_FOREACH_SAFE(n, tn, delivery_jobs.head)
+	{
+		struct delivery_job *const job = n->data;
+
+		if (job->step == &gs_delivery_step)
+			delivery_job_cancel(job);
+	}
+
 	(void) service_delete(globsvs);
 }
 
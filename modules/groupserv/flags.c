@@ -158,7 +158,7 @@ no_founder:
 	if (ga != NULL && flags != 0)
 	{
 		if (ga->flags != flags)
-			ga->flags = flags;
+			groupacs_modify(ga, flags);
 		else
 		{
 			command_fail(si, fault_nochange, _("Group \2%s\2 access for \2%s\2 unchanged."), entity(mg)->name, mt->name);
@@ -101,6 +101,7 @@ static struct command gs_info = {
 	.maxparc        = 2,
 	.cmd            = &gs_cmd_info,
 	.help           = { .path = "groupserv/info" },
+	.replica_safe   = true,
 };
 
 static void
@@ -57,6 +57,7 @@ static struct command gs_list = {
 	.maxparc        = 1,
 	.cmd            = &gs_cmd_list,
 	.help           = { .path = "groupserv/list" },
+	.sched_class    = CMD_SCHED_QUERY,
 };
 
 static void
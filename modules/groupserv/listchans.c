@@ -85,6 +85,7 @@ static struct command gs_listchans = {
 	.maxparc        = 1,
 	.cmd            = &gs_cmd_listchans,
 	.help           = { .path = "groupserv/listchans" },
+	.replica_safe   = true,
 };
 
 static void
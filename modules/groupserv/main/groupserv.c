@@ -14,6 +14,155 @@ struct groupserv_config gs_config;
 
 mowgli_heap_t *mygroup_heap, *groupacs_heap;
 
+/* Each group keeps a table of every account in it, directly or through
+ * nested groups, so that asking whether an account is in a group does not
+ * walk the access lists. Any change to any group's access list makes every
+ * table stale; a stale table is rebuilt the next time it is asked.
+ */
+#define MYGROUP_MEMBERS_MIN_SIZE        16U
+
+static unsigned int mygroup_members_gen = 1;
+
+static void
+groupacs_changed(void)
+{
+	if (++mygroup_members_gen == 0)
+		mygroup_members_gen = 1;
+
+	chanacs_flags_invalidate();
+}
+
+static inline unsigned int
+mygroup_members_slot(const struct myentity *const mt, const unsigned int mask)
+{
+	const uint64_t h = ((uint64_t) (uintptr_t) mt) * UINT64_C(0x9E3779B97F4A7C15);
+
+	return ((unsigned int) (h >> 32)) & mask;
+}
+
+static struct mygroup_member *
+mygroup_members_probe(struct mygroup_member *const table, const unsigned int size, const struct myentity *const mt)
+{
+	const unsigned int mask = size - 1U;
+	unsigned int i = mygroup_members_slot(mt, mask);
+
+	while (table[i].mt != NULL && table[i].mt != mt)
+		i = (i + 1U) & mask;
+
+	return &table[i];
+}
+
+static void
+mygroup_members_add(struct mygroup *const mg, struct myentity *const mt, const unsigned int flags)
+{
+	struct mygroup_member *gm;
+
+	if ((mg->members_count + 1U) * 2U > mg->members_size)
+	{
+		const unsigned int size = mg->members_size ? (mg->members_size * 2U) : MYGROUP_MEMBERS_MIN_SIZE;
+		struct mygroup_member *const table = scalloc(size, sizeof *table);
+
+		for (unsigned int i = 0; i < mg->members_size; i++)
+			if (mg->members[i].mt != NULL)
+				*mygroup_members_probe(table, size, mg->members[i].mt) = mg->members[i];
+
+		sfree(mg->members);
+
+		mg->members = table;
+		mg->members_size = size;
+	}
+
+	gm = mygroup_members_probe(mg->members, mg->members_size, mt);
+
+	if (gm->mt == NULL)
+	{
+		gm->mt = mt;
+		mg->members_count++;
+	}
+
+	gm->flags |= flags;
+}
+
+static void
+mygroup_members_collect(struct mygroup *const top, struct mygroup *const mg, mowgli_list_t *const visited)
+{
+	mowgli_node_t *n;
+
+	mg->visited = true;
+	mowgli_node_add(mg, mowgli_node_create(), visited);
+
+	MOWGLI_ITER_FOREACH(n, mg->acs.head)
+	{
+		struct groupacs *const ga = n->data;
+
+		if (isgroup(ga->mt))
+		{
+			if (! group(ga->mt)->visited)
+				mygroup_members_collect(top, group(ga->mt), visited);
+		}
+		else if (isuser(ga->mt))
+			mygroup_members_add(top, ga->mt, ga->flags);
+	}
+}
+
+void
+mygroup_members_forget(struct mygroup *mg)
+{
+	return_if_fail(mg != NULL);
+
+	sfree(mg->members);
+
+	mg->members = NULL;
+	mg->members_size = 0;
+	mg->members_count = 0;
+	mg->members_gen = 0;
+}
+
+/* Returns how the account mt is in mg, with the flags of every entry that
+ * names it in mg or in a group nested in mg; NULL if it is not in mg.
+ */
+const struct mygroup_member *
+mygroup_member_find(struct mygroup *mg, const struct myentity *mt)
+{
+	return_val_if_fail(mg != NULL, NULL);
+	return_val_if_fail(mt != NULL, NULL);
+
+	if (mg->members_gen != mygroup_members_gen)
+	{
+		mowgli_list_t visited = { NULL, NULL, 0 };
+		mowgli_node_t *n, *tn;
+
+		mygroup_members_forget(mg);
+		mygroup_members_collect(mg, mg, &visited);
+
+		MOWGLI_ITER_FOREACH_SAFE(n, tn, visited.head)
+		{
+			((struct mygroup *) n->data)->visited = false;
+
+			mowgli_node_delete(n, &visited);
+			mowgli_node_free(n);
+		}
+
+		mg->members_gen = mygroup_members_gen;
+	}
+
+	if (mg->members == NULL)
+		return NULL;
+
+	const struct mygroup_member *const gm = mygroup_members_probe(mg->members, mg->members_size, mt);
+
+	return (gm->mt != NULL) ? gm : NULL;
+}
+
+// Where an entity's list of group memberships is kept
+static unsigned int membership_slot;
+
+void
+mygroups_privatedata_init(void)
+{
+	membership_slot = privatedata_slot_register("groupserv:membership");
+}
+
 void
 mygroups_init(void)
 {
@@ -44,6 +193,9 @@ mygroup_delete(struct mygroup *mg)
 		atheme_object_unref(ga);
 	}
 
+	groupacs_changed();
+	mygroup_members_forget(mg);
+
 	metadata_delete_all(mg);
 	strshare_unref(entity(mg)->name);
 	mowgli_heap_free(mygroup_heap, mg);
@@ -124,18 +276,27 @@ groupacs_add(struct mygroup *mg, struct myentity *mt, unsigned int flags)
 	mowgli_node_add(ga, &ga->gnode, &mg->acs);
 	mowgli_node_add(ga, &ga->unode, myentity_get_membership_list(mt));
 
+	groupacs_changed();
+
 	return ga;
 }
 
-struct groupacs *
-groupacs_find(struct mygroup *mg, struct myentity *mt, unsigned int flags, bool allow_recurse)
+void
+groupacs_modify(struct groupacs *ga, unsigned int flags)
+{
+	return_if_fail(ga != NULL);
+
+	ga->flags = flags;
+
+	groupacs_changed();
+}
+
+static struct groupacs *
+groupacs_find_walk(struct mygroup *mg, struct myentity *mt, unsigned int flags, bool allow_recurse)
 {
 	mowgli_node_t *n;
 	struct groupacs *out = NULL;
 
-	return_val_if_fail(mg != NULL, NULL);
-	return_val_if_fail(mt != NULL, NULL);
-
 	mg->visited = true;
 
 	MOWGLI_ITER_FOREACH(n, mg->acs.head)
@@ -149,7 +310,7 @@ groupacs_find(struct mygroup *mg, struct myentity *mt, unsigned int flags, bool
 		{
 			struct groupacs *ga2;
 
-			ga2 = groupacs_find(group(ga->mt), mt, flags, allow_recurse);
+			ga2 = groupacs_find_walk(group(ga->mt), mt, flags, allow_recurse);
 
 			if (ga2 != NULL)
 				out = ga;
@@ -171,6 +332,24 @@ groupacs_find(struct mygroup *mg, struct myentity *mt, unsigned int flags, bool
 	return out;
 }
 
+struct groupacs *
+groupacs_find(struct mygroup *mg, struct myentity *mt, unsigned int flags, bool allow_recurse)
+{
+	return_val_if_fail(mg != NULL, NULL);
+	return_val_if_fail(mt != NULL, NULL);
+
+	// most lookups are for accounts that are not in the group at all
+	if (allow_recurse && isuser(mt))
+	{
+		const struct mygroup_member *const gm = mygroup_member_find(mg, mt);
+
+		if (gm == NULL || (flags && ! (gm->flags & flags)))
+			return NULL;
+	}
+
+	return groupacs_find_walk(mg, mt, flags, allow_recurse);
+}
+
 void
 groupacs_delete(struct mygroup *mg, struct myentity *mt)
 {
@@ -182,6 +361,8 @@ groupacs_delete(struct mygroup *mg, struct myentity *mt)
 		mowgli_node_delete(&ga->gnode, &mg->acs);
 		mowgli_node_delete(&ga->unode, myentity_get_membership_list(mt));
 		atheme_object_unref(ga);
+
+		groupacs_changed();
 	}
 }
 
@@ -233,12 +414,12 @@ myentity_get_membership_list(struct myentity *mt)
 {
 	mowgli_list_t *l;
 
-	l = privatedata_get(mt, "groupserv:membership");
+	l = privatedata_slot_get(mt, membership_slot);
 	if (l != NULL)
 		return l;
 
 	l = mowgli_list_create();
-	privatedata_set(mt, "groupserv:membership", l);
+	privatedata_slot_set(mt, membership_slot, l);
 
 	return l;
 }
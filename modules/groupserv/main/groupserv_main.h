@@ -15,6 +15,7 @@
 
 extern struct groupserv_config gs_config;
 
+void mygroups_privatedata_init(void);
 void mygroups_init(void);
 void mygroups_deinit(void);
 struct mygroup *mygroup_add(const char *name);
@@ -24,6 +25,10 @@ struct mygroup *mygroup_find(const char *name);
 struct groupacs *groupacs_add(struct mygroup *mg, struct myentity *mt, unsigned int flags);
 struct groupacs *groupacs_find(struct mygroup *mg, struct myentity *mt, unsigned int flags, bool allow_recurse);
 void groupacs_delete(struct mygroup *mg, struct myentity *mt);
+void groupacs_modify(struct groupacs *ga, unsigned int flags);
+
+const struct mygroup_member *mygroup_member_find(struct mygroup *mg, const struct myentity *mt);
+void mygroup_members_forget(struct mygroup *mg);
 
 bool groupacs_sourceinfo_has_flag(struct mygroup *mg, struct sourceinfo *si, unsigned int flag);
 unsigned int groupacs_sourceinfo_flags(struct mygroup *mg, struct sourceinfo *si);
@@ -123,7 +123,7 @@ osinfo_hook(struct sourceinfo *si)
 void
 gs_hooks_init(void)
 {
-	mygroup_expire_timer = mowgli_timer_add(base_eventloop, "mygroup_expire", mygroup_expire, NULL, SECONDS_PER_HOUR);
+	mygroup_expire_timer = timer_add("mygroup_expire", mygroup_expire, NULL, SECONDS_PER_HOUR);
 
 	hook_add_user_info(user_info_hook);
 	hook_add_myuser_delete(myuser_delete_hook);
@@ -134,7 +134,7 @@ gs_hooks_init(void)
 void
 gs_hooks_deinit(void)
 {
-	mowgli_timer_destroy(base_eventloop, mygroup_expire_timer);
+	timer_destroy(mygroup_expire_timer);
 
 	hook_del_user_info(user_info_hook);
 	hook_del_myuser_delete(myuser_delete_hook);
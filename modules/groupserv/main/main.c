@@ -36,6 +36,8 @@ mod_init(struct module *const restrict m)
 
 	struct groupserv_persist_record *rec = mowgli_global_storage_get("atheme.groupserv.main.persist");
 
+	mygroups_privatedata_init();
+
 	if (rec == NULL)
 		mygroups_init();
 	else
@@ -54,6 +56,7 @@ mod_init(struct module *const restrict m)
 			continue_if_fail(isgroup(grp));
 
 			mygroup_set_entity_vtable(grp);
+			mygroup_members_forget(group(grp));
 		}
 	}
 
@@ -22,7 +22,9 @@ mygroup_match_entity(struct myentity *self, struct myentity *mt)
 	if (!isuser(mt))
 		return false;
 
-	return groupacs_find(mg, mt, GA_CHANACS, true) != NULL;
+	const struct mygroup_member *const gm = mygroup_member_find(mg, mt);
+
+	return gm != NULL && (gm->flags & GA_CHANACS);
 }
 
 static bool
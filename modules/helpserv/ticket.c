@@ -9,18 +9,26 @@
 
 #include <atheme.h>
 
+#define TICKET_LIST_PAGE 50U
+
 struct help_ticket
 {
 	stringref nick;
 	time_t ticket_ts;
 	char *creator;
 	char *topic;
+	mowgli_node_t node;
 };
 
 static unsigned int ratelimit_count = 0;
 static time_t ratelimit_firsttime = 0;
 
+// open tickets, oldest first; the head is always the next to expire
 static mowgli_list_t helpserv_reqlist;
+static mowgli_patricia_t *helpserv_reqs_by_account = NULL;
+
+static unsigned int ticket_expire = 0;
+static mowgli_eventloop_timer_t *ticket_expire_timer = NULL;
 
 static void
 write_ticket_db(struct database_handle *db)
@@ -29,7 +37,7 @@ write_ticket_db(struct database_handle *db)
 
 	MOWGLI_ITER_FOREACH(n, helpserv_reqlist.head)
 	{
-		struct help_ticket *l = n->data;
+		const struct help_ticket *const l = n->data;
 
 		db_start_row(db, "HE");
 		db_write_word(db, l->nick);
@@ -40,6 +48,64 @@ write_ticket_db(struct database_handle *db)
 	}
 }
 
+static inline struct help_ticket *
+ticket_find(const char *account)
+{
+	return mowgli_patricia_retrieve(helpserv_reqs_by_account, account);
+}
+
+// keeps helpserv_reqlist in ticket_ts order; tickets are nearly always the newest
+static void
+ticket_queue(struct help_ticket *const restrict l)
+{
+	mowgli_node_t *n;
+
+	MOWGLI_ITER_FOREACH_PREV(n, helpserv_reqlist.tail)
+	{
+		const struct help_ticket *const prev = n->data;
+
+		if (prev->ticket_ts <= l->ticket_ts)
+		{
+			if (n->next != NULL)
+				mowgli_node_add_before(l, &l->node, &helpserv_reqlist, n->next);
+			else
+				mowgli_node_add(l, &l->node, &helpserv_reqlist);
+
+			return;
+		}
+	}
+
+	mowgli_node_add_head(l, &l->node, &helpserv_reqlist);
+}
+
+static struct help_ticket *
+ticket_add(const char *account, time_t ticket_ts, const char *creator, const char *topic)
+{
+	struct help_ticket *const l = smalloc(sizeof *l);
+
+	l->nick = strshare_get(account);
+	l->ticket_ts = ticket_ts;
+	l->creator = sstrdup(creator);
+	l->topic = sstrdup(topic);
+
+	ticket_queue(l);
+	(void) mowgli_patricia_add(helpserv_reqs_by_account, l->nick, l);
+
+	return l;
+}
+
+static void
+ticket_delete(struct help_ticket *const restrict l)
+{
+	mowgli_node_delete(&l->node, &helpserv_reqlist);
+	(void) mowgli_patricia_delete(helpserv_reqs_by_account, l->nick);
+
+	strshare_unref(l->nick);
+	sfree(l->creator);
+	sfree(l->topic);
+	sfree(l);
+}
+
 static void
 db_h_he(struct database_handle *db, const char *type)
 {
@@ -48,62 +114,65 @@ db_h_he(struct database_handle *db, const char *type)
 	const char *creator = db_sread_word(db);
 	const char *topic = db_sread_str(db);
 
-	struct help_ticket *const l = smalloc(sizeof *l);
-	l->nick = strshare_get(nick);
-	l->ticket_ts = ticket_ts;
-	l->creator = sstrdup(creator);
-	l->topic = sstrdup(topic);
-	mowgli_node_add(l, mowgli_node_create(), &helpserv_reqlist);
+	struct help_ticket *const old = ticket_find(nick);
+
+	// only one ticket per account; keep the newest
+	if (old != NULL)
+	{
+		if (old->ticket_ts > ticket_ts)
+			return;
+
+		ticket_delete(old);
+	}
+
+	(void) ticket_add(nick, ticket_ts, creator, topic);
+}
+
+static void
+ticket_expire_cb(void *unused)
+{
+	mowgli_node_t *n, *tn;
+
+	if (ticket_expire == 0)
+		return;
+
+	MOWGLI_ITER_FOREACH_SAFE(n, tn, helpserv_reqlist.head)
+	{
+		struct help_ticket *const l = n->data;
+
+		if (l->ticket_ts + (time_t) ticket_expire > CURRTIME)
+			break;
+
+		slog(LG_REGISTER, "HELP:REQUEST:TIMEOUT: \2%s\2 \2%s\2", l->nick, l->topic);
+
+		ticket_delete(l);
+	}
 }
 
 static void
 account_drop_request(struct myuser *mu)
 {
-        mowgli_node_t *n;
-        struct help_ticket *l;
-
-        MOWGLI_ITER_FOREACH(n, helpserv_reqlist.head)
-        {
-                l = n->data;
-                if (!irccasecmp(l->nick, entity(mu)->name))
-                {
-                        slog(LG_REGISTER, "HELP:REQUEST:DROPACCOUNT: \2%s\2 \2%s\2", l->nick, l->topic);
-
-                        mowgli_node_delete(n, &helpserv_reqlist);
-
-                        strshare_unref(l->nick);
-                        sfree(l->creator);
-                        sfree(l->topic);
-                        sfree(l);
-
-                        return;
-                }
-        }
+	struct help_ticket *l;
+
+	if ((l = ticket_find(entity(mu)->name)) != NULL)
+	{
+		slog(LG_REGISTER, "HELP:REQUEST:DROPACCOUNT: \2%s\2 \2%s\2", l->nick, l->topic);
+
+		ticket_delete(l);
+	}
 }
 
 static void
 account_delete_request(struct myuser *mu)
 {
-        mowgli_node_t *n;
-        struct help_ticket *l;
-
-        MOWGLI_ITER_FOREACH(n, helpserv_reqlist.head)
-        {
-                l = n->data;
-                if (!irccasecmp(l->nick, entity(mu)->name))
-                {
-                        slog(LG_REGISTER, "HELP:REQUEST:EXPIRE: \2%s\2 \2%s\2", l->nick, l->topic);
-
-                        mowgli_node_delete(n, &helpserv_reqlist);
-
-                        strshare_unref(l->nick);
-                        sfree(l->creator);
-                        sfree(l->topic);
-                        sfree(l);
-
-                        return;
-                }
-        }
+	struct help_ticket *l;
+
+	if ((l = ticket_find(entity(mu)->name)) != NULL)
+	{
+		slog(LG_REGISTER, "HELP:REQUEST:EXPIRE: \2%s\2 \2%s\2", l->nick, l->topic);
+
+		ticket_delete(l);
+	}
 }
 
 // REQUEST <topic>
@@ -111,7 +180,6 @@ static void
 helpserv_cmd_request(struct sourceinfo *si, int parc, char *parv[])
 {
 	const char *topic = parv[0];
-	mowgli_node_t *n;
 	struct help_ticket *l;
 
 	if (!topic)
@@ -134,33 +202,32 @@ helpserv_cmd_request(struct sourceinfo *si, int parc, char *parv[])
 	}
 
 	// search for it
-	MOWGLI_ITER_FOREACH(n, helpserv_reqlist.head)
+	if ((l = ticket_find(entity(si->smu)->name)) != NULL)
 	{
-		l = n->data;
-
-		if (!irccasecmp(l->nick, entity(si->smu)->name))
+		if (!strcmp(topic, l->topic))
 		{
-			if (!strcmp(topic, l->topic))
-			{
-				command_success_nodata(si, _("You have already requested help about \2%s\2."), topic);
-				return;
-			}
-			if (ratelimit_count > config_options.ratelimit_uses && !has_priv(si, PRIV_FLOOD))
-			{
-				command_fail(si, fault_toomany, _("The system is currently too busy to process your help request, please try again later."));
-				slog(LG_INFO, "HELP:REQUEST:THROTTLED: %s", si->su->nick);
-				return;
-			}
-			sfree(l->topic);
-			l->topic = sstrdup(topic);
-			l->ticket_ts = CURRTIME;;
-
-			command_success_nodata(si, _("You have requested help about \2%s\2."), topic);
-			logcommand(si, CMDLOG_REQUEST, "REQUEST: \2%s\2", topic);
-			if (config_options.ratelimit_uses && config_options.ratelimit_period)
-				ratelimit_count++;
+			command_success_nodata(si, _("You have already requested help about \2%s\2."), topic);
 			return;
 		}
+		if (ratelimit_count > config_options.ratelimit_uses && !has_priv(si, PRIV_FLOOD))
+		{
+			command_fail(si, fault_toomany, _("The system is currently too busy to process your help request, please try again later."));
+			slog(LG_INFO, "HELP:REQUEST:THROTTLED: %s", si->su->nick);
+			return;
+		}
+		sfree(l->topic);
+		l->topic = sstrdup(topic);
+		l->ticket_ts = CURRTIME;
+
+		// it is the newest now
+		mowgli_node_delete(&l->node, &helpserv_reqlist);
+		mowgli_node_add(l, &l->node, &helpserv_reqlist);
+
+		command_success_nodata(si, _("You have requested help about \2%s\2."), topic);
+		logcommand(si, CMDLOG_REQUEST, "REQUEST: \2%s\2", topic);
+		if (config_options.ratelimit_uses && config_options.ratelimit_period)
+			ratelimit_count++;
+		return;
 	}
 
 	if (ratelimit_count > config_options.ratelimit_uses && !has_priv(si, PRIV_FLOOD))
@@ -169,14 +236,8 @@ helpserv_cmd_request(struct sourceinfo *si, int parc, char *parv[])
 		slog(LG_INFO, "HELP:REQUEST:THROTTLED: %s", si->su->nick);
 		return;
 	}
-	l = smalloc(sizeof *l);
-	l->nick = strshare_ref(entity(si->smu)->name);
-	l->ticket_ts = CURRTIME;;
-	l->creator = sstrdup(get_source_name(si));
-	l->topic = sstrdup(topic);
 
-	n = mowgli_node_create();
-	mowgli_node_add(l, n, &helpserv_reqlist);
+	(void) ticket_add(entity(si->smu)->name, CURRTIME, get_source_name(si), topic);
 
 	command_success_nodata(si, _("You have requested help about \2%s\2."), topic);
 	logcommand(si, CMDLOG_REQUEST, "REQUEST: \2%s\2", topic);
@@ -192,7 +253,6 @@ helpserv_cmd_close(struct sourceinfo *si, int parc, char *parv[])
 	char *nick = parv[0];
 	struct user *u;
 	struct help_ticket *l;
-	mowgli_node_t *n;
 
 	if (!nick)
 	{
@@ -201,73 +261,89 @@ helpserv_cmd_close(struct sourceinfo *si, int parc, char *parv[])
 		return;
 	}
 
-	MOWGLI_ITER_FOREACH(n, helpserv_reqlist.head)
+	if ((l = ticket_find(nick)) == NULL)
 	{
-		l = n->data;
-		if (!irccasecmp(l->nick, nick))
-		{
-			if ((u = user_find_named(nick)) != NULL)
-			{
-				if (parv[1] != NULL)
-					notice(si->service->nick, u->nick, "[auto notice] Your help request has been closed: %s", parv[1]);
-				else
-					notice(si->service->nick, u->nick, "[auto notice] Your help request has been closed.");
-			}
-			else
-			{
-				struct service *svs;
-				char buf[BUFSIZE];
-
-				if ((svs = service_find("memoserv")) != NULL && myuser_find(parv[0]) != NULL)
-				{
-					if (parv[1] != NULL)
-						snprintf(buf, BUFSIZE, "%s [auto memo] Your help request has been closed: %s", parv[0], parv[1]);
-					else
-						snprintf(buf, BUFSIZE, "%s [auto memo] Your help request has been closed.", parv[0]);
+		command_success_nodata(si, _("Nick \2%s\2 not found in help request database."), nick);
+		return;
+	}
 
-					command_exec_split(svs, si, "SEND", buf, svs->commands);
-				}
-			}
+	if ((u = user_find_named(nick)) != NULL)
+	{
+		if (parv[1] != NULL)
+			notice(si->service->nick, u->nick, "[auto notice] Your help request has been closed: %s", parv[1]);
+		else
+			notice(si->service->nick, u->nick, "[auto notice] Your help request has been closed.");
+	}
+	else
+	{
+		struct service *svs;
+		char buf[BUFSIZE];
 
+		if ((svs = service_find("memoserv")) != NULL && myuser_find(parv[0]) != NULL)
+		{
 			if (parv[1] != NULL)
-				logcommand(si, CMDLOG_REQUEST, "CLOSE: Help for \2%s\2 about \2%s\2 (\2%s\2)", nick, l->topic, parv[1]);
+				snprintf(buf, BUFSIZE, "%s [auto memo] Your help request has been closed: %s", parv[0], parv[1]);
 			else
-				logcommand(si, CMDLOG_REQUEST, "CLOSE: Help for \2%s\2 about \2%s\2", nick, l->topic);
-
-			mowgli_node_delete(n, &helpserv_reqlist);
+				snprintf(buf, BUFSIZE, "%s [auto memo] Your help request has been closed.", parv[0]);
 
-			strshare_unref(l->nick);
-			sfree(l->creator);
-			sfree(l->topic);
-			sfree(l);
-
-			return;
+			command_exec_split(svs, si, "SEND", buf, svs->commands);
 		}
 	}
 
-	command_success_nodata(si, _("Nick \2%s\2 not found in help request database."), nick);
+	if (parv[1] != NULL)
+		logcommand(si, CMDLOG_REQUEST, "CLOSE: Help for \2%s\2 about \2%s\2 (\2%s\2)", nick, l->topic, parv[1]);
+	else
+		logcommand(si, CMDLOG_REQUEST, "CLOSE: Help for \2%s\2 about \2%s\2", nick, l->topic);
+
+	ticket_delete(l);
 }
 
-// LIST
+// LIST [page]
 static void
 helpserv_cmd_list(struct sourceinfo *si, int parc, char *parv[])
 {
 	struct help_ticket *l;
 	mowgli_node_t *n;
 	unsigned int x = 0;
+	unsigned int page = 0;
 	char buf[BUFSIZE];
 	struct tm *tm;
 
+	if (parv[0] != NULL && (!string_to_uint(parv[0], &page) || page == 0))
+	{
+		command_fail(si, fault_badparams, STR_INVALID_PARAMS, "LIST");
+		command_fail(si, fault_badparams, _("Syntax: LIST [page]"));
+		return;
+	}
+
 	MOWGLI_ITER_FOREACH(n, helpserv_reqlist.head)
 	{
 		l = n->data;
 		x++;
 
+		if (page != 0 && (x - 1) / TICKET_LIST_PAGE != page - 1)
+		{
+			if ((x - 1) / TICKET_LIST_PAGE >= page)
+				break;
+
+			continue;
+		}
+
 		tm = localtime(&l->ticket_ts);
 		strftime(buf, BUFSIZE, TIME_FORMAT, tm);
 		command_success_nodata(si, _("#%u Nick: \2%s\2, Topic: \2%s\2 (%s - %s)"),
 			x, l->nick, l->topic, l->creator, buf);
 	}
+
+	if (page != 0)
+	{
+		command_success_nodata(si, _("End of page \2%u\2 of \2%zu\2 (\2%zu\2 requests)."), page,
+		                       (MOWGLI_LIST_LENGTH(&helpserv_reqlist) + TICKET_LIST_PAGE - 1) / TICKET_LIST_PAGE,
+		                       MOWGLI_LIST_LENGTH(&helpserv_reqlist));
+		logcommand(si, CMDLOG_GET, "LIST: page \2%u\2", page);
+		return;
+	}
+
 	command_success_nodata(si, _("End of list."));
 	logcommand(si, CMDLOG_GET, "LIST");
 }
@@ -276,29 +352,18 @@ helpserv_cmd_list(struct sourceinfo *si, int parc, char *parv[])
 static void
 helpserv_cmd_cancel(struct sourceinfo *si, int parc, char *parv[])
 {
-        struct help_ticket *l;
-        mowgli_node_t *n;
-
-        MOWGLI_ITER_FOREACH(n, helpserv_reqlist.head)
-        {
-                l = n->data;
-
-                if (!irccasecmp(l->nick, entity(si->smu)->name))
-                {
-                        mowgli_node_delete(n, &helpserv_reqlist);
+	struct help_ticket *l;
 
-                        strshare_unref(l->nick);
-                        sfree(l->creator);
-                        sfree(l->topic);
-                        sfree(l);
+	if ((l = ticket_find(entity(si->smu)->name)) == NULL)
+	{
+		command_fail(si, fault_badparams, _("You do not have a help request to cancel."));
+		return;
+	}
 
-                        command_success_nodata(si, _("Your help request has been cancelled."));
+	ticket_delete(l);
 
-                        logcommand(si, CMDLOG_REQUEST, "CANCEL");
-                        return;
-                }
-        }
-        command_fail(si, fault_badparams, _("You do not have a help request to cancel."));
+	command_success_nodata(si, _("Your help request has been cancelled."));
+	logcommand(si, CMDLOG_REQUEST, "CANCEL");
 }
 
 static struct command helpserv_request = {
@@ -349,6 +414,15 @@ mod_init(struct module *const restrict m)
 
 	MODULE_TRY_REQUEST_DEPENDENCY(m, "helpserv/main")
 
+	struct service *const helpsvs = service_find("helpserv");
+
+	helpserv_reqs_by_account = mowgli_patricia_create(&irccasecanon);
+
+	if (helpsvs != NULL)
+		add_duration_conf_item("TICKET_EXPIRE", &helpsvs->conf_table, 0, &ticket_expire, "d", 0);
+
+	ticket_expire_timer = timer_add("helpserv_ticket_expire", &ticket_expire_cb, NULL, SECONDS_PER_HOUR);
+
 	hook_add_user_drop(account_drop_request);
 	hook_add_myuser_delete(account_delete_request);
 	hook_add_db_write(write_ticket_db);
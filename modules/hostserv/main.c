@@ -14,12 +14,16 @@
 static struct service *hostsvs = NULL;
 
 static void
-on_user_identify(struct user *u)
+hostserv_apply_vhost(struct user *u)
 {
 	struct myuser *mu = u->myuser;
 	struct metadata *md;
 	char buf[NICKLEN + 20];
 
+	// logged out again before the end of the burst
+	if (mu == NULL)
+		return;
+
 	snprintf(buf, sizeof buf, "private:usercloak:%s", u->nick);
 	md = metadata_find(mu, buf);
 	if (md == NULL)
@@ -30,6 +34,20 @@ on_user_identify(struct user *u)
 	do_sethost(u, md->value);
 }
 
+/* Users identified by a bursting server get their vhost once it has
+ * finished, as the nick and account they have by then; those who quit
+ * first are dropped, and do_sethost() skips anyone whose host is right
+ * already, so a relink does not resend every vhost on the network.
+ */
+static void
+on_user_identify(struct user *u)
+{
+	if (burst_defer_user(u, &hostserv_apply_vhost))
+		return;
+
+	hostserv_apply_vhost(u);
+}
+
 static void
 mod_init(struct module *const restrict m)
 {
@@ -48,6 +66,7 @@ static void
 mod_deinit(const enum module_unload_intent ATHEME_VATTR_UNUSED intent)
 {
 	(void) hook_del_user_identify(&on_user_identify);
+	burst_cancel_user_fn(&hostserv_apply_vhost);
 
 	(void) service_delete(hostsvs);
 }
@@ -12,16 +12,93 @@
 #include "hostserv.h"
 #include "../groupserv/groupserv.h"
 
+#define HS_OFFERLIST_PAGE 50U
+
 struct hsoffered
 {
 	char *vhost;
 	time_t vhost_ts;
 	stringref creator;
 	struct myentity *group;
-	mowgli_node_t node;
+	mowgli_node_t node;     // in hs_offeredlist
+	mowgli_node_t vnode;    // in its hs_offervhost
+	mowgli_node_t gnode;    // in its group's "hostserv:offers" list
+};
+
+// the offers of one vhost, to anyone and to groups
+struct hs_offervhost
+{
+	char *vhost;
+	mowgli_list_t offers;
 };
 
 static mowgli_list_t hs_offeredlist;
+static mowgli_patricia_t *hs_offers_by_vhost = NULL;    // struct hs_offervhost
+
+// Where a group's list of offers is kept
+static unsigned int hs_offers_slot;
+
+static void
+hs_offer_link(struct hsoffered *const restrict l)
+{
+	struct hs_offervhost *ov = mowgli_patricia_retrieve(hs_offers_by_vhost, l->vhost);
+
+	mowgli_node_add(l, &l->node, &hs_offeredlist);
+
+	if (ov == NULL)
+	{
+		ov = smalloc(sizeof *ov);
+		ov->vhost = sstrdup(l->vhost);
+		mowgli_patricia_add(hs_offers_by_vhost, ov->vhost, ov);
+	}
+
+	mowgli_node_add(l, &l->vnode, &ov->offers);
+
+	if (l->group != NULL)
+	{
+		mowgli_list_t *gl = privatedata_slot_get(l->group, hs_offers_slot);
+
+		if (gl == NULL)
+		{
+			gl = mowgli_list_create();
+			privatedata_slot_set(l->group, hs_offers_slot, gl);
+		}
+
+		mowgli_node_add(l, &l->gnode, gl);
+	}
+}
+
+static void
+hs_offer_free(struct hsoffered *const restrict l)
+{
+	struct hs_offervhost *const ov = mowgli_patricia_retrieve(hs_offers_by_vhost, l->vhost);
+
+	mowgli_node_delete(&l->node, &hs_offeredlist);
+
+	if (ov != NULL)
+	{
+		mowgli_node_delete(&l->vnode, &ov->offers);
+
+		if (MOWGLI_LIST_LENGTH(&ov->offers) == 0)
+		{
+			(void) mowgli_patricia_delete(hs_offers_by_vhost, ov->vhost);
+			sfree(ov->vhost);
+			sfree(ov);
+		}
+	}
+
+	if (l->group != NULL)
+	{
+		mowgli_list_t *const gl = privatedata_slot_get(l->group, hs_offers_slot);
+
+		if (gl != NULL)
+			mowgli_node_delete(&l->gnode, gl);
+	}
+
+	strshare_unref(l->creator);
+	sfree(l->vhost);
+	sfree(l);
+}
 
 static void
 write_hsofferdb(struct database_handle *db)
@@ -69,20 +146,24 @@ db_h_ho(struct database_handle *db, const char *type)
 	l->vhost_ts = vhost_ts;
 	l->creator = strshare_get(creator);
 
-	mowgli_node_add(l, &l->node, &hs_offeredlist);
+	hs_offer_link(l);
 }
 
 static inline struct hsoffered *
 hs_offer_find(const char *host, struct myentity *mt)
 {
+	const struct hs_offervhost *const ov = mowgli_patricia_retrieve(hs_offers_by_vhost, host);
 	mowgli_node_t *n;
 	struct hsoffered *l;
 
-	MOWGLI_ITER_FOREACH(n, hs_offeredlist.head)
+	if (ov == NULL)
+		return NULL;
+
+	MOWGLI_ITER_FOREACH(n, ov->offers.head)
 	{
 		l = n->data;
 
-		if (!irccasecmp(l->vhost, host) && (l->group == mt || mt == NULL))
+		if (l->group == mt || mt == NULL)
 			return l;
 	}
 
@@ -95,24 +176,24 @@ remove_group_offered_hosts(struct mygroup *mg)
 	return_if_fail(mg != NULL);
 
 	struct myentity *mt = entity(mg);
+	mowgli_list_t *const gl = privatedata_slot_get(mt, hs_offers_slot);
 	mowgli_node_t *n, *tn;
 	struct hsoffered *l;
 
-	MOWGLI_ITER_FOREACH_SAFE(n, tn, hs_offeredlist.head)
+	if (gl == NULL)
+		return;
+
+	MOWGLI_ITER_FOREACH_SAFE(n, tn, gl->head)
 	{
 		l = n->data;
 
-		if (l->group != NULL && l->group == mt)
-		{
-			slog(LG_VERBOSE, "remove_group_offered_hosts(): removing %s (group %s)", l->vhost, l->group->name);
+		slog(LG_VERBOSE, "remove_group_offered_hosts(): removing %s (group %s)", l->vhost, l->group->name);
 
-			mowgli_node_delete(n, &hs_offeredlist);
-
-			strshare_unref(l->creator);
-			sfree(l->vhost);
-			sfree(l);
-		}
+		hs_offer_free(l);
 	}
+
+	privatedata_slot_set(mt, hs_offers_slot, NULL);
+	mowgli_list_free(gl);
 }
 
 // OFFER <host>
@@ -175,7 +256,7 @@ hs_cmd_offer(struct sourceinfo *si, int parc, char *parv[])
 	l->vhost_ts = CURRTIME;;
 	l->creator = strshare_ref(entity(si->smu)->name);
 
-	mowgli_node_add(l, &l->node, &hs_offeredlist);
+	hs_offer_link(l);
 
 	if (mt != NULL)
 	{
@@ -217,11 +298,7 @@ hs_cmd_unoffer(struct sourceinfo *si, int parc, char *parv[])
 
 	while (l != NULL)
 	{
-		mowgli_node_delete(&l->node, &hs_offeredlist);
-
-		strshare_unref(l->creator);
-		sfree(l->vhost);
-		sfree(l);
+		hs_offer_free(l);
 
 		l = hs_offer_find(host, NULL);
 	}
@@ -257,6 +334,7 @@ static void
 hs_cmd_take(struct sourceinfo *si, int parc, char *parv[])
 {
 	char *host = parv[0];
+	const struct hs_offervhost *ov;
 	struct hsoffered *l;
 	mowgli_node_t *n;
 	struct metadata *md;
@@ -291,35 +369,38 @@ hs_cmd_take(struct sourceinfo *si, int parc, char *parv[])
 		return;
 	}
 
-	MOWGLI_ITER_FOREACH(n, hs_offeredlist.head)
+	if ((ov = mowgli_patricia_retrieve(hs_offers_by_vhost, host)) == NULL)
+	{
+		command_success_nodata(si, _("vhost \2%s\2 not found in vhost offer database."), host);
+		return;
+	}
+
+	MOWGLI_ITER_FOREACH(n, ov->offers.head)
 	{
 		l = n->data;
 
 		if (l->group != NULL && !myuser_is_in_group(si->smu, l->group))
 			continue;
 
-		if (!irccasecmp(l->vhost, host))
-		{
-			if (strstr(host, "$account"))
-				replace(host, BUFSIZE, "$account", entity(si->smu)->name);
+		if (strstr(host, "$account"))
+			replace(host, BUFSIZE, "$account", entity(si->smu)->name);
 
-			if (!check_vhost_validity(si, host))
-				return;
+		if (!check_vhost_validity(si, host))
+			return;
 
-			logcommand(si, CMDLOG_GET, "TAKE: \2%s\2 for \2%s\2", host, entity(si->smu)->name);
+		logcommand(si, CMDLOG_GET, "TAKE: \2%s\2 for \2%s\2", host, entity(si->smu)->name);
 
-			command_success_nodata(si, _("You have taken vhost \2%s\2."), host);
-			hs_sethost_all(si->smu, host, get_source_name(si));
-			do_sethost_all(si->smu, host);
+		command_success_nodata(si, _("You have taken vhost \2%s\2."), host);
+		hs_sethost_all(si->smu, host, get_source_name(si));
+		do_sethost_all(si->smu, host);
 
-			return;
-		}
+		return;
 	}
 
 	command_success_nodata(si, _("vhost \2%s\2 not found in vhost offer database."), host);
 }
 
-// OFFERLIST
+// OFFERLIST [page]
 static void
 hs_cmd_offerlist(struct sourceinfo *si, int parc, char *parv[])
 {
@@ -327,6 +408,17 @@ hs_cmd_offerlist(struct sourceinfo *si, int parc, char *parv[])
 	mowgli_node_t *n;
 	char buf[BUFSIZE];
 	struct tm *tm;
+	unsigned int page = 0;
+	size_t skip, shown = 0;
+
+	if (parv[0] != NULL && (!string_to_uint(parv[0], &page) || page == 0))
+	{
+		command_fail(si, fault_badparams, STR_INVALID_PARAMS, "OFFERLIST");
+		command_fail(si, fault_badparams, _("Syntax: OFFERLIST [page]"));
+		return;
+	}
+
+	skip = (page != 0) ? ((size_t) (page - 1) * HS_OFFERLIST_PAGE) : 0;
 
 	MOWGLI_ITER_FOREACH(n, hs_offeredlist.head)
 	{
@@ -335,6 +427,14 @@ hs_cmd_offerlist(struct sourceinfo *si, int parc, char *parv[])
 		if (l->group != NULL && !myuser_is_in_group(si->smu, l->group) && !has_priv(si, PRIV_GROUP_ADMIN))
 			continue;
 
+		if (skip != 0)
+		{
+			skip--;
+			continue;
+		}
+		if (page != 0 && shown++ == HS_OFFERLIST_PAGE)
+			break;
+
 		tm = localtime(&l->vhost_ts);
 		strftime(buf, BUFSIZE, TIME_FORMAT, tm);
 
@@ -345,6 +445,13 @@ hs_cmd_offerlist(struct sourceinfo *si, int parc, char *parv[])
 			command_success_nodata(si, _("vHost: \2%s\2, Creator: \2%s\2 (%s)"),
 						l->vhost, l->creator, buf);
 	}
+	if (page != 0)
+	{
+		command_success_nodata(si, _("End of page \2%u\2."), page);
+		logcommand(si, CMDLOG_GET, "OFFERLIST: page \2%u\2", page);
+		return;
+	}
+
 	command_success_nodata(si, _("End of list."));
 	logcommand(si, CMDLOG_GET, "OFFERLIST");
 }
@@ -397,6 +504,9 @@ mod_init(struct module *const restrict m)
 
 	MODULE_TRY_REQUEST_DEPENDENCY(m, "hostserv/main")
 
+	hs_offers_by_vhost = mowgli_patricia_create(&irccasecanon);
+	hs_offers_slot = privatedata_slot_register("hostserv:offers");
+
 	hook_add_db_write(write_hsofferdb);
 	db_register_type_handler("HO", db_h_ho);
 
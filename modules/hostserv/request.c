@@ -11,12 +11,23 @@
 #include <atheme.h>
 #include "hostserv.h"
 
+#define HS_WAITING_PAGE 50U
+
 struct hsrequest
 {
 	char *nick;
 	char *vhost;
 	time_t vhost_ts;
 	char *creator;
+	mowgli_node_t node;     // in hs_reqlist, oldest first
+	mowgli_node_t vnode;    // in its hs_reqvhost
+};
+
+// the requests for one vhost
+struct hs_reqvhost
+{
+	char *vhost;
+	mowgli_list_t reqs;
 };
 
 static bool no_subsequent_requests;
@@ -27,6 +38,8 @@ static unsigned int ratelimit_count = 0;
 static time_t ratelimit_firsttime = 0;
 
 static mowgli_list_t hs_reqlist;
+static mowgli_patricia_t *hs_reqs_by_nick = NULL;       // struct hsrequest, by nick or account
+static mowgli_patricia_t *hs_reqs_by_vhost = NULL;      // struct hs_reqvhost
 static char *groupmemo;
 
 static void
@@ -36,7 +49,7 @@ write_hsreqdb(struct database_handle *db)
 
 	MOWGLI_ITER_FOREACH(n, hs_reqlist.head)
 	{
-		struct hsrequest *l = n->data;
+		const struct hsrequest *const l = n->data;
 
 		db_start_row(db, "HR");
 		db_write_word(db, l->nick);
@@ -47,90 +60,140 @@ write_hsreqdb(struct database_handle *db)
 	}
 }
 
+static struct hsrequest *
+request_find(const char *nick)
+{
+	return mowgli_patricia_retrieve(hs_reqs_by_nick, nick);
+}
+
 static void
-db_h_hr(struct database_handle *db, const char *type)
+request_vhost_link(struct hsrequest *const restrict l)
 {
-	const char *nick = db_sread_word(db);
-	const char *vhost = db_sread_word(db);
-	time_t vhost_ts = db_sread_time(db);
-	const char *creator = db_sread_word(db);
+	struct hs_reqvhost *rv = mowgli_patricia_retrieve(hs_reqs_by_vhost, l->vhost);
+
+	if (rv == NULL)
+	{
+		rv = smalloc(sizeof *rv);
+		rv->vhost = sstrdup(l->vhost);
+		mowgli_patricia_add(hs_reqs_by_vhost, rv->vhost, rv);
+	}
+
+	mowgli_node_add(l, &l->vnode, &rv->reqs);
+}
+
+static void
+request_vhost_unlink(struct hsrequest *const restrict l)
+{
+	struct hs_reqvhost *const rv = mowgli_patricia_retrieve(hs_reqs_by_vhost, l->vhost);
+
+	return_if_fail(rv != NULL);
+
+	mowgli_node_delete(&l->vnode, &rv->reqs);
 
+	if (MOWGLI_LIST_LENGTH(&rv->reqs) == 0)
+	{
+		(void) mowgli_patricia_delete(hs_reqs_by_vhost, rv->vhost);
+		sfree(rv->vhost);
+		sfree(rv);
+	}
+}
+
+static struct hsrequest *
+request_add(const char *nick, const char *vhost, time_t vhost_ts, const char *creator)
+{
 	struct hsrequest *const l = smalloc(sizeof *l);
+
 	l->nick = sstrdup(nick);
 	l->vhost = sstrdup(vhost);
 	l->vhost_ts = vhost_ts;
 	l->creator = sstrdup(creator);
-	mowgli_node_add(l, mowgli_node_create(), &hs_reqlist);
+
+	mowgli_node_add(l, &l->node, &hs_reqlist);
+	(void) mowgli_patricia_add(hs_reqs_by_nick, l->nick, l);
+	request_vhost_link(l);
+
+	return l;
 }
 
 static void
-remove_request_from_list(mowgli_node_t *const restrict n)
+request_set_vhost(struct hsrequest *const restrict l, const char *vhost)
 {
-	struct hsrequest *const l = n->data;
+	request_vhost_unlink(l);
+	sfree(l->vhost);
+	l->vhost = sstrdup(vhost);
+	l->vhost_ts = CURRTIME;
+	request_vhost_link(l);
+}
+
+static void
+db_h_hr(struct database_handle *db, const char *type)
+{
+	const char *nick = db_sread_word(db);
+	const char *vhost = db_sread_word(db);
+	time_t vhost_ts = db_sread_time(db);
+	const char *creator = db_sread_word(db);
+
+	struct hsrequest *const old = request_find(nick);
+
+	// the newest one wins, as it would have when it was made
+	if (old != NULL)
+	{
+		request_set_vhost(old, vhost);
+		old->vhost_ts = vhost_ts;
+	}
+	else
+		(void) request_add(nick, vhost, vhost_ts, creator);
+}
+
+static void
+remove_request_from_list(struct hsrequest *const restrict l)
+{
+	mowgli_node_delete(&l->node, &hs_reqlist);
+	(void) mowgli_patricia_delete(hs_reqs_by_nick, l->nick);
+	request_vhost_unlink(l);
 
 	sfree(l->nick);
 	sfree(l->vhost);
 	sfree(l->creator);
 	sfree(l);
-
-	mowgli_node_delete(n, &hs_reqlist);
-	mowgli_node_free(n);
 }
 
 static void
 nick_drop_request(struct hook_user_req *hdata)
 {
-	mowgli_node_t *n;
 	struct hsrequest *l;
 
-	MOWGLI_ITER_FOREACH(n, hs_reqlist.head)
+	if ((l = request_find(hdata->mn->nick)) != NULL)
 	{
-		l = n->data;
-		if (!irccasecmp(l->nick, hdata->mn->nick))
-		{
-			slog(LG_REGISTER, "VHOSTREQ:DROPNICK: \2%s\2 \2%s\2", l->nick, l->vhost);
+		slog(LG_REGISTER, "VHOSTREQ:DROPNICK: \2%s\2 \2%s\2", l->nick, l->vhost);
 
-			remove_request_from_list(n);
-			return;
-		}
+		remove_request_from_list(l);
 	}
 }
 
 static void
 account_drop_request(struct myuser *mu)
 {
-	mowgli_node_t *n;
 	struct hsrequest *l;
 
-	MOWGLI_ITER_FOREACH(n, hs_reqlist.head)
+	if ((l = request_find(entity(mu)->name)) != NULL)
 	{
-		l = n->data;
-		if (!irccasecmp(l->nick, entity(mu)->name))
-		{
-			slog(LG_REGISTER, "VHOSTREQ:DROPACCOUNT: \2%s\2 \2%s\2", l->nick, l->vhost);
+		slog(LG_REGISTER, "VHOSTREQ:DROPACCOUNT: \2%s\2 \2%s\2", l->nick, l->vhost);
 
-			remove_request_from_list(n);
-			return;
-		}
+		remove_request_from_list(l);
 	}
 }
 
 static void
 account_delete_request(struct myuser *mu)
 {
-	mowgli_node_t *n;
 	struct hsrequest *l;
 
-	MOWGLI_ITER_FOREACH(n, hs_reqlist.head)
+	if ((l = request_find(entity(mu)->name)) != NULL)
 	{
-		l = n->data;
-		if (!irccasecmp(l->nick, entity(mu)->name))
-		{
-			slog(LG_REGISTER, "VHOSTREQ:EXPIRE: \2%s\2 \2%s\2", l->nick, l->vhost);
+		slog(LG_REGISTER, "VHOSTREQ:EXPIRE: \2%s\2 \2%s\2", l->nick, l->vhost);
 
-			remove_request_from_list(n);
-			return;
-		}
+		remove_request_from_list(l);
 	}
 }
 
@@ -293,44 +356,37 @@ hs_cmd_request(struct sourceinfo *si, int parc, char *parv[])
 		return;
 
 	// search for it
-	MOWGLI_ITER_FOREACH(n, hs_reqlist.head)
+	if ((l = request_find(target)) != NULL)
 	{
-		l = n->data;
-
-		if (!irccasecmp(l->nick, target))
+		if (no_subsequent_requests)
 		{
-			if (no_subsequent_requests)
-			{
-				command_fail(si, fault_badparams, _("You already have an outstanding vhost request. "
-				                                    "Please wait for network staff to approve or "
-				                                    "reject it."));
-				return;
-			}
-			if (!strcmp(host, l->vhost))
-			{
-				command_success_nodata(si, _("You have already requested vhost \2%s\2."), host);
-				return;
-			}
-			if (ratelimit_count > config_options.ratelimit_uses && !has_priv(si, PRIV_FLOOD))
-			{
-				command_fail(si, fault_toomany, _("The system is currently too busy to process your vHost request, please try again later."));
-				slog(LG_INFO, "VHOSTREQUEST:THROTTLED: %s", si->su->nick);
-				return;
-			}
-			sfree(l->vhost);
-			l->vhost = sstrdup(host);
-			l->vhost_ts = CURRTIME;
+			command_fail(si, fault_badparams, _("You already have an outstanding vhost request. "
+			                                    "Please wait for network staff to approve or "
+			                                    "reject it."));
+			return;
+		}
+		if (!strcmp(host, l->vhost))
+		{
+			command_success_nodata(si, _("You have already requested vhost \2%s\2."), host);
+			return;
+		}
+		if (ratelimit_count > config_options.ratelimit_uses && !has_priv(si, PRIV_FLOOD))
+		{
+			command_fail(si, fault_toomany, _("The system is currently too busy to process your vHost request, please try again later."));
+			slog(LG_INFO, "VHOSTREQUEST:THROTTLED: %s", si->su->nick);
+			return;
+		}
+		request_set_vhost(l, host);
 
-			command_success_nodata(si, _("You have requested vhost \2%s\2."), host);
+		command_success_nodata(si, _("You have requested vhost \2%s\2."), host);
 
-			if (groupmemo != NULL)
-				send_group_memo(si, "[auto memo] Please review \2%s\2 for me!", host);
+		if (groupmemo != NULL)
+			send_group_memo(si, "[auto memo] Please review \2%s\2 for me!", host);
 
-			logcommand(si, CMDLOG_REQUEST, "REQUEST: \2%s\2", host);
-			if (config_options.ratelimit_uses && config_options.ratelimit_period)
-				ratelimit_count++;
-			return;
-		}
+		logcommand(si, CMDLOG_REQUEST, "REQUEST: \2%s\2", host);
+		if (config_options.ratelimit_uses && config_options.ratelimit_period)
+			ratelimit_count++;
+		return;
 	}
 
 	if (ratelimit_count > config_options.ratelimit_uses && !has_priv(si, PRIV_FLOOD))
@@ -340,14 +396,7 @@ hs_cmd_request(struct sourceinfo *si, int parc, char *parv[])
 		return;
 	}
 
-	l = smalloc(sizeof *l);
-	l->nick = sstrdup(target);
-	l->vhost = sstrdup(host);
-	l->vhost_ts = CURRTIME;;
-	l->creator = sstrdup(get_source_name(si));
-
-	n = mowgli_node_create();
-	mowgli_node_add(l, n, &hs_reqlist);
+	(void) request_add(target, host, CURRTIME, get_source_name(si));
 
 	command_success_nodata(si, _("You have requested vhost \2%s\2."), host);
 
@@ -360,13 +409,28 @@ hs_cmd_request(struct sourceinfo *si, int parc, char *parv[])
 	return;
 }
 
+static void
+hs_activate_one(struct sourceinfo *si, struct hsrequest *l)
+{
+	struct user *u;
+	char buf[BUFSIZE];
+
+	if ((u = user_find_named(l->nick)) != NULL)
+		notice(si->service->nick, u->nick, "[auto memo] Your requested vhost \2%s\2 for nick \2%s\2 has been approved.", l->vhost, l->nick);
+
+	// VHOSTNICK command below will generate snoop
+	logcommand(si, CMDLOG_REQUEST, "ACTIVATE: \2%s\2 for \2%s\2", l->vhost, l->nick);
+	snprintf(buf, BUFSIZE, "%s %s", l->nick, l->vhost);
+	remove_request_from_list(l);
+
+	command_exec_split(si->service, si, request_per_nick ? "VHOSTNICK" : "VHOST", buf, si->service->commands);
+}
+
 // ACTIVATE <nick>
 static void
 hs_cmd_activate(struct sourceinfo *si, int parc, char *parv[])
 {
 	char *nick = parv[0];
-	struct user *u;
-	char buf[BUFSIZE];
 	struct hsrequest *l;
 	mowgli_node_t *n, *tn;
 
@@ -377,43 +441,53 @@ hs_cmd_activate(struct sourceinfo *si, int parc, char *parv[])
 		return;
 	}
 
-	MOWGLI_ITER_FOREACH_SAFE(n, tn, hs_reqlist.head)
+	if (!irccasecmp("*", nick) && hs_reqlist.count != 0)
 	{
-		l = n->data;
-
-		if (!irccasecmp(l->nick, nick))
-		{
-			if ((u = user_find_named(nick)) != NULL)
-				notice(si->service->nick, u->nick, "[auto memo] Your requested vhost \2%s\2 for nick \2%s\2 has been approved.", l->vhost, nick);
+		MOWGLI_ITER_FOREACH_SAFE(n, tn, hs_reqlist.head)
+			hs_activate_one(si, n->data);
 
-			// VHOSTNICK command below will generate snoop
-			logcommand(si, CMDLOG_REQUEST, "ACTIVATE: \2%s\2 for \2%s\2", l->vhost, nick);
-			snprintf(buf, BUFSIZE, "%s %s", l->nick, l->vhost);
-			remove_request_from_list(n);
-
-			command_exec_split(si->service, si, request_per_nick ? "VHOSTNICK" : "VHOST", buf, si->service->commands);
-			return;
-		}
+		return;
+	}
 
-		if (!irccasecmp("*", nick))
-		{
-			if ((u = user_find_named(l->nick)) != NULL)
-				notice(si->service->nick, u->nick, "[auto memo] Your requested vhost \2%s\2 for nick \2%s\2 has been approved.", l->vhost, l->nick);
+	if ((l = request_find(nick)) != NULL)
+	{
+		hs_activate_one(si, l);
+		return;
+	}
 
-			// VHOSTNICK command below will generate snoop
-			logcommand(si, CMDLOG_REQUEST, "ACTIVATE: \2%s\2 for \2%s\2", l->vhost, l->nick);
-			snprintf(buf, BUFSIZE, "%s %s", l->nick, l->vhost);
-			remove_request_from_list(n);
+	command_success_nodata(si, _("Nick \2%s\2 not found in vhost request database."), nick);
+}
 
-			command_exec_split(si->service, si, request_per_nick ? "VHOSTNICK" : "VHOST", buf, si->service->commands);
+static void
+hs_reject_one(struct sourceinfo *si, struct hsrequest *l, const char *reason, bool silent)
+{
+	struct service *svs;
+	struct user *u;
+	char buf[BUFSIZE];
 
-			if (hs_reqlist.count == 0)
-				return;
-		}
+	if (! silent && (svs = service_find("memoserv")) != NULL)
+	{
+		if (reason)
+			snprintf(buf, BUFSIZE, "%s [auto memo] Your requested vhost \2%s\2 for nick \2%s\2 has been rejected due to: %s", l->nick, l->vhost, l->nick, reason);
+		else
+			snprintf(buf, BUFSIZE, "%s [auto memo] Your requested vhost \2%s\2 for nick \2%s\2 has been rejected.", l->nick, l->vhost, l->nick);
 
+		command_exec_split(svs, si, "SEND", buf, svs->commands);
+	}
+	else if (! silent && (u = user_find_named(l->nick)) != NULL)
+	{
+		if (reason)
+			notice(si->service->nick, u->nick, "[auto memo] Your requested vhost \2%s\2 for nick \2%s\2 has been rejected due to: %s", l->vhost, l->nick, reason);
+		else
+			notice(si->service->nick, u->nick, "[auto memo] Your requested vhost \2%s\2 for nick \2%s\2 has been rejected.", l->vhost, l->nick);
 	}
 
-	command_success_nodata(si, _("Nick \2%s\2 not found in vhost request database."), nick);
+	if (reason && ! silent)
+		logcommand(si, CMDLOG_REQUEST, "REJECT: \2%s\2 for \2%s\2, Reason: \2%s\2", l->vhost, l->nick, reason);
+	else
+		logcommand(si, CMDLOG_REQUEST, "REJECT: \2%s\2 for \2%s\2", l->vhost, l->nick);
+
+	remove_request_from_list(l);
 }
 
 // REJECT <nick>
@@ -422,8 +496,6 @@ hs_cmd_reject(struct sourceinfo *si, int parc, char *parv[])
 {
 	char *nick = parv[0];
 	char *reason = parv[1];
-	struct user *u;
-	char buf[BUFSIZE];
 	struct hsrequest *l;
 	mowgli_node_t *n, *tn;
 	bool silent = false;
@@ -444,91 +516,89 @@ hs_cmd_reject(struct sourceinfo *si, int parc, char *parv[])
 	if (reason && strcasecmp(reason, "SILENT") == 0)
 		silent = true;
 
-	MOWGLI_ITER_FOREACH_SAFE(n, tn, hs_reqlist.head)
+	if (!irccasecmp("*", nick) && hs_reqlist.count != 0)
 	{
-		struct service *svs;
-
-		l = n->data;
-		if (!irccasecmp(l->nick, nick))
-		{
-			if (! silent && (svs = service_find("memoserv")) != NULL)
-			{
-				if (reason)
-					snprintf(buf, BUFSIZE, "%s [auto memo] Your requested vhost \2%s\2 for nick \2%s\2 has been rejected due to: %s", nick, l->vhost, nick, reason);
-				else
-					snprintf(buf, BUFSIZE, "%s [auto memo] Your requested vhost \2%s\2 for nick \2%s\2 has been rejected.", nick, l->vhost, nick);
+		MOWGLI_ITER_FOREACH_SAFE(n, tn, hs_reqlist.head)
+			hs_reject_one(si, n->data, reason, silent);
 
-				command_exec_split(svs, si, "SEND", buf, svs->commands);
-			}
-			else if (! silent && (u = user_find_named(nick)) != NULL)
-			{
-				if (reason)
-					notice(si->service->nick, u->nick, "[auto memo] Your requested vhost \2%s\2 for nick \2%s\2 has been rejected due to: %s", l->vhost, nick, reason);
-				else
-					notice(si->service->nick, u->nick, "[auto memo] Your requested vhost \2%s\2 for nick \2%s\2 has been rejected.", l->vhost, nick);
-			}
+		return;
+	}
 
-			if (reason && ! silent)
-				logcommand(si, CMDLOG_REQUEST, "REJECT: \2%s\2 for \2%s\2, Reason: \2%s\2", l->vhost, nick, reason);
-			else
-				logcommand(si, CMDLOG_REQUEST, "REJECT: \2%s\2 for \2%s\2", l->vhost, nick);
+	if ((l = request_find(nick)) != NULL)
+	{
+		hs_reject_one(si, l, reason, silent);
+		return;
+	}
 
-			remove_request_from_list(n);
-			return;
-		}
+	command_success_nodata(si, _("Nick \2%s\2 not found in vhost request database."), nick);
+}
 
-		if (!irccasecmp("*", nick))
-		{
-			if (! silent && (svs = service_find("memoserv")) != NULL)
-			{
-				if (reason)
-					snprintf(buf, BUFSIZE, "%s [auto memo] Your requested vhost \2%s\2 for nick \2%s\2 has been rejected due to: %s", nick, l->vhost, nick, reason);
-				else
-					snprintf(buf, BUFSIZE, "%s [auto memo] Your requested vhost \2%s\2 for nick \2%s\2 has been rejected.", nick, l->vhost, nick);
+static void
+hs_waiting_show(struct sourceinfo *si, const struct hsrequest *l)
+{
+	char buf[BUFSIZE];
+	struct tm *tm;
 
-				command_exec_split(svs, si, "SEND", buf, svs->commands);
-			}
-			else if (! silent && (u = user_find_named(l->nick)) != NULL)
-			{
-				if (reason)
-					notice(si->service->nick, u->nick, "[auto memo] Your requested vhost \2%s\2 for nick \2%s\2 has been rejected due to: %s", l->vhost, nick, reason);
-				else
-					notice(si->service->nick, u->nick, "[auto memo] Your requested vhost \2%s\2 for nick \2%s\2 has been rejected.", l->vhost, nick);
-			}
+	tm = localtime(&l->vhost_ts);
+	strftime(buf, BUFSIZE, TIME_FORMAT, tm);
+	command_success_nodata(si, _("Nick: \2%s\2, vHost: \2%s\2 (%s - %s)"),
+		l->nick, l->vhost, l->creator, buf);
+}
 
-			if (reason && ! silent)
-				logcommand(si, CMDLOG_REQUEST, "REJECT: \2%s\2 for \2%s\2, Reason: \2%s\2", l->vhost, l->nick, reason);
-			else
-				logcommand(si, CMDLOG_REQUEST, "REJECT: \2%s\2 for \2%s\2", l->vhost, l->nick);
+// WAITING [page|vhost]
+static void
+hs_cmd_waiting(struct sourceinfo *si, int parc, char *parv[])
+{
+	const char *arg = parv[0];
+	mowgli_node_t *n;
+	unsigned int page = 0;
+	size_t skip, shown = 0;
 
-			remove_request_from_list(n);
+	if (arg != NULL && !string_to_uint(arg, &page))
+	{
+		const struct hs_reqvhost *const rv = mowgli_patricia_retrieve(hs_reqs_by_vhost, arg);
 
-			if (hs_reqlist.count == 0)
-				return;
+		if (rv != NULL)
+		{
+			MOWGLI_ITER_FOREACH(n, rv->reqs.head)
+				hs_waiting_show(si, n->data);
 		}
+
+		command_success_nodata(si, _("End of list."));
+		logcommand(si, CMDLOG_GET, "WAITING: \2%s\2", arg);
+		return;
 	}
 
-	command_success_nodata(si, _("Nick \2%s\2 not found in vhost request database."), nick);
-}
+	if (arg != NULL && page == 0)
+	{
+		command_fail(si, fault_badparams, STR_INVALID_PARAMS, "WAITING");
+		command_fail(si, fault_badparams, _("Syntax: WAITING [page|vhost]"));
+		return;
+	}
 
-// WAITING
-static void
-hs_cmd_waiting(struct sourceinfo *si, int parc, char *parv[])
-{
-	struct hsrequest *l;
-	mowgli_node_t *n;
-	char buf[BUFSIZE];
-	struct tm *tm;
+	skip = (page != 0) ? ((size_t) (page - 1) * HS_WAITING_PAGE) : 0;
 
 	MOWGLI_ITER_FOREACH(n, hs_reqlist.head)
 	{
-		l = n->data;
+		if (skip != 0)
+		{
+			skip--;
+			continue;
+		}
+		if (page != 0 && shown++ == HS_WAITING_PAGE)
+			break;
 
-		tm = localtime(&l->vhost_ts);
-		strftime(buf, BUFSIZE, TIME_FORMAT, tm);
-		command_success_nodata(si, _("Nick: \2%s\2, vHost: \2%s\2 (%s - %s)"),
-			l->nick, l->vhost, l->creator, buf);
+		hs_waiting_show(si, n->data);
 	}
+
+	if (page != 0)
+	{
+		command_success_nodata(si, _("End of page \2%u\2 of \2%zu\2 (\2%zu\2 requests)."), page,
+		                       (hs_reqlist.count + HS_WAITING_PAGE - 1) / HS_WAITING_PAGE, hs_reqlist.count);
+		logcommand(si, CMDLOG_GET, "WAITING: page \2%u\2", page);
+		return;
+	}
+
 	command_success_nodata(si, _("End of list."));
 	logcommand(si, CMDLOG_GET, "WAITING");
 }
@@ -583,6 +653,9 @@ mod_init(struct module *const restrict m)
 
 	hostsvs = service_find("hostserv");
 
+	hs_reqs_by_nick = mowgli_patricia_create(&irccasecanon);
+	hs_reqs_by_vhost = mowgli_patricia_create(&strcasecanon);
+
 	hook_add_user_drop(account_drop_request);
 	hook_add_nick_ungroup(nick_drop_request);
 	hook_add_myuser_delete(account_delete_request);
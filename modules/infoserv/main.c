@@ -31,9 +31,20 @@ struct operlogoninfo
         char *story;
 };
 
+// The lines display_info() and display_oper_info() send, rendered once
+struct logoninfo_cache
+{
+	bool valid;
+	unsigned int count;
+	char **lines;
+};
+
 static mowgli_list_t logon_info;
 static mowgli_list_t operlogon_info;
 
+static struct logoninfo_cache logon_cache;
+static struct logoninfo_cache operlogon_cache;
+
 static unsigned int logoninfo_count = 0;
 
 static struct service *infoserv = NULL;
@@ -65,6 +76,27 @@ underscores_to_spaces(char *y)
 	} while(*y++);
 }
 
+static void
+logoninfo_cache_clear(struct logoninfo_cache *cache)
+{
+	unsigned int i;
+
+	for (i = 0; i < cache->count; i++)
+		sfree(cache->lines[i]);
+
+	sfree(cache->lines);
+	cache->lines = NULL;
+	cache->count = 0;
+	cache->valid = false;
+}
+
+static void
+logoninfo_cache_add(struct logoninfo_cache *cache, const char *line)
+{
+	cache->lines = sreallocarray(cache->lines, cache->count + 1, sizeof *cache->lines);
+	cache->lines[cache->count++] = sstrdup(line);
+}
+
 static void
 write_infodb(struct database_handle *db)
 {
@@ -110,6 +142,7 @@ db_h_li(struct database_handle *db, const char *type)
 	l->info_ts = info_ts;
 	l->story = sstrdup(story);
 	mowgli_node_add(l, mowgli_node_create(), &logon_info);
+	logoninfo_cache_clear(&logon_cache);
 }
 
 static void
@@ -126,18 +159,125 @@ db_h_lio(struct database_handle *db, const char *type)
 	o->info_ts = info_ts;
 	o->story = sstrdup(story);
 	mowgli_node_add(o, mowgli_node_create(), &operlogon_info);
+	logoninfo_cache_clear(&operlogon_cache);
 }
 
 static void
-display_info(struct hook_user_nick *data)
+logoninfo_cache_add_post(struct logoninfo_cache *cache, const char *nick, const char *subject, time_t info_ts,
+                         const char *story)
+{
+	char buf[BUFSIZE];
+	char dBuf[32];
+	struct tm *tm;
+
+	// what is left of the line for the subject, with the longest nick and date
+	const int subjectmax = (int) (sizeof buf - NICKLEN - sizeof dBuf - 32U);
+
+	char *y = sstrdup(subject);
+	underscores_to_spaces(y);
+
+	tm = localtime(&info_ts);
+	strftime(dBuf, sizeof dBuf, "%H:%M on %m/%d/%Y", tm);
+	snprintf(buf, sizeof buf, "[\2%.*s\2] Notice from %.*s, posted %s:", subjectmax, y, (int) NICKLEN, nick, dBuf);
+	logoninfo_cache_add(cache, buf);
+	logoninfo_cache_add(cache, story);
+	sfree(y);
+}
+
+static const struct logoninfo_cache *
+logon_cache_get(void)
 {
-	struct user *u;
 	mowgli_node_t *n;
 	struct logoninfo *l;
-	char dBuf[BUFSIZE];
-	struct tm *tm;
 	unsigned int count = 0;
 
+	if (logon_cache.valid)
+		return &logon_cache;
+
+	logon_cache.valid = true;
+
+	if (logon_info.count == 0)
+		return &logon_cache;
+
+	logoninfo_cache_add(&logon_cache, "*** \2Message(s) of the Day\2 ***");
+
+	MOWGLI_ITER_FOREACH_PREV(n, logon_info.tail)
+	{
+		l = n->data;
+
+		logoninfo_cache_add_post(&logon_cache, l->nick, l->subject, l->info_ts, l->story);
+		count++;
+
+		// only display three latest entries, max.
+		if (count == logoninfo_count)
+			break;
+	}
+
+	logoninfo_cache_add(&logon_cache, "*** \2End of Message(s) of the Day\2 ***");
+
+	return &logon_cache;
+}
+
+static const struct logoninfo_cache *
+operlogon_cache_get(void)
+{
+	mowgli_node_t *n;
+	struct operlogoninfo *o;
+	unsigned int count = 0;
+
+	if (operlogon_cache.valid)
+		return &operlogon_cache;
+
+	operlogon_cache.valid = true;
+
+	if (operlogon_info.count == 0)
+		return &operlogon_cache;
+
+	logoninfo_cache_add(&operlogon_cache, "*** \2Oper Message(s) of the Day\2 ***");
+
+	MOWGLI_ITER_FOREACH_PREV(n, operlogon_info.tail)
+	{
+		o = n->data;
+
+		logoninfo_cache_add_post(&operlogon_cache, o->nick, o->subject, o->info_ts, o->story);
+		count++;
+
+		// only display three latest entries, max.
+		if (count == logoninfo_count)
+			break;
+	}
+
+	logoninfo_cache_add(&operlogon_cache, "*** \2End of Oper Message(s) of the Day\2 ***");
+
+	return &operlogon_cache;
+}
+
+/* The lines are already formatted, so they go straight to the protocol
+ * module instead of through notice(), which would format each of them
+ * again and look both clients up by name.
+ */
+static void
+logoninfo_cache_send(const struct logoninfo_cache *cache, struct user *u)
+{
+	unsigned int i;
+
+	if (u->myuser != NULL && u->myuser->flags & MU_USE_PRIVMSG)
+	{
+		for (i = 0; i < cache->count; i++)
+			msg(infoserv->nick, u->nick, "%s", cache->lines[i]);
+
+		return;
+	}
+
+	for (i = 0; i < cache->count; i++)
+		notice_user_sts(infoserv->me, u, cache->lines[i]);
+}
+
+static void
+display_info(struct hook_user_nick *data)
+{
+	struct user *u;
+
 	u = data->u;
 	if (u == NULL)
 		return;
@@ -149,43 +289,12 @@ display_info(struct hook_user_nick *data)
 	if (!(u->server->flags & SF_EOB))
 		return;
 
-	if (logon_info.count > 0)
-	{
-		notice(infoserv->nick, u->nick, "*** \2Message(s) of the Day\2 ***");
-
-		MOWGLI_ITER_FOREACH_PREV(n, logon_info.tail)
-		{
-			l = n->data;
-
-			char *y = sstrdup(l->subject);
-			underscores_to_spaces(y);
-
-			tm = localtime(&l->info_ts);
-			strftime(dBuf, BUFSIZE, "%H:%M on %m/%d/%Y", tm);
-			notice(infoserv->nick, u->nick, "[\2%s\2] Notice from %s, posted %s:",
-				y, l->nick, dBuf);
-			notice(infoserv->nick, u->nick, "%s", l->story);
-			sfree(y);
-			count++;
-
-			// only display three latest entries, max.
-			if (count == logoninfo_count)
-				break;
-		}
-
-		notice(infoserv->nick, u->nick, "*** \2End of Message(s) of the Day\2 ***");
-	}
+	logoninfo_cache_send(logon_cache_get(), u);
 }
 
 static void
 display_oper_info(struct user *u)
 {
-	mowgli_node_t *n;
-	struct operlogoninfo *o;
-	char dBuf[BUFSIZE];
-	struct tm *tm;
-	unsigned int count = 0;
-
 	if (u == NULL)
 		return;
 
@@ -196,32 +305,15 @@ display_oper_info(struct user *u)
 	if (!(u->server->flags & SF_EOB))
 		return;
 
-	if (operlogon_info.count > 0)
-	{
-		notice(infoserv->nick, u->nick, "*** \2Oper Message(s) of the Day\2 ***");
-
-		MOWGLI_ITER_FOREACH_PREV(n, operlogon_info.tail)
-		{
-			o = n->data;
-
-			char *y = sstrdup(o->subject);
-			underscores_to_spaces(y);
-
-			tm = localtime(&o->info_ts);
-			strftime(dBuf, BUFSIZE, "%H:%M on %m/%d/%Y", tm);
-			notice(infoserv->nick, u->nick, "[\2%s\2] Notice from %s, posted %s:",
-				y, o->nick, dBuf);
-			notice(infoserv->nick, u->nick, "%s", o->story);
-			sfree(y);
-			count++;
-
-			// only display three latest entries, max.
-			if (count == logoninfo_count)
-				break;
-		}
+	logoninfo_cache_send(operlogon_cache_get(), u);
+}
 
-		notice(infoserv->nick, u->nick, "*** \2End of Oper Message(s) of the Day\2 ***");
-	}
+// logoninfo_count may have changed
+static void
+logoninfo_config_ready(void *unused)
+{
+	logoninfo_cache_clear(&logon_cache);
+	logoninfo_cache_clear(&operlogon_cache);
 }
 
 static void
@@ -297,6 +389,7 @@ is_cmd_post(struct sourceinfo *si, int parc, char *parv[])
 
 		n = mowgli_node_create();
 		mowgli_node_add(o, n, &operlogon_info);
+		logoninfo_cache_clear(&operlogon_cache);
 	}
 
 	if (imp > 0)
@@ -309,6 +402,7 @@ is_cmd_post(struct sourceinfo *si, int parc, char *parv[])
 
 		n = mowgli_node_create();
 		mowgli_node_add(l, n, &logon_info);
+		logoninfo_cache_clear(&logon_cache);
 	}
 
 	command_success_nodata(si, _("Added entry to logon info"));
@@ -359,6 +453,7 @@ is_cmd_del(struct sourceinfo *si, int parc, char *parv[])
 			logcommand(si, CMDLOG_ADMIN, "INFO:DEL: \2%s\2, \2%s\2", l->subject, l->story);
 
 			mowgli_node_delete(n, &logon_info);
+			logoninfo_cache_clear(&logon_cache);
 
 			strshare_unref(l->nick);
 			sfree(l->subject);
@@ -408,6 +503,7 @@ is_cmd_odel(struct sourceinfo *si, int parc, char *parv[])
 			logcommand(si, CMDLOG_ADMIN, "INFO:ODEL: \2%s\2, \2%s\2", o->subject, o->story);
 
 			mowgli_node_delete(n, &operlogon_info);
+			logoninfo_cache_clear(&operlogon_cache);
 
 			strshare_unref(o->nick);
 			sfree(o->subject);
@@ -553,6 +649,7 @@ mod_init(struct module *const restrict m)
 	hook_add_user_oper(display_oper_info);
 	hook_add_operserv_info(osinfo_hook);
 	hook_add_db_write(write_infodb);
+	hook_add_config_ready(logoninfo_config_ready);
 
 	db_register_type_handler("LI", db_h_li);
 	db_register_type_handler("LIO", db_h_lio);
@@ -83,11 +83,10 @@ ms_cmd_delete(struct sourceinfo *si, int parc, char *parv[])
 			if (!(memo->status & MEMO_READ))
 				si->smu->memoct_new--;
 
-			// Free to node pool, remove from chain
+			// Remove from chain
 			mowgli_node_delete(n, &si->smu->memos);
-			mowgli_node_free(n);
 
-			sfree(memo);
+			memo_free(memo);
 		}
 
 	}
@@ -16,7 +16,8 @@ ms_cmd_forward(struct sourceinfo *si, int parc, char *parv[])
 	struct user *tu;
 	struct myuser *tmu;
 	struct mymemo *memo, *newmemo;
-	mowgli_node_t *n, *temp;
+	const char *text;
+	mowgli_node_t *n;
 	unsigned int i = 1, memonum = 0;
 	struct service *const memoserv = service_find("memoserv");
 
@@ -101,25 +102,12 @@ ms_cmd_forward(struct sourceinfo *si, int parc, char *parv[])
 	si->smu->memo_ratelimit_time = CURRTIME;
 
 	// Make sure we're not on ignore
-	MOWGLI_ITER_FOREACH(n, tmu->memo_ignores.head)
+	if (myuser_memo_ignore_find(tmu, si->smu))
 	{
-		struct mynick *mn;
-		struct myuser *mu;
-
-		if (nicksvs.no_nick_ownership)
-			mu = myuser_find((const char *)n->data);
-		else
-		{
-			mn = mynick_find((const char *)n->data);
-			mu = mn != NULL ? mn->owner : NULL;
-		}
-		if (mu == si->smu)
-		{
-			// Lie... change this if you want it to fail silent
-			logcommand(si, CMDLOG_SET, "failed FORWARD to \2%s\2 (on ignore list)", entity(tmu)->name);
-			command_success_nodata(si, _("The memo has been successfully forwarded to \2%s\2."), target);
-			return;
-		}
+		// Lie... change this if you want it to fail silent
+		logcommand(si, CMDLOG_SET, "failed FORWARD to \2%s\2 (on ignore list)", entity(tmu)->name);
+		command_success_nodata(si, _("The memo has been successfully forwarded to \2%s\2."), target);
+		return;
 	}
 	logcommand(si, CMDLOG_SET, "FORWARD: to \2%s\2", entity(tmu)->name);
 
@@ -135,17 +123,17 @@ ms_cmd_forward(struct sourceinfo *si, int parc, char *parv[])
 			// Create memo
 			newmemo->sent = CURRTIME;
 			mowgli_strlcpy(newmemo->sender, entity(si->smu)->name, sizeof newmemo->sender);
-			mowgli_strlcpy(newmemo->text, memo->text, sizeof newmemo->text);
+			text = memo_text(memo);
+			memo_set_text(newmemo, tmu, text);
 
-			// Create node, add to their linked list of memos
-			temp = mowgli_node_create();
-			mowgli_node_add(newmemo, temp, &tmu->memos);
+			// Add to their linked list of memos
+			mowgli_node_add(newmemo, &newmemo->node, &tmu->memos);
 			tmu->memoct_new++;
 
 			// Should we email this?
 			if (tmu->flags & MU_EMAILMEMOS)
 			{
-				sendemail(si->su, tmu, EMAIL_MEMO, tmu->email, memo->text);
+				sendemail(si->su, tmu, EMAIL_MEMO, tmu->email, text);
 			}
 		}
 		i++;
@@ -29,9 +29,7 @@ static void
 ms_cmd_ignore_add(struct sourceinfo *si, int parc, char *parv[])
 {
 	struct myuser *tmu;
-	mowgli_node_t *n;
 	const char *newnick;
-	char *temp;
 
 	// Arg check
 	if (parc < 1)
@@ -64,22 +62,13 @@ ms_cmd_ignore_add(struct sourceinfo *si, int parc, char *parv[])
 		return;
 	}
 
-	// Iterate through list, make sure target not in it, if last node append
-	MOWGLI_ITER_FOREACH(n, si->smu->memo_ignores.head)
+	// Add to ignore list, unless they're in it already
+	if (! myuser_memo_ignore_add(si->smu, tmu))
 	{
-		temp = (char *)n->data;
-
-		// Already in the list
-		if (!irccasecmp(temp, newnick))
-		{
-			command_fail(si, fault_nochange, _("Account \2%s\2 is already in your ignore list."), temp);
-			return;
-		}
+		command_fail(si, fault_nochange, _("Account \2%s\2 is already in your ignore list."), newnick);
+		return;
 	}
 
-	// Add to ignore list
-	temp = sstrdup(newnick);
-	mowgli_node_add(temp, mowgli_node_create(), &si->smu->memo_ignores);
 	logcommand(si, CMDLOG_SET, "IGNORE:ADD: \2%s\2", newnick);
 	command_success_nodata(si, _("Account \2%s\2 added to your ignore list."), newnick);
 	return;
@@ -88,8 +77,8 @@ ms_cmd_ignore_add(struct sourceinfo *si, int parc, char *parv[])
 static void
 ms_cmd_ignore_del(struct sourceinfo *si, int parc, char *parv[])
 {
-	mowgli_node_t *n, *tn;
-	char *temp;
+	struct myuser *tmu;
+	struct memo_ignore *mi;
 
 	// Arg check
 	if (parc < 1)
@@ -99,22 +88,12 @@ ms_cmd_ignore_del(struct sourceinfo *si, int parc, char *parv[])
 		return;
 	}
 
-	// Iterate through list, make sure they're not in it, if last node append
-	MOWGLI_ITER_FOREACH_SAFE(n, tn, si->smu->memo_ignores.head)
+	if ((tmu = myuser_find_ext(parv[0])) != NULL && (mi = myuser_memo_ignore_find(si->smu, tmu)) != NULL)
 	{
-		temp = (char *)n->data;
-
-		// Not using list or clear, but we've found our target in the ignore list
-		if (!irccasecmp(temp, parv[0]))
-		{
-			logcommand(si, CMDLOG_SET, "IGNORE:DEL: \2%s\2", temp);
-			command_success_nodata(si, _("Account \2%s\2 removed from ignore list."), temp);
-			mowgli_node_delete(n, &si->smu->memo_ignores);
-			mowgli_node_free(n);
-			sfree(temp);
-
-			return;
-		}
+		logcommand(si, CMDLOG_SET, "IGNORE:DEL: \2%s\2", entity(tmu)->name);
+		command_success_nodata(si, _("Account \2%s\2 removed from ignore list."), entity(tmu)->name);
+		myuser_memo_ignore_delete(mi);
+		return;
 	}
 
 	command_fail(si, fault_nosuch_target, _("\2%s\2 is not in your ignore list."), parv[0]);
@@ -133,11 +112,7 @@ ms_cmd_ignore_clear(struct sourceinfo *si, int parc, char *parv[])
 	}
 
 	MOWGLI_ITER_FOREACH_SAFE(n, tn, si->smu->memo_ignores.head)
-	{
-		sfree(n->data);
-		mowgli_node_delete(n,&si->smu->memo_ignores);
-		mowgli_node_free(n);
-	}
+		myuser_memo_ignore_delete(n->data);
 
 	// Let them know list is clear
 	command_success_nodata(si, _("Ignore list cleared."));
@@ -158,7 +133,9 @@ ms_cmd_ignore_list(struct sourceinfo *si, int parc, char *parv[])
 	// Iterate through list, make sure they're not in it, if last node append
 	MOWGLI_ITER_FOREACH(n, si->smu->memo_ignores.head)
 	{
-		command_success_nodata(si, "%u - %s", i, (char *)n->data);
+		const struct memo_ignore *const mi = n->data;
+
+		command_success_nodata(si, "%u - %s", i, entity(mi->target)->name);
 		i++;
 	}
 
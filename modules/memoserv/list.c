@@ -20,6 +20,7 @@ ms_cmd_list(struct sourceinfo *si, int parc, char *parv[])
 	struct tm *tm;
 	char line[512];
 	char chan[CHANNELLEN + 1];
+	const char *text;
 	char *p;
 
 	command_success_nodata(si, ngettext(N_("You have %zu memo (%u new)."),
@@ -42,12 +43,12 @@ ms_cmd_list(struct sourceinfo *si, int parc, char *parv[])
 
 		snprintf(line, sizeof line, _("- %u From: %s Sent: %s"),
 				i, memo->sender, strfbuf);
-		if (memo->status & MEMO_CHANNEL && *memo->text == '#')
+		if (memo->status & MEMO_CHANNEL && *(text = memo_text(memo)) == '#')
 		{
 			mowgli_strlcat(line, " ", sizeof line);
 			mowgli_strlcat(line, _("To:"), sizeof line);
 			mowgli_strlcat(line, " ", sizeof line);
-			mowgli_strlcpy(chan, memo->text, sizeof chan);
+			mowgli_strlcpy(chan, text, sizeof chan);
 			p = strchr(chan, ' ');
 			if (p != NULL)
 				*p = '\0';
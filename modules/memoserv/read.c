@@ -20,6 +20,7 @@ ms_cmd_read(struct sourceinfo *si, int parc, char *parv[])
 	mowgli_node_t *n;
 	unsigned int i = 1, memonum = 0, numread = 0;
 	char strfbuf[BUFSIZE];
+	char text[MEMOLEN + 1];
 	struct tm *tm;
 	bool readnew;
 
@@ -86,11 +87,11 @@ ms_cmd_read(struct sourceinfo *si, int parc, char *parv[])
 						receipt = smalloc(sizeof *receipt);
 						receipt->sent = CURRTIME;
 						mowgli_strlcpy(receipt->sender, si->service->nick, sizeof receipt->sender);
-						snprintf(receipt->text, sizeof receipt->text, "%s has read a memo from you sent at %s", entity(si->smu)->name, strfbuf);
+						snprintf(text, sizeof text, "%s has read a memo from you sent at %s", entity(si->smu)->name, strfbuf);
+						memo_set_text(receipt, tmu, text);
 
 						// Attach to their linked list
-						n = mowgli_node_create();
-						mowgli_node_add(receipt, n, &tmu->memos);
+						mowgli_node_add(receipt, &receipt->node, &tmu->memos);
 						tmu->memoct_new++;
 					}
 				}
@@ -98,7 +99,7 @@ ms_cmd_read(struct sourceinfo *si, int parc, char *parv[])
 
 			command_success_nodata(si, _("\2Memo %u - Sent by %s, %s\2"), i, memo->sender, strfbuf);
 			command_success_nodata(si, "----------------------------------------------------------------");
-			command_success_nodata(si, "%s", memo->text);
+			command_success_nodata(si, "%s", memo_text(memo));
 			command_success_nodata(si, "----------------------------------------------------------------");
 
 			if (!readnew)
@@ -17,7 +17,6 @@ ms_cmd_send(struct sourceinfo *si, int parc, char *parv[])
 	// misc structs etc
 	struct user *tu;
 	struct myuser *tmu;
-	mowgli_node_t *n;
 	struct mymemo *memo;
 	struct command *cmd;
 	struct service *memoserv;
@@ -99,24 +98,11 @@ ms_cmd_send(struct sourceinfo *si, int parc, char *parv[])
 		}
 
 		// Make sure we're not on ignore
-		MOWGLI_ITER_FOREACH(n, tmu->memo_ignores.head)
+		if (myuser_memo_ignore_find(tmu, si->smu))
 		{
-			struct mynick *mn;
-			struct myuser *mu;
-
-			if (nicksvs.no_nick_ownership)
-				mu = myuser_find((const char *)n->data);
-			else
-			{
-				mn = mynick_find((const char *)n->data);
-				mu = mn != NULL ? mn->owner : NULL;
-			}
-			if (mu == si->smu)
-			{
-				logcommand(si, CMDLOG_SET, "failed SEND to \2%s\2 (on ignore list)", entity(tmu)->name);
-				command_success_nodata(si, _("The memo has been successfully sent to \2%s\2."), target);
-				return;
-			}
+			logcommand(si, CMDLOG_SET, "failed SEND to \2%s\2 (on ignore list)", entity(tmu)->name);
+			command_success_nodata(si, _("The memo has been successfully sent to \2%s\2."), target);
+			return;
 		}
 		logcommand(si, CMDLOG_SET, "SEND: to \2%s\2", entity(tmu)->name);
 
@@ -124,17 +110,16 @@ ms_cmd_send(struct sourceinfo *si, int parc, char *parv[])
 		memo = smalloc(sizeof *memo);
 		memo->sent = CURRTIME;
 		mowgli_strlcpy(memo->sender, entity(si->smu)->name, sizeof memo->sender);
-		mowgli_strlcpy(memo->text, m, sizeof memo->text);
+		memo_set_text(memo, tmu, m);
 
-		// Create a linked list node and add to memos
-		n = mowgli_node_create();
-		mowgli_node_add(memo, n, &tmu->memos);
+		// Add to their memos
+		mowgli_node_add(memo, &memo->node, &tmu->memos);
 		tmu->memoct_new++;
 
 		// Should we email this?
 	        if (tmu->flags & MU_EMAILMEMOS)
 		{
-			sendemail(si->su, tmu, EMAIL_MEMO, tmu->email, memo->text);
+			sendemail(si->su, tmu, EMAIL_MEMO, tmu->email, m);
 	        }
 
 		/* Note: do not disclose other nicks they're logged in with
@@ -11,17 +11,144 @@
 
 static unsigned int *maxmemos;
 
+struct ms_sendall
+{
+	char            sender_id[IDLEN + 1];
+	char *          sender_nick;    // NULL if the same as the account name
+	char *          service;        // internal name of the service used
+	char *          text;
+	char            (*targets)[IDLEN + 1];
+	unsigned int    ntargets;
+	unsigned int    next;
+	unsigned int    sent;
+};
+
+static struct myuser *
+ms_sendall_sender(const struct ms_sendall *const restrict sa)
+{
+	struct myentity *const mt = myentity_find_uid(sa->sender_id);
+
+	return isuser(mt) ? (struct myuser *) mt : NULL;
+}
+
+static bool
+ms_sendall_step(struct delivery_job *const restrict job)
+{
+	struct ms_sendall *const sa = job->data;
+	struct myentity *mt;
+	struct myuser *smu, *tmu;
+	struct mymemo *memo;
+	struct service *memoserv, *svs;
+
+	if (sa->next >= sa->ntargets)
+		return false;
+
+	// The account sending this is gone; nobody would know who it was from
+	if ((smu = ms_sendall_sender(sa)) == NULL)
+	{
+		sa->next = sa->ntargets;
+		return false;
+	}
+
+	// Dropped since the job started
+	if ((mt = myentity_find_uid(sa->targets[sa->next++])) == NULL || ! isuser(mt))
+		return true;
+
+	tmu = (struct myuser *) mt;
+
+	// Does the user allow memos? --pfish
+	if (tmu->flags & MU_NOMEMO)
+		return true;
+
+	// Check to make sure target inbox not full
+	if (tmu->memos.count >= *maxmemos)
+		return true;
+
+	// As in SEND to a single user, make ignore fail silently
+	sa->sent++;
+
+	// Make sure we're not on ignore
+	if (myuser_memo_ignore_find(tmu, smu))
+		return true;
+
+	svs = service_find(sa->service);
+	if ((memoserv = service_find("memoserv")) == NULL)
+		memoserv = svs;
+	if (memoserv == NULL)
+	{
+		sa->next = sa->ntargets;
+		return false;
+	}
+	if (svs == NULL)
+		svs = memoserv;
+
+	// Malloc and populate struct
+	memo = smalloc(sizeof *memo);
+	memo->sent = CURRTIME;
+	memo->status = MEMO_CHANNEL;
+	mowgli_strlcpy(memo->sender, entity(smu)->name, sizeof memo->sender);
+	memo_set_text(memo, tmu, sa->text);
+
+	// Add to their memos
+	mowgli_node_add(memo, &memo->node, &tmu->memos);
+	tmu->memoct_new++;
+
+	// Should we email this?
+	if (tmu->flags & MU_EMAILMEMOS)
+	{
+		// sendemail() wants a user to blame; the sender may have logged out by now
+		struct user *const su = smu->logins.head != NULL ? smu->logins.head->data : memoserv->me;
+
+		sendemail(su, tmu, EMAIL_MEMO, tmu->email, sa->text);
+	}
+
+	// Is the user online? If so, tell them about the new memo.
+	if (sa->sender_nick == NULL)
+		myuser_notice(memoserv->nick, tmu, "You have a new memo from %s (%zu).", entity(smu)->name, MOWGLI_LIST_LENGTH(&tmu->memos));
+	else
+		myuser_notice(memoserv->nick, tmu, "You have a new memo from %s (nick: %s) (%zu).", entity(smu)->name, sa->sender_nick, MOWGLI_LIST_LENGTH(&tmu->memos));
+
+	myuser_notice(svs->nick, tmu, "To read it, type \2/msg %s READ %zu\2",
+	              memoserv->disp, MOWGLI_LIST_LENGTH(&tmu->memos));
+
+	return true;
+}
+
+static void
+ms_sendall_done(struct delivery_job *const restrict job, const bool cancelled)
+{
+	struct ms_sendall *const sa = job->data;
+	struct myuser *const smu = ms_sendall_sender(sa);
+	struct service *const memoserv = service_find("memoserv");
+
+	if (smu != NULL && memoserv != NULL)
+	{
+		if (cancelled)
+			myuser_notice(memoserv->nick, smu, "Your SENDALL memo was cancelled after \2%u\2 of \2%u\2 "
+			              "accounts; it was sent to \2%u\2 of them.", sa->next, sa->ntargets, sa->sent);
+		else
+			myuser_notice(memoserv->nick, smu, "Your SENDALL memo has been sent to \2%u\2 accounts.",
+			              sa->sent);
+	}
+
+	slog(LG_INFO, "SENDALL: memo from %s %s (%u/%u sent)", smu != NULL ? entity(smu)->name : sa->sender_id,
+	     cancelled ? "cancelled" : "finished", sa->sent, sa->next);
+
+	sfree(sa->sender_nick);
+	sfree(sa->service);
+	sfree(sa->text);
+	sfree(sa->targets);
+	sfree(sa);
+}
+
 static void
 ms_cmd_sendall(struct sourceinfo *si, int parc, char *parv[])
 {
 	// misc structs etc
 	struct myentity *mt;
-	mowgli_node_t *n;
-	struct mymemo *memo;
-	unsigned int sent = 0, tried = 0;
-	bool ignored;
-	struct service *memoserv;
+	struct ms_sendall *sa;
 	struct myentity_iteration_state state;
+	char desc[BUFSIZE];
 
 	// Grab args
 	char *m = parv[0];
@@ -72,87 +199,41 @@ ms_cmd_sendall(struct sourceinfo *si, int parc, char *parv[])
 	si->smu->memo_ratelimit_num++;
 	si->smu->memo_ratelimit_time = CURRTIME;
 
-	MYENTITY_FOREACH_T(mt, &state, ENT_USER)
-	{
-		struct myuser *tmu = user(mt);
-
-		if (tmu == si->smu)
-			continue;
-
-		tried++;
-
-		// Does the user allow memos? --pfish
-		if (tmu->flags & MU_NOMEMO)
-			continue;
+	/* Only the recipients are collected here; the memos are written a
+	 * slice at a time by the delivery queue. Accounts are remembered by
+	 * UID, so renames and drops in the meantime are harmless.
+	 */
+	sa = smalloc(sizeof *sa);
+	mowgli_strlcpy(sa->sender_id, entity(si->smu)->id, sizeof sa->sender_id);
+	sa->service = sstrdup(si->service->internal_name);
+	sa->text = sstrdup(m);
+	sa->targets = smalloc((cnt.myuser > 0 ? cnt.myuser : 1) * sizeof *sa->targets);
 
-		// Check to make sure target inbox not full
-		if (tmu->memos.count >= *maxmemos)
-			continue;
+	if (si->su != NULL && irccasecmp(si->su->nick, entity(si->smu)->name))
+		sa->sender_nick = sstrdup(si->su->nick);
 
-		// As in SEND to a single user, make ignore fail silently
-		sent++;
-
-		// Make sure we're not on ignore
-		ignored = false;
-		MOWGLI_ITER_FOREACH(n, tmu->memo_ignores.head)
-		{
-			struct mynick *mn;
-			struct myuser *mu;
-
-			if (nicksvs.no_nick_ownership)
-				mu = myuser_find((const char *)n->data);
-			else
-			{
-				mn = mynick_find((const char *)n->data);
-				mu = mn != NULL ? mn->owner : NULL;
-			}
-			if (mu == si->smu)
-				ignored = true;
-		}
-		if (ignored)
+	MYENTITY_FOREACH_T(mt, &state, ENT_USER)
+	{
+		if (mt == entity(si->smu) || sa->ntargets >= cnt.myuser)
 			continue;
 
-		// Malloc and populate struct
-		memo = smalloc(sizeof *memo);
-		memo->sent = CURRTIME;
-		memo->status = MEMO_CHANNEL;
-		mowgli_strlcpy(memo->sender, entity(si->smu)->name, sizeof memo->sender);
-		mowgli_strlcpy(memo->text, m, sizeof memo->text);
-
-		// Create a linked list node and add to memos
-		n = mowgli_node_create();
-		mowgli_node_add(memo, n, &tmu->memos);
-		tmu->memoct_new++;
-
-		// Should we email this?
-		if (tmu->flags & MU_EMAILMEMOS)
-		{
-			sendemail(si->su, tmu, EMAIL_MEMO, tmu->email, memo->text);
-		}
-
-		memoserv = service_find("memoserv");
-		if (memoserv == NULL)
-			memoserv = si->service;
-
-		// Is the user online? If so, tell them about the new memo.
-		if (si->su == NULL || !irccasecmp(si->su->nick, entity(si->smu)->name))
-			myuser_notice(memoserv->nick, tmu, "You have a new memo from %s (%zu).", entity(si->smu)->name, MOWGLI_LIST_LENGTH(&tmu->memos));
-		else
-			myuser_notice(memoserv->nick, tmu, "You have a new memo from %s (nick: %s) (%zu).", entity(si->smu)->name, si->su->nick, MOWGLI_LIST_LENGTH(&tmu->memos));
-
-		myuser_notice(si->service->nick, tmu, "To read it, type \2/msg %s READ %zu\2",
-		              memoserv->disp, MOWGLI_LIST_LENGTH(&tmu->memos));
+		mowgli_strlcpy(sa->targets[sa->ntargets++], mt->id, sizeof *sa->targets);
 	}
 
 	// Tell user memo sent, return
-	if (sent > 4)
+	if (sa->ntargets > 4)
 		command_add_flood(si, FLOOD_HEAVY);
-	else if (sent > 1)
+	else if (sa->ntargets > 1)
 		command_add_flood(si, FLOOD_MODERATE);
-	logcommand(si, CMDLOG_ADMIN, "SENDALL: \2%s\2 (%u/%u sent)", m, sent, tried);
-	command_success_nodata(si, ngettext(N_("The memo has been successfully sent to \2%u\2 account."),
-	                                    N_("The memo has been successfully sent to \2%u\2 accounts."),
-	                                    sent), sent);
+
+	snprintf(desc, sizeof desc, "MemoServ SENDALL: %s", m);
+	const struct delivery_job *const job = delivery_job_start(entity(si->smu)->name, desc, PRIV_ADMIN, sa->ntargets,
+	                                                          &ms_sendall_step, &ms_sendall_done, sa);
+
+	logcommand(si, CMDLOG_ADMIN, "SENDALL: \2%s\2 (%u accounts queued)", m, sa->ntargets);
+	command_success_nodata(si, ngettext(N_("The memo is being sent to \2%u\2 account (delivery job \2%u\2)."),
+	                                    N_("The memo is being sent to \2%u\2 accounts (delivery job \2%u\2)."),
+	                                    sa->ntargets), sa->ntargets, job->id);
 	return;
 }
 
@@ -176,7 +257,17 @@ mod_init(struct module *const restrict m)
 static void
 mod_deinit(const enum module_unload_intent ATHEME_VATTR_UNUSED intent)
 {
+	mowgli_node_t *n, *tn;
+
 	service_named_unbind_command("memoserv", &ms_sendall);
+
+	MOWGLI_ITER_FOREACH_SAFE(n, tn, delivery_jobs.head)
+	{
+		struct delivery_job *const job = n->data;
+
+		if (job->step == &ms_sendall_step)
+			delivery_job_cancel(job);
+	}
 }
 
 SIMPLE_DECLARE_MODULE_V1("memoserv/sendall", MODULE_UNLOAD_CAPABILITY_OK)
@@ -16,11 +16,13 @@ ms_cmd_sendops(struct sourceinfo *si, int parc, char *parv[])
 {
 	// misc structs etc
 	struct myuser *tmu;
-	mowgli_node_t *n, *tn;
+	mowgli_node_t *tn;
 	struct mymemo *memo;
+	char text[MEMOLEN + 1];
+	char from[BUFSIZE];
 	struct mychan *mc;
 	unsigned int sent = 0, tried = 0;
-	bool ignored, operoverride = false;
+	bool operoverride = false;
 	struct service *memoserv;
 
 	// Grab args
@@ -88,6 +90,18 @@ ms_cmd_sendops(struct sourceinfo *si, int parc, char *parv[])
 	si->smu->memo_ratelimit_num++;
 	si->smu->memo_ratelimit_time = CURRTIME;
 
+	// Everything but the memo count is the same for every operator
+	snprintf(text, sizeof text, "%s %s", mc->name, m);
+
+	memoserv = service_find("memoserv");
+	if (memoserv == NULL)
+		memoserv = si->service;
+
+	if (si->su == NULL || !irccasecmp(si->su->nick, entity(si->smu)->name))
+		mowgli_strlcpy(from, entity(si->smu)->name, sizeof from);
+	else
+		snprintf(from, sizeof from, "%s (nick: %s)", entity(si->smu)->name, si->su->nick);
+
 	MOWGLI_ITER_FOREACH(tn, mc->chanacs.head)
 	{
 		struct chanacs *ca = (struct chanacs *) tn->data;
@@ -110,23 +124,7 @@ ms_cmd_sendops(struct sourceinfo *si, int parc, char *parv[])
 		sent++;
 
 		// Make sure we're not on ignore
-		ignored = false;
-		MOWGLI_ITER_FOREACH(n, tmu->memo_ignores.head)
-		{
-			struct mynick *mn;
-			struct myuser *mu;
-
-			if (nicksvs.no_nick_ownership)
-				mu = myuser_find((const char *)n->data);
-			else
-			{
-				mn = mynick_find((const char *)n->data);
-				mu = mn != NULL ? mn->owner : NULL;
-			}
-			if (mu == si->smu)
-				ignored = true;
-		}
-		if (ignored)
+		if (myuser_memo_ignore_find(tmu, si->smu))
 			continue;
 
 		// Malloc and populate struct
@@ -134,28 +132,20 @@ ms_cmd_sendops(struct sourceinfo *si, int parc, char *parv[])
 		memo->sent = CURRTIME;
 		memo->status = MEMO_CHANNEL;
 		mowgli_strlcpy(memo->sender, entity(si->smu)->name, sizeof memo->sender);
-		snprintf(memo->text, sizeof memo->text, "%s %s", mc->name, m);
+		memo_set_text(memo, tmu, text);
 
-		// Create a linked list node and add to memos
-		n = mowgli_node_create();
-		mowgli_node_add(memo, n, &tmu->memos);
+		// Add to their memos
+		mowgli_node_add(memo, &memo->node, &tmu->memos);
 		tmu->memoct_new++;
 
 		// Should we email this?
 		if (tmu->flags & MU_EMAILMEMOS)
 		{
-			sendemail(si->su, tmu, EMAIL_MEMO, tmu->email, memo->text);
+			sendemail(si->su, tmu, EMAIL_MEMO, tmu->email, text);
 		}
 
-		memoserv = service_find("memoserv");
-		if (memoserv == NULL)
-			memoserv = si->service;
-
 		// Is the user online? If so, tell them about the new memo.
-		if (si->su == NULL || !irccasecmp(si->su->nick, entity(si->smu)->name))
-			myuser_notice(memoserv->nick, tmu, "You have a new memo from %s (%zu).", entity(si->smu)->name, MOWGLI_LIST_LENGTH(&tmu->memos));
-		else
-			myuser_notice(memoserv->nick, tmu, "You have a new memo from %s (nick: %s) (%zu).", entity(si->smu)->name, si->su->nick, MOWGLI_LIST_LENGTH(&tmu->memos));
+		myuser_notice(memoserv->nick, tmu, "You have a new memo from %s (%zu).", from, MOWGLI_LIST_LENGTH(&tmu->memos));
 
 		myuser_notice(si->service->nick, tmu, "To read it, type \2/msg %s READ %zu\2",
 		              memoserv->disp, MOWGLI_LIST_LENGTH(&tmu->memos));
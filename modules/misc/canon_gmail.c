@@ -23,10 +23,8 @@ email_canonicalize_gmail(char email[static (EMAILLEN + 1)],
 	if (! p_at || strcasecmp(p_at, GMAIL_SUFFIX) != 0)
 		return;
 
-	char buf[EMAILLEN + 1];
-	char *p_out = buf;
-
-	(void) memset(buf, 0x00, sizeof buf);
+	// Done in place; what is kept of the local part never moves forward
+	char *p_out = email;
 
 	for (const char *p = email; p < p_at; p++)
 	{
@@ -39,14 +37,9 @@ email_canonicalize_gmail(char email[static (EMAILLEN + 1)],
 		*p_out++ = *p;
 	}
 
-	if (mowgli_strlcat(buf, GMAIL_SUFFIX, sizeof buf) >= sizeof buf)
-	{
-		(void) slog(LG_ERROR, "%s: buffer is too short (BUG)", MOWGLI_FUNC_NAME);
-		return;
-	}
+	(void) memcpy(p_out, GMAIL_SUFFIX, sizeof GMAIL_SUFFIX);
 
-	(void) slog(LG_DEBUG, "%s: '%s' -> '%s'", MOWGLI_FUNC_NAME, email, buf);
-	(void) memcpy(email, buf, sizeof buf);
+	(void) slog(LG_DEBUG, "%s: -> '%s'", MOWGLI_FUNC_NAME, email);
 }
 
 static void
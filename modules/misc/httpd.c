@@ -11,7 +11,12 @@
 
 #define REQUEST_MAX 65536 // maximum size of one call
 
+// Most of a static file sendfile() is asked to write per write event
+#define HTTPD_SENDFILE_MAX      (1024 * 1024)
+
 static struct connection *listener = NULL;
+static char *listener_host = NULL;
+static unsigned int listener_port = 0;
 static mowgli_eventloop_timer_t *httpd_checkidle_timer = NULL;
 
 // conf stuff
@@ -21,11 +26,44 @@ static struct {
 	char *host;
 	char *www_root;
 	unsigned int port;
+	unsigned int max_requests;      // per connection; 0 for no limit
+	unsigned int idle_timeout;
+	unsigned int cache_size;        // bytes of static files kept in memory; 0 to not cache them
+	unsigned int cache_file_max;    // largest file that is cached
 } httpd_config;
 
-// Imported by modules/transport/*rpc/*rpc.so */
-extern mowgli_list_t httpd_path_handlers;
-mowgli_list_t httpd_path_handlers;
+/* Small static files are kept in memory, most recently served first, and
+ * sent from there for as long as stat() says the file has not changed.
+ */
+struct httpd_cached_file
+{
+	char *          path;
+	dev_t           dev;
+	ino_t           ino;
+	off_t           size;
+	time_t          mtime;
+	char *          data;
+	mowgli_node_t   node;
+};
+
+static mowgli_patricia_t *httpd_cache = NULL;
+static mowgli_list_t httpd_cache_lru;
+static size_t httpd_cache_bytes = 0;
+
+// A static file still being written to the connection with sendfile()
+struct httpd_filesend
+{
+	int             fd;
+	off_t           offset;
+	off_t           left;
+};
+
+// How often connections are checked for having been idle too long
+#define HTTPD_CHECKIDLE_INTERVAL        15U
+
+// Imported by modules/transport/*rpc/*rpc.so and misc/metrics; see struct path_handler
+extern mowgli_patricia_t *httpd_path_handlers;
+mowgli_patricia_t *httpd_path_handlers = NULL;
 
 static void
 clear_httpddata(struct httpddata *hd)
@@ -37,6 +75,8 @@ clear_httpddata(struct httpddata *hd)
 		sfree(hd->requestbuf);
 		hd->requestbuf = NULL;
 	}
+	sfree(hd->bodystate);
+	hd->bodystate = NULL;
 	if (hd->replybuf != NULL)
 	{
 		sfree(hd->replybuf);
@@ -47,19 +87,19 @@ clear_httpddata(struct httpddata *hd)
 	hd->correct_content_type = false;
 	hd->expect_100_continue = false;
 	hd->sent_reply = false;
+	hd->accept_encoding = 0;
+	hd->if_none_match[0] = '\0';
+	hd->if_modified_since[0] = '\0';
 }
 
-static int
-open_file(const char *filename)
+static bool
+file_path(const char *filename, char *fname, size_t fnamelen)
 {
-	char fname[256];
-
 	if (strstr(filename, ".."))
-		return -1;
+		return false;
 	if (!strcmp(filename, "/"))
 		filename = "/index.html";
-	snprintf(fname, sizeof fname, "%s/%s", httpd_config.www_root, filename);
-	return open(fname, O_RDONLY);
+	return (size_t) snprintf(fname, fnamelen, "%s/%s", httpd_config.www_root, filename) < fnamelen;
 }
 
 static void
@@ -102,6 +142,39 @@ process_header(struct connection *cptr, char *line)
 	{
 		hd->expect_100_continue = !strcasecmp(p, "100-continue");
 	}
+	else if (!strcasecmp(line, "Accept-Encoding"))
+	{
+		hd->accept_encoding = 0;
+		for (p = strtok(p, ","); p != NULL; p = strtok(NULL, ","))
+		{
+			char *q = strchr(p, ';');
+
+			// "gzip;q=0" turns it down
+			if (q != NULL)
+			{
+				*q++ = '\0';
+				if ((q = strstr(q, "q=")) != NULL && strtod(q + 2, NULL) <= 0)
+					continue;
+			}
+			p += strspn(p, " \t");
+			p[strcspn(p, " \t")] = '\0';
+
+			if (!strcasecmp(p, "gzip"))
+				hd->accept_encoding |= HTTPD_ENCODING_GZIP;
+			else if (!strcasecmp(p, "br"))
+				hd->accept_encoding |= HTTPD_ENCODING_BR;
+			else if (!strcmp(p, "*"))
+				hd->accept_encoding |= HTTPD_ENCODING_GZIP | HTTPD_ENCODING_BR;
+		}
+	}
+	else if (!strcasecmp(line, "If-None-Match"))
+	{
+		mowgli_strlcpy(hd->if_none_match, p, sizeof hd->if_none_match);
+	}
+	else if (!strcasecmp(line, "If-Modified-Since"))
+	{
+		mowgli_strlcpy(hd->if_modified_since, p, sizeof hd->if_modified_since);
+	}
 }
 
 static void
@@ -165,9 +238,394 @@ content_type(const char *filename)
 		return "image/gif";
 	else if (!strcasecmp(p, "png"))
 		return "image/png";
+	else if (!strcasecmp(p, "svg"))
+		return "image/svg+xml";
+	else if (!strcasecmp(p, "ico"))
+		return "image/x-icon";
+	else if (!strcasecmp(p, "css"))
+		return "text/css";
+	else if (!strcasecmp(p, "js"))
+		return "text/javascript";
+	else if (!strcasecmp(p, "json"))
+		return "application/json";
+	else if (!strcasecmp(p, "woff2"))
+		return "font/woff2";
 	return "application/octet-stream";
 }
 
+static void
+cache_drop(struct httpd_cached_file *cf)
+{
+	(void) mowgli_patricia_delete(httpd_cache, cf->path);
+	mowgli_node_delete(&cf->node, &httpd_cache_lru);
+	httpd_cache_bytes -= (size_t) cf->size;
+	sfree(cf->path);
+	sfree(cf->data);
+	sfree(cf);
+}
+
+// Drop the least recently served files until the cache holds at most limit bytes
+static void
+cache_trim(size_t limit)
+{
+	while (httpd_cache_bytes > limit && httpd_cache_lru.tail != NULL)
+		cache_drop(httpd_cache_lru.tail->data);
+}
+
+static struct httpd_cached_file *
+cache_find(const char *fname, const struct stat *sb)
+{
+	struct httpd_cached_file *cf;
+
+	if ((cf = mowgli_patricia_retrieve(httpd_cache, fname)) == NULL)
+		return NULL;
+
+	if (cf->dev != sb->st_dev || cf->ino != sb->st_ino || cf->size != sb->st_size || cf->mtime != sb->st_mtime)
+	{
+		cache_drop(cf);
+		return NULL;
+	}
+
+	mowgli_node_delete(&cf->node, &httpd_cache_lru);
+	mowgli_node_add_head(cf, &cf->node, &httpd_cache_lru);
+	return cf;
+}
+
+static bool
+cache_wanted(const struct stat *sb)
+{
+	return sb->st_size > 0 && (uintmax_t) sb->st_size <= httpd_config.cache_file_max &&
+	       (uintmax_t) sb->st_size <= httpd_config.cache_size;
+}
+
+// Reads all of the file on fd into the cache; NULL if that fails
+static struct httpd_cached_file *
+cache_add(const char *fname, int fd, const struct stat *sb)
+{
+	struct httpd_cached_file *cf;
+	char *data;
+	off_t done = 0;
+	ssize_t count;
+
+	data = smalloc((size_t) sb->st_size);
+	while (done < sb->st_size)
+	{
+		count = read(fd, data + done, (size_t) (sb->st_size - done));
+		if (count <= 0)
+		{
+			sfree(data);
+			return NULL;
+		}
+		done += count;
+	}
+
+	if ((cf = mowgli_patricia_retrieve(httpd_cache, fname)) != NULL)
+		cache_drop(cf);
+	cache_trim(httpd_config.cache_size - (size_t) sb->st_size);
+
+	cf = smalloc(sizeof *cf);
+	cf->path = sstrdup(fname);
+	cf->dev = sb->st_dev;
+	cf->ino = sb->st_ino;
+	cf->size = sb->st_size;
+	cf->mtime = sb->st_mtime;
+	cf->data = data;
+	mowgli_patricia_add(httpd_cache, cf->path, cf);
+	mowgli_node_add_head(cf, &cf->node, &httpd_cache_lru);
+	httpd_cache_bytes += (size_t) cf->size;
+
+	return cf;
+}
+
+/* If the client takes an encoding that fname also exists precompressed in,
+ * switches fname and sb over to that file and returns the encoding.
+ */
+static const char *
+file_variant(const struct httpddata *hd, char *fname, size_t fnamelen, struct stat *sb)
+{
+	static const struct {
+		unsigned int    flag;
+		const char *    suffix;
+		const char *    encoding;
+	} variants[] = {
+		{ HTTPD_ENCODING_BR,    ".br",  "br"    },
+		{ HTTPD_ENCODING_GZIP,  ".gz",  "gzip"  },
+	};
+	const size_t len = strlen(fname);
+	struct stat vsb;
+
+	for (size_t i = 0; i < ARRAY_SIZE(variants); i++)
+	{
+		if (!(hd->accept_encoding & variants[i].flag))
+			continue;
+		if (len + strlen(variants[i].suffix) >= fnamelen)
+			continue;
+
+		mowgli_strlcat(fname, variants[i].suffix, fnamelen);
+		if (stat(fname, &vsb) == 0 && S_ISREG(vsb.st_mode) && vsb.st_mtime >= sb->st_mtime)
+		{
+			*sb = vsb;
+			return variants[i].encoding;
+		}
+		fname[len] = '\0';
+	}
+
+	return NULL;
+}
+
+// The ETag and Last-Modified of a file; the ETag differs between encodings of it
+static void
+file_validators(const struct stat *sb, const char *encoding, char *etag, size_t etaglen, char *lastmod, size_t lastmodlen)
+{
+	const struct tm *tm;
+
+	snprintf(etag, etaglen, "\"%jx-%jx%s%s\"", (uintmax_t) sb->st_size, (uintmax_t) sb->st_mtime,
+	         encoding != NULL ? "-" : "", encoding != NULL ? encoding : "");
+
+	if ((tm = gmtime(&sb->st_mtime)) == NULL || !strftime(lastmod, lastmodlen, "%a, %d %b %Y %H:%M:%S GMT", tm))
+		mowgli_strlcpy(lastmod, "Thu, 01 Jan 1970 00:00:00 GMT", lastmodlen);
+}
+
+/* Whether the copy the client has is still current. If-None-Match wins over
+ * If-Modified-Since; the latter must be the Last-Modified we sent, which is
+ * what clients send back.
+ */
+static bool
+not_modified(const struct httpddata *hd, const char *etag, const char *lastmod)
+{
+	if (hd->if_none_match[0] != '\0')
+		return !strcmp(hd->if_none_match, "*") || strstr(hd->if_none_match, etag) != NULL;
+
+	return hd->if_modified_since[0] != '\0' && !strcmp(hd->if_modified_since, lastmod);
+}
+
+static void
+send_file_header(struct connection *cptr, const struct httpddata *hd, const struct stat *sb, const char *encoding,
+                 const char *etag, const char *lastmod)
+{
+	char outbuf[BUFSIZE];
+
+	snprintf(outbuf, sizeof outbuf,
+	         "HTTP/1.1 200 OK\r\n"
+	         "Server: %s/%s\r\n"
+	         "Content-Type: %s\r\n"
+	         "Content-Length: %lu\r\n"
+	         "%s%s%s"
+	         "ETag: %s\r\n"
+	         "Last-Modified: %s\r\n"
+	         "Vary: Accept-Encoding\r\n"
+	         "\r\n",
+	         PACKAGE_TARNAME, PACKAGE_VERSION,
+	         content_type(hd->filename),
+	         (unsigned long) sb->st_size,
+	         encoding != NULL ? "Content-Encoding: " : "",
+	         encoding != NULL ? encoding : "",
+	         encoding != NULL ? "\r\n" : "",
+	         etag, lastmod);
+
+	sendq_add(cptr, outbuf, strlen(outbuf));
+}
+
+static void
+send_not_modified(struct connection *cptr, const char *etag, const char *lastmod)
+{
+	char outbuf[BUFSIZE];
+
+	snprintf(outbuf, sizeof outbuf,
+	         "HTTP/1.1 304 Not Modified\r\n"
+	         "Server: %s/%s\r\n"
+	         "ETag: %s\r\n"
+	         "Last-Modified: %s\r\n"
+	         "Vary: Accept-Encoding\r\n"
+	         "\r\n",
+	         PACKAGE_TARNAME, PACKAGE_VERSION,
+	         etag, lastmod);
+
+	sendq_add(cptr, outbuf, strlen(outbuf));
+}
+
+#ifdef HAVE_SYS_SENDFILE_H
+static void
+filesend_cancel(struct connection ATHEME_VATTR_UNUSED *cptr, void *vptr)
+{
+	struct httpd_filesend *fs = vptr;
+
+	close(fs->fd);
+	sfree(fs);
+}
+
+/* Write handler while a file is being sent: the headers in the sendq go out
+ * first, then the file straight from its descriptor to the socket.
+ */
+static void
+filesend_write(struct connection *cptr)
+{
+	struct httpddata *hd = cptr->userdata;
+	struct httpd_filesend *fs = hd->deferred;
+	size_t budget = HTTPD_SENDFILE_MAX;
+	ssize_t count;
+
+	if (sendq_nonempty(cptr))
+	{
+		sendq_flush(cptr);
+		if (CF_IS_DEAD(cptr) || sendq_nonempty(cptr))
+			return;
+	}
+
+	while (fs->left > 0 && budget > 0)
+	{
+		size_t len = budget;
+
+		if ((off_t) len > fs->left)
+			len = (size_t) fs->left;
+
+		count = sendfile(cptr->fd, fs->fd, &fs->offset, len);
+		if (count == -1 && mowgli_eventloop_ignore_errno(errno))
+			break;
+		if (count <= 0)
+		{
+			slog(LG_INFO, "filesend_write(): disconnecting fd %d (%s), sendfile failed: %s", cptr->fd, cptr->hbuf,
+			     count == 0 ? "file truncated" : strerror(errno));
+			cptr->flags |= CF_DEAD;
+			return;
+		}
+
+		fs->left -= count;
+		budget -= (size_t) count;
+	}
+
+	if (fs->left > 0)
+	{
+		connection_setselect_write(cptr, filesend_write);
+		return;
+	}
+
+	connection_setselect_write(cptr, NULL);
+	filesend_cancel(cptr, fs);
+	check_close(cptr);
+	httpd_deferred_done(cptr);
+}
+#endif
+
+static void
+serve_file(struct connection *cptr, bool is_get)
+{
+	struct httpddata *hd = cptr->userdata;
+	char fname[PATH_MAX];
+	char etag[80];
+	char lastmod[40];
+	char outbuf[BUFSIZE * 2];
+	const char *encoding;
+	struct httpd_cached_file *cf;
+	struct stat sb;
+	off_t count1;
+	ssize_t count = 0;
+	int in;
+
+	if (!file_path(hd->filename, fname, sizeof fname) || stat(fname, &sb) == -1 || !S_ISREG(sb.st_mode))
+	{
+		slog(LG_DEBUG, "serve_file(): 404 for \2%s\2", hd->filename);
+		send_error(cptr, 404, "Not Found", is_get);
+		check_close(cptr);
+		return;
+	}
+
+	encoding = file_variant(hd, fname, sizeof fname, &sb);
+
+	if ((cf = cache_find(fname, &sb)) != NULL)
+	{
+		file_validators(&sb, encoding, etag, sizeof etag, lastmod, sizeof lastmod);
+		if (not_modified(hd, etag, lastmod))
+		{
+			slog(LG_DEBUG, "serve_file(): 304 for %s", hd->filename);
+			send_not_modified(cptr, etag, lastmod);
+			check_close(cptr);
+			return;
+		}
+
+		slog(LG_INFO, "serve_file(): 200 for %s (cached)", hd->filename);
+		send_file_header(cptr, hd, &sb, encoding, etag, lastmod);
+		if (is_get)
+			sendq_add(cptr, cf->data, (size_t) cf->size);
+		check_close(cptr);
+		return;
+	}
+
+	// What is sent is whatever the opened file is, should it have just been replaced
+	if ((in = open(fname, O_RDONLY)) == -1 || fstat(in, &sb) == -1 || !S_ISREG(sb.st_mode))
+	{
+		if (in != -1)
+			close(in);
+		slog(LG_DEBUG, "serve_file(): 404 for \2%s\2", hd->filename);
+		send_error(cptr, 404, "Not Found", is_get);
+		check_close(cptr);
+		return;
+	}
+
+	file_validators(&sb, encoding, etag, sizeof etag, lastmod, sizeof lastmod);
+	if (not_modified(hd, etag, lastmod))
+	{
+		close(in);
+		slog(LG_DEBUG, "serve_file(): 304 for %s", hd->filename);
+		send_not_modified(cptr, etag, lastmod);
+		check_close(cptr);
+		return;
+	}
+
+	slog(LG_INFO, "serve_file(): 200 for %s", hd->filename);
+
+	if (is_get && cache_wanted(&sb) && (cf = cache_add(fname, in, &sb)) != NULL)
+	{
+		close(in);
+		send_file_header(cptr, hd, &sb, encoding, etag, lastmod);
+		sendq_add(cptr, cf->data, (size_t) cf->size);
+		check_close(cptr);
+		return;
+	}
+
+	send_file_header(cptr, hd, &sb, encoding, etag, lastmod);
+
+#ifdef HAVE_SYS_SENDFILE_H
+	// Connections whose writes go through io_uring only ever write their sendq
+	if (is_get && sb.st_size > 0 && cptr->uring == NULL && !CF_IS_DEAD(cptr))
+	{
+		struct httpd_filesend *fs = smalloc(sizeof *fs);
+
+		fs->fd = in;
+		fs->offset = 0;
+		fs->left = sb.st_size;
+
+		// No further requests are read until the whole file has been written
+		hd->deferred = fs;
+		hd->deferred_cancel = filesend_cancel;
+		connection_setselect_write(cptr, filesend_write);
+		return;
+	}
+#endif
+
+	count1 = is_get ? sb.st_size : 0;
+	while (count1 > 0)
+	{
+		size_t len = sizeof outbuf;
+
+		if ((off_t) len > count1)
+			len = (size_t) count1;
+		count = read(in, outbuf, len);
+		if (count <= 0)
+			break;
+		sendq_add(cptr, outbuf, (size_t) count);
+		count1 -= count;
+	}
+	close(in);
+	if (count1 > 0)
+	{
+		slog(LG_INFO, "serve_file(): disconnecting fd %d (%s), read failed on %s", cptr->fd, cptr->hbuf, hd->filename);
+		cptr->flags |= CF_DEAD;
+	}
+	else
+		check_close(cptr);
+}
+
 static void
 httpd_recvqhandler(struct connection *cptr)
 {
@@ -176,23 +634,20 @@ httpd_recvqhandler(struct connection *cptr)
 	int count;
 	struct httpddata *hd;
 	char *p;
-	int in;
-	struct stat sb;
-	off_t count1;
-	mowgli_node_t *n;
 	struct path_handler *ph = NULL;
 	bool is_get, is_post, handling_done = false;
 
 	hd = cptr->userdata;
 
-	MOWGLI_ITER_FOREACH(n, httpd_path_handlers.head)
-	{
-		ph = (struct path_handler *)n->data;
-		handling_done = !strcmp(hd->filename, ph->path);
+	// Leave anything else the client sent queued until the deferred reply has gone out
+	if (hd->deferred)
+		return;
 
-		if (handling_done)
-			break;
-	}
+	// Looked up every time; the module providing the handler may have been unloaded
+	if (hd->filename[0] != '\0')
+		ph = mowgli_patricia_retrieve(httpd_path_handlers, hd->filename);
+
+	handling_done = (ph != NULL);
 
 	if (handling_done)
 	{
@@ -201,6 +656,14 @@ httpd_recvqhandler(struct connection *cptr)
 			count = recvq_get(cptr, hd->requestbuf + hd->lengthdone, hd->length - hd->lengthdone);
 			if (count <= 0)
 				return;
+			if (ph->body_progress != NULL &&
+			    ! ph->body_progress(cptr, (size_t) hd->lengthdone, (size_t) (hd->lengthdone + count)))
+			{
+				send_error(cptr, 413, "Request Entity Too Large", true);
+				sendq_add_eof(cptr);
+				clear_httpddata(hd);
+				return;
+			}
 			hd->lengthdone += count;
 			if (hd->lengthdone != hd->length)
 				return;
@@ -248,6 +711,10 @@ httpd_recvqhandler(struct connection *cptr)
 		p = strtok(NULL, "");
 		if (p == NULL || !strcmp(p, "HTTP/1.0"))
 			hd->connection_close = true;
+
+		// The reply to the last request allowed says the connection is closing
+		if (httpd_config.max_requests && ++hd->requests >= httpd_config.max_requests)
+			hd->connection_close = true;
 		slog(LG_DEBUG, "httpd_recvqhandler(): request %s for %s", hd->method, hd->filename);
 	}
 	else if (count == 0)
@@ -264,51 +731,19 @@ httpd_recvqhandler(struct connection *cptr)
 
 		hd->method[0] = '\0';
 
+		if (handling_done && is_get && ph->allow_get)
+		{
+			ph->handler(cptr, NULL);
+			clear_httpddata(hd);
+			return;
+		}
+
 		if (!handling_done)
 		{
-			in = open_file(hd->filename);
-			if (in == -1 || fstat(in, &sb) == -1 || !S_ISREG(sb.st_mode))
-			{
-				if (in != -1)
-					close(in);
-				slog(LG_DEBUG, "httpd_recvqhandler(): 404 for \2%s\2", hd->filename);
-				send_error(cptr, 404, "Not Found", is_get);
-				check_close(cptr);
-				return;
-			}
-			slog(LG_INFO, "httpd_recvqhandler(): 200 for %s", hd->filename);
-
-			snprintf(outbuf, sizeof outbuf,
-			         "HTTP/1.1 200 OK\r\n"
-			         "Server: %s/%s\r\n"
-			         "Content-Type: %s\r\n"
-			         "Content-Length: %lu\r\n"
-			         "\r\n",
-			         PACKAGE_TARNAME, PACKAGE_VERSION,
-			         content_type(hd->filename),
-			         (unsigned long) sb.st_size);
-
-			sendq_add(cptr, outbuf, strlen(outbuf));
-			count1 = is_get ? sb.st_size : 0;
-			while (count1 > 0)
-			{
-				count = sizeof outbuf;
-				if (count > count1)
-					count = count1;
-				count = read(in, outbuf, count);
-				if (count <= 0)
-					break;
-				sendq_add(cptr, outbuf, count);
-				count1 -= count;
-			}
-			close(in);
-			if (count1 > 0)
-			{
-				slog(LG_INFO, "httpd_recvqhandler(): disconnecting fd %d (%s), read failed on %s", cptr->fd, cptr->hbuf, hd->filename);
-				cptr->flags |= CF_DEAD;
-			}
-			else
-				check_close(cptr);
+			serve_file(cptr, is_get);
+
+			// Ready for the next request on this connection
+			clear_httpddata(hd);
 		}
 		else
 		{
@@ -356,7 +791,10 @@ httpd_closehandler(struct connection *cptr)
 	hd = cptr->userdata;
 	if (hd != NULL)
 	{
+		if (hd->deferred != NULL && hd->deferred_cancel != NULL)
+			hd->deferred_cancel(cptr, hd->deferred);
 		sfree(hd->requestbuf);
+		sfree(hd->bodystate);
 		sfree(hd);
 	}
 	cptr->userdata = NULL;
@@ -385,14 +823,20 @@ httpd_checkidle(void *arg)
 	struct connection *cptr;
 
 	(void)arg;
-	if (listener == NULL)
+	if (listener == NULL || !httpd_config.idle_timeout)
 		return;
 	MOWGLI_ITER_FOREACH_SAFE(n, tn, connection_list.head)
 	{
 		cptr = n->data;
-		if (cptr->listener == listener && cptr->last_recv + 300 < CURRTIME)
+		if (cptr->listener != listener || ((struct httpddata *) cptr->userdata)->streaming)
+			continue;
+		if (cptr->last_recv + (time_t) httpd_config.idle_timeout < CURRTIME)
 		{
+#ifdef HAVE_SYS_SENDFILE_H
+			if (sendq_nonempty(cptr) || cptr->write_handler == filesend_write)
+#else
 			if (sendq_nonempty(cptr))
+#endif
 				cptr->last_recv = CURRTIME;
 			else
 				/* from a timeout function,
@@ -411,20 +855,40 @@ httpd_config_ready(void *vptr)
 	{
 		// Some code depends on struct connection -> listener == listener.
 		if (listener != NULL)
-			return;
+		{
+			if (! conf_block_changed("httpd") ||
+			    (listener_port == httpd_config.port && ! strcmp(listener_host, httpd_config.host)))
+				return;
+
+			slog(LG_INFO, "httpd_config_ready(): moving listener from host %s port %u to host %s port %u",
+			     listener_host, listener_port, httpd_config.host, httpd_config.port);
+			connection_close_soon_children(listener);
+			listener = NULL;
+		}
 		listener = connection_open_listener_tcp(httpd_config.host,
 			httpd_config.port, do_listen);
 		if (listener == NULL)
 			slog(LG_ERROR, "httpd_config_ready(): failed to open listener on host %s port %u", httpd_config.host, httpd_config.port);
+		else
+		{
+			sfree(listener_host);
+			listener_host = sstrdup(httpd_config.host);
+			listener_port = httpd_config.port;
+		}
 	}
 	else
 		slog(LG_ERROR, "httpd_config_ready(): httpd {} block missing or invalid");
+
+	// The files themselves may have moved along with www_root
+	cache_trim(conf_block_changed("httpd") ? 0 : httpd_config.cache_size);
 }
 
 static void
 mod_init(struct module ATHEME_VATTR_UNUSED *const restrict m)
 {
-	httpd_checkidle_timer = mowgli_timer_add(base_eventloop, "httpd_checkidle", httpd_checkidle, NULL, SECONDS_PER_MINUTE);
+	httpd_path_handlers = mowgli_patricia_create(NULL);
+	httpd_cache = mowgli_patricia_create(NULL);
+	httpd_checkidle_timer = timer_add("httpd_checkidle", httpd_checkidle, NULL, HTTPD_CHECKIDLE_INTERVAL);
 
 	// This module needs a rehash to initialize fully if loaded at run time
 	hook_add_config_ready(httpd_config_ready);
@@ -433,19 +897,35 @@ mod_init(struct module ATHEME_VATTR_UNUSED *const restrict m)
 	add_dupstr_conf_item("HOST", &conf_httpd_table, 0, &httpd_config.host, NULL);
 	add_dupstr_conf_item("WWW_ROOT", &conf_httpd_table, 0, &httpd_config.www_root, NULL);
 	add_uint_conf_item("PORT", &conf_httpd_table, 0, &httpd_config.port, 1, 65535, 0);
+	add_uint_conf_item("MAX_REQUESTS", &conf_httpd_table, 0, &httpd_config.max_requests, 0, UINT_MAX, 100);
+	add_duration_conf_item("IDLE_TIMEOUT", &conf_httpd_table, 0, &httpd_config.idle_timeout, "s", 300);
+	add_uint_conf_item("CACHE_SIZE", &conf_httpd_table, 0, &httpd_config.cache_size, 0, UINT_MAX, 4194304);
+	add_uint_conf_item("CACHE_FILE_MAX", &conf_httpd_table, 0, &httpd_config.cache_file_max, 0, UINT_MAX, 65536);
 }
 
 static void
 mod_deinit(const enum module_unload_intent ATHEME_VATTR_UNUSED intent)
 {
-	mowgli_timer_destroy(base_eventloop, httpd_checkidle_timer);
+	timer_destroy(httpd_checkidle_timer);
 
 	hook_del_config_ready(httpd_config_ready);
 	connection_close_children(listener);
+	sfree(listener_host);
 	del_conf_item("HOST", &conf_httpd_table);
 	del_conf_item("WWW_ROOT", &conf_httpd_table);
 	del_conf_item("PORT", &conf_httpd_table);
+	del_conf_item("MAX_REQUESTS", &conf_httpd_table);
+	del_conf_item("IDLE_TIMEOUT", &conf_httpd_table);
+	del_conf_item("CACHE_SIZE", &conf_httpd_table);
+	del_conf_item("CACHE_FILE_MAX", &conf_httpd_table);
 	del_top_conf("HTTPD");
+
+	mowgli_patricia_destroy(httpd_path_handlers, NULL, NULL);
+	httpd_path_handlers = NULL;
+
+	cache_trim(0);
+	mowgli_patricia_destroy(httpd_cache, NULL, NULL);
+	httpd_cache = NULL;
 }
 
 SIMPLE_DECLARE_MODULE_V1("misc/httpd", MODULE_UNLOAD_CAPABILITY_OK)
@@ -0,0 +1,519 @@
+/*
+ * SPDX-License-Identifier: ISC
+ * SPDX-URL: https://spdx.org/licenses/ISC.html
+ *
+ * Copyright (C) 2026 Atheme Development Group (https://atheme.github.io/)
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * Exports counters in the Prometheus text format on the built-in HTTP
+ * server, at /metrics.
+ *
+ * Everything here is read from counters that the core keeps up to date as
+ * it goes (struct cnt, the command, timer and hook statistics, the last
+ * database save), so that a scrape never walks the user or channel lists.
+ */
+
+#include <atheme.h>
+
+#define METRICS_PATH            "/metrics"
+
+struct metrics_hook_sum
+{
+	const char *            hook;
+	const char *            module;
+	unsigned long long      calls;
+	unsigned long long      total_us;
+	unsigned long long      hist[HOOK_STATS_BUCKETS];
+};
+
+struct metrics_hook_collect
+{
+	const struct hook_handler_stats **      list;
+	size_t                                  count;
+	size_t                                  alloc;
+};
+
+static mowgli_patricia_t **httpd_path_handlers = NULL;
+
+static void ATHEME_FATTR_PRINTF(2, 3)
+metrics_printf(mowgli_string_t *const restrict str, const char *const restrict fmt, ...)
+{
+	char buf[BUFSIZE];
+	va_list ap;
+
+	va_start(ap, fmt);
+	const int len = vsnprintf(buf, sizeof buf, fmt, ap);
+	va_end(ap);
+
+	if (len > 0)
+		(void) mowgli_string_append(str, buf, ((size_t) len < sizeof buf) ? (size_t) len : (sizeof buf - 1));
+}
+
+static void
+metrics_header(mowgli_string_t *const restrict str, const char *const restrict name, const char *const restrict type,
+               const char *const restrict help)
+{
+	(void) metrics_printf(str, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+static void
+metrics_value(mowgli_string_t *const restrict str, const char *const restrict name, const char *const restrict type,
+              const char *const restrict help, const unsigned long long value)
+{
+	(void) metrics_header(str, name, type, help);
+	(void) metrics_printf(str, "%s %llu\n", name, value);
+}
+
+// Label values may not contain unescaped backslashes, quotes or newlines
+static const char *
+metrics_label(const char *const restrict in, char *const restrict out, const size_t outlen)
+{
+	size_t o = 0;
+
+	for (const char *p = in; *p != '\0' && o + 3 < outlen; p++)
+	{
+		if (*p == '\\' || *p == '"')
+			out[o++] = '\\';
+		else if (*p == '\n')
+		{
+			out[o++] = '\\';
+			out[o++] = 'n';
+			continue;
+		}
+
+		out[o++] = *p;
+	}
+
+	out[o] = '\0';
+
+	return out;
+}
+
+// The histograms count microseconds in power-of-two buckets; Prometheus wants seconds
+static void
+metrics_histogram(mowgli_string_t *const restrict str, const char *const restrict name,
+                  const char *const restrict labels, const unsigned int *const restrict hist32,
+                  const unsigned long long *const restrict hist64, const unsigned int buckets,
+                  const unsigned long long count, const unsigned long long total_us)
+{
+	unsigned long long seen = 0;
+
+	for (unsigned int i = 0; i < buckets - 1; i++)
+	{
+		const unsigned long long bound = 1ULL << (i + 1);
+
+		seen += (hist32 != NULL) ? hist32[i] : hist64[i];
+
+		(void) metrics_printf(str, "%s_bucket{%s,le=\"%llu.%06llu\"} %llu\n", name, labels,
+		                      bound / 1000000ULL, bound % 1000000ULL, seen);
+	}
+
+	(void) metrics_printf(str, "%s_bucket{%s,le=\"+Inf\"} %llu\n", name, labels, count);
+	(void) metrics_printf(str, "%s_sum{%s} %llu.%06llu\n", name, labels, total_us / 1000000ULL,
+	                      total_us % 1000000ULL);
+	(void) metrics_printf(str, "%s_count{%s} %llu\n", name, labels, count);
+}
+
+static void
+metrics_command_cb(const struct command_stats *const restrict st, void *const restrict privdata)
+{
+	char label[BUFSIZE];
+	char labels[BUFSIZE];
+
+	(void) snprintf(labels, sizeof labels, "command=\"%s\"", metrics_label(st->name, label, sizeof label));
+	(void) metrics_histogram(privdata, "atheme_command_duration_seconds", labels, st->hist, NULL,
+	                         COMMAND_STATS_BUCKETS, st->calls, st->total_us);
+}
+
+static void
+metrics_timer_cb(const struct timer_stats *const restrict st, void *const restrict privdata)
+{
+	mowgli_string_t *const str = privdata;
+	char label[BUFSIZE];
+
+	(void) metrics_label(st->name, label, sizeof label);
+	(void) metrics_printf(str, "atheme_timer_duration_seconds_sum{timer=\"%s\"} %llu.%06llu\n", label,
+	                      st->total_us / 1000000ULL, st->total_us % 1000000ULL);
+	(void) metrics_printf(str, "atheme_timer_duration_seconds_count{timer=\"%s\"} %u\n", label, st->runs);
+}
+
+static void
+metrics_pcommand_lines_cb(const struct proto_cmd *const restrict pcmd, void *const restrict privdata)
+{
+	char label[BUFSIZE];
+
+	if (pcmd->lines)
+		(void) metrics_printf(privdata, "atheme_protocol_messages_total{command=\"%s\"} %llu\n",
+		                      metrics_label(pcmd->token, label, sizeof label), pcmd->lines);
+}
+
+static void
+metrics_pcommand_bytes_cb(const struct proto_cmd *const restrict pcmd, void *const restrict privdata)
+{
+	char label[BUFSIZE];
+
+	if (pcmd->lines)
+		(void) metrics_printf(privdata, "atheme_protocol_message_bytes_total{command=\"%s\"} %llu\n",
+		                      metrics_label(pcmd->token, label, sizeof label), pcmd->bytes);
+}
+
+static void
+metrics_pcommand_time_cb(const struct proto_cmd *const restrict pcmd, void *const restrict privdata)
+{
+	char label[BUFSIZE];
+
+	if (pcmd->lines)
+		(void) metrics_printf(privdata, "atheme_protocol_handler_seconds_total{command=\"%s\"} %llu.%06llu\n",
+		                      metrics_label(pcmd->token, label, sizeof label),
+		                      pcmd->total_us / 1000000ULL, pcmd->total_us % 1000000ULL);
+}
+
+static void
+metrics_hook_collect_cb(const struct hook_handler_stats *const restrict st, void *const restrict privdata)
+{
+	struct metrics_hook_collect *const hc = privdata;
+
+	if (! st->calls)
+		return;
+
+	if (hc->count == hc->alloc)
+	{
+		hc->alloc = hc->alloc ? (hc->alloc * 2) : 64;
+		hc->list = sreallocarray(hc->list, hc->alloc, sizeof *hc->list);
+	}
+
+	hc->list[hc->count++] = st;
+}
+
+static int
+metrics_hook_compare(const void *const restrict a, const void *const restrict b)
+{
+	const struct hook_handler_stats *const sa = *(const struct hook_handler_stats *const *) a;
+	const struct hook_handler_stats *const sb = *(const struct hook_handler_stats *const *) b;
+	const int ret = strcmp(sa->hook, sb->hook);
+
+	if (ret != 0)
+		return ret;
+
+	return strcmp((sa->module != NULL) ? sa->module : "", (sb->module != NULL) ? sb->module : "");
+}
+
+static void
+metrics_hook_emit(mowgli_string_t *const restrict str, const struct metrics_hook_sum *const restrict sum)
+{
+	char hook[BUFSIZE];
+	char module[BUFSIZE];
+	char labels[BUFSIZE * 2];
+
+	(void) snprintf(labels, sizeof labels, "hook=\"%s\",module=\"%s\"", metrics_label(sum->hook, hook, sizeof hook),
+	                metrics_label((sum->module != NULL) ? sum->module : "", module, sizeof module));
+	(void) metrics_histogram(str, "atheme_hook_duration_seconds", labels, NULL, sum->hist, HOOK_STATS_BUCKETS,
+	                         sum->calls, sum->total_us);
+}
+
+// Handlers of one hook from one module are added up, or their series would clash
+static void
+metrics_hooks(mowgli_string_t *const restrict str)
+{
+	struct metrics_hook_collect hc = { NULL, 0, 0 };
+	struct metrics_hook_sum sum;
+
+	(void) hook_stats_foreach(&metrics_hook_collect_cb, &hc);
+
+	if (! hc.count)
+		return;
+
+	(void) qsort(hc.list, hc.count, sizeof *hc.list, &metrics_hook_compare);
+	(void) metrics_header(str, "atheme_hook_duration_seconds", "histogram",
+	                      "Time spent in hook handlers, per hook and module (only while hook_profiling is on).");
+
+	for (size_t i = 0; i < hc.count; i++)
+	{
+		const struct hook_handler_stats *const st = hc.list[i];
+
+		if (i == 0 || metrics_hook_compare(&hc.list[i - 1], &hc.list[i]) != 0)
+		{
+			if (i != 0)
+				(void) metrics_hook_emit(str, &sum);
+
+			(void) memset(&sum, 0x00, sizeof sum);
+			sum.hook = st->hook;
+			sum.module = st->module;
+		}
+
+		sum.calls += st->calls;
+		sum.total_us += st->total_us;
+
+		for (unsigned int j = 0; j < HOOK_STATS_BUCKETS; j++)
+			sum.hist[j] += st->hist[j];
+	}
+
+	(void) metrics_hook_emit(str, &sum);
+	(void) sfree(hc.list);
+}
+
+// Looked up each time rather than with module_locate_symbol(), which would make us depend on saslserv/main
+static void
+metrics_sasl(mowgli_string_t *const restrict str)
+{
+	struct module *const m = module_find_published("saslserv/main");
+
+	if (! m || ! m->handle)
+		return;
+
+	const struct sasl_session_stats *const st = mowgli_module_symbol(m->handle, "sasl_session_stats");
+
+	if (! st)
+		return;
+
+	(void) metrics_value(str, "atheme_sasl_sessions", "gauge", "SASL sessions in progress.", st->active);
+	(void) metrics_value(str, "atheme_sasl_sessions_peak", "gauge", "Most SASL sessions in progress at once.",
+	                     st->peak);
+	(void) metrics_value(str, "atheme_sasl_sessions_total", "counter", "SASL sessions started.", st->started);
+	(void) metrics_value(str, "atheme_sasl_sessions_timed_out_total", "counter",
+	                     "SASL sessions abandoned for making no progress.", st->timed_out);
+
+	const mowgli_list_t *const mstats = mowgli_module_symbol(m->handle, "sasl_mech_stats");
+	mowgli_node_t *n;
+
+	if (! mstats)
+		return;
+
+	(void) metrics_header(str, "atheme_sasl_outcomes_total", "counter",
+	                      "SASL sessions per mechanism, by how they ended.");
+
+	MOWGLI_ITER_FOREACH(n, mstats->head)
+	{
+		const struct sasl_mech_stats *const ms = n->data;
+		char label[BUFSIZE];
+
+		(void) metrics_label(ms->name, label, sizeof label);
+		(void) metrics_printf(str, "atheme_sasl_outcomes_total{mechanism=\"%s\",outcome=\"succeeded\"} %llu\n"
+		                      "atheme_sasl_outcomes_total{mechanism=\"%s\",outcome=\"failed\"} %llu\n"
+		                      "atheme_sasl_outcomes_total{mechanism=\"%s\",outcome=\"errored\"} %llu\n",
+		                      label, ms->succeeded, label, ms->failed, label, ms->errored);
+		(void) metrics_printf(str, "atheme_sasl_outcomes_total{mechanism=\"%s\",outcome=\"aborted\"} %llu\n"
+		                      "atheme_sasl_outcomes_total{mechanism=\"%s\",outcome=\"timed_out\"} %llu\n",
+		                      label, ms->aborted, label, ms->timed_out);
+	}
+
+	(void) metrics_header(str, "atheme_sasl_steps_total", "counter", "SASL mechanism steps run, per mechanism.");
+
+	MOWGLI_ITER_FOREACH(n, mstats->head)
+	{
+		const struct sasl_mech_stats *const ms = n->data;
+		char label[BUFSIZE];
+
+		(void) metrics_printf(str, "atheme_sasl_steps_total{mechanism=\"%s\"} %llu\n",
+		                      metrics_label(ms->name, label, sizeof label), ms->steps);
+	}
+
+	(void) metrics_header(str, "atheme_sasl_exchange_duration_seconds", "histogram",
+	                      "Time from choosing a SASL mechanism to the result, per mechanism.");
+
+	MOWGLI_ITER_FOREACH(n, mstats->head)
+	{
+		const struct sasl_mech_stats *const ms = n->data;
+		char label[BUFSIZE];
+		char labels[BUFSIZE];
+
+		(void) snprintf(labels, sizeof labels, "mechanism=\"%s\"", metrics_label(ms->name, label, sizeof label));
+		(void) metrics_histogram(str, "atheme_sasl_exchange_duration_seconds", labels, ms->hist, NULL,
+		                         SASL_MECH_STATS_BUCKETS, ms->succeeded + ms->failed + ms->errored, ms->total_us);
+	}
+
+	(void) metrics_header(str, "atheme_sasl_server_duration_seconds", "histogram",
+	                      "Time services spent on a SASL exchange, including asynchronous verification, "
+	                      "per mechanism.");
+
+	MOWGLI_ITER_FOREACH(n, mstats->head)
+	{
+		const struct sasl_mech_stats *const ms = n->data;
+		char label[BUFSIZE];
+		char labels[BUFSIZE];
+
+		(void) snprintf(labels, sizeof labels, "mechanism=\"%s\"", metrics_label(ms->name, label, sizeof label));
+		(void) metrics_histogram(str, "atheme_sasl_server_duration_seconds", labels, ms->server_hist, NULL,
+		                         SASL_MECH_STATS_BUCKETS, ms->succeeded + ms->failed + ms->errored,
+		                         ms->server_us);
+	}
+}
+
+// Likewise for chanserv/akick
+static void
+metrics_akick(mowgli_string_t *const restrict str)
+{
+	struct module *const m = module_find_published("chanserv/akick");
+
+	if (! m || ! m->handle)
+		return;
+
+	const unsigned long long *const checks = mowgli_module_symbol(m->handle, "akick_checks");
+	const unsigned long long *const matches = mowgli_module_symbol(m->handle, "akick_matches");
+
+	if (! checks || ! matches)
+		return;
+
+	(void) metrics_value(str, "atheme_akick_checks_total", "counter",
+	                     "Channel members checked against the AKICK list, on joining and whenever their access "
+	                     "is re-evaluated.", *checks);
+	(void) metrics_value(str, "atheme_akick_matches_total", "counter",
+	                     "Users found to be on a channel's AKICK list.", *matches);
+}
+
+static void
+metrics_build(mowgli_string_t *const restrict str)
+{
+	struct crypt_verify_stats cvs;
+	struct rusage ru;
+
+	(void) metrics_value(str, "atheme_users", "gauge", "Users on the network.", cnt.user);
+	(void) metrics_value(str, "atheme_channels", "gauge", "Channels on the network.", cnt.chan);
+	(void) metrics_value(str, "atheme_chanusers", "gauge", "Channel memberships on the network.", cnt.chanuser);
+	(void) metrics_value(str, "atheme_servers", "gauge", "Servers on the network.", cnt.server);
+	(void) metrics_value(str, "atheme_myusers", "gauge", "Registered accounts.", cnt.myuser);
+	(void) metrics_value(str, "atheme_mynicks", "gauge", "Registered nicknames.", cnt.mynick);
+	(void) metrics_value(str, "atheme_mychans", "gauge", "Registered channels.", cnt.mychan);
+	(void) metrics_value(str, "atheme_chanacs", "gauge", "Channel access entries.", cnt.chanacs);
+	(void) metrics_value(str, "atheme_klines", "gauge", "Network bans set by services.", cnt.kline);
+
+	(void) metrics_value(str, "atheme_sendq_bytes", "gauge", "Bytes queued for sending, on all connections.",
+	                     cnt.sendq);
+	(void) metrics_value(str, "atheme_recvq_bytes", "gauge", "Bytes received and not yet processed.", cnt.recvq);
+	(void) metrics_value(str, "atheme_sendq_pool_bytes", "gauge", "Bytes held in send and receive queue slabs, not counting the uplink.",
+	                     sendq_pool.bytes);
+	(void) metrics_value(str, "atheme_heap_deferred_frees", "gauge",
+	                     "Freed objects not yet handed back to their heaps.", named_heap_deferred.pending);
+	(void) metrics_value(str, "atheme_received_bytes_total", "counter", "Bytes received and processed.", cnt.bin);
+	(void) metrics_value(str, "atheme_sent_bytes_total", "counter", "Bytes queued for sending.", cnt.bout);
+	(void) metrics_value(str, "atheme_write_calls_total", "counter", "Write system calls made to send queues.",
+	                     cnt.bout_writes);
+	(void) metrics_value(str, "atheme_mailqueue_queued", "gauge", "Emails waiting for or being sent to the relay.",
+	                     mailqueue_stats.queued);
+	(void) metrics_value(str, "atheme_mailqueue_submitted_total", "counter", "Emails queued for the relay.",
+	                     mailqueue_stats.submitted);
+	(void) metrics_value(str, "atheme_mailqueue_delivered_total", "counter", "Emails accepted by the relay.",
+	                     mailqueue_stats.delivered);
+	(void) metrics_value(str, "atheme_mailqueue_deferred_total", "counter",
+	                     "Email delivery attempts that failed temporarily.", mailqueue_stats.deferred);
+	(void) metrics_value(str, "atheme_mailqueue_failed_total", "counter",
+	                     "Emails rejected by the relay or given up on.", mailqueue_stats.failed);
+	(void) metrics_value(str, "atheme_mailqueue_connections_total", "counter", "Connections made to the relay.",
+	                     mailqueue_stats.connections);
+	(void) metrics_value(str, "atheme_log_dropped_total", "counter",
+	                     "Debug and verbose log messages dropped because the log writer fell behind.",
+	                     log_writer_dropped());
+
+	(void) metrics_value(str, "atheme_db_changes_total", "counter",
+	                     "Changes to accounts, channels and the like counted for deciding when to save.",
+	                     db_changes.total);
+	(void) metrics_value(str, "atheme_db_unsaved_changes", "gauge",
+	                     "Changes made since the last database save started.", db_changes.unsaved);
+
+	if (db_last_save.finished)
+	{
+		(void) metrics_header(str, "atheme_db_save_duration_seconds", "gauge",
+		                      "How long the last database save took.");
+		(void) metrics_printf(str, "atheme_db_save_duration_seconds %u.%03u\n", db_last_save.duration / 1000U,
+		                      db_last_save.duration % 1000U);
+		(void) metrics_value(str, "atheme_db_save_bytes", "gauge", "Size of the last database written.",
+		                     db_last_save.bytes);
+
+		if (db_last_save.uncompressed)
+			(void) metrics_value(str, "atheme_db_save_uncompressed_bytes", "gauge",
+			                     "Size of the last database written, before compression.",
+			                     db_last_save.uncompressed);
+		(void) metrics_value(str, "atheme_db_save_timestamp_seconds", "gauge",
+		                     "When the last database save finished.", (unsigned long long) db_last_save.finished);
+	}
+
+	(void) crypt_get_verify_stats(&cvs);
+	(void) metrics_value(str, "atheme_password_hashes_dispatched_total", "counter",
+	                     "Password hashes verified by the crypto provider owning their prefix.", cvs.dispatched);
+	(void) metrics_value(str, "atheme_password_hashes_probed_total", "counter",
+	                     "Password hashes with no known prefix, tried against each legacy crypto provider.",
+	                     cvs.probed);
+	(void) metrics_value(str, "atheme_password_hash_probe_calls_total", "counter",
+	                     "Crypto provider calls made while probing password hashes.", cvs.probe_calls);
+
+	(void) memset(&ru, 0x00, sizeof ru);
+
+	if (getrusage(RUSAGE_SELF, &ru) == 0)
+		(void) metrics_value(str, "atheme_max_rss_bytes", "gauge", "Largest resident set size so far.",
+		                     ((unsigned long long) ru.ru_maxrss) * 1024ULL);
+
+	(void) metrics_header(str, "atheme_command_duration_seconds", "histogram", "Time spent executing commands.");
+	(void) command_stats_foreach(&metrics_command_cb, str);
+
+	(void) metrics_header(str, "atheme_timer_duration_seconds", "summary",
+	                      "Time spent in timers and connection handlers.");
+	(void) timer_stats_foreach(&metrics_timer_cb, str);
+
+	(void) metrics_header(str, "atheme_protocol_messages_total", "counter",
+	                      "Lines received from the uplink, by protocol command.");
+	(void) pcommand_stats_foreach(&metrics_pcommand_lines_cb, str);
+	(void) metrics_header(str, "atheme_protocol_message_bytes_total", "counter",
+	                      "Bytes received from the uplink, by protocol command.");
+	(void) pcommand_stats_foreach(&metrics_pcommand_bytes_cb, str);
+	(void) metrics_header(str, "atheme_protocol_handler_seconds_total", "counter",
+	                      "Time spent handling lines from the uplink, by protocol command.");
+	(void) pcommand_stats_foreach(&metrics_pcommand_time_cb, str);
+
+	(void) metrics_hooks(str);
+	(void) metrics_sasl(str);
+	(void) metrics_akick(str);
+}
+
+static void
+metrics_handle_request(struct connection *const restrict cptr, void ATHEME_VATTR_UNUSED *const restrict unused)
+{
+	struct httpddata *const hd = cptr->userdata;
+	mowgli_string_t *const str = mowgli_string_create();
+	char header[300];
+
+	(void) metrics_build(str);
+
+	(void) snprintf(header, sizeof header,
+	                "HTTP/1.1 200 OK\r\n"
+	                "Server: %s/%s\r\n"
+	                "Content-Type: text/plain; version=0.0.4\r\n"
+	                "Content-Length: %zu\r\n"
+	                "%s"
+	                "\r\n",
+	                PACKAGE_TARNAME, PACKAGE_VERSION, str->pos,
+	                hd->connection_close ? "Connection: close\r\n" : "");
+
+	(void) sendq_add(cptr, header, strlen(header));
+	(void) sendq_add(cptr, str->str, str->pos);
+
+	if (hd->connection_close)
+		(void) sendq_add_eof(cptr);
+
+	(void) mowgli_string_destroy(str);
+}
+
+static struct path_handler metrics_path_handler = {
+	.path           = METRICS_PATH,
+	.handler        = &metrics_handle_request,
+	.allow_get      = true,
+};
+
+static void
+mod_init(struct module *const restrict m)
+{
+	MODULE_TRY_REQUEST_SYMBOL(m, httpd_path_handlers, "misc/httpd", "httpd_path_handlers")
+
+	(void) mowgli_patricia_add(*httpd_path_handlers, metrics_path_handler.path, &metrics_path_handler);
+}
+
+static void
+mod_deinit(const enum module_unload_intent ATHEME_VATTR_UNUSED intent)
+{
+	if (mowgli_patricia_retrieve(*httpd_path_handlers, metrics_path_handler.path) == &metrics_path_handler)
+		(void) mowgli_patricia_delete(*httpd_path_handlers, metrics_path_handler.path);
+}
+
+SIMPLE_DECLARE_MODULE_V1("misc/metrics", MODULE_UNLOAD_CAPABILITY_OK)
@@ -77,7 +77,7 @@ construct_mask(struct user *u)
 	}
 	else if (username_is_random(u->user))
 		snprintf(mask, sizeof mask, "*@%s", u->host);
-	else if (u->ip != NULL && !strcmp(u->host, u->ip) &&
+	else if (u->ip != NULL && u->host == u->ip &&
 			(p = strrchr(u->ip, '.')) != NULL)
 		snprintf(mask, sizeof mask, "%s@%.*s.0/24", u->user, (int)(p - u->ip), u->ip);
 	else
@@ -14,7 +14,7 @@ ns_cmd_cert(struct sourceinfo *si, int parc, char *parv[])
 {
 	struct myuser *mu;
 	mowgli_node_t *n, *tn;
-	char *mcfp;
+	const char *mcfp;
 	struct mycertfp *cert;
 
 	if (parc < 1)
@@ -112,7 +112,7 @@ ns_cmd_cert(struct sourceinfo *si, int parc, char *parv[])
 		mu = si->smu;
 		if (parc < 2)
 		{
-			mcfp = si->su != NULL ? si->su->certfp : NULL;
+			mcfp = si->su != NULL ? user_certfp(si->su) : NULL;
 
 			if (mcfp == NULL)
 			{
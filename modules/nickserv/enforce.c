@@ -20,17 +20,16 @@
 struct enforce_timeout
 {
 	char nick[NICKLEN + 1];
-	char host[HOSTLEN + 1];
+	stringref host;
 	time_t timelimit;
 	mowgli_node_t node;
+	struct timerwheel_entry timer;
 };
 
 static mowgli_heap_t *enforce_timeout_heap = NULL;
-static mowgli_eventloop_timer_t *enforce_timeout_check_timer = NULL;
 static mowgli_eventloop_timer_t *enforce_remove_enforcers_timer = NULL;
 
 static mowgli_list_t enforce_list;
-static time_t enforce_next;
 
 static mowgli_patricia_t **ns_set_cmdtree;
 
@@ -39,7 +38,6 @@ static bool
 log_enforce_victim_out(struct user *u, struct myuser *mu)
 {
 	struct mynick *mn;
-	mowgli_node_t *n, *tn;
 
 	return_val_if_fail(u != NULL, false);
 
@@ -53,16 +51,9 @@ log_enforce_victim_out(struct user *u, struct myuser *mu)
 
 	if (!ircd_logout_or_kill(u, entity(u->myuser)->name))
 	{
-		MOWGLI_ITER_FOREACH_SAFE(n, tn, u->myuser->logins.head)
-		{
-			if (n->data == u)
-			{
-				mowgli_node_delete(n, &u->myuser->logins);
-				mowgli_node_free(n);
-				break;
-			}
-		}
+		mowgli_node_delete(&u->mlnode, &u->myuser->logins);
 
+		hook_call_user_logout(u);
 		u->myuser = NULL;
 		return false;
 	}
@@ -92,48 +83,44 @@ guest_nickname(struct user *u)
 }
 
 static void
-enforce_timeout_check(void *arg)
+enforce_timeout_free(struct enforce_timeout *timeout)
 {
-	mowgli_node_t *n, *tn;
-	struct enforce_timeout *timeout;
+	mowgli_node_delete(&timeout->node, &enforce_list);
+	timerwheel_cancel(&timeout->timer);
+	strshare_unref(timeout->host);
+	mowgli_heap_free(enforce_timeout_heap, timeout);
+}
+
+static void
+enforce_timeout_expire(void *arg)
+{
+	struct enforce_timeout *timeout = arg;
 	struct user *u;
 	struct mynick *mn;
 	bool valid;
 
-	enforce_next = 0;
-	MOWGLI_ITER_FOREACH_SAFE(n, tn, enforce_list.head)
-	{
-		timeout = n->data;
-		if (timeout->timelimit > CURRTIME)
-		{
-			enforce_next = timeout->timelimit;
-			enforce_timeout_check_timer = mowgli_timer_add_once(base_eventloop, "enforce_timeout_check", enforce_timeout_check, NULL, enforce_next - CURRTIME);
-			break; // assume sorted list
-		}
-		u = user_find_named(timeout->nick);
-		mn = mynick_find(timeout->nick);
-		valid = u != NULL && mn != NULL && (!strcmp(u->host, timeout->host) || !strcmp(u->vhost, timeout->host));
-		mowgli_node_delete(&timeout->node, &enforce_list);
-		mowgli_heap_free(enforce_timeout_heap, timeout);
-		if (!valid)
-			continue;
-		if (is_internal_client(u))
-			continue;
-		if (u->myuser == mn->owner)
-			continue;
-		if (myuser_access_verify(u, mn->owner))
-			continue;
-		if (!metadata_find(mn->owner, "private:doenforce"))
-			continue;
-
-		notice(nicksvs.nick, u->nick, "You failed to identify in time for the nickname %s", mn->nick);
-		guest_nickname(u);
-		if (ircd->flags & IRCD_HOLDNICK)
-			holdnick_sts(nicksvs.me->me, u->flags & UF_WASENFORCED ? SECONDS_PER_HOUR : 30, u->nick, mn->owner);
-		else
-			u->flags |= UF_DOENFORCE;
-		u->flags |= UF_WASENFORCED;
-	}
+	u = user_find_named(timeout->nick);
+	mn = mynick_find(timeout->nick);
+	valid = u != NULL && mn != NULL && (u->host == timeout->host || u->vhost == timeout->host);
+	enforce_timeout_free(timeout);
+	if (!valid)
+		return;
+	if (is_internal_client(u))
+		return;
+	if (u->myuser == mn->owner)
+		return;
+	if (myuser_access_verify(u, mn->owner))
+		return;
+	if (!metadata_find(mn->owner, "private:doenforce"))
+		return;
+
+	notice(nicksvs.nick, u->nick, "You failed to identify in time for the nickname %s", mn->nick);
+	guest_nickname(u);
+	if (ircd->flags & IRCD_HOLDNICK)
+		holdnick_sts(nicksvs.me->me, u->flags & UF_WASENFORCED ? SECONDS_PER_HOUR : 30, u->nick, mn->owner);
+	else
+		u->flags |= UF_DOENFORCE;
+	u->flags |= UF_WASENFORCED;
 }
 
 static void
@@ -163,7 +150,7 @@ check_enforce(struct hook_nick_enforce *hdata)
 	MOWGLI_ITER_FOREACH(n, enforce_list.head)
 	{
 		timeout2 = n->data;
-		if (!irccasecmp(hdata->mn->nick, timeout2->nick) && (!strcmp(hdata->u->host, timeout2->host) || !strcmp(hdata->u->vhost, timeout2->host)))
+		if (!irccasecmp(hdata->mn->nick, timeout2->nick) && (hdata->u->host == timeout2->host || hdata->u->vhost == timeout2->host))
 		{
 			timeout = timeout2;
 			break;
@@ -175,7 +162,7 @@ check_enforce(struct hook_nick_enforce *hdata)
 	{
 		timeout = mowgli_heap_alloc(enforce_timeout_heap);
 		mowgli_strlcpy(timeout->nick, hdata->mn->nick, sizeof timeout->nick);
-		mowgli_strlcpy(timeout->host, hdata->u->host, sizeof timeout->host);
+		timeout->host = strshare_ref(hdata->u->host);
 
 		if (!metadata_find(hdata->mn->owner, "private:enforcetime"))
 			timeout->timelimit = CURRTIME + nicksvs.enforce_delay;
@@ -186,27 +173,8 @@ check_enforce(struct hook_nick_enforce *hdata)
 			timeout->timelimit = CURRTIME + enforcetime;
 		}
 
-		// insert in sorted order
-		MOWGLI_ITER_FOREACH_PREV(n, enforce_list.tail)
-		{
-			timeout2 = n->data;
-			if (timeout2->timelimit <= timeout->timelimit)
-				break;
-		}
-		if (n == NULL)
-			mowgli_node_add_head(timeout, &timeout->node, &enforce_list);
-		else if (n->next == NULL)
-			mowgli_node_add(timeout, &timeout->node, &enforce_list);
-		else
-			mowgli_node_add_before(timeout, &timeout->node, &enforce_list, n->next);
-
-		if (enforce_next == 0 || enforce_next > timeout->timelimit)
-		{
-			if (enforce_next != 0)
-				mowgli_timer_destroy(base_eventloop, enforce_timeout_check_timer);
-			enforce_next = timeout->timelimit;
-			enforce_timeout_check_timer = mowgli_timer_add_once(base_eventloop, "enforce_timeout_check", enforce_timeout_check, NULL, enforce_next - CURRTIME);
-		}
+		mowgli_node_add(timeout, &timeout->node, &enforce_list);
+		timerwheel_add(&timeout->timer, enforce_timeout_expire, timeout, timeout->timelimit);
 	}
 
 	notice(nicksvs.nick, hdata->u->nick, "You have %u seconds to identify to your nickname before it is changed.", (unsigned int)(timeout->timelimit - CURRTIME));
@@ -335,10 +303,9 @@ ns_cmd_release(struct sourceinfo *si, int parc, char *parv[])
 			MOWGLI_ITER_FOREACH_SAFE(n, tn, enforce_list.head)
 			{
 				timeout = n->data;
-				if (!irccasecmp(mn->nick, timeout->nick) && (!strcmp(si->su->host, timeout->host) || !strcmp(si->su->vhost, timeout->host)))
+				if (!irccasecmp(mn->nick, timeout->nick) && (si->su->host == timeout->host || si->su->vhost == timeout->host))
 				{
-					mowgli_node_delete(&timeout->node, &enforce_list);
-					mowgli_heap_free(enforce_timeout_heap, timeout);
+					enforce_timeout_free(timeout);
 				}
 			}
 		}
@@ -473,15 +440,8 @@ ns_cmd_regain(struct sourceinfo *si, int parc, char *parv[])
 					// logout killed the user...
 					return;
 				si->smu->lastlogin = CURRTIME;
-				MOWGLI_ITER_FOREACH_SAFE(n, tn, si->smu->logins.head)
-				{
-					if (n->data == si->su)
-					{
-						mowgli_node_delete(n, &si->smu->logins);
-						mowgli_node_free(n);
-						break;
-					}
-				}
+				mowgli_node_delete(&si->su->mlnode, &si->smu->logins);
+				hook_call_user_logout(si->su);
 				si->su->myuser = NULL;
 			}
 
@@ -507,10 +467,9 @@ ns_cmd_regain(struct sourceinfo *si, int parc, char *parv[])
 			MOWGLI_ITER_FOREACH_SAFE(n, tn, enforce_list.head)
 			{
 				timeout = n->data;
-				if (!irccasecmp(mn->nick, timeout->nick) && (!strcmp(si->su->host, timeout->host) || !strcmp(si->su->vhost, timeout->host)))
+				if (!irccasecmp(mn->nick, timeout->nick) && (si->su->host == timeout->host || si->su->vhost == timeout->host))
 				{
-					mowgli_node_delete(&timeout->node, &enforce_list);
-					mowgli_heap_free(enforce_timeout_heap, timeout);
+					enforce_timeout_free(timeout);
 				}
 			}
 		}
@@ -670,7 +629,7 @@ mod_init(struct module *const restrict m)
 		return;
 	}
 
-	enforce_remove_enforcers_timer = mowgli_timer_add(base_eventloop, "enforce_remove_enforcers", enforce_remove_enforcers, NULL, 5 * SECONDS_PER_MINUTE);
+	enforce_remove_enforcers_timer = timer_add("enforce_remove_enforcers", enforce_remove_enforcers, NULL, 5 * SECONDS_PER_MINUTE);
 
 	service_named_bind_command("nickserv", &ns_release);
 	service_named_bind_command("nickserv", &ns_regain);
@@ -683,12 +642,14 @@ mod_init(struct module *const restrict m)
 static void
 mod_deinit(const enum module_unload_intent ATHEME_VATTR_UNUSED intent)
 {
+	mowgli_node_t *n, *tn;
+
 	enforce_remove_enforcers(NULL);
 
-	mowgli_timer_destroy(base_eventloop, enforce_remove_enforcers_timer);
+	timer_destroy(enforce_remove_enforcers_timer);
 
-	if (enforce_next)
-		mowgli_timer_destroy(base_eventloop, enforce_timeout_check_timer);
+	MOWGLI_ITER_FOREACH_SAFE(n, tn, enforce_list.head)
+		enforce_timeout_free(n->data);
 
 	service_named_unbind_command("nickserv", &ns_release);
 	service_named_unbind_command("nickserv", &ns_regain);
@@ -84,7 +84,7 @@ ns_cmd_ghost(struct sourceinfo *si, int parc, char *parv[])
 		logcommand(si, CMDLOG_DO, "GHOST: \2%s!%s@%s\2", target_u->nick, target_u->user, target_u->vhost);
 
 		kill_user(si->service->me, target_u, "GHOST command used by %s",
-				si->su != NULL && !strcmp(si->su->user, target_u->user) && !strcmp(si->su->vhost, target_u->vhost) ? si->su->nick : get_source_mask(si));
+				si->su != NULL && si->su->user == target_u->user && si->su->vhost == target_u->vhost ? si->su->nick : get_source_mask(si));
 
 		command_success_nodata(si, _("\2%s\2 has been ghosted."), target);
 
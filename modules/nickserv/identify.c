@@ -20,15 +20,104 @@
 #define COMMAND_DESC	N_("Identifies to services for a nickname.")
 #endif
 
+// A login waiting for verify_password_async()
+struct ns_login_request
+{
+	struct command_pending *    cp;
+	struct pwverify_request *   req;
+};
+
+static struct command ns_login;
+
+// The user went away while the password was being checked
+static void
+ns_login_cancel(void *const restrict priv)
+{
+	struct ns_login_request *const lr = priv;
+
+	(void) verify_password_async_cancel(lr->req);
+	(void) sfree(lr);
+}
+
+static void
+ns_login_verified(struct myuser *const restrict mu, const bool verified, void *const restrict priv)
+{
+	struct ns_login_request *const lr = priv;
+	struct sourceinfo *const si = command_resume(lr->cp);
+	struct user *const u = (si ? si->su : NULL);
+	mowgli_node_t *n;
+	char lau[BUFSIZE];
+
+	// The account was dropped while the password was being checked
+	if (! u || ! mu)
+		goto out;
+
+	if (! verified)
+	{
+		logcommand(si, CMDLOG_LOGIN, "failed " COMMAND_UC " to \2%s\2 (bad password)", entity(mu)->name);
+
+		command_fail(si, fault_authfail, _("Invalid password for \2%s\2."), entity(mu)->name);
+		bad_password(si, mu);
+		goto out;
+	}
+
+	if (u->myuser == mu)
+	{
+		command_fail(si, fault_nochange, _("You are already logged in as \2%s\2."), entity(u->myuser)->name);
+		goto out;
+	}
+
+	if (! (mu->flags & MU_LOGINNOLIMIT)
+		&& !has_priv_myuser(mu, PRIV_LOGIN_NOLIMIT)
+		&& MOWGLI_LIST_LENGTH(&mu->logins) >= me.maxlogins)
+	{
+		command_fail(si, fault_toomany, _("There are already \2%zu\2 sessions logged in to \2%s\2 (maximum allowed: %u)."), MOWGLI_LIST_LENGTH(&mu->logins), entity(mu)->name, me.maxlogins);
+		lau[0] = '\0';
+		MOWGLI_ITER_FOREACH(n, mu->logins.head)
+		{
+			if (lau[0] != '\0')
+				mowgli_strlcat(lau, ", ", sizeof lau);
+			mowgli_strlcat(lau, ((struct user *)n->data)->nick, sizeof lau);
+		}
+		command_fail(si, fault_toomany, _("Logged in nicks are: %s"), lau);
+		logcommand(si, CMDLOG_LOGIN, "failed " COMMAND_UC " to \2%s\2 (too many logins)", entity(mu)->name);
+		goto out;
+	}
+
+	// if they are identified to another account, nuke their session first
+	if (u->myuser)
+	{
+		command_success_nodata(si, _("You have been logged out of \2%s\2."), entity(u->myuser)->name);
+
+		if (ircd_on_logout(u, entity(u->myuser)->name))
+			// logout killed the user...
+			goto out;
+	        u->myuser->lastlogin = CURRTIME;
+	        mowgli_node_delete(&u->mlnode, &u->myuser->logins);
+	        hook_call_user_logout(u);
+	        u->myuser = NULL;
+	}
+
+	command_success_nodata(si, nicksvs.no_nick_ownership ? _("You are now logged in as \2%s\2.") : _("You are now identified for \2%s\2."), entity(mu)->name);
+
+	if (!(mu->flags & MU_CRYPTPASS))
+		(void) command_success_nodata(si, _("Warning: Your password is not encrypted."));
+
+	myuser_login(si->service, u, mu, true);
+	logcommand(si, CMDLOG_LOGIN, COMMAND_UC);
+
+out:
+	(void) command_finish(lr->cp);
+	(void) sfree(lr);
+}
+
 static void
 ns_cmd_login(struct sourceinfo *si, int parc, char *parv[])
 {
 	struct user *u = si->su;
 	struct myuser *mu;
-	mowgli_node_t *n, *tn;
 	const char *target = parv[0];
 	const char *password = parv[1];
-	char lau[BUFSIZE];
 
 	if (si->su == NULL)
 	{
@@ -118,61 +207,22 @@ ns_cmd_login(struct sourceinfo *si, int parc, char *parv[])
 		return;
 	}
 
-	if (verify_password(mu, password))
+	if (command_pending_find(u, &ns_login))
 	{
-		if (! (mu->flags & MU_LOGINNOLIMIT)
-			&& !has_priv_myuser(mu, PRIV_LOGIN_NOLIMIT)
-			&& MOWGLI_LIST_LENGTH(&mu->logins) >= me.maxlogins)
-		{
-			command_fail(si, fault_toomany, _("There are already \2%zu\2 sessions logged in to \2%s\2 (maximum allowed: %u)."), MOWGLI_LIST_LENGTH(&mu->logins), entity(mu)->name, me.maxlogins);
-			lau[0] = '\0';
-			MOWGLI_ITER_FOREACH(n, mu->logins.head)
-			{
-				if (lau[0] != '\0')
-					mowgli_strlcat(lau, ", ", sizeof lau);
-				mowgli_strlcat(lau, ((struct user *)n->data)->nick, sizeof lau);
-			}
-			command_fail(si, fault_toomany, _("Logged in nicks are: %s"), lau);
-			logcommand(si, CMDLOG_LOGIN, "failed " COMMAND_UC " to \2%s\2 (too many logins)", entity(mu)->name);
-			return;
-		}
-
-		// if they are identified to another account, nuke their session first
-		if (u->myuser)
-		{
-			command_success_nodata(si, _("You have been logged out of \2%s\2."), entity(u->myuser)->name);
-
-			if (ircd_on_logout(u, entity(u->myuser)->name))
-				// logout killed the user...
-				return;
-		        u->myuser->lastlogin = CURRTIME;
-		        MOWGLI_ITER_FOREACH_SAFE(n, tn, u->myuser->logins.head)
-		        {
-			        if (n->data == u)
-		                {
-		                        mowgli_node_delete(n, &u->myuser->logins);
-		                        mowgli_node_free(n);
-		                        break;
-		                }
-		        }
-		        u->myuser = NULL;
-		}
-
-		command_success_nodata(si, nicksvs.no_nick_ownership ? _("You are now logged in as \2%s\2.") : _("You are now identified for \2%s\2."), entity(mu)->name);
-
-		if (!(mu->flags & MU_CRYPTPASS))
-			(void) command_success_nodata(si, _("Warning: Your password is not encrypted."));
+		command_fail(si, fault_alreadyexists, _("Your previous %s is still being processed."), COMMAND_UC);
+		return;
+	}
 
-		myuser_login(si->service, u, mu, true);
-		logcommand(si, CMDLOG_LOGIN, COMMAND_UC);
+	// The password is checked off the main loop; ns_login_verified() finishes the login
+	struct ns_login_request *const lr = smalloc(sizeof *lr);
 
+	if (! (lr->req = verify_password_async(mu, password, &ns_login_verified, lr)))
+	{
+		(void) sfree(lr);
 		return;
 	}
 
-	logcommand(si, CMDLOG_LOGIN, "failed " COMMAND_UC " to \2%s\2 (bad password)", entity(mu)->name);
-
-	command_fail(si, fault_authfail, _("Invalid password for \2%s\2."), entity(mu)->name);
-	bad_password(si, mu);
+	lr->cp = command_suspend(si, &ns_login_cancel, lr);
 }
 
 static struct command ns_login = {
@@ -182,6 +232,7 @@ static struct command ns_login = {
 	.maxparc        = 2,
 	.cmd            = &ns_cmd_login,
 	.help           = { .path = "nickserv/" COMMAND_LC },
+	.sched_class    = CMD_SCHED_AUTH,
 };
 
 static void
@@ -195,6 +246,8 @@ mod_init(struct module *const restrict m)
 static void
 mod_deinit(const enum module_unload_intent ATHEME_VATTR_UNUSED intent)
 {
+	(void) command_cancel_all(&ns_login);
+
 	service_named_unbind_command("nickserv", &ns_login);
 }
 
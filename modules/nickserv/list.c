@@ -16,8 +16,61 @@
 extern void list_register(const char *, struct list_param *);
 extern void list_unregister(const char *);
 
+#define NS_LIST_MAXPARC             10
+#define NS_LIST_MAXMATCHES_DEF      1000U
+#define NS_LIST_TRIGRAM_LEN         3U
+
 static mowgli_patricia_t *list_params;
 
+/* Accounts by the day they registered or last logged in on; days[0] is
+ * first_day, counted from the epoch.
+ */
+struct list_time_index
+{
+	mowgli_list_t *             days;
+	unsigned long               first_day;
+	size_t                      ndays;
+};
+
+// Where an account is in the indexes below, keyed by entity ID in list_accounts
+struct list_account
+{
+	struct myuser *             mu;
+	char *                      email;              // As indexed, in case it changes
+	unsigned long               registered_day;
+	unsigned long               lastlogin_day;
+	mowgli_node_t               email_node;
+	mowgli_node_t               registered_node;
+	mowgli_node_t               lastlogin_node;
+};
+
+struct list_email
+{
+	mowgli_list_t               accounts;
+};
+
+// Every nick containing a (case-folded) trigram
+struct list_trigram
+{
+	struct mynick **            nicks;
+	size_t                      count;
+	size_t                      alloc;
+};
+
+static struct list_param param_email, param_lastlogin, param_pattern, param_registered, param_primary;
+static struct list_param param_waitauth;
+
+/* The indexes are built the first time LIST is used (which is after the
+ * database has been loaded), and only kept up to date from then on.
+ */
+static bool list_indexed = false;
+static mowgli_heap_t *list_account_heap = NULL;
+static mowgli_patricia_t *list_accounts = NULL;
+static mowgli_patricia_t *list_emails = NULL;
+static mowgli_patricia_t *list_trigrams = NULL;
+static struct list_time_index list_registered;
+static struct list_time_index list_lastlogin;
+
 static bool
 email_match(const struct mynick *mn, const void *arg)
 {
@@ -36,37 +89,48 @@ lastlogin_match(const struct mynick *mn, const void *arg)
 	return (CURRTIME - mu->lastlogin) > lastlogin;
 }
 
+static void
+pattern_split(const char *pattern, char pat[static 512], char **nickpattern, char **hostpattern)
+{
+	char *p;
+
+	*nickpattern = NULL;
+	*hostpattern = NULL;
+
+	if (pattern == NULL)
+		return;
+
+	mowgli_strlcpy(pat, pattern, 512);
+	p = strrchr(pat, ' ');
+	if (p == NULL)
+		p = strrchr(pat, '!');
+	if (p != NULL)
+	{
+		*p++ = '\0';
+		*nickpattern = pat;
+		*hostpattern = p;
+	}
+	else if (strchr(pat, '@'))
+		*hostpattern = pat;
+	else
+		*nickpattern = pat;
+	if (*nickpattern && !strcmp(*nickpattern, "*"))
+		*nickpattern = NULL;
+}
+
 static bool
 pattern_match(const struct mynick *mn, const void *arg)
 {
 	const char *pattern = (const char*)arg;
 
-	char pat[512], *nickpattern = NULL, *hostpattern = NULL, *p;
+	char pat[512], *nickpattern, *hostpattern;
 	struct metadata *md;
 
 	bool hostmatch;
 
 	struct myuser *mu = mn->owner;
 
-	if (pattern != NULL)
-	{
-		mowgli_strlcpy(pat, pattern, sizeof pat);
-		p = strrchr(pat, ' ');
-		if (p == NULL)
-			p = strrchr(pat, '!');
-		if (p != NULL)
-		{
-			*p++ = '\0';
-			nickpattern = pat;
-			hostpattern = p;
-		}
-		else if (strchr(pat, '@'))
-			hostpattern = pat;
-		else
-			nickpattern = pat;
-		if (nickpattern && !strcmp(nickpattern, "*"))
-			nickpattern = NULL;
-	}
+	pattern_split(pattern, pat, &nickpattern, &hostpattern);
 
 	if (nickpattern && match(nickpattern, mn->nick))
 		return false;
@@ -148,6 +212,320 @@ parse_age(char *s)
 	return duration;
 }
 
+static unsigned long
+list_day(const time_t t)
+{
+	return (t > 0) ? (unsigned long) t / SECONDS_PER_DAY : 0;
+}
+
+static void
+list_time_index_add(struct list_time_index *const restrict idx, const unsigned long day,
+                    struct list_account *const restrict la, mowgli_node_t *const restrict n)
+{
+	if (! idx->ndays)
+	{
+		idx->days = smalloc(sizeof *idx->days);
+		idx->first_day = day;
+		idx->ndays = 1;
+	}
+	else if (day < idx->first_day)
+	{
+		const size_t grow = idx->first_day - day;
+
+		idx->days = srealloc(idx->days, (idx->ndays + grow) * sizeof *idx->days);
+		(void) memmove(idx->days + grow, idx->days, idx->ndays * sizeof *idx->days);
+		(void) memset(idx->days, 0x00, grow * sizeof *idx->days);
+		idx->first_day = day;
+		idx->ndays += grow;
+	}
+	else if (day - idx->first_day >= idx->ndays)
+	{
+		const size_t ndays = day - idx->first_day + 1;
+
+		idx->days = srealloc(idx->days, ndays * sizeof *idx->days);
+		(void) memset(idx->days + idx->ndays, 0x00, (ndays - idx->ndays) * sizeof *idx->days);
+		idx->ndays = ndays;
+	}
+
+	(void) mowgli_node_add(la, n, &idx->days[day - idx->first_day]);
+}
+
+static void
+list_time_index_delete(struct list_time_index *const restrict idx, const unsigned long day,
+                       mowgli_node_t *const restrict n)
+{
+	(void) mowgli_node_delete(n, &idx->days[day - idx->first_day]);
+}
+
+// How many accounts are on lastday or earlier
+static size_t
+list_time_index_count(const struct list_time_index *const restrict idx, const unsigned long lastday)
+{
+	size_t count = 0;
+
+	for (size_t i = 0; i < idx->ndays && idx->first_day + i <= lastday; i++)
+		count += MOWGLI_LIST_LENGTH(&idx->days[i]);
+
+	return count;
+}
+
+static void
+list_email_add(struct list_account *const restrict la)
+{
+	struct list_email *le = mowgli_patricia_retrieve(list_emails, la->email);
+
+	if (! le)
+	{
+		le = smalloc(sizeof *le);
+		(void) mowgli_patricia_add(list_emails, la->email, le);
+	}
+
+	(void) mowgli_node_add(la, &la->email_node, &le->accounts);
+}
+
+static void
+list_email_delete(struct list_account *const restrict la)
+{
+	struct list_email *const le = mowgli_patricia_retrieve(list_emails, la->email);
+
+	return_if_fail(le != NULL);
+
+	(void) mowgli_node_delete(&la->email_node, &le->accounts);
+
+	if (! MOWGLI_LIST_LENGTH(&le->accounts))
+	{
+		(void) mowgli_patricia_delete(list_emails, la->email);
+		(void) sfree(le);
+	}
+}
+
+static void
+list_account_add(struct myuser *const restrict mu)
+{
+	struct list_account *const la = mowgli_heap_alloc(list_account_heap);
+
+	la->mu = mu;
+	la->email = sstrdup(mu->email);
+	la->registered_day = list_day(mu->registered);
+	la->lastlogin_day = list_day(mu->lastlogin);
+
+	(void) list_email_add(la);
+	(void) list_time_index_add(&list_registered, la->registered_day, la, &la->registered_node);
+	(void) list_time_index_add(&list_lastlogin, la->lastlogin_day, la, &la->lastlogin_node);
+	(void) mowgli_patricia_add(list_accounts, entity(mu)->id, la);
+}
+
+static void
+list_account_update(struct myuser *const restrict mu)
+{
+	struct list_account *const la = mowgli_patricia_retrieve(list_accounts, entity(mu)->id);
+
+	return_if_fail(la != NULL);
+
+	if (strcmp(la->email, mu->email) != 0)
+	{
+		(void) list_email_delete(la);
+		(void) sfree(la->email);
+		la->email = sstrdup(mu->email);
+		(void) list_email_add(la);
+	}
+
+	if (la->registered_day != list_day(mu->registered))
+	{
+		(void) list_time_index_delete(&list_registered, la->registered_day, &la->registered_node);
+		la->registered_day = list_day(mu->registered);
+		(void) list_time_index_add(&list_registered, la->registered_day, la, &la->registered_node);
+	}
+
+	if (la->lastlogin_day != list_day(mu->lastlogin))
+	{
+		(void) list_time_index_delete(&list_lastlogin, la->lastlogin_day, &la->lastlogin_node);
+		la->lastlogin_day = list_day(mu->lastlogin);
+		(void) list_time_index_add(&list_lastlogin, la->lastlogin_day, la, &la->lastlogin_node);
+	}
+}
+
+static void
+list_account_delete(struct myuser *const restrict mu)
+{
+	struct list_account *const la = mowgli_patricia_delete(list_accounts, entity(mu)->id);
+
+	return_if_fail(la != NULL);
+
+	(void) list_email_delete(la);
+	(void) list_time_index_delete(&list_registered, la->registered_day, &la->registered_node);
+	(void) list_time_index_delete(&list_lastlogin, la->lastlogin_day, &la->lastlogin_node);
+	(void) sfree(la->email);
+	(void) mowgli_heap_free(list_account_heap, la);
+}
+
+static void
+list_trigram_key(char key[static NS_LIST_TRIGRAM_LEN + 1], const char *const restrict str)
+{
+	for (size_t i = 0; i < NS_LIST_TRIGRAM_LEN; i++)
+		key[i] = (char) ToLower((unsigned char) str[i]);
+
+	key[NS_LIST_TRIGRAM_LEN] = '\0';
+}
+
+static void
+list_trigram_add_nick(struct mynick *const restrict mn)
+{
+	const size_t len = strlen(mn->nick);
+	char key[NS_LIST_TRIGRAM_LEN + 1];
+
+	for (size_t i = 0; i + NS_LIST_TRIGRAM_LEN <= len; i++)
+	{
+		(void) list_trigram_key(key, mn->nick + i);
+
+		struct list_trigram *lt = mowgli_patricia_retrieve(list_trigrams, key);
+
+		if (! lt)
+		{
+			lt = smalloc(sizeof *lt);
+			(void) mowgli_patricia_add(list_trigrams, key, lt);
+		}
+		else if (lt->count && lt->nicks[lt->count - 1] == mn)
+			// The nick has this trigram more than once; it is added to the lists in one go
+			continue;
+
+		if (lt->count == lt->alloc)
+		{
+			lt->alloc = lt->alloc ? (lt->alloc * 2U) : 4U;
+			lt->nicks = srealloc(lt->nicks, lt->alloc * sizeof *lt->nicks);
+		}
+
+		lt->nicks[lt->count++] = mn;
+	}
+}
+
+static void
+list_trigram_delete_nick(const struct mynick *const restrict mn)
+{
+	const size_t len = strlen(mn->nick);
+	char key[NS_LIST_TRIGRAM_LEN + 1];
+
+	for (size_t i = 0; i + NS_LIST_TRIGRAM_LEN <= len; i++)
+	{
+		(void) list_trigram_key(key, mn->nick + i);
+
+		struct list_trigram *const lt = mowgli_patricia_retrieve(list_trigrams, key);
+
+		if (! lt)
+			continue;
+
+		for (size_t j = 0; j < lt->count; j++)
+		{
+			if (lt->nicks[j] != mn)
+				continue;
+
+			lt->nicks[j] = lt->nicks[--lt->count];
+			break;
+		}
+
+		if (! lt->count)
+		{
+			(void) mowgli_patricia_delete(list_trigrams, key);
+			(void) sfree(lt->nicks);
+			(void) sfree(lt);
+		}
+	}
+}
+
+static void
+list_index_build(void)
+{
+	struct myentity_iteration_state mestate;
+	mowgli_patricia_iteration_state_t state;
+	struct myentity *mt;
+	struct mynick *mn;
+
+	if (list_indexed)
+		return;
+
+	MYENTITY_FOREACH_T(mt, &mestate, ENT_USER)
+		(void) list_account_add((struct myuser *) mt);
+
+	MOWGLI_PATRICIA_FOREACH(mn, &state, nicklist)
+		(void) list_trigram_add_nick(mn);
+
+	list_indexed = true;
+}
+
+static void
+list_account_destroy_cb(const char ATHEME_VATTR_UNUSED *const restrict key, void *const restrict data,
+                        void ATHEME_VATTR_UNUSED *const restrict privdata)
+{
+	struct list_account *const la = data;
+
+	(void) sfree(la->email);
+	(void) mowgli_heap_free(list_account_heap, la);
+}
+
+static void
+list_email_destroy_cb(const char ATHEME_VATTR_UNUSED *const restrict key, void *const restrict data,
+                      void ATHEME_VATTR_UNUSED *const restrict privdata)
+{
+	(void) sfree(data);
+}
+
+static void
+list_trigram_destroy_cb(const char ATHEME_VATTR_UNUSED *const restrict key, void *const restrict data,
+                        void ATHEME_VATTR_UNUSED *const restrict privdata)
+{
+	struct list_trigram *const lt = data;
+
+	(void) sfree(lt->nicks);
+	(void) sfree(lt);
+}
+
+static void
+list_myuser_add_hook(struct myuser *const restrict mu)
+{
+	if (list_indexed)
+		(void) list_account_add(mu);
+}
+
+static void
+list_myuser_change_hook(struct myuser *const restrict mu)
+{
+	if (list_indexed)
+		(void) list_account_update(mu);
+}
+
+static void
+list_myuser_delete_hook(struct myuser *const restrict mu)
+{
+	if (list_indexed)
+		(void) list_account_delete(mu);
+}
+
+/* Nothing tells us every time an account's last login time changes, but as
+ * it only ever moves forward, an index that is a little behind still finds
+ * all the accounts last used before any given time (and then some, which
+ * the criterion itself weeds out). Logging in is when it usually moves.
+ */
+static void
+list_user_identify_hook(struct user *const restrict u)
+{
+	if (list_indexed && u->myuser)
+		(void) list_account_update(u->myuser);
+}
+
+static void
+list_mynick_add_hook(struct mynick *const restrict mn)
+{
+	if (list_indexed)
+		(void) list_trigram_add_nick(mn);
+}
+
+static void
+list_mynick_delete_hook(struct mynick *const restrict mn)
+{
+	if (list_indexed)
+		(void) list_trigram_delete_nick(mn);
+}
+
 static void
 build_criteriastr(char *buf, int parc, char *parv[])
 {
@@ -203,112 +581,339 @@ list_one(struct sourceinfo *si, struct myuser *mu, struct mynick *mn)
 		command_success_nodata(si, "- %s (%s) (%s) %s", mn->nick, mu->email, entity(mu)->name, buf);
 }
 
+struct list_criterion
+{
+	const struct list_param *   param;
+	union {
+		bool                    boolval;
+		int                     intval;
+		const char *            strval;
+		time_t                  ageval;
+	} arg;
+};
+
+enum list_plan_type
+{
+	LIST_PLAN_SCAN,         // Every nick
+	LIST_PLAN_TRIGRAM,      // The nicks containing a trigram of the pattern
+	LIST_PLAN_EMAIL,        // The accounts with an email address
+	LIST_PLAN_DAYS,         // The accounts up to a day in a time index
+	LIST_PLAN_ACCOUNTS,     // The accounts a criterion's own index gave
+};
+
+struct list_plan
+{
+	enum list_plan_type             type;
+	size_t                          cost;       // Roughly how many nicks or accounts it visits
+	const struct list_trigram *     trigram;
+	const struct list_email *       email;
+	const struct list_time_index *  days;
+	unsigned long                   lastday;
+	struct myuser **                accounts;
+	size_t                          naccounts;
+};
+
+struct list_scan
+{
+	struct sourceinfo *             si;
+	const struct list_criterion *   crit;
+	size_t                          ncrit;
+	unsigned int                    matches;
+	unsigned int                    limit;
+	bool                            truncated;
+};
+
+// Characters match() gives a meaning to
+static const char list_metachars[] = "*?&#%\\";
+
 static void
-ns_cmd_list(struct sourceinfo *si, int parc, char *parv[])
+list_plan_pattern(struct list_plan *const restrict plan, const char *const restrict patternarg)
 {
-	char criteriastr[BUFSIZE];
+	char pat[512], *nickpattern, *hostpattern;
+	char key[NS_LIST_TRIGRAM_LEN + 1];
 
-	mowgli_patricia_iteration_state_t state;
-	struct myentity_iteration_state mestate;
-	struct mynick *mn;
+	plan->type = LIST_PLAN_TRIGRAM;
+	plan->cost = SIZE_MAX;
 
-	unsigned int matches = 0;
+	pattern_split(patternarg, pat, &nickpattern, &hostpattern);
 
-	int i;
-	bool error = false;
-	bool found;
+	if (! nickpattern)
+		return;
 
-	MOWGLI_PATRICIA_FOREACH(mn, &state, nicklist)
+	// A matching nick has every trigram of every literal run in the pattern; take the rarest
+	for (const char *p = nickpattern; *p != '\0'; )
 	{
-		found = true;
+		const size_t run = strcspn(p, list_metachars);
 
-		for (i = 0; i < parc; i++)
+		for (size_t i = 0; i + NS_LIST_TRIGRAM_LEN <= run; i++)
 		{
-			struct list_param *param = mowgli_patricia_retrieve(list_params, parv[i]);
+			(void) list_trigram_key(key, p + i);
+
+			const struct list_trigram *const lt = mowgli_patricia_retrieve(list_trigrams, key);
 
-			if (param == NULL) {
-				command_fail(si, fault_badparams, _("\2%s\2 is not a recognized LIST criterion"), parv[i]);
-				error = true;
-				break;
+			if (! lt)
+			{
+				plan->trigram = NULL;
+				plan->cost = 0;
+				return;
 			}
 
-			if (param->opttype == OPT_BOOL) {
-				bool arg = true;
+			if (lt->count < plan->cost)
+			{
+				plan->trigram = lt;
+				plan->cost = lt->count;
+			}
+		}
+
+		p += run;
+
+		if (*p != '\0')
+			p++;
+	}
+}
+
+static inline const void *
+list_criterion_arg(const struct list_criterion *const restrict c)
+{
+	if (c->param->opttype == OPT_STRING)
+		return c->arg.strval;
 
-				if (!param->is_match(mn, &arg)) {
-					found = false;
+	return &c->arg;
+}
+
+static void
+list_plan_criteria(struct list_plan *const restrict plan, const struct list_criterion *const restrict crit,
+                   const size_t ncrit)
+{
+	*plan = (struct list_plan) {
+		.type   = LIST_PLAN_SCAN,
+		.cost   = mowgli_patricia_size(nicklist),
+	};
+
+	for (size_t i = 0; i < ncrit; i++)
+	{
+		const struct list_param *const param = crit[i].param;
+		struct list_plan candidate = { .type = LIST_PLAN_SCAN };
+
+		if (param == &param_email && ! strpbrk(crit[i].arg.strval, list_metachars))
+		{
+			candidate.type = LIST_PLAN_EMAIL;
+			candidate.email = mowgli_patricia_retrieve(list_emails, crit[i].arg.strval);
+			candidate.cost = candidate.email ? MOWGLI_LIST_LENGTH(&candidate.email->accounts) : 0;
+		}
+		else if (param == &param_pattern)
+			(void) list_plan_pattern(&candidate, crit[i].arg.strval);
+		else if (param == &param_registered || param == &param_lastlogin)
+		{
+			candidate.type = LIST_PLAN_DAYS;
+			candidate.days = (param == &param_registered) ? &list_registered : &list_lastlogin;
+			candidate.lastday = list_day(CURRTIME - crit[i].arg.ageval);
+			candidate.cost = list_time_index_count(candidate.days, candidate.lastday);
+		}
+		else if (param->candidates)
+		{
+			if (! param->candidates(list_criterion_arg(&crit[i]), &candidate.accounts, &candidate.naccounts))
+				continue;
+
+			candidate.type = LIST_PLAN_ACCOUNTS;
+			candidate.cost = candidate.naccounts;
+		}
+		else
+			continue;
+
+		if (candidate.cost < plan->cost)
+		{
+			sfree(plan->accounts);
+			*plan = candidate;
+		}
+		else
+			sfree(candidate.accounts);
+	}
+}
+
+static bool
+list_criteria_match(const struct mynick *const restrict mn, const struct list_criterion *const restrict crit,
+                    const size_t ncrit)
+{
+	for (size_t i = 0; i < ncrit; i++)
+		if (! crit[i].param->is_match(mn, list_criterion_arg(&crit[i])))
+			return false;
+
+	return true;
+}
+
+// Returns false once the scan has as many matches as it may show
+static bool
+list_scan_nick(struct list_scan *const restrict scan, struct mynick *const restrict mn)
+{
+	if (! list_criteria_match(mn, scan->crit, scan->ncrit))
+		return true;
+
+	if (scan->matches == scan->limit)
+	{
+		scan->truncated = true;
+		return false;
+	}
+
+	list_one(scan->si, NULL, mn);
+	scan->matches++;
+
+	return true;
+}
+
+static bool
+list_scan_account(struct list_scan *const restrict scan, const struct myuser *const restrict mu)
+{
+	mowgli_node_t *n;
+
+	MOWGLI_ITER_FOREACH(n, mu->nicks.head)
+		if (! list_scan_nick(scan, n->data))
+			return false;
+
+	return true;
+}
+
+static bool
+list_scan_accounts(struct list_scan *const restrict scan, const mowgli_list_t *const restrict accounts)
+{
+	mowgli_node_t *n;
+
+	MOWGLI_ITER_FOREACH(n, accounts->head)
+	{
+		const struct list_account *const la = n->data;
+
+		if (! list_scan_account(scan, la->mu))
+			return false;
+	}
+
+	return true;
+}
+
+static void
+list_scan_run(struct list_scan *const restrict scan, const struct list_plan *const restrict plan)
+{
+	mowgli_patricia_iteration_state_t state;
+	struct mynick *mn;
+
+	switch (plan->type)
+	{
+		case LIST_PLAN_SCAN:
+			MOWGLI_PATRICIA_FOREACH(mn, &state, nicklist)
+				if (! list_scan_nick(scan, mn))
 					break;
-				}
-			} else if (param->opttype == OPT_INT) {
-				if (i + 1 < parc) {
-					int arg = atoi(parv[++i]);
-
-					if (!param->is_match (mn, &arg)) {
-						found = false;
-						break;
-					}
-				} else {
-					command_fail(si, fault_needmoreparams, STR_INSUFFICIENT_PARAMS, parv[i]);
-					error = true;
+			break;
+
+		case LIST_PLAN_TRIGRAM:
+			for (size_t i = 0; plan->trigram && i < plan->trigram->count; i++)
+				if (! list_scan_nick(scan, plan->trigram->nicks[i]))
 					break;
-				}
-			} else if (param->opttype == OPT_STRING) {
-				if (i + 1 < parc) {
-					if (!param->is_match (mn, parv[++i])) {
-						found = false;
-						break;
-					}
-				} else {
-					command_fail(si, fault_needmoreparams, STR_INSUFFICIENT_PARAMS, parv[i]);
-					error = true;
+			break;
+
+		case LIST_PLAN_EMAIL:
+			if (plan->email)
+				(void) list_scan_accounts(scan, &plan->email->accounts);
+			break;
+
+		case LIST_PLAN_DAYS:
+			for (size_t i = 0; i < plan->days->ndays && plan->days->first_day + i <= plan->lastday; i++)
+				if (! list_scan_accounts(scan, &plan->days->days[i]))
 					break;
-				}
-			}
-			else if (param->opttype == OPT_AGE) {
-				if (i + 1 < parc)
-				{
-					time_t age = parse_age(parv[++i]);
-
-					if (!param->is_match (mn, &age)) {
-						found = false;
-						break;
-					}
-				} else {
-					command_fail(si, fault_needmoreparams, STR_INSUFFICIENT_PARAMS, parv[i]);
-					error = true;
+			break;
+
+		case LIST_PLAN_ACCOUNTS:
+			for (size_t i = 0; i < plan->naccounts; i++)
+				if (! list_scan_account(scan, plan->accounts[i]))
 					break;
-				}
+			break;
+	}
+}
+
+static void
+ns_cmd_list(struct sourceinfo *si, int parc, char *parv[])
+{
+	char criteriastr[BUFSIZE];
+	struct list_criterion crit[NS_LIST_MAXPARC];
+	struct list_scan scan = {
+		.si     = si,
+		.crit   = crit,
+		.limit  = NS_LIST_MAXMATCHES_DEF,
+	};
+	struct list_plan plan;
+
+	int i;
+
+	for (i = 0; i < parc; i++)
+	{
+		if (!strcasecmp(parv[i], "limit")) {
+			if (i + 1 < parc) {
+				const int arg = atoi(parv[++i]);
+
+				scan.limit = (arg > 0) ? (unsigned int) arg : UINT_MAX;
+				continue;
 			}
-		} //for (i = 0; i < parc; i++)
 
-		if (error) {
-			break;
+			command_fail(si, fault_needmoreparams, STR_INSUFFICIENT_PARAMS, parv[i]);
+			return;
 		}
 
-		if (found) {
-			list_one(si, NULL, mn);
-			matches++;
+		struct list_param *param = mowgli_patricia_retrieve(list_params, parv[i]);
+
+		if (param == NULL) {
+			command_fail(si, fault_badparams, _("\2%s\2 is not a recognized LIST criterion"), parv[i]);
+			return;
 		}
-	} //MOWGLI_PATRICIA_FOREACH(mn, &state, nicklist)
+
+		struct list_criterion *const c = &crit[scan.ncrit++];
+
+		c->param = param;
+
+		if (param->opttype == OPT_BOOL) {
+			c->arg.boolval = true;
+		} else if (param->opttype == OPT_FLAG) {
+			// Not used by LIST criteria; ignored, as it always has been
+			scan.ncrit--;
+		} else if (i + 1 >= parc) {
+			command_fail(si, fault_needmoreparams, STR_INSUFFICIENT_PARAMS, parv[i]);
+			return;
+		} else if (param->opttype == OPT_INT) {
+			c->arg.intval = atoi(parv[++i]);
+		} else if (param->opttype == OPT_STRING) {
+			c->arg.strval = parv[++i];
+		} else if (param->opttype == OPT_AGE) {
+			c->arg.ageval = parse_age(parv[++i]);
+		}
+	}
+
+	/* Rather than test every nick against the criteria, scan only those an
+	 * index says might match the most selective of them.
+	 */
+	list_index_build();
+	list_plan_criteria(&plan, crit, scan.ncrit);
+	list_scan_run(&scan, &plan);
+	sfree(plan.accounts);
 
 	build_criteriastr(criteriastr, parc, parv);
 
-	logcommand(si, CMDLOG_ADMIN, "LIST: \2%s\2 (\2%u\2 matches)", criteriastr, matches);
-	if (matches == 0)
+	logcommand(si, CMDLOG_ADMIN, "LIST: \2%s\2 (\2%u\2 matches)", criteriastr, scan.matches);
+	if (scan.truncated)
+		command_success_nodata(si, _("Stopped after \2%u\2 matches for criteria \2%s\2; use LIMIT to see "
+		                             "more."), scan.matches, criteriastr);
+	else if (scan.matches == 0)
 		command_success_nodata(si, _("No nicknames matched criteria \2%s\2"), criteriastr);
 	else
 		command_success_nodata(si, ngettext(N_("\2%u\2 match for criteria \2%s\2."),
-		                                    N_("\2%u\2 matches for criteria \2%s\2."), matches),
-		                                    matches, criteriastr);
+		                                    N_("\2%u\2 matches for criteria \2%s\2."), scan.matches),
+		                                    scan.matches, criteriastr);
 }
 
 static struct command ns_list = {
 	.name           = "LIST",
 	.desc           = N_("Lists nicknames registered matching a given pattern."),
 	.access         = PRIV_USER_AUSPEX,
-	.maxparc        = 10,
+	.maxparc        = NS_LIST_MAXPARC,
 	.cmd            = &ns_cmd_list,
 	.help           = { .path = "nickserv/list" },
+	.sched_class    = CMD_SCHED_QUERY,
 };
 
 static void
@@ -316,43 +921,48 @@ mod_init(struct module *const restrict m)
 {
 	MODULE_TRY_REQUEST_DEPENDENCY(m, "nickserv/main")
 
+	list_account_heap = mowgli_heap_create(sizeof(struct list_account), 1024, BH_NOW);
 	list_params = mowgli_patricia_create(strcasecanon);
+	list_accounts = mowgli_patricia_create(NULL);
+	list_emails = mowgli_patricia_create(strcasecanon);
+	list_trigrams = mowgli_patricia_create(NULL);
 	service_named_bind_command("nickserv", &ns_list);
 
+	(void) hook_add_myuser_add(&list_myuser_add_hook);
+	(void) hook_add_myuser_change(&list_myuser_change_hook);
+	(void) hook_add_myuser_delete(&list_myuser_delete_hook);
+	(void) hook_add_mynick_add(&list_mynick_add_hook);
+	(void) hook_add_mynick_delete(&list_mynick_delete_hook);
+	(void) hook_add_user_identify(&list_user_identify_hook);
+
 	// list email
-	static struct list_param email;
-	email.opttype = OPT_STRING;
-	email.is_match = email_match;
+	param_email.opttype = OPT_STRING;
+	param_email.is_match = email_match;
 
-	static struct list_param lastlogin;
-	lastlogin.opttype = OPT_AGE;
-	lastlogin.is_match = lastlogin_match;
+	param_lastlogin.opttype = OPT_AGE;
+	param_lastlogin.is_match = lastlogin_match;
 
-	static struct list_param pattern;
-	pattern.opttype = OPT_STRING;
-	pattern.is_match = pattern_match;
+	param_pattern.opttype = OPT_STRING;
+	param_pattern.is_match = pattern_match;
 
-	static struct list_param registered;
-	registered.opttype = OPT_AGE;
-	registered.is_match = registered_match;
+	param_registered.opttype = OPT_AGE;
+	param_registered.is_match = registered_match;
 
-	static struct list_param primary;
-	primary.opttype = OPT_BOOL;
-	primary.is_match = primary_match;
+	param_primary.opttype = OPT_BOOL;
+	param_primary.is_match = primary_match;
 
-	list_register("email", &email);
-	list_register("lastlogin", &lastlogin);
-	list_register("mail", &email);
+	list_register("email", &param_email);
+	list_register("lastlogin", &param_lastlogin);
+	list_register("mail", &param_email);
 
-	list_register("pattern", &pattern);
-	list_register("registered", &registered);
-	list_register("primary", &primary);
+	list_register("pattern", &param_pattern);
+	list_register("registered", &param_registered);
+	list_register("primary", &param_primary);
 
-	static struct list_param waitauth;
-	waitauth.opttype = OPT_BOOL;
-	waitauth.is_match = has_waitauth;
+	param_waitauth.opttype = OPT_BOOL;
+	param_waitauth.is_match = has_waitauth;
 
-	list_register("waitauth", &waitauth);
+	list_register("waitauth", &param_waitauth);
 }
 
 static void
@@ -360,6 +970,13 @@ mod_deinit(const enum module_unload_intent ATHEME_VATTR_UNUSED intent)
 {
 	service_named_unbind_command("nickserv", &ns_list);
 
+	(void) hook_del_myuser_add(&list_myuser_add_hook);
+	(void) hook_del_myuser_change(&list_myuser_change_hook);
+	(void) hook_del_myuser_delete(&list_myuser_delete_hook);
+	(void) hook_del_mynick_add(&list_mynick_add_hook);
+	(void) hook_del_mynick_delete(&list_mynick_delete_hook);
+	(void) hook_del_user_identify(&list_user_identify_hook);
+
 	list_unregister("email");
 	list_unregister("lastlogin");
 	list_unregister("mail");
@@ -368,6 +985,13 @@ mod_deinit(const enum module_unload_intent ATHEME_VATTR_UNUSED intent)
 	list_unregister("registered");
 
 	list_unregister("waitauth");
+
+	(void) mowgli_patricia_destroy(list_accounts, &list_account_destroy_cb, NULL);
+	(void) mowgli_patricia_destroy(list_emails, &list_email_destroy_cb, NULL);
+	(void) mowgli_patricia_destroy(list_trigrams, &list_trigram_destroy_cb, NULL);
+	(void) sfree(list_registered.days);
+	(void) sfree(list_lastlogin.days);
+	(void) mowgli_heap_destroy(list_account_heap);
 }
 
 SIMPLE_DECLARE_MODULE_V1("nickserv/list", MODULE_UNLOAD_CAPABILITY_OK)
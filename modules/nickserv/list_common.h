@@ -25,6 +25,13 @@ struct list_param
 {
 	enum list_opttype opttype;
 	bool (*is_match)(const struct mynick *mn, const void *arg);
+
+	/* Optional: which accounts can match at all, if the module that owns
+	 * the criterion keeps an index of them. Returns false if it cannot tell;
+	 * otherwise sets *accounts (freed by the caller with sfree) to *count
+	 * distinct accounts, which is_match() is then asked only about.
+	 */
+	bool (*candidates)(const void *arg, struct myuser ***accounts, size_t *count);
 };
 
 #endif /* !ATHEME_MOD_NICKSERV_LIST_COMMON_H */
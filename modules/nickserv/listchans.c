@@ -90,6 +90,7 @@ static struct command ns_listchans = {
 	.maxparc        = 1,
 	.cmd            = &ns_cmd_listchans,
 	.help           = { .path = "nickserv/listchans" },
+	.replica_safe   = true,
 };
 
 static void
@@ -97,6 +97,7 @@ static struct command ns_listgroups = {
 	.maxparc        = 1,
 	.cmd            = &ns_cmd_listgroups,
 	.help           = { .path = "nickserv/listgroups" },
+	.replica_safe   = true,
 };
 
 static void
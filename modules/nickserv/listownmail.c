@@ -12,8 +12,8 @@
 static void
 ns_cmd_listownmail(struct sourceinfo *si, int parc, char *parv[])
 {
-	struct myentity *mt;
-	struct myentity_iteration_state state;
+	const mowgli_list_t *accounts;
+	mowgli_node_t *n;
 	unsigned int matches = 0;
 
 	if (si->smu->flags & MU_WAITAUTH)
@@ -35,21 +35,19 @@ ns_cmd_listownmail(struct sourceinfo *si, int parc, char *parv[])
 
 	command_add_flood(si, FLOOD_HEAVY);
 
-	MYENTITY_FOREACH_T(mt, &state, ENT_USER)
-	{
-		struct myuser *mu = user(mt);
+	// This always has at least si->smu in it
+	accounts = myuser_email_accounts(si->smu->email);
 
-		continue_if_fail(mu != NULL);
+	MOWGLI_ITER_FOREACH(n, accounts ? accounts->head : NULL)
+	{
+		struct myuser *mu = n->data;
 
-		if (!strcasecmp(si->smu->email_canonical, mu->email_canonical))
-		{
-			// in the future we could add a LIMIT parameter
-			if (matches == 0)
-				command_success_nodata(si, _("Accounts matching e-mail address \2%s\2:"), si->smu->email);
+		// in the future we could add a LIMIT parameter
+		if (matches == 0)
+			command_success_nodata(si, _("Accounts matching e-mail address \2%s\2:"), si->smu->email);
 
-			command_success_nodata(si, "- %s (%s)", entity(mu)->name, mu->email);
-			matches++;
-		}
+		command_success_nodata(si, "- %s (%s)", entity(mu)->name, mu->email);
+		matches++;
 	}
 
 	logcommand(si, CMDLOG_GET, "LISTOWNMAIL: \2%s\2 (\2%u\2 matches)", si->smu->email, matches);
@@ -13,7 +13,6 @@ static void
 ns_cmd_logout(struct sourceinfo *si, int parc, char *parv[])
 {
 	struct user *u = si->su;
-	mowgli_node_t *n, *tn;
 	struct mynick *mn;
 	char *user = parv[0];
 	char *pass = parv[1];
@@ -100,15 +99,8 @@ ns_cmd_logout(struct sourceinfo *si, int parc, char *parv[])
 
 	if (!ircd_on_logout(u, entity(u->myuser)->name))
 	{
-		MOWGLI_ITER_FOREACH_SAFE(n, tn, u->myuser->logins.head)
-		{
-			if (n->data == u)
-			{
-				mowgli_node_delete(n, &u->myuser->logins);
-				mowgli_node_free(n);
-				break;
-			}
-		}
+		mowgli_node_delete(&u->mlnode, &u->myuser->logins);
+		hook_call_user_logout(u);
 		u->myuser = NULL;
 	}
 }
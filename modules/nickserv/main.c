@@ -37,6 +37,12 @@ nickserv_handle_nickchange(struct user *u)
 	if (nicksvs.me == NULL || nicksvs.no_nick_ownership)
 		return;
 
+	/* Users introduced in a netjoin are checked once the burst is over;
+	 * many of them will have been logged in by then.
+	 */
+	if (burst_defer_user(u, &nickserv_handle_nickchange))
+		return;
+
 	// They're logged in, don't send them spam -- jilles
 	if (u->myuser)
 		u->flags |= UF_SEENINFO;
@@ -170,6 +176,7 @@ mod_deinit(const enum module_unload_intent ATHEME_VATTR_UNUSED intent)
 
         hook_del_config_ready(nickserv_config_ready);
         hook_del_nick_check(nickserv_handle_nickchange);
+	burst_cancel_user_fn(nickserv_handle_nickchange);
 }
 
 SIMPLE_DECLARE_MODULE_V1("nickserv/main", MODULE_UNLOAD_CAPABILITY_OK)
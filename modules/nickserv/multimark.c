@@ -14,6 +14,40 @@
 #define MULTIMARK_PERSIST_MDNAME "atheme.nickserv.multimark"
 
 struct multimark
+{
+	stringref setter_uid;
+	stringref setter_name;
+	stringref restored_from_uid;
+	stringref restored_from_account;
+	time_t time;
+	unsigned int number;
+	char *mark;
+};
+
+/* An account's marks, in the order they were set. Once it has one, it keeps
+ * it until it is deleted, empty or not.
+ */
+struct multimark_set
+{
+	struct myuser *mu;
+	unsigned int count;
+	unsigned int alloc;
+	struct multimark *marks;
+	mowgli_node_t node;         // in multimark_marked, while count != 0
+};
+
+// Where an account's struct multimark_set is kept
+static unsigned int multimark_set_slot;
+
+// How many marks of one account an index entry has
+struct multimark_posting
+{
+	struct myuser *mu;
+	unsigned int refs;
+};
+
+// The layout of marks before they were packed, as an older copy of this module left them
+struct multimark_v1
 {
 	char *setter_uid;
 	char *setter_name;
@@ -39,40 +73,302 @@ struct restored_mark
 
 static mowgli_patricia_t *restored_marks;
 
-static inline mowgli_list_t *
-multimark_list(struct myuser *mu)
+/* Which accounts have marks set by an account name, and which have a word
+ * (as log_index_key() picks them, so at least LOG_INDEX_KEY_MIN characters
+ * between spaces) in one of their marks; each maps to a tree of postings by
+ * account id. Not kept across reloads, but rebuilt from the marks.
+ */
+static mowgli_patricia_t *multimark_setters;
+static mowgli_patricia_t *multimark_words;
+
+// Accounts with at least one mark
+static mowgli_list_t multimark_marked;
+
+// Accounts that still have an old style (nickserv/mark) mark, by id
+static mowgli_patricia_t *multimark_unmigrated;
+
+static inline unsigned char
+multimark_fold(const unsigned char c)
 {
-	mowgli_list_t *l;
+	// As log_index_key() folds the pattern
+	return ToLowerTab[(unsigned char) tolower(c)];
+}
+
+static void
+multimark_posting_add(mowgli_patricia_t *const restrict index, const char *const restrict key,
+                      struct myuser *const restrict mu)
+{
+	mowgli_patricia_t *postings = mowgli_patricia_retrieve(index, key);
+
+	if (! postings)
+	{
+		postings = mowgli_patricia_create(NULL);
+		(void) mowgli_patricia_add(index, key, postings);
+	}
+
+	struct multimark_posting *mp = mowgli_patricia_retrieve(postings, entity(mu)->id);
+
+	if (! mp)
+	{
+		mp = smalloc(sizeof *mp);
+		mp->mu = mu;
+		(void) mowgli_patricia_add(postings, entity(mu)->id, mp);
+	}
+
+	mp->refs++;
+}
+
+static void
+multimark_posting_del(mowgli_patricia_t *const restrict index, const char *const restrict key,
+                      struct myuser *const restrict mu)
+{
+	mowgli_patricia_t *const postings = mowgli_patricia_retrieve(index, key);
+
+	if (! postings)
+		return;
+
+	struct multimark_posting *const mp = mowgli_patricia_retrieve(postings, entity(mu)->id);
 
+	if (! mp || --mp->refs != 0)
+		return;
+
+	(void) mowgli_patricia_delete(postings, entity(mu)->id);
+	(void) sfree(mp);
+
+	if (mowgli_patricia_size(postings) != 0)
+		return;
+
+	(void) mowgli_patricia_delete(index, key);
+	(void) mowgli_patricia_destroy(postings, NULL, NULL);
+}
+
+// Calls fn for each indexable word of a mark, as often as it has it
+static void
+multimark_foreach_word(const char *text, void (*const fn)(const char *, struct myuser *), struct myuser *const mu)
+{
+	char word[BUFSIZE];
+
+	while (*text)
+	{
+		size_t len = 0;
+
+		for (; *text && *text != ' '; text++)
+			if (len < sizeof word - 1U)
+				word[len++] = (char) multimark_fold((const unsigned char) *text);
+
+		while (*text == ' ')
+			text++;
+
+		if (len < LOG_INDEX_KEY_MIN)
+			continue;
+
+		word[len] = '\0';
+		fn(word, mu);
+	}
+}
+
+static void
+multimark_word_add(const char *const restrict word, struct myuser *const restrict mu)
+{
+	(void) multimark_posting_add(multimark_words, word, mu);
+}
+
+static void
+multimark_word_del(const char *const restrict word, struct myuser *const restrict mu)
+{
+	(void) multimark_posting_del(multimark_words, word, mu);
+}
+
+static void
+multimark_index_add(struct myuser *const restrict mu, const struct multimark *const restrict mm)
+{
+	(void) multimark_posting_add(multimark_setters, mm->setter_name, mu);
+	(void) multimark_foreach_word(mm->mark, &multimark_word_add, mu);
+}
+
+static void
+multimark_index_del(struct myuser *const restrict mu, const struct multimark *const restrict mm)
+{
+	(void) multimark_posting_del(multimark_setters, mm->setter_name, mu);
+	(void) multimark_foreach_word(mm->mark, &multimark_word_del, mu);
+}
+
+static inline struct multimark_set *
+multimark_get_set(struct myuser *mu)
+{
 	return_val_if_fail(mu != NULL, NULL);
 
-	l = privatedata_get(mu, "mark:list");
+	return privatedata_slot_get(mu, multimark_set_slot);
+}
 
-	if (l != NULL)
-		return l;
+/* Adds a mark like the one given (whose names need not be shared strings yet,
+ * and whose own text is not used), with a copy of text.
+ */
+static void
+multimark_add(struct myuser *const restrict mu, const struct multimark *const restrict mark,
+              const char *const restrict text)
+{
+	struct multimark_set *set = multimark_get_set(mu);
 
-	l = mowgli_list_create();
-	privatedata_set(mu, "mark:list", l);
+	if (! set)
+	{
+		set = smalloc(sizeof *set);
+		set->mu = mu;
+		privatedata_slot_set(mu, multimark_set_slot, set);
+	}
 
-	return l;
+	if (set->count == set->alloc)
+	{
+		set->alloc = set->alloc ? (set->alloc * 2U) : 2U;
+		set->marks = sreallocarray(set->marks, set->alloc, sizeof *set->marks);
+	}
+
+	struct multimark *const mm = &set->marks[set->count++];
+
+	mm->setter_uid = strshare_get(mark->setter_uid);
+	mm->setter_name = strshare_get(mark->setter_name);
+	mm->restored_from_uid = strshare_get(mark->restored_from_uid);
+	mm->restored_from_account = strshare_get(mark->restored_from_account);
+	mm->time = mark->time;
+	mm->number = mark->number;
+	mm->mark = sstrdup(text);
+
+	if (set->count == 1U)
+		(void) mowgli_node_add(set, &set->node, &multimark_marked);
+
+	(void) multimark_index_add(mu, mm);
+}
+
+static void
+multimark_remove(struct multimark_set *const restrict set, const unsigned int i)
+{
+	struct multimark *const mm = &set->marks[i];
+
+	(void) multimark_index_del(set->mu, mm);
+
+	(void) strshare_unref(mm->setter_uid);
+	(void) strshare_unref(mm->setter_name);
+	(void) strshare_unref(mm->restored_from_uid);
+	(void) strshare_unref(mm->restored_from_account);
+	(void) sfree(mm->mark);
+
+	// Keep the rest in order; marks are listed in the order they were set
+	(void) memmove(mm, mm + 1, (set->count - i - 1U) * sizeof *mm);
+
+	if (--set->count == 0)
+		(void) mowgli_node_delete(&set->node, &multimark_marked);
+}
+
+static void
+multimark_myuser_delete(struct myuser *const restrict mu)
+{
+	struct multimark_set *const set = multimark_get_set(mu);
+
+	(void) mowgli_patricia_delete(multimark_unmigrated, entity(mu)->id);
+
+	if (! set)
+		return;
+
+	while (set->count)
+		(void) multimark_remove(set, set->count - 1U);
+
+	(void) sfree(set->marks);
+	(void) sfree(set);
+}
+
+static void
+multimark_metadata_add(struct hook_metadata_req *const restrict req)
+{
+	if (strcmp(req->name, "private:mark:setter") != 0 || db_object_type(req->target) != DB_OBJECT_MYUSER)
+		return;
+
+	struct myuser *const mu = req->target;
+
+	if (! mowgli_patricia_retrieve(multimark_unmigrated, entity(mu)->id))
+		(void) mowgli_patricia_add(multimark_unmigrated, entity(mu)->id, mu);
+}
+
+static void
+multimark_metadata_delete(struct hook_metadata_req *const restrict req)
+{
+	if (strcmp(req->name, "private:mark:setter") != 0 || db_object_type(req->target) != DB_OBJECT_MYUSER)
+		return;
+
+	// If the account itself is going away, multimark_myuser_delete() has seen to it
+	if (atheme_object(req->target)->refcount == -1)
+		return;
+
+	(void) mowgli_patricia_delete(multimark_unmigrated, entity(req->target)->id);
+}
+
+struct multimark_search
+{
+	const char *pattern;        // for setter names, or
+	const char *word;           // for a word of a mark
+	mowgli_patricia_t *found;   // distinct accounts, by id
+};
+
+static int
+multimark_search_posting(const char ATHEME_VATTR_UNUSED *const restrict key, void *const restrict data,
+                         void *const restrict privdata)
+{
+	const struct multimark_posting *const mp = data;
+	struct multimark_search *const search = privdata;
+
+	(void) mowgli_patricia_add(search->found, entity(mp->mu)->id, mp->mu);
+
+	return 0;
+}
+
+static int
+multimark_search_key(const char *const restrict key, void *const restrict data, void *const restrict privdata)
+{
+	struct multimark_search *const search = privdata;
+
+	if (search->word ? (strstr(key, search->word) != NULL) : (match(search->pattern, key) == 0))
+		(void) mowgli_patricia_foreach(data, &multimark_search_posting, search);
+
+	return 0;
+}
+
+static int
+multimark_search_result(const char ATHEME_VATTR_UNUSED *const restrict key, void *const restrict data,
+                        void *const restrict privdata)
+{
+	struct myuser ***const cursor = privdata;
+
+	*(*cursor)++ = data;
+
+	return 0;
+}
+
+// The accounts in the postings of every key of index the search matches, as LIST candidates
+static void
+multimark_search_run(mowgli_patricia_t *const restrict index, struct multimark_search *const restrict search,
+                     struct myuser ***const restrict accounts, size_t *const restrict count)
+{
+	search->found = mowgli_patricia_create(NULL);
+
+	(void) mowgli_patricia_foreach(index, &multimark_search_key, search);
+
+	*count = mowgli_patricia_size(search->found);
+	*accounts = smalloc(((*count) ? (*count) : 1U) * sizeof **accounts);
+
+	struct myuser **cursor = *accounts;
+
+	(void) mowgli_patricia_foreach(search->found, &multimark_search_result, &cursor);
+	(void) mowgli_patricia_destroy(search->found, NULL, NULL);
 }
 
 static bool
 multimark_match(const struct mynick *mn, const void *arg)
 {
 	const char *markpattern = (const char*)arg;
-	struct myuser *mu = mn->owner;
+	const struct multimark_set *const set = multimark_get_set(mn->owner);
 
-	mowgli_list_t *l = multimark_list(mu);
-
-	mowgli_node_t *n;
-	struct multimark *mm;
-
-	MOWGLI_ITER_FOREACH(n, l->head)
+	for (unsigned int i = 0; set && i < set->count; i++)
 	{
-		mm = n->data;
-
-		if (!match(markpattern, mm->mark))
+		if (!match(markpattern, set->marks[i].mark))
 		{
 			return true;
 		}
@@ -81,12 +377,51 @@ multimark_match(const struct mynick *mn, const void *arg)
 	return false;
 }
 
+static bool
+multimark_match_candidates(const void *const arg, struct myuser ***const accounts, size_t *const count)
+{
+	char word[BUFSIZE];
+	struct multimark_search search = { .word = word };
+
+	// Every mark that matches has the longest literal word of the pattern in one of its words
+	if (! log_index_key(arg, word, sizeof word))
+		return false;
+
+	(void) multimark_search_run(multimark_words, &search, accounts, count);
+
+	return true;
+}
+
+static bool
+multimark_setter_match(const struct mynick *mn, const void *arg)
+{
+	const char *setterpattern = arg;
+	const struct multimark_set *const set = multimark_get_set(mn->owner);
+
+	for (unsigned int i = 0; set && i < set->count; i++)
+		if (! match(setterpattern, set->marks[i].setter_name))
+			return true;
+
+	return false;
+}
+
+static bool
+multimark_setter_candidates(const void *const arg, struct myuser ***const accounts, size_t *const count)
+{
+	struct multimark_search search = { .pattern = arg };
+
+	// There are far fewer setters than marked accounts, so this always pays
+	(void) multimark_search_run(multimark_setters, &search, accounts, count);
+
+	return true;
+}
+
 static bool
 is_user_marked(struct myuser *mu)
 {
-	mowgli_list_t *l = multimark_list(mu);
+	const struct multimark_set *const set = multimark_get_set(mu);
 
-	return MOWGLI_LIST_LENGTH(l) != 0;
+	return set && set->count != 0;
 }
 
 static bool
@@ -97,6 +432,26 @@ is_marked(const struct mynick *mn, const void *arg)
 	return is_user_marked(mu);
 }
 
+static bool
+is_marked_candidates(const void ATHEME_VATTR_UNUSED *const arg, struct myuser ***const accounts,
+                     size_t *const count)
+{
+	const mowgli_node_t *n;
+	size_t i = 0;
+
+	*count = MOWGLI_LIST_LENGTH(&multimark_marked);
+	*accounts = smalloc(((*count) ? (*count) : 1U) * sizeof **accounts);
+
+	MOWGLI_ITER_FOREACH(n, multimark_marked.head)
+	{
+		const struct multimark_set *const set = n->data;
+
+		(*accounts)[i++] = set->mu;
+	}
+
+	return true;
+}
+
 static mowgli_list_t *
 restored_mark_list(const char *nick)
 {
@@ -111,35 +466,72 @@ restored_mark_list(const char *nick)
 	return l;
 }
 
+static void
+restored_mark_free(struct restored_mark *rm)
+{
+	sfree(rm->account_uid);
+	sfree(rm->account_name);
+	sfree(rm->nick);
+	sfree(rm->setter_uid);
+	sfree(rm->setter_name);
+	sfree(rm->mark);
+	sfree(rm);
+}
+
+static unsigned int
+get_multimark_max(struct myuser *mu)
+{
+	unsigned int max = 0;
+
+	const struct multimark_set *const set = multimark_get_set(mu);
+
+	for (unsigned int i = 0; set && i < set->count; i++)
+	{
+		if (set->marks[i].number > max)
+		{
+			max = set->marks[i].number;
+		}
+	}
+
+	return max+1;
+}
+
+// Gives mu a mark it (or a nick of it) had before the account it was on was dropped
+static void
+multimark_restore(struct myuser *mu, const struct restored_mark *rm)
+{
+	const struct multimark mm = {
+		.setter_uid             = rm->setter_uid,
+		.setter_name            = rm->setter_name,
+		.restored_from_uid      = rm->account_uid,
+		.restored_from_account  = rm->account_name,
+		.time                   = rm->time,
+		.number                 = get_multimark_max(mu),
+	};
+
+	multimark_add(mu, &mm, rm->mark);
+}
+
 static void
 write_multimark_db(struct database_handle *db)
 {
 	mowgli_node_t *n;
-	struct myuser *mu;
-	struct myentity_iteration_state state;
-	mowgli_list_t *l;
-	struct myentity *mt;
+	const struct multimark_set *set;
 
 	mowgli_patricia_iteration_state_t state2;
 	mowgli_list_t *rml;
 	struct restored_mark *rm;
-	struct multimark *mm;
+	const struct multimark *mm;
 
-	MYENTITY_FOREACH_T(mt, &state, ENT_USER)
+	MOWGLI_ITER_FOREACH(n, multimark_marked.head)
 	{
-		mu = user(mt);
-		l = multimark_list(mu);
+		set = n->data;
 
-		if (l == NULL)
+		for (unsigned int i = 0; i < set->count; i++)
 		{
-			continue;
-		}
-
-		MOWGLI_ITER_FOREACH(n, l->head)
-		{
-			mm = n->data;
+			mm = &set->marks[i];
 			db_start_row(db, "MM");
-			db_write_word(db, entity(mu)->id);
+			db_write_word(db, entity(set->mu)->id);
 			db_write_word(db, mm->setter_uid);
 			db_write_word(db, mm->setter_name);
 
@@ -183,8 +575,6 @@ static void
 db_h_mm(struct database_handle *db, const char *type)
 {
 	struct myuser *mu;
-	mowgli_patricia_iteration_state_t state;
-	mowgli_list_t *l;
 
 	const char *account_uid = db_sread_word(db);
 	const char *setter_uid = db_sread_word(db);
@@ -197,24 +587,20 @@ db_h_mm(struct database_handle *db, const char *type)
 
 	mu = myuser_find_uid(account_uid);
 
-	l = multimark_list(mu);
-
-	struct multimark *const mm = smalloc(sizeof *mm);
-
-	mm->setter_uid = sstrdup(setter_uid);
-	mm->setter_name = sstrdup(setter_name);
-	mm->restored_from_account = sstrdup(restored_from_account);
+	struct multimark mm = {
+		.setter_uid             = setter_uid,
+		.setter_name            = setter_name,
+		.restored_from_account  = restored_from_account,
+		.time                   = time,
+		.number                 = number,
+	};
 
 	if (strcasecmp(restored_from_uid, "NULL"))
 	{
-		mm->restored_from_uid = sstrdup(restored_from_uid);
+		mm.restored_from_uid = restored_from_uid;
 	}
 
-	mm->time = time;
-	mm->number = number;
-	mm->mark = sstrdup(mark);
-
-	mowgli_node_add(mm, &mm->node, l);
+	multimark_add(mu, &mm, mark);
 }
 
 static void
@@ -246,41 +632,18 @@ db_h_rm(struct database_handle *db, const char *type)
 	mowgli_node_add(rm, &rm->node, l);
 }
 
-static unsigned int
-get_multimark_max(struct myuser *mu)
-{
-	unsigned int max = 0;
-
-	mowgli_list_t *l = multimark_list(mu);
-
-	mowgli_node_t *n;
-	struct multimark *mm;
-
-	MOWGLI_ITER_FOREACH(n, l->head)
-	{
-		mm = n->data;
-		if (mm->number > max)
-		{
-			max = mm->number;
-		}
-	}
-
-	return max+1;
-}
-
 // Copy old style marks
 static void
 migrate_user(struct myuser *mu)
 {
-	mowgli_list_t *l;
 	struct metadata *md;
 
 	char *setter, *reason;
 	struct myuser *setter_user;
+	char setterbuf[BUFSIZE];
 
 	time_t time;
 
-	l = multimark_list(mu);
 	md = metadata_find(mu, "private:mark:setter");
 	char *begin, *end;
 
@@ -295,7 +658,7 @@ migrate_user(struct myuser *mu)
 	md = metadata_find(mu, "private:mark:timestamp");
 	time = md != NULL ? atoi(md->value) : 0;
 
-	struct multimark *const mm = smalloc(sizeof *mm);
+	struct multimark mm = { .setter_uid = NULL };
 
 	/* "Was MARKED by nick (actual_account)"
 	 * Finds the string between '(' and ')', which
@@ -304,30 +667,27 @@ migrate_user(struct myuser *mu)
 	begin = strchr(setter, '(');
 
 	if (begin) {
-		end = strchr(setter, ')');
+		(void) mowgli_strlcpy(setterbuf, begin + 1, sizeof setterbuf);
+
+		end = strchr(setterbuf, ')');
 
 		if (end) {
 			*end = 0;
 		}
 
-		setter = sstrdup(begin+1);
+		setter = setterbuf;
 	}
 
 	if ((setter_user = myuser_find(setter)) != NULL) {
-		mm->setter_uid = sstrdup(entity(setter_user)->id);
-	} else {
-		mm->setter_uid = NULL;
+		mm.setter_uid = entity(setter_user)->id;
 	}
 
-	mm->setter_name = sstrdup(setter);
-	mm->restored_from_uid = NULL;
-	mm->restored_from_account = NULL;
+	mm.setter_name = setter;
 
-	mm->time = time;
-	mm->number = get_multimark_max(mu);
-	mm->mark = sstrdup(reason);
+	mm.time = time;
+	mm.number = get_multimark_max(mu);
 
-	mowgli_node_add(mm, &mm->node, l);
+	multimark_add(mu, &mm, reason);
 
 	// remove old style mark
 	metadata_delete(mu, "private:mark:setter");
@@ -338,16 +698,14 @@ migrate_user(struct myuser *mu)
 static void
 migrate_all(struct sourceinfo *si)
 {
-	struct myentity_iteration_state state;
-	struct myentity *mt;
+	mowgli_patricia_iteration_state_t state;
+	struct myuser *mu;
 
 	command_success_nodata(si, _("Migrating mark data..."));
 
-	MYENTITY_FOREACH_T(mt, &state, ENT_USER)
-	{
-		struct myuser *mu = user(mt);
+	// Deleting its old style mark takes each account off the tree again
+	MOWGLI_PATRICIA_FOREACH(mu, &state, multimark_unmigrated)
 		migrate_user(mu);
-	}
 
 	command_success_nodata(si, _("Mark data migrated successfully."));
 }
@@ -356,10 +714,9 @@ static void
 nick_ungroup_hook(struct hook_user_req *hdata)
 {
 	struct myuser *mu = hdata->mu;
-	mowgli_list_t *l = multimark_list(mu);
+	const struct multimark_set *const set = multimark_get_set(mu);
 
-	mowgli_node_t *n;
-	struct multimark *mm;
+	const struct multimark *mm;
 
 	char *uid = entity(mu)->id;
 	const char *nick = hdata->mn->nick;
@@ -367,9 +724,9 @@ nick_ungroup_hook(struct hook_user_req *hdata)
 
 	mowgli_list_t *rml = restored_mark_list(nick);
 
-	MOWGLI_ITER_FOREACH(n, l->head)
+	for (unsigned int i = 0; set && i < set->count; i++)
 	{
-		mm = n->data;
+		mm = &set->marks[i];
 
 		struct restored_mark *const rm = smalloc(sizeof *rm);
 		rm->account_uid = sstrdup(uid);
@@ -392,18 +749,17 @@ account_drop_hook(struct myuser *mu)
 
 	migrate_user(mu);
 
-	mowgli_list_t *l = multimark_list(mu);
+	const struct multimark_set *const set = multimark_get_set(mu);
 
-	mowgli_node_t *n;
-	struct multimark *mm;
+	const struct multimark *mm;
 
 	char *uid = entity(mu)->id;
 	const char *name = entity(mu)->name;
 	mowgli_list_t *rml = restored_mark_list(name);
 
-	MOWGLI_ITER_FOREACH(n, l->head)
+	for (unsigned int i = 0; set && i < set->count; i++)
 	{
-		mm = n->data;
+		mm = &set->marks[i];
 
 		struct restored_mark *const rm = smalloc(sizeof *rm);
 		rm->account_uid = sstrdup(uid);
@@ -421,7 +777,6 @@ account_drop_hook(struct myuser *mu)
 static void
 account_register_hook(struct myuser *mu)
 {
-	mowgli_list_t *l;
 	mowgli_node_t *n, *tn;
 
 	struct restored_mark *rm;
@@ -429,33 +784,21 @@ account_register_hook(struct myuser *mu)
 
 	const char *name = entity(mu)->name;
 
-	char *setter_name;
-	struct myuser *setter;
-
 	//Migrate any old-style marks that have already been restored at user
 	//creation.
 
 	migrate_user(mu);
 
-	l = multimark_list(mu);
 	rml = restored_mark_list(name);
 
 	MOWGLI_ITER_FOREACH_SAFE(n, tn, rml->head)
 	{
 		rm = n->data;
 
-		struct multimark *const mm = smalloc(sizeof *mm);
-		mm->setter_uid = sstrdup(rm->setter_uid);
-		mm->setter_name = sstrdup(rm->setter_name);
-		mm->restored_from_uid = rm->account_uid;
-		mm->restored_from_account = rm->account_name;
-		mm->time = rm->time;
-		mm->number = get_multimark_max(mu);
-		mm->mark = sstrdup(rm->mark);
-
-		mowgli_node_add(mm, &mm->node, l);
+		multimark_restore(mu, rm);
 
 		mowgli_node_delete(&rm->node, rml);
+		restored_mark_free(rm);
 	}
 }
 
@@ -463,20 +806,17 @@ static void
 nick_group_hook(struct hook_user_req *hdata)
 {
 	struct myuser *smu = hdata->si->smu;
-	mowgli_list_t *l;
+	const struct multimark_set *set;
 
-	mowgli_node_t *n, *tn, *n2;
-	struct multimark *mm2;
+	mowgli_node_t *n, *tn;
 
 	mowgli_list_t *rml;
 	struct restored_mark *rm;
 
-	char *uid = entity(smu)->id;
 	const char *name = hdata->mn->nick;
 
 	migrate_user(smu);
 
-	l = multimark_list(smu);
 	rml = restored_mark_list(name);
 
 	MOWGLI_ITER_FOREACH_SAFE(n, tn, rml->head)
@@ -484,11 +824,11 @@ nick_group_hook(struct hook_user_req *hdata)
 		rm = n->data;
 		bool already_exists = false;
 
-		MOWGLI_ITER_FOREACH (n2, l->head)
-		{
-			mm2 = n2->data;
+		set = multimark_get_set(smu);
 
-			if (!strcasecmp (mm2->mark, rm->mark))
+		for (unsigned int i = 0; set && i < set->count; i++)
+		{
+			if (!strcasecmp (set->marks[i].mark, rm->mark))
 			{
 				already_exists = true;
 				break;
@@ -497,31 +837,21 @@ nick_group_hook(struct hook_user_req *hdata)
 
 		mowgli_node_delete(&rm->node, rml);
 
-		if (already_exists)
+		if (! already_exists)
 		{
-			continue;
+			multimark_restore(smu, rm);
 		}
 
-		struct multimark *const mm = smalloc(sizeof *mm);
-		mm->setter_uid = sstrdup(rm->setter_uid);
-		mm->setter_name = sstrdup(rm->setter_name);
-		mm->restored_from_uid = rm->account_uid;
-		mm->restored_from_account = rm->account_name;
-		mm->time = rm->time;
-		mm->number = get_multimark_max(smu);
-		mm->mark = sstrdup(rm->mark);
-
-		mowgli_node_add(mm, &mm->node, l);
+		restored_mark_free(rm);
 	}
 }
 
 static void
 show_multimark(struct hook_user_req *hdata)
 {
-	mowgli_list_t *l;
+	const struct multimark_set *set;
 
-	mowgli_node_t *n;
-	struct multimark *mm;
+	const struct multimark *mm;
 	struct tm *tm;
 	char time[BUFSIZE];
 
@@ -537,11 +867,11 @@ show_multimark(struct hook_user_req *hdata)
 	}
 
 	migrate_user(hdata->mu);
-	l = multimark_list(hdata->mu);
+	set = multimark_get_set(hdata->mu);
 
-	MOWGLI_ITER_FOREACH(n, l->head)
+	for (unsigned int i = 0; set && i < set->count; i++)
 	{
-		mm = n->data;
+		mm = &set->marks[i];
 		tm = localtime(&mm->time);
 		strftime(time, sizeof time, TIME_FORMAT, tm);
 
@@ -729,10 +1059,9 @@ ns_cmd_multimark(struct sourceinfo *si, int parc, char *parv[])
 	char *action = parv[1];
 	char *info = parv[2];
 	struct myuser *mu;
-	struct myuser_name *mun;
-	mowgli_list_t *l;
+	struct multimark_set *set;
 
-	mowgli_node_t *n, *tn;
+	mowgli_node_t *n;
 	struct multimark *mm;
 	struct tm *tm;
 	char time[BUFSIZE];
@@ -782,15 +1111,14 @@ ns_cmd_multimark(struct sourceinfo *si, int parc, char *parv[])
 			return;
 		}
 
-		l = multimark_list(mu);
+		const struct multimark newmark = {
+			.setter_uid     = entity(si->smu)->id,
+			.setter_name    = entity(si->smu)->name,
+			.time           = CURRTIME,
+			.number         = get_multimark_max(mu),
+		};
 
-		mm = smalloc(sizeof *mm);
-		mm->setter_uid = sstrdup(entity(si->smu)->id);
-		mm->setter_name = sstrdup(entity(si->smu)->name);
-		mm->time = CURRTIME;
-		mm->number = get_multimark_max(mu);
-		mm->mark = sstrdup(info);
-		mowgli_node_add(mm, &mm->node, l);
+		multimark_add(mu, &newmark, info);
 
 		command_success_nodata(si, _("\2%s\2 has been marked."), target);
 		logcommand(si, CMDLOG_ADMIN, "MARK:ADD: \2%s\2 \2%s\2", target, info);
@@ -853,11 +1181,11 @@ ns_cmd_multimark(struct sourceinfo *si, int parc, char *parv[])
 
 		command_success_nodata(si, _("Marks for \2%s\2:"), target);
 
-		l = multimark_list(mu);
+		set = multimark_get_set(mu);
 
-		MOWGLI_ITER_FOREACH(n, l->head)
+		for (unsigned int i = 0; set && i < set->count; i++)
 		{
-			mm = n->data;
+			mm = &set->marks[i];
 			tm = localtime(&mm->time);
 			strftime(time, sizeof time, TIME_FORMAT, tm);
 
@@ -995,11 +1323,11 @@ ns_cmd_multimark(struct sourceinfo *si, int parc, char *parv[])
 
 		unsigned int found = 0;
 
-		l = multimark_list(mu);
+		set = multimark_get_set(mu);
 
-		MOWGLI_ITER_FOREACH_SAFE(n, tn, l->head)
+		for (unsigned int i = set ? set->count : 0; i-- > 0; )
 		{
-			mm = n->data;
+			mm = &set->marks[i];
 
 			switch (mode)
 			{
@@ -1017,14 +1345,7 @@ ns_cmd_multimark(struct sourceinfo *si, int parc, char *parv[])
 					break;
 			}
 
-			mowgli_node_delete(&mm->node, l);
-
-			sfree(mm->setter_uid);
-			sfree(mm->setter_name);
-			sfree(mm->restored_from_uid);
-			sfree(mm->restored_from_account);
-			sfree(mm->mark);
-			sfree(mm);
+			multimark_remove(set, i);
 
 			found++;
 
@@ -1077,6 +1398,81 @@ ns_cmd_multimark(struct sourceinfo *si, int parc, char *parv[])
 	}
 }
 
+// Takes over the marks an older copy of this module left in a list
+static void
+multimark_adopt_v1(struct myuser *mu)
+{
+	mowgli_list_t *const l = privatedata_get(mu, "mark:list");
+	mowgli_node_t *n, *tn;
+
+	if (l == NULL)
+		return;
+
+	MOWGLI_ITER_FOREACH_SAFE(n, tn, l->head)
+	{
+		struct multimark_v1 *const old = n->data;
+		const struct multimark mm = {
+			.setter_uid             = old->setter_uid,
+			.setter_name            = old->setter_name,
+			.restored_from_uid      = old->restored_from_uid,
+			.restored_from_account  = old->restored_from_account,
+			.time                   = old->time,
+			.number                 = old->number,
+		};
+
+		multimark_add(mu, &mm, old->mark);
+
+		mowgli_node_delete(&old->node, l);
+		sfree(old->setter_uid);
+		sfree(old->setter_name);
+		sfree(old->restored_from_uid);
+		sfree(old->restored_from_account);
+		sfree(old->mark);
+		sfree(old);
+	}
+}
+
+// The indexes are not kept across a reload; puts back what the accounts already have
+static void
+multimark_index_rebuild(void)
+{
+	struct myentity_iteration_state state;
+	struct myentity *mt;
+
+	MYENTITY_FOREACH_T(mt, &state, ENT_USER)
+	{
+		struct myuser *const mu = user(mt);
+		struct multimark_set *const set = multimark_get_set(mu);
+
+		if (set && set->count)
+		{
+			(void) mowgli_node_add(set, &set->node, &multimark_marked);
+
+			for (unsigned int i = 0; i < set->count; i++)
+				(void) multimark_index_add(mu, &set->marks[i]);
+		}
+
+		(void) multimark_adopt_v1(mu);
+
+		if (metadata_find(mu, "private:mark:setter"))
+			(void) mowgli_patricia_add(multimark_unmigrated, entity(mu)->id, mu);
+	}
+}
+
+static void
+multimark_postings_free(const char ATHEME_VATTR_UNUSED *const restrict key, void *const restrict data,
+                        void ATHEME_VATTR_UNUSED *const restrict privdata)
+{
+	(void) sfree(data);
+}
+
+static void
+multimark_index_free(const char ATHEME_VATTR_UNUSED *const restrict key, void *const restrict data,
+                     void ATHEME_VATTR_UNUSED *const restrict privdata)
+{
+	(void) mowgli_patricia_destroy(data, &multimark_postings_free, NULL);
+}
+
 static struct command ns_multimark = {
 	.name           = "MARK",
 	.desc           = N_("Adds a note to a user."),
@@ -1106,6 +1502,13 @@ mod_init(struct module *const restrict m)
 	else
 		mowgli_global_storage_free(MULTIMARK_PERSIST_MDNAME);
 
+	multimark_set_slot = privatedata_slot_register("mark:set");
+
+	multimark_setters = mowgli_patricia_create(&irccasecanon);
+	multimark_words = mowgli_patricia_create(NULL);
+	multimark_unmigrated = mowgli_patricia_create(NULL);
+	multimark_index_rebuild();
+
 	hook_add_db_write(write_multimark_db);
 	db_register_type_handler("MM", db_h_mm);
 	db_register_type_handler("RM", db_h_rm);
@@ -1117,18 +1520,30 @@ mod_init(struct module *const restrict m)
 	hook_add_nick_ungroup(nick_ungroup_hook);
 	hook_add_nick_group(nick_group_hook);
 	hook_add_user_register(account_register_hook);
+	hook_add_myuser_delete(multimark_myuser_delete);
+	hook_add_metadata_add(multimark_metadata_add);
+	hook_add_metadata_delete(multimark_metadata_delete);
 
 	service_named_bind_command("nickserv", &ns_multimark);
 
 	static struct list_param mark;
 	mark.opttype = OPT_STRING;
 	mark.is_match = multimark_match;
+	mark.candidates = multimark_match_candidates;
 
 	list_register("mark-reason", &mark);
 
+	static struct list_param mark_setter;
+	mark_setter.opttype = OPT_STRING;
+	mark_setter.is_match = multimark_setter_match;
+	mark_setter.candidates = multimark_setter_candidates;
+
+	list_register("mark-setter", &mark_setter);
+
 	static struct list_param mark_check;
 	mark_check.opttype = OPT_BOOL;
 	mark_check.is_match = is_marked;
+	mark_check.candidates = is_marked_candidates;
 
 	list_register("marked", &mark_check);
 
@@ -1149,12 +1564,21 @@ mod_deinit(const enum module_unload_intent ATHEME_VATTR_UNUSED intent)
 	hook_del_nick_ungroup(nick_ungroup_hook);
 	hook_del_nick_group(nick_group_hook);
 	hook_del_user_register(account_register_hook);
+	hook_del_myuser_delete(multimark_myuser_delete);
+	hook_del_metadata_add(multimark_metadata_add);
+	hook_del_metadata_delete(multimark_metadata_delete);
 
 	service_named_unbind_command("nickserv", &ns_multimark);
 
 	list_unregister("mark-reason");
+	list_unregister("mark-setter");
 	list_unregister("marked");
 
+	// The marks themselves stay with the accounts, for the next copy of this module
+	mowgli_patricia_destroy(multimark_setters, &multimark_index_free, NULL);
+	mowgli_patricia_destroy(multimark_words, &multimark_index_free, NULL);
+	mowgli_patricia_destroy(multimark_unmigrated, NULL, NULL);
+
 	mowgli_global_storage_put(MULTIMARK_PERSIST_MDNAME, restored_marks);
 }
 
@@ -0,0 +1,273 @@
+/*
+ * SPDX-License-Identifier: ISC
+ * SPDX-URL: https://spdx.org/licenses/ISC.html
+ *
+ * Copyright (C) 2026 Atheme Development Group (https://atheme.github.io/)
+ *
+ * Rejects e-mail addresses whose domain does not exist, for REGISTER and
+ * SET EMAIL, without blocking while the domain is looked up.
+ *
+ * The resolver can only ask for address records, so that is what is looked
+ * up: a domain is taken not to exist only if there is no such name for
+ * either A or AAAA. Anything short of a definite answer (e.g. a timeout, or
+ * a domain that only has MX records) lets the address through.
+ */
+
+#include <atheme.h>
+
+#define MXCHECK_CACHE_EXPIRE_INTERVAL (5 * SECONDS_PER_MINUTE)
+
+/* A domain's answer, cached or still being looked up; every command waiting
+ * for the same domain shares the one query.
+ */
+struct mxcheck_domain
+{
+	char                    name[EMAILLEN + 1];
+	mowgli_dns_query_t      dns_query;
+	mowgli_list_t           waiters;
+	time_t                  expires;
+	bool                    pending;
+	bool                    tried_aaaa;
+	bool                    exists;
+};
+
+// A command waiting for a domain to be looked up
+struct mxcheck_waiter
+{
+	mowgli_node_t           node;
+	struct mxcheck_domain * md;
+	email_check_cb          cb;
+	void *                  priv;
+};
+
+static mowgli_dns_t *dns_base = NULL;
+
+// Keyed by the domain
+static mowgli_patricia_t *mxcheck_cache = NULL;
+static mowgli_eventloop_timer_t *mxcheck_cache_timer = NULL;
+
+static unsigned int mxcheck_cache_time;
+static unsigned int mxcheck_negative_cache_time;
+
+static unsigned long long mxcheck_cache_hits = 0;
+static unsigned long long mxcheck_cache_joins = 0;
+static unsigned long long mxcheck_cache_misses = 0;
+static unsigned long long mxcheck_rejected = 0;
+
+static void
+mxcheck_domain_free(struct mxcheck_domain *const restrict md)
+{
+	if (md->pending)
+		(void) mowgli_dns_delete_query(dns_base, &md->dns_query);
+
+	(void) mowgli_patricia_delete(mxcheck_cache, md->name);
+	(void) sfree(md);
+}
+
+static void
+mxcheck_cache_expire(void ATHEME_VATTR_UNUSED *const restrict unused)
+{
+	mowgli_patricia_iteration_state_t state;
+	struct mxcheck_domain *md;
+
+	MOWGLI_PATRICIA_FOREACH(md, &state, mxcheck_cache)
+		if (! md->pending && md->expires <= CURRTIME)
+			(void) mxcheck_domain_free(md);
+}
+
+static void
+mxcheck_dns_callback(mowgli_dns_reply_t *const restrict reply, const int result, void *const restrict vptr)
+{
+	struct mxcheck_domain *const md = vptr;
+	mowgli_node_t *n;
+	bool answered = false;
+
+	if (result == MOWGLI_DNS_RES_SUCCESS && reply != NULL)
+	{
+		md->exists = true;
+		answered = true;
+	}
+	else if (result == MOWGLI_DNS_RES_NXDOMAIN && ! md->tried_aaaa)
+	{
+		// No A records; it may still have AAAA records
+		md->tried_aaaa = true;
+
+		(void) mowgli_dns_gethost_byname(dns_base, md->name, &md->dns_query, MOWGLI_DNS_T_AAAA);
+		return;
+	}
+	else if (result == MOWGLI_DNS_RES_NXDOMAIN)
+	{
+		md->exists = false;
+		answered = true;
+	}
+	else
+		md->exists = true;
+
+	md->pending = false;
+
+	// The resolver doesn't tell us the TTL either, so answers are kept for as long as configured
+	if (answered)
+		md->expires = CURRTIME + (md->exists ? mxcheck_cache_time : mxcheck_negative_cache_time);
+	else
+		md->expires = 0;
+
+	if (! md->exists)
+		mxcheck_rejected += MOWGLI_LIST_LENGTH(&md->waiters);
+
+	// A callback may cancel other waiters, so take them one at a time
+	while ((n = md->waiters.head) != NULL)
+	{
+		struct mxcheck_waiter *const mw = n->data;
+
+		(void) mowgli_node_delete(&mw->node, &md->waiters);
+		(void) mw->cb(md->exists, mw->priv);
+		(void) sfree(mw);
+	}
+
+	if (md->expires <= CURRTIME)
+		(void) mxcheck_domain_free(md);
+}
+
+static enum email_check_result
+mxcheck_start(const char *const restrict email, const email_check_cb cb, void *const restrict priv,
+              void **const restrict handle)
+{
+	const char *domain = strrchr(email, '@');
+	struct mxcheck_domain *md;
+
+	// Address literals have nothing to look up
+	if (! domain || ! *++domain || *domain == '[' || strlen(domain) > EMAILLEN)
+		return EMAIL_CHECK_VALID;
+
+	if ((md = mowgli_patricia_retrieve(mxcheck_cache, domain)) != NULL && ! md->pending && md->expires > CURRTIME)
+	{
+		mxcheck_cache_hits++;
+
+		if (md->exists)
+			return EMAIL_CHECK_VALID;
+
+		mxcheck_rejected++;
+		return EMAIL_CHECK_INVALID;
+	}
+
+	if (md == NULL)
+	{
+		md = smalloc(sizeof *md);
+		(void) mowgli_strlcpy(md->name, domain, sizeof md->name);
+		md->dns_query.ptr = md;
+		md->dns_query.callback = &mxcheck_dns_callback;
+		(void) mowgli_patricia_add(mxcheck_cache, md->name, md);
+	}
+
+	if (md->pending)
+		mxcheck_cache_joins++;
+	else
+	{
+		mxcheck_cache_misses++;
+		md->pending = true;
+		md->tried_aaaa = false;
+
+		// May call back straight away, in which case md may be gone
+		(void) mowgli_dns_gethost_byname(dns_base, domain, &md->dns_query, MOWGLI_DNS_T_A);
+
+		if ((md = mowgli_patricia_retrieve(mxcheck_cache, domain)) == NULL)
+			return EMAIL_CHECK_VALID;
+	}
+
+	if (! md->pending)
+		return md->exists ? EMAIL_CHECK_VALID : EMAIL_CHECK_INVALID;
+
+	// Nobody to tell later; the answer will be cached for next time
+	if (! cb)
+		return EMAIL_CHECK_VALID;
+
+	struct mxcheck_waiter *const mw = smalloc(sizeof *mw);
+
+	mw->md = md;
+	mw->cb = cb;
+	mw->priv = priv;
+
+	(void) mowgli_node_add(mw, &mw->node, &md->waiters);
+
+	*handle = mw;
+
+	return EMAIL_CHECK_PENDING;
+}
+
+// The query carries on regardless, to be cached
+static void
+mxcheck_cancel(void *const restrict handle)
+{
+	struct mxcheck_waiter *const mw = handle;
+
+	(void) mowgli_node_delete(&mw->node, &mw->md->waiters);
+	(void) sfree(mw);
+}
+
+static const struct email_checker mxcheck_checker = {
+	.start  = &mxcheck_start,
+	.cancel = &mxcheck_cancel,
+};
+
+static void
+mxcheck_osinfo(struct sourceinfo *const restrict si)
+{
+	const unsigned long long lookups = mxcheck_cache_hits + mxcheck_cache_joins + mxcheck_cache_misses;
+
+	(void) command_success_nodata(si, _("E-mail domain checks: %llu (%llu answered from the cache, %llu joined a "
+	                                    "query in flight, %llu queries sent; %llu rejected)"), lookups,
+	                              mxcheck_cache_hits, mxcheck_cache_joins, mxcheck_cache_misses,
+	                              mxcheck_rejected);
+
+	(void) command_success_nodata(si, _("E-mail domains cached: %u"), mowgli_patricia_size(mxcheck_cache));
+}
+
+static void
+mod_init(struct module *const restrict m)
+{
+	MODULE_TRY_REQUEST_DEPENDENCY(m, "nickserv/main")
+
+	if (! (dns_base = mowgli_dns_create(base_eventloop, MOWGLI_DNS_TYPE_ASYNC)))
+	{
+		(void) slog(LG_ERROR, "%s: failed to create Mowgli DNS resolver object", m->name);
+		m->mflags |= MODFLAG_FAIL;
+		return;
+	}
+
+	mxcheck_cache = mowgli_patricia_create(&strcasecanon);
+	mxcheck_cache_timer = timer_add("mxcheck_cache_expire", &mxcheck_cache_expire, NULL,
+	                                MXCHECK_CACHE_EXPIRE_INTERVAL);
+
+	(void) hook_add_operserv_info(&mxcheck_osinfo);
+
+	(void) add_duration_conf_item("MXCHECK_CACHE_TIME", &nicksvs.me->conf_table, 0, &mxcheck_cache_time, "m",
+	                              SECONDS_PER_HOUR);
+	(void) add_duration_conf_item("MXCHECK_NEGATIVE_CACHE_TIME", &nicksvs.me->conf_table, 0,
+	                              &mxcheck_negative_cache_time, "m", 10 * SECONDS_PER_MINUTE);
+
+	(void) email_checker_register(&mxcheck_checker);
+}
+
+static void
+mod_deinit(const enum module_unload_intent ATHEME_VATTR_UNUSED intent)
+{
+	mowgli_patricia_iteration_state_t state;
+	struct mxcheck_domain *md;
+
+	// Whoever is still waiting is told (and their waiters cancelled) first
+	(void) email_checker_unregister(&mxcheck_checker);
+
+	MOWGLI_PATRICIA_FOREACH(md, &state, mxcheck_cache)
+		(void) mxcheck_domain_free(md);
+
+	(void) timer_destroy(mxcheck_cache_timer);
+	(void) mowgli_patricia_destroy(mxcheck_cache, NULL, NULL);
+	(void) mowgli_dns_destroy(dns_base);
+
+	(void) hook_del_operserv_info(&mxcheck_osinfo);
+
+	(void) del_conf_item("MXCHECK_CACHE_TIME", &nicksvs.me->conf_table);
+	(void) del_conf_item("MXCHECK_NEGATIVE_CACHE_TIME", &nicksvs.me->conf_table);
+}
+
+SIMPLE_DECLARE_MODULE_V1("nickserv/mxcheck", MODULE_UNLOAD_CAPABILITY_OK)
@@ -12,18 +12,138 @@
 static unsigned int ratelimit_count = 0;
 static time_t ratelimit_firsttime = 0;
 
+// A registration waiting for verify_password_async(), with an authentication module
+struct ns_register_request
+{
+	struct command_pending *    cp;
+	struct pwverify_request *   req;
+	char                        eid[IDLEN + 1];
+};
+
+// Everything after the password check
+static void
+ns_register_finish(struct sourceinfo *const restrict si, struct myuser *const restrict mu)
+{
+	struct mynick *const mn = (nicksvs.no_nick_ownership ? NULL : mynick_find(entity(mu)->name));
+	char lau[BUFSIZE], lao[BUFSIZE];
+	struct hook_user_req req;
+
+	if (me.auth == AUTH_EMAIL)
+	{
+		char *key = random_string(16);
+		mu->flags |= MU_WAITAUTH;
+
+		metadata_add(mu, "private:verify:register:key", key);
+		metadata_add(mu, "private:verify:register:timestamp", number_to_string(time(NULL)));
+
+		if (!sendemail(si->su != NULL ? si->su : si->service->me, mu, EMAIL_REGISTER, mu->email, key))
+		{
+			command_fail(si, fault_emailfail, _("Sending email failed, sorry! Registration aborted."));
+			atheme_object_unref(mu);
+			sfree(key);
+			return;
+		}
+
+		command_success_nodata(si, _("An email containing nickname activation instructions has been sent to \2%s\2."), mu->email);
+		command_success_nodata(si, _("Please check the address if you don't receive it. If it is incorrect, DROP then REGISTER again."));
+		command_success_nodata(si, _("If you do not complete registration within one day, your nickname will expire."));
+
+		sfree(key);
+	}
+
+	// The user may have logged in to something else while the password was being checked
+	if (si->su != NULL && si->su->myuser == NULL)
+	{
+		si->su->myuser = mu;
+		mowgli_node_add(si->su, &si->su->mlnode, &mu->logins);
+
+		if (!(mu->flags & MU_WAITAUTH))
+			// only grant ircd registered status if it's verified
+			ircd_on_login(si->su, mu, NULL);
+	}
+
+	command_add_flood(si, FLOOD_MODERATE);
+
+	if (!nicksvs.no_nick_ownership && si->su != NULL)
+		logcommand(si, CMDLOG_REGISTER, "REGISTER: \2%s\2 to \2%s\2", entity(mu)->name, mu->email);
+	else
+		logcommand(si, CMDLOG_REGISTER, "REGISTER: \2%s\2 to \2%s\2 by \2%s\2", entity(mu)->name, mu->email, si->su != NULL ? si->su->nick : get_source_name(si));
+
+	if (is_soper(mu))
+	{
+		wallops("\2%s\2 registered the nick \2%s\2 and gained services operator privileges.", get_oper_name(si), entity(mu)->name);
+		logcommand(si, CMDLOG_ADMIN, "SOPER: \2%s\2 as \2%s\2", get_oper_name(si), entity(mu)->name);
+	}
+
+	command_success_nodata(si, _("\2%s\2 is now registered to \2%s\2."), entity(mu)->name, mu->email);
+	hook_call_user_register(mu);
+
+	if (si->su != NULL)
+	{
+		snprintf(lau, BUFSIZE, "%s@%s", si->su->user, si->su->vhost);
+		metadata_add(mu, "private:host:vhost", lau);
+
+		snprintf(lao, BUFSIZE, "%s@%s", si->su->user, si->su->host);
+		metadata_add(mu, "private:host:actual", lao);
+	}
+
+	if (!(mu->flags & MU_WAITAUTH))
+	{
+		req.si = si;
+		req.mu = mu;
+		req.mn = mn;
+		hook_call_user_verify_register(&req);
+	}
+}
+
+// The user quit while the password was being checked; the registration is abandoned
+static void
+ns_register_cancel(void *const restrict priv)
+{
+	struct ns_register_request *const rr = priv;
+	struct myuser *const mu = user(myentity_find_uid(rr->eid));
+
+	(void) verify_password_async_cancel(rr->req);
+
+	if (mu)
+		(void) atheme_object_unref(mu);
+
+	(void) sfree(rr);
+}
+
+static void
+ns_register_verified(struct myuser *const restrict mu, const bool verified, void *const restrict priv)
+{
+	struct ns_register_request *const rr = priv;
+	struct sourceinfo *const si = command_resume(rr->cp);
+
+	// The account was dropped meanwhile
+	if (! mu)
+		;
+	else if (! si)
+		(void) atheme_object_unref(mu);
+	else if (! verified)
+	{
+		command_fail(si, fault_authfail, _("Invalid password for \2%s\2."), entity(mu)->name);
+		bad_password(si, mu);
+		atheme_object_unref(mu);
+	}
+	else
+		(void) ns_register_finish(si, mu);
+
+	(void) command_finish(rr->cp);
+	(void) sfree(rr);
+}
+
 static void
 ns_cmd_register(struct sourceinfo *si, int parc, char *parv[])
 {
 	struct myuser *mu;
 	struct mynick *mn = NULL;
-	mowgli_node_t *n;
 	const char *account;
 	const char *pass;
 	const char *email;
-	char lau[BUFSIZE], lao[BUFSIZE];
 	struct hook_user_register_check hdata;
-	struct hook_user_req req;
 
 	if (si->smu)
 	{
@@ -121,6 +241,10 @@ ns_cmd_register(struct sourceinfo *si, int parc, char *parv[])
 		return;
 	}
 
+	// The domain may have to be looked up; if so, this is run again once it has been
+	if (!command_check_email(si, email, parc, parv))
+		return;
+
 	if ((unsigned int)(CURRTIME - ratelimit_firsttime) > config_options.ratelimit_period)
 	{
 		ratelimit_count = 0;
@@ -167,81 +291,32 @@ ns_cmd_register(struct sourceinfo *si, int parc, char *parv[])
 
 	if (auth_module_loaded)
 	{
-		if (!verify_password(mu, pass))
+		// Over IRC the password is checked off the main loop; anything else needs the answer now
+		if (si->su != NULL)
 		{
-			command_fail(si, fault_authfail, _("Invalid password for \2%s\2."), entity(mu)->name);
-			bad_password(si, mu);
-			atheme_object_unref(mu);
-			return;
-		}
-	}
+			struct ns_register_request *const rr = smalloc(sizeof *rr);
 
-	if (me.auth == AUTH_EMAIL)
-	{
-		char *key = random_string(16);
-		mu->flags |= MU_WAITAUTH;
+			(void) mowgli_strlcpy(rr->eid, entity(mu)->id, sizeof rr->eid);
 
-		metadata_add(mu, "private:verify:register:key", key);
-		metadata_add(mu, "private:verify:register:timestamp", number_to_string(time(NULL)));
+			if ((rr->req = verify_password_async(mu, pass, &ns_register_verified, rr)))
+			{
+				rr->cp = command_suspend(si, &ns_register_cancel, rr);
+				return;
+			}
 
-		if (!sendemail(si->su != NULL ? si->su : si->service->me, mu, EMAIL_REGISTER, mu->email, key))
+			(void) sfree(rr);
+		}
+
+		if (!verify_password(mu, pass))
 		{
-			command_fail(si, fault_emailfail, _("Sending email failed, sorry! Registration aborted."));
+			command_fail(si, fault_authfail, _("Invalid password for \2%s\2."), entity(mu)->name);
+			bad_password(si, mu);
 			atheme_object_unref(mu);
-			sfree(key);
 			return;
 		}
-
-		command_success_nodata(si, _("An email containing nickname activation instructions has been sent to \2%s\2."), mu->email);
-		command_success_nodata(si, _("Please check the address if you don't receive it. If it is incorrect, DROP then REGISTER again."));
-		command_success_nodata(si, _("If you do not complete registration within one day, your nickname will expire."));
-
-		sfree(key);
-	}
-
-	if (si->su != NULL)
-	{
-		si->su->myuser = mu;
-		n = mowgli_node_create();
-		mowgli_node_add(si->su, n, &mu->logins);
-
-		if (!(mu->flags & MU_WAITAUTH))
-			// only grant ircd registered status if it's verified
-			ircd_on_login(si->su, mu, NULL);
-	}
-
-	command_add_flood(si, FLOOD_MODERATE);
-
-	if (!nicksvs.no_nick_ownership && si->su != NULL)
-		logcommand(si, CMDLOG_REGISTER, "REGISTER: \2%s\2 to \2%s\2", account, email);
-	else
-		logcommand(si, CMDLOG_REGISTER, "REGISTER: \2%s\2 to \2%s\2 by \2%s\2", account, email, si->su != NULL ? si->su->nick : get_source_name(si));
-
-	if (is_soper(mu))
-	{
-		wallops("\2%s\2 registered the nick \2%s\2 and gained services operator privileges.", get_oper_name(si), entity(mu)->name);
-		logcommand(si, CMDLOG_ADMIN, "SOPER: \2%s\2 as \2%s\2", get_oper_name(si), entity(mu)->name);
 	}
 
-	command_success_nodata(si, _("\2%s\2 is now registered to \2%s\2."), entity(mu)->name, mu->email);
-	hook_call_user_register(mu);
-
-	if (si->su != NULL)
-	{
-		snprintf(lau, BUFSIZE, "%s@%s", si->su->user, si->su->vhost);
-		metadata_add(mu, "private:host:vhost", lau);
-
-		snprintf(lao, BUFSIZE, "%s@%s", si->su->user, si->su->host);
-		metadata_add(mu, "private:host:actual", lao);
-	}
-
-	if (!(mu->flags & MU_WAITAUTH))
-	{
-		req.si = si;
-		req.mu = mu;
-		req.mn = mn;
-		hook_call_user_verify_register(&req);
-	}
+	(void) ns_register_finish(si, mu);
 }
 
 static struct command ns_register = {
@@ -264,6 +339,8 @@ mod_init(struct module *const restrict m)
 static void
 mod_deinit(const enum module_unload_intent ATHEME_VATTR_UNUSED intent)
 {
+	(void) command_cancel_all(&ns_register);
+
 	service_named_unbind_command("nickserv", &ns_register);
 }
 
@@ -86,9 +86,9 @@ ns_cmd_return(struct sourceinfo *si, int parc, char *parv[])
 		u = (struct user *)n->data;
 		if (!ircd_logout_or_kill(u, entity(mu)->name))
 		{
+			hook_call_user_logout(u);
 			u->myuser = NULL;
 			mowgli_node_delete(n, &mu->logins);
-			mowgli_node_free(n);
 		}
 	}
 	mu->flags |= MU_NOBURSTLOGIN;
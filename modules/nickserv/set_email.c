@@ -53,6 +53,10 @@ ns_cmd_set_email(struct sourceinfo *si, int parc, char *parv[])
 		return;
 	}
 
+	// The domain may have to be looked up; if so, this is run again once it has been
+	if (!command_check_email(si, email, parc, parv))
+		return;
+
 	if (me.auth == AUTH_EMAIL)
 	{
 		unsigned long key = makekey();
@@ -102,6 +106,8 @@ mod_init(struct module *const restrict m)
 static void
 mod_deinit(const enum module_unload_intent ATHEME_VATTR_UNUSED intent)
 {
+	(void) command_cancel_all(&ns_set_email);
+
 	command_delete(&ns_set_email, *ns_set_cmdtree);
 }
 
@@ -42,7 +42,7 @@ ns_cmd_set_emailmemos(struct sourceinfo *si, int parc, char *parv[])
 
 	if (!strcasecmp("ON", params))
 	{
-		if (me.mta == NULL)
+		if (me.mta == NULL && me.smtprelay == NULL)
 		{
 			command_fail(si, fault_emailfail, _("Sending email is administratively disabled."));
 			return;
@@ -14,7 +14,7 @@ ns_cmd_taxonomy(struct sourceinfo *si, int parc, char *parv[])
 {
 	const char *target = parv[0];
 	struct myuser *mu;
-	mowgli_patricia_iteration_state_t state;
+	struct metadata_iteration_state state;
 	bool isoper;
 	struct metadata *md;
 
@@ -41,7 +41,7 @@ ns_cmd_taxonomy(struct sourceinfo *si, int parc, char *parv[])
 
 	command_success_nodata(si, _("Taxonomy for \2%s\2:"), entity(mu)->name);
 
-	MOWGLI_PATRICIA_FOREACH(md, &state, atheme_object(mu)->metadata)
+	METADATA_FOREACH(md, &state, mu)
 	{
 		if (!strncmp(md->name, "private:", 8) && !isoper)
 			continue;
@@ -59,6 +59,7 @@ static struct command ns_taxonomy = {
 	.maxparc        = 1,
 	.cmd            = &ns_cmd_taxonomy,
 	.help           = { .path = "nickserv/taxonomy" },
+	.replica_safe   = true,
 };
 
 static void
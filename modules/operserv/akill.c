@@ -46,36 +46,26 @@ os_cmd_akill(struct sourceinfo *const restrict si, const int parc, char **const
 	if (parc < 1)
 	{
 		(void) command_fail(si, fault_needmoreparams, STR_INSUFFICIENT_PARAMS, "AKILL");
-		(void) command_fail(si, fault_needmoreparams, _("Syntax: AKILL ADD|DEL|LIST"));
+		(void) command_fail(si, fault_needmoreparams, _("Syntax: AKILL ADD|IMPORT|DEL|LIST"));
 		return;
 	}
 
 	(void) subcommand_dispatch_simple(si->service, si, parc, parv, os_akill_cmds, "AKILL");
 }
 
-static void
-os_cmd_akill_add(struct sourceinfo *si, int parc, char *parv[])
+/* Parses the "[!P|!T <minutes>] <reason>" that AKILL ADD and IMPORT take,
+ * token being its first word (the rest is still in strtok()'s hands).
+ */
+static bool
+os_akill_parse_reason(struct sourceinfo *const restrict si, char *const restrict token, long *const restrict duration,
+                      char reason[static BUFSIZE], const char *const restrict cmd, const char *const restrict syntax)
 {
-	struct user *u;
-	char *target = parv[0];
-	char *token = strtok(parv[1], " ");
-	char star[] = "*";
-	const char *kuser, *khost;
-	char *treason, reason[BUFSIZE];
-	long duration;
+	char *treason;
 	char *s;
-	struct kline *k;
-
-	if (!target || !token)
-	{
-		command_fail(si, fault_needmoreparams, STR_INSUFFICIENT_PARAMS, "AKILL ADD");
-		command_fail(si, fault_needmoreparams, _("Syntax: AKILL ADD <nick|hostmask> [!P|!T <minutes>] <reason>"));
-		return;
-	}
 
 	if (!strcasecmp(token, "!P"))
 	{
-		duration = 0;
+		*duration = 0;
 		treason = strtok(NULL, "");
 
 		if (treason)
@@ -93,36 +83,36 @@ os_cmd_akill_add(struct sourceinfo *si, int parc, char *parv[])
 			mowgli_strlcpy(reason, "No reason given", BUFSIZE);
 		if (s)
 		{
-			duration = (atol(s) * SECONDS_PER_MINUTE);
+			*duration = (atol(s) * SECONDS_PER_MINUTE);
 			while (isdigit((unsigned char)*s))
 				s++;
 			if (*s == 'h' || *s == 'H')
-				duration *= MINUTES_PER_HOUR;
+				*duration *= MINUTES_PER_HOUR;
 			else if (*s == 'd' || *s == 'D')
-				duration *= MINUTES_PER_DAY;
+				*duration *= MINUTES_PER_DAY;
 			else if (*s == 'w' || *s == 'W')
-				duration *= MINUTES_PER_WEEK;
+				*duration *= MINUTES_PER_WEEK;
 			else if (*s == '\0')
 				;
 			else
-				duration = 0;
-			if (duration == 0)
+				*duration = 0;
+			if (*duration == 0)
 			{
 				command_fail(si, fault_badparams, _("Invalid duration given."));
-				command_fail(si, fault_badparams, _("Syntax: AKILL ADD <nick|hostmask> [!P|!T <minutes>] <reason>"));
-				return;
+				command_fail(si, fault_badparams, "%s", syntax);
+				return false;
 			}
 		}
 		else {
-			command_fail(si, fault_needmoreparams, STR_INSUFFICIENT_PARAMS, "AKILL ADD");
-			command_fail(si, fault_needmoreparams, _("Syntax: AKILL ADD <nick|hostmask> [!P|!T <minutes>] <reason>"));
-			return;
+			command_fail(si, fault_needmoreparams, STR_INSUFFICIENT_PARAMS, cmd);
+			command_fail(si, fault_needmoreparams, "%s", syntax);
+			return false;
 		}
 
 	}
 	else
 	{
-		duration = config_options.kline_time;
+		*duration = config_options.kline_time;
 		mowgli_strlcpy(reason, token, BUFSIZE);
 		treason = strtok(NULL, "");
 
@@ -133,6 +123,93 @@ os_cmd_akill_add(struct sourceinfo *si, int parc, char *parv[])
 		}
 	}
 
+	return true;
+}
+
+// Whether kuser@khost is specific enough for si to AKILL; if not, says why unless quiet
+static bool
+os_akill_mask_specific(struct sourceinfo *const restrict si, const char *const restrict kuser,
+                       const char *const restrict khost, const bool quiet)
+{
+	const char *p;
+	int i = 0;
+
+	/* make sure there's at least 4 non-wildcards */
+	/* except if the user has no wildcards */
+	for (p = kuser; *p; p++)
+	{
+		if (*p != '*' && *p != '?' && *p != '.')
+			i++;
+	}
+	for (p = khost; *p; p++)
+	{
+		if (*p != '*' && *p != '?' && *p != '.')
+			i++;
+	}
+
+	if (i < 4 && (strchr(kuser, '*') || strchr(kuser, '?')) && !has_priv(si, PRIV_AKILL_ANYMASK))
+	{
+		if (!quiet)
+			command_fail(si, fault_badparams, _("Invalid user@host: \2%s@%s\2. At least four non-wildcard characters are required."), kuser, khost);
+		return false;
+	}
+
+	return true;
+}
+
+// Whether *@khost would not ban services themselves, or nearly everyone
+static bool
+os_akill_mask_safe(struct sourceinfo *const restrict si, const char *const restrict kuser,
+                   const char *const restrict khost, const bool quiet)
+{
+	if (!strcmp(kuser, "*"))
+	{
+		bool unsafe = false;
+		const char *p;
+
+		if (!match(khost, "127.0.0.1") || !match_ips(khost, "127.0.0.1"))
+			unsafe = true;
+		else if (me.vhost != NULL && (!match(khost, me.vhost) || !match_ips(khost, me.vhost)))
+			unsafe = true;
+		else if ((p = strrchr(khost, '/')) != NULL && IsDigit(p[1]) && atoi(p + 1) < 4)
+			unsafe = true;
+		if (unsafe)
+		{
+			if (!quiet)
+			{
+				command_fail(si, fault_badparams, _("Invalid user@host: \2%s@%s\2. This mask is unsafe."), kuser, khost);
+				logcommand(si, CMDLOG_ADMIN, "failed AKILL ADD \2%s@%s\2 (unsafe mask)", kuser, khost);
+			}
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static void
+os_cmd_akill_add(struct sourceinfo *si, int parc, char *parv[])
+{
+	struct user *u;
+	char *target = parv[0];
+	char *token = strtok(parv[1], " ");
+	char star[] = "*";
+	const char *kuser, *khost;
+	char reason[BUFSIZE];
+	long duration;
+	struct kline *k;
+
+	if (!target || !token)
+	{
+		command_fail(si, fault_needmoreparams, STR_INSUFFICIENT_PARAMS, "AKILL ADD");
+		command_fail(si, fault_needmoreparams, _("Syntax: AKILL ADD <nick|hostmask> [!P|!T <minutes>] <reason>"));
+		return;
+	}
+
+	if (!os_akill_parse_reason(si, token, &duration, reason, "AKILL ADD",
+	                           _("Syntax: AKILL ADD <nick|hostmask> [!P|!T <minutes>] <reason>")))
+		return;
+
 	if (strchr(target,'!'))
 	{
 		command_fail(si, fault_badparams, _("Invalid character '%c' in user@host."), '!');
@@ -155,9 +232,6 @@ os_cmd_akill_add(struct sourceinfo *si, int parc, char *parv[])
 	}
 	else
 	{
-		const char *p;
-		int i = 0;
-
 		kuser = collapse(strtok(target, "@"));
 		khost = collapse(strtok(NULL, ""));
 
@@ -175,44 +249,12 @@ os_cmd_akill_add(struct sourceinfo *si, int parc, char *parv[])
 			return;
 		}
 
-		/* make sure there's at least 4 non-wildcards */
-		/* except if the user has no wildcards */
-		for (p = kuser; *p; p++)
-		{
-			if (*p != '*' && *p != '?' && *p != '.')
-				i++;
-		}
-		for (p = khost; *p; p++)
-		{
-			if (*p != '*' && *p != '?' && *p != '.')
-				i++;
-		}
-
-		if (i < 4 && (strchr(kuser, '*') || strchr(kuser, '?')) && !has_priv(si, PRIV_AKILL_ANYMASK))
-		{
-			command_fail(si, fault_badparams, _("Invalid user@host: \2%s@%s\2. At least four non-wildcard characters are required."), kuser, khost);
+		if (!os_akill_mask_specific(si, kuser, khost, false))
 			return;
-		}
 	}
 
-	if (!strcmp(kuser, "*"))
-	{
-		bool unsafe = false;
-		char *p;
-
-		if (!match(khost, "127.0.0.1") || !match_ips(khost, "127.0.0.1"))
-			unsafe = true;
-		else if (me.vhost != NULL && (!match(khost, me.vhost) || !match_ips(khost, me.vhost)))
-			unsafe = true;
-		else if ((p = strrchr(khost, '/')) != NULL && IsDigit(p[1]) && atoi(p + 1) < 4)
-			unsafe = true;
-		if (unsafe)
-		{
-			command_fail(si, fault_badparams, _("Invalid user@host: \2%s@%s\2. This mask is unsafe."), kuser, khost);
-			logcommand(si, CMDLOG_ADMIN, "failed AKILL ADD \2%s@%s\2 (unsafe mask)", kuser, khost);
-			return;
-		}
-	}
+	if (!os_akill_mask_safe(si, kuser, khost, false))
+		return;
 
 	if (kline_find(kuser, khost))
 	{
@@ -236,6 +278,92 @@ os_cmd_akill_add(struct sourceinfo *si, int parc, char *parv[])
 		logcommand(si, CMDLOG_ADMIN, "AKILL:ADD: \2%s@%s\2 (reason: \2%s\2) (duration: \2Permanent\2)", k->user, k->host, k->reason);
 }
 
+/* Adds many user@host masks at once (separated by commas), for importing
+ * blocklists; see kline_add_bulk() for how they are sent to the network.
+ */
+static void
+os_cmd_akill_import(struct sourceinfo *si, int parc, char *parv[])
+{
+	char *list = parv[0];
+	char *token = strtok(parv[1], " ");
+	char reason[BUFSIZE];
+	struct kline_mask *masks;
+	size_t count = 0, size = 1;
+	unsigned int invalid = 0, dups = 0, added;
+	long duration;
+
+	if (!list || !token)
+	{
+		command_fail(si, fault_needmoreparams, STR_INSUFFICIENT_PARAMS, "AKILL IMPORT");
+		command_fail(si, fault_needmoreparams, _("Syntax: AKILL IMPORT <user@host>[,<user@host>...] [!P|!T <minutes>] <reason>"));
+		return;
+	}
+
+	if (!os_akill_parse_reason(si, token, &duration, reason, "AKILL IMPORT",
+	                           _("Syntax: AKILL IMPORT <user@host>[,<user@host>...] [!P|!T <minutes>] <reason>")))
+		return;
+
+	for (const char *p = list; *p; p++)
+		if (*p == ',')
+			size++;
+
+	masks = smalloc(size * sizeof *masks);
+
+	for (char *mask = list, *next; mask != NULL; mask = next)
+	{
+		char *at;
+
+		if ((next = strchr(mask, ',')) != NULL)
+			*next++ = '\0';
+
+		if (!*mask)
+			continue;
+
+		// Only user@host masks; a nick in a list to be imported is more likely a mistake
+		if ((at = strchr(mask, '@')) == NULL || at == mask || !at[1] || strchr(at + 1, '@') || strchr(mask, '!'))
+		{
+			invalid++;
+			continue;
+		}
+
+		*at = '\0';
+
+		const char *const kuser = collapse(mask);
+		const char *const khost = collapse(at + 1);
+
+		if (!os_akill_mask_specific(si, kuser, khost, true) || !os_akill_mask_safe(si, kuser, khost, true))
+		{
+			invalid++;
+			continue;
+		}
+
+		masks[count].user = kuser;
+		masks[count].host = khost;
+		count++;
+	}
+
+	added = kline_add_bulk(masks, count, reason, duration, get_storage_oper_name(si), &dups);
+
+	sfree(masks);
+
+	if (duration)
+		command_success_nodata(si, _("Added \2%u\2 timed AKILLs, which will expire in %s."), added, timediff(duration));
+	else
+		command_success_nodata(si, _("Added \2%u\2 AKILLs."), added);
+
+	if (dups)
+		command_success_nodata(si, _("\2%u\2 masks were already matched in the database."), dups);
+
+	if (invalid)
+		command_success_nodata(si, _("\2%u\2 masks were invalid or unsafe, and were skipped."), invalid);
+
+	if (added)
+		verbose_wallops("\2%s\2 is \2importing\2 \2%u\2 \2AKILLs\2 -- reason: \2%s\2", get_oper_name(si), added, reason);
+
+	logcommand(si, CMDLOG_ADMIN, "AKILL:IMPORT: \2%u\2 added, \2%u\2 already matched, \2%u\2 invalid (reason: \2%s\2) (duration: \2%s\2)",
+	           added, dups, invalid, reason, duration ? timediff(duration) : "Permanent");
+}
+
 static void
 os_cmd_akill_del(struct sourceinfo *si, int parc, char *parv[])
 {
@@ -517,6 +645,15 @@ static struct command os_akill_add = {
 	.help           = { .path = "" },
 };
 
+static struct command os_akill_import = {
+	.name           = "IMPORT",
+	.desc           = N_("Adds many network host bans at once."),
+	.access         = AC_NONE,
+	.maxparc        = 2,
+	.cmd            = &os_cmd_akill_import,
+	.help           = { .path = "" },
+};
+
 static struct command os_akill_del = {
 	.name           = "DEL",
 	.desc           = N_("Deletes a network host ban."),
@@ -558,6 +695,7 @@ mod_init(struct module *const restrict m)
 	}
 
 	(void) command_add(&os_akill_add, os_akill_cmds);
+	(void) command_add(&os_akill_import, os_akill_cmds);
 	(void) command_add(&os_akill_del, os_akill_cmds);
 	(void) command_add(&os_akill_list, os_akill_cmds);
 	(void) command_add(&os_akill_sync, os_akill_cmds);
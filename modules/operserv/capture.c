@@ -0,0 +1,151 @@
+/*
+ * SPDX-License-Identifier: ISC
+ * SPDX-URL: https://spdx.org/licenses/ISC.html
+ *
+ * Copyright (C) 2026 Atheme Development Group (https://atheme.github.io/)
+ *
+ * Starts and stops capturing uplink traffic (see libathemecore/capture.c).
+ */
+
+#include <atheme.h>
+
+#define CAPTURE_SIZE_DEF_MIB    64U
+
+// Captures go in the data directory; a name may not go anywhere else
+static bool
+os_capture_name_valid(const char *const restrict name)
+{
+	if (! *name || *name == '.' || strlen(name) > 64U)
+		return false;
+
+	for (const char *p = name; *p; p++)
+		if (! isalnum((unsigned char) *p) && *p != '.' && *p != '-' && *p != '_')
+			return false;
+
+	return true;
+}
+
+static void
+os_cmd_capture_start(struct sourceinfo *const restrict si, const char *const restrict name,
+                     const char *const restrict sizestr)
+{
+	char path[BUFSIZE];
+	unsigned int mib = CAPTURE_SIZE_DEF_MIB;
+
+	if (! name)
+	{
+		(void) command_fail(si, fault_needmoreparams, STR_INSUFFICIENT_PARAMS, "CAPTURE START");
+		(void) command_fail(si, fault_needmoreparams, _("Syntax: CAPTURE START <file> [size]"));
+		return;
+	}
+
+	if (! os_capture_name_valid(name))
+	{
+		(void) command_fail(si, fault_badparams, _("\2%s\2 is not a valid capture file name."), name);
+		return;
+	}
+
+	const unsigned int mib_max = (unsigned int) (CAPTURE_SIZE_MAX / (1024U * 1024U));
+
+	if (sizestr && (! string_to_uint(sizestr, &mib) || ! mib || mib > mib_max))
+	{
+		(void) command_fail(si, fault_badparams, _("The size must be between 1 and %u MiB."), mib_max);
+		return;
+	}
+
+	(void) snprintf(path, sizeof path, "%s/%s", datadir, name);
+
+	if (! capture_start(path, ((size_t) mib) * 1024U * 1024U))
+	{
+		(void) command_fail(si, fault_nosuch_target, _("Could not start capturing to \2%s\2; see the log "
+		                                               "for why."), name);
+		return;
+	}
+
+	(void) wallops("\2%s\2 started capturing uplink traffic to \2%s\2.", get_oper_name(si), name);
+	(void) logcommand(si, CMDLOG_ADMIN, "CAPTURE:START: \2%s\2 (\2%u\2 MiB)", name, mib);
+	(void) command_success_nodata(si, _("Now capturing uplink traffic to \2%s\2 (%u MiB)."), name, mib);
+}
+
+static void
+os_cmd_capture_stop(struct sourceinfo *const restrict si)
+{
+	if (! capture_running)
+	{
+		(void) command_fail(si, fault_nochange, _("Uplink traffic is not being captured."));
+		return;
+	}
+
+	(void) capture_stop();
+
+	(void) wallops("\2%s\2 stopped capturing uplink traffic.", get_oper_name(si));
+	(void) logcommand(si, CMDLOG_ADMIN, "CAPTURE:STOP");
+	(void) command_success_nodata(si, _("No longer capturing uplink traffic."));
+}
+
+static void
+os_cmd_capture_status(struct sourceinfo *const restrict si)
+{
+	struct capture_status status;
+
+	if (! capture_status_get(&status))
+	{
+		(void) command_success_nodata(si, _("Uplink traffic is not being captured."));
+		return;
+	}
+
+	(void) command_success_nodata(si, _("Capturing uplink traffic to \2%s\2 for %s."), status.path,
+	                              time_ago(status.started));
+	(void) command_success_nodata(si, _("%llu lines written, %llu still in the file (%zu of %zu KiB used)."),
+	                              status.written, status.records, status.used / 1024U, status.size / 1024U);
+	(void) logcommand(si, CMDLOG_GET, "CAPTURE:STATUS");
+}
+
+static void
+os_cmd_capture(struct sourceinfo *si, int parc, char *parv[])
+{
+	if (parc < 1)
+	{
+		(void) command_fail(si, fault_needmoreparams, STR_INSUFFICIENT_PARAMS, "CAPTURE");
+		(void) command_fail(si, fault_needmoreparams, _("Syntax: CAPTURE START|STOP|STATUS [parameters]"));
+		return;
+	}
+
+	if (! strcasecmp(parv[0], "START"))
+		(void) os_cmd_capture_start(si, (parc > 1) ? parv[1] : NULL, (parc > 2) ? parv[2] : NULL);
+	else if (! strcasecmp(parv[0], "STOP"))
+		(void) os_cmd_capture_stop(si);
+	else if (! strcasecmp(parv[0], "STATUS"))
+		(void) os_cmd_capture_status(si);
+	else
+	{
+		(void) command_fail(si, fault_badparams, STR_INVALID_PARAMS, "CAPTURE");
+		(void) command_fail(si, fault_badparams, _("Syntax: CAPTURE START|STOP|STATUS [parameters]"));
+	}
+}
+
+static struct command os_capture = {
+	.name           = "CAPTURE",
+	.desc           = N_("Captures uplink traffic to a file for replaying."),
+	.access         = PRIV_ADMIN,
+	.maxparc        = 3,
+	.cmd            = &os_cmd_capture,
+	.help           = { .path = "oservice/capture" },
+};
+
+static void
+mod_init(struct module *const restrict m)
+{
+	MODULE_TRY_REQUEST_DEPENDENCY(m, "operserv/main")
+
+	(void) service_named_bind_command("operserv", &os_capture);
+}
+
+static void
+mod_deinit(const enum module_unload_intent ATHEME_VATTR_UNUSED intent)
+{
+	// A capture in progress carries on; it belongs to the core
+	(void) service_named_unbind_command("operserv", &os_capture);
+}
+
+SIMPLE_DECLARE_MODULE_V1("operserv/capture", MODULE_UNLOAD_CAPABILITY_OK)
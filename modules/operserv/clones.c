@@ -12,35 +12,74 @@
 #define CLONESDB_VERSION	3
 #define CLONES_GRACE_TIMEPERIOD	180
 
+/* Host entries and exemptions live in the same radix tree, so that a single
+ * walk down it from the root finds both; the kind comes first in each.
+ */
+enum clones_entry_kind
+{
+	CLONES_ENTRY_HOST       = 0,
+	CLONES_ENTRY_EXEMPTION  = 1,
+};
+
 struct clones_exemption
 {
+	enum clones_entry_kind kind;
 	char *ip;
 	unsigned int allowed;
 	unsigned int warn;
 	char *reason;
 	long expires;
+	struct cidr_tree_node *leaf;    // NULL if ip can't be parsed
+	mowgli_node_t treenode;
 };
 
 struct clones_hostentry
 {
-	char ip[HOSTIPLEN + 1];
+	enum clones_entry_kind kind;
+	char ip[HOSTIPLEN + 5];         // The address, or prefix/length
+	struct cidr_addr prefix;
 	mowgli_list_t clients;
 	time_t firstkill;
 	unsigned int gracekills;
+	bool splitting;
+	struct cidr_tree_node *leaf;
+	mowgli_node_t treenode;
+	mowgli_node_t node;
+	unsigned int heapidx;           // In clones_heap
+};
+
+struct clones_lookup
+{
+	unsigned int bitlen;            // Of the host entry wanted
+	struct clones_hostentry *he;
+	struct clones_exemption *c;
 };
 
 static mowgli_patricia_t *os_clones_cmds = NULL;
-static mowgli_patricia_t *hostlist = NULL;
+static struct cidr_tree *clones_tree = NULL;
+static mowgli_list_t hostentries;
 static mowgli_heap_t *hostentry_heap = NULL;
+
+/* Every host entry, in a binary max-heap on the number of clients, so that
+ * the busiest hosts can be found without looking at all of the others
+ */
+static struct clones_hostentry **clones_heap = NULL;
+static unsigned int clones_heap_len = 0;
+static unsigned int clones_heap_size = 0;
 static struct service *serviceinfo = NULL;
 
 static mowgli_list_t clone_exempts;
+static struct db_shard *clones_shard = NULL;
 static bool kline_enabled;
 static unsigned int grace_count;
 static long kline_duration = SECONDS_PER_HOUR;
 static unsigned int clones_allowed, clones_warn;
 static unsigned int clones_dbversion = 1;
 
+// The prefix lengths the host entries in clones_tree were made with
+static unsigned int clones_ipv4_prefix = 32;
+static unsigned int clones_ipv6_prefix = 64;
+
 static inline bool
 cexempt_expired(struct clones_exemption *c)
 {
@@ -50,11 +89,390 @@ cexempt_expired(struct clones_exemption *c)
 	return false;
 }
 
+static bool
+cexempt_parse(const char *const restrict ip, struct cidr_addr *const restrict ca)
+{
+	if (strchr(ip, '/'))
+		return cidr_parse_mask(ip, ca);
+
+	return cidr_parse_address(ip, ca);
+}
+
+static void
+cexempt_attach(struct clones_exemption *const restrict c)
+{
+	struct cidr_addr ca;
+
+	c->kind = CLONES_ENTRY_EXEMPTION;
+	c->leaf = NULL;
+
+	if (! cexempt_parse(c->ip, &ca))
+	{
+		(void) slog(LG_ERROR, "CLONES: exemption for \2%s\2 is not a valid IP address or mask; ignoring it",
+		            c->ip);
+		return;
+	}
+
+	c->leaf = cidr_tree_add(clones_tree, &ca, c, &c->treenode);
+}
+
+static void
+cexempt_free(struct clones_exemption *const restrict c, mowgli_node_t *const restrict n)
+{
+	if (c->leaf)
+		(void) cidr_tree_delete(clones_tree, c->leaf, &c->treenode);
+
+	(void) sfree(c->ip);
+	(void) sfree(c->reason);
+	(void) sfree(c);
+	(void) mowgli_node_delete(n, &clone_exempts);
+	(void) mowgli_node_free(n);
+}
+
+static void
+clones_lookup_cb(mowgli_list_t *const restrict entries, void *const restrict privdata)
+{
+	struct clones_lookup *const lk = privdata;
+	mowgli_node_t *n;
+
+	MOWGLI_ITER_FOREACH(n, entries->head)
+	{
+		const enum clones_entry_kind *const kind = n->data;
+
+		if (*kind == CLONES_ENTRY_HOST)
+		{
+			struct clones_hostentry *const he = n->data;
+
+			if (he->prefix.prefixlen == lk->bitlen)
+				lk->he = he;
+		}
+		else
+		{
+			struct clones_exemption *const c = n->data;
+
+			// Prefixes are visited from the shortest to the longest, so the most specific one wins
+			if (! cexempt_expired(c))
+				lk->c = c;
+		}
+	}
+}
+
+static inline unsigned int
+clones_host_count(const struct clones_hostentry *const restrict he)
+{
+	return (unsigned int) MOWGLI_LIST_LENGTH(&he->clients);
+}
+
+static inline void
+clones_heap_set(const unsigned int i, struct clones_hostentry *const restrict he)
+{
+	clones_heap[i] = he;
+	he->heapidx = i;
+}
+
+static void
+clones_heap_up(unsigned int i)
+{
+	struct clones_hostentry *const he = clones_heap[i];
+	const unsigned int count = clones_host_count(he);
+
+	while (i > 0)
+	{
+		const unsigned int parent = (i - 1) / 2;
+
+		if (clones_host_count(clones_heap[parent]) >= count)
+			break;
+
+		(void) clones_heap_set(i, clones_heap[parent]);
+		i = parent;
+	}
+
+	(void) clones_heap_set(i, he);
+}
+
+static void
+clones_heap_down(unsigned int i)
+{
+	struct clones_hostentry *const he = clones_heap[i];
+	const unsigned int count = clones_host_count(he);
+
+	for (;;)
+	{
+		unsigned int child = (2 * i) + 1;
+
+		if (child >= clones_heap_len)
+			break;
+
+		if (child + 1 < clones_heap_len &&
+		    clones_host_count(clones_heap[child + 1]) > clones_host_count(clones_heap[child]))
+			child++;
+
+		if (clones_host_count(clones_heap[child]) <= count)
+			break;
+
+		(void) clones_heap_set(i, clones_heap[child]);
+		i = child;
+	}
+
+	(void) clones_heap_set(i, he);
+}
+
+static void
+clones_heap_insert(struct clones_hostentry *const restrict he)
+{
+	if (clones_heap_len == clones_heap_size)
+	{
+		clones_heap_size = clones_heap_size ? (clones_heap_size * 2) : 64;
+		clones_heap = sreallocarray(clones_heap, clones_heap_size, sizeof *clones_heap);
+	}
+
+	(void) clones_heap_set(clones_heap_len++, he);
+	(void) clones_heap_up(he->heapidx);
+}
+
+static void
+clones_heap_remove(struct clones_hostentry *const restrict he)
+{
+	struct clones_hostentry *const last = clones_heap[--clones_heap_len];
+
+	if (last == he)
+		return;
+
+	(void) clones_heap_set(he->heapidx, last);
+	(void) clones_heap_up(last->heapidx);
+	(void) clones_heap_down(last->heapidx);
+}
+
+/* Finds the host entry counting clients from u's address (and creates it,
+ * if asked to), and the most specific exemption covering that address;
+ * O(prefix length).
+ */
+static struct clones_hostentry *
+clones_host_find(struct user *const restrict u, struct clones_exemption **const restrict exempt, const bool create)
+{
+	struct clones_lookup lk = { .he = NULL, .c = NULL };
+	struct clones_hostentry *he;
+	const char *const ip = u->ip;
+	const struct cidr_addr ca = u->ipaddr;
+
+	if (exempt)
+		*exempt = NULL;
+
+	if (ca.family == 0)
+		return NULL;
+
+	lk.bitlen = (ca.family == AF_INET6) ? clones_ipv6_prefix : clones_ipv4_prefix;
+
+	(void) cidr_tree_foreach_match(clones_tree, &ca, &clones_lookup_cb, &lk);
+
+	if (exempt)
+		*exempt = lk.c;
+
+	if (lk.he || ! create)
+		return lk.he;
+
+	he = mowgli_heap_alloc(hostentry_heap);
+	he->kind = CLONES_ENTRY_HOST;
+	he->prefix = ca;
+
+	if (lk.bitlen == ca.prefixlen)
+		(void) mowgli_strlcpy(he->ip, ip, sizeof he->ip);
+	else
+	{
+		char addr[HOSTIPLEN + 1];
+
+		for (unsigned int bit = lk.bitlen; bit < ca.prefixlen; bit++)
+			he->prefix.addr[bit >> 3] &= (unsigned char) ~(0x80U >> (bit & 0x07U));
+
+		he->prefix.prefixlen = lk.bitlen;
+
+		if (! inet_ntop(ca.family, he->prefix.addr, addr, sizeof addr))
+			(void) mowgli_strlcpy(addr, ip, sizeof addr);
+
+		(void) snprintf(he->ip, sizeof he->ip, "%s/%u", addr, lk.bitlen);
+	}
+
+	he->leaf = cidr_tree_add(clones_tree, &he->prefix, he, &he->treenode);
+	(void) mowgli_node_add(he, &he->node, &hostentries);
+	(void) clones_heap_insert(he);
+
+	return he;
+}
+
+static void
+clones_host_free(struct clones_hostentry *const restrict he)
+{
+	mowgli_node_t *n, *tn;
+
+	MOWGLI_ITER_FOREACH_SAFE(n, tn, he->clients.head)
+	{
+		(void) mowgli_node_delete(n, &he->clients);
+		(void) mowgli_node_free(n);
+	}
+
+	(void) cidr_tree_delete(clones_tree, he->leaf, &he->treenode);
+	(void) mowgli_node_delete(&he->node, &hostentries);
+	(void) clones_heap_remove(he);
+	(void) mowgli_heap_free(hostentry_heap, he);
+}
+
+// The most specific exemption covering all of a host entry's prefix
+static struct clones_exemption *
+clones_host_exempt(const struct clones_hostentry *const restrict he)
+{
+	struct clones_lookup lk = { .bitlen = UINT_MAX, .he = NULL, .c = NULL };
+
+	(void) cidr_tree_foreach_match(clones_tree, &he->prefix, &clones_lookup_cb, &lk);
+
+	return lk.c;
+}
+
+static void
+clones_frontier_push(unsigned int *const restrict frontier, unsigned int len, const unsigned int idx)
+{
+	const unsigned int count = clones_host_count(clones_heap[idx]);
+
+	while (len > 0)
+	{
+		const unsigned int parent = (len - 1) / 2;
+
+		if (clones_host_count(clones_heap[frontier[parent]]) >= count)
+			break;
+
+		frontier[len] = frontier[parent];
+		len = parent;
+	}
+
+	frontier[len] = idx;
+}
+
+static unsigned int
+clones_frontier_pop(unsigned int *const restrict frontier, const unsigned int len)
+{
+	const unsigned int top = frontier[0];
+	const unsigned int last = frontier[len - 1];
+	const unsigned int count = clones_host_count(clones_heap[last]);
+	unsigned int i = 0;
+
+	for (;;)
+	{
+		unsigned int child = (2 * i) + 1;
+
+		if (child >= len - 1)
+			break;
+
+		if (child + 1 < len - 1 &&
+		    clones_host_count(clones_heap[frontier[child + 1]]) > clones_host_count(clones_heap[frontier[child]]))
+			child++;
+
+		if (clones_host_count(clones_heap[frontier[child]]) <= count)
+			break;
+
+		frontier[i] = frontier[child];
+		i = child;
+	}
+
+	frontier[i] = last;
+
+	return top;
+}
+
+/* Calls cb for up to max of the hosts with at least min clients, most first.
+ * The candidates are kept in a second heap holding the children of every
+ * host already reported, so this is O(max log max) however many hosts there
+ * are. Exported for transport/jsonrpc (see <atheme/clones.h>).
+ */
+extern unsigned int clones_top_foreach(unsigned int max, unsigned int min, clones_top_fn cb, void *privdata);
+
+unsigned int
+clones_top_foreach(const unsigned int max, const unsigned int min, const clones_top_fn cb, void *const privdata)
+{
+	unsigned int *frontier;
+	unsigned int len = 0, size, found = 0;
+
+	return_val_if_fail(cb != NULL, 0);
+
+	if (! max || ! clones_heap_len)
+		return 0;
+
+	// Every host reported takes one candidate out and puts at most two back
+	size = ((max < clones_heap_len) ? max : clones_heap_len) + 1;
+	frontier = smalloc(size * sizeof *frontier);
+
+	(void) clones_frontier_push(frontier, len++, 0);
+
+	while (len && found < max)
+	{
+		const unsigned int idx = clones_frontier_pop(frontier, len--);
+		struct clones_hostentry *const he = clones_heap[idx];
+		const unsigned int count = clones_host_count(he);
+
+		if (count < min)
+			break;
+
+		const struct clones_exemption *const c = clones_host_exempt(he);
+		const struct clones_top_entry entry = {
+			.ip         = he->ip,
+			.clients    = count,
+			.exempt     = (c != NULL),
+			.allowed    = c ? c->allowed : clones_allowed,
+		};
+
+		(void) cb(&entry, privdata);
+		found++;
+
+		for (unsigned int child = (2 * idx) + 1; child <= (2 * idx) + 2; child++)
+			if (child < clones_heap_len && len < size)
+				(void) clones_frontier_push(frontier, len++, child);
+	}
+
+	(void) sfree(frontier);
+
+	return found;
+}
+
+static struct clones_hostentry *
+clones_host_attach(struct user *const restrict u, struct clones_exemption **const restrict exempt)
+{
+	struct clones_hostentry *const he = clones_host_find(u, exempt, true);
+
+	if (he)
+	{
+		(void) mowgli_node_add(u, mowgli_node_create(), &he->clients);
+		(void) clones_heap_up(he->heapidx);
+	}
+
+	return he;
+}
+
+// Everyone is counted again from scratch after the prefix lengths change
+static void
+clones_rebuild(void)
+{
+	mowgli_patricia_iteration_state_t state;
+	mowgli_node_t *n, *tn;
+	struct user *u;
+
+	MOWGLI_ITER_FOREACH_SAFE(n, tn, hostentries.head)
+		(void) clones_host_free(n->data);
+
+	clones_ipv4_prefix = config_options.clone_ipv4_prefix;
+	clones_ipv6_prefix = config_options.clone_ipv6_prefix;
+
+	MOWGLI_PATRICIA_FOREACH(u, &state, userlist)
+		if (! is_internal_client(u) && u->ip != NULL && ! (u->flags & UF_NETSPLIT))
+			(void) clones_host_attach(u, NULL);
+}
+
 static void
 clones_configready(void *unused)
 {
 	clones_allowed = config_options.default_clone_allowed;
 	clones_warn = config_options.default_clone_warn;
+
+	if (clones_ipv4_prefix != config_options.clone_ipv4_prefix ||
+	    clones_ipv6_prefix != config_options.clone_ipv6_prefix)
+		(void) clones_rebuild();
 }
 
 static void
@@ -80,13 +498,7 @@ write_exemptdb(struct database_handle *db)
 	{
 		struct clones_exemption *c = n->data;
 		if (cexempt_expired(c))
-		{
-			sfree(c->ip);
-			sfree(c->reason);
-			sfree(c);
-			mowgli_node_delete(n, &clone_exempts);
-			mowgli_node_free(n);
-		}
+			(void) cexempt_free(c, n);
 		else
 		{
 			db_start_row(db, "CLONES-EX");
@@ -155,35 +567,10 @@ db_h_ex(struct database_handle *db, const char *type)
 	c->warn = warn;
 	c->expires = expires;
 	c->reason = sstrdup(reason);
+	(void) cexempt_attach(c);
 	mowgli_node_add(c, mowgli_node_create(), &clone_exempts);
 }
 
-static struct clones_exemption *
-find_exempt(const char *ip)
-{
-	mowgli_node_t *n;
-
-	// first check for an exact match
-	MOWGLI_ITER_FOREACH(n, clone_exempts.head)
-	{
-		struct clones_exemption *c = n->data;
-
-		if (!strcmp(ip, c->ip))
-			return c;
-	}
-
-	// then look for cidr
-	MOWGLI_ITER_FOREACH(n, clone_exempts.head)
-	{
-		struct clones_exemption *c = n->data;
-
-		if (!match_ips(c->ip, ip))
-			return c;
-	}
-
-	return 0;
-}
-
 static void
 os_cmd_clones(struct sourceinfo *const restrict si, const int parc, char **const restrict parv)
 {
@@ -217,6 +604,7 @@ os_cmd_clones_kline(struct sourceinfo *si, int parc, char *parv[])
 		command_success_nodata(si, _("Enabled CLONES klines."));
 		wallops("\2%s\2 enabled CLONES klines", get_oper_name(si));
 		logcommand(si, CMDLOG_ADMIN, "CLONES:KLINE:ON");
+		db_shard_dirty(clones_shard);
 	}
 	else if (!strcasecmp(arg, "OFF"))
 	{
@@ -229,6 +617,7 @@ os_cmd_clones_kline(struct sourceinfo *si, int parc, char *parv[])
 		command_success_nodata(si, _("Disabled CLONES klines."));
 		wallops("\2%s\2 disabled CLONES klines", get_oper_name(si));
 		logcommand(si, CMDLOG_ADMIN, "CLONES:KLINE:OFF");
+		db_shard_dirty(clones_shard);
 	}
 	else if (isdigit((unsigned char)arg[0]))
 	{
@@ -244,6 +633,7 @@ os_cmd_clones_kline(struct sourceinfo *si, int parc, char *parv[])
 		                                    grace_count), grace_count);
 		wallops("\2%s\2 enabled CLONES klines with a grace of %u kills", get_oper_name(si), grace_count);
 		logcommand(si, CMDLOG_ADMIN, "CLONES:KLINE:ON grace %u", grace_count);
+		db_shard_dirty(clones_shard);
 	}
 	else
 	{
@@ -261,26 +651,33 @@ os_cmd_clones_kline(struct sourceinfo *si, int parc, char *parv[])
 	}
 }
 
+static void
+os_clones_list_cb(const struct clones_top_entry *const restrict entry, void *const restrict privdata)
+{
+	struct sourceinfo *const si = privdata;
+
+	if (entry->exempt)
+		command_success_nodata(si, _("%u from %s (\2EXEMPT\2; allowed %u)"), entry->clients, entry->ip,
+		                       entry->allowed);
+	else
+		command_success_nodata(si, _("%u from %s"), entry->clients, entry->ip);
+}
+
 static void
 os_cmd_clones_list(struct sourceinfo *si, int parc, char *parv[])
 {
-	struct clones_hostentry *he;
-	unsigned int k = 0;
-	mowgli_patricia_iteration_state_t state;
+	unsigned int max = UINT_MAX;
 
-	MOWGLI_PATRICIA_FOREACH(he, &state, hostlist)
+	if (parc > 0 && (! string_to_uint(parv[0], &max) || ! max))
 	{
-		k = MOWGLI_LIST_LENGTH(&he->clients);
-
-		if (k > 3)
-		{
-			struct clones_exemption *c = find_exempt(he->ip);
-			if (c)
-				command_success_nodata(si, _("%u from %s (\2EXEMPT\2; allowed %u)"), k, he->ip, c->allowed);
-			else
-				command_success_nodata(si, _("%u from %s"), k, he->ip);
-		}
+		command_fail(si, fault_badparams, STR_INVALID_PARAMS, "CLONES LIST");
+		command_fail(si, fault_badparams, _("Syntax: CLONES LIST [count]"));
+		return;
 	}
+
+	// Busiest first, and only as many hosts are looked at as are shown
+	(void) clones_top_foreach(max, 4, &os_clones_list_cb, si);
+
 	command_success_nodata(si, _("End of CLONES LIST"));
 	logcommand(si, CMDLOG_ADMIN, "CLONES:LIST");
 }
@@ -305,7 +702,9 @@ os_cmd_clones_addexempt(struct sourceinfo *si, int parc, char *parv[])
 		return;
 	}
 
-	if (!valid_ip_or_mask(ip))
+	struct cidr_addr ca;
+
+	if (!valid_ip_or_mask(ip) || !cexempt_parse(ip, &ca))
 	{
 		command_fail(si, fault_badparams, _("Invalid IP/mask given."));
 		command_fail(si, fault_badparams, _("Syntax: CLONES ADDEXEMPT <ip> <clones> [!P|!T <minutes>] <reason>"));
@@ -406,6 +805,7 @@ os_cmd_clones_addexempt(struct sourceinfo *si, int parc, char *parv[])
 		c = smalloc(sizeof *c);
 		c->ip = sstrdup(ip);
 		c->reason = sstrdup(rreason);
+		(void) cexempt_attach(c);
 		mowgli_node_add(c, mowgli_node_create(), &clone_exempts);
 		command_success_nodata(si, _("Added \2%s\2 to clone exempt list."), ip);
 	}
@@ -425,6 +825,7 @@ os_cmd_clones_addexempt(struct sourceinfo *si, int parc, char *parv[])
 	c->expires = duration ? (CURRTIME + duration) : 0;
 
 	logcommand(si, CMDLOG_ADMIN, "CLONES:ADDEXEMPT: \2%s\2 \2%u\2 (reason: \2%s\2) (duration: \2%s\2)", ip, clones, c->reason, timediff(duration));
+	db_shard_dirty(clones_shard);
 }
 
 static void
@@ -445,22 +846,13 @@ os_cmd_clones_delexempt(struct sourceinfo *si, int parc, char *parv[])
 		struct clones_exemption *c = n->data;
 
 		if (cexempt_expired(c))
-		{
-			sfree(c->ip);
-			sfree(c->reason);
-			sfree(c);
-			mowgli_node_delete(n, &clone_exempts);
-			mowgli_node_free(n);
-		}
+			(void) cexempt_free(c, n);
 		else if (!strcmp(c->ip, arg))
 		{
-			sfree(c->ip);
-			sfree(c->reason);
-			sfree(c);
-			mowgli_node_delete(n, &clone_exempts);
-			mowgli_node_free(n);
+			(void) cexempt_free(c, n);
 			command_success_nodata(si, _("Removed \2%s\2 from clone exempt list."), arg);
 			logcommand(si, CMDLOG_ADMIN, "CLONES:DELEXEMPT: \2%s\2", arg);
+			db_shard_dirty(clones_shard);
 			return;
 		}
 	}
@@ -526,13 +918,7 @@ os_cmd_clones_setexempt(struct sourceinfo *si, int parc, char *parv[])
 			struct clones_exemption *c = n->data;
 
 			if (cexempt_expired(c))
-			{
-				sfree(c->ip);
-				sfree(c->reason);
-				sfree(c);
-				mowgli_node_delete(n, &clone_exempts);
-				mowgli_node_free(n);
-			}
+				(void) cexempt_free(c, n);
 			else if (!strcmp(c->ip, ip))
 			{
 				if (!strcasecmp(subcmd, "ALLOWED"))
@@ -552,6 +938,7 @@ os_cmd_clones_setexempt(struct sourceinfo *si, int parc, char *parv[])
 					{
 						command_success_nodata(si, _("Clone warning messages will be disabled for host \2%s\2"), ip);
 						c->warn = 0;
+						db_shard_dirty(clones_shard);
 						return;
 					}
 					else if (clones > c->allowed)
@@ -620,6 +1007,7 @@ os_cmd_clones_setexempt(struct sourceinfo *si, int parc, char *parv[])
 				}
 
 				logcommand(si, CMDLOG_ADMIN, "CLONES:SETEXEMPT: \2%s\2 \2%d\2 (reason: \2%s\2) (duration: \2%s\2)", ip, clones, c->reason, timediff((c->expires - CURRTIME)));
+				db_shard_dirty(clones_shard);
 
 				return;
 			}
@@ -662,6 +1050,7 @@ os_cmd_clones_duration(struct sourceinfo *si, int parc, char *parv[])
 	}
 
 	kline_duration = duration;
+	db_shard_dirty(clones_shard);
 	command_success_nodata(si, _("Clone ban duration set to \2%s\2 (%ld seconds)"), parv[0], kline_duration);
 }
 
@@ -677,13 +1066,7 @@ os_cmd_clones_listexempt(struct sourceinfo *si, int parc, char *parv[])
 		struct clones_exemption *c = n->data;
 
 		if (cexempt_expired(c))
-		{
-			sfree(c->ip);
-			sfree(c->reason);
-			sfree(c);
-			mowgli_node_delete(n, &clone_exempts);
-			mowgli_node_free(n);
-		}
+			(void) cexempt_free(c, n);
 		else if (c->expires)
 			command_success_nodata(si, _("%s - allowed limit %u, warn on %u - expires in %s - \2%s\2"), c->ip, c->allowed, c->warn, timediff(c->expires > CURRTIME ? c->expires - CURRTIME : 0), c->reason);
 		else
@@ -699,6 +1082,7 @@ clones_newuser(struct hook_user_nick *data)
 	struct user *u = data->u;
 	unsigned int i;
 	struct clones_hostentry *he;
+	struct clones_exemption *c;
 	unsigned int allowed, warn;
 	mowgli_node_t *n;
 
@@ -710,18 +1094,12 @@ clones_newuser(struct hook_user_nick *data)
 	if (is_internal_client(u) || u->ip == NULL)
 		return;
 
-	he = mowgli_patricia_retrieve(hostlist, u->ip);
-	if (he == NULL)
-	{
-		he = mowgli_heap_alloc(hostentry_heap);
-		mowgli_strlcpy(he->ip, u->ip, sizeof he->ip);
-		mowgli_patricia_add(hostlist, he->ip, he);
-	}
-	mowgli_node_add(u, mowgli_node_create(), &he->clients);
+	if ((he = clones_host_attach(u, &c)) == NULL)
+		return;
+
 	i = MOWGLI_LIST_LENGTH(&he->clients);
 
-	struct clones_exemption *c = find_exempt(u->ip);
-	if (c == 0)
+	if (c == NULL)
 	{
 		allowed = clones_allowed;
 		warn = clones_warn;
@@ -760,7 +1138,7 @@ clones_newuser(struct hook_user_nick *data)
 	{
 		// User has exceeded the maximum number of allowed clones.
 		if (is_autokline_exempt(u))
-			slog(LG_INFO, "CLONES: \2%u\2 clones on \2%s\2 (%s!%s@%s) (user is autokline exempt)", i, u->ip, u->nick, u->user, u->host);
+			slog(LG_INFO, "CLONES: \2%u\2 clones on \2%s\2 (%s!%s@%s) (user is autokline exempt)", i, he->ip, u->nick, u->user, u->host);
 		else if (!kline_enabled || he->gracekills < grace_count || (grace_count > 0 && he->firstkill < time(NULL) - CLONES_GRACE_TIMEPERIOD))
 		{
 			if (he->firstkill < time(NULL) - CLONES_GRACE_TIMEPERIOD)
@@ -774,9 +1152,9 @@ clones_newuser(struct hook_user_nick *data)
 			}
 
 			if (!kline_enabled)
-				slog(LG_INFO, "CLONES: \2%u\2 clones on \2%s\2 (%s!%s@%s) (TKLINE disabled, killing user)", i, u->ip, u->nick, u->user, u->host);
+				slog(LG_INFO, "CLONES: \2%u\2 clones on \2%s\2 (%s!%s@%s) (TKLINE disabled, killing user)", i, he->ip, u->nick, u->user, u->host);
 			else
-				slog(LG_INFO, "CLONES: \2%u\2 clones on \2%s\2 (%s!%s@%s) (grace period, killing user, %u grace kills remaining)", i, u->ip, u->nick,
+				slog(LG_INFO, "CLONES: \2%u\2 clones on \2%s\2 (%s!%s@%s) (grace period, killing user, %u grace kills remaining)", i, he->ip, u->nick,
 					u->user, u->host, grace_count - he->gracekills);
 
 			kill_user(serviceinfo->me, u, "Too many connections from this host.");
@@ -785,8 +1163,8 @@ clones_newuser(struct hook_user_nick *data)
 		else
 		{
 			if (! (u->flags & UF_KLINESENT)) {
-				slog(LG_INFO, "CLONES: \2%u\2 clones on \2%s\2 (%s!%s@%s) (TKLINE due to excess clones)", i, u->ip, u->nick, u->user, u->host);
-				kline_sts("*", "*", u->ip, kline_duration, "Excessive clones");
+				slog(LG_INFO, "CLONES: \2%u\2 clones on \2%s\2 (%s!%s@%s) (TKLINE due to excess clones)", i, he->ip, u->nick, u->user, u->host);
+				kline_sts("*", "*", he->ip, kline_duration, "Excessive clones");
 				u->flags |= UF_KLINESENT;
 			}
 		}
@@ -794,7 +1172,7 @@ clones_newuser(struct hook_user_nick *data)
 	}
 	else if (i >= warn && warn != 0)
 	{
-		slog(LG_INFO, "CLONES: \2%u\2 clones on \2%s\2 (%s!%s@%s) (\2%u\2 allowed)", i, u->ip, u->nick, u->user, u->host, allowed);
+		slog(LG_INFO, "CLONES: \2%u\2 clones on \2%s\2 (%s!%s@%s) (\2%u\2 allowed)", i, he->ip, u->nick, u->user, u->host, allowed);
 		msg(serviceinfo->nick, u->nick, _("\2WARNING\2: You may not have more than \2%u\2 clients connected to the network at once. Any further connections risks being removed."), allowed);
 	}
 }
@@ -809,7 +1187,11 @@ clones_userquit(struct user *u)
 	if (is_internal_client(u) || u->ip == NULL)
 		return;
 
-	he = mowgli_patricia_retrieve(hostlist, u->ip);
+	// Already dropped by clones_netsplit()
+	if (u->flags & UF_NETSPLIT)
+		return;
+
+	he = clones_host_find(u, NULL, false);
 	if (he == NULL)
 	{
 		slog(LG_DEBUG, "clones_userquit(): hostentry for %s not found??", u->ip);
@@ -820,12 +1202,62 @@ clones_userquit(struct user *u)
 	{
 		mowgli_node_delete(n, &he->clients);
 		mowgli_node_free(n);
+		// TODO: free later if he->firstkill > time(NULL) - CLONES_GRACE_TIMEPERIOD.
 		if (MOWGLI_LIST_LENGTH(&he->clients) == 0)
+			(void) clones_host_free(he);
+		else
+			(void) clones_heap_down(he->heapidx);
+	}
+}
+
+static void
+clones_netsplit(struct hook_user_netsplit *data)
+{
+	mowgli_list_t hosts = { NULL, NULL, 0 };
+	mowgli_node_t *n, *tn, *hn, *htn;
+
+	// Find each host with split clients once ...
+	MOWGLI_ITER_FOREACH(n, data->users->head)
+	{
+		struct user *u = n->data;
+		struct clones_hostentry *he;
+
+		if (u->ip == NULL)
+			continue;
+
+		he = clones_host_find(u, NULL, false);
+		if (he == NULL || he->splitting)
+			continue;
+
+		he->splitting = true;
+		mowgli_node_add(he, mowgli_node_create(), &hosts);
+	}
+
+	// ... and drop all of them from it in a single pass
+	MOWGLI_ITER_FOREACH_SAFE(hn, htn, hosts.head)
+	{
+		struct clones_hostentry *he = hn->data;
+
+		MOWGLI_ITER_FOREACH_SAFE(n, tn, he->clients.head)
 		{
-			// TODO: free later if he->firstkill > time(NULL) - CLONES_GRACE_TIMEPERIOD.
-			mowgli_patricia_delete(hostlist, he->ip);
-			mowgli_heap_free(hostentry_heap, he);
+			struct user *u = n->data;
+
+			if (u->flags & UF_NETSPLIT)
+			{
+				mowgli_node_delete(n, &he->clients);
+				mowgli_node_free(n);
+			}
 		}
+
+		he->splitting = false;
+
+		if (MOWGLI_LIST_LENGTH(&he->clients) == 0)
+			(void) clones_host_free(he);
+		else
+			(void) clones_heap_down(he->heapidx);
+
+		mowgli_node_delete(hn, &hosts);
+		mowgli_node_free(hn);
 	}
 }
 
@@ -851,7 +1283,7 @@ static struct command os_clones_list = {
 	.name           = "LIST",
 	.desc           = N_("Lists clones on the network."),
 	.access         = AC_NONE,
-	.maxparc        = 0,
+	.maxparc        = 1,
 	.cmd            = &os_cmd_clones_list,
 	.help           = { .path = "" },
 };
@@ -930,22 +1362,16 @@ mod_init(struct module *const restrict m)
 		return;
 	}
 
-	if (! (hostlist = mowgli_patricia_create(&noopcanon)))
-	{
-		(void) slog(LG_ERROR, "%s: mowgli_patricia_create() failed", m->name);
-
-		(void) mowgli_patricia_destroy(os_clones_cmds, NULL, NULL);
-
-		m->mflags |= MODFLAG_FAIL;
-		return;
-	}
+	clones_tree = cidr_tree_create();
+	clones_ipv4_prefix = config_options.clone_ipv4_prefix;
+	clones_ipv6_prefix = config_options.clone_ipv6_prefix;
 
 	if (! (hostentry_heap = mowgli_heap_create(sizeof(struct clones_hostentry), HEAP_USER, BH_NOW)))
 	{
 		(void) slog(LG_ERROR, "%s: mowgli_heap_create() failed", m->name);
 
 		(void) mowgli_patricia_destroy(os_clones_cmds, NULL, NULL);
-		(void) mowgli_patricia_destroy(hostlist, NULL, NULL);
+		(void) cidr_tree_destroy(clones_tree);
 
 		m->mflags |= MODFLAG_FAIL;
 		return;
@@ -964,7 +1390,7 @@ mod_init(struct module *const restrict m)
 	(void) hook_add_config_ready(&clones_configready);
 	(void) hook_add_user_add(&clones_newuser);
 	(void) hook_add_user_delete(&clones_userquit);
-	(void) hook_add_db_write(&write_exemptdb);
+	(void) hook_add_user_netsplit(&clones_netsplit);
 
 	(void) db_register_type_handler("CLONES-DBV", &db_h_clonesdbv);
 	(void) db_register_type_handler("CLONES-CK", &db_h_ck);
@@ -972,6 +1398,9 @@ mod_init(struct module *const restrict m)
 	(void) db_register_type_handler("CLONES-GR", &db_h_gr);
 	(void) db_register_type_handler("CLONES-EX", &db_h_ex);
 
+	clones_shard = db_shard_register("clones", &write_exemptdb);
+	db_shard_load(clones_shard);
+
 	// add everyone to host hash
 	struct user *u;
 	mowgli_patricia_iteration_state_t state;
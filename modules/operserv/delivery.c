@@ -0,0 +1,119 @@
+/*
+ * SPDX-License-Identifier: ISC
+ * SPDX-URL: https://spdx.org/licenses/ISC.html
+ *
+ * Copyright (C) 2026 Atheme Development Group (https://atheme.github.io/)
+ *
+ * This file contains functionality implementing OperServ DELIVERY.
+ */
+
+#include <atheme.h>
+
+static void
+os_cmd_delivery_list(struct sourceinfo *const restrict si)
+{
+	mowgli_node_t *n;
+	unsigned int shown = 0;
+
+	MOWGLI_ITER_FOREACH(n, delivery_jobs.head)
+	{
+		const struct delivery_job *const job = n->data;
+
+		if (! has_priv(si, job->privilege))
+			continue;
+
+		if (job->total)
+			(void) command_success_nodata(si, _("%u: \2%s\2 by %s, %u of %u done, started %s ago"),
+			                              job->id, job->desc, job->owner, job->done, job->total,
+			                              time_ago(job->started));
+		else
+			(void) command_success_nodata(si, _("%u: \2%s\2 by %s, %u done, started %s ago"),
+			                              job->id, job->desc, job->owner, job->done,
+			                              time_ago(job->started));
+		shown++;
+	}
+
+	(void) command_success_nodata(si, ngettext(N_("\2%u\2 delivery in progress."),
+	                                           N_("\2%u\2 deliveries in progress."), shown), shown);
+
+	(void) logcommand(si, CMDLOG_GET, "DELIVERY:LIST");
+}
+
+static void
+os_cmd_delivery_cancel(struct sourceinfo *const restrict si, const char *const restrict arg)
+{
+	struct delivery_job *job;
+	unsigned int id;
+
+	if (! arg)
+	{
+		(void) command_fail(si, fault_needmoreparams, STR_INSUFFICIENT_PARAMS, "DELIVERY CANCEL");
+		(void) command_fail(si, fault_needmoreparams, _("Syntax: DELIVERY CANCEL <id>"));
+		return;
+	}
+
+	if (! string_to_uint(arg, &id))
+	{
+		(void) command_fail(si, fault_badparams, STR_INVALID_PARAMS, "DELIVERY CANCEL");
+		(void) command_fail(si, fault_badparams, _("Syntax: DELIVERY CANCEL <id>"));
+		return;
+	}
+
+	if (! (job = delivery_job_find(id)) || ! has_priv(si, job->privilege))
+	{
+		(void) command_fail(si, fault_nosuch_target, _("There is no delivery with ID \2%u\2."), id);
+		return;
+	}
+
+	(void) logcommand(si, CMDLOG_ADMIN, "DELIVERY:CANCEL: \2%u\2 (\2%s\2 by \2%s\2, %u done)",
+	                  job->id, job->desc, job->owner, job->done);
+
+	(void) command_success_nodata(si, _("Delivery \2%u\2 (\2%s\2) has been cancelled after %u recipients."),
+	                              job->id, job->desc, job->done);
+
+	delivery_job_cancel(job);
+}
+
+static void
+os_cmd_delivery_func(struct sourceinfo *const restrict si, const int parc, char **const restrict parv)
+{
+	if (parc < 1 || ! strcasecmp(parv[0], "LIST"))
+	{
+		(void) os_cmd_delivery_list(si);
+		return;
+	}
+
+	if (! strcasecmp(parv[0], "CANCEL"))
+	{
+		(void) os_cmd_delivery_cancel(si, (parc > 1) ? parv[1] : NULL);
+		return;
+	}
+
+	(void) command_fail(si, fault_badparams, STR_INVALID_PARAMS, "DELIVERY");
+	(void) command_fail(si, fault_badparams, _("Syntax: DELIVERY [LIST|CANCEL <id>]"));
+}
+
+static struct command os_cmd_delivery = {
+	.name           = "DELIVERY",
+	.desc           = N_("Shows or cancels global notices and memos still being sent."),
+	.access         = AC_NONE,
+	.maxparc        = 2,
+	.cmd            = &os_cmd_delivery_func,
+	.help           = { .path = "oservice/delivery" },
+};
+
+static void
+mod_init(struct module *const restrict m)
+{
+	MODULE_TRY_REQUEST_DEPENDENCY(m, "operserv/main")
+
+	(void) service_named_bind_command("operserv", &os_cmd_delivery);
+}
+
+static void
+mod_deinit(const enum module_unload_intent ATHEME_VATTR_UNUSED intent)
+{
+	(void) service_named_unbind_command("operserv", &os_cmd_delivery);
+}
+
+SIMPLE_DECLARE_MODULE_V1("operserv/delivery", MODULE_UNLOAD_CAPABILITY_OK)
@@ -52,9 +52,9 @@ cmd_os_genhash_func(struct sourceinfo *const restrict si, const int parc, char *
 		return;
 	}
 
-	const char *const result = ci->crypt(password, NULL);
+	char result[PASSLEN + 1];
 
-	if (! result)
+	if (! crypt_password_using(ci, password, result, sizeof result))
 	{
 		(void) command_fail(si, fault_internalerror, _("Failed to encrypt password with crypto provider "
 		                                               "\2%s\2"), ci->id);
@@ -9,9 +9,57 @@
 
 #include <atheme.h>
 
+#ifdef HAVE_USABLE_PTHREAD
+#  include <pthread.h>
+#endif
+
 #define MAXMATCHES 100
 
-static const char *
+// What was found in one day's log file, newest match first
+struct greplog_day
+{
+	struct greplog_day *        next;
+	char                        path[256];
+	bool                        opened;
+	mowgli_list_t               lines;
+	unsigned int                lines_read;
+	unsigned int                lines_valid;
+};
+
+struct greplog_request
+{
+	mowgli_node_t               node;
+	struct sourceinfo *         si;
+	char                        client[NICKLEN + UIDLEN + 1];  // CLIENT_NAME() of the user, if any
+	char *                      service;
+	char *                      pattern;
+	char *                      baselog;
+	char                        key[BUFSIZE];   // See log_index_key()
+	bool                        keyed;
+	unsigned int                days;
+	char **                     paths;          // Of every day's log file, today's first
+	struct log_index_plan       live;           // For today's, worked out on the main thread
+	unsigned int                found;          // Matches the search has kept so far
+	unsigned int                matches;        // ... and those shown
+	struct greplog_day *        done;           // Days searched but not shown yet, in order
+	struct greplog_day **       done_tail;
+	bool                        finished;       // No more days are coming
+	bool                        cancelled;
+#ifdef HAVE_USABLE_PTHREAD
+	pthread_t                   thread;
+	bool                        threaded;
+#endif
+};
+
+static mowgli_list_t greplog_requests;
+static mowgli_eventloop_timer_t *greplog_timer = NULL;
+
+#ifdef HAVE_USABLE_PTHREAD
+// Protects done, done_tail, finished and cancelled of every request
+static pthread_mutex_t greplog_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+static struct logfile *
 get_logfile(const unsigned int *masks)
 {
 	struct logfile *lf;
@@ -21,12 +69,12 @@ get_logfile(const unsigned int *masks)
 	{
 		lf = logfile_find_mask(masks[i]);
 		if (lf != NULL)
-			return lf->log_path;
+			return lf;
 	}
 	return NULL;
 }
 
-static const char *
+static struct logfile *
 get_commands_log(void)
 {
 	const unsigned int masks[] = {
@@ -41,7 +89,7 @@ get_commands_log(void)
 	return get_logfile(masks);
 }
 
-static const char *
+static struct logfile *
 get_account_log(void)
 {
 	const unsigned int masks[] = {
@@ -52,21 +100,352 @@ get_account_log(void)
 	return get_logfile(masks);
 }
 
+static void
+greplog_day_free(struct greplog_day *const restrict gd)
+{
+	mowgli_node_t *n, *tn;
+
+	MOWGLI_ITER_FOREACH_SAFE(n, tn, gd->lines.head)
+	{
+		mowgli_node_delete(n, &gd->lines);
+		sfree(n->data);
+		mowgli_node_free(n);
+	}
+
+	sfree(gd);
+}
+
+static void
+greplog_request_free(struct greplog_request *const restrict gr)
+{
+	struct greplog_day *gd, *next;
+
+#ifdef HAVE_USABLE_PTHREAD
+	if (gr->threaded)
+		(void) pthread_join(gr->thread, NULL);
+#endif
+
+	for (gd = gr->done; gd != NULL; gd = next)
+	{
+		next = gd->next;
+		greplog_day_free(gd);
+	}
+
+	for (unsigned int day = 0; day <= gr->days; day++)
+		sfree(gr->paths[day]);
+
+	mowgli_node_delete(&gr->node, &greplog_requests);
+	atheme_object_unref(gr->si);
+	log_index_plan_free(&gr->live);
+	sfree(gr->paths);
+	sfree(gr->service);
+	sfree(gr->pattern);
+	sfree(gr->baselog);
+	sfree(gr);
+}
+
+// Whether whoever asked is still there to see the output; see operserv/rmatch
+static bool
+greplog_request_present(const struct greplog_request *const restrict gr)
+{
+	if (! gr->si->su)
+		return true;
+
+	const struct user *const u = user_find(gr->client);
+
+	return (u && u == gr->si->su);
+}
+
+static bool
+greplog_cancelled(struct greplog_request *const restrict gr)
+{
+#ifdef HAVE_USABLE_PTHREAD
+	(void) pthread_mutex_lock(&greplog_lock);
+
+	const bool cancelled = gr->cancelled;
+
+	(void) pthread_mutex_unlock(&greplog_lock);
+
+	return cancelled;
+#else
+	return gr->cancelled;
+#endif
+}
+
+/* Checks one line read from a log file against the request, keeping only the
+ * last (MAXMATCHES - matches on later days) matching lines of the day.
+ */
+static void
+greplog_check_line(const struct greplog_request *const restrict gr, struct greplog_day *const restrict gd,
+                   char *const restrict str)
+{
+	char *p, *q;
+
+	p = strchr(str, '\n');
+	if (p != NULL)
+		*p = '\0';
+	gd->lines_read++;
+	p = *str == '[' ? strchr(str, ']') : NULL;
+	if (p == NULL)
+		return;
+	p++;
+	if (*p++ != ' ')
+		return;
+	q = strchr(p, ' ');
+	if (q == NULL)
+		return;
+	gd->lines_valid++;
+	*q = '\0';
+	if (strcmp(gr->service, "*") && strcasecmp(gr->service, p))
+		return;
+	*q++ = ' ';
+	if (match(gr->pattern, q))
+		return;
+	mowgli_node_add_head(sstrdup(str), mowgli_node_create(), &gd->lines);
+	if (MOWGLI_LIST_LENGTH(&gd->lines) > MAXMATCHES - gr->found)
+	{
+		mowgli_node_t *const n = gd->lines.tail;
+
+		mowgli_node_delete(n, &gd->lines);
+		sfree(n->data);
+		mowgli_node_free(n);
+	}
+}
+
+/* Reads one day's log file. With an index, only the lines it points at are
+ * read of the part it covers; everything else still has to be gone through.
+ */
+static void
+greplog_search_day(struct greplog_request *const restrict gr, struct greplog_day *const restrict gd,
+                   const struct log_index_plan *const restrict plan)
+{
+	FILE *const in = fopen(gd->path, "r");
+	unsigned int lines = 0;
+	char str[1024];
+
+	if (in == NULL)
+		return;
+
+	gd->opened = true;
+
+	if (plan->indexed)
+	{
+		uint64_t pos = 0;
+
+		while (pos < plan->start && fgets(str, sizeof str, in) != NULL)
+		{
+			pos += strlen(str);
+			greplog_check_line(gr, gd, str);
+		}
+
+		for (size_t i = 0; i < plan->count; i++)
+		{
+			if (! (++lines % 1024U) && greplog_cancelled(gr))
+				goto out;
+
+			if (fseeko(in, (off_t) plan->offsets[i], SEEK_SET) != 0 || fgets(str, sizeof str, in) == NULL)
+				continue;
+
+			greplog_check_line(gr, gd, str);
+		}
+
+		if (fseeko(in, (off_t) plan->end, SEEK_SET) != 0)
+			goto out;
+	}
+
+	while (fgets(str, sizeof str, in) != NULL)
+	{
+		if (! (++lines % 65536U) && greplog_cancelled(gr))
+			break;
+
+		greplog_check_line(gr, gd, str);
+	}
+
+out:
+	fclose(in);
+}
+
+// Searches one day after the other, until there are enough matches
+static void
+greplog_search(struct greplog_request *const restrict gr)
+{
+	for (unsigned int day = 0; day <= gr->days; day++)
+	{
+		if (greplog_cancelled(gr))
+			break;
+
+		struct greplog_day *const gd = smalloc(sizeof *gd);
+		struct log_index_plan plan = { .indexed = false };
+
+		mowgli_strlcpy(gd->path, gr->paths[day], sizeof gd->path);
+
+		if (day == 0)
+			greplog_search_day(gr, gd, &gr->live);
+		else
+		{
+			if (gr->keyed)
+				log_index_plan_file(gr->baselog, gd->path, gr->key, &plan);
+
+			greplog_search_day(gr, gd, &plan);
+			log_index_plan_free(&plan);
+		}
+
+		gr->found += MOWGLI_LIST_LENGTH(&gd->lines);
+
+#ifdef HAVE_USABLE_PTHREAD
+		(void) pthread_mutex_lock(&greplog_lock);
+#endif
+
+		*gr->done_tail = gd;
+		gr->done_tail = &gd->next;
+
+#ifdef HAVE_USABLE_PTHREAD
+		(void) pthread_mutex_unlock(&greplog_lock);
+#endif
+
+		if (gr->found >= MAXMATCHES)
+			break;
+	}
+
+#ifdef HAVE_USABLE_PTHREAD
+	(void) pthread_mutex_lock(&greplog_lock);
+#endif
+
+	gr->finished = true;
+
+#ifdef HAVE_USABLE_PTHREAD
+	(void) pthread_mutex_unlock(&greplog_lock);
+#endif
+}
+
+#ifdef HAVE_USABLE_PTHREAD
+
+static void *
+greplog_thread(void *const restrict vgr)
+{
+	(void) greplog_search(vgr);
+	return NULL;
+}
+
+static bool
+greplog_thread_start(struct greplog_request *const restrict gr)
+{
+	// Signals must only ever be delivered to the main thread
+	sigset_t newset;
+	sigset_t oldset;
+
+	(void) sigfillset(&newset);
+	(void) pthread_sigmask(SIG_BLOCK, &newset, &oldset);
+
+	const int ret = pthread_create(&gr->thread, NULL, &greplog_thread, gr);
+
+	(void) pthread_sigmask(SIG_SETMASK, &oldset, NULL);
+
+	if (ret != 0)
+	{
+		(void) slog(LG_ERROR, "%s: pthread_create(3): %s", MOWGLI_FUNC_NAME, strerror(ret));
+		return false;
+	}
+
+	gr->threaded = true;
+	return true;
+}
+
+#endif /* HAVE_USABLE_PTHREAD */
+
+/* Shows whatever days have been searched since the last time; returns true
+ * once there is nothing more to come and the request is done with.
+ */
+static bool
+greplog_deliver(struct greplog_request *const restrict gr)
+{
+	struct greplog_day *gd, *next;
+	mowgli_node_t *n;
+
+#ifdef HAVE_USABLE_PTHREAD
+	(void) pthread_mutex_lock(&greplog_lock);
+#endif
+
+	struct greplog_day *const done = gr->done;
+	const bool finished = gr->finished;
+
+	gr->done = NULL;
+	gr->done_tail = &gr->done;
+
+#ifdef HAVE_USABLE_PTHREAD
+	(void) pthread_mutex_unlock(&greplog_lock);
+#endif
+
+	const bool present = greplog_request_present(gr);
+
+	for (gd = done; gd != NULL; gd = next)
+	{
+		next = gd->next;
+
+		if (present && ! gd->opened)
+			command_success_nodata(gr->si, _("Failed to open log file %s"), gd->path);
+		else if (present)
+		{
+			MOWGLI_ITER_FOREACH(n, gd->lines.head)
+			{
+				gr->matches++;
+				command_success_nodata(gr->si, "[%u] %s", gr->matches, (const char *) n->data);
+			}
+			if (gr->matches == 0 && gd->lines_read > gd->lines_valid && gd->lines_read > 0)
+				command_success_nodata(gr->si, _("Log file may be corrupted, %u/%u unexpected lines"),
+				                       gd->lines_read - gd->lines_valid, gd->lines_read);
+			if (gr->matches >= MAXMATCHES)
+				command_success_nodata(gr->si, _("Too many matches, halting search"));
+		}
+
+		greplog_day_free(gd);
+	}
+
+	if (! finished)
+		return false;
+
+	if (! present)
+		return true;
+
+	if (gr->matches == 0)
+		command_success_nodata(gr->si, _("No lines matched pattern \2%s\2"), gr->pattern);
+	else
+		command_success_nodata(gr->si, ngettext(N_("\2%u\2 match for pattern \2%s\2"),
+		                                        N_("\2%u\2 matches for pattern \2%s\2"), gr->matches),
+		                       gr->matches, gr->pattern);
+
+	return true;
+}
+
+static void
+greplog_deliver_run(void ATHEME_VATTR_UNUSED *const restrict unused)
+{
+	mowgli_node_t *n, *tn;
+
+	greplog_timer = NULL;
+
+	MOWGLI_ITER_FOREACH_SAFE(n, tn, greplog_requests.head)
+	{
+		struct greplog_request *const gr = n->data;
+
+		if (greplog_deliver(gr))
+			greplog_request_free(gr);
+	}
+
+	if (greplog_requests.head != NULL)
+		greplog_timer = timer_add_once("greplog_deliver", &greplog_deliver_run, NULL, 1);
+}
+
 // GREPLOG <service> <mask>
 static void
 os_cmd_greplog(struct sourceinfo *si, int parc, char *parv[])
 {
-	const char *service, *pattern, *baselog;
-	unsigned int matches = 0, matches_sv = 0;
-	unsigned int day, days, maxdays, lines, linesv;
-	FILE *in;
-	char str[1024];
-	char *p, *q;
+	const char *service, *pattern;
+	struct logfile *lf;
+	unsigned int day, days, maxdays;
 	char logfile[256];
 	time_t t;
 	struct tm *tm;
-	mowgli_list_t loglines = { NULL, NULL, 0 };
-	mowgli_node_t *n, *tn;
 
 	// require user, channel and server auspex (channel auspex checked via in struct command)
 	if (!has_priv(si, PRIV_USER_AUSPEX))
@@ -102,91 +481,66 @@ os_cmd_greplog(struct sourceinfo *si, int parc, char *parv[])
 	else
 		days = 0;
 
-	baselog = !strcmp(service, "*") ? get_account_log() : get_commands_log();
-	if (baselog == NULL)
+	lf = !strcmp(service, "*") ? get_account_log() : get_commands_log();
+	if (lf == NULL)
 	{
 		command_fail(si, fault_badparams, _("There is no log file matching your request."));
 		return;
 	}
 
+	// Logged now, as whoever asked may not be around any more once the search is done
+	logcommand(si, CMDLOG_ADMIN, "GREPLOG: \2%s\2 \2%s\2 (\2%u\2 days)", service, pattern, days);
+
+	struct greplog_request *const gr = smalloc(sizeof *gr);
+
+	gr->si = atheme_object_ref(si);
+	gr->service = sstrdup(service);
+	gr->pattern = sstrdup(pattern);
+	gr->baselog = sstrdup(lf->log_path);
+	gr->days = days;
+	gr->paths = smalloc((days + 1) * sizeof *gr->paths);
+	gr->done_tail = &gr->done;
+
+	if (si->su)
+		mowgli_strlcpy(gr->client, CLIENT_NAME(si->su), sizeof gr->client);
+
 	for (day = 0; day <= days; day++)
 	{
 		if (day == 0)
-			mowgli_strlcpy(logfile, baselog, sizeof logfile);
+			mowgli_strlcpy(logfile, lf->log_path, sizeof logfile);
 		else
 		{
 			t = CURRTIME - (day * SECONDS_PER_DAY);
 			tm = localtime(&t);
 			snprintf(logfile, sizeof logfile, "%s.%04u%02u%02u",
-					baselog, (unsigned int) (tm->tm_year + 1900),
+					lf->log_path, (unsigned int) (tm->tm_year + 1900),
 					(unsigned int) (tm->tm_mon + 1), (unsigned int) tm->tm_mday);
 		}
-		in = fopen(logfile, "r");
-		if (in == NULL)
-		{
-			command_success_nodata(si, _("Failed to open log file %s"), logfile);
-			continue;
-		}
-		matches_sv = matches;
-		lines = linesv = 0;
-		while (fgets(str, sizeof str, in) != NULL)
-		{
-			p = strchr(str, '\n');
-			if (p != NULL)
-				*p = '\0';
-			lines++;
-			p = *str == '[' ? strchr(str, ']') : NULL;
-			if (p == NULL)
-				continue;
-			p++;
-			if (*p++ != ' ')
-				continue;
-			q = strchr(p, ' ');
-			if (q == NULL)
-				continue;
-			linesv++;
-			*q = '\0';
-			if (strcmp(service, "*") && strcasecmp(service, p))
-				continue;
-			*q++ = ' ';
-			if (match(pattern, q))
-				continue;
-			matches++;
-			mowgli_node_add_head(sstrdup(str), mowgli_node_create(), &loglines);
-			if (matches > MAXMATCHES)
-			{
-				n = loglines.tail;
-				mowgli_node_delete(n, &loglines);
-				sfree(n->data);
-				mowgli_node_free(n);
-			}
-		}
-		fclose(in);
-		matches = matches_sv;
-		MOWGLI_ITER_FOREACH_SAFE(n, tn, loglines.head)
-		{
-			p = n->data;
-			matches++;
-			command_success_nodata(si, "[%u] %s", matches, p);
-			mowgli_node_delete(n, &loglines);
-			sfree(n->data);
-			mowgli_node_free(n);
-		}
-		if (matches == 0 && lines > linesv && lines > 0)
-			command_success_nodata(si, _("Log file may be corrupted, %u/%u unexpected lines"), lines - linesv, lines);
-		if (matches >= MAXMATCHES)
-		{
-			command_success_nodata(si, _("Too many matches, halting search"));
-			break;
-		}
+		gr->paths[day] = sstrdup(logfile);
+	}
+
+	if ((gr->keyed = log_index_key(pattern, gr->key, sizeof gr->key)))
+		log_index_plan_live(lf, gr->key, &gr->live);
+
+	mowgli_node_add(gr, &gr->node, &greplog_requests);
+
+	/* The logs are searched on another thread, and the output for each day
+	 * is sent as soon as it is done with; without a user to send it to
+	 * later (e.g. over RPC), it all has to be in the reply.
+	 */
+#ifdef HAVE_USABLE_PTHREAD
+	if (si->su && greplog_thread_start(gr))
+	{
+		if (greplog_timer == NULL)
+			greplog_timer = timer_add_once("greplog_deliver", &greplog_deliver_run, NULL, 1);
+
+		return;
 	}
+#endif
 
-	logcommand(si, CMDLOG_ADMIN, "GREPLOG: \2%s\2 \2%s\2 (\2%u\2 matches)", service, pattern, matches);
-	if (matches == 0)
-		command_success_nodata(si, _("No lines matched pattern \2%s\2"), pattern);
-	else if (matches > 0)
-		command_success_nodata(si, ngettext(N_("\2%u\2 match for pattern \2%s\2"),
-						    N_("\2%u\2 matches for pattern \2%s\2"), matches), matches, pattern);
+	greplog_search(gr);
+	(void) greplog_deliver(gr);
+	greplog_request_free(gr);
 }
 
 static struct command os_greplog = {
@@ -209,6 +563,25 @@ mod_init(struct module *const restrict m)
 static void
 mod_deinit(const enum module_unload_intent ATHEME_VATTR_UNUSED intent)
 {
+	mowgli_node_t *n, *tn;
+
+#ifdef HAVE_USABLE_PTHREAD
+	(void) pthread_mutex_lock(&greplog_lock);
+#endif
+
+	MOWGLI_ITER_FOREACH(n, greplog_requests.head)
+		((struct greplog_request *) n->data)->cancelled = true;
+
+#ifdef HAVE_USABLE_PTHREAD
+	(void) pthread_mutex_unlock(&greplog_lock);
+#endif
+
+	MOWGLI_ITER_FOREACH_SAFE(n, tn, greplog_requests.head)
+		greplog_request_free(n->data);
+
+	if (greplog_timer)
+		timer_destroy(greplog_timer);
+
 	service_named_unbind_command("operserv", &os_greplog);
 }
 
@@ -18,6 +18,13 @@ os_cmd_info(struct sourceinfo *si, int parc, char *parv[])
 	logcommand(si, CMDLOG_GET, "INFO");
 
 	command_success_nodata(si, _("How often services writes changes to the database: %u minutes"), config_options.commit_interval / SECONDS_PER_MINUTE);
+	if (db_changes.unsaved)
+		command_success_nodata(si, _("Changes since the last database write: %u (accounts %u, channels %u, access %u, metadata %u, other %u), at risk for %s"),
+			db_changes.unsaved, db_changes.unsaved_by[DB_CHANGE_MYUSER], db_changes.unsaved_by[DB_CHANGE_MYCHAN],
+			db_changes.unsaved_by[DB_CHANGE_CHANACS], db_changes.unsaved_by[DB_CHANGE_METADATA],
+			db_changes.unsaved_by[DB_CHANGE_OTHER], timediff(CURRTIME - db_changes.oldest_unsaved));
+	else
+		command_success_nodata(si, _("Changes since the last database write: none"));
 	command_success_nodata(si, _("Default kline time: %u days"), config_options.kline_time / SECONDS_PER_DAY);
 	command_success_nodata(si, _("Will services be sending WALLOPS/GLOBOPS about various things: %s"), config_options.silent ? _("No") : _("Yes"));
 	command_success_nodata(si, _("How many messages before a flood is triggered, (if 0, flood protection is disabled): %u"), config_options.flood_msgs);
@@ -42,6 +49,10 @@ os_cmd_info(struct sourceinfo *si, int parc, char *parv[])
 	command_success_nodata(si, _("Maximum number of founders allowed per channel: %u"), chansvs.maxfounders);
 	command_success_nodata(si, _("Show entity IDs to everyone: %s"),
 		config_options.show_entity_id ? _("Yes") : _("No"));
+	if (me.smtprelay != NULL)
+		command_success_nodata(si, _("Email queue: %u queued, %llu delivered, %llu deferred, %llu failed, %llu relay connections"),
+			mailqueue_stats.queued, mailqueue_stats.delivered, mailqueue_stats.deferred,
+			mailqueue_stats.failed, mailqueue_stats.connections);
 
 	if (IS_TAINTED)
 	{
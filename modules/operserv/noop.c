@@ -33,7 +33,7 @@ check_quit(struct user *u)
 		mowgli_node_free(n);
 		if (MOWGLI_LIST_LENGTH(&noop_kill_queue) == 0)
 		{
-			mowgli_timer_destroy(base_eventloop, noop_kill_users_timer);
+			timer_destroy(noop_kill_users_timer);
 			hook_del_user_delete(check_quit);
 		}
 	}
@@ -77,7 +77,7 @@ check_user(struct user *u)
 		{
 			if (MOWGLI_LIST_LENGTH(&noop_kill_queue) == 0)
 			{
-				noop_kill_users_timer = mowgli_timer_add_once(base_eventloop, "noop_kill_users", noop_kill_users, NULL, 0);
+				noop_kill_users_timer = timer_add_once("noop_kill_users", noop_kill_users, NULL, 0);
 				hook_add_user_delete(check_quit);
 			}
 			if (!mowgli_node_find(u, &noop_kill_queue))
@@ -97,7 +97,7 @@ check_user(struct user *u)
 		{
 			if (MOWGLI_LIST_LENGTH(&noop_kill_queue) == 0)
 			{
-				noop_kill_users_timer = mowgli_timer_add_once(base_eventloop, "noop_kill_users", noop_kill_users, NULL, 0);
+				noop_kill_users_timer = timer_add_once("noop_kill_users", noop_kill_users, NULL, 0);
 				hook_add_user_delete(check_quit);
 			}
 			if (!mowgli_node_find(u, &noop_kill_queue))
@@ -72,7 +72,7 @@ os_cmd_rakill(struct sourceinfo *si, int parc, char *parv[])
 	if (source == NULL)
 		source = si->smu != NULL && MOWGLI_LIST_LENGTH(&si->smu->logins) > 0 ?
 			si->smu->logins.head->data : si->service->me;
-	sprintf(usermask, "%s!%s@%s %s", source->nick, source->user, source->host, source->gecos);
+	sprintf(usermask, "%s!%s@%s %s", source->nick, source->user, source->host, user_gecos(source));
 	if (regex_match(regex, usermask))
 	{
 		regex_destroy(regex);
@@ -85,12 +85,12 @@ os_cmd_rakill(struct sourceinfo *si, int parc, char *parv[])
 
 	MOWGLI_PATRICIA_FOREACH(u, &state, userlist)
 	{
-		sprintf(usermask, "%s!%s@%s %s", u->nick, u->user, u->host, u->gecos);
+		sprintf(usermask, "%s!%s@%s %s", u->nick, u->user, u->host, user_gecos(u));
 
 		if (regex_match(regex, usermask))
 		{
 			// match
-			command_success_nodata(si, _("\2Match:\2  %s!%s@%s %s - AKILLing"), u->nick, u->user, u->host, u->gecos);
+			command_success_nodata(si, _("\2Match:\2  %s!%s@%s %s - AKILLing"), u->nick, u->user, u->host, user_gecos(u));
 			if (! (u->flags & UF_KLINESENT)) {
 				kline_sts("*", "*", u->host, SECONDS_PER_WEEK, reason);
 				u->flags |= UF_KLINESENT;
@@ -15,14 +15,151 @@
 
 #define MAXMATCHES_DEF 1000
 
+struct rmatch_request
+{
+	struct command_pending *    cp;
+	struct user_scan *          scan;
+	struct atheme_regex *       regex;
+	struct atheme_regex *       interp;     // The same pattern without JIT, for the timing comparison
+	struct atheme_regex *       scanning;   // Which of them the current scan uses
+	char *                      pattern;
+	int                         flags;
+	unsigned int                matches;
+	unsigned int                maxmatches;
+	unsigned long long          jit_us;
+};
+
+static struct command os_rmatch;
+
+static void
+rmatch_request_free(struct rmatch_request *const restrict rr)
+{
+	(void) regex_destroy(rr->regex);
+
+	if (rr->interp)
+		(void) regex_destroy(rr->interp);
+
+	(void) sfree(rr->pattern);
+	(void) sfree(rr);
+}
+
+// The user quit while the scan was running
+static void
+rmatch_cancel(void *const restrict priv)
+{
+	struct rmatch_request *const rr = priv;
+
+	if (rr->scan)
+		(void) user_scan_cancel(rr->scan);
+
+	(void) rmatch_request_free(rr);
+}
+
+static bool
+rmatch_scan_match(const struct user_snapshot *const restrict snap, const size_t i, void *const restrict priv)
+{
+	const struct rmatch_request *const rr = priv;
+	char usermask[512];
+
+	(void) snprintf(usermask, sizeof usermask, "%s!%s@%s %s", user_snapshot_get(snap, USF_NICK, i),
+	                user_snapshot_get(snap, USF_USER, i), user_snapshot_get(snap, USF_HOST, i),
+	                user_snapshot_get(snap, USF_GECOS, i));
+
+	return regex_match(rr->scanning, usermask);
+}
+
+static void
+rmatch_scan_result(const struct user_snapshot *const restrict snap, const size_t i, void *const restrict priv)
+{
+	struct rmatch_request *const rr = priv;
+	struct sourceinfo *const si = command_resume(rr->cp);
+
+	rr->matches++;
+
+	if (! si)
+		;
+	else if (rr->matches <= rr->maxmatches)
+		command_success_nodata(si, _("\2Match:\2  %s!%s@%s %s"), user_snapshot_get(snap, USF_NICK, i),
+		                       user_snapshot_get(snap, USF_USER, i), user_snapshot_get(snap, USF_HOST, i),
+		                       user_snapshot_get(snap, USF_GECOS, i));
+	else if (rr->matches == rr->maxmatches + 1)
+	{
+		command_success_nodata(si, _("Too many matches, not displaying any more"));
+		command_success_nodata(si, _("Add the FORCE keyword to see them all"));
+	}
+
+	(void) command_yield(rr->cp);
+}
+
+static void
+rmatch_scan_timed(const struct user_snapshot *const restrict snap, const unsigned long long interp_us,
+                  void *const restrict priv)
+{
+	struct rmatch_request *const rr = priv;
+	struct sourceinfo *const si = command_resume(rr->cp);
+
+	if (si)
+		command_success_nodata(si, _("Scanning %zu users took %llu.%03llu ms with JIT and %llu.%03llu ms "
+		                             "without (%.1fx)"), snap->count,
+		                       rr->jit_us / 1000ULL, rr->jit_us % 1000ULL, interp_us / 1000ULL,
+		                       interp_us % 1000ULL, (double) interp_us / (rr->jit_us ? rr->jit_us : 1ULL));
+
+	(void) command_finish(rr->cp);
+	(void) rmatch_request_free(rr);
+}
+
+static void
+rmatch_scan_done(const struct user_snapshot *const restrict snap, const unsigned long long match_us,
+                 void *const restrict priv)
+{
+	struct rmatch_request *const rr = priv;
+	struct sourceinfo *const si = command_resume(rr->cp);
+
+	rr->scan = NULL;
+
+	if (! si)
+	{
+		(void) command_finish(rr->cp);
+		(void) rmatch_request_free(rr);
+		return;
+	}
+
+	command_success_nodata(si, ngettext(N_("\2%u\2 match for pattern \2%s\2"),
+	                                    N_("\2%u\2 matches for pattern \2%s\2"),
+	                                    rr->matches), rr->matches, rr->pattern);
+
+	/* Show what JIT compilation buys by timing the same scan (without the
+	 * output) with the pattern compiled both ways. The time spent matching
+	 * this scan is the figure with JIT.
+	 */
+	if (rr->regex->jit && (rr->interp = regex_create(rr->pattern, rr->flags | AREGEX_NOJIT)) != NULL)
+	{
+		rr->jit_us = match_us;
+		rr->scanning = rr->interp;
+
+		(void) command_yield(rr->cp);
+
+		// If this finishes at once, rr is gone by the time it returns
+		struct user_scan *const scan = user_scan_start(&rmatch_scan_match, NULL, &rmatch_scan_timed, rr,
+		                                               si->su != NULL);
+		if (scan)
+			rr->scan = scan;
+
+		return;
+	}
+
+	command_success_nodata(si, _("Scanning %zu users took %llu.%03llu ms"), snap->count,
+	                       match_us / 1000ULL, match_us % 1000ULL);
+
+	(void) command_finish(rr->cp);
+	(void) rmatch_request_free(rr);
+}
+
 static void
 os_cmd_rmatch(struct sourceinfo *si, int parc, char *parv[])
 {
 	struct atheme_regex *regex;
-	char usermask[512];
-	unsigned int matches = 0, maxmatches;
-	mowgli_patricia_iteration_state_t state;
-	struct user *u;
+	unsigned int maxmatches;
 	char *args = parv[0];
 	char *pattern;
 	int flags = 0;
@@ -64,29 +201,27 @@ os_cmd_rmatch(struct sourceinfo *si, int parc, char *parv[])
 		return;
 	}
 
-	MOWGLI_PATRICIA_FOREACH(u, &state, userlist)
-	{
-		sprintf(usermask, "%s!%s@%s %s", u->nick, u->user, u->host, u->gecos);
-
-		if (regex_match(regex, usermask))
-		{
-			matches++;
-			if (matches <= maxmatches)
-				command_success_nodata(si, _("\2Match:\2  %s!%s@%s %s"), u->nick, u->user, u->host, u->gecos);
-			else if (matches == maxmatches + 1)
-			{
-				command_success_nodata(si, _("Too many matches, not displaying any more"));
-				command_success_nodata(si, _("Add the FORCE keyword to see them all"));
-			}
-		}
-	}
+	// Logged now, as whoever asked may not be around any more once the scan is done
+	logcommand(si, CMDLOG_ADMIN, "RMATCH: \2%s\2", pattern);
 
-	regex_destroy(regex);
-	command_success_nodata(si, ngettext(N_("\2%u\2 match for pattern \2%s\2"),
-	                                    N_("\2%u\2 matches for pattern \2%s\2"),
-	                                    matches), matches, pattern);
+	struct rmatch_request *const rr = smalloc(sizeof *rr);
+
+	rr->regex = regex;
+	rr->scanning = regex;
+	rr->pattern = sstrdup(pattern);
+	rr->flags = flags;
+	rr->maxmatches = maxmatches;
 
-	logcommand(si, CMDLOG_ADMIN, "RMATCH: \2%s\2 (\2%u\2 matches)", pattern, matches);
+	rr->cp = command_suspend(si, &rmatch_cancel, rr);
+
+	/* Users are matched on other threads, and the output trickles out from
+	 * the event loop; without a user to send it to later (e.g. over RPC),
+	 * it all has to be in the reply, so the scan is done right away.
+	 */
+	struct user_scan *const scan = user_scan_start(&rmatch_scan_match, &rmatch_scan_result, &rmatch_scan_done,
+	                                               rr, si->su != NULL);
+	if (scan)
+		rr->scan = scan;
 }
 
 static struct command os_rmatch = {
@@ -96,6 +231,7 @@ static struct command os_rmatch = {
 	.maxparc        = 1,
 	.cmd            = &os_cmd_rmatch,
 	.help           = { .path = "oservice/rmatch" },
+	.sched_class    = CMD_SCHED_QUERY,
 };
 
 static void
@@ -109,6 +245,8 @@ mod_init(struct module *const restrict m)
 static void
 mod_deinit(const enum module_unload_intent ATHEME_VATTR_UNUSED intent)
 {
+	(void) command_cancel_all(&os_rmatch);
+
 	service_named_unbind_command("operserv", &os_rmatch);
 }
 
@@ -15,71 +15,142 @@ struct rnc
 	unsigned int count;
 };
 
+struct rnc_request
+{
+	mowgli_node_t               node;
+	struct sourceinfo *         si;
+	char                        client[NICKLEN + UIDLEN + 1];  // CLIENT_NAME() of the user, if any
+	struct user_scan *          scan;
+	mowgli_patricia_t *         realnames;
+	unsigned int                count;
+};
+
+static mowgli_list_t rnc_requests;
+
 static void
-os_cmd_rnc(struct sourceinfo *si, int parc, char *parv[])
+rnc_realnames_free(const char ATHEME_VATTR_UNUSED *const restrict key, void *const restrict data,
+                   void ATHEME_VATTR_UNUSED *const restrict privdata)
 {
-	char *param = parv[0];
-	unsigned int count = 20;
+	(void) sfree(data);
+}
 
-	if (param && ! string_to_uint(param, &count))
-		count = 20;
+static void
+rnc_request_free(struct rnc_request *const restrict rr)
+{
+	(void) mowgli_node_delete(&rr->node, &rnc_requests);
+	(void) mowgli_patricia_destroy(rr->realnames, &rnc_realnames_free, NULL);
+	(void) atheme_object_unref(rr->si);
+	(void) sfree(rr);
+}
+
+static int
+rnc_compare(const void *const restrict a, const void *const restrict b)
+{
+	const struct rnc *const ra = *((const struct rnc *const *) a);
+	const struct rnc *const rb = *((const struct rnc *const *) b);
+
+	if (ra->count != rb->count)
+		return (ra->count < rb->count) ? 1 : -1;
 
-	struct user *u;
-	struct rnc *rnc, *biggest;
-	mowgli_patricia_t *realnames;
-	unsigned int i, found = 0;
-	mowgli_patricia_iteration_state_t state;
+	return strcmp(ra->gecos, rb->gecos);
+}
 
-	realnames = mowgli_patricia_create(noopcanon);
+static bool
+rnc_scan_match(const struct user_snapshot ATHEME_VATTR_UNUSED *const restrict snap,
+               const size_t ATHEME_VATTR_UNUSED i, void ATHEME_VATTR_UNUSED *const restrict priv)
+{
+	return true;
+}
+
+// Counted here, a slice at a time, rather than in one go when the scan is done
+static void
+rnc_scan_result(const struct user_snapshot *const restrict snap, const size_t i, void *const restrict priv)
+{
+	struct rnc_request *const rr = priv;
+	const char *const gecos = user_snapshot_get(snap, USF_GECOS, i);
+	struct rnc *rnc;
 
-	MOWGLI_PATRICIA_FOREACH(u, &state, userlist)
+	if ((rnc = mowgli_patricia_retrieve(rr->realnames, gecos)) != NULL)
 	{
-		rnc = mowgli_patricia_retrieve(realnames, u->gecos);
-		if (rnc != NULL)
-			rnc->count++;
-		else
-		{
-			rnc = smalloc(sizeof *rnc);
-			rnc->gecos = u->gecos;
-			rnc->count = 1;
-			mowgli_patricia_add(realnames, rnc->gecos, rnc);
-		}
+		rnc->count++;
+		return;
 	}
 
-	// this is ugly to the max :P
-	for (i = 1; i <= count; i++)
+	rnc = smalloc(sizeof *rnc);
+	rnc->gecos = gecos;
+	rnc->count = 1;
+
+	(void) mowgli_patricia_add(rr->realnames, rnc->gecos, rnc);
+}
+
+static void
+rnc_scan_done(const struct user_snapshot ATHEME_VATTR_UNUSED *const restrict snap,
+              const unsigned long long ATHEME_VATTR_UNUSED match_us, void *const restrict priv)
+{
+	struct rnc_request *const rr = priv;
+	const struct user *const u = rr->si->su ? user_find(rr->client) : NULL;
+
+	// The user quit (or, without UIDs, changed nick) while the scan was running
+	if (rr->si->su && (! u || u != rr->si->su))
 	{
-		found = 0;
-		biggest = NULL;
-		MOWGLI_PATRICIA_FOREACH(rnc, &state, realnames)
-		{
-			if (rnc->count > found)
-			{
-				found = rnc->count;
-				biggest = rnc;
-			}
-		}
-
-		if (biggest == NULL)
-			break;
-
-		command_success_nodata(si, ngettext(N_("\2%u\2: \2%u\2 match for realname \2%s\2"),
-		                                    N_("\2%u\2: \2%u\2 matches for realname \2%s\2"),
-		                                    biggest->count), i, biggest->count, biggest->gecos);
-
-		mowgli_patricia_delete(realnames, biggest->gecos);
-		sfree(biggest);
+		(void) rnc_request_free(rr);
+		return;
 	}
 
-	// cleanup
-	MOWGLI_PATRICIA_FOREACH(rnc, &state, realnames)
+	const unsigned int found = mowgli_patricia_size(rr->realnames);
+
+	if (found)
 	{
-		mowgli_patricia_delete(realnames, rnc->gecos);
-		sfree(rnc);
+		mowgli_patricia_iteration_state_t state;
+		struct rnc **const sorted = smalloc(found * sizeof *sorted);
+		struct rnc *rnc;
+		unsigned int i = 0;
+
+		MOWGLI_PATRICIA_FOREACH(rnc, &state, rr->realnames)
+			sorted[i++] = rnc;
+
+		(void) qsort(sorted, found, sizeof *sorted, &rnc_compare);
+
+		for (i = 0; i < found && i < rr->count; i++)
+			command_success_nodata(rr->si, ngettext(N_("\2%u\2: \2%u\2 match for realname \2%s\2"),
+			                                        N_("\2%u\2: \2%u\2 matches for realname \2%s\2"),
+			                                        sorted[i]->count), i + 1, sorted[i]->count,
+			                       sorted[i]->gecos);
+
+		(void) sfree(sorted);
 	}
-	mowgli_patricia_destroy(realnames, NULL, NULL);
+
+	// The keys point into the snapshot, which is about to go away
+	(void) rnc_request_free(rr);
+}
+
+static void
+os_cmd_rnc(struct sourceinfo *si, int parc, char *parv[])
+{
+	char *param = parv[0];
+	unsigned int count = 20;
+
+	if (param && ! string_to_uint(param, &count))
+		count = 20;
 
 	logcommand(si, CMDLOG_ADMIN, "RNC: \2%u\2", count);
+
+	struct rnc_request *const rr = smalloc(sizeof *rr);
+
+	rr->si = atheme_object_ref(si);
+	rr->realnames = mowgli_patricia_create(noopcanon);
+	rr->count = count;
+
+	if (si->su)
+		(void) mowgli_strlcpy(rr->client, CLIENT_NAME(si->su), sizeof rr->client);
+
+	(void) mowgli_node_add(rr, &rr->node, &rnc_requests);
+
+	// Without a user to send the output to later (e.g. over RPC), it has to be done right away
+	struct user_scan *const scan = user_scan_start(&rnc_scan_match, &rnc_scan_result, &rnc_scan_done, rr,
+	                                               si->su != NULL);
+	if (scan)
+		rr->scan = scan;
 }
 
 static struct command os_rnc = {
@@ -102,6 +173,18 @@ mod_init(struct module *const restrict m)
 static void
 mod_deinit(const enum module_unload_intent ATHEME_VATTR_UNUSED intent)
 {
+	mowgli_node_t *n, *tn;
+
+	MOWGLI_ITER_FOREACH_SAFE(n, tn, rnc_requests.head)
+	{
+		struct rnc_request *const rr = n->data;
+
+		if (rr->scan)
+			(void) user_scan_cancel(rr->scan);
+
+		(void) rnc_request_free(rr);
+	}
+
 	service_named_unbind_command("operserv", &os_rnc);
 }
 
@@ -27,6 +27,73 @@ static FILE *f;
 
 static mowgli_patricia_t *os_rwatch_cmds;
 static mowgli_list_t rwatch_list;
+static struct db_shard *rwatch_shard = NULL;
+
+/* All of rwatch_list as one regex set, so that a connecting client isn't
+ * matched against every pattern in turn; rebuilt the next time it is needed
+ * after the list changes.
+ */
+static struct regex_set *rwatch_set = NULL;
+static struct rwatch **rwatch_set_entries = NULL;
+static size_t rwatch_set_count = 0;
+static bool *rwatch_set_matches = NULL;
+static bool *rwatch_set_oldmatches = NULL;
+
+static void
+rwatch_set_invalidate(void)
+{
+	if (rwatch_set)
+		regex_set_destroy(rwatch_set);
+
+	sfree(rwatch_set_entries);
+	sfree(rwatch_set_matches);
+	sfree(rwatch_set_oldmatches);
+
+	rwatch_set = NULL;
+	rwatch_set_entries = NULL;
+	rwatch_set_matches = NULL;
+	rwatch_set_oldmatches = NULL;
+	rwatch_set_count = 0;
+}
+
+static void
+rwatch_set_build(void)
+{
+	mowgli_node_t *n;
+	size_t i = 0;
+
+	if (rwatch_set)
+		return;
+
+	const size_t count = MOWGLI_LIST_LENGTH(&rwatch_list);
+	const size_t alloc = count ? count : 1;
+
+	char **const patterns = smalloc(alloc * sizeof *patterns);
+	int *const flags = smalloc(alloc * sizeof *flags);
+	struct atheme_regex **const regexes = smalloc(alloc * sizeof *regexes);
+
+	rwatch_set_entries = smalloc(alloc * sizeof *rwatch_set_entries);
+	rwatch_set_matches = smalloc(alloc * sizeof *rwatch_set_matches);
+	rwatch_set_oldmatches = smalloc(alloc * sizeof *rwatch_set_oldmatches);
+
+	MOWGLI_ITER_FOREACH(n, rwatch_list.head)
+	{
+		struct rwatch *const rw = n->data;
+
+		rwatch_set_entries[i] = rw;
+		patterns[i] = rw->regex;
+		flags[i] = rw->reflags;
+		regexes[i] = rw->re;
+		i++;
+	}
+
+	rwatch_set = regex_set_create(patterns, flags, regexes, count);
+	rwatch_set_count = count;
+
+	sfree(patterns);
+	sfree(flags);
+	sfree(regexes);
+}
 
 static void
 write_rwatchdb(struct database_handle *db)
@@ -93,6 +160,7 @@ load_rwatchdb(char *path)
 				rw->actions = atoi(actionstr);
 				rw->reason = sstrdup(reason);
 				mowgli_node_add(rw, mowgli_node_create(), &rwatch_list);
+				rwatch_set_invalidate();
 				rw = NULL;
 			}
 		}
@@ -141,6 +209,7 @@ db_h_rr(struct database_handle *db, const char *type)
 	rwread->actions = actions;
 	rwread->reason = sstrdup(reason);
 	mowgli_node_add(rwread, mowgli_node_create(), &rwatch_list);
+	rwatch_set_invalidate();
 	rwread = NULL;
 }
 
@@ -218,8 +287,10 @@ os_cmd_rwatch_add(struct sourceinfo *si, int parc, char *parv[])
 	rw->re = regex;
 
 	mowgli_node_add(rw, mowgli_node_create(), &rwatch_list);
+	rwatch_set_invalidate();
 	command_success_nodata(si, _("Added \2%s\2 to regex watch list."), pattern);
 	logcommand(si, CMDLOG_ADMIN, "RWATCH:ADD: \2%s\2 (reason: \2%s\2)", pattern, reason);
+	db_shard_dirty(rwatch_shard);
 }
 
 static void
@@ -276,8 +347,10 @@ os_cmd_rwatch_del(struct sourceinfo *si, int parc, char *parv[])
 			sfree(rw);
 			mowgli_node_delete(n, &rwatch_list);
 			mowgli_node_free(n);
+			rwatch_set_invalidate();
 			command_success_nodata(si, _("Removed \2%s\2 from regex watch list."), pattern);
 			logcommand(si, CMDLOG_ADMIN, "RWATCH:DEL: \2%s\2", pattern);
+			db_shard_dirty(rwatch_shard);
 			return;
 		}
 	}
@@ -428,6 +501,7 @@ os_cmd_rwatch_set(struct sourceinfo *si, int parc, char *parv[])
 				wallops("\2%s\2 disabled quarantine on regex watch pattern \2%s\2", get_oper_name(si), pattern);
 
 			logcommand(si, CMDLOG_ADMIN, "RWATCH:SET: \2%s\2 \2%s\2", pattern, opts);
+			db_shard_dirty(rwatch_shard);
 			return;
 		}
 	}
@@ -436,28 +510,20 @@ os_cmd_rwatch_set(struct sourceinfo *si, int parc, char *parv[])
 }
 
 static void
-rwatch_newuser(struct hook_user_nick *data)
+rwatch_checkuser(struct user *u)
 {
-	struct user *u = data->u;
 	char usermask[NICKLEN + 1 + USERLEN + 1 + HOSTLEN + 1 + GECOSLEN + 1];
-	mowgli_node_t *n;
 	struct rwatch *rw;
 
-	// If the user has been killed, don't do anything.
-	if (!u)
-		return;
-
-	if (is_internal_client(u))
-		return;
+	snprintf(usermask, sizeof usermask, "%s!%s@%s %s", u->nick, u->user, u->host, user_gecos(u));
 
-	snprintf(usermask, sizeof usermask, "%s!%s@%s %s", u->nick, u->user, u->host, u->gecos);
+	rwatch_set_build();
+	regex_set_match(rwatch_set, usermask, rwatch_set_matches);
 
-	MOWGLI_ITER_FOREACH(n, rwatch_list.head)
+	for (size_t i = 0; i < rwatch_set_count; i++)
 	{
-		rw = n->data;
-		if (!rw->re)
-			continue;
-		if (regex_match(rw->re, usermask))
+		rw = rwatch_set_entries[i];
+		if (rwatch_set_matches[i])
 		{
 			if (rw->actions & RWACT_SNOOP)
 			{
@@ -500,13 +566,31 @@ rwatch_newuser(struct hook_user_nick *data)
 	}
 }
 
+static void
+rwatch_newuser(struct hook_user_nick *data)
+{
+	struct user *u = data->u;
+
+	// If the user has been killed, don't do anything.
+	if (!u)
+		return;
+
+	if (is_internal_client(u))
+		return;
+
+	// Users introduced in a netjoin are checked once the burst is over
+	if (burst_defer_user(u, &rwatch_checkuser))
+		return;
+
+	rwatch_checkuser(u);
+}
+
 static void
 rwatch_nickchange(struct hook_user_nick *data)
 {
 	struct user *u = data->u;
 	char usermask[NICKLEN + 1 + USERLEN + 1 + HOSTLEN + 1 + GECOSLEN + 1];
 	char oldusermask[NICKLEN + 1 + USERLEN + 1 + HOSTLEN + 1 + GECOSLEN + 1];
-	mowgli_node_t *n;
 	struct rwatch *rw;
 
 	// If the user has been killed, don't do anything.
@@ -516,18 +600,20 @@ rwatch_nickchange(struct hook_user_nick *data)
 	if (is_internal_client(u))
 		return;
 
-	snprintf(usermask, sizeof usermask, "%s!%s@%s %s", u->nick, u->user, u->host, u->gecos);
-	snprintf(oldusermask, sizeof oldusermask, "%s!%s@%s %s", data->oldnick, u->user, u->host, u->gecos);
+	snprintf(usermask, sizeof usermask, "%s!%s@%s %s", u->nick, u->user, u->host, user_gecos(u));
+	snprintf(oldusermask, sizeof oldusermask, "%s!%s@%s %s", data->oldnick, u->user, u->host, user_gecos(u));
 
-	MOWGLI_ITER_FOREACH(n, rwatch_list.head)
+	rwatch_set_build();
+	regex_set_match(rwatch_set, usermask, rwatch_set_matches);
+	regex_set_match(rwatch_set, oldusermask, rwatch_set_oldmatches);
+
+	for (size_t i = 0; i < rwatch_set_count; i++)
 	{
-		rw = n->data;
-		if (!rw->re)
-			continue;
-		if (regex_match(rw->re, usermask))
+		rw = rwatch_set_entries[i];
+		if (rwatch_set_matches[i])
 		{
 			// Only process if they did not match before.
-			if (regex_match(rw->re, oldusermask))
+			if (rwatch_set_oldmatches[i])
 				continue;
 			if (rw->actions & RWACT_SNOOP)
 			{
@@ -637,7 +723,6 @@ mod_init(struct module *const restrict m)
 
 	(void) hook_add_user_add(&rwatch_newuser);
 	(void) hook_add_user_nickchange(&rwatch_nickchange);
-	(void) hook_add_db_write(&write_rwatchdb);
 
 	char path[BUFSIZE];
 	snprintf(path, BUFSIZE, "%s/%s", datadir, "rwatch.db");
@@ -654,13 +739,16 @@ mod_init(struct module *const restrict m)
 		db_register_type_handler("RR", db_h_rr);
 	}
 
+	rwatch_shard = db_shard_register("rwatch", &write_rwatchdb);
+	db_shard_load(rwatch_shard);
+
 	m->mflags |= MODFLAG_DBHANDLER;
 }
 
 static void
 mod_deinit(const enum module_unload_intent ATHEME_VATTR_UNUSED intent)
 {
-
+	rwatch_set_invalidate();
 }
 
 SIMPLE_DECLARE_MODULE_V1("operserv/rwatch", MODULE_UNLOAD_CAPABILITY_NEVER)
@@ -0,0 +1,720 @@
+/*
+ * SPDX-License-Identifier: ISC
+ * SPDX-URL: https://spdx.org/licenses/ISC.html
+ *
+ * Copyright (C) 2026 Atheme Development Group (https://atheme.github.io/)
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * This file contains code for OS STATS
+ */
+
+#include <atheme.h>
+
+#define OS_STATS_COMMANDS_DEF   20U
+#define OS_STATS_TIMERS_DEF     20U
+#define OS_STATS_HOOKS_DEF      20U
+#define OS_STATS_STARTUP_DEF    20U
+#define OS_STATS_STRINGS_DEF    20U
+#define OS_STATS_STRINGS_MAX    200U
+#define OS_STATS_STRINGS_WIDTH  48U
+
+#define OS_STATS_SYNTAX         "STATS COMMANDS [TIME|CALLS|MAX|SLOW] [count] | TIMERS [TIME|RUNS|MAX|SLOW] [count] | " \
+                                "HOOKS [TIME|CALLS|MAX] [count] | LANES | MEMORY | MODES | STARTUP [count] | " \
+                                "STRINGS [count]"
+
+enum os_stats_sort
+{
+	OS_STATS_SORT_TIME      = 0,
+	OS_STATS_SORT_CALLS,
+	OS_STATS_SORT_MAX,
+	OS_STATS_SORT_SLOW,
+};
+
+struct os_stats_collect
+{
+	const void **                   list;
+	size_t                          count;
+	size_t                          alloc;
+};
+
+static enum os_stats_sort os_stats_sort_key = OS_STATS_SORT_TIME;
+
+static void
+os_stats_collect(struct os_stats_collect *const restrict sc, const void *const restrict st)
+{
+	if (sc->count == sc->alloc)
+	{
+		sc->alloc = sc->alloc ? (sc->alloc * 2) : 64;
+		sc->list = sreallocarray(sc->list, sc->alloc, sizeof *sc->list);
+	}
+
+	sc->list[sc->count++] = st;
+}
+
+static void
+os_stats_collect_cb(const struct command_stats *const restrict st, void *const restrict privdata)
+{
+	(void) os_stats_collect(privdata, st);
+}
+
+static void
+os_stats_collect_timer_cb(const struct timer_stats *const restrict st, void *const restrict privdata)
+{
+	(void) os_stats_collect(privdata, st);
+}
+
+static void
+os_stats_collect_hook_cb(const struct hook_handler_stats *const restrict st, void *const restrict privdata)
+{
+	if (st->calls)
+		(void) os_stats_collect(privdata, st);
+}
+
+static void
+os_stats_collect_startup_cb(const struct startup_entry *const restrict se, void *const restrict privdata)
+{
+	if (se->kind == STARTUP_MODULE)
+		(void) os_stats_collect(privdata, se);
+}
+
+static void
+os_stats_collect_heap_cb(const struct named_heap *const restrict nh, void *const restrict privdata)
+{
+	(void) os_stats_collect(privdata, nh);
+}
+
+static int
+os_stats_compare_heap(const void *const restrict a, const void *const restrict b)
+{
+	const struct named_heap *const na = *(const struct named_heap *const *) a;
+	const struct named_heap *const nb = *(const struct named_heap *const *) b;
+	const size_t ra = named_heap_reserved(na);
+	const size_t rb = named_heap_reserved(nb);
+
+	// Descending
+	if (ra != rb)
+		return (ra < rb) ? 1 : -1;
+
+	return strcmp(na->name, nb->name);
+}
+
+static int
+os_stats_compare_startup(const void *const restrict a, const void *const restrict b)
+{
+	const struct startup_entry *const sa = *(const struct startup_entry *const *) a;
+	const struct startup_entry *const sb = *(const struct startup_entry *const *) b;
+
+	// Descending
+	if (sa->wall_us != sb->wall_us)
+		return (sa->wall_us < sb->wall_us) ? 1 : -1;
+
+	return strcasecmp(sa->name, sb->name);
+}
+
+static int
+os_stats_compare(const void *const restrict a, const void *const restrict b)
+{
+	const struct command_stats *const sa = *(const struct command_stats *const *) a;
+	const struct command_stats *const sb = *(const struct command_stats *const *) b;
+	unsigned long long va, vb;
+
+	switch (os_stats_sort_key)
+	{
+		case OS_STATS_SORT_CALLS:
+			va = sa->calls;
+			vb = sb->calls;
+			break;
+		case OS_STATS_SORT_MAX:
+			va = sa->max_us;
+			vb = sb->max_us;
+			break;
+		case OS_STATS_SORT_SLOW:
+			va = sa->slow;
+			vb = sb->slow;
+			break;
+		case OS_STATS_SORT_TIME:
+		default:
+			va = sa->total_us;
+			vb = sb->total_us;
+			break;
+	}
+
+	// Descending
+	if (va != vb)
+		return (va < vb) ? 1 : -1;
+
+	return strcasecmp(sa->name, sb->name);
+}
+
+static int
+os_stats_compare_timer(const void *const restrict a, const void *const restrict b)
+{
+	const struct timer_stats *const sa = *(const struct timer_stats *const *) a;
+	const struct timer_stats *const sb = *(const struct timer_stats *const *) b;
+	unsigned long long va, vb;
+
+	switch (os_stats_sort_key)
+	{
+		case OS_STATS_SORT_CALLS:
+			va = sa->runs;
+			vb = sb->runs;
+			break;
+		case OS_STATS_SORT_MAX:
+			va = sa->max_us;
+			vb = sb->max_us;
+			break;
+		case OS_STATS_SORT_SLOW:
+			va = sa->slow;
+			vb = sb->slow;
+			break;
+		case OS_STATS_SORT_TIME:
+		default:
+			va = sa->total_us;
+			vb = sb->total_us;
+			break;
+	}
+
+	// Descending
+	if (va != vb)
+		return (va < vb) ? 1 : -1;
+
+	return strcasecmp(sa->name, sb->name);
+}
+
+static int
+os_stats_compare_hook(const void *const restrict a, const void *const restrict b)
+{
+	const struct hook_handler_stats *const sa = *(const struct hook_handler_stats *const *) a;
+	const struct hook_handler_stats *const sb = *(const struct hook_handler_stats *const *) b;
+	unsigned long long va, vb;
+
+	switch (os_stats_sort_key)
+	{
+		case OS_STATS_SORT_CALLS:
+			va = sa->calls;
+			vb = sb->calls;
+			break;
+		case OS_STATS_SORT_MAX:
+			va = sa->max_us;
+			vb = sb->max_us;
+			break;
+		case OS_STATS_SORT_TIME:
+		default:
+			va = sa->total_us;
+			vb = sb->total_us;
+			break;
+	}
+
+	// Descending
+	if (va != vb)
+		return (va < vb) ? 1 : -1;
+
+	return strcmp(sa->hook, sb->hook);
+}
+
+static void
+os_cmd_stats_commands(struct sourceinfo *const restrict si, const int parc, char **const restrict parv)
+{
+	struct os_stats_collect sc = { NULL, 0, 0 };
+	unsigned int limit = OS_STATS_COMMANDS_DEF;
+
+	os_stats_sort_key = OS_STATS_SORT_TIME;
+
+	for (int i = 0; i < parc; i++)
+	{
+		if (! strcasecmp(parv[i], "TIME"))
+			os_stats_sort_key = OS_STATS_SORT_TIME;
+		else if (! strcasecmp(parv[i], "CALLS"))
+			os_stats_sort_key = OS_STATS_SORT_CALLS;
+		else if (! strcasecmp(parv[i], "MAX"))
+			os_stats_sort_key = OS_STATS_SORT_MAX;
+		else if (! strcasecmp(parv[i], "SLOW"))
+			os_stats_sort_key = OS_STATS_SORT_SLOW;
+		else if (! string_to_uint(parv[i], &limit) || ! limit)
+		{
+			(void) command_fail(si, fault_badparams, STR_INVALID_PARAMS, "STATS COMMANDS");
+			(void) command_fail(si, fault_badparams, _("Syntax: STATS COMMANDS [TIME|CALLS|MAX|SLOW] [count]"));
+			return;
+		}
+	}
+
+	(void) command_stats_foreach(&os_stats_collect_cb, &sc);
+
+	if (! sc.count)
+	{
+		(void) command_success_nodata(si, _("No commands have been executed yet."));
+		return;
+	}
+
+	(void) qsort(sc.list, sc.count, sizeof *sc.list, &os_stats_compare);
+
+	(void) command_success_nodata(si, "%-32s %8s %10s %8s %8s %8s %5s", _("Command"), _("Calls"), _("Total ms"),
+	                              _("Avg us"), _("p99 us"), _("Max us"), _("Slow"));
+
+	for (size_t i = 0; i < sc.count && i < limit; i++)
+	{
+		const struct command_stats *const st = sc.list[i];
+
+		(void) command_success_nodata(si, "%-32s %8u %10llu %8llu %8llu %8llu %5u", st->name, st->calls,
+		                              st->total_us / 1000ULL, st->total_us / (st->calls ? st->calls : 1),
+		                              command_stats_percentile(st, 99), st->max_us, st->slow);
+	}
+
+	(void) command_success_nodata(si, ngettext(N_("End of list: %zu command, %zu shown."),
+	                                           N_("End of list: %zu commands, %zu shown."), sc.count),
+	                              sc.count, (sc.count < limit) ? sc.count : (size_t) limit);
+
+	struct command_queue_stats qs;
+
+	(void) command_queue_get_stats(&qs);
+	(void) command_success_nodata(si, _("Commands that waited for their turn: %u (%u waiting now, %u dropped; "
+	                                    "longest wait %llu ms), over budget in %u passes, run in slices: %u "
+	                                    "(%u running now)"), qs.deferred, qs.waiting, qs.dropped,
+	                              qs.max_wait_us / 1000ULL, qs.passes_over, qs.sliced, qs.slices_running);
+
+	(void) logcommand(si, CMDLOG_GET, "STATS: \2COMMANDS\2");
+
+	(void) sfree(sc.list);
+}
+
+static void
+os_cmd_stats_timers(struct sourceinfo *const restrict si, const int parc, char **const restrict parv)
+{
+	struct os_stats_collect sc = { NULL, 0, 0 };
+	unsigned int limit = OS_STATS_TIMERS_DEF;
+
+	os_stats_sort_key = OS_STATS_SORT_TIME;
+
+	for (int i = 0; i < parc; i++)
+	{
+		if (! strcasecmp(parv[i], "TIME"))
+			os_stats_sort_key = OS_STATS_SORT_TIME;
+		else if (! strcasecmp(parv[i], "RUNS"))
+			os_stats_sort_key = OS_STATS_SORT_CALLS;
+		else if (! strcasecmp(parv[i], "MAX"))
+			os_stats_sort_key = OS_STATS_SORT_MAX;
+		else if (! strcasecmp(parv[i], "SLOW"))
+			os_stats_sort_key = OS_STATS_SORT_SLOW;
+		else if (! string_to_uint(parv[i], &limit) || ! limit)
+		{
+			(void) command_fail(si, fault_badparams, STR_INVALID_PARAMS, "STATS TIMERS");
+			(void) command_fail(si, fault_badparams, _("Syntax: STATS TIMERS [TIME|RUNS|MAX|SLOW] [count]"));
+			return;
+		}
+	}
+
+	(void) timer_stats_foreach(&os_stats_collect_timer_cb, &sc);
+
+	if (! sc.count)
+	{
+		(void) command_success_nodata(si, _("No timers have run yet."));
+		return;
+	}
+
+	(void) qsort(sc.list, sc.count, sizeof *sc.list, &os_stats_compare_timer);
+
+	(void) command_success_nodata(si, "%-32s %8s %10s %8s %8s %5s", _("Timer"), _("Runs"), _("Total ms"),
+	                              _("Avg us"), _("Max us"), _("Slow"));
+
+	for (size_t i = 0; i < sc.count && i < limit; i++)
+	{
+		const struct timer_stats *const st = sc.list[i];
+
+		(void) command_success_nodata(si, "%-32s %8u %10llu %8llu %8llu %5u", st->name, st->runs,
+		                              st->total_us / 1000ULL, st->total_us / (st->runs ? st->runs : 1),
+		                              st->max_us, st->slow);
+	}
+
+	(void) command_success_nodata(si, ngettext(N_("End of list: %zu timer, %zu shown."),
+	                                           N_("End of list: %zu timers, %zu shown."), sc.count),
+	                              sc.count, (sc.count < limit) ? sc.count : (size_t) limit);
+
+	(void) logcommand(si, CMDLOG_GET, "STATS: \2TIMERS\2");
+
+	(void) sfree(sc.list);
+}
+
+static void
+os_cmd_stats_lanes(struct sourceinfo *const restrict si)
+{
+	(void) command_success_nodata(si, "%-10s %10s %10s %8s %8s %8s", _("Lane"), _("Runs"), _("Carried"),
+	                              _("Avg us"), _("Max us"), _("Waiting"));
+
+	for (unsigned int lane = 0; lane < CONNECTION_LANES; lane++)
+	{
+		struct connection_lane_stats st;
+
+		(void) connection_lane_stats_get(lane, &st);
+		(void) command_success_nodata(si, "%-10s %10llu %10llu %8llu %8llu %8u", connection_lane_name(lane),
+		                              st.runs, st.carried, st.total_wait_us / (st.runs ? st.runs : 1),
+		                              st.max_wait_us, st.waiting);
+	}
+
+	(void) logcommand(si, CMDLOG_GET, "STATS: \2LANES\2");
+}
+
+static void
+os_cmd_stats_hooks(struct sourceinfo *const restrict si, const int parc, char **const restrict parv)
+{
+	struct os_stats_collect sc = { NULL, 0, 0 };
+	unsigned int limit = OS_STATS_HOOKS_DEF;
+
+	os_stats_sort_key = OS_STATS_SORT_TIME;
+
+	for (int i = 0; i < parc; i++)
+	{
+		if (! strcasecmp(parv[i], "TIME"))
+			os_stats_sort_key = OS_STATS_SORT_TIME;
+		else if (! strcasecmp(parv[i], "CALLS"))
+			os_stats_sort_key = OS_STATS_SORT_CALLS;
+		else if (! strcasecmp(parv[i], "MAX"))
+			os_stats_sort_key = OS_STATS_SORT_MAX;
+		else if (! string_to_uint(parv[i], &limit) || ! limit)
+		{
+			(void) command_fail(si, fault_badparams, STR_INVALID_PARAMS, "STATS HOOKS");
+			(void) command_fail(si, fault_badparams, _("Syntax: STATS HOOKS [TIME|CALLS|MAX] [count]"));
+			return;
+		}
+	}
+
+	(void) hook_stats_foreach(&os_stats_collect_hook_cb, &sc);
+
+	if (! sc.count)
+	{
+		if (config_options.hook_profiling)
+			(void) command_success_nodata(si, _("No hook handlers have been called yet."));
+		else
+			(void) command_success_nodata(si, _("Hook profiling is disabled (see \2hook_profiling\2 in "
+			                                    "the general{} block)."));
+		return;
+	}
+
+	(void) qsort(sc.list, sc.count, sizeof *sc.list, &os_stats_compare_hook);
+
+	(void) command_success_nodata(si, "%-24s %-24s %8s %10s %8s %8s", _("Hook"), _("Module"), _("Calls"),
+	                              _("Total ms"), _("Avg us"), _("Max us"));
+
+	for (size_t i = 0; i < sc.count && i < limit; i++)
+	{
+		const struct hook_handler_stats *const st = sc.list[i];
+
+		(void) command_success_nodata(si, "%-24s %-24s %8u %10llu %8llu %8llu%s", st->hook,
+		                              (st->module != NULL) ? st->module : "-", st->calls,
+		                              st->total_us / 1000ULL, st->total_us / st->calls, st->max_us,
+		                              st->installed ? "" : _(" (removed)"));
+	}
+
+	(void) command_success_nodata(si, ngettext(N_("End of list: %zu handler, %zu shown."),
+	                                           N_("End of list: %zu handlers, %zu shown."), sc.count),
+	                              sc.count, (sc.count < limit) ? sc.count : (size_t) limit);
+
+	if (! config_options.hook_profiling)
+		(void) command_success_nodata(si, _("Hook profiling is currently disabled; these figures are not "
+		                                    "being updated."));
+
+	(void) logcommand(si, CMDLOG_GET, "STATS: \2HOOKS\2");
+
+	(void) sfree(sc.list);
+}
+
+static void
+os_cmd_stats_memory(struct sourceinfo *const restrict si, const int ATHEME_VATTR_UNUSED parc,
+                    char ATHEME_VATTR_UNUSED **const restrict parv)
+{
+	struct os_stats_collect sc = { NULL, 0, 0 };
+	size_t used = 0, reserved = 0;
+
+	(void) named_heap_foreach(&os_stats_collect_heap_cb, &sc);
+
+	if (! sc.count)
+	{
+		(void) command_success_nodata(si, _("No heaps have been created."));
+		return;
+	}
+
+	(void) qsort(sc.list, sc.count, sizeof *sc.list, &os_stats_compare_heap);
+
+	(void) command_success_nodata(si, "%-16s %6s %9s %9s %10s %10s", _("Heap"), _("Size"), _("Live"), _("Peak"),
+	                              _("Used KB"), _("Rsvd KB"));
+
+	for (size_t i = 0; i < sc.count; i++)
+	{
+		const struct named_heap *const nh = sc.list[i];
+
+		used += nh->live * nh->size;
+		reserved += named_heap_reserved(nh);
+
+		(void) command_success_nodata(si, "%-16s %6zu %9zu %9zu %10zu %10zu", nh->name, nh->size, nh->live,
+		                              nh->peak, (nh->live * nh->size) / 1024U, named_heap_reserved(nh) / 1024U);
+	}
+
+	(void) command_success_nodata(si, _("Total: %zu KB used, at least %zu KB reserved, in %zu heaps."),
+	                              used / 1024U, reserved / 1024U, sc.count);
+	(void) command_success_nodata(si, _("Freed objects waiting to be handed back: %zu (at most %zu, %llu so far)."),
+	                              named_heap_deferred.pending, named_heap_deferred.peak,
+	                              named_heap_deferred.reclaimed);
+
+	(void) logcommand(si, CMDLOG_GET, "STATS: \2MEMORY\2");
+
+	(void) sfree(sc.list);
+}
+
+static void
+os_cmd_stats_modes(struct sourceinfo *const restrict si)
+{
+	const unsigned long long changes = modestack_stats.changes;
+	const unsigned long long lines = modestack_stats.lines;
+
+	(void) command_success_nodata(si, _("Mode changes stacked: %llu"), changes);
+	(void) command_success_nodata(si, _("MODE lines sent for them: %llu (%llu saved)"), lines,
+	                              (changes > lines) ? (changes - lines) : 0);
+	(void) command_success_nodata(si, _("End-of-pass flushes: %llu (at most %u channels at once)"),
+	                              modestack_stats.flushes, modestack_stats.peak_channels);
+	(void) command_success_nodata(si, _("Flushes held back for the uplink: %llu"), modestack_stats.holds);
+
+	(void) logcommand(si, CMDLOG_GET, "STATS: \2MODES\2");
+}
+
+static void
+os_stats_startup_phase_cb(const struct startup_entry *const restrict se, void *const restrict privdata)
+{
+	struct sourceinfo *const si = privdata;
+
+	if (se->kind != STARTUP_PHASE)
+		return;
+
+	(void) command_success_nodata(si, "%-20s %9llu %9llu %9ld %9u %9u", se->name, se->wall_us / 1000ULL,
+	                              se->cpu_us / 1000ULL, se->rss_kb, se->myusers, se->mychans);
+}
+
+static void
+os_cmd_stats_startup(struct sourceinfo *const restrict si, const int parc, char **const restrict parv)
+{
+	struct os_stats_collect sc = { NULL, 0, 0 };
+	unsigned int limit = OS_STATS_STARTUP_DEF;
+	unsigned long long total_us;
+
+	if (parc > 0 && (! string_to_uint(parv[0], &limit) || ! limit))
+	{
+		(void) command_fail(si, fault_badparams, STR_INVALID_PARAMS, "STATS STARTUP");
+		(void) command_fail(si, fault_badparams, _("Syntax: STATS STARTUP [count]"));
+		return;
+	}
+
+	(void) command_success_nodata(si, "%-20s %9s %9s %9s %9s %9s", _("Phase"), _("Wall ms"), _("CPU ms"),
+	                              _("RSS KB"), _("Accounts"), _("Channels"));
+	(void) startup_entry_foreach(&os_stats_startup_phase_cb, si);
+
+	(void) startup_entry_foreach(&os_stats_collect_startup_cb, &sc);
+
+	if (sc.count)
+	{
+		(void) qsort(sc.list, sc.count, sizeof *sc.list, &os_stats_compare_startup);
+
+		(void) command_success_nodata(si, " ");
+		(void) command_success_nodata(si, "%-32s %9s %9s %9s", _("Module"), _("Wall us"), _("CPU us"),
+		                              _("+RSS KB"));
+
+		for (size_t i = 0; i < sc.count && i < limit; i++)
+		{
+			const struct startup_entry *const se = sc.list[i];
+
+			(void) command_success_nodata(si, "%-32s %9llu %9llu %9ld", se->name, se->wall_us, se->cpu_us,
+			                              se->rss_kb);
+		}
+
+		(void) command_success_nodata(si, ngettext(N_("End of list: %zu module, %zu shown."),
+		                                           N_("End of list: %zu modules, %zu shown."), sc.count),
+		                              sc.count, (sc.count < limit) ? sc.count : (size_t) limit);
+	}
+
+	if (startup_complete(&total_us))
+		(void) command_success_nodata(si, _("Services were synchronised with the uplink %llu ms after starting."),
+		                              total_us / 1000ULL);
+	else
+		(void) command_success_nodata(si, _("Services have not finished their first burst with the uplink yet."));
+
+	(void) logcommand(si, CMDLOG_GET, "STATS: \2STARTUP\2");
+
+	(void) sfree(sc.list);
+}
+
+struct os_stats_strings
+{
+	stringref *             list;
+	unsigned int *          refs;
+	unsigned int            limit;
+	unsigned int            count;
+};
+
+static inline size_t
+os_stats_string_saved(const stringref str, const unsigned int refcount)
+{
+	return (refcount - 1U) * (strlen(str) + 1U);
+}
+
+// Keeps the strings that save the most memory, most first
+static void
+os_stats_strings_cb(const stringref str, const unsigned int refcount, void *const restrict privdata)
+{
+	struct os_stats_strings *const ss = privdata;
+	const size_t saved = os_stats_string_saved(str, refcount);
+	unsigned int i;
+
+	if (refcount < 2U)
+		return;
+
+	if (ss->count == ss->limit && saved <= os_stats_string_saved(ss->list[ss->count - 1U], ss->refs[ss->count - 1U]))
+		return;
+
+	if (ss->count < ss->limit)
+		ss->count++;
+
+	for (i = ss->count - 1U; i > 0 && os_stats_string_saved(ss->list[i - 1U], ss->refs[i - 1U]) < saved; i--)
+	{
+		ss->list[i] = ss->list[i - 1U];
+		ss->refs[i] = ss->refs[i - 1U];
+	}
+
+	ss->list[i] = str;
+	ss->refs[i] = refcount;
+}
+
+static void
+os_cmd_stats_strings(struct sourceinfo *const restrict si, const int parc, char **const restrict parv)
+{
+	struct strshare_stats st;
+	struct os_stats_strings ss;
+	unsigned int limit = OS_STATS_STRINGS_DEF;
+
+	if (parc > 0 && (! string_to_uint(parv[0], &limit) || ! limit))
+	{
+		(void) command_fail(si, fault_badparams, STR_INVALID_PARAMS, "STATS STRINGS");
+		(void) command_fail(si, fault_badparams, _("Syntax: STATS STRINGS [count]"));
+		return;
+	}
+
+	if (limit > OS_STATS_STRINGS_MAX)
+		limit = OS_STATS_STRINGS_MAX;
+
+	(void) strshare_get_stats(&st);
+
+	(void) command_success_nodata(si, _("Shared strings: %zu, with %zu references (%zu slots in the table)"),
+	                              st.unique, st.refs, st.table_size);
+	(void) command_success_nodata(si, _("Memory: %zu KB held, %zu KB saved over one copy per reference"),
+	                              st.bytes / 1024U, st.saved / 1024U);
+
+	ss.list = smalloc(limit * sizeof *ss.list);
+	ss.refs = smalloc(limit * sizeof *ss.refs);
+	ss.limit = limit;
+	ss.count = 0;
+
+	(void) strshare_foreach(&os_stats_strings_cb, &ss);
+
+	if (ss.count)
+	{
+		(void) command_success_nodata(si, " ");
+		(void) command_success_nodata(si, "%-*s %9s %9s", (int) OS_STATS_STRINGS_WIDTH, _("String"), _("Refs"),
+		                              _("Saved B"));
+
+		for (unsigned int i = 0; i < ss.count; i++)
+			(void) command_success_nodata(si, "%-*.*s %9u %9zu", (int) OS_STATS_STRINGS_WIDTH,
+			                              (int) OS_STATS_STRINGS_WIDTH, ss.list[i], ss.refs[i],
+			                              os_stats_string_saved(ss.list[i], ss.refs[i]));
+	}
+
+	(void) logcommand(si, CMDLOG_GET, "STATS: \2STRINGS\2");
+
+	(void) sfree(ss.list);
+	(void) sfree(ss.refs);
+}
+
+static void
+os_cmd_stats_func(struct sourceinfo *const restrict si, const int parc, char **const restrict parv)
+{
+	if (parc < 1)
+	{
+		(void) command_fail(si, fault_needmoreparams, STR_INSUFFICIENT_PARAMS, "STATS");
+		(void) command_fail(si, fault_needmoreparams, _("Syntax: %s"), OS_STATS_SYNTAX);
+		return;
+	}
+
+	if (! strcasecmp(parv[0], "COMMANDS"))
+	{
+		(void) os_cmd_stats_commands(si, parc - 1, parv + 1);
+		return;
+	}
+
+	if (! strcasecmp(parv[0], "TIMERS"))
+	{
+		(void) os_cmd_stats_timers(si, parc - 1, parv + 1);
+		return;
+	}
+
+	if (! strcasecmp(parv[0], "HOOKS"))
+	{
+		(void) os_cmd_stats_hooks(si, parc - 1, parv + 1);
+		return;
+	}
+
+	if (! strcasecmp(parv[0], "LANES"))
+	{
+		(void) os_cmd_stats_lanes(si);
+		return;
+	}
+
+	if (! strcasecmp(parv[0], "MEMORY"))
+	{
+		(void) os_cmd_stats_memory(si, parc - 1, parv + 1);
+		return;
+	}
+
+	if (! strcasecmp(parv[0], "MODES"))
+	{
+		(void) os_cmd_stats_modes(si);
+		return;
+	}
+
+	if (! strcasecmp(parv[0], "STARTUP"))
+	{
+		(void) os_cmd_stats_startup(si, parc - 1, parv + 1);
+		return;
+	}
+
+	if (! strcasecmp(parv[0], "STRINGS"))
+	{
+		(void) os_cmd_stats_strings(si, parc - 1, parv + 1);
+		return;
+	}
+
+	(void) command_fail(si, fault_badparams, STR_INVALID_PARAMS, "STATS");
+	(void) command_fail(si, fault_badparams, _("Syntax: %s"), OS_STATS_SYNTAX);
+}
+
+static struct command os_cmd_stats = {
+	.name           = "STATS",
+	.desc           = N_("Shows services performance statistics."),
+	.access         = PRIV_SERVER_AUSPEX,
+	.maxparc        = 3,
+	.cmd            = &os_cmd_stats_func,
+	.help           = { .path = "oservice/stats" },
+};
+
+static void
+mod_init(struct module *const restrict m)
+{
+	MODULE_TRY_REQUEST_DEPENDENCY(m, "operserv/main")
+
+	(void) service_named_bind_command("operserv", &os_cmd_stats);
+}
+
+static void
+mod_deinit(const enum module_unload_intent ATHEME_VATTR_UNUSED intent)
+{
+	(void) service_named_unbind_command("operserv", &os_cmd_stats);
+}
+
+SIMPLE_DECLARE_MODULE_V1("operserv/stats", MODULE_UNLOAD_CAPABILITY_OK)
@@ -309,7 +309,7 @@ check_hidehost(struct user *u)
 	if (!(u->flags & UF_HIDEHOSTREQ) || u->myuser == NULL || (u->myuser->flags & MU_WAITAUTH))
 		return;
 	// don't use this if they have some other kind of vhost
-	if (strcmp(u->host, u->vhost))
+	if (u->host != u->vhost)
 	{
 		slog(LG_DEBUG, "check_hidehost(): +x overruled by other vhost for %s", u->nick);
 		return;
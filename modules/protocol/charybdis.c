@@ -165,107 +165,154 @@ extgecos_match(const char *mask, struct user *u)
 	char hostgbuf[NICKLEN + 1 + USERLEN + 1 + HOSTLEN + 1 + GECOSLEN + 1];
 	char realgbuf[NICKLEN + 1 + USERLEN + 1 + HOSTLEN + 1 + GECOSLEN + 1];
 
-	snprintf(hostgbuf, sizeof hostgbuf, "%s!%s@%s#%s", u->nick, u->user, u->vhost, u->gecos);
-	snprintf(realgbuf, sizeof realgbuf, "%s!%s@%s#%s", u->nick, u->user, u->host, u->gecos);
+	snprintf(hostgbuf, sizeof hostgbuf, "%s!%s@%s#%s", u->nick, u->user, u->vhost, user_gecos(u));
+	snprintf(realgbuf, sizeof realgbuf, "%s!%s@%s#%s", u->nick, u->user, u->host, user_gecos(u));
 	return !match(mask, hostgbuf) || !match(mask, realgbuf);
 }
 
-static mowgli_node_t *
-charybdis_next_matching_ban(struct channel *c, struct user *u, int type, mowgli_node_t *first)
+// The user's host forms, built once for however many bans are then checked
+struct charybdis_ban_forms
+{
+	char            hostbuf[NICKLEN + 1 + USERLEN + 1 + HOSTLEN + 1];
+	char            realbuf[NICKLEN + 1 + USERLEN + 1 + HOSTLEN + 1];
+	char            ipbuf[NICKLEN + 1 + USERLEN + 1 + HOSTLEN + 1];
+	const char *    forms[3];
+	size_t          lens[3];
+};
+
+static void
+charybdis_ban_forms_build(struct charybdis_ban_forms *bf, struct user *u)
+{
+	snprintf(bf->hostbuf, sizeof bf->hostbuf, "%s!%s@%s", u->nick, u->user, u->vhost);
+	snprintf(bf->realbuf, sizeof bf->realbuf, "%s!%s@%s", u->nick, u->user, u->host);
+
+	// will be nick!user@ if ip unknown, doesn't matter
+	snprintf(bf->ipbuf, sizeof bf->ipbuf, "%s!%s@%s", u->nick, u->user, u->ip);
+
+	bf->forms[0] = bf->hostbuf;
+	bf->forms[1] = bf->realbuf;
+	bf->forms[2] = bf->ipbuf;
+	bf->lens[0] = strlen(bf->hostbuf);
+	bf->lens[1] = strlen(bf->realbuf);
+	bf->lens[2] = strlen(bf->ipbuf);
+}
+
+static bool
+charybdis_ban_matches(struct chanban *cb, struct user *u, const struct charybdis_ban_forms *bf)
 {
-	struct chanban *cb;
-	mowgli_node_t *n;
-	char hostbuf[NICKLEN + 1 + USERLEN + 1 + HOSTLEN + 1];
-	char realbuf[NICKLEN + 1 + USERLEN + 1 + HOSTLEN + 1];
-	char ipbuf[NICKLEN + 1 + USERLEN + 1 + HOSTLEN + 1];
 	char strippedmask[NICKLEN + 1 + USERLEN + 1 + HOSTLEN + 1 + CHANNELLEN + 3];
 	char *p;
 	bool negate, matched;
 	int exttype;
 	struct channel *target_c;
 
-	snprintf(hostbuf, sizeof hostbuf, "%s!%s@%s", u->nick, u->user, u->vhost);
-	snprintf(realbuf, sizeof realbuf, "%s!%s@%s", u->nick, u->user, u->host);
+	/*
+	 * strip any banforwards from the mask. (SRV-73)
+	 * charybdis itself doesn't support banforward but i don't feel like copying
+	 * this stuff into ircd-seven and it is possible that charybdis may support them
+	 * one day.
+	 *   --nenolod
+	 */
+	mowgli_strlcpy(strippedmask, cb->mask, sizeof strippedmask);
+	p = strrchr(strippedmask, '$');
+	if (p != NULL && p != strippedmask)
+		*p = 0;
+	else
+		p = NULL;
+
+	// the suffix is of the whole mask, so it only tells us anything when nothing was stripped
+	if ((p != NULL || chanban_may_match(cb, bf->forms, bf->lens, 3)) && (!match(strippedmask, bf->hostbuf) || !match(strippedmask, bf->realbuf) || !match(strippedmask, bf->ipbuf) || !(p != NULL ? match_cidr(strippedmask, bf->ipbuf) : match_cidr_parsed(cb->mask, &cb->cidr, bf->ipbuf, &u->ipaddr))))
+		return true;
+	if (strippedmask[0] != '$')
+		return false;
 
-	// will be nick!user@ if ip unknown, doesn't matter
-	snprintf(ipbuf, sizeof ipbuf, "%s!%s@%s", u->nick, u->user, u->ip);
+	p = strippedmask + 1;
+	negate = *p == '~';
+	if (negate)
+		p++;
+	exttype = *p++;
+	if (exttype == '\0')
+		return false;
+
+	// check parameter
+	if (*p++ != ':')
+		p = NULL;
+
+	switch (exttype)
+	{
+		case 'a':
+			matched = u->myuser != NULL && !(u->myuser->flags & MU_WAITAUTH) && (p == NULL || !match(p, entity(u->myuser)->name));
+			break;
+		case 'c':
+			if (p == NULL)
+				return false;
+			target_c = channel_find(p);
+			if (target_c == NULL || (target_c->modes & (CMODE_PRIV | CMODE_SEC)))
+				return false;
+			matched = chanuser_find(target_c, u) != NULL;
+			break;
+		case 'o':
+			matched = is_ircop(u);
+			break;
+		case 'r':
+			if (p == NULL)
+				return false;
+			matched = !match(p, user_gecos(u));
+			break;
+		case 's':
+			if (p == NULL)
+				return false;
+			matched = !match(p, u->server->name);
+			break;
+		case 'x':
+			if (p == NULL)
+				return false;
+			matched = extgecos_match(p, u);
+			break;
+		default:
+			return false;
+	}
+
+	return negate ^ matched;
+}
+
+static mowgli_node_t *
+charybdis_next_matching_ban(struct channel *c, struct user *u, int type, mowgli_node_t *first)
+{
+	struct charybdis_ban_forms bf;
+	mowgli_node_t *n;
+
+	charybdis_ban_forms_build(&bf, u);
 
 	MOWGLI_ITER_FOREACH(n, first)
 	{
-		cb = n->data;
-
-		if (cb->type != type)
-			continue;
-
-		/*
-		 * strip any banforwards from the mask. (SRV-73)
-		 * charybdis itself doesn't support banforward but i don't feel like copying
-		 * this stuff into ircd-seven and it is possible that charybdis may support them
-		 * one day.
-		 *   --nenolod
-		 */
-		mowgli_strlcpy(strippedmask, cb->mask, sizeof strippedmask);
-		p = strrchr(strippedmask, '$');
-		if (p != NULL && p != strippedmask)
-			*p = 0;
-
-		if ((!match(strippedmask, hostbuf) || !match(strippedmask, realbuf) || !match(strippedmask, ipbuf) || !match_cidr(strippedmask, ipbuf)))
+		struct chanban *cb = n->data;
+
+		if (cb->type == type && charybdis_ban_matches(cb, u, &bf))
 			return n;
-		if (strippedmask[0] == '$')
-		{
-			p = strippedmask + 1;
-			negate = *p == '~';
-			if (negate)
-				p++;
-			exttype = *p++;
-			if (exttype == '\0')
-				continue;
-
-			// check parameter
-			if (*p++ != ':')
-				p = NULL;
-
-			switch (exttype)
-			{
-				case 'a':
-					matched = u->myuser != NULL && !(u->myuser->flags & MU_WAITAUTH) && (p == NULL || !match(p, entity(u->myuser)->name));
-					break;
-				case 'c':
-					if (p == NULL)
-						continue;
-					target_c = channel_find(p);
-					if (target_c == NULL || (target_c->modes & (CMODE_PRIV | CMODE_SEC)))
-						continue;
-					matched = chanuser_find(target_c, u) != NULL;
-					break;
-				case 'o':
-					matched = is_ircop(u);
-					break;
-				case 'r':
-					if (p == NULL)
-						continue;
-					matched = !match(p, u->gecos);
-					break;
-				case 's':
-					if (p == NULL)
-						continue;
-					matched = !match(p, u->server->name);
-					break;
-				case 'x':
-					if (p == NULL)
-						continue;
-					matched = extgecos_match(p, u);
-					break;
-				default:
-					continue;
-			}
-			if (negate ^ matched)
-				return n;
-		}
 	}
 	return NULL;
 }
 
+static size_t
+charybdis_matching_bans(struct channel *c, struct user *u, const char *types, struct chanban **bans)
+{
+	struct charybdis_ban_forms bf;
+	mowgli_node_t *n;
+	size_t count = 0;
+
+	charybdis_ban_forms_build(&bf, u);
+
+	MOWGLI_ITER_FOREACH(n, c->bans.head)
+	{
+		struct chanban *cb = n->data;
+
+		if (cb->type != 0 && strchr(types, cb->type) != NULL && charybdis_ban_matches(cb, u, &bf))
+			bans[count++] = cb;
+	}
+	return count;
+}
+
 static bool
 charybdis_is_valid_host(const char *host)
 {
@@ -321,6 +368,7 @@ mod_init(struct module *const restrict m)
 	notice_channel_sts = &charybdis_notice_channel_sts;
 
 	next_matching_ban = &charybdis_next_matching_ban;
+	matching_bans = &charybdis_matching_bans;
 	is_valid_host = &charybdis_is_valid_host;
 	is_extban = &charybdis_is_extban;
 
@@ -93,8 +93,8 @@ extgecos_match(const char *mask, struct user *u)
 	char hostgbuf[NICKLEN + 1 + USERLEN + 1 + HOSTLEN + 1 + GECOSLEN + 1];
 	char realgbuf[NICKLEN + 1 + USERLEN + 1 + HOSTLEN + 1 + GECOSLEN + 1];
 
-	snprintf(hostgbuf, sizeof hostgbuf, "%s!%s@%s#%s", u->nick, u->user, u->vhost, u->gecos);
-	snprintf(realgbuf, sizeof realgbuf, "%s!%s@%s#%s", u->nick, u->user, u->host, u->gecos);
+	snprintf(hostgbuf, sizeof hostgbuf, "%s!%s@%s#%s", u->nick, u->user, u->vhost, user_gecos(u));
+	snprintf(realgbuf, sizeof realgbuf, "%s!%s@%s#%s", u->nick, u->user, u->host, user_gecos(u));
 	return !match(mask, hostgbuf) || !match(mask, realgbuf);
 }
 
@@ -143,6 +143,9 @@ chatircd_next_matching_ban(struct channel *c, struct user *u, int type, mowgli_n
 	// will be nick!user@ if ip unknown, doesn't matter
 	snprintf(ipbuf, sizeof ipbuf, "%s!%s@%s", u->nick, u->user, u->ip);
 
+	const char *const forms[] = { hostbuf, realbuf, ipbuf };
+	const size_t lens[] = { strlen(hostbuf), strlen(realbuf), strlen(ipbuf) };
+
 	MOWGLI_ITER_FOREACH(n, first)
 	{
 		cb = n->data;
@@ -160,8 +163,11 @@ chatircd_next_matching_ban(struct channel *c, struct user *u, int type, mowgli_n
 		p = strrchr(strippedmask, '$');
 		if (p != NULL && p != strippedmask)
 			*p = 0;
+		else
+			p = NULL;
 
-		if ((!match(strippedmask, hostbuf) || !match(strippedmask, realbuf) || !match(strippedmask, ipbuf) || !match_cidr(strippedmask, ipbuf)))
+		// the suffix is of the whole mask, so it only tells us anything when nothing was stripped
+		if ((p != NULL || chanban_may_match(cb, forms, lens, 3)) && (!match(strippedmask, hostbuf) || !match(strippedmask, realbuf) || !match(strippedmask, ipbuf) || !(p != NULL ? match_cidr(strippedmask, ipbuf) : match_cidr_parsed(cb->mask, &cb->cidr, ipbuf, &u->ipaddr))))
 			return n;
 		if (strippedmask[0] == '$')
 		{
@@ -196,7 +202,7 @@ chatircd_next_matching_ban(struct channel *c, struct user *u, int type, mowgli_n
 				case 'r':
 					if (p == NULL)
 						continue;
-					matched = !match(p, u->gecos);
+					matched = !match(p, user_gecos(u));
 					break;
 				case 'u':
 					if (p == NULL)
@@ -252,6 +258,7 @@ mod_init(struct module *const restrict m)
 	MODULE_TRY_REQUEST_DEPENDENCY(m, "protocol/charybdis")
 
 	next_matching_ban = &chatircd_next_matching_ban;
+	matching_bans = &generic_matching_bans;
 	is_extban = &chatircd_is_extban;
 
 	mode_list = chatircd_mode_list;
@@ -125,6 +125,9 @@ inspircd_next_matching_ban(struct channel *c, struct user *u, int type, mowgli_n
 	// will be nick!user@ if ip unknown, doesn't matter
 	snprintf(ipbuf, sizeof ipbuf, "%s!%s@%s", u->nick, u->user, u->ip);
 
+	const char *const forms[] = { hostbuf, realbuf, ipbuf };
+	const size_t lens[] = { strlen(hostbuf), strlen(realbuf), strlen(ipbuf) };
+
 	MOWGLI_ITER_FOREACH(n, first)
 	{
 		struct channel *target_c;
@@ -134,7 +137,7 @@ inspircd_next_matching_ban(struct channel *c, struct user *u, int type, mowgli_n
 		if (cb->type != type)
 			continue;
 
-		if ((!match(cb->mask, hostbuf) || !match(cb->mask, realbuf) || !match(cb->mask, ipbuf)) || !match_cidr(cb->mask, ipbuf))
+		if (chanban_may_match(cb, forms, lens, 3) && ((!match(cb->mask, hostbuf) || !match(cb->mask, realbuf) || !match(cb->mask, ipbuf)) || !match_cidr_parsed(cb->mask, &cb->cidr, ipbuf, &u->ipaddr)))
 			return n;
 
 		if (cb->mask[1] == ':' && strchr("MRUjrm", cb->mask[0]))
@@ -165,7 +168,7 @@ inspircd_next_matching_ban(struct channel *c, struct user *u, int type, mowgli_n
 			case 'r':
 				if (p == NULL)
 					continue;
-				matched = !match(p, u->gecos);
+				matched = !match(p, user_gecos(u));
 				break;
 			case 'm':
 				matched = (!match(p, hostbuf) || !match(p, realbuf) || !match(p, ipbuf)) || !match_cidr(p, ipbuf);
@@ -328,7 +331,18 @@ static struct extmode inspircd_ignore_mode_list[] = {
 static void
 inspircd_send_fjoin(struct channel *c, struct user *u, char *modes)
 {
-	sts(":%s FJOIN %s %lu %s :o,%s", me.numeric, c->name, (unsigned long)c->ts, modes, u->uid);
+	struct sendq_line l;
+
+	if (!sts_begin(&l, me.numeric))
+		return;
+
+	sts_word(&l, "FJOIN");
+	sts_word(&l, c->name);
+	sts_time(&l, c->ts);
+	sts_word(&l, modes);
+	sts_word(&l, ":o,");
+	sendq_line_str(&l, u->uid);
+	sts_end(&l);
 }
 
 static unsigned int
@@ -365,8 +379,30 @@ inspircd_introduce_nick(struct user *u)
 	// :penguin.omega.org.za UID 497AAAAAB 1188302517 OperServ 127.0.0.1 127.0.0.1 OperServ +s 127.0.0.1 :Operator Server
 	const char *umode = user_get_umodestr(u);
 	const bool send_oper = (is_ircop(u) && !has_servprotectmod);
+	struct sendq_line l;
+
+	if (!sts_begin(&l, me.numeric))
+		return;
+
+	sts_word(&l, "UID");
+	sts_word(&l, u->uid);
+	sts_time(&l, u->ts);
+	sts_word(&l, u->nick);
+	sts_word(&l, u->host);
+	sts_word(&l, u->host);
+	sts_word(&l, u->user);
+	sts_word(&l, "0.0.0.0");
+	sts_time(&l, u->ts);
+	sts_word(&l, umode);
+	if (send_oper && has_hideopermod)
+		sendq_line_char(&l, 'H');
+	if (has_hidechansmod)
+		sendq_line_char(&l, 'I');
+	if (has_servprotectmod)
+		sendq_line_char(&l, 'k');
+	sts_trailing(&l, user_gecos(u));
+	sts_end(&l);
 
-	sts(":%s UID %s %lu %s %s %s %s 0.0.0.0 %lu %s%s%s%s :%s", me.numeric, u->uid, (unsigned long)u->ts, u->nick, u->host, u->host, u->user, (unsigned long)u->ts, umode, (send_oper && has_hideopermod) ? "H" : "", has_hidechansmod ? "I" : "", has_servprotectmod ? "k" : "", u->gecos);
 	if (send_oper)
 		sts(":%s OPERTYPE Service", u->uid);
 }
@@ -589,6 +625,7 @@ static void
 inspircd_mode_sts(char *sender, struct channel *target, char *modes)
 {
 	struct user *sender_p;
+	struct sendq_line l;
 
 	return_if_fail(sender != NULL);
 	return_if_fail(target != NULL);
@@ -598,7 +635,14 @@ inspircd_mode_sts(char *sender, struct channel *target, char *modes)
 
 	return_if_fail(sender_p != NULL);
 
-	sts(":%s FMODE %s %lu %s", sender_p->uid, target->name, (unsigned long)target->ts, modes);
+	if (!sts_begin(&l, sender_p->uid))
+		return;
+
+	sts_word(&l, "FMODE");
+	sts_word(&l, target->name);
+	sts_time(&l, target->ts);
+	sts_word(&l, modes);
+	sts_end(&l);
 }
 
 static void
@@ -894,28 +938,34 @@ m_notice(struct sourceinfo *si, int parc, char *parv[])
 	handle_message(si, parv[0], true, parv[1]);
 }
 
-static void
-map_a_prefix(char prefix, char* prefixandnick, unsigned int *nlen)
+/* The status modes of an FJOIN member, from its mode letters ("vh" in
+ * "vh,0F8XXXXN"); letters that have no prefix here (modules can add their
+ * own) are ignored.
+ */
+static unsigned int
+inspircd_fjoin_modes(const char *p, const char *end)
 {
+	unsigned int modes = 0;
 	size_t j, k;
 
-	// does this char match a known prefix?
-	for (j = 0; status_mode_list[j].mode; j++)
+	for (; p < end; p++)
 	{
-		// yup. add it to the 'final' combination (@%w00t)
-		if (prefix == status_mode_list[j].mode)
-		{
-			for (k = 0; prefix_mode_list[k].mode; k++)
+		for (j = 0; status_mode_list[j].mode; j++)
+			if (*p == status_mode_list[j].mode)
+				break;
+
+		if (!status_mode_list[j].mode)
+			continue;
+
+		for (k = 0; prefix_mode_list[k].mode; k++)
+			if (status_mode_list[j].value == prefix_mode_list[k].value)
 			{
-				if (status_mode_list[j].value == prefix_mode_list[k].value)
-				{
-					prefixandnick[*nlen] = prefix_mode_list[k].mode;
-					(*nlen)++;
-					return;
-				}
+				modes |= status_mode_list[j].value;
+				break;
 			}
-		}
 	}
+
+	return modes;
 }
 
 static void
@@ -923,13 +973,10 @@ m_fjoin(struct sourceinfo *si, int parc, char *parv[])
 {
 	// :08X FJOIN #flaps 1234 +nt vh,0F8XXXXN ,08XGH75C ,001CCCC3 aq,00ABBBB1
 	struct channel *c;
-	unsigned int userc;
-	unsigned int i;
-	unsigned int nlen;
-	bool prefix = true;
 	bool keep_new_modes = true;
-	char *userv[256];
-	char prefixandnick[51];
+	struct chanuser_add_entry batch[CHANUSER_ADD_BATCH];
+	unsigned int batchc = 0;
+	char *p, *next, *comma;
 	time_t ts;
 
 	c = channel_find(parv[0]);
@@ -985,59 +1032,36 @@ m_fjoin(struct sourceinfo *si, int parc, char *parv[])
 	 * can add their own prefixes (dangerous!) - therefore, don't just chanuser_add(), split the prefix
 	 * out and ignore unknown prefixes (probably the safest option). --w00t
 	 */
-	userc = sjtoken(parv[parc - 1], ' ', userv);
-
 	if (keep_new_modes)
 	{
 		channel_mode(NULL, c, parc - 3, parv + 2);
 	}
 
-	// loop over all the users in this fjoin
-	for (i = 0; i < userc; i++)
+	// the members are cut out of the line in place and added a batch at a time
+	for (p = parv[parc - 1]; p != NULL; p = next)
 	{
-		nlen = 0;
-		prefix = true;
+		if ((next = strchr(p, ' ')) != NULL)
+			*next++ = '\0';
 
-		slog(LG_DEBUG, "m_fjoin(): processing user: %s", userv[i]);
-
-		/* ok, now look at the chars in the nick.. we have something like "@%,w00t", but need @%w00t.. and
-		 * we also want to ignore unknown prefixes.. loop through the chars
-		 */
-		for (; *userv[i]; userv[i]++)
-		{
-			map_a_prefix(*userv[i], prefixandnick, &nlen);
+		slog(LG_DEBUG, "m_fjoin(): processing user: %s", p);
 
-			// it's not a known prefix char, have we reached the end of the prefixes?
-			if (*userv[i] == ',')
-			{
-				// yup, skip over the comma
-				userv[i]++;
+		// "modes,UID"; a member without the comma is a desync, skip it
+		if ((comma = strchr(p, ',')) == NULL || comma[1] == '\0')
+			continue;
 
-				// if we're ignoring status (keep_new_modes is false) then just add them to chan here...
-				if (keep_new_modes == false)
-				{
-					// This ignores the @%, and just adds 'w00t' to the chan
-					chanuser_add(c, userv[i]);
-				}
-				else
-				{
-					// else, we do care about their prefixes.. add '@%w00t' to the chan
-					mowgli_strlcpy(prefixandnick + nlen, userv[i], sizeof(prefixandnick) - nlen);
-					chanuser_add(c, prefixandnick);
-				}
+		// if we're ignoring status (keep_new_modes is false) then just add them to chan
+		batch[batchc].modes = keep_new_modes ? inspircd_fjoin_modes(p, comma) : 0;
+		batch[batchc].name = comma + 1;
 
-				// added them.. break out of this loop, which will move us to the next user
-				break;
-			}
-			else
-			{
-				// unknown prefix char
-			}
+		if (++batchc == CHANUSER_ADD_BATCH)
+		{
+			chanuser_add_many(c, batch, batchc);
+			batchc = 0;
 		}
-
-		// go to the next user
 	}
 
+	chanuser_add_many(c, batch, batchc);
+
 	if (c->nummembers == 0 && !(c->modes & ircd->perm_mode))
 		channel_delete(c);
 }
@@ -1129,10 +1153,9 @@ inspircd_user_mode(struct user *u, const char *modes)
 					 * This only occurs when a user is introduced after a netmerge with their
 					 * vhost instead of their cloaked host. - Adam
 					 */
-					if (strcmp(u->vhost, u->chost))
+					if (strcmp(u->vhost, user_chost(u)))
 					{
-						strshare_unref(u->chost);
-						u->chost = strshare_get(u->vhost);
+						user_set_chost(u, u->vhost);
 					}
 				}
 				break;
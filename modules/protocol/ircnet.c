@@ -94,7 +94,7 @@ void ircnet_introduce_nick(struct user *u)
 {
 	const char *umode = user_get_umodestr(u);
 
-	sts(":%s UNICK %s %s %s %s 0.0.0.0 %s :%s", me.numeric, u->nick, u->uid, u->user, u->host, umode, u->gecos);
+	sts(":%s UNICK %s %s %s %s 0.0.0.0 %s :%s", me.numeric, u->nick, u->uid, u->user, u->host, umode, user_gecos(u));
 }
 
 static void
@@ -140,6 +140,41 @@ ircnet_kick(struct user *source, struct channel *c, struct user *u, const char *
 	chanuser_delete(c, u);
 }
 
+/* KICK takes a comma-separated list of nicks, so a batch goes out in as
+ * many lines as it takes to fit them */
+static void
+ircnet_kick_batch_sts(struct user *source, struct channel *c, struct user **users, size_t count, const char *reason)
+{
+	const char *from = source != NULL && chanuser_find(c, source) ? CLIENT_NAME(source) : ME;
+	char names[BUFSIZE];
+	size_t room, i = 0, j, k;
+
+	// what a line has left for the nicks
+	room = strlen(from) + strlen(c->name) + strlen(reason) + 10;
+	room = room < 400 ? 510 - room : 0;
+
+	while (i < count)
+	{
+		mowgli_strlcpy(names, CLIENT_NAME(users[i]), sizeof names);
+
+		for (j = i + 1; j < count; j++)
+		{
+			if (strlen(names) + 1 + strlen(CLIENT_NAME(users[j])) > room)
+				break;
+
+			mowgli_strlcat(names, ",", sizeof names);
+			mowgli_strlcat(names, CLIENT_NAME(users[j]), sizeof names);
+		}
+
+		sts(":%s KICK %s %s :%s", from, c->name, names, reason);
+
+		for (k = i; k < j; k++)
+			chanuser_delete(c, users[k]);
+
+		i = j;
+	}
+}
+
 static void ATHEME_FATTR_PRINTF(3, 4)
 ircnet_msg(const char *from, const char *target, const char *fmt, ...)
 {
@@ -761,6 +796,7 @@ mod_init(struct module *const restrict m)
 	quit_sts = &ircnet_quit_sts;
 	join_sts = &ircnet_join_sts;
 	kick = &ircnet_kick;
+	kick_batch_sts = &ircnet_kick_batch_sts;
 	msg = &ircnet_msg;
 	msg_global_sts = &ircnet_msg_global_sts;
 	notice_user_sts = &ircnet_notice_user_sts;
@@ -150,7 +150,7 @@ check_hidehost(struct user *u)
 		return;
 
 	// don't use this if they have some other kind of vhost
-	if (strcmp(u->host, u->vhost))
+	if (u->host != u->vhost)
 	{
 		slog(LG_DEBUG, "check_hidehost(): +x overruled by other vhost for %s", u->nick);
 		return;
@@ -104,7 +104,7 @@ ngircd_introduce_nick(struct user *u)
 {
 	const char *umode = user_get_umodestr(u);
 
-	sts(":%s NICK %s 1 %s %s 1 %s :%s", me.name, u->nick, u->user, u->host, umode, u->gecos);
+	sts(":%s NICK %s 1 %s %s 1 %s :%s", me.name, u->nick, u->user, u->host, umode, user_gecos(u));
 }
 
 static void
@@ -146,6 +146,41 @@ ngircd_kick(struct user *source, struct channel *c, struct user *u, const char *
 	chanuser_delete(c, u);
 }
 
+/* KICK takes a comma-separated list of nicks, so a batch goes out in as
+ * many lines as it takes to fit them */
+static void
+ngircd_kick_batch_sts(struct user *source, struct channel *c, struct user **users, size_t count, const char *reason)
+{
+	const char *from = CLIENT_NAME(source);
+	char names[BUFSIZE];
+	size_t room, i = 0, j, k;
+
+	// what a line has left for the nicks
+	room = strlen(from) + strlen(c->name) + strlen(reason) + 10;
+	room = room < 400 ? 510 - room : 0;
+
+	while (i < count)
+	{
+		mowgli_strlcpy(names, CLIENT_NAME(users[i]), sizeof names);
+
+		for (j = i + 1; j < count; j++)
+		{
+			if (strlen(names) + 1 + strlen(CLIENT_NAME(users[j])) > room)
+				break;
+
+			mowgli_strlcat(names, ",", sizeof names);
+			mowgli_strlcat(names, CLIENT_NAME(users[j]), sizeof names);
+		}
+
+		sts(":%s KICK %s %s :%s", from, c->name, names, reason);
+
+		for (k = i; k < j; k++)
+			chanuser_delete(c, users[k]);
+
+		i = j;
+	}
+}
+
 static void ATHEME_FATTR_PRINTF(3, 4)
 ngircd_msg(const char *from, const char *target, const char *fmt, ...)
 {
@@ -323,19 +358,15 @@ ngircd_sethost_sts(struct user *source, struct user *target, const char *host)
 		sts(":%s METADATA %s cloakhost :%s", me.name, target->nick, host);
 		sts(":%s MODE %s +x", me.name, target->nick);
 
-		if (strcmp(host, target->chost))
-		{
-			strshare_unref(target->chost);
-			target->chost = strshare_get(host);
-		}
+		if (strcmp(host, user_chost(target)))
+			user_set_chost(target, host);
 	}
 	else
 	{
 		sts(":%s MODE %s -x", me.name, target->nick);
 		sts(":%s METADATA %s cloakhost :", me.name, target->nick);
 
-		strshare_unref(target->chost);
-		target->chost = strshare_get(target->host);
+		user_set_chost(target, target->host);
 	}
 }
 
@@ -591,13 +622,13 @@ ngircd_user_mode(struct user *u, const char *modes)
 			case '-': dir = MTYPE_DEL; break;
 			case '+': dir = MTYPE_ADD; break;
 			case 'x':
-				slog(LG_DEBUG, "user had vhost='%s' chost='%s'", u->vhost, u->chost);
+				slog(LG_DEBUG, "user had vhost='%s' chost='%s'", u->vhost, user_chost(u));
 				if (dir == MTYPE_ADD)
 				{
-					if (strcmp(u->vhost, u->chost))
+					if (strcmp(u->vhost, user_chost(u)))
 					{
 						strshare_unref(u->vhost);
-						u->vhost = strshare_get(u->chost);
+						u->vhost = strshare_get(user_chost(u));
 					}
 				}
 				else if (dir == MTYPE_DEL)
@@ -605,7 +636,7 @@ ngircd_user_mode(struct user *u, const char *modes)
 					strshare_unref(u->vhost);
 					u->vhost = strshare_get(u->host);
 				}
-				slog(LG_DEBUG, "user got vhost='%s' chost='%s'", u->vhost, u->chost);
+				slog(LG_DEBUG, "user got vhost='%s' chost='%s'", u->vhost, user_chost(u));
 				break;
 		}
 }
@@ -850,8 +881,7 @@ m_metadata(struct sourceinfo *si, int parc, char *parv[])
 	}
 	else if (!strcmp(parv[1], "cloakhost"))
 	{
-		strshare_unref(u->chost);
-		u->chost = strshare_get(parv[2]);
+		user_set_chost(u, parv[2]);
 	}
 }
 
@@ -885,6 +915,7 @@ mod_init(struct module *const restrict m)
 	quit_sts = &ngircd_quit_sts;
 	join_sts = &ngircd_join_sts;
 	kick = &ngircd_kick;
+	kick_batch_sts = &ngircd_kick_batch_sts;
 	msg = &ngircd_msg;
 	msg_global_sts = &ngircd_msg_global_sts;
 	notice_user_sts = &ngircd_notice_user_sts;
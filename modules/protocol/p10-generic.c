@@ -38,8 +38,25 @@ static void
 p10_introduce_nick(struct user *u)
 {
 	const char *umode = user_get_umodestr(u);
+	struct sendq_line l;
 
-	sts("%s N %s 1 %lu %s %s %sk ]]]]]] %s :%s", me.numeric, u->nick, (unsigned long)u->ts, u->user, u->host, umode, u->uid, u->gecos);
+	// P10 sources carry no colon
+	if (!sts_begin(&l, NULL))
+		return;
+
+	sts_word(&l, me.numeric);
+	sts_word(&l, "N");
+	sts_word(&l, u->nick);
+	sts_word(&l, "1");
+	sts_time(&l, u->ts);
+	sts_word(&l, u->user);
+	sts_word(&l, u->host);
+	sts_word(&l, umode);
+	sendq_line_char(&l, 'k');
+	sts_word(&l, "]]]]]]");
+	sts_word(&l, u->uid);
+	sts_trailing(&l, user_gecos(u));
+	sts_end(&l);
 }
 
 static void
@@ -61,30 +78,126 @@ p10_wallops_sts(const char *text)
 	sts("%s WA :%s", me.numeric, text);
 }
 
+// source M channel modes
+static void
+p10_send_mode(const char *source, struct channel *c, const char *modes)
+{
+	struct sendq_line l;
+
+	if (!sts_begin(&l, NULL))
+		return;
+
+	sts_word(&l, source);
+	sts_word(&l, "M");
+	sts_word(&l, c->name);
+	sts_word(&l, modes);
+	sts_end(&l);
+}
+
 static void
 p10_join_sts(struct channel *c, struct user *u, bool isnew, char *modes)
 {
+	struct sendq_line l;
+
+	if (!sts_begin(&l, NULL))
+		return;
+
 	// If the channel doesn't exist, we need to create it.
-	if (isnew)
+	sts_word(&l, u->uid);
+	sts_word(&l, isnew ? "C" : "J");
+	sts_word(&l, c->name);
+	sts_time(&l, c->ts);
+	sts_end(&l);
+
+	if (!isnew)
 	{
-		sts("%s C %s %lu", u->uid, c->name, (unsigned long)c->ts);
-		if (modes[0] && modes[1])
-			sts("%s M %s %s", u->uid, c->name, modes);
+		if (!sts_begin(&l, NULL))
+			return;
+
+		sts_word(&l, me.numeric);
+		sts_word(&l, "M");
+		sts_word(&l, c->name);
+		sts_word(&l, "+o");
+		sts_word(&l, u->uid);
+		sts_end(&l);
 	}
-	else
+	else if (modes[0] && modes[1])
+		p10_send_mode(u->uid, c, modes);
+}
+
+/* C and J take a list of channels sharing a TS */
+static void
+p10_join_batch_sts(struct user *u, struct channel **chans, const bool *isnew, size_t count)
+{
+	struct sendq_line l;
+	char names[BUFSIZE];
+	char *modes;
+	size_t i = 0, j, k;
+
+	while (i < count)
 	{
-		sts("%s J %s %lu", u->uid, c->name, (unsigned long)c->ts);
-		sts("%s M %s +o %s", me.numeric, c->name, u->uid);
+		mowgli_strlcpy(names, chans[i]->name, sizeof names);
+
+		for (j = i + 1; j < count && isnew[j] == isnew[i] && chans[j]->ts == chans[i]->ts; j++)
+		{
+			if (strlen(names) + 1 + strlen(chans[j]->name) > 400)
+				break;
+
+			mowgli_strlcat(names, ",", sizeof names);
+			mowgli_strlcat(names, chans[j]->name, sizeof names);
+		}
+
+		if (!sts_begin(&l, NULL))
+			return;
+
+		sts_word(&l, u->uid);
+		sts_word(&l, isnew[i] ? "C" : "J");
+		sts_word(&l, names);
+		sts_time(&l, chans[i]->ts);
+		sts_end(&l);
+
+		for (k = i; k < j; k++)
+		{
+			if (!isnew[k])
+			{
+				if (!sts_begin(&l, NULL))
+					return;
+
+				sts_word(&l, me.numeric);
+				sts_word(&l, "M");
+				sts_word(&l, chans[k]->name);
+				sts_word(&l, "+o");
+				sts_word(&l, u->uid);
+				sts_end(&l);
+			}
+			else if ((modes = channel_modes(chans[k], true))[0] && modes[1])
+				p10_send_mode(u->uid, chans[k], modes);
+		}
+
+		i = j;
 	}
 }
 
 static void
 p10_chan_lowerts(struct channel *c, struct user *u)
 {
+	struct sendq_line l;
+
 	slog(LG_DEBUG, "p10_chan_lowerts(): lowering TS for %s to %lu",
 			c->name, (unsigned long)c->ts);
-	sts("%s B %s %lu %s %s:o", me.numeric, c->name, (unsigned long)c->ts,
-			channel_modes(c, true), u->uid);
+
+	if (sts_begin(&l, NULL))
+	{
+		sts_word(&l, me.numeric);
+		sts_word(&l, "B");
+		sts_word(&l, c->name);
+		sts_time(&l, c->ts);
+		sts_word(&l, channel_modes(c, true));
+		sts_word(&l, u->uid);
+		sendq_line_str(&l, ":o");
+		sts_end(&l);
+	}
+
 	chanban_clear(c);
 }
 
@@ -280,10 +393,7 @@ p10_mode_sts(char *sender, struct channel *target, char *modes)
 
 	return_if_fail(fptr != NULL);
 
-	if (chanuser_find(target, fptr))
-		sts("%s M %s %s", fptr->uid, target->name, modes);
-	else
-		sts("%s M %s %s", me.numeric, target->name, modes);
+	p10_send_mode(chanuser_find(target, fptr) ? fptr->uid : me.numeric, target, modes);
 }
 
 static void
@@ -1010,7 +1120,7 @@ check_hidehost(struct user *u)
 	if (!(u->flags & UF_HIDEHOSTREQ) || u->myuser == NULL || (u->myuser->flags & MU_WAITAUTH))
 		return;
 	// don't use this if they have some other kind of vhost
-	if (strcmp(u->host, u->vhost))
+	if (u->host != u->vhost)
 	{
 		slog(LG_DEBUG, "check_hidehost(): +x overruled by other vhost for %s", u->nick);
 		return;
@@ -1044,6 +1154,7 @@ mod_init(struct module *const restrict m)
 	quit_sts = &p10_quit_sts;
 	wallops_sts = &p10_wallops_sts;
 	join_sts = &p10_join_sts;
+	join_batch_sts = &p10_join_batch_sts;
 	chan_lowerts = &p10_chan_lowerts;
 	kick = &p10_kick;
 	msg = &p10_msg;
@@ -102,13 +102,34 @@ static void
 ts6_introduce_nick(struct user *u)
 {
 	const char *umode = user_get_umodestr(u);
+	struct sendq_line l;
 
-	if (ircd->uses_uid && use_euid)
-		sts(":%s EUID %s 1 %lu %s %s %s 0 %s * * :%s", me.numeric, u->nick, (unsigned long)u->ts, umode, u->user, u->host, u->uid, u->gecos);
-	else if (ircd->uses_uid)
-		sts(":%s UID %s 1 %lu %s %s %s 0 %s :%s", me.numeric, u->nick, (unsigned long)u->ts, umode, u->user, u->host, u->uid, u->gecos);
+	if (!sts_begin(&l, ircd->uses_uid ? me.numeric : NULL))
+		return;
+
+	sts_word(&l, !ircd->uses_uid ? "NICK" : use_euid ? "EUID" : "UID");
+	sts_word(&l, u->nick);
+	sts_word(&l, "1");
+	sts_time(&l, u->ts);
+	sts_word(&l, umode);
+	sts_word(&l, u->user);
+	sts_word(&l, u->host);
+
+	if (ircd->uses_uid)
+	{
+		sts_word(&l, "0");
+		sts_word(&l, u->uid);
+		if (use_euid)
+		{
+			sts_word(&l, "*");
+			sts_word(&l, "*");
+		}
+	}
 	else
-		sts("NICK %s 1 %lu %s %s %s %s :%s", u->nick, (unsigned long)u->ts, umode, u->user, u->host, me.name, u->gecos);
+		sts_word(&l, me.name);
+
+	sts_trailing(&l, user_gecos(u));
+	sts_end(&l);
 }
 
 static void
@@ -129,15 +150,28 @@ ts6_wallops_sts(const char *text)
 	sts(":%s WALLOPS :%s", ME, text);
 }
 
+// :ME SJOIN ts channel modes :@user
+static void
+ts6_sjoin_sts(struct channel *c, struct user *u, const char *modes)
+{
+	struct sendq_line l;
+
+	if (!sts_begin(&l, ME))
+		return;
+
+	sts_word(&l, "SJOIN");
+	sts_time(&l, c->ts);
+	sts_word(&l, c->name);
+	sts_word(&l, modes);
+	sts_word(&l, ":@");
+	sendq_line_str(&l, CLIENT_NAME(u));
+	sts_end(&l);
+}
+
 static void
 ts6_join_sts(struct channel *c, struct user *u, bool isnew, char *modes)
 {
-	if (isnew)
-		sts(":%s SJOIN %lu %s %s :@%s", ME, (unsigned long)c->ts,
-				c->name, modes, CLIENT_NAME(u));
-	else
-		sts(":%s SJOIN %lu %s + :@%s", ME, (unsigned long)c->ts,
-				c->name, CLIENT_NAME(u));
+	ts6_sjoin_sts(c, u, isnew ? modes : "+");
 }
 
 static void
@@ -145,8 +179,7 @@ ts6_chan_lowerts(struct channel *c, struct user *u)
 {
 	slog(LG_DEBUG, "ts6_chan_lowerts(): lowering TS for %s to %lu",
 			c->name, (unsigned long)c->ts);
-	sts(":%s SJOIN %lu %s %s :@%s", ME, (unsigned long)c->ts, c->name,
-				channel_modes(c, true), CLIENT_NAME(u));
+	ts6_sjoin_sts(c, u, channel_modes(c, true));
 	if (ircd->uses_uid)
 		chanban_clear(c);
 }
@@ -398,7 +431,7 @@ ts6_topic_sts(struct channel *c, struct user *source, const char *setter, time_t
 	 */
 	if (!chanuser_find(c, source))
 	{
-		sts(":%s SJOIN %lu %s + :@%s", ME, (unsigned long)c->ts, c->name, CLIENT_NAME(source));
+		ts6_sjoin_sts(c, source, "+");
 		joined = 1;
 	}
 	sts(":%s TOPIC %s :%s", CLIENT_NAME(source), c->name, topic);
@@ -412,6 +445,7 @@ static void
 ts6_mode_sts(char *sender, struct channel *target, char *modes)
 {
 	struct user *u;
+	struct sendq_line l;
 
 	return_if_fail(sender != NULL);
 	return_if_fail(target != NULL);
@@ -421,10 +455,20 @@ ts6_mode_sts(char *sender, struct channel *target, char *modes)
 
 	return_if_fail(u != NULL);
 
+	if (!sts_begin(&l, CLIENT_NAME(u)))
+		return;
+
 	if (ircd->uses_uid)
-		sts(":%s TMODE %lu %s %s", CLIENT_NAME(u), (unsigned long)target->ts, target->name, modes);
+	{
+		sts_word(&l, "TMODE");
+		sts_time(&l, target->ts);
+	}
 	else
-		sts(":%s MODE %s %s", CLIENT_NAME(u), target->name, modes);
+		sts_word(&l, "MODE");
+
+	sts_word(&l, target->name);
+	sts_word(&l, modes);
+	sts_end(&l);
 }
 
 static void
@@ -723,11 +767,11 @@ m_sjoin(struct sourceinfo *si, int parc, char *parv[])
 
 	struct channel *c;
 	bool keep_new_modes = true;
-	unsigned int userc;
-	char *userv[256];
-	unsigned int i;
+	struct chanuser_add_entry batch[CHANUSER_ADD_BATCH];
+	unsigned int batchc = 0;
 	time_t ts;
-	char *p;
+	const char *name;
+	char *p, *next;
 
 	// :origin SJOIN ts chan modestr [key or limits] :users
 	c = channel_find(parv[1]);
@@ -789,22 +833,30 @@ m_sjoin(struct sourceinfo *si, int parc, char *parv[])
 	if (keep_new_modes)
 		channel_mode(NULL, c, parc - 3, parv + 2);
 
-	userc = sjtoken(parv[parc - 1], ' ', userv);
+	// the members are cut out of the line in place and added a batch at a time
+	for (p = parv[parc - 1]; p != NULL; p = next)
+	{
+		if ((next = strchr(p, ' ')) != NULL)
+			*next++ = '\0';
 
-	if (keep_new_modes)
-		for (i = 0; i < userc; i++)
-			chanuser_add(c, userv[i]);
-	else
-		for (i = 0; i < userc; i++)
+		name = p;
+		batch[batchc].modes = chanuser_prefix_modes(&name);
+		batch[batchc].name = name;
+
+		/* XXX for TS5 we should mark them deopped
+		 * if they were opped and drop modes from them
+		 * -- jilles */
+		if (!keep_new_modes)
+			batch[batchc].modes = 0;
+
+		if (*name != '\0' && ++batchc == CHANUSER_ADD_BATCH)
 		{
-			p = userv[i];
-			while (*p == '@' || *p == '%' || *p == '+')
-				p++;
-			/* XXX for TS5 we should mark them deopped
-			 * if they were opped and drop modes from them
-			 * -- jilles */
-			chanuser_add(c, p);
+			chanuser_add_many(c, batch, batchc);
+			batchc = 0;
 		}
+	}
+
+	chanuser_add_many(c, batch, batchc);
 
 	if (c->nummembers == 0 && !(c->modes & ircd->perm_mode))
 		channel_delete(c);
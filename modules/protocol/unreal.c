@@ -260,6 +260,9 @@ unreal_next_matching_ban(struct channel *c, struct user *u, int type, mowgli_nod
 	// will be nick!user@ if ip unknown, doesn't matter
 	snprintf(ipbuf, sizeof ipbuf, "%s!%s@%s", u->nick, u->user, u->ip);
 
+	const char *const forms[] = { hostbuf, realbuf, ipbuf };
+	const size_t lens[] = { strlen(hostbuf), strlen(realbuf), strlen(ipbuf) };
+
 	MOWGLI_ITER_FOREACH(n, first)
 	{
 		cb = n->data;
@@ -267,7 +270,7 @@ unreal_next_matching_ban(struct channel *c, struct user *u, int type, mowgli_nod
 		if (cb->type != type)
 			continue;
 
-		if ((!match(cb->mask, hostbuf) || !match(cb->mask, realbuf) || !match(cb->mask, ipbuf)))
+		if (chanban_may_match(cb, forms, lens, 3) && (!match(cb->mask, hostbuf) || !match(cb->mask, realbuf) || !match(cb->mask, ipbuf)))
 			return n;
 		if (cb->mask[0] == '~')
 		{
@@ -297,7 +300,7 @@ unreal_next_matching_ban(struct channel *c, struct user *u, int type, mowgli_nod
 				case 'r':
 					if (p == NULL)
 						continue;
-					matched = !match(p, u->gecos);
+					matched = !match(p, user_gecos(u));
 					break;
 				case 'R':
 					matched = should_reg_umode(u);
@@ -342,9 +345,9 @@ unreal_introduce_nick(struct user *u)
 	const char *umode = user_get_umodestr(u);
 
 	if (!ircd->uses_uid)
-		sts("NICK %s 1 %lu %s %s %s 0 %sS * :%s", u->nick, (unsigned long)u->ts, u->user, u->host, me.name, umode, u->gecos);
+		sts("NICK %s 1 %lu %s %s %s 0 %sS * :%s", u->nick, (unsigned long)u->ts, u->user, u->host, me.name, umode, user_gecos(u));
 	else
-		sts(":%s UID %s 1 %lu %s %s %s * %sS * * * :%s", ME, u->nick, (unsigned long)u->ts, u->user, u->host, u->uid, umode, u->gecos);
+		sts(":%s UID %s 1 %lu %s %s %s * %sS * * * :%s", ME, u->nick, (unsigned long)u->ts, u->user, u->host, u->uid, umode, user_gecos(u));
 }
 
 static void
@@ -393,6 +396,41 @@ unreal_kick(struct user *source, struct channel *c, struct user *u, const char *
 	chanuser_delete(c, u);
 }
 
+/* KICK takes a comma-separated list of nicks, so a batch goes out in as
+ * many lines as it takes to fit them */
+static void
+unreal_kick_batch_sts(struct user *source, struct channel *c, struct user **users, size_t count, const char *reason)
+{
+	const char *from = source->nick;
+	char names[BUFSIZE];
+	size_t room, i = 0, j, k;
+
+	// what a line has left for the nicks
+	room = strlen(from) + strlen(c->name) + strlen(reason) + 10;
+	room = room < 400 ? 510 - room : 0;
+
+	while (i < count)
+	{
+		mowgli_strlcpy(names, users[i]->nick, sizeof names);
+
+		for (j = i + 1; j < count; j++)
+		{
+			if (strlen(names) + 1 + strlen(users[j]->nick) > room)
+				break;
+
+			mowgli_strlcat(names, ",", sizeof names);
+			mowgli_strlcat(names, users[j]->nick, sizeof names);
+		}
+
+		sts(":%s KICK %s %s :%s", from, c->name, names, reason);
+
+		for (k = i; k < j; k++)
+			chanuser_delete(c, users[k]);
+
+		i = j;
+	}
+}
+
 static void ATHEME_FATTR_PRINTF(3, 4)
 unreal_msg(const char *from, const char *target, const char *fmt, ...)
 {
@@ -1265,10 +1303,9 @@ unreal_user_mode(struct user *u, const char *changes)
 					 * This only occurs when a user is introduced after a netmerge with their
 					 * vhost instead of their cloaked host. - Adam
 					 */
-					if (strcmp(u->vhost, u->chost))
+					if (strcmp(u->vhost, user_chost(u)))
 					{
-						strshare_unref(u->chost);
-						u->chost = strshare_get(u->vhost);
+						user_set_chost(u, u->vhost);
 					}
 				}
 				else if (dir == MTYPE_DEL)
@@ -1580,6 +1617,7 @@ mod_init(struct module *const restrict m)
 	wallops_sts = &unreal_wallops_sts;
 	join_sts = &unreal_join_sts;
 	kick = &unreal_kick;
+	kick_batch_sts = &unreal_kick_batch_sts;
 	msg = &unreal_msg;
 	msg_global_sts = &unreal_msg_global_sts;
 	notice_user_sts = &unreal_notice_user_sts;
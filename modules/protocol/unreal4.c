@@ -233,6 +233,9 @@ unreal_next_matching_ban(struct channel *c, struct user *u, int type, mowgli_nod
 	// will be nick!user@ if ip unknown, doesn't matter
 	snprintf(ipbuf, sizeof ipbuf, "%s!%s@%s", u->nick, u->user, u->ip);
 
+	const char *const forms[] = { hostbuf, realbuf, ipbuf };
+	const size_t lens[] = { strlen(hostbuf), strlen(realbuf), strlen(ipbuf) };
+
 	MOWGLI_ITER_FOREACH(n, first)
 	{
 		cb = n->data;
@@ -240,7 +243,7 @@ unreal_next_matching_ban(struct channel *c, struct user *u, int type, mowgli_nod
 		if (cb->type != type)
 			continue;
 
-		if ((!match(cb->mask, hostbuf) || !match(cb->mask, realbuf) || !match(cb->mask, ipbuf)))
+		if (chanban_may_match(cb, forms, lens, 3) && (!match(cb->mask, hostbuf) || !match(cb->mask, realbuf) || !match(cb->mask, ipbuf)))
 			return n;
 		if (cb->mask[0] == '~')
 		{
@@ -270,7 +273,7 @@ unreal_next_matching_ban(struct channel *c, struct user *u, int type, mowgli_nod
 				case 'r':
 					if (p == NULL)
 						continue;
-					matched = !match(p, u->gecos);
+					matched = !match(p, user_gecos(u));
 					break;
 				case 'R':
 					matched = should_reg_umode(u);
@@ -314,11 +317,41 @@ static void
 unreal_introduce_nick(struct user *u)
 {
 	const char *umode = user_get_umodestr(u);
+	struct sendq_line l;
+
+	if (!sts_begin(&l, ircd->uses_uid ? ME : NULL))
+		return;
+
+	sts_word(&l, ircd->uses_uid ? "UID" : "NICK");
+	sts_word(&l, u->nick);
+	sts_word(&l, "1");
+	sts_time(&l, u->ts);
+	sts_word(&l, u->user);
+	sts_word(&l, u->host);
 
-	if (!ircd->uses_uid)
-		sts("NICK %s 1 %lu %s %s %s 0 %sS * :%s", u->nick, (unsigned long)u->ts, u->user, u->host, me.name, umode, u->gecos);
+	if (ircd->uses_uid)
+	{
+		sts_word(&l, u->uid);
+		sts_word(&l, "*");
+	}
 	else
-		sts(":%s UID %s 1 %lu %s %s %s * %sS * * * :%s", ME, u->nick, (unsigned long)u->ts, u->user, u->host, u->uid, umode, u->gecos);
+	{
+		sts_word(&l, me.name);
+		sts_word(&l, "0");
+	}
+
+	sts_word(&l, umode);
+	sendq_line_char(&l, 'S');
+	sts_word(&l, "*");
+
+	if (ircd->uses_uid)
+	{
+		sts_word(&l, "*");
+		sts_word(&l, "*");
+	}
+
+	sts_trailing(&l, user_gecos(u));
+	sts_end(&l);
 }
 
 static void
@@ -339,15 +372,28 @@ unreal_wallops_sts(const char *text)
 	sts(":%s GLOBOPS :%s", ME, text);
 }
 
+// :ME SJOIN ts channel modes :@user
+static void
+unreal_sjoin_sts(struct channel *c, struct user *u, const char *modes)
+{
+	struct sendq_line l;
+
+	if (!sts_begin(&l, ME))
+		return;
+
+	sts_word(&l, "SJOIN");
+	sts_time(&l, c->ts);
+	sts_word(&l, c->name);
+	sts_word(&l, modes);
+	sts_word(&l, ":@");
+	sendq_line_str(&l, CLIENT_NAME(u));
+	sts_end(&l);
+}
+
 static void
 unreal_join_sts(struct channel *c, struct user *u, bool isnew, char *modes)
 {
-	if (isnew)
-		sts(":%s SJOIN %lu %s %s :@%s", ME, (unsigned long)c->ts,
-				c->name, modes, CLIENT_NAME(u));
-	else
-		sts(":%s SJOIN %lu %s + :@%s", ME, (unsigned long)c->ts,
-				c->name, CLIENT_NAME(u));
+	unreal_sjoin_sts(c, u, isnew ? modes : "+");
 }
 
 static void
@@ -355,8 +401,7 @@ unreal_chan_lowerts(struct channel *c, struct user *u)
 {
 	slog(LG_DEBUG, "unreal_chan_lowerts(): lowering TS for %s to %lu",
 			c->name, (unsigned long)c->ts);
-	sts(":%s SJOIN %lu %s %s :@%s", ME, (unsigned long)c->ts, c->name,
-			channel_modes(c, true), CLIENT_NAME(u));
+	unreal_sjoin_sts(c, u, channel_modes(c, true));
 }
 
 static void
@@ -367,6 +412,41 @@ unreal_kick(struct user *source, struct channel *c, struct user *u, const char *
 	chanuser_delete(c, u);
 }
 
+/* KICK takes a comma-separated list of nicks, so a batch goes out in as
+ * many lines as it takes to fit them */
+static void
+unreal_kick_batch_sts(struct user *source, struct channel *c, struct user **users, size_t count, const char *reason)
+{
+	const char *from = source->nick;
+	char names[BUFSIZE];
+	size_t room, i = 0, j, k;
+
+	// what a line has left for the nicks
+	room = strlen(from) + strlen(c->name) + strlen(reason) + 10;
+	room = room < 400 ? 510 - room : 0;
+
+	while (i < count)
+	{
+		mowgli_strlcpy(names, users[i]->nick, sizeof names);
+
+		for (j = i + 1; j < count; j++)
+		{
+			if (strlen(names) + 1 + strlen(users[j]->nick) > room)
+				break;
+
+			mowgli_strlcat(names, ",", sizeof names);
+			mowgli_strlcat(names, users[j]->nick, sizeof names);
+		}
+
+		sts(":%s KICK %s %s :%s", from, c->name, names, reason);
+
+		for (k = i; k < j; k++)
+			chanuser_delete(c, users[k]);
+
+		i = j;
+	}
+}
+
 static void ATHEME_FATTR_PRINTF(3, 4)
 unreal_msg(const char *from, const char *target, const char *fmt, ...)
 {
@@ -558,11 +638,19 @@ unreal_topic_sts(struct channel *c, struct user *source, const char *setter, tim
 static void
 unreal_mode_sts(char *sender, struct channel *target, char *modes)
 {
+	struct sendq_line l;
+
 	return_if_fail(sender != NULL);
 	return_if_fail(target != NULL);
 	return_if_fail(modes != NULL);
 
-	sts(":%s MODE %s %s", sender, target->name, modes);
+	if (!sts_begin(&l, sender))
+		return;
+
+	sts_word(&l, "MODE");
+	sts_word(&l, target->name);
+	sts_word(&l, modes);
+	sts_end(&l);
 }
 
 static void
@@ -877,6 +965,46 @@ remove_our_modes(struct channel *c)
 	}
 }
 
+/* The member list of an SJOIN, which also carries the lists: &ban "exception
+ * 'invex. The members are cut out of the line in place and added a batch at
+ * a time.
+ */
+static void
+unreal_sjoin_members(struct channel *c, char *list)
+{
+	struct chanuser_add_entry batch[CHANUSER_ADD_BATCH];
+	unsigned int batchc = 0;
+	const char *name;
+	char *p, *next;
+
+	for (p = list; p != NULL; p = next)
+	{
+		if ((next = strchr(p, ' ')) != NULL)
+			*next++ = '\0';
+
+		if (*p == '&')	// channel ban
+			chanban_add(c, p + 1, 'b');
+		else if (*p == '"')	// exception
+			chanban_add(c, p + 1, 'e');
+		else if (*p == '\'')	// invex
+			chanban_add(c, p + 1, 'I');
+		else
+		{
+			name = p;
+			batch[batchc].modes = chanuser_prefix_modes(&name);
+			batch[batchc].name = name;
+
+			if (*name != '\0' && ++batchc == CHANUSER_ADD_BATCH)
+			{
+				chanuser_add_many(c, batch, batchc);
+				batchc = 0;
+			}
+		}
+	}
+
+	chanuser_add_many(c, batch, batchc);
+}
+
 static void
 m_sjoin(struct sourceinfo *si, int parc, char *parv[])
 {
@@ -888,9 +1016,6 @@ m_sjoin(struct sourceinfo *si, int parc, char *parv[])
 	 */
 
 	struct channel *c;
-	unsigned int userc;
-	char *userv[256];
-	unsigned int i;
 	time_t ts;
 
 	if (parc >= 4)
@@ -914,17 +1039,7 @@ m_sjoin(struct sourceinfo *si, int parc, char *parv[])
 		}
 
 		channel_mode(NULL, c, parc - 3, parv + 2);
-		userc = sjtoken(parv[parc - 1], ' ', userv);
-
-		for (i = 0; i < userc; i++)
-			if (*userv[i] == '&')	// channel ban
-				chanban_add(c, userv[i] + 1, 'b');
-			else if (*userv[i] == '"')	// exception
-				chanban_add(c, userv[i] + 1, 'e');
-			else if (*userv[i] == '\'')	// invex
-				chanban_add(c, userv[i] + 1, 'I');
-			else
-				chanuser_add(c, userv[i]);
+		unreal_sjoin_members(c, parv[parc - 1]);
 	}
 	else if (parc == 3)
 	{
@@ -948,17 +1063,7 @@ m_sjoin(struct sourceinfo *si, int parc, char *parv[])
 
 		channel_mode_va(NULL, c, 1, "+");
 
-		userc = sjtoken(parv[parc - 1], ' ', userv);
-
-		for (i = 0; i < userc; i++)
-			if (*userv[i] == '&')	// channel ban
-				chanban_add(c, userv[i] + 1, 'b');
-			else if (*userv[i] == '"')	// exception
-				chanban_add(c, userv[i] + 1, 'e');
-			else if (*userv[i] == '\'')	// invex
-				chanban_add(c, userv[i] + 1, 'I');
-			else
-				chanuser_add(c, userv[i]);
+		unreal_sjoin_members(c, parv[parc - 1]);
 	}
 	else if (parc == 2)
 	{
@@ -1245,10 +1350,9 @@ unreal_user_mode(struct user *u, const char *changes)
 					 * This only occurs when a user is introduced after a netmerge with their
 					 * vhost instead of their cloaked host. - Adam
 					 */
-					if (strcmp(u->vhost, u->chost))
+					if (strcmp(u->vhost, user_chost(u)))
 					{
-						strshare_unref(u->chost);
-						u->chost = strshare_get(u->vhost);
+						user_set_chost(u, u->vhost);
 					}
 				}
 				else if (dir == MTYPE_DEL)
@@ -1590,6 +1694,7 @@ mod_init(struct module *const restrict m)
 	wallops_sts = &unreal_wallops_sts;
 	join_sts = &unreal_join_sts;
 	kick = &unreal_kick;
+	kick_batch_sts = &unreal_kick_batch_sts;
 	msg = &unreal_msg;
 	msg_global_sts = &unreal_msg_global_sts;
 	notice_user_sts = &unreal_notice_user_sts;
@@ -49,21 +49,67 @@
 
 #define IRCD_RES_HOSTLEN 255
 
+// How often expired answers are dropped from the cache (and the DNSBLs put in order)
+#define DNSBL_CACHE_EXPIRE_INTERVAL     SECONDS_PER_MINUTE
+
+/* A DNSBL that fails this many queries in a row (timeouts, errors and garbage)
+ * is not used for DNSBL_BREAKER_MIN seconds; then a single query is let
+ * through, and each time that fails too, it is left alone for twice as long,
+ * up to DNSBL_BREAKER_MAX.
+ */
+#define DNSBL_BREAKER_FAILURES          5U
+#define DNSBL_BREAKER_MIN               SECONDS_PER_MINUTE
+#define DNSBL_BREAKER_MAX               (30U * SECONDS_PER_MINUTE)
+
 // A configured DNSBL
 struct Blacklist {
 	struct atheme_object parent;
 	char host[IRCD_RES_HOSTLEN + 1];
 	unsigned int hits;
 	time_t lastwarning;
+	bool listed;            // still in the configuration; see dnsbl_config_purge()
+
+	unsigned long long lookups;     // users checked against it, from the cache or not
+	unsigned long long queries;     // sent to the resolver
+	unsigned long long failed;      // of those, not answered
+	unsigned long long skipped;     // not sent because of the limits below
+	unsigned int latency_ms;        // moving average, over answered queries
+	unsigned int inflight;
+	unsigned int failures;          // in a row
+	unsigned int backoff;
+	time_t skip_until;
 
 	mowgli_node_t node;
 };
 
-// A lookup in progress for a particular DNSBL for a particular client
-struct BlacklistClient {
+/* A particular DNSBL's answer for a particular address, cached or still
+ * being looked up; every client from that address waiting for it shares the
+ * one query.
+ */
+struct dnsbl_lookup {
+	char name[IRCD_RES_HOSTLEN + 1];        // e.g. 2.0.0.127.torbl.ahbl.org
 	struct Blacklist *blacklist;
-	struct user *u;
 	mowgli_dns_query_t dns_query;
+	mowgli_list_t waiters;
+	struct timeval sent;
+	time_t expires;
+	bool pending;
+	bool listed;
+};
+
+// A client waiting for a lookup to finish
+struct BlacklistClient {
+	struct dnsbl_lookup *lookup;
+	struct user *u;
+	mowgli_node_t node;
+	mowgli_node_t lookupnode;
+};
+
+/* A user introduced in a netjoin, waiting to be looked up; by name, so that
+ * nothing needs doing when they quit first.
+ */
+struct dnsbl_queued {
+	char client[NICKLEN + UIDLEN + 1];      // CLIENT_NAME() of the user
 	mowgli_node_t node;
 };
 
@@ -100,9 +146,35 @@ static mowgli_list_t blacklist_list = { NULL, NULL, 0 };
 static mowgli_patricia_t **os_set_cmdtree = NULL;
 
 static mowgli_list_t dnsbl_elist;
+static struct db_shard *dnsbl_shard = NULL;
 
 static mowgli_dns_t *dns_base = NULL;
 
+// Keyed by the name looked up, which covers both the address and the DNSBL
+static mowgli_patricia_t *dnsbl_cache = NULL;
+static mowgli_eventloop_timer_t *dnsbl_cache_timer = NULL;
+
+static unsigned int dnsbl_cache_time;
+static unsigned int dnsbl_negative_cache_time;
+
+static unsigned int dnsbl_burst_rate = 50;
+
+// Queries in flight, to all of the DNSBLs
+static unsigned int dnsbl_inflight = 0;
+static unsigned int dnsbl_max_queries = 1000;
+
+// Users waiting to be looked up after a netjoin, drained at dnsbl_burst_rate queries per second
+static mowgli_list_t dnsbl_scan_queue = { NULL, NULL, 0 };
+static mowgli_eventloop_timer_t *dnsbl_scan_timer = NULL;
+static long dnsbl_scan_budget = 0;
+
+static unsigned long long dnsbl_cache_hits = 0;
+static unsigned long long dnsbl_cache_joins = 0;
+static unsigned long long dnsbl_cache_misses = 0;
+
+// Where a user's list of queries in flight is kept
+static unsigned int dnsbl_queries_slot;
+
 static inline mowgli_list_t *
 dnsbl_queries(struct user *u)
 {
@@ -110,12 +182,12 @@ dnsbl_queries(struct user *u)
 
 	return_val_if_fail(u != NULL, NULL);
 
-	l = privatedata_get(u, "dnsbl:queries");
+	l = privatedata_slot_get(u, dnsbl_queries_slot);
 	if (l != NULL)
 		return l;
 
 	l = mowgli_list_create();
-	privatedata_set(u, "dnsbl:queries", l);
+	privatedata_slot_set(u, dnsbl_queries_slot, l);
 
 	return l;
 }
@@ -192,6 +264,7 @@ ps_cmd_dnsblexempt(struct sourceinfo *si, int parc, char *parv[])
 
 		command_success_nodata(si, _("You have added \2%s\2 to the DNSBL exempts list."), ip);
 		logcommand(si, CMDLOG_ADMIN, "DNSBL:EXEMPT:ADD: \2%s\2 \2%s\2", ip, reason);
+		db_shard_dirty(dnsbl_shard);
 	}
 	else if (!strcasecmp("DEL", command))
 	{
@@ -219,6 +292,7 @@ ps_cmd_dnsblexempt(struct sourceinfo *si, int parc, char *parv[])
 				sfree(de->ip);
 				sfree(de);
 
+				db_shard_dirty(dnsbl_shard);
 				return;
 			}
 		}
@@ -249,6 +323,122 @@ ps_cmd_dnsblexempt(struct sourceinfo *si, int parc, char *parv[])
 	}
 }
 
+static void
+dnsbl_lookup_free(struct dnsbl_lookup *const restrict dl)
+{
+	if (dl->pending)
+	{
+		(void) mowgli_dns_delete_query(dns_base, &dl->dns_query);
+
+		dl->blacklist->inflight--;
+		dnsbl_inflight--;
+	}
+
+	(void) mowgli_patricia_delete(dnsbl_cache, dl->name);
+	(void) atheme_object_unref(dl->blacklist);
+	(void) sfree(dl);
+}
+
+// The DNSBLs listing the most users go first, and the quickest of those
+static int
+dnsbl_blacklist_compare(mowgli_node_t *const a, mowgli_node_t *const b, void ATHEME_VATTR_UNUSED *const opaque)
+{
+	const struct Blacklist *const bla = a->data;
+	const struct Blacklist *const blb = b->data;
+
+	// Hit rates compared without dividing; a DNSBL nobody has been checked against yet has a rate of 0
+	const unsigned long long ra = bla->hits * (blb->lookups ? blb->lookups : 1ULL);
+	const unsigned long long rb = blb->hits * (bla->lookups ? bla->lookups : 1ULL);
+
+	if (ra != rb)
+		return (ra > rb) ? -1 : 1;
+
+	if (bla->latency_ms != blb->latency_ms)
+		return (bla->latency_ms < blb->latency_ms) ? -1 : 1;
+
+	return 0;
+}
+
+static void
+dnsbl_cache_expire(void ATHEME_VATTR_UNUSED *const restrict unused)
+{
+	mowgli_patricia_iteration_state_t state;
+	struct dnsbl_lookup *dl;
+
+	MOWGLI_PATRICIA_FOREACH(dl, &state, dnsbl_cache)
+		if (! dl->pending && dl->expires <= CURRTIME)
+			(void) dnsbl_lookup_free(dl);
+
+	(void) mowgli_list_sort(&blacklist_list, &dnsbl_blacklist_compare, NULL);
+}
+
+static unsigned int
+dnsbl_elapsed_ms(const struct timeval *const restrict since)
+{
+#ifdef HAVE_GETTIMEOFDAY
+	struct timeval elapsed;
+
+	(void) e_time(*since, &elapsed);
+
+	if (elapsed.tv_sec < 0)
+		return 0;
+
+	return (unsigned int) ((elapsed.tv_sec * 1000) + (elapsed.tv_usec / 1000));
+#else
+	(void) since;
+
+	return 0;
+#endif
+}
+
+// A DNSBL that isn't answering is skipped; see DNSBL_BREAKER_FAILURES
+static bool
+dnsbl_blacklist_tripped(const struct Blacklist *const restrict blptr)
+{
+	if (blptr->failures < DNSBL_BREAKER_FAILURES)
+		return false;
+
+	// One query at a time, once it is due, to find out whether it has recovered
+	return (blptr->skip_until > CURRTIME || blptr->inflight);
+}
+
+static void
+dnsbl_blacklist_result(struct Blacklist *const restrict blptr, const bool answered, const unsigned int ms)
+{
+	if (answered)
+	{
+		// An eighth of each new answer's time
+		if (! blptr->latency_ms)
+			blptr->latency_ms = ms;
+		else
+			blptr->latency_ms = (unsigned int) ((((unsigned long long) blptr->latency_ms * 7U) + ms) / 8U);
+
+		if (blptr->failures >= DNSBL_BREAKER_FAILURES)
+			(void) slog(LG_INFO, "DNSBL: %s is answering again", blptr->host);
+
+		blptr->failures = 0;
+		blptr->backoff = 0;
+		return;
+	}
+
+	blptr->failed++;
+
+	// The rest of the queries that were in flight when it tripped don't count against it again
+	if (++blptr->failures < DNSBL_BREAKER_FAILURES || blptr->skip_until > CURRTIME)
+		return;
+
+	blptr->backoff = blptr->backoff ? (blptr->backoff * 2U) : DNSBL_BREAKER_MIN;
+
+	if (blptr->backoff > DNSBL_BREAKER_MAX)
+		blptr->backoff = DNSBL_BREAKER_MAX;
+
+	blptr->skip_until = CURRTIME + blptr->backoff;
+
+	(void) slog(LG_INFO, "DNSBL: %s failed %u queries in a row; not using it for %s", blptr->host,
+	            blptr->failures, timediff((time_t) blptr->backoff));
+}
+
+// The user no longer needs the answers; the queries still run, to be cached
 static void
 abort_blacklist_queries(struct user *u)
 {
@@ -259,7 +449,7 @@ abort_blacklist_queries(struct user *u)
 	{
 		struct BlacklistClient *blcptr = n->data;
 
-		mowgli_dns_delete_query(dns_base, &blcptr->dns_query);
+		mowgli_node_delete(&blcptr->lookupnode, &blcptr->lookup->waiters);
 		mowgli_node_delete(n, l);
 		sfree(blcptr);
 	}
@@ -274,11 +464,13 @@ dnsbl_hit(struct user *u, struct Blacklist *blptr)
 
 	abort_blacklist_queries(u);
 
+	blptr->hits++;
+
 	switch (action)
 	{
 		case DNSBL_ACT_KLINE:
 			if (! (u->flags & UF_KLINESENT)) {
-				slog(LG_INFO, "DNSBL: k-lining \2%s\2!%s@%s [%s] who is listed in DNS Blacklist %s.", u->nick, u->user, u->host, u->gecos, blptr->host);
+				slog(LG_INFO, "DNSBL: k-lining \2%s\2!%s@%s [%s] who is listed in DNS Blacklist %s.", u->nick, u->user, u->host, user_gecos(u), blptr->host);
 				notice(svs->nick, u->nick, "Your IP address %s is listed in DNS Blacklist %s", u->ip, blptr->host);
 				kline_add("*", u->ip, "Banned (DNS Blacklist)", SECONDS_PER_DAY, "Proxyscan");
 				u->flags |= UF_KLINESENT;
@@ -290,7 +482,7 @@ dnsbl_hit(struct user *u, struct Blacklist *blptr)
 			ATHEME_FALLTHROUGH;
 
 		case DNSBL_ACT_SNOOP:
-			slog(LG_INFO, "DNSBL: \2%s\2!%s@%s [%s] is listed in DNS Blacklist %s.", u->nick, u->user, u->host, u->gecos, blptr->host);
+			slog(LG_INFO, "DNSBL: \2%s\2!%s@%s [%s] is listed in DNS Blacklist %s.", u->nick, u->user, u->host, user_gecos(u), blptr->host);
 			break;
 
 		case DNSBL_ACT_NONE:
@@ -301,91 +493,197 @@ dnsbl_hit(struct user *u, struct Blacklist *blptr)
 static void
 blacklist_dns_callback(mowgli_dns_reply_t *reply, int result, void *vptr)
 {
-	struct BlacklistClient *blcptr = (struct BlacklistClient *) vptr;
-	int listed = 0;
-	mowgli_list_t *l;
-
-	if (blcptr == NULL)
-		return;
+	struct dnsbl_lookup *const dl = vptr;
+	mowgli_node_t *n;
+	bool answered = (result == MOWGLI_DNS_RES_SUCCESS || result == MOWGLI_DNS_RES_NXDOMAIN);
 
-	if (blcptr->u == NULL)
-	{
-		sfree(blcptr);
-		return;
-	}
+	dl->pending = false;
+	dl->listed = false;
 
-	l = dnsbl_queries(blcptr->u);
-	mowgli_node_delete(&blcptr->node, l);
+	dl->blacklist->inflight--;
+	dnsbl_inflight--;
 
 	if (reply != NULL)
 	{
 		// only accept 127.x.y.z as a listing
 		if (reply->addr.addr.ss_family == AF_INET &&
 				!memcmp(&((struct sockaddr_in *)&reply->addr.addr)->sin_addr, "\177", 1))
-			listed++;
-		else if (blcptr->blacklist->lastwarning + SECONDS_PER_HOUR < CURRTIME)
+			dl->listed = true;
+		else
 		{
-			slog(LG_DEBUG,
-					"Garbage reply from blacklist %s",
-					blcptr->blacklist->host);
-			blcptr->blacklist->lastwarning = CURRTIME;
+			answered = false;
+
+			if (dl->blacklist->lastwarning + SECONDS_PER_HOUR < CURRTIME)
+			{
+				slog(LG_DEBUG,
+						"Garbage reply from blacklist %s",
+						dl->blacklist->host);
+				dl->blacklist->lastwarning = CURRTIME;
+			}
 		}
 	}
 
-	// they have a blacklist entry for this client
-	if (listed)
-		dnsbl_hit(blcptr->u, blcptr->blacklist);
+	(void) dnsbl_blacklist_result(dl->blacklist, answered, dnsbl_elapsed_ms(&dl->sent));
+
+	/* The resolver doesn't tell us the TTL of the record, so listings and
+	 * non-listings are remembered for as long as configured. Timeouts and
+	 * garbage are not remembered at all.
+	 */
+	if (answered)
+		dl->expires = CURRTIME + (dl->listed ? dnsbl_cache_time : dnsbl_negative_cache_time);
+	else
+		dl->expires = 0;
+
+	// A hit aborts the user's other lookups, which may well include some of these
+	while ((n = dl->waiters.head) != NULL)
+	{
+		struct BlacklistClient *const blcptr = n->data;
+		struct user *const u = blcptr->u;
+
+		mowgli_node_delete(&blcptr->lookupnode, &dl->waiters);
+		mowgli_node_delete(&blcptr->node, dnsbl_queries(u));
+		sfree(blcptr);
+
+		// they have a blacklist entry for this client
+		if (dl->listed)
+			dnsbl_hit(u, dl->blacklist);
+	}
 
-	atheme_object_unref(blcptr->blacklist);
-	sfree(blcptr);
+	if (dl->expires <= CURRTIME)
+		(void) dnsbl_lookup_free(dl);
 }
 
 /* XXX: no IPv6 implementation, not to concerned right now though. */
 /* 2015-12-06: at least we shouldn't crash on bad inputs anymore... -bcode */
-static void
-initiate_blacklist_dnsquery(struct Blacklist *blptr, struct user *u)
+/* Returns true if the user turned out to be listed (from the cache).
+ * share is the most queries one DNSBL may have in flight.
+ */
+static bool
+initiate_blacklist_dnsquery(struct Blacklist *blptr, struct user *u, const unsigned int share)
 {
 	char buf[IRCD_RES_HOSTLEN + 1];
 	unsigned int ip[4];
-	mowgli_list_t *l;
+	struct dnsbl_lookup *dl;
 
 	if (u->ip == NULL)
-		return;
+		return false;
 
 	// A sscanf worked fine for chary for many years, it'll be fine here
 	if (sscanf(u->ip, "%u.%u.%u.%u", &ip[3], &ip[2], &ip[1], &ip[0]) != 4)
-		return;
+		return false;
+
+	// becomes 2.0.0.127.torbl.ahbl.org or whatever
+	snprintf(buf, sizeof buf, "%u.%u.%u.%u.%s", ip[0], ip[1], ip[2], ip[3], blptr->host);
+
+	blptr->lookups++;
+
+	if ((dl = mowgli_patricia_retrieve(dnsbl_cache, buf)) != NULL && ! dl->pending && dl->expires > CURRTIME)
+	{
+		dnsbl_cache_hits++;
+
+		if (! dl->listed)
+			return false;
+
+		dnsbl_hit(u, dl->blacklist);
+		return true;
+	}
+
+	// Joining a query in flight costs nothing; only new ones are limited
+	if ((dl == NULL || ! dl->pending) && (dnsbl_blacklist_tripped(blptr) || blptr->inflight >= share))
+	{
+		blptr->skipped++;
+		return false;
+	}
+
+	if (dl == NULL)
+	{
+		dl = smalloc(sizeof *dl);
+		mowgli_strlcpy(dl->name, buf, sizeof dl->name);
+		dl->blacklist = atheme_object_ref(blptr);
+		dl->dns_query.ptr = dl;
+		dl->dns_query.callback = blacklist_dns_callback;
+		mowgli_patricia_add(dnsbl_cache, dl->name, dl);
+	}
+	else if (dl->blacklist != blptr)
+	{
+		// The blacklists have been reconfigured since this was last looked up
+		atheme_object_unref(dl->blacklist);
+		dl->blacklist = atheme_object_ref(blptr);
+	}
 
 	struct BlacklistClient *blcptr = smalloc(sizeof *blcptr);
 
-	blcptr->blacklist = atheme_object_ref(blptr);
+	blcptr->lookup = dl;
 	blcptr->u = u;
 
-	blcptr->dns_query.ptr = blcptr;
-	blcptr->dns_query.callback = blacklist_dns_callback;
+	mowgli_node_add(blcptr, &blcptr->node, dnsbl_queries(u));
+	mowgli_node_add(blcptr, &blcptr->lookupnode, &dl->waiters);
 
-	// becomes 2.0.0.127.torbl.ahbl.org or whatever
-	snprintf(buf, sizeof buf, "%u.%u.%u.%u.%s", ip[0], ip[1], ip[2], ip[3], blptr->host);
+	if (dl->pending)
+	{
+		dnsbl_cache_joins++;
+		return false;
+	}
 
-	mowgli_dns_gethost_byname(dns_base, buf, &blcptr->dns_query, MOWGLI_DNS_T_A);
+	dnsbl_cache_misses++;
+	dl->pending = true;
 
-	l = dnsbl_queries(u);
-	mowgli_node_add(blcptr, &blcptr->node, l);
+	blptr->queries++;
+	blptr->inflight++;
+	dnsbl_inflight++;
+
+#ifdef HAVE_GETTIMEOFDAY
+	(void) s_time(&dl->sent);
+#endif
+
+	// May call back straight away; dl must not be touched after this
+	mowgli_dns_gethost_byname(dns_base, dl->name, &dl->dns_query, MOWGLI_DNS_T_A);
+
+	return false;
 }
 
+// Whether a user can't be looked up in every DNSBL without going over dnsbl_max_queries
+static inline bool
+dnsbl_queries_full(void)
+{
+	return (dnsbl_inflight && dnsbl_inflight + blacklist_list.count > dnsbl_max_queries);
+}
+
+static void dnsbl_queue_user(struct user *u);
+
 static void
 lookup_blacklists(struct user *u)
 {
 	mowgli_node_t *n;
+	unsigned int usable = 0;
+
+	if (u == NULL)
+		return;
+
+	// They wait their turn, as if they had been introduced in a netjoin
+	if (dnsbl_queries_full())
+	{
+		(void) dnsbl_queue_user(u);
+		return;
+	}
+
+	MOWGLI_ITER_FOREACH(n, blacklist_list.head)
+		if (! dnsbl_blacklist_tripped(n->data))
+			usable++;
+
+	// So that one slow DNSBL can't hold all of the queries allowed in flight
+	unsigned int share = usable ? (dnsbl_max_queries / usable) : dnsbl_max_queries;
+
+	if (! share)
+		share = 1;
 
 	MOWGLI_ITER_FOREACH(n, blacklist_list.head)
 	{
 		struct Blacklist *blptr = (struct Blacklist *) n->data;
 
-		if (u == NULL)
+		// Nothing more to find out once they're known to be listed
+		if (initiate_blacklist_dnsquery(blptr, u, share))
 			return;
-
-		initiate_blacklist_dnsquery(blptr, u);
 	}
 }
 
@@ -449,14 +747,16 @@ new_blacklist(char *name)
 		blptr = smalloc(sizeof *blptr);
 		atheme_object_init(atheme_object(blptr), "proxyscan dnsbl", NULL);
 		mowgli_node_add(atheme_object_ref(blptr), &blptr->node, &blacklist_list);
+		blptr->lastwarning = 0;
 	}
 
 	mowgli_strlcpy(blptr->host, name, sizeof blptr->host);
-	blptr->lastwarning = 0;
+	blptr->listed = true;
 
 	return blptr;
 }
 
+// Drops the blacklists that are no longer configured
 static void
 destroy_blacklists(void)
 {
@@ -467,6 +767,9 @@ destroy_blacklists(void)
 	{
 		blptr = n->data;
 
+		if (blptr->listed)
+			continue;
+
 		mowgli_node_delete(n, &blacklist_list);
 		atheme_object_unref(blptr);
 	}
@@ -487,8 +790,21 @@ dnsbl_config_handler(mowgli_config_file_entry_t *ce)
 	return 0;
 }
 
+/* Blacklists that are still configured after a rehash are kept, along with
+ * their hit counts and the lookups in flight; the rest go in
+ * dnsbl_config_ready().
+ */
 static void
 dnsbl_config_purge(void *unused)
+{
+	mowgli_node_t *n;
+
+	MOWGLI_ITER_FOREACH(n, blacklist_list.head)
+		((struct Blacklist *) n->data)->listed = false;
+}
+
+static void
+dnsbl_config_ready(void *unused)
 {
 	destroy_blacklists();
 }
@@ -515,11 +831,82 @@ dnsbl_action_config_handler(mowgli_config_file_entry_t *ce)
 	return 0;
 }
 
+static void
+check_dnsbls_user(struct user *u)
+{
+	mowgli_node_t *n;
+
+	MOWGLI_ITER_FOREACH(n, dnsbl_elist.head)
+	{
+		struct dnsbl_exemption *de = n->data;
+
+		if (!irccasecmp(de->ip, u->ip))
+			return;
+	}
+
+	lookup_blacklists(u);
+}
+
+// Looks the user up, and returns how many queries that took
+static unsigned long long
+dnsbl_scan_user(struct user *const restrict u)
+{
+	const unsigned long long sent = dnsbl_cache_misses;
+
+	check_dnsbls_user(u);
+
+	return dnsbl_cache_misses - sent;
+}
+
+static void
+dnsbl_scan_queue_run(void ATHEME_VATTR_UNUSED *const restrict unused)
+{
+	dnsbl_scan_timer = NULL;
+
+	// Queries sent for new clients in the meantime come out of this second's share
+	dnsbl_scan_budget += (long) dnsbl_burst_rate;
+
+	if (dnsbl_scan_budget > (long) dnsbl_burst_rate)
+		dnsbl_scan_budget = (long) dnsbl_burst_rate;
+
+	while (dnsbl_scan_budget > 0 && dnsbl_scan_queue.head != NULL && ! dnsbl_queries_full())
+	{
+		struct dnsbl_queued *const dq = dnsbl_scan_queue.head->data;
+		struct user *const u = user_find(dq->client);
+
+		mowgli_node_delete(&dq->node, &dnsbl_scan_queue);
+		sfree(dq);
+
+		if (u == NULL || action == DNSBL_ACT_NONE)
+			continue;
+
+		dnsbl_scan_budget -= (long) dnsbl_scan_user(u);
+	}
+
+	if (dnsbl_scan_queue.head != NULL)
+		dnsbl_scan_timer = timer_add_once("dnsbl_scan_queue", &dnsbl_scan_queue_run, NULL, 1);
+}
+
+// Run instead of check_dnsbls_user() at the end of a burst
+static void
+dnsbl_queue_user(struct user *u)
+{
+	struct dnsbl_queued *const dq = smalloc(sizeof *dq);
+
+	mowgli_strlcpy(dq->client, CLIENT_NAME(u), sizeof dq->client);
+	mowgli_node_add(dq, &dq->node, &dnsbl_scan_queue);
+
+	if (dnsbl_scan_timer == NULL)
+	{
+		dnsbl_scan_budget = 0;
+		dnsbl_scan_timer = timer_add_once("dnsbl_scan_queue", &dnsbl_scan_queue_run, NULL, 1);
+	}
+}
+
 static void
 check_dnsbls(struct hook_user_nick *data)
 {
 	struct user *u = data->u;
-	mowgli_node_t *n;
 
 	if (!u)
 		return;
@@ -530,15 +917,16 @@ check_dnsbls(struct hook_user_nick *data)
 	if (action == DNSBL_ACT_NONE)
 		return;
 
-	MOWGLI_ITER_FOREACH(n, dnsbl_elist.head)
-	{
-		struct dnsbl_exemption *de = n->data;
-
-		if (!irccasecmp(de->ip, u->ip))
-			return;
-	}
+	/* Users introduced in a netjoin are queued once the burst is over, to
+	 * be looked up a few at a time; new clients take priority.
+	 */
+	if (burst_defer_user(u, &dnsbl_queue_user))
+		return;
 
-	lookup_blacklists(u);
+	if (dnsbl_scan_queue.head != NULL)
+		dnsbl_scan_budget -= (long) dnsbl_scan_user(u);
+	else
+		check_dnsbls_user(u);
 }
 
 static void
@@ -553,9 +941,42 @@ osinfo_hook(struct sourceinfo *si)
 
 	MOWGLI_ITER_FOREACH(n, blacklist_list.head)
 	{
-		struct Blacklist *blptr = (struct Blacklist *) n->data;
+		const struct Blacklist *const blptr = n->data;
+
+		command_success_nodata(si, _("Using DNSBL: %s (%llu lookups, %u%% listed; %llu queries, %u%% failed, "
+		                             "%u ms on average; %llu skipped)"), blptr->host, blptr->lookups,
+		                       blptr->lookups ? (unsigned int) ((blptr->hits * 100ULL) / blptr->lookups) : 0U,
+		                       blptr->queries,
+		                       blptr->queries ? (unsigned int) ((blptr->failed * 100ULL) / blptr->queries) : 0U,
+		                       blptr->latency_ms, blptr->skipped);
+
+		if (blptr->failures >= DNSBL_BREAKER_FAILURES)
+			command_success_nodata(si, _("DNSBL %s is not answering; it has failed %u queries in a row, and "
+			                             "is tried again in %s"), blptr->host, blptr->failures,
+			                       (blptr->skip_until > CURRTIME) ?
+			                       timediff(blptr->skip_until - CURRTIME) : _("a moment"));
+	}
+
+	const unsigned long long lookups = dnsbl_cache_hits + dnsbl_cache_joins + dnsbl_cache_misses;
+
+	command_success_nodata(si, _("DNSBL lookups: %llu (%llu answered from the cache, %llu joined a query in "
+	                             "flight, %llu queries sent; %u%% hit rate)"), lookups, dnsbl_cache_hits,
+	                       dnsbl_cache_joins, dnsbl_cache_misses,
+	                       lookups ? (unsigned int) (((dnsbl_cache_hits + dnsbl_cache_joins) * 100ULL) / lookups)
+	                               : 0U);
+
+	command_success_nodata(si, _("DNSBL answers cached: %u"), mowgli_patricia_size(dnsbl_cache));
+	command_success_nodata(si, _("DNSBL queries in flight: %u (at most %u)"), dnsbl_inflight, dnsbl_max_queries);
 
-		command_success_nodata(si, _("Using DNSBL: %s"), blptr->host);
+	if (dnsbl_scan_queue.count)
+	{
+		// At worst, every user takes a query per DNSBL
+		const unsigned long long queries = (unsigned long long) dnsbl_scan_queue.count * blacklist_list.count;
+		const unsigned long long eta = (queries + dnsbl_burst_rate - 1) / dnsbl_burst_rate;
+
+		command_success_nodata(si, _("DNSBL scan queue: %zu users waiting (done in at most %s, at %u "
+		                             "queries per second)"), dnsbl_scan_queue.count, timediff((time_t) eta),
+		                       dnsbl_burst_rate);
 	}
 }
 
@@ -635,6 +1056,8 @@ mod_init(struct module *const restrict m)
 	MODULE_TRY_REQUEST_DEPENDENCY(m, "proxyscan/main")
 	MODULE_TRY_REQUEST_SYMBOL(m, os_set_cmdtree, "operserv/set_core", "os_set_cmdtree")
 
+	dnsbl_queries_slot = privatedata_slot_register("dnsbl:queries");
+
 	if (! (dns_base = mowgli_dns_create(base_eventloop, MOWGLI_DNS_TYPE_ASYNC)))
 	{
 		(void) slog(LG_ERROR, "%s: failed to create Mowgli DNS resolver object", m->name);
@@ -644,20 +1067,32 @@ mod_init(struct module *const restrict m)
 
 	struct service *proxyscan = service_find("proxyscan");
 
-	hook_add_db_write(write_dnsbl_exempt_db);
+	dnsbl_cache = mowgli_patricia_create(&strcasecanon);
+	dnsbl_cache_timer = timer_add("dnsbl_cache_expire", &dnsbl_cache_expire, NULL,
+	                              DNSBL_CACHE_EXPIRE_INTERVAL);
 
 	db_register_type_handler("BLE", db_h_ble);
 
+	dnsbl_shard = db_shard_register("dnsbl", write_dnsbl_exempt_db);
+	db_shard_load(dnsbl_shard);
+
 	service_bind_command(proxyscan, &ps_dnsblexempt);
 	service_bind_command(proxyscan, &ps_dnsblscan);
 
 	hook_add_config_purge(dnsbl_config_purge);
+	hook_add_config_ready(dnsbl_config_ready);
 	hook_add_user_add(check_dnsbls);
 	hook_add_user_delete(abort_blacklist_queries);
 	hook_add_operserv_info(osinfo_hook);
 
 	add_conf_item("DNSBL_ACTION", &proxyscan->conf_table, dnsbl_action_config_handler);
 	add_conf_item("BLACKLISTS", &proxyscan->conf_table, dnsbl_config_handler);
+	add_duration_conf_item("DNSBL_CACHE_TIME", &proxyscan->conf_table, 0, &dnsbl_cache_time, "m",
+	                       30 * SECONDS_PER_MINUTE);
+	add_duration_conf_item("DNSBL_NEGATIVE_CACHE_TIME", &proxyscan->conf_table, 0, &dnsbl_negative_cache_time,
+	                       "m", 10 * SECONDS_PER_MINUTE);
+	add_uint_conf_item("DNSBL_BURST_RATE", &proxyscan->conf_table, 0, &dnsbl_burst_rate, 1, 100000, 50);
+	add_uint_conf_item("DNSBL_MAX_QUERIES", &proxyscan->conf_table, 0, &dnsbl_max_queries, 1, 1000000, 1000);
 
 	command_add(&os_set_dnsblaction, *os_set_cmdtree);
 
@@ -667,14 +1102,50 @@ mod_init(struct module *const restrict m)
 static void
 mod_deinit(const enum module_unload_intent ATHEME_VATTR_UNUSED intent)
 {
+	mowgli_patricia_iteration_state_t state;
+	struct dnsbl_lookup *dl;
+
+	MOWGLI_PATRICIA_FOREACH(dl, &state, dnsbl_cache)
+	{
+		mowgli_node_t *n;
+
+		while ((n = dl->waiters.head) != NULL)
+		{
+			struct BlacklistClient *const blcptr = n->data;
+
+			mowgli_node_delete(&blcptr->lookupnode, &dl->waiters);
+			mowgli_node_delete(&blcptr->node, dnsbl_queries(blcptr->u));
+			sfree(blcptr);
+		}
+
+		(void) dnsbl_lookup_free(dl);
+	}
+
+	timer_destroy(dnsbl_cache_timer);
+
+	if (dnsbl_scan_timer != NULL)
+		timer_destroy(dnsbl_scan_timer);
+
+	mowgli_node_t *n, *tn;
+
+	MOWGLI_ITER_FOREACH_SAFE(n, tn, dnsbl_scan_queue.head)
+	{
+		struct dnsbl_queued *const dq = n->data;
+
+		mowgli_node_delete(&dq->node, &dnsbl_scan_queue);
+		sfree(dq);
+	}
+	mowgli_patricia_destroy(dnsbl_cache, NULL, NULL);
 	mowgli_dns_destroy(dns_base);
 
 	struct service *proxyscan;
 
-	hook_del_db_write(write_dnsbl_exempt_db);
+	db_shard_unregister(dnsbl_shard);
 	hook_del_user_add(check_dnsbls);
 	hook_del_user_delete(abort_blacklist_queries);
+	burst_cancel_user_fn(dnsbl_queue_user);
 	hook_del_config_purge(dnsbl_config_purge);
+	hook_del_config_ready(dnsbl_config_ready);
 	hook_del_operserv_info(osinfo_hook);
 
 	db_unregister_type_handler("BLE");
@@ -683,6 +1154,10 @@ mod_deinit(const enum module_unload_intent ATHEME_VATTR_UNUSED intent)
 
 	del_conf_item("DNSBL_ACTION", &proxyscan->conf_table);
 	del_conf_item("BLACKLISTS", &proxyscan->conf_table);
+	del_conf_item("DNSBL_CACHE_TIME", &proxyscan->conf_table);
+	del_conf_item("DNSBL_NEGATIVE_CACHE_TIME", &proxyscan->conf_table);
+	del_conf_item("DNSBL_BURST_RATE", &proxyscan->conf_table);
+	del_conf_item("DNSBL_MAX_QUERIES", &proxyscan->conf_table);
 
 	command_delete(&os_set_dnsblaction, *os_set_cmdtree);
 
@@ -8,24 +8,27 @@
  */
 
 #include <atheme.h>
+#include "rpgserv.h"
+
+static mowgli_patricia_t **rpgserv_channels = NULL;
 
 static void
 rs_cmd_list(struct sourceinfo *si, int parc, char *parv[])
 {
 	mowgli_patricia_iteration_state_t state;
-	struct mychan *mc;
+	struct rs_channel *rc;
 	unsigned int listed = 0;
 	char *desc;
 
-	MOWGLI_PATRICIA_FOREACH(mc, &state, mclist)
+	MOWGLI_PATRICIA_FOREACH(rc, &state, *rpgserv_channels)
 	{
+		struct mychan *const mc = rc->mc;
+
 		if (!mc->chan)
 			continue;
 		if (CMODE_SEC & mc->chan->modes || CMODE_PRIV & mc->chan->modes)
 			continue;
 
-		if (!metadata_find(mc, "private:rpgserv:enabled"))
-			continue;
 		if (!metadata_find(mc, "private:rpgserv:summary"))
 			desc = _("<no summary>");
 		else
@@ -50,7 +53,7 @@ static struct command rs_list = {
 static void
 mod_init(struct module *const restrict m)
 {
-	MODULE_TRY_REQUEST_DEPENDENCY(m, "rpgserv/main")
+	MODULE_TRY_REQUEST_SYMBOL(m, rpgserv_channels, "rpgserv/main", "rpgserv_channels")
 
 	service_named_bind_command("rpgserv", &rs_list);
 }
@@ -9,12 +9,120 @@
  */
 
 #include <atheme.h>
+#include "rpgserv.h"
+
+#define RS_MDPREFIX "private:rpgserv:"
+
+// Imported by other modules/rpgserv/*.so
+extern mowgli_patricia_t *rpgserv_channels;
+mowgli_patricia_t *rpgserv_channels = NULL;
 
 static struct service *rpgserv = NULL;
 
+static void
+rs_channel_forget(struct mychan *const restrict mc)
+{
+	struct rs_channel *const rc = mowgli_patricia_delete(rpgserv_channels, mc->name);
+
+	if (rc != NULL)
+		(void) sfree(rc);
+}
+
+static unsigned int
+rs_tags_parse(const enum rs_tag_field field, const char *const restrict value, bool *const restrict loose)
+{
+	const struct rs_tag_field_info *const fi = &rs_tag_fields[field];
+	unsigned int mask = 0;
+	char copy[BUFSIZE];
+	char *keyword;
+	char *pos;
+
+	(void) mowgli_strlcpy(copy, value, sizeof copy);
+
+	for (keyword = strtok_r(copy, " ", &pos); keyword != NULL; keyword = strtok_r(NULL, " ", &pos))
+	{
+		unsigned int i;
+
+		for (i = 0; i < fi->nkeys; i++)
+			if (strcasecmp(keyword, fi->keys[i]) == 0)
+				break;
+
+		if (i < fi->nkeys)
+			mask |= (1U << i);
+		else
+			*loose = true;
+	}
+
+	return mask;
+}
+
+// Brings the channel's entry (if it should have one) in line with its metadata
+static void
+rs_channel_update(struct mychan *const restrict mc)
+{
+	struct rs_channel *rc = mowgli_patricia_retrieve(rpgserv_channels, mc->name);
+
+	if (! metadata_find(mc, RS_MDPREFIX "enabled"))
+	{
+		if (rc != NULL)
+			(void) rs_channel_forget(mc);
+
+		return;
+	}
+
+	if (rc == NULL)
+	{
+		rc = smalloc(sizeof *rc);
+		rc->mc = mc;
+
+		(void) mowgli_patricia_add(rpgserv_channels, mc->name, rc);
+	}
+
+	rc->loose = false;
+
+	for (unsigned int i = 0; i < RS_TAG_FIELDS; i++)
+	{
+		const struct metadata *const md = metadata_find(mc, rs_tag_fields[i].mdkey);
+
+		rc->tags[i] = md ? rs_tags_parse(i, md->value, &rc->loose) : 0;
+	}
+}
+
+static void
+rs_metadata_change(struct hook_metadata_req *const restrict req)
+{
+	if (db_object_type(req->target) != DB_OBJECT_MYCHAN)
+		return;
+
+	if (strncmp(req->name, RS_MDPREFIX, strlen(RS_MDPREFIX)) != 0)
+		return;
+
+	// the channel itself is being destroyed (and has been forgotten already)
+	if (atheme_object(req->target)->refcount == -1)
+		return;
+
+	(void) rs_channel_update(req->target);
+}
+
+static void
+rs_mychan_delete(struct mychan *const restrict mc)
+{
+	(void) rs_channel_forget(mc);
+}
+
+static void
+rs_channel_free_cb(const char ATHEME_VATTR_UNUSED *const restrict key, void *const restrict data,
+                   void ATHEME_VATTR_UNUSED *const restrict privdata)
+{
+	(void) sfree(data);
+}
+
 static void
 mod_init(struct module *const restrict m)
 {
+	mowgli_patricia_iteration_state_t state;
+	struct mychan *mc;
+
 	if (! (rpgserv = service_add("rpgserv", NULL)))
 	{
 		(void) slog(LG_ERROR, "%s: service_add() failed", m->name);
@@ -22,11 +130,27 @@ mod_init(struct module *const restrict m)
 		m->mflags |= MODFLAG_FAIL;
 		return;
 	}
+
+	rpgserv_channels = mowgli_patricia_create(irccasecanon);
+
+	// If the database is loaded already; the hooks see to the rest
+	MOWGLI_PATRICIA_FOREACH(mc, &state, mclist)
+		(void) rs_channel_update(mc);
+
+	(void) hook_add_metadata_add(&rs_metadata_change);
+	(void) hook_add_metadata_delete(&rs_metadata_change);
+	(void) hook_add_mychan_delete(&rs_mychan_delete);
 }
 
 static void
 mod_deinit(const enum module_unload_intent ATHEME_VATTR_UNUSED intent)
 {
+	(void) hook_del_metadata_add(&rs_metadata_change);
+	(void) hook_del_metadata_delete(&rs_metadata_change);
+	(void) hook_del_mychan_delete(&rs_mychan_delete);
+
+	(void) mowgli_patricia_destroy(rpgserv_channels, &rs_channel_free_cb, NULL);
+
 	(void) service_delete(rpgserv);
 }
 
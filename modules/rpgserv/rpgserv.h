@@ -0,0 +1,65 @@
+/*
+ * SPDX-License-Identifier: ISC
+ * SPDX-URL: https://spdx.org/licenses/ISC.html
+ *
+ * Copyright (C) 2026 Atheme Development Group (https://atheme.github.io/)
+ *
+ * The index of RPG-enabled channels kept by rpgserv/main
+ */
+
+#ifndef ATHEME_MOD_RPGSERV_RPGSERV_H
+#define ATHEME_MOD_RPGSERV_RPGSERV_H 1
+
+#include <atheme.h>
+#include "prettyprint.h"
+
+enum rs_tag_field
+{
+	RS_TAG_GENRE            = 0,
+	RS_TAG_PERIOD           = 1,
+	RS_TAG_RULESET          = 2,
+	RS_TAG_RATING           = 3,
+	RS_TAG_SYSTEM           = 4,
+	RS_TAG_FIELDS
+};
+
+struct rs_tag_field_info
+{
+	const char *            mdkey;
+	const char **           keys;
+	unsigned int            nkeys;
+};
+
+static const struct rs_tag_field_info rs_tag_fields[RS_TAG_FIELDS] = {
+	[RS_TAG_GENRE]   = { "private:rpgserv:genre",   genre_keys,   ARRAY_SIZE(genre_keys) },
+	[RS_TAG_PERIOD]  = { "private:rpgserv:period",  period_keys,  ARRAY_SIZE(period_keys) },
+	[RS_TAG_RULESET] = { "private:rpgserv:ruleset", ruleset_keys, ARRAY_SIZE(ruleset_keys) },
+	[RS_TAG_RATING]  = { "private:rpgserv:rating",  rating_keys,  ARRAY_SIZE(rating_keys) },
+	[RS_TAG_SYSTEM]  = { "private:rpgserv:system",  system_keys,  ARRAY_SIZE(system_keys) },
+};
+
+// An RPG-enabled channel, in rpgserv_channels (keyed by its name)
+struct rs_channel
+{
+	struct mychan *         mc;
+	unsigned int            tags[RS_TAG_FIELDS];    // bit i set if the field has keyword i of its list
+	bool                    loose;                  // some field has words not in its list (see SEARCH)
+};
+
+/* The keywords of a field that contain 'word' (ignoring case), as SEARCH has
+ * always matched them.
+ */
+static inline unsigned int
+rs_tags_matching(const enum rs_tag_field field, const char *const restrict word)
+{
+	const struct rs_tag_field_info *const fi = &rs_tag_fields[field];
+	unsigned int mask = 0;
+
+	for (unsigned int i = 0; i < fi->nkeys; i++)
+		if (strcasestr(fi->keys[i], word) != NULL)
+			mask |= (1U << i);
+
+	return mask;
+}
+
+#endif /* !ATHEME_MOD_RPGSERV_RPGSERV_H */
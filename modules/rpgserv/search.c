@@ -8,49 +8,64 @@
  */
 
 #include <atheme.h>
-#include "prettyprint.h"
+#include "rpgserv.h"
+
+static mowgli_patricia_t **rpgserv_channels = NULL;
+
+// The old way, for channels with words SEARCH has no bits for
+static bool
+rs_search_loose(struct mychan *const restrict mc, const int parc, char *parv[])
+{
+	for (unsigned int i = 0; i < RS_TAG_FIELDS; i++)
+	{
+		const struct metadata *const md = metadata_find(mc, rs_tag_fields[i].mdkey);
+
+		if (md == NULL)
+			continue;
+
+		for (unsigned int j = 0; j < (unsigned int) parc; j++)
+			if (strcasestr(md->value, parv[j]) != NULL)
+				return true;
+	}
+
+	return false;
+}
 
 static void
 rs_cmd_search(struct sourceinfo *si, int parc, char *parv[])
 {
 	mowgli_patricia_iteration_state_t state;
-	struct mychan *mc;
+	struct rs_channel *rc;
 	unsigned int listed = 0;
+	unsigned int wanted[RS_TAG_FIELDS];
+	unsigned int i, j;
 
-	MOWGLI_PATRICIA_FOREACH(mc, &state, mclist)
+	// A channel matches if any word is in any of its fields
+	for (i = 0; i < RS_TAG_FIELDS; i++)
 	{
-		unsigned int i, j;
-		struct metadata *md;
+		wanted[i] = 0;
+
+		for (j = 0; j < (unsigned int) parc; j++)
+			wanted[i] |= rs_tags_matching(i, parv[j]);
+	}
 
-		static const char *mdkeys[] = {
-			"private:rpgserv:genre", "private:rpgserv:period", "private:rpgserv:ruleset",
-			"private:rpgserv:rating", "private:rpgserv:system"
-		};
+	MOWGLI_PATRICIA_FOREACH(rc, &state, *rpgserv_channels)
+	{
+		struct mychan *const mc = rc->mc;
+		struct metadata *md;
 
 		if (!mc->chan)
 			continue;
 		if (CMODE_SEC & mc->chan->modes || CMODE_PRIV & mc->chan->modes)
 			continue;
 
-		if (!metadata_find(mc, "private:rpgserv:enabled"))
-			continue;
-
-		for (i = 0; i < ARRAY_SIZE(mdkeys); i++)
-		{
-			md = metadata_find(mc, mdkeys[i]);
-			if (md == NULL)
-				continue;
+		for (i = 0; i < RS_TAG_FIELDS; i++)
+			if (rc->tags[i] & wanted[i])
+				break;
 
-			for (j = 0; j < (unsigned int) parc; j++)
-			{
-				if (strcasestr(md->value, parv[j]) != NULL)
-					goto __matched;
-			}
-		}
-
-		continue;
+		if (i == RS_TAG_FIELDS && !(rc->loose && rs_search_loose(mc, parc, parv)))
+			continue;
 
-__matched:
 		listed++;
 
 		command_success_nodata(si, _("Channel \2%s\2:"), mc->name);
@@ -87,7 +102,7 @@ static struct command rs_search = {
 static void
 mod_init(struct module *const restrict m)
 {
-	MODULE_TRY_REQUEST_DEPENDENCY(m, "rpgserv/main")
+	MODULE_TRY_REQUEST_SYMBOL(m, rpgserv_channels, "rpgserv/main", "rpgserv_channels")
 
 	service_named_bind_command("rpgserv", &rs_search);
 }
@@ -137,6 +137,18 @@
 
 #define ATHEME_ECDH_X25519_KEY_REGEN_INTERVAL   SECONDS_PER_HOUR
 #define ATHEME_ECDH_X25519_PUBKEY_MDNAME        "private:x25519pubkey"
+#define ATHEME_ECDH_X25519_SHARED_CACHE_MAX     4096U
+
+/* The scalar multiplication is the only expensive part of a login, and its
+ * result only depends on the client's public key and our current keypair;
+ * the per-session salt keeps the challenge keys distinct regardless. So the
+ * shared secrets are remembered (keyed by the client's encoded public key)
+ * until the keypair is next regenerated.
+ */
+struct ecdh_x25519_shared_entry
+{
+	unsigned char   secret[ATHEME_ECDH_X25519_XKEY_LEN];
+};
 
 static mowgli_patricia_t **ns_set_cmdtree = NULL;
 static const struct sasl_core_functions *sasl_core_functions = NULL;
@@ -144,6 +156,56 @@ static const struct sasl_core_functions *sasl_core_functions = NULL;
 static mowgli_eventloop_timer_t *ecdh_x25519_keypair_regen_timer = NULL;
 static unsigned char ecdh_x25519_server_seckey[ATHEME_ECDH_X25519_XKEY_LEN];
 static unsigned char ecdh_x25519_server_pubkey[ATHEME_ECDH_X25519_XKEY_LEN];
+static mowgli_patricia_t *ecdh_x25519_shared_cache = NULL;
+
+static void
+ecdh_x25519_shared_entry_free(const char ATHEME_VATTR_UNUSED *const restrict key, void *const restrict data,
+                              void ATHEME_VATTR_UNUSED *const restrict privdata)
+{
+	(void) smemzerofree(data, sizeof(struct ecdh_x25519_shared_entry));
+}
+
+static void
+ecdh_x25519_shared_cache_clear(void)
+{
+	if (! ecdh_x25519_shared_cache)
+		return;
+
+	(void) mowgli_patricia_destroy(ecdh_x25519_shared_cache, &ecdh_x25519_shared_entry_free, NULL);
+
+	ecdh_x25519_shared_cache = NULL;
+}
+
+static bool ATHEME_FATTR_WUR
+ecdh_x25519_shared_get(const char *const restrict encoded, const unsigned char *const restrict client_pubkey,
+                       unsigned char *const restrict shared_secret)
+{
+	const struct ecdh_x25519_shared_entry *ent;
+
+	if (ecdh_x25519_shared_cache && (ent = mowgli_patricia_retrieve(ecdh_x25519_shared_cache, encoded)))
+	{
+		(void) memcpy(shared_secret, ent->secret, sizeof ent->secret);
+		return true;
+	}
+
+	if (! ecdh_x25519_compute_shared(ecdh_x25519_server_seckey, client_pubkey, shared_secret))
+		// This function logs messages on failure
+		return false;
+
+	// Not worth being clever about; a full cache is simply started over
+	if (ecdh_x25519_shared_cache &&
+	    mowgli_patricia_size(ecdh_x25519_shared_cache) >= ATHEME_ECDH_X25519_SHARED_CACHE_MAX)
+		(void) ecdh_x25519_shared_cache_clear();
+
+	if (! ecdh_x25519_shared_cache)
+		ecdh_x25519_shared_cache = mowgli_patricia_create(NULL);
+
+	struct ecdh_x25519_shared_entry *const newent = smalloc(sizeof *newent);
+
+	(void) memcpy(newent->secret, shared_secret, sizeof newent->secret);
+	(void) mowgli_patricia_add(ecdh_x25519_shared_cache, encoded, newent);
+	return true;
+}
 
 static bool
 ecdh_x25519_keypair_regen(void)
@@ -158,6 +220,7 @@ ecdh_x25519_keypair_regen(void)
 	(void) memcpy(ecdh_x25519_server_seckey, seckey, sizeof seckey);
 	(void) memcpy(ecdh_x25519_server_pubkey, pubkey, sizeof pubkey);
 	(void) smemzero(seckey, sizeof seckey);
+	(void) ecdh_x25519_shared_cache_clear();
 	return true;
 }
 
@@ -243,7 +306,7 @@ ecdh_x25519_sasl_step_account_names(struct sasl_session *const restrict p,
 		goto cleanup;
 	}
 
-	if (! ecdh_x25519_compute_shared(ecdh_x25519_server_seckey, client_pubkey, shared_secret))
+	if (! ecdh_x25519_shared_get(md->value, client_pubkey, shared_secret))
 		// This function logs messages on failure
 		goto cleanup;
 
@@ -398,10 +461,10 @@ mod_init(struct module *const restrict m)
 		m->mflags |= MODFLAG_FAIL;
 		return;
 	}
-	if (! (ecdh_x25519_keypair_regen_timer = mowgli_timer_add(base_eventloop, "ecdh_x25519_keypair_regen",
+	if (! (ecdh_x25519_keypair_regen_timer = timer_add("ecdh_x25519_keypair_regen",
 	       &ecdh_x25519_keypair_regen_cb, NULL, ATHEME_ECDH_X25519_KEY_REGEN_INTERVAL)))
 	{
-		(void) slog(LG_ERROR, "%s: mowgli_timer_add() failed (BUG?); refusing to load", m->name);
+		(void) slog(LG_ERROR, "%s: timer_add() failed (BUG?); refusing to load", m->name);
 		m->mflags |= MODFLAG_FAIL;
 		return;
 	}
@@ -414,7 +477,8 @@ static void
 mod_deinit(const enum module_unload_intent ATHEME_VATTR_UNUSED intent)
 {
 	(void) smemzero(ecdh_x25519_server_seckey, sizeof ecdh_x25519_server_seckey);
-	(void) mowgli_timer_destroy(base_eventloop, ecdh_x25519_keypair_regen_timer);
+	(void) ecdh_x25519_shared_cache_clear();
+	(void) timer_destroy(ecdh_x25519_keypair_regen_timer);
 	(void) sasl_core_functions->mech_unregister(&sasl_mech_ecdh_x25519_challenge);
 	(void) command_delete(&ns_cmd_set_x25519_pubkey, *ns_set_cmdtree);
 }
@@ -17,12 +17,18 @@
 #include <openssl/evp.h>
 
 #define CHALLENGE_LENGTH	32U
+#define SIGNATURE_MAXLEN	0x100U
 #define CURVE_IDENTIFIER	NID_X9_62_prime256v1
 
 struct sasl_ecdsa_nist256p_challenge_session
 {
-	unsigned char    challenge[CHALLENGE_LENGTH];
-	EC_KEY          *pubkey;
+	unsigned char            challenge[CHALLENGE_LENGTH];
+	unsigned char            signature[SIGNATURE_MAXLEN];
+	size_t                   signature_len;
+	EC_KEY                  *pubkey;
+	struct sasl_session     *session;
+	struct pwverify_request *job;            // Verification running on the crypto workers (if any)
+	enum sasl_mechanism_result result;
 };
 
 static const struct sasl_core_functions *sasl_core_functions = NULL;
@@ -128,13 +134,14 @@ sasl_mech_ecdsa_step_account_names(struct sasl_session *const restrict p,
 	return ASASL_MRESULT_CONTINUE;
 }
 
+// Runs on a crypto worker thread; only touches the session's own copy of everything
 static enum sasl_mechanism_result ATHEME_FATTR_WUR
-sasl_mech_ecdsa_step_verify_signature(struct sasl_session *const restrict p,
-                                      const struct sasl_input_buf *const restrict in)
+sasl_mech_ecdsa_verify(const struct sasl_ecdsa_nist256p_challenge_session *const restrict s)
 {
-	struct sasl_ecdsa_nist256p_challenge_session *const s = p->mechdata;
+	const unsigned char *const sig = s->signature;
+	const int siglen = (int) s->signature_len;
 
-	const int retd = ECDSA_verify(0, s->challenge, sizeof s->challenge, in->buf, (int) in->len, s->pubkey);
+	const int retd = ECDSA_verify(0, s->challenge, sizeof s->challenge, sig, siglen, s->pubkey);
 
 	if (retd == 1)
 		return ASASL_MRESULT_SUCCESS;
@@ -151,7 +158,7 @@ sasl_mech_ecdsa_step_verify_signature(struct sasl_session *const restrict p,
 	if (! digest_oneshot(DIGALG_SHA2_256, s->challenge, sizeof s->challenge, digestbuf, NULL))
 		return ASASL_MRESULT_ERROR;
 
-	const int reth = ECDSA_verify(0, digestbuf, sizeof digestbuf, in->buf, (int) in->len, s->pubkey);
+	const int reth = ECDSA_verify(0, digestbuf, sizeof digestbuf, sig, siglen, s->pubkey);
 
 	if (reth == 1)
 		return ASASL_MRESULT_SUCCESS;
@@ -162,6 +169,57 @@ sasl_mech_ecdsa_step_verify_signature(struct sasl_session *const restrict p,
 	return ASASL_MRESULT_FAILURE;
 }
 
+static void
+sasl_mech_ecdsa_verify_run(void *const restrict priv)
+{
+	struct sasl_ecdsa_nist256p_challenge_session *const s = priv;
+
+	s->result = sasl_mech_ecdsa_verify(s);
+}
+
+static void
+sasl_mech_ecdsa_verify_done(void *const restrict priv)
+{
+	struct sasl_ecdsa_nist256p_challenge_session *const s = priv;
+
+	// The job is freed once this returns; the session may be destroyed by the call below
+	s->job = NULL;
+
+	(void) sasl_core_functions->mech_async_done(s->session, s->result);
+}
+
+/* Two signature verifications cost more than everything else in a login put
+ * together, so they are done on the crypto workers rather than holding up
+ * every other client while they run.
+ */
+static enum sasl_mechanism_result ATHEME_FATTR_WUR
+sasl_mech_ecdsa_step_verify_signature(struct sasl_session *const restrict p,
+                                      const struct sasl_input_buf *const restrict in)
+{
+	struct sasl_ecdsa_nist256p_challenge_session *const s = p->mechdata;
+
+	if (s->job || s->signature_len)
+	{
+		(void) slog(LG_DEBUG, "%s: client sent more data after the signature", MOWGLI_FUNC_NAME);
+		return ASASL_MRESULT_ERROR;
+	}
+	if (in->len > sizeof s->signature)
+	{
+		(void) slog(LG_DEBUG, "%s: in->len (%zu) is unacceptable", MOWGLI_FUNC_NAME, in->len);
+		return ASASL_MRESULT_ERROR;
+	}
+
+	(void) memcpy(s->signature, in->buf, in->len);
+
+	s->signature_len = in->len;
+	s->session = p;
+
+	if (! (s->job = crypto_job_submit(&sasl_mech_ecdsa_verify_run, &sasl_mech_ecdsa_verify_done, s)))
+		return sasl_mech_ecdsa_verify(s);
+
+	return ASASL_MRESULT_ASYNC;
+}
+
 static enum sasl_mechanism_result ATHEME_FATTR_WUR
 sasl_mech_ecdsa_step(struct sasl_session *const restrict p, const struct sasl_input_buf *const restrict in,
                      struct sasl_output_buf *const restrict out)
@@ -175,6 +233,20 @@ sasl_mech_ecdsa_step(struct sasl_session *const restrict p, const struct sasl_in
 		return sasl_mech_ecdsa_step_verify_signature(p, in);
 }
 
+static void
+sasl_mech_ecdsa_cancel(struct sasl_session *const restrict p)
+{
+	if (! (p && p->mechdata))
+		return;
+
+	struct sasl_ecdsa_nist256p_challenge_session *const s = p->mechdata;
+
+	if (s->job)
+		(void) crypto_job_cancel(s->job);
+
+	s->job = NULL;
+}
+
 static void
 sasl_mech_ecdsa_finish(struct sasl_session *const restrict p)
 {
@@ -183,6 +255,10 @@ sasl_mech_ecdsa_finish(struct sasl_session *const restrict p)
 
 	struct sasl_ecdsa_nist256p_challenge_session *const s = p->mechdata;
 
+	// Should have been done by mech_cancel already, but the worker must not be left using the key
+	if (s->job)
+		(void) crypto_job_cancel(s->job);
+
 	if (s->pubkey)
 		(void) EC_KEY_free(s->pubkey);
 
@@ -197,6 +273,7 @@ static const struct sasl_mechanism sasl_mech_ecdsa = {
 	.mech_start     = NULL,
 	.mech_step      = &sasl_mech_ecdsa_step,
 	.mech_finish    = &sasl_mech_ecdsa_finish,
+	.mech_cancel    = &sasl_mech_ecdsa_cancel,
 	.password_based = false,
 };
 
@@ -16,15 +16,173 @@
 
 #define ASASL_OUTFLAGS_WIPE_FREE_BUF    (ASASL_OUTFLAG_WIPE_BUF | ASASL_OUTFLAG_FREE_BUF)
 #define LOGIN_CANCELLED_STR             "There was a problem logging you in; login cancelled"
+#define SASL_MECHLIST_BITS              64U
+#define SASL_MECHLIST_VARIANTS_MAX      16U
 
 static mowgli_list_t sasl_sessions;
+static struct namehash *sasl_session_index = NULL;      // by UID
 static mowgli_list_t sasl_mechanisms;
 static char sasl_mechlist_string[SASL_S2S_MAXLEN_ATONCE_B64];
+
+/* The lists that a session can be sent besides sasl_mechlist_string (for an
+ * account without a password, or a SCRAM digest mismatch), by which of the
+ * mechanisms they leave out; emptied whenever a mechanism comes or goes.
+ */
+struct sasl_mechlist_variant
+{
+	uint64_t                excluded;
+	char                    string[SASL_S2S_MAXLEN_ATONCE_B64];
+	mowgli_node_t           node;
+};
+
+static mowgli_list_t sasl_mechlist_variants;
+static uint64_t sasl_mechlist_password_based = 0;
 static bool sasl_hide_server_names;
 
-static mowgli_eventloop_timer_t *sasl_delete_stale_timer = NULL;
 static struct service *saslsvs = NULL;
 
+// Read by misc/metrics (looked up on each request, so that it does not need this module)
+extern struct sasl_session_stats sasl_session_stats;
+struct sasl_session_stats sasl_session_stats;
+
+// Likewise, and by statserv/sasl; entries are struct sasl_mech_stats
+extern mowgli_list_t sasl_mech_stats;
+mowgli_list_t sasl_mech_stats;
+
+enum sasl_session_outcome
+{
+	SASL_OUTCOME_SUCCEEDED  = 0,
+	SASL_OUTCOME_FAILED,
+	SASL_OUTCOME_ERRORED,
+	SASL_OUTCOME_ABORTED,
+	SASL_OUTCOME_TIMED_OUT,
+};
+
+static void sasl_session_expire(void *vptr);
+
+static struct sasl_mech_stats *
+sasl_mech_stats_get(const char *const restrict name)
+{
+	mowgli_node_t *n;
+
+	MOWGLI_ITER_FOREACH(n, sasl_mech_stats.head)
+	{
+		struct sasl_mech_stats *const ms = n->data;
+
+		if (strcmp(ms->name, name) == 0)
+			return ms;
+	}
+
+	struct sasl_mech_stats *const ms = smalloc(sizeof *ms);
+
+	(void) mowgli_strlcpy(ms->name, name, sizeof ms->name);
+	(void) mowgli_node_add(ms, &ms->node, &sasl_mech_stats);
+
+	return ms;
+}
+
+static void
+sasl_mech_stats_clear(void)
+{
+	mowgli_node_t *n, *tn;
+
+	MOWGLI_ITER_FOREACH_SAFE(n, tn, sasl_mech_stats.head)
+	{
+		struct sasl_mech_stats *const ms = n->data;
+
+		(void) mowgli_node_delete(&ms->node, &sasl_mech_stats);
+		(void) sfree(ms);
+	}
+}
+
+static unsigned long long
+sasl_elapsed_us(const struct timeval *const restrict since)
+{
+#ifdef HAVE_GETTIMEOFDAY
+	struct timeval elapsed;
+
+	(void) e_time(*since, &elapsed);
+
+	if (elapsed.tv_sec < 0)
+		return 0;
+
+	return (((unsigned long long) elapsed.tv_sec) * 1000000ULL) + (unsigned long long) elapsed.tv_usec;
+#else
+	(void) since;
+
+	return 0;
+#endif
+}
+
+static void
+sasl_mech_stats_hist(unsigned int *const restrict hist, const unsigned long long us)
+{
+	unsigned int bucket = 0;
+
+	while (bucket < SASL_MECH_STATS_BUCKETS - 1 && (us >> (bucket + 1)))
+		bucket++;
+
+	hist[bucket]++;
+}
+
+// The mechanism has been handed a step; sasl_session_step_done() follows, possibly from sasl_mech_async_done()
+static void
+sasl_session_step_start(struct sasl_session *const restrict p)
+{
+#ifdef HAVE_GETTIMEOFDAY
+	(void) s_time(&p->step_started);
+#endif
+
+	if (p->mstats)
+		p->mstats->steps++;
+}
+
+static void
+sasl_session_step_done(struct sasl_session *const restrict p)
+{
+	p->server_us += sasl_elapsed_us(&p->step_started);
+}
+
+// Only the first outcome of a session counts; e.g. the abort that follows a failure does not
+static void
+sasl_session_outcome(struct sasl_session *const restrict p, const enum sasl_session_outcome outcome)
+{
+	struct sasl_mech_stats *const ms = p->mstats;
+
+	if (! ms || (p->flags & ASASL_SFLAG_OUTCOME_COUNTED))
+		return;
+
+	p->flags |= ASASL_SFLAG_OUTCOME_COUNTED;
+
+	switch (outcome)
+	{
+		case SASL_OUTCOME_SUCCEEDED:
+			ms->succeeded++;
+			break;
+		case SASL_OUTCOME_FAILED:
+			ms->failed++;
+			break;
+		case SASL_OUTCOME_ERRORED:
+			ms->errored++;
+			break;
+		case SASL_OUTCOME_ABORTED:
+			ms->aborted++;
+			return;
+		case SASL_OUTCOME_TIMED_OUT:
+			ms->timed_out++;
+			return;
+	}
+
+	// Abandoned sessions would only tell us how patient clients and the timeout are
+	const unsigned long long total_us = sasl_elapsed_us(&p->mech_started);
+
+	ms->total_us += total_us;
+	ms->server_us += p->server_us;
+
+	(void) sasl_mech_stats_hist(ms->hist, total_us);
+	(void) sasl_mech_stats_hist(ms->server_hist, p->server_us);
+}
+
 static const char *
 sasl_format_sourceinfo(struct sourceinfo *const restrict si, const bool full)
 {
@@ -108,17 +266,7 @@ sasl_session_find(const char *const restrict uid)
 	if (! uid || ! *uid)
 		return NULL;
 
-	mowgli_node_t *n;
-
-	MOWGLI_ITER_FOREACH(n, sasl_sessions.head)
-	{
-		struct sasl_session *const p = n->data;
-
-		if (strcmp(p->uid, uid) == 0)
-			return p;
-	}
-
-	return NULL;
+	return namehash_find(sasl_session_index, uid);
 }
 
 static struct sasl_session *
@@ -134,6 +282,15 @@ sasl_session_find_or_make(const struct sasl_message *const restrict smsg)
 
 		(void) mowgli_strlcpy(p->uid, smsg->uid, sizeof p->uid);
 		(void) mowgli_node_add(p, &p->node, &sasl_sessions);
+		(void) namehash_add(sasl_session_index, p->uid, p);
+		(void) timerwheel_add(&p->expire_timer, &sasl_session_expire, p, CURRTIME + SASL_SESSION_TIMEOUT);
+
+		sasl_session_stats.started++;
+
+		ATHEME_TRACE1(sasl__session__start, p->uid);
+
+		if (++sasl_session_stats.active > sasl_session_stats.peak)
+			sasl_session_stats.peak = sasl_session_stats.active;
 	}
 
 	return p;
@@ -164,15 +321,14 @@ sasl_server_eob(struct server ATHEME_VATTR_UNUSED *const restrict s)
 }
 
 static void
-sasl_mechlist_string_build(const struct sasl_session *const restrict p, const struct myuser *const restrict mu,
-                           const char **const restrict avoid)
+sasl_mechlist_build_uncached(const struct myuser *const restrict mu, const char **const restrict avoid,
+                             char *const restrict buf, const size_t bufsz)
 {
-	char buf[sizeof sasl_mechlist_string];
 	char *bufptr = buf;
 	size_t written = 0;
 	mowgli_node_t *n;
 
-	(void) memset(buf, 0x00, sizeof buf);
+	(void) memset(buf, 0x00, bufsz);
 
 	MOWGLI_ITER_FOREACH(n, sasl_mechanisms.head)
 	{
@@ -195,7 +351,7 @@ sasl_mechlist_string_build(const struct sasl_session *const restrict p, const st
 
 		const size_t namelen = strlen(mptr->name);
 
-		if (written + namelen >= sizeof buf)
+		if (written + namelen >= bufsz)
 			break;
 
 		(void) memcpy(bufptr, mptr->name, namelen);
@@ -207,16 +363,157 @@ sasl_mechlist_string_build(const struct sasl_session *const restrict p, const st
 
 	if (written)
 		*(--bufptr) = 0x00;
+}
 
-	if (p)
+// Builds the list of mechanisms, leaving out those whose bits (in registration order) are set in excluded
+static void
+sasl_mechlist_format(const uint64_t excluded, char *const restrict buf, const size_t bufsz)
+{
+	char *bufptr = buf;
+	size_t written = 0;
+	size_t idx = 0;
+	mowgli_node_t *n;
+
+	(void) memset(buf, 0x00, bufsz);
+
+	MOWGLI_ITER_FOREACH(n, sasl_mechanisms.head)
+	{
+		const struct sasl_mechanism *const mptr = n->data;
+		const size_t bit = idx++;
+
+		continue_if_fail(mptr != NULL);
+
+		if (bit < SASL_MECHLIST_BITS && (excluded & (UINT64_C(1) << bit)))
+			continue;
+
+		const size_t namelen = strlen(mptr->name);
+
+		if (written + namelen >= bufsz)
+			break;
+
+		(void) memcpy(bufptr, mptr->name, namelen);
+
+		bufptr += namelen;
+		*bufptr++ = ',';
+		written += namelen + 1;
+	}
+
+	if (written)
+		*(--bufptr) = 0x00;
+}
+
+static void
+sasl_mechlist_string_build(const struct sasl_session *const restrict p, const struct myuser *const restrict mu,
+                           const char **const restrict avoid)
+{
+	uint64_t excluded = 0;
+	size_t idx = 0;
+	mowgli_node_t *n;
+
+	if (! p)
+	{
+		(void) sasl_mechlist_format(0, sasl_mechlist_string, sizeof sasl_mechlist_string);
+		return;
+	}
+
+	if (MOWGLI_LIST_LENGTH(&sasl_mechanisms) > SASL_MECHLIST_BITS)
+	{
+		// Too many mechanisms to say which are left out with a mask (never, in practice)
+		char buf[sizeof sasl_mechlist_string];
+
+		(void) sasl_mechlist_build_uncached(mu, avoid, buf, sizeof buf);
 		(void) sasl_sts(p->uid, 'M', buf);
-	else
-		(void) memcpy(sasl_mechlist_string, buf, sizeof buf);
+		return;
+	}
+
+	if (mu != NULL && (mu->flags & MU_NOPASSWORD))
+		excluded |= sasl_mechlist_password_based;
+
+	MOWGLI_ITER_FOREACH(n, sasl_mechanisms.head)
+	{
+		const struct sasl_mechanism *const mptr = n->data;
+		const size_t bit = idx++;
+
+		for (size_t i = 0; avoid != NULL && avoid[i] != NULL; i++)
+		{
+			if (strcmp(mptr->name, avoid[i]) != 0)
+				continue;
+
+			excluded |= (UINT64_C(1) << bit);
+			break;
+		}
+	}
+
+	if (! excluded)
+	{
+		(void) sasl_sts(p->uid, 'M', sasl_mechlist_string);
+		return;
+	}
+
+	MOWGLI_ITER_FOREACH(n, sasl_mechlist_variants.head)
+	{
+		const struct sasl_mechlist_variant *const v = n->data;
+
+		if (v->excluded == excluded)
+		{
+			(void) sasl_sts(p->uid, 'M', v->string);
+			return;
+		}
+	}
+
+	struct sasl_mechlist_variant *const v = smalloc(sizeof *v);
+
+	v->excluded = excluded;
+
+	(void) sasl_mechlist_format(excluded, v->string, sizeof v->string);
+
+	// There are only ever a few of these; if something makes more, forget the oldest
+	if (MOWGLI_LIST_LENGTH(&sasl_mechlist_variants) >= SASL_MECHLIST_VARIANTS_MAX)
+	{
+		struct sasl_mechlist_variant *const old = sasl_mechlist_variants.head->data;
+
+		(void) mowgli_node_delete(&old->node, &sasl_mechlist_variants);
+		(void) sfree(old);
+	}
+
+	(void) mowgli_node_add(v, &v->node, &sasl_mechlist_variants);
+	(void) sasl_sts(p->uid, 'M', v->string);
 }
 
+static void
+sasl_mechlist_variants_clear(void)
+{
+	mowgli_node_t *n, *tn;
+
+	MOWGLI_ITER_FOREACH_SAFE(n, tn, sasl_mechlist_variants.head)
+	{
+		struct sasl_mechlist_variant *const v = n->data;
+
+		(void) mowgli_node_delete(&v->node, &sasl_mechlist_variants);
+		(void) sfree(v);
+	}
+}
+
+// Called whenever a mechanism comes or goes, which is the only time any of the lists change
 static void
 sasl_mechlist_do_rebuild(void)
 {
+	size_t idx = 0;
+	mowgli_node_t *n;
+
+	(void) sasl_mechlist_variants_clear();
+
+	sasl_mechlist_password_based = 0;
+
+	MOWGLI_ITER_FOREACH(n, sasl_mechanisms.head)
+	{
+		const struct sasl_mechanism *const mptr = n->data;
+		const size_t bit = idx++;
+
+		if (bit < SASL_MECHLIST_BITS && mptr->password_based)
+			sasl_mechlist_password_based |= (UINT64_C(1) << bit);
+	}
+
 	(void) sasl_mechlist_string_build(NULL, NULL, NULL);
 
 	if (me.connected)
@@ -336,16 +633,21 @@ sasl_user_can_login(struct sasl_session *const restrict p)
 static void
 sasl_session_destroy(struct sasl_session *const restrict p)
 {
-	mowgli_node_t *n;
+	(void) mowgli_node_delete(&p->node, &sasl_sessions);
+	(void) namehash_delete(sasl_session_index, p->uid, p);
+	(void) timerwheel_cancel(&p->expire_timer);
 
-	MOWGLI_ITER_FOREACH(n, sasl_sessions.head)
-	{
-		if (n == &p->node && n->data == p)
-		{
-			(void) mowgli_node_delete(n, &sasl_sessions);
-			break;
-		}
-	}
+	sasl_session_stats.active--;
+
+	(void) sasl_session_outcome(p, SASL_OUTCOME_ABORTED);
+
+	ATHEME_TRACE3(sasl__session__end, p->uid, p->mechptr ? p->mechptr->name : "", p->server_us);
+
+	if (p->pwreq)
+		(void) verify_password_async_cancel(p->pwreq);
+
+	if ((p->flags & ASASL_SFLAG_ASYNC_PENDING) && p->mechptr && p->mechptr->mech_cancel)
+		(void) p->mechptr->mech_cancel(p);
 
 	if (p->mechptr && p->mechptr->mech_finish)
 		(void) p->mechptr->mech_finish(p);
@@ -433,18 +735,9 @@ sasl_handle_login(struct sasl_session *const restrict p, struct user *const u, s
 
 		if (! (was_killed = ircd_on_logout(u, entity(u->myuser)->name)))
 		{
-			mowgli_node_t *n;
-
-			MOWGLI_ITER_FOREACH(n, u->myuser->logins.head)
-			{
-				if (n->data == u)
-				{
-					(void) mowgli_node_delete(n, &u->myuser->logins);
-					(void) mowgli_node_free(n);
-					break;
-				}
-			}
+			mowgli_node_delete(&u->mlnode, &u->myuser->logins);
 
+			hook_call_user_logout(u);
 			u->myuser = NULL;
 		}
 	}
@@ -577,60 +870,21 @@ sasl_process_output(struct sasl_session *const restrict p, struct sasl_output_bu
 	return true;
 }
 
-/* given an entire sasl message, advance session by passing data to mechanism
- * and feeding returned data back to client.
+/* Acts on the result of a mechanism step, either straight from sasl_process_packet() or, for
+ * mechanisms that returned ASASL_MRESULT_ASYNC, later from sasl_mech_async_done().
  */
 static bool ATHEME_FATTR_WUR
-sasl_process_packet(struct sasl_session *const restrict p, char *const restrict buf, const size_t len)
+sasl_process_result(struct sasl_session *const restrict p, const enum sasl_mechanism_result rc,
+                    const bool have_responded)
 {
-	struct sasl_output_buf outbuf = {
-		.buf    = NULL,
-		.len    = 0,
-		.flags  = ASASL_OUTFLAG_NONE,
-	};
-
-	enum sasl_mechanism_result rc;
-	bool have_responded = false;
-
-	if (! p->mechptr && ! len)
+	switch (rc)
 	{
-		// First piece of data in a session is the name of the SASL mechanism that will be used
-		if (! (p->mechptr = sasl_mechanism_find(buf)))
+		case ASASL_MRESULT_ASYNC:
 		{
-			(void) sasl_sts(p->uid, 'M', sasl_mechlist_string);
-			return false;
+			p->flags |= ASASL_SFLAG_ASYNC_PENDING;
+			return true;
 		}
 
-		(void) sasl_sourceinfo_recreate(p);
-
-		if (p->mechptr->mech_start)
-			rc = p->mechptr->mech_start(p, &outbuf);
-		else
-			rc = ASASL_MRESULT_CONTINUE;
-	}
-	else if (! p->mechptr)
-	{
-		(void) slog(LG_ERROR, "%s: session has no mechanism (BUG!)", MOWGLI_FUNC_NAME);
-		return false;
-	}
-	else
-	{
-		rc = sasl_process_input(p, buf, len, &outbuf);
-	}
-
-	if (outbuf.buf && outbuf.len)
-	{
-		if (! sasl_process_output(p, &outbuf))
-			return false;
-
-		have_responded = true;
-	}
-
-	// Some progress has been made, reset timeout.
-	p->flags &= ~ASASL_SFLAG_MARKED_FOR_DELETION;
-
-	switch (rc)
-	{
 		case ASASL_MRESULT_CONTINUE:
 		{
 			if (! have_responded)
@@ -652,6 +906,7 @@ sasl_process_packet(struct sasl_session *const restrict p, char *const restrict
 				if (u)
 					(void) notice(saslsvs->nick, u->nick, LOGIN_CANCELLED_STR);
 
+				(void) sasl_session_outcome(p, SASL_OUTCOME_ERRORED);
 				return false;
 			}
 
@@ -659,13 +914,20 @@ sasl_process_packet(struct sasl_session *const restrict p, char *const restrict
 			 * Otherwise, we will log them in on introduction of user to network
 			 */
 			if (u && ! sasl_handle_login(p, u, mu))
+			{
+				(void) sasl_session_outcome(p, SASL_OUTCOME_ERRORED);
 				return false;
+			}
+
+			(void) sasl_session_outcome(p, SASL_OUTCOME_SUCCEEDED);
 
 			return sasl_session_success(p, mu, (u != NULL));
 		}
 
 		case ASASL_MRESULT_FAILURE:
 		{
+			(void) sasl_session_outcome(p, SASL_OUTCOME_FAILED);
+
 			if (*p->authceid)
 			{
 				/* If we reach this, they failed SASL auth, so if they were trying
@@ -690,6 +952,7 @@ sasl_process_packet(struct sasl_session *const restrict p, char *const restrict
 		}
 
 		case ASASL_MRESULT_ERROR:
+			(void) sasl_session_outcome(p, SASL_OUTCOME_ERRORED);
 			return false;
 	}
 
@@ -700,6 +963,74 @@ sasl_process_packet(struct sasl_session *const restrict p, char *const restrict
 	return false;
 }
 
+/* given an entire sasl message, advance session by passing data to mechanism
+ * and feeding returned data back to client.
+ */
+static bool ATHEME_FATTR_WUR
+sasl_process_packet(struct sasl_session *const restrict p, char *const restrict buf, const size_t len)
+{
+	struct sasl_output_buf outbuf = {
+		.buf    = NULL,
+		.len    = 0,
+		.flags  = ASASL_OUTFLAG_NONE,
+	};
+
+	enum sasl_mechanism_result rc;
+	bool have_responded = false;
+
+	if (! p->mechptr && ! len)
+	{
+		// First piece of data in a session is the name of the SASL mechanism that will be used
+		if (! (p->mechptr = sasl_mechanism_find(buf)))
+		{
+			(void) sasl_sts(p->uid, 'M', sasl_mechlist_string);
+			return false;
+		}
+
+		(void) sasl_sourceinfo_recreate(p);
+
+		p->mstats = sasl_mech_stats_get(p->mechptr->name);
+		p->mstats->started++;
+
+#ifdef HAVE_GETTIMEOFDAY
+		(void) s_time(&p->mech_started);
+#endif
+		(void) sasl_session_step_start(p);
+
+		if (p->mechptr->mech_start)
+			rc = p->mechptr->mech_start(p, &outbuf);
+		else
+			rc = ASASL_MRESULT_CONTINUE;
+	}
+	else if (! p->mechptr)
+	{
+		(void) slog(LG_ERROR, "%s: session has no mechanism (BUG!)", MOWGLI_FUNC_NAME);
+		return false;
+	}
+	else
+	{
+		(void) sasl_session_step_start(p);
+
+		rc = sasl_process_input(p, buf, len, &outbuf);
+	}
+
+	if (rc != ASASL_MRESULT_ASYNC)
+		(void) sasl_session_step_done(p);
+
+	if (outbuf.buf && outbuf.len)
+	{
+		if (! sasl_process_output(p, &outbuf))
+			return false;
+
+		have_responded = true;
+	}
+
+	// Some progress has been made, reset timeout.
+	(void) timerwheel_add(&p->expire_timer, &sasl_session_expire, p, CURRTIME + SASL_SESSION_TIMEOUT);
+
+	return sasl_process_result(p, rc, have_responded);
+}
+
 static bool ATHEME_FATTR_WUR
 sasl_process_buffer(struct sasl_session *const restrict p)
 {
@@ -809,7 +1140,10 @@ sasl_input_clientdata(const struct sasl_message *const restrict smsg, struct sas
 
 	// Abort?
 	if (len == 1 && smsg->parv[0][0] == '*')
+	{
+		(void) sasl_session_outcome(p, SASL_OUTCOME_ABORTED);
 		return false;
+	}
 
 	// End of data?
 	if (len == 1 && smsg->parv[0][0] == '+')
@@ -869,7 +1203,11 @@ sasl_input(struct sasl_message *const restrict smsg)
 
 		case 'C':
 			// (C)lient data
-			ret = sasl_input_clientdata(smsg, p);
+			if (p->flags & ASASL_SFLAG_ASYNC_PENDING)
+				// The client may not send anything more until we have answered
+				ret = false;
+			else
+				ret = sasl_input_clientdata(smsg, p);
 			break;
 
 		case 'D':
@@ -879,7 +1217,11 @@ sasl_input(struct sasl_message *const restrict smsg)
 	}
 
 	if (! ret)
+	{
+		// Anything that did not already count as something else was a protocol error
+		(void) sasl_session_outcome(p, SASL_OUTCOME_ERRORED);
 		(void) sasl_session_abort(p);
+	}
 }
 
 static void
@@ -895,24 +1237,34 @@ sasl_user_add(struct hook_user_nick *const restrict data)
 	if (! p)
 		return;
 
-	(void) sasl_handle_login(p, u, NULL);
+	// Don't log in a client that did not wait for its credentials to be checked
+	if (! (p->flags & ASASL_SFLAG_ASYNC_PENDING))
+		(void) sasl_handle_login(p, u, NULL);
+
 	(void) sasl_session_destroy(p);
 }
 
 static void
-sasl_delete_stale(void ATHEME_VATTR_UNUSED *const restrict vptr)
+sasl_session_expire(void *const restrict vptr)
 {
-	mowgli_node_t *n, *tn;
+	struct sasl_session *const p = vptr;
 
-	MOWGLI_ITER_FOREACH_SAFE(n, tn, sasl_sessions.head)
-	{
-		struct sasl_session *const p = n->data;
+	(void) slog(LG_DEBUG, "%s: abandoning session %s", MOWGLI_FUNC_NAME, p->uid);
 
-		if (p->flags & ASASL_SFLAG_MARKED_FOR_DELETION)
-			(void) sasl_session_destroy(p);
-		else
-			p->flags |= ASASL_SFLAG_MARKED_FOR_DELETION;
-	}
+	sasl_session_stats.timed_out++;
+
+	(void) sasl_session_outcome(p, SASL_OUTCOME_TIMED_OUT);
+	(void) sasl_session_destroy(p);
+}
+
+static void
+sasl_osinfo_hook(struct sourceinfo *const restrict si)
+{
+	return_if_fail(si != NULL);
+
+	(void) command_success_nodata(si, _("SASL sessions: %u in progress (at most %u), %llu started, %llu timed out"),
+	                                  sasl_session_stats.active, sasl_session_stats.peak,
+	                                  sasl_session_stats.started, sasl_session_stats.timed_out);
 }
 
 static void
@@ -944,6 +1296,7 @@ sasl_mech_register(const struct sasl_mechanism *const restrict mech)
 	 */
 	(void) mowgli_node_add((void *)((uintptr_t) mech), node, &sasl_mechanisms);
 
+	(void) sasl_mech_stats_get(mech->name);
 	(void) sasl_mechlist_do_rebuild();
 }
 
@@ -976,6 +1329,52 @@ sasl_mech_unregister(const struct sasl_mechanism *const restrict mech)
 	}
 }
 
+static void
+sasl_mech_async_done(struct sasl_session *const restrict p, const enum sasl_mechanism_result rc)
+{
+	return_if_fail(p != NULL);
+	return_if_fail(p->flags & ASASL_SFLAG_ASYNC_PENDING);
+	return_if_fail(rc != ASASL_MRESULT_ASYNC);
+
+	p->flags &= ~ASASL_SFLAG_ASYNC_PENDING;
+
+	(void) sasl_session_step_done(p);
+
+	if (! sasl_process_result(p, rc, false))
+		(void) sasl_session_abort(p);
+}
+
+static void
+sasl_mech_password_verified(struct myuser ATHEME_VATTR_UNUSED *const restrict mu, const bool verified,
+                            void *const restrict priv)
+{
+	struct sasl_session *const p = priv;
+
+	// The request is freed once this returns
+	p->pwreq = NULL;
+
+	(void) sasl_mech_async_done(p, verified ? ASASL_MRESULT_SUCCESS : ASASL_MRESULT_FAILURE);
+}
+
+/* Checks a password for a mechanism without holding up other sessions. The step that calls this should return
+ * its result; the session is resumed with ASASL_MRESULT_SUCCESS or ASASL_MRESULT_FAILURE once the password has
+ * been checked, and the check is abandoned if the session goes away first.
+ */
+static enum sasl_mechanism_result ATHEME_FATTR_WUR
+sasl_mech_verify_password(struct sasl_session *const restrict p, struct myuser *const restrict mu,
+                          const char *const restrict password)
+{
+	return_val_if_fail(p != NULL, ASASL_MRESULT_ERROR);
+	return_val_if_fail(mu != NULL, ASASL_MRESULT_ERROR);
+	return_val_if_fail(password != NULL, ASASL_MRESULT_ERROR);
+	return_val_if_fail(p->pwreq == NULL, ASASL_MRESULT_ERROR);
+
+	if (! (p->pwreq = verify_password_async(mu, password, &sasl_mech_password_verified, p)))
+		return ASASL_MRESULT_ERROR;
+
+	return ASASL_MRESULT_ASYNC;
+}
+
 static inline bool ATHEME_FATTR_WUR
 sasl_authxid_can_login(struct sasl_session *const restrict p, const char *const restrict authxid,
                        struct myuser **const restrict muo, char *const restrict val_name,
@@ -1043,11 +1442,13 @@ sasl_authzid_can_login(struct sasl_session *const restrict p, const char *const
 extern const struct sasl_core_functions sasl_core_functions;
 const struct sasl_core_functions sasl_core_functions = {
 
-	.mech_register      = &sasl_mech_register,
-	.mech_unregister    = &sasl_mech_unregister,
-	.authcid_can_login  = &sasl_authcid_can_login,
-	.authzid_can_login  = &sasl_authzid_can_login,
-	.recalc_mechlist    = &sasl_mechlist_string_build,
+	.mech_register        = &sasl_mech_register,
+	.mech_unregister      = &sasl_mech_unregister,
+	.authcid_can_login    = &sasl_authcid_can_login,
+	.authzid_can_login    = &sasl_authzid_can_login,
+	.recalc_mechlist      = &sasl_mechlist_string_build,
+	.mech_async_done      = &sasl_mech_async_done,
+	.mech_verify_password = &sasl_mech_verify_password,
 };
 
 static void
@@ -1094,8 +1495,9 @@ mod_init(struct module *const restrict m)
 	(void) hook_add_sasl_input(&sasl_input);
 	(void) hook_add_user_add(&sasl_user_add);
 	(void) hook_add_server_eob(&sasl_server_eob);
+	(void) hook_add_operserv_info(&sasl_osinfo_hook);
 
-	sasl_delete_stale_timer = mowgli_timer_add(base_eventloop, "sasl_delete_stale", &sasl_delete_stale, NULL, SECONDS_PER_MINUTE / 2);
+	sasl_session_index = namehash_create(false);
 	authservice_loaded++;
 
 	(void) add_bool_conf_item("HIDE_SERVER_NAMES", &saslsvs->conf_table, 0, &sasl_hide_server_names, false);
@@ -1107,17 +1509,21 @@ mod_deinit(const enum module_unload_intent ATHEME_VATTR_UNUSED intent)
 	(void) hook_del_sasl_input(&sasl_input);
 	(void) hook_del_user_add(&sasl_user_add);
 	(void) hook_del_server_eob(&sasl_server_eob);
-
-	(void) mowgli_timer_destroy(base_eventloop, sasl_delete_stale_timer);
+	(void) hook_del_operserv_info(&sasl_osinfo_hook);
 
 	(void) del_conf_item("HIDE_SERVER_NAMES", &saslsvs->conf_table);
 	(void) service_delete(saslsvs);
 
 	authservice_loaded--;
 
+	(void) sasl_mechlist_variants_clear();
+	(void) sasl_mech_stats_clear();
+
 	if (sasl_sessions.head)
 		(void) slog(LG_ERROR, "saslserv/main: shutting down with a non-empty session list; "
 		                      "a mechanism did not unregister itself! (BUG)");
+	else
+		(void) namehash_destroy(sasl_session_index);
 }
 
 SIMPLE_DECLARE_MODULE_V1("saslserv/main", MODULE_UNLOAD_CAPABILITY_OK)
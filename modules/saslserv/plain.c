@@ -56,10 +56,8 @@ sasl_mech_plain_step(struct sasl_session *const restrict p, const struct sasl_in
 	if (! sasl_core_functions->authcid_can_login(p, authcid, &mu))
 		return ASASL_MRESULT_ERROR;
 
-	if (! verify_password(mu, secret))
-		return ASASL_MRESULT_FAILURE;
-
-	return ASASL_MRESULT_SUCCESS;
+	// Hashing the password can take a while; the session is resumed once it has been checked
+	return sasl_core_functions->mech_verify_password(p, mu, secret);
 }
 
 static const struct sasl_mechanism sasl_mech_plain = {
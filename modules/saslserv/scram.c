@@ -57,6 +57,10 @@
 #define SCRAM_PASSHASH_LENGTH_MAX       (7U + BASE64_SIZE_RAW(PBKDF2_SALTLEN_MAX) + \
                                          (2U * BASE64_SIZE_RAW(SCRAM_MDLEN_MAX)) + 9U)
 
+#define SCRAM_CACHE_SIZE_MIN            0U          // Disables the cache
+#define SCRAM_CACHE_SIZE_DEF            4096U
+#define SCRAM_CACHE_SIZE_MAX            1048576U
+
 struct scram_attribute
 {
 	char *                      value;
@@ -85,18 +89,123 @@ struct scram_session
 	char                        nonce[SCRAM_NONCE_LENGTH_MAX_COMBINED + 1];
 };
 
+/* Parsing a user's credentials (and, for regular PBKDF2 credentials, deriving a ServerKey and StoredKey
+ * from them) only depends upon the stored hash, so the result can be kept around for the next login. The
+ * hash it was computed from is kept alongside it, so that an entry is never used once that has changed,
+ * no matter which code path changed it.
+ */
+struct scram_cache_entry
+{
+	mowgli_node_t               node;       // For entry into mowgli_list_t scram_cache_lru
+	struct pbkdf2v2_dbentry     db;         // Parsed credentials from database
+	char                        eid[IDLEN + 1];
+	char                        pass[PASSLEN + 1];
+};
+
 typedef struct scram_attribute scram_attr_list[128];
 
 static mowgli_list_t scram_sessions;
 
+static mowgli_patricia_t *scram_cache = NULL;
+static mowgli_list_t scram_cache_lru;           // Most recently used entry first
+static unsigned int scram_cache_size = SCRAM_CACHE_SIZE_DEF;
+static unsigned int scram_cache_hits = 0;
+static unsigned int scram_cache_misses = 0;
+
 static const struct sasl_core_functions *sasl_core_functions = NULL;
 static const struct pbkdf2v2_scram_functions *pbkdf2v2_scram_functions = NULL;
 
+static void
+scram_cache_entry_free(struct scram_cache_entry *const restrict ce)
+{
+	(void) mowgli_patricia_delete(scram_cache, ce->eid);
+	(void) mowgli_node_delete(&ce->node, &scram_cache_lru);
+	(void) smemzerofree(ce, sizeof *ce);
+}
+
+static void
+scram_cache_trim(const unsigned int size)
+{
+	while (MOWGLI_LIST_LENGTH(&scram_cache_lru) > size)
+		(void) scram_cache_entry_free(scram_cache_lru.tail->data);
+}
+
+static void
+scram_cache_forget(struct myuser *const restrict mu)
+{
+	struct scram_cache_entry *const ce = mowgli_patricia_retrieve(scram_cache, entity(mu)->id);
+
+	if (ce)
+		(void) scram_cache_entry_free(ce);
+}
+
+static bool ATHEME_FATTR_WUR
+scram_cache_dbextract(struct myuser *const restrict mu, struct pbkdf2v2_dbentry *const restrict db)
+{
+	// The configured size may have shrunk since the last login
+	(void) scram_cache_trim(scram_cache_size);
+
+	struct scram_cache_entry *ce = mowgli_patricia_retrieve(scram_cache, entity(mu)->id);
+
+	if (ce && strcmp(ce->pass, mu->pass) == 0)
+	{
+		scram_cache_hits++;
+
+		(void) memcpy(db, &ce->db, sizeof *db);
+		(void) mowgli_node_delete(&ce->node, &scram_cache_lru);
+		(void) mowgli_node_add_head(ce, &ce->node, &scram_cache_lru);
+		return true;
+	}
+
+	scram_cache_misses++;
+
+	if (ce)
+		(void) scram_cache_entry_free(ce);
+
+	if (! pbkdf2v2_scram_functions->dbextract(mu->pass, db))
+		return false;
+
+	if (! scram_cache_size)
+		return true;
+
+	(void) scram_cache_trim(scram_cache_size - 1U);
+
+	ce = smalloc(sizeof *ce);
+
+	(void) memcpy(&ce->db, db, sizeof ce->db);
+	(void) mowgli_strlcpy(ce->eid, entity(mu)->id, sizeof ce->eid);
+	(void) mowgli_strlcpy(ce->pass, mu->pass, sizeof ce->pass);
+	(void) mowgli_patricia_add(scram_cache, ce->eid, ce);
+	(void) mowgli_node_add_head(ce, &ce->node, &scram_cache_lru);
+	return true;
+}
+
+static void
+scram_myuser_change(struct myuser *const restrict mu)
+{
+	return_if_fail(mu != NULL);
+
+	// Possibly a new password; don't hold onto credentials derived from the old one
+	(void) scram_cache_forget(mu);
+}
+
+static void
+scram_osinfo_hook(struct sourceinfo *const restrict si)
+{
+	return_if_fail(si != NULL);
+
+	(void) command_success_nodata(si, _("SCRAM credential cache: %zu/%u entries, %u hits, %u misses"),
+	                                  MOWGLI_LIST_LENGTH(&scram_cache_lru), scram_cache_size,
+	                                  scram_cache_hits, scram_cache_misses);
+}
+
 static void
 scram_myuser_delete(struct myuser *const restrict mu)
 {
 	mowgli_node_t *n;
 
+	(void) scram_cache_forget(mu);
+
 	MOWGLI_ITER_FOREACH(n, scram_sessions.head)
 	{
 		struct scram_session *const s = n->data;
@@ -403,7 +512,7 @@ scram_step_clientfirst(struct sasl_session *const restrict p, const struct sasl_
 		(void) scram_error("other-error", out);
 		goto error;
 	}
-	if (! pbkdf2v2_scram_functions->dbextract(mu->pass, &db))
+	if (! scram_cache_dbextract(mu, &db))
 	{
 		// User's password hash is not in a compatible (PBKDF2 v2) format
 		(void) scram_error("other-error", out);
@@ -703,9 +812,9 @@ scram_step_success(struct sasl_session *const restrict p)
 	}
 
 	(void) slog(LG_DEBUG, "%s: succeeded", MOWGLI_FUNC_NAME);
-	(void) smemzero(s->mu->pass, sizeof s->mu->pass);
-	(void) memcpy(s->mu->pass, buf, (size_t) ret);
+	(void) replace_password(s->mu, buf, true);
 	(void) smemzero(buf, sizeof buf);
+	(void) scram_cache_forget(s->mu);
 
 end:
 	(void) smemzero(csk64, sizeof csk64);
@@ -861,6 +970,18 @@ mod_init(struct module *const restrict m)
 
 	// We need to be told when a user account is deleted in case there is an active SCRAM negotiation for it
 	(void) hook_add_myuser_delete(&scram_myuser_delete);
+
+	// We also need to forget cached credentials when the account's password might have changed
+	(void) hook_add_myuser_change(&scram_myuser_change);
+	(void) hook_add_operserv_info(&scram_osinfo_hook);
+
+	struct service *const saslsvs = service_find("saslserv");
+
+	if (saslsvs)
+		(void) add_uint_conf_item("SCRAM_CACHE_SIZE", &saslsvs->conf_table, 0, &scram_cache_size,
+		                          SCRAM_CACHE_SIZE_MIN, SCRAM_CACHE_SIZE_MAX, SCRAM_CACHE_SIZE_DEF);
+
+	scram_cache = mowgli_patricia_create(NULL);
 }
 
 static void
@@ -869,8 +990,18 @@ mod_deinit(const enum module_unload_intent ATHEME_VATTR_UNUSED intent)
 	// Unregister configuration interest in the pbkdf2v2 module
 	(void) pbkdf2v2_scram_functions->confhook(NULL);
 
-	// We no longer need this
+	// We no longer need these
 	(void) hook_del_myuser_delete(&scram_myuser_delete);
+	(void) hook_del_myuser_change(&scram_myuser_change);
+	(void) hook_del_operserv_info(&scram_osinfo_hook);
+
+	struct service *const saslsvs = service_find("saslserv");
+
+	if (saslsvs)
+		(void) del_conf_item("SCRAM_CACHE_SIZE", &saslsvs->conf_table);
+
+	(void) scram_cache_trim(0);
+	(void) mowgli_patricia_destroy(scram_cache, NULL, NULL);
 
 	// Unregister the SASL mechanisms
 	(void) scram_mechanisms_unregister();
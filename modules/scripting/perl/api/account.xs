@@ -35,6 +35,11 @@ CODE:
 OUTPUT:
 	RETVAL
 
+void
+foreach_chunk(SV * package, int size, SV * code)
+CODE:
+	perl_foreach_chunk(PERL_COLLECTION_ACCOUNTS, size, code);
+
 const char *
 email(Atheme_Account self)
 CODE:
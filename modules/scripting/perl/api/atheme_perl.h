@@ -28,6 +28,9 @@ void perl_command_help_func(struct sourceinfo *si, const char *subcmd);
 static const IV invalid_object_pointer = -1;
 
 void register_object_reference(SV *sv);
+SV *find_object_reference(const void *data, const char *package);
+mowgli_node_t *mark_object_references(void);
+void invalidate_object_references_since(mowgli_node_t *mark);
 void invalidate_object_references(void);
 void free_object_list(void);
 
@@ -58,5 +61,15 @@ perl_list_create(mowgli_list_t *list, const char *package)
  */
 
 SV * bless_pointer_to_package(void *data, const char *package);
+void perl_object_setref(SV *sv, void *data, const char *package);
+
+enum perl_collection
+{
+	PERL_COLLECTION_USERS,
+	PERL_COLLECTION_CHANNELS,
+	PERL_COLLECTION_ACCOUNTS,
+};
+
+void perl_foreach_chunk(enum perl_collection what, int size, SV *code);
 
 #endif /* !ATHEME_MOD_SCRIPTING_PERL_API_ATHEME_PERL_H */
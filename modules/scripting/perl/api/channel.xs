@@ -7,6 +7,11 @@ CODE:
 OUTPUT:
 	RETVAL
 
+void
+foreach_chunk(SV * package, int size, SV * code)
+CODE:
+	perl_foreach_chunk(PERL_COLLECTION_CHANNELS, size, code);
+
 const char *
 name(Atheme_Channel self)
 CODE:
@@ -3,7 +3,7 @@
 MODULE = Atheme			PACKAGE = Atheme::Internal::Hooklist
 
 void
-enable_perl_hook_handler(const char *hookname)
+enable_perl_hook_handler(const char *hookname, SV *hooklist)
 
 void
 disable_perl_hook_handler(const char *hookname)
@@ -12,13 +12,20 @@ my %arg_types;
 # THIS LIST IS NOT A SUBSTITUTE FOR ACTUALLY DEFINING HOOK STRUCTURES. IT IS FOR STRUCTURES
 # WITH MEMBERS THAT WE CAN'T SUPPORT YET.
 my @unsupported_types = (
+	'struct connection',
 	'struct database_handle',
 	'struct hook_channel_acl_req',
+	'struct hook_chanacs_replace',
+	'struct hook_config_block_change',
 	'struct hook_host_request',
+	'struct hook_metadata_req',
 	'struct hook_module_load',
 	'struct hook_myentity_req',
+	'struct hook_myuser_password',
+	'struct hook_myuser_purge',
 	'struct hook_user_login_check',
 	'struct hook_user_logout_check',
+	'struct hook_user_netsplit',
 	'struct hook_user_rename_check',
 	'struct mygroup',
 	'struct sasl_message',
@@ -231,6 +238,16 @@ typedef enum {
 	PERL_HOOK_FROM_PERL
 } perl_hook_marshal_direction_t;
 
+EOF
+
+# What each enabled hook dispatches to, bound when it is enabled.
+
+foreach my $hookname (sort keys %hooks) {
+	print $outfile "static struct perl_hook_binding perl_hook_binding_$hookname;\n";
+}
+
+print $outfile <<EOF;
+
 #include "perl_hooks_extra.h"
 
 EOF
@@ -353,26 +370,7 @@ static void perl_hook_$hookname ($arg_type * data)
 	SV *arg;
 	perl_hook_marshal_$arg_type_underscored(PERL_HOOK_TO_PERL, data, &arg);
 
-	dSP;
-	ENTER;
-	SAVETMPS;
-	PUSHMARK(SP);
-
-	XPUSHs(newRV_noinc((SV*)get_cv("Atheme::Hooks::call_hooks", 0)));
-	XPUSHs(sv_2mortal(newSVpv("$hookname", 0)));
-	XPUSHs(arg);
-	PUTBACK;
-	call_pv("Atheme::Init::call_wrapper", G_EVAL | G_DISCARD);
-
-	SPAGAIN;
-
-	if (SvTRUE(ERRSV))
-	{
-		slog(LG_ERROR, "Calling perl hook $hookname raised unexpected error %s", SvPV_nolen(ERRSV));
-	}
-
-	FREETMPS;
-	LEAVE;
+	perl_hook_dispatch(&perl_hook_binding_$hookname, "$hookname", arg);
 
 	perl_hook_marshal_$arg_type_underscored(PERL_HOOK_FROM_PERL, data, &arg);
 	SvREFCNT_dec(arg);
@@ -387,12 +385,13 @@ EOF
 
 print $outfile <<EOF;
 
-void enable_perl_hook_handler(const char *hookname)
+void enable_perl_hook_handler(const char *hookname, SV *hooklist)
 {
 EOF
 foreach my $hookname (sort keys %hooks) {
 	print $outfile <<"EOF";
 	if (0 == strcmp(hookname, "$hookname")) {
+		perl_hook_bind(&perl_hook_binding_$hookname, hooklist);
 		hook_add_$hookname(perl_hook_$hookname);
 		return;
 	}
@@ -411,6 +410,7 @@ foreach my $hookname (sort keys %hooks) {
 	print $outfile <<"EOF";
 	if (0 == strcmp(hookname, "$hookname")) {
 		hook_del_$hookname(perl_hook_$hookname);
+		perl_hook_unbind(&perl_hook_binding_$hookname);
 		return;
 	}
 EOF
@@ -10,7 +10,18 @@
 
 #include "atheme_perl.h"
 
-void enable_perl_hook_handler(const char * hookname);
+/* What an enabled hook calls, looked up once when it is enabled rather than
+ * by name on every event: Atheme::Init::call_wrapper, to run the
+ * Atheme::Internal::Hooklist::call_hooks method of the hook's list.
+ */
+struct perl_hook_binding
+{
+	SV * hooklist;
+	SV * call_hooks;
+	SV * call_wrapper;
+};
+
+void enable_perl_hook_handler(const char * hookname, SV * hooklist);
 void disable_perl_hook_handler(const char * hookname);
 
 #endif /* !ATHEME_MOD_SCRIPTING_PERL_API_PERL_HOOKS_H */
@@ -10,6 +10,60 @@
 
 #include <atheme.h>
 
+static void perl_hook_unbind(struct perl_hook_binding * b)
+{
+	if (b->hooklist != NULL)
+		SvREFCNT_dec(b->hooklist);
+	if (b->call_hooks != NULL)
+		SvREFCNT_dec(b->call_hooks);
+	if (b->call_wrapper != NULL)
+		SvREFCNT_dec(b->call_wrapper);
+
+	b->hooklist = b->call_hooks = b->call_wrapper = NULL;
+}
+
+static void perl_hook_bind(struct perl_hook_binding * b, SV * hooklist)
+{
+	CV *call_hooks = get_cv("Atheme::Internal::Hooklist::call_hooks", 0);
+	CV *call_wrapper = get_cv("Atheme::Init::call_wrapper", 0);
+
+	if (call_hooks == NULL || call_wrapper == NULL)
+	{
+		dTHX;
+		Perl_croak(aTHX_ "Couldn't find the perl hook dispatch functions");
+	}
+
+	perl_hook_unbind(b);
+
+	b->hooklist = newSVsv(hooklist);
+	b->call_hooks = newRV_inc((SV*)call_hooks);
+	b->call_wrapper = SvREFCNT_inc((SV*)call_wrapper);
+}
+
+static void perl_hook_dispatch(const struct perl_hook_binding * b, const char * hookname, SV * arg)
+{
+	dSP;
+	ENTER;
+	SAVETMPS;
+	PUSHMARK(SP);
+
+	XPUSHs(b->call_hooks);
+	XPUSHs(b->hooklist);
+	XPUSHs(arg);
+	PUTBACK;
+	call_sv(b->call_wrapper, G_EVAL | G_DISCARD);
+
+	SPAGAIN;
+
+	if (SvTRUE(ERRSV))
+	{
+		slog(LG_ERROR, "Calling perl hook %s raised unexpected error %s", hookname, SvPV_nolen(ERRSV));
+	}
+
+	FREETMPS;
+	LEAVE;
+}
+
 /*
  * Special-case. Pass undef to the handler routine where it takes no argument.
  */
@@ -35,7 +89,7 @@ static void perl_hook_marshal_struct_hook_expiry_req(perl_hook_marshal_direction
 		 * converted to before use. */
 		sv_tmp = bless_pointer_to_package(data->data.mc, packagename);
 		hv_store(hash, argname, strlen(argname), sv_tmp, 0);
-		sv_setiv(sv_tmp, data->do_expire);
+		sv_tmp = newSViv(data->do_expire);
 		hv_store(hash, "do_expire", 8, sv_tmp, 0);
 
 		*psv = newRV_noinc((SV*)hash);
@@ -54,24 +108,13 @@ static void perl_hook_marshal_struct_hook_expiry_req(perl_hook_marshal_direction
  * structure but need to populate it in different ways.
  */
 
-static void perl_hook_expiry_check(struct hook_expiry_req * data, const char *hookname, const char *packagename, const char * argname)
+static void perl_hook_expiry_check(struct hook_expiry_req * data, const struct perl_hook_binding * b, const char *hookname,
+		const char *packagename, const char * argname)
 {
 	SV *arg;
-	perl_hook_marshal_struct_hook_expiry_req(PERL_HOOK_TO_PERL, data, &arg, packagename, argname);
+	perl_hook_marshal_struct_hook_expiry_req(PERL_HOOK_TO_PERL, data, &arg, argname, packagename);
 
-	dSP;
-	ENTER;
-	SAVETMPS;
-	PUSHMARK(SP);
-
-	XPUSHs(sv_2mortal(newRV_noinc((SV*)get_cv("Atheme::Hooks::call_hooks", 0))));
-	XPUSHs(sv_2mortal(newSVpv(hookname, 0)));
-	XPUSHs(arg);
-	call_pv("Atheme::Init::call_wrapper", G_EVAL | G_DISCARD);
-
-	SPAGAIN;
-	FREETMPS;
-	LEAVE;
+	perl_hook_dispatch(b, hookname, arg);
 
 	perl_hook_marshal_struct_hook_expiry_req(PERL_HOOK_FROM_PERL, data, &arg, NULL, NULL);
 	SvREFCNT_dec(arg);
@@ -82,17 +125,17 @@ static void perl_hook_expiry_check(struct hook_expiry_req * data, const char *ho
 
 static void perl_hook_user_check_expire(struct hook_expiry_req * data)
 {
-	perl_hook_expiry_check(data, "user_check_expire", "Atheme::Account", "account");
+	perl_hook_expiry_check(data, &perl_hook_binding_user_check_expire, "user_check_expire", "Atheme::Account", "account");
 }
 
 static void perl_hook_nick_check_expire(struct hook_expiry_req * data)
 {
-	perl_hook_expiry_check(data, "nick_check_expire", "Atheme::NickRegistration", "nick");
+	perl_hook_expiry_check(data, &perl_hook_binding_nick_check_expire, "nick_check_expire", "Atheme::NickRegistration", "nick");
 }
 
 static void perl_hook_channel_check_expire(struct hook_expiry_req * data)
 {
-	perl_hook_expiry_check(data, "channel_check_expire", "Atheme::ChannelRegistration", "channel");
+	perl_hook_expiry_check(data, &perl_hook_binding_channel_check_expire, "channel_check_expire", "Atheme::ChannelRegistration", "channel");
 }
 
 #endif /* !ATHEME_MOD_SCRIPTING_PERL_API_PERL_HOOKS_EXTRA_H */
@@ -9,22 +9,178 @@
 #include "atheme_perl.h"
 
 static void (*real_register_object_reference)(SV *) = NULL;
+static SV *(*real_find_object_reference)(const void *, const char *) = NULL;
+static mowgli_node_t *(*real_mark_object_references)(void) = NULL;
+static void (*real_invalidate_object_references_since)(mowgli_node_t *) = NULL;
 static void (*real_invalidate_object_references)(void) = NULL;
 
+/* Makes sv a reference to the wrapper for data, blessed into package; an
+ * object that already has one (since references were last invalidated)
+ * shares it rather than getting its own.
+ */
+void
+perl_object_setref(SV *sv, void *data, const char *package)
+{
+	SV *cached = find_object_reference(data, package);
+
+	if (cached != NULL)
+	{
+		sv_setsv(sv, cached);
+		return;
+	}
+
+	sv_setref_pv(sv, package, data);
+	register_object_reference(sv);
+}
+
 SV *
 bless_pointer_to_package(void *data, const char *package)
 {
 	SV *ret = newSV(0);
-	sv_setref_pv(ret, package, data);
 
 	/* If this function is being called, then the XS method in question
 	 * is declared as returning SV*, which means the magic typemap code
 	 * doesn't get called, and we have to do this manually.
 	 */
-	register_object_reference(ret);
+	perl_object_setref(ret, data, package);
 	return ret;
 }
 
+static const char *
+perl_collection_package(const enum perl_collection what)
+{
+	switch (what)
+	{
+		case PERL_COLLECTION_USERS:
+			return "Atheme::User";
+		case PERL_COLLECTION_CHANNELS:
+			return "Atheme::Channel";
+		case PERL_COLLECTION_ACCOUNTS:
+			return "Atheme::Account";
+	}
+
+	return NULL;
+}
+
+static void *
+perl_collection_find(const enum perl_collection what, const char *name)
+{
+	switch (what)
+	{
+		case PERL_COLLECTION_USERS:
+			return user_find_named(name);
+		case PERL_COLLECTION_CHANNELS:
+			return channel_find(name);
+		case PERL_COLLECTION_ACCOUNTS:
+			return myuser_find(name);
+	}
+
+	return NULL;
+}
+
+static void
+perl_names_add(stringref **names, size_t *count, size_t *alloc, const char *name)
+{
+	if (*count == *alloc)
+	{
+		*alloc = *alloc ? (*alloc * 2) : 256;
+		*names = srealloc(*names, *alloc * sizeof **names);
+	}
+
+	(*names)[(*count)++] = strshare_get(name);
+}
+
+/* Calls code with the users, channels or accounts, up to size at a time.
+ * Only their names are taken up front, and looked up again for each chunk,
+ * so that the callback may change the lists; anything that went away by
+ * then is skipped. The wrappers made during a call are invalidated when it
+ * returns, so that iterating over everything does not keep one for every
+ * object alive until the end.
+ */
+void
+perl_foreach_chunk(enum perl_collection what, int size, SV *code)
+{
+	dTHX;
+
+	const char *package = perl_collection_package(what);
+	stringref *names = NULL;
+	size_t count = 0, alloc = 0;
+	void **chunk;
+	bool failed = false;
+
+	if (size < 1)
+		Perl_croak(aTHX_ "Chunk size must be positive");
+
+	if (what == PERL_COLLECTION_USERS)
+	{
+		mowgli_patricia_iteration_state_t state;
+		struct user *u;
+
+		MOWGLI_PATRICIA_FOREACH(u, &state, userlist)
+			perl_names_add(&names, &count, &alloc, u->nick);
+	}
+	else if (what == PERL_COLLECTION_CHANNELS)
+	{
+		mowgli_patricia_iteration_state_t state;
+		struct channel *c;
+
+		MOWGLI_PATRICIA_FOREACH(c, &state, chanlist)
+			perl_names_add(&names, &count, &alloc, c->name);
+	}
+	else
+	{
+		struct myentity_iteration_state state;
+		struct myentity *mt;
+
+		MYENTITY_FOREACH_T(mt, &state, ENT_USER)
+			perl_names_add(&names, &count, &alloc, mt->name);
+	}
+
+	chunk = smalloc((size_t) size * sizeof *chunk);
+
+	for (size_t i = 0; i < count && !failed; )
+	{
+		size_t n = 0;
+
+		for (; i < count && n < (size_t) size; i++)
+			if ((chunk[n] = perl_collection_find(what, names[i])) != NULL)
+				n++;
+
+		if (n == 0)
+			continue;
+
+		mowgli_node_t *mark = mark_object_references();
+
+		dSP;
+		ENTER;
+		SAVETMPS;
+		PUSHMARK(SP);
+
+		for (size_t j = 0; j < n; j++)
+			XPUSHs(sv_2mortal(bless_pointer_to_package(chunk[j], package)));
+
+		PUTBACK;
+		call_sv(code, G_DISCARD | G_EVAL);
+
+		failed = SvTRUE(ERRSV);
+
+		FREETMPS;
+		LEAVE;
+
+		invalidate_object_references_since(mark);
+	}
+
+	for (size_t i = 0; i < count; i++)
+		strshare_unref(names[i]);
+
+	sfree(names);
+	sfree(chunk);
+
+	// Passes the callback's error on
+	if (failed)
+		Perl_croak(aTHX_ NULL);
+}
+
 void
 register_object_reference(SV *sv)
 {
@@ -40,6 +196,52 @@ register_object_reference(SV *sv)
 	real_register_object_reference(sv);
 }
 
+SV *
+find_object_reference(const void *data, const char *package)
+{
+	if (real_find_object_reference == NULL)
+	{
+		real_find_object_reference = module_locate_symbol(PERL_MODULE_NAME, "find_object_reference");
+		if (real_find_object_reference == NULL)
+		{
+			dTHX;
+			Perl_croak(aTHX_ "Couldn't locate symbol find_object_reference in " PERL_MODULE_NAME);
+		}
+	}
+	return real_find_object_reference(data, package);
+}
+
+mowgli_node_t *
+mark_object_references(void)
+{
+	if (real_mark_object_references == NULL)
+	{
+		real_mark_object_references = module_locate_symbol(PERL_MODULE_NAME, "mark_object_references");
+		if (real_mark_object_references == NULL)
+		{
+			dTHX;
+			Perl_croak(aTHX_ "Couldn't locate symbol mark_object_references in " PERL_MODULE_NAME);
+		}
+	}
+	return real_mark_object_references();
+}
+
+void
+invalidate_object_references_since(mowgli_node_t *mark)
+{
+	if (real_invalidate_object_references_since == NULL)
+	{
+		real_invalidate_object_references_since = module_locate_symbol(PERL_MODULE_NAME,
+									"invalidate_object_references_since");
+		if (real_invalidate_object_references_since == NULL)
+		{
+			dTHX;
+			Perl_croak(aTHX_ "Couldn't locate symbol invalidate_object_references_since in " PERL_MODULE_NAME);
+		}
+	}
+	real_invalidate_object_references_since(mark);
+}
+
 void
 invalidate_object_references(void)
 {
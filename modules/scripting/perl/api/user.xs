@@ -7,6 +7,11 @@ CODE:
 OUTPUT:
 	RETVAL
 
+void
+foreach_chunk(SV * package, int size, SV * code)
+CODE:
+	perl_foreach_chunk(PERL_COLLECTION_USERS, size, code);
+
 const char *
 nick(Atheme_User self)
 CODE:
@@ -45,7 +50,7 @@ OUTPUT:
 const char *
 gecos(Atheme_User self)
 CODE:
-	RETVAL = self->gecos;
+	RETVAL = user_gecos(self);
 OUTPUT:
 	RETVAL
 
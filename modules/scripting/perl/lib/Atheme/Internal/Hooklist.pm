@@ -24,7 +24,7 @@ sub add_hook {
 	push @{$Atheme::Hooks::hooks_by_package{$caller}}, { list => $self, hook => $hook };
 
 	if (scalar @{$self->{hooks}} == 0) {
-		enable_perl_hook_handler($self->{name})
+		enable_perl_hook_handler($self->{name}, $self)
 	}
 
 	push @{$self->{hooks}}, $hook;
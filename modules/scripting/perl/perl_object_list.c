@@ -10,10 +10,33 @@
 
 static mowgli_list_t * perl_object_references = NULL;
 
+/* The registered references by what they point to, so that an object handed
+ * to Perl again before they are invalidated gets the wrapper it already has
+ * instead of another one. Keys are "package:address".
+ */
+static mowgli_patricia_t * perl_object_index = NULL;
+
+static void
+object_reference_key(char *buf, size_t len, const void *data, const char *package)
+{
+	snprintf(buf, len, "%s:%p", package, data);
+}
+
+static void
+object_reference_key_sv(char *buf, size_t len, SV *sv)
+{
+	dTHX;
+
+	SV *ref = SvRV(sv);
+
+	object_reference_key(buf, len, INT2PTR(void *, SvIVX(ref)), HvNAME(SvSTASH(ref)));
+}
+
 void
 register_object_reference(SV * sv)
 {
 	dTHX;
+	char key[BUFSIZE];
 
 	if (!sv_isobject(sv))
 		Perl_croak(aTHX_ "Attempted to register an object reference that isn't");
@@ -21,7 +44,81 @@ register_object_reference(SV * sv)
 	if (perl_object_references == NULL)
 		perl_object_references = mowgli_list_create();
 
+	if (perl_object_index == NULL)
+		perl_object_index = mowgli_patricia_create(noopcanon);
+
 	mowgli_node_add(SvREFCNT_inc(sv), mowgli_node_create(), perl_object_references);
+
+	object_reference_key_sv(key, sizeof key, sv);
+
+	if (mowgli_patricia_retrieve(perl_object_index, key) == NULL)
+		mowgli_patricia_add(perl_object_index, key, sv);
+}
+
+SV *
+find_object_reference(const void *data, const char *package)
+{
+	char key[BUFSIZE];
+
+	if (perl_object_index == NULL)
+		return NULL;
+
+	object_reference_key(key, sizeof key, data, package);
+
+	return mowgli_patricia_retrieve(perl_object_index, key);
+}
+
+mowgli_node_t *
+mark_object_references(void)
+{
+	if (perl_object_references == NULL)
+		return NULL;
+
+	return perl_object_references->tail;
+}
+
+static void
+invalidate_object_reference(mowgli_node_t *n)
+{
+	dTHX;
+
+	SV *sv = n->data;
+	SV *ref = SvRV(sv);
+	if (!sv_isobject(sv))
+		slog(LG_ERROR, "invalidate_object_references: found object reference that isn't");
+	else
+	{
+		if (perl_object_index != NULL)
+		{
+			char key[BUFSIZE];
+
+			object_reference_key_sv(key, sizeof key, sv);
+
+			if (mowgli_patricia_retrieve(perl_object_index, key) == sv)
+				(void) mowgli_patricia_delete(perl_object_index, key);
+		}
+
+		SvIVX(ref) = invalid_object_pointer;
+	}
+
+	SvREFCNT_dec(sv);
+	mowgli_node_delete(n, perl_object_references);
+	mowgli_node_free(n);
+}
+
+/* Invalidates only the references registered after mark was taken with
+ * mark_object_references(), e.g. those made for one chunk of an iteration.
+ */
+void
+invalidate_object_references_since(mowgli_node_t *mark)
+{
+	mowgli_node_t *n;
+
+	if (perl_object_references == NULL)
+		return;
+
+	while ((n = perl_object_references->tail) != NULL && n != mark)
+		invalidate_object_reference(n);
 }
 
 void
@@ -33,18 +130,7 @@ invalidate_object_references(void)
 		return;
 
 	while ((n = perl_object_references->head) != NULL)
-	{
-		SV *sv = n->data;
-		SV *ref = SvRV(sv);
-		if (!sv_isobject(sv))
-			slog(LG_ERROR, "invalidate_object_references: found object reference that isn't");
-		else
-			SvIVX(ref) = invalid_object_pointer;
-
-		SvREFCNT_dec(sv);
-		mowgli_node_delete(n, perl_object_references);
-		mowgli_node_free(n);
-	}
+		invalidate_object_reference(n);
 }
 
 void
@@ -52,6 +138,12 @@ free_object_list(void)
 {
 	mowgli_node_t *n;
 
+	if (perl_object_index != NULL)
+	{
+		mowgli_patricia_destroy(perl_object_index, NULL, NULL);
+		perl_object_index = NULL;
+	}
+
 	if (perl_object_references == NULL)
 		return;
 
@@ -0,0 +1,103 @@
+/*
+ * SPDX-License-Identifier: ISC
+ * SPDX-URL: https://spdx.org/licenses/ISC.html
+ *
+ * Copyright (C) 2026 Atheme Development Group (https://atheme.github.io/)
+ *
+ * Network size over time.
+ */
+
+#include <atheme.h>
+
+#define SS_HISTORY_DEFAULT_COUNT        10U
+
+static void
+ss_history_print(struct sourceinfo *const restrict si, const struct netstats_sample *const restrict sample)
+{
+	const struct netstats_value *const users = &sample->values[NETSTATS_USERS];
+	const struct netstats_value *const chans = &sample->values[NETSTATS_CHANNELS];
+	const struct netstats_value *const servs = &sample->values[NETSTATS_SERVERS];
+
+	char strfbuf[BUFSIZE];
+	const struct tm *const tm = localtime(&sample->start);
+
+	(void) strftime(strfbuf, sizeof strfbuf, TIME_FORMAT, tm);
+
+	(void) command_success_nodata(si, _("%s: users %u (peak %u, +%u/-%u), channels %u (peak %u, +%u/-%u), "
+	                                    "servers %u (peak %u, +%u/-%u)"), strfbuf,
+	                              users->last, users->peak, users->added, users->removed,
+	                              chans->last, chans->peak, chans->added, chans->removed,
+	                              servs->last, servs->peak, servs->added, servs->removed);
+}
+
+static void
+ss_history_print_cb(const struct netstats_sample *const restrict sample, void *const restrict si)
+{
+	(void) ss_history_print(si, sample);
+}
+
+static void
+ss_cmd_history(struct sourceinfo *const restrict si, const int parc, char **const restrict parv)
+{
+	enum netstats_resolution res;
+	struct netstats_sample current;
+	unsigned int count = SS_HISTORY_DEFAULT_COUNT;
+
+	if (parc < 1)
+	{
+		(void) command_fail(si, fault_needmoreparams, STR_INSUFFICIENT_PARAMS, "HISTORY");
+		(void) command_fail(si, fault_needmoreparams, _("Syntax: HISTORY <MINUTE|HOUR|DAY> [count]"));
+		return;
+	}
+
+	if (! netstats_resolution_parse(parv[0], &res))
+	{
+		(void) command_fail(si, fault_badparams, STR_INVALID_PARAMS, "HISTORY");
+		(void) command_fail(si, fault_badparams, _("Syntax: HISTORY <MINUTE|HOUR|DAY> [count]"));
+		return;
+	}
+
+	if (parc > 1 && ! string_to_uint(parv[1], &count))
+	{
+		(void) command_fail(si, fault_badparams, STR_INVALID_PARAMS, "HISTORY");
+		(void) command_fail(si, fault_badparams, _("Syntax: HISTORY <MINUTE|HOUR|DAY> [count]"));
+		return;
+	}
+
+	if (count > netstats_resolution_size(res))
+		count = netstats_resolution_size(res);
+
+	(void) command_success_nodata(si, _("Network size per %s, newest first:"), netstats_resolution_name(res));
+
+	if (netstats_current(res, &current))
+		(void) ss_history_print(si, &current);
+
+	(void) netstats_history_foreach(res, count, &ss_history_print_cb, si);
+
+	(void) command_success_nodata(si, _("End of network history."));
+}
+
+static struct command ss_history = {
+	.name           = "HISTORY",
+	.desc           = N_("Shows how the size of the network has changed."),
+	.access         = AC_NONE,
+	.maxparc        = 2,
+	.cmd            = &ss_cmd_history,
+	.help           = { .path = "statserv/history" },
+};
+
+static void
+mod_init(struct module *const restrict m)
+{
+	MODULE_TRY_REQUEST_DEPENDENCY(m, "statserv/main")
+
+	(void) service_named_bind_command("statserv", &ss_history);
+}
+
+static void
+mod_deinit(const enum module_unload_intent ATHEME_VATTR_UNUSED intent)
+{
+	(void) service_named_unbind_command("statserv", &ss_history);
+}
+
+SIMPLE_DECLARE_MODULE_V1("statserv/history", MODULE_UNLOAD_CAPABILITY_OK)
@@ -8,6 +8,10 @@
 #include <atheme.h>
 #include <atheme/pbkdf2.h>
 
+#define PWHASHES_HOURS              168U
+#define PWHASHES_DAYS               366U
+#define PWHASHES_DEFAULT_COUNT      10U
+
 #define SCANFMT_BASE64_CRYPT3       "%[" BASE64_ALPHABET_CRYPT3 "]"
 #define SCANFMT_BASE64_RFC4648      "%[" BASE64_ALPHABET_RFC4648 "]"
 #define SCANFMT_HEXADECIMAL         "%[A-Fa-f0-9]"
@@ -131,190 +135,483 @@ crypto_type_to_name(const enum crypto_type type)
 	return NULL;
 }
 
-static void
-ss_cmd_pwhashes_func(struct sourceinfo *const restrict si, const int ATHEME_VATTR_UNUSED parc,
-                     char ATHEME_VATTR_UNUSED **const restrict parv)
+struct pwhash_paramset
 {
-	(void) logcommand(si, CMDLOG_GET, "PWHASHES");
+	enum crypto_type        type;
+	char                    params[64];
+	unsigned int            count;
+};
 
-	unsigned int pwhashes[TYPE_TOTAL_COUNT];
+struct pwhash_provider
+{
+	char                    id[64];
+	unsigned int            count;
+};
 
-	(void) memset(&pwhashes, 0x00, sizeof pwhashes);
+struct pwhash_sample
+{
+	time_t                  when;
+	unsigned int            accounts;
+	unsigned int            encrypted;
+	unsigned int            current;
+	unsigned int            plaintext;
+	char                    provider[64];   // the default one, then
+};
 
-	struct myentity *mt;
-	struct myentity_iteration_state state;
+struct pwhash_ring
+{
+	const char *            name;
+	unsigned int            size;
+	unsigned int            head;
+	unsigned int            count;
+	struct pwhash_sample *  samples;
+};
+
+static unsigned int pwhashes[TYPE_TOTAL_COUNT];
+static unsigned int pwhashes_accounts = 0;
+static unsigned int pwhashes_encrypted = 0;
+
+// Keyed by type and parameters; only hashes that have parameters are in here
+static mowgli_patricia_t *pwhash_paramsets = NULL;
+
+// Keyed by the ID of the crypto provider that recognised the hash when it was counted
+static mowgli_patricia_t *pwhash_providers = NULL;
+
+static struct pwhash_sample pwhash_hour_samples[PWHASHES_HOURS];
+static struct pwhash_sample pwhash_day_samples[PWHASHES_DAYS];
+
+static struct pwhash_ring pwhash_rings[] = {
+	{ "HOUR", PWHASHES_HOURS, 0, 0, pwhash_hour_samples },
+	{ "DAY",  PWHASHES_DAYS,  0, 0, pwhash_day_samples },
+};
+
+static mowgli_eventloop_timer_t *pwhash_sample_timer = NULL;
+
+/* Works out what kind of hash pw is, and writes its cost parameters (if it
+ * has any, and they are not the same for every hash of its kind) to params.
+ */
+static enum crypto_type
+pwhash_classify(const char *const restrict pw, const bool crypted, char *const restrict params, const size_t len)
+{
+	enum crypto_type type = TYPE_UNKNOWN;
 
 	char s1[BUFSIZE];
 	char s2[BUFSIZE];
 	char s3[BUFSIZE];
-	char s4[BUFSIZE];
 	unsigned int i1;
 	unsigned int i2;
 	unsigned int i3;
 	unsigned int i4;
 
-	MYENTITY_FOREACH_T(mt, &state, ENT_USER)
-	{
-		const struct myuser *const mu = user(mt);
+	const size_t pwlen = strlen(pw);
 
-		continue_if_fail(mu != NULL);
+	*params = '\0';
 
-		const char *const pw = mu->pass;
-		const size_t pwlen = strlen(pw);
+	if (! crypted)
+	{
+		type = TYPE_NONE;
+	}
+	else if (sscanf(pw, SCANFMT_ANOPE_ENC_SHA256, s1, s2) == 2)
+	{
+		type = TYPE_ANOPE_ENC_SHA256;
+	}
+	else if (sscanf(pw, SCANFMT_ARGON2, s1, &i1, &i2, &i3, &i4, s2, s3) == 7)
+	{
+		if (strcasecmp(s1, "argon2d") == 0)
+			type = TYPE_ARGON2D;
+		else if (strcasecmp(s1, "argon2i") == 0)
+			type = TYPE_ARGON2I;
+		else if (strcasecmp(s1, "argon2id") == 0)
+			type = TYPE_ARGON2ID;
 
-		if (! (mu->flags & MU_CRYPTPASS))
-		{
-			pwhashes[TYPE_NONE]++;
-		}
-		else if (sscanf(pw, SCANFMT_ANOPE_ENC_SHA256, s1, s2) == 2)
-		{
-			pwhashes[TYPE_ANOPE_ENC_SHA256]++;
-		}
-		else if (sscanf(pw, SCANFMT_ARGON2, s1, &i1, &i2, &i3, &i4, s2, s3) == 7)
-		{
-			if (strcasecmp(s1, "argon2d") == 0)
-				pwhashes[TYPE_ARGON2D]++;
-			else if (strcasecmp(s1, "argon2i") == 0)
-				pwhashes[TYPE_ARGON2I]++;
-			else if (strcasecmp(s1, "argon2id") == 0)
-				pwhashes[TYPE_ARGON2ID]++;
-			else
-				pwhashes[TYPE_UNKNOWN]++;
-		}
-		else if (sscanf(pw, SCANFMT_BASE64, s1) == 1)
-		{
-			pwhashes[TYPE_BASE64]++;
-		}
-		else if (pwlen >= 60U && sscanf(pw, SCANFMT_BCRYPT, s1, &i1, s2, s3) == 4)
-		{
-			pwhashes[TYPE_BCRYPT]++;
-		}
-		else if (pwlen == 13U && sscanf(pw, SCANFMT_CRYPT3_DES, s1) == 1 && strcmp(s1, pw) == 0)
-		{
-			// Fuzzy (no rigid format)
-			pwhashes[TYPE_CRYPT3_DES]++;
-		}
-		else if (sscanf(pw, SCANFMT_CRYPT3_MD5, s1, s2) == 2)
-		{
-			pwhashes[TYPE_CRYPT3_MD5]++;
-		}
-		else if (sscanf(pw, SCANFMT_CRYPT3_SHA2_256, s1, s2) == 2)
-		{
-			pwhashes[TYPE_CRYPT3_SHA2_256]++;
-		}
-		else if (sscanf(pw, SCANFMT_CRYPT3_SHA2_256_EXT, &i1, s1, s2) == 3)
-		{
-			pwhashes[TYPE_CRYPT3_SHA2_256]++;
-		}
-		else if (sscanf(pw, SCANFMT_CRYPT3_SHA2_512, s1, s2) == 2)
-		{
-			pwhashes[TYPE_CRYPT3_SHA2_512]++;
-		}
-		else if (sscanf(pw, SCANFMT_CRYPT3_SHA2_512_EXT, &i1, s1, s2) == 3)
-		{
-			pwhashes[TYPE_CRYPT3_SHA2_512]++;
-		}
-		else if (sscanf(pw, SCANFMT_IRCSERVICES, s1) == 1)
+		if (type != TYPE_UNKNOWN)
+			(void) snprintf(params, len, "v=%u m=%u t=%u p=%u", i1, i2, i3, i4);
+	}
+	else if (sscanf(pw, SCANFMT_BASE64, s1) == 1)
+	{
+		type = TYPE_BASE64;
+	}
+	else if (pwlen >= 60U && sscanf(pw, SCANFMT_BCRYPT, s1, &i1, s2, s3) == 4)
+	{
+		type = TYPE_BCRYPT;
+		(void) snprintf(params, len, "cost=%u", i1);
+	}
+	else if (pwlen == 13U && sscanf(pw, SCANFMT_CRYPT3_DES, s1) == 1 && strcmp(s1, pw) == 0)
+	{
+		// Fuzzy (no rigid format)
+		type = TYPE_CRYPT3_DES;
+	}
+	else if (sscanf(pw, SCANFMT_CRYPT3_MD5, s1, s2) == 2)
+	{
+		type = TYPE_CRYPT3_MD5;
+	}
+	else if (sscanf(pw, SCANFMT_CRYPT3_SHA2_256, s1, s2) == 2)
+	{
+		type = TYPE_CRYPT3_SHA2_256;
+		(void) mowgli_strlcpy(params, "rounds=5000", len);
+	}
+	else if (sscanf(pw, SCANFMT_CRYPT3_SHA2_256_EXT, &i1, s1, s2) == 3)
+	{
+		type = TYPE_CRYPT3_SHA2_256;
+		(void) snprintf(params, len, "rounds=%u", i1);
+	}
+	else if (sscanf(pw, SCANFMT_CRYPT3_SHA2_512, s1, s2) == 2)
+	{
+		type = TYPE_CRYPT3_SHA2_512;
+		(void) mowgli_strlcpy(params, "rounds=5000", len);
+	}
+	else if (sscanf(pw, SCANFMT_CRYPT3_SHA2_512_EXT, &i1, s1, s2) == 3)
+	{
+		type = TYPE_CRYPT3_SHA2_512;
+		(void) snprintf(params, len, "rounds=%u", i1);
+	}
+	else if (sscanf(pw, SCANFMT_IRCSERVICES, s1) == 1)
+	{
+		type = TYPE_IRCSERVICES;
+	}
+	else if (pwlen == 144U && sscanf(pw, SCANFMT_PBKDF2, s1, s2) == 2 &&
+	         strlen(s1) == 16U && strlen(s2) == 128U)
+	{
+		// Fuzzy (no rigid format)
+		type = TYPE_PBKDF2;
+	}
+	else if (sscanf(pw, SCANFMT_PBKDF2V2_SCRAM, &i1, &i2, s1, s2, s3) == 5)
+	{
+		switch (i1)
 		{
-			pwhashes[TYPE_IRCSERVICES]++;
+			case PBKDF2_PRF_SCRAM_MD5:
+			case PBKDF2_PRF_SCRAM_MD5_S64:
+				type = TYPE_PBKDF2V2_SCRAM_MD5;
+				break;
+			case PBKDF2_PRF_SCRAM_SHA1:
+			case PBKDF2_PRF_SCRAM_SHA1_S64:
+				type = TYPE_PBKDF2V2_SCRAM_SHA1;
+				break;
+			case PBKDF2_PRF_SCRAM_SHA2_256:
+			case PBKDF2_PRF_SCRAM_SHA2_256_S64:
+				type = TYPE_PBKDF2V2_SCRAM_SHA2_256;
+				break;
+			case PBKDF2_PRF_SCRAM_SHA2_512:
+			case PBKDF2_PRF_SCRAM_SHA2_512_S64:
+				type = TYPE_PBKDF2V2_SCRAM_SHA2_512;
+				break;
 		}
-		else if (pwlen == 144U && sscanf(pw, SCANFMT_PBKDF2, s1, s2) == 2 &&
-		         strlen(s1) == 16U && strlen(s2) == 128U)
+
+		if (type != TYPE_UNKNOWN)
+			(void) snprintf(params, len, "iterations=%u", i2);
+	}
+	else if (sscanf(pw, SCANFMT_PBKDF2V2_HMAC, &i1, &i2, s1, s2) == 4)
+	{
+		switch (i1)
 		{
-			// Fuzzy (no rigid format)
-			pwhashes[TYPE_PBKDF2]++;
+			case PBKDF2_PRF_HMAC_MD5:
+			case PBKDF2_PRF_HMAC_MD5_S64:
+				type = TYPE_PBKDF2V2_HMAC_MD5;
+				break;
+			case PBKDF2_PRF_HMAC_SHA1:
+			case PBKDF2_PRF_HMAC_SHA1_S64:
+				type = TYPE_PBKDF2V2_HMAC_SHA1;
+				break;
+			case PBKDF2_PRF_HMAC_SHA2_256:
+			case PBKDF2_PRF_HMAC_SHA2_256_S64:
+				type = TYPE_PBKDF2V2_HMAC_SHA2_256;
+				break;
+			case PBKDF2_PRF_HMAC_SHA2_512:
+			case PBKDF2_PRF_HMAC_SHA2_512_S64:
+				type = TYPE_PBKDF2V2_HMAC_SHA2_512;
+				break;
 		}
-		else if (sscanf(pw, SCANFMT_PBKDF2V2_SCRAM, &i1, &i2, s1, s2, s3) == 5)
+
+		if (type != TYPE_UNKNOWN)
+			(void) snprintf(params, len, "iterations=%u", i2);
+	}
+	else if (sscanf(pw, SCANFMT_RAWMD5, s1) == 1)
+	{
+		type = TYPE_RAWMD5;
+	}
+	else if (sscanf(pw, SCANFMT_RAWSHA1, s1) == 1)
+	{
+		type = TYPE_RAWSHA1;
+	}
+	else if (sscanf(pw, SCANFMT_RAWSHA2_256, s1) == 1)
+	{
+		type = TYPE_RAWSHA2_256;
+	}
+	else if (sscanf(pw, SCANFMT_RAWSHA2_512, s1) == 1)
+	{
+		type = TYPE_RAWSHA2_512;
+	}
+	else if (sscanf(pw, SCANFMT_SCRYPT, &i1, &i2, &i3, s1, s2) == 5)
+	{
+		type = TYPE_SCRYPT;
+		(void) snprintf(params, len, "ln=%u r=%u p=%u", i1, i2, i3);
+	}
+
+	(void) smemzero(s1, sizeof s1);
+	(void) smemzero(s2, sizeof s2);
+	(void) smemzero(s3, sizeof s3);
+
+	return type;
+}
+
+// Never below zero, even if a provider came or went between counting a hash in and out
+static inline void
+pwhash_adjust(unsigned int *const restrict counter, const int delta)
+{
+	if (delta > 0)
+		(*counter)++;
+	else if (*counter > 0)
+		(*counter)--;
+}
+
+static void
+pwhash_count(const char *const restrict pw, const bool crypted, const int delta)
+{
+	char params[64];
+	char key[BUFSIZE];
+
+	const enum crypto_type type = pwhash_classify(pw, crypted, params, sizeof params);
+
+	(void) pwhash_adjust(&pwhashes_accounts, delta);
+	(void) pwhash_adjust(&pwhashes[type], delta);
+
+	if (params[0] != '\0')
+	{
+		struct pwhash_paramset *ps;
+
+		(void) snprintf(key, sizeof key, "%u %s", (unsigned int) type, params);
+
+		if (! (ps = mowgli_patricia_retrieve(pwhash_paramsets, key)) && delta > 0)
 		{
-			switch (i1)
-			{
-				case PBKDF2_PRF_SCRAM_MD5:
-				case PBKDF2_PRF_SCRAM_MD5_S64:
-					pwhashes[TYPE_PBKDF2V2_SCRAM_MD5]++;
-					break;
-				case PBKDF2_PRF_SCRAM_SHA1:
-				case PBKDF2_PRF_SCRAM_SHA1_S64:
-					pwhashes[TYPE_PBKDF2V2_SCRAM_SHA1]++;
-					break;
-				case PBKDF2_PRF_SCRAM_SHA2_256:
-				case PBKDF2_PRF_SCRAM_SHA2_256_S64:
-					pwhashes[TYPE_PBKDF2V2_SCRAM_SHA2_256]++;
-					break;
-				case PBKDF2_PRF_SCRAM_SHA2_512:
-				case PBKDF2_PRF_SCRAM_SHA2_512_S64:
-					pwhashes[TYPE_PBKDF2V2_SCRAM_SHA2_512]++;
-					break;
-				default:
-					pwhashes[TYPE_UNKNOWN]++;
-					break;
-			}
+			ps = smalloc(sizeof *ps);
+			ps->type = type;
+			(void) mowgli_strlcpy(ps->params, params, sizeof ps->params);
+			(void) mowgli_patricia_add(pwhash_paramsets, key, ps);
 		}
-		else if (sscanf(pw, SCANFMT_PBKDF2V2_HMAC, &i1, &i2, s1, s2) == 4)
+
+		if (ps)
 		{
-			switch (i1)
+			(void) pwhash_adjust(&ps->count, delta);
+
+			if (! ps->count)
 			{
-				case PBKDF2_PRF_HMAC_MD5:
-				case PBKDF2_PRF_HMAC_MD5_S64:
-					pwhashes[TYPE_PBKDF2V2_HMAC_MD5]++;
-					break;
-				case PBKDF2_PRF_HMAC_SHA1:
-				case PBKDF2_PRF_HMAC_SHA1_S64:
-					pwhashes[TYPE_PBKDF2V2_HMAC_SHA1]++;
-					break;
-				case PBKDF2_PRF_HMAC_SHA2_256:
-				case PBKDF2_PRF_HMAC_SHA2_256_S64:
-					pwhashes[TYPE_PBKDF2V2_HMAC_SHA2_256]++;
-					break;
-				case PBKDF2_PRF_HMAC_SHA2_512:
-				case PBKDF2_PRF_HMAC_SHA2_512_S64:
-					pwhashes[TYPE_PBKDF2V2_HMAC_SHA2_512]++;
-					break;
-				default:
-					pwhashes[TYPE_UNKNOWN]++;
-					break;
+				(void) mowgli_patricia_delete(pwhash_paramsets, key);
+				(void) sfree(ps);
 			}
 		}
-		else if (sscanf(pw, SCANFMT_RAWMD5, s1) == 1)
-		{
-			pwhashes[TYPE_RAWMD5]++;
-		}
-		else if (sscanf(pw, SCANFMT_RAWSHA1, s1) == 1)
-		{
-			pwhashes[TYPE_RAWSHA1]++;
-		}
-		else if (sscanf(pw, SCANFMT_RAWSHA2_256, s1) == 1)
-		{
-			pwhashes[TYPE_RAWSHA2_256]++;
-		}
-		else if (sscanf(pw, SCANFMT_RAWSHA2_512, s1) == 1)
-		{
-			pwhashes[TYPE_RAWSHA2_512]++;
-		}
-		else if (sscanf(pw, SCANFMT_SCRYPT, &i1, &i2, &i3, s1, s2) == 5)
-		{
-			pwhashes[TYPE_SCRYPT]++;
-		}
-		else
-		{
-			pwhashes[TYPE_UNKNOWN]++;
-		}
 	}
 
-	(void) smemzero(s1, sizeof s1);
-	(void) smemzero(s2, sizeof s2);
-	(void) smemzero(s3, sizeof s3);
-	(void) smemzero(s4, sizeof s4);
+	if (! crypted)
+		return;
+
+	(void) pwhash_adjust(&pwhashes_encrypted, delta);
+
+	const struct crypt_impl *const ci = crypt_get_hash_provider(pw);
+	struct pwhash_provider *pp;
+
+	if (! ci)
+		return;
+
+	if (! (pp = mowgli_patricia_retrieve(pwhash_providers, ci->id)) && delta > 0)
+	{
+		pp = smalloc(sizeof *pp);
+		(void) mowgli_strlcpy(pp->id, ci->id, sizeof pp->id);
+		(void) mowgli_patricia_add(pwhash_providers, pp->id, pp);
+	}
+
+	if (! pp)
+		return;
+
+	(void) pwhash_adjust(&pp->count, delta);
+
+	if (! pp->count)
+	{
+		(void) mowgli_patricia_delete(pwhash_providers, pp->id);
+		(void) sfree(pp);
+	}
+}
+
+static unsigned int
+pwhash_current(const struct crypt_impl *const restrict ci_default)
+{
+	const struct pwhash_provider *pp;
+
+	if (! ci_default || ! (pp = mowgli_patricia_retrieve(pwhash_providers, ci_default->id)))
+		return 0;
+
+	return pp->count;
+}
+
+static void
+pwhash_myuser_add(struct myuser *const restrict mu)
+{
+	(void) pwhash_count(mu->pass, (mu->flags & MU_CRYPTPASS), 1);
+}
+
+static void
+pwhash_myuser_delete(struct myuser *const restrict mu)
+{
+	(void) pwhash_count(mu->pass, (mu->flags & MU_CRYPTPASS), -1);
+}
+
+static void
+pwhash_myuser_password_change(struct hook_myuser_password *const restrict hdata)
+{
+	(void) pwhash_count(hdata->oldpass, hdata->oldcrypted, -1);
+	(void) pwhash_count(hdata->mu->pass, (hdata->mu->flags & MU_CRYPTPASS), 1);
+}
+
+static void
+pwhash_sample_take(struct pwhash_sample *const restrict sample)
+{
+	const struct crypt_impl *const ci_default = crypt_get_default_provider();
+
+	sample->when = CURRTIME;
+	sample->accounts = pwhashes_accounts;
+	sample->encrypted = pwhashes_encrypted;
+	sample->current = pwhash_current(ci_default);
+	sample->plaintext = pwhashes[TYPE_NONE] + pwhashes[TYPE_BASE64];
+
+	(void) mowgli_strlcpy(sample->provider, ci_default ? ci_default->id : "", sizeof sample->provider);
+}
+
+static void
+pwhash_ring_push(struct pwhash_ring *const restrict ring, const struct pwhash_sample *const restrict sample)
+{
+	ring->samples[ring->head] = *sample;
+	ring->head = (ring->head + 1) % ring->size;
+
+	if (ring->count < ring->size)
+		ring->count++;
+}
+
+static const struct pwhash_sample *
+pwhash_ring_newest(const struct pwhash_ring *const restrict ring, const unsigned int age)
+{
+	return &ring->samples[(ring->head + ring->size - 1 - age) % ring->size];
+}
+
+static void
+pwhash_sample_tick(void ATHEME_VATTR_UNUSED *const restrict unused)
+{
+	struct pwhash_ring *const hours = &pwhash_rings[0];
+	struct pwhash_ring *const days = &pwhash_rings[1];
+	struct pwhash_sample sample;
+
+	(void) pwhash_sample_take(&sample);
+	(void) pwhash_ring_push(hours, &sample);
+
+	if (! days->count || pwhash_ring_newest(days, 0)->when / SECONDS_PER_DAY != sample.when / SECONDS_PER_DAY)
+		(void) pwhash_ring_push(days, &sample);
+}
+
+static void
+pwhash_sample_print(struct sourceinfo *const restrict si, const struct pwhash_sample *const restrict sample)
+{
+	char strfbuf[BUFSIZE];
+	const struct tm *const tm = localtime(&sample->when);
+
+	(void) strftime(strfbuf, sizeof strfbuf, TIME_FORMAT, tm);
+
+	if (sample->provider[0] == '\0')
+	{
+		(void) command_success_nodata(si, _("%s: %u accounts, %u encrypted, %u plain-text"), strfbuf,
+		                              sample->accounts, sample->encrypted, sample->plaintext);
+		return;
+	}
+
+	(void) command_success_nodata(si, _("%s: %u accounts, %u encrypted, %u plain-text; %u (%u%%) from %s"),
+	                              strfbuf, sample->accounts, sample->encrypted, sample->plaintext,
+	                              sample->current, sample->encrypted ?
+	                              (unsigned int) ((100ULL * sample->current) / sample->encrypted) : 100U,
+	                              sample->provider);
+}
+
+static void
+ss_cmd_pwhashes_history(struct sourceinfo *const restrict si, const int parc, char **const restrict parv)
+{
+	const struct pwhash_ring *ring = NULL;
+	struct pwhash_sample current;
+	unsigned int count = PWHASHES_DEFAULT_COUNT;
+
+	if (parc > 1)
+		for (size_t i = 0; i < ARRAY_SIZE(pwhash_rings); i++)
+			if (strcasecmp(parv[1], pwhash_rings[i].name) == 0)
+				ring = &pwhash_rings[i];
+
+	if (! ring || (parc > 2 && ! string_to_uint(parv[2], &count)))
+	{
+		(void) command_fail(si, fault_badparams, STR_INVALID_PARAMS, "PWHASHES");
+		(void) command_fail(si, fault_badparams, _("Syntax: PWHASHES HISTORY <HOUR|DAY> [count]"));
+		return;
+	}
+
+	if (count > ring->count)
+		count = ring->count;
+
+	(void) logcommand(si, CMDLOG_GET, "PWHASHES: HISTORY %s", ring->name);
+
+	(void) pwhash_sample_take(&current);
+	(void) command_success_nodata(si, _("Password hashes per %s, newest first:"), ring->name);
+	(void) pwhash_sample_print(si, &current);
+
+	for (unsigned int i = 0; i < count; i++)
+		(void) pwhash_sample_print(si, pwhash_ring_newest(ring, i));
+
+	(void) command_success_nodata(si, _("End of password hash history."));
+}
+
+static void
+ss_cmd_pwhashes_func(struct sourceinfo *const restrict si, const int parc, char **const restrict parv)
+{
+	if (parc > 0 && strcasecmp(parv[0], "HISTORY") == 0)
+	{
+		(void) ss_cmd_pwhashes_history(si, parc, parv);
+		return;
+	}
+
+	(void) logcommand(si, CMDLOG_GET, "PWHASHES");
+
+	const struct crypt_impl *const ci_default = crypt_get_default_provider();
+	const unsigned int current = pwhash_current(ci_default);
 
 	for (enum crypto_type i = TYPE_NONE; i < TYPE_TOTAL_COUNT; i++)
-		if (pwhashes[i])
-			(void) command_success_nodata(si, "%-36s: %u", crypto_type_to_name(i), pwhashes[i]);
+	{
+		mowgli_patricia_iteration_state_t state;
+		const struct pwhash_paramset *ps;
+
+		if (! pwhashes[i])
+			continue;
+
+		(void) command_success_nodata(si, "%-36s: %u", crypto_type_to_name(i), pwhashes[i]);
+
+		MOWGLI_PATRICIA_FOREACH(ps, &state, pwhash_paramsets)
+			if (ps->type == i)
+				(void) command_success_nodata(si, "    %-32s: %u", ps->params, ps->count);
+	}
+
+	if (! ci_default)
+		return;
+
+	struct pwverify_stats pws;
+
+	(void) pwverify_get_stats(&pws);
+	(void) command_success_nodata(si, " ");
+	(void) command_success_nodata(si, _("%u of %u encrypted passwords (%u%%) are from the default crypto "
+	                                    "provider, \2%s\2."), current, pwhashes_encrypted,
+	                                    pwhashes_encrypted ?
+	                                    (unsigned int) ((100ULL * current) / pwhashes_encrypted) : 100U,
+	                                    ci_default->id);
+	(void) command_success_nodata(si, _("Passwords re-encrypted on login: %u (%u waiting or in progress, "
+	                                    "%u dropped, %u discarded)."), pws.rehash_done, pws.rehash_queued,
+	                                    pws.rehash_dropped, pws.rehash_stale);
 }
 
 static struct command ss_cmd_pwhashes = {
 	.name           = "PWHASHES",
 	.desc           = N_("Shows database password hash statistics."),
 	.access         = PRIV_SERVER_AUSPEX,
-	.maxparc        = 1,
+	.maxparc        = 3,
 	.cmd            = &ss_cmd_pwhashes_func,
 	.help           = { .path = "statserv/pwhashes" },
 };
@@ -324,12 +621,50 @@ mod_init(struct module *const restrict m)
 {
 	MODULE_TRY_REQUEST_DEPENDENCY(m, "statserv/main")
 
+	struct myentity *mt;
+	struct myentity_iteration_state state;
+
+	pwhash_paramsets = mowgli_patricia_create(NULL);
+	pwhash_providers = mowgli_patricia_create(NULL);
+
+	// Counted once here (if the database is loaded already), then kept up to date
+	MYENTITY_FOREACH_T(mt, &state, ENT_USER)
+	{
+		const struct myuser *const mu = user(mt);
+
+		continue_if_fail(mu != NULL);
+
+		(void) pwhash_count(mu->pass, (mu->flags & MU_CRYPTPASS), 1);
+	}
+
+	(void) hook_add_myuser_add(&pwhash_myuser_add);
+	(void) hook_add_myuser_delete(&pwhash_myuser_delete);
+	(void) hook_add_myuser_password_change(&pwhash_myuser_password_change);
+
+	pwhash_sample_timer = timer_add("pwhash_sample_tick", &pwhash_sample_tick, NULL, SECONDS_PER_HOUR);
+
 	(void) service_named_bind_command("statserv", &ss_cmd_pwhashes);
 }
 
+static void
+pwhash_free_cb(const char ATHEME_VATTR_UNUSED *const restrict key, void *const restrict data,
+               void ATHEME_VATTR_UNUSED *const restrict privdata)
+{
+	(void) sfree(data);
+}
+
 static void
 mod_deinit(const enum module_unload_intent ATHEME_VATTR_UNUSED intent)
 {
+	(void) hook_del_myuser_add(&pwhash_myuser_add);
+	(void) hook_del_myuser_delete(&pwhash_myuser_delete);
+	(void) hook_del_myuser_password_change(&pwhash_myuser_password_change);
+
+	(void) timer_destroy(pwhash_sample_timer);
+
+	(void) mowgli_patricia_destroy(pwhash_paramsets, &pwhash_free_cb, NULL);
+	(void) mowgli_patricia_destroy(pwhash_providers, &pwhash_free_cb, NULL);
+
 	(void) service_named_unbind_command("statserv", &ss_cmd_pwhashes);
 }
 
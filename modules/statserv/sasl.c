@@ -0,0 +1,96 @@
+/*
+ * SPDX-License-Identifier: ISC
+ * SPDX-URL: https://spdx.org/licenses/ISC.html
+ *
+ * Copyright (C) 2026 Atheme Development Group (https://atheme.github.io/)
+ *
+ * How SASL logins are faring, per mechanism.
+ */
+
+#include <atheme.h>
+
+// The bound of the histogram bucket that the given percentage of sessions fall within, in usec
+static unsigned long long
+ss_sasl_percentile_us(const unsigned int *const restrict hist, const unsigned long long count,
+                      const unsigned int percent)
+{
+	const unsigned long long want = ((count * percent) + 99ULL) / 100ULL;
+	unsigned long long seen = 0;
+
+	for (unsigned int i = 0; i < SASL_MECH_STATS_BUCKETS; i++)
+		if ((seen += hist[i]) >= want)
+			return 1ULL << (i + 1);
+
+	return 1ULL << SASL_MECH_STATS_BUCKETS;
+}
+
+static void
+ss_cmd_sasl_func(struct sourceinfo *const restrict si, const int ATHEME_VATTR_UNUSED parc,
+                 char ATHEME_VATTR_UNUSED **const restrict parv)
+{
+	// Looked up each time rather than with module_locate_symbol(), which would make us depend on saslserv/main
+	struct module *const m = module_find_published("saslserv/main");
+	const mowgli_list_t *stats = NULL;
+
+	if (m && m->handle)
+		stats = mowgli_module_symbol(m->handle, "sasl_mech_stats");
+
+	if (! stats)
+	{
+		(void) command_fail(si, fault_nosuch_target, _("\2%s\2 is not loaded."), "saslserv/main");
+		return;
+	}
+
+	(void) logcommand(si, CMDLOG_GET, "SASL");
+
+	mowgli_node_t *n;
+
+	MOWGLI_ITER_FOREACH(n, stats->head)
+	{
+		const struct sasl_mech_stats *const ms = n->data;
+		const unsigned long long completed = ms->succeeded + ms->failed + ms->errored;
+
+		(void) command_success_nodata(si, _("\2%s\2: %llu started, %llu succeeded, %llu failed, %llu errored, "
+		                                    "%llu aborted, %llu timed out"), ms->name, ms->started,
+		                                    ms->succeeded, ms->failed, ms->errored, ms->aborted, ms->timed_out);
+
+		if (! completed)
+			continue;
+
+		(void) command_success_nodata(si, _("    exchange: %llu ms average, 95%% within %llu ms; server: %llu ms "
+		                                    "average, 95%% within %llu ms, %llu.%02llu steps per session"),
+		                                    (ms->total_us / completed) / 1000ULL,
+		                                    ss_sasl_percentile_us(ms->hist, completed, 95U) / 1000ULL,
+		                                    (ms->server_us / completed) / 1000ULL,
+		                                    ss_sasl_percentile_us(ms->server_hist, completed, 95U) / 1000ULL,
+		                                    ms->steps / ms->started,
+		                                    ((ms->steps * 100ULL) / ms->started) % 100ULL);
+	}
+
+	(void) command_success_nodata(si, _("End of SASL statistics."));
+}
+
+static struct command ss_cmd_sasl = {
+	.name           = "SASL",
+	.desc           = N_("Shows SASL login statistics per mechanism."),
+	.access         = PRIV_SERVER_AUSPEX,
+	.maxparc        = 1,
+	.cmd            = &ss_cmd_sasl_func,
+	.help           = { .path = "statserv/sasl" },
+};
+
+static void
+mod_init(struct module *const restrict m)
+{
+	MODULE_TRY_REQUEST_DEPENDENCY(m, "statserv/main")
+
+	(void) service_named_bind_command("statserv", &ss_cmd_sasl);
+}
+
+static void
+mod_deinit(const enum module_unload_intent ATHEME_VATTR_UNUSED intent)
+{
+	(void) service_named_unbind_command("statserv", &ss_cmd_sasl);
+}
+
+SIMPLE_DECLARE_MODULE_V1("statserv/sasl", MODULE_UNLOAD_CAPABILITY_OK)
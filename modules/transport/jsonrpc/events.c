@@ -0,0 +1,469 @@
+/*
+ * SPDX-License-Identifier: ISC
+ * SPDX-URL: https://spdx.org/licenses/ISC.html
+ *
+ * Copyright (C) 2026 Atheme Development Group (https://atheme.github.io/)
+ *
+ * JSONRPC event streams (atheme.subscribe)
+ */
+
+#include <atheme.h>
+#include "jsonrpclib.h"
+
+// How often subscribers get a keepalive and have their authcookie rechecked
+#define JSONRPC_EVENTS_KEEPALIVE        30U
+
+/* Events for a subscriber are dropped (and it is told how many) once this
+ * many bytes are waiting to be written, until no more than the second number
+ * are; the overflow event goes out as soon as that happens.
+ */
+#define JSONRPC_EVENTS_QUEUE_HIGH       65536U
+#define JSONRPC_EVENTS_QUEUE_LOW        16384U
+
+enum jsonrpc_event_type
+{
+	JSONRPC_EVENT_IDENTIFY          = 0x01U,
+	JSONRPC_EVENT_LOGOUT            = 0x02U,
+	JSONRPC_EVENT_ACCOUNT_DROP      = 0x04U,
+	JSONRPC_EVENT_CHANNEL_REGISTER  = 0x08U,
+	JSONRPC_EVENT_METADATA          = 0x10U,
+};
+
+static const struct {
+	const char *            name;
+	enum jsonrpc_event_type type;
+} jsonrpc_event_names[] = {
+	{ "identify",           JSONRPC_EVENT_IDENTIFY          },
+	{ "logout",             JSONRPC_EVENT_LOGOUT            },
+	{ "account_drop",       JSONRPC_EVENT_ACCOUNT_DROP      },
+	{ "channel_register",   JSONRPC_EVENT_CHANNEL_REGISTER  },
+	{ "metadata",           JSONRPC_EVENT_METADATA          },
+};
+
+struct jsonrpc_subscriber
+{
+	mowgli_node_t           node;
+	struct connection *     conn;
+	struct myuser *         mu;
+	char *                  ticket;
+	unsigned int            events;         // JSONRPC_EVENT_* mask
+	unsigned int            dropped;        // events lost since the last overflow event
+};
+
+static mowgli_list_t jsonrpc_subscribers;
+static mowgli_eventloop_timer_t *jsonrpc_keepalive_timer = NULL;
+
+static void
+jsonrpc_subscriber_free(struct jsonrpc_subscriber *const restrict sub)
+{
+	mowgli_node_delete(&sub->node, &jsonrpc_subscribers);
+	sfree(sub->ticket);
+	sfree(sub);
+}
+
+static void
+jsonrpc_subscriber_cancel(struct connection ATHEME_VATTR_UNUSED *const restrict cptr, void *const restrict priv)
+{
+	jsonrpc_subscriber_free(priv);
+}
+
+// Ends the stream once what has been queued for it is written
+static void
+jsonrpc_subscriber_end(struct jsonrpc_subscriber *const restrict sub)
+{
+	struct httpddata *const hd = sub->conn->userdata;
+
+	hd->deferred = NULL;
+	hd->deferred_cancel = NULL;
+	sendq_add_eof(sub->conn);
+
+	jsonrpc_subscriber_free(sub);
+}
+
+static void
+jsonrpc_subscriber_write(struct jsonrpc_subscriber *const restrict sub, const char *const restrict event,
+                         const char *const restrict data)
+{
+	struct connection *const conn = sub->conn;
+
+	if (conn->flags & CF_DEAD)
+		return;
+
+	if (sendq_congested(conn))
+	{
+		sub->dropped++;
+		return;
+	}
+
+	mowgli_string_t *const str = mowgli_string_create();
+	char buf[BUFSIZE];
+
+	// Tell the client it has missed something and should resynchronise
+	if (sub->dropped)
+	{
+		(void) snprintf(buf, sizeof buf, "event: overflow\ndata: {\"dropped\":%u}\n\n", sub->dropped);
+		mowgli_string_append(str, buf, strlen(buf));
+		sub->dropped = 0;
+	}
+
+	if (event != NULL)
+	{
+		mowgli_string_append(str, "event: ", 7);
+		mowgli_string_append(str, event, strlen(event));
+		mowgli_string_append(str, "\ndata: ", 7);
+		mowgli_string_append(str, data, strlen(data));
+		mowgli_string_append(str, "\n\n", 2);
+	}
+
+	if (str->pos)
+		sendq_add(conn, str->str, str->pos);
+
+	mowgli_string_destroy(str);
+}
+
+/* Sends an event to everyone subscribed to it who may see it: anyone with
+ * PRIV_USER_AUSPEX (or, for channel events, PRIV_CHAN_AUSPEX) sees all of
+ * them, anyone else only those about their own account. Takes ownership of
+ * data.
+ */
+static void
+jsonrpc_event_emit(const enum jsonrpc_event_type type, const char *const restrict event,
+                   mowgli_json_t *const restrict data, const struct myuser *const restrict mu, const bool channel)
+{
+	mowgli_node_t *n, *tn;
+	mowgli_string_t *str = NULL;
+
+	MOWGLI_ITER_FOREACH_SAFE(n, tn, jsonrpc_subscribers.head)
+	{
+		struct jsonrpc_subscriber *const sub = n->data;
+
+		if (! (sub->events & type))
+			continue;
+
+		if (sub->mu != mu && ! has_priv_myuser(sub->mu, channel ? PRIV_CHAN_AUSPEX : PRIV_USER_AUSPEX))
+			continue;
+
+		// Only encoded if someone wants it
+		if (str == NULL)
+		{
+			str = mowgli_string_create();
+			mowgli_json_serialize_to_string(data, str, 0);
+		}
+
+		jsonrpc_subscriber_write(sub, event, str->str);
+	}
+
+	if (str != NULL)
+		mowgli_string_destroy(str);
+
+	mowgli_json_decref(data);
+}
+
+static mowgli_json_t *
+jsonrpc_event_login_data(const struct user *const restrict u)
+{
+	mowgli_json_t *const data = mowgli_json_create_object();
+	mowgli_patricia_t *const patricia = MOWGLI_JSON_OBJECT(data);
+
+	mowgli_patricia_add(patricia, "nick", mowgli_json_create_string(u->nick));
+	mowgli_patricia_add(patricia, "accountname", mowgli_json_create_string(entity(u->myuser)->name));
+	mowgli_patricia_add(patricia, "logins", mowgli_json_create_integer((int) MOWGLI_LIST_LENGTH(&u->myuser->logins)));
+
+	return data;
+}
+
+static void
+jsonrpc_event_user_identify(struct user *const restrict u)
+{
+	if (MOWGLI_LIST_LENGTH(&jsonrpc_subscribers) == 0 || u->myuser == NULL)
+		return;
+
+	jsonrpc_event_emit(JSONRPC_EVENT_IDENTIFY, "identify", jsonrpc_event_login_data(u), u->myuser, false);
+}
+
+static void
+jsonrpc_event_user_logout(struct user *const restrict u)
+{
+	if (MOWGLI_LIST_LENGTH(&jsonrpc_subscribers) == 0 || u->myuser == NULL)
+		return;
+
+	jsonrpc_event_emit(JSONRPC_EVENT_LOGOUT, "logout", jsonrpc_event_login_data(u), u->myuser, false);
+}
+
+static void
+jsonrpc_event_myuser_delete(struct myuser *const restrict mu)
+{
+	mowgli_node_t *n, *tn;
+
+	if (MOWGLI_LIST_LENGTH(&jsonrpc_subscribers) == 0)
+		return;
+
+	mowgli_json_t *const data = mowgli_json_create_object();
+
+	mowgli_patricia_add(MOWGLI_JSON_OBJECT(data), "accountname", mowgli_json_create_string(entity(mu)->name));
+
+	jsonrpc_event_emit(JSONRPC_EVENT_ACCOUNT_DROP, "account_drop", data, mu, false);
+
+	// Whoever subscribed as this account can't be authenticated any more
+	MOWGLI_ITER_FOREACH_SAFE(n, tn, jsonrpc_subscribers.head)
+	{
+		struct jsonrpc_subscriber *const sub = n->data;
+
+		if (sub->mu == mu)
+			jsonrpc_subscriber_end(sub);
+	}
+}
+
+static void
+jsonrpc_event_channel_register(struct hook_channel_req *const restrict hdata)
+{
+	if (MOWGLI_LIST_LENGTH(&jsonrpc_subscribers) == 0)
+		return;
+
+	struct myuser *const mu = hdata->si != NULL ? hdata->si->smu : NULL;
+	mowgli_json_t *const data = mowgli_json_create_object();
+	mowgli_patricia_t *const patricia = MOWGLI_JSON_OBJECT(data);
+
+	mowgli_patricia_add(patricia, "channel", mowgli_json_create_string(hdata->mc->name));
+	mowgli_patricia_add(patricia, "founder", mowgli_json_create_string(mu != NULL ? entity(mu)->name : "*"));
+
+	jsonrpc_event_emit(JSONRPC_EVENT_CHANNEL_REGISTER, "channel_register", data, mu, true);
+}
+
+// Metadata on accounts and channels; private: keys are never sent
+static void
+jsonrpc_event_metadata(struct hook_metadata_req *const restrict req)
+{
+	struct myuser *mu = NULL;
+	const char *kind, *name;
+
+	if (MOWGLI_LIST_LENGTH(&jsonrpc_subscribers) == 0 || ! strncmp(req->name, "private:", 8))
+		return;
+
+	// The object itself is being destroyed
+	if (atheme_object(req->target)->refcount == -1)
+		return;
+
+	switch (db_object_type(req->target))
+	{
+		case DB_OBJECT_MYUSER:
+			mu = req->target;
+
+			// Still being set up
+			if (myuser_find(entity(mu)->name) != mu)
+				return;
+
+			kind = "accountname";
+			name = entity(mu)->name;
+			break;
+
+		case DB_OBJECT_MYCHAN:
+			kind = "channel";
+			name = ((const struct mychan *) req->target)->name;
+			break;
+
+		default:
+			return;
+	}
+
+	mowgli_json_t *const data = mowgli_json_create_object();
+	mowgli_patricia_t *const patricia = MOWGLI_JSON_OBJECT(data);
+
+	mowgli_patricia_add(patricia, kind, mowgli_json_create_string(name));
+	mowgli_patricia_add(patricia, "key", mowgli_json_create_string(req->name));
+	mowgli_patricia_add(patricia, "value", req->value != NULL ? mowgli_json_create_string(req->value) : mowgli_json_null);
+
+	jsonrpc_event_emit(JSONRPC_EVENT_METADATA, "metadata", data, mu, mu == NULL);
+}
+
+static void
+jsonrpc_events_sendq_resume(struct connection *const restrict cptr)
+{
+	mowgli_node_t *n;
+
+	MOWGLI_ITER_FOREACH(n, jsonrpc_subscribers.head)
+	{
+		struct jsonrpc_subscriber *const sub = n->data;
+
+		if (sub->conn == cptr)
+		{
+			jsonrpc_subscriber_write(sub, NULL, NULL);
+			return;
+		}
+	}
+}
+
+static void
+jsonrpc_events_keepalive(void ATHEME_VATTR_UNUSED *const restrict arg)
+{
+	// An SSE comment; EventSource ignores it
+	static char keepalive[] = ":\n\n";
+	mowgli_node_t *n, *tn;
+
+	MOWGLI_ITER_FOREACH_SAFE(n, tn, jsonrpc_subscribers.head)
+	{
+		struct jsonrpc_subscriber *const sub = n->data;
+
+		// Logged out through atheme.logout, or expired
+		if (! authcookie_validate(sub->ticket, sub->mu))
+		{
+			jsonrpc_subscriber_end(sub);
+			continue;
+		}
+
+		// Also delivers a pending overflow event if there is room again
+		jsonrpc_subscriber_write(sub, NULL, NULL);
+
+		if (! sendq_nonempty(sub->conn))
+			sendq_add(sub->conn, keepalive, sizeof keepalive - 1);
+	}
+}
+
+/* atheme.subscribe
+ *
+ * JSON inputs:
+ *       authcookie, account name, event types (optional, default all of them)
+ *
+ * JSON outputs:
+ *       fault 1 - insufficient parameters
+ *       fault 2 - unknown event type, or part of a batch
+ *       fault 3 - unknown user
+ *       fault 15 - validation failed
+ *       default - the reply is a stream of server-sent events
+ *       (text/event-stream) that lasts until the connection is closed, the
+ *       authcookie stops being valid or the account is dropped.
+ */
+bool
+jsonrpcmethod_subscribe(void *conn, mowgli_list_t *params, char *id)
+{
+	struct connection *const cptr = conn;
+	struct httpddata *const hd = cptr->userdata;
+	struct myuser *mu;
+	unsigned int events = 0;
+	char buf[BUFSIZE];
+	mowgli_node_t *n;
+	size_t i;
+
+	if (MOWGLI_LIST_LENGTH(params) < 2)
+	{
+		jsonrpc_failure_string(conn, fault_needmoreparams, "Insufficient parameters.", id);
+		return false;
+	}
+
+	// A batch is answered all at once
+	if (jsonrpc_in_batch())
+	{
+		jsonrpc_failure_string(conn, fault_badparams, "atheme.subscribe cannot be part of a batch.", id);
+		return false;
+	}
+
+	const char *const cookie = mowgli_node_nth_data(params, 0);
+	const char *const accountname = mowgli_node_nth_data(params, 1);
+
+	if ((mu = myuser_find(accountname)) == NULL)
+	{
+		jsonrpc_failure_string(conn, fault_nosuch_source, "Unknown user.", id);
+		return false;
+	}
+
+	if (! jsonrpc_authcookie_validate(cookie, mu))
+	{
+		jsonrpc_failure_string(conn, fault_badauthcookie, "Invalid authcookie for this account.", id);
+		return false;
+	}
+
+	for (n = params->head->next->next; n != NULL; n = n->next)
+	{
+		for (i = 0; i < ARRAY_SIZE(jsonrpc_event_names); i++)
+			if (! strcasecmp(n->data, jsonrpc_event_names[i].name))
+				break;
+
+		if (i == ARRAY_SIZE(jsonrpc_event_names))
+		{
+			jsonrpc_failure_string(conn, fault_badparams, "Unknown event type.", id);
+			return false;
+		}
+
+		events |= jsonrpc_event_names[i].type;
+	}
+
+	struct jsonrpc_subscriber *const sub = smalloc(sizeof *sub);
+
+	sub->conn = cptr;
+	sub->mu = mu;
+	sub->ticket = sstrdup(cookie);
+	sub->events = events ? events : ~0U;
+	mowgli_node_add(sub, &sub->node, &jsonrpc_subscribers);
+
+	// Nothing more is read from the connection, and the stream ends when it closes
+	hd->connection_close = true;
+	hd->streaming = true;
+	hd->deferred = sub;
+	hd->deferred_cancel = &jsonrpc_subscriber_cancel;
+	sendq_set_watermarks(cptr, JSONRPC_EVENTS_QUEUE_HIGH, JSONRPC_EVENTS_QUEUE_LOW);
+
+	(void) snprintf(buf, sizeof buf,
+	                "HTTP/1.1 200 OK\r\n"
+	                "Server: %s/%s\r\n"
+	                "Content-Type: text/event-stream\r\n"
+	                "Cache-Control: no-cache\r\n"
+	                "Connection: close\r\n"
+	                "\r\n",
+	                PACKAGE_TARNAME, PACKAGE_VERSION);
+
+	sendq_add(cptr, buf, strlen(buf));
+
+	mowgli_json_t *const data = mowgli_json_create_object();
+	mowgli_string_t *const str = mowgli_string_create();
+
+	mowgli_patricia_add(MOWGLI_JSON_OBJECT(data), "id", mowgli_json_create_string(id));
+	mowgli_json_serialize_to_string(data, str, 0);
+	jsonrpc_subscriber_write(sub, "subscribed", str->str);
+	mowgli_string_destroy(str);
+	mowgli_json_decref(data);
+
+	logcommand_external(nicksvs.me, "jsonrpc", conn, NULL, mu, CMDLOG_GET, "SUBSCRIBE");
+
+	return true;
+}
+
+void
+jsonrpc_events_init(void)
+{
+	hook_add_user_identify(jsonrpc_event_user_identify);
+	hook_add_user_logout(jsonrpc_event_user_logout);
+	hook_add_myuser_delete(jsonrpc_event_myuser_delete);
+	hook_add_channel_register(jsonrpc_event_channel_register);
+	hook_add_metadata_add(jsonrpc_event_metadata);
+	hook_add_metadata_delete(jsonrpc_event_metadata);
+	hook_add_sendq_resume(jsonrpc_events_sendq_resume);
+
+	jsonrpc_keepalive_timer = timer_add("jsonrpc_events_keepalive", &jsonrpc_events_keepalive, NULL,
+	                                    JSONRPC_EVENTS_KEEPALIVE);
+}
+
+void
+jsonrpc_events_deinit(void)
+{
+	mowgli_node_t *n, *tn;
+
+	hook_del_user_identify(jsonrpc_event_user_identify);
+	hook_del_user_logout(jsonrpc_event_user_logout);
+	hook_del_myuser_delete(jsonrpc_event_myuser_delete);
+	hook_del_channel_register(jsonrpc_event_channel_register);
+	hook_del_metadata_add(jsonrpc_event_metadata);
+	hook_del_metadata_delete(jsonrpc_event_metadata);
+	hook_del_sendq_resume(jsonrpc_events_sendq_resume);
+
+	timer_destroy(jsonrpc_keepalive_timer);
+
+	// The streams can't go on without us
+	MOWGLI_ITER_FOREACH_SAFE(n, tn, jsonrpc_subscribers.head)
+	{
+		struct jsonrpc_subscriber *const sub = n->data;
+		struct connection *const conn = sub->conn;
+
+		jsonrpc_subscriber_end(sub);
+		connection_close_soon(conn);
+	}
+}
@@ -10,36 +10,31 @@
 #include <atheme.h>
 #include "jsonrpclib.h"
 
-void
-jsonrpc_process(char *buffer, void *userdata)
-{
-	if (!buffer)
-	{
-		return;
-	}
-
-	mowgli_json_t *parsed = mowgli_json_parse_string(buffer);
+// Calls beyond this many in one batch are answered with an error instead of being run
+#define JSONRPC_BATCH_MAX       100U
 
-	if (parsed == NULL) {
-		return;
-	}
+/* A chunk's size is written once its data is, as 4 hex digits and CRLF (the
+ * size may have leading zeroes), into the space left for it in front; a slab
+ * holds less than 0xFFFF bytes.
+ */
+#define JSONRPC_CHUNK_HEAD      6U
+#define JSONRPC_CHUNK_TAIL      2U
 
-	mowgli_json_tag_t tag = MOWGLI_JSON_TAG(parsed);
+// A chunk is started in a fresh slab if the last one has less room than this
+#define JSONRPC_CHUNK_MIN       64U
 
+static void
+jsonrpc_process_call(mowgli_json_t *parsed, void *userdata)
+{
 	//JSON RPC works with JSON objects only, anything else can't be correct.
 
-	if (tag != MOWGLI_JSON_TAG_OBJECT)
+	if (MOWGLI_JSON_TAG(parsed) != MOWGLI_JSON_TAG_OBJECT)
 	{
 		return;
 	}
 
 	mowgli_patricia_t *obj = MOWGLI_JSON_OBJECT(parsed);
 
-	if (parsed == NULL)
-	{
-		return;
-	}
-
 	mowgli_json_t *method = mowgli_patricia_retrieve(obj, "method");
 	mowgli_json_t *params = mowgli_patricia_retrieve(obj, "params");
 	mowgli_json_t *id = mowgli_patricia_retrieve(obj, "id");
@@ -64,18 +59,24 @@ jsonrpc_process(char *buffer, void *userdata)
 	params_list = MOWGLI_JSON_ARRAY(params);
 
 	mowgli_json_t *param;
-	mowgli_node_t *n;
+	mowgli_node_t *n, *tn;
 
 	jsonrpc_method_fn call_method = get_json_method(method_str);
 
+	if (call_method == NULL)
+	{
+		jsonrpc_failure_string(userdata, fault_badparams, "Invalid command", id_str);
+		return;
+	}
+
 	MOWGLI_LIST_FOREACH(n, params_list->head)
 	{
 		param = n->data;
 
 		if (MOWGLI_JSON_TAG(param) != MOWGLI_JSON_TAG_STRING) {
-			continue;
+			jsonrpc_failure_string(userdata, fault_badparams, "Invalid parameters.", id_str);
+			return;
 		}
-
 	}
 
 	mowgli_list_t *params_str = mowgli_list_create();
@@ -88,60 +89,300 @@ jsonrpc_process(char *buffer, void *userdata)
 		mowgli_node_add(param_str, mowgli_node_create(), params_str);
 	}
 
-	if (call_method != NULL) {
-		call_method(userdata, params_str, id_str);
-	} else {
-		jsonrpc_failure_string(userdata, fault_badparams, "Invalid command", id_str);
+	call_method(userdata, params_str, id_str);
+
+	MOWGLI_LIST_FOREACH_SAFE(n, tn, params_str->head)
+	{
+		mowgli_node_delete(n, params_str);
+		mowgli_node_free(n);
+	}
+
+	mowgli_list_free(params_str);
+}
+
+/* A request is either one call object or (JSON-RPC 2.0) an array of them;
+ * the calls in a batch are run in order and their replies sent back as one
+ * array.
+ */
+void
+jsonrpc_process(char *buffer, void *userdata)
+{
+	if (!buffer)
+	{
 		return;
 	}
 
+	mowgli_json_t *parsed = mowgli_json_parse_string(buffer);
+
+	if (parsed == NULL) {
+		return;
+	}
+
+	if (MOWGLI_JSON_TAG(parsed) == MOWGLI_JSON_TAG_ARRAY)
+	{
+		mowgli_list_t *calls = MOWGLI_JSON_ARRAY(parsed);
+		unsigned int ncalls = 0;
+		mowgli_node_t *n;
+
+		jsonrpc_batch_begin(userdata);
+
+		MOWGLI_LIST_FOREACH(n, calls->head)
+		{
+			mowgli_json_t *call = n->data;
+
+			if (++ncalls > JSONRPC_BATCH_MAX)
+			{
+				mowgli_json_t *id = NULL;
+
+				if (MOWGLI_JSON_TAG(call) == MOWGLI_JSON_TAG_OBJECT)
+					id = mowgli_patricia_retrieve(MOWGLI_JSON_OBJECT(call), "id");
+
+				if (id != NULL && MOWGLI_JSON_TAG(id) == MOWGLI_JSON_TAG_STRING)
+					jsonrpc_failure_string(userdata, fault_toomany, "Too many calls in one batch.",
+					                       MOWGLI_JSON_STRING_STR(id));
+
+				continue;
+			}
+
+			jsonrpc_process_call(call, userdata);
+			jsonrpc_batch_next(userdata);
+		}
+
+		jsonrpc_batch_end(userdata);
+	}
+	else
+		jsonrpc_process_call(parsed, userdata);
+
+	const struct httpddata *const hd = ((struct connection *) userdata)->userdata;
+
+	// A deferred call (atheme.login) may still refer to its parameters; an event stream does not
+	if (! hd->deferred || hd->streaming)
+		mowgli_json_decref(parsed);
 }
 
 void
-jsonrpc_success_string(void *conn, const char *result, const char *id)
+jsonrpc_writer_begin(struct jsonrpc_writer *w, void *conn)
 {
-	mowgli_json_t *obj = mowgli_json_create_object();
+	const struct httpddata *const hd = ((struct connection *) conn)->userdata;
+
+	char buf[300];
+
+	w->conn = conn;
+	w->chunk = NULL;
+	w->data = NULL;
+	w->len = 0;
+	w->room = 0;
+	w->chunked = !hd->connection_close;
+	w->failed = false;
+
+	snprintf(buf, sizeof buf,
+	         "HTTP/1.1 200 OK\r\n"
+	         "Server: %s/%s\r\n"
+	         "Content-Type: application/json\r\n"
+	         "%s"
+	         "\r\n",
+	         PACKAGE_TARNAME, PACKAGE_VERSION,
+	         w->chunked ? "Transfer-Encoding: chunked\r\n" : "Connection: close\r\n");
+
+	sendq_add(w->conn, buf, strlen(buf));
+}
 
-	mowgli_patricia_t *patricia = MOWGLI_JSON_OBJECT(obj);
+// Queues what has been written of the current chunk
+void
+jsonrpc_writer_flush(struct jsonrpc_writer *w)
+{
+	char head[24];
 
-	mowgli_json_t *resultobj = mowgli_json_create_string(result);
-	mowgli_json_t *idobj = mowgli_json_create_string(id);
+	if (w->chunk == NULL)
+		return;
 
-	mowgli_patricia_add(patricia, "result", resultobj);
-	mowgli_patricia_add(patricia, "id", idobj);
-	mowgli_patricia_add(patricia, "error", mowgli_json_null);
+	// An empty chunk would end the body
+	if (w->len != 0 && w->chunked)
+	{
+		snprintf(head, sizeof head, "%04zx\r\n", w->len);
+		memcpy(w->chunk, head, JSONRPC_CHUNK_HEAD);
+		memcpy(w->data + w->len, "\r\n", JSONRPC_CHUNK_TAIL);
+		sendq_commit(w->conn, JSONRPC_CHUNK_HEAD + w->len + JSONRPC_CHUNK_TAIL);
+	}
+	else if (w->len != 0)
+		sendq_commit(w->conn, w->len);
 
-	mowgli_string_t *str = mowgli_string_create();
+	w->chunk = NULL;
+	w->len = 0;
+}
 
-	mowgli_json_serialize_to_string(obj, str, 0);
+// Makes room for len (at most a few) more bytes in the current chunk
+static bool
+jsonrpc_writer_room(struct jsonrpc_writer *w, size_t len)
+{
+	size_t room;
+
+	if (w->failed)
+		return false;
+
+	if (w->chunk != NULL && w->len + len <= w->room)
+		return true;
 
-	jsonrpc_send_data(conn, str->str);
+	jsonrpc_writer_flush(w);
+
+	if ((w->chunk = sendq_reserve(w->conn, JSONRPC_CHUNK_MIN, &room)) == NULL)
+	{
+		w->failed = true;
+		return false;
+	}
+
+	if (w->chunked)
+	{
+		w->data = w->chunk + JSONRPC_CHUNK_HEAD;
+		w->room = room - JSONRPC_CHUNK_HEAD - JSONRPC_CHUNK_TAIL;
+	}
+	else
+	{
+		w->data = w->chunk;
+		w->room = room;
+	}
+
+	return true;
 }
 
 void
-jsonrpc_failure_string(void *conn, int code, const char *error, const char *id)
+jsonrpc_writer_appendn(struct jsonrpc_writer *w, const char *str, size_t len)
 {
-	mowgli_json_t *obj = mowgli_json_create_object();
-	mowgli_json_t *errorobj = mowgli_json_create_object();
+	while (len > 0 && jsonrpc_writer_room(w, 1))
+	{
+		size_t l = w->room - w->len;
 
-	mowgli_patricia_t *patricia = MOWGLI_JSON_OBJECT(errorobj);
+		if (l > len)
+			l = len;
 
-	mowgli_patricia_add(patricia, "code", mowgli_json_create_integer(code));
-	mowgli_patricia_add(patricia, "message", mowgli_json_create_string(error));
+		memcpy(w->data + w->len, str, l);
+		w->len += l;
+		str += l;
+		len -= l;
+	}
+}
 
-	patricia = MOWGLI_JSON_OBJECT(obj);
+void
+jsonrpc_writer_append(struct jsonrpc_writer *w, const char *str)
+{
+	jsonrpc_writer_appendn(w, str, strlen(str));
+}
+
+// str as a JSON string, quoted and escaped
+void
+jsonrpc_writer_string(struct jsonrpc_writer *w, const char *str)
+{
+	static const char hex[] = "0123456789abcdef";
+
+	jsonrpc_writer_appendn(w, "\"", 1);
+
+	while (*str != '\0')
+	{
+		size_t run = 0;
 
-	mowgli_json_t *idobj = mowgli_json_create_string(id);
+		while ((unsigned char) str[run] >= 0x20 && str[run] != '"' && str[run] != '\\')
+			run++;
 
-	mowgli_patricia_add(patricia, "result", mowgli_json_null);
-	mowgli_patricia_add(patricia, "id", idobj);
-	mowgli_patricia_add(patricia, "error", errorobj);
+		if (run != 0)
+		{
+			jsonrpc_writer_appendn(w, str, run);
+			str += run;
+			continue;
+		}
+
+		if (!jsonrpc_writer_room(w, 6))
+			return;
 
-	mowgli_string_t *str = mowgli_string_create();
+		const unsigned char c = (unsigned char) *str++;
+		char *p = w->data + w->len;
 
-	mowgli_json_serialize_to_string(obj, str, 0);
+		*p++ = '\\';
 
-	jsonrpc_send_data(conn, str->str);
+		switch (c)
+		{
+			case '"':
+			case '\\':
+				*p++ = (char) c;
+				break;
+			case '\n':
+				*p++ = 'n';
+				break;
+			case '\r':
+				*p++ = 'r';
+				break;
+			case '\t':
+				*p++ = 't';
+				break;
+			default:
+				*p++ = 'u';
+				*p++ = '0';
+				*p++ = '0';
+				*p++ = hex[c >> 4];
+				*p++ = hex[c & 0x0F];
+				break;
+		}
+
+		w->len = (size_t) (p - w->data);
+	}
+
+	jsonrpc_writer_appendn(w, "\"", 1);
+}
+
+void
+jsonrpc_writer_int(struct jsonrpc_writer *w, long long value)
+{
+	char buf[24];
+
+	snprintf(buf, sizeof buf, "%lld", value);
+	jsonrpc_writer_append(w, buf);
+}
+
+void
+jsonrpc_writer_end(struct jsonrpc_writer *w)
+{
+	const struct httpddata *const hd = ((struct connection *) w->conn)->userdata;
+
+	static char last_chunk[] = "0\r\n\r\n";
+
+	jsonrpc_writer_flush(w);
+
+	if (w->chunked && !w->failed)
+		sendq_add(w->conn, last_chunk, sizeof last_chunk - 1);
+
+	if (hd->connection_close)
+		sendq_add_eof(w->conn);
+}
+
+void
+jsonrpc_success_string(void *conn, const char *result, const char *id)
+{
+	struct jsonrpc_writer wbuf;
+	struct jsonrpc_writer *const w = jsonrpc_reply_begin(conn, &wbuf);
+
+	jsonrpc_writer_append(w, "{\"result\":");
+	jsonrpc_writer_string(w, result);
+	jsonrpc_writer_append(w, ",\"id\":");
+	jsonrpc_writer_string(w, id);
+	jsonrpc_writer_append(w, ",\"error\":null}");
+
+	jsonrpc_reply_end(w);
+}
+
+void
+jsonrpc_failure_string(void *conn, int code, const char *error, const char *id)
+{
+	struct jsonrpc_writer wbuf;
+	struct jsonrpc_writer *const w = jsonrpc_reply_begin(conn, &wbuf);
+
+	jsonrpc_writer_append(w, "{\"result\":null,\"id\":");
+	jsonrpc_writer_string(w, id);
+	jsonrpc_writer_append(w, ",\"error\":{\"code\":");
+	jsonrpc_writer_int(w, code);
+	jsonrpc_writer_append(w, ",\"message\":");
+	jsonrpc_writer_string(w, error);
+	jsonrpc_writer_append(w, "}}");
+
+	jsonrpc_reply_end(w);
 }
 
 char * ATHEME_FATTR_MALLOC
@@ -20,6 +20,35 @@ struct jsonrpc_sourceinfo
     char *id;
 };
 
+/* Writes a reply straight into the connection's sendq as it is produced,
+ * escaping strings on the way, so however long the reply only the slab being
+ * filled is held for it. The body goes out with chunked transfer encoding,
+ * or to a client that is not keeping the connection undelimited, ending when
+ * the connection is closed.
+ */
+struct jsonrpc_writer
+{
+	struct connection *     conn;
+	char *                  chunk;          // being filled, in the sendq; NULL if none is
+	char *                  data;           // the chunk's data, after its size
+	size_t                  len;            // of that so far
+	size_t                  room;           // for it
+	bool                    chunked;
+	bool                    failed;         // the sendq took no more; the rest is dropped
+};
+
+void jsonrpc_writer_begin(struct jsonrpc_writer *w, void *conn);
+void jsonrpc_writer_appendn(struct jsonrpc_writer *w, const char *str, size_t len);
+void jsonrpc_writer_append(struct jsonrpc_writer *w, const char *str);
+void jsonrpc_writer_string(struct jsonrpc_writer *w, const char *str);
+void jsonrpc_writer_int(struct jsonrpc_writer *w, long long value);
+void jsonrpc_writer_flush(struct jsonrpc_writer *w);
+void jsonrpc_writer_end(struct jsonrpc_writer *w);
+
+// The writer for one reply: the batch's, if the call is part of one
+struct jsonrpc_writer *jsonrpc_reply_begin(void *conn, struct jsonrpc_writer *w);
+void jsonrpc_reply_end(struct jsonrpc_writer *w);
+
 char *jsonrpc_normalizeBuffer(const char *buf) ATHEME_FATTR_MALLOC;
 
 jsonrpc_method_fn get_json_method(const char *method_name);
@@ -31,4 +60,14 @@ void jsonrpc_send_data(void *conn, char *str);
 void jsonrpc_success_string(void *conn, const char *str, const char *id);
 void jsonrpc_failure_string(void *conn, int code, const char *str, const char *id);
 
+void jsonrpc_batch_begin(void *conn);
+void jsonrpc_batch_next(void *conn);
+void jsonrpc_batch_end(void *conn);
+bool jsonrpc_authcookie_validate(const char *cookie, struct myuser *mu);
+bool jsonrpc_in_batch(void);
+
+bool jsonrpcmethod_subscribe(void *conn, mowgli_list_t *params, char *id);
+void jsonrpc_events_init(void);
+void jsonrpc_events_deinit(void);
+
 #endif /* !ATHEME_MOD_TRANSPORT_JSONRPC_JSONRPCLIB_H */
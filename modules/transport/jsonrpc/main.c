@@ -10,9 +10,28 @@
 #include <atheme.h>
 #include "jsonrpclib.h"
 
-static mowgli_list_t *httpd_path_handlers = NULL;
+static mowgli_patricia_t **httpd_path_handlers = NULL;
 static mowgli_patricia_t *json_methods = NULL;
 
+// While a batch is being run, its replies are all written as one array with this
+static struct jsonrpc_writer jsonrpc_batch_writer;
+static struct jsonrpc_writer *jsonrpc_batch = NULL;
+static unsigned int jsonrpc_batch_replies = 0;
+
+/* hd->replybuf as last grown by jsonrpc_command_success_nodata(), so that a
+ * command's output need not be measured again for every line of it
+ */
+static const char *jsonrpc_reply = NULL;
+static size_t jsonrpc_reply_len = 0;
+static size_t jsonrpc_reply_size = 0;
+
+/* The authcookie last validated in the current batch. Deleting an account
+ * destroys its authcookies, so this is only trusted while none have been.
+ */
+static char *jsonrpc_batch_cookie = NULL;
+static struct myuser *jsonrpc_batch_mu = NULL;
+static unsigned int jsonrpc_batch_destroyed = 0;
+
 void
 jsonrpc_register_method(const char *method_name, jsonrpc_method_fn method)
 {
@@ -31,6 +50,84 @@ get_json_method(const char *method_name)
 	return mowgli_patricia_retrieve(json_methods, method_name);
 }
 
+static void
+jsonrpc_batch_forget_cookie(void)
+{
+	sfree(jsonrpc_batch_cookie);
+
+	jsonrpc_batch_cookie = NULL;
+	jsonrpc_batch_mu = NULL;
+}
+
+void
+jsonrpc_batch_begin(void *conn)
+{
+	return_if_fail(jsonrpc_batch == NULL);
+
+	jsonrpc_batch = &jsonrpc_batch_writer;
+	jsonrpc_batch_replies = 0;
+
+	jsonrpc_writer_begin(jsonrpc_batch, conn);
+	jsonrpc_writer_append(jsonrpc_batch, "[");
+	jsonrpc_writer_flush(jsonrpc_batch);
+}
+
+// Between two calls in a batch; each gets its own reply state
+void
+jsonrpc_batch_next(void *conn)
+{
+	struct httpddata *hd = ((struct connection *) conn)->userdata;
+
+	sfree(hd->replybuf);
+	hd->replybuf = NULL;
+	hd->sent_reply = false;
+}
+
+void
+jsonrpc_batch_end(void *conn)
+{
+	return_if_fail(jsonrpc_batch != NULL);
+
+	struct jsonrpc_writer *const batch = jsonrpc_batch;
+
+	jsonrpc_batch = NULL;
+	jsonrpc_batch_forget_cookie();
+
+	jsonrpc_writer_append(batch, "]");
+	jsonrpc_writer_end(batch);
+}
+
+bool
+jsonrpc_in_batch(void)
+{
+	return jsonrpc_batch != NULL;
+}
+
+/* Like authcookie_validate(), but within a batch a cookie is only looked up
+ * once for as long as it stays valid.
+ */
+bool
+jsonrpc_authcookie_validate(const char *cookie, struct myuser *mu)
+{
+	if (jsonrpc_batch != NULL && jsonrpc_batch_mu == mu && jsonrpc_batch_destroyed == authcookie_destroyed &&
+	    !strcmp(jsonrpc_batch_cookie, cookie))
+		return true;
+
+	if (!authcookie_validate(cookie, mu))
+		return false;
+
+	if (jsonrpc_batch != NULL)
+	{
+		jsonrpc_batch_forget_cookie();
+
+		jsonrpc_batch_cookie = sstrdup(cookie);
+		jsonrpc_batch_mu = mu;
+		jsonrpc_batch_destroyed = authcookie_destroyed;
+	}
+
+	return true;
+}
+
 static void
 jsonrpc_command_fail(struct sourceinfo *si, enum cmd_faultcode code, const char *message)
 {
@@ -77,6 +174,7 @@ jsonrpc_command_success_nodata(struct sourceinfo *si, const char *message)
 	char *p;
 
 	char *newmessage = jsonrpc_normalizeBuffer(message);
+	size_t len;
 
 	cptr = si->connection;
 	hd = cptr->userdata;
@@ -85,19 +183,29 @@ jsonrpc_command_success_nodata(struct sourceinfo *si, const char *message)
 		sfree(newmessage);
 		return;
 	}
-	if (hd->replybuf != NULL)
-	{
-		hd->replybuf = srealloc(hd->replybuf, strlen(hd->replybuf) + strlen(newmessage) + 2);
-		p = hd->replybuf + strlen(hd->replybuf);
-		*p++ = '\n';
-	}
-	else
+
+	if (hd->replybuf == NULL)
+		jsonrpc_reply_len = jsonrpc_reply_size = 0;
+	else if (hd->replybuf != jsonrpc_reply)
+		jsonrpc_reply_len = jsonrpc_reply_size = strlen(hd->replybuf);
+
+	// The buffer doubles, rather than growing by each line
+	len = strlen(newmessage);
+	if (jsonrpc_reply_len + len + 2 > jsonrpc_reply_size)
 	{
-		hd->replybuf = smalloc(strlen(newmessage) + 1);
-		p = hd->replybuf;
+		jsonrpc_reply_size *= 2;
+		if (jsonrpc_reply_size < jsonrpc_reply_len + len + 2)
+			jsonrpc_reply_size = jsonrpc_reply_len + len + 2;
+		hd->replybuf = srealloc(hd->replybuf, jsonrpc_reply_size);
 	}
 
-	strcpy(p, newmessage);
+	p = hd->replybuf + jsonrpc_reply_len;
+	if (jsonrpc_reply_len)
+		*p++ = '\n';
+
+	memcpy(p, newmessage, len + 1);
+	jsonrpc_reply = hd->replybuf;
+	jsonrpc_reply_len = (size_t) (p - hd->replybuf) + len;
 	sfree(newmessage);
 }
 
@@ -108,6 +216,86 @@ static struct sourceinfo_vtable jsonrpc_vtable = {
 	.cmd_success_nodata = jsonrpc_command_success_nodata
 };
 
+static mowgli_list_t jsonrpc_login_requests;
+
+// An atheme.login call waiting for verify_password_async(); see httpd_deferred_done()
+struct jsonrpc_login_request
+{
+	mowgli_node_t               node;
+	struct connection *         conn;
+	struct pwverify_request *   req;
+	char *                      id;
+	char *                      sourceip;
+};
+
+static void
+jsonrpc_login_request_free(struct jsonrpc_login_request *const restrict lr)
+{
+	mowgli_node_delete(&lr->node, &jsonrpc_login_requests);
+	sfree(lr->sourceip);
+	sfree(lr->id);
+	sfree(lr);
+}
+
+static void
+jsonrpc_login_cancel(struct connection ATHEME_VATTR_UNUSED *const restrict cptr, void *const restrict priv)
+{
+	struct jsonrpc_login_request *const lr = priv;
+
+	verify_password_async_cancel(lr->req);
+	jsonrpc_login_request_free(lr);
+}
+
+static void
+jsonrpc_login_verified(struct myuser *const restrict mu, const bool verified, void *const restrict priv)
+{
+	struct jsonrpc_login_request *const lr = priv;
+	struct connection *const conn = lr->conn;
+	struct authcookie *ac;
+
+	if (!mu)
+	{
+		jsonrpc_failure_string(conn, fault_nosuch_source, "The account is not registered.", lr->id);
+	}
+	else if (!verified)
+	{
+		struct sourceinfo *si;
+
+		logcommand_external(nicksvs.me, "jsonrpc", conn, lr->sourceip, NULL, CMDLOG_LOGIN, "failed LOGIN to \2%s\2 (bad password)", entity(mu)->name);
+		jsonrpc_failure_string(conn, fault_authfail, "The password is incorrect.", lr->id);
+
+		si = sourceinfo_create();
+
+		struct jsonrpc_sourceinfo *jsi = (struct jsonrpc_sourceinfo *)si;
+
+		si->service = NULL;
+		si->sourcedesc = lr->sourceip;
+		si->connection = conn;
+		si->v = &jsonrpc_vtable;
+		si->force_language = language_find("en");
+
+		jsi->base = si;
+		jsi->id = lr->id;
+
+		bad_password(si, mu);
+
+		atheme_object_unref(si);
+	}
+	else
+	{
+		mu->lastlogin = CURRTIME;
+
+		ac = authcookie_create(mu);
+
+		logcommand_external(nicksvs.me, "jsonrpc", conn, lr->sourceip, mu, CMDLOG_LOGIN, "LOGIN");
+
+		jsonrpc_success_string(conn, ac->ticket, lr->id);
+	}
+
+	jsonrpc_login_request_free(lr);
+	httpd_deferred_done(conn);
+}
+
 // These taken from modules/transport/xmlrpc/main.c
 
 /* atheme.login
@@ -130,7 +318,7 @@ static bool
 jsonrpcmethod_login(void *conn, mowgli_list_t *params, char *id)
 {
 	struct myuser *mu;
-	struct authcookie *ac;
+	struct httpddata *hd = ((struct connection *) conn)->userdata;
 	char *sourceip, *accountname, *password;
 
 	size_t len = MOWGLI_LIST_LENGTH(params);
@@ -141,6 +329,13 @@ jsonrpcmethod_login(void *conn, mowgli_list_t *params, char *id)
 		return false;
 	}
 
+	// The reply to a login comes later, and a batch is answered all at once
+	if (jsonrpc_batch != NULL)
+	{
+		jsonrpc_failure_string(conn, fault_badparams, "atheme.login cannot be part of a batch.", id);
+		return false;
+	}
+
 	accountname = mowgli_node_nth_data(params, 0);
 	password = mowgli_node_nth_data(params, 1);
 	sourceip = len >= 3 ? mowgli_node_nth_data(params, 2) : NULL;
@@ -158,40 +353,23 @@ jsonrpcmethod_login(void *conn, mowgli_list_t *params, char *id)
 		return false;
 	}
 
-	if (!verify_password(mu, password))
-	{
-		struct sourceinfo *si;
-
-		logcommand_external(nicksvs.me, "jsonrpc", conn, sourceip, NULL, CMDLOG_LOGIN, "failed LOGIN to \2%s\2 (bad password)", entity(mu)->name);
-		jsonrpc_failure_string(conn, fault_authfail, "The password is incorrect.", id);
-
-		si = sourceinfo_create();
-
-		struct jsonrpc_sourceinfo *jsi = (struct jsonrpc_sourceinfo *)si;
-
-		si->service = NULL;
-		si->sourcedesc = sourceip;
-		si->connection = conn;
-		si->v = &jsonrpc_vtable;
-		si->force_language = language_find("en");
-
-		jsi->base = si;
-		jsi->id = id;
+	// The reply is sent from jsonrpc_login_verified() once the password has been checked
+	struct jsonrpc_login_request *const lr = smalloc(sizeof *lr);
 
-		bad_password(si, mu);
-
-		atheme_object_unref(si);
+	lr->conn = conn;
+	lr->id = sstrdup(id);
+	lr->sourceip = sourceip != NULL ? sstrdup(sourceip) : NULL;
+	mowgli_node_add(lr, &lr->node, &jsonrpc_login_requests);
 
+	if (!(lr->req = verify_password_async(mu, password, &jsonrpc_login_verified, lr)))
+	{
+		jsonrpc_login_request_free(lr);
+		jsonrpc_failure_string(conn, fault_authfail, "The password is incorrect.", id);
 		return false;
 	}
 
-	mu->lastlogin = CURRTIME;
-
-	ac = authcookie_create(mu);
-
-	logcommand_external(nicksvs.me, "jsonrpc", conn, sourceip, mu, CMDLOG_LOGIN, "LOGIN");
-
-	jsonrpc_success_string(conn, ac->ticket, id);
+	hd->deferred = lr;
+	hd->deferred_cancel = &jsonrpc_login_cancel;
 
 	return true;
 }
@@ -234,7 +412,7 @@ jsonrpcmethod_logout(void *conn, mowgli_list_t *params, char *id)
 		return false;
 	}
 
-	if (authcookie_validate(cookie, mu) == false)
+	if (jsonrpc_authcookie_validate(cookie, mu) == false)
 	{
 		jsonrpc_failure_string(conn, fault_badauthcookie, "Invalid authcookie for this account.", id);
 		return false;
@@ -311,7 +489,7 @@ jsonrpcmethod_command(void *conn, mowgli_list_t *params, char *id)
 			return 0;
 		}
 
-		if (authcookie_validate(cookie, mu) == false)
+		if (jsonrpc_authcookie_validate(cookie, mu) == false)
 		{
 			jsonrpc_failure_string(conn, fault_badauthcookie, "Invalid authcookie for this account.", id);
 			return 0;
@@ -335,6 +513,12 @@ jsonrpcmethod_command(void *conn, mowgli_list_t *params, char *id)
 		return 0;
 	}
 
+	if (replica && ! cmd->replica_safe)
+	{
+		jsonrpc_failure_string(conn, fault_noprivs, "This is a read-only replica; send the command to the primary.", id);
+		return 0;
+	}
+
 	//command = mowgli_node_nth_data(params, 4);
 
 	memset(newparv, '\0', sizeof newparv);
@@ -422,7 +606,7 @@ jsonrpcmethod_privset(void *conn, mowgli_list_t *params, char *id)
 			return 0;
 		}
 
-		if (authcookie_validate(cookie, mu) == false)
+		if (jsonrpc_authcookie_validate(cookie, mu) == false)
 		{
 			jsonrpc_failure_string(conn, fault_badauthcookie, "Invalid authcookie for this account.", id);
 			return 0;
@@ -533,6 +717,103 @@ jsonrpcmethod_ison(void *conn, mowgli_list_t *params, char *id)
 	return 0;
 }
 
+/* atheme.presence
+ *
+ * JSON inputs:
+ *       one or more nicknames or account names
+ *
+ * JSON outputs:
+ *       An array with one object per input, in the same order, with the
+ *       following properties:
+ *       name: string: the nickname or account name as given
+ *       online: boolean: if there is a user with that nickname online, or
+ *       someone is logged in to that account
+ *       accountname: string: the account the user is logged in to, or the
+ *       account itself, else '*'
+ *       logins: integer: how many users are logged in to that account
+ */
+static void
+jsonrpc_append_json_string(mowgli_string_t *str, const char *value)
+{
+	mowgli_json_t *obj = mowgli_json_create_string(value);
+
+	mowgli_json_serialize_to_string(obj, str, 0);
+	mowgli_json_decref(obj);
+}
+
+static bool
+jsonrpcmethod_presence(void *conn, mowgli_list_t *params, char *id)
+{
+	mowgli_node_t *n;
+	bool first = true;
+
+	MOWGLI_LIST_FOREACH(n, params->head)
+	{
+		const char *param = n->data;
+
+		if (*param == '\0' || strchr(param, '\r') || strchr(param, '\n'))
+		{
+			jsonrpc_failure_string(conn, fault_badparams, "Invalid parameters.", id);
+			return 0;
+		}
+	}
+
+	if (MOWGLI_LIST_LENGTH(params) < 1)
+	{
+		jsonrpc_failure_string(conn, fault_needmoreparams, "Insufficient parameters.", id);
+		return 0;
+	}
+
+	/* Encode the answers one after another instead of building a JSON
+	 * tree for all of them first.
+	 */
+	mowgli_string_t *str = mowgli_string_create();
+
+	mowgli_string_append(str, "{\"id\":", 6);
+	jsonrpc_append_json_string(str, id);
+	mowgli_string_append(str, ",\"error\":null,\"result\":[", 24);
+
+	MOWGLI_LIST_FOREACH(n, params->head)
+	{
+		const char *name = n->data;
+		struct myuser *mu = NULL;
+		bool online = false;
+		char buf[BUFSIZE];
+
+		const struct user *const u = user_find_named(name);
+
+		if (u != NULL)
+		{
+			online = true;
+			mu = u->myuser;
+		}
+		else if ((mu = myuser_find(name)) != NULL)
+			online = MOWGLI_LIST_LENGTH(&mu->logins) != 0;
+
+		if (! first)
+			mowgli_string_append_char(str, ',');
+
+		first = false;
+
+		mowgli_string_append(str, "{\"name\":", 8);
+		jsonrpc_append_json_string(str, name);
+		mowgli_string_append(str, ",\"accountname\":", 15);
+		jsonrpc_append_json_string(str, mu != NULL ? entity(mu)->name : "*");
+
+		const int len = snprintf(buf, sizeof buf, ",\"online\":%s,\"logins\":%zu}", online ? "true" : "false",
+		                         mu != NULL ? MOWGLI_LIST_LENGTH(&mu->logins) : 0);
+
+		mowgli_string_append(str, buf, (size_t) len);
+	}
+
+	mowgli_string_append(str, "]}", 2);
+
+	jsonrpc_send_data(conn, str->str);
+	mowgli_string_destroy(str);
+
+	return 0;
+}
+
 /* atheme.metadata
  *
  * JSON inputs:
@@ -613,32 +894,370 @@ jsonrpcmethod_metadata(void *conn, mowgli_list_t *params, char *id)
 	return 0;
 }
 
-void
-jsonrpc_send_data(void *conn, char *str)
+static void
+jsonrpc_commandstats_cb(const struct command_stats *st, void *privdata)
 {
-	struct httpddata *hd = ((struct connection *) conn)->userdata;
+	mowgli_json_t *const stobj = mowgli_json_create_object();
+	mowgli_json_t *const histobj = mowgli_json_create_array();
+	mowgli_patricia_t *patricia = MOWGLI_JSON_OBJECT(stobj);
+
+	for (unsigned int i = 0; i < COMMAND_STATS_BUCKETS; i++)
+		mowgli_node_add(mowgli_json_create_integer((int) st->hist[i]), mowgli_node_create(),
+				MOWGLI_JSON_ARRAY(histobj));
+
+	mowgli_patricia_add(patricia, "calls", mowgli_json_create_integer((int) st->calls));
+	mowgli_patricia_add(patricia, "slow", mowgli_json_create_integer((int) st->slow));
+	mowgli_patricia_add(patricia, "total_ms", mowgli_json_create_float((double) st->total_us / 1000U));
+	mowgli_patricia_add(patricia, "max_ms", mowgli_json_create_float((double) st->max_us / 1000U));
+	mowgli_patricia_add(patricia, "histogram", histobj);
+
+	mowgli_patricia_add(MOWGLI_JSON_OBJECT((mowgli_json_t *) privdata), st->name, stobj);
+}
+
+/* atheme.commandstats
+ *
+ * JSON inputs:
+ *       authcookie, account name
+ *
+ * JSON outputs:
+ *       An object with a property for every command that has been executed
+ *       ("service COMMAND [SUBCOMMAND]"), each an object with the following
+ *       properties:
+ *       calls: integer: number of times the command was executed
+ *       slow: integer: how many of those took at least slow_command_time
+ *       total_ms, max_ms: number: total and longest execution time
+ *       histogram: array of integers: element i counts the calls that took
+ *       from 2^i to 2^(i+1) microseconds (the last one also counts longer)
+ */
+static bool
+jsonrpcmethod_commandstats(void *conn, mowgli_list_t *params, char *id)
+{
+	struct myuser *mu;
+	mowgli_node_t *n;
+
+	char *param, *accountname, *cookie;
+
+	size_t len = MOWGLI_LIST_LENGTH(params);
+	cookie = mowgli_node_nth_data(params, 0);
+	accountname = mowgli_node_nth_data(params, 1);
 
-	char buf[300];
+	MOWGLI_LIST_FOREACH(n, params->head)
+	{
+		param = n->data;
+
+		if (*param == '\0' || strchr(param, '\r') || strchr(param, '\n'))
+		{
+			jsonrpc_failure_string(conn, fault_badparams, "Invalid authcookie for this account.", id);
+			return 0;
+		}
+	}
+
+	if (len < 2)
+	{
+		jsonrpc_failure_string(conn, fault_needmoreparams, "Insufficient parameters.", id);
+		return 0;
+	}
+
+	if ((mu = myuser_find(accountname)) == NULL)
+	{
+		jsonrpc_failure_string(conn, fault_nosuch_source, "Unknown user.", id);
+		return 0;
+	}
+
+	if (jsonrpc_authcookie_validate(cookie, mu) == false)
+	{
+		jsonrpc_failure_string(conn, fault_badauthcookie, "Invalid authcookie for this account.", id);
+		return 0;
+	}
+
+	if (!has_priv_myuser(mu, PRIV_SERVER_AUSPEX))
+	{
+		jsonrpc_failure_string(conn, fault_noprivs, "You do not have sufficient privileges.", id);
+		return 0;
+	}
+
+	mowgli_json_t *resultobj = mowgli_json_create_object();
+
+	command_stats_foreach(jsonrpc_commandstats_cb, resultobj);
+
+	mowgli_json_t *obj = mowgli_json_create_object();
+	mowgli_patricia_t *patricia = MOWGLI_JSON_OBJECT(obj);
+
+	mowgli_json_t *idobj = mowgli_json_create_string(id);
+
+	mowgli_patricia_add(patricia, "result", resultobj);
+	mowgli_patricia_add(patricia, "id", idobj);
+	mowgli_patricia_add(patricia, "error", mowgli_json_null);
+
+	mowgli_string_t *str = mowgli_string_create();
+
+	mowgli_json_serialize_to_string(obj, str, 0);
+
+	jsonrpc_send_data(conn, str->str);
+
+	return 0;
+}
+
+static mowgli_json_t *
+jsonrpc_netstats_sample(const struct netstats_sample *sample)
+{
+	mowgli_json_t *const obj = mowgli_json_create_object();
+	mowgli_patricia_t *patricia = MOWGLI_JSON_OBJECT(obj);
+
+	mowgli_patricia_add(patricia, "start", mowgli_json_create_integer((int) sample->start));
+	mowgli_patricia_add(patricia, "end", mowgli_json_create_integer((int) sample->end));
+
+	for (unsigned int i = 0; i < NETSTATS_METRIC_COUNT; i++)
+	{
+		const struct netstats_value *const v = &sample->values[i];
+		mowgli_json_t *const vobj = mowgli_json_create_object();
+		mowgli_patricia_t *const vpatricia = MOWGLI_JSON_OBJECT(vobj);
+
+		mowgli_patricia_add(vpatricia, "last", mowgli_json_create_integer((int) v->last));
+		mowgli_patricia_add(vpatricia, "peak", mowgli_json_create_integer((int) v->peak));
+		mowgli_patricia_add(vpatricia, "added", mowgli_json_create_integer((int) v->added));
+		mowgli_patricia_add(vpatricia, "removed", mowgli_json_create_integer((int) v->removed));
+
+		mowgli_patricia_add(patricia, netstats_metric_name(i), vobj);
+	}
+
+	return obj;
+}
+
+static void
+jsonrpc_netstats_cb(const struct netstats_sample *sample, void *privdata)
+{
+	mowgli_node_add(jsonrpc_netstats_sample(sample), mowgli_node_create(),
+	                MOWGLI_JSON_ARRAY((mowgli_json_t *) privdata));
+}
+
+/* atheme.netstats
+ *
+ * JSON inputs:
+ *       resolution (MINUTE, HOUR or DAY), optionally how many samples
+ *
+ * JSON outputs:
+ *       An object with the following properties:
+ *       current: the period in progress, or null
+ *       history: array of finished periods, newest first
+ *       Each period is an object with start and end (UNIX timestamps), and
+ *       users, channels and servers: objects with last (count at the end),
+ *       peak, added and removed.
+ */
+static bool
+jsonrpcmethod_netstats(void *conn, mowgli_list_t *params, char *id)
+{
+	enum netstats_resolution res;
+	struct netstats_sample current;
+	unsigned int count;
+	mowgli_node_t *n;
+
+	MOWGLI_LIST_FOREACH(n, params->head)
+	{
+		const char *param = n->data;
+
+		if (*param == '\0' || strchr(param, '\r') || strchr(param, '\n'))
+		{
+			jsonrpc_failure_string(conn, fault_badparams, "Invalid parameters.", id);
+			return 0;
+		}
+	}
+
+	if (MOWGLI_LIST_LENGTH(params) < 1)
+	{
+		jsonrpc_failure_string(conn, fault_needmoreparams, "Insufficient parameters.", id);
+		return 0;
+	}
+
+	if (! netstats_resolution_parse(mowgli_node_nth_data(params, 0), &res))
+	{
+		jsonrpc_failure_string(conn, fault_badparams, "Unknown resolution.", id);
+		return 0;
+	}
+
+	count = netstats_resolution_size(res);
+
+	if (MOWGLI_LIST_LENGTH(params) > 1 && ! string_to_uint(mowgli_node_nth_data(params, 1), &count))
+	{
+		jsonrpc_failure_string(conn, fault_badparams, "Invalid sample count.", id);
+		return 0;
+	}
+
+	mowgli_json_t *resultobj = mowgli_json_create_object();
+	mowgli_json_t *histobj = mowgli_json_create_array();
+
+	netstats_history_foreach(res, count, jsonrpc_netstats_cb, histobj);
+
+	if (netstats_current(res, &current))
+		mowgli_patricia_add(MOWGLI_JSON_OBJECT(resultobj), "current", jsonrpc_netstats_sample(&current));
+	else
+		mowgli_patricia_add(MOWGLI_JSON_OBJECT(resultobj), "current", mowgli_json_null);
+
+	mowgli_patricia_add(MOWGLI_JSON_OBJECT(resultobj), "history", histobj);
 
-	size_t len = strlen(str);
+	mowgli_json_t *obj = mowgli_json_create_object();
+	mowgli_patricia_t *patricia = MOWGLI_JSON_OBJECT(obj);
+
+	mowgli_patricia_add(patricia, "result", resultobj);
+	mowgli_patricia_add(patricia, "id", mowgli_json_create_string(id));
+	mowgli_patricia_add(patricia, "error", mowgli_json_null);
+
+	mowgli_string_t *str = mowgli_string_create();
+
+	mowgli_json_serialize_to_string(obj, str, 0);
+
+	jsonrpc_send_data(conn, str->str);
+
+	mowgli_string_destroy(str);
+	mowgli_json_decref(obj);
+
+	return 0;
+}
+
+static void
+jsonrpc_clones_cb(const struct clones_top_entry *const restrict entry, void *const restrict privdata)
+{
+	mowgli_json_t *const hostobj = mowgli_json_create_object();
+	mowgli_patricia_t *const patricia = MOWGLI_JSON_OBJECT(hostobj);
+
+	mowgli_patricia_add(patricia, "ip", mowgli_json_create_string(entry->ip));
+	mowgli_patricia_add(patricia, "clients", mowgli_json_create_integer((int) entry->clients));
+	mowgli_patricia_add(patricia, "exempt", entry->exempt ? mowgli_json_true : mowgli_json_false);
+	mowgli_patricia_add(patricia, "allowed", mowgli_json_create_integer((int) entry->allowed));
+
+	mowgli_node_add(hostobj, mowgli_node_create(), MOWGLI_JSON_ARRAY((mowgli_json_t *) privdata));
+}
+
+/* atheme.clones
+ *
+ * JSON inputs:
+ *       authcookie, account name, optionally how many hosts (default 10) and
+ *       the fewest clients a host must have to be listed (default 4)
+ *
+ * JSON outputs:
+ *       Array of the hosts with the most clients, most first, as OperServ
+ *       CLONES LIST shows them; each an object with ip (the address or
+ *       prefix), clients, exempt (boolean) and allowed (the limit that
+ *       applies to it, 0 if none)
+ */
+static bool
+jsonrpcmethod_clones(void *conn, mowgli_list_t *params, char *id)
+{
+	unsigned int max = 10, min = 4;
+	struct myuser *mu;
+	mowgli_node_t *n;
+
+	MOWGLI_LIST_FOREACH(n, params->head)
+	{
+		const char *param = n->data;
+
+		if (*param == '\0' || strchr(param, '\r') || strchr(param, '\n'))
+		{
+			jsonrpc_failure_string(conn, fault_badparams, "Invalid parameters.", id);
+			return 0;
+		}
+	}
+
+	if (MOWGLI_LIST_LENGTH(params) < 2)
+	{
+		jsonrpc_failure_string(conn, fault_needmoreparams, "Insufficient parameters.", id);
+		return 0;
+	}
+
+	if ((mu = myuser_find(mowgli_node_nth_data(params, 1))) == NULL)
+	{
+		jsonrpc_failure_string(conn, fault_nosuch_source, "Unknown user.", id);
+		return 0;
+	}
+
+	if (jsonrpc_authcookie_validate(mowgli_node_nth_data(params, 0), mu) == false)
+	{
+		jsonrpc_failure_string(conn, fault_badauthcookie, "Invalid authcookie for this account.", id);
+		return 0;
+	}
+
+	if (!has_priv_myuser(mu, PRIV_AKILL))
+	{
+		jsonrpc_failure_string(conn, fault_noprivs, "You do not have sufficient privileges.", id);
+		return 0;
+	}
+
+	if ((MOWGLI_LIST_LENGTH(params) > 2 && ! string_to_uint(mowgli_node_nth_data(params, 2), &max)) ||
+	    (MOWGLI_LIST_LENGTH(params) > 3 && ! string_to_uint(mowgli_node_nth_data(params, 3), &min)))
+	{
+		jsonrpc_failure_string(conn, fault_badparams, "Invalid count.", id);
+		return 0;
+	}
+
+	// Looked up each time rather than with module_locate_symbol(), which would make us depend on operserv/clones
+	struct module *const m = module_find_published("operserv/clones");
+	clones_top_foreach_fn top_foreach = NULL;
+
+	if (m && m->handle)
+		top_foreach = (clones_top_foreach_fn) mowgli_module_symbol(m->handle, "clones_top_foreach");
+
+	if (! top_foreach)
+	{
+		jsonrpc_failure_string(conn, fault_unimplemented, "operserv/clones is not loaded.", id);
+		return 0;
+	}
+
+	mowgli_json_t *resultobj = mowgli_json_create_array();
+
+	(void) top_foreach(max, min, jsonrpc_clones_cb, resultobj);
+
+	mowgli_json_t *obj = mowgli_json_create_object();
+	mowgli_patricia_t *patricia = MOWGLI_JSON_OBJECT(obj);
+
+	mowgli_patricia_add(patricia, "result", resultobj);
+	mowgli_patricia_add(patricia, "id", mowgli_json_create_string(id));
+	mowgli_patricia_add(patricia, "error", mowgli_json_null);
+
+	mowgli_string_t *str = mowgli_string_create();
+
+	mowgli_json_serialize_to_string(obj, str, 0);
 
-	snprintf(buf, sizeof buf,
-	         "HTTP/1.1 200 OK\r\n"
-	         "Server: %s/%s\r\n"
-	         "Content-Type: application/json\r\n"
-	         "Content-Length: %zu\r\n"
-	         "%s"
-	         "\r\n",
-	         PACKAGE_TARNAME, PACKAGE_VERSION,
-	         len,
-	         hd->connection_close ? "Connection: close\r\n" : "");
+	jsonrpc_send_data(conn, str->str);
 
-	sendq_add((struct connection *)conn, buf, strlen(buf));
-	sendq_add((struct connection *)conn, str, len);
+	mowgli_string_destroy(str);
+	mowgli_json_decref(obj);
 
-	if (hd->connection_close) {
-		sendq_add_eof((struct connection *) conn);
+	return 0;
+}
+
+struct jsonrpc_writer *
+jsonrpc_reply_begin(void *conn, struct jsonrpc_writer *w)
+{
+	if (jsonrpc_batch == NULL)
+	{
+		jsonrpc_writer_begin(w, conn);
+		return w;
 	}
+
+	if (jsonrpc_batch_replies++)
+		jsonrpc_writer_append(jsonrpc_batch, ",");
+
+	return jsonrpc_batch;
+}
+
+// Nothing is left half-written between replies, in case anything else is queued in between
+void
+jsonrpc_reply_end(struct jsonrpc_writer *w)
+{
+	if (w == jsonrpc_batch)
+		jsonrpc_writer_flush(w);
+	else
+		jsonrpc_writer_end(w);
+}
+
+void
+jsonrpc_send_data(void *conn, char *str)
+{
+	struct jsonrpc_writer wbuf;
+	struct jsonrpc_writer *const w = jsonrpc_reply_begin(conn, &wbuf);
+
+	jsonrpc_writer_append(w, str);
+	jsonrpc_reply_end(w);
 }
 
 static void
@@ -649,7 +1268,7 @@ handle_request(struct connection *cptr, void *requestbuf)
 	return;
 }
 
-static struct path_handler handle_jsonrpc = { NULL, handle_request };
+static struct path_handler handle_jsonrpc = { NULL, handle_request, false, NULL };
 
 static void
 mod_init(struct module *const restrict m)
@@ -657,7 +1276,7 @@ mod_init(struct module *const restrict m)
 	MODULE_TRY_REQUEST_SYMBOL(m, httpd_path_handlers, "misc/httpd", "httpd_path_handlers")
 
 	handle_jsonrpc.path = "/jsonrpc";
-	mowgli_node_add(&handle_jsonrpc, mowgli_node_create(), httpd_path_handlers);
+	mowgli_patricia_add(*httpd_path_handlers, handle_jsonrpc.path, &handle_jsonrpc);
 
 	json_methods = mowgli_patricia_create(strcasecanon);
 
@@ -667,14 +1286,21 @@ mod_init(struct module *const restrict m)
 
 	jsonrpc_register_method("atheme.privset", jsonrpcmethod_privset);
 	jsonrpc_register_method("atheme.ison", jsonrpcmethod_ison);
+	jsonrpc_register_method("atheme.presence", jsonrpcmethod_presence);
 	jsonrpc_register_method("atheme.metadata", jsonrpcmethod_metadata);
+	jsonrpc_register_method("atheme.commandstats", jsonrpcmethod_commandstats);
+	jsonrpc_register_method("atheme.netstats", jsonrpcmethod_netstats);
+	jsonrpc_register_method("atheme.clones", jsonrpcmethod_clones);
+	jsonrpc_register_method("atheme.subscribe", jsonrpcmethod_subscribe);
+
+	jsonrpc_events_init();
 
 }
 
 static void
 mod_deinit(const enum module_unload_intent ATHEME_VATTR_UNUSED intent)
 {
-	mowgli_node_t *n;
+	mowgli_node_t *n, *tn;
 
 	jsonrpc_unregister_method("atheme.login");
 	jsonrpc_unregister_method("atheme.logout");
@@ -682,13 +1308,30 @@ mod_deinit(const enum module_unload_intent ATHEME_VATTR_UNUSED intent)
 
 	jsonrpc_unregister_method("atheme.privset");
 	jsonrpc_unregister_method("atheme.ison");
+	jsonrpc_unregister_method("atheme.presence");
 	jsonrpc_unregister_method("atheme.metadata");
+	jsonrpc_unregister_method("atheme.commandstats");
+	jsonrpc_unregister_method("atheme.netstats");
+	jsonrpc_unregister_method("atheme.clones");
+	jsonrpc_unregister_method("atheme.subscribe");
+
+	jsonrpc_events_deinit();
 
-	if ((n = mowgli_node_find(&handle_jsonrpc, httpd_path_handlers)) != NULL)
+	// Logins still being checked can't be answered once we are gone
+	MOWGLI_ITER_FOREACH_SAFE(n, tn, jsonrpc_login_requests.head)
 	{
-		mowgli_node_delete(n, httpd_path_handlers);
-		mowgli_node_free(n);
+		struct jsonrpc_login_request *const lr = n->data;
+		struct httpddata *const hd = lr->conn->userdata;
+
+		hd->deferred = NULL;
+		hd->deferred_cancel = NULL;
+		connection_close_soon(lr->conn);
+
+		jsonrpc_login_cancel(lr->conn, lr);
 	}
+
+	if (mowgli_patricia_retrieve(*httpd_path_handlers, handle_jsonrpc.path) == &handle_jsonrpc)
+		mowgli_patricia_delete(*httpd_path_handlers, handle_jsonrpc.path);
 }
 
 SIMPLE_DECLARE_MODULE_V1("transport/jsonrpc", MODULE_UNLOAD_CAPABILITY_OK)
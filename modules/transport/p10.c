@@ -28,6 +28,7 @@ p10_parse(char *line)
 	int parc = 0;
 	unsigned int i;
 	struct proto_cmd *pcmd;
+	size_t linelen = 0;
 
 	// clear the parv
 	for (i = 0; i <= MAXPARC; i++)
@@ -49,9 +50,9 @@ p10_parse(char *line)
 
 		// copy the original line so we know what we crashed on
 		memset((char *)&coreLine, '\0', BUFSIZE);
-		mowgli_strlcpy(coreLine, line, BUFSIZE);
+		linelen = mowgli_strlcpy(coreLine, line, BUFSIZE);
 
-		slog(LG_RAWDATA, "-> %s", line);
+		slog_lazy(LG_RAWDATA, "-> %s", line);
 
 		// find the first space
 		if ((pos = strchr(line, ' ')))
@@ -144,6 +145,9 @@ p10_parse(char *line)
 		// take the command through the hash table
 		if ((pcmd = pcommand_find(command)))
 		{
+			pcmd->lines++;
+			pcmd->bytes += linelen;
+
 			if (si->su && !(pcmd->sourcetype & MSRC_USER))
 			{
 				slog(LG_INFO, "p10_parse(): user %s sent disallowed command %s", si->su->nick, pcmd->token);
@@ -166,7 +170,8 @@ p10_parse(char *line)
 			}
 			if (pcmd->handler)
 			{
-				pcmd->handler(si, parc, parv);
+				ATHEME_TRACE3(parse__dispatch, origin, command, parc);
+				pcommand_dispatch(pcmd, si, parc, parv);
 			}
 		}
 	}
@@ -20,15 +20,14 @@ void
 irc_parse(char *line)
 {
 	struct sourceinfo *si;
-	char *pos;
 	char *origin = NULL;
 	char *command = NULL;
-	char *message = NULL;
 	char *parv[MAXPARC + 1];
 	static char coreLine[BUFSIZE];
 	int parc = 0;
 	unsigned int i;
 	struct proto_cmd *pcmd;
+	size_t linelen = 0;
 
 	// clear the parv
 	for (i = 0; i <= MAXPARC; i++)
@@ -49,61 +48,25 @@ irc_parse(char *line)
 			goto cleanup;
 
 		// copy the original line so we know what we crashed on
-		memset((char *)&coreLine, '\0', BUFSIZE);
-		mowgli_strlcpy(coreLine, line, BUFSIZE);
+		linelen = mowgli_strlcpy(coreLine, line, BUFSIZE);
 
-		slog(LG_RAWDATA, "-> %s", line);
+		slog_lazy(LG_RAWDATA, "-> %s", line);
 
-		// find the first space
-		if ((pos = strchr(line, ' ')))
-		{
-			*pos = '\0';
-			pos++;
-
-			/* if it starts with a : we have a prefix/origin
-			 * pull the origin off into `origin', and have pos for the
-			 * command, message will be the part afterwards
-			 */
-			if (*line == ':')
-			{
-                        	origin = line + 1;
-
-				si->s = server_find(origin);
-				si->su = user_find(origin);
+		// split off the prefix, command and parameters in one go
+		if ((parc = irc_tokenize(line, &origin, &command, parv)) < 0)
+			goto cleanup;
 
-				if ((message = strchr(pos, ' ')))
-				{
-					*message = '\0';
-					message++;
-					command = pos;
-				}
-				else
-				{
-					command = pos;
-					message = NULL;
-				}
-			}
-			else
-			{
-				if (me.recvsvr)
-				{
-					origin = me.actual;
-					si->s = server_find(origin);
-				}
-				message = pos;
-				command = line;
-			}
+		if (origin != NULL)
+		{
+			si->s = server_find(origin);
+			si->su = user_find(origin);
 		}
-		else
+		else if (me.recvsvr)
 		{
-			if (me.recvsvr)
-			{
-				origin = me.actual;
-				si->s = server_find(origin);
-			}
-			command = line;
-			message = NULL;
+			origin = me.actual;
+			si->s = server_find(origin);
 		}
+
                 if (!si->s && !si->su && me.recvsvr)
                 {
                         slog(LG_DEBUG, "irc_parse(): got message from nonexistent user or server: %s", origin);
@@ -121,27 +84,12 @@ irc_parse(char *line)
 		}
 		si->smu = si->su != NULL ? si->su->myuser : NULL;
 
-		/* okay, the nasty part is over, now we need to make a
-		 * parv out of what's left
-		 */
-
-		if (message)
-		{
-			if (*message == ':')
-			{
-				message++;
-				parv[0] = message;
-				parc = 1;
-			}
-			else
-				parc = tokenize(message, parv);
-		}
-		else
-			parc = 0;
-
 		// take the command through the hash table
 		if ((pcmd = pcommand_find(command)))
 		{
+			pcmd->lines++;
+			pcmd->bytes += linelen;
+
 			if (si->su && !(pcmd->sourcetype & MSRC_USER))
 			{
 				slog(LG_INFO, "irc_parse(): user %s sent disallowed command %s", si->su->nick, pcmd->token);
@@ -164,7 +112,8 @@ irc_parse(char *line)
 			}
 			if (pcmd->handler)
 			{
-				pcmd->handler(si, parc, parv);
+				ATHEME_TRACE3(parse__dispatch, origin, command, parc);
+				pcommand_dispatch(pcmd, si, parc, parv);
 			}
 		}
 	}
@@ -16,7 +16,10 @@ static struct {
 
 static struct connection *current_cptr = NULL; // XXX: Hack: src/xmlrpc.c requires us to do this
 
-static mowgli_list_t *httpd_path_handlers = NULL;
+static mowgli_patricia_t **httpd_path_handlers = NULL;
+
+// The path handle_xmlrpc is registered under, which the configured one may no longer be
+static char *xmlrpc_registered_path = NULL;
 
 // Configuration
 static mowgli_list_t conf_xmlrpc_table;
@@ -49,17 +52,43 @@ dump_buffer(char *buf, int length)
 	return buf;
 }
 
+static bool
+handle_request_progress(struct connection *cptr, size_t from, size_t to)
+{
+	struct httpddata *hd = cptr->userdata;
+
+	return xmlrpc_feed(&hd->bodystate, hd->requestbuf, from, to);
+}
+
 static void
 handle_request(struct connection *cptr, void *requestbuf)
 {
+	struct httpddata *hd = cptr->userdata;
+
 	current_cptr = cptr;
-	xmlrpc_process(requestbuf, cptr);
+	if (hd->bodystate != NULL)
+		xmlrpc_process_parsed(requestbuf, hd->bodystate, cptr);
+	else
+		xmlrpc_process(requestbuf, cptr);
 	current_cptr = NULL;
 
 	return;
 }
 
-static struct path_handler handle_xmlrpc = { NULL, handle_request };
+static struct path_handler handle_xmlrpc = { NULL, handle_request, false, handle_request_progress };
+
+static void
+xmlrpc_unregister_path(void)
+{
+	if (xmlrpc_registered_path == NULL)
+		return;
+
+	if (mowgli_patricia_retrieve(*httpd_path_handlers, xmlrpc_registered_path) == &handle_xmlrpc)
+		mowgli_patricia_delete(*httpd_path_handlers, xmlrpc_registered_path);
+
+	sfree(xmlrpc_registered_path);
+	xmlrpc_registered_path = NULL;
+}
 
 static void
 xmlrpc_config_ready(void *vptr)
@@ -71,10 +100,13 @@ xmlrpc_config_ready(void *vptr)
 
 	if (handle_xmlrpc.handler != NULL)
 	{
-		if (mowgli_node_find(&handle_xmlrpc, httpd_path_handlers))
+		if (xmlrpc_registered_path != NULL && !strcmp(xmlrpc_registered_path, handle_xmlrpc.path))
 			return;
 
-		mowgli_node_add(&handle_xmlrpc, mowgli_node_create(), httpd_path_handlers);
+		xmlrpc_unregister_path();
+
+		mowgli_patricia_add(*httpd_path_handlers, handle_xmlrpc.path, &handle_xmlrpc);
+		xmlrpc_registered_path = sstrdup(handle_xmlrpc.path);
 	}
 	else
 		slog(LG_ERROR, "xmlrpc_config_ready(): xmlrpc {} block missing or invalid");
@@ -152,6 +184,82 @@ static struct sourceinfo_vtable xmlrpc_vtable = {
 
 // These taken from the old modules/xmlrpc/account.c
 
+static mowgli_list_t xmlrpc_login_requests;
+
+// An atheme.login call waiting for verify_password_async(); see httpd_deferred_done()
+struct xmlrpc_login_request
+{
+	mowgli_node_t               node;
+	struct connection *         conn;
+	struct pwverify_request *   req;
+	char *                      sourceip;
+};
+
+static void
+xmlrpc_login_request_free(struct xmlrpc_login_request *const restrict lr)
+{
+	mowgli_node_delete(&lr->node, &xmlrpc_login_requests);
+	sfree(lr->sourceip);
+	sfree(lr);
+}
+
+static void
+xmlrpc_login_cancel(struct connection ATHEME_VATTR_UNUSED *const restrict cptr, void *const restrict priv)
+{
+	struct xmlrpc_login_request *const lr = priv;
+
+	verify_password_async_cancel(lr->req);
+	xmlrpc_login_request_free(lr);
+}
+
+static void
+xmlrpc_login_verified(struct myuser *const restrict mu, const bool verified, void *const restrict priv)
+{
+	struct xmlrpc_login_request *const lr = priv;
+	struct connection *const conn = lr->conn;
+	struct authcookie *ac;
+
+	current_cptr = conn;
+
+	if (!mu)
+	{
+		xmlrpc_generic_error(fault_nosuch_source, "The account is not registered.");
+	}
+	else if (!verified)
+	{
+		struct sourceinfo *si;
+
+		logcommand_external(nicksvs.me, "xmlrpc", conn, lr->sourceip, NULL, CMDLOG_LOGIN, "failed LOGIN to \2%s\2 (bad password)", entity(mu)->name);
+		xmlrpc_generic_error(fault_authfail, "The password is not valid for this account.");
+
+		si = sourceinfo_create();
+		si->service = NULL;
+		si->sourcedesc = lr->sourceip;
+		si->connection = conn;
+		si->v = &xmlrpc_vtable;
+		si->force_language = language_find("en");
+
+		bad_password(si, mu);
+
+		atheme_object_unref(si);
+	}
+	else
+	{
+		mu->lastlogin = CURRTIME;
+
+		ac = authcookie_create(mu);
+
+		logcommand_external(nicksvs.me, "xmlrpc", conn, lr->sourceip, mu, CMDLOG_LOGIN, "LOGIN");
+
+		xmlrpc_send_string(ac->ticket);
+	}
+
+	current_cptr = NULL;
+
+	xmlrpc_login_request_free(lr);
+	httpd_deferred_done(conn);
+}
+
 /* atheme.login
  *
  * XML Inputs:
@@ -172,7 +280,7 @@ static int
 xmlrpcmethod_login(void *conn, int parc, char *parv[])
 {
 	struct myuser *mu;
-	struct authcookie *ac;
+	struct httpddata *hd = ((struct connection *) conn)->userdata;
 	const char *sourceip;
 
 	if (parc < 2)
@@ -196,34 +304,22 @@ xmlrpcmethod_login(void *conn, int parc, char *parv[])
 		return 0;
 	}
 
-	if (!verify_password(mu, parv[1]))
-	{
-		struct sourceinfo *si;
-
-		logcommand_external(nicksvs.me, "xmlrpc", conn, sourceip, NULL, CMDLOG_LOGIN, "failed LOGIN to \2%s\2 (bad password)", entity(mu)->name);
-		xmlrpc_generic_error(fault_authfail, "The password is not valid for this account.");
+	// The reply is sent from xmlrpc_login_verified() once the password has been checked
+	struct xmlrpc_login_request *const lr = smalloc(sizeof *lr);
 
-		si = sourceinfo_create();
-		si->service = NULL;
-		si->sourcedesc = parv[2] != NULL && *parv[2] ? parv[2] : NULL;
-		si->connection = conn;
-		si->v = &xmlrpc_vtable;
-		si->force_language = language_find("en");
-
-		bad_password(si, mu);
-
-		atheme_object_unref(si);
+	lr->conn = conn;
+	lr->sourceip = sourceip != NULL ? sstrdup(sourceip) : NULL;
+	mowgli_node_add(lr, &lr->node, &xmlrpc_login_requests);
 
+	if (!(lr->req = verify_password_async(mu, parv[1], &xmlrpc_login_verified, lr)))
+	{
+		xmlrpc_login_request_free(lr);
+		xmlrpc_generic_error(fault_authfail, "The password is not valid for this account.");
 		return 0;
 	}
 
-	mu->lastlogin = CURRTIME;
-
-	ac = authcookie_create(mu);
-
-	logcommand_external(nicksvs.me, "xmlrpc", conn, sourceip, mu, CMDLOG_LOGIN, "LOGIN");
-
-	xmlrpc_send_string(ac->ticket);
+	hd->deferred = lr;
+	hd->deferred_cancel = &xmlrpc_login_cancel;
 
 	return 0;
 }
@@ -347,6 +443,12 @@ xmlrpcmethod_command(void *conn, int parc, char *parv[])
 		return 0;
 	}
 
+	if (replica && ! cmd->replica_safe)
+	{
+		xmlrpc_generic_error(fault_noprivs, "This is a read-only replica; send the command to the primary.");
+		return 0;
+	}
+
 	memset(newparv, '\0', sizeof newparv);
 	newparc = parc - 5;
 	if (newparc > 20)
@@ -485,6 +587,84 @@ xmlrpcmethod_ison(void *conn, int parc, char *parv[])
 	return 0;
 }
 
+/* atheme.presence
+ *
+ * XML inputs:
+ *       one or more nicknames or account names
+ *
+ * XML outputs:
+ *       array with one struct per input, in the same order, with the
+ *       following members:
+ *       name: string: the nickname or account name as given
+ *       online: boolean: if there is a user with that nickname online, or
+ *       someone is logged in to that account
+ *       accountname: string: the account the user is logged in to, or the
+ *       account itself, else '*'
+ *       logins: integer: how many users are logged in to that account
+ */
+static int
+xmlrpcmethod_presence(void *conn, int parc, char *parv[])
+{
+	int i;
+
+	for (i = 0; i < parc; i++)
+	{
+		if (strchr(parv[i], '\r') || strchr(parv[i], '\n'))
+		{
+			xmlrpc_generic_error(fault_badparams, "Invalid parameters.");
+			return 0;
+		}
+	}
+
+	if (parc < 1)
+	{
+		xmlrpc_generic_error(fault_needmoreparams, "Insufficient parameters.");
+		return 0;
+	}
+
+	// Encode the answers one after another, they can be far more than XMLRPC_BUFSIZE
+	mowgli_string_t *s = mowgli_string_create();
+
+	s->append(s, "<array><data>", 13);
+
+	for (i = 0; i < parc; i++)
+	{
+		struct myuser *mu = NULL;
+		bool online = false;
+		char buf[XMLRPC_BUFSIZE];
+
+		const struct user *const u = user_find_named(parv[i]);
+
+		if (u != NULL)
+		{
+			online = true;
+			mu = u->myuser;
+		}
+		else if ((mu = myuser_find(parv[i])) != NULL)
+			online = MOWGLI_LIST_LENGTH(&mu->logins) != 0;
+
+		s->append(s, "\r\n<value><struct><member><name>name</name><value>", 49);
+		xmlrpc_string_append(s, parv[i]);
+		s->append(s, "</value></member><member><name>accountname</name><value>", 56);
+		xmlrpc_string_append(s, mu != NULL ? entity(mu)->name : "*");
+
+		const int len = snprintf(buf, sizeof buf, "</value></member>"
+		                         "<member><name>online</name><value><boolean>%d</boolean></value></member>"
+		                         "<member><name>logins</name><value><i4>%zu</i4></value></member>"
+		                         "</struct></value>", online ? 1 : 0,
+		                         mu != NULL ? MOWGLI_LIST_LENGTH(&mu->logins) : 0);
+
+		s->append(s, buf, (size_t) len);
+	}
+
+	s->append(s, "\r\n</data></array>", 17);
+
+	xmlrpc_send(1, s->str);
+	s->destroy(s);
+
+	return 0;
+}
+
 /* atheme.metadata
  *
  * XML inputs:
@@ -578,27 +758,38 @@ mod_init(struct module *const restrict m)
 	xmlrpc_register_method("atheme.command", xmlrpcmethod_command);
 	xmlrpc_register_method("atheme.privset", xmlrpcmethod_privset);
 	xmlrpc_register_method("atheme.ison", xmlrpcmethod_ison);
+	xmlrpc_register_method("atheme.presence", xmlrpcmethod_presence);
 	xmlrpc_register_method("atheme.metadata", xmlrpcmethod_metadata);
 }
 
 static void
 mod_deinit(const enum module_unload_intent ATHEME_VATTR_UNUSED intent)
 {
-	mowgli_node_t *n;
+	mowgli_node_t *n, *tn;
 
 	xmlrpc_unregister_method("atheme.login");
 	xmlrpc_unregister_method("atheme.logout");
 	xmlrpc_unregister_method("atheme.command");
 	xmlrpc_unregister_method("atheme.privset");
 	xmlrpc_unregister_method("atheme.ison");
+	xmlrpc_unregister_method("atheme.presence");
 	xmlrpc_unregister_method("atheme.metadata");
 
-	if ((n = mowgli_node_find(&handle_xmlrpc, httpd_path_handlers)) != NULL)
+	// Logins still being checked can't be answered once we are gone
+	MOWGLI_ITER_FOREACH_SAFE(n, tn, xmlrpc_login_requests.head)
 	{
-		mowgli_node_delete(n, httpd_path_handlers);
-		mowgli_node_free(n);
+		struct xmlrpc_login_request *const lr = n->data;
+		struct httpddata *const hd = lr->conn->userdata;
+
+		hd->deferred = NULL;
+		hd->deferred_cancel = NULL;
+		connection_close_soon(lr->conn);
+
+		xmlrpc_login_cancel(lr->conn, lr);
 	}
 
+	xmlrpc_unregister_path();
+
 	del_conf_item("PATH", &conf_xmlrpc_table);
 	del_top_conf("XMLRPC");
 
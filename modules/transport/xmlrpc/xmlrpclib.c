@@ -34,186 +34,313 @@ static int xmlrpc_error_code;
 
 static mowgli_patricia_t *XMLRPCCMD = NULL;
 
+static void xmlrpc_normalize_inplace(char *buf);
+
 int
 xmlrpc_getlast_error(void)
 {
 	return xmlrpc_error_code;
 }
 
-/**
- * Parse Data down to just the <xml> without any \r\n or \t
- * @param buffer Incoming data buffer
- * @return cleaned up buffer
+enum xmlrpc_capture
+{
+	XMLRPC_CAPTURE_NONE,
+	XMLRPC_CAPTURE_NAME,
+	XMLRPC_CAPTURE_VALUE,
+};
+
+/* State of xmlrpc_feed(); everything is an offset into the request buffer,
+ * which the method name and parameters end up as slices of.
  */
-static char *
-xmlrpc_parse(char *buffer)
+struct xmlrpc_parser
 {
-	char *tmp = NULL;
+	size_t                  pos;            // how far the buffer has been scanned
+	bool                    in_tag;
+	size_t                  tagstart;       // just after the '<'
+
+	enum xmlrpc_capture     capture;
+	size_t                  start;          // of the text being captured
+	size_t                  end;            // 0 until the first '<' after start
+	bool                    in_value;
+
+	bool                    xml_decl;       // seen <?xml ...?>
+	bool                    have_name;
+	int                     error;          // set by a malformed document, reported once it has all arrived
+	size_t                  name_start;
+	size_t                  name_end;
+
+	unsigned int            parc;
+	struct {
+		size_t          start;
+		size_t          end;
+	}                       parv[XMLRPC_PARAMS_MAX];
+};
+
+static bool
+xmlrpc_tag_is(const char *const restrict tag, const size_t len, const char *const restrict name)
+{
+	return strlen(name) == len && ! strncasecmp(tag, name, len);
+}
 
-	/*
-	   Okay since the buffer could contain
-	   HTTP header information, lets break
-	   off at the point that the <?xml?> starts
-	 */
-	tmp = strstr(buffer, "<?xml");
+static bool
+xmlrpc_parser_tag(struct xmlrpc_parser *const restrict xp, const char *const restrict buffer, const size_t gt)
+{
+	const char *tag = buffer + xp->tagstart;
+	size_t len = gt - xp->tagstart;
+	bool closing = false, empty = false;
 
-	// check if its xml doc
-	if (tmp)
+	if (len && (*tag == '?' || *tag == '!'))
 	{
-		// get all the odd characters out of the data
-		return xmlrpc_normalizeBuffer(tmp);
+		if (len >= 4 && ! strncasecmp(tag, "?xml", 4))
+			xp->xml_decl = true;
+
+		return true;
 	}
-	return NULL;
-}
 
-static char *
-xmlrpc_method(char *buffer)
-{
-	char *data, *p, *name;
-	int namelen;
-
-	data = strstr(buffer, "<methodName>");
-	if (data)
-	{
-		data += 12;
-		p = strchr(data, '<');
-		if (p == NULL)
-			return NULL;
-		namelen = p - data;
-		name = smalloc(namelen + 1);
-		memcpy(name, data, namelen);
-		return name;
-	}
-	return NULL;
+	if (len && *tag == '/')
+	{
+		closing = true;
+		tag++;
+		len--;
+	}
+	else if (len && tag[len - 1] == '/')
+	{
+		empty = true;
+		len--;
+	}
+
+	// Attributes are of no interest
+	for (size_t i = 0; i < len; i++)
+	{
+		if (isspace((unsigned char) tag[i]))
+		{
+			len = i;
+			break;
+		}
+	}
+
+	if (xmlrpc_tag_is(tag, len, "methodName"))
+	{
+		if (! closing)
+		{
+			xp->capture = XMLRPC_CAPTURE_NAME;
+			xp->start = gt + 1;
+			xp->end = empty ? gt + 1 : 0;
+		}
+
+		if (closing || empty)
+		{
+			if (xp->capture == XMLRPC_CAPTURE_NAME && xp->end != 0)
+			{
+				xp->name_start = xp->start;
+				xp->name_end = xp->end;
+				xp->have_name = true;
+			}
+
+			xp->capture = XMLRPC_CAPTURE_NONE;
+		}
+	}
+	else if (xmlrpc_tag_is(tag, len, "value"))
+	{
+		if (! closing)
+		{
+			// Arrays and structs have values of their own
+			if (xp->in_value)
+				xp->error = -10;
+
+			xp->in_value = true;
+			xp->capture = XMLRPC_CAPTURE_VALUE;
+			xp->start = gt + 1;
+			xp->end = empty ? gt + 1 : 0;
+		}
+
+		if ((closing || empty) && xp->in_value)
+		{
+			if (xp->parc == XMLRPC_PARAMS_MAX)
+				return false;
+
+			xp->parv[xp->parc].start = xp->start;
+			xp->parv[xp->parc].end = xp->end;
+			xp->parc++;
+
+			xp->in_value = false;
+			xp->capture = XMLRPC_CAPTURE_NONE;
+		}
+	}
+	else if (xp->in_value && ! closing)
+	{
+		if (xmlrpc_tag_is(tag, len, "array") || xmlrpc_tag_is(tag, len, "struct"))
+			xp->error = -10;
+
+		// <string>, <i4>, <boolean>, ...: the value is what is inside
+		xp->start = gt + 1;
+		xp->end = empty ? gt + 1 : 0;
+	}
+
+	return true;
 }
 
-/* Splits up a series of values into an array of strings.
- * The given buffer is modified and the pointers in the array point to
- * parts of the buffer. The array itself is dynamically allocated.
- * Returns the number of values placed in the array.
- * Largely rewritten by jilles 20080803
+/*
+ * xmlrpc_feed()
+ *
+ * Scans buffer[from, to), which has just been added to a request; *state is
+ * NULL the first time and is then sfree()able. This is a single pass over
+ * each byte, so it can be called as a request arrives. Returns false if the
+ * request has too many (XMLRPC_PARAMS_MAX) or too large (XMLRPC_PARAMLEN_MAX)
+ * parameters, before anything is done with them.
  */
-static int
-xmlrpc_split_buf(char *buffer, char ***argv)
+bool
+xmlrpc_feed(void **const restrict state, char *const restrict buffer, const size_t from, const size_t to)
 {
-	int ac = 0;
-	int argvsize = 8;
-	char *data, *str;
-	char *nexttag = NULL;
-	char *p;
-	int tagtype = 0;
-
-	data = buffer;
-	*argv = smalloc(sizeof(char *) * argvsize);
-	while ((data = strstr(data, "<value>")))
-	{
-		data += 7;
-		nexttag = strchr(data, '<');
-		if (nexttag == NULL)
-			break;
-		nexttag++;
-		p = strchr(nexttag, '>');
-		if (p == NULL)
-			break;
-		*p++ = '\0';
+	struct xmlrpc_parser *xp = *state;
 
-		// strings
-		if (!stricmp("string", nexttag))
-			tagtype = 1;
-		else
-			tagtype = 0;
-		str = p;
-		p = strchr(str, '<');
-		if (p == NULL)
-			break;
-		*p++ = '\0';
-		if (ac >= argvsize)
+	if (xp == NULL)
+		*state = xp = smalloc(sizeof *xp);
+
+	return_val_if_fail(xp->pos == from, false);
+
+	for (size_t i = from; i < to; i++)
+	{
+		if (xp->in_tag)
 		{
-			argvsize *= 2;
-			*argv = sreallocarray(*argv, argvsize, sizeof(char *));
+			if (buffer[i] != '>')
+				continue;
+
+			xp->in_tag = false;
+
+			if (! xmlrpc_parser_tag(xp, buffer, i))
+				return false;
 		}
-		if (tagtype == 1)
-			(*argv)[ac++] = xmlrpc_decode_string(str);
-		else
-			(*argv)[ac++] = str;
-		data = p;
-	}			// while
-	return ac;
+		else if (buffer[i] == '<')
+		{
+			if (xp->capture != XMLRPC_CAPTURE_NONE && xp->end == 0)
+				xp->end = i;
+
+			xp->in_tag = true;
+			xp->tagstart = i + 1;
+		}
+		else if (xp->capture != XMLRPC_CAPTURE_NONE && xp->end == 0 && i - xp->start >= XMLRPC_PARAMLEN_MAX)
+			return false;
+	}
+
+	xp->pos = to;
+
+	return true;
 }
 
+/*
+ * xmlrpc_process_parsed()
+ *
+ * Runs the call in a request that has all been through xmlrpc_feed(). The
+ * method name and parameters are terminated and decoded where they are in
+ * buffer.
+ */
 void
-xmlrpc_process(char *buffer, void *userdata)
+xmlrpc_process_parsed(char *buffer, void *state, void *userdata)
 {
+	struct xmlrpc_parser *const xp = state;
 	int retVal = 0;
 	XMLRPCCmd *current = NULL;
 	XMLRPCCmd *xml;
-	char *tmp;
-	int ac;
-	char **av = NULL;
-	char *name = NULL;
+	char *av[XMLRPC_PARAMS_MAX];
+	unsigned int i;
 
 	xmlrpc_error_code = 0;
 
-	if (!buffer)
+	if (!buffer || !xp)
 	{
 		xmlrpc_error_code = -1;
 		return;
 	}
 
-	tmp = xmlrpc_parse(buffer);
-	if (tmp)
+	if (!xp->xml_decl)
 	{
-		name = xmlrpc_method(tmp);
-		if (name)
-		{
-			xml = mowgli_patricia_retrieve(XMLRPCCMD, name);
-			if (xml)
-			{
-				ac = xmlrpc_split_buf(tmp, &av);
-				if (xml->func)
-				{
-					retVal = xml->func(userdata, ac, av);
-					if (retVal == XMLRPC_CONT)
-					{
-						current = xml->next;
-						while (current && current->func && retVal == XMLRPC_CONT)
-						{
-							retVal = current->func(userdata, ac, av);
-							current = current->next;
-						}
-					}
-					else
-					{	// we assume that XMLRPC_STOP means the handler has given no output
-						xmlrpc_error_code = -7;
-						xmlrpc_generic_error(xmlrpc_error_code, "XMLRPC error: First eligible function returned XMLRPC_STOP");
-					}
-				}
-				else
-				{
-					xmlrpc_error_code = -6;
-					xmlrpc_generic_error(xmlrpc_error_code, "XMLRPC error: Method has no registered function");
-				}
-			}
-			else
-			{
-				xmlrpc_error_code = -4;
-				xmlrpc_generic_error(xmlrpc_error_code, "XMLRPC error: Unknown routine called");
-			}
-		}
-		else
+		xmlrpc_error_code = -2;
+		xmlrpc_generic_error(xmlrpc_error_code, "XMLRPC error: Invalid document end at line 1");
+		return;
+	}
+
+	if (!xp->have_name)
+	{
+		xmlrpc_error_code = -3;
+		xmlrpc_generic_error(xmlrpc_error_code, "XMLRPC error: Missing methodRequest or methodName.");
+		return;
+	}
+
+	buffer[xp->name_end] = '\0';
+	xmlrpc_normalize_inplace(buffer + xp->name_start);
+
+	xml = mowgli_patricia_retrieve(XMLRPCCMD, buffer + xp->name_start);
+	if (!xml)
+	{
+		xmlrpc_error_code = -4;
+		xmlrpc_generic_error(xmlrpc_error_code, "XMLRPC error: Unknown routine called");
+		return;
+	}
+
+	if (xp->error)
+	{
+		xmlrpc_error_code = xp->error;
+		xmlrpc_generic_error(xmlrpc_error_code, "XMLRPC error: Parameters must be scalar values");
+		return;
+	}
+
+	if (!xml->func)
+	{
+		xmlrpc_error_code = -6;
+		xmlrpc_generic_error(xmlrpc_error_code, "XMLRPC error: Method has no registered function");
+		return;
+	}
+
+	for (i = 0; i < xp->parc; i++)
+	{
+		av[i] = buffer + xp->parv[i].start;
+		buffer[xp->parv[i].end] = '\0';
+
+		xmlrpc_normalize_inplace(av[i]);
+		(void) xmlrpc_decode_string(av[i]);
+	}
+
+	retVal = xml->func(userdata, (int) xp->parc, av);
+	if (retVal == XMLRPC_CONT)
+	{
+		current = xml->next;
+		while (current && current->func && retVal == XMLRPC_CONT)
 		{
-			xmlrpc_error_code = -3;
-			xmlrpc_generic_error(xmlrpc_error_code, "XMLRPC error: Missing methodRequest or methodName.");
+			retVal = current->func(userdata, (int) xp->parc, av);
+			current = current->next;
 		}
 	}
 	else
+	{	// we assume that XMLRPC_STOP means the handler has given no output
+		xmlrpc_error_code = -7;
+		xmlrpc_generic_error(xmlrpc_error_code, "XMLRPC error: First eligible function returned XMLRPC_STOP");
+	}
+}
+
+// A whole request at once
+void
+xmlrpc_process(char *buffer, void *userdata)
+{
+	void *state = NULL;
+
+	xmlrpc_error_code = 0;
+
+	if (!buffer)
 	{
-		xmlrpc_error_code = -2;
-		xmlrpc_generic_error(xmlrpc_error_code, "XMLRPC error: Invalid document end at line 1");
+		xmlrpc_error_code = -1;
+		return;
 	}
-	sfree(av);
-	sfree(tmp);
-	sfree(name);
+
+	if (!xmlrpc_feed(&state, buffer, 0, strlen(buffer)))
+	{
+		xmlrpc_error_code = -9;
+		xmlrpc_generic_error(xmlrpc_error_code, "XMLRPC error: Too many or too large parameters");
+	}
+	else
+		xmlrpc_process_parsed(buffer, state, userdata);
+
+	sfree(state);
 }
 
 void
@@ -572,6 +699,17 @@ xmlrpc_string(char *buf, const char *value)
 	return buf;
 }
 
+/* Like xmlrpc_string(), but appends to s instead of a fixed size buffer, for
+ * responses too big to prepare in XMLRPC_BUFSIZE pieces.
+ */
+void
+xmlrpc_string_append(mowgli_string_t *s, const char *value)
+{
+	s->append(s, "<string>", 8);
+	xmlrpc_append_char_encode(s, value);
+	s->append(s, "</string>", 9);
+}
+
 char *
 xmlrpc_boolean(char *buf, int value)
 {
@@ -620,14 +758,16 @@ xmlrpc_array(int argc, ...)
 	return sstrdup(buf);
 }
 
-char *
-xmlrpc_normalizeBuffer(const char *buf)
+/* Strips control characters (and colour codes), in place; the result is
+ * never longer than what was there.
+ */
+static void
+xmlrpc_normalize_inplace(char *const buf)
 {
-	char *newbuf;
+	char *const newbuf = buf;
 	int i, len, j = 0;
 
 	len = strlen(buf);
-	newbuf = smalloc(sizeof(char) * len + 1);
 
 	for (i = 0; i < len; i++)
 	{
@@ -707,8 +847,16 @@ xmlrpc_normalizeBuffer(const char *buf)
 
 	// Terminate the string
 	newbuf[j] = 0;
+}
+
+char *
+xmlrpc_normalizeBuffer(const char *buf)
+{
+	char *const newbuf = sstrdup(buf);
+
+	xmlrpc_normalize_inplace(newbuf);
 
-	return (newbuf);
+	return newbuf;
 }
 
 int
@@ -38,6 +38,8 @@
  */
 
 #define XMLRPC_BUFSIZE         4096
+#define XMLRPC_PARAMS_MAX      256     /* parameters in one call */
+#define XMLRPC_PARAMLEN_MAX    8192    /* bytes in one parameter, as sent */
 #define XMLLIB_VERSION		 "1.0.0"
 #define XMLLIB_AUTHOR		 "Trystan Scott Lee <trystan@nomadirc.net>"
 
@@ -59,6 +61,8 @@ typedef int (*XMLRPCMethodFunc)(void *userdata, int ac, char **av);
 
 int xmlrpc_getlast_error(void);
 void xmlrpc_process(char *buffer, void *userdata);
+bool xmlrpc_feed(void **state, char *buffer, size_t from, size_t to);
+void xmlrpc_process_parsed(char *buffer, void *state, void *userdata);
 int xmlrpc_register_method(const char *name, XMLRPCMethodFunc func);
 int xmlrpc_unregister_method(const char *method);
 
@@ -66,6 +70,7 @@ char *xmlrpc_array(int argc, ...);
 char *xmlrpc_double(char *buf, double value);
 char *xmlrpc_boolean(char *buf, int value);
 char *xmlrpc_string(char *buf, const char *value);
+void xmlrpc_string_append(mowgli_string_t *s, const char *value);
 char *xmlrpc_integer(char *buf, int value);
 char *xmlrpc_time2date(char *buf, time_t t);
 
@@ -0,0 +1,132 @@
+/*
+ * SPDX-License-Identifier: ISC
+ * SPDX-URL: https://spdx.org/licenses/ISC.html
+ *
+ * Copyright (C) 2026 Atheme Development Group (https://atheme.github.io/)
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * Measures case-insensitive patricia lookups and irccasecmp() throughput
+ * for both casemappings, across tree sizes typical of production networks.
+ */
+
+#include <atheme.h>
+#include <atheme/libathemecore.h>
+
+#define BENCH_LOOKUPS           2000000U
+#define BENCH_KEYLEN_MAX        32U
+
+static const unsigned int bench_tree_sizes[] = { 1000U, 10000U, 50000U, 250000U };
+
+static const char bench_keychars[] =
+	"abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789[]\\^{}|~_-`";
+
+static long double
+bench_now(void)
+{
+	struct timespec ts;
+
+	(void) memset(&ts, 0x00, sizeof ts);
+	(void) clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ((long double) ts.tv_sec) + (((long double) ts.tv_nsec) / 1000000000.0L);
+}
+
+static void
+bench_make_key(char *const buf, const bool channel)
+{
+	// Mostly nickname-length keys, with a tail of longer channel names
+	size_t len = 4U + (size_t) (rand() % (channel ? 28 : 12));
+	size_t i = 0;
+
+	if (channel)
+		buf[i++] = '#';
+
+	for (; i < len; i++)
+		buf[i] = bench_keychars[rand() % (int) (sizeof bench_keychars - 1U)];
+
+	buf[i] = '\0';
+}
+
+static void
+bench_swap_case(char *const dst, const char *const src)
+{
+	size_t i;
+
+	for (i = 0; src[i] != '\0'; i++)
+		dst[i] = (rand() & 1) ? ToLower(src[i]) : ToUpper(src[i]);
+
+	dst[i] = '\0';
+}
+
+static void
+bench_run(const unsigned int size)
+{
+	char (*const keys)[BENCH_KEYLEN_MAX] = smalloc(size * sizeof *keys);
+	char (*const probes)[BENCH_KEYLEN_MAX] = smalloc(size * sizeof *probes);
+	mowgli_patricia_t *const tree = mowgli_patricia_create(&irccasecanon);
+	unsigned int found = 0;
+	unsigned int equal = 0;
+
+	for (unsigned int i = 0; i < size; i++)
+	{
+		do {
+			(void) bench_make_key(keys[i], (i % 4U) == 0);
+		} while (! mowgli_patricia_add(tree, keys[i], keys[i]));
+
+		(void) bench_swap_case(probes[i], keys[i]);
+	}
+
+	long double begin = bench_now();
+
+	for (unsigned int i = 0; i < BENCH_LOOKUPS; i++)
+		if (mowgli_patricia_retrieve(tree, probes[i % size]))
+			found++;
+
+	const long double lookup_secs = bench_now() - begin;
+
+	begin = bench_now();
+
+	for (unsigned int i = 0; i < BENCH_LOOKUPS; i++)
+		if (irccasecmp(keys[i % size], probes[i % size]) == 0)
+			equal++;
+
+	const long double cmp_secs = bench_now() - begin;
+
+	(void) printf("%8u keys: %12.0Lf lookups/s (%u hit), %12.0Lf irccasecmp/s (%u equal)\n", size,
+	              BENCH_LOOKUPS / lookup_secs, found, BENCH_LOOKUPS / cmp_secs, equal);
+
+	(void) mowgli_patricia_destroy(tree, NULL, NULL);
+	(void) sfree(probes);
+	(void) sfree(keys);
+}
+
+int
+main(int argc, char *argv[])
+{
+	static const struct {
+		const char *    name;
+		int             mapping;
+	} mappings[] = {
+		{ "rfc1459",    MATCH_RFC1459   },
+		{ "ascii",      MATCH_ASCII     },
+	};
+
+	if (! libathemecore_early_init())
+		return EXIT_FAILURE;
+
+	srand(1U);
+
+	for (size_t m = 0; m < ARRAY_SIZE(mappings); m++)
+	{
+		(void) set_match_mapping(mappings[m].mapping);
+		(void) printf("casemapping %s:\n", mappings[m].name);
+
+		for (size_t s = 0; s < ARRAY_SIZE(bench_tree_sizes); s++)
+			(void) bench_run(bench_tree_sizes[s]);
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,712 @@
+/*
+ * SPDX-License-Identifier: ISC
+ * SPDX-URL: https://spdx.org/licenses/ISC.html
+ *
+ * Copyright (C) 2026 Atheme Development Group (https://atheme.github.io/)
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * Measures the core primitives that sit on the burst and command paths, on
+ * generated data shaped like a production network: nick!user@host masks,
+ * protocol lines, command arguments, database rows and so on.
+ *
+ * The output is one tab-separated line per benchmark (name, operations,
+ * seconds, operations per second, nanoseconds per operation), after a header
+ * line starting with '#', so that runs can be compared with cut(1) or fed to
+ * a spreadsheet as they are. Lines starting with '#' are comments.
+ */
+
+#include <atheme.h>
+#include <atheme/libathemecore.h>
+#include <ext/getopt_long.h>
+
+#define BENCH_SCALE_DEF         1U
+#define BENCH_SCALE_MAX         1000U
+#define BENCH_OPS               1000000U
+#define BENCH_POOL              4096U
+#define BENCH_KEYS              50000U
+#define BENCH_DB_ROWS           200000U
+#define BENCH_CHANNELS          2000U
+
+static const char bench_nickchars[] =
+	"abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789[]\\^{}|_-`";
+
+static const char *const bench_domains[] = {
+	"dsl.example.net", "cable.example.com", "users.example.org", "cloak.example.chat",
+	"dynamic.isp.example", "static.hosting.example", "mobile.carrier.example", "vpn.example.io",
+};
+
+static const char *const bench_texts[] = {
+	"hi", "anyone around?", "has anyone seen the new release notes yet", "lol",
+	"I think the problem is in the config file, try removing the second block and rehashing",
+	"brb", "thanks!", "that's what I said yesterday, nobody listened",
+};
+
+static const char *const bench_flags[] = {
+	"+votsriRfAeiI", "+V", "-o+v", "+*", "-*", "=+AO", "+founder", "+Ffs", "-RfAei", "+b",
+};
+
+static unsigned int bench_scale = BENCH_SCALE_DEF;
+static const char *bench_only = NULL;
+static unsigned long long bench_sink = 0;
+
+static long double
+bench_now(void)
+{
+	struct timespec ts;
+
+	(void) memset(&ts, 0x00, sizeof ts);
+	(void) clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ((long double) ts.tv_sec) + (((long double) ts.tv_nsec) / 1000000000.0L);
+}
+
+static bool
+bench_wanted(const char *const restrict name)
+{
+	return (! bench_only || strncmp(name, bench_only, strlen(bench_only)) == 0);
+}
+
+static void
+bench_report(const char *const restrict name, const unsigned long long ops, const long double secs)
+{
+	const long double rate = (secs > 0.0L) ? (((long double) ops) / secs) : 0.0L;
+	const long double ns = ops ? ((secs * 1000000000.0L) / (long double) ops) : 0.0L;
+
+	(void) printf("%s\t%llu\t%.6Lf\t%.0Lf\t%.1Lf\n", name, ops, secs, rate, ns);
+	(void) fflush(stdout);
+}
+
+static void
+bench_make_nick(char *const restrict buf, const size_t len)
+{
+	// Nicknames may not start with a digit or a dash
+	buf[0] = bench_nickchars[rand() % 52];
+
+	for (size_t i = 1; i < len; i++)
+		buf[i] = bench_nickchars[rand() % (int) (sizeof bench_nickchars - 1U)];
+
+	buf[len] = '\0';
+}
+
+static void
+bench_make_host(char *const restrict buf, const size_t bufsize)
+{
+	if (rand() % 4 == 0)
+		(void) snprintf(buf, bufsize, "%d.%d.%d.%d", 1 + rand() % 223, rand() % 256, rand() % 256,
+		                1 + rand() % 254);
+	else
+		(void) snprintf(buf, bufsize, "%x%x.%s", (unsigned int) rand(), (unsigned int) rand() & 0xFFFFU,
+		                bench_domains[rand() % (int) ARRAY_SIZE(bench_domains)]);
+}
+
+static void
+bench_make_hostmask(char *const restrict buf, const size_t bufsize)
+{
+	char nick[NICKLEN + 1];
+	char user[USERLEN + 1];
+	char host[HOSTLEN + 1];
+
+	(void) bench_make_nick(nick, 3U + (size_t) (rand() % 12));
+	(void) bench_make_nick(user, 2U + (size_t) (rand() % 8));
+	(void) bench_make_host(host, sizeof host);
+	(void) snprintf(buf, bufsize, "%s!%s%s@%s", nick, (rand() % 3) ? "~" : "", user, host);
+}
+
+static void
+bench_make_channel(char *const restrict buf, const size_t bufsize)
+{
+	char name[33];
+
+	(void) bench_make_nick(name, 3U + (size_t) (rand() % 20));
+	(void) snprintf(buf, bufsize, "#%s", name);
+}
+
+// match(): ban-style masks against the hostmasks of users joining
+static void
+bench_match(void)
+{
+	static const char *const masks[] = {
+		"*!*@*.dsl.example.net", "*!*@1.2.3.*", "*spam*!*@*", "b?d!*@*", "*!~*@*", "*!*@*.example.io",
+		"*!*bot*@*", "*!*@*cloak*", "a*!*@*", "*!*@some.specific.host.example",
+	};
+
+	char (*const names)[BUFSIZE] = smalloc(BENCH_POOL * sizeof *names);
+	const unsigned long long ops = BENCH_OPS * (unsigned long long) bench_scale;
+	unsigned long long hits = 0;
+
+	for (unsigned int i = 0; i < BENCH_POOL; i++)
+		(void) bench_make_hostmask(names[i], sizeof names[i]);
+
+	const long double begin = bench_now();
+
+	for (unsigned long long i = 0; i < ops; i++)
+		if (match(masks[i % ARRAY_SIZE(masks)], names[i % BENCH_POOL]) == 0)
+			hits++;
+
+	(void) bench_report("match", ops, bench_now() - begin);
+
+	bench_sink += hits;
+	(void) sfree(names);
+}
+
+// irccasecmp(): equal names differing only in case, then unequal ones
+static void
+bench_irccasecmp(void)
+{
+	char (*const names)[NICKLEN + 1] = smalloc(BENCH_POOL * sizeof *names);
+	char (*const swapped)[NICKLEN + 1] = smalloc(BENCH_POOL * sizeof *swapped);
+	const unsigned long long ops = BENCH_OPS * (unsigned long long) bench_scale;
+	unsigned long long equal = 0;
+
+	for (unsigned int i = 0; i < BENCH_POOL; i++)
+	{
+		size_t j;
+
+		(void) bench_make_nick(names[i], 3U + (size_t) (rand() % 12));
+
+		for (j = 0; names[i][j] != '\0'; j++)
+			swapped[i][j] = (rand() & 1) ? ToLower(names[i][j]) : ToUpper(names[i][j]);
+
+		swapped[i][j] = '\0';
+	}
+
+	long double begin = bench_now();
+
+	for (unsigned long long i = 0; i < ops; i++)
+		if (irccasecmp(names[i % BENCH_POOL], swapped[i % BENCH_POOL]) == 0)
+			equal++;
+
+	(void) bench_report("irccasecmp.equal", ops, bench_now() - begin);
+
+	begin = bench_now();
+
+	for (unsigned long long i = 0; i < ops; i++)
+		if (irccasecmp(names[i % BENCH_POOL], swapped[(i + 1U) % BENCH_POOL]) == 0)
+			equal++;
+
+	(void) bench_report("irccasecmp.unequal", ops, bench_now() - begin);
+
+	bench_sink += equal;
+	(void) sfree(swapped);
+	(void) sfree(names);
+}
+
+/* The same case-insensitive point lookups through a patricia tree and
+ * through the hash tables that now index users and channels; a quarter of
+ * the lookups miss.
+ */
+static void
+bench_lookup(void)
+{
+	char (*const keys)[NICKLEN + 1] = smalloc(BENCH_KEYS * sizeof *keys);
+	char (*const probes)[NICKLEN + 1] = smalloc(BENCH_KEYS * sizeof *probes);
+	mowgli_patricia_t *const tree = mowgli_patricia_create(&irccasecanon);
+	struct namehash *const hash = namehash_create(true);
+	const unsigned long long ops = BENCH_OPS * (unsigned long long) bench_scale;
+	unsigned long long found = 0;
+
+	for (unsigned int i = 0; i < BENCH_KEYS; i++)
+	{
+		do {
+			(void) bench_make_nick(keys[i], 3U + (size_t) (rand() % 12));
+		} while (! mowgli_patricia_add(tree, keys[i], keys[i]));
+
+		(void) namehash_add(hash, keys[i], keys[i]);
+
+		if (i % 4U == 0)
+			(void) bench_make_nick(probes[i], NICKLEN - 1U);
+		else
+			for (size_t j = 0; j <= strlen(keys[i]); j++)
+				probes[i][j] = ToUpper(keys[i][j]);
+	}
+
+	long double begin = bench_now();
+
+	for (unsigned long long i = 0; i < ops; i++)
+		if (mowgli_patricia_retrieve(tree, probes[i % BENCH_KEYS]))
+			found++;
+
+	(void) bench_report("lookup.patricia", ops, bench_now() - begin);
+
+	begin = bench_now();
+
+	for (unsigned long long i = 0; i < ops; i++)
+		if (namehash_find(hash, probes[i % BENCH_KEYS]))
+			found++;
+
+	(void) bench_report("lookup.namehash", ops, bench_now() - begin);
+
+	bench_sink += found;
+	(void) namehash_destroy(hash);
+	(void) mowgli_patricia_destroy(tree, NULL, NULL);
+	(void) sfree(probes);
+	(void) sfree(keys);
+}
+
+// tokenize(): the parameters of protocol lines, with the prefix and command already taken off
+static void
+bench_tokenize(void)
+{
+	char (*const lines)[BUFSIZE] = smalloc(BENCH_POOL * sizeof *lines);
+	size_t *const lens = smalloc(BENCH_POOL * sizeof *lens);
+	const unsigned long long ops = BENCH_OPS * (unsigned long long) bench_scale;
+	unsigned long long params = 0;
+	char buf[BUFSIZE];
+	char *parv[MAXPARC + 1];
+
+	for (unsigned int i = 0; i < BENCH_POOL; i++)
+	{
+		char nick[NICKLEN + 1];
+		char chan[CHANNELLEN + 1];
+		char host[HOSTLEN + 1];
+
+		(void) bench_make_nick(nick, 3U + (size_t) (rand() % 12));
+		(void) bench_make_channel(chan, sizeof chan);
+		(void) bench_make_host(host, sizeof host);
+
+		switch (i % 4U)
+		{
+			case 0:
+				(void) snprintf(lines[i], sizeof lines[i], "%s :%s", chan,
+				                bench_texts[rand() % (int) ARRAY_SIZE(bench_texts)]);
+				break;
+			case 1:
+				(void) snprintf(lines[i], sizeof lines[i], "%s 1 1700000000 +i ~%s %s 0 001AAA%03X * * :%s",
+				                nick, nick, host, i % 0x1000U, "realname goes here");
+				break;
+			case 2:
+				(void) snprintf(lines[i], sizeof lines[i], "1700000000 %s +nt :@001AAAAAB +001AAAAAC "
+				                "001AAAAAD 001AAAAAE", chan);
+				break;
+			default:
+				(void) snprintf(lines[i], sizeof lines[i], "%s +o 001AAAAAB", chan);
+				break;
+		}
+
+		lens[i] = strlen(lines[i]) + 1U;
+	}
+
+	// Every pass needs a fresh copy, as in the parser; the copy is counted too
+	const long double begin = bench_now();
+
+	for (unsigned long long i = 0; i < ops; i++)
+	{
+		(void) memcpy(buf, lines[i % BENCH_POOL], lens[i % BENCH_POOL]);
+		params += (unsigned long long) tokenize(buf, parv);
+	}
+
+	(void) bench_report("tokenize", ops, bench_now() - begin);
+
+	bench_sink += params;
+	(void) sfree(lens);
+	(void) sfree(lines);
+}
+
+// text_to_parv(): service command arguments, split as command_exec_split() would
+static void
+bench_text_to_parv(void)
+{
+	char (*const lines)[BUFSIZE] = smalloc(BENCH_POOL * sizeof *lines);
+	size_t *const lens = smalloc(BENCH_POOL * sizeof *lens);
+	const unsigned long long ops = BENCH_OPS * (unsigned long long) bench_scale;
+	unsigned long long params = 0;
+	char buf[BUFSIZE];
+	char *parv[MAXPARC + 1];
+
+	for (unsigned int i = 0; i < BENCH_POOL; i++)
+	{
+		char nick[NICKLEN + 1];
+		char chan[CHANNELLEN + 1];
+
+		(void) bench_make_nick(nick, 3U + (size_t) (rand() % 12));
+		(void) bench_make_channel(chan, sizeof chan);
+
+		if (i % 3U == 0)
+			(void) snprintf(lines[i], sizeof lines[i], "%s %s %s", chan, nick,
+			                bench_flags[rand() % (int) ARRAY_SIZE(bench_flags)]);
+		else if (i % 3U == 1)
+			(void) snprintf(lines[i], sizeof lines[i], "%s hunter2", nick);
+		else
+			(void) snprintf(lines[i], sizeof lines[i], "%s  ENTRYMSG  %s ", chan,
+			                bench_texts[rand() % (int) ARRAY_SIZE(bench_texts)]);
+
+		lens[i] = strlen(lines[i]) + 1U;
+	}
+
+	const long double begin = bench_now();
+
+	for (unsigned long long i = 0; i < ops; i++)
+	{
+		(void) memcpy(buf, lines[i % BENCH_POOL], lens[i % BENCH_POOL]);
+		params += (unsigned long long) text_to_parv(buf, 3, parv);
+	}
+
+	(void) bench_report("text_to_parv", ops, bench_now() - begin);
+
+	bench_sink += params;
+	(void) sfree(lens);
+	(void) sfree(lines);
+}
+
+// base64: SASL-sized payloads (PLAIN, a SCRAM step, a key) both ways
+static void
+bench_base64(void)
+{
+	static const size_t sizes[] = { 24U, 64U, 96U, 256U, 400U };
+
+	unsigned char (*const raw)[400] = smalloc(BENCH_POOL * sizeof *raw);
+	char (*const encoded)[BASE64_SIZE_STR(400)] = smalloc(BENCH_POOL * sizeof *encoded);
+	const unsigned long long ops = BENCH_OPS * (unsigned long long) bench_scale;
+	unsigned long long bytes = 0;
+	unsigned char out[400];
+	char dst[BASE64_SIZE_STR(400)];
+
+	for (unsigned int i = 0; i < BENCH_POOL; i++)
+	{
+		for (size_t j = 0; j < sizeof raw[i]; j++)
+			raw[i][j] = (unsigned char) rand();
+
+		bytes += base64_encode(raw[i], sizes[i % ARRAY_SIZE(sizes)], encoded[i], sizeof encoded[i]);
+	}
+
+	long double begin = bench_now();
+
+	for (unsigned long long i = 0; i < ops; i++)
+		bytes += base64_encode(raw[i % BENCH_POOL], sizes[(i % BENCH_POOL) % ARRAY_SIZE(sizes)], dst, sizeof dst);
+
+	(void) bench_report("base64_encode", ops, bench_now() - begin);
+
+	begin = bench_now();
+
+	for (unsigned long long i = 0; i < ops; i++)
+		bytes += base64_decode(encoded[i % BENCH_POOL], out, sizeof out);
+
+	(void) bench_report("base64_decode", ops, bench_now() - begin);
+
+	bench_sink += bytes;
+	(void) sfree(encoded);
+	(void) sfree(raw);
+}
+
+/* strshare_get(): the user fields a burst shares (server names, common
+ * vhosts and gecos); each one is released again, so most calls find the
+ * string already shared by the ones kept alive.
+ */
+static void
+bench_strshare(void)
+{
+	char (*const strs)[HOSTLEN + 1] = smalloc(BENCH_POOL * sizeof *strs);
+	stringref *const held = smalloc(BENCH_POOL * sizeof *held);
+	const unsigned long long ops = BENCH_OPS * (unsigned long long) bench_scale;
+
+	for (unsigned int i = 0; i < BENCH_POOL; i++)
+	{
+		// Only a few hundred distinct strings among them
+		if (i < 256U)
+			(void) bench_make_host(strs[i], sizeof strs[i]);
+		else
+			(void) mowgli_strlcpy(strs[i], strs[rand() % 256], sizeof strs[i]);
+
+		held[i] = strshare_get(strs[i]);
+	}
+
+	const long double begin = bench_now();
+
+	for (unsigned long long i = 0; i < ops; i++)
+		(void) strshare_unref(strshare_get(strs[i % BENCH_POOL]));
+
+	(void) bench_report("strshare_get", ops, bench_now() - begin);
+
+	for (unsigned int i = 0; i < BENCH_POOL; i++)
+		(void) strshare_unref(held[i]);
+
+	(void) sfree(held);
+	(void) sfree(strs);
+}
+
+// flags_make_bitmasks(): FLAGS and template strings from ChanServ
+static void
+bench_flags_make_bitmasks(void)
+{
+	const unsigned long long ops = BENCH_OPS * (unsigned long long) bench_scale;
+	unsigned long long bits = 0;
+	unsigned int addflags;
+	unsigned int removeflags;
+
+	const long double begin = bench_now();
+
+	for (unsigned long long i = 0; i < ops; i++)
+	{
+		(void) flags_make_bitmasks(bench_flags[i % ARRAY_SIZE(bench_flags)], &addflags, &removeflags);
+		bits += addflags ^ removeflags;
+	}
+
+	(void) bench_report("flags_make_bitmasks", ops, bench_now() - begin);
+
+	bench_sink += bits;
+}
+
+/* Modestack building: what ChanServ stacks for a channel on a netjoin (simple
+ * modes, ops and voices, a limit and some bans), then flushed into lines. Each
+ * op is a whole channel; no protocol module is loaded, so nothing is sent.
+ */
+static void
+bench_modestack(struct server *const restrict server)
+{
+	struct channel **const chans = smalloc(BENCH_CHANNELS * sizeof *chans);
+	char (*const nicks)[NICKLEN + 1] = smalloc(BENCH_POOL * sizeof *nicks);
+	char (*const masks)[BUFSIZE] = smalloc(BENCH_POOL * sizeof *masks);
+	const unsigned long long ops = (BENCH_OPS / 10U) * (unsigned long long) bench_scale;
+	unsigned int nchans = 0;
+
+	for (unsigned int i = 0; i < BENCH_POOL; i++)
+	{
+		(void) bench_make_nick(nicks[i], 3U + (size_t) (rand() % 12));
+		(void) snprintf(masks[i], sizeof masks[i], "*!*@%x.%s", (unsigned int) rand(),
+		                bench_domains[rand() % (int) ARRAY_SIZE(bench_domains)]);
+	}
+
+	while (nchans < BENCH_CHANNELS)
+	{
+		char name[CHANNELLEN + 1];
+
+		(void) bench_make_channel(name, sizeof name);
+
+		if (! channel_find(name))
+			chans[nchans++] = channel_add(name, CURRTIME, server);
+	}
+
+	const long double begin = bench_now();
+
+	for (unsigned long long i = 0; i < ops; i++)
+	{
+		struct channel *const c = chans[i % BENCH_CHANNELS];
+		const unsigned int base = (unsigned int) (i % BENCH_POOL);
+
+		(void) modestack_mode_simple("ChanServ", c, MTYPE_ADD, CMODE_NOEXT | CMODE_TOPIC);
+		(void) modestack_mode_simple("ChanServ", c, MTYPE_DEL, CMODE_MOD);
+		(void) modestack_mode_limit("ChanServ", c, MTYPE_ADD, 50U + (unsigned int) (i % 200U));
+
+		for (unsigned int j = 0; j < 6U; j++)
+			(void) modestack_mode_param("ChanServ", c, MTYPE_ADD, (j % 2U) ? 'v' : 'o',
+			                            nicks[(base + j) % BENCH_POOL]);
+
+		for (unsigned int j = 0; j < 3U; j++)
+			(void) modestack_mode_param("ChanServ", c, (j == 2U) ? MTYPE_DEL : MTYPE_ADD, 'b',
+			                            masks[(base + j) % BENCH_POOL]);
+
+		(void) modestack_flush_channel(c);
+	}
+
+	(void) bench_report("modestack", ops, bench_now() - begin);
+
+	for (unsigned int i = 0; i < nchans; i++)
+		(void) channel_delete(chans[i]);
+
+	(void) sfree(masks);
+	(void) sfree(nicks);
+	(void) sfree(chans);
+}
+
+/* opensex row parsing: a generated database, read back through the backend
+ * row by row and word by word (the type handlers are not run). Each op is a
+ * row, including the time taken to open the file.
+ */
+static void
+bench_opensex(void)
+{
+	char dir[BUFSIZE];
+	char path[BUFSIZE];
+	FILE *fp;
+
+	if (! module_find_published("backend/opensex") && ! module_load("backend/opensex"))
+	{
+		(void) printf("# opensex: skipped, could not load backend/opensex\n");
+		return;
+	}
+
+	(void) snprintf(dir, sizeof dir, "%s/atheme-core-benchmark.XXXXXX", P_tmpdir);
+
+	if (! mkdtemp(dir))
+	{
+		(void) printf("# opensex: skipped, mkdtemp(3): %s\n", strerror(errno));
+		return;
+	}
+
+	const int ret = snprintf(path, sizeof path, "%s/services.db", dir);
+
+	if (ret < 0 || (size_t) ret >= sizeof path)
+	{
+		(void) printf("# opensex: skipped, %s is too long\n", dir);
+		(void) rmdir(dir);
+		return;
+	}
+
+	if (! (fp = fopen(path, "w")))
+	{
+		(void) printf("# opensex: skipped, fopen(3): %s\n", strerror(errno));
+		(void) rmdir(dir);
+		return;
+	}
+
+	(void) fprintf(fp, "DBV 12\nGRVER 1\n");
+
+	for (unsigned int i = 0; i < BENCH_DB_ROWS; i++)
+	{
+		char nick[NICKLEN + 1];
+		char chan[CHANNELLEN + 1];
+		char host[HOSTLEN + 1];
+
+		(void) bench_make_nick(nick, 3U + (size_t) (rand() % 12));
+
+		switch (i % 6U)
+		{
+			case 0:
+				(void) fprintf(fp, "MU AAAA%05u %s $pbkdf2v2$0$aGVsbG8gd29ybGQ$c29tZSBoYXNoIGdvZXMgaGVyZQ "
+				               "%s@example.net 1600000000 1700000000 +sC default\n", i, nick, nick);
+				break;
+			case 1:
+				(void) fprintf(fp, "MN %s %s 1600000000 1700000000\n", nick, nick);
+				break;
+			case 2:
+				(void) bench_make_host(host, sizeof host);
+				(void) fprintf(fp, "MDU %s private:host:actual %s!~%s@%s\n", nick, nick, nick, host);
+				break;
+			case 3:
+				(void) bench_make_channel(chan, sizeof chan);
+				(void) fprintf(fp, "MC %s 1600000000 1700000000 +v 0 0 0\n", chan);
+				break;
+			case 4:
+				(void) bench_make_channel(chan, sizeof chan);
+				(void) fprintf(fp, "CA %s %s +AFRefiorstv 1700000000 %s\n", chan, nick, nick);
+				break;
+			default:
+				(void) bench_make_channel(chan, sizeof chan);
+				(void) fprintf(fp, "MDC %s private:entrymsg %s\n", chan,
+				               bench_texts[rand() % (int) ARRAY_SIZE(bench_texts)]);
+				break;
+		}
+	}
+
+	(void) fclose(fp);
+
+	char *const olddatadir = datadir;
+	const unsigned int passes = bench_scale;
+	unsigned long long rows = 0;
+	unsigned long long words = 0;
+
+	datadir = dir;
+
+	const long double begin = bench_now();
+
+	for (unsigned int pass = 0; pass < passes; pass++)
+	{
+		struct database_handle *const db = db_open(NULL, DB_READ);
+
+		if (! db)
+			break;
+
+		while (db_read_next_row(db))
+		{
+			rows++;
+
+			while (db_read_word(db))
+				words++;
+		}
+
+		(void) db_close(db);
+	}
+
+	(void) bench_report("opensex.rows", rows, bench_now() - begin);
+
+	datadir = olddatadir;
+	bench_sink += words;
+
+	(void) unlink(path);
+	(void) rmdir(dir);
+}
+
+int
+main(int argc, char *argv[])
+{
+	int c;
+
+	if (! libathemecore_early_init())
+		return EXIT_FAILURE;
+
+	const mowgli_getopt_option_t long_opts[] = {
+		{ "scale", required_argument, NULL, 's', 0 },
+		{  "only", required_argument, NULL, 'o', 0 },
+		{    NULL,                 0, NULL,  0 , 0 },
+	};
+
+	while ((c = mowgli_getopt_long(argc, argv, "s:o:", long_opts, NULL)) != -1)
+	{
+		switch (c)
+		{
+			case 's':
+				if (! string_to_uint(mowgli_optarg, &bench_scale) || ! bench_scale ||
+				    bench_scale > BENCH_SCALE_MAX)
+				{
+					(void) fprintf(stderr, "%s: the scale must be between 1 and %u\n", argv[0],
+					               BENCH_SCALE_MAX);
+					return EXIT_FAILURE;
+				}
+				break;
+			case 'o':
+				bench_only = mowgli_optarg;
+				break;
+			default:
+				(void) fprintf(stderr, "usage: %s [-s scale] [-o group]\n", argv[0]);
+				return EXIT_FAILURE;
+		}
+	}
+
+	char execname[] = "core-benchmark";
+	char logpath[] = LOGDIR "/core-benchmark.log";
+
+	atheme_bootstrap();
+	atheme_init(execname, logpath);
+	atheme_setup();
+
+	runflags = RF_LIVE;
+	datadir = DATADIR;
+	offline_mode = true;
+
+	// The same data on every run, so that runs can be compared
+	srand(1U);
+
+	struct server *const server = server_add("bench.example.net", 0, NULL, NULL, "core-benchmark");
+
+	(void) printf("# atheme %s (%s) core-benchmark, scale %u\n", PACKAGE_VERSION, SERNO, bench_scale);
+	(void) printf("# benchmark\tops\tseconds\tops_per_sec\tns_per_op\n");
+
+	if (bench_wanted("match"))
+		(void) bench_match();
+	if (bench_wanted("irccasecmp"))
+		(void) bench_irccasecmp();
+	if (bench_wanted("lookup"))
+		(void) bench_lookup();
+	if (bench_wanted("tokenize"))
+		(void) bench_tokenize();
+	if (bench_wanted("text_to_parv"))
+		(void) bench_text_to_parv();
+	if (bench_wanted("base64"))
+		(void) bench_base64();
+	if (bench_wanted("strshare_get"))
+		(void) bench_strshare();
+	if (bench_wanted("flags_make_bitmasks"))
+		(void) bench_flags_make_bitmasks();
+	if (bench_wanted("modestack"))
+		(void) bench_modestack(server);
+	if (bench_wanted("opensex"))
+		(void) bench_opensex();
+
+	// Keeps the loops above from being optimised away
+	(void) printf("# checksum %llu\n", bench_sink);
+
+	return EXIT_SUCCESS;
+}
@@ -11,6 +11,7 @@
 
 #include <atheme/attributes.h>      // ATHEME_FATTR_WUR
 #include <atheme/argon2.h>          // ATHEME_ARGON2_*
+#include <atheme/base64.h>          // base64_*()
 #include <atheme/bcrypt.h>          // ATHEME_BCRYPT_*
 #include <atheme/constants.h>       // BUFSIZE, PASSLEN
 #include <atheme/digest.h>          // digest_oneshot_pbkdf2()
@@ -423,3 +424,310 @@ benchmark_pbkdf2(const enum digest_algorithm digest, const size_t itercount, con
 	(void) pbkdf2_print_rowstats(digest, itercount, with_sasl_scram, duration);
 	return true;
 }
+
+void
+pbkdf2_multi_print_colheaders(void)
+{
+	(void) bench_print(_(""
+		"\n"
+		"Digest           Iterations     Lanes  Elapsed        Hashes/sec\n"
+		"---------------- -------------- ------ -------------- --------------"
+	));
+}
+
+void
+pbkdf2_multi_print_rowstats(const enum digest_algorithm digest, const size_t iterations, const bool with_sasl_scram,
+                            const size_t lanes, const long double elapsed)
+{
+	(void) bench_print(_("%16s %14zu %6zu %13LFs %14.1LF"), md_digest_to_name(digest, with_sasl_scram),
+	                   iterations, lanes, elapsed, (((long double) lanes) / elapsed));
+}
+
+/* Like benchmark_pbkdf2(), but derives as many different passwords at once as
+ * the digest frontend's multi-buffer kernel takes (the way the password
+ * verification threads do when several logins are waiting), so that the rate
+ * at which a single core can verify passwords can be seen.
+ */
+bool ATHEME_FATTR_WUR
+benchmark_pbkdf2_multi(const enum digest_algorithm digest, const size_t itercount, const bool with_sasl_scram,
+                       long double *const restrict elapsed, size_t *const restrict lanes)
+{
+	const size_t mdlen = digest_size_alg(digest);
+	const size_t count = BENCH_MIN(digest_pbkdf2_lanes(digest), DIGEST_MB_LANES_SHA2_256);
+	struct digest_pbkdf2_job jobs[DIGEST_MB_LANES_SHA2_256];
+	unsigned char results[DIGEST_MB_LANES_SHA2_256][DIGEST_MDLEN_MAX];
+	struct timespec begin;
+	struct timespec end;
+
+	for (size_t i = 0; i < count; i++)
+	{
+		// Different passwords, so that nothing can be shared between the lanes
+		jobs[i].pass = passbuf + (i % (PASSLEN / 2U));
+		jobs[i].passLen = (PASSLEN / 2U);
+		jobs[i].salt = saltbuf;
+		jobs[i].saltLen = PBKDF2_SALTLEN_DEF;
+		jobs[i].c = itercount;
+		jobs[i].dk = results[i];
+		jobs[i].dkLen = mdlen;
+	}
+
+	(void) memset(&begin, 0x00, sizeof begin);
+	(void) memset(&end, 0x00, sizeof end);
+
+	if (clock_gettime(CLOCK_MONOTONIC, &begin) != 0)
+	{
+		(void) perror("clock_gettime(2)");
+		return false;
+	}
+	if (! digest_oneshot_pbkdf2_multi(digest, jobs, count))
+	{
+		(void) bench_print("digest_oneshot_pbkdf2_multi() failed");
+		return false;
+	}
+	if (clock_gettime(CLOCK_MONOTONIC, &end) != 0)
+	{
+		(void) perror("clock_gettime(2)");
+		return false;
+	}
+
+	const long double begin_ld = ((long double) begin.tv_sec) + (((long double) begin.tv_nsec) / nsec_per_sec);
+	const long double end_ld = ((long double) end.tv_sec) + (((long double) end.tv_nsec) / nsec_per_sec);
+	const long double duration = (end_ld - begin_ld);
+
+	if (elapsed)
+		*elapsed = duration;
+
+	if (lanes)
+		*lanes = count;
+
+	(void) pbkdf2_multi_print_rowstats(digest, itercount, with_sasl_scram, count, duration);
+	return true;
+}
+
+void
+digest_kernel_print_colheaders(void)
+{
+	(void) bench_print(_(""
+		"\n"
+		"Digest           Kernel         Throughput\n"
+		"---------------- -------------- --------------"
+	));
+}
+
+void
+digest_kernel_print_rowstats(const enum digest_algorithm digest, const char *const restrict kernel,
+                             const long double mibps)
+{
+	(void) bench_print(_("%16s %14s %9.1LF MiB/s"), md_digest_to_name(digest, false), kernel, mibps);
+}
+
+/* Hashes a buffer with each of the internal SHA1/SHA2 compression kernels
+ * that this CPU can run (see libathemecore/digest_direct_accel.c) for about
+ * half a second each; this goes straight to the internal code, whichever
+ * digest frontend was built.
+ */
+bool ATHEME_FATTR_WUR
+benchmark_digest_kernels(const enum digest_algorithm digest)
+{
+	static unsigned char databuf[BENCH_DIGEST_BUFLEN];
+
+	void (*init)(union digest_direct_ctx *);
+	void (*update)(union digest_direct_ctx *, const void *, size_t);
+	void (*final)(union digest_direct_ctx *, void *);
+
+	switch (digest)
+	{
+		case DIGALG_SHA1:
+			init = &digest_direct_init_sha1;
+			update = &digest_direct_update_sha1;
+			final = &digest_direct_final_sha1;
+			break;
+		case DIGALG_SHA2_256:
+			init = &digest_direct_init_sha2_256;
+			update = &digest_direct_update_sha2_256;
+			final = &digest_direct_final_sha2_256;
+			break;
+		case DIGALG_SHA2_512:
+			init = &digest_direct_init_sha2_512;
+			update = &digest_direct_update_sha2_512;
+			final = &digest_direct_final_sha2_512;
+			break;
+		default:
+			(void) bench_print(_("%s has no choice of compression kernels"), md_digest_to_name(digest, false));
+			return true;
+	}
+
+	(void) atheme_random_buf(databuf, sizeof databuf);
+
+	const size_t count = digest_direct_kernel_count(digest);
+	const size_t selected = digest_direct_kernel_selected(digest);
+
+	for (size_t i = 0; i < count; i++)
+	{
+		union digest_direct_ctx ctx;
+		struct timespec begin;
+		struct timespec end;
+		long double duration = 0.0L;
+		size_t rounds = 0;
+
+		(void) digest_direct_kernel_select(digest, i);
+
+		if (clock_gettime(CLOCK_MONOTONIC, &begin) != 0)
+		{
+			(void) perror("clock_gettime(2)");
+			(void) digest_direct_kernel_select(digest, selected);
+			return false;
+		}
+
+		const long double begin_ld = ((long double) begin.tv_sec) + (((long double) begin.tv_nsec) / nsec_per_sec);
+
+		while (duration < BENCH_DIGEST_SECONDS)
+		{
+			(void) init(&ctx);
+			(void) update(&ctx, databuf, sizeof databuf);
+			(void) final(&ctx, hashbuf);
+
+			rounds++;
+
+			if (clock_gettime(CLOCK_MONOTONIC, &end) != 0)
+			{
+				(void) perror("clock_gettime(2)");
+				(void) digest_direct_kernel_select(digest, selected);
+				return false;
+			}
+
+			const long double end_ld = ((long double) end.tv_sec) + (((long double) end.tv_nsec) / nsec_per_sec);
+
+			duration = (end_ld - begin_ld);
+		}
+
+		const long double mebibytes = (((long double) rounds) * sizeof databuf) / (1024.0L * 1024.0L);
+
+		(void) digest_kernel_print_rowstats(digest, digest_direct_kernel_name(digest, i), (mebibytes / duration));
+	}
+
+	(void) digest_direct_kernel_select(digest, selected);
+	return true;
+}
+
+void
+base64_kernel_print_colheaders(void)
+{
+	(void) bench_print(_(""
+		"\n"
+		"Kernel         Encode           Decode\n"
+		"-------------- ---------------- ----------------"
+	));
+}
+
+void
+base64_kernel_print_rowstats(const char *const restrict kernel, const long double enc_mibps,
+                             const long double dec_mibps)
+{
+	(void) bench_print(_("%14s %10.1LF MiB/s %10.1LF MiB/s"), kernel, enc_mibps, dec_mibps);
+}
+
+// MiB/s of input (raw bytes for encoding, base64 characters for decoding) over about half a second
+static bool ATHEME_FATTR_WUR
+base64_kernel_measure(const bool encode, const unsigned char *const restrict raw, char *const restrict enc,
+                      unsigned char *const restrict dec, long double *const restrict mibps)
+{
+	const size_t enclen = BASE64_SIZE_RAW(BENCH_BASE64_BUFLEN);
+	struct timespec begin;
+	struct timespec end;
+	long double duration = 0.0L;
+	size_t rounds = 0;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &begin) != 0)
+	{
+		(void) perror("clock_gettime(2)");
+		return false;
+	}
+
+	const long double begin_ld = ((long double) begin.tv_sec) + (((long double) begin.tv_nsec) / nsec_per_sec);
+
+	while (duration < BENCH_BASE64_SECONDS)
+	{
+		const size_t ret = encode ? base64_encode(raw, BENCH_BASE64_BUFLEN, enc, enclen + 1U) :
+		                            base64_decode(enc, dec, BENCH_BASE64_BUFLEN);
+
+		if (ret != (encode ? enclen : BENCH_BASE64_BUFLEN))
+		{
+			(void) bench_print(_("%s() failed"), encode ? "base64_encode" : "base64_decode");
+			return false;
+		}
+
+		rounds++;
+
+		if (clock_gettime(CLOCK_MONOTONIC, &end) != 0)
+		{
+			(void) perror("clock_gettime(2)");
+			return false;
+		}
+
+		const long double end_ld = ((long double) end.tv_sec) + (((long double) end.tv_nsec) / nsec_per_sec);
+
+		duration = (end_ld - begin_ld);
+	}
+
+	const size_t inlen = encode ? BENCH_BASE64_BUFLEN : enclen;
+
+	*mibps = ((((long double) rounds) * inlen) / (1024.0L * 1024.0L)) / duration;
+	return true;
+}
+
+/* Encodes and decodes a buffer with each of the base64 kernels that this
+ * CPU can run (see libathemecore/base64_accel.c), first checking that each
+ * gives exactly what the portable code does.
+ */
+bool ATHEME_FATTR_WUR
+benchmark_base64_kernels(void)
+{
+	static unsigned char raw[BENCH_BASE64_BUFLEN];
+	static unsigned char dec[BENCH_BASE64_BUFLEN];
+	static char expected[BASE64_SIZE_STR(BENCH_BASE64_BUFLEN)];
+	static char enc[BASE64_SIZE_STR(BENCH_BASE64_BUFLEN)];
+
+	const size_t count = base64_kernel_count();
+	const size_t selected = base64_kernel_selected();
+	bool result = true;
+
+	(void) atheme_random_buf(raw, sizeof raw);
+	(void) base64_kernel_select(0);
+
+	if (base64_encode(raw, sizeof raw, expected, sizeof expected) == BASE64_FAIL)
+	{
+		(void) bench_print(_("base64_encode() failed"));
+		return false;
+	}
+
+	for (size_t i = 0; result && i < count; i++)
+	{
+		long double enc_mibps;
+		long double dec_mibps;
+
+		(void) base64_kernel_select(i);
+
+		if (base64_encode(raw, sizeof raw, enc, sizeof enc) == BASE64_FAIL || strcmp(enc, expected) != 0 ||
+		    base64_decode(enc, dec, sizeof dec) != sizeof dec || memcmp(dec, raw, sizeof raw) != 0)
+		{
+			(void) bench_print(_("The %s kernel does not agree with the portable code (BUG)"),
+			                   base64_kernel_name(i));
+			result = false;
+			break;
+		}
+
+		if (! base64_kernel_measure(true, raw, enc, dec, &enc_mibps) ||
+		    ! base64_kernel_measure(false, raw, enc, dec, &dec_mibps))
+		{
+			// This function logs error messages on failure
+			result = false;
+			break;
+		}
+
+		(void) base64_kernel_print_rowstats(base64_kernel_name(i), enc_mibps, dec_mibps);
+	}
+
+	(void) base64_kernel_select(selected);
+	return result;
+}
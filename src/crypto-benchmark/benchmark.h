@@ -31,6 +31,15 @@
 #define BENCH_RUN_OPTIONS_SCRYPT    0x0008U
 #define BENCH_RUN_OPTIONS_BCRYPT    0x0010U
 #define BENCH_RUN_OPTIONS_PBKDF2    0x0020U
+#define BENCH_RUN_OPTIONS_CONCURRENCY 0x0040U
+#define BENCH_RUN_OPTIONS_DIGEST    0x0080U
+#define BENCH_RUN_OPTIONS_BASE64    0x0100U
+
+#define BENCH_DIGEST_BUFLEN         0x100000U   // 1 MiB
+#define BENCH_DIGEST_SECONDS        0.5L
+
+#define BENCH_BASE64_BUFLEN         0x10000U    // 64 KiB
+#define BENCH_BASE64_SECONDS        0.5L
 
 #if defined(HAVE_LIBARGON2) || defined(HAVE_LIBSODIUM_SCRYPT)
 #  define HAVE_ANY_MEMORY_HARD_ALGORITHM 1
@@ -65,5 +74,16 @@ const char *md_digest_to_name(enum digest_algorithm, bool);
 void pbkdf2_print_colheaders(void);
 void pbkdf2_print_rowstats(enum digest_algorithm, size_t, bool, long double);
 bool benchmark_pbkdf2(enum digest_algorithm, size_t, bool, long double *) ATHEME_FATTR_WUR;
+void pbkdf2_multi_print_colheaders(void);
+void pbkdf2_multi_print_rowstats(enum digest_algorithm, size_t, bool, size_t, long double);
+bool benchmark_pbkdf2_multi(enum digest_algorithm, size_t, bool, long double *, size_t *) ATHEME_FATTR_WUR;
+
+void digest_kernel_print_colheaders(void);
+void digest_kernel_print_rowstats(enum digest_algorithm, const char *, long double);
+bool benchmark_digest_kernels(enum digest_algorithm) ATHEME_FATTR_WUR;
+
+void base64_kernel_print_colheaders(void);
+void base64_kernel_print_rowstats(const char *, long double, long double);
+bool benchmark_base64_kernels(void) ATHEME_FATTR_WUR;
 
 #endif /* !ATHEME_SRC_CRYPTO_BENCHMARK_BENCHMARK_H */
@@ -0,0 +1,490 @@
+/*
+ * SPDX-License-Identifier: ISC
+ * SPDX-URL: https://spdx.org/licenses/ISC.html
+ *
+ * Copyright (C) 2026 Atheme Development Group (https://atheme.github.io/)
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * The other benchmarks time one hash at a time on an otherwise idle machine.
+ * During a login storm the password verification threads run one hash per
+ * core at once, and the memory-hard algorithms then compete for memory
+ * bandwidth and cache; this measures them that way instead, and can base its
+ * advice on the login rate that services must keep up with.
+ */
+
+#include <atheme/argon2.h>          // ATHEME_ARGON2_*
+#include <atheme/attributes.h>      // ATHEME_FATTR_WUR
+#include <atheme/bcrypt.h>          // ATHEME_BCRYPT_*, atheme_eks_bf_compute()
+#include <atheme/constants.h>       // BUFSIZE, PASSLEN
+#include <atheme/digest.h>          // digest_oneshot_pbkdf2()
+#include <atheme/i18n.h>            // _() (gettext)
+#include <atheme/memory.h>          // sreallocarray()
+#include <atheme/pbkdf2.h>          // PBKDF2_*
+#include <atheme/random.h>          // atheme_random_*()
+#include <atheme/scrypt.h>          // ATHEME_SCRYPT_*
+#include <atheme/stdheaders.h>      // (everything else)
+#include <atheme/sysconf.h>         // HAVE_*
+
+#ifdef HAVE_USABLE_PTHREAD
+
+#include <pthread.h>                // pthread_*()
+#include <sys/resource.h>           // getrusage()
+
+#ifdef HAVE_LIBARGON2
+#  include <argon2.h>               // argon2_context, argon2_ctx(), argon2_type2string()
+#endif
+
+#ifdef HAVE_LIBSODIUM_SCRYPT
+#  include <sodium/crypto_pwhash_scryptsalsa208sha256.h> // crypto_pwhash_scryptsalsa208sha256_str()
+#endif
+
+#include "benchmark.h"              // bench_print(), memory_power2k_to_str(), md_digest_to_name()
+#include "concurrency.h"            // self-declarations
+
+// Every thread keeps hashing until this much time has passed (and it has done at least 2)
+#define BENCH_CC_RUNTIME            2.0L
+#define BENCH_CC_HASHES_MIN         2U
+
+struct bench_cc_thread
+{
+	const struct bench_cc_params *  params;
+	pthread_t                       thread;
+	long double                     deadline;
+	long double *                   latencies;
+	size_t                          count;
+	size_t                          alloc;
+	bool                            failed;
+};
+
+static const long double nsec_per_sec = 1000000000.0L;
+
+static unsigned char cc_saltbuf[BUFSIZE];
+static char cc_passbuf[PASSLEN + 1];
+static bool cc_initialised = false;
+
+static long double
+bench_cc_now(void)
+{
+	struct timespec ts;
+
+	(void) memset(&ts, 0x00, sizeof ts);
+	(void) clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ((long double) ts.tv_sec) + (((long double) ts.tv_nsec) / nsec_per_sec);
+}
+
+static bool
+bench_cc_hash(const struct bench_cc_params *const restrict params, unsigned char *const restrict out)
+{
+	switch (params->algorithm)
+	{
+		case BENCH_CC_ARGON2:
+		{
+#ifdef HAVE_LIBARGON2
+			argon2_context ctx = {
+				.out            = out,
+				.outlen         = ATHEME_ARGON2_HASHLEN_DEF,
+				.pwd            = (void *) cc_passbuf,
+				.pwdlen         = PASSLEN,
+				.salt           = cc_saltbuf,
+				.saltlen        = ATHEME_ARGON2_SALTLEN_DEF,
+				.t_cost         = params->cost,
+				.m_cost         = (1U << params->memcost),
+				.lanes          = params->lanes,
+				.threads        = params->lanes,
+				.version        = ARGON2_VERSION_NUMBER,
+			};
+
+			return (argon2_ctx(&ctx, params->argon2_type) == (int) ARGON2_OK);
+#else
+			return false;
+#endif
+		}
+
+		case BENCH_CC_SCRYPT:
+#ifdef HAVE_LIBSODIUM_SCRYPT
+			return (crypto_pwhash_scryptsalsa208sha256_str((void *) out, cc_passbuf, PASSLEN, params->cost,
+			                                               ((1ULL << params->memcost) * 1024ULL)) == 0);
+#else
+			return false;
+#endif
+
+		case BENCH_CC_BCRYPT:
+			return atheme_eks_bf_compute(cc_passbuf, ATHEME_BCRYPT_VERSION_MINOR, (unsigned int) params->cost,
+			                             cc_saltbuf, out);
+
+		case BENCH_CC_PBKDF2:
+			return digest_oneshot_pbkdf2(params->digest, cc_passbuf, PASSLEN, cc_saltbuf, PBKDF2_SALTLEN_DEF,
+			                             params->cost, out, digest_size_alg(params->digest));
+	}
+
+	return false;
+}
+
+static void *
+bench_cc_worker(void *const restrict arg)
+{
+	struct bench_cc_thread *const t = arg;
+	unsigned char out[BUFSIZE];
+
+	while (t->count < BENCH_CC_HASHES_MIN || bench_cc_now() < t->deadline)
+	{
+		const long double begin = bench_cc_now();
+
+		if (! bench_cc_hash(t->params, out))
+		{
+			t->failed = true;
+			break;
+		}
+
+		const long double end = bench_cc_now();
+
+		if (t->count == t->alloc)
+		{
+			const size_t alloc = (t->alloc ? (t->alloc * 2U) : 64U);
+
+			if (! (t->latencies = sreallocarray(t->latencies, alloc, sizeof *t->latencies)))
+			{
+				t->failed = true;
+				break;
+			}
+
+			t->alloc = alloc;
+		}
+
+		t->latencies[t->count++] = (end - begin);
+	}
+
+	return NULL;
+}
+
+static int
+bench_cc_compare(const void *const restrict a, const void *const restrict b)
+{
+	const long double x = *((const long double *) a);
+	const long double y = *((const long double *) b);
+
+	return (x > y) - (x < y);
+}
+
+// Best effort: let ru_maxrss reflect this run rather than everything before it (Linux 4.0+)
+static void
+bench_cc_reset_peak_rss(void)
+{
+	FILE *const fp = fopen("/proc/self/clear_refs", "w");
+
+	if (! fp)
+		return;
+
+	(void) fputs("5", fp);
+	(void) fclose(fp);
+}
+
+static const char *
+bench_cc_params_to_str(const struct bench_cc_params *const restrict params)
+{
+	static char result[BUFSIZE];
+
+	switch (params->algorithm)
+	{
+		case BENCH_CC_ARGON2:
+#ifdef HAVE_LIBARGON2
+			(void) snprintf(result, sizeof result, "%s m=%s t=%zu p=%zu", argon2_type2string(params->argon2_type, 1),
+			                memory_power2k_to_str(params->memcost), params->cost, params->lanes);
+#endif
+			break;
+
+		case BENCH_CC_SCRYPT:
+#ifdef HAVE_LIBSODIUM_SCRYPT
+			(void) snprintf(result, sizeof result, "scrypt m=%s ops=%zu", memory_power2k_to_str(params->memcost),
+			                params->cost);
+#endif
+			break;
+
+		case BENCH_CC_BCRYPT:
+			(void) snprintf(result, sizeof result, "bcrypt cost=%zu", params->cost);
+			break;
+
+		case BENCH_CC_PBKDF2:
+			(void) snprintf(result, sizeof result, "%s c=%zu", md_digest_to_name(params->digest,
+			                params->with_sasl_scram), params->cost);
+			break;
+	}
+
+	return result;
+}
+
+void
+concurrency_print_colheaders(void)
+{
+	(void) bench_print(_(""
+		"\n"
+		"Parameters                     Threads Hashes  p50 Latency   p99 Latency   Hashes/sec   Peak RSS\n"
+		"------------------------------ ------- ------- ------------- ------------- ------------ ----------"
+	));
+}
+
+// Works out the statistics for a run from what each of its threads recorded
+static bool
+bench_cc_collect(const struct bench_cc_params *const restrict params, const struct bench_cc_thread *const threads,
+                 const unsigned int nthreads, const long double elapsed, struct bench_cc_result *const restrict result)
+{
+	size_t total = 0;
+
+	for (unsigned int i = 0; i < nthreads; i++)
+	{
+		if (threads[i].failed)
+		{
+			(void) bench_print(_("Hashing with %s failed"), bench_cc_params_to_str(params));
+			return false;
+		}
+
+		total += threads[i].count;
+	}
+
+	if (! total)
+		return false;
+
+	long double *const latencies = calloc(total, sizeof *latencies);
+
+	if (! latencies)
+	{
+		(void) perror("calloc(3)");
+		return false;
+	}
+
+	size_t n = 0;
+
+	for (unsigned int i = 0; i < nthreads; i++)
+		for (size_t j = 0; j < threads[i].count; j++)
+			latencies[n++] = threads[i].latencies[j];
+
+	(void) qsort(latencies, total, sizeof *latencies, &bench_cc_compare);
+
+	struct rusage ru;
+
+	(void) memset(&ru, 0x00, sizeof ru);
+	(void) getrusage(RUSAGE_SELF, &ru);
+
+	result->hashes = total;
+	result->p50 = latencies[(total - 1U) / 2U];
+	result->p99 = latencies[((total * 99U) + 99U) / 100U - 1U];
+	result->rate = (((long double) total) / elapsed);
+	result->peak_rss = ru.ru_maxrss;
+
+	(void) free(latencies);
+
+	(void) bench_print(_("%-30s %7u %7zu %12LFs %12LFs %12.1LF %6ld MiB"), bench_cc_params_to_str(params), nthreads,
+	                   result->hashes, result->p50, result->p99, result->rate, (result->peak_rss / 1024L));
+	return true;
+}
+
+/* Runs nthreads threads that each hash the same password over and over with
+ * the given parameters for a couple of seconds, and reports the latency of the
+ * individual hashes, how many were done per second in total, and the largest
+ * resident set size that the process had while doing so.
+ */
+bool ATHEME_FATTR_WUR
+benchmark_concurrency(const struct bench_cc_params *const restrict params, const unsigned int nthreads,
+                      struct bench_cc_result *const restrict result)
+{
+	if (! cc_initialised)
+	{
+		(void) atheme_random_buf(cc_saltbuf, sizeof cc_saltbuf);
+		(void) atheme_random_str(cc_passbuf, PASSLEN);
+		cc_initialised = true;
+	}
+
+	struct bench_cc_thread *const threads = calloc(nthreads, sizeof *threads);
+
+	if (! threads)
+	{
+		(void) perror("calloc(3)");
+		return false;
+	}
+
+	(void) bench_cc_reset_peak_rss();
+
+	const long double begin = bench_cc_now();
+	unsigned int started = 0;
+
+	for (unsigned int i = 0; i < nthreads; i++)
+	{
+		threads[i].params = params;
+		threads[i].deadline = begin + BENCH_CC_RUNTIME;
+
+		const int ret = pthread_create(&threads[i].thread, NULL, &bench_cc_worker, &threads[i]);
+
+		if (ret != 0)
+		{
+			(void) bench_print("pthread_create(3): %s", strerror(ret));
+			break;
+		}
+
+		started++;
+	}
+
+	for (unsigned int i = 0; i < started; i++)
+		(void) pthread_join(threads[i].thread, NULL);
+
+	const long double end = bench_cc_now();
+	const bool retval = (started == nthreads && bench_cc_collect(params, threads, nthreads, (end - begin), result));
+
+	for (unsigned int i = 0; i < nthreads; i++)
+		(void) sfree(threads[i].latencies);
+
+	(void) free(threads);
+	return retval;
+}
+
+/* Suggests parameters that let nthreads password verification threads keep
+ * up with login_rate logins per second. The work done by each algorithm is
+ * close to proportional to its time cost parameter (bcrypt's being the base 2
+ * logarithm of it), so the measured rate scales that parameter; the memory
+ * cost only comes down when the time cost has nowhere left to go. The result
+ * is measured again before it is printed.
+ */
+bool ATHEME_FATTR_WUR
+concurrency_recommend(const struct bench_cc_params *const restrict params, const unsigned int nthreads,
+                      const struct bench_cc_result *const restrict measured, const unsigned int login_rate,
+                      const long double clocklimit)
+{
+	struct bench_cc_params tuned = *params;
+	long double ratio = (measured->rate / login_rate);
+
+	switch (params->algorithm)
+	{
+		case BENCH_CC_ARGON2:
+		case BENCH_CC_SCRYPT:
+		{
+			const size_t cost_min = ((params->algorithm == BENCH_CC_ARGON2) ?
+			                         ATHEME_ARGON2_TIMECOST_MIN : ATHEME_SCRYPT_OPSLIMIT_MIN);
+			const size_t cost_max = ((params->algorithm == BENCH_CC_ARGON2) ?
+			                         ATHEME_ARGON2_TIMECOST_MAX : ATHEME_SCRYPT_OPSLIMIT_MAX);
+			const size_t mem_min = ((params->algorithm == BENCH_CC_ARGON2) ?
+			                        ATHEME_ARGON2_MEMCOST_MIN : ATHEME_SCRYPT_MEMLIMIT_MIN);
+
+			long double cost = (params->cost * ratio);
+
+			while (cost < cost_min && tuned.memcost > mem_min)
+			{
+				// Half the memory is roughly half the work
+				tuned.memcost--;
+				cost *= 2.0L;
+			}
+
+			tuned.cost = BENCH_MAX(cost_min, BENCH_MIN(cost_max, (size_t) cost));
+			break;
+		}
+
+		case BENCH_CC_BCRYPT:
+		{
+			size_t cost = params->cost;
+
+			for (; ratio >= 2.0L && cost < ATHEME_BCRYPT_ROUNDS_MAX; ratio /= 2.0L)
+				cost++;
+
+			for (; ratio < 1.0L && cost > ATHEME_BCRYPT_ROUNDS_MIN; ratio *= 2.0L)
+				cost--;
+
+			tuned.cost = cost;
+			break;
+		}
+
+		case BENCH_CC_PBKDF2:
+		{
+			size_t cost = (size_t) (params->cost * ratio);
+
+			cost -= (cost % 1000U);
+			cost = BENCH_MAX(PBKDF2_ITERCNT_MIN, BENCH_MIN(PBKDF2_ITERCNT_MAX, cost));
+
+			if (params->with_sasl_scram)
+				cost = BENCH_MIN(CYRUS_SASL_ITERCNT_MAX, cost);
+
+			tuned.cost = cost;
+			break;
+		}
+	}
+
+	struct bench_cc_result result;
+
+	(void) bench_print("");
+	(void) bench_print(_("Target: %u logins per second with %u threads; measuring %s ..."), login_rate, nthreads,
+	                   bench_cc_params_to_str(&tuned));
+
+	(void) concurrency_print_colheaders();
+
+	if (! benchmark_concurrency(&tuned, nthreads, &result))
+		// This function logs error messages on failure
+		return false;
+
+	if (result.rate < login_rate)
+	{
+		(void) bench_print("");
+		(void) bench_print(_(""
+			"WARNING: Even these parameters manage only %.1LF logins per second!\n"
+			"         Add threads (general::auth_threads) or use a cheaper algorithm."
+		), result.rate);
+	}
+
+	if (result.p99 > clocklimit)
+	{
+		(void) bench_print("");
+		(void) bench_print(_(""
+			"NOTICE: 1%% of logins took longer than %LFs (the -g/--optimal-clock-limit)\n"
+			"        to hash while all threads were busy."
+		), clocklimit);
+	}
+
+	(void) bench_print("");
+	(void) bench_print(_("Recommended parameters:"));
+	(void) bench_print("");
+
+	(void) fprintf(stdout, "general {\n");
+	(void) fprintf(stdout, "\tauth_threads = %u;\n", nthreads);
+	(void) fprintf(stdout, "};\n");
+	(void) fprintf(stdout, "crypto {\n");
+	(void) fprintf(stdout, _("\t/* Target: %u logins/s; Benchmarked: %.1LF/s, p50 %LFs, p99 %LFs */\n"), login_rate,
+	               result.rate, result.p50, result.p99);
+
+	switch (tuned.algorithm)
+	{
+		case BENCH_CC_ARGON2:
+#ifdef HAVE_LIBARGON2
+			(void) fprintf(stdout, "\targon2_type = \"%s\";\n", argon2_type2string(tuned.argon2_type, 0));
+			(void) fprintf(stdout, "\targon2_memcost = %zu; /* %s */ \n", tuned.memcost,
+			               memory_power2k_to_str(tuned.memcost));
+			(void) fprintf(stdout, "\targon2_timecost = %zu;\n", tuned.cost);
+			(void) fprintf(stdout, "\targon2_threads = %zu;\n", tuned.lanes);
+#endif
+			break;
+
+		case BENCH_CC_SCRYPT:
+#ifdef HAVE_LIBSODIUM_SCRYPT
+			(void) fprintf(stdout, "\tscrypt_memlimit = %zu; /* %s */ \n", tuned.memcost,
+			               memory_power2k_to_str(tuned.memcost));
+			(void) fprintf(stdout, "\tscrypt_opslimit = %zu;\n", tuned.cost);
+#endif
+			break;
+
+		case BENCH_CC_BCRYPT:
+			(void) fprintf(stdout, "\tbcrypt_cost = %zu;\n", tuned.cost);
+			break;
+
+		case BENCH_CC_PBKDF2:
+			(void) fprintf(stdout, "\tpbkdf2v2_digest = \"%s\";\n", md_digest_to_name(tuned.digest,
+			               tuned.with_sasl_scram));
+			(void) fprintf(stdout, "\tpbkdf2v2_rounds = %zu;\n", tuned.cost);
+			break;
+	}
+
+	(void) fprintf(stdout, "};\n");
+	(void) fflush(stdout);
+
+	return true;
+}
+
+#endif /* HAVE_USABLE_PTHREAD */
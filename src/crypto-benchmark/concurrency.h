@@ -0,0 +1,66 @@
+/*
+ * SPDX-License-Identifier: ISC
+ * SPDX-URL: https://spdx.org/licenses/ISC.html
+ *
+ * Copyright (C) 2026 Atheme Development Group (https://atheme.github.io/)
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ */
+
+#ifndef ATHEME_SRC_CRYPTO_BENCHMARK_CONCURRENCY_H
+#define ATHEME_SRC_CRYPTO_BENCHMARK_CONCURRENCY_H 1
+
+#include <atheme/attributes.h>      // ATHEME_FATTR_WUR
+#include <atheme/digest.h>          // enum digest_algorithm
+#include <atheme/stdheaders.h>      // bool, size_t
+#include <atheme/sysconf.h>         // HAVE_*
+
+#ifdef HAVE_LIBARGON2
+#  include <argon2.h>               // argon2_type
+#endif
+
+#ifdef HAVE_USABLE_PTHREAD
+
+#define BENCH_CONCURRENCY_THREADS_MAX   256U
+#define BENCH_CONCURRENCY_RATE_MAX      100000U
+
+enum bench_cc_algorithm
+{
+	BENCH_CC_ARGON2     = 0,
+	BENCH_CC_SCRYPT     = 1,
+	BENCH_CC_BCRYPT     = 2,
+	BENCH_CC_PBKDF2     = 3,
+};
+
+struct bench_cc_params
+{
+	enum bench_cc_algorithm     algorithm;
+	size_t                      cost;       // Argon2 time cost, scrypt opslimit, bcrypt rounds, PBKDF2 iterations
+	size_t                      memcost;    // Argon2 memory cost, scrypt memlimit (both as a power of 2, in KiB)
+	size_t                      lanes;      // Argon2 threads
+	enum digest_algorithm       digest;     // PBKDF2 digest
+	bool                        with_sasl_scram;
+#ifdef HAVE_LIBARGON2
+	argon2_type                 argon2_type;
+#endif
+};
+
+struct bench_cc_result
+{
+	size_t                      hashes;
+	long double                 p50;        // Latency of one hash, in seconds
+	long double                 p99;
+	long double                 rate;       // Hashes per second, all threads together
+	long                        peak_rss;   // In KiB
+};
+
+void concurrency_print_colheaders(void);
+bool benchmark_concurrency(const struct bench_cc_params *, unsigned int, struct bench_cc_result *) ATHEME_FATTR_WUR;
+bool concurrency_recommend(const struct bench_cc_params *, unsigned int, const struct bench_cc_result *,
+                           unsigned int, long double) ATHEME_FATTR_WUR;
+
+#endif /* HAVE_USABLE_PTHREAD */
+
+#endif /* !ATHEME_SRC_CRYPTO_BENCHMARK_CONCURRENCY_H */
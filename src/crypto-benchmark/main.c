@@ -10,6 +10,7 @@
  */
 
 #include <atheme/argon2.h>          // ATHEME_ARGON2_*
+#include <atheme/base64.h>          // base64_kernel_*()
 #include <atheme/bcrypt.h>          // ATHEME_BCRYPT_*
 #include <atheme/digest.h>          // DIGALG_*
 #include <atheme/i18n.h>            // _() (gettext)
@@ -23,6 +24,7 @@
 #include <ext/getopt_long.h>        // mowgli_getopt_option_t, mowgli_getopt_long()
 
 #include "benchmark.h"              // (everything else)
+#include "concurrency.h"            // benchmark_concurrency(), concurrency_*()
 #include "optimal.h"                // do_optimal_benchmarks()
 #include "selftests.h"              // do_crypto_selftests()
 
@@ -80,6 +82,14 @@ static enum digest_algorithm b_pbkdf2_digests_default[] = { DIGALG_SHA1, DIGALG_
 static enum digest_algorithm *b_pbkdf2_digests = NULL;
 static size_t b_pbkdf2_digests_count = 0;
 
+#ifdef HAVE_USABLE_PTHREAD
+
+static size_t *b_concurrency_threads = NULL;
+static size_t b_concurrency_threads_count = 0;
+static unsigned int b_concurrency_login_rate = 0;
+
+#endif /* HAVE_USABLE_PTHREAD */
+
 static long double optimal_clocklimit = BENCH_CLOCKTIME_DEF;
 static unsigned int optimal_memlimit = BENCH_MEMLIMIT_DEF;
 static bool optimal_memlimit_given = false;
@@ -118,6 +128,13 @@ static const mowgli_getopt_option_t bench_long_opts[] = {
 	{    "run-pbkdf2-benchmarks",       no_argument, NULL, 'k', 0 },
 	{        "pbkdf2-iterations", required_argument, NULL, 'c', 0 },
 	{ "pbkdf2-digest-algorithms", required_argument, NULL, 'd', 0 },
+	{    "run-digest-benchmarks",       no_argument, NULL, 'D', 0 },
+	{    "run-base64-benchmarks",       no_argument, NULL, 'B', 0 },
+#ifdef HAVE_USABLE_PTHREAD
+	{ "run-concurrency-benchmarks",     no_argument, NULL, 'C', 0 },
+	{      "concurrency-threads", required_argument, NULL, 'j', 0 },
+	{        "target-login-rate", required_argument, NULL, 'R', 0 },
+#endif
 
 	{ NULL, 0, NULL, 0, 0 },
 };
@@ -164,11 +181,27 @@ print_usage(void)
 		"  -c/--pbkdf2-iterations         Comma-separated iteration counts\n"
 		"  -d/--pbkdf2-digests            Comma-separated digest algorithms\n"
 		"\n"
+		"  -D/--run-digest-benchmarks   Measure the throughput of each SHA1 and SHA2\n"
+		"                                 compression kernel that this CPU can run\n"
+		"                                 (for the digest algorithms given with -d)\n"
+		"\n"
+		"  -B/--run-base64-benchmarks   Measure the throughput of each base64 encoding\n"
+		"                                 and decoding kernel that this CPU can run\n"
+		"\n"
+		"  -C/--run-concurrency-benchmarks\n"
+		"                               Run every algorithm above on several threads at\n"
+		"                                 once, with the (first) configuration given by\n"
+		"                                 the options above, or the services defaults\n"
+		"  -j/--concurrency-threads       Comma-separated thread counts\n"
+		"                                   (defaults to 1 and the number of CPUs)\n"
+		"  -R/--target-login-rate         Logins per second to tune parameters for\n"
+		"                                   (using the largest thread count)\n"
+		"\n"
 		"  Valid Argon2 types are: Argon2d, Argon2i, Argon2id (case-insensitive)\n"
 		"  Valid PBKDF2 digests are: MD5, SHA1, SHA2-256, SHA2-512 (case-insensitive)\n"
 		"\n"
 		"  If one of the above customisable options are not given, defaults are used.\n"
-		"  One of -h/-v/-o/-a/-s/-k MUST be given. They are all mutually-exclusive.\n"
+		"  One of -h/-v/-o/-a/-s/-b/-k/-D/-B/-C MUST be given. They are all mutually-exclusive.\n"
 	));
 }
 
@@ -450,6 +483,41 @@ process_options(int argc, char *argv[])
 				break;
 			}
 
+			case 'D':
+				run_options |= BENCH_RUN_OPTIONS_DIGEST;
+				break;
+
+			case 'B':
+				run_options |= BENCH_RUN_OPTIONS_BASE64;
+				break;
+
+#ifdef HAVE_USABLE_PTHREAD
+			case 'C':
+				run_options |= BENCH_RUN_OPTIONS_CONCURRENCY;
+				break;
+
+			case 'j':
+				if (! process_uint_option(c, mowgli_optarg, &b_concurrency_threads,
+				                          &b_concurrency_threads_count, 1U, BENCH_CONCURRENCY_THREADS_MAX))
+					// This function logs error messages on failure
+					return false;
+
+				break;
+
+			case 'R':
+				if (! string_to_uint(mowgli_optarg, &b_concurrency_login_rate) ||
+				    b_concurrency_login_rate < 1U || b_concurrency_login_rate > BENCH_CONCURRENCY_RATE_MAX)
+				{
+					(void) bench_print(_(""
+						"'%s' is not a valid value for integer option '%c'\n"
+						"range of valid values: %u to %u (inclusive)\n"
+					), mowgli_optarg, c, 1U, BENCH_CONCURRENCY_RATE_MAX);
+
+					return false;
+				}
+				break;
+#endif /* HAVE_USABLE_PTHREAD */
+
 			default:
 				(void) print_usage();
 				return false;
@@ -584,6 +652,126 @@ do_bcrypt_benchmarks(void)
 	return true;
 }
 
+#ifdef HAVE_USABLE_PTHREAD
+
+static bool ATHEME_FATTR_WUR
+do_concurrency_benchmark(const struct bench_cc_params *const restrict params)
+{
+	struct bench_cc_result result;
+	size_t maxthreads = 0;
+
+	(void) concurrency_print_colheaders();
+
+	for (size_t b_concurrency_thread = 0; b_concurrency_thread < b_concurrency_threads_count; b_concurrency_thread++)
+	{
+		const size_t nthreads = b_concurrency_threads[b_concurrency_thread];
+
+		if (! benchmark_concurrency(params, (unsigned int) nthreads, &result))
+			// This function logs error messages on failure
+			return false;
+
+		maxthreads = BENCH_MAX(maxthreads, nthreads);
+	}
+
+	if (! b_concurrency_login_rate)
+		return true;
+
+	if (maxthreads != b_concurrency_threads[b_concurrency_threads_count - 1U])
+	{
+		(void) concurrency_print_colheaders();
+
+		if (! benchmark_concurrency(params, (unsigned int) maxthreads, &result))
+			// This function logs error messages on failure
+			return false;
+	}
+
+	return concurrency_recommend(params, (unsigned int) maxthreads, &result, b_concurrency_login_rate,
+	                             optimal_clocklimit);
+}
+
+// The first value given for an option, or the services default if it was not given
+#define BENCH_CC_FIRST(list, def)   (((list) == list##_default) ? (def) : (list)[0])
+
+/* Unlike the customisable benchmarks above, this only uses the first value of
+ * each list; every configuration takes a few seconds per thread count, and the
+ * point is to see one configuration under load rather than to compare many.
+ */
+static bool ATHEME_FATTR_WUR
+do_concurrency_benchmarks(void)
+{
+	static size_t b_concurrency_threads_default[2] = { 1U, 1U };
+
+	(void) bench_print("");
+	(void) bench_print("");
+	(void) bench_print(_("Beginning concurrent benchmark ..."));
+
+	if (! b_concurrency_threads)
+	{
+		const long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+		b_concurrency_threads = b_concurrency_threads_default;
+		b_concurrency_threads_count = 1U;
+
+		if (ncpus > 1)
+		{
+			b_concurrency_threads_default[1] = BENCH_MIN((size_t) ncpus, BENCH_CONCURRENCY_THREADS_MAX);
+			b_concurrency_threads_count = 2U;
+		}
+	}
+
+	struct bench_cc_params params;
+
+#ifdef HAVE_LIBARGON2
+	(void) memset(&params, 0x00, sizeof params);
+
+	params.algorithm = BENCH_CC_ARGON2;
+	params.argon2_type = b_argon2_types[0];
+	params.memcost = BENCH_CC_FIRST(b_argon2_memcosts, ATHEME_ARGON2_MEMCOST_DEF);
+	params.cost = BENCH_CC_FIRST(b_argon2_timecosts, ATHEME_ARGON2_TIMECOST_DEF);
+	params.lanes = BENCH_CC_FIRST(b_argon2_threads, ATHEME_ARGON2_THREADS_DEF);
+
+	if (! do_concurrency_benchmark(&params))
+		// This function logs error messages on failure
+		return false;
+#endif /* HAVE_LIBARGON2 */
+
+#ifdef HAVE_LIBSODIUM_SCRYPT
+	(void) memset(&params, 0x00, sizeof params);
+
+	params.algorithm = BENCH_CC_SCRYPT;
+	params.memcost = BENCH_CC_FIRST(b_scrypt_memlimits, ATHEME_SCRYPT_MEMLIMIT_DEF);
+	params.cost = BENCH_CC_FIRST(b_scrypt_opslimits, ATHEME_SCRYPT_OPSLIMIT_DEF);
+
+	if (! do_concurrency_benchmark(&params))
+		// This function logs error messages on failure
+		return false;
+#endif /* HAVE_LIBSODIUM_SCRYPT */
+
+	(void) memset(&params, 0x00, sizeof params);
+
+	params.algorithm = BENCH_CC_BCRYPT;
+	params.cost = BENCH_CC_FIRST(b_bcrypt_costs, ATHEME_BCRYPT_ROUNDS_DEF);
+
+	if (! do_concurrency_benchmark(&params))
+		// This function logs error messages on failure
+		return false;
+
+	(void) memset(&params, 0x00, sizeof params);
+
+	params.algorithm = BENCH_CC_PBKDF2;
+	params.digest = BENCH_CC_FIRST(b_pbkdf2_digests, DIGALG_SHA2_512);
+	params.cost = BENCH_CC_FIRST(b_pbkdf2_itercounts, PBKDF2_ITERCNT_DEF);
+	params.with_sasl_scram = with_sasl_scram;
+
+	if (! do_concurrency_benchmark(&params))
+		// This function logs error messages on failure
+		return false;
+
+	return true;
+}
+
+#endif /* HAVE_USABLE_PTHREAD */
+
 static bool ATHEME_FATTR_WUR
 do_pbkdf2_benchmarks(void)
 {
@@ -614,6 +802,54 @@ do_pbkdf2_benchmarks(void)
 	      // This function logs error messages on failure
 	      return false;
 
+	(void) pbkdf2_multi_print_colheaders();
+
+	for (size_t b_pbkdf2_digest = 0; b_pbkdf2_digest < b_pbkdf2_digests_count; b_pbkdf2_digest++)
+	  for (size_t b_pbkdf2_itercount = 0; b_pbkdf2_itercount < b_pbkdf2_itercounts_count; b_pbkdf2_itercount++)
+	    if (! benchmark_pbkdf2_multi(b_pbkdf2_digests[b_pbkdf2_digest], b_pbkdf2_itercounts[b_pbkdf2_itercount],
+	                                 with_sasl_scram, NULL, NULL))
+	      // This function logs error messages on failure
+	      return false;
+
+	return true;
+}
+
+static bool ATHEME_FATTR_WUR
+do_digest_benchmarks(void)
+{
+	(void) bench_print("");
+	(void) bench_print("");
+	(void) bench_print(_("Beginning digest kernel benchmark ..."));
+
+	(void) digest_kernel_print_colheaders();
+
+	for (size_t b_pbkdf2_digest = 0; b_pbkdf2_digest < b_pbkdf2_digests_count; b_pbkdf2_digest++)
+	  if (! benchmark_digest_kernels(b_pbkdf2_digests[b_pbkdf2_digest]))
+	    // This function logs error messages on failure
+	    return false;
+
+	(void) bench_print("");
+	(void) bench_print(_("Currently selected: %s"), digest_direct_get_kernels());
+
+	return true;
+}
+
+static bool ATHEME_FATTR_WUR
+do_base64_benchmarks(void)
+{
+	(void) bench_print("");
+	(void) bench_print("");
+	(void) bench_print(_("Beginning base64 kernel benchmark ..."));
+
+	(void) base64_kernel_print_colheaders();
+
+	if (! benchmark_base64_kernels())
+		// This function logs error messages on failure
+		return false;
+
+	(void) bench_print("");
+	(void) bench_print(_("Currently selected: %s"), base64_kernel_name(base64_kernel_selected()));
+
 	return true;
 }
 
@@ -668,5 +904,19 @@ main(int argc, char *argv[])
 		// This function logs error messages on failure
 		return EXIT_FAILURE;
 
+	if ((run_options & BENCH_RUN_OPTIONS_DIGEST) && ! do_digest_benchmarks())
+		// This function logs error messages on failure
+		return EXIT_FAILURE;
+
+	if ((run_options & BENCH_RUN_OPTIONS_BASE64) && ! do_base64_benchmarks())
+		// This function logs error messages on failure
+		return EXIT_FAILURE;
+
+#ifdef HAVE_USABLE_PTHREAD
+	if ((run_options & BENCH_RUN_OPTIONS_CONCURRENCY) && ! do_concurrency_benchmarks())
+		// This function logs error messages on failure
+		return EXIT_FAILURE;
+#endif /* HAVE_USABLE_PTHREAD */
+
 	return EXIT_SUCCESS;
 }
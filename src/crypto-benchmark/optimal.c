@@ -373,6 +373,39 @@ do_optimal_pbkdf2_benchmark(const long double optimal_clocklimit, const bool wit
 			return false;
 	}
 
+	/* The password verification threads hash several waiting passwords at once
+	 * where the digest frontend can; show what that does to the login rate and
+	 * to how long a login in a full batch waits, at the recommended count.
+	 */
+	long double elapsed_multi;
+	size_t lanes;
+
+	(void) pbkdf2_multi_print_colheaders();
+
+	if (! benchmark_pbkdf2_multi(md, iterations, with_sasl_scram, &elapsed_multi, &lanes))
+		// This function logs error messages on failure
+		return false;
+
+	const long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+	const long double rate = (((long double) lanes) / elapsed_multi);
+
+	(void) bench_print("");
+	(void) bench_print(_("Multi-buffer verification: %zu %s at once (%s)"), lanes, mdname,
+	                   digest_get_frontend_info());
+	(void) bench_print(_("Verifications per second: %.1LF per core, %.1LF on all %ld cores"), rate,
+	                   (rate * ((ncpus > 0) ? ncpus : 1)), ((ncpus > 0) ? ncpus : 1L));
+
+	if (elapsed_multi > optimal_clocklimit)
+	{
+		const size_t batch_iterations = (size_t) (iterations * (optimal_clocklimit / elapsed_multi));
+
+		(void) bench_print(_(""
+			"NOTICE: A full batch takes longer than the target; logins that arrive\n"
+			"        together may wait up to %LFs. %zu iterations would keep a full\n"
+			"        batch within the target."
+		), elapsed_multi, BENCH_MAX(PBKDF2_ITERCNT_MIN, batch_iterations));
+	}
+
 	(void) bench_print("");
 	(void) bench_print(_("Recommended parameters:"));
 	(void) bench_print("");
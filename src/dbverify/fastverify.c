@@ -0,0 +1,978 @@
+/*
+ * SPDX-License-Identifier: ISC
+ * SPDX-URL: https://spdx.org/licenses/ISC.html
+ *
+ * Copyright (C) 2026 Atheme Development Group (https://atheme.github.io/)
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * The normal mode of dbverify loads the whole database into the object
+ * model first, which takes as long and as much memory as starting services.
+ * This checks an OpenSEX file as it streams past instead: row syntax, that
+ * the rows which refer to accounts, channels, access entries and names
+ * refer to ones the file defines, and duplicates. It keeps nothing of an
+ * object but a 64-bit hash of its (casefolded) name, and writes nothing.
+ *
+ * With more than one thread, the file is cut into chunks at row boundaries
+ * and each is checked on its own; a reference that its own chunk cannot
+ * satisfy is kept aside and looked up again once all the chunks are merged.
+ */
+
+#include <atheme.h>
+#include "fastverify.h"
+
+#ifdef HAVE_USABLE_PTHREAD
+#  include <pthread.h>
+#endif
+
+#ifdef HAVE_SYS_MMAN_H
+#  include <sys/mman.h>
+#endif
+
+#define FV_MAX_WORDS            12U
+#define FV_MAX_REPORTS          100U            // kept per chunk; the rest are only counted
+#define FV_MAX_LOGGED           1000U
+#define FV_MIN_CHUNK            (1U << 24)      // not worth a thread below this many bytes
+#define FV_SET_MIN_SLOTS        1024U
+#define FV_NAME_MAX             96U
+#define FV_PREAMBLE_LINES       64U             // how far into the file to look for the DBV row
+
+#define FV_FNV64_OFFSET         0xCBF29CE484222325ULL
+#define FV_FNV64_PRIME          0x00000100000001B3ULL
+
+enum fv_setid
+{
+	FV_SET_ACCOUNT,
+	FV_SET_GROUP,
+	FV_SET_EID,
+	FV_SET_CHANNEL,
+	FV_SET_CHANACS,
+	FV_SET_NICK,
+	FV_SET_NAME,
+	FV_SET_COUNT,
+};
+
+enum fv_ref
+{
+	FV_REF_ACCOUNT,
+	FV_REF_ENTITY,          // an account or a group
+	FV_REF_GROUP,
+	FV_REF_CHANNEL,
+	FV_REF_CHANACS,
+	FV_REF_NAME,
+};
+
+// Sorted, for fv_row_lookup()
+enum fv_row
+{
+	FV_ROW_AC,
+	FV_ROW_CA,
+	FV_ROW_DBV,
+	FV_ROW_GACL,
+	FV_ROW_GRP,
+	FV_ROW_KL,
+	FV_ROW_MC,
+	FV_ROW_MCFP,
+	FV_ROW_MDA,
+	FV_ROW_MDC,
+	FV_ROW_MDG,
+	FV_ROW_MDN,
+	FV_ROW_MDU,
+	FV_ROW_ME,
+	FV_ROW_MI,
+	FV_ROW_MN,
+	FV_ROW_MO,
+	FV_ROW_MU,
+	FV_ROW_NAM,
+	FV_ROW_QL,
+	FV_ROW_SI,
+	FV_ROW_SO,
+	FV_ROW_XL,
+	FV_ROW_OTHER,
+	FV_ROW_COUNT,
+};
+
+static const char *const fv_row_names[FV_ROW_COUNT] = {
+	"AC", "CA", "DBV", "GACL", "GRP", "KL", "MC", "MCFP", "MDA", "MDC", "MDG", "MDN",
+	"MDU", "ME", "MI", "MN", "MO", "MU", "NAM", "QL", "SI", "SO", "XL", NULL,
+};
+
+static const char *const fv_set_dups[FV_SET_COUNT] = {
+	[FV_SET_ACCOUNT]        = "duplicate account; it will be skipped",
+	[FV_SET_GROUP]          = "duplicate group",
+	[FV_SET_EID]            = "duplicate entity ID; a normal dbverify run will regenerate it",
+	[FV_SET_CHANNEL]        = "duplicate channel",
+	[FV_SET_CHANACS]        = "duplicate channel access entry; a normal dbverify run will remove it",
+	[FV_SET_NICK]           = "duplicate nick; it will be skipped",
+	[FV_SET_NAME]           = "duplicate held name",
+};
+
+static const char *const fv_ref_missing[] = {
+	[FV_REF_ACCOUNT]        = "refers to a nonexistent account; the row will be dropped",
+	[FV_REF_ENTITY]         = "refers to a nonexistent account or group",
+	[FV_REF_GROUP]          = "refers to a nonexistent group",
+	[FV_REF_CHANNEL]        = "refers to a nonexistent channel",
+	[FV_REF_CHANACS]        = "refers to a nonexistent channel access entry; the row will be dropped",
+	[FV_REF_NAME]           = "refers to a nonexistent held name; the row will be dropped",
+};
+
+struct fv_word
+{
+	const char *            p;
+	size_t                  len;
+};
+
+// Open addressing over hashes alone; 0 marks an empty slot, so no key is ever 0
+struct fv_set
+{
+	uint64_t *              keys;
+	unsigned int *          lines;  // where each key was first seen
+	size_t                  mask;
+	size_t                  count;
+};
+
+// A reference that the chunk it appears in could not satisfy (yet)
+struct fv_pending
+{
+	uint64_t                key;
+	size_t                  off;    // of the name, from the start of the file
+	unsigned int            line;
+	unsigned short          len;
+	unsigned char           ref;
+	unsigned char           row;
+};
+
+struct fv_report
+{
+	unsigned int            line;
+	unsigned int            first;  // line of the earlier definition, for duplicates
+	const char *            what;
+	enum fv_row             row;
+	char                    name[FV_NAME_MAX];
+};
+
+struct fv_chunk
+{
+	const char *            map;    // the whole file; offsets are from here
+	size_t                  start;
+	size_t                  end;
+	unsigned int            dbv;
+	unsigned int            lines;
+	unsigned int            base;   // lines in the chunks before this one
+	unsigned int            problems;
+	unsigned int            nreports;
+	size_t                  npending;
+	size_t                  maxpending;
+	struct fv_pending *     pending;
+	unsigned long long      rows[FV_ROW_COUNT];
+	struct fv_set           sets[FV_SET_COUNT];
+	struct fv_report        reports[FV_MAX_REPORTS];
+#ifdef HAVE_USABLE_PTHREAD
+	pthread_t               thread;
+	bool                    threaded;
+#endif
+};
+
+static unsigned int fv_logged = 0;
+
+static uint64_t
+fv_hash(uint64_t hash, const struct fv_word *const restrict w)
+{
+	const unsigned char *const p = (const unsigned char *) w->p;
+
+	// The same casemapping as irccasecanon, so that names the trees would merge hash alike
+	if (match_mapping == MATCH_ASCII)
+	{
+		for (size_t i = 0; i < w->len; i++)
+			hash = (hash ^ (unsigned char) toupper(p[i])) * FV_FNV64_PRIME;
+	}
+	else
+	{
+		for (size_t i = 0; i < w->len; i++)
+			hash = (hash ^ ToUpperTab[p[i]]) * FV_FNV64_PRIME;
+	}
+
+	return hash;
+}
+
+static inline uint64_t
+fv_key(const struct fv_word *const restrict w)
+{
+	const uint64_t hash = fv_hash(FV_FNV64_OFFSET, w);
+
+	return hash ? hash : 1U;
+}
+
+// A channel and an access entry target; the space cannot occur in either word
+static inline uint64_t
+fv_pair_key(const struct fv_word *const restrict a, const struct fv_word *const restrict b)
+{
+	const uint64_t hash = fv_hash((fv_hash(FV_FNV64_OFFSET, a) ^ (uint64_t) ' ') * FV_FNV64_PRIME, b);
+
+	return hash ? hash : 1U;
+}
+
+static inline size_t
+fv_slot(const struct fv_set *const restrict set, const uint64_t key)
+{
+	return (size_t) ((key * 0x9E3779B97F4A7C15ULL) >> 32) & set->mask;
+}
+
+static bool
+fv_set_has(const struct fv_set *const restrict set, const uint64_t key)
+{
+	if (! set->keys)
+		return false;
+
+	for (size_t i = fv_slot(set, key); set->keys[i]; i = (i + 1) & set->mask)
+		if (set->keys[i] == key)
+			return true;
+
+	return false;
+}
+
+static void
+fv_set_grow(struct fv_set *const restrict set)
+{
+	uint64_t *const oldkeys = set->keys;
+	unsigned int *const oldlines = set->lines;
+	const size_t oldsize = oldkeys ? set->mask + 1 : 0;
+	const size_t size = oldkeys ? oldsize * 2 : FV_SET_MIN_SLOTS;
+
+	set->keys = scalloc(size, sizeof *set->keys);
+	set->lines = scalloc(size, sizeof *set->lines);
+	set->mask = size - 1;
+
+	for (size_t i = 0; i < oldsize; i++)
+	{
+		if (! oldkeys[i])
+			continue;
+
+		size_t j = fv_slot(set, oldkeys[i]);
+
+		while (set->keys[j])
+			j = (j + 1) & set->mask;
+
+		set->keys[j] = oldkeys[i];
+		set->lines[j] = oldlines[i];
+	}
+
+	sfree(oldkeys);
+	sfree(oldlines);
+}
+
+// Returns 0 if the key is new, or else the line it was first seen on
+static unsigned int
+fv_set_add(struct fv_set *const restrict set, const uint64_t key, const unsigned int line)
+{
+	if (! set->keys || (set->count + 1) * 4 > (set->mask + 1) * 3)
+		fv_set_grow(set);
+
+	size_t i = fv_slot(set, key);
+
+	for (; set->keys[i]; i = (i + 1) & set->mask)
+		if (set->keys[i] == key)
+			return set->lines[i];
+
+	set->keys[i] = key;
+	set->lines[i] = line;
+	set->count++;
+
+	return 0;
+}
+
+static void
+fv_set_free(struct fv_set *const restrict set)
+{
+	sfree(set->keys);
+	sfree(set->lines);
+
+	(void) memset(set, 0x00, sizeof *set);
+}
+
+static bool
+fv_resolves(const struct fv_set *const restrict sets, const enum fv_ref ref, const uint64_t key)
+{
+	switch (ref)
+	{
+		case FV_REF_ACCOUNT:
+			return fv_set_has(&sets[FV_SET_ACCOUNT], key);
+		case FV_REF_ENTITY:
+			return fv_set_has(&sets[FV_SET_ACCOUNT], key) || fv_set_has(&sets[FV_SET_GROUP], key);
+		case FV_REF_GROUP:
+			return fv_set_has(&sets[FV_SET_GROUP], key);
+		case FV_REF_CHANNEL:
+			return fv_set_has(&sets[FV_SET_CHANNEL], key);
+		case FV_REF_CHANACS:
+			return fv_set_has(&sets[FV_SET_CHANACS], key);
+		case FV_REF_NAME:
+			return fv_set_has(&sets[FV_SET_NAME], key);
+	}
+
+	return false;
+}
+
+static enum fv_row
+fv_row_lookup(const struct fv_word *const restrict w)
+{
+	unsigned int lo = 0, hi = FV_ROW_OTHER;
+
+	while (lo < hi)
+	{
+		const unsigned int mid = (lo + hi) / 2;
+		const char *const name = fv_row_names[mid];
+		int cmp = strncmp(name, w->p, w->len);
+
+		if (! cmp && name[w->len] != '\0')
+			cmp = 1;
+
+		if (! cmp)
+			return (enum fv_row) mid;
+
+		if (cmp < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return FV_ROW_OTHER;
+}
+
+// Worker side; the main thread logs these once every chunk is done
+static void
+fv_report(struct fv_chunk *const restrict c, const unsigned int line, const enum fv_row row,
+          const char *const restrict what, const struct fv_word *const restrict w, const unsigned int first)
+{
+	c->problems++;
+
+	if (c->nreports >= FV_MAX_REPORTS)
+		return;
+
+	struct fv_report *const r = &c->reports[c->nreports++];
+	const size_t len = ! w ? 0 : (w->len < sizeof r->name) ? w->len : sizeof r->name - 1;
+
+	r->line = line;
+	r->first = first;
+	r->what = what;
+	r->row = row;
+
+	if (len)
+		(void) memcpy(r->name, w->p, len);
+
+	r->name[len] = '\0';
+}
+
+static void
+fv_define(struct fv_chunk *const restrict c, const enum fv_setid set, const uint64_t key,
+          const struct fv_word *const restrict w, const unsigned int line, const enum fv_row row)
+{
+	const unsigned int first = fv_set_add(&c->sets[set], key, line);
+
+	if (first)
+		fv_report(c, line, row, fv_set_dups[set], w, first);
+}
+
+// The name is the span of the file that the key was made from, for the log
+static void
+fv_refer(struct fv_chunk *const restrict c, const enum fv_ref ref, const uint64_t key,
+         const struct fv_word *const restrict w, const unsigned int line, const enum fv_row row)
+{
+	if (fv_resolves(c->sets, ref, key))
+		return;
+
+	if (c->npending == c->maxpending)
+	{
+		c->maxpending = c->maxpending ? c->maxpending * 2 : 1024U;
+		c->pending = sreallocarray(c->pending, c->maxpending, sizeof *c->pending);
+	}
+
+	struct fv_pending *const p = &c->pending[c->npending++];
+
+	p->key = key;
+	p->off = (size_t) (w->p - c->map);
+	p->len = (unsigned short) ((w->len < FV_NAME_MAX) ? w->len : FV_NAME_MAX - 1);
+	p->line = line;
+	p->ref = (unsigned char) ref;
+	p->row = (unsigned char) row;
+}
+
+static bool
+fv_numeric(const struct fv_word *const restrict w)
+{
+	size_t i = (w->len && w->p[0] == '-') ? 1 : 0;
+
+	if (i == w->len)
+		return false;
+
+	for (; i < w->len; i++)
+		if (! isdigit((unsigned char) w->p[i]))
+			return false;
+
+	return true;
+}
+
+// Needs at least nwords words (counting the row type); numeric is a bitmask of word indices
+static bool
+fv_syntax(struct fv_chunk *const restrict c, const struct fv_word *const restrict w, const unsigned int nw,
+          const unsigned int line, const enum fv_row row, const unsigned int nwords, const unsigned int numeric)
+{
+	if (nw < nwords)
+	{
+		fv_report(c, line, row, "too few fields", NULL, 0);
+		return false;
+	}
+
+	for (unsigned int i = 1; i < nw; i++)
+	{
+		if (! (numeric & (1U << i)) || fv_numeric(&w[i]))
+			continue;
+
+		fv_report(c, line, row, "field is not a number", &w[i], 0);
+		return false;
+	}
+
+	return true;
+}
+
+static bool
+fv_hostmask(const struct fv_word *const restrict w)
+{
+	char buf[BUFSIZE];
+
+	if (w->len >= sizeof buf)
+		return false;
+
+	(void) memcpy(buf, w->p, w->len);
+	buf[w->len] = '\0';
+
+	return validhostmask(buf);
+}
+
+static void
+fv_check_row(struct fv_chunk *const restrict c, const struct fv_word *const restrict w, const unsigned int nw,
+             const unsigned int line)
+{
+	const enum fv_row row = fv_row_lookup(&w[0]);
+
+	c->rows[row]++;
+
+	switch (row)
+	{
+		case FV_ROW_MU:
+		{
+			// MU [<id>] <name> <pass> <email> <registered> <lastlogin> <flags> [<language>]
+			const unsigned int o = (c->dbv >= 10) ? 1 : 0;
+			const unsigned int numeric = (3U << (4 + o)) | ((c->dbv >= 8) ? 0 : (1U << (6 + o)));
+
+			if (! fv_syntax(c, w, nw, line, row, 7 + o, numeric))
+				return;
+
+			if (o)
+				fv_define(c, FV_SET_EID, fv_key(&w[1]), &w[1], line, row);
+
+			fv_define(c, FV_SET_ACCOUNT, fv_key(&w[1 + o]), &w[1 + o], line, row);
+			return;
+		}
+
+		case FV_ROW_GRP:
+			// GRP <id> <name> <registered> <flags>
+			if (! fv_syntax(c, w, nw, line, row, 5, 1U << 3))
+				return;
+
+			fv_define(c, FV_SET_EID, fv_key(&w[1]), &w[1], line, row);
+			fv_define(c, FV_SET_GROUP, fv_key(&w[2]), &w[2], line, row);
+			return;
+
+		case FV_ROW_MN:
+			// MN <account> <nick> <registered> <lastseen>
+			if (! fv_syntax(c, w, nw, line, row, 5, (1U << 3) | (1U << 4)))
+				return;
+
+			fv_refer(c, FV_REF_ACCOUNT, fv_key(&w[1]), &w[1], line, row);
+			fv_define(c, FV_SET_NICK, fv_key(&w[2]), &w[2], line, row);
+			return;
+
+		case FV_ROW_AC:
+		case FV_ROW_MCFP:
+		case FV_ROW_MI:
+		case FV_ROW_MDU:
+			if (fv_syntax(c, w, nw, line, row, 3, 0))
+				fv_refer(c, FV_REF_ACCOUNT, fv_key(&w[1]), &w[1], line, row);
+			return;
+
+		case FV_ROW_SO:
+			// SO <account> <class> <flags> [<password>]
+			if (fv_syntax(c, w, nw, line, row, 4, 0))
+				fv_refer(c, FV_REF_ACCOUNT, fv_key(&w[1]), &w[1], line, row);
+			return;
+
+		case FV_ROW_ME:
+			// ME <account> <sender> <sent> <status> <text>
+			if (fv_syntax(c, w, nw, line, row, 5, (1U << 3) | (1U << 4)))
+				fv_refer(c, FV_REF_ACCOUNT, fv_key(&w[1]), &w[1], line, row);
+			return;
+
+		case FV_ROW_MO:
+			// MO <account> <sender> <sent> <status> <offset> <length>
+			if (fv_syntax(c, w, nw, line, row, 7, 0xFU << 3))
+				fv_refer(c, FV_REF_ACCOUNT, fv_key(&w[1]), &w[1], line, row);
+			return;
+
+		case FV_ROW_NAM:
+			if (fv_syntax(c, w, nw, line, row, 2, 0))
+				fv_define(c, FV_SET_NAME, fv_key(&w[1]), &w[1], line, row);
+			return;
+
+		case FV_ROW_MDN:
+			if (fv_syntax(c, w, nw, line, row, 3, 0))
+				fv_refer(c, FV_REF_NAME, fv_key(&w[1]), &w[1], line, row);
+			return;
+
+		case FV_ROW_MDG:
+			if (fv_syntax(c, w, nw, line, row, 3, 0))
+				fv_refer(c, FV_REF_GROUP, fv_key(&w[1]), &w[1], line, row);
+			return;
+
+		case FV_ROW_GACL:
+			// GACL <group> <entity> <flags>
+			if (! fv_syntax(c, w, nw, line, row, 4, 0))
+				return;
+
+			fv_refer(c, FV_REF_GROUP, fv_key(&w[1]), &w[1], line, row);
+			fv_refer(c, FV_REF_ENTITY, fv_key(&w[2]), &w[2], line, row);
+			return;
+
+		case FV_ROW_MC:
+			// MC <channel> <registered> <used> <flags> ...
+			if (fv_syntax(c, w, nw, line, row, 5, (1U << 2) | (1U << 3)))
+				fv_define(c, FV_SET_CHANNEL, fv_key(&w[1]), &w[1], line, row);
+			return;
+
+		case FV_ROW_MDC:
+			if (fv_syntax(c, w, nw, line, row, 3, 0))
+				fv_refer(c, FV_REF_CHANNEL, fv_key(&w[1]), &w[1], line, row);
+			return;
+
+		case FV_ROW_CA:
+		{
+			// CA <channel> <entity or hostmask> <flags> <modified> [<setter>]
+			if (! fv_syntax(c, w, nw, line, row, (c->dbv >= 9) ? 6 : 5, 1U << 4))
+				return;
+
+			const struct fv_word span = { w[1].p, (size_t) (w[2].p + w[2].len - w[1].p) };
+
+			fv_refer(c, FV_REF_CHANNEL, fv_key(&w[1]), &w[1], line, row);
+
+			// Exttargets ($chanacs and friends) are provided by modules, which this mode does not load
+			if (w[2].len && w[2].p[0] != '$' && ! fv_hostmask(&w[2]))
+				fv_refer(c, FV_REF_ENTITY, fv_key(&w[2]), &w[2], line, row);
+
+			fv_define(c, FV_SET_CHANACS, fv_pair_key(&w[1], &w[2]), &span, line, row);
+			return;
+		}
+
+		case FV_ROW_MDA:
+		{
+			// MDA <channel> <mask> <key> <value>, or MDA <channel>:<mask> <key> <value> before DBV 12
+			if (c->dbv >= 12)
+			{
+				if (! fv_syntax(c, w, nw, line, row, 4, 0))
+					return;
+
+				const struct fv_word span = { w[1].p, (size_t) (w[2].p + w[2].len - w[1].p) };
+
+				fv_refer(c, FV_REF_CHANACS, fv_pair_key(&w[1], &w[2]), &span, line, row);
+				return;
+			}
+
+			if (! fv_syntax(c, w, nw, line, row, 3, 0))
+				return;
+
+			const char *colon = w[1].p + w[1].len;
+
+			while (colon > w[1].p && *--colon != ':')
+				;
+
+			if (*colon != ':')
+			{
+				fv_report(c, line, row, "channel access entry has no mask", &w[1], 0);
+				return;
+			}
+
+			const struct fv_word chan = { w[1].p, (size_t) (colon - w[1].p) };
+			const struct fv_word mask = { colon + 1, (size_t) (w[1].p + w[1].len - colon - 1) };
+
+			fv_refer(c, FV_REF_CHANACS, fv_pair_key(&chan, &mask), &w[1], line, row);
+			return;
+		}
+
+		default:
+			return;
+	}
+}
+
+static void
+fv_scan(struct fv_chunk *const restrict c)
+{
+	struct fv_word w[FV_MAX_WORDS];
+
+	for (size_t pos = c->start; pos < c->end; )
+	{
+		const char *const row = c->map + pos;
+		const char *const nl = memchr(row, '\n', c->end - pos);
+		const size_t len = nl ? (size_t) (nl - row) : c->end - pos;
+		unsigned int nw = 0;
+
+		pos += len + 1;
+		c->lines++;
+
+		if (! len || strchr("#\t \r", *row))
+			continue;
+
+		// Split as db_read_word() would; trailing free text beyond the words we look at is left alone
+		for (size_t i = 0; i <= len && nw < FV_MAX_WORDS; nw++)
+		{
+			const char *const sp = memchr(row + i, ' ', len - i);
+			const size_t wlen = sp ? (size_t) (sp - (row + i)) : len - i;
+
+			w[nw].p = row + i;
+			w[nw].len = wlen;
+
+			if (! sp)
+			{
+				nw++;
+				break;
+			}
+
+			i += wlen + 1;
+		}
+
+		fv_check_row(c, w, nw, c->lines);
+	}
+}
+
+#ifdef HAVE_USABLE_PTHREAD
+static void *
+fv_scan_thread(void *const restrict arg)
+{
+	fv_scan(arg);
+
+	return NULL;
+}
+#endif
+
+static void
+fv_log(const unsigned int line, const char *const restrict rowname, const char *const restrict name,
+       const size_t namelen, const char *const restrict what, const unsigned int first)
+{
+	if (fv_logged++ >= FV_MAX_LOGGED)
+	{
+		if (fv_logged == FV_MAX_LOGGED + 1)
+			slog(LG_INFO, "*** fast: too many problems; only counting the rest");
+
+		return;
+	}
+
+	char where[BUFSIZE] = "";
+
+	// Duplicates found while merging chunks have no row text to hand
+	if (name && namelen)
+		(void) snprintf(where, sizeof where, " %s '%.*s':", rowname, (int) namelen, name);
+	else if (rowname)
+		(void) snprintf(where, sizeof where, " %s:", rowname);
+
+	if (first)
+		slog(LG_INFO, "*** fast: line %u:%s %s (first seen on line %u)", line, where, what, first);
+	else
+		slog(LG_INFO, "*** fast: line %u:%s %s", line, where, what);
+}
+
+static unsigned int
+fv_dbv(const char *const restrict map, const size_t len)
+{
+	size_t pos = 0;
+
+	for (unsigned int i = 0; i < FV_PREAMBLE_LINES && pos < len; i++)
+	{
+		const char *const row = map + pos;
+		const char *const nl = memchr(row, '\n', len - pos);
+		const size_t rowlen = nl ? (size_t) (nl - row) : len - pos;
+		char buf[32];
+
+		pos += rowlen + 1;
+
+		if (rowlen < 5 || rowlen >= sizeof buf || strncmp(row, "DBV ", 4) != 0)
+			continue;
+
+		(void) memcpy(buf, row + 4, rowlen - 4);
+		buf[rowlen - 4] = '\0';
+
+		return (unsigned int) strtoul(buf, NULL, 10);
+	}
+
+	return 0;
+}
+
+// Chunks end just after a newline, so that no row straddles two
+static size_t
+fv_boundary(const char *const restrict map, const size_t len, size_t pos)
+{
+	if (pos >= len)
+		return len;
+
+	const char *const nl = memchr(map + pos, '\n', len - pos);
+
+	return nl ? (size_t) (nl - map) + 1 : len;
+}
+
+static void
+fv_finish(struct fv_chunk *const restrict chunks, const unsigned int nchunks, unsigned int *const restrict problems)
+{
+	struct fv_chunk *const g = &chunks[0];
+	unsigned int base = 0;
+
+	for (unsigned int k = 0; k < nchunks; k++)
+	{
+		struct fv_chunk *const c = &chunks[k];
+
+		c->base = base;
+		base += c->lines;
+		*problems += c->problems;
+
+		for (unsigned int i = 0; i < c->nreports; i++)
+		{
+			const struct fv_report *const r = &c->reports[i];
+
+			fv_log(c->base + r->line, fv_row_names[r->row], r->name, strlen(r->name), r->what,
+			       r->first ? c->base + r->first : 0);
+		}
+
+		if (c->problems > c->nreports)
+			slog(LG_INFO, "*** fast: %u more problem(s) found in lines %u to %u", c->problems - c->nreports,
+			     c->base + 1, c->base + c->lines);
+	}
+
+	// Chunks merge in file order, so the definition that is kept is the one that loading would keep
+	for (unsigned int k = 1; k < nchunks; k++)
+	{
+		struct fv_chunk *const c = &chunks[k];
+
+		for (unsigned int s = 0; s < FV_SET_COUNT; s++)
+		{
+			struct fv_set *const set = &c->sets[s];
+
+			/* Slot order is hash order; copying that into a smaller table would pile
+			 * every key up in one run, so make room for all of them first.
+			 */
+			while (set->count && (! g->sets[s].keys ||
+			       (g->sets[s].count + set->count) * 4 > (g->sets[s].mask + 1) * 3))
+				fv_set_grow(&g->sets[s]);
+
+			for (size_t i = 0; set->keys && i <= set->mask; i++)
+			{
+				if (! set->keys[i])
+					continue;
+
+				const unsigned int line = c->base + set->lines[i];
+				const unsigned int first = fv_set_add(&g->sets[s], set->keys[i], line);
+
+				if (! first)
+					continue;
+
+				(*problems)++;
+				fv_log(line, NULL, NULL, 0, fv_set_dups[s], first);
+			}
+
+			fv_set_free(set);
+		}
+	}
+
+	for (unsigned int k = 0; k < nchunks; k++)
+	{
+		struct fv_chunk *const c = &chunks[k];
+
+		for (size_t i = 0; i < c->npending; i++)
+		{
+			const struct fv_pending *const p = &c->pending[i];
+
+			if (fv_resolves(g->sets, p->ref, p->key))
+				continue;
+
+			const char *const what = (p->row == FV_ROW_CA) ?
+			    "refers to a nonexistent channel or target; services will refuse to load the database" :
+			    fv_ref_missing[p->ref];
+
+			(*problems)++;
+			fv_log(c->base + p->line, fv_row_names[p->row], c->map + p->off, p->len, what, 0);
+		}
+
+		sfree(c->pending);
+		c->pending = NULL;
+	}
+}
+
+/*
+ * fastverify_run(const char *filename, unsigned int threads)
+ *
+ * Checks the OpenSEX database filename (under the data directory) with up
+ * to threads threads, logging what it finds.
+ *
+ * Outputs:
+ *      - true if nothing was wrong, false otherwise
+ */
+bool
+fastverify_run(const char *const restrict filename, unsigned int threads)
+{
+	char path[BUFSIZE];
+	unsigned int problems = 0;
+	bool mapped = false;
+	size_t len = 0;
+	char *map;
+	FILE *f;
+
+	(void) snprintf(path, sizeof path, "%s/%s", datadir, filename);
+
+	if (! (f = fopen(path, "r")))
+	{
+		slog(LG_ERROR, "*** fast: cannot open '%s' for reading: %s", path, strerror(errno));
+		return false;
+	}
+
+	// A compressed file has to be inflated whole; there is no row boundary to seek to in it
+	if (! (map = db_input_decompress(f, path, &len)))
+	{
+		struct stat sb;
+
+		if (fstat(fileno(f), &sb) != 0 || ! S_ISREG(sb.st_mode) || (uintmax_t) sb.st_size >= SIZE_MAX)
+		{
+			slog(LG_ERROR, "*** fast: '%s' is not a regular file", path);
+			(void) fclose(f);
+			return false;
+		}
+
+		len = (size_t) sb.st_size;
+
+#ifdef HAVE_SYS_MMAN_H
+		if (len)
+		{
+			void *const addr = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fileno(f), 0);
+
+			if (addr != MAP_FAILED)
+			{
+#ifdef MADV_SEQUENTIAL
+				(void) madvise(addr, len, MADV_SEQUENTIAL);
+#endif
+				map = addr;
+				mapped = true;
+			}
+		}
+#endif
+
+		if (! mapped)
+		{
+			map = smalloc(len + 1);
+
+			if (len && fread(map, 1, len, f) != len)
+			{
+				slog(LG_ERROR, "*** fast: cannot read '%s': %s", path, strerror(errno));
+				sfree(map);
+				(void) fclose(f);
+				return false;
+			}
+		}
+	}
+
+	(void) fclose(f);
+
+	const unsigned int dbv = fv_dbv(map, len);
+
+	if (threads > FASTVERIFY_THREADS_MAX)
+		threads = FASTVERIFY_THREADS_MAX;
+
+	if (len / FV_MIN_CHUNK < threads)
+		threads = (unsigned int) (len / FV_MIN_CHUNK);
+
+	if (! threads)
+		threads = 1;
+
+	slog(LG_INFO, "*** fast: checking %s (%zu bytes, schema version %u) with %u thread(s)", path, len, dbv, threads);
+
+	struct fv_chunk *const chunks = scalloc(threads, sizeof *chunks);
+
+	for (unsigned int k = 0; k < threads; k++)
+	{
+		chunks[k].map = map;
+		chunks[k].dbv = dbv;
+		chunks[k].start = k ? chunks[k - 1].end : 0;
+		chunks[k].end = (k + 1 == threads) ? len : fv_boundary(map, len, (len / threads) * (k + 1));
+	}
+
+#ifdef HAVE_USABLE_PTHREAD
+	for (unsigned int k = 1; k < threads; k++)
+	{
+		const int ret = pthread_create(&chunks[k].thread, NULL, &fv_scan_thread, &chunks[k]);
+
+		if (ret == 0)
+			chunks[k].threaded = true;
+		else
+			slog(LG_ERROR, "*** fast: pthread_create(3): %s; checking chunk %u here", strerror(ret), k);
+	}
+#endif
+
+	fv_scan(&chunks[0]);
+
+	for (unsigned int k = 1; k < threads; k++)
+	{
+#ifdef HAVE_USABLE_PTHREAD
+		if (chunks[k].threaded)
+		{
+			(void) pthread_join(chunks[k].thread, NULL);
+			continue;
+		}
+#endif
+		fv_scan(&chunks[k]);
+	}
+
+	fv_finish(chunks, threads, &problems);
+
+	unsigned long long rows[FV_ROW_COUNT] = { 0 };
+	unsigned int lines = 0;
+
+	for (unsigned int k = 0; k < threads; k++)
+	{
+		lines += chunks[k].lines;
+
+		for (unsigned int r = 0; r < FV_ROW_COUNT; r++)
+			rows[r] += chunks[k].rows[r];
+	}
+
+	for (unsigned int r = 0; r < FV_ROW_OTHER; r++)
+		if (rows[r])
+			slog(LG_INFO, "*** fast: %llu %s row(s)", rows[r], fv_row_names[r]);
+
+	if (rows[FV_ROW_OTHER])
+		slog(LG_INFO, "*** fast: %llu row(s) of other types (not checked)", rows[FV_ROW_OTHER]);
+
+	slog(LG_INFO, "*** fast: %u line(s): %zu account(s), %zu group(s), %zu nick(s), %zu channel(s), "
+	              "%zu channel access entries", lines, chunks[0].sets[FV_SET_ACCOUNT].count,
+	              chunks[0].sets[FV_SET_GROUP].count, chunks[0].sets[FV_SET_NICK].count,
+	              chunks[0].sets[FV_SET_CHANNEL].count, chunks[0].sets[FV_SET_CHANACS].count);
+
+	slog(LG_INFO, "*** fast: %u problem(s) found", problems);
+
+	for (unsigned int s = 0; s < FV_SET_COUNT; s++)
+		fv_set_free(&chunks[0].sets[s]);
+
+	sfree(chunks);
+
+#ifdef HAVE_SYS_MMAN_H
+	if (mapped)
+		(void) munmap(map, len);
+	else
+#endif
+		sfree(map);
+
+	return problems == 0;
+}
@@ -0,0 +1,21 @@
+/*
+ * SPDX-License-Identifier: ISC
+ * SPDX-URL: https://spdx.org/licenses/ISC.html
+ *
+ * Copyright (C) 2026 Atheme Development Group (https://atheme.github.io/)
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ */
+
+#ifndef ATHEME_SRC_DBVERIFY_FASTVERIFY_H
+#define ATHEME_SRC_DBVERIFY_FASTVERIFY_H 1
+
+#include <atheme/stdheaders.h>      // bool
+
+#define FASTVERIFY_THREADS_MAX          64U
+
+bool fastverify_run(const char *filename, unsigned int threads);
+
+#endif /* !ATHEME_SRC_DBVERIFY_FASTVERIFY_H */
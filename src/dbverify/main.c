@@ -11,6 +11,9 @@
 
 #include <atheme.h>
 #include <atheme/libathemecore.h>
+#include <ext/getopt_long.h>
+
+#include "fastverify.h"
 
 static unsigned int
 verify_entity_uids(void)
@@ -63,14 +66,14 @@ verify_channel_registrations(void)
 			if (key == NULL)
 			{
 				slog(LG_INFO, "*** phase 3: %s: chanacs entry %p is dangling; unlinking from object store", mc->name, ca);
-				mowgli_node_delete(&ca->cnode, &mc->chanacs);
+				chanacs_detach(ca);
 				continue;
 			}
 
 			if ((ca2 = mowgli_patricia_retrieve(known, key)) != NULL)
 			{
 				slog(LG_INFO, "*** phase 3: %s: chanacs entry '%s' (%p) duplicates chanacs entry %p", mc->name, ca->entity != NULL ? ca->entity->name : ca->host, ca, ca2);
-				mowgli_node_delete(&ca->cnode, &mc->chanacs);
+				chanacs_detach(ca);
 				continue;
 			}
 
@@ -90,12 +93,79 @@ handle_mdep(struct database_handle *db, const char *type)
 		exit(EXIT_FAILURE);
 }
 
+static const struct database_module *
+load_backend(const char *name)
+{
+	char modname[BUFSIZE];
+	struct module *m;
+
+	(void) snprintf(modname, sizeof modname, "backend/%s", name);
+
+	if (! (m = module_find_published(modname)) && ! (m = module_load(modname)))
+		return NULL;
+
+	/* The backend is not a dependency of the converted data; don't let it
+	 * end up as an MDEP that would switch the format back on startup.
+	 */
+	m->mflags &= ~MODFLAG_DBHANDLER;
+
+	return db_mod;
+}
+
 int
 main(int argc, char *argv[])
 {
+	const char *informat = "opensex";
+	const char *outformat = NULL;
+	const struct database_module *inmod, *outmod;
+	unsigned int threads = 0;
+	bool fast = false;
+	int c;
+
 	if (! libathemecore_early_init())
 		return EXIT_FAILURE;
 
+	const mowgli_getopt_option_t long_opts[] = {
+		{  "input-format", required_argument, NULL, 'i', 0 },
+		{ "output-format", required_argument, NULL, 'o', 0 },
+		{          "fast",       no_argument, NULL, 'f', 0 },
+		{       "threads", required_argument, NULL, 'j', 0 },
+		{            NULL,                 0, NULL,  0 , 0 },
+	};
+
+	while ((c = mowgli_getopt_long(argc, argv, "fi:j:o:", long_opts, NULL)) != -1)
+	{
+		switch (c)
+		{
+			case 'i':
+				informat = mowgli_optarg;
+				break;
+			case 'o':
+				outformat = mowgli_optarg;
+				break;
+			case 'f':
+				fast = true;
+				break;
+			case 'j':
+				if (! string_to_uint(mowgli_optarg, &threads) || ! threads || threads > FASTVERIFY_THREADS_MAX)
+				{
+					fprintf(stderr, "%s: thread count must be between 1 and %u\n", argv[0], FASTVERIFY_THREADS_MAX);
+					return EXIT_FAILURE;
+				}
+
+				// the normal mode is single-threaded; -j only makes sense for the fast one
+				fast = true;
+				break;
+			default:
+				fprintf(stderr, "usage: %s [-i backend] [-o backend] [database [output]]\n", argv[0]);
+				fprintf(stderr, "       %s -f [-j threads] [database]\n", argv[0]);
+				return EXIT_FAILURE;
+		}
+	}
+
+	if (outformat == NULL)
+		outformat = informat;
+
 	atheme_bootstrap();
 	atheme_init(argv[0], LOGDIR "/dbverify.log");
 	atheme_setup();
@@ -105,19 +175,37 @@ main(int argc, char *argv[])
 	strict_mode = false;
 	offline_mode = true;
 
-	char *filename = argv[1] ? argv[1] : "services.db";
+	char *filename = (mowgli_optind < argc) ? argv[mowgli_optind] : "services.db";
+	char *outfilename = (mowgli_optind + 1 < argc) ? argv[mowgli_optind + 1] : filename;
 	slog(LG_INFO, "dbverify is operating on %s", filename);
 
-	if (! module_load("backend/opensex"))
+	/* Read-only: it reports what a normal run would find or fix without
+	 * building the object model at all, so it needs no backend either.
+	 */
+	if (fast)
+	{
+		if (strcmp(informat, "opensex") != 0)
+		{
+			slog(LG_ERROR, "the fast mode only reads opensex databases");
+			return EXIT_FAILURE;
+		}
+
+		return fastverify_run(filename, threads ? threads : 1) ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
+	if (! (outmod = load_backend(outformat)) || ! (inmod = load_backend(informat)))
 		return EXIT_FAILURE;
 
 	db_unregister_type_handler("MDEP");
 	db_register_type_handler("MDEP", handle_mdep);
 
-	slog(LG_INFO, "*** phase 1: demarshaling objects from opensex datastore");
+	slog(LG_INFO, "*** phase 1: demarshaling objects from %s datastore", informat);
+
+	db_mod = inmod;
 
 	runflags &= ~RF_LIVE;
 	db_load(filename);
+	hook_call_db_loaded();
 	runflags |= RF_LIVE;
 
 	slog(LG_INFO, "*** phase 2: doing basic atheme database consistency check");
@@ -134,9 +222,11 @@ main(int argc, char *argv[])
 	while ((errcnt = verify_entity_uids()) != 0)
 		slog(LG_INFO, "*** phase 4: %u error(s) were found; running another pass", errcnt);
 
-	slog(LG_INFO, "*** phase 5: writing corrected state to object store");
+	slog(LG_INFO, "*** phase 5: writing corrected state to %s object store %s", outformat, outfilename);
+
+	db_mod = outmod;
 
-	db_save(filename, DB_SAVE_BLOCKING);
+	db_save(outfilename, DB_SAVE_BLOCKING);
 
 	return EXIT_SUCCESS;
 }
@@ -0,0 +1,68 @@
+/*
+ * SPDX-License-Identifier: ISC
+ * SPDX-URL: https://spdx.org/licenses/ISC.html
+ *
+ * Copyright (C) 2026 Atheme Development Group (https://atheme.github.io/)
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ */
+
+#ifndef ATHEME_SRC_DRAGON_DRAGON_H
+#define ATHEME_SRC_DRAGON_DRAGON_H 1
+
+#include <atheme/stdheaders.h>      // bool, size_t
+#include <atheme/structures.h>      // struct server
+
+struct dragon_profile
+{
+	const char *    name;
+	unsigned int    users;
+	unsigned int    channels;
+	long double     channel_zipf;       // Exponent of the channel popularity curve; 0 is uniform
+	unsigned int    max_joins;          // Most channels a single user is in
+	long double     membership_zipf;    // Exponent of the channels-per-user curve
+	unsigned int    registered_pct;     // Users that have (and are logged into) an account
+	unsigned int    regchan_pct;        // Channels that are registered
+	unsigned int    akills;
+	unsigned int    akicks;             // Per registered channel
+	unsigned int    access;             // Per registered channel
+};
+
+enum dragon_phase
+{
+	DRAGON_PHASE_DATABASE       = 0,
+	DRAGON_PHASE_USER_ADD,
+	DRAGON_PHASE_LOGIN,
+	DRAGON_PHASE_CHANUSER_ADD,
+	DRAGON_PHASE_PARSE,
+	DRAGON_PHASE_HOOKS,
+	DRAGON_PHASE_EOB,
+	DRAGON_PHASE_MODESTACK,
+	DRAGON_PHASE_BURST,
+	DRAGON_PHASE_SENDQ,
+	DRAGON_PHASE_UPLINK,
+	DRAGON_PHASE_COUNT,
+};
+
+// phase.c
+void dragon_phase_init(void);
+void dragon_phase_begin(enum dragon_phase);
+void dragon_phase_end(unsigned long);
+void dragon_phase_add(enum dragon_phase, long double, unsigned long);
+long double dragon_now(void);
+unsigned long long dragon_allocations(void);
+unsigned long dragon_peak_rss(void);
+void dragon_report(void);
+
+// world.c
+const struct dragon_profile *dragon_profile_find(const char *);
+void dragon_profile_list(FILE *);
+void dragon_world_seed(unsigned long long);
+void dragon_world_database(const struct dragon_profile *);
+void dragon_world_users(const struct dragon_profile *, struct server *);
+void dragon_world_channels(const struct dragon_profile *, struct server *);
+void dragon_world_burst(void);
+
+#endif /* !ATHEME_SRC_DRAGON_DRAGON_H */
@@ -11,10 +11,44 @@
 
 #include <atheme.h>
 #include <atheme/libathemecore.h>
+#include <ext/getopt_long.h>
 
-static struct timeval burstbegin;
+#include "dragon.h"
+
+// Lines parsed between sendq flushes when replaying
+#define DRAGON_REPLAY_BATCH     1000U
+
+enum dragon_mode
+{
+	DRAGON_MODE_LINK        = 0,    // burst our world to a real uplink and time its reply
+	DRAGON_MODE_OFFLINE,            // receive the world from a fake uplink
+	DRAGON_MODE_REPLAY,             // receive captured uplink traffic from a fake uplink
+};
+
+/* What a replay must do for dragon to exit successfully, for catching
+ * regressions in a protocol module's burst handling; 0 is no limit.
+ */
+struct dragon_limits
+{
+	unsigned int    min_rate;           // lines parsed per second
+	long double     max_allocs;         // allocations per line parsed
+	unsigned int    max_rss;            // peak RSS, in KiB
+};
+
+static enum dragon_mode dragon_mode = DRAGON_MODE_LINK;
+static struct dragon_profile dragon_profile;
+static struct dragon_limits dragon_limits;
+static const char *replay_file = NULL;
+
+static unsigned int replay_lines = 0;
+static unsigned long long replay_allocs = 0;
+static long double replay_secs = 0;
+
+static long double burstbegin;
 static bool bursting = false;
 
+static int sink_peer = -1;
+
 void
 bootstrap(void)
 {
@@ -38,44 +72,29 @@ conf_check(void)
 	return true;
 }
 
-void
-build_world(void)
-{
-	int i;
-	char userbuf[BUFSIZE];
-
-	for (i = 100000; i > 0; i--)
-	{
-		snprintf(userbuf, sizeof userbuf, "User%d", i);
-		user_add(userbuf, "user", "localhost", NULL, NULL, ircd->uses_uid ? uid_get() : NULL, "User", me.me, CURRTIME);
-	}
-}
-
-void
+static void
 burst_world(void)
 {
-	mowgli_node_t *n;
-
 	slog(LG_INFO, "handshake complete, starting burst");
 
-	s_time(&burstbegin);
-
-	MOWGLI_ITER_FOREACH(n, me.me->userlist.head)
-		introduce_nick(n->data);
+	dragon_world_burst();
 
 	ping_sts();
+
+	burstbegin = dragon_now();
 	bursting = true;
 }
 
-void
-phase_buildworld(void)
+static void
+phase_buildworld(struct server *s)
 {
 	struct timeval ts, te;
 
-	slog(LG_INFO, "building world, please wait.");
+	slog(LG_INFO, "building world (%s profile), please wait.", dragon_profile.name);
 
 	s_time(&ts);
-	build_world();
+	dragon_world_users(&dragon_profile, s);
+	dragon_world_channels(&dragon_profile, s);
 	e_time(ts, &te);
 
 	slog(LG_INFO, "world created in %d msec", tv2ms(&te));
@@ -84,17 +103,19 @@ phase_buildworld(void)
 static void
 m_pong(struct sourceinfo *si, int parc, char *parv[])
 {
-	struct timeval te;
-
 	if (!bursting)
 	{
 		burst_world();
 		return;
 	}
 
-	e_time(burstbegin, &te);
+	const long double secs = dragon_now() - burstbegin;
+
+	dragon_phase_add(DRAGON_PHASE_UPLINK, secs, 1);
 
-	slog(LG_INFO, "burst took %d msec", tv2ms(&te));
+	slog(LG_INFO, "burst took %d msec", (int) (secs * 1000.0L));
+
+	dragon_report();
 
 	runflags |= RF_SHUTDOWN;
 }
@@ -106,18 +127,492 @@ hijack_pong_handler(void)
 	pcommand_add("PONG", m_pong, 1, MSRC_SERVER);
 }
 
+/* Writes out the sendq and throws it away on the other end of the socket
+ * pair, until it is empty; only the writing is timed.
+ */
+static void
+sink_flush(void)
+{
+	char buf[BUFSIZE * 16];
+	struct connection *const cptr = curr_uplink->conn;
+	long double secs = 0;
+	unsigned long flushes = 0;
+
+	while (cptr != NULL && sendq_nonempty(cptr) && !CF_IS_DEAD(cptr))
+	{
+		const long double begin = dragon_now();
+
+		sendq_flush(cptr);
+
+		secs += dragon_now() - begin;
+		flushes++;
+
+		while (read(sink_peer, buf, sizeof buf) > 0)
+			;
+	}
+
+	if (flushes)
+		dragon_phase_add(DRAGON_PHASE_SENDQ, secs, flushes);
+}
+
+/* Stands in for the uplink connection: we log in as usual, but nothing is
+ * read from it, and everything written to it is discarded.
+ */
+static bool
+sink_connect(void)
+{
+	int fds[2];
+
+	if (uplinks.head == NULL)
+	{
+		slog(LG_ERROR, "sink_connect(): the configuration needs an uplink{} block, even when offline");
+		return false;
+	}
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0)
+	{
+		slog(LG_ERROR, "sink_connect(): socketpair(): %s", strerror(errno));
+		return false;
+	}
+
+	(void) fcntl(fds[1], F_SETFL, fcntl(fds[1], F_GETFL) | O_NONBLOCK);
+
+	curr_uplink = uplinks.head->data;
+
+	if (! (curr_uplink->conn = connection_add("dragon sink", fds[0], 0, NULL, NULL)))
+		return false;
+
+	sink_peer = fds[1];
+
+	irc_handle_connect(curr_uplink->conn);
+	sink_flush();
+
+	return true;
+}
+
+static char *
+replay_line_extract(char *buf)
+{
+	char *line = buf;
+	char *p;
+
+	// A rawdata log line: "[timestamp] -> line"; skip anything we sent
+	if (*line == '[')
+	{
+		if (!(p = strstr(line, "] -> ")))
+			return NULL;
+
+		line = p + 5;
+	}
+
+	line[strcspn(line, "\r\n")] = '\0';
+
+	return (*line != '\0') ? line : NULL;
+}
+
+// A run of lines parsed between sendq flushes
+struct replay_batch
+{
+	unsigned int            lines;
+	long double             begin;
+	unsigned long long      allocs;
+};
+
+static void
+replay_batch_begin(struct replay_batch *const restrict b)
+{
+	b->lines = 0;
+	b->begin = dragon_now();
+	b->allocs = dragon_allocations();
+
+	dragon_phase_begin(DRAGON_PHASE_PARSE);
+}
+
+/* Everything parse() did for a batch of lines, hooks and mode changes
+ * included, but not writing out what it sent.
+ */
+static void
+replay_batch_end(const struct replay_batch *const restrict b)
+{
+	dragon_phase_end(b->lines);
+
+	replay_secs += dragon_now() - b->begin;
+	replay_allocs += dragon_allocations() - b->allocs;
+	replay_lines += b->lines;
+}
+
+static void
+replay_parse(struct replay_batch *const restrict b, char *const restrict line)
+{
+	parse(line);
+
+	if (++b->lines < DRAGON_REPLAY_BATCH)
+		return;
+
+	replay_batch_end(b);
+	sink_flush();
+	replay_batch_begin(b);
+}
+
+/* A capture (see OperServ CAPTURE) has what the uplink sent when, so the
+ * clock is set to each line's time as it is parsed, as it was in production.
+ */
+static void
+replay_capture(struct capture_reader *const restrict reader, struct replay_batch *const restrict b)
+{
+	char buf[BUFSIZE * 2];
+	struct capture_record rec;
+
+	while (me.connected && capture_read(reader, &rec))
+	{
+		if (rec.direction != CAPTURE_IN || ! rec.len)
+			continue;
+
+		const size_t len = (rec.len < sizeof buf) ? rec.len : (sizeof buf - 1);
+
+		(void) memcpy(buf, rec.line, len);
+		buf[len] = '\0';
+
+		CURRTIME = (time_t) (rec.when / 1000000000ULL);
+
+		replay_parse(b, buf);
+	}
+}
+
+static bool
+replay_run(const char *const path)
+{
+	char buf[BUFSIZE * 2];
+	struct replay_batch b;
+	struct capture_reader *const reader = capture_open(path);
+	FILE *fp = NULL;
+
+	if (! reader && ! (fp = fopen(path, "r")))
+	{
+		slog(LG_ERROR, "replay_run(): fopen('%s'): %s", path, strerror(errno));
+		return false;
+	}
+
+	slog(LG_INFO, "replaying uplink traffic from %s (%s)", path, reader ? "capture" : "text");
+
+	replay_batch_begin(&b);
+
+	if (reader)
+		replay_capture(reader, &b);
+	else
+	{
+		while (me.connected && fgets(buf, sizeof buf, fp))
+		{
+			char *const line = replay_line_extract(buf);
+
+			if (line)
+				replay_parse(&b, line);
+		}
+	}
+
+	replay_batch_end(&b);
+
+	if (reader)
+		(void) capture_close(reader);
+	else
+		(void) fclose(fp);
+
+	slog(LG_INFO, "replayed %u lines in %.3Lf msec: %.0Lf lines/sec, %.2Lf allocations/line", replay_lines,
+	     replay_secs * 1000.0L, (replay_secs > 0) ? replay_lines / replay_secs : 0.0L,
+	     replay_lines ? (long double) replay_allocs / replay_lines : 0.0L);
+
+	return true;
+}
+
+// Whether the run stayed within the limits given on the command line
+static bool
+limits_check(void)
+{
+	bool ok = true;
+
+	if (dragon_mode == DRAGON_MODE_REPLAY && replay_lines != 0)
+	{
+		const long double rate = (replay_secs > 0) ? replay_lines / replay_secs : 0.0L;
+		const long double allocs = (long double) replay_allocs / replay_lines;
+
+		if (dragon_limits.min_rate && rate < dragon_limits.min_rate)
+		{
+			slog(LG_ERROR, "regression: %.0Lf lines/sec, below the limit of %u", rate,
+			     dragon_limits.min_rate);
+			ok = false;
+		}
+
+		if (dragon_limits.max_allocs > 0 && allocs > dragon_limits.max_allocs)
+		{
+			slog(LG_ERROR, "regression: %.2Lf allocations/line, above the limit of %.2Lf", allocs,
+			     dragon_limits.max_allocs);
+			ok = false;
+		}
+	}
+
+	if (dragon_limits.max_rss && dragon_peak_rss() > dragon_limits.max_rss)
+	{
+		slog(LG_ERROR, "regression: %lu KiB peak RSS, above the limit of %u KiB", dragon_peak_rss(),
+		     dragon_limits.max_rss);
+		ok = false;
+	}
+
+	return ok;
+}
+
+static bool
+offline_run(void)
+{
+	struct server *s;
+
+	if (! sink_connect())
+		return false;
+
+	if (dragon_mode == DRAGON_MODE_REPLAY)
+	{
+		if (! replay_run(replay_file))
+			return false;
+	}
+	else
+	{
+		s = server_add("uplink.dragon.invalid", 1, me.me, ircd->uses_uid ? "0DG" : NULL, "dragon uplink");
+		me.actual = sstrdup(s->name);
+		me.recvsvr = true;
+		services_init();
+
+		phase_buildworld(s);
+		sink_flush();
+
+		dragon_phase_begin(DRAGON_PHASE_EOB);
+		handle_eob(s);
+		dragon_phase_end(1);
+	}
+
+	dragon_phase_begin(DRAGON_PHASE_MODESTACK);
+	modestack_flush_now();
+	dragon_phase_end(1);
+
+	sink_flush();
+
+	dragon_report();
+	return limits_check();
+}
+
+static void
+print_usage(const char *const prog)
+{
+	(void) fprintf(stderr,
+		"usage: %s [options] [config file]\n"
+		"\n"
+		"  -p, --profile NAME             start from a built-in workload profile (default: flat)\n"
+		"  -u, --users N                  number of users\n"
+		"  -c, --channels N               number of channels\n"
+		"  -z, --channel-zipf S           exponent of the channel popularity curve (0 is uniform)\n"
+		"  -j, --max-joins N              most channels a single user is in\n"
+		"  -m, --membership-zipf S        exponent of the channels-per-user curve\n"
+		"  -r, --registered PCT           percentage of users that are logged in\n"
+		"  -C, --registered-channels PCT  percentage of channels that are registered\n"
+		"  -a, --akills N                 number of akills\n"
+		"  -k, --akicks N                 akicks per registered channel\n"
+		"  -A, --access N                 access entries per registered channel\n"
+		"  -s, --seed N                   seed for the world generator\n"
+		"  -o, --offline                  receive the world from a fake uplink instead of linking\n"
+		"  -R, --replay FILE              replay captured uplink traffic (an OperServ CAPTURE file, raw lines,\n"
+		"                                 or a rawdata log); implies -o\n"
+		"  -L, --min-rate N               fail if a replay parses fewer than N lines/sec\n"
+		"  -M, --max-allocs N             fail if a replay makes more than N allocations/line\n"
+		"  -S, --max-rss N                fail if peak RSS goes over N KiB\n"
+		"\n"
+		"profiles:\n", prog);
+
+	dragon_profile_list(stderr);
+}
+
+static bool
+parse_uint_arg(const int c, unsigned int *const out, const unsigned int max)
+{
+	if (! string_to_uint(mowgli_optarg, out) || *out > max)
+	{
+		(void) fprintf(stderr, "'%s' is not a valid value for option '%c' (0 to %u)\n", mowgli_optarg, c, max);
+		return false;
+	}
+
+	return true;
+}
+
+static bool
+parse_double_arg(const int c, long double *const out)
+{
+	char *end = NULL;
+
+	errno = 0;
+	*out = strtold(mowgli_optarg, &end);
+
+	if (errno != 0 || end == mowgli_optarg || *end != '\0' || *out < 0 || *out > 10)
+	{
+		(void) fprintf(stderr, "'%s' is not a valid value for option '%c' (0 to 10)\n", mowgli_optarg, c);
+		return false;
+	}
+
+	return true;
+}
+
+static bool
+parse_limit_arg(const int c, long double *const out)
+{
+	char *end = NULL;
+
+	errno = 0;
+	*out = strtold(mowgli_optarg, &end);
+
+	if (errno != 0 || end == mowgli_optarg || *end != '\0' || *out < 0)
+	{
+		(void) fprintf(stderr, "'%s' is not a valid value for option '%c'\n", mowgli_optarg, c);
+		return false;
+	}
+
+	return true;
+}
+
+static bool
+parse_options(int argc, char *argv[])
+{
+	const struct dragon_profile *p;
+	unsigned long long seed;
+	char *end;
+	int c;
+
+	const mowgli_getopt_option_t long_opts[] = {
+		{                "help",       no_argument, NULL, 'h', 0 },
+		{             "profile", required_argument, NULL, 'p', 0 },
+		{               "users", required_argument, NULL, 'u', 0 },
+		{            "channels", required_argument, NULL, 'c', 0 },
+		{        "channel-zipf", required_argument, NULL, 'z', 0 },
+		{           "max-joins", required_argument, NULL, 'j', 0 },
+		{     "membership-zipf", required_argument, NULL, 'm', 0 },
+		{          "registered", required_argument, NULL, 'r', 0 },
+		{ "registered-channels", required_argument, NULL, 'C', 0 },
+		{              "akills", required_argument, NULL, 'a', 0 },
+		{              "akicks", required_argument, NULL, 'k', 0 },
+		{              "access", required_argument, NULL, 'A', 0 },
+		{                "seed", required_argument, NULL, 's', 0 },
+		{             "offline",       no_argument, NULL, 'o', 0 },
+		{              "replay", required_argument, NULL, 'R', 0 },
+		{            "min-rate", required_argument, NULL, 'L', 0 },
+		{          "max-allocs", required_argument, NULL, 'M', 0 },
+		{             "max-rss", required_argument, NULL, 'S', 0 },
+		{                  NULL,                 0, NULL,  0 , 0 },
+	};
+
+	dragon_profile = *dragon_profile_find("flat");
+
+	while ((c = mowgli_getopt_long(argc, argv, "hp:u:c:z:j:m:r:C:a:k:A:s:oR:L:M:S:", long_opts, NULL)) != -1)
+	{
+		switch (c)
+		{
+			case 'p':
+				if (! (p = dragon_profile_find(mowgli_optarg)))
+				{
+					(void) fprintf(stderr, "unknown profile '%s'\n", mowgli_optarg);
+					return false;
+				}
+				dragon_profile = *p;
+				break;
+			case 'u':
+				if (! parse_uint_arg(c, &dragon_profile.users, 10000000U))
+					return false;
+				break;
+			case 'c':
+				if (! parse_uint_arg(c, &dragon_profile.channels, 10000000U))
+					return false;
+				break;
+			case 'z':
+				if (! parse_double_arg(c, &dragon_profile.channel_zipf))
+					return false;
+				break;
+			case 'j':
+				if (! parse_uint_arg(c, &dragon_profile.max_joins, 1000U))
+					return false;
+				break;
+			case 'm':
+				if (! parse_double_arg(c, &dragon_profile.membership_zipf))
+					return false;
+				break;
+			case 'r':
+				if (! parse_uint_arg(c, &dragon_profile.registered_pct, 100U))
+					return false;
+				break;
+			case 'C':
+				if (! parse_uint_arg(c, &dragon_profile.regchan_pct, 100U))
+					return false;
+				break;
+			case 'a':
+				if (! parse_uint_arg(c, &dragon_profile.akills, 10000000U))
+					return false;
+				break;
+			case 'k':
+				if (! parse_uint_arg(c, &dragon_profile.akicks, 100000U))
+					return false;
+				break;
+			case 'A':
+				if (! parse_uint_arg(c, &dragon_profile.access, 100000U))
+					return false;
+				break;
+			case 's':
+				errno = 0;
+				end = NULL;
+				seed = strtoull(mowgli_optarg, &end, 0);
+				if (errno != 0 || end == mowgli_optarg || *end != '\0')
+				{
+					(void) fprintf(stderr, "'%s' is not a valid seed\n", mowgli_optarg);
+					return false;
+				}
+				dragon_world_seed(seed);
+				break;
+			case 'o':
+				if (dragon_mode == DRAGON_MODE_LINK)
+					dragon_mode = DRAGON_MODE_OFFLINE;
+				break;
+			case 'R':
+				replay_file = mowgli_optarg;
+				dragon_mode = DRAGON_MODE_REPLAY;
+				break;
+			case 'L':
+				if (! parse_uint_arg(c, &dragon_limits.min_rate, UINT_MAX))
+					return false;
+				break;
+			case 'M':
+				if (! parse_limit_arg(c, &dragon_limits.max_allocs))
+					return false;
+				break;
+			case 'S':
+				if (! parse_uint_arg(c, &dragon_limits.max_rss, UINT_MAX))
+					return false;
+				break;
+			default:
+				print_usage(argv[0]);
+				return false;
+		}
+	}
+
+	return true;
+}
+
 int
 main(int argc, char *argv[])
 {
 	if (! libathemecore_early_init())
 		return EXIT_FAILURE;
 
+	if (! parse_options(argc, argv))
+		return EXIT_FAILURE;
+
 	atheme_bootstrap();
 	atheme_init(argv[0], LOGDIR "/dbverify.log");
 	atheme_setup();
 	struct module *m;
 	unsigned int errcnt;
-	char *config_file = argv[1] != NULL ? argv[1] : "./dragon.conf";
+	char *config_file = (mowgli_optind < argc) ? argv[mowgli_optind] : "./dragon.conf";
 
 	runflags = RF_LIVE;
 	datadir = DATADIR;
@@ -132,17 +627,25 @@ main(int argc, char *argv[])
 
 	slog(LG_INFO, "link implementation: %s @%p", ircd->ircdname, ircd);
 
-	hijack_pong_handler();
+	dragon_phase_init();
 
 	mowgli_eventloop_synchronize(base_eventloop);
 	CURRTIME = mowgli_eventloop_get_time(base_eventloop);
 
-	phase_buildworld();
+	if (dragon_mode != DRAGON_MODE_REPLAY)
+		dragon_world_database(&dragon_profile);
+
+	if (dragon_mode != DRAGON_MODE_LINK)
+		return offline_run() ? EXIT_SUCCESS : EXIT_FAILURE;
+
+	hijack_pong_handler();
+
+	phase_buildworld(me.me);
 	uplink_connect();
 
 	slog(LG_INFO, "uplink: %s @%p", curr_uplink->name, curr_uplink);
 
 	io_loop();
 
-	return EXIT_SUCCESS;
+	return limits_check() ? EXIT_SUCCESS : EXIT_FAILURE;
 }
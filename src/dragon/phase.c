@@ -0,0 +1,225 @@
+/*
+ * SPDX-License-Identifier: ISC
+ * SPDX-URL: https://spdx.org/licenses/ISC.html
+ *
+ * Copyright (C) 2026 Atheme Development Group (https://atheme.github.io/)
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * Per-phase timing for dragon.
+ *
+ * Time spent in hook handlers and in sending out mode changes is measured on
+ * its own (by wrapping the busiest hooks with a probe before the first and
+ * after the last handler, and by wrapping mode_sts), and subtracted from
+ * whatever phase it happened in, so that for example "user_add" is the cost
+ * of user_add() itself and "hooks" is what the loaded modules added to it.
+ */
+
+#include <atheme.h>
+#include <atheme/libathemecore.h>
+
+#include "dragon.h"
+
+static const char *const dragon_phase_names[DRAGON_PHASE_COUNT] = {
+	[DRAGON_PHASE_DATABASE]     = "database",
+	[DRAGON_PHASE_USER_ADD]     = "user_add",
+	[DRAGON_PHASE_LOGIN]        = "login",
+	[DRAGON_PHASE_CHANUSER_ADD] = "chanuser_add",
+	[DRAGON_PHASE_PARSE]        = "parse",
+	[DRAGON_PHASE_HOOKS]        = "hooks",
+	[DRAGON_PHASE_EOB]          = "eob",
+	[DRAGON_PHASE_MODESTACK]    = "modestack",
+	[DRAGON_PHASE_BURST]        = "burst",
+	[DRAGON_PHASE_SENDQ]        = "sendq",
+	[DRAGON_PHASE_UPLINK]       = "uplink",
+};
+
+// Hooks that run for every user or membership in a burst
+static const char *const dragon_probed_hooks[] = {
+	"user_add", "nick_check", "user_identify", "channel_add", "channel_join", "chanuser_sync", "server_eob",
+};
+
+static long double dragon_phase_secs[DRAGON_PHASE_COUNT];
+static unsigned long dragon_phase_ops[DRAGON_PHASE_COUNT];
+
+static int dragon_phase_current = -1;
+static long double dragon_phase_started;
+static long double dragon_phase_excluded;   // hooks + modestack at dragon_phase_begin()
+
+static unsigned int dragon_hook_depth = 0;
+static long double dragon_hook_started;
+
+static void (*dragon_orig_mode_sts)(char *sender, struct channel *target, char *modes) = NULL;
+
+long double
+dragon_now(void)
+{
+	struct timespec ts;
+
+	(void) memset(&ts, 0x00, sizeof ts);
+	(void) clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ((long double) ts.tv_sec) + (((long double) ts.tv_nsec) / 1000000000.0L);
+}
+
+void
+dragon_phase_add(const enum dragon_phase phase, const long double secs, const unsigned long ops)
+{
+	dragon_phase_secs[phase] += secs;
+	dragon_phase_ops[phase] += ops;
+}
+
+static void
+dragon_hook_begin(void ATHEME_VATTR_UNUSED *data)
+{
+	if (dragon_hook_depth++ == 0)
+		dragon_hook_started = dragon_now();
+}
+
+static void
+dragon_hook_end(void ATHEME_VATTR_UNUSED *data)
+{
+	if (dragon_hook_depth && --dragon_hook_depth == 0)
+		dragon_phase_add(DRAGON_PHASE_HOOKS, dragon_now() - dragon_hook_started, 1);
+}
+
+// A handler that calls hook_stop() skips our end probe; close the sample here
+static void
+dragon_hook_settle(void)
+{
+	if (! dragon_hook_depth)
+		return;
+
+	dragon_phase_add(DRAGON_PHASE_HOOKS, dragon_now() - dragon_hook_started, 1);
+	dragon_hook_depth = 0;
+}
+
+static void
+dragon_mode_sts(char *sender, struct channel *target, char *modes)
+{
+	if (dragon_phase_current == DRAGON_PHASE_MODESTACK)
+	{
+		dragon_orig_mode_sts(sender, target, modes);
+		return;
+	}
+
+	const long double begin = dragon_now();
+
+	dragon_orig_mode_sts(sender, target, modes);
+
+	const long double secs = dragon_now() - begin;
+
+	dragon_phase_add(DRAGON_PHASE_MODESTACK, secs, 1);
+
+	// Keep "hooks" exclusive of the modes its handlers sent
+	if (dragon_hook_depth)
+		dragon_hook_started += secs;
+}
+
+void
+dragon_phase_init(void)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(dragon_probed_hooks); i++)
+	{
+		struct hook *const h = hook_get(dragon_probed_hooks[i]);
+
+		// Don't make an unused hook look busy
+		if (! h->count)
+			continue;
+
+		hook_handle_add_first(h, &dragon_hook_begin);
+		hook_handle_add(h, &dragon_hook_end);
+	}
+
+	dragon_orig_mode_sts = mode_sts;
+	mode_sts = &dragon_mode_sts;
+}
+
+void
+dragon_phase_begin(const enum dragon_phase phase)
+{
+	dragon_phase_current = (int) phase;
+	dragon_phase_excluded = dragon_phase_secs[DRAGON_PHASE_HOOKS] + dragon_phase_secs[DRAGON_PHASE_MODESTACK];
+	dragon_phase_started = dragon_now();
+}
+
+void
+dragon_phase_end(const unsigned long ops)
+{
+	return_if_fail(dragon_phase_current >= 0);
+
+	dragon_hook_settle();
+
+	const enum dragon_phase phase = (enum dragon_phase) dragon_phase_current;
+	long double secs = dragon_now() - dragon_phase_started;
+
+	if (phase != DRAGON_PHASE_MODESTACK)
+		secs -= (dragon_phase_secs[DRAGON_PHASE_HOOKS] + dragon_phase_secs[DRAGON_PHASE_MODESTACK]) -
+		        dragon_phase_excluded;
+
+	dragon_phase_add(phase, (secs > 0) ? secs : 0, ops);
+
+	dragon_phase_current = -1;
+}
+
+static void
+dragon_heap_allocs(const struct named_heap *const restrict nh, void *const restrict privdata)
+{
+	unsigned long long *const total = privdata;
+
+	*total += nh->allocs;
+}
+
+// Allocations so far, both from named heaps and from smalloc() and friends
+unsigned long long
+dragon_allocations(void)
+{
+	unsigned long long total = memory_allocations;
+
+	(void) named_heap_foreach(&dragon_heap_allocs, &total);
+
+	return total;
+}
+
+// The most memory this process has had resident, in KiB
+unsigned long
+dragon_peak_rss(void)
+{
+	struct rusage ru;
+
+	(void) memset(&ru, 0x00, sizeof ru);
+	(void) getrusage(RUSAGE_SELF, &ru);
+
+	return (unsigned long) ru.ru_maxrss;
+}
+
+void
+dragon_report(void)
+{
+	long double total = 0;
+
+	for (size_t i = 0; i < DRAGON_PHASE_COUNT; i++)
+		total += dragon_phase_secs[i];
+
+	slog(LG_INFO, "%-14s %12s %12s %8s", "phase", "msec", "count", "share");
+
+	for (size_t i = 0; i < DRAGON_PHASE_COUNT; i++)
+	{
+		if (! dragon_phase_ops[i])
+			continue;
+
+		slog(LG_INFO, "%-14s %12.3Lf %12lu %7.1Lf%%", dragon_phase_names[i],
+		     dragon_phase_secs[i] * 1000.0L, dragon_phase_ops[i],
+		     (total > 0) ? (dragon_phase_secs[i] * 100.0L) / total : 0.0L);
+	}
+
+	slog(LG_INFO, "%-14s %12.3Lf", "total", total * 1000.0L);
+	slog(LG_INFO, "world: %u users, %u channels, %u chanusers, %u accounts, %u registered channels, "
+	              "%u chanacs, %u klines", cnt.user, cnt.chan, cnt.chanuser, cnt.myuser, cnt.mychan,
+	              cnt.chanacs, cnt.kline);
+	slog(LG_INFO, "sendq: %u bytes queued, %u bytes in %u writes", cnt.bout, cnt.bout_written,
+	     cnt.bout_writes);
+	slog(LG_INFO, "memory: %llu allocations, %lu KiB peak RSS", dragon_allocations(), dragon_peak_rss());
+}
@@ -0,0 +1,455 @@
+/*
+ * SPDX-License-Identifier: ISC
+ * SPDX-URL: https://spdx.org/licenses/ISC.html
+ *
+ * Copyright (C) 2026 Atheme Development Group (https://atheme.github.io/)
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * Builds a synthetic network from a workload profile.
+ *
+ * Channel popularity follows a Zipf curve (the first channel is the biggest),
+ * and so does the number of channels each user is in; memberships are added
+ * grouped by channel, the way an SJOIN burst delivers them. Everything is
+ * drawn from a seeded generator, so the same profile and seed always give
+ * the same world.
+ */
+
+#include <atheme.h>
+#include <atheme/libathemecore.h>
+
+#include <math.h>
+
+#include "dragon.h"
+
+#define DRAGON_HOST_DOMAIN      "dragon.invalid"
+
+struct dragon_zipf
+{
+	long double *   cdf;
+	unsigned int    n;
+};
+
+struct dragon_member
+{
+	unsigned int    chan;
+	unsigned int    user;
+};
+
+static const struct dragon_profile dragon_profiles[] = {
+
+	// The world dragon always used to build: lots of users and nothing else
+	{   "flat", 100000,     0, 0.0L,  0, 0.0L,  0,  0,    0,  0,  0 },
+
+	{  "small",   2000,   300, 1.0L,  8, 1.2L, 40, 20,   50,  5, 10 },
+	{ "medium",  20000,  4000, 1.0L, 12, 1.2L, 40, 20,  500, 10, 20 },
+	{  "large", 100000, 25000, 1.1L, 20, 1.3L, 35, 15, 2000, 20, 30 },
+};
+
+static unsigned long long dragon_rng_state = 0x9E3779B97F4A7C15ULL;
+
+static struct user **world_users = NULL;
+static unsigned int world_nusers = 0;
+static bool *world_registered = NULL;
+static struct myuser **world_accounts = NULL;
+static unsigned int world_naccounts = 0;
+static struct channel **world_channels = NULL;
+static unsigned int world_nchannels = 0;
+
+const struct dragon_profile *
+dragon_profile_find(const char *const name)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(dragon_profiles); i++)
+		if (strcasecmp(dragon_profiles[i].name, name) == 0)
+			return &dragon_profiles[i];
+
+	return NULL;
+}
+
+void
+dragon_profile_list(FILE *const fp)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(dragon_profiles); i++)
+	{
+		const struct dragon_profile *const p = &dragon_profiles[i];
+
+		(void) fprintf(fp, "  %-8s %6u users, %5u channels, up to %2u joins each, %2u%% registered, "
+		                   "%4u akills\n", p->name, p->users, p->channels, p->max_joins, p->registered_pct,
+		                   p->akills);
+	}
+}
+
+void
+dragon_world_seed(const unsigned long long seed)
+{
+	dragon_rng_state = seed ? seed : 0x9E3779B97F4A7C15ULL;
+}
+
+// xorshift64*
+static inline unsigned long long
+dragon_rand(void)
+{
+	dragon_rng_state ^= dragon_rng_state >> 12;
+	dragon_rng_state ^= dragon_rng_state << 25;
+	dragon_rng_state ^= dragon_rng_state >> 27;
+
+	return dragon_rng_state * 2685821657736338717ULL;
+}
+
+static inline bool
+dragon_rand_pct(const unsigned int pct)
+{
+	return (dragon_rand() % 100U) < pct;
+}
+
+static void
+dragon_zipf_init(struct dragon_zipf *const z, const unsigned int n, const long double s)
+{
+	long double sum = 0;
+
+	z->cdf = smalloc(n * sizeof *z->cdf);
+	z->n = n;
+
+	for (unsigned int k = 0; k < n; k++)
+	{
+		sum += 1.0L / powl((long double) (k + 1), s);
+		z->cdf[k] = sum;
+	}
+}
+
+// Returns a rank in [0, n)
+static unsigned int
+dragon_zipf_sample(const struct dragon_zipf *const z)
+{
+	const long double u = ((long double) (dragon_rand() >> 11) / 9007199254740992.0L) * z->cdf[z->n - 1];
+	unsigned int lo = 0;
+	unsigned int hi = z->n - 1;
+
+	while (lo < hi)
+	{
+		const unsigned int mid = lo + ((hi - lo) / 2);
+
+		if (z->cdf[mid] < u)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+static void
+dragon_zipf_free(struct dragon_zipf *const z)
+{
+	sfree(z->cdf);
+	z->cdf = NULL;
+}
+
+// TS6-style UIDs: the SID, then a letter and five letters or digits
+static void
+dragon_uid(char *const buf, const size_t len, const char *const sid, unsigned int i)
+{
+	static const char alnum[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
+	char id[7];
+
+	for (int pos = 5; pos > 0; pos--)
+	{
+		id[pos] = alnum[i % 36U];
+		i /= 36U;
+	}
+
+	id[0] = alnum[i % 26U];
+	id[6] = '\0';
+
+	(void) snprintf(buf, len, "%s%s", sid, id);
+}
+
+/*
+ * The accounts, registered channels and akills that would have been loaded
+ * from the database before the burst.
+ */
+void
+dragon_world_database(const struct dragon_profile *const p)
+{
+	char name[BUFSIZE];
+	unsigned int naccess = 0, nakicks = 0;
+
+	dragon_phase_begin(DRAGON_PHASE_DATABASE);
+
+	world_registered = scalloc(p->users ? p->users : 1, sizeof *world_registered);
+	world_accounts = smalloc((p->users ? p->users : 1) * sizeof *world_accounts);
+
+	for (unsigned int i = 0; i < p->users; i++)
+	{
+		if (! dragon_rand_pct(p->registered_pct))
+			continue;
+
+		(void) snprintf(name, sizeof name, "User%u", i);
+
+		struct myuser *const mu = myuser_add(name, "*", "dragon@" DRAGON_HOST_DOMAIN, MU_CRYPTPASS);
+
+		(void) mynick_add(mu, name);
+
+		world_registered[i] = true;
+		world_accounts[world_naccounts++] = mu;
+	}
+
+	for (unsigned int i = 0; world_naccounts && i < p->channels; i++)
+	{
+		if (! dragon_rand_pct(p->regchan_pct))
+			continue;
+
+		(void) snprintf(name, sizeof name, "#chan%u", i);
+
+		struct mychan *const mc = mychan_add(name);
+		struct myuser *const founder = world_accounts[dragon_rand() % world_naccounts];
+
+		(void) chanacs_add(mc, entity(founder), CA_FOUNDER_0, CURRTIME, NULL);
+
+		for (unsigned int j = 0; j < p->access; j++)
+		{
+			struct myentity *const mt = entity(world_accounts[dragon_rand() % world_naccounts]);
+
+			if (chanacs_find(mc, mt, 0) != NULL)
+				continue;
+
+			(void) chanacs_add(mc, mt, CA_AOP_DEF, CURRTIME, NULL);
+			naccess++;
+		}
+
+		for (unsigned int j = 0; j < p->akicks; j++)
+		{
+			(void) snprintf(name, sizeof name, "*!*@akick%u." DRAGON_HOST_DOMAIN, nakicks++);
+			(void) chanacs_add_host(mc, name, CA_AKICK, CURRTIME, NULL);
+		}
+	}
+
+	// None of these match anyone; every connecting user is checked against them all
+	for (unsigned int i = 0; i < p->akills; i++)
+	{
+		(void) snprintf(name, sizeof name, "akill%u." DRAGON_HOST_DOMAIN, i);
+		(void) kline_add("*", name, "dragon", 0, "dragon");
+	}
+
+	dragon_phase_end(world_naccounts + naccess + nakicks + p->akills);
+
+	slog(LG_INFO, "database: %u accounts, %u registered channels, %u access entries, %u akicks, %u akills",
+	     world_naccounts, cnt.mychan, naccess, nakicks, p->akills);
+}
+
+// Enforcement may kill some of our users; forget them so that they aren't joined anywhere
+static void
+dragon_world_user_delete(struct user *const u)
+{
+	for (unsigned int i = 0; i < world_nusers; i++)
+	{
+		if (world_users[i] != u)
+			continue;
+
+		world_users[i] = NULL;
+		break;
+	}
+}
+
+/*
+ * Introduces the profile's users on s. For a remote server, registered users
+ * are then logged in the way a burst would (EUID's account field, or similar).
+ */
+void
+dragon_world_users(const struct dragon_profile *const p, struct server *const s)
+{
+	char nick[NICKLEN + 1];
+	char host[HOSTLEN + 1];
+	char ip[HOSTIPLEN + 1];
+	char uid[IDLEN + 1];
+	unsigned int nusers = 0, nlogins = 0;
+
+	world_users = scalloc(p->users ? p->users : 1, sizeof *world_users);
+	world_nusers = p->users;
+
+	hook_add_user_delete(dragon_world_user_delete);
+
+	dragon_phase_begin(DRAGON_PHASE_USER_ADD);
+
+	for (unsigned int i = 0; i < p->users; i++)
+	{
+		const char *id = NULL;
+
+		(void) snprintf(nick, sizeof nick, "User%u", i);
+		(void) snprintf(host, sizeof host, "h%u." DRAGON_HOST_DOMAIN, i / 2U);
+		(void) snprintf(ip, sizeof ip, "10.%u.%u.%u", (i >> 16) & 0xFFU, (i >> 8) & 0xFFU, i & 0xFFU);
+
+		if (s == me.me)
+			id = ircd->uses_uid ? uid_get() : NULL;
+		else if (ircd->uses_uid && s->sid != NULL)
+		{
+			(void) dragon_uid(uid, sizeof uid, s->sid, i);
+			id = uid;
+		}
+
+		if ((world_users[i] = user_add(nick, "dragon", host, NULL, ip, id, "dragon user", s, CURRTIME)))
+			nusers++;
+	}
+
+	dragon_phase_end(nusers);
+
+	if (s == me.me)
+		return;
+
+	dragon_phase_begin(DRAGON_PHASE_LOGIN);
+
+	for (unsigned int i = 0; i < p->users; i++)
+	{
+		if (! world_registered[i] || world_users[i] == NULL)
+			continue;
+
+		handle_burstlogin(world_users[i], world_users[i]->nick, 0);
+		nlogins++;
+	}
+
+	dragon_phase_end(nlogins);
+}
+
+static int
+dragon_member_cmp(const void *const a, const void *const b)
+{
+	const struct dragon_member *const ma = a;
+	const struct dragon_member *const mb = b;
+
+	if (ma->chan != mb->chan)
+		return (ma->chan < mb->chan) ? -1 : 1;
+
+	return (ma->user < mb->user) ? -1 : (ma->user > mb->user);
+}
+
+void
+dragon_world_channels(const struct dragon_profile *const p, struct server *const s)
+{
+	struct dragon_zipf chanz, joinz;
+	struct dragon_member *members;
+	size_t nmembers = 0, alloc;
+	char name[BUFSIZE];
+	char who[BUFSIZE];
+	unsigned int nchanusers = 0;
+
+	if (! p->channels || ! p->max_joins || ! p->users)
+		return;
+
+	dragon_zipf_init(&chanz, p->channels, p->channel_zipf);
+	dragon_zipf_init(&joinz, p->max_joins, p->membership_zipf);
+
+	alloc = p->users * 2U;
+	members = smalloc(alloc * sizeof *members);
+
+	for (unsigned int i = 0; i < p->users; i++)
+	{
+		const unsigned int joins = dragon_zipf_sample(&joinz) + 1;
+		const size_t first = nmembers;
+
+		if (world_users[i] == NULL)
+			continue;
+
+		for (unsigned int j = 0; j < joins; j++)
+		{
+			const unsigned int chan = dragon_zipf_sample(&chanz);
+			bool dup = false;
+
+			for (size_t k = first; ! dup && k < nmembers; k++)
+				dup = (members[k].chan == chan);
+
+			if (dup)
+				continue;
+
+			if (nmembers == alloc)
+			{
+				alloc *= 2U;
+				members = srealloc(members, alloc * sizeof *members);
+			}
+
+			members[nmembers].chan = chan;
+			members[nmembers].user = i;
+			nmembers++;
+		}
+	}
+
+	dragon_zipf_free(&chanz);
+	dragon_zipf_free(&joinz);
+
+	qsort(members, nmembers, sizeof *members, &dragon_member_cmp);
+
+	world_channels = smalloc(p->channels * sizeof *world_channels);
+
+	dragon_phase_begin(DRAGON_PHASE_CHANUSER_ADD);
+
+	for (size_t k = 0; k < nmembers; k++)
+	{
+		const bool first = (k == 0 || members[k - 1].chan != members[k].chan);
+		struct user *const u = world_users[members[k].user];
+		struct channel *c = NULL;
+
+		if (first)
+		{
+			(void) snprintf(name, sizeof name, "#chan%u", members[k].chan);
+
+			c = channel_add(name, CURRTIME, s);
+			world_channels[world_nchannels++] = c;
+		}
+		else
+			c = world_channels[world_nchannels - 1];
+
+		if (u == NULL)
+			continue;
+
+		(void) snprintf(who, sizeof who, "%s%s", first ? "@" : "", (u->uid != NULL) ? u->uid : u->nick);
+
+		if (chanuser_add(c, who))
+			nchanusers++;
+	}
+
+	dragon_phase_end(nchanusers);
+
+	sfree(members);
+
+	slog(LG_INFO, "channels: %u channels, %u memberships (%zu drawn)", world_nchannels, nchanusers, nmembers);
+}
+
+/*
+ * Sends the world (which lives on me.me) to the uplink: the users, then each
+ * channel's members.
+ */
+void
+dragon_world_burst(void)
+{
+	unsigned int nlines = 0;
+
+	dragon_phase_begin(DRAGON_PHASE_BURST);
+
+	for (unsigned int i = 0; i < world_nusers; i++)
+	{
+		if (world_users[i] == NULL)
+			continue;
+
+		introduce_nick(world_users[i]);
+		nlines++;
+	}
+
+	for (unsigned int i = 0; i < world_nchannels; i++)
+	{
+		struct channel *const c = world_channels[i];
+		bool isnew = true;
+		mowgli_node_t *n;
+
+		MOWGLI_ITER_FOREACH(n, c->members.head)
+		{
+			struct chanuser *const cu = n->data;
+
+			join_sts(c, cu->user, isnew, channel_modes(c, true));
+			isnew = false;
+			nlines++;
+		}
+	}
+
+	dragon_phase_end(nlines);
+}
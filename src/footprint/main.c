@@ -9,18 +9,106 @@
 
 #include <atheme.h>
 #include <atheme/libathemecore.h>
+#include <ext/getopt_long.h>
 
-int
-main(int argc, char *argv[])
+/* libmowgli's patricia structures are private; these are their sizes on
+ * LP64: the tree itself, a leaf and a copy of the key for every key, and
+ * about one interior node per key after the first.
+ */
+#define PATRICIA_TREE_SIZE      32U
+#define PATRICIA_NODE_SIZE      152U
+#define PATRICIA_LEAF_SIZE      40U
+#define METADATA_KEY_SIZE       16U     // a typical key, with its NUL
+
+static void
+handle_mdep(struct database_handle *db, const char *type)
 {
-	if (! libathemecore_early_init())
+	const char *modname = db_sread_word(db);
+
+	if (! module_request(modname))
+		exit(EXIT_FAILURE);
+}
+
+static void
+print_heap(const struct named_heap *nh, void *privdata)
+{
+	size_t *totals = privdata;
+	size_t reserved = named_heap_reserved(nh);
+
+	totals[0] += nh->live * nh->size;
+	totals[1] += reserved;
+
+	printf("%-16s %5zu B %8zu live %8zu KB used %8zu KB reserved\n", nh->name, nh->size, nh->live,
+		(nh->live * nh->size) / 1024, reserved / 1024);
+}
+
+/* load a real database and report what its objects actually take up */
+static int
+footprint_measure(const char *filename, const char *backend)
+{
+	char modname[BUFSIZE];
+	size_t totals[2] = { 0, 0 };
+
+	atheme_bootstrap();
+	atheme_init("footprint", LOGDIR "/footprint.log");
+	atheme_setup();
+
+	runflags = RF_LIVE;
+	datadir = DATADIR;
+	strict_mode = false;
+	offline_mode = true;
+
+	snprintf(modname, sizeof modname, "backend/%s", backend);
+
+	if (! module_find_published(modname) && ! module_load(modname))
+	{
+		fprintf(stderr, "footprint: could not load %s\n", modname);
 		return EXIT_FAILURE;
+	}
+
+	db_unregister_type_handler("MDEP");
+	db_register_type_handler("MDEP", handle_mdep);
+
+	runflags &= ~RF_LIVE;
+	db_load(filename);
+	hook_call_db_loaded();
+	runflags |= RF_LIVE;
+
+	printf("footprint for atheme %s (%s), measured from %s\n", PACKAGE_VERSION, SERNO, filename);
+
+	printf("\n* * *\n\n");
 
+	printf("%u registered users\n", cnt.myuser);
+	printf("%u registered nicks\n", cnt.mynick);
+	printf("%u registered channels\n", cnt.mychan);
+	printf("%u channel access entries\n", cnt.chanacs);
+	printf("%u klines / %u xlines / %u qlines\n", cnt.kline, cnt.xline, cnt.qline);
+
+	printf("\n* * *\n\n");
+
+	/* modules that keep their own mowgli heaps are not included */
+	named_heap_foreach(&print_heap, totals);
+
+	printf("\n* * *\n\n");
+
+	printf("total: %zu KB used, at least %zu KB reserved\n", totals[0] / 1024, totals[1] / 1024);
+
+	return EXIT_SUCCESS;
+}
+
+/* make up a network and work out roughly what it would take up */
+static int
+footprint_estimate(void)
+{
 	unsigned int usercount = 0, channelcount = 0, membercount = 0,
 		klinecount = 0, qlinecount = 0, xlinecount = 0, regchannelcount = 0,
-		servercount = 0, regusercount = 0;
+		servercount = 0, regusercount = 0, mdobjcount = 0;
 	unsigned int i;
 
+	const size_t mdinline = sizeof(struct metadata_table) + 4 * sizeof(struct metadata *);
+	const size_t mdtree = sizeof(struct metadata_table) + PATRICIA_TREE_SIZE +
+		4 * (PATRICIA_LEAF_SIZE + METADATA_KEY_SIZE) + 3 * PATRICIA_NODE_SIZE;
+
 	/* make up some statistics */
 	srand(time(NULL));
 
@@ -37,6 +125,9 @@ main(int argc, char *argv[])
 	/* 5% of users are probably misbehaving in some way... */
 	klinecount = xlinecount = qlinecount = (usercount * 0.05);
 
+	/* accounts and channels typically carry a handful of metadata keys */
+	mdobjcount = regusercount + regchannelcount;
+
 	printf("footprint for atheme %s (%s)\n", PACKAGE_VERSION, SERNO);
 
 	printf("\n* * *\n\n");
@@ -52,6 +143,11 @@ main(int argc, char *argv[])
 	printf("\n* * *\n\n");
 
 	printf("sizeof object_t: %zu B\n", sizeof(struct atheme_object));
+	printf("sizeof metadata_t: %zu B --> %zu KB (4 per object)\n", sizeof(struct metadata), (mdobjcount * 4 * sizeof(struct metadata)) / 1024);
+	printf("sizeof metadata_table_t (4 inline keys): %zu B --> %zu KB\n", mdinline, (mdobjcount * mdinline) / 1024);
+	printf("    the same 4 keys in a patricia tree: about %zu B --> %zu KB (%zu KB saved)\n", mdtree,
+		(mdobjcount * mdtree) / 1024, (mdobjcount * (mdtree - mdinline)) / 1024);
+	printf("    (objects switch to a patricia tree past %u metadata keys)\n", METADATA_INLINE_MAX);
 
 	printf("\n* * *\n\n");
 
@@ -63,6 +159,7 @@ main(int argc, char *argv[])
 	printf("\n* * *\n\n");
 
 	printf("sizeof user_t: %zu B --> %zu KB\n", sizeof(struct user), (usercount * sizeof(struct user)) / 1024);
+	printf("sizeof user_cold_t: %zu B --> %zu KB\n", sizeof(struct user_cold), (usercount * sizeof(struct user_cold)) / 1024);
 	printf("sizeof channel_t: %zu B --> %zu KB\n", sizeof(struct channel), (channelcount * sizeof(struct channel)) / 1024);
 	printf("sizeof chanuser_t: %zu B --> %zu KB\n", sizeof(struct chanuser), (membercount * sizeof(struct chanuser)) / 1024);
 
@@ -78,3 +175,41 @@ main(int argc, char *argv[])
 
 	return EXIT_SUCCESS;
 }
+
+int
+main(int argc, char *argv[])
+{
+	const char *backend = "opensex";
+	const char *filename = NULL;
+	int c;
+
+	if (! libathemecore_early_init())
+		return EXIT_FAILURE;
+
+	const mowgli_getopt_option_t long_opts[] = {
+		{ "database", required_argument, NULL, 'd', 0 },
+		{  "backend", required_argument, NULL, 'i', 0 },
+		{       NULL,                 0, NULL,  0 , 0 },
+	};
+
+	while ((c = mowgli_getopt_long(argc, argv, "d:i:", long_opts, NULL)) != -1)
+	{
+		switch (c)
+		{
+			case 'd':
+				filename = mowgli_optarg;
+				break;
+			case 'i':
+				backend = mowgli_optarg;
+				break;
+			default:
+				fprintf(stderr, "usage: %s [-i backend] [-d database]\n", argv[0]);
+				return EXIT_FAILURE;
+		}
+	}
+
+	if (filename != NULL)
+		return footprint_measure(filename, backend);
+
+	return footprint_estimate();
+}
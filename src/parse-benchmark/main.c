@@ -0,0 +1,343 @@
+/*
+ * SPDX-License-Identifier: ISC
+ * SPDX-URL: https://spdx.org/licenses/ISC.html
+ *
+ * Copyright (C) 2026 Atheme Development Group (https://atheme.github.io/)
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * Replays a recorded burst through the line tokenizer and protocol command
+ * lookup only (no handlers are run), comparing the old multi-pass split plus
+ * patricia lookup against irc_tokenize() plus pcommand_find().
+ *
+ * The input is either raw protocol lines, a log written with the rawdata log
+ * level, or a file written by OperServ CAPTURE; only the received lines of
+ * the last two are used. Record one burst per protocol module to compare
+ * them; every command token seen in the file is registered, so the dispatch
+ * table has the same shape as it would with that protocol module loaded.
+ */
+
+#include <atheme.h>
+#include <atheme/libathemecore.h>
+
+#define BENCH_PASSES_DEF        20U
+#define BENCH_PASSES_MAX        100000U
+
+static long double
+bench_now(void)
+{
+	struct timespec ts;
+
+	(void) memset(&ts, 0x00, sizeof ts);
+	(void) clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ((long double) ts.tv_sec) + (((long double) ts.tv_nsec) / 1000000000.0L);
+}
+
+static void
+bench_dummy_handler(struct sourceinfo ATHEME_VATTR_UNUSED *si, int ATHEME_VATTR_UNUSED parc,
+                    char ATHEME_VATTR_UNUSED *parv[])
+{
+	// Nothing To Do
+}
+
+// Splits a line the way irc_parse() used to: prefix, command, then tokenize()
+static int
+bench_legacy_split(char *line, char **origin, char **command, char **parv)
+{
+	char *pos;
+	char *message = NULL;
+
+	*origin = NULL;
+	*command = NULL;
+
+	if ((pos = strchr(line, ' ')))
+	{
+		*pos = '\0';
+		pos++;
+
+		if (*line == ':')
+		{
+			*origin = line + 1;
+
+			if ((message = strchr(pos, ' ')))
+			{
+				*message = '\0';
+				message++;
+			}
+
+			*command = pos;
+		}
+		else
+		{
+			message = pos;
+			*command = line;
+		}
+	}
+	else
+		*command = line;
+
+	if (!message)
+		return 0;
+
+	if (*message == ':')
+	{
+		parv[0] = message + 1;
+		return 1;
+	}
+
+	return tokenize(message, parv);
+}
+
+static char *
+bench_line_extract(char *buf)
+{
+	char *line = buf;
+	char *p;
+
+	// A rawdata log line: "[timestamp] -> line"; skip anything we sent
+	if (*line == '[')
+	{
+		if (!(p = strstr(line, "] -> ")))
+			return NULL;
+
+		line = p + 5;
+	}
+
+	line[strcspn(line, "\r\n")] = '\0';
+
+	return (*line != '\0') ? line : NULL;
+}
+
+static void
+bench_load_line(const char *const line, mowgli_list_t *const lines, size_t *const bytes)
+{
+	(void) mowgli_node_add(sstrdup(line), mowgli_node_create(), lines);
+	*bytes += strlen(line);
+
+	// Register each command we see, like a protocol module would
+	char copy[BUFSIZE];
+	char *parv[MAXPARC + 1];
+	char *origin;
+	char *command;
+
+	(void) mowgli_strlcpy(copy, line, sizeof copy);
+
+	if (irc_tokenize(copy, &origin, &command, parv) >= 0 && ! pcommand_find(command))
+		(void) pcommand_add(command, &bench_dummy_handler, 0, MSRC_UNREG | MSRC_USER | MSRC_SERVER);
+}
+
+// The received lines of an OperServ CAPTURE file
+static void
+bench_load_capture(struct capture_reader *const reader, mowgli_list_t *const lines, size_t *const bytes)
+{
+	char buf[BUFSIZE];
+	struct capture_record rec;
+
+	while (capture_read(reader, &rec))
+	{
+		if (rec.direction != CAPTURE_IN || ! rec.len)
+			continue;
+
+		const size_t len = (rec.len < sizeof buf) ? rec.len : (sizeof buf - 1);
+
+		(void) memcpy(buf, rec.line, len);
+		buf[len] = '\0';
+
+		(void) bench_load_line(buf, lines, bytes);
+	}
+
+	(void) capture_close(reader);
+}
+
+static bool
+bench_load(const char *const path, mowgli_list_t *const lines, size_t *const bytes)
+{
+	char buf[BUFSIZE];
+	struct capture_reader *const reader = capture_open(path);
+
+	*bytes = 0;
+
+	if (reader)
+	{
+		(void) bench_load_capture(reader, lines, bytes);
+		return true;
+	}
+
+	FILE *const fp = fopen(path, "r");
+
+	if (! fp)
+	{
+		(void) fprintf(stderr, "fopen('%s'): %s\n", path, strerror(errno));
+		return false;
+	}
+
+	while (fgets(buf, sizeof buf, fp))
+	{
+		char *const line = bench_line_extract(buf);
+
+		if (line)
+			(void) bench_load_line(line, lines, bytes);
+	}
+
+	(void) fclose(fp);
+	return true;
+}
+
+// Both tokenizers must agree, or the comparison means nothing
+static size_t
+bench_verify(const mowgli_list_t *const lines)
+{
+	mowgli_node_t *n;
+	size_t mismatches = 0;
+
+	MOWGLI_ITER_FOREACH(n, lines->head)
+	{
+		char a[BUFSIZE], b[BUFSIZE];
+		char *aparv[MAXPARC + 1], *bparv[MAXPARC + 1];
+		char *aorigin, *acommand, *borigin, *bcommand;
+
+		(void) mowgli_strlcpy(a, n->data, sizeof a);
+		(void) mowgli_strlcpy(b, n->data, sizeof b);
+
+		const int aparc = bench_legacy_split(a, &aorigin, &acommand, aparv);
+		const int bparc = irc_tokenize(b, &borigin, &bcommand, bparv);
+		bool same = (bparc >= 0) && (aparc == bparc) && ! strcmp(acommand, bcommand) &&
+		            ((aorigin == NULL) == (borigin == NULL)) && (! aorigin || ! strcmp(aorigin, borigin));
+
+		for (int i = 0; same && i < aparc; i++)
+			same = ! strcmp(aparv[i], bparv[i]);
+
+		if (! same)
+		{
+			if (mismatches++ < 5U)
+				(void) fprintf(stderr, "tokenizers disagree on: %s\n", (const char *) n->data);
+		}
+	}
+
+	return mismatches;
+}
+
+static long double
+bench_legacy(const mowgli_list_t *const lines, const unsigned int passes, size_t *const found)
+{
+	const long double begin = bench_now();
+
+	*found = 0;
+
+	for (unsigned int pass = 0; pass < passes; pass++)
+	{
+		mowgli_node_t *n;
+
+		MOWGLI_ITER_FOREACH(n, lines->head)
+		{
+			char buf[BUFSIZE];
+			char *parv[MAXPARC + 1];
+			char *origin;
+			char *command;
+
+			(void) mowgli_strlcpy(buf, n->data, sizeof buf);
+			(void) bench_legacy_split(buf, &origin, &command, parv);
+
+			if (mowgli_patricia_retrieve(pcommands, command))
+				(*found)++;
+		}
+	}
+
+	return bench_now() - begin;
+}
+
+static long double
+bench_single_pass(const mowgli_list_t *const lines, const unsigned int passes, size_t *const found)
+{
+	const long double begin = bench_now();
+
+	*found = 0;
+
+	for (unsigned int pass = 0; pass < passes; pass++)
+	{
+		mowgli_node_t *n;
+
+		MOWGLI_ITER_FOREACH(n, lines->head)
+		{
+			char buf[BUFSIZE];
+			char *parv[MAXPARC + 1];
+			char *origin;
+			char *command;
+
+			(void) mowgli_strlcpy(buf, n->data, sizeof buf);
+
+			if (irc_tokenize(buf, &origin, &command, parv) >= 0 && pcommand_find(command))
+				(*found)++;
+		}
+	}
+
+	return bench_now() - begin;
+}
+
+static void
+bench_print(const char *const name, const long double secs, const size_t nlines, const unsigned int passes,
+            const size_t found)
+{
+	const long double total = (long double) nlines * passes;
+
+	(void) printf("%-24s %10.3Lf s %14.0Lf lines/s %10.1Lf ns/line (%zu dispatched)\n", name, secs,
+	              total / secs, (secs * 1000000000.0L) / total, found);
+}
+
+int
+main(int argc, char *argv[])
+{
+	mowgli_list_t lines = { NULL, NULL, 0 };
+	unsigned int passes = BENCH_PASSES_DEF;
+	size_t bytes;
+	size_t found;
+
+	if (argc < 2 || argc > 3)
+	{
+		(void) fprintf(stderr, "Usage: %s <burst file> [passes]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	if (argc == 3 && (! string_to_uint(argv[2], &passes) || ! passes || passes > BENCH_PASSES_MAX))
+	{
+		(void) fprintf(stderr, "%s: passes must be between 1 and %u\n", argv[0], BENCH_PASSES_MAX);
+		return EXIT_FAILURE;
+	}
+
+	if (! libathemecore_early_init())
+		return EXIT_FAILURE;
+
+	(void) pcommand_init();
+
+	if (! bench_load(argv[1], &lines, &bytes))
+		return EXIT_FAILURE;
+
+	if (! MOWGLI_LIST_LENGTH(&lines))
+	{
+		(void) fprintf(stderr, "%s: no protocol lines found in '%s'\n", argv[0], argv[1]);
+		return EXIT_FAILURE;
+	}
+
+	(void) printf("%zu lines (%zu bytes), %u distinct commands, %u passes\n", MOWGLI_LIST_LENGTH(&lines),
+	              bytes, mowgli_patricia_size(pcommands), passes);
+
+	const size_t mismatches = bench_verify(&lines);
+
+	if (mismatches)
+		(void) printf("WARNING: the tokenizers disagree on %zu lines\n", mismatches);
+
+	const long double legacy = bench_legacy(&lines, passes, &found);
+
+	(void) bench_print("split + tokenize()", legacy, MOWGLI_LIST_LENGTH(&lines), passes, found);
+
+	const long double single = bench_single_pass(&lines, passes, &found);
+
+	(void) bench_print("irc_tokenize()", single, MOWGLI_LIST_LENGTH(&lines), passes, found);
+
+	(void) printf("speedup: %.2Lfx\n", legacy / single);
+
+	return EXIT_SUCCESS;
+}